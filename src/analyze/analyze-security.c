@@ -38,6 +38,9 @@
 #include "unit-name.h"
 #include "unit-serialize.h"
 
+/* Maximum number of property queries that are in flight at the same time */
+#define SECURITY_BUS_BATCH_MAX 64U
+
 typedef struct SecurityInfo {
         char *id;
         char *type;
@@ -2288,7 +2291,7 @@ static int property_read_device_allow(
         return sd_bus_message_exit_container(m);
 }
 
-static int acquire_security_info(sd_bus *bus, const char *name, SecurityInfo *info, AnalyzeSecurityFlags flags) {
+static int acquire_security_info(sd_bus_message *reply, const char *name, SecurityInfo *info, AnalyzeSecurityFlags flags) {
 
         static const struct bus_properties_map security_map[] = {
                 { "AmbientCapabilities",     "t",       NULL,                                    offsetof(SecurityInfo, ambient_capabilities)      },
@@ -2342,28 +2345,21 @@ static int acquire_security_info(sd_bus *bus, const char *name, SecurityInfo *in
         };
 
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        _cleanup_free_ char *path = NULL;
         int r;
 
         /* Note: this mangles *info on failure! */
 
-        assert(bus);
+        assert(reply);
         assert(name);
         assert(info);
 
-        path = unit_dbus_path_from_name(name);
-        if (!path)
-                return log_oom();
+        if (sd_bus_message_is_method_error(reply, NULL)) {
+                r = sd_bus_message_get_errno(reply);
+                return log_error_errno(r, "Failed to get unit properties: %s",
+                                       bus_error_message(sd_bus_message_get_error(reply), r));
+        }
 
-        r = bus_map_all_properties(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        security_map,
-                        BUS_MAP_STRDUP | BUS_MAP_BOOLEAN_AS_BOOL,
-                        &error,
-                        NULL,
-                        info);
+        r = bus_message_map_all_properties(reply, security_map, BUS_MAP_STRDUP | BUS_MAP_BOOLEAN_AS_BOOL, &error, info);
         if (r < 0)
                 return log_error_errno(r, "Failed to get unit properties: %s", bus_error_message(&error, r));
 
@@ -2412,7 +2408,7 @@ static int acquire_security_info(sd_bus *bus, const char *name, SecurityInfo *in
         return 0;
 }
 
-static int analyze_security_one(sd_bus *bus,
+static int analyze_security_one(sd_bus_message *reply,
                                 const char *name,
                                 Table *overview_table,
                                 AnalyzeSecurityFlags flags,
@@ -2427,10 +2423,10 @@ static int analyze_security_one(sd_bus *bus,
 
         int r;
 
-        assert(bus);
+        assert(reply);
         assert(name);
 
-        r = acquire_security_info(bus, name, info, flags);
+        r = acquire_security_info(reply, name, info, flags);
         if (r == -EMEDIUMTYPE) /* Ignore this one because not loaded or Type is oneshot */
                 return 0;
         if (r < 0)
@@ -2443,6 +2439,120 @@ static int analyze_security_one(sd_bus *bus,
         return 0;
 }
 
+typedef struct SecurityReply {
+        sd_bus_slot *slot;
+        sd_bus_message *reply;
+} SecurityReply;
+
+static void security_reply_done(SecurityReply *r) {
+        assert(r);
+
+        r->slot = sd_bus_slot_unref(r->slot);
+        r->reply = sd_bus_message_unref(r->reply);
+}
+
+static int on_security_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        SecurityReply *r = ASSERT_PTR(userdata);
+
+        r->reply = sd_bus_message_ref(m);
+        return 0;
+}
+
+static int analyze_security_batch(sd_bus *bus,
+                                  char **names,
+                                  Table *overview_table,
+                                  AnalyzeSecurityFlags flags,
+                                  unsigned threshold,
+                                  JsonVariant *policy,
+                                  PagerFlags pager_flags,
+                                  JsonFormatFlags json_format_flags) {
+
+        SecurityReply replies[SECURITY_BUS_BATCH_MAX] = {};
+        size_t n = 0;
+        int ret = 0, r;
+
+        assert(bus);
+
+        /* Issue the GetAll() calls for a whole batch of units at once, so that the service manager can
+         * process them back to back, instead of waiting for a full round trip per unit. The replies are
+         * then assessed in the order of the names, so that the output does not depend on timing. */
+
+        STRV_FOREACH(i, names) {
+                _cleanup_free_ char *path = NULL;
+
+                path = unit_dbus_path_from_name(*i);
+                if (!path) {
+                        r = log_oom();
+                        goto finish;
+                }
+
+                r = sd_bus_call_method_async(
+                                bus,
+                                &replies[n].slot,
+                                "org.freedesktop.systemd1",
+                                path,
+                                "org.freedesktop.DBus.Properties",
+                                "GetAll",
+                                on_security_reply,
+                                replies + n,
+                                "s", "");
+                if (r < 0) {
+                        log_error_errno(r, "Failed to query properties of %s: %m", *i);
+                        goto finish;
+                }
+
+                n++;
+                if (n < SECURITY_BUS_BATCH_MAX && i[1])
+                        continue;
+
+                for (size_t j = 0; j < n;) {
+                        if (replies[j].reply) {
+                                j++;
+                                continue;
+                        }
+
+                        r = sd_bus_process(bus, NULL);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to process bus: %m");
+                                goto finish;
+                        }
+                        if (r > 0)
+                                continue;
+
+                        r = sd_bus_wait(bus, UINT64_MAX);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to wait for bus: %m");
+                                goto finish;
+                        }
+                }
+
+                for (size_t j = 0; j < n; j++) {
+                        char **name = i - n + 1 + j;
+
+                        if (!FLAGS_SET(flags, ANALYZE_SECURITY_SHORT) && name != names) {
+                                putc('\n', stdout);
+                                fflush(stdout);
+                        }
+
+                        r = analyze_security_one(replies[j].reply, *name, overview_table, flags, threshold, policy, pager_flags, json_format_flags);
+                        if (r < 0 && ret >= 0)
+                                ret = r;
+
+                        security_reply_done(replies + j);
+                }
+
+                n = 0;
+        }
+
+        return ret;
+
+finish:
+        for (size_t j = 0; j < n; j++)
+                security_reply_done(replies + j);
+
+        return r;
+}
+
 /* Refactoring SecurityInfo so that it can make use of existing struct variables instead of reading from dbus */
 static int get_security_info(Unit *u, ExecContext *c, CGroupContext *g, SecurityInfo **ret_info) {
         assert(ret_info);
@@ -2859,21 +2969,13 @@ static int analyze_security(sd_bus *bus,
 
                 flags |= ANALYZE_SECURITY_SHORT|ANALYZE_SECURITY_ONLY_LOADED|ANALYZE_SECURITY_ONLY_LONG_RUNNING;
 
-                STRV_FOREACH(i, list) {
-                        r = analyze_security_one(bus, *i, overview_table, flags, threshold, policy, pager_flags, json_format_flags);
-                        if (r < 0 && ret >= 0)
-                                ret = r;
-                }
+                ret = analyze_security_batch(bus, list, overview_table, flags, threshold, policy, pager_flags, json_format_flags);
+
+        } else {
+                _cleanup_strv_free_ char **names = NULL;
 
-        } else
                 STRV_FOREACH(i, units) {
                         _cleanup_free_ char *mangled = NULL, *instance = NULL;
-                        const char *name;
-
-                        if (!FLAGS_SET(flags, ANALYZE_SECURITY_SHORT) && i != units) {
-                                putc('\n', stdout);
-                                fflush(stdout);
-                        }
 
                         r = unit_name_mangle(*i, 0, &mangled);
                         if (r < 0)
@@ -2889,15 +2991,16 @@ static int analyze_security(sd_bus *bus,
                                 if (r < 0)
                                         return log_oom();
 
-                                name = instance;
+                                r = strv_consume(&names, TAKE_PTR(instance));
                         } else
-                                name = mangled;
-
-                        r = analyze_security_one(bus, name, overview_table, flags, threshold, policy, pager_flags, json_format_flags);
-                        if (r < 0 && ret >= 0)
-                                ret = r;
+                                r = strv_consume(&names, TAKE_PTR(mangled));
+                        if (r < 0)
+                                return log_oom();
                 }
 
+                ret = analyze_security_batch(bus, names, overview_table, flags, threshold, policy, pager_flags, json_format_flags);
+        }
+
         if (overview_table) {
                 if (!FLAGS_SET(flags, ANALYZE_SECURITY_SHORT)) {
                         putc('\n', stdout);
@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "analyze.h"
+#include "analyze-stats.h"
+#include "def.h"
+#include "format-table.h"
+#include "string-util.h"
+#include "strv.h"
+#include "varlink.h"
+
+/* The daemons implementing io.systemd.Statistics.Get(), see stats-util.h */
+static const char* const stats_socket_table[] = {
+        "systemd",          VARLINK_ADDR_PATH_MANAGER,
+        "systemd-journald", "/run/systemd/journal/io.systemd.journal",
+        "systemd-udevd",    VARLINK_ADDR_PATH_UDEV,
+        "systemd-resolved", "/run/systemd/resolve/io.systemd.Resolve",
+        "systemd-networkd", VARLINK_ADDR_PATH_NETWORK,
+        NULL
+};
+
+static int stats_socket_from_name(const char *name, const char **ret) {
+        assert(name);
+        assert(ret);
+
+        /* Also allow a socket path, e.g. for a journald namespace instance */
+        if (strchr(name, '/')) {
+                *ret = name;
+                return 0;
+        }
+
+        /* Accept the name without the "systemd-" prefix too, e.g. "journald" */
+        STRV_FOREACH_PAIR(n, p, (char**) stats_socket_table)
+                if (streq(name, *n) || streq_ptr(name, startswith(*n, "systemd-"))) {
+                        *ret = *p;
+                        return 0;
+                }
+
+        return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                               "Unknown daemon '%s', expected one of systemd, systemd-journald, systemd-udevd, "
+                               "systemd-resolved, systemd-networkd, or a socket path.", name);
+}
+
+static int table_add_counters(Table *table, JsonVariant *counters) {
+        const char *name;
+        JsonVariant *v;
+        int r;
+
+        JSON_VARIANT_OBJECT_FOREACH(name, v, counters) {
+                r = table_add_many(table,
+                                   TABLE_STRING, name,
+                                   TABLE_UINT64, json_variant_unsigned(v));
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+
+        return 0;
+}
+
+static int table_add_histograms(Table *table, JsonVariant *histograms) {
+        const char *name;
+        JsonVariant *v;
+        int r;
+
+        JSON_VARIANT_OBJECT_FOREACH(name, v, histograms) {
+                uint64_t n = json_variant_unsigned(json_variant_by_key(v, "count"));
+
+                r = table_add_many(table,
+                                   TABLE_STRING, name,
+                                   TABLE_UINT64, n);
+                if (r < 0)
+                        return table_log_add_error(r);
+
+                if (n == 0)
+                        r = table_add_many(table,
+                                           TABLE_EMPTY,
+                                           TABLE_EMPTY);
+                else
+                        r = table_add_many(table,
+                                           TABLE_TIMESPAN, json_variant_unsigned(json_variant_by_key(v, "totalUSec")) / n,
+                                           TABLE_TIMESPAN, json_variant_unsigned(json_variant_by_key(v, "maxUSec")));
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+
+        return 0;
+}
+
+static int table_print_sorted(Table *table) {
+        int r;
+
+        r = table_set_sort(table, (size_t) 0);
+        if (r < 0)
+                return log_error_errno(r, "Failed to set sort column: %m");
+
+        r = table_print(table, NULL);
+        if (r < 0)
+                return table_log_print_error(r);
+
+        return 0;
+}
+
+int verb_stats(int argc, char *argv[], void *userdata) {
+        _cleanup_(varlink_flush_close_unrefp) Varlink *link = NULL;
+        _cleanup_(table_unrefp) Table *counters = NULL, *histograms = NULL;
+        JsonVariant *reply = NULL;
+        const char *error, *path;
+        int r;
+
+        r = stats_socket_from_name(argv[1], &path);
+        if (r < 0)
+                return r;
+
+        r = varlink_connect_address(&link, path);
+        if (r < 0)
+                return log_error_errno(r, "Failed to connect to %s: %m", path);
+
+        (void) varlink_set_description(link, argv[1]);
+
+        r = varlink_call(link, "io.systemd.Statistics.Get", NULL, &reply, &error, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to issue io.systemd.Statistics.Get() varlink call: %m");
+        if (error)
+                return log_error_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                       "Failed to issue io.systemd.Statistics.Get() varlink call: %s", error);
+
+        if (!FLAGS_SET(arg_json_format_flags, JSON_FORMAT_OFF)) {
+                json_variant_dump(reply, arg_json_format_flags, NULL, NULL);
+                return EXIT_SUCCESS;
+        }
+
+        counters = table_new("counter", "value");
+        if (!counters)
+                return log_oom();
+
+        (void) table_set_align_percent(counters, table_get_cell(counters, 0, 1), 100);
+
+        r = table_add_counters(counters, json_variant_by_key(reply, "counters"));
+        if (r < 0)
+                return r;
+
+        histograms = table_new("histogram", "count", "average", "max");
+        if (!histograms)
+                return log_oom();
+
+        for (size_t i = 1; i < 4; i++)
+                (void) table_set_align_percent(histograms, table_get_cell(histograms, 0, i), 100);
+
+        r = table_add_histograms(histograms, json_variant_by_key(reply, "histograms"));
+        if (r < 0)
+                return r;
+
+        pager_open(arg_pager_flags);
+
+        r = table_print_sorted(counters);
+        if (r < 0)
+                return r;
+
+        putchar('\n');
+
+        return table_print_sorted(histograms);
+}
@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "analyze.h"
+#include "analyze-trace.h"
+#include "bus-error.h"
+#include "bus-locator.h"
+#include "bus-util.h"
+#include "hashmap.h"
+#include "json.h"
+
+/* Converts the boot trace recorded by the service manager (see BootTrace=) into the Trace Event Format, as
+ * understood by Perfetto and chrome://tracing. Each unit gets its own track, on which the recorded events
+ * are shown, plus spans for the time its job waited for its dependencies and the time it was running. */
+
+typedef struct TraceUnit {
+        char *name;
+        uint64_t track;
+        usec_t enqueued;
+        usec_t running;
+} TraceUnit;
+
+typedef struct TraceContext {
+        JsonVariant **events;
+        size_t n_events;
+        Hashmap *units;
+} TraceContext;
+
+static TraceUnit* trace_unit_free(TraceUnit *u) {
+        if (!u)
+                return NULL;
+
+        free(u->name);
+        return mfree(u);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(TraceUnit*, trace_unit_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(trace_unit_hash_ops, char, string_hash_func, string_compare_func,
+                                              TraceUnit, trace_unit_free);
+
+static void trace_context_done(TraceContext *c) {
+        assert(c);
+
+        json_variant_unref_many(c->events, c->n_events);
+        c->events = mfree(c->events);
+        c->n_events = 0;
+        c->units = hashmap_free(c->units);
+}
+
+static int trace_context_append(TraceContext *c, JsonVariant *v) {
+        assert(c);
+        assert(v);
+
+        /* Collect the events and build the array once in the end, as appending to a JsonVariant array
+         * copies it every time. */
+        if (!GREEDY_REALLOC(c->events, c->n_events + 1))
+                return -ENOMEM;
+
+        c->events[c->n_events++] = json_variant_ref(v);
+        return 0;
+}
+
+static int trace_context_append_event(
+                TraceContext *c,
+                const char *name,
+                uint64_t track,
+                usec_t timestamp,
+                usec_t duration) {
+
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        int r;
+
+        assert(c);
+        assert(name);
+
+        /* Events with a duration become complete events ("X"), all others instant events ("i") on the
+         * track of the unit. */
+        r = json_build(&v, JSON_BUILD_OBJECT(
+                                       JSON_BUILD_PAIR_STRING("name", name),
+                                       JSON_BUILD_PAIR_STRING("cat", "systemd"),
+                                       JSON_BUILD_PAIR_STRING("ph", duration > 0 ? "X" : "i"),
+                                       JSON_BUILD_PAIR_CONDITION(duration == 0, "s", JSON_BUILD_STRING("t")),
+                                       JSON_BUILD_PAIR_UNSIGNED("ts", timestamp),
+                                       JSON_BUILD_PAIR_CONDITION(duration > 0, "dur", JSON_BUILD_UNSIGNED(duration)),
+                                       JSON_BUILD_PAIR_UNSIGNED("pid", 1),
+                                       JSON_BUILD_PAIR_UNSIGNED("tid", track)));
+        if (r < 0)
+                return r;
+
+        return trace_context_append(c, v);
+}
+
+static int trace_context_get_unit(TraceContext *c, const char *name, TraceUnit **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_(trace_unit_freep) TraceUnit *u = NULL;
+        TraceUnit *existing;
+        int r;
+
+        assert(c);
+        assert(name);
+        assert(ret);
+
+        existing = hashmap_get(c->units, name);
+        if (existing) {
+                *ret = existing;
+                return 0;
+        }
+
+        u = new(TraceUnit, 1);
+        if (!u)
+                return -ENOMEM;
+
+        *u = (TraceUnit) {
+                .name = strdup(name),
+                .track = hashmap_size(c->units) + 1,
+        };
+        if (!u->name)
+                return -ENOMEM;
+
+        /* Name the track after the unit */
+        r = json_build(&v, JSON_BUILD_OBJECT(
+                                       JSON_BUILD_PAIR_STRING("name", "thread_name"),
+                                       JSON_BUILD_PAIR_STRING("ph", "M"),
+                                       JSON_BUILD_PAIR_UNSIGNED("pid", 1),
+                                       JSON_BUILD_PAIR_UNSIGNED("tid", u->track),
+                                       JSON_BUILD_PAIR("args", JSON_BUILD_OBJECT(JSON_BUILD_PAIR_STRING("name", name)))));
+        if (r < 0)
+                return r;
+
+        r = trace_context_append(c, v);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_put(&c->units, &trace_unit_hash_ops, u->name, u);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(u);
+        return 0;
+}
+
+static int trace_context_add(TraceContext *c, const char *name, const char *type, usec_t timestamp, usec_t duration) {
+        TraceUnit *u;
+        int r;
+
+        assert(c);
+        assert(name);
+        assert(type);
+
+        r = trace_context_get_unit(c, name, &u);
+        if (r < 0)
+                return r;
+
+        r = trace_context_append_event(c, type, u->track, timestamp, duration);
+        if (r < 0)
+                return r;
+
+        if (streq(type, "job-enqueued"))
+                u->enqueued = timestamp;
+        else if (streq(type, "job-running")) {
+                if (u->enqueued > 0 && timestamp > u->enqueued) {
+                        r = trace_context_append_event(c, "waiting", u->track, u->enqueued, timestamp - u->enqueued);
+                        if (r < 0)
+                                return r;
+                }
+
+                u->enqueued = 0;
+                u->running = timestamp;
+        } else if (streq(type, "job-finished")) {
+                if (u->running > 0 && timestamp > u->running) {
+                        r = trace_context_append_event(c, "running", u->track, u->running, timestamp - u->running);
+                        if (r < 0)
+                                return r;
+                }
+
+                u->enqueued = u->running = 0;
+        }
+
+        return 0;
+}
+
+int verb_trace(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(json_variant_unrefp) JsonVariant *events = NULL, *v = NULL;
+        _cleanup_(trace_context_done) TraceContext c = {};
+        int r;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return bus_log_connect_error(r, arg_transport);
+
+        r = bus_call_method(bus, bus_systemd_mgr, "GetBootTrace", &error, &reply, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get boot trace: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(sstt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (;;) {
+                const char *name, *type;
+                uint64_t timestamp, duration;
+
+                r = sd_bus_message_read(reply, "(sstt)", &name, &type, &timestamp, &duration);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0)
+                        break;
+
+                r = trace_context_add(&c, name, type, timestamp, duration);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to convert boot trace event: %m");
+        }
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        r = json_variant_new_array(&events, c.events, c.n_events);
+        if (r < 0)
+                return log_error_errno(r, "Failed to build trace event array: %m");
+
+        r = json_build(&v, JSON_BUILD_OBJECT(
+                                       JSON_BUILD_PAIR("traceEvents", JSON_BUILD_VARIANT(events)),
+                                       JSON_BUILD_PAIR_STRING("displayTimeUnit", "ms")));
+        if (r < 0)
+                return log_error_errno(r, "Failed to build trace: %m");
+
+        json_variant_dump(v, FLAGS_SET(arg_json_format_flags, JSON_FORMAT_OFF) ? JSON_FORMAT_NEWLINE : arg_json_format_flags,
+                          stdout, NULL);
+
+        return EXIT_SUCCESS;
+}
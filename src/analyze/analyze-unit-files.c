@@ -4,6 +4,7 @@
 #include "analyze-unit-files.h"
 #include "path-lookup.h"
 #include "strv.h"
+#include "unit-file.h"
 
 static bool strv_fnmatch_strv_or_empty(char* const* patterns, char **strv, int flags) {
         STRV_FOREACH(s, strv)
@@ -25,7 +26,9 @@ int verb_unit_files(int argc, char *argv[], void *userdata) {
         if (r < 0)
                 return r;
 
-        r = unit_file_build_name_map(&lp, NULL, &unit_ids, &unit_names, NULL);
+        r = unit_file_build_name_map(&lp,
+                                     arg_scope == LOOKUP_SCOPE_SYSTEM ? UNIT_NAME_MAP_CACHE_PATH : NULL,
+                                     NULL, &unit_ids, &unit_names, NULL);
         if (r < 0)
                 return log_error_errno(r, "unit_file_build_name_map() failed: %m");
 
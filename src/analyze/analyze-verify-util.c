@@ -11,11 +11,15 @@
 #include "manager.h"
 #include "pager.h"
 #include "path-util.h"
+#include "process-util.h"
 #include "string-table.h"
 #include "strv.h"
 #include "unit-name.h"
 #include "unit-serialize.h"
 
+/* Maximum number of man processes that are run at the same time */
+#define VERIFY_MAN_PARALLEL_MAX 16U
+
 static void log_syntax_callback(const char *unit, int level, void *userdata) {
         Set **s = userdata;
         int r;
@@ -181,14 +185,77 @@ static int verify_executables(Unit *u, const char *root) {
         return r;
 }
 
-static int verify_documentation(Unit *u, bool check_man) {
+static int verify_man_pages(Unit **units, size_t n_units, Hashmap **ret) {
+        _cleanup_hashmap_free_ Hashmap *results = NULL;
+        struct {
+                const char *page;
+                pid_t pid;
+        } running[VERIFY_MAN_PARALLEL_MAX] = {};
+        const char *page;
+        size_t n = 0;
+        void *v;
+        int r;
+
+        assert(units || n_units == 0);
+        assert(ret);
+
+        /* Many units refer to the same man pages, hence check each of them only once, and run a couple of
+         * man processes in parallel. Returns a hashmap from the man page to the result of show_man_page(). */
+
+        for (size_t i = 0; i < n_units; i++)
+                STRV_FOREACH(p, units[i]->documentation) {
+                        _cleanup_free_ char *copy = NULL;
+                        const char *e;
+
+                        e = startswith(*p, "man:");
+                        if (!e || hashmap_contains(results, e))
+                                continue;
+
+                        copy = strdup(e);
+                        if (!copy)
+                                return -ENOMEM;
+
+                        r = hashmap_ensure_put(&results, &string_hash_ops_free, copy, INT_TO_PTR(0));
+                        if (r < 0)
+                                return r;
+
+                        TAKE_PTR(copy);
+                }
+
+        HASHMAP_FOREACH_KEY(v, page, results) {
+                size_t slot = n++ % ELEMENTSOF(running);
+
+                if (running[slot].page)
+                        (void) hashmap_update(results, running[slot].page,
+                                              INT_TO_PTR(wait_for_terminate_and_check(NULL, running[slot].pid, 0)));
+
+                r = show_man_page_async(page, true, &running[slot].pid);
+                if (r < 0) {
+                        (void) hashmap_update(results, page, INT_TO_PTR(r));
+                        running[slot].page = NULL;
+                        continue;
+                }
+
+                running[slot].page = page;
+        }
+
+        for (size_t slot = 0; slot < ELEMENTSOF(running); slot++)
+                if (running[slot].page)
+                        (void) hashmap_update(results, running[slot].page,
+                                              INT_TO_PTR(wait_for_terminate_and_check(NULL, running[slot].pid, 0)));
+
+        *ret = TAKE_PTR(results);
+        return 0;
+}
+
+static int verify_documentation(Unit *u, Hashmap *man_results) {
         int r = 0, k;
 
         STRV_FOREACH(p, u->documentation) {
                 log_unit_debug(u, "Found documentation item: %s", *p);
 
-                if (check_man && startswith(*p, "man:")) {
-                        k = show_man_page(*p + 4, true);
+                if (man_results && startswith(*p, "man:")) {
+                        k = PTR_TO_INT(hashmap_get(man_results, *p + 4));
                         if (k != 0) {
                                 if (k < 0)
                                         log_unit_error_errno(u, k, "Can't show %s: %m", *p + 4);
@@ -207,7 +274,7 @@ static int verify_documentation(Unit *u, bool check_man) {
         return r;
 }
 
-static int verify_unit(Unit *u, bool check_man, const char *root) {
+static int verify_unit(Unit *u, Hashmap *man_results, const char *root) {
         _cleanup_(sd_bus_error_free) sd_bus_error err = SD_BUS_ERROR_NULL;
         int r, k;
 
@@ -229,7 +296,7 @@ static int verify_unit(Unit *u, bool check_man, const char *root) {
         if (k < 0 && r == 0)
                 r = k;
 
-        k = verify_documentation(u, check_man);
+        k = verify_documentation(u, man_results);
         if (k < 0 && r == 0)
                 r = k;
 
@@ -251,6 +318,7 @@ int verify_units(char **filenames, LookupScope scope, bool check_man, bool run_g
 
         _cleanup_(manager_freep) Manager *m = NULL;
         _cleanup_(set_destroy_ignore_pointer_max) Set *s = NULL;
+        _cleanup_hashmap_free_ Hashmap *man_results = NULL;
         _unused_ _cleanup_(clear_log_syntax_callback) dummy_t dummy;
         Unit *units[strv_length(filenames)];
         _cleanup_free_ char *var = NULL;
@@ -308,8 +376,14 @@ int verify_units(char **filenames, LookupScope scope, bool check_man, bool run_g
                 count++;
         }
 
+        if (check_man) {
+                k = verify_man_pages(units, count, &man_results);
+                if (k < 0)
+                        return log_error_errno(k, "Failed to check man pages: %m");
+        }
+
         for (i = 0; i < count; i++) {
-                k = verify_unit(units[i], check_man, root);
+                k = verify_unit(units[i], man_results, root);
                 if (k < 0 && r == 0)
                         r = k;
         }
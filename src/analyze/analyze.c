@@ -28,11 +28,13 @@
 #include "analyze-plot.h"
 #include "analyze-security.h"
 #include "analyze-service-watchdogs.h"
+#include "analyze-stats.h"
 #include "analyze-syscall-filter.h"
 #include "analyze-time.h"
 #include "analyze-time-data.h"
 #include "analyze-timespan.h"
 #include "analyze-timestamp.h"
+#include "analyze-trace.h"
 #include "analyze-unit-files.h"
 #include "analyze-unit-paths.h"
 #include "analyze-compare-versions.h"
@@ -189,6 +191,7 @@ static int help(int argc, char *argv[], void *userdata) {
                "                             of units\n"
                "  plot                       Output SVG graphic showing service\n"
                "                             initialization\n"
+               "  trace                      Output boot trace in Trace Event Format\n"
                "  dot [UNIT...]              Output dependency graph in %s format\n"
                "  dump                       Output state serialization of service\n"
                "                             manager\n"
@@ -209,6 +212,7 @@ static int help(int argc, char *argv[], void *userdata) {
                "  timespan SPAN...           Validate a time span\n"
                "  security [UNIT...]         Analyze security of unit\n"
                "  inspect-elf FILE...        Parse and print ELF package metadata\n"
+               "  stats DAEMON               Show performance counters of a daemon\n"
                "\nOptions:\n"
                "     --recursive-errors=MODE Control which units are verified\n"
                "     --offline=BOOL          Perform a security review on unit file(s)\n"
@@ -495,9 +499,9 @@ static int parse_argv(int argc, char *argv[]) {
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "Option --offline= is only supported for security right now.");
 
-        if (arg_json_format_flags != JSON_FORMAT_OFF && !STRPTR_IN_SET(argv[optind], "security", "inspect-elf"))
+        if (arg_json_format_flags != JSON_FORMAT_OFF && !STRPTR_IN_SET(argv[optind], "security", "inspect-elf", "trace", "stats"))
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
-                                       "Option --json= is only supported for security and inspect-elf right now.");
+                                       "Option --json= is only supported for security, inspect-elf, trace and stats right now.");
 
         if (arg_threshold != 100 && !streq_ptr(argv[optind], "security"))
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
@@ -548,6 +552,7 @@ static int run(int argc, char *argv[]) {
                 { "blame",             VERB_ANY, 1,        0,            verb_blame             },
                 { "critical-chain",    VERB_ANY, VERB_ANY, 0,            verb_critical_chain    },
                 { "plot",              VERB_ANY, 1,        0,            verb_plot              },
+                { "trace",             VERB_ANY, 1,        0,            verb_trace             },
                 { "dot",               VERB_ANY, VERB_ANY, 0,            verb_dot               },
                 /* ↓ The following seven verbs are deprecated, from here … ↓ */
                 { "log-level",         VERB_ANY, 2,        0,            verb_log_control       },
@@ -574,6 +579,7 @@ static int run(int argc, char *argv[]) {
                 { "timespan",          2,        VERB_ANY, 0,            verb_timespan          },
                 { "security",          VERB_ANY, VERB_ANY, 0,            verb_security          },
                 { "inspect-elf",       2,        VERB_ANY, 0,            verb_elf_inspection    },
+                { "stats",             2,        2,        0,            verb_stats             },
                 {}
         };
 
@@ -86,6 +86,79 @@ int cg_read_pid(FILE *f, pid_t *_pid) {
         return 1;
 }
 
+static int cg_read_items_pids(const char *controller, const char *path, const char *item, pid_t **ret_pids, size_t *ret_n_pids) {
+        _cleanup_free_ char *fs = NULL, *contents = NULL;
+        _cleanup_free_ pid_t *pids = NULL;
+        size_t n_pids = 0;
+        int r;
+
+        assert(ret_pids);
+        assert(ret_n_pids);
+
+        r = cg_get_path(controller, path, item, &fs);
+        if (r < 0)
+                return r;
+
+        /* Reading the whole file at once is much faster than parsing it number by number with stdio, which
+         * matters with many thousands of processes. */
+        r = read_full_virtual_file(fs, &contents, NULL);
+        if (r == -EFBIG) {
+                _cleanup_fclose_ FILE *f = NULL;
+                pid_t pid;
+
+                /* More processes than fit into the buffer? Fall back to reading them one by one. */
+                r = cg_enumerate_items(controller, path, &f, item);
+                if (r < 0)
+                        return r;
+
+                while ((r = cg_read_pid(f, &pid)) > 0) {
+                        if (!GREEDY_REALLOC(pids, n_pids + 1))
+                                return -ENOMEM;
+
+                        pids[n_pids++] = pid;
+                }
+                if (r < 0)
+                        return r;
+
+                *ret_pids = TAKE_PTR(pids);
+                *ret_n_pids = n_pids;
+                return 0;
+        }
+        if (r < 0)
+                return r;
+
+        for (char *p = contents; *p;) {
+                pid_t pid;
+                char *e;
+
+                e = strchr(p, '\n');
+                if (e)
+                        *e = '\0';
+
+                r = parse_pid(p, &pid);
+                if (r < 0)
+                        return -EIO;
+
+                if (!GREEDY_REALLOC(pids, n_pids + 1))
+                        return -ENOMEM;
+
+                pids[n_pids++] = pid;
+
+                if (!e)
+                        break;
+
+                p = e + 1;
+        }
+
+        *ret_pids = TAKE_PTR(pids);
+        *ret_n_pids = n_pids;
+        return 0;
+}
+
+int cg_read_pids(const char *controller, const char *path, pid_t **ret_pids, size_t *ret_n_pids) {
+        return cg_read_items_pids(controller, path, "cgroup.procs", ret_pids, ret_n_pids);
+}
+
 int cg_read_event(
                 const char *controller,
                 const char *path,
@@ -282,11 +355,11 @@ static int cg_kill_items(
         my_pid = getpid_cached();
 
         do {
-                _cleanup_fclose_ FILE *f = NULL;
-                pid_t pid = 0;
+                _cleanup_free_ pid_t *pids = NULL;
+                size_t n_pids = 0;
                 done = true;
 
-                r = cg_enumerate_items(controller, path, &f, item);
+                r = cg_read_items_pids(controller, path, item, &pids, &n_pids);
                 if (r < 0) {
                         if (ret >= 0 && r != -ENOENT)
                                 return r;
@@ -294,7 +367,8 @@ static int cg_kill_items(
                         return ret;
                 }
 
-                while ((r = cg_read_pid(f, &pid)) > 0) {
+                for (size_t i = 0; i < n_pids; i++) {
+                        pid_t pid = pids[i];
 
                         if ((flags & CGROUP_IGNORE_SELF) && pid == my_pid)
                                 continue;
@@ -333,13 +407,6 @@ static int cg_kill_items(
                         }
                 }
 
-                if (r < 0) {
-                        if (ret >= 0)
-                                return r;
-
-                        return ret;
-                }
-
                 /* To avoid racing against processes which fork
                  * quicker than we can kill them we repeat this until
                  * no new pids need to be killed. */
@@ -368,11 +435,12 @@ int cg_kill(
 
         /* Only in case of killing with SIGKILL and when using cgroupsv2, kill remaining threads manually as
            a workaround for kernel bug. It was fixed in 5.2-rc5 (c03cd7738a83), backported to 4.19.66
-           (4340d175b898) and 4.14.138 (feb6b123b7dd). */
+           (4340d175b898) and 4.14.138 (feb6b123b7dd). Kernels which support cgroup.kill (5.14) have the fix,
+           so skip enumerating all threads there, which is expensive for cgroups with many processes. */
         r = cg_unified_controller(controller);
         if (r < 0)
                 return r;
-        if (r == 0)
+        if (r == 0 || cg_kill_supported())
                 return ret;
 
         r = cg_kill_items(controller, path, sig, flags, s, log_kill, userdata, "cgroup.threads");
@@ -1031,22 +1099,39 @@ int cg_mangle_path(const char *path, char **result) {
 }
 
 int cg_get_root_path(char **path) {
+        static thread_local char *cached = NULL;
         char *p, *e;
         int r;
 
         assert(path);
 
+        /* This is called for every cg_pid_get_path_shifted() and hence for every sd_pid_get_session() and
+         * friends. Once PID 1 moved itself into init.scope it stays there, hence the root can't change
+         * anymore from that point on, and we can avoid reading /proc/1/cgroup again and again. */
+        if (cached) {
+                p = strdup(cached);
+                if (!p)
+                        return -ENOMEM;
+
+                *path = p;
+                return 0;
+        }
+
         r = cg_pid_get_path(SYSTEMD_CGROUP_CONTROLLER, 1, &p);
         if (r < 0)
                 return r;
 
         e = endswith(p, "/" SPECIAL_INIT_SCOPE);
-        if (!e)
-                e = endswith(p, "/" SPECIAL_SYSTEM_SLICE); /* legacy */
-        if (!e)
-                e = endswith(p, "/system"); /* even more legacy */
-        if (e)
+        if (e) {
                 *e = 0;
+                cached = strdup(p); /* Not fatal if this fails, we'll just try again next time */
+        } else {
+                e = endswith(p, "/" SPECIAL_SYSTEM_SLICE); /* legacy */
+                if (!e)
+                        e = endswith(p, "/system"); /* even more legacy */
+                if (e)
+                        *e = 0;
+        }
 
         *path = p;
         return 0;
@@ -1732,6 +1817,37 @@ int cg_set_attribute(const char *controller, const char *path, const char *attri
         return write_string_file(p, value, WRITE_STRING_FILE_DISABLE_BUFFER);
 }
 
+int cg_set_attribute_at(int dir_fd, const char *attribute, const char *value) {
+        _cleanup_close_ int fd = -1;
+        size_t l;
+        ssize_t n;
+
+        assert(dir_fd >= 0);
+        assert(attribute);
+        assert(value);
+
+        /* Like cg_set_attribute(), but writes the attribute relative to an already opened cgroup directory,
+         * which saves the path resolution on each write. This is only useful on the unified hierarchy, where
+         * all attributes of a cgroup are located in the same directory. Like write_string_file() this appends
+         * a newline if there's none, and writes everything with a single syscall, as cgroupfs expects. */
+
+        if (!endswith(value, "\n"))
+                value = strjoina(value, "\n");
+
+        fd = openat(dir_fd, attribute, O_WRONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        l = strlen(value);
+        n = write(fd, value, l);
+        if (n < 0)
+                return -errno;
+        if ((size_t) n != l)
+                return -EIO;
+
+        return 0;
+}
+
 int cg_get_attribute(const char *controller, const char *path, const char *attribute, char **ret) {
         _cleanup_free_ char *p = NULL;
         int r;
@@ -177,6 +177,8 @@ typedef enum CGroupUnified {
 
 int cg_enumerate_processes(const char *controller, const char *path, FILE **_f);
 int cg_read_pid(FILE *f, pid_t *_pid);
+/* Reads all PIDs from cgroup.procs at once. Note that the result might contain duplicates. */
+int cg_read_pids(const char *controller, const char *path, pid_t **ret_pids, size_t *ret_n_pids);
 int cg_read_event(const char *controller, const char *path, const char *event,
                   char **val);
 
@@ -212,6 +214,7 @@ typedef enum  {
 } CGroupKeyMode;
 
 int cg_set_attribute(const char *controller, const char *path, const char *attribute, const char *value);
+int cg_set_attribute_at(int dir_fd, const char *attribute, const char *value);
 int cg_get_attribute(const char *controller, const char *path, const char *attribute, char **ret);
 int cg_get_keyed_attribute_full(const char *controller, const char *path, const char *attribute, char **keys, char **values, CGroupKeyMode mode);
 
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "alloc-util.h"
+#include "compress-pool.h"
+#include "macro.h"
+#include "pthread-util.h"
+
+struct CompressPool {
+        unsigned n_ref;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t work_cond; /* signalled when a new batch is posted, or when shutting down */
+        pthread_cond_t done_cond; /* signalled when the last job of a batch is done */
+
+        pthread_t *threads;
+        size_t n_threads;
+
+        /* The batch being worked on, protected by the mutex */
+        CompressJob *jobs;
+        size_t n_jobs;
+        size_t next_job;
+        size_t n_pending;
+
+        bool shutdown;
+};
+
+static void compress_job_run(CompressJob *j) {
+        assert(j);
+
+        j->dst_size = 0;
+
+        if (j->dictionary) {
+                assert(j->compression == COMPRESSION_ZSTD);
+                j->result = compress_blob_with_dictionary(j->dictionary, j->src, j->src_size, j->dst, j->dst_alloc_size, &j->dst_size);
+        } else
+                j->result = compress_blob_explicit(j->compression, j->src, j->src_size, j->dst, j->dst_alloc_size, &j->dst_size);
+}
+
+/* Picks up and runs jobs of the current batch until there are none left. Called with the mutex held. */
+static void compress_pool_work_locked(CompressPool *p) {
+        assert(p);
+
+        while (p->next_job < p->n_jobs) {
+                CompressJob *j = p->jobs + p->next_job++;
+
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+                compress_job_run(j);
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+                assert(p->n_pending > 0);
+                if (--p->n_pending == 0)
+                        assert_se(pthread_cond_signal(&p->done_cond) == 0);
+        }
+}
+
+static void* compress_pool_thread(void *userdata) {
+        CompressPool *p = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "compress-pool");
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        for (;;) {
+                while (!p->shutdown && p->next_job >= p->n_jobs)
+                        assert_se(pthread_cond_wait(&p->work_cond, &p->mutex) == 0);
+
+                if (p->shutdown)
+                        break;
+
+                compress_pool_work_locked(p);
+        }
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+        return NULL;
+}
+
+static CompressPool* compress_pool_free(CompressPool *p) {
+        if (!p)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        p->shutdown = true;
+        assert_se(pthread_cond_broadcast(&p->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        for (size_t i = 0; i < p->n_threads; i++)
+                (void) pthread_join(p->threads[i], NULL);
+
+        free(p->threads);
+
+        assert_se(pthread_cond_destroy(&p->work_cond) == 0);
+        assert_se(pthread_cond_destroy(&p->done_cond) == 0);
+        assert_se(pthread_mutex_destroy(&p->mutex) == 0);
+
+        return mfree(p);
+}
+
+DEFINE_TRIVIAL_REF_UNREF_FUNC(CompressPool, compress_pool, compress_pool_free);
+
+int compress_pool_new(unsigned n_threads, CompressPool **ret) {
+        _cleanup_(compress_pool_unrefp) CompressPool *p = NULL;
+        sigset_t ss, saved_ss;
+        int r = 0, k;
+
+        assert(n_threads > 0);
+        assert(ret);
+
+        p = new(CompressPool, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (CompressPool) {
+                .n_ref = 1,
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .work_cond = PTHREAD_COND_INITIALIZER,
+                .done_cond = PTHREAD_COND_INITIALIZER,
+        };
+
+        p->threads = new(pthread_t, n_threads);
+        if (!p->threads)
+                return -ENOMEM;
+
+        /* The workers never need to handle signals, leave them all to the thread that owns the pool. SIGBUS
+         * is not blocked, like for the journal offlining thread. */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        for (; p->n_threads < n_threads; p->n_threads++) {
+                r = pthread_create(p->threads + p->n_threads, NULL, compress_pool_thread, p);
+                if (r > 0)
+                        break;
+        }
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+        if (k > 0)
+                return -k;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+unsigned compress_pool_get_n_threads(CompressPool *p) {
+        assert(p);
+
+        return p->n_threads;
+}
+
+void compress_pool_run(CompressPool *p, CompressJob jobs[], size_t n_jobs) {
+        assert(p);
+        assert(jobs || n_jobs == 0);
+
+        if (n_jobs == 0)
+                return;
+
+        /* A single job is not worth the wakeups */
+        if (n_jobs == 1) {
+                compress_job_run(jobs);
+                return;
+        }
+
+        _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_lock_ = pthread_mutex_lock_assert(&p->mutex);
+
+        assert(p->n_pending == 0);
+
+        p->jobs = jobs;
+        p->n_jobs = n_jobs;
+        p->next_job = 0;
+        p->n_pending = n_jobs;
+
+        assert_se(pthread_cond_broadcast(&p->work_cond) == 0);
+
+        /* Instead of idling, help the workers */
+        compress_pool_work_locked(p);
+
+        while (p->n_pending > 0)
+                assert_se(pthread_cond_wait(&p->done_cond, &p->mutex) == 0);
+
+        p->jobs = NULL;
+        p->n_jobs = p->next_job = 0;
+}
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compress.h"
+#include "macro.h"
+
+/* A small pool of threads that compresses blobs in parallel. Work is handed over in batches: the caller
+ * blocks in compress_pool_run() until all jobs of the batch are done, and helps working on them in the
+ * meantime. */
+
+typedef struct CompressPool CompressPool;
+
+typedef struct CompressJob {
+        Compression compression;
+        CompressDictionary *dictionary; /* if set, compression must be COMPRESSION_ZSTD */
+        const void *src;
+        uint64_t src_size;
+        void *dst;
+        size_t dst_alloc_size;
+
+        /* Set when the job is done: the compression that was used or a negative errno, and on success the
+         * number of bytes written to dst */
+        int result;
+        size_t dst_size;
+} CompressJob;
+
+int compress_pool_new(unsigned n_threads, CompressPool **ret);
+CompressPool* compress_pool_ref(CompressPool *p);
+CompressPool* compress_pool_unref(CompressPool *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(CompressPool*, compress_pool_unref);
+
+unsigned compress_pool_get_n_threads(CompressPool *p);
+
+/* Runs all jobs, and returns once they are all done. Per-job failures are reported in CompressJob.result
+ * only. Must not be called concurrently on the same pool. */
+void compress_pool_run(CompressPool *p, CompressJob jobs[], size_t n_jobs);
@@ -18,6 +18,7 @@
 #endif
 
 #if HAVE_ZSTD
+#include <zdict.h>
 #include <zstd.h>
 #include <zstd_errors.h>
 #endif
@@ -28,6 +29,8 @@
 #include "fileio.h"
 #include "io-util.h"
 #include "macro.h"
+#include "parse-util.h"
+#include "pthread-util.h"
 #include "sparse-endian.h"
 #include "string-table.h"
 #include "string-util.h"
@@ -66,6 +69,284 @@ static const char* const compression_table[_COMPRESSION_MAX] = {
 
 DEFINE_STRING_TABLE_LOOKUP(compression, Compression);
 
+static CompressionStatistics compression_statistics[_COMPRESSION_MAX] = {};
+
+void compression_get_statistics(Compression compression, CompressionStatistics *ret) {
+        CompressionStatistics *st;
+
+        assert(compression >= 0 && compression < _COMPRESSION_MAX);
+        assert(ret);
+
+        st = compression_statistics + compression;
+
+        *ret = (CompressionStatistics) {
+                .n_compressed = __atomic_load_n(&st->n_compressed, __ATOMIC_RELAXED),
+                .n_failed = __atomic_load_n(&st->n_failed, __ATOMIC_RELAXED),
+                .uncompressed_bytes = __atomic_load_n(&st->uncompressed_bytes, __ATOMIC_RELAXED),
+                .compressed_bytes = __atomic_load_n(&st->compressed_bytes, __ATOMIC_RELAXED),
+                .usec = __atomic_load_n(&st->usec, __ATOMIC_RELAXED),
+        };
+}
+
+static void compression_account(Compression compression, usec_t begin, int r, uint64_t src_size, size_t dst_size) {
+        CompressionStatistics *st;
+
+        assert(compression > COMPRESSION_NONE && compression < _COMPRESSION_MAX);
+
+        /* Several threads might compress at the same time, hence update the counters atomically. Relaxed
+         * ordering is fine, nobody derives anything from the order in which they are bumped. */
+        st = compression_statistics + compression;
+        (void) __atomic_add_fetch(&st->usec, usec_sub_unsigned(now(CLOCK_MONOTONIC), begin), __ATOMIC_RELAXED);
+        if (r > 0) {
+                (void) __atomic_add_fetch(&st->n_compressed, 1, __ATOMIC_RELAXED);
+                (void) __atomic_add_fetch(&st->uncompressed_bytes, src_size, __ATOMIC_RELAXED);
+                (void) __atomic_add_fetch(&st->compressed_bytes, dst_size, __ATOMIC_RELAXED);
+        } else
+                (void) __atomic_add_fetch(&st->n_failed, 1, __ATOMIC_RELAXED);
+}
+
+int compress_blob_explicit(
+                Compression compression,
+                const void *src, uint64_t src_size,
+                void *dst, size_t dst_alloc_size, size_t *dst_size) {
+
+        usec_t begin;
+        int r;
+
+        if (compression <= COMPRESSION_NONE || compression >= _COMPRESSION_MAX)
+                return -EOPNOTSUPP;
+
+        begin = now(CLOCK_MONOTONIC);
+
+        switch (compression) {
+        case COMPRESSION_ZSTD:
+                r = compress_blob_zstd(src, src_size, dst, dst_alloc_size, dst_size);
+                break;
+        case COMPRESSION_LZ4:
+                r = compress_blob_lz4(src, src_size, dst, dst_alloc_size, dst_size);
+                break;
+        case COMPRESSION_XZ:
+                r = compress_blob_xz(src, src_size, dst, dst_alloc_size, dst_size);
+                break;
+        default:
+                assert_not_reached();
+        }
+
+        compression_account(compression, begin, r, src_size, r > 0 ? *dst_size : 0);
+        return r;
+}
+
+/* How many compression contexts to keep around per dictionary, i.e. roughly how many threads may compress
+ * with it at the same time without allocating a new one */
+#define COMPRESS_DICTIONARY_CCTX_MAX 8U
+
+struct CompressDictionary {
+        void *data;
+        size_t size;
+        uint32_t id;
+
+#if HAVE_ZSTD
+        ZSTD_DDict *ddict;
+        ZSTD_CDict *cdict;
+
+        /* Setting up a compression context for a dictionary is much more expensive than compressing a
+         * short blob with it, hence keep idle contexts around */
+        pthread_mutex_t cctx_mutex;
+        ZSTD_CCtx *cctx[COMPRESS_DICTIONARY_CCTX_MAX];
+        size_t n_cctx;
+#endif
+};
+
+int compress_dictionary_new(const void *data, size_t size, bool compress, CompressDictionary **ret) {
+#if HAVE_ZSTD
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+        uint32_t id;
+
+        assert(data || size == 0);
+        assert(ret);
+
+        /* Only accept proper zstd dictionaries, whose ID is recorded in the frames compressed with them.
+         * That's what tells the frames that need the dictionary apart from those that don't. */
+        id = ZSTD_getDictID_fromDict(data, size);
+        if (id == 0)
+                return -EBADMSG;
+
+        d = new(CompressDictionary, 1);
+        if (!d)
+                return -ENOMEM;
+
+        *d = (CompressDictionary) {
+                .id = id,
+                .cctx_mutex = PTHREAD_MUTEX_INITIALIZER,
+        };
+
+        d->data = memdup(data, size);
+        if (!d->data)
+                return -ENOMEM;
+        d->size = size;
+
+        d->ddict = ZSTD_createDDict(d->data, d->size);
+        if (!d->ddict)
+                return -ENOMEM;
+
+        /* The compression side is considerably larger, only set it up if it's going to be used */
+        if (compress) {
+                d->cdict = ZSTD_createCDict(d->data, d->size, 0);
+                if (!d->cdict)
+                        return -ENOMEM;
+        }
+
+        *ret = TAKE_PTR(d);
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+CompressDictionary* compress_dictionary_free(CompressDictionary *d) {
+        if (!d)
+                return NULL;
+
+#if HAVE_ZSTD
+        for (size_t i = 0; i < d->n_cctx; i++)
+                ZSTD_freeCCtx(d->cctx[i]);
+
+        ZSTD_freeCDict(d->cdict);
+        ZSTD_freeDDict(d->ddict);
+        assert_se(pthread_mutex_destroy(&d->cctx_mutex) == 0);
+#endif
+
+        free(d->data);
+        return mfree(d);
+}
+
+uint32_t compress_dictionary_get_id(const CompressDictionary *d) {
+        assert(d);
+
+        return d->id;
+}
+
+const void* compress_dictionary_get_data(const CompressDictionary *d, size_t *ret_size) {
+        assert(d);
+
+        if (ret_size)
+                *ret_size = d->size;
+
+        return d->data;
+}
+
+int compress_dictionary_train(
+                const void *samples,
+                const size_t sample_sizes[],
+                size_t n_samples,
+                size_t max_size,
+                void **ret,
+                size_t *ret_size) {
+#if HAVE_ZSTD
+        _cleanup_free_ void *buf = NULL;
+        size_t k;
+
+        assert(samples || n_samples == 0);
+        assert(sample_sizes || n_samples == 0);
+        assert(max_size > 0);
+        assert(ret);
+        assert(ret_size);
+
+        if (n_samples > UINT_MAX)
+                return -E2BIG;
+
+        buf = malloc(max_size);
+        if (!buf)
+                return -ENOMEM;
+
+        k = ZDICT_trainFromBuffer(buf, max_size, samples, sample_sizes, n_samples);
+        if (ZDICT_isError(k)) {
+                /* Usually this means there are too few samples, or they have too little in common */
+                log_debug("ZSTD dictionary training failed: %s", ZDICT_getErrorName(k));
+                return -ENODATA;
+        }
+
+        *ret = TAKE_PTR(buf);
+        *ret_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int compress_blob_with_dictionary(
+                CompressDictionary *d,
+                const void *src, uint64_t src_size,
+                void *dst, size_t dst_alloc_size, size_t *dst_size) {
+#if HAVE_ZSTD
+        ZSTD_CCtx *cctx = NULL;
+        usec_t begin;
+        size_t k;
+        int r;
+
+        assert(d);
+        assert(d->cdict);
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size > 0);
+        assert(dst_size);
+
+        begin = now(CLOCK_MONOTONIC);
+
+        assert_se(pthread_mutex_lock(&d->cctx_mutex) == 0);
+        if (d->n_cctx > 0)
+                cctx = d->cctx[--d->n_cctx];
+        assert_se(pthread_mutex_unlock(&d->cctx_mutex) == 0);
+
+        if (!cctx) {
+                cctx = ZSTD_createCCtx();
+                if (!cctx)
+                        return -ENOMEM;
+        }
+
+        k = ZSTD_compress_usingCDict(cctx, dst, dst_alloc_size, src, src_size, d->cdict);
+        if (ZSTD_isError(k))
+                r = zstd_ret_to_errno(k);
+        else {
+                *dst_size = k;
+                r = COMPRESSION_ZSTD;
+        }
+
+        assert_se(pthread_mutex_lock(&d->cctx_mutex) == 0);
+        if (d->n_cctx < COMPRESS_DICTIONARY_CCTX_MAX) {
+                d->cctx[d->n_cctx++] = cctx;
+                cctx = NULL;
+        }
+        assert_se(pthread_mutex_unlock(&d->cctx_mutex) == 0);
+
+        ZSTD_freeCCtx(cctx);
+
+        compression_account(COMPRESSION_ZSTD, begin, r, src_size, r > 0 ? *dst_size : 0);
+        return r;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+#if HAVE_ZSTD
+static const ZSTD_DDict* compress_dictionary_for_frame(const CompressDictionary *d, const void *src, uint64_t src_size) {
+        uint32_t id;
+
+        /* Referencing a dictionary also changes the initial state of the decoder, so it must not be used for
+         * frames that were compressed without it */
+
+        if (!d)
+                return NULL;
+
+        id = ZSTD_getDictID_fromFrame(src, src_size);
+        if (id == 0 || id != d->id)
+                return NULL;
+
+        return d->ddict;
+}
+#endif
+
 int compress_blob_xz(const void *src, uint64_t src_size,
                      void *dst, size_t dst_alloc_size, size_t *dst_size) {
 #if HAVE_XZ
@@ -263,7 +544,19 @@ int decompress_blob_zstd(
                 size_t *dst_size,
                 size_t dst_max) {
 
+        return decompress_blob_zstd_with_dictionary(NULL, src, src_size, dst, dst_size, dst_max);
+}
+
+int decompress_blob_zstd_with_dictionary(
+                const CompressDictionary *d,
+                const void *src,
+                uint64_t src_size,
+                void **dst,
+                size_t *dst_size,
+                size_t dst_max) {
+
 #if HAVE_ZSTD
+        const ZSTD_DDict *ddict;
         uint64_t size;
 
         assert(src);
@@ -287,6 +580,13 @@ int decompress_blob_zstd(
         if (!dctx)
                 return -ENOMEM;
 
+        ddict = compress_dictionary_for_frame(d, src, src_size);
+        if (ddict) {
+                size_t k = ZSTD_DCtx_refDDict(dctx, ddict);
+                if (ZSTD_isError(k))
+                        return zstd_ret_to_errno(k);
+        }
+
         ZSTD_inBuffer input = {
                 .src = src,
                 .size = src_size,
@@ -318,6 +618,18 @@ int decompress_blob(
                 size_t* dst_size,
                 size_t dst_max) {
 
+        return decompress_blob_with_dictionary(compression, NULL, src, src_size, dst, dst_size, dst_max);
+}
+
+int decompress_blob_with_dictionary(
+                Compression compression,
+                const CompressDictionary *d,
+                const void *src,
+                uint64_t src_size,
+                void **dst,
+                size_t* dst_size,
+                size_t dst_max) {
+
         if (compression == COMPRESSION_XZ)
                 return decompress_blob_xz(
                                 src, src_size,
@@ -327,7 +639,8 @@ int decompress_blob(
                                 src, src_size,
                                 dst, dst_size, dst_max);
         else if (compression == COMPRESSION_ZSTD)
-                return decompress_blob_zstd(
+                return decompress_blob_zstd_with_dictionary(
+                                d,
                                 src, src_size,
                                 dst, dst_size, dst_max);
         else
@@ -473,7 +786,21 @@ int decompress_startswith_zstd(
                 const void *prefix,
                 size_t prefix_len,
                 uint8_t extra) {
+
+        return decompress_startswith_zstd_with_dictionary(NULL, src, src_size, buffer, prefix, prefix_len, extra);
+}
+
+int decompress_startswith_zstd_with_dictionary(
+                const CompressDictionary *d,
+                const void *src,
+                uint64_t src_size,
+                void **buffer,
+                const void *prefix,
+                size_t prefix_len,
+                uint8_t extra) {
 #if HAVE_ZSTD
+        const ZSTD_DDict *ddict;
+
         assert(src);
         assert(src_size > 0);
         assert(buffer);
@@ -490,6 +817,13 @@ int decompress_startswith_zstd(
         if (!dctx)
                 return -ENOMEM;
 
+        ddict = compress_dictionary_for_frame(d, src, src_size);
+        if (ddict) {
+                size_t k = ZSTD_DCtx_refDDict(dctx, ddict);
+                if (ZSTD_isError(k))
+                        return zstd_ret_to_errno(k);
+        }
+
         if (!(greedy_realloc(buffer, MAX(ZSTD_DStreamOutSize(), prefix_len + 1), 1)))
                 return -ENOMEM;
 
@@ -526,6 +860,19 @@ int decompress_startswith(
                 size_t prefix_len,
                 uint8_t extra) {
 
+        return decompress_startswith_with_dictionary(compression, NULL, src, src_size, buffer, prefix, prefix_len, extra);
+}
+
+int decompress_startswith_with_dictionary(
+                Compression compression,
+                const CompressDictionary *d,
+                const void *src,
+                uint64_t src_size,
+                void **buffer,
+                const void *prefix,
+                size_t prefix_len,
+                uint8_t extra) {
+
         if (compression == COMPRESSION_XZ)
                 return decompress_startswith_xz(
                                 src, src_size,
@@ -540,7 +887,8 @@ int decompress_startswith(
                                 prefix, prefix_len,
                                 extra);
         else if (compression == COMPRESSION_ZSTD)
-                return decompress_startswith_zstd(
+                return decompress_startswith_zstd_with_dictionary(
+                                d,
                                 src, src_size,
                                 buffer,
                                 prefix, prefix_len,
@@ -549,7 +897,88 @@ int decompress_startswith(
                 return -EBADMSG;
 }
 
-int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size) {
+#define COMPRESS_THREADS_MAX 64U
+
+int compress_threads_from_env(unsigned *ret) {
+        const char *e;
+        unsigned n;
+
+        assert(ret);
+
+        e = getenv("SYSTEMD_COMPRESS_THREADS");
+        if (!e)
+                return 0;
+
+        if (safe_atou(e, &n) < 0 || n == 0) {
+                log_debug("Failed to parse $SYSTEMD_COMPRESS_THREADS, ignoring: %s", e);
+                return 0;
+        }
+
+        *ret = MIN(n, COMPRESS_THREADS_MAX);
+        return 1;
+}
+
+static unsigned compress_stream_threads(unsigned threads) {
+        unsigned n;
+
+        if (threads > 0)
+                return MIN(threads, COMPRESS_THREADS_MAX);
+
+        /* The stream helpers are used for coredumps, i.e. while the system might be in trouble, hence stay
+         * single-threaded unless told otherwise. */
+        return compress_threads_from_env(&n) > 0 ? n : 1;
+}
+
+#if HAVE_XZ
+static lzma_ret xz_encoder_init(lzma_stream *s, unsigned threads) {
+        assert(s);
+
+        if (threads > 1) {
+                lzma_mt mt = {
+                        .threads = threads,
+                        .preset = LZMA_PRESET_DEFAULT,
+                        .check = LZMA_CHECK_CRC64,
+                };
+                lzma_ret ret;
+
+                ret = lzma_stream_encoder_mt(s, &mt);
+                if (ret == LZMA_OK)
+                        return ret;
+
+                log_debug("Failed to initialize multi-threaded XZ encoder (code %u), using a single thread.", ret);
+        }
+
+        return lzma_easy_encoder(s, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
+}
+
+static lzma_ret xz_decoder_init(lzma_stream *s, unsigned threads) {
+        assert(s);
+
+#if LZMA_VERSION >= UINT32_C(50040002)
+        if (threads > 1) {
+                /* Only streams made of several blocks, as written by multi-threaded encoders, can be
+                 * decoded in parallel. Let's use at most a quarter of the memory for that, like xz(1)
+                 * does, and fall back to a single thread beyond that rather than failing. */
+                lzma_mt mt = {
+                        .threads = threads,
+                        .memlimit_threading = MAX(lzma_physmem() / 4, UINT64_C(1)),
+                        .memlimit_stop = UINT64_MAX,
+                };
+                lzma_ret ret;
+
+                ret = lzma_stream_decoder_mt(s, &mt);
+                if (ret == LZMA_OK)
+                        return ret;
+
+                log_debug("Failed to initialize multi-threaded XZ decoder (code %u), using a single thread.", ret);
+        }
+#endif
+
+        return lzma_stream_decoder(s, UINT64_MAX, 0);
+}
+#endif
+
+int compress_stream_xz_full(int fdf, int fdt, uint64_t max_bytes, unsigned threads, uint64_t *ret_uncompressed_size) {
 #if HAVE_XZ
         _cleanup_(lzma_end) lzma_stream s = LZMA_STREAM_INIT;
         lzma_ret ret;
@@ -559,7 +988,7 @@ int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncom
         assert(fdf >= 0);
         assert(fdt >= 0);
 
-        ret = lzma_easy_encoder(&s, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
+        ret = xz_encoder_init(&s, compress_stream_threads(threads));
         if (ret != LZMA_OK)
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "Failed to initialize XZ encoder: code %u",
@@ -726,7 +1155,7 @@ int decompress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
         assert(fdf >= 0);
         assert(fdt >= 0);
 
-        ret = lzma_stream_decoder(&s, UINT64_MAX, 0);
+        ret = xz_decoder_init(&s, compress_stream_threads(0));
         if (ret != LZMA_OK)
                 return log_debug_errno(SYNTHETIC_ERRNO(ENOMEM),
                                        "Failed to initialize XZ decoder: code %u",
@@ -853,7 +1282,7 @@ int decompress_stream_lz4(int in, int out, uint64_t max_bytes) {
 #endif
 }
 
-int compress_stream_zstd(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size) {
+int compress_stream_zstd_full(int fdf, int fdt, uint64_t max_bytes, unsigned threads, uint64_t *ret_uncompressed_size) {
 #if HAVE_ZSTD
         _cleanup_(ZSTD_freeCCtxp) ZSTD_CCtx *cctx = NULL;
         _cleanup_free_ void *in_buff = NULL, *out_buff = NULL;
@@ -877,6 +1306,15 @@ int compress_stream_zstd(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_unc
         if (ZSTD_isError(z))
                 log_debug("Failed to enable ZSTD checksum, ignoring: %s", ZSTD_getErrorName(z));
 
+        /* zstd compresses on worker threads if it was built with support for that. Decompression is
+         * always single-threaded. */
+        threads = compress_stream_threads(threads);
+        if (threads > 1) {
+                z = ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, threads);
+                if (ZSTD_isError(z))
+                        log_debug("Failed to enable multi-threaded ZSTD compression, ignoring: %s", ZSTD_getErrorName(z));
+        }
+
         /* This loop read from the input file, compresses that entire chunk,
          * and writes all output produced to the output file.
          */
@@ -1066,6 +1504,114 @@ int decompress_stream_zstd(int fdf, int fdt, uint64_t max_bytes) {
 #endif
 }
 
+struct DecompressContext {
+        Compression compression;
+        uint64_t in_bytes;
+        uint64_t out_bytes;
+
+#if HAVE_ZSTD
+        ZSTD_DCtx *dctx;
+        size_t last_result;
+#endif
+};
+
+int decompress_context_new(Compression compression, DecompressContext **ret) {
+#if HAVE_ZSTD
+        _cleanup_(decompress_context_freep) DecompressContext *c = NULL;
+
+        assert(ret);
+
+        if (compression != COMPRESSION_ZSTD)
+                return -EPROTONOSUPPORT;
+
+        c = new(DecompressContext, 1);
+        if (!c)
+                return -ENOMEM;
+
+        *c = (DecompressContext) {
+                .compression = compression,
+        };
+
+        c->dctx = ZSTD_createDCtx();
+        if (!c->dctx)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(c);
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+DecompressContext* decompress_context_free(DecompressContext *c) {
+        if (!c)
+                return NULL;
+
+#if HAVE_ZSTD
+        ZSTD_freeDCtx(c->dctx);
+#endif
+
+        return mfree(c);
+}
+
+int decompress_context_decompress(
+                DecompressContext *c,
+                const void **src, size_t *src_size,
+                void *dst, size_t dst_size) {
+#if HAVE_ZSTD
+        ZSTD_inBuffer input;
+        ZSTD_outBuffer output = {
+                .dst = dst,
+                .size = dst_size,
+        };
+
+        assert(c);
+        assert(src);
+        assert(src_size);
+        assert(*src || *src_size == 0);
+        assert(dst);
+        assert(dst_size > 0);
+        assert(dst_size <= INT_MAX);
+
+        input = (ZSTD_inBuffer) {
+                .src = *src,
+                .size = *src_size,
+        };
+
+        c->last_result = ZSTD_decompressStream(c->dctx, &output, &input);
+        if (ZSTD_isError(c->last_result)) {
+                log_debug("ZSTD decoder failed: %s", ZSTD_getErrorName(c->last_result));
+                return zstd_ret_to_errno(c->last_result);
+        }
+
+        c->in_bytes += input.pos;
+        c->out_bytes += output.pos;
+
+        *src = (const uint8_t*) *src + input.pos;
+        *src_size -= input.pos;
+
+        return (int) output.pos;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int decompress_context_finish(DecompressContext *c) {
+        assert(c);
+
+#if HAVE_ZSTD
+        if (c->last_result != 0)
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                       "ZSTD decoder failed: stream ends in the middle of a frame.");
+
+        log_debug("ZSTD decompression finished (%" PRIu64 " -> %" PRIu64 " bytes)",
+                  c->in_bytes, c->out_bytes);
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_stream(const char *filename, int fdf, int fdt, uint64_t max_bytes) {
 
         if (endswith(filename, ".lz4"))
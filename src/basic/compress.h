@@ -2,9 +2,13 @@
 #pragma once
 
 #include <errno.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <unistd.h>
 
+#include "macro.h"
+#include "time-util.h"
+
 typedef enum Compression {
         COMPRESSION_NONE,
         COMPRESSION_XZ,
@@ -17,6 +21,37 @@ typedef enum Compression {
 const char* compression_to_string(Compression compression);
 Compression compression_from_string(const char *compression);
 
+typedef struct CompressionStatistics {
+        uint64_t n_compressed;          /* blobs that were compressed successfully */
+        uint64_t n_failed;              /* blobs that could not be compressed, e.g. because they didn't shrink */
+        uint64_t uncompressed_bytes;    /* input size of the blobs that were compressed successfully */
+        uint64_t compressed_bytes;      /* output size of the blobs that were compressed successfully */
+        usec_t usec;                    /* time spent compressing, including failed attempts */
+} CompressionStatistics;
+
+/* Counters are process-wide, and may be bumped from any thread */
+void compression_get_statistics(Compression compression, CompressionStatistics *ret);
+
+/* A zstd dictionary, which allows compressing even short blobs efficiently if they have a lot in common.
+ * Blobs compressed with a dictionary can only be decompressed with the same dictionary. */
+typedef struct CompressDictionary CompressDictionary;
+
+int compress_dictionary_new(const void *data, size_t size, bool compress, CompressDictionary **ret);
+CompressDictionary* compress_dictionary_free(CompressDictionary *d);
+DEFINE_TRIVIAL_CLEANUP_FUNC(CompressDictionary*, compress_dictionary_free);
+
+uint32_t compress_dictionary_get_id(const CompressDictionary *d);
+const void* compress_dictionary_get_data(const CompressDictionary *d, size_t *ret_size);
+
+/* Trains a dictionary of at most max_size bytes from the samples, which are concatenated in one buffer */
+int compress_dictionary_train(
+                const void *samples,
+                const size_t sample_sizes[],
+                size_t n_samples,
+                size_t max_size,
+                void **ret,
+                size_t *ret_size);
+
 int compress_blob_xz(const void *src, uint64_t src_size,
                      void *dst, size_t dst_alloc_size, size_t *dst_size);
 int compress_blob_lz4(const void *src, uint64_t src_size,
@@ -24,15 +59,29 @@ int compress_blob_lz4(const void *src, uint64_t src_size,
 int compress_blob_zstd(const void *src, uint64_t src_size,
                        void *dst, size_t dst_alloc_size, size_t *dst_size);
 
+/* Compresses with zstd, using a dictionary created with compress set. May be called from any thread. */
+int compress_blob_with_dictionary(
+                CompressDictionary *d,
+                const void *src, uint64_t src_size,
+                void *dst, size_t dst_alloc_size, size_t *dst_size);
+
 int decompress_blob_xz(const void *src, uint64_t src_size,
                        void **dst, size_t* dst_size, size_t dst_max);
 int decompress_blob_lz4(const void *src, uint64_t src_size,
                         void **dst, size_t* dst_size, size_t dst_max);
 int decompress_blob_zstd(const void *src, uint64_t src_size,
                         void **dst, size_t* dst_size, size_t dst_max);
+int decompress_blob_zstd_with_dictionary(const CompressDictionary *d,
+                                         const void *src, uint64_t src_size,
+                                         void **dst, size_t* dst_size, size_t dst_max);
 int decompress_blob(Compression compression,
                     const void *src, uint64_t src_size,
                     void **dst, size_t* dst_size, size_t dst_max);
+/* The dictionary is only used for frames that were compressed with it, and may be NULL */
+int decompress_blob_with_dictionary(Compression compression,
+                                    const CompressDictionary *d,
+                                    const void *src, uint64_t src_size,
+                                    void **dst, size_t* dst_size, size_t dst_max);
 
 int decompress_startswith_xz(const void *src, uint64_t src_size,
                              void **buffer,
@@ -46,36 +95,64 @@ int decompress_startswith_zstd(const void *src, uint64_t src_size,
                                void **buffer,
                                const void *prefix, size_t prefix_len,
                                uint8_t extra);
+int decompress_startswith_zstd_with_dictionary(const CompressDictionary *d,
+                                               const void *src, uint64_t src_size,
+                                               void **buffer,
+                                               const void *prefix, size_t prefix_len,
+                                               uint8_t extra);
 int decompress_startswith(Compression compression,
                           const void *src, uint64_t src_size,
                           void **buffer,
                           const void *prefix, size_t prefix_len,
                           uint8_t extra);
+int decompress_startswith_with_dictionary(Compression compression,
+                                          const CompressDictionary *d,
+                                          const void *src, uint64_t src_size,
+                                          void **buffer,
+                                          const void *prefix, size_t prefix_len,
+                                          uint8_t extra);
 
-int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size);
+/* Returns 1 and the number of worker threads from $SYSTEMD_COMPRESS_THREADS if that is set, 0 otherwise */
+int compress_threads_from_env(unsigned *ret);
+
+/* The _full() variants take the number of worker threads to compress on. 0 selects the default, i.e. the
+ * value of $SYSTEMD_COMPRESS_THREADS or a single thread. LZ4 always compresses on the calling thread. */
+int compress_stream_xz_full(int fdf, int fdt, uint64_t max_bytes, unsigned threads, uint64_t *ret_uncompressed_size);
+static inline int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size) {
+        return compress_stream_xz_full(fdf, fdt, max_bytes, 0, ret_uncompressed_size);
+}
 int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size);
-int compress_stream_zstd(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size);
+int compress_stream_zstd_full(int fdf, int fdt, uint64_t max_bytes, unsigned threads, uint64_t *ret_uncompressed_size);
+static inline int compress_stream_zstd(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size) {
+        return compress_stream_zstd_full(fdf, fdt, max_bytes, 0, ret_uncompressed_size);
+}
 
 int decompress_stream_xz(int fdf, int fdt, uint64_t max_size);
 int decompress_stream_lz4(int fdf, int fdt, uint64_t max_size);
 int decompress_stream_zstd(int fdf, int fdt, uint64_t max_size);
 
-static inline int compress_blob_explicit(
+/* Decompresses a stream that arrives in pieces, e.g. over the network. Only zstd is supported for now. */
+typedef struct DecompressContext DecompressContext;
+
+int decompress_context_new(Compression compression, DecompressContext **ret);
+DecompressContext* decompress_context_free(DecompressContext *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(DecompressContext*, decompress_context_free);
+
+/* Decompresses as much of the input as fits into dst, and advances *src and *src_size past the input that
+ * was consumed. Returns the number of bytes written to dst. If that is dst_size, there may be more output
+ * pending even if all input was consumed, hence call again until it is smaller. */
+int decompress_context_decompress(
+                DecompressContext *c,
+                const void **src, size_t *src_size,
+                void *dst, size_t dst_size);
+/* Returns -EBADMSG if the stream ended in the middle of a frame */
+int decompress_context_finish(DecompressContext *c);
+
+/* Compresses with the specified algorithm, and accounts the time spent in the per-algorithm statistics */
+int compress_blob_explicit(
                 Compression compression,
                 const void *src, uint64_t src_size,
-                void *dst, size_t dst_alloc_size, size_t *dst_size) {
-
-        switch (compression) {
-        case COMPRESSION_ZSTD:
-                return compress_blob_zstd(src, src_size, dst, dst_alloc_size, dst_size);
-        case COMPRESSION_LZ4:
-                return compress_blob_lz4(src, src_size, dst, dst_alloc_size, dst_size);
-        case COMPRESSION_XZ:
-                return compress_blob_xz(src, src_size, dst, dst_alloc_size, dst_size);
-        default:
-                return -EOPNOTSUPP;
-        }
-}
+                void *dst, size_t dst_alloc_size, size_t *dst_size);
 
 #define compress_blob(src, src_size, dst, dst_alloc_size, dst_size) \
         compress_blob_explicit(                                     \
@@ -83,19 +160,23 @@ static inline int compress_blob_explicit(
                 src, src_size,                                      \
                 dst, dst_alloc_size, dst_size)
 
-static inline int compress_stream(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size) {
+static inline int compress_stream_full(int fdf, int fdt, uint64_t max_bytes, unsigned threads, uint64_t *ret_uncompressed_size) {
         switch (DEFAULT_COMPRESSION) {
         case COMPRESSION_ZSTD:
-                return compress_stream_zstd(fdf, fdt, max_bytes, ret_uncompressed_size);
+                return compress_stream_zstd_full(fdf, fdt, max_bytes, threads, ret_uncompressed_size);
         case COMPRESSION_LZ4:
                 return compress_stream_lz4(fdf, fdt, max_bytes, ret_uncompressed_size);
         case COMPRESSION_XZ:
-                return compress_stream_xz(fdf, fdt, max_bytes, ret_uncompressed_size);
+                return compress_stream_xz_full(fdf, fdt, max_bytes, threads, ret_uncompressed_size);
         default:
                 return -EOPNOTSUPP;
         }
 }
 
+static inline int compress_stream(int fdf, int fdt, uint64_t max_bytes, uint64_t *ret_uncompressed_size) {
+        return compress_stream_full(fdf, fdt, max_bytes, 0, ret_uncompressed_size);
+}
+
 static inline const char* default_compression_extension(void) {
         switch (DEFAULT_COMPRESSION) {
         case COMPRESSION_ZSTD:
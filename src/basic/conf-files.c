@@ -19,6 +19,162 @@
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "time-util.h"
+
+typedef struct DirListing {
+        dev_t dev;
+        ino_t ino;
+        usec_t mtime;
+        char **names;
+} DirListing;
+
+static DirListing* dir_listing_free(DirListing *l) {
+        if (!l)
+                return NULL;
+
+        strv_free(l->names);
+        return mfree(l);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(DirListing*, dir_listing_free);
+
+DEFINE_PRIVATE_HASH_OPS_FULL(dir_listing_hash_ops,
+                             char, path_hash_func, path_compare, free,
+                             DirListing, dir_listing_free);
+
+static int dir_listing_get(Hashmap **cache, const char *path, char ***ret) {
+        _cleanup_(dir_listing_freep) DirListing *l = NULL;
+        _cleanup_closedir_ DIR *dir = NULL;
+        _cleanup_free_ char *key = NULL;
+        DirListing *cached;
+        struct stat st;
+        int r;
+
+        assert(cache);
+        assert(path);
+        assert(ret);
+
+        /* Returns the (unsorted) names of the non-hidden entries in the directory. The listing is kept in the
+         * cache, and only read again when the directory was replaced or modified since. If an entry is added
+         * while we read the directory, the mtime is newer than what we store, hence we'll read it again next
+         * time. The returned array is owned by the cache. */
+
+        if (stat(path, &st) < 0)
+                return -errno;
+
+        cached = hashmap_get(*cache, path);
+        if (cached &&
+            cached->dev == st.st_dev &&
+            cached->ino == st.st_ino &&
+            cached->mtime == timespec_load(&st.st_mtim)) {
+                *ret = cached->names;
+                return 0;
+        }
+
+        dir = opendir(path);
+        if (!dir)
+                return -errno;
+
+        l = new(DirListing, 1);
+        if (!l)
+                return -ENOMEM;
+
+        *l = (DirListing) {
+                .dev = st.st_dev,
+                .ino = st.st_ino,
+                .mtime = timespec_load(&st.st_mtim),
+        };
+
+        FOREACH_DIRENT(de, dir, return -errno)
+                if (strv_extend(&l->names, de->d_name) < 0)
+                        return -ENOMEM;
+
+        if (cached) {
+                strv_free_and_replace(cached->names, l->names);
+                cached->dev = l->dev;
+                cached->ino = l->ino;
+                cached->mtime = l->mtime;
+
+                *ret = cached->names;
+                return 0;
+        }
+
+        key = strdup(path);
+        if (!key)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(cache, &dir_listing_hash_ops, key, l);
+        if (r < 0)
+                return r;
+        TAKE_PTR(key);
+
+        *ret = TAKE_PTR(l)->names;
+        return 0;
+}
+
+static int files_add_cached(
+                Hashmap *h,
+                const char *suffix,
+                const char *root,
+                unsigned flags,
+                const char *path,
+                Hashmap **cache) {
+
+        const char *dirpath;
+        char **names;
+        int r;
+
+        assert(h);
+        assert(path);
+        assert(cache);
+
+        /* Like files_add(), but takes the directory contents from the cache, and hence doesn't support the
+         * flags which require looking at the entries themselves. */
+
+        dirpath = prefix_roota(root, path);
+
+        r = dir_listing_get(cache, dirpath, &names);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return log_debug_errno(r, "Failed to read directory '%s': %m", dirpath);
+
+        STRV_FOREACH(n, names) {
+                char *p, *key;
+
+                if (suffix && !endswith(*n, suffix))
+                        continue;
+
+                if (hashmap_contains(h, *n)) {
+                        log_debug("Skipping overridden file '%s/%s'.", dirpath, *n);
+                        continue;
+                }
+
+                if (flags & CONF_FILES_BASENAME) {
+                        p = strdup(*n);
+                        if (!p)
+                                return -ENOMEM;
+
+                        key = p;
+                } else {
+                        p = path_join(dirpath, *n);
+                        if (!p)
+                                return -ENOMEM;
+
+                        key = basename(p);
+                }
+
+                r = hashmap_put(h, key, p);
+                if (r < 0) {
+                        free(p);
+                        return log_debug_errno(r, "Failed to add item to hashmap: %m");
+                }
+
+                assert(r > 0);
+        }
+
+        return 0;
+}
 
 static int files_add(
                 Hashmap *h,
@@ -141,7 +297,8 @@ static int conf_files_list_strv_internal(
                 const char *suffix,
                 const char *root,
                 unsigned flags,
-                char **dirs) {
+                char **dirs,
+                Hashmap **cache) {
 
         _cleanup_hashmap_free_ Hashmap *fh = NULL;
         _cleanup_set_free_free_ Set *masked = NULL;
@@ -164,8 +321,15 @@ static int conf_files_list_strv_internal(
                         return -ENOMEM;
         }
 
+        /* Listings can only be reused if we don't need to look at the entries themselves */
+        if (flags & (CONF_FILES_FILTER_MASKED|CONF_FILES_REGULAR|CONF_FILES_DIRECTORY|CONF_FILES_EXECUTABLE))
+                cache = NULL;
+
         STRV_FOREACH(p, dirs) {
-                r = files_add(fh, masked, suffix, root, flags, *p);
+                if (cache)
+                        r = files_add_cached(fh, suffix, root, flags, *p, cache);
+                else
+                        r = files_add(fh, masked, suffix, root, flags, *p);
                 if (r == -ENOMEM)
                         return r;
                 if (r < 0)
@@ -259,7 +423,27 @@ int conf_files_list_strv(char ***ret, const char *suffix, const char *root, unsi
         if (!copy)
                 return -ENOMEM;
 
-        return conf_files_list_strv_internal(ret, suffix, root, flags, copy);
+        return conf_files_list_strv_internal(ret, suffix, root, flags, copy, NULL);
+}
+
+int conf_files_list_strv_cached(
+                char ***ret,
+                const char *suffix,
+                const char *root,
+                unsigned flags,
+                const char* const* dirs,
+                Hashmap **cache) {
+
+        _cleanup_strv_free_ char **copy = NULL;
+
+        assert(ret);
+        assert(cache);
+
+        copy = strv_copy((char**) dirs);
+        if (!copy)
+                return -ENOMEM;
+
+        return conf_files_list_strv_internal(ret, suffix, root, flags, copy, cache);
 }
 
 int conf_files_list(char ***ret, const char *suffix, const char *root, unsigned flags, const char *dir) {
@@ -271,7 +455,7 @@ int conf_files_list(char ***ret, const char *suffix, const char *root, unsigned
         if (!dirs)
                 return -ENOMEM;
 
-        return conf_files_list_strv_internal(ret, suffix, root, flags, dirs);
+        return conf_files_list_strv_internal(ret, suffix, root, flags, dirs, NULL);
 }
 
 int conf_files_list_nulstr(char ***ret, const char *suffix, const char *root, unsigned flags, const char *dirs) {
@@ -283,7 +467,7 @@ int conf_files_list_nulstr(char ***ret, const char *suffix, const char *root, un
         if (!d)
                 return -ENOMEM;
 
-        return conf_files_list_strv_internal(ret, suffix, root, flags, d);
+        return conf_files_list_strv_internal(ret, suffix, root, flags, d, NULL);
 }
 
 int conf_files_list_with_replacement(
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 #pragma once
 
+#include "hashmap.h"
 #include "macro.h"
 
 enum {
@@ -13,6 +14,16 @@ enum {
 
 int conf_files_list(char ***ret, const char *suffix, const char *root, unsigned flags, const char *dir);
 int conf_files_list_strv(char ***ret, const char *suffix, const char *root, unsigned flags, const char* const* dirs);
+/* Like conf_files_list_strv(), but keeps the directory listings in the cache and reuses them as long as the
+ * directories don't change. Only useful for flags which don't require looking at the files. Release the
+ * cache with hashmap_free(). */
+int conf_files_list_strv_cached(
+                char ***ret,
+                const char *suffix,
+                const char *root,
+                unsigned flags,
+                const char* const* dirs,
+                Hashmap **cache);
 int conf_files_list_nulstr(char ***ret, const char *suffix, const char *root, unsigned flags, const char *dirs);
 int conf_files_insert(char ***strv, const char *root, char **dirs, const char *path);
 int conf_files_list_with_replacement(
@@ -73,5 +73,10 @@
 #define VARLINK_ADDR_PATH_MANAGED_OOM_SYSTEM "/run/systemd/io.system.ManagedOOM"
 /* Path where systemd-oomd listens for varlink connections from user managers to report changes in ManagedOOM settings. */
 #define VARLINK_ADDR_PATH_MANAGED_OOM_USER "/run/systemd/oom/io.system.ManagedOOM"
+/* Paths where PID1, systemd-udevd and systemd-networkd listen for varlink connections, e.g. for
+ * io.systemd.Statistics.Get(). */
+#define VARLINK_ADDR_PATH_MANAGER "/run/systemd/io.systemd.Manager"
+#define VARLINK_ADDR_PATH_UDEV "/run/udev/io.systemd.Udev"
+#define VARLINK_ADDR_PATH_NETWORK "/run/systemd/netif/io.systemd.Network"
 
 #define KERNEL_BASELINE_VERSION "4.15"
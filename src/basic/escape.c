@@ -89,8 +89,20 @@ char* cescape_length(const char *s, size_t n) {
         if (!r)
                 return NULL;
 
-        for (f = s, t = r; f < s + n; f++)
-                t += cescape_char(*f, t);
+        for (f = s, t = r; f < s + n; ) {
+                const char *e;
+
+                /* Copy runs of characters that need no escaping in one go */
+                for (e = f; e < s + n && *e >= ' ' && *e < 127 && !IN_SET(*e, '\\', '"', '\''); e++)
+                        ;
+                if (e > f) {
+                        t = mempcpy(t, f, e - f);
+                        f = e;
+                        continue;
+                }
+
+                t += cescape_char(*(f++), t);
+        }
 
         *t = 0;
 
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "fast-hash.h"
+#include "unaligned.h"
+
+/* The odd constants wyhash uses, with as many bits set as unset in each byte */
+#define P0 UINT64_C(0xa0761d6478bd642f)
+#define P1 UINT64_C(0xe7037ed1a0b428db)
+#define P2 UINT64_C(0x8ebc6af09c88c6e3)
+
+static uint64_t mix(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+        __uint128_t r = (__uint128_t) a * b;
+
+        return (uint64_t) r ^ (uint64_t) (r >> 64);
+#else
+        /* No 128 bit integers on most 32 bit archs, do it the long way */
+        uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t) a, lb = (uint32_t) b,
+                rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t, lo, hi;
+
+        t = rl + (rm0 << 32);
+        lo = t + (rm1 << 32);
+        hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+
+        return lo ^ hi;
+#endif
+}
+
+uint64_t fast_hash(const void *p, size_t n, uint64_t seed) {
+        const uint8_t *q = p;
+        uint64_t a, b;
+        size_t l = n;
+
+        seed ^= mix(seed ^ P0, P1);
+
+        for (; l > 16; l -= 16, q += 16)
+                seed = mix(unaligned_read_ne64(q) ^ P1, unaligned_read_ne64(q + 8) ^ seed);
+
+        /* Read the remaining 0…16 bytes as two (possibly overlapping) words */
+        if (l > 8) {
+                a = unaligned_read_ne64(q);
+                b = unaligned_read_ne64(q + l - 8);
+        } else if (l >= 4) {
+                a = unaligned_read_ne32(q);
+                b = unaligned_read_ne32(q + l - 4);
+        } else if (l > 0) {
+                a = ((uint64_t) q[0] << 16) | ((uint64_t) q[l / 2] << 8) | q[l - 1];
+                b = 0;
+        } else
+                a = b = 0;
+
+        return mix(P2 ^ n, mix(a ^ P1, b ^ seed));
+}
@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "macro.h"
+
+/* A keyed hash function in the style of wyhash, built on 64×64→128 bit multiplications. It is several times
+ * faster than SipHash for the short keys we usually deal with, but makes no promises about how hard it is to
+ * find colliding inputs. Hence only use it for hashmaps whose keys can't be chosen by untrusted parties, via
+ * the fast_*_hash_ops, and keep using SipHash for anything else. */
+
+uint64_t fast_hash(const void *p, size_t n, uint64_t seed) _pure_;
+
+static inline uint64_t fast_hash_string(const char *s, uint64_t seed) {
+        return fast_hash(s, strlen(s), seed);
+}
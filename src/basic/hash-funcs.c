@@ -2,6 +2,7 @@
 
 #include <string.h>
 
+#include "fast-hash.h"
 #include "hash-funcs.h"
 #include "path-util.h"
 
@@ -16,6 +17,31 @@ DEFINE_HASH_OPS_FULL(string_hash_ops_free_free,
                      char, string_hash_func, string_compare_func, free,
                      void, free);
 
+uint64_t string_fast_hash_func(const char *p, uint64_t seed) {
+        return fast_hash_string(p, seed);
+}
+
+const struct hash_ops fast_string_hash_ops = {
+        .hash = (hash_func_t) string_hash_func,
+        .compare = (compare_func_t) string_compare_func,
+        .fast_hash = (fast_hash_func_t) string_fast_hash_func,
+};
+
+const struct hash_ops fast_string_hash_ops_free = {
+        .hash = (hash_func_t) string_hash_func,
+        .compare = (compare_func_t) string_compare_func,
+        .free_key = free,
+        .fast_hash = (fast_hash_func_t) string_fast_hash_func,
+};
+
+const struct hash_ops fast_string_hash_ops_free_free = {
+        .hash = (hash_func_t) string_hash_func,
+        .compare = (compare_func_t) string_compare_func,
+        .free_key = free,
+        .free_value = free,
+        .fast_hash = (fast_hash_func_t) string_fast_hash_func,
+};
+
 void path_hash_func(const char *q, struct siphash *state) {
         bool add_slash = false;
 
@@ -62,6 +88,43 @@ DEFINE_HASH_OPS_FULL(path_hash_ops_free_free,
                      char, path_hash_func, path_compare, free,
                      void, free);
 
+uint64_t path_fast_hash_func(const char *q, uint64_t seed) {
+        assert(q);
+
+        /* Same as path_hash_func(), but chains the hash values of the components instead of feeding them
+         * into a single SipHash state. The component lengths go into each of them, hence no need for the
+         * slashes in between. */
+
+        if (path_is_absolute(q))
+                seed = fast_hash("/", 1, seed);
+
+        for (;;) {
+                const char *e;
+                int r;
+
+                r = path_find_first_component(&q, true, &e);
+                if (r == 0)
+                        return seed;
+                if (r < 0)
+                        return fast_hash_string(q, seed);
+
+                seed = fast_hash(e, r, seed);
+        }
+}
+
+const struct hash_ops fast_path_hash_ops = {
+        .hash = (hash_func_t) path_hash_func,
+        .compare = (compare_func_t) path_compare,
+        .fast_hash = (fast_hash_func_t) path_fast_hash_func,
+};
+
+const struct hash_ops fast_path_hash_ops_free = {
+        .hash = (hash_func_t) path_hash_func,
+        .compare = (compare_func_t) path_compare,
+        .free_key = free,
+        .fast_hash = (fast_hash_func_t) path_fast_hash_func,
+};
+
 void trivial_hash_func(const void *p, struct siphash *state) {
         siphash24_compress(&p, sizeof(p), state);
 }
@@ -88,6 +151,16 @@ const struct hash_ops trivial_hash_ops_free_free = {
         .free_value = free,
 };
 
+uint64_t trivial_fast_hash_func(const void *p, uint64_t seed) {
+        return fast_hash(&p, sizeof(p), seed);
+}
+
+const struct hash_ops fast_trivial_hash_ops = {
+        .hash = trivial_hash_func,
+        .compare = trivial_compare_func,
+        .fast_hash = trivial_fast_hash_func,
+};
+
 void uint64_hash_func(const uint64_t *p, struct siphash *state) {
         siphash24_compress(p, sizeof(uint64_t), state);
 }
@@ -7,12 +7,16 @@
 
 typedef void (*hash_func_t)(const void *p, struct siphash *state);
 typedef int (*compare_func_t)(const void *a, const void *b);
+typedef uint64_t (*fast_hash_func_t)(const void *p, uint64_t seed);
 
 struct hash_ops {
         hash_func_t hash;
         compare_func_t compare;
         free_func_t free_key;
         free_func_t free_value;
+        /* If set, used instead of hash() and SipHash, see fast-hash.h. Only for keys not controlled by
+         * untrusted parties. */
+        fast_hash_func_t fast_hash;
 };
 
 #define _DEFINE_HASH_OPS(uq, name, type, hash_func, compare_func, free_key_func, free_value_func, scope) \
@@ -84,6 +88,17 @@ extern const struct hash_ops path_hash_ops;
 extern const struct hash_ops path_hash_ops_free;
 extern const struct hash_ops path_hash_ops_free_free;
 
+/* The same as string_hash_ops and path_hash_ops, but using fast_hash() instead of SipHash, for hashmaps
+ * with keys from trusted sources only, e.g. unit names or paths from the configuration. */
+uint64_t string_fast_hash_func(const char *p, uint64_t seed) _pure_;
+extern const struct hash_ops fast_string_hash_ops;
+extern const struct hash_ops fast_string_hash_ops_free;
+extern const struct hash_ops fast_string_hash_ops_free_free;
+
+uint64_t path_fast_hash_func(const char *p, uint64_t seed);
+extern const struct hash_ops fast_path_hash_ops;
+extern const struct hash_ops fast_path_hash_ops_free;
+
 /* This will compare the passed pointers directly, and will not dereference them. This is hence not useful for strings
  * or suchlike. */
 void trivial_hash_func(const void *p, struct siphash *state);
@@ -92,6 +107,9 @@ extern const struct hash_ops trivial_hash_ops;
 extern const struct hash_ops trivial_hash_ops_free;
 extern const struct hash_ops trivial_hash_ops_free_free;
 
+uint64_t trivial_fast_hash_func(const void *p, uint64_t seed) _const_;
+extern const struct hash_ops fast_trivial_hash_ops;
+
 /* 32bit values we can always just embed in the pointer itself, but in order to support 32bit archs we need store 64bit
  * values indirectly, since they don't fit in a pointer. */
 void uint64_hash_func(const uint64_t *p, struct siphash *state);
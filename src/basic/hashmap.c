@@ -19,6 +19,7 @@
 #include "siphash24.h"
 #include "string-util.h"
 #include "strv.h"
+#include "unaligned.h"
 
 #if ENABLE_DEBUG_HASHMAP
 #include "list.h"
@@ -66,6 +67,16 @@
  * - Short summary of random vs. linear probing, and tombstones vs. backward shift.
  */
 
+/*
+ * Each bucket has a byte of metadata, its DIB (see below). Indirectly stored
+ * hashmaps have another one with the top bits of the hash value of the entry
+ * in it, its tag. Lookups only look at an entry's key if both its DIB and its
+ * tag match the key looked for. This way most lookups of keys not in the
+ * hashmap never touch the keys in it, whose comparison function
+ * (e.g. strcmp()) would likely incur another cache miss per bucket.
+ * Direct storage is too small for the tags to pay off.
+ */
+
 /*
  * XXX Ideas for improvement:
  * For unordered hashmaps, randomize iteration order, similarly to Perl:
@@ -116,6 +127,7 @@ assert_cc(IDX_FIRST == _IDX_ITERATOR_FIRST);
  * All entry types can fit into an ordered_hashmap_entry. */
 struct swap_entries {
         struct ordered_hashmap_entry e[_IDX_SWAP_END - _IDX_SWAP_BEGIN];
+        uint8_t tags[_IDX_SWAP_END - _IDX_SWAP_BEGIN];
 };
 
 /* Distance from Initial Bucket */
@@ -127,6 +139,15 @@ typedef uint8_t dib_raw_t;
 
 #define DIB_FREE UINT_MAX
 
+/* Top bits of the hash value of the entry in a bucket */
+typedef uint8_t tag_raw_t;
+
+/* Where an entry belongs, and its tag */
+struct hash_info {
+        unsigned idx;
+        tag_raw_t tag;
+};
+
 #if ENABLE_DEBUG_HASHMAP
 struct hashmap_debug_info {
         LIST_FIELDS(struct hashmap_debug_info, debug_list);
@@ -156,7 +177,7 @@ enum HashmapType {
 };
 
 struct _packed_ indirect_storage {
-        void *storage;                     /* where buckets and DIBs are stored */
+        void *storage;                     /* where buckets, DIBs and tags are stored */
         uint8_t  hash_key[HASH_KEY_SIZE];  /* hash key; changes during resize */
 
         unsigned n_entries;                /* number of stored entries */
@@ -333,17 +354,26 @@ static uint8_t* hash_key(HashmapBase *h) {
                                : shared_hash_key;
 }
 
-static unsigned base_bucket_hash(HashmapBase *h, const void *p) {
+static struct hash_info base_bucket_hash(HashmapBase *h, const void *p) {
         struct siphash state;
         uint64_t hash;
 
-        siphash24_init(&state, hash_key(h));
+        if (h->hash_ops->fast_hash)
+                hash = h->hash_ops->fast_hash(p, unaligned_read_ne64(hash_key(h)));
+        else {
+                siphash24_init(&state, hash_key(h));
 
-        h->hash_ops->hash(p, &state);
+                h->hash_ops->hash(p, &state);
 
-        hash = siphash24_finalize(&state);
+                hash = siphash24_finalize(&state);
+        }
 
-        return (unsigned) (hash % n_buckets(h));
+        /* Map the lower 32 bits onto the buckets by multiplication instead of the much slower division, the
+         * number of buckets is not a power of two. Take the tag from the top bits, which are unrelated. */
+        return (struct hash_info) {
+                .idx = (unsigned) (((hash & UINT32_MAX) * n_buckets(h)) >> 32),
+                .tag = (tag_raw_t) (hash >> 56),
+        };
 }
 #define bucket_hash(h, p) base_bucket_hash(HASHMAP_BASE(h), p)
 
@@ -410,6 +440,21 @@ static dib_raw_t* dib_raw_ptr(HashmapBase *h) {
                 ((uint8_t*) storage_ptr(h) + hashmap_type_info[h->type].entry_size * n_buckets(h));
 }
 
+/* Only indirect storage has tags, stored after the DIBs */
+static tag_raw_t* tag_raw_ptr(HashmapBase *h) {
+        return h->has_indirect ? (tag_raw_t*) (dib_raw_ptr(h) + n_buckets(h)) : NULL;
+}
+
+static tag_raw_t* bucket_tag_at_virtual(HashmapBase *h, struct swap_entries *swap, unsigned idx) {
+        tag_raw_t *tags;
+
+        if (idx >= _IDX_SWAP_BEGIN)
+                return &swap->tags[idx - _IDX_SWAP_BEGIN];
+
+        tags = tag_raw_ptr(h);
+        return tags ? &tags[idx] : NULL;
+}
+
 static unsigned bucket_distance(HashmapBase *h, unsigned idx, unsigned from) {
         return idx >= from ? idx - from
                            : n_buckets(h) + idx - from;
@@ -434,7 +479,7 @@ static unsigned bucket_calculate_dib(HashmapBase *h, unsigned idx, dib_raw_t raw
          * This returns the correct DIB value by recomputing the hash value in
          * the unlikely case. XXX Hitting this case could be a hint to rehash.
          */
-        initial_bucket = bucket_hash(h, bucket_at(h, idx)->key);
+        initial_bucket = bucket_hash(h, bucket_at(h, idx)->key).idx;
         return bucket_distance(h, idx, initial_bucket);
 }
 
@@ -462,6 +507,7 @@ static void bucket_mark_free(HashmapBase *h, unsigned idx) {
 static void bucket_move_entry(HashmapBase *h, struct swap_entries *swap,
                               unsigned from, unsigned to) {
         struct hashmap_base_entry *e_from, *e_to;
+        tag_raw_t *t_from, *t_to;
 
         assert(from != to);
 
@@ -470,6 +516,11 @@ static void bucket_move_entry(HashmapBase *h, struct swap_entries *swap,
 
         memcpy(e_to, e_from, hashmap_type_info[h->type].entry_size);
 
+        t_from = bucket_tag_at_virtual(h, swap, from);
+        t_to   = bucket_tag_at_virtual(h, swap, to);
+        if (t_from && t_to)
+                *t_to = *t_from;
+
         if (h->type == HASHMAP_TYPE_ORDERED) {
                 OrderedHashmap *lh = (OrderedHashmap*) h;
                 struct ordered_hashmap_entry *le, *le_to;
@@ -496,11 +547,11 @@ static void bucket_move_entry(HashmapBase *h, struct swap_entries *swap,
 }
 
 static unsigned next_idx(HashmapBase *h, unsigned idx) {
-        return (idx + 1U) % n_buckets(h);
+        return idx + 1U < n_buckets(h) ? idx + 1U : 0;
 }
 
 static unsigned prev_idx(HashmapBase *h, unsigned idx) {
-        return (n_buckets(h) + idx - 1U) % n_buckets(h);
+        return idx > 0 ? idx - 1U : n_buckets(h) - 1U;
 }
 
 static void* entry_value(HashmapBase *h, struct hashmap_base_entry *e) {
@@ -1005,12 +1056,12 @@ static bool hashmap_put_robin_hood(HashmapBase *h, unsigned idx,
  *          -ENOMEM if may_resize==true and resize failed with -ENOMEM.
  *          Cannot return -ENOMEM if !may_resize.
  */
-static int hashmap_base_put_boldly(HashmapBase *h, unsigned idx,
+static int hashmap_base_put_boldly(HashmapBase *h, struct hash_info hash,
                                    struct swap_entries *swap, bool may_resize) {
         struct ordered_hashmap_entry *new_entry;
         int r;
 
-        assert(idx < n_buckets(h));
+        assert(hash.idx < n_buckets(h));
 
         new_entry = bucket_at_swap(swap, IDX_PUT);
 
@@ -1019,10 +1070,12 @@ static int hashmap_base_put_boldly(HashmapBase *h, unsigned idx,
                 if (r < 0)
                         return r;
                 if (r > 0)
-                        idx = bucket_hash(h, new_entry->p.b.key);
+                        hash = bucket_hash(h, new_entry->p.b.key);
         }
         assert(n_entries(h) < n_buckets(h));
 
+        swap->tags[IDX_PUT - _IDX_SWAP_BEGIN] = hash.tag;
+
         if (h->type == HASHMAP_TYPE_ORDERED) {
                 OrderedHashmap *lh = (OrderedHashmap*) h;
 
@@ -1042,7 +1095,7 @@ static int hashmap_base_put_boldly(HashmapBase *h, unsigned idx,
                         lh->iterate_list_head = IDX_PUT;
         }
 
-        assert_se(hashmap_put_robin_hood(h, idx, swap) == false);
+        assert_se(hashmap_put_robin_hood(h, hash.idx, swap) == false);
 
         n_entries_inc(h);
 #if ENABLE_DEBUG_HASHMAP
@@ -1053,8 +1106,8 @@ static int hashmap_base_put_boldly(HashmapBase *h, unsigned idx,
 
         return 1;
 }
-#define hashmap_put_boldly(h, idx, swap, may_resize) \
-        hashmap_base_put_boldly(HASHMAP_BASE(h), idx, swap, may_resize)
+#define hashmap_put_boldly(h, hash, swap, may_resize) \
+        hashmap_base_put_boldly(HASHMAP_BASE(h), hash, swap, may_resize)
 
 /*
  * Returns 0 if resize is not needed.
@@ -1065,8 +1118,10 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
         struct swap_entries swap;
         void *new_storage;
         dib_raw_t *old_dibs, *new_dibs;
+        tag_raw_t *new_tags;
         const struct hashmap_type_info *hi;
-        unsigned idx, optimal_idx;
+        struct hash_info optimal;
+        unsigned idx;
         unsigned old_n_buckets, new_n_buckets, n_rehashed, new_n_entries;
         uint8_t new_shift;
         bool rehash_next;
@@ -1093,7 +1148,7 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
         if (_unlikely_(new_n_buckets < new_n_entries))
                 return -ENOMEM;
 
-        if (_unlikely_(new_n_buckets > UINT_MAX / (hi->entry_size + sizeof(dib_raw_t))))
+        if (_unlikely_(new_n_buckets > UINT_MAX / (hi->entry_size + sizeof(dib_raw_t) + sizeof(tag_raw_t))))
                 return -ENOMEM;
 
         old_n_buckets = n_buckets(h);
@@ -1102,10 +1157,10 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
                 return 0;
 
         new_shift = log2u_round_up(MAX(
-                        new_n_buckets * (hi->entry_size + sizeof(dib_raw_t)),
+                        new_n_buckets * (hi->entry_size + sizeof(dib_raw_t) + sizeof(tag_raw_t)),
                         2 * sizeof(struct direct_storage)));
 
-        /* Realloc storage (buckets and DIB array). */
+        /* Realloc storage (buckets, DIB and tag arrays). */
         new_storage = realloc(h->has_indirect ? h->indirect.storage : NULL,
                               1U << new_shift);
         if (!new_storage)
@@ -1128,16 +1183,19 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
         h->has_indirect = true;
         h->indirect.storage = new_storage;
         h->indirect.n_buckets = (1U << new_shift) /
-                                (hi->entry_size + sizeof(dib_raw_t));
+                                (hi->entry_size + sizeof(dib_raw_t) + sizeof(tag_raw_t));
 
         old_dibs = (dib_raw_t*)((uint8_t*) new_storage + hi->entry_size * old_n_buckets);
         new_dibs = dib_raw_ptr(h);
+        new_tags = tag_raw_ptr(h);
 
         /*
          * Move the DIB array to the new place, replacing valid DIB values with
          * DIB_RAW_REHASH to indicate all of the used buckets need rehashing.
          * Note: Overlap is not possible, because we have at least doubled the
          * number of buckets and dib_raw_t is smaller than any entry type.
+         * The old tags are of no use anymore, all of them are recalculated
+         * with the new hash key below.
          */
         for (idx = 0; idx < old_n_buckets; idx++) {
                 assert(old_dibs[idx] != DIB_RAW_REHASH);
@@ -1145,7 +1203,7 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
                                                               : DIB_RAW_REHASH;
         }
 
-        /* Zero the area of newly added entries (including the old DIB area) */
+        /* Zero the area of newly added entries (including the old DIB and tag area) */
         memzero(bucket_at(h, old_n_buckets),
                (n_buckets(h) - old_n_buckets) * hi->entry_size);
 
@@ -1159,14 +1217,15 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
                 if (new_dibs[idx] != DIB_RAW_REHASH)
                         continue;
 
-                optimal_idx = bucket_hash(h, bucket_at(h, idx)->key);
+                optimal = bucket_hash(h, bucket_at(h, idx)->key);
 
                 /*
                  * Not much to do if by luck the entry hashes to its current
-                 * location. Just set its DIB.
+                 * location. Just set its DIB and tag.
                  */
-                if (optimal_idx == idx) {
+                if (optimal.idx == idx) {
                         new_dibs[idx] = 0;
+                        new_tags[idx] = optimal.tag;
                         n_rehashed++;
                         continue;
                 }
@@ -1181,12 +1240,13 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
                          * Find the new bucket for the current entry. This may make
                          * another entry homeless and load it into IDX_PUT.
                          */
-                        rehash_next = hashmap_put_robin_hood(h, optimal_idx, &swap);
+                        swap.tags[IDX_PUT - _IDX_SWAP_BEGIN] = optimal.tag;
+                        rehash_next = hashmap_put_robin_hood(h, optimal.idx, &swap);
                         n_rehashed++;
 
                         /* Did the current entry displace another one? */
                         if (rehash_next)
-                                optimal_idx = bucket_hash(h, bucket_at_swap(&swap, IDX_PUT)->p.b.key);
+                                optimal = bucket_hash(h, bucket_at_swap(&swap, IDX_PUT)->p.b.key);
                 } while (rehash_next);
         }
 
@@ -1199,10 +1259,11 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
  * Finds an entry with a matching key
  * Returns: index of the found entry, or IDX_NIL if not found.
  */
-static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key) {
+static unsigned base_bucket_scan(HashmapBase *h, struct hash_info hash, const void *key) {
         struct hashmap_base_entry *e;
-        unsigned dib, distance;
+        unsigned dib, distance, idx = hash.idx;
         dib_raw_t *dibs = dib_raw_ptr(h);
+        tag_raw_t *tags = tag_raw_ptr(h);
 
         assert(idx < n_buckets(h));
 
@@ -1214,7 +1275,7 @@ static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key)
 
                 if (dib < distance)
                         return IDX_NIL;
-                if (dib == distance) {
+                if (dib == distance && (!tags || tags[idx] == hash.tag)) {
                         e = bucket_at(h, idx);
                         if (h->hash_ops->compare(e->key, key) == 0)
                                 return idx;
@@ -1223,12 +1284,13 @@ static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key)
                 idx = next_idx(h, idx);
         }
 }
-#define bucket_scan(h, idx, key) base_bucket_scan(HASHMAP_BASE(h), idx, key)
+#define bucket_scan(h, hash, key) base_bucket_scan(HASHMAP_BASE(h), hash, key)
 
 int hashmap_put(Hashmap *h, const void *key, void *value) {
         struct swap_entries swap;
         struct plain_hashmap_entry *e;
-        unsigned hash, idx;
+        struct hash_info hash;
+        unsigned idx;
 
         assert(h);
 
@@ -1250,7 +1312,8 @@ int hashmap_put(Hashmap *h, const void *key, void *value) {
 int set_put(Set *s, const void *key) {
         struct swap_entries swap;
         struct hashmap_base_entry *e;
-        unsigned hash, idx;
+        struct hash_info hash;
+        unsigned idx;
 
         assert(s);
 
@@ -1291,7 +1354,8 @@ int _set_ensure_consume(Set **s, const struct hash_ops *hash_ops, void *key  HAS
 int hashmap_replace(Hashmap *h, const void *key, void *value) {
         struct swap_entries swap;
         struct plain_hashmap_entry *e;
-        unsigned hash, idx;
+        struct hash_info hash;
+        unsigned idx;
 
         assert(h);
 
@@ -1324,7 +1388,8 @@ int hashmap_replace(Hashmap *h, const void *key, void *value) {
 
 int hashmap_update(Hashmap *h, const void *key, void *value) {
         struct plain_hashmap_entry *e;
-        unsigned hash, idx;
+        struct hash_info hash;
+        unsigned idx;
 
         assert(h);
 
@@ -1342,7 +1407,8 @@ int hashmap_update(Hashmap *h, const void *key, void *value) {
 
 void* _hashmap_get(HashmapBase *h, const void *key) {
         struct hashmap_base_entry *e;
-        unsigned hash, idx;
+        struct hash_info hash;
+        unsigned idx;
 
         if (!h)
                 return NULL;
@@ -1358,7 +1424,8 @@ void* _hashmap_get(HashmapBase *h, const void *key) {
 
 void* hashmap_get2(Hashmap *h, const void *key, void **key2) {
         struct plain_hashmap_entry *e;
-        unsigned hash, idx;
+        struct hash_info hash;
+        unsigned idx;
 
         if (!h)
                 return NULL;
@@ -1376,7 +1443,7 @@ void* hashmap_get2(Hashmap *h, const void *key, void **key2) {
 }
 
 bool _hashmap_contains(HashmapBase *h, const void *key) {
-        unsigned hash;
+        struct hash_info hash;
 
         if (!h)
                 return false;
@@ -1387,7 +1454,8 @@ bool _hashmap_contains(HashmapBase *h, const void *key) {
 
 void* _hashmap_remove(HashmapBase *h, const void *key) {
         struct hashmap_base_entry *e;
-        unsigned hash, idx;
+        struct hash_info hash;
+        unsigned idx;
         void *data;
 
         if (!h)
@@ -1407,7 +1475,8 @@ void* _hashmap_remove(HashmapBase *h, const void *key) {
 
 void* hashmap_remove2(Hashmap *h, const void *key, void **rkey) {
         struct plain_hashmap_entry *e;
-        unsigned hash, idx;
+        struct hash_info hash;
+        unsigned idx;
         void *data;
 
         if (!h) {
@@ -1437,7 +1506,8 @@ void* hashmap_remove2(Hashmap *h, const void *key, void **rkey) {
 int hashmap_remove_and_put(Hashmap *h, const void *old_key, const void *new_key, void *value) {
         struct swap_entries swap;
         struct plain_hashmap_entry *e;
-        unsigned old_hash, new_hash, idx;
+        struct hash_info old_hash, new_hash;
+        unsigned idx;
 
         if (!h)
                 return -ENOENT;
@@ -1464,7 +1534,8 @@ int hashmap_remove_and_put(Hashmap *h, const void *old_key, const void *new_key,
 int set_remove_and_put(Set *s, const void *old_key, const void *new_key) {
         struct swap_entries swap;
         struct hashmap_base_entry *e;
-        unsigned old_hash, new_hash, idx;
+        struct hash_info old_hash, new_hash;
+        unsigned idx;
 
         if (!s)
                 return -ENOENT;
@@ -1490,7 +1561,8 @@ int set_remove_and_put(Set *s, const void *old_key, const void *new_key) {
 int hashmap_remove_and_replace(Hashmap *h, const void *old_key, const void *new_key, void *value) {
         struct swap_entries swap;
         struct plain_hashmap_entry *e;
-        unsigned old_hash, new_hash, idx_old, idx_new;
+        struct hash_info old_hash, new_hash;
+        unsigned idx_old, idx_new;
 
         if (!h)
                 return -ENOENT;
@@ -1525,7 +1597,8 @@ int hashmap_remove_and_replace(Hashmap *h, const void *old_key, const void *new_
 
 void* _hashmap_remove_value(HashmapBase *h, const void *key, void *value) {
         struct hashmap_base_entry *e;
-        unsigned hash, idx;
+        struct hash_info hash;
+        unsigned idx;
 
         if (!h)
                 return NULL;
@@ -1671,7 +1744,7 @@ int _hashmap_move(HashmapBase *h, HashmapBase *other) {
                 return r;
 
         HASHMAP_FOREACH_IDX(idx, other, i) {
-                unsigned h_hash;
+                struct hash_info h_hash;
 
                 e = bucket_at(other, idx);
                 h_hash = bucket_hash(h, e->key);
@@ -1693,7 +1766,8 @@ int _hashmap_move(HashmapBase *h, HashmapBase *other) {
 
 int _hashmap_move_one(HashmapBase *h, HashmapBase *other, const void *key) {
         struct swap_entries swap;
-        unsigned h_hash, other_hash, idx;
+        struct hash_info h_hash, other_hash;
+        unsigned idx;
         struct hashmap_base_entry *e, *n;
         int r;
 
@@ -1778,7 +1852,8 @@ char** _hashmap_get_strv(HashmapBase *h) {
 
 void* ordered_hashmap_next(OrderedHashmap *h, const void *key) {
         struct ordered_hashmap_entry *e;
-        unsigned hash, idx;
+        struct hash_info hash;
+        unsigned idx;
 
         if (!h)
                 return NULL;
@@ -90,6 +90,7 @@ struct iovec_wrapper {
 struct iovec_wrapper *iovw_new(void);
 struct iovec_wrapper *iovw_free(struct iovec_wrapper *iovw);
 struct iovec_wrapper *iovw_free_free(struct iovec_wrapper *iovw);
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct iovec_wrapper*, iovw_free_free);
 void iovw_free_contents(struct iovec_wrapper *iovw, bool free_vectors);
 int iovw_put(struct iovec_wrapper *iovw, void *data, size_t len);
 int iovw_put_string_field(struct iovec_wrapper *iovw, const char *field, const char *value);
@@ -39,6 +39,19 @@
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+#define LOG_BUFFER_SIZE (64U*1024U)
+#define LOG_BUFFER_MESSAGES_MAX 128U
+
+typedef struct LogBuffer {
+        pid_t pid; /* The process that turned buffering on, children inherit a copy across fork() */
+        unsigned n_dropped;
+        size_t n_messages;
+        size_t size;
+        struct iovec iovec[LOG_BUFFER_MESSAGES_MAX];
+        struct mmsghdr mmsghdr[LOG_BUFFER_MESSAGES_MAX];
+        char data[LOG_BUFFER_SIZE];
+} LogBuffer;
+
 static log_syntax_callback_t log_syntax_callback = NULL;
 static void *log_syntax_callback_userdata = NULL;
 
@@ -63,6 +76,10 @@ static bool always_reopen_console = false;
 static bool open_when_needed = false;
 static bool prohibit_ipc = false;
 
+/* Journal messages collected for sending them in one go, see log_set_buffered(). Per thread, so that no
+ * locking is needed. */
+static thread_local LogBuffer *log_buffer = NULL;
+
 /* Akin to glibc's __abort_msg; which is private and we hence cannot
  * use here. */
 static char *log_abort_msg = NULL;
@@ -335,6 +352,8 @@ void log_set_target(LogTarget target) {
 void log_close(void) {
         /* Do not call from library code. */
 
+        log_flush();
+
         log_close_journal();
         log_close_syslog();
         log_close_kmsg();
@@ -624,6 +643,108 @@ static int write_to_journal(
         return 1;
 }
 
+static bool log_buffer_inherited(void) {
+        assert(log_buffer);
+
+        if (log_buffer->pid == getpid_cached())
+                return false;
+
+        /* We are a child process. The messages in the buffer are for the parent to send, and since children
+         * commonly leave via _exit(), we don't buffer anything here. */
+        log_buffer = mfree(log_buffer);
+        return true;
+}
+
+void log_flush(void) {
+        size_t sent = 0;
+
+        if (!log_buffer || log_buffer->n_messages == 0)
+                return;
+
+        PROTECT_ERRNO;
+
+        if (log_buffer_inherited())
+                return;
+
+        for (size_t i = 0; i < log_buffer->n_messages; i++)
+                log_buffer->mmsghdr[i] = (struct mmsghdr) {
+                        .msg_hdr.msg_iov = log_buffer->iovec + i,
+                        .msg_hdr.msg_iovlen = 1,
+                };
+
+        while (journal_fd >= 0 && sent < log_buffer->n_messages) {
+                int k;
+
+                k = sendmmsg(journal_fd, log_buffer->mmsghdr + sent, log_buffer->n_messages - sent, MSG_NOSIGNAL);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno != EAGAIN)
+                                log_close_journal();
+                        break;
+                }
+
+                sent += k;
+        }
+
+        log_buffer->n_dropped += log_buffer->n_messages - sent;
+        log_buffer->n_messages = log_buffer->size = 0;
+
+        if (log_buffer->n_dropped > 0 && journal_fd >= 0) {
+                char buffer[LINE_MAX];
+
+                xsprintf(buffer, "Dropped %u log messages, as the journal did not take them in time.", log_buffer->n_dropped);
+                if (write_to_journal(LOG_WARNING|log_facility, 0, PROJECT_FILE, __LINE__, __func__,
+                                     NULL, NULL, NULL, NULL, buffer) > 0)
+                        log_buffer->n_dropped = 0;
+        }
+}
+
+static int buffer_to_journal(
+                int level,
+                int error,
+                const char *file,
+                int line,
+                const char *func,
+                const char *object_field,
+                const char *object,
+                const char *extra_field,
+                const char *extra,
+                const char *buffer) {
+
+        char header[LINE_MAX], *p;
+        size_t n;
+
+        assert_raw(log_buffer);
+
+        if (journal_fd < 0)
+                return 0;
+
+        if (log_buffer_inherited())
+                return write_to_journal(level, error, file, line, func, object_field, object, extra_field, extra, buffer);
+
+        log_do_header(header, sizeof(header), level, error, file, line, func, object_field, object, extra_field, extra);
+
+        n = strlen(header) + STRLEN("MESSAGE=") + strlen(buffer) + 1;
+        if (n > LOG_BUFFER_SIZE) {
+                /* Doesn't fit at all, send it right away, but keep the order */
+                log_flush();
+                return write_to_journal(level, error, file, line, func, object_field, object, extra_field, extra, buffer);
+        }
+
+        if (log_buffer->n_messages >= LOG_BUFFER_MESSAGES_MAX || log_buffer->size + n > LOG_BUFFER_SIZE)
+                log_flush();
+
+        p = log_buffer->data + log_buffer->size;
+        log_buffer->iovec[log_buffer->n_messages++] = IOVEC_MAKE(p, n);
+        log_buffer->size += n;
+
+        p = stpcpy(stpcpy(stpcpy(p, header), "MESSAGE="), buffer);
+        *p = '\n';
+
+        return 1;
+}
+
 int log_dispatch_internal(
                 int level,
                 int error,
@@ -664,7 +785,10 @@ int log_dispatch_internal(
                                        LOG_TARGET_JOURNAL_OR_KMSG,
                                        LOG_TARGET_JOURNAL)) {
 
-                        k = write_to_journal(level, error, file, line, func, object_field, object, extra_field, extra, buffer);
+                        if (log_buffer && !open_when_needed)
+                                k = buffer_to_journal(level, error, file, line, func, object_field, object, extra_field, extra, buffer);
+                        else
+                                k = write_to_journal(level, error, file, line, func, object_field, object, extra_field, extra, buffer);
                         if (k < 0 && k != -EAGAIN)
                                 log_close_journal();
                 }
@@ -699,6 +823,10 @@ int log_dispatch_internal(
                 buffer = e;
         } while (buffer);
 
+        /* Don't keep back anything important */
+        if (log_buffer && LOG_PRI(level) <= LOG_WARNING)
+                log_flush();
+
         if (open_when_needed)
                 log_close();
 
@@ -1205,6 +1333,10 @@ void log_parse_environment_variables(void) {
         e = getenv("SYSTEMD_LOG_TID");
         if (e && log_show_tid_from_string(e) < 0)
                 log_warning("Failed to parse log tid '%s'. Ignoring.", e);
+
+        e = getenv("SYSTEMD_LOG_BUFFERED");
+        if (e && log_set_buffered_from_string(e) < 0)
+                log_warning("Failed to parse log buffering '%s'. Ignoring.", e);
 }
 
 void log_parse_environment(void) {
@@ -1300,6 +1432,17 @@ int log_show_tid_from_string(const char *e) {
         return 0;
 }
 
+int log_set_buffered_from_string(const char *e) {
+        int t;
+
+        t = parse_boolean(e);
+        if (t < 0)
+                return t;
+
+        log_set_buffered(t);
+        return 0;
+}
+
 bool log_on_console(void) {
         if (IN_SET(log_target, LOG_TARGET_CONSOLE,
                                LOG_TARGET_CONSOLE_PREFIXED))
@@ -1465,6 +1608,30 @@ void log_set_prohibit_ipc(bool b) {
         prohibit_ipc = b;
 }
 
+void log_set_buffered(bool b) {
+        static bool registered = false;
+
+        if (!b) {
+                log_flush();
+                log_buffer = mfree(log_buffer);
+                return;
+        }
+
+        if (log_buffer)
+                return;
+
+        /* If this fails we simply keep logging unbuffered */
+        log_buffer = new0(LogBuffer, 1);
+        if (!log_buffer)
+                return;
+
+        log_buffer->pid = getpid_cached();
+
+        /* Make sure nothing is lost when the program returns from main() or calls exit() */
+        if (!registered && atexit(log_flush) == 0)
+                registered = true;
+}
+
 int log_emergency_level(void) {
         /* Returns the log level to use for log_emergency() logging. We use LOG_EMERG only when we are PID 1, as only
          * then the system of the whole system is obviously affected. */
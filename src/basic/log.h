@@ -70,6 +70,7 @@ int log_show_color_from_string(const char *e);
 int log_show_location_from_string(const char *e);
 int log_show_time_from_string(const char *e);
 int log_show_tid_from_string(const char *e);
+int log_set_buffered_from_string(const char *e);
 
 /* Functions below that open and close logs or configure logging based on the
  * environment should not be called from library code — this is always a job
@@ -325,6 +326,13 @@ void log_set_open_when_needed(bool b);
  * stderr, the console or kmsg */
 void log_set_prohibit_ipc(bool b);
 
+/* If turned on, messages to the journal are collected in a buffer of the calling thread and sent in batches
+ * when it is full, when a message of LOG_WARNING or higher priority is logged, when log_flush() is called
+ * (which sd-event does before it goes to sleep), and on exit. Messages the journal does not accept in time are
+ * dropped and counted, and a message about them is logged later. */
+void log_set_buffered(bool b);
+void log_flush(void);
+
 int log_dup_console(void);
 
 int log_syntax_internal(
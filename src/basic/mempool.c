@@ -3,9 +3,12 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "alloc-util.h"
+#include "log.h"
 #include "macro.h"
 #include "memory-util.h"
 #include "mempool.h"
+#include "string-util.h"
 
 struct pool {
         struct pool *next;
@@ -27,6 +30,7 @@ void* mempool_alloc_tile(struct mempool *mp) {
 
                 r = mp->freelist;
                 mp->freelist = * (void**) mp->freelist;
+                mp->n_used++;
                 return r;
         }
 
@@ -49,9 +53,11 @@ void* mempool_alloc_tile(struct mempool *mp) {
                 p->n_used = 0;
 
                 mp->first_pool = p;
+                mp->n_tiles += n;
         }
 
         i = mp->first_pool->n_used++;
+        mp->n_used++;
 
         return ((uint8_t*) mp->first_pool) + ALIGN(sizeof(struct pool)) + i*mp->tile_size;
 }
@@ -66,8 +72,89 @@ void* mempool_alloc0_tile(struct mempool *mp) {
 }
 
 void mempool_free_tile(struct mempool *mp, void *p) {
+        assert(mp->n_used > 0);
+
         * (void**) p = mp->freelist;
         mp->freelist = p;
+        mp->n_used--;
+}
+
+static bool pool_contains(struct mempool *mp, struct pool *p, void *tile) {
+        uint8_t *begin = (uint8_t*) p + ALIGN(sizeof(struct pool));
+
+        return (uint8_t*) tile >= begin && (uint8_t*) tile < begin + p->n_used * mp->tile_size;
+}
+
+size_t mempool_trim(struct mempool *mp) {
+        size_t released = 0, n_pools = 0, n_released = 0;
+
+        assert(mp);
+
+        /* A pool can go if all tiles carved from it so far are on the freelist. There are only a few pools,
+         * as each one is twice as large as the previous one, hence simply walk the freelist for each. */
+
+        for (struct pool **p = &mp->first_pool; *p; ) {
+                struct pool *pool = *p;
+                size_t n_free = 0;
+
+                n_pools++;
+
+                for (void *t = mp->freelist; t; t = * (void**) t)
+                        if (pool_contains(mp, pool, t))
+                                n_free++;
+
+                if (n_free < pool->n_used) {
+                        p = &pool->next;
+                        continue;
+                }
+
+                /* Unlink the pool's tiles from the freelist, then the pool itself */
+                for (void **t = &mp->freelist; *t; )
+                        if (pool_contains(mp, pool, *t))
+                                *t = * (void**) *t;
+                        else
+                                t = (void**) *t;
+
+                *p = pool->next;
+                mp->n_tiles -= pool->n_tiles;
+                released += PAGE_ALIGN(ALIGN(sizeof(struct pool)) + pool->n_tiles * mp->tile_size);
+                n_released++;
+                free(pool);
+        }
+
+        if (n_released > 0)
+                log_debug("Released %zu of %zu pools of %s (%zu bytes), %zu of %zu tiles in use.",
+                          n_released, n_pools, strna(mp->name), released, mp->n_used, mp->n_tiles);
+
+        return released;
+}
+
+void* mempool_alloc0_tile_or_malloc(struct mempool *mp, bool *ret_from_pool) {
+        void *p;
+
+        assert(ret_from_pool);
+
+        if (mempool_enabled && mempool_enabled()) {
+                p = mempool_alloc0_tile(mp);
+                *ret_from_pool = true;
+        } else {
+                p = malloc0(mp->tile_size);
+                *ret_from_pool = false;
+        }
+
+        return p;
+}
+
+void* mempool_free_tile_or_free(struct mempool *mp, void *p, bool from_pool) {
+        if (!p)
+                return NULL;
+
+        if (from_pool)
+                mempool_free_tile(mp, p);
+        else
+                free(p);
+
+        return NULL;
 }
 
 #if VALGRIND
@@ -11,20 +11,36 @@ struct mempool {
         void *freelist;
         size_t tile_size;
         unsigned at_least;
+        const char *name;
+
+        /* Statistics */
+        size_t n_tiles;   /* tiles in all pools */
+        size_t n_used;    /* tiles currently handed out */
 };
 
 void* mempool_alloc_tile(struct mempool *mp);
 void* mempool_alloc0_tile(struct mempool *mp);
 void mempool_free_tile(struct mempool *mp, void *p);
 
+/* Returns the memory of pools none of whose tiles are in use anymore to libc, returns the number of bytes
+ * released. Call this when a burst of allocations is over, e.g. after a transaction was processed. */
+size_t mempool_trim(struct mempool *mp);
+
 #define DEFINE_MEMPOOL(pool_name, tile_type, alloc_at_least) \
 static struct mempool pool_name = { \
         .tile_size = sizeof(tile_type), \
         .at_least = alloc_at_least, \
+        .name = #pool_name, \
 }
 
 __attribute__((weak)) bool mempool_enabled(void);
 
+/* For objects other than hashmaps: allocates a zeroed tile from the pool if the program enabled pools and we
+ * are on the main thread, and falls back to malloc() otherwise. The caller has to remember which one it was
+ * and pass it back on freeing, and must free objects from the pool on the main thread only. */
+void* mempool_alloc0_tile_or_malloc(struct mempool *mp, bool *ret_from_pool);
+void* mempool_free_tile_or_free(struct mempool *mp, void *p, bool from_pool);
+
 #if VALGRIND
 void mempool_drop(struct mempool *mp);
 #endif
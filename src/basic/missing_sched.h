@@ -7,6 +7,16 @@
 #define CLONE_NEWCGROUP 0x02000000
 #endif
 
+/* Added in Linux 5.2 */
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+
+/* Added in Linux 5.7, only accepted by clone3() */
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
 /* Not exposed yet. Defined at include/linux/sched.h */
 #ifndef PF_KTHREAD
 #define PF_KTHREAD 0x00200000
@@ -110,6 +110,74 @@ assert_cc(__NR_bpf == systemd_NR_bpf);
 #  endif
 #endif
 
+#ifndef __IGNORE_clone3
+#  if defined(__aarch64__)
+#    define systemd_NR_clone3 435
+#  elif defined(__alpha__)
+#    define systemd_NR_clone3 -1
+#  elif defined(__arc__) || defined(__tilegx__)
+#    define systemd_NR_clone3 435
+#  elif defined(__arm__)
+#    define systemd_NR_clone3 435
+#  elif defined(__i386__)
+#    define systemd_NR_clone3 435
+#  elif defined(__ia64__)
+#    define systemd_NR_clone3 -1
+#  elif defined(__loongarch64)
+#    define systemd_NR_clone3 435
+#  elif defined(__m68k__)
+#    define systemd_NR_clone3 435
+#  elif defined(_MIPS_SIM)
+#    if _MIPS_SIM == _MIPS_SIM_ABI32
+#      define systemd_NR_clone3 4435
+#    elif _MIPS_SIM == _MIPS_SIM_NABI32
+#      define systemd_NR_clone3 6435
+#    elif _MIPS_SIM == _MIPS_SIM_ABI64
+#      define systemd_NR_clone3 5435
+#    else
+#      error "Unknown MIPS ABI"
+#    endif
+#  elif defined(__hppa__)
+#    define systemd_NR_clone3 435
+#  elif defined(__powerpc__)
+#    define systemd_NR_clone3 435
+#  elif defined(__riscv)
+#    if __riscv_xlen == 32
+#      define systemd_NR_clone3 435
+#    elif __riscv_xlen == 64
+#      define systemd_NR_clone3 435
+#    else
+#      error "Unknown RISC-V ABI"
+#    endif
+#  elif defined(__s390__)
+#    define systemd_NR_clone3 435
+#  elif defined(__sparc__)
+#    define systemd_NR_clone3 -1
+#  elif defined(__x86_64__)
+#    if defined(__ILP32__)
+#      define systemd_NR_clone3 (435 | /* __X32_SYSCALL_BIT */ 0x40000000)
+#    else
+#      define systemd_NR_clone3 435
+#    endif
+#  elif !defined(missing_arch_template)
+#    warning "clone3() syscall number is unknown for your architecture"
+#  endif
+
+/* may be an (invalid) negative number due to libseccomp, see PR 13319 */
+#  if defined __NR_clone3 && __NR_clone3 >= 0
+#    if defined systemd_NR_clone3
+assert_cc(__NR_clone3 == systemd_NR_clone3);
+#    endif
+#  else
+#    if defined __NR_clone3
+#      undef __NR_clone3
+#    endif
+#    if defined systemd_NR_clone3 && systemd_NR_clone3 >= 0
+#      define __NR_clone3 systemd_NR_clone3
+#    endif
+#  endif
+#endif
+
 #ifndef __IGNORE_close_range
 #  if defined(__aarch64__)
 #    define systemd_NR_close_range 436
@@ -382,6 +450,142 @@ assert_cc(__NR_getrandom == systemd_NR_getrandom);
 #  endif
 #endif
 
+#ifndef __IGNORE_io_uring_enter
+#  if defined(__aarch64__)
+#    define systemd_NR_io_uring_enter 426
+#  elif defined(__alpha__)
+#    define systemd_NR_io_uring_enter 536
+#  elif defined(__arc__) || defined(__tilegx__)
+#    define systemd_NR_io_uring_enter 426
+#  elif defined(__arm__)
+#    define systemd_NR_io_uring_enter 426
+#  elif defined(__i386__)
+#    define systemd_NR_io_uring_enter 426
+#  elif defined(__ia64__)
+#    define systemd_NR_io_uring_enter 1450
+#  elif defined(__loongarch64)
+#    define systemd_NR_io_uring_enter 426
+#  elif defined(__m68k__)
+#    define systemd_NR_io_uring_enter 426
+#  elif defined(_MIPS_SIM)
+#    if _MIPS_SIM == _MIPS_SIM_ABI32
+#      define systemd_NR_io_uring_enter 4426
+#    elif _MIPS_SIM == _MIPS_SIM_NABI32
+#      define systemd_NR_io_uring_enter 6426
+#    elif _MIPS_SIM == _MIPS_SIM_ABI64
+#      define systemd_NR_io_uring_enter 5426
+#    else
+#      error "Unknown MIPS ABI"
+#    endif
+#  elif defined(__hppa__)
+#    define systemd_NR_io_uring_enter 426
+#  elif defined(__powerpc__)
+#    define systemd_NR_io_uring_enter 426
+#  elif defined(__riscv)
+#    if __riscv_xlen == 32
+#      define systemd_NR_io_uring_enter 426
+#    elif __riscv_xlen == 64
+#      define systemd_NR_io_uring_enter 426
+#    else
+#      error "Unknown RISC-V ABI"
+#    endif
+#  elif defined(__s390__)
+#    define systemd_NR_io_uring_enter 426
+#  elif defined(__sparc__)
+#    define systemd_NR_io_uring_enter 426
+#  elif defined(__x86_64__)
+#    if defined(__ILP32__)
+#      define systemd_NR_io_uring_enter (426 | /* __X32_SYSCALL_BIT */ 0x40000000)
+#    else
+#      define systemd_NR_io_uring_enter 426
+#    endif
+#  elif !defined(missing_arch_template)
+#    warning "io_uring_enter() syscall number is unknown for your architecture"
+#  endif
+
+/* may be an (invalid) negative number due to libseccomp, see PR 13319 */
+#  if defined __NR_io_uring_enter && __NR_io_uring_enter >= 0
+#    if defined systemd_NR_io_uring_enter
+assert_cc(__NR_io_uring_enter == systemd_NR_io_uring_enter);
+#    endif
+#  else
+#    if defined __NR_io_uring_enter
+#      undef __NR_io_uring_enter
+#    endif
+#    if defined systemd_NR_io_uring_enter && systemd_NR_io_uring_enter >= 0
+#      define __NR_io_uring_enter systemd_NR_io_uring_enter
+#    endif
+#  endif
+#endif
+
+#ifndef __IGNORE_io_uring_setup
+#  if defined(__aarch64__)
+#    define systemd_NR_io_uring_setup 425
+#  elif defined(__alpha__)
+#    define systemd_NR_io_uring_setup 535
+#  elif defined(__arc__) || defined(__tilegx__)
+#    define systemd_NR_io_uring_setup 425
+#  elif defined(__arm__)
+#    define systemd_NR_io_uring_setup 425
+#  elif defined(__i386__)
+#    define systemd_NR_io_uring_setup 425
+#  elif defined(__ia64__)
+#    define systemd_NR_io_uring_setup 1449
+#  elif defined(__loongarch64)
+#    define systemd_NR_io_uring_setup 425
+#  elif defined(__m68k__)
+#    define systemd_NR_io_uring_setup 425
+#  elif defined(_MIPS_SIM)
+#    if _MIPS_SIM == _MIPS_SIM_ABI32
+#      define systemd_NR_io_uring_setup 4425
+#    elif _MIPS_SIM == _MIPS_SIM_NABI32
+#      define systemd_NR_io_uring_setup 6425
+#    elif _MIPS_SIM == _MIPS_SIM_ABI64
+#      define systemd_NR_io_uring_setup 5425
+#    else
+#      error "Unknown MIPS ABI"
+#    endif
+#  elif defined(__hppa__)
+#    define systemd_NR_io_uring_setup 425
+#  elif defined(__powerpc__)
+#    define systemd_NR_io_uring_setup 425
+#  elif defined(__riscv)
+#    if __riscv_xlen == 32
+#      define systemd_NR_io_uring_setup 425
+#    elif __riscv_xlen == 64
+#      define systemd_NR_io_uring_setup 425
+#    else
+#      error "Unknown RISC-V ABI"
+#    endif
+#  elif defined(__s390__)
+#    define systemd_NR_io_uring_setup 425
+#  elif defined(__sparc__)
+#    define systemd_NR_io_uring_setup 425
+#  elif defined(__x86_64__)
+#    if defined(__ILP32__)
+#      define systemd_NR_io_uring_setup (425 | /* __X32_SYSCALL_BIT */ 0x40000000)
+#    else
+#      define systemd_NR_io_uring_setup 425
+#    endif
+#  elif !defined(missing_arch_template)
+#    warning "io_uring_setup() syscall number is unknown for your architecture"
+#  endif
+
+/* may be an (invalid) negative number due to libseccomp, see PR 13319 */
+#  if defined __NR_io_uring_setup && __NR_io_uring_setup >= 0
+#    if defined systemd_NR_io_uring_setup
+assert_cc(__NR_io_uring_setup == systemd_NR_io_uring_setup);
+#    endif
+#  else
+#    if defined __NR_io_uring_setup
+#      undef __NR_io_uring_setup
+#    endif
+#    if defined systemd_NR_io_uring_setup && systemd_NR_io_uring_setup >= 0
+#      define __NR_io_uring_setup systemd_NR_io_uring_setup
+#    endif
+#  endif
+#endif
+
 #ifndef __IGNORE_memfd_create
 #  if defined(__aarch64__)
 #    define systemd_NR_memfd_create 279
@@ -7,10 +7,13 @@ import functools
 # We only generate numbers for a dozen or so syscalls
 SYSCALLS = [
     'bpf',
+    'clone3',
     'close_range',
     'copy_file_range',
     'epoll_pwait2',
     'getrandom',
+    'io_uring_enter',
+    'io_uring_setup',
     'memfd_create',
     'mount_setattr',
     'move_mount',
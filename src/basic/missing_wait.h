@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <sys/wait.h>
+
+/* Added in Linux 5.4 */
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
@@ -7,7 +7,12 @@
  * priority. Insertion and removal are Θ(log n). Optionally, the caller can
  * provide a pointer to an index which will be kept up-to-date by the prioq.
  *
- * The underlying algorithm used in this implementation is a Heap.
+ * The underlying algorithm used in this implementation is a Heap. It's a 4-ary
+ * one rather than a binary one: that halves the number of levels, and hence
+ * of (cache missing) steps when moving items up and down, at the price of more
+ * comparisons per level going down, whose operands are all next to each other
+ * in memory though. Items are moved into the hole left by the item being
+ * shuffled, rather than swapped, hence each one is written once per step.
  */
 
 #include <errno.h>
@@ -22,6 +27,8 @@ struct prioq_item {
         unsigned *idx;
 };
 
+#define PRIOQ_ARITY 4U
+
 struct Prioq {
         compare_func_t compare_func;
         unsigned n_items, n_allocated;
@@ -64,110 +71,122 @@ int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func) {
         return 0;
 }
 
-static void swap(Prioq *q, unsigned j, unsigned k) {
+static void set_item(Prioq *q, unsigned k, struct prioq_item item) {
         assert(q);
-        assert(j < q->n_items);
         assert(k < q->n_items);
 
-        assert(!q->items[j].idx || *(q->items[j].idx) == j);
-        assert(!q->items[k].idx || *(q->items[k].idx) == k);
-
-        SWAP_TWO(q->items[j].data, q->items[k].data);
-        SWAP_TWO(q->items[j].idx, q->items[k].idx);
-
-        if (q->items[j].idx)
-                *q->items[j].idx = j;
-
-        if (q->items[k].idx)
-                *q->items[k].idx = k;
+        q->items[k] = item;
+        if (item.idx)
+                *item.idx = k;
 }
 
 static unsigned shuffle_up(Prioq *q, unsigned idx) {
+        struct prioq_item i;
+
         assert(q);
         assert(idx < q->n_items);
 
+        i = q->items[idx];
+
         while (idx > 0) {
                 unsigned k;
 
-                k = (idx-1)/2;
+                k = (idx - 1) / PRIOQ_ARITY; /* parent */
 
-                if (q->compare_func(q->items[k].data, q->items[idx].data) <= 0)
+                if (q->compare_func(q->items[k].data, i.data) <= 0)
                         break;
 
-                swap(q, idx, k);
+                set_item(q, idx, q->items[k]);
                 idx = k;
         }
 
+        set_item(q, idx, i);
         return idx;
 }
 
 static unsigned shuffle_down(Prioq *q, unsigned idx) {
+        struct prioq_item i;
+
         assert(q);
+        assert(idx < q->n_items);
+
+        i = q->items[idx];
 
         for (;;) {
                 unsigned j, k, s;
+                void *smallest;
 
-                k = (idx+1)*2; /* right child */
-                j = k-1;       /* left child */
-
-                if (j >= q->n_items)
-                        break;
-
-                if (q->compare_func(q->items[j].data, q->items[idx].data) < 0)
-
-                        /* So our left child is smaller than we are, let's
-                         * remember this fact */
-                        s = j;
-                else
-                        s = idx;
+                /* Written this way, to not overflow for huge indexes */
+                if (idx >= (q->n_items - 1 + PRIOQ_ARITY - 1) / PRIOQ_ARITY)
+                        break; /* No children */
 
-                if (k < q->n_items &&
-                    q->compare_func(q->items[k].data, q->items[s].data) < 0)
+                j = idx * PRIOQ_ARITY + 1; /* first child */
+                k = MIN(j + PRIOQ_ARITY, q->n_items);
 
-                        /* So our right child is smaller than we are, let's
-                         * remember this fact */
-                        s = k;
-
-                /* s now points to the smallest of the three items */
+                /* Find the smallest of us and our children. Compare each child with the smallest one found so
+                 * far, which starts out as us, and keep its data pointer around rather than looking it up again,
+                 * so that the next child can be fetched while comparing. */
+                for (s = idx, smallest = i.data; j < k; j++)
+                        if (q->compare_func(q->items[j].data, smallest) < 0) {
+                                s = j;
+                                smallest = q->items[j].data;
+                        }
 
                 if (s == idx)
-                        /* No swap necessary, we're done */
+                        /* None of our children is smaller than we are, we're done */
                         break;
 
-                swap(q, idx, s);
+                set_item(q, idx, q->items[s]);
                 idx = s;
         }
 
+        set_item(q, idx, i);
         return idx;
 }
 
+static int prioq_grow(Prioq *q, unsigned n_add) {
+        struct prioq_item *j;
+        unsigned n;
+
+        assert(q);
+
+        if (q->n_items + n_add <= q->n_allocated)
+                return 0;
+
+        n = MAX((q->n_items + n_add) * 2, 16u);
+        j = reallocarray(q->items, n, sizeof(struct prioq_item));
+        if (!j)
+                return -ENOMEM;
+
+        q->items = j;
+        q->n_allocated = n;
+        return 0;
+}
+
+int prioq_reserve(Prioq *q, unsigned n_add) {
+        assert(q);
+
+        /* Makes sure that the next n_add calls to prioq_put() will not have to allocate memory, and hence
+         * cannot fail. */
+        return prioq_grow(q, n_add);
+}
+
 int prioq_put(Prioq *q, void *data, unsigned *idx) {
         struct prioq_item *i;
         unsigned k;
+        int r;
 
         assert(q);
 
-        if (q->n_items >= q->n_allocated) {
-                unsigned n;
-                struct prioq_item *j;
-
-                n = MAX((q->n_items+1) * 2, 16u);
-                j = reallocarray(q->items, n, sizeof(struct prioq_item));
-                if (!j)
-                        return -ENOMEM;
-
-                q->items = j;
-                q->n_allocated = n;
-        }
+        r = prioq_grow(q, 1);
+        if (r < 0)
+                return r;
 
         k = q->n_items++;
         i = q->items + k;
         i->data = data;
         i->idx = idx;
 
-        if (idx)
-                *idx = k;
-
         shuffle_up(q, k);
 
         return 0;
@@ -202,10 +221,7 @@ static void remove_item(Prioq *q, struct prioq_item *i) {
 
                 k = i - q->items;
 
-                i->data = l->data;
-                i->idx = l->idx;
-                if (i->idx)
-                        *i->idx = k;
+                *i = *l;
                 q->n_items--;
 
                 k = shuffle_down(q, k);
@@ -269,6 +285,17 @@ int prioq_reshuffle(Prioq *q, void *data, unsigned *idx) {
         return 1;
 }
 
+void prioq_reshuffle_all(Prioq *q) {
+        if (!q || q->n_items <= 1)
+                return;
+
+        /* Restores the heap property from scratch, bottom up, which is O(n), cheaper than reshuffling each
+         * item whose priority changed once there are more than a few of them. */
+
+        for (unsigned k = (q->n_items - 2) / PRIOQ_ARITY + 1; k > 0; k--)
+                shuffle_down(q, k - 1);
+}
+
 void *prioq_peek_by_index(Prioq *q, unsigned idx) {
         if (!q)
                 return NULL;
@@ -14,11 +14,14 @@ Prioq *prioq_new(compare_func_t compare);
 Prioq *prioq_free(Prioq *q);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Prioq*, prioq_free);
 int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func);
+int prioq_reserve(Prioq *q, unsigned n_add);
 
 int prioq_put(Prioq *q, void *data, unsigned *idx);
 int prioq_ensure_put(Prioq **q, compare_func_t compare_func, void *data, unsigned *idx);
 int prioq_remove(Prioq *q, void *data, unsigned *idx);
 int prioq_reshuffle(Prioq *q, void *data, unsigned *idx);
+/* After changing the priority of many items at once, instead of calling prioq_reshuffle() for each */
+void prioq_reshuffle_all(Prioq *q);
 
 void *prioq_peek_by_index(Prioq *q, unsigned idx) _pure_;
 static inline void *prioq_peek(Prioq *q) {
@@ -7,10 +7,13 @@
 
 #include <errno.h>
 #include <sched.h>
+#include <stdint.h>
 #include <sys/syscall.h>
 
 #include "log.h"
 #include "macro.h"
+#include "missing_sched.h"
+#include "missing_syscall_def.h"
 
 /**
  * raw_clone() - uses clone to create a new process with clone flags
@@ -77,3 +80,49 @@ static inline pid_t raw_clone(unsigned long flags) {
 
         return ret;
 }
+
+/* struct clone_args from linux/sched.h, which older headers lack entirely, or lack the cgroup field of */
+struct systemd_clone_args {
+        uint64_t flags;
+        uint64_t pidfd;
+        uint64_t child_tid;
+        uint64_t parent_tid;
+        uint64_t exit_signal;
+        uint64_t stack;
+        uint64_t stack_size;
+        uint64_t tls;
+        uint64_t set_tid;
+        uint64_t set_tid_size;
+        uint64_t cgroup;
+};
+
+/**
+ * raw_clone3() - uses clone3 to create a new process
+ * @args: The arguments to pass to the clone3 system call
+ *
+ * Like raw_clone(), but allows for flags that are only available with clone3, such as CLONE_INTO_CGROUP.
+ * The same restrictions apply: args->stack must not be set, and the flags must not contain CLONE_VM or
+ * any of the flags that need the thread ID pointers.
+ *
+ * Returns: 0 in the child process and the child process id in the parent, or -1 with errno set, in
+ * particular to ENOSYS if the kernel does not know clone3.
+ */
+static inline pid_t raw_clone3(struct systemd_clone_args *args) {
+#if defined(__NR_clone3) && !defined(__sparc__)
+        pid_t ret;
+
+        assert(args);
+        assert(args->stack == 0);
+        assert((args->flags & (CLONE_VM|CLONE_PARENT_SETTID|CLONE_CHILD_SETTID|
+                               CLONE_CHILD_CLEARTID|CLONE_SETTLS)) == 0);
+
+        ret = (pid_t) syscall(__NR_clone3, args, sizeof(*args));
+        if (ret == 0)
+                reset_cached_pid();
+
+        return ret;
+#else
+        errno = ENOSYS;
+        return -1;
+#endif
+}
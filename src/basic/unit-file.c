@@ -1,10 +1,13 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <sys/mman.h>
+
 #include "sd-id128.h"
 
 #include "chase-symlinks.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "macro.h"
 #include "path-lookup.h"
@@ -13,6 +16,8 @@
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "tmpfile-util.h"
+#include "unaligned.h"
 #include "unit-file.h"
 
 bool unit_type_may_alias(UnitType type) {
@@ -241,6 +246,269 @@ bool lookup_paths_timestamp_hash_same(const LookupPaths *lp, uint64_t timestamp_
         return updated == timestamp_hash;
 }
 
+/* The on-disk name map cache starts with this magic, followed by the cache key (see below), and a flag byte
+ * telling whether the path cache is included. Then a list of records follows, each introduced by a type
+ * byte and consisting of NUL-terminated strings:
+ *
+ *     'I' name target         — an entry of the unit ids map
+ *     'N' name alias… ""      — an entry of the unit names map, the list of aliases ends in an empty string
+ *     'P' path                — an entry of the path cache
+ */
+#define UNIT_NAME_MAP_CACHE_MAGIC "SDUNMAP1"
+
+static uint64_t lookup_paths_cache_key(const LookupPaths *lp) {
+        struct siphash state;
+
+        /* Unlike lookup_paths_timestamp_hash_same() this is supposed to be shared between processes, hence
+         * we cover all directories (the excluded ones are modified behind the back of everyone but PID 1),
+         * the search path itself, and the directories' identity. */
+
+        siphash24_init(&state, HASH_KEY.bytes);
+
+        siphash24_compress_string(lp->root_dir, &state);
+
+        STRV_FOREACH(dir, lp->search_path) {
+                struct stat st;
+
+                siphash24_compress_string(*dir, &state);
+
+                if (stat(*dir, &st) < 0) {
+                        siphash24_compress_boolean(false, &state);
+                        continue;
+                }
+
+                siphash24_compress_boolean(true, &state);
+                siphash24_compress(&st.st_dev, sizeof(st.st_dev), &state);
+                siphash24_compress(&st.st_ino, sizeof(st.st_ino), &state);
+
+                nsec_t t = timespec_load_nsec(&st.st_mtim);
+                siphash24_compress(&t, sizeof(t), &state);
+        }
+
+        return siphash24_finalize(&state);
+}
+
+static const char* cache_next_string(const char **p, const char *end) {
+        const char *s = *p, *e;
+
+        e = memchr(s, 0, end - s);
+        if (!e)
+                return NULL;
+
+        *p = e + 1;
+        return s;
+}
+
+static int unit_name_map_cache_read(
+                const char *cache_path,
+                uint64_t key,
+                Hashmap **ret_ids,
+                Hashmap **ret_names,
+                Set **ret_paths) {
+
+        _cleanup_hashmap_free_ Hashmap *ids = NULL, *names = NULL;
+        _cleanup_set_free_ Set *paths = NULL;
+        _cleanup_close_ int fd = -1;
+        const char *p, *end;
+        struct stat st;
+        void *m;
+        int r;
+
+        assert(cache_path);
+        assert(ret_ids);
+        assert(ret_names);
+
+        fd = open(cache_path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return errno == ENOENT ? 0 : -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        r = stat_verify_regular(&st);
+        if (r < 0)
+                return r;
+
+        /* Only trust what we or root wrote */
+        if (st.st_uid != 0 && st.st_uid != geteuid())
+                return -EPERM;
+
+        if ((size_t) st.st_size < STRLEN(UNIT_NAME_MAP_CACHE_MAGIC) + sizeof(uint64_t) + 1)
+                return 0;
+
+        m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED)
+                return -errno;
+
+        p = m;
+        end = p + st.st_size;
+
+        if (memcmp(p, UNIT_NAME_MAP_CACHE_MAGIC, STRLEN(UNIT_NAME_MAP_CACHE_MAGIC)) != 0) {
+                r = 0;
+                goto finish;
+        }
+        p += STRLEN(UNIT_NAME_MAP_CACHE_MAGIC);
+
+        if (unaligned_read_ne64(p) != key) {
+                log_debug("Unit name map cache %s is outdated.", cache_path);
+                r = 0;
+                goto finish;
+        }
+        p += sizeof(uint64_t);
+
+        /* Paths not included, but the caller wants them? Then we can't help. */
+        if (!*(p++) && ret_paths) {
+                r = 0;
+                goto finish;
+        }
+
+        if (ret_paths) {
+                paths = set_new(&path_hash_ops_free);
+                if (!paths) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+        }
+
+        while (p < end) {
+                const char *a, *b;
+                char type = *(p++);
+
+                a = cache_next_string(&p, end);
+                if (!a) {
+                        r = -EBADMSG;
+                        goto finish;
+                }
+
+                switch (type) {
+
+                case 'I': {
+                        _cleanup_free_ char *k = NULL, *v = NULL;
+
+                        b = cache_next_string(&p, end);
+                        if (!b) {
+                                r = -EBADMSG;
+                                goto finish;
+                        }
+
+                        k = strdup(a);
+                        v = strdup(b);
+                        if (!k || !v) {
+                                r = -ENOMEM;
+                                goto finish;
+                        }
+
+                        r = hashmap_ensure_put(&ids, &string_hash_ops_free_free, k, v);
+                        if (r < 0)
+                                goto finish;
+                        TAKE_PTR(k);
+                        TAKE_PTR(v);
+                        break;
+                }
+
+                case 'N':
+                        for (;;) {
+                                b = cache_next_string(&p, end);
+                                if (!b) {
+                                        r = -EBADMSG;
+                                        goto finish;
+                                }
+                                if (isempty(b))
+                                        break;
+
+                                r = string_strv_hashmap_put(&names, a, b);
+                                if (r < 0)
+                                        goto finish;
+                        }
+                        break;
+
+                case 'P':
+                        if (!paths)
+                                break;
+
+                        r = set_put_strdup_full(&paths, &path_hash_ops_free, a);
+                        if (r < 0)
+                                goto finish;
+                        break;
+
+                default:
+                        r = -EBADMSG;
+                        goto finish;
+                }
+        }
+
+        *ret_ids = TAKE_PTR(ids);
+        *ret_names = TAKE_PTR(names);
+        if (ret_paths)
+                *ret_paths = TAKE_PTR(paths);
+        r = 1;
+
+finish:
+        assert_se(munmap(m, st.st_size) >= 0);
+        return r;
+}
+
+static int unit_name_map_cache_write(
+                const char *cache_path,
+                uint64_t key,
+                Hashmap *ids,
+                Hashmap *names,
+                Set *paths) {
+
+        _cleanup_(unlink_and_freep) char *t = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *k, *v;
+        char **l;
+        int r;
+
+        assert(cache_path);
+
+        r = fopen_temporary(cache_path, &f, &t);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0644);
+
+        fputs(UNIT_NAME_MAP_CACHE_MAGIC, f);
+        fwrite(&key, sizeof(key), 1, f);
+        fputc(!!paths, f);
+
+        HASHMAP_FOREACH_KEY(v, k, ids) {
+                fputc('I', f);
+                fputs(k, f);
+                fputc(0, f);
+                fputs(v, f);
+                fputc(0, f);
+        }
+
+        HASHMAP_FOREACH_KEY(l, k, names) {
+                fputc('N', f);
+                fputs(k, f);
+                fputc(0, f);
+                STRV_FOREACH(a, l) {
+                        fputs(*a, f);
+                        fputc(0, f);
+                }
+                fputc(0, f);
+        }
+
+        SET_FOREACH(k, paths) {
+                fputc('P', f);
+                fputs(k, f);
+                fputc(0, f);
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        if (rename(t, cache_path) < 0)
+                return -errno;
+
+        t = mfree(t);
+        return 0;
+}
+
 static int directory_name_is_valid(const char *name) {
 
         /* Accept a directory whose name is a valid unit file name ending in .wants/, .requires/ or .d/ */
@@ -371,6 +639,7 @@ int unit_file_resolve_symlink(
 
 int unit_file_build_name_map(
                 const LookupPaths *lp,
+                const char *cache_path,
                 uint64_t *cache_timestamp_hash,
                 Hashmap **unit_ids_map,
                 Hashmap **unit_names_map,
@@ -384,12 +653,15 @@ int unit_file_build_name_map(
          *
          * At the same, build a cache of paths where to find units. The non-const parameters are for input
          * and output. Existing contents will be freed before the new contents are stored.
+         *
+         * If cache_path is specified, the result is also stored there, and taken from there instead if the
+         * search path didn't change since, so that other processes don't have to do all the work again.
          */
 
         _cleanup_hashmap_free_ Hashmap *ids = NULL, *names = NULL;
         _cleanup_set_free_free_ Set *paths = NULL;
         _cleanup_strv_free_ char **expanded_search_path = NULL;
-        uint64_t timestamp_hash;
+        uint64_t timestamp_hash, cache_key = 0;
         int r;
 
         /* Before doing anything, check if the timestamp hash that was passed is still valid.
@@ -398,6 +670,19 @@ int unit_file_build_name_map(
             lookup_paths_timestamp_hash_same(lp, *cache_timestamp_hash, &timestamp_hash))
                 return 0;
 
+        if (cache_path) {
+                /* Like the timestamp hash, the key is determined before we read anything */
+                cache_key = lookup_paths_cache_key(lp);
+
+                r = unit_name_map_cache_read(cache_path, cache_key, &ids, &names, path_cache ? &paths : NULL);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to read unit name map cache %s, ignoring: %m", cache_path);
+                if (r > 0) {
+                        log_debug("Using unit name map from %s.", cache_path);
+                        goto finish;
+                }
+        }
+
         /* The timestamp hash is now set based on the mtimes from before when we start reading files.
          * If anything is modified concurrently, we'll consider the cache outdated. */
 
@@ -616,6 +901,13 @@ int unit_file_build_name_map(
                                                  dst, special_glyph(SPECIAL_GLYPH_ARROW_RIGHT), src);
         }
 
+        if (cache_path) {
+                r = unit_name_map_cache_write(cache_path, cache_key, ids, names, paths);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to write unit name map cache %s, ignoring: %m", cache_path);
+        }
+
+finish:
         if (cache_timestamp_hash)
                 *cache_timestamp_hash = timestamp_hash;
 
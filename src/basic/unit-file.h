@@ -45,8 +45,12 @@ int unit_file_resolve_symlink(
                 bool resolve_destination_target,
                 char **ret_destination);
 
+/* Where the unit name map of the system's unit search path is cached */
+#define UNIT_NAME_MAP_CACHE_PATH "/run/systemd/unit-name-map"
+
 int unit_file_build_name_map(
                 const LookupPaths *lp,
+                const char *cache_path,
                 uint64_t *cache_timestamp_hash,
                 Hashmap **unit_ids_map,
                 Hashmap **unit_names_map,
@@ -123,6 +123,29 @@ int utf8_encoded_to_unichar(const char *str, char32_t *ret_unichar) {
         return 0;
 }
 
+static size_t ascii_prefix_length(const char *s, size_t n) {
+        size_t i = 0;
+
+        /* Returns the number of leading bytes of s that are 7-bit ASCII characters other than NUL, looking at
+         * up to n bytes. Most strings we validate are pure ASCII, hence check a machine word at a time: a
+         * byte has its high bit set after subtracting 1 from it iff it was either NUL or had the high bit
+         * set already. */
+
+        for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+                uint64_t w;
+
+                memcpy(&w, s + i, sizeof(w));
+                if ((w | (w - UINT64_C(0x0101010101010101))) & UINT64_C(0x8080808080808080))
+                        break;
+        }
+
+        for (; i < n; i++)
+                if ((uint8_t) s[i] - 1U >= 0x7fU)
+                        break;
+
+        return i;
+}
+
 bool utf8_is_printable_newline(const char* str, size_t length, bool allow_newline) {
         assert(str);
 
@@ -130,6 +153,13 @@ bool utf8_is_printable_newline(const char* str, size_t length, bool allow_newlin
                 int encoded_len, r;
                 char32_t val;
 
+                /* Shortcut for printable ASCII characters */
+                if ((uint8_t) *p >= ' ' && (uint8_t) *p < 0x7f) {
+                        p++;
+                        length--;
+                        continue;
+                }
+
                 encoded_len = utf8_encoded_valid_unichar(p, length);
                 if (encoded_len < 0)
                         return false;
@@ -154,18 +184,24 @@ char *utf8_is_valid_n(const char *str, size_t len_bytes) {
 
         assert(str);
 
-        for (const char *p = str; len_bytes != SIZE_MAX ? (size_t) (p - str) < len_bytes : *p != '\0'; ) {
+        if (len_bytes == SIZE_MAX)
+                len_bytes = strlen(str);
+
+        for (size_t i = 0; i < len_bytes; ) {
                 int len;
 
-                if (_unlikely_(*p == '\0') && len_bytes != SIZE_MAX)
+                i += ascii_prefix_length(str + i, len_bytes - i);
+                if (i >= len_bytes)
+                        break;
+
+                if (_unlikely_(str[i] == '\0'))
                         return NULL; /* embedded NUL */
 
-                len = utf8_encoded_valid_unichar(p,
-                                                 len_bytes != SIZE_MAX ? len_bytes - (p - str) : SIZE_MAX);
+                len = utf8_encoded_valid_unichar(str + i, len_bytes - i);
                 if (_unlikely_(len < 0))
                         return NULL; /* invalid character */
 
-                p += len;
+                i += len;
         }
 
         return (char*) str;
@@ -292,11 +328,7 @@ char *ascii_is_valid(const char *str) {
 
         assert(str);
 
-        for (const char *p = str; *p; p++)
-                if ((unsigned char) *p >= 128)
-                        return NULL;
-
-        return (char*) str;
+        return ascii_is_valid_n(str, strlen(str));
 }
 
 char *ascii_is_valid_n(const char *str, size_t len) {
@@ -305,9 +337,8 @@ char *ascii_is_valid_n(const char *str, size_t len) {
 
         assert(str);
 
-        for (size_t i = 0; i < len; i++)
-                if ((unsigned char) str[i] >= 128 || str[i] == 0)
-                        return NULL;
+        if (ascii_prefix_length(str, len) < len)
+                return NULL;
 
         return (char*) str;
 }
@@ -62,6 +62,8 @@ typedef struct {
         char16_t *loader;
         char16_t *devicetree;
         char16_t *options;
+        UINTN options_offset; /* Location of not yet loaded options, see config_entry_load_options() */
+        UINTN options_size;
         char16_t **initrd;
         char16_t key;
         EFI_STATUS (*call)(void);
@@ -461,6 +463,44 @@ static bool ps_continue(void) {
                         !IN_SET(key, KEYPRESS(0, SCAN_ESC, 0), KEYPRESS(0, 0, 'q'), KEYPRESS(0, 0, 'Q'));
 }
 
+static void config_entry_load_options(ConfigEntry *entry) {
+        _cleanup_(file_closep) EFI_FILE *root_dir = NULL;
+        _cleanup_free_ char *content = NULL;
+        UINTN size;
+        EFI_STATUS err;
+
+        assert(entry);
+
+        /* The .cmdline section of unified kernel images is only read once it is needed, i.e. when the entry
+         * is booted, edited or shown, as reading it from every image slows down the menu on firmware with
+         * slow file I/O. */
+
+        size = entry->options_size;
+        if (size == 0)
+                return;
+
+        /* Only try once */
+        entry->options_size = 0;
+
+        err = open_volume(entry->device, &root_dir);
+        if (err != EFI_SUCCESS) {
+                log_error_stall(L"Error opening root path: %r", err);
+                return;
+        }
+
+        err = file_read(root_dir, entry->loader, entry->options_offset, size, &content, NULL);
+        if (err != EFI_SUCCESS) {
+                log_error_stall(L"Error reading command line of %s: %r", entry->loader, err);
+                return;
+        }
+
+        /* chomp the newline */
+        if (content[size - 1] == '\n')
+                content[size - 1] = '\0';
+
+        entry->options = xstra_to_str(content);
+}
+
 static void print_status(Config *config, char16_t *loaded_image_path) {
         UINTN x_max, y_max;
         uint32_t screen_width = 0, screen_height = 0;
@@ -549,6 +589,8 @@ static void print_status(Config *config, char16_t *loaded_image_path) {
         for (UINTN i = 0; i < config->entry_count; i++) {
                 ConfigEntry *entry = config->entries[i];
 
+                config_entry_load_options(entry);
+
                     Print(L"  config entry: %" PRIuN L"/%" PRIuN L"\n", i + 1, config->entry_count);
                 ps_string(L"            id: %s\n", entry->id);
                 ps_string(L"         title: %s\n", entry->title);
@@ -907,6 +949,8 @@ static bool menu_run(
                             LOADER_EFI, LOADER_LINUX, LOADER_UNIFIED_LINUX))
                                 break;
 
+                        config_entry_load_options(config->entries[idx_highlight]);
+
                         /* Unified kernels that are signed as a whole will not accept command line options
                          * when secure boot is enabled unless there is none embedded in the image. Do not try
                          * to pretend we can edit it to only have it be ignored. */
@@ -2173,20 +2217,9 @@ static void config_entry_add_unified(
                 config_add_entry(config, entry);
                 config_entry_parse_tries(entry, L"\\EFI\\Linux", f->FileName, L".efi");
 
-                if (szs[SECTION_CMDLINE] == 0)
-                        continue;
-
-                content = mfree(content);
-
-                /* read the embedded cmdline file */
-                err = file_read(linux_dir, f->FileName, offs[SECTION_CMDLINE], szs[SECTION_CMDLINE], &content, NULL);
-                if (err == EFI_SUCCESS) {
-                        /* chomp the newline */
-                        if (content[szs[SECTION_CMDLINE] - 1] == '\n')
-                                content[szs[SECTION_CMDLINE] - 1] = '\0';
-
-                        entry->options = xstra_to_str(content);
-                }
+                /* The embedded cmdline is read later, see config_entry_load_options() */
+                entry->options_offset = offs[SECTION_CMDLINE];
+                entry->options_size = szs[SECTION_CMDLINE];
         }
 }
 
@@ -2616,6 +2649,8 @@ EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *sys_table) {
                 /* Optionally, read a random seed off the ESP and pass it to the OS */
                 (void) process_random_seed(root_dir, config.random_seed_mode);
 
+                config_entry_load_options(entry);
+
                 err = image_start(image, entry);
                 if (err != EFI_SUCCESS)
                         goto out;
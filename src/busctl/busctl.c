@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <fcntl.h>
 #include <getopt.h>
 
 #include "sd-bus.h"
@@ -48,6 +49,8 @@ static BusTransport arg_transport = BUS_TRANSPORT_LOCAL;
 static const char *arg_host = NULL;
 static bool arg_user = false;
 static size_t arg_snaplen = 4096;
+static char *arg_output = NULL;
+static uint64_t arg_ring_size = 0;
 static bool arg_list = false;
 static bool arg_quiet = false;
 static bool arg_verbose = false;
@@ -61,6 +64,7 @@ static usec_t arg_timeout = 0;
 static const char *arg_destination = NULL;
 
 STATIC_DESTRUCTOR_REGISTER(arg_matches, strv_freep);
+STATIC_DESTRUCTOR_REGISTER(arg_output, freep);
 
 #define NAME_IS_ACQUIRED INT_TO_PTR(1)
 #define NAME_IS_ACTIVATABLE INT_TO_PTR(2)
@@ -1157,8 +1161,89 @@ static int message_dump(sd_bus_message *m, FILE *f) {
         return sd_bus_message_dump(m, f, SD_BUS_MESSAGE_DUMP_WITH_HEADER);
 }
 
+/* Bytes of message data written to the current capture file */
+static uint64_t capture_size = 0;
+
+static int capture_header(FILE *f) {
+        _cleanup_free_ char *osname = NULL;
+        static const char info[] =
+                "busctl (systemd) " STRINGIFY(PROJECT_VERSION) " (Git " GIT_VERSION ")";
+        int r;
+
+        r = parse_os_release(NULL, "PRETTY_NAME", &osname);
+        if (r < 0)
+                log_full_errno(r == -ENOENT ? LOG_DEBUG : LOG_INFO, r,
+                               "Failed to read os-release file, ignoring: %m");
+
+        return bus_pcap_header(arg_snaplen, osname, info, f);
+}
+
+static int capture_open(const char *path) {
+        _cleanup_close_ int fd = -1;
+
+        assert(path);
+
+        /* Bus traffic may contain secrets, hence don't make the capture world-readable */
+        fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC|O_NOCTTY, 0600);
+        if (fd < 0)
+                return log_error_errno(errno, "Failed to open %s: %m", path);
+
+        /* Everything is written to stdout, hence simply put the file in its place */
+        if (dup2(fd, STDOUT_FILENO) < 0)
+                return log_error_errno(errno, "Failed to redirect standard output to %s: %m", path);
+
+        capture_size = 0;
+        return 0;
+}
+
+static int capture_rotate(FILE *f) {
+        _cleanup_free_ char *old = NULL;
+        int r;
+
+        assert(arg_output);
+
+        /* Implements the ring buffer: once the capture file is filled up to half of the ring size, it is
+         * moved aside and a new one is started. Hence, the file and the ".old" one together always contain
+         * the most recent traffic, and both are complete pcapng files that can be opened as they are. */
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return log_error_errno(r, "Couldn't write capture file: %m");
+
+        old = strjoin(arg_output, ".old");
+        if (!old)
+                return log_oom();
+
+        if (rename(arg_output, old) < 0)
+                return log_error_errno(errno, "Failed to rename %s to %s: %m", arg_output, old);
+
+        r = capture_open(arg_output);
+        if (r < 0)
+                return r;
+
+        r = capture_header(f);
+        if (r < 0)
+                return log_error_errno(r, "Couldn't write capture file: %m");
+
+        return 0;
+}
+
 static int message_pcap(sd_bus_message *m, FILE *f) {
-        return bus_message_pcap_frame(m, arg_snaplen, f);
+        int r;
+
+        r = bus_message_pcap_frame(m, arg_snaplen, f);
+        if (r < 0)
+                return log_error_errno(r, "Couldn't write capture file: %m");
+
+        if (arg_ring_size == 0)
+                return 0;
+
+        /* The block framing is not accounted for, so the files may end up slightly larger than requested */
+        capture_size += MIN(BUS_MESSAGE_SIZE(m), arg_snaplen);
+        if (capture_size < arg_ring_size / 2)
+                return 0;
+
+        return capture_rotate(f);
 }
 
 static int message_json(sd_bus_message *m, FILE *f) {
@@ -1304,8 +1389,9 @@ static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f
                 }
 
                 if (m) {
-                        dump(m, stdout);
-                        fflush(stdout);
+                        r = dump(m, stdout);
+                        if (r < 0)
+                                return r;
 
                         if (sd_bus_message_is_signal(m, "org.freedesktop.DBus.Local", "Disconnected") > 0) {
                                 log_info("Connection terminated, exiting.");
@@ -1318,6 +1404,10 @@ static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f
                 if (r > 0)
                         continue;
 
+                /* Only flush when there's nothing more to process, so that on a busy bus the output is written
+                 * in batches rather than with one write() per message */
+                fflush(stdout);
+
                 r = sd_bus_wait(bus, UINT64_MAX);
                 if (r < 0)
                         return log_error_errno(r, "Failed to wait for bus: %m");
@@ -1329,20 +1419,19 @@ static int verb_monitor(int argc, char **argv, void *userdata) {
 }
 
 static int verb_capture(int argc, char **argv, void *userdata) {
-        _cleanup_free_ char *osname = NULL;
-        static const char info[] =
-                "busctl (systemd) " STRINGIFY(PROJECT_VERSION) " (Git " GIT_VERSION ")";
         int r;
 
-        if (isatty(fileno(stdout)) > 0)
+        if (arg_output) {
+                r = capture_open(arg_output);
+                if (r < 0)
+                        return r;
+        } else if (isatty(fileno(stdout)) > 0)
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "Refusing to write message data to console, please redirect output to a file.");
 
-        r = parse_os_release(NULL, "PRETTY_NAME", &osname);
+        r = capture_header(stdout);
         if (r < 0)
-                log_full_errno(r == -ENOENT ? LOG_DEBUG : LOG_INFO, r,
-                               "Failed to read os-release file, ignoring: %m");
-        bus_pcap_header(arg_snaplen, osname, info, stdout);
+                return log_error_errno(r, "Couldn't write capture file: %m");
 
         r = monitor(argc, argv, message_pcap);
         if (r < 0)
@@ -2231,6 +2320,246 @@ static int set_property(int argc, char **argv, void *userdata) {
         return 0;
 }
 
+typedef struct StatisticsHistogram {
+        uint64_t n;
+        usec_t total;
+        usec_t max;
+        const uint64_t *buckets;
+        size_t n_buckets;
+} StatisticsHistogram;
+
+static int read_histogram(sd_bus_message *m, StatisticsHistogram *ret) {
+        StatisticsHistogram h = {};
+        size_t sz;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        r = sd_bus_message_enter_container(m, 'r', "tttat");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read(m, "ttt", &h.n, &h.total, &h.max);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_array(m, 't', (const void**) &h.buckets, &sz);
+        if (r < 0)
+                return r;
+
+        h.n_buckets = sz / sizeof(uint64_t);
+
+        r = sd_bus_message_exit_container(m);
+        if (r < 0)
+                return r;
+
+        *ret = h;
+        return 0;
+}
+
+static usec_t histogram_percentile(const StatisticsHistogram *h, unsigned p) {
+        uint64_t need, seen = 0;
+
+        assert(h);
+        assert(h->n > 0);
+
+        /* Bucket i holds durations below 2^(i+1) µs, hence this is an upper bound, and never more than the
+         * maximum we actually saw. */
+        need = DIV_ROUND_UP(h->n * p, 100U);
+        for (size_t i = 0; i + 1 < h->n_buckets && i < 63; i++) {
+                seen += h->buckets[i];
+                if (seen >= need)
+                        return MIN(UINT64_C(1) << (i + 1), h->max);
+        }
+
+        return h->max;
+}
+
+static int table_add_histogram(Table *table, const StatisticsHistogram *h) {
+        int r;
+
+        assert(table);
+        assert(h);
+
+        if (h->n == 0)
+                return table_add_many(table, TABLE_EMPTY, TABLE_EMPTY, TABLE_EMPTY);
+
+        r = table_add_many(table,
+                           TABLE_TIMESPAN, h->total / h->n,
+                           TABLE_TIMESPAN, histogram_percentile(h, 99),
+                           TABLE_TIMESPAN, h->max);
+        if (r < 0)
+                return table_log_add_error(r);
+
+        return 0;
+}
+
+static int statistics(int argc, char **argv, void *userdata) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(table_unrefp) Table *table = NULL;
+        uint64_t n_received = 0, n_sent = 0;
+        StatisticsHistogram queue = {};
+        usec_t auth = 0;
+        int r;
+
+        r = acquire_bus(false, &bus);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_call_method(bus, argv[1], "/", "org.freedesktop.DBus.Debug.Stats", "GetStats",
+                               &error, &reply, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to acquire statistics of %s: %s",
+                                       argv[1], bus_error_message(&error, r));
+
+        if (!FLAGS_SET(arg_json_format_flags, JSON_FORMAT_OFF)) {
+                _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+                if (arg_json_format_flags & (JSON_FORMAT_PRETTY|JSON_FORMAT_PRETTY_AUTO))
+                        pager_open(arg_pager_flags);
+
+                r = json_transform_message(reply, &v);
+                if (r < 0)
+                        return r;
+
+                json_variant_dump(v, arg_json_format_flags, NULL, NULL);
+                return 0;
+        }
+
+        table = table_new("member", "calls", "handler avg", "handler p99", "handler max",
+                          "reply avg", "reply p99", "reply max");
+        if (!table)
+                return log_oom();
+
+        (void) table_set_sort(table, (size_t) 0);
+
+        r = sd_bus_message_enter_container(reply, 'a', "{sv}");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (;;) {
+                const char *name;
+
+                r = sd_bus_message_enter_container(reply, 'e', "sv");
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0)
+                        break;
+
+                r = sd_bus_message_read(reply, "s", &name);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                if (streq(name, "MessagesReceived"))
+                        r = sd_bus_message_read(reply, "v", "t", &n_received);
+                else if (streq(name, "MessagesSent"))
+                        r = sd_bus_message_read(reply, "v", "t", &n_sent);
+                else if (streq(name, "AuthenticationUSec"))
+                        r = sd_bus_message_read(reply, "v", "t", &auth);
+                else if (streq(name, "QueueUSec")) {
+                        r = sd_bus_message_enter_container(reply, 'v', "(tttat)");
+                        if (r < 0)
+                                return bus_log_parse_error(r);
+
+                        r = read_histogram(reply, &queue);
+                        if (r < 0)
+                                return bus_log_parse_error(r);
+
+                        r = sd_bus_message_exit_container(reply);
+                } else if (streq(name, "Members")) {
+                        r = sd_bus_message_enter_container(reply, 'v', "a(s(tttat)(tttat))");
+                        if (r < 0)
+                                return bus_log_parse_error(r);
+
+                        r = sd_bus_message_enter_container(reply, 'a', "(s(tttat)(tttat))");
+                        if (r < 0)
+                                return bus_log_parse_error(r);
+
+                        for (;;) {
+                                StatisticsHistogram handler, reply_time;
+                                const char *member;
+
+                                r = sd_bus_message_enter_container(reply, 'r', "s(tttat)(tttat)");
+                                if (r < 0)
+                                        return bus_log_parse_error(r);
+                                if (r == 0)
+                                        break;
+
+                                r = sd_bus_message_read(reply, "s", &member);
+                                if (r < 0)
+                                        return bus_log_parse_error(r);
+
+                                r = read_histogram(reply, &handler);
+                                if (r < 0)
+                                        return bus_log_parse_error(r);
+
+                                r = read_histogram(reply, &reply_time);
+                                if (r < 0)
+                                        return bus_log_parse_error(r);
+
+                                r = sd_bus_message_exit_container(reply);
+                                if (r < 0)
+                                        return bus_log_parse_error(r);
+
+                                r = table_add_many(table,
+                                                   TABLE_STRING, member,
+                                                   TABLE_UINT64, handler.n);
+                                if (r < 0)
+                                        return table_log_add_error(r);
+
+                                r = table_add_histogram(table, &handler);
+                                if (r < 0)
+                                        return r;
+
+                                r = table_add_histogram(table, &reply_time);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        r = sd_bus_message_exit_container(reply);
+                        if (r < 0)
+                                return bus_log_parse_error(r);
+
+                        r = sd_bus_message_exit_container(reply);
+                } else
+                        r = sd_bus_message_skip(reply, "v");
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                r = sd_bus_message_exit_container(reply);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+        }
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        pager_open(arg_pager_flags);
+
+        printf("Messages received: %" PRIu64 "\n"
+               "    Messages sent: %" PRIu64 "\n"
+               "   Authentication: %s\n",
+               n_received, n_sent,
+               auth > 0 ? FORMAT_TIMESPAN(auth, 1) : "n/a");
+
+        if (queue.n > 0)
+                printf("   Queued for avg: %s, p99: %s, max: %s\n",
+                       FORMAT_TIMESPAN(queue.total / queue.n, 1),
+                       FORMAT_TIMESPAN(histogram_percentile(&queue, 99), 1),
+                       FORMAT_TIMESPAN(queue.max, 1));
+
+        if (table_get_rows(table) <= 1)
+                return 0;
+
+        putchar('\n');
+
+        return table_print_with_pager(table, arg_json_format_flags, arg_pager_flags, arg_legend);
+}
+
 static int help(void) {
         _cleanup_free_ char *link = NULL;
         int r;
@@ -2258,6 +2587,7 @@ static int help(void) {
                "                           Get property value\n"
                "  set-property SERVICE OBJECT INTERFACE PROPERTY SIGNATURE ARGUMENT...\n"
                "                           Set property value\n"
+               "  statistics SERVICE       Show message statistics of a service\n"
                "  help                     Show this help\n"
                "\nOptions:\n"
                "  -h --help                Show this help\n"
@@ -2276,6 +2606,9 @@ static int help(void) {
                "     --activatable         Only show activatable names\n"
                "     --match=MATCH         Only show matching messages\n"
                "     --size=SIZE           Maximum length of captured packet\n"
+               "     --output=FILE         Write captured packets to FILE instead of stdout\n"
+               "     --ring-size=SIZE      Keep only the most recent SIZE bytes of the capture,\n"
+               "                           split between FILE and FILE.old\n"
                "     --list                Don't show tree, but simple object path list\n"
                "  -q --quiet               Don't show method call reply\n"
                "     --verbose             Show result values in long format\n"
@@ -2318,6 +2651,8 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_ACQUIRED,
                 ARG_ACTIVATABLE,
                 ARG_SIZE,
+                ARG_OUTPUT,
+                ARG_RING_SIZE,
                 ARG_LIST,
                 ARG_VERBOSE,
                 ARG_XML_INTERFACE,
@@ -2348,6 +2683,8 @@ static int parse_argv(int argc, char *argv[]) {
                 { "host",                            required_argument, NULL, 'H'                                 },
                 { "machine",                         required_argument, NULL, 'M'                                 },
                 { "size",                            required_argument, NULL, ARG_SIZE                            },
+                { "output",                          required_argument, NULL, ARG_OUTPUT                          },
+                { "ring-size",                       required_argument, NULL, ARG_RING_SIZE                       },
                 { "list",                            no_argument,       NULL, ARG_LIST                            },
                 { "quiet",                           no_argument,       NULL, 'q'                                 },
                 { "verbose",                         no_argument,       NULL, ARG_VERBOSE                         },
@@ -2438,6 +2775,18 @@ static int parse_argv(int argc, char *argv[]) {
                         break;
                 }
 
+                case ARG_OUTPUT:
+                        r = parse_path_argument(optarg, /* suppress_root= */ false, &arg_output);
+                        if (r < 0)
+                                return r;
+                        break;
+
+                case ARG_RING_SIZE:
+                        r = parse_size(optarg, 1024, &arg_ring_size);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse ring size '%s': %m", optarg);
+                        break;
+
                 case ARG_LIST:
                         arg_list = true;
                         break;
@@ -2524,6 +2873,10 @@ static int parse_argv(int argc, char *argv[]) {
                         assert_not_reached();
                 }
 
+        if (arg_ring_size > 0 && !arg_output)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "--ring-size= requires --output= to be specified.");
+
         return 1;
 }
 
@@ -2539,6 +2892,7 @@ static int busctl_main(int argc, char *argv[]) {
                 { "emit",         4,        VERB_ANY, 0,            emit_signal    },
                 { "get-property", 5,        VERB_ANY, 0,            get_property   },
                 { "set-property", 6,        VERB_ANY, 0,            set_property   },
+                { "statistics",   2,        2,        0,            statistics     },
                 { "help",         VERB_ANY, VERB_ANY, 0,            verb_help      },
                 {}
         };
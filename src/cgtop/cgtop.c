@@ -25,6 +25,7 @@
 #include "pretty-print.h"
 #include "process-util.h"
 #include "procfs-util.h"
+#include "rlimit-util.h"
 #include "sort-util.h"
 #include "stdio-util.h"
 #include "strv.h"
@@ -32,9 +33,20 @@
 #include "unit-name.h"
 #include "virt.h"
 
+/* The attribute files which are read on every refresh, and hence kept open */
+typedef enum GroupFile {
+        GROUP_FILE_PIDS,
+        GROUP_FILE_MEMORY,
+        GROUP_FILE_IO,
+        GROUP_FILE_CPU,
+        _GROUP_FILE_MAX,
+} GroupFile;
+
 typedef struct Group {
         char *path;
 
+        int fds[_GROUP_FILE_MAX];
+
         bool n_tasks_valid:1;
         bool cpu_valid:1;
         bool memory_valid:1;
@@ -88,10 +100,54 @@ static Group *group_free(Group *g) {
         if (!g)
                 return NULL;
 
+        close_many(g->fds, _GROUP_FILE_MAX);
         free(g->path);
         return mfree(g);
 }
 
+static int group_read_file(Group *g, GroupFile f, const char *controller, const char *attribute, char **ret) {
+        _cleanup_free_ char *p = NULL;
+        bool cached;
+        int r;
+
+        assert(g);
+        assert(f >= 0 && f < _GROUP_FILE_MAX);
+        assert(controller);
+        assert(attribute);
+        assert(ret);
+
+        /* Opening every attribute file of every cgroup by path on each refresh is expensive with many
+         * cgroups, hence keep them open and read them again. */
+
+        cached = g->fds[f] >= 0;
+        if (cached) {
+                if (lseek(g->fds[f], 0, SEEK_SET) < 0)
+                        r = -errno;
+                else
+                        r = read_virtual_file_fd(g->fds[f], SIZE_MAX, ret, NULL);
+                if (r >= 0 || r == -ENOMEM)
+                        return r;
+
+                /* The cgroup might have been removed and created again. */
+                g->fds[f] = safe_close(g->fds[f]);
+        }
+
+        r = cg_get_path(controller, g->path, attribute, &p);
+        if (r < 0)
+                return r;
+
+        g->fds[f] = open(p, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (g->fds[f] < 0) {
+                if (ERRNO_IS_RESOURCE(errno))
+                        /* Out of file descriptors? Then read the file without keeping it open. */
+                        return read_full_virtual_file(p, ret, NULL);
+
+                return -errno;
+        }
+
+        return read_virtual_file_fd(g->fds[f], SIZE_MAX, ret, NULL);
+}
+
 
 static const char *maybe_format_timespan(char *buf, size_t l, usec_t t, usec_t accuracy) {
         if (arg_raw) {
@@ -170,6 +226,9 @@ static int process(
                         if (!g)
                                 return -ENOMEM;
 
+                        for (GroupFile f = 0; f < _GROUP_FILE_MAX; f++)
+                                g->fds[f] = -1;
+
                         g->path = strdup(path);
                         if (!g->path) {
                                 group_free(g);
@@ -192,19 +251,19 @@ static int process(
 
         if (streq(controller, SYSTEMD_CGROUP_CONTROLLER) &&
             IN_SET(arg_count, COUNT_ALL_PROCESSES, COUNT_USERSPACE_PROCESSES)) {
-                _cleanup_fclose_ FILE *f = NULL;
-                pid_t pid;
+                _cleanup_free_ pid_t *pids = NULL;
+                size_t n_pids;
 
-                r = cg_enumerate_processes(controller, path, &f);
+                r = cg_read_pids(controller, path, &pids, &n_pids);
                 if (r == -ENOENT)
                         return 0;
                 if (r < 0)
                         return r;
 
                 g->n_tasks = 0;
-                while (cg_read_pid(f, &pid) > 0) {
+                for (size_t i = 0; i < n_pids; i++) {
 
-                        if (arg_count == COUNT_USERSPACE_PROCESSES && is_kernel_thread(pid) > 0)
+                        if (arg_count == COUNT_USERSPACE_PROCESSES && is_kernel_thread(pids[i]) > 0)
                                 continue;
 
                         g->n_tasks++;
@@ -220,19 +279,15 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else {
-                        _cleanup_free_ char *p = NULL, *v = NULL;
-
-                        r = cg_get_path(controller, path, "pids.current", &p);
-                        if (r < 0)
-                                return r;
+                        _cleanup_free_ char *v = NULL;
 
-                        r = read_one_line_file(p, &v);
+                        r = group_read_file(g, GROUP_FILE_PIDS, controller, "pids.current", &v);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
 
-                        r = safe_atou64(v, &g->n_tasks);
+                        r = safe_atou64(strstrip(v), &g->n_tasks);
                         if (r < 0)
                                 return r;
                 }
@@ -247,22 +302,16 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else {
-                        _cleanup_free_ char *p = NULL, *v = NULL;
-
-                        if (all_unified)
-                                r = cg_get_path(controller, path, "memory.current", &p);
-                        else
-                                r = cg_get_path(controller, path, "memory.usage_in_bytes", &p);
-                        if (r < 0)
-                                return r;
+                        _cleanup_free_ char *v = NULL;
 
-                        r = read_one_line_file(p, &v);
+                        r = group_read_file(g, GROUP_FILE_MEMORY, controller,
+                                            all_unified ? "memory.current" : "memory.usage_in_bytes", &v);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
 
-                        r = safe_atou64(v, &g->memory);
+                        r = safe_atou64(strstrip(v), &g->memory);
                         if (r < 0)
                                 return r;
                 }
@@ -272,28 +321,23 @@ static int process(
 
         } else if ((streq(controller, "io") && all_unified) ||
                    (streq(controller, "blkio") && !all_unified)) {
-                _cleanup_fclose_ FILE *f = NULL;
-                _cleanup_free_ char *p = NULL;
+                _cleanup_free_ char *contents = NULL;
                 uint64_t wr = 0, rd = 0;
                 nsec_t timestamp;
 
-                r = cg_get_path(controller, path, all_unified ? "io.stat" : "blkio.io_service_bytes", &p);
+                r = group_read_file(g, GROUP_FILE_IO, controller,
+                                    all_unified ? "io.stat" : "blkio.io_service_bytes", &contents);
+                if (r == -ENOENT)
+                        return 0;
                 if (r < 0)
                         return r;
 
-                f = fopen(p, "re");
-                if (!f) {
-                        if (errno == ENOENT)
-                                return 0;
-                        return -errno;
-                }
-
-                for (;;) {
+                for (const char *c = contents;;) {
                         _cleanup_free_ char *line = NULL;
                         uint64_t k, *q;
                         char *l;
 
-                        r = read_line(f, LONG_LINE_MAX, &line);
+                        r = extract_first_word(&c, &line, NEWLINE, 0);
                         if (r < 0)
                                 return r;
                         if (r == 0)
@@ -364,7 +408,7 @@ static int process(
                 g->io_timestamp = timestamp;
                 g->io_iteration = iteration;
         } else if (STR_IN_SET(controller, "cpu", "cpuacct") || cpu_accounting_is_cheap()) {
-                _cleanup_free_ char *p = NULL, *v = NULL;
+                _cleanup_free_ char *v = NULL;
                 uint64_t new_usage;
                 nsec_t timestamp;
 
@@ -373,18 +417,23 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else if (all_unified) {
-                        _cleanup_free_ char *val = NULL;
+                        const char *val = NULL;
 
                         if (!streq(controller, "cpu"))
                                 return 0;
 
-                        r = cg_get_keyed_attribute("cpu", path, "cpu.stat", STRV_MAKE("usage_usec"), &val);
-                        if (IN_SET(r, -ENOENT, -ENXIO))
+                        r = group_read_file(g, GROUP_FILE_CPU, controller, "cpu.stat", &v);
+                        if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
 
-                        r = safe_atou64(val, &new_usage);
+                        for (const char *c = v; *c && !val; c += strcspn(c, NEWLINE), c += strspn(c, NEWLINE))
+                                val = first_word(c, "usage_usec");
+                        if (!val)
+                                return 0;
+
+                        r = safe_atou64(strndupa_safe(val, strcspn(val, NEWLINE)), &new_usage);
                         if (r < 0)
                                 return r;
 
@@ -393,17 +442,13 @@ static int process(
                         if (!streq(controller, "cpuacct"))
                                 return 0;
 
-                        r = cg_get_path(controller, path, "cpuacct.usage", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = group_read_file(g, GROUP_FILE_CPU, controller, "cpuacct.usage", &v);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
 
-                        r = safe_atou64(v, &new_usage);
+                        r = safe_atou64(strstrip(v), &new_usage);
                         if (r < 0)
                                 return r;
                 }
@@ -437,7 +482,7 @@ static int process(
 }
 
 static int refresh_one(
-                const char *controller,
+                char * const *controllers,
                 const char *path,
                 Hashmap *a,
                 Hashmap *b,
@@ -449,18 +494,21 @@ static int refresh_one(
         Group *ours = NULL;
         int r;
 
-        assert(controller);
+        assert(controllers);
+        assert(controllers[0]);
         assert(path);
         assert(a);
 
         if (depth > arg_depth)
                 return 0;
 
-        r = process(controller, path, a, b, iteration, &ours);
-        if (r < 0)
-                return r;
+        STRV_FOREACH(c, controllers) {
+                r = process(*c, path, a, b, iteration, &ours);
+                if (r < 0)
+                        return r;
+        }
 
-        r = cg_enumerate_subgroups(controller, path, &d);
+        r = cg_enumerate_subgroups(controllers[0], path, &d);
         if (r == -ENOENT)
                 return 0;
         if (r < 0)
@@ -482,7 +530,7 @@ static int refresh_one(
 
                 path_simplify(p);
 
-                r = refresh_one(controller, p, a, b, iteration, depth + 1, &child);
+                r = refresh_one(controllers, p, a, b, iteration, depth + 1, &child);
                 if (r < 0)
                         return r;
 
@@ -490,7 +538,7 @@ static int refresh_one(
                     IN_SET(arg_count, COUNT_ALL_PROCESSES, COUNT_USERSPACE_PROCESSES) &&
                     child &&
                     child->n_tasks_valid &&
-                    streq(controller, SYSTEMD_CGROUP_CONTROLLER)) {
+                    streq(controllers[0], SYSTEMD_CGROUP_CONTROLLER)) {
 
                         /* Recursively sum up processes */
 
@@ -510,10 +558,19 @@ static int refresh_one(
 }
 
 static int refresh(const char *root, Hashmap *a, Hashmap *b, unsigned iteration) {
+        char **controllers = STRV_MAKE(SYSTEMD_CGROUP_CONTROLLER, "cpu", "cpuacct", "memory", "io", "blkio", "pids");
         int r;
 
-        FOREACH_STRING(c, SYSTEMD_CGROUP_CONTROLLER, "cpu", "cpuacct", "memory", "io", "blkio", "pids") {
-                r = refresh_one(c, root, a, b, iteration, 0, NULL);
+        r = cg_all_unified();
+        if (r < 0)
+                return r;
+        if (r > 0)
+                /* All controllers share a single hierarchy, hence walk it only once and read the attributes
+                 * of all controllers while at it. */
+                return refresh_one(controllers, root, a, b, iteration, 0, NULL);
+
+        STRV_FOREACH(c, controllers) {
+                r = refresh_one(STRV_MAKE(*c), root, a, b, iteration, 0, NULL);
                 if (r < 0)
                         return r;
         }
@@ -926,6 +983,9 @@ static int run(int argc, char *argv[]) {
         if (r < 0)
                 return log_error_errno(r, "Failed to determine supported controllers: %m");
 
+        /* The attribute files of all shown cgroups are kept open. */
+        (void) rlimit_nofile_bump(HIGH_RLIMIT_NOFILE);
+
         arg_count = (mask & CGROUP_MASK_PIDS) ? COUNT_PIDS : COUNT_USERSPACE_PROCESSES;
 
         if (arg_recursive_unset && arg_count == COUNT_PIDS)
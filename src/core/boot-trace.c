@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "boot-trace.h"
+#include "manager.h"
+#include "string-table.h"
+#include "unit.h"
+
+static bool manager_boot_trace_enabled(Manager *m) {
+        assert(m);
+
+        /* Only the boot is traced, afterwards this costs nothing. */
+        return m->boot_trace && !MANAGER_IS_FINISHED(m) && !MANAGER_IS_TEST_RUN(m);
+}
+
+void manager_boot_trace(Manager *m, const char *unit, BootTraceEventType type, usec_t timestamp, usec_t duration) {
+        BootTraceEvent *e;
+        char *copy;
+
+        assert(m);
+        assert(unit);
+        assert(type >= 0 && type < _BOOT_TRACE_EVENT_TYPE_MAX);
+
+        if (!manager_boot_trace_enabled(m))
+                return;
+
+        if (!m->boot_trace_events) {
+                m->boot_trace_events = new0(BootTraceEvent, BOOT_TRACE_EVENTS_MAX);
+                if (!m->boot_trace_events)
+                        return (void) log_oom_debug();
+        }
+
+        copy = strdup(unit);
+        if (!copy)
+                return (void) log_oom_debug();
+
+        /* Once the buffer is full, the oldest event is overwritten. */
+        e = m->boot_trace_events + (m->boot_trace_head + m->n_boot_trace_events) % BOOT_TRACE_EVENTS_MAX;
+        if (m->n_boot_trace_events < BOOT_TRACE_EVENTS_MAX)
+                m->n_boot_trace_events++;
+        else
+                m->boot_trace_head = (m->boot_trace_head + 1) % BOOT_TRACE_EVENTS_MAX;
+
+        free(e->unit);
+        *e = (BootTraceEvent) {
+                .unit = copy,
+                .type = type,
+                .timestamp = timestamp,
+                .duration = duration,
+        };
+}
+
+void manager_free_boot_trace(Manager *m) {
+        assert(m);
+
+        if (m->boot_trace_events)
+                for (size_t i = 0; i < BOOT_TRACE_EVENTS_MAX; i++)
+                        free(m->boot_trace_events[i].unit);
+
+        m->boot_trace_events = mfree(m->boot_trace_events);
+        m->boot_trace_head = m->n_boot_trace_events = 0;
+}
+
+void unit_boot_trace(Unit *u, BootTraceEventType type, usec_t start) {
+        usec_t n;
+
+        assert(u);
+
+        if (!manager_boot_trace_enabled(u->manager))
+                return;
+
+        n = now(CLOCK_MONOTONIC);
+        if (start == USEC_INFINITY)
+                manager_boot_trace(u->manager, u->id, type, n, 0);
+        else
+                manager_boot_trace(u->manager, u->id, type, start, usec_sub_unsigned(n, start));
+}
+
+static const char* const boot_trace_event_type_table[_BOOT_TRACE_EVENT_TYPE_MAX] = {
+        [BOOT_TRACE_JOB_ENQUEUED]   = "job-enqueued",
+        [BOOT_TRACE_JOB_RUNNING]    = "job-running",
+        [BOOT_TRACE_JOB_FINISHED]   = "job-finished",
+        [BOOT_TRACE_CGROUP_REALIZE] = "cgroup-realize",
+        [BOOT_TRACE_EXEC_SPAWN]     = "exec-spawn",
+        [BOOT_TRACE_EXEC_EXITED]    = "exec-exited",
+        [BOOT_TRACE_READY]          = "ready",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(boot_trace_event_type, BootTraceEventType);
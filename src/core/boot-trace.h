@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "macro.h"
+#include "time-util.h"
+
+typedef struct Manager Manager;
+typedef struct Unit Unit;
+
+/* With BootTrace= enabled, the service manager records what happens to each unit while booting in a ring
+ * buffer, so that "systemd-analyze trace" can show where the boot actually waits. Events with a duration
+ * cover an operation PID 1 itself performs synchronously, all others are instants. */
+
+#define BOOT_TRACE_EVENTS_MAX 16384U
+
+typedef enum BootTraceEventType {
+        BOOT_TRACE_JOB_ENQUEUED,
+        BOOT_TRACE_JOB_RUNNING,        /* All ordering dependencies are satisfied */
+        BOOT_TRACE_JOB_FINISHED,
+        BOOT_TRACE_CGROUP_REALIZE,
+        BOOT_TRACE_EXEC_SPAWN,
+        BOOT_TRACE_EXEC_EXITED,
+        BOOT_TRACE_READY,
+        _BOOT_TRACE_EVENT_TYPE_MAX,
+        _BOOT_TRACE_EVENT_TYPE_INVALID = -EINVAL,
+} BootTraceEventType;
+
+typedef struct BootTraceEvent {
+        char *unit;
+        BootTraceEventType type;
+        usec_t timestamp;              /* CLOCK_MONOTONIC */
+        usec_t duration;
+} BootTraceEvent;
+
+void manager_boot_trace(Manager *m, const char *unit, BootTraceEventType type, usec_t timestamp, usec_t duration);
+void manager_free_boot_trace(Manager *m);
+
+/* Records an event for the unit. If 'start' is not USEC_INFINITY, the event lasted from then until now. */
+void unit_boot_trace(Unit *u, BootTraceEventType type, usec_t start);
+
+const char* boot_trace_event_type_to_string(BootTraceEventType i) _const_;
+BootTraceEventType boot_trace_event_type_from_string(const char *s) _pure_;
@@ -17,10 +17,13 @@
 #include "alloc-util.h"
 #include "bpf-firewall.h"
 #include "bpf-program.h"
+#include "cpu-set-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "in-addr-prefix-util.h"
 #include "memory-util.h"
 #include "missing_syscall.h"
+#include "sort-util.h"
 #include "unit.h"
 #include "strv.h"
 #include "virt.h"
@@ -35,6 +38,47 @@ enum {
         ACCESS_DENIED  = 2,
 };
 
+/* The LPM trie maps implementing IPAddressAllow= and IPAddressDeny= of a unit. These rules are typically
+ * set in a drop-in or on a slice and hence the same for many units, so the maps are shared between all
+ * units with the same effective rules, keyed by a canonical string representation of them. The BPF
+ * programs of units that do not do IP accounting only depend on these maps, hence they are shared too. */
+struct BPFFirewallAccess {
+        Manager *manager;
+        unsigned n_ref;
+        char *key;
+
+        int ipv4_allow_map_fd;
+        int ipv6_allow_map_fd;
+        int ipv4_deny_map_fd;
+        int ipv6_deny_map_fd;
+        bool allow_any;
+        bool deny_any;
+
+        /* Loaded programs without accounting, indexed by is_ingress */
+        int prog_fd[2];
+};
+
+static BPFFirewallAccess *bpf_firewall_access_free(BPFFirewallAccess *a) {
+        if (!a)
+                return NULL;
+
+        if (a->manager && a->key)
+                hashmap_remove_value(a->manager->bpf_firewall_access, a->key, a);
+
+        safe_close(a->ipv4_allow_map_fd);
+        safe_close(a->ipv6_allow_map_fd);
+        safe_close(a->ipv4_deny_map_fd);
+        safe_close(a->ipv6_deny_map_fd);
+        safe_close(a->prog_fd[false]);
+        safe_close(a->prog_fd[true]);
+
+        free(a->key);
+        return mfree(a);
+}
+
+DEFINE_PRIVATE_TRIVIAL_REF_UNREF_FUNC(BPFFirewallAccess, bpf_firewall_access, bpf_firewall_access_free);
+DEFINE_TRIVIAL_CLEANUP_FUNC(BPFFirewallAccess*, bpf_firewall_access_unref);
+
 /* Compile instructions for one list of addresses, one direction and one specific verdict on matches. */
 
 static int add_lookup_instructions(
@@ -147,9 +191,7 @@ static int bpf_firewall_compile_bpf(
                 Unit *u,
                 const char *prog_name,
                 bool is_ingress,
-                BPFProgram **ret,
-                bool ip_allow_any,
-                bool ip_deny_any) {
+                BPFProgram **ret) {
 
         const struct bpf_insn pre_insn[] = {
                 /*
@@ -194,23 +236,26 @@ static int bpf_firewall_compile_bpf(
         };
 
         _cleanup_(bpf_program_freep) BPFProgram *p = NULL;
+        BPFFirewallAccess *a;
         int accounting_map_fd, r;
         bool access_enabled;
 
         assert(u);
         assert(ret);
 
+        a = u->ip_bpf_access;
+
         accounting_map_fd = is_ingress ?
                 u->ip_accounting_ingress_map_fd :
                 u->ip_accounting_egress_map_fd;
 
-        access_enabled =
-                u->ipv4_allow_map_fd >= 0 ||
-                u->ipv6_allow_map_fd >= 0 ||
-                u->ipv4_deny_map_fd >= 0 ||
-                u->ipv6_deny_map_fd >= 0 ||
-                ip_allow_any ||
-                ip_deny_any;
+        access_enabled = a &&
+                (a->ipv4_allow_map_fd >= 0 ||
+                 a->ipv6_allow_map_fd >= 0 ||
+                 a->ipv4_deny_map_fd >= 0 ||
+                 a->ipv6_deny_map_fd >= 0 ||
+                 a->allow_any ||
+                 a->deny_any);
 
         if (accounting_map_fd < 0 && !access_enabled) {
                 *ret = NULL;
@@ -221,6 +266,16 @@ static int bpf_firewall_compile_bpf(
         if (r < 0)
                 return r;
 
+        if (accounting_map_fd < 0 && a->prog_fd[is_ingress] >= 0) {
+                /* Another unit with the same rules loaded this program already. */
+                p->kernel_fd = fcntl(a->prog_fd[is_ingress], F_DUPFD_CLOEXEC, 3);
+                if (p->kernel_fd < 0)
+                        return -errno;
+
+                *ret = TAKE_PTR(p);
+                return 0;
+        }
+
         r = bpf_program_add_instructions(p, pre_insn, ELEMENTSOF(pre_insn));
         if (r < 0)
                 return r;
@@ -234,37 +289,37 @@ static int bpf_firewall_compile_bpf(
                  * - Otherwise, access will be granted
                  */
 
-                if (u->ipv4_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_deny_map_fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
+                if (a->ipv4_deny_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ipv4_deny_map_fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_deny_map_fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
+                if (a->ipv6_deny_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ipv6_deny_map_fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv4_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_allow_map_fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
+                if (a->ipv4_allow_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ipv4_allow_map_fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_allow_map_fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
+                if (a->ipv6_allow_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ipv6_allow_map_fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (ip_allow_any) {
+                if (a->allow_any) {
                         r = add_instructions_for_ip_any(p, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (ip_deny_any) {
+                if (a->deny_any) {
                         r = add_instructions_for_ip_any(p, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
@@ -331,6 +386,17 @@ static int bpf_firewall_compile_bpf(
                         return r;
         } while (false);
 
+        if (accounting_map_fd < 0) {
+                /* Load the program right away, so that other units with the same rules can use it. */
+                r = bpf_program_load_kernel(p, NULL, 0);
+                if (r < 0)
+                        return r;
+
+                a->prog_fd[is_ingress] = fcntl(p->kernel_fd, F_DUPFD_CLOEXEC, 3);
+                if (a->prog_fd[is_ingress] < 0)
+                        return -errno;
+        }
+
         *ret = TAKE_PTR(p);
 
         return 0;
@@ -491,6 +557,140 @@ static int bpf_firewall_prepare_access_maps(
         return 0;
 }
 
+static int in_addr_prefix_compare(const struct in_addr_prefix *x, const struct in_addr_prefix *y) {
+        int r;
+
+        r = CMP(x->family, y->family);
+        if (r != 0)
+                return r;
+
+        r = CMP(x->prefixlen, y->prefixlen);
+        if (r != 0)
+                return r;
+
+        return memcmp(&x->address, &y->address, FAMILY_ADDRESS_SIZE(x->family));
+}
+
+static int bpf_firewall_access_key_append(Unit *u, int verdict, char **key) {
+        _cleanup_free_ struct in_addr_prefix *items = NULL;
+        size_t n_items = 0;
+        bool any = false;
+        int r;
+
+        assert(u);
+        assert(key);
+
+        /* Collects the rules of the unit and its slices that end up in the maps built by
+         * bpf_firewall_prepare_access_maps(), and appends them to the key in a canonical order. */
+
+        for (Unit *p = u; p; p = UNIT_GET_SLICE(p)) {
+                struct in_addr_prefix *a;
+                CGroupContext *cc;
+                Set *prefixes;
+                bool *reduced;
+
+                cc = unit_get_cgroup_context(p);
+                if (!cc)
+                        continue;
+
+                prefixes = verdict == ACCESS_ALLOWED ? cc->ip_address_allow : cc->ip_address_deny;
+                reduced = verdict == ACCESS_ALLOWED ? &cc->ip_address_allow_reduced : &cc->ip_address_deny_reduced;
+
+                if (!*reduced) {
+                        r = in_addr_prefixes_reduce(prefixes);
+                        if (r < 0)
+                                return r;
+
+                        *reduced = true;
+                }
+
+                if (in_addr_prefixes_is_any(prefixes)) {
+                        any = true;
+                        break;
+                }
+
+                if (!GREEDY_REALLOC(items, n_items + set_size(prefixes)))
+                        return -ENOMEM;
+
+                SET_FOREACH(a, prefixes)
+                        items[n_items++] = *a;
+        }
+
+        if (!strextend(key, verdict == ACCESS_ALLOWED ? "allow:" : " deny:"))
+                return -ENOMEM;
+
+        if (any)
+                return strextend(key, " any") ? 0 : -ENOMEM;
+
+        typesafe_qsort(items, n_items, in_addr_prefix_compare);
+
+        for (size_t i = 0; i < n_items; i++) {
+                r = strextendf(key, " %s",
+                               IN_ADDR_PREFIX_TO_STRING(items[i].family, &items[i].address, items[i].prefixlen));
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int bpf_firewall_access_acquire(Unit *u, BPFFirewallAccess **ret) {
+        _cleanup_(bpf_firewall_access_unrefp) BPFFirewallAccess *a = NULL;
+        _cleanup_free_ char *key = NULL;
+        BPFFirewallAccess *existing;
+        int r;
+
+        assert(u);
+        assert(u->manager);
+        assert(ret);
+
+        r = bpf_firewall_access_key_append(u, ACCESS_ALLOWED, &key);
+        if (r < 0)
+                return r;
+
+        r = bpf_firewall_access_key_append(u, ACCESS_DENIED, &key);
+        if (r < 0)
+                return r;
+
+        existing = hashmap_get(u->manager->bpf_firewall_access, key);
+        if (existing) {
+                log_unit_debug(u, "bpf-firewall: Sharing BPF access maps with other units with the same rules.");
+                *ret = bpf_firewall_access_ref(existing);
+                return 0;
+        }
+
+        a = new(BPFFirewallAccess, 1);
+        if (!a)
+                return -ENOMEM;
+
+        *a = (BPFFirewallAccess) {
+                .n_ref = 1,
+                .ipv4_allow_map_fd = -1,
+                .ipv6_allow_map_fd = -1,
+                .ipv4_deny_map_fd = -1,
+                .ipv6_deny_map_fd = -1,
+                .prog_fd = { -1, -1 },
+        };
+
+        r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &a->ipv4_allow_map_fd, &a->ipv6_allow_map_fd, &a->allow_any);
+        if (r < 0)
+                return r;
+
+        r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &a->ipv4_deny_map_fd, &a->ipv6_deny_map_fd, &a->deny_any);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_put(&u->manager->bpf_firewall_access, &string_hash_ops, key, a);
+        if (r < 0)
+                return r;
+
+        a->manager = u->manager;
+        a->key = TAKE_PTR(key);
+
+        *ret = TAKE_PTR(a);
+        return 0;
+}
+
 static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_ingress, int *fd_egress) {
         int r;
 
@@ -500,7 +700,7 @@ static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_i
 
         if (enabled) {
                 if (*fd_ingress < 0) {
-                        r = bpf_map_new(BPF_MAP_TYPE_ARRAY, sizeof(int), sizeof(uint64_t), 2, 0);
+                        r = bpf_map_new(BPF_MAP_TYPE_PERCPU_ARRAY, sizeof(int), sizeof(uint64_t), 2, 0);
                         if (r < 0)
                                 return r;
 
@@ -508,8 +708,7 @@ static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_i
                 }
 
                 if (*fd_egress < 0) {
-
-                        r = bpf_map_new(BPF_MAP_TYPE_ARRAY, sizeof(int), sizeof(uint64_t), 2, 0);
+                        r = bpf_map_new(BPF_MAP_TYPE_PERCPU_ARRAY, sizeof(int), sizeof(uint64_t), 2, 0);
                         if (r < 0)
                                 return r;
 
@@ -520,7 +719,8 @@ static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_i
                 *fd_ingress = safe_close(*fd_ingress);
                 *fd_egress = safe_close(*fd_egress);
 
-                zero(u->ip_accounting_extra);
+                if (u->cgroup_accounting)
+                        zero(u->cgroup_accounting->ip_accounting_extra);
         }
 
         return 0;
@@ -528,7 +728,6 @@ static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_i
 
 int bpf_firewall_compile(Unit *u) {
         const char *ingress_name = NULL, *egress_name = NULL;
-        bool ip_allow_any = false, ip_deny_any = false;
         CGroupContext *cc;
         int r, supported;
 
@@ -567,11 +766,7 @@ int bpf_firewall_compile(Unit *u) {
         u->ip_bpf_ingress = bpf_program_free(u->ip_bpf_ingress);
         u->ip_bpf_egress = bpf_program_free(u->ip_bpf_egress);
 
-        u->ipv4_allow_map_fd = safe_close(u->ipv4_allow_map_fd);
-        u->ipv4_deny_map_fd = safe_close(u->ipv4_deny_map_fd);
-
-        u->ipv6_allow_map_fd = safe_close(u->ipv6_allow_map_fd);
-        u->ipv6_deny_map_fd = safe_close(u->ipv6_deny_map_fd);
+        u->ip_bpf_access = bpf_firewall_access_unref(u->ip_bpf_access);
 
         if (u->type != UNIT_SLICE) {
                 /* In inner nodes we only do accounting, we do not actually bother with access control. However, leaf
@@ -580,24 +775,20 @@ int bpf_firewall_compile(Unit *u) {
                  * means that all configure IP access rules *will* take effect on processes, even though we never
                  * compile them for inner nodes. */
 
-                r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &u->ipv4_allow_map_fd, &u->ipv6_allow_map_fd, &ip_allow_any);
-                if (r < 0)
-                        return log_unit_error_errno(u, r, "bpf-firewall: Preparation of BPF allow maps failed: %m");
-
-                r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &u->ipv4_deny_map_fd, &u->ipv6_deny_map_fd, &ip_deny_any);
+                r = bpf_firewall_access_acquire(u, &u->ip_bpf_access);
                 if (r < 0)
-                        return log_unit_error_errno(u, r, "bpf-firewall: Preparation of BPF deny maps failed: %m");
+                        return log_unit_error_errno(u, r, "bpf-firewall: Preparation of BPF access maps failed: %m");
         }
 
         r = bpf_firewall_prepare_accounting_maps(u, cc->ip_accounting, &u->ip_accounting_ingress_map_fd, &u->ip_accounting_egress_map_fd);
         if (r < 0)
                 return log_unit_error_errno(u, r, "bpf-firewall: Preparation of BPF accounting maps failed: %m");
 
-        r = bpf_firewall_compile_bpf(u, ingress_name, true, &u->ip_bpf_ingress, ip_allow_any, ip_deny_any);
+        r = bpf_firewall_compile_bpf(u, ingress_name, true, &u->ip_bpf_ingress);
         if (r < 0)
                 return log_unit_error_errno(u, r, "bpf-firewall: Compilation of ingress BPF program failed: %m");
 
-        r = bpf_firewall_compile_bpf(u, egress_name, false, &u->ip_bpf_egress, ip_allow_any, ip_deny_any);
+        r = bpf_firewall_compile_bpf(u, egress_name, false, &u->ip_bpf_egress);
         if (r < 0)
                 return log_unit_error_errno(u, r, "bpf-firewall: Compilation of egress BPF program failed: %m");
 
@@ -763,23 +954,79 @@ int bpf_firewall_install(Unit *u) {
         return 0;
 }
 
-int bpf_firewall_read_accounting(int map_fd, uint64_t *ret_bytes, uint64_t *ret_packets) {
-        uint64_t key, packets;
+static int n_possible_cpus(void) {
+        static int cached = 0;
+        _cleanup_(cpu_set_reset) CPUSet cpus = {};
+        _cleanup_free_ char *line = NULL;
+        int r, n;
+
+        /* The kernel copies one value for each possible CPU when looking up or updating an element of a
+         * per-CPU map, hence we need to know how many there are. */
+
+        if (cached > 0)
+                return cached;
+
+        r = read_one_line_file("/sys/devices/system/cpu/possible", &line);
+        if (r < 0)
+                return r;
+
+        r = parse_cpu_set(line, &cpus);
+        if (r < 0)
+                return r;
+
+        n = CPU_COUNT_S(cpus.allocated, cpus.set);
+        if (n <= 0)
+                return -EINVAL;
+
+        return (cached = n);
+}
+
+static int read_percpu_counter(int map_fd, uint64_t key, int n_cpus, uint64_t *ret) {
+        _cleanup_free_ uint64_t *values = NULL;
+        uint64_t sum = 0;
         int r;
 
+        assert(map_fd >= 0);
+        assert(n_cpus > 0);
+        assert(ret);
+
+        values = new(uint64_t, n_cpus);
+        if (!values)
+                return -ENOMEM;
+
+        r = bpf_map_lookup_element(map_fd, &key, values);
+        if (r < 0)
+                return r;
+
+        for (int i = 0; i < n_cpus; i++)
+                sum += values[i];
+
+        *ret = sum;
+        return 0;
+}
+
+int bpf_firewall_read_accounting(int map_fd, uint64_t *ret_bytes, uint64_t *ret_packets) {
+        uint64_t packets;
+        int r, n_cpus;
+
+        /* The counters are kept in per-CPU maps, so that packets processed on different CPUs do not
+         * contend on the same cache line. Sum them up here. */
+
         if (map_fd < 0)
                 return -EBADF;
 
+        n_cpus = n_possible_cpus();
+        if (n_cpus < 0)
+                return n_cpus;
+
         if (ret_packets) {
-                key = MAP_KEY_PACKETS;
-                r = bpf_map_lookup_element(map_fd, &key, &packets);
+                r = read_percpu_counter(map_fd, MAP_KEY_PACKETS, n_cpus, &packets);
                 if (r < 0)
                         return r;
         }
 
         if (ret_bytes) {
-                key = MAP_KEY_BYTES;
-                r = bpf_map_lookup_element(map_fd, &key, ret_bytes);
+                r = read_percpu_counter(map_fd, MAP_KEY_BYTES, n_cpus, ret_bytes);
                 if (r < 0)
                         return r;
         }
@@ -791,19 +1038,28 @@ int bpf_firewall_read_accounting(int map_fd, uint64_t *ret_bytes, uint64_t *ret_
 }
 
 int bpf_firewall_reset_accounting(int map_fd) {
-        uint64_t key, value = 0;
-        int r;
+        _cleanup_free_ uint64_t *values = NULL;
+        uint64_t key;
+        int r, n_cpus;
 
         if (map_fd < 0)
                 return -EBADF;
 
+        n_cpus = n_possible_cpus();
+        if (n_cpus < 0)
+                return n_cpus;
+
+        values = new0(uint64_t, n_cpus);
+        if (!values)
+                return -ENOMEM;
+
         key = MAP_KEY_PACKETS;
-        r = bpf_map_update_element(map_fd, &key, &value);
+        r = bpf_map_update_element(map_fd, &key, values);
         if (r < 0)
                 return r;
 
         key = MAP_KEY_BYTES;
-        return bpf_map_update_element(map_fd, &key, &value);
+        return bpf_map_update_element(map_fd, &key, values);
 }
 
 static int bpf_firewall_unsupported_reason = 0;
@@ -952,10 +1208,7 @@ void bpf_firewall_close(Unit *u) {
         u->ip_accounting_ingress_map_fd = safe_close(u->ip_accounting_ingress_map_fd);
         u->ip_accounting_egress_map_fd = safe_close(u->ip_accounting_egress_map_fd);
 
-        u->ipv4_allow_map_fd = safe_close(u->ipv4_allow_map_fd);
-        u->ipv6_allow_map_fd = safe_close(u->ipv6_allow_map_fd);
-        u->ipv4_deny_map_fd = safe_close(u->ipv4_deny_map_fd);
-        u->ipv6_deny_map_fd = safe_close(u->ipv6_deny_map_fd);
+        u->ip_bpf_access = bpf_firewall_access_unref(u->ip_bpf_access);
 
         u->ip_bpf_ingress = bpf_program_free(u->ip_bpf_ingress);
         u->ip_bpf_ingress_installed = bpf_program_free(u->ip_bpf_ingress_installed);
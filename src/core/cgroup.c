@@ -16,6 +16,7 @@
 #include "cgroup-setup.h"
 #include "cgroup-util.h"
 #include "cgroup.h"
+#include "critical-chain.h"
 #include "devnum-util.h"
 #include "fd-util.h"
 #include "fileio.h"
@@ -24,6 +25,7 @@
 #include "io-util.h"
 #include "ip-protocol-list.h"
 #include "limits-util.h"
+#include "numa-util.h"
 #include "nulstr-util.h"
 #include "parse-util.h"
 #include "path-util.h"
@@ -45,6 +47,9 @@
 
 #define CGROUP_CPU_QUOTA_DEFAULT_PERIOD_USEC ((usec_t) 100 * USEC_PER_MSEC)
 
+/* How often to check cgroups we couldn't get an inotify watch for */
+#define CGROUP_POLL_INTERVAL_USEC ((usec_t) 1 * USEC_PER_SEC)
+
 /* Returns the log level to use when cgroup attribute writes fail. When an attribute is missing or we have access
  * problems we downgrade to LOG_DEBUG. This is supposed to be nice to container managers and kernels which want to mask
  * out specific attributes from us. */
@@ -90,7 +95,8 @@ bool unit_has_startup_cgroup_constraints(Unit *u) {
                c->startup_io_weight != CGROUP_WEIGHT_INVALID ||
                c->startup_blockio_weight != CGROUP_BLKIO_WEIGHT_INVALID ||
                c->startup_cpuset_cpus.set ||
-               c->startup_cpuset_mems.set;
+               c->startup_cpuset_mems.set ||
+               unit_on_critical_chain(u);
 }
 
 bool unit_has_host_root_cgroup(Unit *u) {
@@ -105,15 +111,61 @@ bool unit_has_host_root_cgroup(Unit *u) {
         return unit_has_name(u, SPECIAL_ROOT_SLICE);
 }
 
-static int set_attribute_and_warn(Unit *u, const char *controller, const char *attribute, const char *value) {
+int unit_remember_cgroup_attribute(Unit *u, const char *attribute, const char *value) {
+        _cleanup_free_ char *a = NULL, *v = NULL;
+        char *old_key;
         int r;
 
-        r = cg_set_attribute(controller, u->cgroup_path, attribute, value);
+        assert(u);
+        assert(attribute);
+
+        /* Records the value we last wrote to the specified cgroup attribute. If value is NULL the attribute is
+         * forgotten, so that it is written unconditionally the next time. On failure the attribute is
+         * forgotten too. */
+
+        free(hashmap_remove2(u->cgroup_attributes, attribute, (void**) &old_key));
+        free(old_key);
+
+        if (!value)
+                return 0;
+
+        a = strdup(attribute);
+        v = strdup(value);
+        if (!a || !v)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(&u->cgroup_attributes, &string_hash_ops_free_free, a, v);
         if (r < 0)
+                return r;
+
+        TAKE_PTR(a);
+        TAKE_PTR(v);
+        return 0;
+}
+
+static int set_attribute_and_warn(Unit *u, const char *controller, const char *attribute, const char *value) {
+        int r;
+
+        /* Writing to cgroupfs is not cheap, and on every reload we re-apply the cgroup context of all units,
+         * hence skip the write if the attribute already has the value we want. */
+        if (streq_ptr(hashmap_get(u->cgroup_attributes, attribute), value))
+                return 0;
+
+        if (u->cgroup_attributes_fd >= 0)
+                r = cg_set_attribute_at(u->cgroup_attributes_fd, attribute, value);
+        else
+                r = cg_set_attribute(controller, u->cgroup_path, attribute, value);
+        if (r < 0) {
                 log_unit_full_errno(u, LOG_LEVEL_CGROUP_WRITE(r), r, "Failed to set '%s' attribute on '%s' to '%.*s': %m",
                                     strna(attribute), empty_to_root(u->cgroup_path), (int) strcspn(value, NEWLINE), value);
 
-        return r;
+                /* We don't know what the attribute is set to now, hence make sure to write it next time */
+                (void) unit_remember_cgroup_attribute(u, attribute, NULL);
+                return r;
+        }
+
+        (void) unit_remember_cgroup_attribute(u, attribute, value);
+        return 0;
 }
 
 static void cgroup_compat_warn(void) {
@@ -454,6 +506,7 @@ void cgroup_context_dump(Unit *u, FILE* f, const char *prefix) {
                 "%sStartupAllowedCPUs: %s\n"
                 "%sAllowedMemoryNodes: %s\n"
                 "%sStartupAllowedMemoryNodes: %s\n"
+                "%sAutoNUMAPlacement: %s\n"
                 "%sIOWeight: %" PRIu64 "\n"
                 "%sStartupIOWeight: %" PRIu64 "\n"
                 "%sBlockIOWeight: %" PRIu64 "\n"
@@ -490,6 +543,7 @@ void cgroup_context_dump(Unit *u, FILE* f, const char *prefix) {
                 prefix, strempty(startup_cpuset_cpus),
                 prefix, strempty(cpuset_mems),
                 prefix, strempty(startup_cpuset_mems),
+                prefix, yes_no(c->numa_auto_placement),
                 prefix, c->io_weight,
                 prefix, c->startup_io_weight,
                 prefix, c->blockio_weight,
@@ -886,6 +940,15 @@ static uint64_t cgroup_context_cpu_weight(CGroupContext *c, ManagerState state)
                 return CGROUP_WEIGHT_DEFAULT;
 }
 
+static uint64_t unit_get_default_weight(Unit *u, ManagerState state) {
+        /* Units on the critical chain of the previous boot get a larger share while booting, unless they
+         * have a weight configured explicitly. */
+        if (IN_SET(state, MANAGER_STARTING, MANAGER_INITIALIZING) && unit_on_critical_chain(u))
+                return CRITICAL_CHAIN_STARTUP_WEIGHT;
+
+        return CGROUP_WEIGHT_DEFAULT;
+}
+
 static uint64_t cgroup_context_cpu_shares(CGroupContext *c, ManagerState state) {
         if (IN_SET(state, MANAGER_STARTING, MANAGER_INITIALIZING, MANAGER_STOPPING) &&
             c->startup_cpu_shares != CGROUP_CPU_SHARES_INVALID)
@@ -1008,6 +1071,132 @@ static void cgroup_apply_unified_cpuset(Unit *u, const CPUSet *cpus, const char
         (void) set_attribute_and_warn(u, "cpuset", name, buf);
 }
 
+void unit_set_numa_node(Unit *u, int node) {
+        Manager *m;
+
+        assert(u);
+        assert_se(m = u->manager);
+
+        /* Keeps track of how many units we placed on each NUMA node, so that new units can be placed on the
+         * least used one. */
+
+        if (u->cgroup_numa_node == node)
+                return;
+
+        if (u->cgroup_numa_node >= 0 && (size_t) u->cgroup_numa_node < m->n_numa_node_units) {
+                assert(m->numa_node_units[u->cgroup_numa_node] > 0);
+                m->numa_node_units[u->cgroup_numa_node]--;
+        }
+
+        u->cgroup_numa_node = -1;
+
+        if (node < 0)
+                return;
+
+        if ((size_t) node >= m->n_numa_node_units) {
+                if (!GREEDY_REALLOC0(m->numa_node_units, node + 1)) {
+                        log_oom();
+                        return;
+                }
+
+                m->n_numa_node_units = node + 1;
+        }
+
+        m->numa_node_units[node]++;
+        u->cgroup_numa_node = node;
+}
+
+static int unit_pick_numa_node(Unit *u) {
+        _cleanup_(cpu_set_reset) CPUSet nodes = {};
+        uint64_t best_free = 0;
+        unsigned best_units = 0;
+        int best = -1, n_candidates = 0, r;
+        Manager *m;
+
+        assert(u);
+        assert_se(m = u->manager);
+
+        /* Picks the node with the fewest units we placed on it, and among those the one with the most free
+         * memory. Nodes without CPUs are skipped, since we need to confine the unit to some CPUs, too.
+         * Returns -ENODEV if there is only one node to pick from, as there is nothing to gain then. */
+
+        r = numa_get_online_nodes(&nodes);
+        if (r < 0)
+                return r;
+
+        for (unsigned node = 0; node < nodes.allocated * 8; node++) {
+                _cleanup_(cpu_set_reset) CPUSet cpus = {};
+                uint64_t free_memory;
+                unsigned n_units;
+
+                if (!CPU_ISSET_S(node, nodes.allocated, nodes.set))
+                        continue;
+
+                if (numa_node_get_cpus(node, &cpus) < 0 || !cpus.set || CPU_COUNT_S(cpus.allocated, cpus.set) == 0)
+                        continue;
+
+                r = numa_node_get_free_memory(node, &free_memory);
+                if (r < 0) {
+                        log_unit_debug_errno(u, r, "Failed to read free memory of NUMA node %u, ignoring: %m", node);
+                        continue;
+                }
+
+                n_candidates++;
+
+                n_units = node < m->n_numa_node_units ? m->numa_node_units[node] : 0;
+                if (best < 0 || n_units < best_units || (n_units == best_units && free_memory > best_free)) {
+                        best = node;
+                        best_units = n_units;
+                        best_free = free_memory;
+                }
+        }
+
+        if (n_candidates < 2)
+                return -ENODEV;
+
+        return best;
+}
+
+static void cgroup_apply_numa_placement(Unit *u) {
+        _cleanup_(cpu_set_reset) CPUSet cpus = {}, mems = {};
+        int r;
+
+        assert(u);
+
+        if (u->cgroup_numa_node < 0) {
+                r = unit_pick_numa_node(u);
+                if (r == -ENODEV) {
+                        log_unit_debug(u, "Not more than one NUMA node with CPUs available, not placing unit.");
+                        return;
+                }
+                if (r < 0) {
+                        log_unit_warning_errno(u, r, "Failed to pick NUMA node for unit, ignoring: %m");
+                        return;
+                }
+
+                unit_set_numa_node(u, r);
+                if (u->cgroup_numa_node < 0)
+                        return;
+
+                log_unit_debug(u, "Placing unit on NUMA node %i.", u->cgroup_numa_node);
+        }
+
+        r = numa_node_get_cpus(u->cgroup_numa_node, &cpus);
+        if (r < 0) {
+                log_unit_warning_errno(u, r, "Failed to read CPUs of NUMA node %i, ignoring: %m", u->cgroup_numa_node);
+                return;
+        }
+
+        r = cpu_set_add(&mems, u->cgroup_numa_node);
+        if (r < 0) {
+                log_oom();
+                return;
+        }
+
+        cgroup_apply_unified_cpuset(u, &cpus, "cpuset.cpus");
+        cgroup_apply_unified_cpuset(u, &mems, "cpuset.mems");
+}
+
 static bool cgroup_context_has_io_config(CGroupContext *c) {
         return c->io_accounting ||
                 c->io_weight != CGROUP_WEIGHT_INVALID ||
@@ -1371,6 +1560,16 @@ static void cgroup_context_apply(
         if (is_local_root) /* Make sure we don't try to display messages with an empty path. */
                 path = "/";
 
+        /* On the unified hierarchy all attributes of a cgroup are located in the same directory, hence open it
+         * once and write the attributes relative to it, instead of resolving the full path for each write. If
+         * this fails we'll fall back to the latter. */
+        if (cg_all_unified() > 0) {
+                _cleanup_free_ char *fs = NULL;
+
+                if (cg_get_path(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, NULL, &fs) >= 0)
+                        u->cgroup_attributes_fd = open(fs, O_PATH|O_DIRECTORY|O_CLOEXEC);
+        }
+
         /* We generally ignore errors caused by read-only mounted cgroup trees (assuming we are running in a container
          * then), and missing cgroups, i.e. EROFS and ENOENT. */
 
@@ -1395,7 +1594,7 @@ static void cgroup_context_apply(
                                 log_cgroup_compat(u, "Applying [Startup]CPUShares=%" PRIu64 " as [Startup]CPUWeight=%" PRIu64 " on %s",
                                                   shares, weight, path);
                         } else
-                                weight = CGROUP_WEIGHT_DEFAULT;
+                                weight = unit_get_default_weight(u, state);
 
                         cgroup_apply_unified_cpu_weight(u, weight);
                         cgroup_apply_unified_cpu_quota(u, c->cpu_quota_per_sec_usec, c->cpu_quota_period_usec);
@@ -1414,7 +1613,7 @@ static void cgroup_context_apply(
                         } else if (cgroup_context_has_cpu_shares(c))
                                 shares = cgroup_context_cpu_shares(c, state);
                         else
-                                shares = CGROUP_CPU_SHARES_DEFAULT;
+                                shares = cgroup_cpu_weight_to_shares(unit_get_default_weight(u, state));
 
                         cgroup_apply_legacy_cpu_shares(u, shares);
                         cgroup_apply_legacy_cpu_quota(u, c->cpu_quota_per_sec_usec, c->cpu_quota_period_usec);
@@ -1422,8 +1621,15 @@ static void cgroup_context_apply(
         }
 
         if ((apply_mask & CGROUP_MASK_CPUSET) && !is_local_root) {
-                cgroup_apply_unified_cpuset(u, cgroup_context_allowed_cpus(c, state), "cpuset.cpus");
-                cgroup_apply_unified_cpuset(u, cgroup_context_allowed_mems(c, state), "cpuset.mems");
+                /* Explicitly configured CPUs and memory nodes take precedence over automatic placement. */
+                if (c->numa_auto_placement && !cgroup_context_has_allowed_cpus(c) && !cgroup_context_has_allowed_mems(c))
+                        cgroup_apply_numa_placement(u);
+                else {
+                        unit_set_numa_node(u, -1);
+
+                        cgroup_apply_unified_cpuset(u, cgroup_context_allowed_cpus(c, state), "cpuset.cpus");
+                        cgroup_apply_unified_cpuset(u, cgroup_context_allowed_mems(c, state), "cpuset.mems");
+                }
         }
 
         /* The 'io' controller attributes are not exported on the host's root cgroup (being a pure cgroup v2
@@ -1447,7 +1653,7 @@ static void cgroup_context_apply(
                         log_cgroup_compat(u, "Applying [Startup]BlockIOWeight=%" PRIu64 " as [Startup]IOWeight=%" PRIu64,
                                           blkio_weight, weight);
                 } else
-                        weight = CGROUP_WEIGHT_DEFAULT;
+                        weight = unit_get_default_weight(u, state);
 
                 set_io_weight(u, weight);
 
@@ -1510,7 +1716,7 @@ static void cgroup_context_apply(
                         } else if (has_blockio)
                                 weight = cgroup_context_blkio_weight(c, state);
                         else
-                                weight = CGROUP_BLKIO_WEIGHT_DEFAULT;
+                                weight = cgroup_weight_io_to_blkio(unit_get_default_weight(u, state));
 
                         set_blkio_weight(u, weight);
 
@@ -1648,6 +1854,8 @@ static void cgroup_context_apply(
 
         if (apply_mask & CGROUP_MASK_BPF_RESTRICT_NETWORK_INTERFACES)
                 cgroup_apply_restrict_network_interfaces(u);
+
+        u->cgroup_attributes_fd = safe_close(u->cgroup_attributes_fd);
 }
 
 static bool unit_get_needs_bpf_firewall(Unit *u) {
@@ -1730,7 +1938,10 @@ static CGroupMask unit_get_cgroup_mask(Unit *u) {
             c->cpu_quota_per_sec_usec != USEC_INFINITY)
                 mask |= CGROUP_MASK_CPU;
 
-        if (cgroup_context_has_allowed_cpus(c) || cgroup_context_has_allowed_mems(c))
+        if (unit_on_critical_chain(u))
+                mask |= CGROUP_MASK_CPU | CGROUP_MASK_IO | CGROUP_MASK_BLKIO;
+
+        if (cgroup_context_has_allowed_cpus(c) || cgroup_context_has_allowed_mems(c) || c->numa_auto_placement)
                 mask |= CGROUP_MASK_CPUSET;
 
         if (cgroup_context_has_io_config(c) || cgroup_context_has_blockio_config(c))
@@ -2007,6 +2218,8 @@ int unit_set_cgroup_path(Unit *u, const char *path) {
         return 1;
 }
 
+static int unit_poll_cgroup(Unit *u);
+
 int unit_watch_cgroup(Unit *u) {
         _cleanup_free_ char *events = NULL;
         int r;
@@ -2048,6 +2261,18 @@ int unit_watch_cgroup(Unit *u) {
                                       * is not an error */
                         return 0;
 
+                if (errno == ENOSPC) { /* Out of inotify watches? Then poll, rather than never noticing
+                                        * the cgroup running empty. */
+                        static bool warned = false;
+
+                        log_unit_full_errno(u, warned ? LOG_DEBUG : LOG_WARNING, errno,
+                                            "Failed to add control inotify watch descriptor for control group %s, polling instead: %m",
+                                            empty_to_root(u->cgroup_path));
+                        warned = true;
+
+                        return unit_poll_cgroup(u);
+                }
+
                 return log_unit_error_errno(u, errno, "Failed to add control inotify watch descriptor for control group %s: %m", empty_to_root(u->cgroup_path));
         }
 
@@ -2208,6 +2433,11 @@ static int unit_update_cgroup(
                 migrate_mask = u->cgroup_realized_mask ^ target_mask;
         }
 
+        /* A freshly created cgroup carries the kernel's defaults, and if the set of controllers changed,
+         * attribute files might have come and gone. Either way what we wrote before is no longer in place. */
+        if (created || u->cgroup_realized_mask != target_mask)
+                u->cgroup_attributes = hashmap_free(u->cgroup_attributes);
+
         /* Keep track that this is now realized */
         u->cgroup_realized = true;
         u->cgroup_realized_mask = target_mask;
@@ -2705,7 +2935,9 @@ void unit_add_family_to_cgroup_realize_queue(Unit *u) {
 }
 
 int unit_realize_cgroup(Unit *u) {
+        usec_t start;
         Unit *slice;
+        int r;
 
         assert(u);
 
@@ -2726,7 +2958,11 @@ int unit_realize_cgroup(Unit *u) {
                 unit_add_family_to_cgroup_realize_queue(slice);
 
         /* And realize this one now (and apply the values) */
-        return unit_realize_cgroup_now(u, manager_state(u->manager));
+        start = now(CLOCK_MONOTONIC);
+        r = unit_realize_cgroup_now(u, manager_state(u->manager));
+        unit_boot_trace(u, BOOT_TRACE_CGROUP_REALIZE, start);
+
+        return r;
 }
 
 void unit_release_cgroup(Unit *u) {
@@ -2748,6 +2984,8 @@ void unit_release_cgroup(Unit *u) {
                 u->cgroup_control_inotify_wd = -1;
         }
 
+        (void) set_remove(u->manager->cgroup_polled_units, u);
+
         if (u->cgroup_memory_inotify_wd >= 0) {
                 if (inotify_rm_watch(u->manager->cgroup_inotify_fd, u->cgroup_memory_inotify_wd) < 0)
                         log_unit_debug_errno(u, errno, "Failed to remove cgroup memory inotify watch %i for %s, ignoring: %m", u->cgroup_memory_inotify_wd, u->id);
@@ -2755,6 +2993,10 @@ void unit_release_cgroup(Unit *u) {
                 (void) hashmap_remove(u->manager->cgroup_memory_inotify_wd_unit, INT_TO_PTR(u->cgroup_memory_inotify_wd));
                 u->cgroup_memory_inotify_wd = -1;
         }
+
+        u->cgroup_attributes = hashmap_free(u->cgroup_attributes);
+
+        unit_set_numa_node(u, -1);
 }
 
 bool unit_maybe_release_cgroup(Unit *u) {
@@ -3050,6 +3292,7 @@ static void unit_remove_from_cgroup_empty_queue(Unit *u) {
 
 int unit_check_oomd_kill(Unit *u) {
         _cleanup_free_ char *value = NULL;
+        CGroupAccounting *a;
         bool increased;
         uint64_t n = 0;
         int r;
@@ -3073,8 +3316,12 @@ int unit_check_oomd_kill(Unit *u) {
                          return r;
         }
 
-        increased = n > u->managed_oom_kill_last;
-        u->managed_oom_kill_last = n;
+        a = unit_acquire_cgroup_accounting(u);
+        if (!a)
+                return log_oom();
+
+        increased = n > a->managed_oom_kill_last;
+        a->managed_oom_kill_last = n;
 
         if (!increased)
                 return 0;
@@ -3104,6 +3351,7 @@ int unit_check_oomd_kill(Unit *u) {
 
 int unit_check_oom(Unit *u) {
         _cleanup_free_ char *oom_kill = NULL;
+        CGroupAccounting *a;
         bool increased;
         uint64_t c;
         int r;
@@ -3122,8 +3370,12 @@ int unit_check_oom(Unit *u) {
                         return log_unit_debug_errno(u, r, "Failed to parse oom_kill field: %m");
         }
 
-        increased = c > u->oom_kill_last;
-        u->oom_kill_last = c;
+        a = unit_acquire_cgroup_accounting(u);
+        if (!a)
+                return log_oom();
+
+        increased = c > a->oom_kill_last;
+        a->oom_kill_last = c;
 
         if (!increased)
                 return 0;
@@ -3241,13 +3493,80 @@ static int unit_check_cgroup_events(Unit *u) {
         return 0;
 }
 
+static int on_cgroup_poll(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = ASSERT_PTR(userdata);
+        Unit *u;
+        int r;
+
+        assert(s);
+
+        SET_FOREACH(u, m->cgroup_polled_units)
+                (void) unit_check_cgroup_events(u);
+
+        if (set_isempty(m->cgroup_polled_units))
+                return 0;
+
+        r = sd_event_source_set_time_relative(s, CGROUP_POLL_INTERVAL_USEC);
+        if (r < 0)
+                return log_error_errno(r, "Failed to reset cgroup poll timer: %m");
+
+        return sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+}
+
+static int unit_poll_cgroup(Unit *u) {
+        Manager *m;
+        int r;
+
+        assert(u);
+        m = u->manager;
+
+        r = set_ensure_put(&m->cgroup_polled_units, NULL, u);
+        if (r < 0)
+                return log_oom();
+
+        if (m->cgroup_poll_event_source) {
+                int enabled;
+
+                r = sd_event_source_get_enabled(m->cgroup_poll_event_source, &enabled);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to query cgroup poll timer: %m");
+                if (enabled != SD_EVENT_OFF)
+                        return 0;
+
+                r = sd_event_source_set_time_relative(m->cgroup_poll_event_source, CGROUP_POLL_INTERVAL_USEC);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to reset cgroup poll timer: %m");
+
+                r = sd_event_source_set_enabled(m->cgroup_poll_event_source, SD_EVENT_ONESHOT);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to enable cgroup poll timer: %m");
+
+                return 0;
+        }
+
+        r = sd_event_add_time_relative(m->event, &m->cgroup_poll_event_source, CLOCK_MONOTONIC,
+                                       CGROUP_POLL_INTERVAL_USEC, 0, on_cgroup_poll, m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate cgroup poll timer: %m");
+
+        (void) sd_event_source_set_description(m->cgroup_poll_event_source, "cgroup-poll");
+        return 0;
+}
+
 static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        _cleanup_set_free_ Set *pending = NULL;
         Manager *m = userdata;
+        bool overflow = false;
+        Unit *u;
 
         assert(s);
         assert(fd >= 0);
         assert(m);
 
+        /* A cgroup.events file is typically modified a couple of times in quick succession (for example
+         * when a unit's processes exit one after the other), hence first collect all units with events
+         * queued, and only then read each unit's cgroup.events file once. */
+
         for (;;) {
                 union inotify_event_buffer buffer;
                 ssize_t l;
@@ -3255,17 +3574,19 @@ static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents,
                 l = read(fd, &buffer, sizeof(buffer));
                 if (l < 0) {
                         if (ERRNO_IS_TRANSIENT(errno))
-                                return 0;
+                                break;
 
                         return log_error_errno(errno, "Failed to read control group inotify events: %m");
                 }
 
                 FOREACH_INOTIFY_EVENT_WARN(e, buffer, l) {
-                        Unit *u;
-
-                        if (e->wd < 0)
-                                /* Queue overflow has no watch descriptor */
+                        if (e->wd < 0) {
+                                /* Queue overflow has no watch descriptor. We lost events, and don't know
+                                 * which, hence check everything below. */
+                                if (e->mask & IN_Q_OVERFLOW)
+                                        overflow = true;
                                 continue;
+                        }
 
                         if (e->mask & IN_IGNORED)
                                 /* The watch was just removed */
@@ -3275,14 +3596,31 @@ static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents,
                          * because it was queued before the removal. Let's ignore this here safely. */
 
                         u = hashmap_get(m->cgroup_control_inotify_wd_unit, INT_TO_PTR(e->wd));
-                        if (u)
-                                unit_check_cgroup_events(u);
+                        if (u && set_ensure_put(&pending, NULL, u) < 0)
+                                (void) unit_check_cgroup_events(u); /* Can't batch on OOM, check right away */
 
                         u = hashmap_get(m->cgroup_memory_inotify_wd_unit, INT_TO_PTR(e->wd));
                         if (u)
                                 unit_add_to_cgroup_oom_queue(u);
                 }
         }
+
+        if (overflow) {
+                log_debug("Control group inotify queue overflowed, checking all control groups.");
+
+                HASHMAP_FOREACH(u, m->cgroup_control_inotify_wd_unit)
+                        (void) unit_check_cgroup_events(u);
+
+                HASHMAP_FOREACH(u, m->cgroup_memory_inotify_wd_unit)
+                        unit_add_to_cgroup_oom_queue(u);
+
+                return 0;
+        }
+
+        SET_FOREACH(u, pending)
+                (void) unit_check_cgroup_events(u);
+
+        return 0;
 }
 
 static int cg_bpf_mask_supported(CGroupMask *ret) {
@@ -3501,6 +3839,9 @@ void manager_shutdown_cgroup(Manager *m, bool delete) {
         m->cgroup_inotify_event_source = sd_event_source_disable_unref(m->cgroup_inotify_event_source);
         m->cgroup_inotify_fd = safe_close(m->cgroup_inotify_fd);
 
+        m->cgroup_polled_units = set_free(m->cgroup_polled_units);
+        m->cgroup_poll_event_source = sd_event_source_disable_unref(m->cgroup_poll_event_source);
+
         m->pin_cgroupfs_fd = safe_close(m->pin_cgroupfs_fd);
 
         m->cgroup_root = mfree(m->cgroup_root);
@@ -3757,6 +4098,7 @@ static int unit_get_cpu_usage_raw(Unit *u, nsec_t *ret) {
 }
 
 int unit_get_cpu_usage(Unit *u, nsec_t *ret) {
+        CGroupAccounting *a;
         nsec_t ns;
         int r;
 
@@ -3770,23 +4112,27 @@ int unit_get_cpu_usage(Unit *u, nsec_t *ret) {
                 return -ENODATA;
 
         r = unit_get_cpu_usage_raw(u, &ns);
-        if (r == -ENODATA && u->cpu_usage_last != NSEC_INFINITY) {
+        if (r == -ENODATA && u->cgroup_accounting && u->cgroup_accounting->cpu_usage_last != NSEC_INFINITY) {
                 /* If we can't get the CPU usage anymore (because the cgroup was already removed, for example), use our
                  * cached value. */
 
                 if (ret)
-                        *ret = u->cpu_usage_last;
+                        *ret = u->cgroup_accounting->cpu_usage_last;
                 return 0;
         }
         if (r < 0)
                 return r;
 
-        if (ns > u->cpu_usage_base)
-                ns -= u->cpu_usage_base;
+        a = unit_acquire_cgroup_accounting(u);
+        if (!a)
+                return -ENOMEM;
+
+        if (ns > a->cpu_usage_base)
+                ns -= a->cpu_usage_base;
         else
                 ns = 0;
 
-        u->cpu_usage_last = ns;
+        a->cpu_usage_last = ns;
         if (ret)
                 *ret = ns;
 
@@ -3826,7 +4172,7 @@ int unit_get_ip_accounting(
          * all BPF programs and maps anew, but serialize the old counters. When deserializing we store them in the
          * ip_accounting_extra[] field, and add them in here transparently. */
 
-        *ret = value + u->ip_accounting_extra[metric];
+        *ret = value + (u->cgroup_accounting ? u->cgroup_accounting->ip_accounting_extra[metric] : 0);
 
         return r;
 }
@@ -3921,6 +4267,7 @@ int unit_get_io_accounting(
                 uint64_t *ret) {
 
         uint64_t raw[_CGROUP_IO_ACCOUNTING_METRIC_MAX];
+        CGroupAccounting *a;
         int r;
 
         /* Retrieve an IO account parameter. This will subtract the counter when the unit was started. */
@@ -3928,43 +4275,152 @@ int unit_get_io_accounting(
         if (!UNIT_CGROUP_BOOL(u, io_accounting))
                 return -ENODATA;
 
-        if (allow_cache && u->io_accounting_last[metric] != UINT64_MAX)
+        a = u->cgroup_accounting;
+
+        if (allow_cache && a && a->io_accounting_last[metric] != UINT64_MAX)
                 goto done;
 
         r = unit_get_io_accounting_raw(u, raw);
-        if (r == -ENODATA && u->io_accounting_last[metric] != UINT64_MAX)
+        if (r == -ENODATA && a && a->io_accounting_last[metric] != UINT64_MAX)
                 goto done;
         if (r < 0)
                 return r;
 
+        a = unit_acquire_cgroup_accounting(u);
+        if (!a)
+                return -ENOMEM;
+
         for (CGroupIOAccountingMetric i = 0; i < _CGROUP_IO_ACCOUNTING_METRIC_MAX; i++) {
                 /* Saturated subtraction */
-                if (raw[i] > u->io_accounting_base[i])
-                        u->io_accounting_last[i] = raw[i] - u->io_accounting_base[i];
+                if (raw[i] > a->io_accounting_base[i])
+                        a->io_accounting_last[i] = raw[i] - a->io_accounting_base[i];
                 else
-                        u->io_accounting_last[i] = 0;
+                        a->io_accounting_last[i] = 0;
         }
 
 done:
         if (ret)
-                *ret = u->io_accounting_last[metric];
+                *ret = a->io_accounting_last[metric];
 
         return 0;
 }
 
-int unit_reset_cpu_accounting(Unit *u) {
+int unit_get_accounting_snapshot(Unit *u, CGroupAccountingMetric metric, usec_t ts, uint64_t *ret) {
+        static const CGroupIOAccountingMetric io_metric[_CGROUP_ACCOUNTING_METRIC_MAX] = {
+                [CGROUP_ACCOUNTING_IO_READ_BYTES]       = CGROUP_IO_READ_BYTES,
+                [CGROUP_ACCOUNTING_IO_WRITE_BYTES]      = CGROUP_IO_WRITE_BYTES,
+                [CGROUP_ACCOUNTING_IO_READ_OPERATIONS]  = CGROUP_IO_READ_OPERATIONS,
+                [CGROUP_ACCOUNTING_IO_WRITE_OPERATIONS] = CGROUP_IO_WRITE_OPERATIONS,
+        };
+        static const CGroupIPAccountingMetric ip_metric[_CGROUP_ACCOUNTING_METRIC_MAX] = {
+                [CGROUP_ACCOUNTING_IP_INGRESS_BYTES]   = CGROUP_IP_INGRESS_BYTES,
+                [CGROUP_ACCOUNTING_IP_INGRESS_PACKETS] = CGROUP_IP_INGRESS_PACKETS,
+                [CGROUP_ACCOUNTING_IP_EGRESS_BYTES]    = CGROUP_IP_EGRESS_BYTES,
+                [CGROUP_ACCOUNTING_IP_EGRESS_PACKETS]  = CGROUP_IP_EGRESS_PACKETS,
+        };
+        CGroupAccounting *a;
+        bool io_cached = false;
+        uint64_t v = UINT64_MAX;
+        nsec_t ns;
         int r;
 
         assert(u);
+        assert(metric >= 0);
+        assert(metric < _CGROUP_ACCOUNTING_METRIC_MAX);
+        assert(ret);
+
+        /* Returns the value of the metric, or UINT64_MAX if it is not available, like the corresponding unit
+         * property. Values read less than CGROUP_ACCOUNTING_SNAPSHOT_MAX_AGE_USEC before `ts` are reused. */
+
+        a = unit_acquire_cgroup_accounting(u);
+        if (!a)
+                return -ENOMEM;
+
+        if (a->snapshot_timestamp[metric] > 0 &&
+            usec_add(a->snapshot_timestamp[metric], CGROUP_ACCOUNTING_SNAPSHOT_MAX_AGE_USEC) > ts) {
+                *ret = a->snapshot[metric];
+                return 0;
+        }
 
-        u->cpu_usage_last = NSEC_INFINITY;
+        switch (metric) {
 
-        r = unit_get_cpu_usage_raw(u, &u->cpu_usage_base);
+        case CGROUP_ACCOUNTING_CPU_USAGE:
+                r = unit_get_cpu_usage(u, &ns);
+                if (r >= 0)
+                        v = ns;
+                break;
+
+        case CGROUP_ACCOUNTING_MEMORY_CURRENT:
+                r = unit_get_memory_current(u, &v);
+                break;
+
+        case CGROUP_ACCOUNTING_TASKS_CURRENT:
+                r = unit_get_tasks_current(u, &v);
+                break;
+
+        case CGROUP_ACCOUNTING_IO_READ_BYTES:
+        case CGROUP_ACCOUNTING_IO_WRITE_BYTES:
+        case CGROUP_ACCOUNTING_IO_READ_OPERATIONS:
+        case CGROUP_ACCOUNTING_IO_WRITE_OPERATIONS:
+                /* All IO metrics are read from io.stat at once, hence if another one was read for the same
+                 * snapshot already, use the values read then. */
+                for (CGroupAccountingMetric i = CGROUP_ACCOUNTING_IO_READ_BYTES; i <= CGROUP_ACCOUNTING_IO_WRITE_OPERATIONS; i++)
+                        if (a->snapshot_timestamp[i] == ts)
+                                io_cached = true;
+
+                r = unit_get_io_accounting(u, io_metric[metric], io_cached, &v);
+                break;
+
+        case CGROUP_ACCOUNTING_IP_INGRESS_BYTES:
+        case CGROUP_ACCOUNTING_IP_INGRESS_PACKETS:
+        case CGROUP_ACCOUNTING_IP_EGRESS_BYTES:
+        case CGROUP_ACCOUNTING_IP_EGRESS_PACKETS:
+                r = unit_get_ip_accounting(u, ip_metric[metric], &v);
+                break;
+
+        default:
+                assert_not_reached();
+        }
+        if (r == -ENOMEM)
+                return r;
         if (r < 0) {
-                u->cpu_usage_base = 0;
+                if (r != -ENODATA)
+                        log_unit_debug_errno(u, r, "Failed to read %s, ignoring: %m",
+                                             cgroup_accounting_metric_to_string(metric));
+                v = UINT64_MAX;
+        }
+
+        a->snapshot[metric] = v;
+        a->snapshot_timestamp[metric] = ts;
+
+        *ret = v;
+        return 0;
+}
+
+int unit_reset_cpu_accounting(Unit *u) {
+        CGroupAccounting *a;
+        nsec_t ns;
+        int r;
+
+        assert(u);
+
+        r = unit_get_cpu_usage_raw(u, &ns);
+        if (r < 0) {
+                /* Nothing to account yet? Then there's no need to allocate anything either */
+                if (u->cgroup_accounting) {
+                        u->cgroup_accounting->cpu_usage_base = 0;
+                        u->cgroup_accounting->cpu_usage_last = NSEC_INFINITY;
+                }
                 return r;
         }
 
+        a = unit_acquire_cgroup_accounting(u);
+        if (!a)
+                return -ENOMEM;
+
+        a->cpu_usage_base = ns;
+        a->cpu_usage_last = NSEC_INFINITY;
+
         return 0;
 }
 
@@ -3979,28 +4435,65 @@ int unit_reset_ip_accounting(Unit *u) {
         if (u->ip_accounting_egress_map_fd >= 0)
                 q = bpf_firewall_reset_accounting(u->ip_accounting_egress_map_fd);
 
-        zero(u->ip_accounting_extra);
+        if (u->cgroup_accounting)
+                zero(u->cgroup_accounting->ip_accounting_extra);
 
         return r < 0 ? r : q;
 }
 
 int unit_reset_io_accounting(Unit *u) {
+        uint64_t raw[_CGROUP_IO_ACCOUNTING_METRIC_MAX];
+        CGroupAccounting *a;
         int r;
 
         assert(u);
 
-        for (CGroupIOAccountingMetric i = 0; i < _CGROUP_IO_ACCOUNTING_METRIC_MAX; i++)
-                u->io_accounting_last[i] = UINT64_MAX;
-
-        r = unit_get_io_accounting_raw(u, u->io_accounting_base);
+        r = unit_get_io_accounting_raw(u, raw);
         if (r < 0) {
-                zero(u->io_accounting_base);
+                if (u->cgroup_accounting) {
+                        zero(u->cgroup_accounting->io_accounting_base);
+                        for (CGroupIOAccountingMetric i = 0; i < _CGROUP_IO_ACCOUNTING_METRIC_MAX; i++)
+                                u->cgroup_accounting->io_accounting_last[i] = UINT64_MAX;
+                }
                 return r;
         }
 
+        a = unit_acquire_cgroup_accounting(u);
+        if (!a)
+                return -ENOMEM;
+
+        memcpy(a->io_accounting_base, raw, sizeof(raw));
+        for (CGroupIOAccountingMetric i = 0; i < _CGROUP_IO_ACCOUNTING_METRIC_MAX; i++)
+                a->io_accounting_last[i] = UINT64_MAX;
+
         return 0;
 }
 
+CGroupAccounting* unit_acquire_cgroup_accounting(Unit *u) {
+        CGroupAccounting *a;
+
+        assert(u);
+
+        /* Returns the unit's accounting state, allocating and initializing it first if needed. Returns NULL
+         * on OOM. */
+
+        if (u->cgroup_accounting)
+                return u->cgroup_accounting;
+
+        a = new(CGroupAccounting, 1);
+        if (!a)
+                return NULL;
+
+        *a = (CGroupAccounting) {
+                .cpu_usage_last = NSEC_INFINITY,
+        };
+
+        for (CGroupIOAccountingMetric i = 0; i < _CGROUP_IO_ACCOUNTING_METRIC_MAX; i++)
+                a->io_accounting_last[i] = UINT64_MAX;
+
+        return (u->cgroup_accounting = a);
+}
+
 int unit_reset_accounting(Unit *u) {
         int r, q, v;
 
@@ -4010,6 +4503,9 @@ int unit_reset_accounting(Unit *u) {
         q = unit_reset_io_accounting(u);
         v = unit_reset_ip_accounting(u);
 
+        if (u->cgroup_accounting)
+                zero(u->cgroup_accounting->snapshot_timestamp);
+
         return r < 0 ? r : q < 0 ? q : v;
 }
 
@@ -4118,6 +4614,9 @@ int compare_job_priority(const void *a, const void *b) {
         uint64_t weight_x, weight_y;
         int ret;
 
+        if ((ret = CMP(unit_on_critical_chain(x->unit), unit_on_critical_chain(y->unit))) != 0)
+                return -ret;
+
         if ((ret = CMP(x->unit->type, y->unit->type)) != 0)
                 return -ret;
 
@@ -4221,3 +4720,19 @@ static const char* const freezer_action_table[_FREEZER_ACTION_MAX] = {
 };
 
 DEFINE_STRING_TABLE_LOOKUP(freezer_action, FreezerAction);
+
+static const char* const cgroup_accounting_metric_table[_CGROUP_ACCOUNTING_METRIC_MAX] = {
+        [CGROUP_ACCOUNTING_CPU_USAGE]           = "CPUUsageNSec",
+        [CGROUP_ACCOUNTING_MEMORY_CURRENT]      = "MemoryCurrent",
+        [CGROUP_ACCOUNTING_TASKS_CURRENT]       = "TasksCurrent",
+        [CGROUP_ACCOUNTING_IO_READ_BYTES]       = "IOReadBytes",
+        [CGROUP_ACCOUNTING_IO_WRITE_BYTES]      = "IOWriteBytes",
+        [CGROUP_ACCOUNTING_IO_READ_OPERATIONS]  = "IOReadOperations",
+        [CGROUP_ACCOUNTING_IO_WRITE_OPERATIONS] = "IOWriteOperations",
+        [CGROUP_ACCOUNTING_IP_INGRESS_BYTES]    = "IPIngressBytes",
+        [CGROUP_ACCOUNTING_IP_INGRESS_PACKETS]  = "IPIngressPackets",
+        [CGROUP_ACCOUNTING_IP_EGRESS_BYTES]     = "IPEgressBytes",
+        [CGROUP_ACCOUNTING_IP_EGRESS_PACKETS]   = "IPEgressPackets",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(cgroup_accounting_metric, CGroupAccountingMetric);
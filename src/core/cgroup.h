@@ -135,6 +135,7 @@ struct CGroupContext {
         CPUSet startup_cpuset_cpus;
         CPUSet cpuset_mems;
         CPUSet startup_cpuset_mems;
+        bool numa_auto_placement;
 
         uint64_t io_weight;
         uint64_t startup_io_weight;
@@ -216,6 +217,53 @@ typedef enum CGroupIOAccountingMetric {
         _CGROUP_IO_ACCOUNTING_METRIC_INVALID = -EINVAL,
 } CGroupIOAccountingMetric;
 
+/* Used when querying accounting data of many units at once, see GetUnitsAccounting() on the bus. Named after
+ * the corresponding unit properties. */
+typedef enum CGroupAccountingMetric {
+        CGROUP_ACCOUNTING_CPU_USAGE,
+        CGROUP_ACCOUNTING_MEMORY_CURRENT,
+        CGROUP_ACCOUNTING_TASKS_CURRENT,
+        CGROUP_ACCOUNTING_IO_READ_BYTES,
+        CGROUP_ACCOUNTING_IO_WRITE_BYTES,
+        CGROUP_ACCOUNTING_IO_READ_OPERATIONS,
+        CGROUP_ACCOUNTING_IO_WRITE_OPERATIONS,
+        CGROUP_ACCOUNTING_IP_INGRESS_BYTES,
+        CGROUP_ACCOUNTING_IP_INGRESS_PACKETS,
+        CGROUP_ACCOUNTING_IP_EGRESS_BYTES,
+        CGROUP_ACCOUNTING_IP_EGRESS_PACKETS,
+        _CGROUP_ACCOUNTING_METRIC_MAX,
+        _CGROUP_ACCOUNTING_METRIC_INVALID = -EINVAL,
+} CGroupAccountingMetric;
+
+/* Values returned by unit_get_accounting_snapshot() are reused for this long, so that frequent bulk queries
+ * do not translate into reads of cgroupfs for every unit and metric. */
+#define CGROUP_ACCOUNTING_SNAPSHOT_MAX_AGE_USEC (1 * USEC_PER_SEC)
+
+/* Accounting state of a unit's cgroup. This is allocated only once there's actually something to account
+ * for, since most loaded units never get started, or don't have a cgroup in the first place. */
+typedef struct CGroupAccounting {
+        /* Where the cpu.stat or cpuacct.usage was at the time the unit was started */
+        nsec_t cpu_usage_base;
+        nsec_t cpu_usage_last; /* the most recently read value */
+
+        /* The current counter of OOM kills initiated by systemd-oomd */
+        uint64_t managed_oom_kill_last;
+
+        /* The current counter of the oom_kill field in the memory.events cgroup attribute */
+        uint64_t oom_kill_last;
+
+        /* Where the io.stat data was at the time the unit was started */
+        uint64_t io_accounting_base[_CGROUP_IO_ACCOUNTING_METRIC_MAX];
+        uint64_t io_accounting_last[_CGROUP_IO_ACCOUNTING_METRIC_MAX]; /* the most recently read value */
+
+        /* IP accounting counters carried over from a previous runtime, see unit_get_ip_accounting() */
+        uint64_t ip_accounting_extra[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
+
+        /* The values last returned by unit_get_accounting_snapshot(), and when they were read (CLOCK_MONOTONIC) */
+        uint64_t snapshot[_CGROUP_ACCOUNTING_METRIC_MAX];
+        usec_t snapshot_timestamp[_CGROUP_ACCOUNTING_METRIC_MAX];
+} CGroupAccounting;
+
 typedef struct Unit Unit;
 typedef struct Manager Manager;
 
@@ -256,6 +304,7 @@ void unit_add_family_to_cgroup_realize_queue(Unit *u);
 const char *unit_get_realized_cgroup_path(Unit *u, CGroupMask mask);
 char *unit_default_cgroup_path(const Unit *u);
 int unit_set_cgroup_path(Unit *u, const char *path);
+int unit_remember_cgroup_attribute(Unit *u, const char *attribute, const char *value);
 int unit_pick_cgroup_path(Unit *u);
 
 int unit_realize_cgroup(Unit *u);
@@ -264,6 +313,7 @@ int unit_watch_cgroup(Unit *u);
 int unit_watch_cgroup_memory(Unit *u);
 
 void unit_release_cgroup(Unit *u);
+void unit_set_numa_node(Unit *u, int node);
 /* Releases the cgroup only if it is recursively empty.
  * Returns true if the cgroup was released, false otherwise. */
 bool unit_maybe_release_cgroup(Unit *u);
@@ -297,11 +347,13 @@ int unit_get_tasks_current(Unit *u, uint64_t *ret);
 int unit_get_cpu_usage(Unit *u, nsec_t *ret);
 int unit_get_io_accounting(Unit *u, CGroupIOAccountingMetric metric, bool allow_cache, uint64_t *ret);
 int unit_get_ip_accounting(Unit *u, CGroupIPAccountingMetric metric, uint64_t *ret);
+int unit_get_accounting_snapshot(Unit *u, CGroupAccountingMetric metric, usec_t ts, uint64_t *ret);
 
 int unit_reset_cpu_accounting(Unit *u);
 int unit_reset_ip_accounting(Unit *u);
 int unit_reset_io_accounting(Unit *u);
 int unit_reset_accounting(Unit *u);
+CGroupAccounting* unit_acquire_cgroup_accounting(Unit *u);
 
 #define UNIT_CGROUP_BOOL(u, name)                       \
         ({                                              \
@@ -335,3 +387,6 @@ int unit_cgroup_freezer_action(Unit *u, FreezerAction action);
 
 const char* freezer_action_to_string(FreezerAction a) _const_;
 FreezerAction freezer_action_from_string(const char *s) _pure_;
+
+const char* cgroup_accounting_metric_to_string(CGroupAccountingMetric m) _const_;
+CGroupAccountingMetric cgroup_accounting_metric_from_string(const char *s) _pure_;
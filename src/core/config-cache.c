@@ -0,0 +1,525 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "conf-parser.h"
+#include "config-cache.h"
+#include "cpu-set-util.h"
+#include "escape.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "load-fragment.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "serialize.h"
+#include "strv.h"
+#include "tmpfile-util.h"
+#include "unit.h"
+
+/* Reading a handful of files is not worth starting threads for */
+#define CONFIG_CACHE_PRELOAD_THREADED_MIN 32U
+#define CONFIG_CACHE_PRELOAD_THREADS_MAX 8U
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(config_file_hash_ops,
+                                              char, path_hash_func, path_compare,
+                                              ConfigFile, config_file_free);
+
+typedef struct PreloadJob {
+        const char *path;
+        ConfigFile *result;
+} PreloadJob;
+
+typedef struct Preload {
+        PreloadJob *jobs;
+        size_t n_jobs;
+        size_t next;
+} Preload;
+
+static int config_cache_put(Manager *m, ConfigFile *c) {
+        assert(m);
+        assert(c);
+
+        return hashmap_ensure_put(&m->config_cache, &config_file_hash_ops, c->filename, c);
+}
+
+static ConfigFile* config_cache_get(Manager *m, const char *path, const struct stat *st) {
+        ConfigFile *c;
+
+        assert(m);
+        assert(path);
+        assert(st);
+
+        c = hashmap_get(m->config_cache, path);
+        if (c) {
+                if (config_file_is_current(c, st))
+                        return c;
+
+                assert_se(hashmap_remove(m->config_cache, path) == c);
+                config_file_free(c);
+                return NULL;
+        }
+
+        /* Read before the reload began? Then adopt it, if the file didn't change since. */
+        c = hashmap_remove(m->config_cache_stale, path);
+        if (c) {
+                if (!config_file_is_current(c, st) || config_cache_put(m, c) < 0) {
+                        config_file_free(c);
+                        return NULL;
+                }
+
+                return c;
+        }
+
+        /* Part of the unit snapshot? The file was copied into the image after the snapshot was written,
+         * hence the inode and ctime are different by now, and size and mtime are all we can compare. */
+        c = hashmap_remove(m->config_cache_snapshot, path);
+        if (!c)
+                return NULL;
+
+        if (c->st.st_size != st->st_size ||
+            timespec_load_nsec(&c->st.st_mtim) != timespec_load_nsec(&st->st_mtim)) {
+                log_debug("Unit snapshot entry for '%s' is outdated, reading file.", path);
+                config_file_free(c);
+                return NULL;
+        }
+
+        c->st = *st;
+        if (config_cache_put(m, c) < 0) {
+                config_file_free(c);
+                return NULL;
+        }
+
+        return c;
+}
+
+int manager_config_cache_collect(Manager *m, Set **ret) {
+        _cleanup_set_free_ Set *paths = NULL;
+        const char *k;
+        Unit *u;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Returns the unit files and drop-ins of all units currently loaded, i.e. the ones a reload will
+         * most likely read again */
+
+        HASHMAP_FOREACH_KEY(u, k, m->units) {
+                if (u->id != k) /* Skip aliases */
+                        continue;
+
+                if (u->fragment_path) {
+                        r = set_put_strdup_full(&paths, &path_hash_ops_free, u->fragment_path);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = set_put_strdupv_full(&paths, &path_hash_ops_free, u->dropin_paths);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(paths);
+        return 0;
+}
+
+static void* preload_thread(void *userdata) {
+        Preload *p = ASSERT_PTR(userdata);
+
+        for (;;) {
+                size_t i;
+
+                i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED);
+                if (i >= p->n_jobs)
+                        break;
+
+                /* Failures are not fatal here, unit_config_parse() will try again and log about them */
+                (void) config_file_read(p->jobs[i].path, NULL, &p->jobs[i].result);
+        }
+
+        return NULL;
+}
+
+static unsigned preload_run(Preload *p) {
+        pthread_t threads[CONFIG_CACHE_PRELOAD_THREADS_MAX];
+        sigset_t ss, saved_ss;
+        unsigned n_threads = 0, n_wanted = 0;
+        int k;
+
+        assert(p);
+
+        if (p->n_jobs >= CONFIG_CACHE_PRELOAD_THREADED_MIN) {
+                k = cpus_in_affinity_mask();
+                if (k > 1)
+                        n_wanted = MIN((unsigned) k - 1, CONFIG_CACHE_PRELOAD_THREADS_MAX);
+        }
+
+        if (n_wanted > 0) {
+                /* The workers never need to handle signals, leave them all to the main thread */
+                assert_se(sigfillset(&ss) >= 0);
+                assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+                if (pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0) {
+                        for (; n_threads < n_wanted; n_threads++)
+                                if (pthread_create(threads + n_threads, NULL, preload_thread, p) != 0)
+                                        break;
+
+                        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+                }
+        }
+
+        /* Whether we got any threads or not, we help out ourselves, hence this always completes */
+        (void) preload_thread(p);
+
+        for (unsigned i = 0; i < n_threads; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        return n_threads;
+}
+
+void manager_config_cache_begin_reload(Manager *m, Set *paths) {
+        _cleanup_free_ PreloadJob *jobs = NULL;
+        size_t n_jobs = 0, n_cached = 0;
+        const char *path;
+        unsigned n_threads;
+
+        assert(m);
+
+        /* Whatever we have cached might be outdated now. Keep it around only to compare against. */
+        hashmap_free(m->config_cache_stale);
+        m->config_cache_stale = TAKE_PTR(m->config_cache);
+
+        /* Then, read the files the units we had loaded before the reload are likely going to need again,
+         * unless they didn't change. Reading is independent of the parsing tables and unit state, hence
+         * can be done in parallel. Parsing then happens one by one when the units are loaded. */
+        SET_FOREACH(path, paths) {
+                struct stat st;
+
+                if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+                        continue;
+
+                if (config_cache_get(m, path, &st)) {
+                        n_cached++;
+                        continue;
+                }
+
+                if (!GREEDY_REALLOC(jobs, n_jobs + 1)) {
+                        log_oom_debug();
+                        break;
+                }
+
+                jobs[n_jobs++] = (PreloadJob) {
+                        .path = path,
+                };
+        }
+
+        Preload p = {
+                .jobs = jobs,
+                .n_jobs = n_jobs,
+        };
+
+        n_threads = preload_run(&p);
+
+        for (size_t i = 0; i < n_jobs; i++)
+                if (jobs[i].result && config_cache_put(m, jobs[i].result) < 0)
+                        config_file_free(jobs[i].result);
+
+        log_debug("Reusing %zu unchanged unit files, read %zu changed ones with %u helper threads.",
+                  n_cached, n_jobs, n_threads);
+}
+
+void manager_config_cache_end_reload(Manager *m) {
+        assert(m);
+
+        /* Everything that wasn't needed again by now belongs to units that are gone. Similar for whatever
+         * is left of the unit snapshot, it's only useful on boot. */
+        m->config_cache_stale = hashmap_free(m->config_cache_stale);
+        m->config_cache_snapshot = hashmap_free(m->config_cache_snapshot);
+}
+
+void manager_config_cache_flush(Manager *m) {
+        assert(m);
+
+        m->config_cache = hashmap_free(m->config_cache);
+        m->config_cache_stale = hashmap_free(m->config_cache_stale);
+        m->config_cache_snapshot = hashmap_free(m->config_cache_snapshot);
+}
+
+static int snapshot_parse_line(ConfigFile *c, const char *value) {
+        _cleanup_free_ char *number = NULL, *text = NULL;
+        const char *space;
+        unsigned line;
+        ssize_t l;
+        int r;
+
+        assert(c);
+        assert(value);
+
+        /* The line number, a single space, then the escaped line */
+        space = strchr(value, ' ');
+        if (!space)
+                return -EBADMSG;
+
+        number = strndup(value, space - value);
+        if (!number)
+                return -ENOMEM;
+
+        r = safe_atou(number, &line);
+        if (r < 0)
+                return r;
+
+        l = cunescape(space + 1, 0, &text);
+        if (l < 0)
+                return l;
+
+        if (!GREEDY_REALLOC(c->line_numbers, c->n_lines + 1))
+                return -ENOMEM;
+
+        r = strv_consume_with_size(&c->lines, &c->n_lines, TAKE_PTR(text));
+        if (r < 0)
+                return r;
+
+        c->line_numbers[c->n_lines - 1] = line;
+        return 0;
+}
+
+static int snapshot_add(Hashmap **h, ConfigFile **c) {
+        int r;
+
+        assert(h);
+        assert(c);
+
+        if (!*c)
+                return 0;
+
+        r = hashmap_ensure_put(h, &config_file_hash_ops, (*c)->filename, *c);
+        if (r == -EEXIST)
+                return -EBADMSG;
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(*c);
+        return 0;
+}
+
+int manager_config_cache_load_snapshot(Manager *m, const char *path) {
+        _cleanup_(config_file_freep) ConfigFile *c = NULL;
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        bool header = false;
+        int r;
+
+        assert(m);
+        assert(path);
+
+        /* Reads the unit snapshot. It uses the same format as the serialization, and consists of a header
+         * line, followed by one block per file: its path, size and mtime, and its logical lines. */
+
+        f = fopen(path, "re");
+        if (!f)
+                return errno == ENOENT ? 0 : -errno;
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+                const char *val;
+
+                r = deserialize_read_line(f, &line);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                if (!header) {
+                        if (!streq(line, "unit-snapshot=1"))
+                                return -EPROTONOSUPPORT;
+
+                        header = true;
+                        continue;
+                }
+
+                if ((val = startswith(line, "file="))) {
+                        r = snapshot_add(&h, &c);
+                        if (r < 0)
+                                return r;
+
+                        if (!path_is_absolute(val) || !path_is_normalized(val))
+                                return -EBADMSG;
+
+                        c = new0(ConfigFile, 1);
+                        if (!c)
+                                return -ENOMEM;
+
+                        c->filename = strdup(val);
+                        if (!c->filename)
+                                return -ENOMEM;
+
+                } else if (!c)
+                        return -EBADMSG;
+
+                else if ((val = startswith(line, "size="))) {
+                        uint64_t size;
+
+                        r = safe_atou64(val, &size);
+                        if (r < 0)
+                                return r;
+
+                        c->st.st_size = size;
+
+                } else if ((val = startswith(line, "mtime="))) {
+                        nsec_t mtime;
+
+                        r = safe_atou64(val, &mtime);
+                        if (r < 0)
+                                return r;
+
+                        c->st.st_mtim = (struct timespec) {
+                                .tv_sec = mtime / NSEC_PER_SEC,
+                                .tv_nsec = mtime % NSEC_PER_SEC,
+                        };
+
+                } else if ((val = startswith(line, "line="))) {
+                        r = snapshot_parse_line(c, val);
+                        if (r < 0)
+                                return r;
+
+                } else
+                        log_debug("Unknown unit snapshot item '%s', ignoring.", line);
+        }
+
+        r = snapshot_add(&h, &c);
+        if (r < 0)
+                return r;
+
+        log_debug("Loaded %u entries from unit snapshot %s.", hashmap_size(h), path);
+
+        hashmap_free(m->config_cache_snapshot);
+        m->config_cache_snapshot = TAKE_PTR(h);
+        return 1;
+}
+
+static int snapshot_write_one(FILE *f, const ConfigFile *c) {
+        int r;
+
+        assert(f);
+        assert(c);
+
+        r = serialize_item(f, "file", c->filename);
+        if (r < 0)
+                return r;
+
+        r = serialize_item_format(f, "size", "%" PRIu64, (uint64_t) c->st.st_size);
+        if (r < 0)
+                return r;
+
+        r = serialize_item_format(f, "mtime", NSEC_FMT, timespec_load_nsec(&c->st.st_mtim));
+        if (r < 0)
+                return r;
+
+        for (size_t i = 0; i < c->n_lines; i++) {
+                _cleanup_free_ char *e = NULL;
+
+                e = cescape(c->lines[i]);
+                if (!e)
+                        return -ENOMEM;
+
+                r = serialize_item_format(f, "line", "%u %s", c->line_numbers[i], e);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+int manager_config_cache_write_snapshot(Manager *m, const char *path) {
+        _cleanup_(unlink_and_freep) char *t = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        ConfigFile *c;
+        unsigned n = 0;
+        int r;
+
+        assert(m);
+        assert(path);
+
+        /* Writes out all unit files and drop-ins we read so far. Generated and transient units as well as
+         * anything else below /run are created anew on each boot, hence never match, and are skipped. */
+
+        r = fopen_temporary(path, &f, &t);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create unit snapshot %s: %m", path);
+
+        if (fchmod(fileno(f), 0644) < 0)
+                return log_error_errno(errno, "Failed to set access mode of unit snapshot: %m");
+
+        fputs("unit-snapshot=1\n", f);
+
+        HASHMAP_FOREACH(c, m->config_cache) {
+                if (path_startswith(c->filename, "/run"))
+                        continue;
+
+                r = snapshot_write_one(f, c);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to write unit snapshot entry for %s: %m", c->filename);
+
+                n++;
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return log_error_errno(r, "Failed to write unit snapshot %s: %m", path);
+
+        if (rename(t, path) < 0)
+                return log_error_errno(errno, "Failed to move unit snapshot %s into place: %m", path);
+
+        t = mfree(t);
+
+        log_info("Wrote %u unit files to unit snapshot %s.", n, path);
+        return 0;
+}
+
+int unit_config_parse(Unit *u, const char *path, FILE *f, struct stat *ret_stat) {
+        _cleanup_(config_file_freep) ConfigFile *n = NULL;
+        ConfigFile *c;
+        struct stat st;
+        int r;
+
+        assert(u);
+        assert(path);
+
+        /* Like config_parse() with the unit file parser tables, but reuses what we read before if the file
+         * didn't change since. */
+
+        if ((f ? fstat(fileno(f), &st) : stat(path, &st)) < 0)
+                goto fallback;
+
+        c = config_cache_get(u->manager, path, &st);
+        if (!c) {
+                r = config_file_read(path, f, &n);
+                if (r < 0)
+                        goto fallback;
+
+                if (config_cache_put(u->manager, n) >= 0)
+                        c = TAKE_PTR(n);
+                else
+                        c = n;
+        }
+
+        r = config_parse_file(u->id, c,
+                              UNIT_VTABLE(u)->sections,
+                              config_item_perf_lookup, load_fragment_gperf_lookup,
+                              0,
+                              u);
+        if (r >= 0 && ret_stat)
+                *ret_stat = c->st;
+
+        return r;
+
+fallback:
+        /* Let config_parse() deal with (and log about) whatever went wrong */
+        return config_parse(u->id, path, NULL,
+                            UNIT_VTABLE(u)->sections,
+                            config_item_perf_lookup, load_fragment_gperf_lookup,
+                            0, u, ret_stat);
+}
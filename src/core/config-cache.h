@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "set.h"
+
+typedef struct Manager Manager;
+typedef struct Unit Unit;
+
+/* Keeps unit files and drop-ins we read around in their pre-split form (see ConfigFile), so that a reload
+ * doesn't have to read files again that didn't change, and can read those that did in parallel. */
+
+/* Unit files of the initial transaction, pre-split, as written by "systemd --test --write-unit-snapshot=" when
+ * the image is built. Used on boot for files whose size and mtime still match. */
+#define UNIT_SNAPSHOT_PATH ROOTLIBEXECDIR "/unit-snapshot"
+
+int manager_config_cache_collect(Manager *m, Set **ret);
+void manager_config_cache_begin_reload(Manager *m, Set *paths);
+void manager_config_cache_end_reload(Manager *m);
+void manager_config_cache_flush(Manager *m);
+
+int manager_config_cache_load_snapshot(Manager *m, const char *path);
+int manager_config_cache_write_snapshot(Manager *m, const char *path);
+
+int unit_config_parse(Unit *u, const char *path, FILE *f, struct stat *ret_stat);
@@ -2,6 +2,7 @@
 
 #include "core-varlink.h"
 #include "mkdir-label.h"
+#include "stats-util.h"
 #include "strv.h"
 #include "user-util.h"
 #include "varlink.h"
@@ -463,6 +464,10 @@ static int vl_method_get_memberships(Varlink *link, JsonVariant *parameters, Var
         return varlink_error(link, "io.systemd.UserDatabase.NoRecordFound", NULL);
 }
 
+static int vl_method_get_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        return stats_varlink_reply(link, parameters);
+}
+
 static void vl_disconnect(VarlinkServer *s, Varlink *link, void *userdata) {
         Manager *m = userdata;
 
@@ -497,7 +502,8 @@ static int manager_varlink_init_system(Manager *m) {
                         "io.systemd.UserDatabase.GetUserRecord",  vl_method_get_user_record,
                         "io.systemd.UserDatabase.GetGroupRecord", vl_method_get_group_record,
                         "io.systemd.UserDatabase.GetMemberships", vl_method_get_memberships,
-                        "io.systemd.ManagedOOM.SubscribeManagedOOMCGroups",  vl_method_subscribe_managed_oom_cgroups);
+                        "io.systemd.ManagedOOM.SubscribeManagedOOMCGroups",  vl_method_subscribe_managed_oom_cgroups,
+                        "io.systemd.Statistics.Get",              vl_method_get_statistics);
         if (r < 0)
                 return log_error_errno(r, "Failed to register varlink methods: %m");
 
@@ -515,6 +521,10 @@ static int manager_varlink_init_system(Manager *m) {
                 r = varlink_server_listen_address(s, VARLINK_ADDR_PATH_MANAGED_OOM_SYSTEM, 0666);
                 if (r < 0)
                         return log_error_errno(r, "Failed to bind to varlink socket: %m");
+
+                r = varlink_server_listen_address(s, VARLINK_ADDR_PATH_MANAGER, 0600);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to bind to varlink socket: %m");
         }
 
         r = varlink_server_attach_event(s, m->event, SD_EVENT_PRIORITY_NORMAL);
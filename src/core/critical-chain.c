@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "critical-chain.h"
+#include "fileio.h"
+#include "manager.h"
+#include "special.h"
+#include "strv.h"
+#include "unit.h"
+
+int manager_load_critical_chain(Manager *m) {
+        _cleanup_free_ char *data = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        int r;
+
+        assert(m);
+
+        if (!m->critical_chain_scheduling || !MANAGER_IS_SYSTEM(m) || MANAGER_IS_TEST_RUN(m))
+                return 0;
+
+        /* /var might not be mounted yet this early, in which case we simply don't have any hints for this
+         * boot. */
+        r = read_full_file(CRITICAL_CHAIN_PATH, &data, NULL);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return log_debug_errno(r, "Failed to read %s, ignoring: %m", CRITICAL_CHAIN_PATH);
+
+        l = strv_split_newlines(data);
+        if (!l)
+                return log_oom();
+
+        STRV_FOREACH(i, l) {
+                if (!unit_name_is_valid(*i, UNIT_NAME_PLAIN|UNIT_NAME_INSTANCE))
+                        continue;
+
+                r = set_put_strdup(&m->critical_chain, *i);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        log_debug("Loaded %u units on the critical chain of the previous boot.", set_size(m->critical_chain));
+        return 0;
+}
+
+int manager_save_critical_chain(Manager *m) {
+        _cleanup_set_free_ Set *seen = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        _cleanup_free_ char *data = NULL;
+        usec_t finish;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        if (!m->critical_chain_scheduling || !MANAGER_IS_SYSTEM(m) || MANAGER_IS_TEST_RUN(m) || in_initrd())
+                return 0;
+
+        finish = m->timestamps[MANAGER_TIMESTAMP_FINISH].monotonic;
+
+        /* Follows the After= dependency which became active last, starting from the default target. This is
+         * the same chain "systemd-analyze critical-chain" shows. */
+        u = manager_get_unit(m, SPECIAL_DEFAULT_TARGET);
+        while (u) {
+                usec_t latest = 0;
+                Unit *other, *next = NULL;
+
+                r = set_ensure_put(&seen, NULL, u);
+                if (r < 0)
+                        return log_oom();
+                if (r == 0) /* dependency loop */
+                        break;
+
+                r = strv_extend(&l, u->id);
+                if (r < 0)
+                        return log_oom();
+
+                UNIT_FOREACH_DEPENDENCY(other, u, UNIT_ATOM_AFTER) {
+                        usec_t t = other->active_enter_timestamp.monotonic;
+
+                        if (t == 0 || t > finish || t <= latest)
+                                continue;
+
+                        latest = t;
+                        next = other;
+                }
+
+                u = next;
+        }
+
+        data = strv_join(l, "\n");
+        if (!data)
+                return log_oom();
+
+        r = write_string_file(CRITICAL_CHAIN_PATH, data, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_MKDIR_0755);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to write %s, ignoring: %m", CRITICAL_CHAIN_PATH);
+
+        log_debug("Recorded %zu units on the critical chain of this boot.", strv_length(l));
+        return 0;
+}
+
+void manager_drop_critical_chain(Manager *m) {
+        assert(m);
+
+        m->critical_chain = set_free_free(m->critical_chain);
+}
+
+bool unit_on_critical_chain(Unit *u) {
+        assert(u);
+
+        return set_contains(u->manager->critical_chain, u->id);
+}
@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stdbool.h>
+
+typedef struct Manager Manager;
+typedef struct Unit Unit;
+
+/* With CriticalChainScheduling= enabled, the units on the critical chain of the default target are recorded
+ * when the boot finished, i.e. what "systemd-analyze critical-chain" shows. On the next boot, their jobs are
+ * dispatched first, and they get a larger CPU and IO weight until the boot finished. */
+
+#define CRITICAL_CHAIN_PATH "/var/lib/systemd/critical-chain"
+#define CRITICAL_CHAIN_STARTUP_WEIGHT UINT64_C(1000)
+
+int manager_load_critical_chain(Manager *m);
+int manager_save_critical_chain(Manager *m);
+void manager_drop_critical_chain(Manager *m);
+
+bool unit_on_critical_chain(Unit *u);
@@ -33,6 +33,7 @@
 #include "path-util.h"
 #include "process-util.h"
 #include "selinux-access.h"
+#include "sort-util.h"
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
@@ -1177,6 +1178,22 @@ static int method_reset_failed(sd_bus_message *message, void *userdata, sd_bus_e
         return sd_bus_reply_method_return(message, NULL);
 }
 
+static bool unit_matches_filter(Unit *u, char **states, char **patterns) {
+        assert(u);
+
+        if (!strv_isempty(states) &&
+            !strv_contains(states, unit_load_state_to_string(u->load_state)) &&
+            !strv_contains(states, unit_active_state_to_string(unit_active_state(u))) &&
+            !strv_contains(states, unit_sub_state_to_string(u)))
+                return false;
+
+        if (!strv_isempty(patterns) &&
+            !strv_fnmatch_or_empty(patterns, u->id, FNM_NOESCAPE))
+                return false;
+
+        return true;
+}
+
 static int list_units_filtered(sd_bus_message *message, void *userdata, sd_bus_error *error, char **states, char **patterns) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         Manager *m = userdata;
@@ -1205,14 +1222,7 @@ static int list_units_filtered(sd_bus_message *message, void *userdata, sd_bus_e
                 if (k != u->id)
                         continue;
 
-                if (!strv_isempty(states) &&
-                    !strv_contains(states, unit_load_state_to_string(u->load_state)) &&
-                    !strv_contains(states, unit_active_state_to_string(unit_active_state(u))) &&
-                    !strv_contains(states, unit_sub_state_to_string(u)))
-                        continue;
-
-                if (!strv_isempty(patterns) &&
-                    !strv_fnmatch_or_empty(patterns, u->id, FNM_NOESCAPE))
+                if (!unit_matches_filter(u, states, patterns))
                         continue;
 
                 r = reply_unit_info(reply, u);
@@ -1258,6 +1268,217 @@ static int method_list_units_by_patterns(sd_bus_message *message, void *userdata
         return list_units_filtered(message, userdata, error, states, patterns);
 }
 
+static int unit_compare_by_id(Unit * const *a, Unit * const *b) {
+        return strcmp((*a)->id, (*b)->id);
+}
+
+static int method_list_units_paged(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_strv_free_ char **states = NULL, **patterns = NULL;
+        _cleanup_free_ Unit **units = NULL;
+        Manager *m = userdata;
+        const char *after;
+        size_t n = 0;
+        uint32_t max;
+        const char *k;
+        Unit *u;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Like ListUnitsByPatterns(), but returns the units ordered by name, starting after the specified
+         * name, and at most the specified number of them. This way clients can fetch the list piecemeal
+         * instead of having us build one huge reply in one go. */
+
+        r = sd_bus_message_read_strv(message, &states);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &patterns);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read(message, "su", &after, &max);
+        if (r < 0)
+                return r;
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        units = new(Unit*, hashmap_size(m->units));
+        if (!units)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units) {
+                if (k != u->id)
+                        continue;
+
+                if (!isempty(after) && strcmp(u->id, after) <= 0)
+                        continue;
+
+                if (!unit_matches_filter(u, states, patterns))
+                        continue;
+
+                units[n++] = u;
+        }
+
+        typesafe_qsort(units, n, unit_compare_by_id);
+
+        if (max > 0 && n > max)
+                n = max;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(ssssssouso)");
+        if (r < 0)
+                return r;
+
+        for (size_t i = 0; i < n; i++) {
+                r = reply_unit_info(reply, units[i]);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static bool unit_in_slice(Unit *u, Unit *slice) {
+        assert(u);
+        assert(slice);
+
+        for (; u; u = UNIT_GET_SLICE(u))
+                if (u == slice)
+                        return true;
+
+        return false;
+}
+
+static int method_get_units_accounting(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_free_ CGroupAccountingMetric *metrics = NULL;
+        _cleanup_strv_free_ char **metric_names = NULL;
+        Manager *m = ASSERT_PTR(userdata);
+        const char *slice_name, *k;
+        Unit *slice = NULL, *u;
+        size_t n_metrics;
+        usec_t ts;
+        int r;
+
+        assert(message);
+
+        /* Returns the selected accounting metrics of all units with a cgroup, or of those in the specified
+         * slice, in one go, so that monitoring doesn't need to query the properties of every unit one by
+         * one. Values are cached for a short time, see unit_get_accounting_snapshot(). */
+
+        r = sd_bus_message_read(message, "s", &slice_name);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &metric_names);
+        if (r < 0)
+                return r;
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        if (!isempty(slice_name)) {
+                r = bus_get_unit_by_name(m, message, slice_name, &slice, error);
+                if (r < 0)
+                        return r;
+
+                if (slice->type != UNIT_SLICE)
+                        return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Unit %s is not a slice.", slice_name);
+        }
+
+        n_metrics = strv_length(metric_names);
+        metrics = new(CGroupAccountingMetric, n_metrics);
+        if (!metrics)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < n_metrics; i++) {
+                metrics[i] = cgroup_accounting_metric_from_string(metric_names[i]);
+                if (metrics[i] < 0)
+                        return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS,
+                                                 "Unknown accounting metric: %s", metric_names[i]);
+        }
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "t", now(CLOCK_REALTIME));
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sat)");
+        if (r < 0)
+                return r;
+
+        ts = now(CLOCK_MONOTONIC);
+
+        HASHMAP_FOREACH_KEY(u, k, m->units) {
+                if (k != u->id)
+                        continue;
+
+                if (!u->cgroup_path)
+                        continue;
+
+                if (slice && !unit_in_slice(u, slice))
+                        continue;
+
+                r = sd_bus_message_open_container(reply, 'r', "sat");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(reply, "s", u->id);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_open_container(reply, 'a', "t");
+                if (r < 0)
+                        return r;
+
+                for (size_t i = 0; i < n_metrics; i++) {
+                        uint64_t v;
+
+                        r = unit_get_accounting_snapshot(u, metrics[i], ts, &v);
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_append(reply, "t", v);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_list_jobs(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         Manager *m = userdata;
@@ -1942,6 +2163,44 @@ static int method_get_dynamic_users(sd_bus_message *message, void *userdata, sd_
         return sd_bus_send(NULL, reply, NULL);
 }
 
+static int method_get_boot_trace(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = ASSERT_PTR(userdata);
+        int r;
+
+        assert(message);
+
+        if (!m->boot_trace)
+                return sd_bus_error_set(error, SD_BUS_ERROR_NOT_SUPPORTED,
+                                        "Boot tracing is not enabled, set BootTrace=yes.");
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sstt)");
+        if (r < 0)
+                return r;
+
+        for (size_t i = 0; i < m->n_boot_trace_events; i++) {
+                const BootTraceEvent *e = m->boot_trace_events + (m->boot_trace_head + i) % BOOT_TRACE_EVENTS_MAX;
+
+                r = sd_bus_message_append(reply, "(sstt)",
+                                          e->unit,
+                                          boot_trace_event_type_to_string(e->type),
+                                          e->timestamp,
+                                          e->duration);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_enqueue_marked_jobs(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
         int r;
@@ -2769,6 +3028,8 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_PROPERTY("NJobs", "u", property_get_hashmap_size, offsetof(Manager, jobs), 0),
         SD_BUS_PROPERTY("NInstalledJobs", "u", bus_property_get_unsigned, offsetof(Manager, n_installed_jobs), 0),
         SD_BUS_PROPERTY("NFailedJobs", "u", bus_property_get_unsigned, offsetof(Manager, n_failed_jobs), 0),
+        SD_BUS_PROPERTY("NCoalescedChangeSignals", "t", NULL, offsetof(Manager, n_coalesced_change_signals), 0),
+        SD_BUS_PROPERTY("NDroppedChangeSignals", "t", NULL, offsetof(Manager, n_dropped_change_signals), 0),
         SD_BUS_PROPERTY("Progress", "d", property_get_progress, 0, 0),
         SD_BUS_PROPERTY("Environment", "as", property_get_environment, 0, 0),
         SD_BUS_PROPERTY("ConfirmSpawn", "b", bus_property_get_bool, offsetof(Manager, confirm_spawn), SD_BUS_VTABLE_PROPERTY_CONST),
@@ -3039,6 +3300,16 @@ const sd_bus_vtable bus_manager_vtable[] = {
                                 SD_BUS_RESULT("a(ssssssouso)", units),
                                 method_list_units_by_names,
                                 SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD_WITH_ARGS("ListUnitsPaged",
+                                SD_BUS_ARGS("as", states, "as", patterns, "s", start_after, "u", max_units),
+                                SD_BUS_RESULT("a(ssssssouso)", units),
+                                method_list_units_paged,
+                                SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD_WITH_ARGS("GetUnitsAccounting",
+                                SD_BUS_ARGS("s", slice, "as", metrics),
+                                SD_BUS_RESULT("t", timestamp, "a(sat)", units),
+                                method_get_units_accounting,
+                                SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD_WITH_ARGS("ListJobs",
                                 SD_BUS_NO_ARGS,
                                 SD_BUS_RESULT("a(usssoo)", jobs),
@@ -3249,6 +3520,11 @@ const sd_bus_vtable bus_manager_vtable[] = {
                                 SD_BUS_RESULT("a(us)", users),
                                 method_get_dynamic_users,
                                 SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD_WITH_ARGS("GetBootTrace",
+                                SD_BUS_NO_ARGS,
+                                SD_BUS_RESULT("a(sstt)", events),
+                                method_get_boot_trace,
+                                SD_BUS_VTABLE_UNPRIVILEGED),
 
         SD_BUS_SIGNAL_WITH_ARGS("UnitNew",
                                 SD_BUS_ARGS("s", id, "o", unit),
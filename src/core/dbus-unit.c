@@ -1625,6 +1625,12 @@ static int send_changed_signal(sd_bus *bus, void *userdata) {
         assert(bus);
         assert(u);
 
+        /* Don't let a direct client that doesn't keep up hold up everybody else */
+        if (bus_is_lagging(u->manager, bus)) {
+                u->manager->n_dropped_change_signals++;
+                return 0;
+        }
+
         p = unit_dbus_path(u);
         if (!p)
                 return -ENOMEM;
@@ -1646,14 +1652,22 @@ static int send_changed_signal(sd_bus *bus, void *userdata) {
                         NULL);
 }
 
+usec_t bus_unit_change_signal_deadline(Unit *u) {
+        assert(u);
+
+        /* Returns when the next change signal for this unit may be sent, or 0 if right away */
+
+        if (!u->sent_dbus_new_signal || u->dbus_change_signal_timestamp == 0)
+                return 0;
+
+        return usec_add(u->dbus_change_signal_timestamp, UNIT_CHANGE_SIGNAL_COALESCE_USEC);
+}
+
 void bus_unit_send_change_signal(Unit *u) {
         int r;
         assert(u);
 
-        if (u->in_dbus_queue) {
-                LIST_REMOVE(dbus_queue, u->manager->dbus_unit_queue, u);
-                u->in_dbus_queue = false;
-        }
+        unit_remove_from_dbus_queue(u);
 
         if (!u->id)
                 return;
@@ -1663,6 +1677,7 @@ void bus_unit_send_change_signal(Unit *u) {
                 log_unit_debug_errno(u, r, "Failed to send unit change signal for %s: %m", u->id);
 
         u->sent_dbus_new_signal = true;
+        u->dbus_change_signal_timestamp = now(CLOCK_MONOTONIC);
 }
 
 void bus_unit_send_pending_change_signal(Unit *u, bool including_new) {
@@ -1683,6 +1698,14 @@ void bus_unit_send_pending_change_signal(Unit *u, bool including_new) {
                                                * when we are reloading. */
                 return;
 
+        if (!including_new &&
+            bus_unit_change_signal_deadline(u) > now(CLOCK_MONOTONIC)) { /* If we sent a signal for this unit only
+                                                                           * very recently, let the pending one
+                                                                           * cover this transition too */
+                u->manager->n_coalesced_change_signals++;
+                return;
+        }
+
         bus_unit_send_change_signal(u);
 }
 
@@ -2480,6 +2503,9 @@ int bus_unit_set_properties(
         if (commit && n > 0 && UNIT_VTABLE(u)->bus_commit_properties)
                 UNIT_VTABLE(u)->bus_commit_properties(u);
 
+        if (n > 0)
+                unit_bump_dbus_generation(u);
+
         return n;
 }
 
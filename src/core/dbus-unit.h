@@ -8,6 +8,11 @@
 extern const sd_bus_vtable bus_unit_vtable[];
 extern const sd_bus_vtable bus_unit_cgroup_vtable[];
 
+/* Change signals for the same unit are sent at most once in this interval. State changes in between are
+ * folded into the next signal. */
+#define UNIT_CHANGE_SIGNAL_COALESCE_USEC (100 * USEC_PER_MSEC)
+
+usec_t bus_unit_change_signal_deadline(Unit *u);
 void bus_unit_send_change_signal(Unit *u);
 void bus_unit_send_pending_change_signal(Unit *u, bool including_new);
 int bus_unit_send_pending_freezer_message(Unit *u);
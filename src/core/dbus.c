@@ -46,6 +46,9 @@
 
 #define CONNECTIONS_MAX 4096
 
+/* How many messages may be queued on a direct connection before we consider it lagging behind */
+#define BUS_SUBSCRIBER_BUDGET 256U
+
 static void destroy_bus(Manager *m, sd_bus **bus);
 
 int bus_send_pending_reload_message(Manager *m) {
@@ -616,12 +619,35 @@ int bus_manager_introspect_implementations(FILE *out, const char *pattern) {
                                             &manager_log_control_object));
 }
 
+static uint64_t bus_unit_generation(sd_bus *bus, const char *path, void *userdata) {
+        Manager *m = ASSERT_PTR(userdata);
+        Unit *u;
+
+        /* Only unit objects are cached, everything else is retrieved anew each time */
+        if (!object_path_startswith(path, "/org/freedesktop/systemd1/unit"))
+                return 0;
+
+        if (find_unit(m, bus, path, &u, NULL) <= 0)
+                return 0;
+
+        return u->dbus_generation;
+}
+
 static int bus_setup_api_vtables(Manager *m, sd_bus *bus) {
         int r;
 
         assert(m);
         assert(bus);
 
+        r = bus_set_property_cache(bus, bus_unit_generation, m);
+        if (r < 0)
+                return r;
+
+        /* Cheap enough to always have around, and retrievable with "busctl statistics" when we are slow */
+        r = sd_bus_set_statistics(bus, true);
+        if (r < 0)
+                return r;
+
 #if HAVE_SELINUX
         r = sd_bus_add_filter(bus, NULL, mac_selinux_filter, m);
         if (r < 0)
@@ -709,6 +735,13 @@ static int bus_on_connection(sd_event_source *s, int fd, uint32_t revents, void
                 return 0;
         }
 
+        /* Our own clients may ask for large arrays to be passed as memfds rather than inline */
+        r = bus_negotiate_memfd(bus, true);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to enable memfd passing for new connection bus: %m");
+                return 0;
+        }
+
         r = sd_bus_negotiate_creds(bus, 1,
                                    SD_BUS_CREDS_PID|SD_BUS_CREDS_UID|
                                    SD_BUS_CREDS_EUID|SD_BUS_CREDS_EFFECTIVE_CAPS|
@@ -724,6 +757,9 @@ static int bus_on_connection(sd_event_source *s, int fd, uint32_t revents, void
                 return 0;
         }
 
+        /* Enable this before starting the connection, so that the authentication is accounted for too */
+        (void) sd_bus_set_statistics(bus, true);
+
         r = sd_bus_start(bus);
         if (r < 0) {
                 log_warning_errno(r, "Failed to start new connection bus: %m");
@@ -1186,16 +1222,40 @@ int bus_verify_set_environment_async(Manager *m, sd_bus_message *call, sd_bus_er
         return bus_verify_polkit_async(call, CAP_SYS_ADMIN, "org.freedesktop.systemd1.set-environment", NULL, false, UID_INVALID, &m->polkit_registry, error);
 }
 
+bool bus_is_lagging(Manager *m, sd_bus *bus) {
+        uint64_t k;
+
+        assert(m);
+        assert(bus);
+
+        /* Returns true if this is a direct connection that has more messages queued than it should. We
+         * stop sending it unit change signals until it caught up again. The API bus is throttled as a
+         * whole instead, see manager_dispatch_dbus_queue(). */
+
+        if (bus == m->api_bus)
+                return false;
+
+        if (sd_bus_get_n_queued_write(bus, &k) < 0)
+                return false;
+
+        return k > BUS_SUBSCRIBER_BUDGET;
+}
+
 uint64_t manager_bus_n_queued_write(Manager *m) {
         uint64_t c = 0;
         sd_bus *b;
         int r;
 
-        /* Returns the total number of messages queued for writing on all our direct and API buses. */
+        /* Returns the total number of messages queued for writing on all our direct and API buses. Direct
+         * connections that are lagging behind are not counted, they don't get further unit change signals
+         * anyway, and shouldn't hold up everybody else. */
 
         SET_FOREACH(b, m->private_buses) {
                 uint64_t k;
 
+                if (bus_is_lagging(m, b))
+                        continue;
+
                 r = sd_bus_get_n_queued_write(b, &k);
                 if (r < 0)
                         log_debug_errno(r, "Failed to query queued messages for private bus: %m");
@@ -51,6 +51,7 @@
 #include "creds-util.h"
 #include "data-fd-util.h"
 #include "def.h"
+#include "dirent-util.h"
 #include "env-file.h"
 #include "env-util.h"
 #include "errno-list.h"
@@ -72,6 +73,7 @@
 #include "memory-util.h"
 #include "missing_fs.h"
 #include "missing_ioprio.h"
+#include "missing_syscall.h"
 #include "mkdir-label.h"
 #include "mount-util.h"
 #include "mountpoint-util.h"
@@ -80,6 +82,7 @@
 #include "path-util.h"
 #include "process-util.h"
 #include "random-util.h"
+#include "raw-clone.h"
 #include "recurse-dir.h"
 #include "rlimit-util.h"
 #include "rm-rf.h"
@@ -88,6 +91,7 @@
 #endif
 #include "securebits-util.h"
 #include "selinux-util.h"
+#include "sha256.h"
 #include "signal-util.h"
 #include "smack-util.h"
 #include "socket-util.h"
@@ -1454,7 +1458,7 @@ static bool context_has_no_new_privileges(const ExecContext *c) {
                 context_has_syscall_logs(c);
 }
 
-static bool exec_context_has_credentials(const ExecContext *context) {
+bool exec_context_has_credentials(const ExecContext *context) {
 
         assert(context);
 
@@ -1473,8 +1477,74 @@ static bool skip_seccomp_unavailable(const Unit* u, const char* msg) {
         return true;
 }
 
+/* Compiled SystemCallFilter= programs are cached in the manager, keyed by their contents. Services tend to
+ * share a handful of distinct filters, hence this is plenty. */
+#define SECCOMP_FILTER_CACHE_MAX 64U
+
+static void syscall_filter_actions(const ExecContext *c, uint32_t *ret_default_action, uint32_t *ret_action) {
+        uint32_t negative_action;
+
+        assert(c);
+        assert(ret_default_action);
+        assert(ret_action);
+
+        negative_action = c->syscall_errno == SECCOMP_ERROR_NUMBER_KILL ? scmp_act_kill_process() : SCMP_ACT_ERRNO(c->syscall_errno);
+
+        if (c->syscall_allow_list) {
+                *ret_default_action = negative_action;
+                *ret_action = SCMP_ACT_ALLOW;
+        } else {
+                *ret_default_action = SCMP_ACT_ALLOW;
+                *ret_action = negative_action;
+        }
+}
+
+static int compile_syscall_filter(Unit *u, const ExecContext *c) {
+        _cleanup_(seccomp_compiled_filter_freep) SeccompCompiledFilter *f = NULL;
+        _cleanup_free_ char *key = NULL;
+        uint32_t default_action, action;
+        int r;
+
+        assert(u);
+        assert(c);
+
+        /* Called in the manager before forking off the child, so that the (fairly expensive) translation of
+         * the filter into BPF happens only once per distinct filter, instead of once in every child. The
+         * child finds the result in its copy of our memory. */
+
+        if (!context_has_syscall_filters(c))
+                return 0;
+
+        if (!is_seccomp_available())
+                return 0;
+
+        syscall_filter_actions(c, &default_action, &action);
+
+        r = seccomp_syscall_filter_key(default_action, c->syscall_filter, action, &key);
+        if (r < 0)
+                return r;
+
+        if (hashmap_contains(u->manager->seccomp_filters, key))
+                return 0;
+
+        r = seccomp_compile_syscall_filter_set_raw(default_action, c->syscall_filter, action, &f);
+        if (r < 0)
+                return r;
+
+        if (hashmap_size(u->manager->seccomp_filters) >= SECCOMP_FILTER_CACHE_MAX)
+                hashmap_clear(u->manager->seccomp_filters);
+
+        r = hashmap_ensure_put(&u->manager->seccomp_filters, &seccomp_compiled_filter_hash_ops, key, f);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(key);
+        TAKE_PTR(f);
+        return 1;
+}
+
 static int apply_syscall_filter(const Unit* u, const ExecContext *c, bool needs_ambient_hack) {
-        uint32_t negative_action, default_action, action;
+        uint32_t default_action, action;
         int r;
 
         assert(u);
@@ -1486,17 +1556,21 @@ static int apply_syscall_filter(const Unit* u, const ExecContext *c, bool needs_
         if (skip_seccomp_unavailable(u, "SystemCallFilter="))
                 return 0;
 
-        negative_action = c->syscall_errno == SECCOMP_ERROR_NUMBER_KILL ? scmp_act_kill_process() : SCMP_ACT_ERRNO(c->syscall_errno);
+        syscall_filter_actions(c, &default_action, &action);
 
-        if (c->syscall_allow_list) {
-                default_action = negative_action;
-                action = SCMP_ACT_ALLOW;
-        } else {
-                default_action = SCMP_ACT_ALLOW;
-                action = negative_action;
-        }
+        if (!needs_ambient_hack) {
+                _cleanup_free_ char *key = NULL;
+                SeccompCompiledFilter *f;
 
-        if (needs_ambient_hack) {
+                /* Use the program compiled by the manager, if there is one */
+                r = seccomp_syscall_filter_key(default_action, c->syscall_filter, action, &key);
+                if (r < 0)
+                        return r;
+
+                f = hashmap_get(u->manager->seccomp_filters, key);
+                if (f)
+                        return seccomp_load_compiled_filter(f);
+        } else {
                 r = seccomp_filter_set_add(c->syscall_filter, c->syscall_allow_list, syscall_filter_sets + SYSCALL_FILTER_SET_SETUID);
                 if (r < 0)
                         return r;
@@ -2624,6 +2698,237 @@ static char **credential_search_path(
         return TAKE_PTR(l);
 }
 
+/* Decrypting credentials is slow, in particular if a TPM2 is involved, and services that are restarted
+ * frequently would pay for it on every start. Hence the credential store is kept across restarts (see
+ * unit_destroy_runtime_data()), and for each encrypted credential in it we keep a record of the ciphertext
+ * it was decrypted from, and when it expires. When the store is set up again, the plaintext of credentials
+ * whose ciphertext didn't change is taken from the old store instead of decrypting it again. The records
+ * are kept outside of the store, so that the service doesn't see them, and go away with the store. */
+
+typedef struct CredentialCacheRecord {
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        le64_t not_after;
+} _packed_ CredentialCacheRecord;
+
+typedef struct CredentialCacheEntry {
+        CredentialCacheRecord record;
+        void *data;
+        size_t size;
+} CredentialCacheEntry;
+
+typedef struct CredentialCache {
+        Hashmap *entries; /* credential id → CredentialCacheEntry */
+        int dir_fd;
+} CredentialCache;
+
+#define CREDENTIAL_CACHE_NULL (CredentialCache) { .dir_fd = -1 }
+
+static CredentialCacheEntry* credential_cache_entry_free(CredentialCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        erase_and_free(e->data);
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(CredentialCacheEntry*, credential_cache_entry_free);
+
+DEFINE_PRIVATE_HASH_OPS_FULL(credential_cache_hash_ops, char, string_hash_func, string_compare_func, free,
+                             CredentialCacheEntry, credential_cache_entry_free);
+
+static void credential_cache_done(CredentialCache *cache) {
+        assert(cache);
+
+        cache->entries = hashmap_free(cache->entries);
+        cache->dir_fd = safe_close(cache->dir_fd);
+}
+
+static char *credential_cache_path(const ExecParameters *params, const char *unit) {
+        assert(params);
+        assert(unit);
+
+        if (!params->prefix[EXEC_DIRECTORY_RUNTIME])
+                return NULL;
+
+        return path_join(params->prefix[EXEC_DIRECTORY_RUNTIME], "systemd/credential-cache", unit);
+}
+
+static int credential_cache_load_one(CredentialCache *cache, int store_dfd, const char *id) {
+        _cleanup_(credential_cache_entry_freep) CredentialCacheEntry *e = NULL;
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ char *k = NULL;
+        ssize_t n;
+        int r;
+
+        assert(cache);
+        assert(store_dfd >= 0);
+        assert(id);
+
+        e = new0(CredentialCacheEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        fd = openat(cache->dir_fd, id, O_RDONLY|O_CLOEXEC|O_NOFOLLOW|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        n = loop_read(fd, &e->record, sizeof(e->record), /* do_poll= */ false);
+        if (n < 0)
+                return n;
+        if (n != sizeof(e->record))
+                return -EBADMSG;
+
+        r = read_full_file_full(
+                        store_dfd, id,
+                        UINT64_MAX,
+                        CREDENTIAL_SIZE_MAX,
+                        READ_FULL_FILE_SECURE,
+                        NULL,
+                        (char**) &e->data, &e->size);
+        if (r < 0)
+                return r;
+
+        k = strdup(id);
+        if (!k)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(&cache->entries, &credential_cache_hash_ops, k, e);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(k);
+        TAKE_PTR(e);
+        return 0;
+}
+
+static int credential_cache_open(const ExecParameters *params, const char *unit, int store_dfd, CredentialCache *ret) {
+        _cleanup_(credential_cache_done) CredentialCache cache = CREDENTIAL_CACHE_NULL;
+        _cleanup_free_ char *p = NULL;
+        _cleanup_closedir_ DIR *d = NULL;
+        int r, fd;
+
+        assert(params);
+        assert(unit);
+        assert(store_dfd >= 0);
+        assert(ret);
+
+        p = credential_cache_path(params, unit);
+        if (!p)
+                return -ENOMEM;
+
+        r = mkdir_p(p, 0700);
+        if (r < 0)
+                return r;
+
+        cache.dir_fd = open(p, O_DIRECTORY|O_CLOEXEC|O_RDONLY);
+        if (cache.dir_fd < 0)
+                return -errno;
+
+        d = xopendirat(cache.dir_fd, ".", O_NOFOLLOW);
+        if (!d)
+                return -errno;
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                if (!credential_name_valid(de->d_name))
+                        continue;
+
+                r = credential_cache_load_one(&cache, store_dfd, de->d_name);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0)
+                        log_debug_errno(r, "Failed to load cached credential %s, ignoring: %m", de->d_name);
+        }
+
+        /* Only the records of the credentials that end up in the new store are written again */
+        fd = fd_reopen(cache.dir_fd, O_DIRECTORY|O_CLOEXEC|O_RDONLY);
+        if (fd < 0)
+                return fd;
+
+        r = rm_rf_children(fd, 0, NULL);
+        if (r < 0)
+                return r;
+
+        *ret = (CredentialCache) {
+                .entries = TAKE_PTR(cache.entries),
+                .dir_fd = TAKE_FD(cache.dir_fd),
+        };
+        return 0;
+}
+
+static int credential_cache_put(CredentialCache *cache, const char *id, const uint8_t digest[static SHA256_DIGEST_SIZE], usec_t not_after) {
+        CredentialCacheRecord record = {
+                .not_after = htole64(not_after),
+        };
+        _cleanup_close_ int fd = -1;
+
+        assert(cache);
+        assert(id);
+
+        if (cache->dir_fd < 0)
+                return 0;
+
+        memcpy(record.digest, digest, SHA256_DIGEST_SIZE);
+
+        fd = openat(cache->dir_fd, id, O_CREAT|O_TRUNC|O_WRONLY|O_CLOEXEC|O_NOFOLLOW|O_NOCTTY, 0600);
+        if (fd < 0)
+                return -errno;
+
+        return loop_write(fd, &record, sizeof(record), /* do_poll= */ false);
+}
+
+static int decrypt_credential_cached(
+                CredentialCache *cache,
+                const char *id,
+                const void *input,
+                size_t input_size,
+                void **ret,
+                size_t *ret_size) {
+
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        struct sha256_ctx ctx;
+        CredentialCacheEntry *e;
+        usec_t ts, not_after;
+        int r;
+
+        assert(cache);
+        assert(id);
+        assert(ret);
+        assert(ret_size);
+
+        sha256_init_ctx(&ctx);
+        sha256_process_bytes(input, input_size, &ctx);
+        sha256_finish_ctx(&ctx, digest);
+
+        ts = now(CLOCK_REALTIME);
+
+        e = hashmap_get(cache->entries, id);
+        if (e &&
+            memcmp(e->record.digest, digest, SHA256_DIGEST_SIZE) == 0 &&
+            (le64toh(e->record.not_after) == USEC_INFINITY || le64toh(e->record.not_after) >= ts)) {
+                void *copy;
+
+                copy = memdup(e->data, e->size);
+                if (!copy)
+                        return -ENOMEM;
+
+                log_debug("Reusing plaintext of encrypted credential %s from previous run.", id);
+
+                not_after = le64toh(e->record.not_after);
+                *ret = copy;
+                *ret_size = e->size;
+        } else {
+                r = decrypt_credential_and_warn(id, ts, NULL, input, input_size, ret, ret_size, &not_after);
+                if (r < 0)
+                        return r;
+        }
+
+        r = credential_cache_put(cache, id, digest, not_after);
+        if (r < 0)
+                log_debug_errno(r, "Failed to write cache record for credential %s, ignoring: %m", id);
+
+        return 0;
+}
+
 static int load_credential(
                 const ExecContext *context,
                 const ExecParameters *params,
@@ -2635,6 +2940,7 @@ static int load_credential(
                 int write_dfd,
                 uid_t uid,
                 bool ownership_ok,
+                CredentialCache *cache,
                 uint64_t *left) {
 
         ReadFullFileFlags flags = READ_FULL_FILE_SECURE|READ_FULL_FILE_FAIL_WHEN_LARGER;
@@ -2652,6 +2958,7 @@ static int load_credential(
         assert(path);
         assert(unit);
         assert(write_dfd >= 0);
+        assert(cache);
         assert(left);
 
         if (read_dfd >= 0) {
@@ -2748,7 +3055,7 @@ static int load_credential(
                 _cleanup_free_ void *plaintext = NULL;
                 size_t plaintext_size = 0;
 
-                r = decrypt_credential_and_warn(id, now(CLOCK_REALTIME), NULL, data, size, &plaintext, &plaintext_size);
+                r = decrypt_credential_cached(cache, id, data, size, &plaintext, &plaintext_size);
                 if (r < 0)
                         return r;
 
@@ -2776,6 +3083,7 @@ struct load_cred_args {
         int dfd;
         uid_t uid;
         bool ownership_ok;
+        CredentialCache *cache;
         uint64_t *left;
 };
 
@@ -2823,6 +3131,7 @@ static int load_cred_recurse_dir_cb(
                         args->dfd,
                         args->uid,
                         args->ownership_ok,
+                        args->cache,
                         args->left);
         if (r < 0)
                 return r;
@@ -2838,11 +3147,12 @@ static int acquire_credentials(
                 uid_t uid,
                 bool ownership_ok) {
 
+        _cleanup_(credential_cache_done) CredentialCache cache = CREDENTIAL_CACHE_NULL;
         uint64_t left = CREDENTIALS_TOTAL_SIZE_MAX;
         _cleanup_close_ int dfd = -1;
         ExecLoadCredential *lc;
         ExecSetCredential *sc;
-        int r;
+        int r, fd;
 
         assert(context);
         assert(p);
@@ -2851,6 +3161,23 @@ static int acquire_credentials(
         if (dfd < 0)
                 return -errno;
 
+        /* The store might be left over from a previous run of the unit, in which case it was made read-only
+         * at the end. Pick up what we can reuse from it, and then start from a clean slate. */
+        if (fchmod(dfd, 0700) < 0)
+                return -errno;
+
+        r = credential_cache_open(params, unit, dfd, &cache);
+        if (r < 0)
+                log_debug_errno(r, "Failed to open credential cache, ignoring: %m");
+
+        fd = fd_reopen(dfd, O_DIRECTORY|O_CLOEXEC|O_RDONLY);
+        if (fd < 0)
+                return fd;
+
+        r = rm_rf_children(fd, REMOVE_CHMOD, NULL);
+        if (r < 0)
+                return r;
+
         /* First, load credentials off disk (or acquire via AF_UNIX socket) */
         HASHMAP_FOREACH(lc, context->load_credentials) {
                 _cleanup_close_ int sub_fd = -1;
@@ -2881,6 +3208,7 @@ static int acquire_credentials(
                                         dfd,
                                         uid,
                                         ownership_ok,
+                                        &cache,
                                         &left);
                 else
                         /* Directory */
@@ -2899,6 +3227,7 @@ static int acquire_credentials(
                                                 .dfd = dfd,
                                                 .uid = uid,
                                                 .ownership_ok = ownership_ok,
+                                                .cache = &cache,
                                                 .left = &left,
                                         });
                 if (r < 0)
@@ -2922,7 +3251,7 @@ static int acquire_credentials(
                         return log_debug_errno(errno, "Failed to test if credential %s exists: %m", sc->id);
 
                 if (sc->encrypted) {
-                        r = decrypt_credential_and_warn(sc->id, now(CLOCK_REALTIME), NULL, sc->data, sc->size, &plaintext, &size);
+                        r = decrypt_credential_cached(&cache, sc->id, sc->data, sc->size, &plaintext, &size);
                         if (r < 0)
                                 return r;
 
@@ -3563,6 +3892,7 @@ static int apply_mount_namespace(
                 ns_info = (NamespaceInfo) {
                         .ignore_protect_paths = false,
                         .private_dev = context->private_devices,
+                        .private_dev_template = context->private_devices && u->manager->private_dev_template > 0,
                         .protect_control_groups = context->protect_control_groups,
                         .protect_kernel_tunables = context->protect_kernel_tunables,
                         .protect_kernel_modules = context->protect_kernel_modules,
@@ -4099,6 +4429,7 @@ static int exec_child(
                 size_t n_storage_fds,
                 char **files_env,
                 int user_lookup_fd,
+                bool in_cgroup,
                 int *exit_status) {
 
         _cleanup_strv_free_ char **our_env = NULL, **pass_env = NULL, **joined_exec_search_path = NULL, **accum_env = NULL, **replaced_argv = NULL;
@@ -4328,8 +4659,9 @@ static int exec_child(
                 (void) fd_nonblock(socket_fd, false);
 
         /* Journald will try to look-up our cgroup in order to populate _SYSTEMD_CGROUP and _SYSTEMD_UNIT fields.
-         * Hence we need to migrate to the target cgroup from init.scope before connecting to journald */
-        if (params->cgroup_path) {
+         * Hence we need to migrate to the target cgroup from init.scope before connecting to journald. That
+         * already happened if we were cloned right into it. */
+        if (params->cgroup_path && !in_cgroup) {
                 _cleanup_free_ char *p = NULL;
 
                 r = exec_parameters_get_cgroup_path(params, &p);
@@ -5158,19 +5490,117 @@ static int exec_child(
 static int exec_context_load_environment(const Unit *unit, const ExecContext *c, char ***l);
 static int exec_context_named_iofds(const ExecContext *c, const ExecParameters *p, int named_iofds[static 3]);
 
+static pid_t exec_clone(Unit *unit, const char *cgroup_path, int *ret_pidfd, bool *ret_in_cgroup) {
+        static bool clone_into_cgroup_unsupported = false;
+        _cleanup_close_ int pidfd = -1;
+        pid_t pid;
+
+        assert(unit);
+        assert(ret_in_cgroup);
+
+        /* Creates the child right in its cgroup, which saves the migration in both the parent and the
+         * child, and avoids the window in which the child still lives in our cgroup. That is only possible
+         * on the unified hierarchy, with the other hierarchies we need to attach the child to each of them
+         * anyway. If requested, also returns a pidfd for the child. */
+
+        if (cgroup_path && !clone_into_cgroup_unsupported && cg_all_unified() > 0) {
+                _cleanup_free_ char *fs = NULL;
+                _cleanup_close_ int cgroup_fd = -1;
+                int r;
+
+                r = cg_get_path(SYSTEMD_CGROUP_CONTROLLER, cgroup_path, NULL, &fs);
+                if (r < 0)
+                        return r;
+
+                cgroup_fd = open(fs, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+                if (cgroup_fd < 0)
+                        log_unit_debug_errno(unit, errno, "Failed to open cgroup %s, not cloning into it: %m", fs);
+                else {
+                        struct systemd_clone_args args = {
+                                .flags = CLONE_INTO_CGROUP | (ret_pidfd ? CLONE_PIDFD : 0),
+                                .pidfd = PTR_TO_UINT64(&pidfd),
+                                .exit_signal = SIGCHLD,
+                                .cgroup = cgroup_fd,
+                        };
+
+                        pid = raw_clone3(&args);
+                        if (pid >= 0) {
+                                if (pid == 0)
+                                        pidfd = -1; /* Only installed in the parent */
+
+                                if (ret_pidfd)
+                                        *ret_pidfd = TAKE_FD(pidfd);
+                                *ret_in_cgroup = true;
+                                return pid;
+                        }
+
+                        if (ERRNO_IS_NOT_SUPPORTED(errno) || IN_SET(errno, E2BIG, EINVAL)) {
+                                log_unit_debug_errno(unit, errno, "clone3() with CLONE_INTO_CGROUP not supported, falling back to fork(): %m");
+                                clone_into_cgroup_unsupported = true;
+                        } else
+                                /* e.g. EBUSY, because the cgroup got children in the meantime. The child will
+                                 * tell in more detail when it fails to attach itself. */
+                                log_unit_debug_errno(unit, errno, "Failed to clone into cgroup %s, falling back to fork(): %m", fs);
+                }
+        }
+
+        pid = fork();
+        if (pid < 0)
+                return -errno;
+        if (pid > 0 && ret_pidfd) {
+                /* The child is not reaped before we return, hence its PID cannot be recycled yet */
+                pidfd = pidfd_open(pid, 0);
+                if (pidfd < 0)
+                        log_unit_debug_errno(unit, errno, "Failed to acquire pidfd for child, ignoring: %m");
+        }
+
+        if (ret_pidfd)
+                *ret_pidfd = TAKE_FD(pidfd);
+        *ret_in_cgroup = false;
+        return pid;
+}
+
+static void exec_setup_private_dev_template(Unit *u, const ExecContext *c) {
+        int r;
+
+        assert(u);
+        assert(c);
+
+        /* Prepares the shared /dev for PrivateDevices= once, on first use. Only the system manager can
+         * mount in its own namespace, and if that fails, services just keep building /dev on their own. */
+
+        if (!c->private_devices || u->manager->private_dev_template >= 0)
+                return;
+
+        if (!MANAGER_IS_SYSTEM(u->manager) || MANAGER_IS_TEST_RUN(u->manager)) {
+                u->manager->private_dev_template = false;
+                return;
+        }
+
+        r = setup_private_dev_template();
+        if (r < 0)
+                log_unit_debug_errno(u, r, "Failed to set up " PRIVATE_DEV_TEMPLATE ", ignoring: %m");
+
+        u->manager->private_dev_template = r >= 0;
+}
+
 int exec_spawn(Unit *unit,
                ExecCommand *command,
                const ExecContext *context,
                const ExecParameters *params,
                ExecRuntime *runtime,
                DynamicCreds *dcreds,
-               pid_t *ret) {
+               pid_t *ret,
+               int *ret_pidfd) {
 
         int socket_fd, r, named_iofds[3] = { -1, -1, -1 }, *fds = NULL;
         _cleanup_free_ char *subcgroup_path = NULL;
         _cleanup_strv_free_ char **files_env = NULL;
         size_t n_storage_fds = 0, n_socket_fds = 0;
         _cleanup_free_ char *line = NULL;
+        _cleanup_close_ int pidfd = -1;
+        usec_t start = now(CLOCK_MONOTONIC);
+        bool in_cgroup;
         pid_t pid;
 
         assert(unit);
@@ -5237,9 +5667,17 @@ int exec_spawn(Unit *unit,
                 }
         }
 
-        pid = fork();
+        exec_setup_private_dev_template(unit, context);
+
+#if HAVE_SECCOMP
+        r = compile_syscall_filter(unit, context);
+        if (r < 0)
+                log_unit_debug_errno(unit, r, "Failed to compile system call filter, leaving it to the child: %m");
+#endif
+
+        pid = exec_clone(unit, subcgroup_path ?: params->cgroup_path, ret_pidfd ? &pidfd : NULL, &in_cgroup);
         if (pid < 0)
-                return log_unit_error_errno(unit, errno, "Failed to fork: %m");
+                return log_unit_error_errno(unit, pid, "Failed to fork: %m");
 
         if (pid == 0) {
                 int exit_status = EXIT_SUCCESS;
@@ -5257,6 +5695,7 @@ int exec_spawn(Unit *unit,
                                n_storage_fds,
                                files_env,
                                unit->manager->user_lookup_fds[1],
+                               in_cgroup,
                                &exit_status);
 
                 if (r < 0) {
@@ -5275,17 +5714,20 @@ int exec_spawn(Unit *unit,
                 _exit(exit_status);
         }
 
-        log_unit_debug(unit, "Forked %s as "PID_FMT, command->path, pid);
+        log_unit_debug(unit, "Forked %s as "PID_FMT"%s", command->path, pid, in_cgroup ? " into its cgroup" : "");
+        unit_boot_trace(unit, BOOT_TRACE_EXEC_SPAWN, start);
 
         /* We add the new process to the cgroup both in the child (so that we can be sure that no user code is ever
          * executed outside of the cgroup) and in the parent (so that we can be sure that when we kill the cgroup the
          * process will be killed too). */
-        if (subcgroup_path)
+        if (subcgroup_path && !in_cgroup)
                 (void) cg_attach(SYSTEMD_CGROUP_CONTROLLER, subcgroup_path, pid);
 
         exec_status_start(&command->exec_status, pid);
 
         *ret = pid;
+        if (ret_pidfd)
+                *ret_pidfd = TAKE_FD(pidfd);
         return 0;
 }
 
@@ -5458,6 +5900,14 @@ int exec_context_destroy_credentials(const ExecContext *c, const char *runtime_p
         (void) umount2(p, MNT_DETACH|UMOUNT_NOFOLLOW);
         (void) rm_rf(p, REMOVE_ROOT|REMOVE_CHMOD);
 
+        /* The records of the credentials we might reuse on the next start go away with the store */
+        p = mfree(p);
+        p = path_join(runtime_prefix, "systemd/credential-cache", unit);
+        if (!p)
+                return -ENOMEM;
+
+        (void) rm_rf(p, REMOVE_ROOT|REMOVE_CHMOD);
+
         return 0;
 }
 
@@ -434,7 +434,8 @@ int exec_spawn(Unit *unit,
                const ExecParameters *exec_params,
                ExecRuntime *runtime,
                DynamicCreds *dynamic_creds,
-               pid_t *ret);
+               pid_t *ret,
+               int *ret_pidfd);
 
 void exec_command_done_array(ExecCommand *c, size_t n);
 ExecCommand* exec_command_free_list(ExecCommand *c);
@@ -451,6 +452,7 @@ void exec_context_done(ExecContext *c);
 void exec_context_dump(const ExecContext *c, FILE* f, const char *prefix);
 
 int exec_context_destroy_runtime_directory(const ExecContext *c, const char *runtime_root);
+bool exec_context_has_credentials(const ExecContext *context);
 int exec_context_destroy_credentials(const ExecContext *c, const char *runtime_root, const char *unit);
 
 const char* exec_context_fdname(const ExecContext *c, int fd_index);
@@ -1,13 +1,42 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
+#include "conf-files.h"
+#include "fileio.h"
+#include "fs-util.h"
 #include "generator-setup.h"
 #include "macro.h"
 #include "mkdir-label.h"
+#include "path-util.h"
 #include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+
+int lookup_paths_generator_inputs_dir(const LookupPaths *p, char **ret) {
+        char *d;
+
+        assert(p);
+        assert(ret);
+
+        /* Generators may declare the inputs their output depends on by writing a list of paths to a file
+         * named after themselves in this directory, which is placed next to the generator directories. */
+
+        if (!p->generator)
+                return -EINVAL;
+
+        d = strjoin(p->generator, ".inputs");
+        if (!d)
+                return -ENOMEM;
+
+        *ret = d;
+        return 0;
+}
 
 int lookup_paths_mkdir_generator(LookupPaths *p) {
+        _cleanup_free_ char *inputs = NULL;
         int r, q;
 
         assert(p);
@@ -25,10 +54,18 @@ int lookup_paths_mkdir_generator(LookupPaths *p) {
         if (q < 0 && r >= 0)
                 r = q;
 
+        q = lookup_paths_generator_inputs_dir(p, &inputs);
+        if (q >= 0)
+                q = mkdir_p_label(inputs, 0755);
+        if (q < 0 && r >= 0)
+                r = q;
+
         return r;
 }
 
 void lookup_paths_trim_generator(LookupPaths *p) {
+        _cleanup_free_ char *inputs = NULL;
+
         assert(p);
 
         /* Trim empty dirs */
@@ -39,9 +76,13 @@ void lookup_paths_trim_generator(LookupPaths *p) {
                 (void) rmdir(p->generator_early);
         if (p->generator_late)
                 (void) rmdir(p->generator_late);
+        if (lookup_paths_generator_inputs_dir(p, &inputs) >= 0)
+                (void) rmdir(inputs);
 }
 
 void lookup_paths_flush_generator(LookupPaths *p) {
+        _cleanup_free_ char *inputs = NULL;
+
         assert(p);
 
         /* Flush the generated unit files in full */
@@ -52,7 +93,144 @@ void lookup_paths_flush_generator(LookupPaths *p) {
                 (void) rm_rf(p->generator_early, REMOVE_ROOT|REMOVE_PHYSICAL);
         if (p->generator_late)
                 (void) rm_rf(p->generator_late, REMOVE_ROOT|REMOVE_PHYSICAL);
+        if (lookup_paths_generator_inputs_dir(p, &inputs) >= 0)
+                (void) rm_rf(inputs, REMOVE_ROOT|REMOVE_PHYSICAL);
 
         if (p->temporary_dir)
                 (void) rm_rf(p->temporary_dir, REMOVE_ROOT|REMOVE_PHYSICAL);
 }
+
+static int digest_input(const char *path, struct sha256_ctx *ctx) {
+        struct stat st;
+        int r;
+
+        assert(path);
+        assert(ctx);
+
+        if (!path_is_absolute(path))
+                return -EINVAL;
+
+        sha256_process_bytes(path, strlen(path) + 1, ctx);
+
+        if (lstat(path, &st) < 0) {
+                if (errno != ENOENT)
+                        return -errno;
+
+                /* That the input is missing is relevant too, e.g. for /etc/rc.local. */
+                zero(st);
+
+        } else if (S_ISLNK(st.st_mode)) {
+                _cleanup_free_ char *target = NULL;
+
+                /* E.g. the /dev/disk/by-* symlinks, which identify block devices. The target itself is
+                 * digested below. */
+                r = readlink_malloc(path, &target);
+                if (r < 0)
+                        return r;
+
+                sha256_process_bytes(target, strlen(target) + 1, ctx);
+
+                if (stat(path, &st) < 0) {
+                        if (errno != ENOENT)
+                                return -errno;
+
+                        zero(st);
+                }
+        }
+
+        sha256_process_bytes(&st.st_mode, sizeof(st.st_mode), ctx);
+
+        if (S_ISREG(st.st_mode)) {
+                _cleanup_free_ char *data = NULL;
+                size_t size;
+
+                r = read_full_file(path, &data, &size);
+                if (r < 0)
+                        return r;
+
+                sha256_process_bytes(&size, sizeof(size), ctx);
+                sha256_process_bytes(data, size, ctx);
+
+        } else if (S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode))
+                sha256_process_bytes(&st.st_rdev, sizeof(st.st_rdev), ctx);
+
+        else if (S_ISDIR(st.st_mode))
+                /* Only catches entries being added or removed, not modified, so generators should list the
+                 * files within the directory they read, too. */
+                sha256_process_bytes(&st.st_mtim, sizeof(st.st_mtim), ctx);
+
+        return 0;
+}
+
+int generator_inputs_digest(
+                const LookupPaths *p,
+                char **directories,
+                char **environment,
+                uint8_t ret[static SHA256_DIGEST_SIZE]) {
+
+        _cleanup_strv_free_ char **binaries = NULL;
+        _cleanup_free_ char *inputs_dir = NULL;
+        struct sha256_ctx ctx;
+        int r;
+
+        assert(p);
+        assert(ret);
+
+        /* Calculates a digest of everything the output of the generators depends on: the generator binaries
+         * themselves, the environment they are invoked with, and the inputs they declared. Returns -ENODATA
+         * if any generator did not declare its inputs, as its output can then never be reused. */
+
+        r = lookup_paths_generator_inputs_dir(p, &inputs_dir);
+        if (r < 0)
+                return r;
+
+        /* Same as execute_directories() */
+        r = conf_files_list_strv(&binaries, NULL, NULL, CONF_FILES_EXECUTABLE|CONF_FILES_REGULAR|CONF_FILES_FILTER_MASKED, (const char* const*) directories);
+        if (r < 0)
+                return r;
+
+        sha256_init_ctx(&ctx);
+
+        STRV_FOREACH(e, environment)
+                sha256_process_bytes(*e, strlen(*e) + 1, &ctx);
+
+        STRV_FOREACH(b, binaries) {
+                _cleanup_free_ char *j = NULL, *data = NULL;
+                _cleanup_strv_free_ char **l = NULL;
+                struct stat st;
+
+                if (stat(*b, &st) < 0)
+                        return -errno;
+
+                sha256_process_bytes(*b, strlen(*b) + 1, &ctx);
+                sha256_process_bytes(&st.st_ino, sizeof(st.st_ino), &ctx);
+                sha256_process_bytes(&st.st_size, sizeof(st.st_size), &ctx);
+                sha256_process_bytes(&st.st_mtim, sizeof(st.st_mtim), &ctx);
+
+                j = path_join(inputs_dir, basename(*b));
+                if (!j)
+                        return -ENOMEM;
+
+                r = read_full_file(j, &data, NULL);
+                if (r == -ENOENT)
+                        return -ENODATA;
+                if (r < 0)
+                        return r;
+
+                l = strv_split_newlines(data);
+                if (!l)
+                        return -ENOMEM;
+
+                STRV_FOREACH(i, l) {
+                        if (isempty(*i) || **i == '#')
+                                continue;
+
+                        r = digest_input(*i, &ctx);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        sha256_finish_ctx(&ctx, ret);
+        return 0;
+}
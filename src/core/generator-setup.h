@@ -2,7 +2,11 @@
 #pragma once
 
 #include "path-lookup.h"
+#include "sha256.h"
 
 int lookup_paths_mkdir_generator(LookupPaths *p);
 void lookup_paths_trim_generator(LookupPaths *p);
 void lookup_paths_flush_generator(LookupPaths *p);
+
+int lookup_paths_generator_inputs_dir(const LookupPaths *p, char **ret);
+int generator_inputs_digest(const LookupPaths *p, char **directories, char **environment, uint8_t ret[static SHA256_DIGEST_SIZE]);
@@ -15,11 +15,13 @@
 #include "job.h"
 #include "log.h"
 #include "macro.h"
+#include "mempool.h"
 #include "parse-util.h"
 #include "serialize.h"
 #include "set.h"
 #include "sort-util.h"
 #include "special.h"
+#include "stats-util.h"
 #include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
@@ -28,14 +30,23 @@
 #include "unit.h"
 #include "virt.h"
 
+/* Transactions allocate and free lots of these at once, hence keep them together, see job_trim_pools() */
+DEFINE_MEMPOOL(job_pool, Job, 64);
+DEFINE_MEMPOOL(job_dependency_pool, JobDependency, 256);
+
+DEFINE_STATS_COUNTER(stats_jobs_installed, "manager.jobs_installed");
+DEFINE_STATS_COUNTER(stats_jobs_merged, "manager.jobs_merged");
+DEFINE_STATS_HISTOGRAM(stats_job, "manager.job"); /* From installation until the job finished */
+
 Job* job_new_raw(Unit *unit) {
         Job *j;
+        bool from_pool;
 
         /* used for deserialization */
 
         assert(unit);
 
-        j = new(Job, 1);
+        j = mempool_alloc0_tile_or_malloc(&job_pool, &from_pool);
         if (!j)
                 return NULL;
 
@@ -43,6 +54,7 @@ Job* job_new_raw(Unit *unit) {
                 .manager = unit->manager,
                 .unit = unit,
                 .type = _JOB_TYPE_INVALID,
+                .from_pool = from_pool,
         };
 
         return j;
@@ -104,7 +116,12 @@ Job* job_free(Job *j) {
         sd_bus_track_unref(j->bus_track);
         strv_free(j->deserialized_clients);
 
-        return mfree(j);
+        return mempool_free_tile_or_free(&job_pool, j, j->from_pool);
+}
+
+void job_trim_pools(void) {
+        (void) mempool_trim(&job_pool);
+        (void) mempool_trim(&job_dependency_pool);
 }
 
 static void job_set_state(Job *j, JobState state) {
@@ -209,6 +226,7 @@ Job* job_install(Job *j) {
                         if (uj->state == JOB_WAITING ||
                             (job_type_allows_late_merge(j->type) && job_type_is_superset(uj->type, j->type))) {
                                 job_merge_into_installed(uj, j);
+                                stats_counter_inc(&stats_jobs_merged);
                                 log_unit_debug(uj->unit,
                                                "Merged %s/%s into installed job %s/%s as %"PRIu32,
                                                j->unit->id, job_type_to_string(j->type), uj->unit->id,
@@ -220,6 +238,7 @@ Job* job_install(Job *j) {
                                 /* XXX It should be safer to queue j to run after uj finishes, but it is
                                  * not currently possible to have more than one installed job per unit. */
                                 job_merge_into_installed(uj, j);
+                                stats_counter_inc(&stats_jobs_merged);
                                 log_unit_debug(uj->unit,
                                                "Merged into running job, re-running: %s/%s as %"PRIu32,
                                                uj->unit->id, job_type_to_string(uj->type), uj->id);
@@ -235,9 +254,11 @@ Job* job_install(Job *j) {
         j->installed = true;
 
         j->manager->n_installed_jobs++;
+        stats_counter_inc(&stats_jobs_installed);
         log_unit_debug(j->unit,
                        "Installed new job %s/%s as %u",
                        j->unit->id, job_type_to_string(j->type), (unsigned) j->id);
+        unit_boot_trace(j->unit, BOOT_TRACE_JOB_ENQUEUED, USEC_INFINITY);
 
         job_add_to_gc_queue(j);
 
@@ -283,6 +304,7 @@ int job_install_deserialized(Job *j) {
 
 JobDependency* job_dependency_new(Job *subject, Job *object, bool matters, bool conflicts) {
         JobDependency *l;
+        bool from_pool;
 
         assert(object);
 
@@ -291,10 +313,11 @@ JobDependency* job_dependency_new(Job *subject, Job *object, bool matters, bool
          * this means the 'anchor' job (i.e. the one the user
          * explicitly asked for) is the requester. */
 
-        l = new0(JobDependency, 1);
+        l = mempool_alloc0_tile_or_malloc(&job_dependency_pool, &from_pool);
         if (!l)
                 return NULL;
 
+        l->from_pool = from_pool;
         l->subject = subject;
         l->object = object;
         l->matters = matters;
@@ -316,7 +339,7 @@ void job_dependency_free(JobDependency *l) {
 
         LIST_REMOVE(object, l->object->object_list, l);
 
-        free(l);
+        mempool_free_tile_or_free(&job_dependency_pool, l, l->from_pool);
 }
 
 void job_dump(Job *j, FILE *f, const char *prefix) {
@@ -846,6 +869,7 @@ int job_run_and_invalidate(Job *j) {
         job_start_timer(j, true);
         job_set_state(j, JOB_RUNNING);
         job_add_to_dbus_queue(j);
+        unit_boot_trace(j->unit, BOOT_TRACE_JOB_RUNNING, USEC_INFINITY);
 
         switch (j->type) {
 
@@ -940,8 +964,12 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
         j->result = result;
 
+        if (j->begin_usec > 0)
+                stats_histogram_add_since(&stats_job, j->begin_usec);
+
         log_unit_debug(u, "Job %" PRIu32 " %s/%s finished, result=%s",
                        j->id, u->id, job_type_to_string(t), job_result_to_string(result));
+        unit_boot_trace(u, BOOT_TRACE_JOB_FINISHED, USEC_INFINITY);
 
         /* If this job did nothing to the respective unit we don't log the status message */
         if (!already)
@@ -1176,7 +1204,7 @@ int job_deserialize(Job *j, FILE *f) {
                 char *l, *v;
                 size_t k;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
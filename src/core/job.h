@@ -111,6 +111,7 @@ struct JobDependency {
 
         bool matters:1;
         bool conflicts:1;
+        bool from_pool:1;
 };
 
 struct Job {
@@ -161,12 +162,14 @@ struct Job {
         bool in_gc_queue:1;
         bool ref_by_private_bus:1;
         bool return_skip_on_cond_failure:1;
+        bool from_pool:1;
 };
 
 Job* job_new(Unit *unit, JobType type);
 Job* job_new_raw(Unit *unit);
 void job_unlink(Job *job);
 Job* job_free(Job *job);
+void job_trim_pools(void);
 Job* job_install(Job *j);
 int job_install_deserialized(Job *j);
 void job_uninstall(Job *j);
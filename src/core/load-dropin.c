@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include "conf-parser.h"
+#include "config-cache.h"
 #include "fs-util.h"
 #include "load-dropin.h"
 #include "load-fragment.h"
@@ -18,6 +19,7 @@ static int process_deps(Unit *u, UnitDependency dependency, const char *dir_suff
         r = unit_file_find_dropin_paths(NULL,
                                         u->manager->lookup_paths.search_path,
                                         u->manager->unit_path_cache,
+                                        &u->manager->dropin_dir_cache,
                                         dir_suffix, NULL,
                                         u->id, u->aliases,
                                         &paths);
@@ -114,10 +116,7 @@ int unit_load_dropin(Unit *u) {
         STRV_FOREACH(f, u->dropin_paths) {
                 struct stat st;
 
-                r = config_parse(u->id, *f, NULL,
-                                 UNIT_VTABLE(u)->sections,
-                                 config_item_perf_lookup, load_fragment_gperf_lookup,
-                                 0, u, &st);
+                r = unit_config_parse(u, *f, NULL, &st);
                 if (r > 0)
                         u->dropin_mtime = MAX(u->dropin_mtime, timespec_load(&st.st_mtim));
         }
@@ -12,6 +12,7 @@ static inline int unit_find_dropin_paths(Unit *u, char ***paths) {
         return unit_file_find_dropin_paths(NULL,
                                            u->manager->lookup_paths.search_path,
                                            u->manager->unit_path_cache,
+                                           &u->manager->dropin_dir_cache,
                                            ".d", ".conf",
                                            u->id, u->aliases,
                                            paths);
@@ -29,6 +29,7 @@
 #include "capability-util.h"
 #include "cgroup-setup.h"
 #include "conf-parser.h"
+#include "config-cache.h"
 #include "core-varlink.h"
 #include "cpu-set-util.h"
 #include "creds-util.h"
@@ -2238,7 +2239,6 @@ int config_parse_path_spec(const char *unit,
         s->unit = UNIT(p);
         s->path = TAKE_PTR(k);
         s->type = b;
-        s->inotify_fd = -1;
 
         LIST_PREPEND(spec, p->specs, s);
 
@@ -6102,6 +6102,7 @@ int unit_load_fragment(Unit *u) {
 
         /* Possibly rebuild the fragment map to catch new units */
         r = unit_file_build_name_map(&u->manager->lookup_paths,
+                                     manager_unit_name_map_cache_path(u->manager),
                                      &u->manager->unit_cache_timestamp_hash,
                                      &u->manager->unit_id_map,
                                      &u->manager->unit_name_map,
@@ -6118,19 +6119,15 @@ int unit_load_fragment(Unit *u) {
                 return r;
 
         if (fragment) {
-                /* Open the file, check if this is a mask, otherwise read. */
-                _cleanup_fclose_ FILE *f = NULL;
+                /* Check if this is a mask, otherwise read. */
                 struct stat st;
 
-                /* Try to open the file name. A symlink is OK, for example for linked files or masks. We
-                 * expect that all symlinks within the lookup paths have been already resolved, but we don't
-                 * verify this here. */
-                f = fopen(fragment, "re");
-                if (!f)
-                        return log_unit_notice_errno(u, errno, "Failed to open %s: %m", fragment);
-
-                if (fstat(fileno(f), &st) < 0)
-                        return -errno;
+                /* A symlink is OK, for example for linked files or masks. We expect that all symlinks within
+                 * the lookup paths have been already resolved, but we don't verify this here. We don't open
+                 * the file here: if it's in the config cache already, e.g. because it's the template of
+                 * other instances loaded before, unit_config_parse() won't need to read it at all. */
+                if (stat(fragment, &st) < 0)
+                        return log_unit_notice_errno(u, errno, "Failed to access %s: %m", fragment);
 
                 r = free_and_strdup(&u->fragment_path, fragment);
                 if (r < 0)
@@ -6146,12 +6143,7 @@ int unit_load_fragment(Unit *u) {
                         u->fragment_mtime = timespec_load(&st.st_mtim);
 
                         /* Now, parse the file contents */
-                        r = config_parse(u->id, fragment, f,
-                                         UNIT_VTABLE(u)->sections,
-                                         config_item_perf_lookup, load_fragment_gperf_lookup,
-                                         0,
-                                         u,
-                                         NULL);
+                        r = unit_config_parse(u, fragment, NULL, NULL);
                         if (r == -ENOEXEC)
                                 log_unit_notice_errno(u, r, "Unit configuration has fatal error, unit will not be started.");
                         if (r < 0)
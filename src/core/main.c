@@ -32,6 +32,7 @@
 #include "cgroup-util.h"
 #include "clock-util.h"
 #include "conf-parser.h"
+#include "config-cache.h"
 #include "cpu-set-util.h"
 #include "crash-handler.h"
 #include "dbus-manager.h"
@@ -102,6 +103,25 @@
 
 #define DEFAULT_TASKS_MAX ((TasksMax) { 15U, 100U }) /* 15% */
 
+#if ENABLE_BUILTIN_GENERATORS
+/* Generators linked into this binary, see the builtin-generators meson option. They are still only run if
+ * the installed binary is found in the generator search path, so that they can be masked or overridden. */
+int builtin_generator_fstab_main(int argc, char *argv[]);
+int builtin_generator_getty_main(int argc, char *argv[]);
+#if HAVE_BLKID
+int builtin_generator_gpt_auto_main(int argc, char *argv[]);
+#endif
+
+static const ExecBuiltin builtin_generators[] = {
+        { SYSTEM_GENERATOR_DIR "/systemd-fstab-generator",    builtin_generator_fstab_main    },
+        { SYSTEM_GENERATOR_DIR "/systemd-getty-generator",    builtin_generator_getty_main    },
+#if HAVE_BLKID
+        { SYSTEM_GENERATOR_DIR "/systemd-gpt-auto-generator", builtin_generator_gpt_auto_main },
+#endif
+        {}
+};
+#endif
+
 static enum {
         ACTION_RUN,
         ACTION_HELP,
@@ -113,6 +133,7 @@ static enum {
 } arg_action = ACTION_RUN;
 
 static const char *arg_bus_introspect = NULL;
+static const char *arg_write_unit_snapshot = NULL;
 
 /* Those variables are initialized to 0 automatically, so we avoid uninitialized memory access.  Real
  * defaults are assigned in reset_arguments() below. */
@@ -162,6 +183,8 @@ static bool arg_default_tasks_accounting;
 static TasksMax arg_default_tasks_max;
 static sd_id128_t arg_machine_id;
 static EmergencyAction arg_cad_burst_action;
+static bool arg_critical_chain_scheduling;
+static bool arg_boot_trace;
 static OOMPolicy arg_default_oom_policy;
 static CPUSet arg_cpu_affinity;
 static NUMAPolicy arg_numa_policy;
@@ -656,6 +679,8 @@ static int parse_config_file(void) {
                 { "Manager", "DefaultTasksAccounting",       config_parse_bool,                  0,                        &arg_default_tasks_accounting     },
                 { "Manager", "DefaultTasksMax",              config_parse_tasks_max,             0,                        &arg_default_tasks_max            },
                 { "Manager", "CtrlAltDelBurstAction",        config_parse_emergency_action,      0,                        &arg_cad_burst_action             },
+                { "Manager", "CriticalChainScheduling",      config_parse_bool,                  0,                        &arg_critical_chain_scheduling    },
+                { "Manager", "BootTrace",                    config_parse_bool,                  0,                        &arg_boot_trace                   },
                 { "Manager", "DefaultOOMPolicy",             config_parse_oom_policy,            0,                        &arg_default_oom_policy           },
                 { "Manager", "DefaultOOMScoreAdjust",        config_parse_oom_score_adjust,      0,                        NULL                              },
                 {}
@@ -749,6 +774,8 @@ static void set_manager_settings(Manager *m) {
         m->confirm_spawn = arg_confirm_spawn;
         m->service_watchdogs = arg_service_watchdogs;
         m->cad_burst_action = arg_cad_burst_action;
+        m->critical_chain_scheduling = arg_critical_chain_scheduling;
+        m->boot_trace = arg_boot_trace;
 
         manager_set_watchdog(m, WATCHDOG_RUNTIME, arg_runtime_watchdog);
         manager_set_watchdog(m, WATCHDOG_REBOOT, arg_reboot_watchdog);
@@ -773,6 +800,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_SYSTEM,
                 ARG_USER,
                 ARG_TEST,
+                ARG_WRITE_UNIT_SNAPSHOT,
                 ARG_NO_PAGER,
                 ARG_VERSION,
                 ARG_DUMP_CONFIGURATION_ITEMS,
@@ -802,6 +830,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "system",                   no_argument,       NULL, ARG_SYSTEM                   },
                 { "user",                     no_argument,       NULL, ARG_USER                     },
                 { "test",                     no_argument,       NULL, ARG_TEST                     },
+                { "write-unit-snapshot",      required_argument, NULL, ARG_WRITE_UNIT_SNAPSHOT      },
                 { "no-pager",                 no_argument,       NULL, ARG_NO_PAGER                 },
                 { "help",                     no_argument,       NULL, 'h'                          },
                 { "version",                  no_argument,       NULL, ARG_VERSION                  },
@@ -921,6 +950,11 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_action = ACTION_TEST;
                         break;
 
+                case ARG_WRITE_UNIT_SNAPSHOT:
+                        arg_write_unit_snapshot = optarg;
+                        arg_action = ACTION_TEST;
+                        break;
+
                 case ARG_NO_PAGER:
                         arg_pager_flags |= PAGER_DISABLE;
                         break;
@@ -1078,6 +1112,7 @@ static int help(void) {
                "     --test                      Determine initial transaction, dump it and exit\n"
                "     --system                    Combined with --test: operate in system mode\n"
                "     --user                      Combined with --test: operate in user mode\n"
+               "     --write-unit-snapshot=PATH  Like --test, but write the unit files read to PATH\n"
                "     --dump-configuration-items  Dump understood unit configuration items\n"
                "     --dump-bus-properties       Dump exposed bus properties\n"
                "     --bus-introspect=PATH       Write XML introspection data\n"
@@ -2411,6 +2446,8 @@ static void reset_arguments(void) {
         arg_default_tasks_max = DEFAULT_TASKS_MAX;
         arg_machine_id = (sd_id128_t) {};
         arg_cad_burst_action = EMERGENCY_ACTION_REBOOT_FORCE;
+        arg_critical_chain_scheduling = false;
+        arg_boot_trace = false;
         arg_default_oom_policy = OOM_STOP;
 
         cpu_set_reset(&arg_cpu_affinity);
@@ -2929,6 +2966,11 @@ int main(int argc, char *argv[]) {
         set_manager_settings(m);
         manager_set_first_boot(m, first_boot);
 
+#if ENABLE_BUILTIN_GENERATORS
+        if (arg_system && arg_action == ACTION_RUN)
+                m->generator_builtins = builtin_generators;
+#endif
+
         /* Remember whether we should queue the default job */
         queue_default_job = !arg_serialization || arg_switched_root;
 
@@ -2957,6 +2999,14 @@ int main(int argc, char *argv[]) {
                  FORMAT_TIMESPAN(after_startup - before_startup, 100 * USEC_PER_MSEC));
 
         if (arg_action == ACTION_TEST) {
+                if (arg_write_unit_snapshot) {
+                        r = manager_config_cache_write_snapshot(m, arg_write_unit_snapshot);
+                        if (r < 0) {
+                                retval = EXIT_FAILURE;
+                                goto finish;
+                        }
+                }
+
                 manager_test_summary(m);
                 retval = EXIT_SUCCESS;
                 goto finish;
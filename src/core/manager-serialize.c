@@ -228,7 +228,7 @@ static int manager_deserialize_units(Manager *m, FILE *f, FDSet *fds) {
         for (;;) {
                 _cleanup_free_ char *line = NULL;
                 /* Start marker */
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -329,7 +329,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                 _cleanup_free_ char *line = NULL;
                 const char *val, *l;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
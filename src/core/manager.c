@@ -29,9 +29,11 @@
 #include "bus-kernel.h"
 #include "bus-util.h"
 #include "clean-ipc.h"
+#include "config-cache.h"
 #include "clock-util.h"
 #include "core-varlink.h"
 #include "creds-util.h"
+#include "critical-chain.h"
 #include "dbus-job.h"
 #include "dbus-manager.h"
 #include "dbus-unit.h"
@@ -74,6 +76,7 @@
 #include "socket-util.h"
 #include "special.h"
 #include "stat-util.h"
+#include "stats-util.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -106,6 +109,20 @@
 /* How many units and jobs to process of the bus queue before returning to the event loop. */
 #define MANAGER_BUS_MESSAGE_BUDGET 100U
 
+/* How many notification messages to process per wakeup before returning to the event loop. */
+#define MANAGER_NOTIFY_MESSAGE_BUDGET 64U
+
+/* Remembers which unit the cgroup of a PID belongs to, while processing one batch of notification messages */
+typedef struct NotifyPidCache {
+        pid_t pid;
+        Unit *unit;
+} NotifyPidCache;
+
+DEFINE_STATS_HISTOGRAM(stats_unit_load, "manager.unit_load");
+DEFINE_STATS_HISTOGRAM(stats_run_queue, "manager.run_queue");
+DEFINE_STATS_COUNTER(stats_jobs_run, "manager.jobs_run");
+DEFINE_STATS_COUNTER(stats_notify_messages, "manager.notify_messages");
+
 static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_signal_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
@@ -729,6 +746,7 @@ static void manager_free_unit_name_maps(Manager *m) {
         m->unit_id_map = hashmap_free(m->unit_id_map);
         m->unit_name_map = hashmap_free(m->unit_name_map);
         m->unit_path_cache = set_free(m->unit_path_cache);
+        m->dropin_dir_cache = hashmap_free(m->dropin_dir_cache);
         m->unit_cache_timestamp_hash = 0;
 }
 
@@ -858,6 +876,7 @@ int manager_new(LookupScope scope, ManagerTestRunFlags test_run_flags, Manager *
 
                 .have_ask_password = -EINVAL, /* we don't know */
                 .first_boot = -1,
+                .private_dev_template = -1,
                 .test_run_flags = test_run_flags,
 
                 .default_oom_policy = OOM_STOP,
@@ -896,7 +915,7 @@ int manager_new(LookupScope scope, ManagerTestRunFlags test_run_flags, Manager *
         if (r < 0)
                 return r;
 
-        r = hashmap_ensure_allocated(&m->cgroup_unit, &path_hash_ops);
+        r = hashmap_ensure_allocated(&m->cgroup_unit, &fast_path_hash_ops);
         if (r < 0)
                 return r;
 
@@ -1460,6 +1479,7 @@ static void manager_clear_jobs_and_units(Manager *m) {
         assert(!m->load_queue);
         assert(prioq_isempty(m->run_queue));
         assert(!m->dbus_unit_queue);
+        assert(!m->dbus_unit_coalesce_queue);
         assert(!m->dbus_job_queue);
         assert(!m->cleanup_queue);
         assert(!m->gc_unit_queue);
@@ -1501,6 +1521,7 @@ Manager* manager_free(Manager *m) {
 
         exec_runtime_vacuum(m);
         hashmap_free(m->exec_runtime_by_id);
+        hashmap_free(m->seccomp_filters);
 
         dynamic_user_vacuum(m, false);
         hashmap_free(m->dynamic_users);
@@ -1514,6 +1535,9 @@ Manager* manager_free(Manager *m) {
         prioq_free(m->run_queue);
 
         set_free(m->startup_units);
+        manager_drop_critical_chain(m);
+        manager_free_boot_trace(m);
+        unit_state_table_free(m->unit_state_table);
         set_free(m->failed_units);
 
         sd_event_source_unref(m->signal_event_source);
@@ -1523,6 +1547,7 @@ Manager* manager_free(Manager *m) {
         sd_event_source_unref(m->time_change_event_source);
         sd_event_source_unref(m->timezone_change_event_source);
         sd_event_source_unref(m->jobs_in_progress_event_source);
+        sd_event_source_unref(m->dbus_coalesce_event_source);
         sd_event_source_unref(m->run_queue_event_source);
         sd_event_source_unref(m->user_lookup_event_source);
 
@@ -1544,7 +1569,10 @@ Manager* manager_free(Manager *m) {
         strv_free(m->client_environment);
 
         hashmap_free(m->cgroup_unit);
+        hashmap_free(m->bpf_firewall_access);
+        free(m->numa_node_units);
         manager_free_unit_name_maps(m);
+        manager_config_cache_flush(m);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -1800,6 +1828,22 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds, const char *roo
 
         lookup_paths_log(&m->lookup_paths);
 
+        /* Only on a fresh boot, not when we are reloaded or reexecuted */
+        if (!serialization)
+                (void) manager_load_critical_chain(m);
+
+        if (!serialization && MANAGER_IS_SYSTEM(m) && !MANAGER_IS_TEST_RUN(m)) {
+                r = manager_config_cache_load_snapshot(m, UNIT_SNAPSHOT_PATH);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to load unit snapshot %s, ignoring: %m", UNIT_SNAPSHOT_PATH);
+        }
+
+        if (MANAGER_IS_SYSTEM(m) && !MANAGER_IS_TEST_RUN(m) && !m->unit_state_table) {
+                r = unit_state_table_new(UNIT_STATE_TABLE_PATH, &m->unit_state_table);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to create unit state table, ignoring: %m");
+        }
+
         {
                 /* This block is (optionally) done with the reloading counter bumped */
                 _unused_ _cleanup_(manager_reloading_stopp) Manager *reloading = NULL;
@@ -2073,10 +2117,14 @@ unsigned manager_dispatch_load_queue(Manager *m) {
          * tries to load its data until the queue is empty */
 
         while ((u = m->load_queue)) {
+                usec_t begin = now(CLOCK_MONOTONIC);
+
                 assert(u->in_load_queue);
 
                 unit_load(u);
                 n++;
+
+                stats_histogram_add_since(&stats_unit_load, begin);
         }
 
         m->dispatching_load_queue = false;
@@ -2259,18 +2307,24 @@ void manager_unwatch_pid(Manager *m, pid_t pid) {
 
 static int manager_dispatch_run_queue(sd_event_source *source, void *userdata) {
         Manager *m = userdata;
+        usec_t begin;
         Job *j;
 
         assert(source);
         assert(m);
 
+        begin = now(CLOCK_MONOTONIC);
+
         while ((j = prioq_peek(m->run_queue))) {
                 assert(j->installed);
                 assert(j->in_run_queue);
 
                 (void) job_run_and_invalidate(j);
+                stats_counter_inc(&stats_jobs_run);
         }
 
+        stats_histogram_add_since(&stats_run_queue, begin);
+
         if (m->n_running_jobs > 0)
                 manager_watch_jobs_in_progress(m);
 
@@ -2292,8 +2346,71 @@ void manager_trigger_run_queue(Manager *m) {
                 log_warning_errno(r, "Failed to enable job run queue event source, ignoring: %m");
 }
 
+static int manager_dispatch_dbus_coalesce(sd_event_source *source, usec_t usec, void *userdata);
+
+static int manager_arm_dbus_coalesce(Manager *m, usec_t deadline) {
+        usec_t t;
+        int r;
+
+        assert(m);
+
+        /* Nothing to do if the timer is already set to go off earlier */
+        if (m->dbus_coalesce_event_source &&
+            sd_event_source_get_enabled(m->dbus_coalesce_event_source, NULL) > 0 &&
+            sd_event_source_get_time(m->dbus_coalesce_event_source, &t) >= 0 &&
+            t <= deadline)
+                return 0;
+
+        r = event_reset_time(m->event, &m->dbus_coalesce_event_source,
+                             CLOCK_MONOTONIC, deadline, USEC_PER_MSEC,
+                             manager_dispatch_dbus_coalesce, m,
+                             0, "manager-dbus-coalesce", true);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to arm unit change signal coalescing timer: %m");
+
+        return 0;
+}
+
+static void manager_requeue_coalesced(Manager *m, usec_t until) {
+        usec_t next = USEC_INFINITY;
+
+        assert(m);
+
+        /* Moves units whose coalescing window ended before the specified time back to the D-Bus queue, and
+         * rearms the timer for the remaining ones, if any. */
+
+        LIST_FOREACH(dbus_queue, u, m->dbus_unit_coalesce_queue) {
+                usec_t d;
+
+                assert(u->in_dbus_queue);
+                assert(u->in_dbus_coalesce_queue);
+
+                d = bus_unit_change_signal_deadline(u);
+                if (d > until) {
+                        next = MIN(next, d);
+                        continue;
+                }
+
+                LIST_REMOVE(dbus_queue, m->dbus_unit_coalesce_queue, u);
+                u->in_dbus_coalesce_queue = false;
+                LIST_PREPEND(dbus_queue, m->dbus_unit_queue, u);
+        }
+
+        if (next != USEC_INFINITY)
+                (void) manager_arm_dbus_coalesce(m, next);
+}
+
+static int manager_dispatch_dbus_coalesce(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = ASSERT_PTR(userdata);
+
+        /* The queue itself is dispatched by the main loop */
+        manager_requeue_coalesced(m, usec);
+        return 0;
+}
+
 static unsigned manager_dispatch_dbus_queue(Manager *m) {
         unsigned n = 0, budget;
+        usec_t ts = 0;
         Unit *u;
         Job *j;
 
@@ -2301,9 +2418,12 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
 
         /* When we are reloading, let's not wait with generating signals, since we need to exit the manager as quickly
          * as we can. There's no point in throttling generation of signals in that case. */
-        if (MANAGER_IS_RELOADING(m) || m->send_reloading_done || m->pending_reload_message)
+        if (MANAGER_IS_RELOADING(m) || m->send_reloading_done || m->pending_reload_message) {
                 budget = UINT_MAX; /* infinite budget in this case */
-        else {
+
+                /* Don't hold anything back either */
+                manager_requeue_coalesced(m, USEC_INFINITY);
+        } else {
                 /* Anything to do at all? */
                 if (!m->dbus_unit_queue && !m->dbus_job_queue)
                         return 0;
@@ -2328,9 +2448,26 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
         }
 
         while (budget != 0 && (u = m->dbus_unit_queue)) {
+                usec_t d;
 
                 assert(u->in_dbus_queue);
 
+                /* If we sent a change signal for this unit only very recently, hold this one back for a
+                 * bit, so that a burst of state changes results in a single signal per unit and window. */
+                if (budget != UINT_MAX) {
+                        d = bus_unit_change_signal_deadline(u);
+                        if (d > 0 && ts == 0)
+                                ts = now(CLOCK_MONOTONIC);
+                        if (d > ts) {
+                                LIST_REMOVE(dbus_queue, m->dbus_unit_queue, u);
+                                LIST_PREPEND(dbus_queue, m->dbus_unit_coalesce_queue, u);
+                                u->in_dbus_coalesce_queue = true;
+
+                                (void) manager_arm_dbus_coalesce(m, d);
+                                continue;
+                        }
+                }
+
                 bus_unit_send_change_signal(u);
                 n++;
 
@@ -2440,10 +2577,40 @@ static void manager_invoke_notify_message(
         }
 }
 
-static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+static Unit *manager_get_unit_by_pid_cgroup_cached(
+                Manager *m,
+                pid_t pid,
+                NotifyPidCache *cache,
+                size_t *n_cache) {
+
+        Unit *u;
+
+        assert(m);
+        assert(cache);
+        assert(n_cache);
+
+        /* Looking up the cgroup of a process means reading a file in /proc/, let's do that only once per
+         * sender and batch. Since a PID might be reused or moved to another cgroup, the result is not kept
+         * beyond the batch. */
+
+        for (size_t i = 0; i < *n_cache; i++)
+                if (cache[i].pid == pid)
+                        return cache[i].unit;
+
+        u = manager_get_unit_by_pid_cgroup(m, pid);
+
+        if (*n_cache < MANAGER_NOTIFY_MESSAGE_BUDGET)
+                cache[(*n_cache)++] = (NotifyPidCache) {
+                        .pid = pid,
+                        .unit = u,
+                };
+
+        return u;
+}
+
+static int manager_process_notify_message(Manager *m, NotifyPidCache *cache, size_t *n_cache) {
 
         _cleanup_fdset_free_ FDSet *fds = NULL;
-        Manager *m = userdata;
         char buf[NOTIFY_BUFFER_MAX+1];
         struct iovec iovec = {
                 .iov_base = buf,
@@ -2469,20 +2636,16 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         ssize_t n;
 
         assert(m);
-        assert(m->notify_fd == fd);
 
-        if (revents != EPOLLIN) {
-                log_warning("Got unexpected poll event for notify fd.");
-                return 0;
-        }
+        /* Returns 0 if there was no message to process, 1 if one was processed (or ignored) */
 
         n = recvmsg_safe(m->notify_fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC);
         if (n < 0) {
                 if (ERRNO_IS_TRANSIENT(n))
-                        return 0; /* Spurious wakeup, try again */
+                        return 0; /* Spurious wakeup or drained, try again */
                 if (n == -EXFULL) {
                         log_warning("Got message with truncated control data (too many fds sent?), ignoring.");
-                        return 0;
+                        return 1;
                 }
                 /* If this is any other, real error, then let's stop processing this socket. This of course
                  * means we won't take notification messages anymore, but that's still better than busy
@@ -2514,25 +2677,25 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
                 if (r < 0) {
                         close_many(fd_array, n_fds);
                         log_oom();
-                        return 0;
+                        return 1;
                 }
         }
 
         if (!ucred || !pid_is_valid(ucred->pid)) {
                 log_warning("Received notify message without valid credentials. Ignoring.");
-                return 0;
+                return 1;
         }
 
         if ((size_t) n >= sizeof(buf) || (msghdr.msg_flags & MSG_TRUNC)) {
                 log_warning("Received notify message exceeded maximum size. Ignoring.");
-                return 0;
+                return 1;
         }
 
         /* As extra safety check, let's make sure the string we get doesn't contain embedded NUL bytes. We permit one
          * trailing NUL byte in the message, but don't expect it. */
         if (n > 1 && memchr(buf, 0, n-1)) {
                 log_warning("Received notify message with embedded NUL bytes. Ignoring.");
-                return 0;
+                return 1;
         }
 
         /* Make sure it's NUL-terminated, then parse it to obtain the tags list */
@@ -2540,18 +2703,18 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         tags = strv_split_newlines(buf);
         if (!tags) {
                 log_oom();
-                return 0;
+                return 1;
         }
 
         /* possibly a barrier fd, let's see */
         if (manager_process_barrier_fd(tags, fds))
-                return 0;
+                return 1;
 
         /* Increase the generation counter used for filtering out duplicate unit invocations. */
         m->notifygen++;
 
         /* Notify every unit that might be interested, which might be multiple. */
-        u1 = manager_get_unit_by_pid_cgroup(m, ucred->pid);
+        u1 = manager_get_unit_by_pid_cgroup_cached(m, ucred->pid, cache, n_cache);
         u2 = hashmap_get(m->watch_pids, PID_TO_PTR(ucred->pid));
         array = hashmap_get(m->watch_pids, PID_TO_PTR(-ucred->pid));
         if (array) {
@@ -2586,6 +2749,33 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         if (fdset_size(fds) > 0)
                 log_warning("Got extra auxiliary fds with notification message, closing them.");
 
+        return 1;
+}
+
+static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        NotifyPidCache cache[MANAGER_NOTIFY_MESSAGE_BUDGET];
+        Manager *m = ASSERT_PTR(userdata);
+        size_t n_cache = 0;
+        int r;
+
+        assert(m->notify_fd == fd);
+
+        if (revents != EPOLLIN) {
+                log_warning("Got unexpected poll event for notify fd.");
+                return 0;
+        }
+
+        /* Process a batch of messages per wakeup, so that a flood of them (e.g. from many services pinging
+         * the watchdog) doesn't cost a full event loop iteration each. Don't drain the socket completely
+         * though, so that other event sources still get their turn. */
+        for (unsigned i = 0; i < MANAGER_NOTIFY_MESSAGE_BUDGET; i++) {
+                r = manager_process_notify_message(m, cache, &n_cache);
+                if (r <= 0)
+                        return r;
+
+                stats_counter_inc(&stats_notify_messages);
+        }
+
         return 0;
 }
 
@@ -2605,11 +2795,79 @@ static void manager_invoke_sigchld_event(
 
         log_unit_debug(u, "Child "PID_FMT" belongs to %s.", si->si_pid, u->id);
         unit_unwatch_pid(u, si->si_pid);
+        unit_boot_trace(u, BOOT_TRACE_EXEC_EXITED, USEC_INFINITY);
 
         if (UNIT_VTABLE(u)->sigchld_event)
                 UNIT_VTABLE(u)->sigchld_event(u, si->si_pid, si->si_code, si->si_status);
 }
 
+void manager_dispatch_child_exit(Manager *m, const siginfo_t *si, Unit *owner) {
+        _cleanup_free_ Unit **array_copy = NULL;
+        _cleanup_free_ char *name = NULL;
+        Unit *u1, *u2, **array;
+
+        assert(m);
+        assert(si);
+
+        /* Dispatches the exit of a child process (which must not be reaped yet) to all units watching it. If
+         * the caller already knows the unit the process belongs to (because it watched it via a pidfd) it
+         * may pass it in as 'owner', in which case we skip looking up the unit via the process' cgroup. */
+
+        if (!IN_SET(si->si_code, CLD_EXITED, CLD_KILLED, CLD_DUMPED))
+                return;
+
+        if (DEBUG_LOGGING) {
+                (void) get_process_comm(si->si_pid, &name);
+
+                log_debug("Child "PID_FMT" (%s) died (code=%s, status=%i/%s)",
+                          si->si_pid, strna(name),
+                          sigchld_code_to_string(si->si_code),
+                          si->si_status,
+                          strna(si->si_code == CLD_EXITED
+                                ? exit_status_to_string(si->si_status, EXIT_STATUS_FULL)
+                                : signal_to_string(si->si_status)));
+        }
+
+        /* Increase the generation counter used for filtering out duplicate unit invocations */
+        m->sigchldgen++;
+
+        /* And now figure out the unit this belongs to, it might be multiple... */
+        u1 = owner ?: manager_get_unit_by_pid_cgroup(m, si->si_pid);
+        u2 = hashmap_get(m->watch_pids, PID_TO_PTR(si->si_pid));
+        array = hashmap_get(m->watch_pids, PID_TO_PTR(-si->si_pid));
+        if (array) {
+                size_t n = 0;
+
+                /* Count how many entries the array has */
+                while (array[n])
+                        n++;
+
+                /* Make a copy of the array so that we don't trip up on the array changing beneath us */
+                array_copy = newdup(Unit*, array, n+1);
+                if (!array_copy)
+                        log_oom();
+        }
+
+        /* Finally, execute them all. Note that u1, u2 and the array might contain duplicates, but
+         * that's fine, manager_invoke_sigchld_event() will ensure we only invoke the handlers once for
+         * each iteration. */
+        if (u1) {
+                /* We check for oom condition, in case we got SIGCHLD before the oom notification.
+                 * We only do this for the cgroup the PID belonged to. */
+                (void) unit_check_oom(u1);
+
+                /* We check if systemd-oomd performed a kill so that we log and notify appropriately */
+                (void) unit_check_oomd_kill(u1);
+
+                manager_invoke_sigchld_event(m, u1, si);
+        }
+        if (u2)
+                manager_invoke_sigchld_event(m, u2, si);
+        if (array_copy)
+                for (size_t i = 0; array_copy[i]; i++)
+                        manager_invoke_sigchld_event(m, array_copy[i], si);
+}
+
 static int manager_dispatch_sigchld(sd_event_source *source, void *userdata) {
         Manager *m = userdata;
         siginfo_t si = {};
@@ -2619,7 +2877,9 @@ static int manager_dispatch_sigchld(sd_event_source *source, void *userdata) {
         assert(m);
 
         /* First we call waitid() for a PID and do not reap the zombie. That way we can still access /proc/$PID for it
-         * while it is a zombie. */
+         * while it is a zombie. Note that processes we watch via a pidfd are usually reaped by
+         * unit_dispatch_pidfd() before we get here, this is mostly relevant for processes we only know by
+         * their PID. */
 
         if (waitid(P_ALL, 0, &si, WEXITED|WNOHANG|WNOWAIT) < 0) {
 
@@ -2632,60 +2892,7 @@ static int manager_dispatch_sigchld(sd_event_source *source, void *userdata) {
         if (si.si_pid <= 0)
                 goto turn_off;
 
-        if (IN_SET(si.si_code, CLD_EXITED, CLD_KILLED, CLD_DUMPED)) {
-                _cleanup_free_ Unit **array_copy = NULL;
-                _cleanup_free_ char *name = NULL;
-                Unit *u1, *u2, **array;
-
-                (void) get_process_comm(si.si_pid, &name);
-
-                log_debug("Child "PID_FMT" (%s) died (code=%s, status=%i/%s)",
-                          si.si_pid, strna(name),
-                          sigchld_code_to_string(si.si_code),
-                          si.si_status,
-                          strna(si.si_code == CLD_EXITED
-                                ? exit_status_to_string(si.si_status, EXIT_STATUS_FULL)
-                                : signal_to_string(si.si_status)));
-
-                /* Increase the generation counter used for filtering out duplicate unit invocations */
-                m->sigchldgen++;
-
-                /* And now figure out the unit this belongs to, it might be multiple... */
-                u1 = manager_get_unit_by_pid_cgroup(m, si.si_pid);
-                u2 = hashmap_get(m->watch_pids, PID_TO_PTR(si.si_pid));
-                array = hashmap_get(m->watch_pids, PID_TO_PTR(-si.si_pid));
-                if (array) {
-                        size_t n = 0;
-
-                        /* Count how many entries the array has */
-                        while (array[n])
-                                n++;
-
-                        /* Make a copy of the array so that we don't trip up on the array changing beneath us */
-                        array_copy = newdup(Unit*, array, n+1);
-                        if (!array_copy)
-                                log_oom();
-                }
-
-                /* Finally, execute them all. Note that u1, u2 and the array might contain duplicates, but
-                 * that's fine, manager_invoke_sigchld_event() will ensure we only invoke the handlers once for
-                 * each iteration. */
-                if (u1) {
-                        /* We check for oom condition, in case we got SIGCHLD before the oom notification.
-                         * We only do this for the cgroup the PID belonged to. */
-                        (void) unit_check_oom(u1);
-
-                        /* We check if systemd-oomd performed a kill so that we log and notify appropriately */
-                        (void) unit_check_oomd_kill(u1);
-
-                        manager_invoke_sigchld_event(m, u1, &si);
-                }
-                if (u2)
-                        manager_invoke_sigchld_event(m, u2, &si);
-                if (array_copy)
-                        for (size_t i = 0; array_copy[i]; i++)
-                                manager_invoke_sigchld_event(m, array_copy[i], &si);
-        }
+        manager_dispatch_child_exit(m, &si, NULL);
 
         /* And now, we actually reap the zombie. */
         if (waitid(P_PID, si.si_pid, &si, WEXITED) < 0) {
@@ -3333,6 +3540,7 @@ int manager_override_watchdog_pretimeout_governor(Manager *m, const char *govern
 
 int manager_reload(Manager *m) {
         _unused_ _cleanup_(manager_reloading_stopp) Manager *reloading = NULL;
+        _cleanup_set_free_ Set *config_paths = NULL;
         _cleanup_fdset_free_ FDSet *fds = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         int r;
@@ -3357,17 +3565,21 @@ int manager_reload(Manager *m) {
         if (fseeko(f, 0, SEEK_SET) < 0)
                 return log_error_errno(errno, "Failed to seek to beginning of serialization: %m");
 
+        /* Remember which unit files we read so far, so that we can read them again ahead of time */
+        r = manager_config_cache_collect(m, &config_paths);
+        if (r < 0)
+                log_debug_errno(r, "Failed to collect unit file paths, ignoring: %m");
+
         /* 💀 This is the point of no return, from here on there is no way back. 💀 */
         reloading = NULL;
 
         bus_manager_send_reloading(m, true);
 
-        /* Start by flushing out all jobs and units, all generated units, all runtime environments, all dynamic users
-         * and everything else that is worth flushing out. We'll get it all back from the serialization — if we need
-         * it. */
+        /* Start by flushing out all jobs and units, all runtime environments, all dynamic users and everything
+         * else that is worth flushing out. We'll get it all back from the serialization — if we need it.
+         * Generated units are flushed by manager_run_generators(), unless they can be reused. */
 
         manager_clear_jobs_and_units(m);
-        lookup_paths_flush_generator(&m->lookup_paths);
         lookup_paths_free(&m->lookup_paths);
         exec_runtime_vacuum(m);
         dynamic_user_vacuum(m, false);
@@ -3383,9 +3595,14 @@ int manager_reload(Manager *m) {
 
         lookup_paths_log(&m->lookup_paths);
 
-        /* We flushed out generated files, for which we don't watch mtime, so we should flush the old map. */
+        /* We might have flushed out generated files, for which we don't watch mtime, so we should flush the
+         * old map. */
         manager_free_unit_name_maps(m);
 
+        /* Read ahead the unit files we are going to need again, unless they didn't change */
+        manager_config_cache_begin_reload(m, config_paths);
+        config_paths = set_free(config_paths);
+
         /* First, enumerate what we can from kernel and suchlike */
         manager_enumerate_perpetual(m);
         manager_enumerate(m);
@@ -3408,6 +3625,7 @@ int manager_reload(Manager *m) {
 
         /* Clean up runtime objects no longer referenced */
         manager_vacuum(m);
+        manager_config_cache_end_reload(m);
 
         /* Clean up deserialized tracked clients */
         m->deserialized_subscribed = strv_free(m->deserialized_subscribed);
@@ -3627,6 +3845,9 @@ void manager_check_finished(Manager *m) {
         if (hashmap_buckets(m->jobs) > hashmap_size(m->units) / 10)
                 m->jobs = hashmap_free(m->jobs);
 
+        /* Same for the memory of the jobs themselves */
+        job_trim_pools();
+
         manager_send_ready(m);
 
         /* Notify Type=idle units that we are done now */
@@ -3650,6 +3871,9 @@ void manager_check_finished(Manager *m) {
 
         manager_notify_finished(m);
 
+        (void) manager_save_critical_chain(m);
+        manager_drop_critical_chain(m);
+
         manager_invalidate_startup_units(m);
 }
 
@@ -3755,6 +3979,8 @@ static int build_generator_environment(Manager *m, char ***ret) {
 
 static int manager_run_generators(Manager *m) {
         _cleanup_strv_free_ char **paths = NULL, **ge = NULL;
+        _cleanup_free_ char *inputs_dir = NULL;
+        uint8_t digest[SHA256_DIGEST_SIZE];
         int r;
 
         assert(m);
@@ -3766,6 +3992,31 @@ static int manager_run_generators(Manager *m) {
         if (!paths)
                 return log_oom();
 
+        r = lookup_paths_generator_inputs_dir(&m->lookup_paths, &inputs_dir);
+        if (r < 0)
+                return log_error_errno(r, "Failed to determine generator inputs directory: %m");
+
+        r = build_generator_environment(m, &ge);
+        if (r < 0)
+                return log_error_errno(r, "Failed to build generator environment: %m");
+
+        r = strv_env_assign(&ge, "SYSTEMD_GENERATOR_INPUTS_DIR", inputs_dir);
+        if (r < 0)
+                return log_oom();
+
+        /* If all generators declared their inputs the last time they ran and none of them changed since,
+         * the generated units from back then are still good. Note that generator output is flushed when the
+         * manager goes away, hence this only helps on reloads. */
+        if (m->generator_inputs_digest_valid &&
+            generator_inputs_digest(&m->lookup_paths, paths, ge, digest) >= 0 &&
+            memcmp(digest, m->generator_inputs_digest, sizeof(digest)) == 0) {
+                log_debug("Inputs of all generators unchanged, reusing their previous output.");
+                return 0;
+        }
+
+        m->generator_inputs_digest_valid = false;
+        lookup_paths_flush_generator(&m->lookup_paths);
+
         if (!generator_path_any((const char* const*) paths))
                 return 0;
 
@@ -3783,20 +4034,23 @@ static int manager_run_generators(Manager *m) {
                 NULL,
         };
 
-        r = build_generator_environment(m, &ge);
-        if (r < 0) {
-                log_error_errno(r, "Failed to build generator environment: %m");
-                goto finish;
-        }
-
         RUN_WITH_UMASK(0022)
-                (void) execute_directories(
+                (void) execute_directories_full(
                                 (const char* const*) paths,
                                 DEFAULT_TIMEOUT_USEC,
                                 /* callbacks= */ NULL, /* callback_args= */ NULL,
                                 (char**) argv,
                                 ge,
-                                EXEC_DIR_PARALLEL | EXEC_DIR_IGNORE_ERRORS | EXEC_DIR_SET_SYSTEMD_EXEC_PID);
+                                EXEC_DIR_PARALLEL | EXEC_DIR_IGNORE_ERRORS | EXEC_DIR_SET_SYSTEMD_EXEC_PID,
+                                m->generator_builtins);
+
+        r = generator_inputs_digest(&m->lookup_paths, paths, ge, m->generator_inputs_digest);
+        if (r == -ENODATA)
+                log_debug("Not all generators declared their inputs, will run them again on reload.");
+        else if (r < 0)
+                log_debug_errno(r, "Failed to calculate digest of generator inputs, ignoring: %m");
+        else
+                m->generator_inputs_digest_valid = true;
 
         r = 0;
 
@@ -15,6 +15,7 @@
 #include "list.h"
 #include "prioq.h"
 #include "ratelimit.h"
+#include "sha256.h"
 #include "varlink.h"
 
 struct libmnt_monitor;
@@ -122,11 +123,14 @@ typedef enum WatchdogType {
         _WATCHDOG_TYPE_MAX,
 } WatchdogType;
 
+#include "boot-trace.h"
 #include "execute.h"
 #include "job.h"
 #include "path-lookup.h"
 #include "show-status.h"
+#include "unit-file.h"
 #include "unit-name.h"
+#include "unit-state-table.h"
 
 typedef enum ManagerTestRunFlags {
         MANAGER_TEST_NORMAL                  = 0,       /* run normally */
@@ -167,6 +171,10 @@ struct Manager {
         LIST_HEAD(Unit, dbus_unit_queue);
         LIST_HEAD(Job, dbus_job_queue);
 
+        /* Units whose change signal is held back, since they had one only very recently. They are moved
+         * back to the queue above once their coalescing window is over. */
+        LIST_HEAD(Unit, dbus_unit_coalesce_queue);
+
         /* Units to remove */
         LIST_HEAD(Unit, cleanup_queue);
 
@@ -232,6 +240,9 @@ struct Manager {
 
         sd_event_source *jobs_in_progress_event_source;
 
+        /* Wakes us up when unit change signals held back for coalescing are due */
+        sd_event_source *dbus_coalesce_event_source;
+
         int user_lookup_fds[2];
         sd_event_source *user_lookup_event_source;
 
@@ -242,6 +253,37 @@ struct Manager {
         Set *unit_path_cache;
         uint64_t unit_cache_timestamp_hash;
 
+        /* Listings of drop-in directories, see conf_files_list_strv_cached(). Flushed together with the
+         * unit path cache, so that each directory is read at most once per reload. */
+        Hashmap *dropin_dir_cache;
+
+        /* Unit files and drop-ins we read, keyed by path, see config-cache.h. During a reload, what we
+         * had read before is moved to config_cache_stale, and moved back when found unchanged. */
+        Hashmap *config_cache;
+        Hashmap *config_cache_stale;
+        /* Read from the unit snapshot on boot, only size and mtime of the files are known */
+        Hashmap *config_cache_snapshot;
+
+        /* Digest of the inputs of the generators as of their last run, if all of them declared their inputs,
+         * see generator_inputs_digest(). If unchanged on reload, the generators are not run again. */
+        uint8_t generator_inputs_digest[SHA256_DIGEST_SIZE];
+        bool generator_inputs_digest_valid;
+
+        /* Generators linked into PID 1, which are run in a forked child without executing the binary */
+        const ExecBuiltin *generator_builtins;
+
+        /* Names of the units on the critical chain of the previous boot, while booting, see critical-chain.h */
+        bool critical_chain_scheduling;
+        Set *critical_chain;
+
+        /* Ring buffer of events recorded while booting, see boot-trace.h */
+        bool boot_trace;
+        BootTraceEvent *boot_trace_events;
+        size_t boot_trace_head, n_boot_trace_events;
+
+        /* Unit states published for clients that don't want to go through the bus, see unit-state-table.h */
+        UnitStateTable *unit_state_table;
+
         char **transient_environment;  /* The environment, as determined from config files, kernel cmdline and environment generators */
         char **client_environment;     /* Environment variables created by clients through the bus API */
 
@@ -260,6 +302,11 @@ struct Manager {
         struct libmnt_monitor *mount_monitor;
         sd_event_source *mount_event_source;
 
+        /* The lines of /proc/self/mountinfo we looked at last, mapped to the names of their mount units, and
+         * libmount's utab at that time. Allows us to only process what changed. */
+        Hashmap *mountinfo_lines;
+        char *mountinfo_utab;
+
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
         sd_event_source *swap_event_source;
@@ -301,6 +348,15 @@ struct Manager {
         int cgroup_inotify_fd;
         sd_event_source *cgroup_inotify_event_source;
 
+        /* Units whose cgroup.events attribute couldn't be watched via inotify, because we ran out of
+         * watches. These are polled periodically instead. */
+        Set *cgroup_polled_units;
+        sd_event_source *cgroup_poll_event_source;
+
+        /* Number of units placed on each NUMA node by AutoNUMAPlacement=, indexed by node */
+        unsigned *numa_node_units;
+        size_t n_numa_node_units;
+
         /* Maps for finding the unit for each inotify watch descriptor for the cgroup.events and
          * memory.events cgroupv2 attributes. */
         Hashmap *cgroup_control_inotify_wd_unit;
@@ -389,6 +445,13 @@ struct Manager {
         unsigned n_installed_jobs;
         unsigned n_failed_jobs;
 
+        /* Unit change signals that were folded into a later one, or not sent to a lagging direct client */
+        uint64_t n_coalesced_change_signals;
+        uint64_t n_dropped_change_signals;
+
+        /* Last generation handed out to a unit, see Unit.dbus_generation */
+        uint64_t dbus_generation;
+
         /* Jobs in progress watching */
         unsigned n_running_jobs;
         unsigned n_on_console;
@@ -424,6 +487,9 @@ struct Manager {
         /* ExecRuntime, indexed by their owner unit id */
         Hashmap *exec_runtime_by_id;
 
+        /* Compiled SystemCallFilter= programs, indexed by seccomp_syscall_filter_key() */
+        Hashmap *seccomp_filters;
+
         /* When the user hits C-A-D more than 7 times per 2s, do something immediately... */
         RateLimit ctrl_alt_del_ratelimit;
         EmergencyAction cad_burst_action;
@@ -436,6 +502,9 @@ struct Manager {
 
         int first_boot; /* tri-state */
 
+        /* Whether PRIVATE_DEV_TEMPLATE is ready to be used by services, tri-state */
+        int private_dev_template;
+
         /* Prefixes of e.g. RuntimeDirectory= */
         char *prefix[_EXEC_DIRECTORY_TYPE_MAX];
         char *received_credentials_directory;
@@ -457,6 +526,10 @@ struct Manager {
 
         /* Reference to RestrictFileSystems= BPF program */
         struct restrict_fs_bpf *restrict_fs;
+
+        /* IPAddressAllow=/IPAddressDeny= BPF maps shared between units: canonical rules string =>
+         * BPFFirewallAccess object, see bpf-firewall.c */
+        Hashmap *bpf_firewall_access;
 };
 
 static inline usec_t manager_default_timeout_abort_usec(Manager *m) {
@@ -476,6 +549,11 @@ static inline usec_t manager_default_timeout_abort_usec(Manager *m) {
 
 #define MANAGER_IS_TEST_RUN(m) ((m)->test_run_flags != 0)
 
+/* Only the system manager proper shares its unit name map with others */
+#define manager_unit_name_map_cache_path(m)                             \
+        (MANAGER_IS_SYSTEM(m) && !MANAGER_IS_TEST_RUN(m) && !(m)->lookup_paths.root_dir ? \
+         UNIT_NAME_MAP_CACHE_PATH : NULL)
+
 int manager_new(LookupScope scope, ManagerTestRunFlags test_run_flags, Manager **m);
 Manager* manager_free(Manager *m);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Manager*, manager_free);
@@ -501,6 +579,7 @@ int manager_propagate_reload(Manager *m, Unit *unit, JobMode mode, sd_bus_error
 void manager_clear_jobs(Manager *m);
 
 void manager_unwatch_pid(Manager *m, pid_t pid);
+void manager_dispatch_child_exit(Manager *m, const siginfo_t *si, Unit *owner);
 
 unsigned manager_dispatch_load_queue(Manager *m);
 
@@ -11,7 +11,10 @@
 #include "dbus-mount.h"
 #include "dbus-unit.h"
 #include "device.h"
+#include "escape.h"
 #include "exit-status.h"
+#include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "fstab-util.h"
 #include "libmount-util.h"
@@ -851,6 +854,7 @@ static int mount_spawn(Mount *m, ExecCommand *c, pid_t *_pid) {
                 .stderr_fd = -1,
                 .exec_fd   = -1,
         };
+        int pidfd = -1;
         pid_t pid;
         int r;
 
@@ -876,11 +880,12 @@ static int mount_spawn(Mount *m, ExecCommand *c, pid_t *_pid) {
                        &exec_params,
                        m->exec_runtime,
                        &m->dynamic_creds,
-                       &pid);
+                       &pid,
+                       &pidfd);
         if (r < 0)
                 return r;
 
-        r = unit_watch_pid(UNIT(m), pid, true);
+        r = unit_watch_pidfd(UNIT(m), pid, pidfd);
         if (r < 0)
                 return r;
 
@@ -1767,16 +1772,12 @@ static int mount_setup_unit(
         return 0;
 }
 
-static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
-        _cleanup_(mnt_free_tablep) struct libmnt_table *table = NULL;
-        _cleanup_(mnt_free_iterp) struct libmnt_iter *iter = NULL;
+static int mount_setup_fs_table(Manager *m, struct libmnt_table *table, struct libmnt_iter *iter, Set *ids, bool set_flags) {
         int r;
 
         assert(m);
-
-        r = libmount_parse(NULL, NULL, &table, &iter);
-        if (r < 0)
-                return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
+        assert(table);
+        assert(iter);
 
         for (;;) {
                 struct libmnt_fs *fs;
@@ -1788,6 +1789,10 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
                 if (r < 0)
                         return log_error_errno(r, "Failed to get next entry from /proc/self/mountinfo: %m");
 
+                /* If a set of mount IDs is specified, only look at those */
+                if (ids && !set_contains(ids, INT_TO_PTR(mnt_fs_get_id(fs))))
+                        continue;
+
                 device = mnt_fs_get_source(fs);
                 path = mnt_fs_get_target(fs);
                 options = mnt_fs_get_options(fs);
@@ -1804,6 +1809,216 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
         return 0;
 }
 
+static int mountinfo_line_parse(const char *line, int *ret_id, char **ret_unit_name) {
+        _cleanup_free_ char *where = NULL;
+        const char *p = line, *e;
+        int id, r;
+
+        assert(line);
+        assert(ret_id);
+        assert(ret_unit_name);
+
+        /* Extracts the mount ID and the name of the mount unit from a line of /proc/self/mountinfo, i.e.
+         * the first and fifth field. The unit name is NULL if the mount point cannot be mapped to one. */
+
+        if (sscanf(line, "%i ", &id) != 1)
+                return -EBADMSG;
+
+        for (unsigned i = 0; i < 4; i++) {
+                p = strchr(p, ' ');
+                if (!p)
+                        return -EBADMSG;
+                p++;
+        }
+
+        e = strchrnul(p, ' ');
+
+        /* The kernel escapes whitespace and backslashes in octal */
+        r = cunescape_length(p, e - p, 0, &where);
+        if (r < 0)
+                return r;
+
+        *ret_id = id;
+        if (unit_name_from_path(where, ".mount", ret_unit_name) < 0)
+                *ret_unit_name = NULL;
+
+        return 0;
+}
+
+static bool mount_can_skip_unchanged(Manager *m, const char *name, bool set_flags) {
+        Unit *u;
+
+        assert(m);
+
+        /* Called for lines of /proc/self/mountinfo that didn't change since the last time we looked. If the
+         * corresponding unit is in the state that processing the line again would leave it in anyway, we
+         * only need to mark it as mounted, and can skip all the rest. Returns false if the line should be
+         * processed after all. */
+
+        if (!name)
+                return true;
+
+        u = manager_get_unit(m, name);
+        if (!u)
+                return true; /* API file systems and such, which we don't create units for */
+
+        if (!MOUNT(u)->from_proc_self_mountinfo ||
+            MOUNT(u)->state == MOUNT_MOUNTING ||
+            IN_SET(u->load_state, UNIT_NOT_FOUND, UNIT_BAD_SETTING, UNIT_ERROR))
+                return false;
+
+        if (set_flags)
+                MOUNT(u)->proc_flags |= MOUNT_PROC_IS_MOUNTED;
+
+        return true;
+}
+
+static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
+        _cleanup_hashmap_free_ Hashmap *lines = NULL;
+        _cleanup_set_free_ Set *added = NULL, *dirty = NULL, *ids = NULL;
+        _cleanup_(mnt_free_tablep) struct libmnt_table *table = NULL;
+        _cleanup_(mnt_free_iterp) struct libmnt_iter *iter = NULL;
+        _cleanup_free_ char *buf = NULL, *utab = NULL, *selected = NULL;
+        size_t size, selected_size = 0, n_selected = 0;
+        const char *name;
+        bool full;
+        int r;
+
+        assert(m);
+
+        /* On container hosts there might be tens of thousands of mounts, and they change all the time, hence
+         * we remember the lines of /proc/self/mountinfo we saw the last time, and only look again at the
+         * ones that were added, as well as all lines for mount points where something was added or
+         * removed. libmount merges the userspace mount options from utab into the kernel's entries, hence
+         * if that changed, process everything again. Same if we are enumerating, as the units might have
+         * been reloaded since the last time. */
+
+        r = read_full_file("/proc/self/mountinfo", &buf, &size);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read /proc/self/mountinfo: %m");
+
+        r = read_full_file("/run/mount/utab", &utab, NULL);
+        if (r < 0 && r != -ENOENT)
+                log_debug_errno(r, "Failed to read /run/mount/utab, ignoring: %m");
+
+        full = !set_flags || !m->mountinfo_lines || !streq_ptr(utab, m->mountinfo_utab);
+
+        lines = hashmap_new(&fast_string_hash_ops_free_free);
+        if (!lines)
+                return log_oom();
+
+        for (char *p = buf, *e; p < buf + size; p = e + 1) {
+                _cleanup_free_ char *l = NULL, *n = NULL;
+                int id;
+
+                e = strchrnul(p, '\n');
+                *e = 0;
+                if (isempty(p))
+                        continue;
+
+                if (!full)
+                        n = hashmap_remove2(m->mountinfo_lines, p, (void**) &l);
+                if (l) {
+                        /* Unchanged since last time */
+                        r = hashmap_put(lines, l, n);
+                        if (r < 0)
+                                return log_oom();
+
+                        TAKE_PTR(l);
+                        TAKE_PTR(n);
+                        continue;
+                }
+
+                r = mountinfo_line_parse(p, &id, &n);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to parse line of /proc/self/mountinfo, ignoring: %s", p);
+                        continue;
+                }
+
+                l = strdup(p);
+                if (!l)
+                        return log_oom();
+
+                r = hashmap_put(lines, l, n);
+                if (r < 0)
+                        return log_oom();
+
+                /* Remember the lines that are new, and the units they affect. The hashmap owns them now. */
+                if (set_ensure_put(&added, NULL, l) < 0)
+                        return log_oom();
+
+                if (n && set_ensure_put(&dirty, &string_hash_ops, n) < 0)
+                        return log_oom();
+
+                TAKE_PTR(l);
+                TAKE_PTR(n);
+        }
+
+        /* Whatever is left over are the lines that are gone. Processing all remaining lines for the same
+         * mount points is necessary in case mounts were stacked on top of each other. */
+        HASHMAP_FOREACH(name, m->mountinfo_lines)
+                if (name && set_ensure_put(&dirty, &string_hash_ops, name) < 0)
+                        return log_oom();
+
+        if (!full) {
+                /* Now go through all lines again in the original order, and pick the ones to process */
+                for (char *p = buf; p < buf + size; p += strlen(p) + 1) {
+                        void *l = NULL;
+                        int id;
+
+                        name = hashmap_get2(lines, p, &l);
+                        if (!l) /* unparsable */
+                                continue;
+
+                        if (!set_contains(added, l) &&
+                            !(name && set_contains(dirty, name)) &&
+                            mount_can_skip_unchanged(m, name, set_flags))
+                                continue;
+
+                        if (!GREEDY_REALLOC(selected, selected_size + strlen(p) + 2))
+                                return log_oom();
+
+                        selected_size = stpcpy(stpcpy(selected + selected_size, p), "\n") - selected;
+                        n_selected++;
+
+                        if (!isempty(utab) && sscanf(p, "%i", &id) == 1 &&
+                            set_ensure_put(&ids, NULL, INT_TO_PTR(id)) < 0)
+                                return log_oom();
+                }
+
+                log_debug("Processing %zu of %u lines of /proc/self/mountinfo.", n_selected, hashmap_size(lines));
+        }
+
+        if (full || (n_selected > 0 && !isempty(utab))) {
+                /* Let libmount parse everything, so that utab is taken into account */
+                r = libmount_parse(NULL, NULL, &table, &iter);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
+        } else if (n_selected > 0) {
+                _cleanup_fclose_ FILE *f = NULL;
+
+                f = fmemopen_unlocked(selected, selected_size, "r");
+                if (!f)
+                        return log_oom();
+
+                r = libmount_parse("/proc/self/mountinfo", f, &table, &iter);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
+        }
+
+        if (table) {
+                r = mount_setup_fs_table(m, table, iter, full ? NULL : ids, set_flags);
+                if (r < 0)
+                        return r;
+        }
+
+        hashmap_free(m->mountinfo_lines);
+        m->mountinfo_lines = TAKE_PTR(lines);
+        free_and_replace(m->mountinfo_utab, utab);
+
+        return 0;
+}
+
 static void mount_shutdown(Manager *m) {
         assert(m);
 
@@ -1811,6 +2026,9 @@ static void mount_shutdown(Manager *m) {
 
         mnt_unref_monitor(m->mount_monitor);
         m->mount_monitor = NULL;
+
+        m->mountinfo_lines = hashmap_free(m->mountinfo_lines);
+        m->mountinfo_utab = mfree(m->mountinfo_utab);
 }
 
 static int mount_get_timeout(Unit *u, usec_t *timeout) {
@@ -1998,6 +2216,9 @@ static int mount_process_proc_self_mountinfo(Manager *m) {
                 LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT])
                         MOUNT(u)->proc_flags = 0;
 
+                /* And process everything next time, as we don't know how far we got */
+                m->mountinfo_lines = hashmap_free(m->mountinfo_lines);
+
                 return 0;
         }
 
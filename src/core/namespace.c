@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <sys/file.h>
 #include <sys/mount.h>
+#include <sys/statvfs.h>
 #include <unistd.h>
 #include <linux/fs.h>
 
@@ -903,7 +904,7 @@ add_symlink:
         return 0;
 }
 
-static int mount_private_dev(MountEntry *m) {
+static int populate_private_dev(const char *temporary_mount) {
         static const char devnodes[] =
                 "/dev/null\0"
                 "/dev/zero\0"
@@ -912,21 +913,83 @@ static int mount_private_dev(MountEntry *m) {
                 "/dev/urandom\0"
                 "/dev/tty\0";
 
-        char temporary_mount[] = "/tmp/namespace-dev-XXXXXX";
-        const char *d, *dev = NULL, *devpts = NULL, *devshm = NULL, *devhugepages = NULL, *devmqueue = NULL, *devlog = NULL, *devptmx = NULL;
+        const char *d, *devptmx, *devlog;
         bool can_mknod = true;
         int r;
 
-        assert(m);
+        assert(temporary_mount);
 
-        if (!mkdtemp(temporary_mount))
-                return log_debug_errno(errno, "Failed to create temporary directory '%s': %m", temporary_mount);
+        /* Fills the empty tmpfs mounted at <temporary_mount>/dev with the device nodes and symlinks of a
+         * minimal /dev. The API file systems below it are bind mounted separately. */
+
+        FOREACH_STRING(d, "pts", "shm", "mqueue", "hugepages")
+                (void) mkdir(strjoina(temporary_mount, "/dev/", d), 0755);
+
+        /* /dev/ptmx can either be a device node or a symlink to /dev/pts/ptmx.
+         * When /dev/ptmx a device node, /dev/pts/ptmx has 000 permissions making it inaccessible.
+         * Thus, in that case make a clone.
+         * In nspawn and other containers it will be a symlink, in that case make it a symlink. */
+        r = is_symlink("/dev/ptmx");
+        if (r < 0)
+                return log_debug_errno(r, "Failed to detect whether /dev/ptmx is a symlink or not: %m");
+        if (r > 0) {
+                devptmx = strjoina(temporary_mount, "/dev/ptmx");
+                if (symlink("pts/ptmx", devptmx) < 0)
+                        return log_debug_errno(errno, "Failed to create a symlink '%s' to pts/ptmx: %m", devptmx);
+        } else {
+                r = clone_device_node("/dev/ptmx", temporary_mount, &can_mknod);
+                if (r < 0)
+                        return r;
+        }
+
+        devlog = strjoina(temporary_mount, "/dev/log");
+        if (symlink("/run/systemd/journal/dev-log", devlog) < 0)
+                log_debug_errno(errno, "Failed to create a symlink '%s' to /run/systemd/journal/dev-log, ignoring: %m", devlog);
+
+        NULSTR_FOREACH(d, devnodes) {
+                r = clone_device_node(d, temporary_mount, &can_mknod);
+                /* ENXIO means the *source* is not a device file, skip creation in that case */
+                if (r < 0 && r != -ENXIO)
+                        return r;
+        }
+
+        r = dev_setup(temporary_mount, UID_INVALID, GID_INVALID);
+        if (r < 0)
+                log_debug_errno(r, "Failed to set up basic device tree at '%s', ignoring: %m", temporary_mount);
+
+        return 0;
+}
+
+int setup_private_dev_template(void) {
+        const char *dev = PRIVATE_DEV_TEMPLATE "/dev";
+        struct statvfs sv;
+        int r;
+
+        /* Builds the contents of a private /dev once, in the manager's own namespace, so that services with
+         * PrivateDevices= merely have to bind mount it instead of creating and populating a tmpfs each. The
+         * tmpfs is made read-only on the superblock level, hence services can't alter what they share.
+         * Returns 1 if the template was created, 0 if the one left by a previous manager instance is
+         * reused. */
+
+        r = path_is_mount_point(dev, NULL, 0);
+        if (r > 0) {
+                if (statvfs(dev, &sv) >= 0 && FLAGS_SET(sv.f_flag, ST_RDONLY))
+                        return 0;
+
+                /* Not sealed, i.e. we were interrupted while populating it. Start from scratch. */
+                r = umount_recursive(dev, 0);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to unmount stale '%s': %m", dev);
+        } else if (r < 0 && r != -ENOENT)
+                return log_debug_errno(r, "Failed to determine whether '%s' is a mount point: %m", dev);
+
+        r = mkdir_p(dev, 0755);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to create '%s': %m", dev);
 
-        dev = strjoina(temporary_mount, "/dev");
-        (void) mkdir(dev, 0755);
         r = mount_nofollow_verbose(LOG_DEBUG, "tmpfs", dev, "tmpfs", DEV_MOUNT_OPTIONS, "mode=755" TMPFS_LIMITS_DEV);
         if (r < 0)
-                goto fail;
+                return r;
 
         r = label_fix_full(AT_FDCWD, dev, "/dev", 0);
         if (r < 0) {
@@ -934,61 +997,74 @@ static int mount_private_dev(MountEntry *m) {
                 goto fail;
         }
 
-        devpts = strjoina(temporary_mount, "/dev/pts");
-        (void) mkdir(devpts, 0755);
-        r = mount_nofollow_verbose(LOG_DEBUG, "/dev/pts", devpts, NULL, MS_BIND, NULL);
+        r = populate_private_dev(PRIVATE_DEV_TEMPLATE);
         if (r < 0)
                 goto fail;
 
-        /* /dev/ptmx can either be a device node or a symlink to /dev/pts/ptmx.
-         * When /dev/ptmx a device node, /dev/pts/ptmx has 000 permissions making it inaccessible.
-         * Thus, in that case make a clone.
-         * In nspawn and other containers it will be a symlink, in that case make it a symlink. */
-        r = is_symlink("/dev/ptmx");
-        if (r < 0) {
-                log_debug_errno(r, "Failed to detect whether /dev/ptmx is a symlink or not: %m");
+        r = mount_nofollow_verbose(LOG_DEBUG, NULL, dev, NULL, MS_REMOUNT|MS_RDONLY|DEV_MOUNT_OPTIONS, "mode=755" TMPFS_LIMITS_DEV);
+        if (r < 0)
                 goto fail;
-        } else if (r > 0) {
-                devptmx = strjoina(temporary_mount, "/dev/ptmx");
-                if (symlink("pts/ptmx", devptmx) < 0) {
-                        r = log_debug_errno(errno, "Failed to create a symlink '%s' to pts/ptmx: %m", devptmx);
+
+        return 1;
+
+fail:
+        (void) umount_recursive(dev, 0);
+        return r;
+}
+
+static int mount_private_dev(MountEntry *m, bool use_template) {
+        char temporary_mount[] = "/tmp/namespace-dev-XXXXXX";
+        const char *dev = NULL, *devpts = NULL, *devshm = NULL, *devhugepages = NULL, *devmqueue = NULL;
+        int r;
+
+        assert(m);
+
+        if (!mkdtemp(temporary_mount))
+                return log_debug_errno(errno, "Failed to create temporary directory '%s': %m", temporary_mount);
+
+        dev = strjoina(temporary_mount, "/dev");
+        (void) mkdir(dev, 0755);
+
+        /* The template comes with all device nodes already in place. It is unlikely to go away under us,
+         * but if it does, simply build the tree ourselves. */
+        if (use_template) {
+                r = mount_nofollow_verbose(LOG_DEBUG, PRIVATE_DEV_TEMPLATE "/dev", dev, NULL, MS_BIND|MS_REC, NULL);
+                if (r < 0)
+                        use_template = false;
+        }
+
+        if (!use_template) {
+                r = mount_nofollow_verbose(LOG_DEBUG, "tmpfs", dev, "tmpfs", DEV_MOUNT_OPTIONS, "mode=755" TMPFS_LIMITS_DEV);
+                if (r < 0)
+                        goto fail;
+
+                r = label_fix_full(AT_FDCWD, dev, "/dev", 0);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to fix label of '%s' as /dev: %m", dev);
                         goto fail;
                 }
-        } else {
-                r = clone_device_node("/dev/ptmx", temporary_mount, &can_mknod);
+
+                r = populate_private_dev(temporary_mount);
                 if (r < 0)
                         goto fail;
         }
 
+        devpts = strjoina(temporary_mount, "/dev/pts");
+        r = mount_nofollow_verbose(LOG_DEBUG, "/dev/pts", devpts, NULL, MS_BIND, NULL);
+        if (r < 0)
+                goto fail;
+
         devshm = strjoina(temporary_mount, "/dev/shm");
-        (void) mkdir(devshm, 0755);
         r = mount_nofollow_verbose(LOG_DEBUG, "/dev/shm", devshm, NULL, MS_BIND, NULL);
         if (r < 0)
                 goto fail;
 
         devmqueue = strjoina(temporary_mount, "/dev/mqueue");
-        (void) mkdir(devmqueue, 0755);
         (void) mount_nofollow_verbose(LOG_DEBUG, "/dev/mqueue", devmqueue, NULL, MS_BIND, NULL);
 
         devhugepages = strjoina(temporary_mount, "/dev/hugepages");
-        (void) mkdir(devhugepages, 0755);
         (void) mount_nofollow_verbose(LOG_DEBUG, "/dev/hugepages", devhugepages, NULL, MS_BIND, NULL);
 
-        devlog = strjoina(temporary_mount, "/dev/log");
-        if (symlink("/run/systemd/journal/dev-log", devlog) < 0)
-                log_debug_errno(errno, "Failed to create a symlink '%s' to /run/systemd/journal/dev-log, ignoring: %m", devlog);
-
-        NULSTR_FOREACH(d, devnodes) {
-                r = clone_device_node(d, temporary_mount, &can_mknod);
-                /* ENXIO means the *source* is not a device file, skip creation in that case */
-                if (r < 0 && r != -ENXIO)
-                        goto fail;
-        }
-
-        r = dev_setup(temporary_mount, UID_INVALID, GID_INVALID);
-        if (r < 0)
-                log_debug_errno(r, "Failed to set up basic device tree at '%s', ignoring: %m", temporary_mount);
-
         /* Create the /dev directory if missing. It is more likely to be missing when the service is started
          * with RootDirectory. This is consistent with mount units creating the mount points when missing. */
         (void) mkdir_p_label(mount_entry_path(m), 0755);
@@ -1020,7 +1096,7 @@ fail:
         if (devmqueue)
                 (void) umount_verbose(LOG_DEBUG, devmqueue, UMOUNT_NOFOLLOW);
 
-        (void) umount_verbose(LOG_DEBUG, dev, UMOUNT_NOFOLLOW);
+        (void) umount_recursive(dev, 0);
         (void) rmdir(dev);
         (void) rmdir(temporary_mount);
 
@@ -1441,7 +1517,7 @@ static int apply_one_mount(
                 break;
 
         case PRIVATE_DEV:
-                return mount_private_dev(m);
+                return mount_private_dev(m, ns_info->private_dev_template);
 
         case BIND_DEV:
                 return mount_bind_dev(m);
@@ -66,6 +66,7 @@ typedef enum ProcSubset {
 struct NamespaceInfo {
         bool ignore_protect_paths;
         bool private_dev;
+        bool private_dev_template;
         bool private_mounts;
         bool protect_control_groups;
         bool protect_kernel_tunables;
@@ -151,6 +152,11 @@ int setup_namespace(
 
 #define RUN_SYSTEMD_EMPTY "/run/systemd/empty"
 
+/* A pre-populated, read-only /dev for PrivateDevices=, set up by the system manager */
+#define PRIVATE_DEV_TEMPLATE "/run/systemd/private-dev"
+
+int setup_private_dev_template(void);
+
 static inline char* namespace_cleanup_tmpdir(char *p) {
         PROTECT_ERRNO;
         if (!streq_ptr(p, RUN_SYSTEMD_EMPTY))
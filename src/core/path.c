@@ -1,7 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <errno.h>
-#include <sys/epoll.h>
 #include <sys/inotify.h>
 #include <unistd.h>
 
@@ -10,9 +9,7 @@
 #include "dbus-path.h"
 #include "dbus-unit.h"
 #include "escape.h"
-#include "fd-util.h"
 #include "glob-util.h"
-#include "inotify-util.h"
 #include "macro.h"
 #include "mkdir-label.h"
 #include "path.h"
@@ -32,9 +29,39 @@ static const UnitActiveState state_translation_table[_PATH_STATE_MAX] = {
         [PATH_FAILED] = UNIT_FAILED,
 };
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static int path_dispatch_inotify(sd_event_source *source, const struct inotify_event *event, void *userdata);
 
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
+static int path_spec_add_watch(
+                PathSpec *s,
+                uint32_t mask,
+                sd_event_inotify_handler_t handler,
+                sd_event_source **ret) {
+
+        _cleanup_(sd_event_source_unrefp) sd_event_source *source = NULL;
+        int r;
+
+        assert(s);
+        assert(handler);
+
+        if (!GREEDY_REALLOC(s->event_sources, s->n_event_sources + 1))
+                return -ENOMEM;
+
+        /* sd-event coalesces watches on the same inode, and uses a single inotify instance for all of them,
+         * hence this neither costs an fd per watch nor a watch per unit watching the same inode. */
+        r = sd_event_add_inotify(s->unit->manager->event, &source, s->path, mask, handler, s);
+        if (r < 0)
+                return r;
+
+        s->event_sources[s->n_event_sources++] = source;
+
+        if (ret)
+                *ret = source;
+
+        TAKE_PTR(source);
+        return 0;
+}
+
+int path_spec_watch(PathSpec *s, sd_event_inotify_handler_t handler) {
         static const int flags_table[_PATH_TYPE_MAX] = {
                 [PATH_EXISTS]              = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
                 [PATH_EXISTS_GLOB]         = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
@@ -53,26 +80,13 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
 
         path_spec_unwatch(s);
 
-        s->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
-        if (s->inotify_fd < 0) {
-                r = log_error_errno(errno, "Failed to allocate inotify fd: %m");
-                goto fail;
-        }
-
-        r = sd_event_add_io(s->unit->manager->event, &s->event_source, s->inotify_fd, EPOLLIN, handler, s);
-        if (r < 0) {
-                log_error_errno(r, "Failed to add inotify fd to event loop: %m");
-                goto fail;
-        }
-
-        (void) sd_event_source_set_description(s->event_source, "path");
-
         /* This function assumes the path was passed through path_simplify()! */
         assert(!strstr(s->path, "//"));
 
         for (slash = strchr(s->path, '/'); ; slash = strchr(slash+1, '/')) {
+                sd_event_source *source = NULL;
                 bool incomplete = false;
-                int flags, wd = -1;
+                int flags;
                 char tmp, *cut;
 
                 if (slash) {
@@ -94,27 +108,23 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
 
                         SET_FLAG(f, IN_DONT_FOLLOW, !follow_symlink);
 
-                        wd = inotify_add_watch(s->inotify_fd, s->path, f);
-                        if (wd < 0) {
-                                if (IN_SET(errno, EACCES, ENOENT)) {
-                                        incomplete = true; /* This is an expected error, let's accept this
-                                                            * quietly: we have an incomplete watch for
-                                                            * now. */
-                                        break;
-                                }
-
-                                /* This second call to inotify_add_watch() should fail like the previous one
-                                 * and is done for logging the error in a comprehensive way. */
-                                wd = inotify_add_watch_and_warn(s->inotify_fd, s->path, f);
-                                if (wd < 0) {
-                                        if (cut)
-                                                *cut = tmp;
+                        r = path_spec_add_watch(s, f, handler, &source);
+                        if (IN_SET(r, -EACCES, -ENOENT)) {
+                                incomplete = true; /* This is an expected error, let's accept this
+                                                    * quietly: we have an incomplete watch for
+                                                    * now. */
+                                break;
+                        }
+                        if (r < 0) {
+                                if (r == -ENOSPC)
+                                        log_error_errno(r, "Failed to add a watch for %s: inotify watch limit reached", s->path);
+                                else
+                                        log_error_errno(r, "Failed to add a watch for %s: %m", s->path);
 
-                                        r = wd;
-                                        goto fail;
-                                }
+                                if (cut)
+                                        *cut = tmp;
 
-                                /* Hmm, we succeeded in adding the watch this time... let's continue. */
+                                goto fail;
                         }
                 }
 
@@ -133,7 +143,7 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                         char tmp2 = *cut2;
                         *cut2 = '\0';
 
-                        (void) inotify_add_watch(s->inotify_fd, s->path, IN_MOVE_SELF);
+                        (void) path_spec_add_watch(s, IN_MOVE_SELF, handler, NULL);
                         /* Error is ignored, the worst can happen is we get spurious events. */
 
                         *cut2 = tmp2;
@@ -146,13 +156,13 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                         oldslash = slash;
                 else {
                         /* whole path has been iterated over */
-                        s->primary_wd = wd;
+                        s->primary_event_source = source;
                         break;
                 }
         }
 
         if (!exists) {
-                r = log_error_errno(errno, "Failed to add watch on any of the components of %s: %m", s->path);
+                r = log_error_errno(r, "Failed to add watch on any of the components of %s: %m", s->path);
                 /* either EACCESS or ENOENT */
                 goto fail;
         }
@@ -167,34 +177,33 @@ fail:
 void path_spec_unwatch(PathSpec *s) {
         assert(s);
 
-        s->event_source = sd_event_source_disable_unref(s->event_source);
-        s->inotify_fd = safe_close(s->inotify_fd);
-}
+        for (size_t i = 0; i < s->n_event_sources; i++)
+                sd_event_source_disable_unref(s->event_sources[i]);
 
-int path_spec_fd_event(PathSpec *s, uint32_t revents) {
-        union inotify_event_buffer buffer;
-        ssize_t l;
+        s->event_sources = mfree(s->event_sources);
+        s->n_event_sources = 0;
+        s->primary_event_source = NULL;
+}
 
+bool path_spec_owns_event_source(PathSpec *s, sd_event_source *source) {
         assert(s);
 
-        if (revents != EPOLLIN)
-                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
-                                       "Got invalid poll event on inotify.");
-
-        l = read(s->inotify_fd, &buffer, sizeof(buffer));
-        if (l < 0) {
-                if (ERRNO_IS_TRANSIENT(errno))
-                        return 0;
+        for (size_t i = 0; i < s->n_event_sources; i++)
+                if (s->event_sources[i] == source)
+                        return true;
 
-                return log_error_errno(errno, "Failed to read inotify event: %m");
-        }
+        return false;
+}
 
-        if (IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED))
-                FOREACH_INOTIFY_EVENT_WARN(e, buffer, l)
-                        if (s->primary_wd == e->wd)
-                                return 1;
+bool path_spec_event_is_change(PathSpec *s, sd_event_source *source, const struct inotify_event *event) {
+        assert(s);
+        assert(event);
 
-        return 0;
+        /* Only changes of the watched inode itself count, events on the parent directories are just a
+         * reason to check whether the path appeared. */
+        return IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED) &&
+                source == s->primary_event_source &&
+                !FLAGS_SET(event->mask, IN_Q_OVERFLOW);
 }
 
 static bool path_spec_check_good(PathSpec *s, bool initial, bool from_trigger_notify) {
@@ -252,7 +261,7 @@ static void path_spec_dump(PathSpec *s, FILE *f, const char *prefix) {
 
 void path_spec_done(PathSpec *s) {
         assert(s);
-        assert(s->inotify_fd == -1);
+        assert(s->n_event_sources == 0);
 
         free(s->path);
 }
@@ -288,6 +297,7 @@ static void path_done(Unit *u) {
         assert(p);
 
         path_free_specs(p);
+        p->coalesce_event_source = sd_event_source_disable_unref(p->coalesce_event_source);
 }
 
 static int path_add_mount_dependencies(Path *p) {
@@ -430,6 +440,9 @@ static void path_unwatch(Path *p) {
 
         LIST_FOREACH(spec, s, p->specs)
                 path_spec_unwatch(s);
+
+        (void) sd_event_source_set_enabled(p->coalesce_event_source, SD_EVENT_OFF);
+        p->changed = false;
 }
 
 static int path_watch(Path *p) {
@@ -438,7 +451,7 @@ static int path_watch(Path *p) {
         assert(p);
 
         LIST_FOREACH(spec, s, p->specs) {
-                r = path_spec_watch(s, path_dispatch_io);
+                r = path_spec_watch(s, path_dispatch_inotify);
                 if (r < 0)
                         return r;
         }
@@ -729,44 +742,64 @@ _pure_ static const char *path_sub_state_to_string(Unit *u) {
         return path_state_to_string(PATH(u)->state);
 }
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        PathSpec *s = userdata, *found = NULL;
-        Path *p;
-        int changed;
+static int path_dispatch_coalesced(sd_event_source *source, void *userdata) {
+        Path *p = PATH(userdata);
+        bool changed;
 
-        assert(s);
-        assert(s->unit);
-        assert(fd >= 0);
+        assert(p);
 
-        p = PATH(s->unit);
+        changed = p->changed;
+        p->changed = false;
 
         if (!IN_SET(p->state, PATH_WAITING, PATH_RUNNING))
                 return 0;
 
-        LIST_FOREACH(spec, i, p->specs)
-                if (path_spec_owns_inotify_fd(i, fd)) {
-                        found = i;
-                        break;
-                }
-
-        if (!found) {
-                log_error("Got event on unknown fd.");
-                goto fail;
-        }
-
-        changed = path_spec_fd_event(found, revents);
-        if (changed < 0)
-                goto fail;
-
         if (changed)
                 path_enter_running(p);
         else
                 path_enter_waiting(p, false, false);
 
         return 0;
+}
+
+static int path_dispatch_inotify(sd_event_source *source, const struct inotify_event *event, void *userdata) {
+        PathSpec *s = userdata;
+        Path *p;
+        int r;
+
+        assert(s);
+        assert(s->unit);
+        assert(event);
+
+        p = PATH(s->unit);
+
+        if (!IN_SET(p->state, PATH_WAITING, PATH_RUNNING))
+                return 0;
+
+        if (path_spec_event_is_change(s, source, event))
+                p->changed = true;
+
+        /* A single change of a file often results in a burst of events, possibly on several watched inodes,
+         * and each of them is dispatched separately. Hence act on them only once all queued events are
+         * processed, so that we check the paths and rebuild the watches once per burst rather than once per
+         * event. The inotify event sources run at normal priority, which is why this runs just below. */
+        if (p->coalesce_event_source)
+                r = sd_event_source_set_enabled(p->coalesce_event_source, SD_EVENT_ONESHOT);
+        else {
+                r = sd_event_add_defer(UNIT(p)->manager->event, &p->coalesce_event_source, path_dispatch_coalesced, p);
+                if (r >= 0) {
+                        r = sd_event_source_set_priority(p->coalesce_event_source, SD_EVENT_PRIORITY_NORMAL + 1);
+                        if (r >= 0)
+                                r = sd_event_source_set_enabled(p->coalesce_event_source, SD_EVENT_ONESHOT);
+
+                        (void) sd_event_source_set_description(p->coalesce_event_source, "path-coalesce");
+                }
+        }
+        if (r < 0) {
+                log_unit_error_errno(UNIT(p), r, "Failed to schedule processing of inotify events: %m");
+                path_enter_dead(p, PATH_FAILURE_RESOURCES);
+        }
 
-fail:
-        path_enter_dead(p, PATH_FAILURE_RESOURCES);
         return 0;
 }
 
@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 #pragma once
 
+#include <sys/inotify.h>
+
 typedef struct Path Path;
 typedef struct PathSpec PathSpec;
 
@@ -21,26 +23,24 @@ typedef struct PathSpec {
 
         char *path;
 
-        sd_event_source *event_source;
+        /* One inotify event source for each watched inode, i.e. the path and its parents */
+        sd_event_source **event_sources;
+        size_t n_event_sources;
+        sd_event_source *primary_event_source;
 
         LIST_FIELDS(struct PathSpec, spec);
 
         PathType type;
-        int inotify_fd;
-        int primary_wd;
 
         bool previous_exists;
 } PathSpec;
 
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler);
+int path_spec_watch(PathSpec *s, sd_event_inotify_handler_t handler);
 void path_spec_unwatch(PathSpec *s);
-int path_spec_fd_event(PathSpec *s, uint32_t events);
+bool path_spec_owns_event_source(PathSpec *s, sd_event_source *source);
+bool path_spec_event_is_change(PathSpec *s, sd_event_source *source, const struct inotify_event *event);
 void path_spec_done(PathSpec *s);
 
-static inline bool path_spec_owns_inotify_fd(PathSpec *s, int fd) {
-        return s->inotify_fd == fd;
-}
-
 typedef enum PathResult {
         PATH_SUCCESS,
         PATH_FAILURE_RESOURCES,
@@ -64,6 +64,10 @@ struct Path {
         PathResult result;
 
         RateLimit trigger_limit;
+
+        /* Processes the inotify events of all specs in one go, see path_dispatch_inotify() */
+        sd_event_source *coalesce_event_source;
+        bool changed;
 };
 
 void path_free_specs(Path *p);
@@ -91,7 +91,7 @@ static const UnitActiveState state_translation_table_idle[_SERVICE_STATE_MAX] =
         [SERVICE_CLEANING] = UNIT_MAINTENANCE,
 };
 
-static int service_dispatch_inotify_io(sd_event_source *source, int fd, uint32_t events, void *userdata);
+static int service_dispatch_inotify_io(sd_event_source *source, const struct inotify_event *event, void *userdata);
 static int service_dispatch_timer(sd_event_source *source, usec_t usec, void *userdata);
 static int service_dispatch_watchdog(sd_event_source *source, usec_t usec, void *userdata);
 static int service_dispatch_exec_io(sd_event_source *source, int fd, uint32_t events, void *userdata);
@@ -1493,6 +1493,7 @@ static int service_spawn_internal(
         _cleanup_(sd_event_source_unrefp) sd_event_source *exec_fd_source = NULL;
         _cleanup_strv_free_ char **final_env = NULL, **our_env = NULL;
         size_t n_env = 0;
+        int pidfd = -1;
         pid_t pid;
         int r;
 
@@ -1668,14 +1669,15 @@ static int service_spawn_internal(
                        &exec_params,
                        s->exec_runtime,
                        &s->dynamic_creds,
-                       &pid);
+                       &pid,
+                       &pidfd);
         if (r < 0)
                 return r;
 
         s->exec_fd_event_source = TAKE_PTR(exec_fd_source);
         s->exec_fd_hot = false;
 
-        r = unit_watch_pid(UNIT(s), pid, true);
+        r = unit_watch_pidfd(UNIT(s), pid, pidfd);
         if (r < 0)
                 return r;
 
@@ -3233,14 +3235,13 @@ static int service_demand_pid_file(Service *s) {
         /* PATH_CHANGED would not be enough. There are daemons (sendmail) that
          * keep their PID file open all the time. */
         ps->type = PATH_MODIFIED;
-        ps->inotify_fd = -1;
 
         s->pid_file_pathspec = ps;
 
         return service_watch_pid_file(s);
 }
 
-static int service_dispatch_inotify_io(sd_event_source *source, int fd, uint32_t events, void *userdata) {
+static int service_dispatch_inotify_io(sd_event_source *source, const struct inotify_event *event, void *userdata) {
         PathSpec *p = userdata;
         Service *s;
 
@@ -3249,16 +3250,12 @@ static int service_dispatch_inotify_io(sd_event_source *source, int fd, uint32_t
         s = SERVICE(p->unit);
 
         assert(s);
-        assert(fd >= 0);
         assert(IN_SET(s->state, SERVICE_START, SERVICE_START_POST));
         assert(s->pid_file_pathspec);
-        assert(path_spec_owns_inotify_fd(s->pid_file_pathspec, fd));
+        assert(path_spec_owns_event_source(s->pid_file_pathspec, source));
 
         log_unit_debug(UNIT(s), "inotify event");
 
-        if (path_spec_fd_event(p, events) < 0)
-                goto fail;
-
         if (service_retry_pid_file(s) == 0)
                 return 0;
 
@@ -4139,6 +4136,7 @@ static void service_notify_message(
 
                 if (streq(*i, "READY=1")) {
                         s->notify_state = NOTIFY_READY;
+                        unit_boot_trace(u, BOOT_TRACE_READY, USEC_INFINITY);
 
                         /* Type=notify services inform us about completed
                          * initialization with READY=1 */
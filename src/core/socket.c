@@ -47,6 +47,9 @@
 #include "unit.h"
 #include "user-util.h"
 
+/* The maximum number of pending connections we accept() per wakeup of a listening socket */
+#define SOCKET_ACCEPT_BATCH_MAX 16
+
 struct SocketPeer {
         unsigned n_ref;
 
@@ -1924,6 +1927,7 @@ static int socket_spawn(Socket *s, ExecCommand *c, pid_t *_pid) {
                 .stderr_fd = -1,
                 .exec_fd   = -1,
         };
+        int pidfd = -1;
         pid_t pid;
         int r;
 
@@ -1949,11 +1953,12 @@ static int socket_spawn(Socket *s, ExecCommand *c, pid_t *_pid) {
                        &exec_params,
                        s->exec_runtime,
                        &s->dynamic_creds,
-                       &pid);
+                       &pid,
+                       &pidfd);
         if (r < 0)
                 return r;
 
-        r = unit_watch_pid(UNIT(s), pid, true);
+        r = unit_watch_pidfd(UNIT(s), pid, pidfd);
         if (r < 0)
                 return r;
 
@@ -2899,17 +2904,23 @@ static int socket_accept_do(Socket *s, int fd) {
         return cfd;
 }
 
-static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd) {
+static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd, int *ret_fds, size_t n_max) {
         _cleanup_close_pair_ int pair[2] = { -1, -1 };
-        int cfd, r;
+        size_t n = 0;
+        int cfd = -1, r;
         pid_t pid;
 
         assert(s);
         assert(p);
         assert(fd >= 0);
+        assert(ret_fds);
+        assert(n_max > 0);
 
         /* Similar to socket_address_listen_in_cgroup(), but for accept() rather than socket(): make sure that any
-         * connection socket is also properly associated with the cgroup. */
+         * connection socket is also properly associated with the cgroup.
+         *
+         * Accepts up to n_max pending connections in one go, so that under load we don't have to fork off a
+         * helper process for each of them. Returns the number of connection sockets stored in ret_fds. */
 
         if (!IN_SET(p->address.sockaddr.sa.sa_family, AF_INET, AF_INET6))
                 goto shortcut;
@@ -2931,55 +2942,80 @@ static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd) {
 
                 pair[0] = safe_close(pair[0]);
 
-                cfd = socket_accept_do(s, fd);
-                if (cfd == -EAGAIN) /* spurious accept() */
-                        _exit(EXIT_SUCCESS);
-                if (cfd < 0) {
-                        log_unit_error_errno(UNIT(s), cfd, "Failed to accept connection socket: %m");
-                        _exit(EXIT_FAILURE);
-                }
+                for (; n < n_max; n++) {
+                        cfd = socket_accept_do(s, fd);
+                        if (cfd == -EAGAIN) /* spurious accept(), or no more pending connections */
+                                break;
+                        if (cfd < 0) {
+                                if (n > 0) /* Pass on what we got so far */
+                                        break;
 
-                r = send_one_fd(pair[1], cfd, 0);
-                if (r < 0) {
-                        log_unit_error_errno(UNIT(s), r, "Failed to send connection socket to parent: %m");
-                        _exit(EXIT_FAILURE);
+                                log_unit_error_errno(UNIT(s), cfd, "Failed to accept connection socket: %m");
+                                _exit(EXIT_FAILURE);
+                        }
+
+                        r = send_one_fd(pair[1], cfd, 0);
+                        if (r < 0) {
+                                log_unit_error_errno(UNIT(s), r, "Failed to send connection socket to parent: %m");
+                                _exit(EXIT_FAILURE);
+                        }
+
+                        safe_close(cfd);
                 }
 
                 _exit(EXIT_SUCCESS);
         }
 
         pair[1] = safe_close(pair[1]);
-        cfd = receive_one_fd(pair[0], 0);
+
+        for (; n < n_max; n++) {
+                cfd = receive_one_fd(pair[0], 0);
+                if (cfd < 0)
+                        break;
+
+                ret_fds[n] = cfd;
+        }
 
         /* We synchronously wait for the helper, as it shouldn't be slow */
         r = wait_for_terminate_and_check("(sd-accept)", pid, WAIT_LOG_ABNORMAL);
         if (r < 0) {
-                safe_close(cfd);
+                close_many(ret_fds, n);
                 return r;
         }
 
+        if (n > 0)
+                return (int) n;
+
         /* If we received no fd, we got EIO here. If this happens with a process exit code of EXIT_SUCCESS
          * this is a spurious accept(), let's convert that back to EAGAIN here. */
         if (cfd == -EIO)
                 return -EAGAIN;
-        if (cfd < 0)
-                return log_unit_error_errno(UNIT(s), cfd, "Failed to receive connection socket: %m");
 
-        return cfd;
+        return log_unit_error_errno(UNIT(s), cfd, "Failed to receive connection socket: %m");
 
 shortcut:
-        cfd = socket_accept_do(s, fd);
-        if (cfd == -EAGAIN) /* spurious accept(), skip it silently */
+        for (; n < n_max; n++) {
+                cfd = socket_accept_do(s, fd);
+                if (cfd == -EAGAIN) /* spurious accept(), or no more pending connections */
+                        break;
+                if (cfd < 0) {
+                        if (n > 0)
+                                break;
+
+                        return log_unit_error_errno(UNIT(s), cfd, "Failed to accept connection socket: %m");
+                }
+
+                ret_fds[n] = cfd;
+        }
+
+        if (n == 0) /* spurious accept(), skip it silently */
                 return -EAGAIN;
-        if (cfd < 0)
-                return log_unit_error_errno(UNIT(s), cfd, "Failed to accept connection socket: %m");
 
-        return cfd;
+        return (int) n;
 }
 
 static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         SocketPort *p = userdata;
-        int cfd = -1;
 
         assert(p);
         assert(fd >= 0);
@@ -3001,16 +3037,35 @@ static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
             p->type == SOCKET_SOCKET &&
             socket_address_can_accept(&p->address)) {
 
-                cfd = socket_accept_in_cgroup(p->socket, p, fd);
-                if (cfd == -EAGAIN) /* Spurious accept() */
+                int cfds[SOCKET_ACCEPT_BATCH_MAX], n;
+                unsigned n_max = 1;
+
+                /* Take as many pending connections as we'd accept anyway. If we are at the limit already,
+                 * take one so that it's refused in socket_enter_running() as before. */
+                if (p->socket->n_connections < p->socket->max_connections)
+                        n_max = MIN(p->socket->max_connections - p->socket->n_connections, (unsigned) SOCKET_ACCEPT_BATCH_MAX);
+
+                n = socket_accept_in_cgroup(p->socket, p, fd, cfds, n_max);
+                if (n == -EAGAIN) /* Spurious accept() */
                         return 0;
-                if (cfd < 0)
+                if (n < 0)
                         goto fail;
 
-                socket_apply_socket_options(p->socket, p, cfd);
+                for (int i = 0; i < n; i++) {
+                        /* One of the previous connections might have failed the socket unit already */
+                        if (p->socket->state != SOCKET_LISTENING) {
+                                close_many(cfds + i, n - i);
+                                break;
+                        }
+
+                        socket_apply_socket_options(p->socket, p, cfds[i]);
+                        socket_enter_running(p->socket, cfds[i]);
+                }
+
+                return 0;
         }
 
-        socket_enter_running(p->socket, cfd);
+        socket_enter_running(p->socket, -1);
         return 0;
 
 fail:
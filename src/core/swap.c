@@ -669,6 +669,7 @@ static int swap_spawn(Swap *s, ExecCommand *c, pid_t *_pid) {
                 .stderr_fd = -1,
                 .exec_fd   = -1,
         };
+        int pidfd = -1;
         pid_t pid;
         int r;
 
@@ -694,11 +695,12 @@ static int swap_spawn(Swap *s, ExecCommand *c, pid_t *_pid) {
                        &exec_params,
                        s->exec_runtime,
                        &s->dynamic_creds,
-                       &pid);
+                       &pid,
+                       &pidfd);
         if (r < 0)
                 goto fail;
 
-        r = unit_watch_pid(UNIT(s), pid, true);
+        r = unit_watch_pidfd(UNIT(s), pid, pidfd);
         if (r < 0)
                 goto fail;
 
@@ -274,38 +274,42 @@ static int transaction_merge_jobs(Transaction *tr, sd_bus_error *e) {
 }
 
 static void transaction_drop_redundant(Transaction *tr) {
-        bool again;
+        Job *j;
 
         /* Goes through the transaction and removes all jobs of the units whose jobs are all noops. If not
-         * all of a unit's jobs are redundant, they are kept. */
+         * all of a unit's jobs are redundant, they are kept.
+         *
+         * Whether a job is redundant only depends on its own unit, not on any other job in the transaction,
+         * and deleting a job without its dependencies only ever touches the current hashmap entry. Hence a
+         * single pass is sufficient, there's no need to start over after each deletion. On a system where
+         * most units are already up this would otherwise be quadratic in the size of the transaction. */
 
         assert(tr);
 
-        do {
-                Job *j;
-
-                again = false;
-
-                HASHMAP_FOREACH(j, tr->jobs) {
-                        bool keep = false;
-
-                        LIST_FOREACH(transaction, k, j)
-                                if (tr->anchor_job == k ||
-                                    !job_type_is_redundant(k->type, unit_active_state(k->unit)) ||
-                                    (k->unit->job && job_type_is_conflicting(k->type, k->unit->job->type))) {
-                                        keep = true;
-                                        break;
-                                }
+        HASHMAP_FOREACH(j, tr->jobs) {
+                bool keep = false;
 
-                        if (!keep) {
-                                log_trace("Found redundant job %s/%s, dropping from transaction.",
-                                          j->unit->id, job_type_to_string(j->type));
-                                transaction_delete_job(tr, j, false);
-                                again = true;
+                LIST_FOREACH(transaction, k, j)
+                        if (tr->anchor_job == k ||
+                            !job_type_is_redundant(k->type, unit_active_state(k->unit)) ||
+                            (k->unit->job && job_type_is_conflicting(k->type, k->unit->job->type))) {
+                                keep = true;
                                 break;
                         }
+
+                if (keep)
+                        continue;
+
+                /* Delete all jobs of this unit, i.e. the whole list starting at j */
+                while (j) {
+                        Job *next = j->transaction_next;
+
+                        log_trace("Found redundant job %s/%s, dropping from transaction.",
+                                  j->unit->id, job_type_to_string(j->type));
+                        transaction_delete_job(tr, j, false);
+                        j = next;
                 }
-        } while (again);
+        }
 }
 
 _pure_ static bool unit_matters_to_anchor(Unit *u, Job *job) {
@@ -500,7 +504,11 @@ static void transaction_collect_garbage(Transaction *tr) {
 
         assert(tr);
 
-        /* Drop jobs that are not required by any other job */
+        /* Drop jobs that are not required by any other job. A job without any object links has no jobs
+         * depending on it, hence deleting it only removes the current hashmap entry (or replaces it by the
+         * next job of the same unit), and we can continue iterating. Only jobs that lost their last object
+         * link in the process need another pass, so the number of passes is bounded by the length of the
+         * longest chain of garbage, rather than the number of garbage jobs. */
 
         do {
                 Job *j;
@@ -515,7 +523,7 @@ static void transaction_collect_garbage(Transaction *tr) {
                                 log_trace("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type));
                                 transaction_delete_job(tr, j, true);
                                 again = true;
-                                break;
+                                continue;
                         }
 
                         log_trace("Keeping job %s/%s because of %s/%s",
@@ -552,55 +560,91 @@ static int transaction_is_destructive(Transaction *tr, JobMode mode, sd_bus_erro
         return 0;
 }
 
+static bool job_should_be_dropped_to_minimize_impact(Job *j) {
+        bool stops_running_service, changes_existing_job;
+
+        assert(j);
+
+        /* If it matters, we shouldn't drop it */
+        if (j->matters_to_anchor)
+                return false;
+
+        /* Would this stop a running service?
+         * Would this change an existing job?
+         * If so, let's drop this entry */
+
+        stops_running_service =
+                j->type == JOB_STOP && UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(j->unit));
+
+        changes_existing_job =
+                j->unit->job &&
+                job_type_is_conflicting(j->type, j->unit->job->type);
+
+        if (!stops_running_service && !changes_existing_job)
+                return false;
+
+        if (stops_running_service)
+                log_unit_debug(j->unit,
+                               "%s/%s would stop a running service.",
+                               j->unit->id, job_type_to_string(j->type));
+
+        if (changes_existing_job)
+                log_unit_debug(j->unit,
+                               "%s/%s would change existing job.",
+                               j->unit->id, job_type_to_string(j->type));
+
+        return true;
+}
+
 static void transaction_minimize_impact(Transaction *tr) {
+        _cleanup_free_ Unit **units = NULL;
+        size_t n_units = 0;
         Job *head;
 
         assert(tr);
 
         /* Drops all unnecessary jobs that reverse already active jobs
-         * or that stop a running service. */
-
-rescan:
-        HASHMAP_FOREACH(head, tr->jobs) {
+         * or that stop a running service.
+         *
+         * Deleting a job might delete other jobs depending on it, which invalidates any iteration over the
+         * transaction. But whether a job should be dropped doesn't depend on other jobs, hence first collect
+         * the units in question, and then look their jobs up again one by one, instead of starting over
+         * after each deletion. */
+
+        HASHMAP_FOREACH(head, tr->jobs)
                 LIST_FOREACH(transaction, j, head) {
-                        bool stops_running_service, changes_existing_job;
-
-                        /* If it matters, we shouldn't drop it */
                         if (j->matters_to_anchor)
                                 continue;
 
-                        /* Would this stop a running service?
-                         * Would this change an existing job?
-                         * If so, let's drop this entry */
+                        if (!GREEDY_REALLOC(units, n_units + 1)) {
+                                log_oom();
+                                return;
+                        }
 
-                        stops_running_service =
-                                j->type == JOB_STOP && UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(j->unit));
+                        units[n_units++] = head->unit;
+                        break;
+                }
 
-                        changes_existing_job =
-                                j->unit->job &&
-                                job_type_is_conflicting(j->type, j->unit->job->type);
+        for (size_t i = 0; i < n_units; i++) {
+                bool again;
 
-                        if (!stops_running_service && !changes_existing_job)
-                                continue;
+                do {
+                        again = false;
 
-                        if (stops_running_service)
-                                log_unit_debug(j->unit,
-                                               "%s/%s would stop a running service.",
-                                               j->unit->id, job_type_to_string(j->type));
+                        LIST_FOREACH(transaction, j, (Job*) hashmap_get(tr->jobs, units[i])) {
+                                if (!job_should_be_dropped_to_minimize_impact(j))
+                                        continue;
 
-                        if (changes_existing_job)
+                                /* Ok, let's get rid of this */
                                 log_unit_debug(j->unit,
-                                               "%s/%s would change existing job.",
+                                               "Deleting %s/%s to minimize impact.",
                                                j->unit->id, job_type_to_string(j->type));
 
-                        /* Ok, let's get rid of this */
-                        log_unit_debug(j->unit,
-                                       "Deleting %s/%s to minimize impact.",
-                                       j->unit->id, job_type_to_string(j->type));
-
-                        transaction_delete_job(tr, j, true);
-                        goto rescan;
-                }
+                                transaction_delete_job(tr, j, true);
+                                again = true;
+                                break;
+                        }
+                } while (again);
         }
 }
 
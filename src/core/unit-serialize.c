@@ -3,6 +3,7 @@
 #include "bpf-socket-bind.h"
 #include "bus-util.h"
 #include "dbus.h"
+#include "escape.h"
 #include "fileio-label.h"
 #include "fileio.h"
 #include "format-util.h"
@@ -69,6 +70,25 @@ static int deserialize_markers(Unit *u, const char *value) {
         }
 }
 
+static int serialize_cgroup_attributes(FILE *f, Unit *u) {
+        const char *value, *attribute;
+
+        assert(f);
+        assert(u);
+
+        HASHMAP_FOREACH_KEY(value, attribute, u->cgroup_attributes) {
+                _cleanup_free_ char *e = NULL;
+
+                e = cescape(value);
+                if (!e)
+                        return log_oom();
+
+                (void) serialize_item_format(f, "cgroup-attribute", "%s %s", attribute, e);
+        }
+
+        return 0;
+}
+
 static const char *const ip_accounting_metric_field[_CGROUP_IP_ACCOUNTING_METRIC_MAX] = {
         [CGROUP_IP_INGRESS_BYTES] = "ip-accounting-ingress-bytes",
         [CGROUP_IP_INGRESS_PACKETS] = "ip-accounting-ingress-packets",
@@ -90,6 +110,80 @@ static const char *const io_accounting_metric_field_last[_CGROUP_IO_ACCOUNTING_M
         [CGROUP_IO_WRITE_OPERATIONS] = "io-accounting-write-operations-last",
 };
 
+static void serialize_cgroup_accounting(FILE *f, Unit *u) {
+        CGroupAccounting *a;
+
+        assert(f);
+        assert(u);
+
+        /* Units that never accounted anything have nothing to carry over */
+        a = u->cgroup_accounting;
+        if (!a)
+                return;
+
+        (void) serialize_item_format(f, "cpu-usage-base", "%" PRIu64, a->cpu_usage_base);
+        if (a->cpu_usage_last != NSEC_INFINITY)
+                (void) serialize_item_format(f, "cpu-usage-last", "%" PRIu64, a->cpu_usage_last);
+
+        if (a->managed_oom_kill_last > 0)
+                (void) serialize_item_format(f, "managed-oom-kill-last", "%" PRIu64, a->managed_oom_kill_last);
+
+        if (a->oom_kill_last > 0)
+                (void) serialize_item_format(f, "oom-kill-last", "%" PRIu64, a->oom_kill_last);
+
+        for (CGroupIOAccountingMetric im = 0; im < _CGROUP_IO_ACCOUNTING_METRIC_MAX; im++) {
+                (void) serialize_item_format(f, io_accounting_metric_field_base[im], "%" PRIu64, a->io_accounting_base[im]);
+
+                if (a->io_accounting_last[im] != UINT64_MAX)
+                        (void) serialize_item_format(f, io_accounting_metric_field_last[im], "%" PRIu64, a->io_accounting_last[im]);
+        }
+}
+
+static int deserialize_cgroup_accounting(Unit *u, const char *l, const char *v) {
+        CGroupAccounting *a;
+        size_t offset;
+        uint64_t c;
+        ssize_t m;
+        int r;
+
+        assert(u);
+        assert(l);
+        assert(v);
+
+        /* Returns > 0 if the key was one of ours, 0 if not. The accounting state is only allocated once we
+         * actually find something to put in it. */
+
+        if (STR_IN_SET(l, "cpu-usage-base", "cpuacct-usage-base"))
+                offset = offsetof(CGroupAccounting, cpu_usage_base);
+        else if (streq(l, "cpu-usage-last"))
+                offset = offsetof(CGroupAccounting, cpu_usage_last);
+        else if (streq(l, "managed-oom-kill-last"))
+                offset = offsetof(CGroupAccounting, managed_oom_kill_last);
+        else if (streq(l, "oom-kill-last"))
+                offset = offsetof(CGroupAccounting, oom_kill_last);
+        else if ((m = string_table_lookup(ip_accounting_metric_field, ELEMENTSOF(ip_accounting_metric_field), l)) >= 0)
+                offset = offsetof(CGroupAccounting, ip_accounting_extra) + m * sizeof(uint64_t);
+        else if ((m = string_table_lookup(io_accounting_metric_field_base, ELEMENTSOF(io_accounting_metric_field_base), l)) >= 0)
+                offset = offsetof(CGroupAccounting, io_accounting_base) + m * sizeof(uint64_t);
+        else if ((m = string_table_lookup(io_accounting_metric_field_last, ELEMENTSOF(io_accounting_metric_field_last), l)) >= 0)
+                offset = offsetof(CGroupAccounting, io_accounting_last) + m * sizeof(uint64_t);
+        else
+                return 0;
+
+        r = safe_atou64(v, &c);
+        if (r < 0) {
+                log_unit_debug_errno(u, r, "Failed to parse accounting value %s=%s, ignoring: %m", l, v);
+                return 1;
+        }
+
+        a = unit_acquire_cgroup_accounting(u);
+        if (!a)
+                return log_oom();
+
+        *(uint64_t*) ((uint8_t*) a + offset) = c;
+        return 1;
+}
+
 int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool switching_root) {
         int r;
 
@@ -142,22 +236,7 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool switching_root) {
         (void) serialize_bool(f, "exported-log-rate-limit-interval", u->exported_log_ratelimit_interval);
         (void) serialize_bool(f, "exported-log-rate-limit-burst", u->exported_log_ratelimit_burst);
 
-        (void) serialize_item_format(f, "cpu-usage-base", "%" PRIu64, u->cpu_usage_base);
-        if (u->cpu_usage_last != NSEC_INFINITY)
-                (void) serialize_item_format(f, "cpu-usage-last", "%" PRIu64, u->cpu_usage_last);
-
-        if (u->managed_oom_kill_last > 0)
-                (void) serialize_item_format(f, "managed-oom-kill-last", "%" PRIu64, u->managed_oom_kill_last);
-
-        if (u->oom_kill_last > 0)
-                (void) serialize_item_format(f, "oom-kill-last", "%" PRIu64, u->oom_kill_last);
-
-        for (CGroupIOAccountingMetric im = 0; im < _CGROUP_IO_ACCOUNTING_METRIC_MAX; im++) {
-                (void) serialize_item_format(f, io_accounting_metric_field_base[im], "%" PRIu64, u->io_accounting_base[im]);
-
-                if (u->io_accounting_last[im] != UINT64_MAX)
-                        (void) serialize_item_format(f, io_accounting_metric_field_last[im], "%" PRIu64, u->io_accounting_last[im]);
-        }
+        serialize_cgroup_accounting(f, u);
 
         if (u->cgroup_path)
                 (void) serialize_item(f, "cgroup", u->cgroup_path);
@@ -166,6 +245,9 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool switching_root) {
         (void) serialize_cgroup_mask(f, "cgroup-realized-mask", u->cgroup_realized_mask);
         (void) serialize_cgroup_mask(f, "cgroup-enabled-mask", u->cgroup_enabled_mask);
         (void) serialize_cgroup_mask(f, "cgroup-invalidated-mask", u->cgroup_invalidated_mask);
+        if (u->cgroup_numa_node >= 0)
+                (void) serialize_item_format(f, "cgroup-numa-node", "%i", u->cgroup_numa_node);
+        (void) serialize_cgroup_attributes(f, u);
 
         (void) bpf_serialize_socket_bind(u, f, fds);
 
@@ -274,10 +356,9 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
         for (;;) {
                 _cleanup_free_ char *line = NULL;
                 char *l, *v;
-                ssize_t m;
                 size_t k;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0) /* eof */
@@ -353,19 +434,6 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                 else if (MATCH_DESERIALIZE("exported-log-rate-limit-burst", l, v, parse_boolean, u->exported_log_ratelimit_burst))
                         continue;
 
-                else if (MATCH_DESERIALIZE_IMMEDIATE("cpu-usage-base", l, v, safe_atou64, u->cpu_usage_base) ||
-                         MATCH_DESERIALIZE_IMMEDIATE("cpuacct-usage-base", l, v, safe_atou64, u->cpu_usage_base))
-                        continue;
-
-                else if (MATCH_DESERIALIZE_IMMEDIATE("cpu-usage-last", l, v, safe_atou64, u->cpu_usage_last))
-                        continue;
-
-                else if (MATCH_DESERIALIZE_IMMEDIATE("managed-oom-kill-last", l, v, safe_atou64, u->managed_oom_kill_last))
-                        continue;
-
-                else if (MATCH_DESERIALIZE_IMMEDIATE("oom-kill-last", l, v, safe_atou64, u->oom_kill_last))
-                        continue;
-
                 else if (streq(l, "cgroup")) {
                         r = unit_set_cgroup_path(u, v);
                         if (r < 0)
@@ -388,6 +456,31 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                 else if (MATCH_DESERIALIZE_IMMEDIATE("cgroup-invalidated-mask", l, v, cg_mask_from_string, u->cgroup_invalidated_mask))
                         continue;
 
+                else if (streq(l, "cgroup-numa-node")) {
+                        int node;
+
+                        r = safe_atoi(v, &node);
+                        if (r < 0 || node < 0)
+                                log_unit_debug(u, "Failed to parse NUMA node %s, ignoring.", v);
+                        else
+                                unit_set_numa_node(u, node);
+
+                        continue;
+                }
+
+                else if (streq(l, "cgroup-attribute")) {
+                        _cleanup_free_ char *attribute = NULL, *value = NULL;
+                        const char *p = v;
+
+                        r = extract_first_word(&p, &attribute, NULL, 0);
+                        if (r <= 0 || !p || cunescape(p, 0, &value) < 0)
+                                log_unit_debug(u, "Failed to parse cgroup attribute value, ignoring: %s", v);
+                        else
+                                (void) unit_remember_cgroup_attribute(u, attribute, value);
+
+                        continue;
+                }
+
                 else if (STR_IN_SET(l, "ipv4-socket-bind-bpf-link-fd", "ipv6-socket-bind-bpf-link-fd")) {
                         int fd;
 
@@ -485,42 +578,11 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                         continue;
                 }
 
-                /* Check if this is an IP accounting metric serialization field */
-                m = string_table_lookup(ip_accounting_metric_field, ELEMENTSOF(ip_accounting_metric_field), l);
-                if (m >= 0) {
-                        uint64_t c;
-
-                        r = safe_atou64(v, &c);
-                        if (r < 0)
-                                log_unit_debug(u, "Failed to parse IP accounting value %s, ignoring.", v);
-                        else
-                                u->ip_accounting_extra[m] = c;
-                        continue;
-                }
-
-                m = string_table_lookup(io_accounting_metric_field_base, ELEMENTSOF(io_accounting_metric_field_base), l);
-                if (m >= 0) {
-                        uint64_t c;
-
-                        r = safe_atou64(v, &c);
-                        if (r < 0)
-                                log_unit_debug(u, "Failed to parse IO accounting base value %s, ignoring.", v);
-                        else
-                                u->io_accounting_base[m] = c;
-                        continue;
-                }
-
-                m = string_table_lookup(io_accounting_metric_field_last, ELEMENTSOF(io_accounting_metric_field_last), l);
-                if (m >= 0) {
-                        uint64_t c;
-
-                        r = safe_atou64(v, &c);
-                        if (r < 0)
-                                log_unit_debug(u, "Failed to parse IO accounting last value %s, ignoring.", v);
-                        else
-                                u->io_accounting_last[m] = c;
+                r = deserialize_cgroup_accounting(u, l, v);
+                if (r < 0)
+                        return r;
+                if (r > 0)
                         continue;
-                }
 
                 r = exec_runtime_deserialize_compat(u, l, v, fds);
                 if (r < 0) {
@@ -566,7 +628,7 @@ int unit_deserialize_skip(FILE *f) {
                 _cleanup_free_ char *line = NULL;
                 char *l;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
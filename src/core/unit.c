@@ -37,6 +37,7 @@
 #include "log.h"
 #include "macro.h"
 #include "missing_audit.h"
+#include "missing_wait.h"
 #include "mkdir-label.h"
 #include "path-util.h"
 #include "process-util.h"
@@ -105,29 +106,26 @@ Unit* unit_new(Manager *m, size_t size) {
         u->on_success_job_mode = JOB_FAIL;
         u->cgroup_control_inotify_wd = -1;
         u->cgroup_memory_inotify_wd = -1;
+        u->cgroup_numa_node = -1;
+        u->state_table_slot = SIZE_MAX;
+        u->cgroup_attributes_fd = -1;
         u->job_timeout = USEC_INFINITY;
         u->job_running_timeout = USEC_INFINITY;
         u->ref_uid = UID_INVALID;
         u->ref_gid = GID_INVALID;
-        u->cpu_usage_last = NSEC_INFINITY;
         u->cgroup_invalidated_mask |= CGROUP_MASK_BPF_FIREWALL;
         u->failure_action_exit_status = u->success_action_exit_status = -1;
 
         u->ip_accounting_ingress_map_fd = -1;
         u->ip_accounting_egress_map_fd = -1;
-        for (CGroupIOAccountingMetric i = 0; i < _CGROUP_IO_ACCOUNTING_METRIC_MAX; i++)
-                u->io_accounting_last[i] = UINT64_MAX;
-
-        u->ipv4_allow_map_fd = -1;
-        u->ipv6_allow_map_fd = -1;
-        u->ipv4_deny_map_fd = -1;
-        u->ipv6_deny_map_fd = -1;
 
         u->last_section_private = -1;
 
         u->start_ratelimit = (RateLimit) { m->default_start_limit_interval, m->default_start_limit_burst };
         u->auto_start_stop_ratelimit = (RateLimit) { 10 * USEC_PER_SEC, 16 };
 
+        unit_bump_dbus_generation(u);
+
         return u;
 }
 
@@ -493,10 +491,19 @@ void unit_add_to_gc_queue(Unit *u) {
         u->in_gc_queue = true;
 }
 
+void unit_bump_dbus_generation(Unit *u) {
+        assert(u);
+
+        u->dbus_generation = ++u->manager->dbus_generation;
+}
+
 void unit_add_to_dbus_queue(Unit *u) {
         assert(u);
         assert(u->type != _UNIT_TYPE_INVALID);
 
+        /* Whatever changed, cached property values are outdated now, even if nobody is to be told */
+        unit_bump_dbus_generation(u);
+
         if (u->load_state == UNIT_STUB || u->in_dbus_queue)
                 return;
 
@@ -512,6 +519,21 @@ void unit_add_to_dbus_queue(Unit *u) {
         u->in_dbus_queue = true;
 }
 
+void unit_remove_from_dbus_queue(Unit *u) {
+        assert(u);
+
+        if (!u->in_dbus_queue)
+                return;
+
+        if (u->in_dbus_coalesce_queue)
+                LIST_REMOVE(dbus_queue, u->manager->dbus_unit_coalesce_queue, u);
+        else
+                LIST_REMOVE(dbus_queue, u->manager->dbus_unit_queue, u);
+
+        u->in_dbus_queue = false;
+        u->in_dbus_coalesce_queue = false;
+}
+
 void unit_submit_to_stop_when_unneeded_queue(Unit *u) {
         assert(u);
 
@@ -580,6 +602,7 @@ static void unit_clear_dependencies(Unit *u) {
         }
 
         u->dependencies = hashmap_free(u->dependencies);
+        u->dependency_atoms = 0;
 }
 
 static void unit_remove_transient(Unit *u) {
@@ -679,6 +702,7 @@ Unit* unit_free(Unit *u) {
                 unit_remove_transient(u);
 
         bus_unit_send_removed_signal(u);
+        unit_state_table_remove(u->manager->unit_state_table, &u->state_table_slot);
 
         unit_done(u);
 
@@ -729,6 +753,7 @@ Unit* unit_free(Unit *u) {
 #endif
 
         unit_release_cgroup(u);
+        free(u->cgroup_accounting);
 
         if (!MANAGER_IS_RELOADING(u->manager))
                 unit_unlink_state_files(u);
@@ -749,8 +774,7 @@ Unit* unit_free(Unit *u) {
         if (u->in_load_queue)
                 LIST_REMOVE(load_queue, u->manager->load_queue, u);
 
-        if (u->in_dbus_queue)
-                LIST_REMOVE(dbus_queue, u->manager->dbus_unit_queue, u);
+        unit_remove_from_dbus_queue(u);
 
         if (u->in_cleanup_queue)
                 LIST_REMOVE(cleanup_queue, u->manager->cleanup_queue, u);
@@ -1002,7 +1026,7 @@ static int unit_per_dependency_type_hashmap_update(
 }
 
 static int unit_add_dependency_hashmap(
-                Hashmap **dependencies,
+                Unit *u,
                 UnitDependency d,
                 Unit *other,
                 UnitDependencyMask origin_mask,
@@ -1011,7 +1035,7 @@ static int unit_add_dependency_hashmap(
         Hashmap *per_type;
         int r;
 
-        assert(dependencies);
+        assert(u);
         assert(other);
         assert(origin_mask < _UNIT_DEPENDENCY_MASK_FULL);
         assert(destination_mask < _UNIT_DEPENDENCY_MASK_FULL);
@@ -1019,23 +1043,25 @@ static int unit_add_dependency_hashmap(
 
         /* Ensure the top-level dependency hashmap exists that maps UnitDependency → Hashmap(Unit* →
          * UnitDependencyInfo) */
-        r = hashmap_ensure_allocated(dependencies, NULL);
+        r = hashmap_ensure_allocated(&u->dependencies, NULL);
         if (r < 0)
                 return r;
 
         /* Acquire the inner hashmap, that maps Unit* → UnitDependencyInfo, for the specified dependency
          * type, and if it's missing allocate it and insert it. */
-        per_type = hashmap_get(*dependencies, UNIT_DEPENDENCY_TO_PTR(d));
+        per_type = hashmap_get(u->dependencies, UNIT_DEPENDENCY_TO_PTR(d));
         if (!per_type) {
                 per_type = hashmap_new(NULL);
                 if (!per_type)
                         return -ENOMEM;
 
-                r = hashmap_put(*dependencies, UNIT_DEPENDENCY_TO_PTR(d), per_type);
+                r = hashmap_put(u->dependencies, UNIT_DEPENDENCY_TO_PTR(d), per_type);
                 if (r < 0) {
                         hashmap_free(per_type);
                         return r;
                 }
+
+                u->dependency_atoms |= unit_dependency_to_atom(d);
         }
 
         return unit_per_dependency_type_hashmap_update(per_type, other, origin_mask, destination_mask);
@@ -1131,6 +1157,9 @@ static void unit_merge_dependencies(
         }
 
         other->dependencies = hashmap_free(other->dependencies);
+
+        u->dependency_atoms |= other->dependency_atoms;
+        other->dependency_atoms = 0;
 }
 
 int unit_merge(Unit *u, Unit *other) {
@@ -1606,6 +1635,30 @@ static int unit_validate_on_failure_job_mode(
         return 0;
 }
 
+static void unit_publish_state(Unit *u, UnitActiveState state) {
+        int r;
+
+        assert(u);
+
+        if (!u->manager->unit_state_table)
+                return;
+
+        /* Merged units are only aliases of another unit now, and are looked up via the bus. */
+        if (u->load_state == UNIT_MERGED)
+                return unit_state_table_remove(u->manager->unit_state_table, &u->state_table_slot);
+
+        r = unit_state_table_update(
+                        u->manager->unit_state_table,
+                        &u->state_table_slot,
+                        u->id,
+                        u->load_state,
+                        state,
+                        unit_sub_state_to_string(u),
+                        u->state_change_timestamp.realtime);
+        if (r < 0)
+                log_unit_debug_errno(u, r, "Failed to publish unit state, ignoring: %m");
+}
+
 int unit_load(Unit *u) {
         int r;
 
@@ -1677,6 +1730,7 @@ int unit_load(Unit *u) {
         assert((u->load_state != UNIT_MERGED) == !u->merged_into);
 
         unit_add_to_dbus_queue(unit_follow_merge(u));
+        unit_publish_state(u, unit_active_state(u));
         unit_add_to_gc_queue(u);
         (void) manager_varlink_send_managed_oom_update(u);
 
@@ -1697,6 +1751,7 @@ fail:
                 u->fragment_not_found_timestamp_hash = u->manager->unit_cache_timestamp_hash;
 
         unit_add_to_dbus_queue(u);
+        unit_publish_state(u, unit_active_state(u));
         unit_add_to_gc_queue(u);
 
         return log_unit_debug_errno(u, r, "Failed to load configuration: %m");
@@ -2678,6 +2733,8 @@ void unit_notify(Unit *u, UnitActiveState os, UnitActiveState ns, UnitNotifyFlag
         /* Keep track of failed units */
         (void) manager_update_failed_units(m, u, ns == UNIT_FAILED);
 
+        unit_publish_state(u, ns);
+
         /* Make sure the cgroup and state files are always removed when we become inactive */
         if (UNIT_IS_INACTIVE_OR_FAILED(ns)) {
                 SET_FLAG(u->markers,
@@ -2854,12 +2911,108 @@ int unit_watch_pid(Unit *u, pid_t pid, bool exclusive) {
         return 0;
 }
 
+static int unit_dispatch_pidfd(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        Unit *u = ASSERT_PTR(userdata);
+        siginfo_t si = {};
+        pid_t pid = 0;
+        void *k, *v;
+
+        assert(s);
+        assert(fd >= 0);
+
+        /* A process we hold a pidfd for exited. We know which unit it belongs to, hence dispatch it right
+         * away, without going through the generic SIGCHLD logic in the manager, which has to look the PID
+         * up first. */
+
+        HASHMAP_FOREACH_KEY(v, k, u->pidfd_sources)
+                if (v == s) {
+                        pid = PTR_TO_PID(k);
+                        break;
+                }
+        assert(pid_is_valid(pid));
+
+        /* Peek first, so that /proc/$PID stays around while the unit processes the event. We use P_PIDFD
+         * here, so that we can be sure we don't look at an unrelated process that reused the PID. */
+        if (waitid(P_PIDFD, fd, &si, WEXITED|WNOHANG|WNOWAIT) < 0) {
+                if (errno != ECHILD)
+                        log_unit_warning_errno(u, errno, "Failed to peek for child "PID_FMT" via its pidfd, ignoring: %m", pid);
+
+                /* Already reaped elsewhere (or we can't), let the generic SIGCHLD logic handle it */
+                sd_event_source_disable_unref(hashmap_remove(u->pidfd_sources, PID_TO_PTR(pid)));
+                return 0;
+        }
+        if (si.si_pid <= 0) /* Spurious wake-up? */
+                return 0;
+
+        /* This drops the event source we are running from via unit_unwatch_pid(), but the fd stays valid
+         * until we return. */
+        manager_dispatch_child_exit(u->manager, &si, u);
+
+        /* Finally, reap it */
+        if (waitid(P_PIDFD, fd, &si, WEXITED) < 0)
+                log_unit_warning_errno(u, errno, "Failed to reap child "PID_FMT", ignoring: %m", pid);
+
+        return 0;
+}
+
+int unit_watch_pidfd(Unit *u, pid_t pid, int pidfd) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+        _cleanup_close_ int fd = pidfd;
+        int r;
+
+        assert(u);
+        assert(pid_is_valid(pid));
+
+        /* Like unit_watch_pid(), but takes possession of a pidfd for the PID (if there's one) and uses it to
+         * get notified about the process' exit directly. Since the pidfd pins the process, this is not
+         * subject to PID reuse races, and the exit can be dispatched without a PID lookup. */
+
+        r = unit_watch_pid(u, pid, true);
+        if (r < 0)
+                return r;
+
+        if (fd < 0)
+                return 0;
+
+        r = hashmap_ensure_allocated(&u->pidfd_sources, NULL);
+        if (r < 0)
+                return r;
+
+        sd_event_source_disable_unref(hashmap_remove(u->pidfd_sources, PID_TO_PTR(pid)));
+
+        r = sd_event_add_io(u->manager->event, &s, fd, EPOLLIN, unit_dispatch_pidfd, u);
+        if (r < 0)
+                return log_unit_debug_errno(u, r, "Failed to watch pidfd of "PID_FMT", relying on SIGCHLD: %m", pid);
+
+        r = sd_event_source_set_io_fd_own(s, true);
+        if (r < 0)
+                return r;
+        TAKE_FD(fd);
+
+        /* Dispatch before the generic SIGCHLD handler, so that it doesn't have to look at this process */
+        r = sd_event_source_set_priority(s, SD_EVENT_PRIORITY_NORMAL-8);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(s, "unit-pidfd");
+
+        r = hashmap_put(u->pidfd_sources, PID_TO_PTR(pid), s);
+        if (r < 0)
+                return r;
+        TAKE_PTR(s);
+
+        return 0;
+}
+
 void unit_unwatch_pid(Unit *u, pid_t pid) {
         Unit **array;
 
         assert(u);
         assert(pid_is_valid(pid));
 
+        /* Drop the pidfd exit watch, if we have one */
+        sd_event_source_disable_unref(hashmap_remove(u->pidfd_sources, PID_TO_PTR(pid)));
+
         /* First let's drop the unit in case it's keyed as "pid". */
         (void) hashmap_remove_value(u->manager->watch_pids, PID_TO_PTR(pid), u);
 
@@ -2891,6 +3044,7 @@ void unit_unwatch_all_pids(Unit *u) {
                 unit_unwatch_pid(u, PTR_TO_PID(set_first(u->pids)));
 
         u->pids = set_free(u->pids);
+        u->pidfd_sources = hashmap_free(u->pidfd_sources);
 }
 
 static void unit_tidy_watch_pids(Unit *u) {
@@ -3120,25 +3274,25 @@ int unit_add_dependency(
                 return log_unit_error_errno(u, SYNTHETIC_ERRNO(EINVAL),
                                             "Requested dependency SliceOf=%s refused (%s is not a cgroup unit).", other->id, other->id);
 
-        r = unit_add_dependency_hashmap(&u->dependencies, d, other, mask, 0);
+        r = unit_add_dependency_hashmap(u, d, other, mask, 0);
         if (r < 0)
                 return r;
         notify = r > 0;
 
         if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d) {
-                r = unit_add_dependency_hashmap(&other->dependencies, inverse_table[d], u, 0, mask);
+                r = unit_add_dependency_hashmap(other, inverse_table[d], u, 0, mask);
                 if (r < 0)
                         return r;
                 notify_other = r > 0;
         }
 
         if (add_reference) {
-                r = unit_add_dependency_hashmap(&u->dependencies, UNIT_REFERENCES, other, mask, 0);
+                r = unit_add_dependency_hashmap(u, UNIT_REFERENCES, other, mask, 0);
                 if (r < 0)
                         return r;
                 notify = notify || r > 0;
 
-                r = unit_add_dependency_hashmap(&other->dependencies, UNIT_REFERENCED_BY, u, 0, mask);
+                r = unit_add_dependency_hashmap(other, UNIT_REFERENCED_BY, u, 0, mask);
                 if (r < 0)
                         return r;
                 notify_other = notify_other || r > 0;
@@ -4690,7 +4844,7 @@ int unit_require_mounts_for(Unit *u, const char *path, UnitDependencyMask mask)
                 if (!x) {
                         _cleanup_free_ char *q = NULL;
 
-                        r = hashmap_ensure_allocated(&u->manager->units_requiring_mounts_for, &path_hash_ops);
+                        r = hashmap_ensure_allocated(&u->manager->units_requiring_mounts_for, &fast_path_hash_ops);
                         if (r < 0)
                                 return r;
 
@@ -5130,46 +5284,44 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
                 return;
 
         HASHMAP_FOREACH(deps, u->dependencies) {
-                bool done;
-
-                do {
-                        UnitDependencyInfo di;
-                        Unit *other;
+                UnitDependencyInfo di;
+                Unit *other;
 
-                        done = true;
+                /* Note that we only ever update or drop the current entry of 'deps' here, which is safe while
+                 * iterating. And since units never depend on themselves, the reverse dependencies we update
+                 * below always live in another unit's hashmaps. Hence there's no need to start the iteration
+                 * over after each entry, which made this quadratic in the number of dependencies, for
+                 * example when dropping all file based dependencies of a target with many Wants= on reload. */
 
-                        HASHMAP_FOREACH_KEY(di.data, other, deps) {
-                                Hashmap *other_deps;
-
-                                if (FLAGS_SET(~mask, di.origin_mask))
-                                        continue;
+                HASHMAP_FOREACH_KEY(di.data, other, deps) {
+                        Hashmap *other_deps;
 
-                                di.origin_mask &= ~mask;
-                                unit_update_dependency_mask(deps, other, di);
+                        if (FLAGS_SET(~mask, di.origin_mask))
+                                continue;
 
-                                /* We updated the dependency from our unit to the other unit now. But most
-                                 * dependencies imply a reverse dependency. Hence, let's delete that one
-                                 * too. For that we go through all dependency types on the other unit and
-                                 * delete all those which point to us and have the right mask set. */
+                        di.origin_mask &= ~mask;
+                        unit_update_dependency_mask(deps, other, di);
 
-                                HASHMAP_FOREACH(other_deps, other->dependencies) {
-                                        UnitDependencyInfo dj;
+                        /* We updated the dependency from our unit to the other unit now. But most
+                         * dependencies imply a reverse dependency. Hence, let's delete that one
+                         * too. For that we go through all dependency types on the other unit and
+                         * delete all those which point to us and have the right mask set. */
 
-                                        dj.data = hashmap_get(other_deps, u);
-                                        if (FLAGS_SET(~mask, dj.destination_mask))
-                                                continue;
+                        assert(other != u);
 
-                                        dj.destination_mask &= ~mask;
-                                        unit_update_dependency_mask(other_deps, u, dj);
-                                }
+                        HASHMAP_FOREACH(other_deps, other->dependencies) {
+                                UnitDependencyInfo dj;
 
-                                unit_add_to_gc_queue(other);
+                                dj.data = hashmap_get(other_deps, u);
+                                if (FLAGS_SET(~mask, dj.destination_mask))
+                                        continue;
 
-                                done = false;
-                                break;
+                                dj.destination_mask &= ~mask;
+                                unit_update_dependency_mask(other_deps, u, dj);
                         }
 
-                } while (!done);
+                        unit_add_to_gc_queue(other);
+                }
         }
 }
 
@@ -5752,7 +5904,10 @@ void unit_destroy_runtime_data(Unit *u, const ExecContext *context) {
             (context->runtime_directory_preserve_mode == EXEC_PRESERVE_RESTART && !unit_will_restart(u)))
                 exec_context_destroy_runtime_directory(context, u->manager->prefix[EXEC_DIRECTORY_RUNTIME]);
 
-        exec_context_destroy_credentials(context, u->manager->prefix[EXEC_DIRECTORY_RUNTIME], u->id);
+        /* Keep the credentials across restarts, so that encrypted ones need not be decrypted again, see
+         * acquire_credentials() */
+        if (!unit_will_restart(u) || !exec_context_has_credentials(context))
+                exec_context_destroy_credentials(context, u->manager->prefix[EXEC_DIRECTORY_RUNTIME], u->id);
 }
 
 int unit_clean(Unit *u, ExecCleanMask mask) {
@@ -17,6 +17,7 @@
 #include "unit-file.h"
 #include "cgroup.h"
 
+typedef struct BPFFirewallAccess BPFFirewallAccess;
 typedef struct UnitRef UnitRef;
 
 typedef enum KillOperation {
@@ -144,6 +145,11 @@ typedef struct Unit {
          * Hashmap(UnitDependency → Hashmap(Unit* → UnitDependencyInfo)) */
         Hashmap *dependencies;
 
+        /* The combined atoms of all dependency types that have a per-type Hashmap in 'dependencies' above,
+         * so that UNIT_FOREACH_DEPENDENCY() can skip units without matching dependencies right away, without
+         * iterating through 'dependencies'. */
+        UnitDependencyAtom dependency_atoms;
+
         /* Similar, for RequiresMountsFor= path dependencies. The key is the path, the value the
          * UnitDependencyInfo type */
         Hashmap *requires_mounts_for;
@@ -215,6 +221,13 @@ typedef struct Unit {
         /* D-Bus queue */
         LIST_FIELDS(Unit, dbus_queue);
 
+        /* When we last sent out a change signal for this unit, used for coalescing */
+        usec_t dbus_change_signal_timestamp;
+
+        /* Bumped whenever properties of the unit might have changed, so that cached GetAll() replies are
+         * invalidated. Taken from a manager-wide counter, hence never reused for a different unit. */
+        uint64_t dbus_generation;
+
         /* Cleanup queue */
         LIST_FIELDS(Unit, cleanup_queue);
 
@@ -247,6 +260,9 @@ typedef struct Unit {
          * process SIGCHLD for */
         Set *pids;
 
+        /* Exit watches for those of the PIDs above we hold a pidfd for, keyed by PID */
+        Hashmap *pidfd_sources;
+
         /* Used in SIGCHLD and sd_notify() message event invocation logic to avoid that we dispatch the same event
          * multiple times on the same unit. */
         unsigned sigchldgen;
@@ -281,19 +297,8 @@ typedef struct Unit {
         UnitFileState unit_file_state;
         int unit_file_preset;
 
-        /* Where the cpu.stat or cpuacct.usage was at the time the unit was started */
-        nsec_t cpu_usage_base;
-        nsec_t cpu_usage_last; /* the most recently read value */
-
-        /* The current counter of OOM kills initiated by systemd-oomd */
-        uint64_t managed_oom_kill_last;
-
-        /* The current counter of the oom_kill field in the memory.events cgroup attribute */
-        uint64_t oom_kill_last;
-
-        /* Where the io.stat data was at the time the unit was started */
-        uint64_t io_accounting_base[_CGROUP_IO_ACCOUNTING_METRIC_MAX];
-        uint64_t io_accounting_last[_CGROUP_IO_ACCOUNTING_METRIC_MAX]; /* the most recently read value */
+        /* CPU, IO, IP and OOM accounting state, allocated lazily */
+        CGroupAccounting *cgroup_accounting;
 
         /* Counterparts in the cgroup filesystem */
         char *cgroup_path;
@@ -307,18 +312,27 @@ typedef struct Unit {
         int cgroup_control_inotify_wd;
         int cgroup_memory_inotify_wd;
 
+        /* The NUMA node the unit was placed on by AutoNUMAPlacement=, or -1 */
+        int cgroup_numa_node;
+
+        /* Our slot in the manager's unit state table, SIZE_MAX if none */
+        size_t state_table_slot;
+
+        /* The values most recently written to the cgroup attributes, keyed by attribute name, so that
+         * re-applying an unchanged cgroup context doesn't need to touch cgroupfs at all */
+        Hashmap *cgroup_attributes;
+
+        /* The cgroup directory, only kept open while the cgroup context is applied (cgroupv2 only) */
+        int cgroup_attributes_fd;
+
         /* Device Controller BPF program */
         BPFProgram *bpf_device_control_installed;
 
         /* IP BPF Firewalling/accounting */
         int ip_accounting_ingress_map_fd;
         int ip_accounting_egress_map_fd;
-        uint64_t ip_accounting_extra[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
 
-        int ipv4_allow_map_fd;
-        int ipv6_allow_map_fd;
-        int ipv4_deny_map_fd;
-        int ipv6_deny_map_fd;
+        BPFFirewallAccess *ip_bpf_access;
         BPFProgram *ip_bpf_ingress, *ip_bpf_ingress_installed;
         BPFProgram *ip_bpf_egress, *ip_bpf_egress_installed;
 
@@ -392,6 +406,7 @@ typedef struct Unit {
         /* Booleans indicating membership of this unit in the various queues */
         bool in_load_queue:1;
         bool in_dbus_queue:1;
+        bool in_dbus_coalesce_queue:1;
         bool in_cleanup_queue:1;
         bool in_gc_queue:1;
         bool in_cgroup_realize_queue:1;
@@ -769,7 +784,9 @@ static inline const char* unit_status_text(Unit *u) {
 }
 
 void unit_add_to_load_queue(Unit *u);
+void unit_bump_dbus_generation(Unit *u);
 void unit_add_to_dbus_queue(Unit *u);
+void unit_remove_from_dbus_queue(Unit *u);
 void unit_add_to_cleanup_queue(Unit *u);
 void unit_add_to_gc_queue(Unit *u);
 void unit_add_to_target_deps_queue(Unit *u);
@@ -821,6 +838,7 @@ typedef enum UnitNotifyFlags {
 void unit_notify(Unit *u, UnitActiveState os, UnitActiveState ns, UnitNotifyFlags flags);
 
 int unit_watch_pid(Unit *u, pid_t pid, bool exclusive);
+int unit_watch_pidfd(Unit *u, pid_t pid, int pidfd);
 void unit_unwatch_pid(Unit *u, pid_t pid);
 void unit_unwatch_all_pids(Unit *u);
 
@@ -1073,12 +1091,13 @@ typedef struct UnitForEachDependencyData {
 } UnitForEachDependencyData;
 
 /* Iterates through all dependencies that have a specific atom in the dependency type set. This tries to be
- * smart: if the atom is unique, we'll directly go to right entry. Otherwise we'll iterate through the
- * per-dependency type hashmap and match all dep that have the right atom set. */
+ * smart: if the unit has no dependency type with the atom at all, we'll skip it right-away. If the atom is
+ * unique, we'll directly go to right entry. Otherwise we'll iterate through the per-dependency type hashmap
+ * and match all dep that have the right atom set. */
 #define _UNIT_FOREACH_DEPENDENCY(other, u, ma, data)                    \
         for (UnitForEachDependencyData data = {                         \
                         .match_atom = (ma),                             \
-                        .by_type = (u)->dependencies,                   \
+                        .by_type = ((u)->dependency_atoms & (ma)) ? (u)->dependencies : NULL, \
                         .by_type_iterator = ITERATOR_FIRST,             \
                         .current_unit = &(other),                       \
                 };                                                      \
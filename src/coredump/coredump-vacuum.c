@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <sys/file.h>
 #include <sys/statvfs.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -9,6 +10,8 @@
 #include "coredump-vacuum.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "fileio.h"
+#include "format-util.h"
 #include "fs-util.h"
 #include "hashmap.h"
 #include "macro.h"
@@ -23,26 +26,105 @@
 #define DEFAULT_KEEP_FREE_UPPER (uint64_t) (4ULL*1024ULL*1024ULL*1024ULL) /* 4 GiB */
 #define DEFAULT_KEEP_FREE (uint64_t) (1024ULL*1024ULL)                    /* 1 MB */
 
+#define COREDUMP_DIR "/var/lib/systemd/coredump"
+
+/* The index records owner, mtime and disk usage of every core in the directory, so that we don't have to
+ * enumerate and stat all of them on every crash. Every instance adds the core it stored, and drops the
+ * ones it removed. Cores removed by somebody else (the admin, tmpfiles, …) are dropped from the index once
+ * we try to remove them ourselves. To not drift too far from reality, the directory is scanned again if
+ * the index is missing, corrupted, or older than a day. Removing the index hence forces a rescan. */
+#define COREDUMP_INDEX ".index"
+#define COREDUMP_INDEX_HEADER "systemd-coredump-index-v1"
+#define COREDUMP_INDEX_RESCAN_USEC USEC_PER_DAY
+
+typedef struct IndexEntry {
+        char *name;
+        uid_t uid;
+        usec_t mtime;
+        uint64_t size;
+} IndexEntry;
+
+typedef struct Index {
+        IndexEntry *entries;
+        size_t n_entries;
+        uint64_t sum;
+        usec_t scanned; /* CLOCK_REALTIME of the last full scan of the directory */
+} Index;
+
 typedef struct VacuumCandidate {
         unsigned n_files;
-        char *oldest_file;
+        size_t oldest;
         usec_t oldest_mtime;
 } VacuumCandidate;
 
-static VacuumCandidate* vacuum_candidate_free(VacuumCandidate *c) {
-        if (!c)
-                return NULL;
+static void index_done(Index *idx) {
+        assert(idx);
+
+        for (size_t i = 0; i < idx->n_entries; i++)
+                free(idx->entries[i].name);
 
-        free(c->oldest_file);
-        return mfree(c);
+        idx->entries = mfree(idx->entries);
+        idx->n_entries = 0;
+        idx->sum = 0;
+        idx->scanned = 0;
 }
-DEFINE_TRIVIAL_CLEANUP_FUNC(VacuumCandidate*, vacuum_candidate_free);
 
-static Hashmap* vacuum_candidate_hashmap_free(Hashmap *h) {
-        return hashmap_free_with_destructor(h, vacuum_candidate_free);
+static IndexEntry* index_find(Index *idx, const char *name) {
+        assert(idx);
+        assert(name);
+
+        for (size_t i = 0; i < idx->n_entries; i++)
+                if (streq(idx->entries[i].name, name))
+                        return idx->entries + i;
+
+        return NULL;
 }
 
-DEFINE_TRIVIAL_CLEANUP_FUNC(Hashmap*, vacuum_candidate_hashmap_free);
+static int index_add(Index *idx, const char *name, uid_t uid, usec_t mtime, uint64_t size) {
+        _cleanup_free_ char *n = NULL;
+        IndexEntry *e;
+
+        assert(idx);
+        assert(name);
+
+        e = index_find(idx, name);
+        if (e) {
+                idx->sum -= e->size;
+                e->uid = uid;
+                e->mtime = mtime;
+                e->size = size;
+                idx->sum += size;
+                return 0;
+        }
+
+        n = strdup(name);
+        if (!n)
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(idx->entries, idx->n_entries + 1))
+                return -ENOMEM;
+
+        idx->entries[idx->n_entries++] = (IndexEntry) {
+                .name = TAKE_PTR(n),
+                .uid = uid,
+                .mtime = mtime,
+                .size = size,
+        };
+        idx->sum += size;
+
+        return 0;
+}
+
+static void index_remove(Index *idx, IndexEntry *e) {
+        assert(idx);
+        assert(e >= idx->entries && e < idx->entries + idx->n_entries);
+
+        idx->sum -= e->size;
+        free(e->name);
+
+        /* The order doesn't matter, hence just move the last entry into the gap */
+        *e = idx->entries[--idx->n_entries];
+}
 
 static int uid_from_file_name(const char *filename, uid_t *uid) {
         const char *p, *e, *u;
@@ -113,133 +195,263 @@ static bool vacuum_necessary(int fd, uint64_t sum, uint64_t keep_free, uint64_t
         return false;
 }
 
-int coredump_vacuum(int exclude_fd, uint64_t keep_free, uint64_t max_use) {
-        _cleanup_closedir_ DIR *d = NULL;
-        struct stat exclude_st;
-        int r;
+static int index_add_file(Index *idx, int dir_fd, const char *name) {
+        struct stat st;
+        uid_t uid;
 
-        if (keep_free == 0 && max_use == 0)
+        assert(idx);
+        assert(dir_fd >= 0);
+        assert(name);
+
+        if (uid_from_file_name(name, &uid) < 0)
                 return 0;
 
-        if (exclude_fd >= 0) {
-                if (fstat(exclude_fd, &exclude_st) < 0)
-                        return log_error_errno(errno, "Failed to fstat(): %m");
+        if (fstatat(dir_fd, name, &st, AT_NO_AUTOMOUNT|AT_SYMLINK_NOFOLLOW) < 0) {
+                if (errno == ENOENT)
+                        return 0;
+
+                return log_warning_errno(errno, "Failed to stat " COREDUMP_DIR "/%s: %m", name);
         }
 
-        /* This algorithm will keep deleting the oldest file of the
-         * user with the most coredumps until we are back in the size
-         * limits. Note that vacuuming for journal files is different,
-         * because we rely on rate-limiting of the messages there,
-         * to avoid being flooded. */
+        if (!S_ISREG(st.st_mode))
+                return 0;
 
-        d = opendir("/var/lib/systemd/coredump");
-        if (!d) {
-                if (errno == ENOENT)
-                        return 0;
+        return index_add(idx, name, uid, timespec_load(&st.st_mtim), (uint64_t) st.st_blocks * 512);
+}
 
-                return log_error_errno(errno, "Can't open coredump directory: %m");
+static int index_scan(Index *idx, DIR *d) {
+        int r;
+
+        assert(idx);
+        assert(d);
+
+        index_done(idx);
+        idx->scanned = now(CLOCK_REALTIME);
+        rewinddir(d);
+
+        FOREACH_DIRENT(de, d, return log_error_errno(errno, "Failed to read directory: %m")) {
+                r = index_add_file(idx, dirfd(d), de->d_name);
+                if (r == -ENOMEM)
+                        return log_oom();
         }
 
+        log_debug("Rebuilt coredump index: %zu cores, %s.", idx->n_entries, FORMAT_BYTES(idx->sum));
+        return 0;
+}
+
+static int index_load(Index *idx, FILE *f) {
+        _cleanup_free_ char *header = NULL;
+        usec_t t, n;
+        int r;
+
+        assert(idx);
+        assert(f);
+
+        /* Returns 1 if the index is valid and up-to-date, 0 if it needs to be rebuilt. */
+
+        r = read_line(f, LONG_LINE_MAX, &header);
+        if (r < 0)
+                log_debug_errno(r, "Failed to read coredump index, rebuilding: %m");
+        if (r <= 0)
+                return 0;
+
+        if (sscanf(header, COREDUMP_INDEX_HEADER " %" SCNu64, &t) != 1)
+                return 0;
+
+        n = now(CLOCK_REALTIME);
+        if (t > n || n - t > COREDUMP_INDEX_RESCAN_USEC)
+                return 0;
+
         for (;;) {
-                _cleanup_(vacuum_candidate_hashmap_freep) Hashmap *h = NULL;
-                VacuumCandidate *worst = NULL;
-                uint64_t sum = 0;
+                _cleanup_free_ char *line = NULL;
+                uint64_t mtime, size;
+                unsigned uid;
+                int k = 0;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to read coredump index, rebuilding: %m");
+                        return 0;
+                }
+                if (r == 0)
+                        break;
 
-                rewinddir(d);
+                if (sscanf(line, "%u %" SCNu64 " %" SCNu64 " %n", &uid, &mtime, &size, &k) != 3 ||
+                    k <= 0 || isempty(line + k) || !uid_is_valid(uid)) {
+                        log_debug("Invalid line in coredump index, rebuilding: %s", line);
+                        return 0;
+                }
 
-                FOREACH_DIRENT(de, d, goto fail) {
-                        VacuumCandidate *c;
-                        struct stat st;
-                        uid_t uid;
-                        usec_t t;
+                r = index_add(idx, line + k, uid, mtime, size);
+                if (r < 0)
+                        return log_oom();
+        }
 
-                        r = uid_from_file_name(de->d_name, &uid);
-                        if (r < 0)
-                                continue;
+        idx->scanned = t;
+        return 1;
+}
+
+static int index_save(Index *idx, FILE *f) {
+        assert(idx);
+        assert(f);
+
+        rewind(f);
+        if (ftruncate(fileno(f), 0) < 0)
+                return -errno;
+
+        fprintf(f, COREDUMP_INDEX_HEADER " " USEC_FMT "\n", idx->scanned);
+        for (size_t i = 0; i < idx->n_entries; i++)
+                fprintf(f, UID_FMT " " USEC_FMT " %" PRIu64 " %s\n",
+                        idx->entries[i].uid, idx->entries[i].mtime, idx->entries[i].size, idx->entries[i].name);
 
-                        if (fstatat(dirfd(d), de->d_name, &st, AT_NO_AUTOMOUNT|AT_SYMLINK_NOFOLLOW) < 0) {
-                                if (errno == ENOENT)
-                                        continue;
+        return fflush_and_check(f);
+}
+
+static int index_find_worst(Index *idx, const IndexEntry *exclude, IndexEntry **ret) {
+        _cleanup_hashmap_free_free_ Hashmap *h = NULL;
+        VacuumCandidate *worst = NULL;
+        int r;
 
-                                log_warning_errno(errno, "Failed to stat /var/lib/systemd/coredump/%s: %m", de->d_name);
-                                continue;
+        assert(idx);
+        assert(ret);
+
+        /* Finds the oldest core of the user with the most cores. This only looks at the index, i.e. doesn't
+         * touch the file system at all. */
+
+        for (size_t i = 0; i < idx->n_entries; i++) {
+                IndexEntry *e = idx->entries + i;
+                VacuumCandidate *c;
+
+                if (e == exclude)
+                        continue;
+
+                c = hashmap_get(h, UID_TO_PTR(e->uid));
+                if (c) {
+                        if (e->mtime < c->oldest_mtime) {
+                                c->oldest = i;
+                                c->oldest_mtime = e->mtime;
                         }
+                } else {
+                        _cleanup_free_ VacuumCandidate *n = NULL;
 
-                        if (!S_ISREG(st.st_mode))
-                                continue;
+                        n = new(VacuumCandidate, 1);
+                        if (!n)
+                                return -ENOMEM;
 
-                        if (exclude_fd >= 0 && stat_inode_same(&exclude_st, &st))
-                                continue;
+                        *n = (VacuumCandidate) {
+                                .oldest = i,
+                                .oldest_mtime = e->mtime,
+                        };
 
-                        r = hashmap_ensure_allocated(&h, NULL);
+                        r = hashmap_ensure_put(&h, NULL, UID_TO_PTR(e->uid), n);
                         if (r < 0)
-                                return log_oom();
+                                return r;
 
-                        t = timespec_load(&st.st_mtim);
+                        c = TAKE_PTR(n);
+                }
 
-                        c = hashmap_get(h, UID_TO_PTR(uid));
-                        if (c) {
+                c->n_files++;
 
-                                if (t < c->oldest_mtime) {
-                                        char *n;
+                if (!worst ||
+                    worst->n_files < c->n_files ||
+                    (worst->n_files == c->n_files && c->oldest_mtime < worst->oldest_mtime))
+                        worst = c;
+        }
+
+        *ret = worst ? idx->entries + worst->oldest : NULL;
+        return 0;
+}
+
+int coredump_vacuum(const char *exclude, uint64_t keep_free, uint64_t max_use) {
+        _cleanup_(index_done) Index idx = {};
+        _cleanup_closedir_ DIR *d = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_close_ int fd = -1;
+        const char *exclude_name = NULL;
+        bool dirty = true;
+        int r;
 
-                                        n = strdup(de->d_name);
-                                        if (!n)
-                                                return log_oom();
+        if (keep_free == 0 && max_use == 0)
+                return 0;
 
-                                        free(c->oldest_file);
-                                        c->oldest_file = n;
-                                        c->oldest_mtime = t;
-                                }
+        if (exclude)
+                exclude_name = basename(exclude);
 
-                        } else {
-                                _cleanup_(vacuum_candidate_freep) VacuumCandidate *n = NULL;
+        /* This algorithm will keep deleting the oldest file of the
+         * user with the most coredumps until we are back in the size
+         * limits. Note that vacuuming for journal files is different,
+         * because we rely on rate-limiting of the messages there,
+         * to avoid being flooded. */
 
-                                n = new0(VacuumCandidate, 1);
-                                if (!n)
-                                        return log_oom();
+        d = opendir(COREDUMP_DIR);
+        if (!d) {
+                if (errno == ENOENT)
+                        return 0;
 
-                                n->oldest_file = strdup(de->d_name);
-                                if (!n->oldest_file)
-                                        return log_oom();
+                return log_error_errno(errno, "Can't open coredump directory: %m");
+        }
 
-                                n->oldest_mtime = t;
+        /* Multiple instances of systemd-coredump may run at the same time, hence serialize all accesses to
+         * the index. */
+        fd = openat(dirfd(d), COREDUMP_INDEX, O_RDWR|O_CREAT|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW, 0600);
+        if (fd < 0)
+                return log_error_errno(errno, "Failed to open " COREDUMP_DIR "/" COREDUMP_INDEX ": %m");
 
-                                r = hashmap_put(h, UID_TO_PTR(uid), n);
-                                if (r < 0)
-                                        return log_oom();
+        if (flock(fd, LOCK_EX) < 0)
+                return log_error_errno(errno, "Failed to lock " COREDUMP_DIR "/" COREDUMP_INDEX ": %m");
 
-                                c = TAKE_PTR(n);
-                        }
+        r = take_fdopen_unlocked(&fd, "r+", &f);
+        if (r < 0)
+                return log_error_errno(r, "Failed to open " COREDUMP_DIR "/" COREDUMP_INDEX ": %m");
 
-                        c->n_files++;
+        r = index_load(&idx, f);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                r = index_scan(&idx, d);
+                if (r < 0)
+                        return r;
+        } else if (exclude_name) {
+                /* The new core was linked into the directory without holding the lock, hence add it now */
+                r = index_add_file(&idx, dirfd(d), exclude_name);
+                if (r == -ENOMEM)
+                        return log_oom();
+        } else
+                dirty = false;
 
-                        if (!worst ||
-                            worst->n_files < c->n_files ||
-                            (worst->n_files == c->n_files && c->oldest_mtime < worst->oldest_mtime))
-                                worst = c;
+        for (;;) {
+                IndexEntry *worst, *e;
+                uint64_t sum;
 
-                        sum += st.st_blocks * 512;
-                }
+                /* Don't count the core we just created, and never remove it */
+                e = exclude_name ? index_find(&idx, exclude_name) : NULL;
+                sum = idx.sum - (e ? e->size : 0);
 
+                r = index_find_worst(&idx, e, &worst);
+                if (r < 0)
+                        return log_oom();
                 if (!worst)
                         break;
 
-                r = vacuum_necessary(dirfd(d), sum, keep_free, max_use);
-                if (r <= 0)
-                        return r;
+                if (!vacuum_necessary(dirfd(d), sum, keep_free, max_use))
+                        break;
 
-                r = unlinkat_deallocate(dirfd(d), worst->oldest_file, 0);
-                if (r == -ENOENT)
-                        continue;
-                if (r < 0)
-                        return log_error_errno(r, "Failed to remove file %s: %m", worst->oldest_file);
+                r = unlinkat_deallocate(dirfd(d), worst->name, 0);
+                if (r < 0 && r != -ENOENT)
+                        return log_error_errno(r, "Failed to remove file %s: %m", worst->name);
+                if (r >= 0)
+                        log_info("Removed old coredump %s.", worst->name);
 
-                log_info("Removed old coredump %s.", worst->oldest_file);
+                index_remove(&idx, worst);
+                dirty = true;
         }
 
-        return 0;
+        if (!dirty)
+                return 0;
+
+        r = index_save(&idx, f);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to write " COREDUMP_DIR "/" COREDUMP_INDEX ": %m");
 
-fail:
-        return log_error_errno(errno, "Failed to read directory: %m");
+        return 0;
 }
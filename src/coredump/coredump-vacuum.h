@@ -4,4 +4,6 @@
 #include <inttypes.h>
 #include <sys/types.h>
 
-int coredump_vacuum(int exclude_fd, uint64_t keep_free, uint64_t max_use);
+/* Removes old cores until the limits are met again. If exclude is not NULL, it's the path of the core that
+ * was just stored, which is recorded in the index, but neither counted nor removed. */
+int coredump_vacuum(const char *exclude, uint64_t keep_free, uint64_t max_use);
@@ -2,6 +2,7 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <sys/file.h>
 #include <sys/prctl.h>
 #include <sys/statvfs.h>
 #include <sys/xattr.h>
@@ -19,8 +20,8 @@
 #include "cgroup-util.h"
 #include "compress.h"
 #include "conf-parser.h"
-#include "copy.h"
 #include "coredump-vacuum.h"
+#include "cpu-set-util.h"
 #include "dirent-util.h"
 #include "elf-util.h"
 #include "escape.h"
@@ -72,6 +73,12 @@
  * go below 4MB for writing core files to storage. */
 #define PROCESS_SIZE_MIN (4U*1024U*1024U)
 
+/* How much of the core to read from the kernel at a time when storing it */
+#define COPY_CORE_BUFFER_SIZE (1024U*1024U)
+
+/* Upper limit for CompressThreads=auto. Beyond that the disk is usually the bottleneck anyway. */
+#define COMPRESS_THREADS_AUTO_MAX 8U
+
 /* Make sure to not make this larger than the maximum journal entry
  * size. See DATA_SIZE_MAX in journal-importer.h. */
 assert_cc(JOURNAL_SIZE_MAX <= DATA_SIZE_MAX);
@@ -152,11 +159,51 @@ static uint64_t arg_external_size_max = EXTERNAL_SIZE_MAX;
 static uint64_t arg_journal_size_max = JOURNAL_SIZE_MAX;
 static uint64_t arg_keep_free = UINT64_MAX;
 static uint64_t arg_max_use = UINT64_MAX;
+static unsigned arg_compress_threads = 0; /* 0 → auto */
+
+static int config_parse_compress_threads(
+                const char* unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        unsigned *threads = ASSERT_PTR(data), n;
+        int r;
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+
+        if (isempty(rvalue) || streq(rvalue, "auto")) {
+                *threads = 0;
+                return 0;
+        }
+
+        r = safe_atou(rvalue, &n);
+        if (r < 0) {
+                log_syntax(unit, LOG_WARNING, filename, line, r, "Failed to parse %s= value, ignoring: %s", lvalue, rvalue);
+                return 0;
+        }
+        if (n == 0) {
+                log_syntax(unit, LOG_WARNING, filename, line, 0, "%s= must be positive or \"auto\", ignoring: %s", lvalue, rvalue);
+                return 0;
+        }
+
+        *threads = n;
+        return 0;
+}
 
 static int parse_config(void) {
         static const ConfigTableItem items[] = {
                 { "Coredump", "Storage",          config_parse_coredump_storage,           0, &arg_storage           },
                 { "Coredump", "Compress",         config_parse_bool,                       0, &arg_compress          },
+                { "Coredump", "CompressThreads",  config_parse_compress_threads,           0, &arg_compress_threads  },
                 { "Coredump", "ProcessSizeMax",   config_parse_iec_uint64,                 0, &arg_process_size_max  },
                 { "Coredump", "ExternalSizeMax",  config_parse_iec_uint64_infinity,        0, &arg_external_size_max },
                 { "Coredump", "JournalSizeMax",   config_parse_iec_size,                   0, &arg_journal_size_max  },
@@ -184,6 +231,23 @@ static uint64_t storage_size_max(void) {
         return 0;
 }
 
+static unsigned compress_threads(void) {
+        int n;
+
+        if (arg_compress_threads > 0)
+                return arg_compress_threads;
+
+        /* By default use half of the CPUs we may run on, so that a large core is compressed quickly, while
+         * the crashing service (which is likely being restarted right now) still gets some CPU time. */
+        n = cpus_in_affinity_mask();
+        if (n < 0) {
+                log_debug_errno(n, "Failed to determine number of CPUs, compressing on a single thread: %m");
+                return 1;
+        }
+
+        return CLAMP((unsigned) n / 2, 1U, COMPRESS_THREADS_AUTO_MAX);
+}
+
 static int fix_acl(int fd, uid_t uid) {
 
 #if HAVE_ACL
@@ -330,6 +394,77 @@ static int make_filename(const Context *context, char **ret) {
         return 0;
 }
 
+static int copy_core_sparse(int fdf, int fdt, uint64_t max_bytes) {
+        _cleanup_free_ uint8_t *buf = NULL;
+        uint64_t left = max_bytes;
+        size_t ps = page_size();
+        off_t hole = 0;
+
+        assert(fdf >= 0);
+        assert(fdt >= 0);
+
+        /* Like copy_bytes(), but doesn't write pages that are all zeros, and leaves holes for them instead.
+         * Cores usually contain lots of those (untouched heap and stack, guard pages, …), and there's no
+         * point in writing them out only to compress them away again. Returns 1 if the max_bytes limit was
+         * hit, 0 otherwise. */
+
+        buf = malloc(COPY_CORE_BUFFER_SIZE);
+        if (!buf)
+                return -ENOMEM;
+
+        while (left > 0) {
+                ssize_t n;
+
+                n = loop_read(fdf, buf, MIN(left, (uint64_t) COPY_CORE_BUFFER_SIZE), true);
+                if (n < 0)
+                        return n;
+                if (n == 0)
+                        break;
+
+                for (size_t i = 0, j; i < (size_t) n; i = j) {
+                        bool zero;
+                        int r;
+
+                        /* Find the longest run of pages that are either all zero or all non-zero */
+                        zero = memeqzero(buf + i, MIN(ps, (size_t) n - i));
+                        for (j = i + MIN(ps, (size_t) n - i); j < (size_t) n; j += MIN(ps, (size_t) n - j))
+                                if (memeqzero(buf + j, MIN(ps, (size_t) n - j)) != zero)
+                                        break;
+
+                        if (zero) {
+                                hole += j - i;
+                                continue;
+                        }
+
+                        if (hole > 0) {
+                                if (lseek(fdt, hole, SEEK_CUR) < 0)
+                                        return -errno;
+                                hole = 0;
+                        }
+
+                        r = loop_write(fdt, buf + i, j - i, false);
+                        if (r < 0)
+                                return r;
+                }
+
+                left -= n;
+        }
+
+        /* Make sure a trailing hole is accounted for in the file size */
+        if (hole > 0) {
+                off_t end;
+
+                end = lseek(fdt, hole, SEEK_CUR);
+                if (end < 0)
+                        return -errno;
+
+                if (ftruncate(fdt, end) < 0)
+                        return -errno;
+        }
+
+        return left == 0;
+}
+
 static int save_external_coredump(
                 const Context *context,
                 int input_fd,
@@ -446,7 +581,7 @@ static int save_external_coredump(
                 log_debug("Limiting core file size to %" PRIu64 " bytes due to cgroup memory limits.", max_size);
         }
 
-        r = copy_bytes(input_fd, fd, max_size, 0);
+        r = copy_core_sparse(input_fd, fd, max_size);
         if (r < 0)
                 return log_error_errno(r, "Cannot store coredump of %s (%s): %m",
                                 context->meta[META_ARGV_PID], context->meta[META_COMM]);
@@ -458,6 +593,7 @@ static int save_external_coredump(
                 _cleanup_free_ char *fn_compressed = NULL;
                 _cleanup_close_ int fd_compressed = -1;
                 uint64_t uncompressed_size = 0;
+                unsigned threads = compress_threads();
 
                 if (lseek(fd, 0, SEEK_SET) == (off_t) -1)
                         return log_error_errno(errno, "Failed to seek on coredump %s: %m", fn);
@@ -470,7 +606,7 @@ static int save_external_coredump(
                 if (fd_compressed < 0)
                         return log_error_errno(fd_compressed, "Failed to create temporary file for coredump %s: %m", fn_compressed);
 
-                r = compress_stream(fd, fd_compressed, max_size, &uncompressed_size);
+                r = compress_stream_full(fd, fd_compressed, max_size, threads, &uncompressed_size);
                 if (r < 0)
                         return log_error_errno(r, "Failed to compress %s: %m", coredump_tmpfile_name(tmp_compressed));
 
@@ -483,7 +619,7 @@ static int save_external_coredump(
                         tmp = unlink_and_free(tmp);
                         fd = safe_close(fd);
 
-                        r = compress_stream(input_fd, fd_compressed, max_size, &partial_uncompressed_size);
+                        r = compress_stream_full(input_fd, fd_compressed, max_size, threads, &partial_uncompressed_size);
                         if (r < 0)
                                 return log_error_errno(r, "Failed to compress %s: %m", coredump_tmpfile_name(tmp_compressed));
                         uncompressed_size += partial_uncompressed_size;
@@ -763,20 +899,91 @@ static int change_uid_gid(const Context *context) {
         return drop_privileges(uid, gid, 0);
 }
 
+static int submit_stacktrace(
+                const Context *context,
+                const char *stacktrace,
+                JsonVariant *json_metadata) {
+
+        _cleanup_(iovw_free_freep) struct iovec_wrapper *iovw = NULL;
+        _cleanup_free_ char *formatted_json = NULL;
+        const char *module_name, *message;
+        JsonVariant *module_json;
+        int r;
+
+        assert(context);
+
+        /* Logs the stack trace and package metadata in a separate entry, that refers to the coredump entry
+         * via PID, timestamp and boot ID. coredumpctl puts the two together again. */
+
+        iovw = iovw_new();
+        if (!iovw)
+                return log_oom();
+
+        (void) iovw_put_string_field(iovw, "MESSAGE_ID=", SD_MESSAGE_COREDUMP_STACKTRACE_STR);
+        (void) iovw_put_string_field(iovw, "PRIORITY=", STRINGIFY(LOG_INFO));
+        (void) iovw_put_string_field(iovw, "COREDUMP_PID=", context->meta[META_ARGV_PID]);
+        (void) iovw_put_string_field(iovw, "COREDUMP_TIMESTAMP=", context->meta[META_ARGV_TIMESTAMP]);
+        if (context->meta[META_COMM])
+                (void) iovw_put_string_field(iovw, "COREDUMP_COMM=", context->meta[META_COMM]);
+        if (context->meta[META_EXE])
+                (void) iovw_put_string_field(iovw, "COREDUMP_EXE=", context->meta[META_EXE]);
+
+        message = strjoina("Stack trace of process ", context->meta[META_ARGV_PID],
+                           " (", context->meta[META_COMM], "):",
+                           stacktrace ? "\n\n" : " not available.", stacktrace);
+        (void) iovw_put_string_field(iovw, "MESSAGE=", message);
+
+        if (stacktrace)
+                (void) iovw_put_string_field(iovw, "COREDUMP_STACKTRACE=", stacktrace);
+
+        /* If we managed to parse any ELF metadata (build-id, ELF package meta),
+         * attach it as journal metadata. */
+        if (json_metadata) {
+                r = json_variant_format(json_metadata, 0, &formatted_json);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to format JSON package metadata: %m");
+
+                (void) iovw_put_string_field(iovw, "COREDUMP_PACKAGE_JSON=", formatted_json);
+        }
+
+        /* In the unlikely scenario that context->meta[META_EXE] is not available,
+         * let's avoid guessing the module name and skip the loop. */
+        if (context->meta[META_EXE])
+                JSON_VARIANT_OBJECT_FOREACH(module_name, module_json, json_metadata) {
+                        JsonVariant *t;
+
+                        /* We only add structured fields for the 'main' ELF module, and only if we can identify it. */
+                        if (!path_equal_filename(module_name, context->meta[META_EXE]))
+                                continue;
+
+                        t = json_variant_by_key(module_json, "name");
+                        if (t)
+                                (void) iovw_put_string_field(iovw, "COREDUMP_PACKAGE_NAME=", json_variant_string(t));
+
+                        t = json_variant_by_key(module_json, "version");
+                        if (t)
+                                (void) iovw_put_string_field(iovw, "COREDUMP_PACKAGE_VERSION=", json_variant_string(t));
+                }
+
+        r = sd_journal_sendv(iovw->iovec, iovw->count);
+        if (r < 0)
+                return log_error_errno(r, "Failed to log stack trace: %m");
+
+        return 0;
+}
+
 static int submit_coredump(
                 Context *context,
                 struct iovec_wrapper *iovw,
                 int input_fd) {
 
         _cleanup_(json_variant_unrefp) JsonVariant *json_metadata = NULL;
-        _cleanup_close_ int coredump_fd = -1, coredump_node_fd = -1;
+        _cleanup_close_ int coredump_fd = -1, coredump_node_fd = -1, lock_fd = -1;
         _cleanup_free_ char *filename = NULL, *coredump_data = NULL;
         _cleanup_free_ char *stacktrace = NULL;
         char *core_message;
-        const char *module_name;
         uint64_t coredump_size = UINT64_MAX, coredump_compressed_size = UINT64_MAX;
-        bool truncated = false;
-        JsonVariant *module_json;
+        bool truncated = false, want_stacktrace = false;
         int r;
 
         assert(context);
@@ -784,7 +991,7 @@ static int submit_coredump(
         assert(input_fd >= 0);
 
         /* Vacuum before we write anything again */
-        (void) coredump_vacuum(-1, arg_keep_free, arg_max_use);
+        (void) coredump_vacuum(NULL, arg_keep_free, arg_max_use);
 
         /* Always stream the coredump to disk, if that's possible */
         r = save_external_coredump(context, input_fd,
@@ -800,14 +1007,20 @@ static int submit_coredump(
         r = maybe_remove_external_coredump(filename, coredump_node_fd >= 0 ? coredump_compressed_size : coredump_size);
         if (r < 0)
                 return r;
-        if (r == 0)
+        if (r == 0) {
                 (void) iovw_put_string_field(iovw, "COREDUMP_FILENAME=", filename);
-        else if (arg_storage == COREDUMP_STORAGE_EXTERNAL)
+
+                /* Vacuum again, but exclude the coredump we just created */
+                (void) coredump_vacuum(filename, arg_keep_free, arg_max_use);
+        } else if (arg_storage == COREDUMP_STORAGE_EXTERNAL)
                 log_info("The core will not be stored: size %"PRIu64" is greater than %"PRIu64" (the configured maximum)",
                          coredump_node_fd >= 0 ? coredump_compressed_size : coredump_size, arg_external_size_max);
 
-        /* Vacuum again, but exclude the coredump we just created */
-        (void) coredump_vacuum(coredump_node_fd >= 0 ? coredump_node_fd : coredump_fd, arg_keep_free, arg_max_use);
+        /* Generating stack traces is expensive, so we only do one at a time, see below. We lock the coredump
+         * directory for that, which we need to open while we still have the privileges for it. */
+        lock_fd = open("/var/lib/systemd/coredump", O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+        if (lock_fd < 0)
+                log_debug_errno(errno, "Failed to open /var/lib/systemd/coredump, not serializing stack trace generation: %m");
 
         /* Now, let's drop privileges to become the user who owns the segfaulted process
          * and allocate the coredump memory under the user's uid. This also ensures that
@@ -823,28 +1036,41 @@ static int submit_coredump(
                 log_debug("Not generating stack trace: core size %"PRIu64" is greater "
                           "than %"PRIu64" (the configured maximum)",
                           coredump_size, arg_process_size_max);
-        else if (coredump_fd >= 0) {
-                bool skip = startswith(context->meta[META_COMM], "systemd-coredum"); /* COMM is 16 bytes usually */
-
-                (void) parse_elf_object(coredump_fd,
-                                        context->meta[META_EXE],
-                                        /* fork_disable_dump= */ skip, /* avoid loops */
-                                        &stacktrace,
-                                        &json_metadata);
+        else
+                want_stacktrace = coredump_fd >= 0;
+
+        if (context->is_journald) {
+                /* We cannot log to the journal, so just print the message, with the stack trace.
+                 * The target was set previously to something safe. */
+                if (want_stacktrace)
+                        (void) parse_elf_object(coredump_fd,
+                                                context->meta[META_EXE],
+                                                /* fork_disable_dump= */ false,
+                                                &stacktrace,
+                                                NULL);
+
+                core_message = strjoina("Process ", context->meta[META_ARGV_PID],
+                                        " (", context->meta[META_COMM], ") of user ",
+                                        context->meta[META_ARGV_UID], " dumped core.",
+                                        filename ? "\nCoredump diverted to " : NULL,
+                                        filename);
+
+                core_message = strjoina(core_message, stacktrace ? "\n\n" : NULL, stacktrace);
+
+                log_dispatch(LOG_ERR, 0, core_message);
+                return 0;
         }
 
 log:
+        /* Log the coredump right away, without the stack trace. Symbolizing the stack can take a long time
+         * for big processes, and if something is crash looping, we'd rather get all the coredumps recorded
+         * quickly, than pile up instances waiting for libdw. */
         core_message = strjoina("Process ", context->meta[META_ARGV_PID],
                                 " (", context->meta[META_COMM], ") of user ",
-                                context->meta[META_ARGV_UID], " dumped core.",
-                                context->is_journald && filename ? "\nCoredump diverted to " : NULL,
-                                context->is_journald && filename ? filename : NULL);
-
-        core_message = strjoina(core_message, stacktrace ? "\n\n" : NULL, stacktrace);
+                                context->meta[META_ARGV_UID], " dumped core.");
 
         if (context->is_journald) {
-                /* We cannot log to the journal, so just print the message.
-                 * The target was set previously to something safe. */
+                /* Saving the core failed, see above. */
                 log_dispatch(LOG_ERR, 0, core_message);
                 return 0;
         }
@@ -854,37 +1080,6 @@ log:
         if (truncated)
                 (void) iovw_put_string_field(iovw, "COREDUMP_TRUNCATED=", "1");
 
-        /* If we managed to parse any ELF metadata (build-id, ELF package meta),
-         * attach it as journal metadata. */
-        if (json_metadata) {
-                _cleanup_free_ char *formatted_json = NULL;
-
-                r = json_variant_format(json_metadata, 0, &formatted_json);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to format JSON package metadata: %m");
-
-                (void) iovw_put_string_field(iovw, "COREDUMP_PACKAGE_JSON=", formatted_json);
-        }
-
-        /* In the unlikely scenario that context->meta[META_EXE] is not available,
-         * let's avoid guessing the module name and skip the loop. */
-        if (context->meta[META_EXE])
-                JSON_VARIANT_OBJECT_FOREACH(module_name, module_json, json_metadata) {
-                        JsonVariant *t;
-
-                        /* We only add structured fields for the 'main' ELF module, and only if we can identify it. */
-                        if (!path_equal_filename(module_name, context->meta[META_EXE]))
-                                continue;
-
-                        t = json_variant_by_key(module_json, "name");
-                        if (t)
-                                (void) iovw_put_string_field(iovw, "COREDUMP_PACKAGE_NAME=", json_variant_string(t));
-
-                        t = json_variant_by_key(module_json, "version");
-                        if (t)
-                                (void) iovw_put_string_field(iovw, "COREDUMP_PACKAGE_VERSION=", json_variant_string(t));
-                }
-
         /* Optionally store the entire coredump in the journal */
         if (arg_storage == COREDUMP_STORAGE_JOURNAL && coredump_fd >= 0) {
                 if (coredump_size <= arg_journal_size_max) {
@@ -907,7 +1102,27 @@ log:
         if (r < 0)
                 return log_error_errno(r, "Failed to log coredump: %m");
 
-        return 0;
+        if (!want_stacktrace)
+                return 0;
+
+        /* Now generate the stack trace. If another instance is doing that already, wait for it, so that we
+         * don't parse lots of big cores in parallel. */
+        if (lock_fd >= 0 && flock(lock_fd, LOCK_EX) < 0)
+                log_debug_errno(errno, "Failed to lock /var/lib/systemd/coredump, ignoring: %m");
+
+        bool skip = startswith(context->meta[META_COMM], "systemd-coredum"); /* COMM is 16 bytes usually */
+
+        r = parse_elf_object(coredump_fd,
+                             context->meta[META_EXE],
+                             /* fork_disable_dump= */ skip, /* avoid loops */
+                             &stacktrace,
+                             &json_metadata);
+        if (r < 0)
+                log_debug_errno(r, "Failed to generate stack trace: %m");
+
+        lock_fd = safe_close(lock_fd);
+
+        return submit_stacktrace(context, stacktrace, json_metadata);
 }
 
 static int save_context(Context *context, const struct iovec_wrapper *iovw) {
@@ -1404,6 +1619,8 @@ static int run(int argc, char *argv[]) {
 
         log_debug("Selected storage '%s'.", coredump_storage_to_string(arg_storage));
         log_debug("Selected compression %s.", yes_no(arg_compress));
+        if (arg_compress_threads > 0)
+                log_debug("Selected %u compression threads.", arg_compress_threads);
 
         r = sd_listen_fds(false);
         if (r < 0)
@@ -110,7 +110,7 @@ static int add_matches(sd_journal *j, char **matches) {
         return 0;
 }
 
-static int acquire_journal(sd_journal **ret, char **matches) {
+static int open_journal(sd_journal **ret) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
         int r;
 
@@ -130,6 +130,20 @@ static int acquire_journal(sd_journal **ret, char **matches) {
                         return log_error_errno(r, "Failed to open journal: %m");
         }
 
+        *ret = TAKE_PTR(j);
+        return 0;
+}
+
+static int acquire_journal(sd_journal **ret, char **matches) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        int r;
+
+        assert(ret);
+
+        r = open_journal(&j);
+        if (r < 0)
+                return r;
+
         r = journal_access_check_and_warn(j, arg_quiet, true);
         if (r < 0)
                 return r;
@@ -544,6 +558,58 @@ static int print_list(FILE* file, sd_journal *j, Table *t) {
         return 0;
 }
 
+static int retrieve_stacktrace(
+                const char *boot_id,
+                const char *pid,
+                const char *timestamp,
+                char **stacktrace,
+                char **pkgmeta_name,
+                char **pkgmeta_version,
+                char **pkgmeta_json) {
+
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        const void *d;
+        size_t l;
+        int r;
+
+        /* systemd-coredump logs the stack trace in a separate entry once it has been generated, look for
+         * the one belonging to this coredump. */
+
+        if (!boot_id || !pid || !timestamp)
+                return 0;
+
+        r = open_journal(&j);
+        if (r < 0)
+                return r;
+
+        FOREACH_STRING(match,
+                       "MESSAGE_ID=" SD_MESSAGE_COREDUMP_STACKTRACE_STR,
+                       strjoina("_BOOT_ID=", boot_id),
+                       strjoina("COREDUMP_PID=", pid),
+                       strjoina("COREDUMP_TIMESTAMP=", timestamp)) {
+                r = sd_journal_add_match(j, match, 0);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to add match \"%s\": %m", match);
+        }
+
+        r = sd_journal_next(j);
+        if (r < 0)
+                return log_error_errno(r, "Failed to search journal: %m");
+        if (r == 0)
+                return 0;
+
+        (void) sd_journal_set_data_threshold(j, 0);
+
+        SD_JOURNAL_FOREACH_DATA(j, d, l) {
+                RETRIEVE(d, l, "COREDUMP_STACKTRACE", *stacktrace);
+                RETRIEVE(d, l, "COREDUMP_PACKAGE_NAME", *pkgmeta_name);
+                RETRIEVE(d, l, "COREDUMP_PACKAGE_VERSION", *pkgmeta_version);
+                RETRIEVE(d, l, "COREDUMP_PACKAGE_JSON", *pkgmeta_json);
+        }
+
+        return 1;
+}
+
 static int print_info(FILE *file, sd_journal *j, bool need_space) {
         _cleanup_free_ char
                 *mid = NULL, *pid = NULL, *uid = NULL, *gid = NULL,
@@ -552,7 +618,7 @@ static int print_info(FILE *file, sd_journal *j, bool need_space) {
                 *boot_id = NULL, *machine_id = NULL, *hostname = NULL,
                 *slice = NULL, *cgroup = NULL, *owner_uid = NULL,
                 *message = NULL, *timestamp = NULL, *filename = NULL,
-                *truncated = NULL, *coredump = NULL,
+                *truncated = NULL, *coredump = NULL, *stacktrace = NULL,
                 *pkgmeta_name = NULL, *pkgmeta_version = NULL, *pkgmeta_json = NULL;
         const void *d;
         size_t l;
@@ -597,6 +663,10 @@ static int print_info(FILE *file, sd_journal *j, bool need_space) {
 
         normal_coredump = streq_ptr(mid, SD_MESSAGE_COREDUMP_STR);
 
+        if (normal_coredump && !pkgmeta_json)
+                (void) retrieve_stacktrace(boot_id, pid, timestamp,
+                                           &stacktrace, &pkgmeta_name, &pkgmeta_version, &pkgmeta_json);
+
         if (comm)
                 fprintf(file,
                         "           PID: %s%s%s (%s)\n",
@@ -762,6 +832,14 @@ static int print_info(FILE *file, sd_journal *j, bool need_space) {
                 fprintf(file, "       Message: %s\n", strstrip(m ?: message));
         }
 
+        if (stacktrace) {
+                _cleanup_free_ char *m = NULL;
+
+                m = strreplace(stacktrace, "\n", "\n                ");
+
+                fprintf(file, "\n                %s\n", strstrip(m ?: stacktrace));
+        }
+
         return 0;
 }
 
@@ -419,7 +419,8 @@ static int verb_cat(int argc, char **argv, void *userdata) {
                                         timestamp,
                                         arg_tpm2_device,
                                         data, size,
-                                        &plaintext, &plaintext_size);
+                                        &plaintext, &plaintext_size,
+                                        /* ret_not_after= */ NULL);
                         if (r < 0)
                                 return r;
 
@@ -578,7 +579,8 @@ static int verb_decrypt(int argc, char **argv, void *userdata) {
                         timestamp,
                         arg_tpm2_device,
                         input, input_size,
-                        &plaintext, &plaintext_size);
+                        &plaintext, &plaintext_size,
+                        /* ret_not_after= */ NULL);
         if (r < 0)
                 return r;
 
@@ -1349,6 +1349,7 @@ int home_setup_luks(
                 }
         } else {
                 _cleanup_free_ char *fstype = NULL, *subdir = NULL;
+                bool was_clean;
                 const char *ip;
 
                 /* When we aren't reopening the home directory we are allocating it fresh, hence the relevant
@@ -1368,8 +1369,10 @@ int home_setup_luks(
                         return log_error_errno(r, "Failed to validate disk label: %m");
 
                 /* Everything before this point left the image untouched. We are now starting to make
-                 * changes, hence mark the image dirty */
-                if (run_mark_dirty(setup->image_fd, true) > 0)
+                 * changes, hence mark the image dirty. If the flag wasn't set so far, the image was cleanly
+                 * deactivated last time, which we use below to skip the file system check. */
+                was_clean = run_mark_dirty(setup->image_fd, true) > 0;
+                if (was_clean)
                         setup->do_mark_clean = true;
 
                 if (!user_record_luks_discard(h)) {
@@ -1418,9 +1421,13 @@ int home_setup_luks(
                 if (r < 0)
                         return r;
 
-                r = run_fsck(setup->dm_node, fstype);
-                if (r < 0)
-                        return r;
+                if (was_clean)
+                        log_debug("Image was cleanly deactivated, skipping file system check.");
+                else {
+                        r = run_fsck(setup->dm_node, fstype);
+                        if (r < 0)
+                                return r;
+                }
 
                 r = home_unshare_and_mount(setup->dm_node, fstype, user_record_luks_discard(h), user_record_mount_flags(h), h->luks_extra_mount_options);
                 if (r < 0)
@@ -17,6 +17,7 @@
 #include "fd-util.h"
 #include "fs-util.h"
 #include "import-common.h"
+#include "memory-util.h"
 #include "missing_fcntl.h"
 #include "ratelimit.h"
 #include "stat-util.h"
@@ -53,7 +54,12 @@ struct RawExport {
 
         struct stat st;
 
+        /* The hole or data extent of the input we are currently in */
+        uint64_t hole_end;
+        uint64_t data_end;
+
         bool eof;
+        bool output_regular;
         bool tried_reflink;
         bool tried_sendfile;
 };
@@ -133,6 +139,67 @@ static void raw_export_report_progress(RawExport *e) {
         e->last_percent = percent;
 }
 
+static int raw_export_copy_progress(uint64_t n_bytes, void *userdata) {
+        RawExport *e = ASSERT_PTR(userdata);
+
+        e->written_uncompressed += n_bytes;
+        e->written_compressed += n_bytes;
+
+        raw_export_report_progress(e);
+        return 0;
+}
+
+static ssize_t raw_export_read(RawExport *e, void *buf, size_t size) {
+        uint64_t pos;
+        ssize_t l;
+        off_t o;
+
+        assert(e);
+        assert(buf);
+
+        /* Reads the next chunk of the input, but produces the zeros of holes without actually reading
+         * them. The input is read sequentially from the start, hence the position is what we read so far. */
+
+        pos = e->written_uncompressed;
+
+        if (pos >= e->hole_end && pos >= e->data_end) {
+                o = lseek(e->input_fd, pos, SEEK_DATA);
+                if (o < 0 && errno == ENXIO)
+                        /* Only a hole up to the end of the file left */
+                        e->hole_end = e->st.st_size;
+                else if (o < 0)
+                        /* SEEK_DATA not supported, just read everything */
+                        e->data_end = UINT64_MAX;
+                else if ((uint64_t) o > pos)
+                        e->hole_end = o;
+                else {
+                        o = lseek(e->input_fd, pos, SEEK_HOLE);
+                        e->data_end = o < 0 ? UINT64_MAX : (uint64_t) o;
+                }
+
+                if (lseek(e->input_fd, pos, SEEK_SET) == (off_t) -1)
+                        return -errno;
+        }
+
+        if (pos < e->hole_end) {
+                size_t n;
+
+                n = MIN(size, e->hole_end - pos);
+                memzero(buf, n);
+
+                if (lseek(e->input_fd, pos + n, SEEK_SET) == (off_t) -1)
+                        return -errno;
+
+                return n;
+        }
+
+        l = read(e->input_fd, buf, MIN(size, e->data_end - pos));
+        if (l < 0)
+                return -errno;
+
+        return l;
+}
+
 static int raw_export_process(RawExport *e) {
         ssize_t l;
         int r;
@@ -154,6 +221,18 @@ static int raw_export_process(RawExport *e) {
                 e->tried_reflink = true;
         }
 
+        if (e->output_regular && e->compress.type == IMPORT_COMPRESS_UNCOMPRESSED) {
+
+                /* If we write to a regular file, let copy_bytes() reflink or copy the data extents in
+                 * the kernel, and only seek over the holes, so that the copy stays sparse. */
+
+                r = copy_bytes_full(e->input_fd, e->output_fd, UINT64_MAX, COPY_REFLINK|COPY_HOLES,
+                                    NULL, NULL, raw_export_copy_progress, e);
+                if (r < 0)
+                        log_error_errno(r, "Failed to copy raw file: %m");
+                goto finish;
+        }
+
         if (!e->tried_sendfile && e->compress.type == IMPORT_COMPRESS_UNCOMPRESSED) {
 
                 l = sendfile(e->output_fd, e->input_fd, NULL, COPY_BUFFER_SIZE);
@@ -183,9 +262,9 @@ static int raw_export_process(RawExport *e) {
                         goto finish;
                 }
 
-                l = read(e->input_fd, input, sizeof(input));
+                l = raw_export_read(e, input, sizeof(input));
                 if (l < 0) {
-                        r = log_error_errno(errno, "Failed to read raw file: %m");
+                        r = log_error_errno((int) l, "Failed to read raw file: %m");
                         goto finish;
                 }
 
@@ -315,6 +394,8 @@ int raw_export_start(RawExport *e, const char *path, int fd, ImportCompressType
         if (r < 0)
                 return r;
 
+        e->output_regular = fd_verify_regular(fd) >= 0;
+
         r = sd_event_add_io(e->event, &e->output_event_source, fd, EPOLLOUT, raw_export_on_output, e);
         if (r == -EPERM) {
                 r = sd_event_add_defer(e->event, &e->output_event_source, raw_export_on_defer, e);
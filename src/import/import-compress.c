@@ -1,9 +1,79 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include "compress.h"
+#include "cpu-set-util.h"
 #include "import-compress.h"
 #include "string-table.h"
 #include "util.h"
 
+#define IMPORT_COMPRESS_THREADS_MAX 16U
+
+static unsigned import_compress_threads(void) {
+        unsigned n;
+        int r;
+
+        /* Unlike elsewhere, images are large and decompressing them is what we spend our time on, hence use
+         * one thread per CPU by default. */
+        if (compress_threads_from_env(&n) > 0)
+                return n;
+
+        r = cpus_in_affinity_mask();
+        if (r <= 0)
+                return 1;
+
+        return MIN((unsigned) r, IMPORT_COMPRESS_THREADS_MAX);
+}
+
+static lzma_ret import_xz_decoder_init(lzma_stream *s) {
+        unsigned threads;
+
+        assert(s);
+
+        threads = import_compress_threads();
+
+#if LZMA_VERSION >= UINT32_C(50040002)
+        if (threads > 1) {
+                /* This only helps for images made of several blocks, e.g. by "xz -T0" or by us, but costs
+                 * nothing otherwise. Don't use more than a quarter of the memory for the worker threads. */
+                lzma_mt mt = {
+                        .threads = threads,
+                        .flags = LZMA_TELL_UNSUPPORTED_CHECK | LZMA_CONCATENATED,
+                        .memlimit_threading = MAX(lzma_physmem() / 4, UINT64_C(1)),
+                        .memlimit_stop = UINT64_MAX,
+                };
+
+                if (lzma_stream_decoder_mt(s, &mt) == LZMA_OK)
+                        return LZMA_OK;
+
+                log_debug("Failed to initialize multi-threaded XZ decoder, using a single thread.");
+        }
+#endif
+
+        return lzma_stream_decoder(s, UINT64_MAX, LZMA_TELL_UNSUPPORTED_CHECK | LZMA_CONCATENATED);
+}
+
+static lzma_ret import_xz_encoder_init(lzma_stream *s) {
+        unsigned threads;
+
+        assert(s);
+
+        threads = import_compress_threads();
+        if (threads > 1) {
+                lzma_mt mt = {
+                        .threads = threads,
+                        .preset = LZMA_PRESET_DEFAULT,
+                        .check = LZMA_CHECK_CRC64,
+                };
+
+                if (lzma_stream_encoder_mt(s, &mt) == LZMA_OK)
+                        return LZMA_OK;
+
+                log_debug("Failed to initialize multi-threaded XZ encoder, using a single thread.");
+        }
+
+        return lzma_easy_encoder(s, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
+}
+
 void import_compress_free(ImportCompress *c) {
         assert(c);
 
@@ -54,7 +124,7 @@ int import_uncompress_detect(ImportCompress *c, const void *data, size_t size) {
         if (memcmp(data, xz_signature, sizeof(xz_signature)) == 0) {
                 lzma_ret xzr;
 
-                xzr = lzma_stream_decoder(&c->xz, UINT64_MAX, LZMA_TELL_UNSUPPORTED_CHECK | LZMA_CONCATENATED);
+                xzr = import_xz_decoder_init(&c->xz);
                 if (xzr != LZMA_OK)
                         return -EIO;
 
@@ -206,7 +276,7 @@ int import_compress_init(ImportCompress *c, ImportCompressType t) {
         case IMPORT_COMPRESS_XZ: {
                 lzma_ret xzr;
 
-                xzr = lzma_easy_encoder(&c->xz, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
+                xzr = import_xz_encoder_init(&c->xz);
                 if (xzr != LZMA_OK)
                         return -EIO;
 
@@ -311,7 +311,17 @@ static int raw_import_open_disk(RawImport *i) {
         return 0;
 }
 
-static int raw_import_try_reflink(RawImport *i) {
+static int raw_import_copy_progress(uint64_t n_bytes, void *userdata) {
+        RawImport *i = ASSERT_PTR(userdata);
+
+        i->written_compressed += n_bytes;
+        i->written_uncompressed += n_bytes;
+
+        raw_import_report_progress(i);
+        return 0;
+}
+
+static int raw_import_try_copy(RawImport *i) {
         off_t p;
         int r;
 
@@ -332,16 +342,33 @@ static int raw_import_try_reflink(RawImport *i) {
         if (p == (off_t) -1)
                 return log_error_errno(errno, "Failed to read file offset of input file: %m");
 
-        /* Let's only try a btrfs reflink, if we are reading from the beginning of the file */
+        /* Let's only try this, if we are reading from the beginning of the file */
         if ((uint64_t) p != (uint64_t) i->buffer_size)
                 return 0;
 
         r = btrfs_reflink(i->input_fd, i->output_fd);
-        if (r >= 0)
+        if (r >= 0) {
+                i->written_compressed = i->written_uncompressed = i->input_stat.st_size;
                 return 1;
+        }
 
-        log_debug_errno(r, "Couldn't establish reflink, using copy: %m");
-        return 0;
+        log_debug_errno(r, "Couldn't establish reflink, copying data extents: %m");
+
+        /* Both sides are regular files and nothing needs to be decoded, hence let copy_bytes() do the work:
+         * it reflinks or copies in the kernel where the file system allows, and skips holes in the source
+         * rather than reading and writing zeros. */
+        if (lseek(i->input_fd, 0, SEEK_SET) == (off_t) -1)
+                return log_error_errno(errno, "Failed to seek to beginning of input file: %m");
+
+        i->buffer_size = 0;
+
+        r = copy_bytes_full(i->input_fd, i->output_fd, UINT64_MAX, COPY_REFLINK|COPY_HOLES,
+                            NULL, NULL, raw_import_copy_progress, i);
+        if (r < 0)
+                return log_error_errno(r, "Failed to copy image: %m");
+
+        i->written_compressed = i->written_uncompressed = i->input_stat.st_size;
+        return 1;
 }
 
 static int raw_import_write(const void *p, size_t sz, void *userdata) {
@@ -431,7 +458,7 @@ static int raw_import_process(RawImport *i) {
                 if (r < 0)
                         goto finish;
 
-                r = raw_import_try_reflink(i);
+                r = raw_import_try_copy(i);
                 if (r < 0)
                         goto finish;
                 if (r > 0)
@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/stat.h>
 #include <sys/xattr.h>
 
@@ -15,11 +17,229 @@
 #include "parse-util.h"
 #include "pull-common.h"
 #include "pull-job.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "sync-util.h"
 #include "xattr-util.h"
 
+/* Downloading in parallel is only worth it for large files, which are then fetched in segments of this size.
+ * Segments which completed before the ones preceding them are kept in memory until they can be written. */
+#define PULL_JOB_PARALLEL_MIN (64U * 1024U * 1024U)
+#define PULL_JOB_SEGMENT_SIZE (16U * 1024U * 1024U)
+#define PULL_JOB_PARALLEL_DEFAULT 4U
+#define PULL_JOB_PARALLEL_MAX 16U
+
+/* If the worker thread falls behind by this much, the transfers wait for it */
+#define PULL_PIPELINE_QUEUED_MAX (32U * 1024U * 1024U)
+
+typedef struct PullChunk PullChunk;
+
+struct PullChunk {
+        PullChunk *next;
+        size_t size;
+        uint8_t data[];
+};
+
+struct PullPipeline {
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        PullChunk *head, *tail;
+        size_t queued;
+
+        bool eof;
+        int error;
+};
+
+static int pull_job_complete(PullJob *j);
+static int pull_job_process_compressed(PullJob *j, const void *p, size_t sz);
+static int pull_job_write_compressed(PullJob *j, void *p, size_t sz);
+
+static unsigned pull_job_parallel_from_env(void) {
+        const char *e;
+        unsigned n;
+
+        e = getenv("SYSTEMD_IMPORT_PARALLEL");
+        if (!e)
+                return PULL_JOB_PARALLEL_DEFAULT;
+
+        if (safe_atou(e, &n) < 0 || n == 0) {
+                log_debug("Failed to parse $SYSTEMD_IMPORT_PARALLEL, ignoring: %s", e);
+                return PULL_JOB_PARALLEL_DEFAULT;
+        }
+
+        return MIN(n, PULL_JOB_PARALLEL_MAX);
+}
+
+static void pull_job_free_segments(PullJob *j) {
+        assert(j);
+
+        for (size_t i = 0; i < j->n_segments; i++)
+                pull_job_unref(j->segments[i]);
+
+        j->segments = mfree(j->segments);
+        j->n_segments = 0;
+}
+
+static void* pull_pipeline_thread(void *userdata) {
+        PullJob *j = ASSERT_PTR(userdata);
+        PullPipeline *p = ASSERT_PTR(j->pipeline);
+
+        for (;;) {
+                _cleanup_free_ PullChunk *c = NULL;
+                int r;
+
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+                while (!p->head && !p->eof)
+                        assert_se(pthread_cond_wait(&p->cond, &p->mutex) == 0);
+
+                c = p->head;
+                if (c) {
+                        p->head = c->next;
+                        if (!p->head)
+                                p->tail = NULL;
+                        p->queued -= c->size;
+
+                        /* There's room in the queue again */
+                        assert_se(pthread_cond_broadcast(&p->cond) == 0);
+                }
+
+                r = p->error;
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+                if (!c) /* End of stream, and everything written */
+                        break;
+                if (r < 0) /* Failed or cancelled, just drop the rest */
+                        continue;
+
+                r = pull_job_process_compressed(j, c->data, c->size);
+                if (r < 0) {
+                        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+                        if (p->error >= 0)
+                                p->error = r;
+                        assert_se(pthread_cond_broadcast(&p->cond) == 0);
+                        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+                }
+        }
+
+        return NULL;
+}
+
+static int pull_job_pipeline_start(PullJob *j) {
+        _cleanup_free_ PullPipeline *p = NULL;
+        sigset_t ss, saved_ss;
+        int r;
+
+        assert(j);
+        assert(!j->pipeline);
+
+        p = new(PullPipeline, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (PullPipeline) {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+        };
+
+        /* The worker never needs to handle signals, leave them all to the event loop */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r != 0)
+                return -r;
+
+        j->pipeline = p;
+        r = pthread_create(&p->thread, NULL, pull_pipeline_thread, j);
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+        if (r != 0) {
+                j->pipeline = NULL;
+                return -r;
+        }
+
+        TAKE_PTR(p);
+        return 0;
+}
+
+static int pull_job_pipeline_stop(PullJob *j, bool cancel) {
+        PullPipeline *p;
+        int r;
+
+        assert(j);
+
+        /* Waits until the worker wrote everything queued (or dropped it, if cancel is true), and returns
+         * the first error it ran into. */
+
+        p = j->pipeline;
+        if (!p)
+                return 0;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        p->eof = true;
+        if (cancel && p->error >= 0)
+                p->error = -ECANCELED;
+        assert_se(pthread_cond_broadcast(&p->cond) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        assert_se(pthread_join(p->thread, NULL) == 0);
+        assert(!p->head);
+
+        r = p->error;
+
+        assert_se(pthread_cond_destroy(&p->cond) == 0);
+        assert_se(pthread_mutex_destroy(&p->mutex) == 0);
+        j->pipeline = mfree(p);
+
+        return cancel ? 0 : r;
+}
+
+static int pull_pipeline_push(PullPipeline *p, const void *data, size_t sz) {
+        PullChunk *c;
+        int r;
+
+        assert(p);
+        assert(data);
+
+        c = malloc(offsetof(PullChunk, data) + sz);
+        if (!c)
+                return -ENOMEM;
+
+        c->next = NULL;
+        c->size = sz;
+        memcpy(c->data, data, sz);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        /* If the worker can't keep up, wait for it rather than buffering without bounds */
+        while (p->queued >= PULL_PIPELINE_QUEUED_MAX && p->error >= 0)
+                assert_se(pthread_cond_wait(&p->cond, &p->mutex) == 0);
+
+        r = p->error;
+        if (r >= 0) {
+                if (p->tail)
+                        p->tail->next = c;
+                else
+                        p->head = c;
+                p->tail = c;
+                p->queued += sz;
+
+                assert_se(pthread_cond_broadcast(&p->cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        if (r < 0) {
+                free(c);
+                return r; /* Already logged by the worker */
+        }
+
+        return 0;
+}
+
 void pull_job_close_disk_fd(PullJob *j) {
         if (!j)
                 return;
@@ -34,6 +254,8 @@ PullJob* pull_job_unref(PullJob *j) {
         if (!j)
                 return NULL;
 
+        (void) pull_job_pipeline_stop(j, /* cancel= */ true);
+        pull_job_free_segments(j);
         pull_job_close_disk_fd(j);
 
         curl_glue_remove_and_free(j->glue, j->curl);
@@ -53,6 +275,7 @@ PullJob* pull_job_unref(PullJob *j) {
         strv_free(j->old_etags);
         free(j->payload);
         free(j->checksum);
+        free(j->range_url);
 
         return mfree(j);
 }
@@ -63,6 +286,10 @@ static void pull_job_finish(PullJob *j, int ret) {
         if (IN_SET(j->state, PULL_JOB_DONE, PULL_JOB_FAILED))
                 return;
 
+        /* Make sure nothing is written anymore once we report back, and stop the remaining transfers */
+        (void) pull_job_pipeline_stop(j, /* cancel= */ ret != 0);
+        pull_job_free_segments(j);
+
         if (ret == 0) {
                 j->state = PULL_JOB_DONE;
                 j->progress_percent = 100;
@@ -86,6 +313,12 @@ static int pull_job_restart(PullJob *j, const char *new_url) {
         if (r < 0)
                 return r;
 
+        (void) pull_job_pipeline_stop(j, /* cancel= */ true);
+        pull_job_free_segments(j);
+        j->accept_ranges = j->segmented = j->main_done = false;
+        j->main_received = j->main_end = j->next_segment = 0;
+        j->range_url = mfree(j->range_url);
+
         j->state = PULL_JOB_INIT;
         j->error = 0;
         j->payload = mfree(j->payload);
@@ -122,6 +355,391 @@ static int pull_job_restart(PullJob *j, const char *new_url) {
         return 0;
 }
 
+static int pull_job_complete(PullJob *j) {
+        int r;
+
+        assert(j);
+
+        /* Called when all data was received, either by the main transfer alone, or together with the
+         * segments. Waits for the worker to write everything out, then finalizes the checksum and file. */
+
+        r = pull_job_pipeline_stop(j, /* cancel= */ false);
+        if (r < 0)
+                return r;
+
+        if (j->state != PULL_JOB_RUNNING)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO), "Premature connection termination.");
+
+        if (j->content_length != UINT64_MAX &&
+            j->content_length != j->written_compressed)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO), "Download truncated.");
+
+        if (j->checksum_ctx) {
+                unsigned checksum_len;
+#if PREFER_OPENSSL
+                uint8_t k[EVP_MAX_MD_SIZE];
+
+                r = EVP_DigestFinal_ex(j->checksum_ctx, k, &checksum_len);
+                if (r == 0)
+                        return log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to get checksum.");
+                assert(checksum_len <= sizeof k);
+#else
+                const uint8_t *k;
+
+                k = gcry_md_read(j->checksum_ctx, GCRY_MD_SHA256);
+                if (!k)
+                        return log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to get checksum.");
+
+                checksum_len = gcry_md_get_algo_dlen(GCRY_MD_SHA256);
+#endif
+
+                j->checksum = hexmem(k, checksum_len);
+                if (!j->checksum)
+                        return log_oom();
+
+                log_debug("SHA256 of %s is %s.", j->url, j->checksum);
+        }
+
+        /* Do a couple of finishing disk operations, but only if we are the sole owner of the file (i.e. no
+         * offset is specified, which indicates we only own the file partially) */
+
+        if (j->disk_fd >= 0) {
+
+                if (S_ISREG(j->disk_stat.st_mode)) {
+
+                        if (j->offset == UINT64_MAX) {
+
+                                if (j->written_compressed > 0) {
+                                        /* Make sure the file size is right, in case the file was sparse and we just seeked
+                                         * for the last part */
+                                        if (ftruncate(j->disk_fd, j->written_uncompressed) < 0)
+                                                return log_error_errno(errno, "Failed to truncate file: %m");
+                                }
+
+                                if (j->etag)
+                                        (void) fsetxattr(j->disk_fd, "user.source_etag", j->etag, strlen(j->etag), 0);
+                                if (j->url)
+                                        (void) fsetxattr(j->disk_fd, "user.source_url", j->url, strlen(j->url), 0);
+
+                                if (j->mtime != 0) {
+                                        struct timespec ut;
+
+                                        timespec_store(&ut, j->mtime);
+
+                                        if (futimens(j->disk_fd, (struct timespec[]) { ut, ut }) < 0)
+                                                log_debug_errno(errno, "Failed to adjust atime/mtime of created image, ignoring: %m");
+
+                                        r = fd_setcrtime(j->disk_fd, j->mtime);
+                                        if (r < 0)
+                                                log_debug_errno(r, "Failed to adjust crtime of created image, ignoring: %m");
+                                }
+                        }
+
+                        if (j->sync) {
+                                r = fsync_full(j->disk_fd);
+                                if (r < 0)
+                                        return log_error_errno(r, "Failed to synchronize file to disk: %m");
+                        }
+
+                } else if (S_ISBLK(j->disk_stat.st_mode) && j->sync) {
+
+                        if (fsync(j->disk_fd) < 0)
+                                return log_error_errno(errno, "Failed to synchronize block device: %m");
+                }
+        }
+
+
+        log_info("Acquired %s.", FORMAT_BYTES(j->written_uncompressed));
+
+        return 0;
+}
+
+static size_t pull_job_segment_header_callback(void *contents, size_t size, size_t nmemb, void *userdata) {
+        _cleanup_free_ char *range = NULL;
+        char expected[STRLEN("bytes --/") + DECIMAL_STR_MAX(uint64_t) * 3];
+        size_t sz = size * nmemb;
+        PullJob *s = ASSERT_PTR(userdata);
+        CURLcode code;
+        long status;
+        int r;
+
+        assert(contents);
+        assert(s->parent);
+
+        r = curl_header_strdup(contents, sz, "Content-Range:", &range);
+        if (r < 0) {
+                s->error = log_oom();
+                return 0;
+        }
+        if (r == 0)
+                return sz;
+
+        code = curl_easy_getinfo(s->curl, CURLINFO_RESPONSE_CODE, &status);
+        if (code != CURLE_OK) {
+                s->error = log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to retrieve response code: %s", curl_easy_strerror(code));
+                return 0;
+        }
+
+        /* Make sure we got exactly the range we asked for, of the file we started with. If the file
+         * changed in the meantime, If-Range: makes the server send all of it with 200 instead. */
+        xsprintf(expected, "bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64,
+                 s->segment_start, s->segment_end - 1, s->parent->content_length);
+
+        if (status != 206 || !streq(range, expected)) {
+                s->error = log_error_errno(SYNTHETIC_ERRNO(EIO),
+                                           "Unexpected response to range request for %s (status %li, range '%s'), refusing.",
+                                           s->url, status, range);
+                return 0;
+        }
+
+        s->range_verified = true;
+        return sz;
+}
+
+static size_t pull_job_segment_write_callback(void *contents, size_t size, size_t nmemb, void *userdata) {
+        size_t sz = size * nmemb;
+        PullJob *s = ASSERT_PTR(userdata);
+
+        assert(contents);
+        assert(s->parent);
+
+        if (!s->range_verified) {
+                s->error = log_error_errno(SYNTHETIC_ERRNO(EIO), "Server did not honour range request for %s, refusing.", s->url);
+                return 0;
+        }
+
+        if (s->payload_size + sz > s->segment_end - s->segment_start) {
+                s->error = log_error_errno(SYNTHETIC_ERRNO(EFBIG), "Got more data than requested for range of %s, refusing.", s->url);
+                return 0;
+        }
+
+        if (!GREEDY_REALLOC(s->payload, s->payload_size + sz)) {
+                s->error = log_oom();
+                return 0;
+        }
+
+        memcpy(s->payload + s->payload_size, contents, sz);
+        s->payload_size += sz;
+
+        return sz;
+}
+
+static int pull_job_segment_new(PullJob *j, uint64_t start, uint64_t end, PullJob **ret) {
+        _cleanup_(pull_job_unrefp) PullJob *s = NULL;
+        char range[DECIMAL_STR_MAX(uint64_t) * 2 + 1];
+        int r;
+
+        assert(j);
+        assert(j->range_url);
+        assert(start < end);
+        assert(ret);
+
+        r = pull_job_new(&s, j->range_url, j->glue, NULL);
+        if (r < 0)
+                return r;
+
+        s->parent = j;
+        s->segment_start = start;
+        s->segment_end = end;
+
+        r = curl_glue_make(&s->curl, s->url, s);
+        if (r < 0)
+                return r;
+
+        xsprintf(range, "%" PRIu64 "-%" PRIu64, start, end - 1);
+        if (curl_easy_setopt(s->curl, CURLOPT_RANGE, range) != CURLE_OK)
+                return -EIO;
+
+        /* Weak ETags can't be used for range requests */
+        if (j->etag && !startswith(j->etag, "W/")) {
+                _cleanup_free_ char *hdr = NULL;
+
+                hdr = strjoin("If-Range: ", j->etag);
+                if (!hdr)
+                        return -ENOMEM;
+
+                s->request_header = curl_slist_new(hdr, NULL);
+                if (!s->request_header)
+                        return -ENOMEM;
+
+                if (curl_easy_setopt(s->curl, CURLOPT_HTTPHEADER, s->request_header) != CURLE_OK)
+                        return -EIO;
+        }
+
+        if (curl_easy_setopt(s->curl, CURLOPT_WRITEFUNCTION, pull_job_segment_write_callback) != CURLE_OK)
+                return -EIO;
+
+        if (curl_easy_setopt(s->curl, CURLOPT_WRITEDATA, s) != CURLE_OK)
+                return -EIO;
+
+        if (curl_easy_setopt(s->curl, CURLOPT_HEADERFUNCTION, pull_job_segment_header_callback) != CURLE_OK)
+                return -EIO;
+
+        if (curl_easy_setopt(s->curl, CURLOPT_HEADERDATA, s) != CURLE_OK)
+                return -EIO;
+
+        r = curl_glue_add(s->glue, s->curl);
+        if (r < 0)
+                return r;
+
+        s->state = PULL_JOB_RUNNING;
+
+        *ret = TAKE_PTR(s);
+        return 0;
+}
+
+static int pull_job_start_segments(PullJob *j) {
+        int r;
+
+        assert(j);
+
+        /* Keeps up to n_parallel transfers going: the main one until it reached its end, and the segments */
+
+        while (j->next_segment < j->content_length &&
+               j->n_segments + !j->main_done < j->n_parallel) {
+                uint64_t end;
+                PullJob *s;
+
+                end = MIN(j->next_segment + PULL_JOB_SEGMENT_SIZE, j->content_length);
+
+                if (!GREEDY_REALLOC(j->segments, j->n_segments + 1))
+                        return log_oom();
+
+                r = pull_job_segment_new(j, j->next_segment, end, &s);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to start range request for %s: %m", j->range_url);
+
+                j->segments[j->n_segments++] = s;
+                j->next_segment = end;
+        }
+
+        return 0;
+}
+
+static int pull_job_maybe_segment(PullJob *j) {
+        const char *url;
+        CURLcode code;
+        long protocol, status;
+        int r;
+
+        assert(j);
+        assert(!j->parent);
+
+        /* Called on the first data we receive. If the server told us it can do ranges, and there's a lot
+         * to download, limit the main transfer to the first segment and fetch the rest in parallel. */
+
+        if (j->n_parallel <= 1 ||
+            !j->accept_ranges ||
+            j->content_length == UINT64_MAX ||
+            j->content_length < PULL_JOB_PARALLEL_MIN)
+                return 0;
+
+        if (curl_easy_getinfo(j->curl, CURLINFO_PROTOCOL, &protocol) != CURLE_OK ||
+            !IN_SET(protocol, CURLPROTO_HTTP, CURLPROTO_HTTPS))
+                return 0;
+
+        if (curl_easy_getinfo(j->curl, CURLINFO_RESPONSE_CODE, &status) != CURLE_OK ||
+            status != 200)
+                return 0;
+
+        /* Ask for the segments where we ended up after redirects, so that all of them come from the
+         * same place */
+        code = curl_easy_getinfo(j->curl, CURLINFO_EFFECTIVE_URL, &url);
+        if (code != CURLE_OK || !url)
+                return 0;
+
+        r = free_and_strdup(&j->range_url, url);
+        if (r < 0)
+                return log_oom();
+
+        j->segmented = true;
+        j->main_end = j->next_segment = PULL_JOB_SEGMENT_SIZE;
+
+        log_info("Downloading %s with up to %u connections.", j->url, j->n_parallel);
+
+        return pull_job_start_segments(j);
+}
+
+static void pull_job_segments_progress(PullJob *j) {
+        unsigned percent;
+        usec_t n;
+
+        assert(j);
+
+        percent = (unsigned) (100 * j->written_compressed / j->content_length);
+        n = now(CLOCK_MONOTONIC);
+
+        if (n <= j->last_status_usec + USEC_PER_SEC || percent == j->progress_percent)
+                return;
+
+        log_info("Got %u%% of %s.", percent, j->url);
+
+        j->progress_percent = percent;
+        j->last_status_usec = n;
+
+        if (j->on_progress)
+                j->on_progress(j);
+}
+
+static int pull_job_dispatch_segments(PullJob *j) {
+        int r;
+
+        assert(j);
+        assert(j->segmented);
+
+        /* Feeds all segments which are complete and next in line into the job, and starts new ones */
+
+        while (j->main_done && j->n_segments > 0 && j->segments[0]->state == PULL_JOB_DONE) {
+                PullJob *s = j->segments[0];
+
+                assert(s->segment_start == j->written_compressed);
+
+                r = pull_job_write_compressed(j, s->payload, s->payload_size);
+
+                pull_job_unref(s);
+                memmove(j->segments, j->segments + 1, sizeof(PullJob*) * (j->n_segments - 1));
+                j->n_segments--;
+
+                if (r < 0)
+                        return r;
+        }
+
+        if (j->main_done)
+                pull_job_segments_progress(j);
+
+        r = pull_job_start_segments(j);
+        if (r < 0)
+                return r;
+
+        if (j->main_done && j->n_segments == 0 && j->next_segment >= j->content_length)
+                pull_job_finish(j, pull_job_complete(j));
+
+        return 0;
+}
+
+static void pull_job_segment_on_finished(PullJob *s, CURLcode result) {
+        PullJob *j;
+        int r;
+
+        assert(s);
+
+        j = ASSERT_PTR(s->parent);
+
+        if (result != CURLE_OK)
+                r = s->error < 0 ? s->error :
+                        log_error_errno(SYNTHETIC_ERRNO(EIO), "Transfer of range of %s failed: %s", s->url, curl_easy_strerror(result));
+        else if (s->payload_size != s->segment_end - s->segment_start)
+                r = log_error_errno(SYNTHETIC_ERRNO(EIO), "Range of %s truncated.", s->url);
+        else {
+                s->state = PULL_JOB_DONE;
+                r = pull_job_dispatch_segments(j);
+        }
+
+        /* Note that this frees the segment */
+        if (r < 0)
+                pull_job_finish(j, r);
+}
+
 void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
         PullJob *j = NULL;
         CURLcode code;
@@ -134,6 +752,28 @@ void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
         if (!j || IN_SET(j->state, PULL_JOB_DONE, PULL_JOB_FAILED))
                 return;
 
+        if (j->parent) {
+                pull_job_segment_on_finished(j, result);
+                return;
+        }
+
+        if (j->segmented && j->main_received == j->main_end && IN_SET(result, CURLE_OK, CURLE_WRITE_ERROR)) {
+                /* We stopped the main transfer ourselves once it reached the first segment's end, the
+                 * segment jobs take care of the rest. */
+                if (j->state != PULL_JOB_RUNNING) {
+                        r = log_error_errno(SYNTHETIC_ERRNO(EIO), "Premature connection termination.");
+                        goto finish;
+                }
+
+                j->main_done = true;
+
+                r = pull_job_dispatch_segments(j);
+                if (r < 0)
+                        goto finish;
+
+                return;
+        }
+
         if (result != CURLE_OK) {
                 r = log_error_errno(SYNTHETIC_ERRNO(EIO), "Transfer failed: %s", curl_easy_strerror(result));
                 goto finish;
@@ -197,106 +837,7 @@ void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
                 }
         }
 
-        if (j->state != PULL_JOB_RUNNING) {
-                r = log_error_errno(SYNTHETIC_ERRNO(EIO), "Premature connection termination.");
-                goto finish;
-        }
-
-        if (j->content_length != UINT64_MAX &&
-            j->content_length != j->written_compressed) {
-                r = log_error_errno(SYNTHETIC_ERRNO(EIO), "Download truncated.");
-                goto finish;
-        }
-
-        if (j->checksum_ctx) {
-                unsigned checksum_len;
-#if PREFER_OPENSSL
-                uint8_t k[EVP_MAX_MD_SIZE];
-
-                r = EVP_DigestFinal_ex(j->checksum_ctx, k, &checksum_len);
-                if (r == 0) {
-                        r = log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to get checksum.");
-                        goto finish;
-                }
-                assert(checksum_len <= sizeof k);
-#else
-                const uint8_t *k;
-
-                k = gcry_md_read(j->checksum_ctx, GCRY_MD_SHA256);
-                if (!k) {
-                        r = log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to get checksum.");
-                        goto finish;
-                }
-
-                checksum_len = gcry_md_get_algo_dlen(GCRY_MD_SHA256);
-#endif
-
-                j->checksum = hexmem(k, checksum_len);
-                if (!j->checksum) {
-                        r = log_oom();
-                        goto finish;
-                }
-
-                log_debug("SHA256 of %s is %s.", j->url, j->checksum);
-        }
-
-        /* Do a couple of finishing disk operations, but only if we are the sole owner of the file (i.e. no
-         * offset is specified, which indicates we only own the file partially) */
-
-        if (j->disk_fd >= 0) {
-
-                if (S_ISREG(j->disk_stat.st_mode)) {
-
-                        if (j->offset == UINT64_MAX) {
-
-                                if (j->written_compressed > 0) {
-                                        /* Make sure the file size is right, in case the file was sparse and we just seeked
-                                         * for the last part */
-                                        if (ftruncate(j->disk_fd, j->written_uncompressed) < 0) {
-                                                r = log_error_errno(errno, "Failed to truncate file: %m");
-                                                goto finish;
-                                        }
-                                }
-
-                                if (j->etag)
-                                        (void) fsetxattr(j->disk_fd, "user.source_etag", j->etag, strlen(j->etag), 0);
-                                if (j->url)
-                                        (void) fsetxattr(j->disk_fd, "user.source_url", j->url, strlen(j->url), 0);
-
-                                if (j->mtime != 0) {
-                                        struct timespec ut;
-
-                                        timespec_store(&ut, j->mtime);
-
-                                        if (futimens(j->disk_fd, (struct timespec[]) { ut, ut }) < 0)
-                                                log_debug_errno(errno, "Failed to adjust atime/mtime of created image, ignoring: %m");
-
-                                        r = fd_setcrtime(j->disk_fd, j->mtime);
-                                        if (r < 0)
-                                                log_debug_errno(r, "Failed to adjust crtime of created image, ignoring: %m");
-                                }
-                        }
-
-                        if (j->sync) {
-                                r = fsync_full(j->disk_fd);
-                                if (r < 0) {
-                                        log_error_errno(r, "Failed to synchronize file to disk: %m");
-                                        goto finish;
-                                }
-                        }
-
-                } else if (S_ISBLK(j->disk_stat.st_mode) && j->sync) {
-
-                        if (fsync(j->disk_fd) < 0) {
-                                r = log_error_errno(errno, "Failed to synchronize block device: %m");
-                                goto finish;
-                        }
-                }
-        }
-
-        log_info("Acquired %s.", FORMAT_BYTES(j->written_uncompressed));
-
-        r = 0;
+        r = pull_job_complete(j);
 
 finish:
         pull_job_finish(j, r);
@@ -360,6 +901,29 @@ finish:
         return 0;
 }
 
+static int pull_job_process_compressed(PullJob *j, const void *p, size_t sz) {
+        int r;
+
+        assert(j);
+        assert(p);
+
+        /* Hashes and decompresses a chunk of the download. This runs on the pipeline thread if there is
+         * one, and is never called concurrently for the same job. */
+
+        if (j->checksum_ctx) {
+#if PREFER_OPENSSL
+                r = EVP_DigestUpdate(j->checksum_ctx, p, sz);
+                if (r == 0)
+                        return log_error_errno(SYNTHETIC_ERRNO(EIO),
+                                               "Could not hash chunk.");
+#else
+                gcry_md_write(j->checksum_ctx, p, sz);
+#endif
+        }
+
+        return import_uncompress(&j->compress, p, sz, pull_job_write_uncompressed, j);
+}
+
 static int pull_job_write_compressed(PullJob *j, void *p, size_t sz) {
         int r;
 
@@ -380,18 +944,10 @@ static int pull_job_write_compressed(PullJob *j, void *p, size_t sz) {
                 return log_error_errno(SYNTHETIC_ERRNO(EFBIG),
                                        "Content length incorrect.");
 
-        if (j->checksum_ctx) {
-#if PREFER_OPENSSL
-                r = EVP_DigestUpdate(j->checksum_ctx, p, sz);
-                if (r == 0)
-                        return log_error_errno(SYNTHETIC_ERRNO(EIO),
-                                               "Could not hash chunk.");
-#else
-                gcry_md_write(j->checksum_ctx, p, sz);
-#endif
-        }
-
-        r = import_uncompress(&j->compress, p, sz, pull_job_write_uncompressed, j);
+        if (j->pipeline)
+                r = pull_pipeline_push(j->pipeline, p, sz);
+        else
+                r = pull_job_process_compressed(j, p, sz);
         if (r < 0)
                 return r;
 
@@ -440,6 +996,14 @@ static int pull_job_open_disk(PullJob *j) {
 #endif
         }
 
+        /* Hash, decompress and write to disk on a separate thread, so that we can keep receiving while
+         * that happens. Not fatal, we'll just do it all inline then. */
+        if (j->disk_fd >= 0) {
+                r = pull_job_pipeline_start(j);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to start decompression thread, processing download inline: %m");
+        }
+
         return 0;
 }
 
@@ -481,12 +1045,26 @@ static int pull_job_detect_compression(PullJob *j) {
 
 static size_t pull_job_write_callback(void *contents, size_t size, size_t nmemb, void *userdata) {
         PullJob *j = userdata;
-        size_t sz = size * nmemb;
+        size_t sz = size * nmemb, full = sz;
         int r;
 
         assert(contents);
         assert(j);
 
+        if (j->state == PULL_JOB_ANALYZING && j->payload_size == 0 && !j->segmented) {
+                r = pull_job_maybe_segment(j);
+                if (r < 0)
+                        goto fail;
+        }
+
+        if (j->segmented) {
+                /* The main transfer only delivers the first segment, the rest is fetched with range
+                 * requests. Once we have everything we asked for, return a short count to abort it. */
+                full = sz;
+                sz = MIN(sz, j->main_end - j->main_received);
+                j->main_received += sz;
+        }
+
         switch (j->state) {
 
         case PULL_JOB_ANALYZING:
@@ -523,6 +1101,9 @@ static size_t pull_job_write_callback(void *contents, size_t size, size_t nmemb,
                 assert_not_reached();
         }
 
+        if (sz < full)
+                return 0;
+
         return sz;
 
 fail:
@@ -541,7 +1122,7 @@ static int http_status_etag_exists(CURLcode status) {
 }
 
 static size_t pull_job_header_callback(void *contents, size_t size, size_t nmemb, void *userdata) {
-        _cleanup_free_ char *length = NULL, *last_modified = NULL, *etag = NULL;
+        _cleanup_free_ char *length = NULL, *last_modified = NULL, *etag = NULL, *ranges = NULL;
         size_t sz = size * nmemb;
         PullJob *j = userdata;
         CURLcode code;
@@ -610,6 +1191,16 @@ static size_t pull_job_header_callback(void *contents, size_t size, size_t nmemb
                 return sz;
         }
 
+        r = curl_header_strdup(contents, sz, "Accept-Ranges:", &ranges);
+        if (r < 0) {
+                log_oom();
+                goto fail;
+        }
+        if (r > 0) {
+                j->accept_ranges = streq(ranges, "bytes");
+                return sz;
+        }
+
         r = curl_header_strdup(contents, sz, "Last-Modified:", &last_modified);
         if (r < 0) {
                 log_oom();
@@ -640,6 +1231,10 @@ static int pull_job_progress_callback(void *userdata, curl_off_t dltotal, curl_o
 
         assert(j);
 
+        /* Progress of segmented downloads is reported as the segments are processed */
+        if (j->segmented)
+                return 0;
+
         if (dltotal <= 0)
                 return 0;
 
@@ -708,6 +1303,7 @@ int pull_job_new(
                 .url = TAKE_PTR(u),
                 .offset = UINT64_MAX,
                 .sync = true,
+                .n_parallel = pull_job_parallel_from_env(),
         };
 
         *ret = TAKE_PTR(j);
@@ -10,6 +10,7 @@
 #include "pull-common.h"
 
 typedef struct PullJob PullJob;
+typedef struct PullPipeline PullPipeline;
 
 typedef void (*PullJobFinished)(PullJob *job);
 typedef int (*PullJobOpenDisk)(PullJob *job);
@@ -79,6 +80,29 @@ struct PullJob {
         char *checksum;
         bool sync;
         bool force_memory;
+
+        /* If the server supports range requests and the file is large, the main transfer only fetches the
+         * first segment, and the rest is fetched by up to n_parallel segment jobs at a time. Their data is
+         * fed into this job strictly in order, so that checksums and decompression work as before. */
+        unsigned n_parallel;
+        bool accept_ranges;
+        bool segmented;
+        bool main_done;
+        uint64_t main_received;
+        uint64_t main_end;
+        uint64_t next_segment;
+        char *range_url;
+        PullJob **segments;
+        size_t n_segments;
+
+        /* Only set for segment jobs */
+        PullJob *parent;
+        uint64_t segment_start;
+        uint64_t segment_end;
+        bool range_verified;
+
+        /* Checksumming, decompression and writing to disk happen on a worker thread, if set */
+        PullPipeline *pipeline;
 };
 
 int pull_job_new(PullJob **job, const char *url, CurlGlue *glue, void *userdata);
@@ -4,6 +4,7 @@
 
 #include "alloc-util.h"
 #include "btrfs-util.h"
+#include "memory-util.h"
 #include "qcow2-util.h"
 #include "sparse-endian.h"
 #include "util.h"
@@ -80,6 +81,10 @@ static int copy_cluster(
         if ((uint64_t) l != cluster_size)
                 return -EIO;
 
+        /* The target was truncated, i.e. is all holes, no need to write zeros */
+        if (memeqzero(buffer, cluster_size))
+                return 0;
+
         l = pwrite(dfd, buffer, cluster_size, doffset);
         if (l < 0)
                 return -errno;
@@ -135,6 +140,9 @@ static int decompress_cluster(
         if (r != Z_STREAM_END || sz != cluster_size)
                 return -EIO;
 
+        if (memeqzero(buffer2, cluster_size))
+                return 0;
+
         l = pwrite(dfd, buffer2, cluster_size, doffset);
         if (l < 0)
                 return -errno;
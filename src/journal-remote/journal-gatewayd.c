@@ -8,6 +8,12 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "sd-bus.h"
 #include "sd-daemon.h"
@@ -16,6 +22,7 @@
 #include "alloc-util.h"
 #include "bus-util.h"
 #include "errno-util.h"
+#include "extract-word.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "glob-util.h"
@@ -29,11 +36,17 @@
 #include "parse-util.h"
 #include "pretty-print.h"
 #include "sigbus.h"
+#include "string-util.h"
 #include "tmpfile-util.h"
 #include "util.h"
 
 #define JOURNAL_WAIT_TIMEOUT (10*USEC_PER_SEC)
 
+/* Entries are serialized in batches of about this size, and handed to microhttpd in blocks of this size */
+#define ENTRIES_BATCH_SIZE (64U*1024U)
+
+#define COMPRESS_CHUNK_SIZE (16U*1024U)
+
 static char *arg_key_pem = NULL;
 static char *arg_cert_pem = NULL;
 static char *arg_trust_pem = NULL;
@@ -46,11 +59,36 @@ STATIC_DESTRUCTOR_REGISTER(arg_key_pem, erase_and_freep);
 STATIC_DESTRUCTOR_REGISTER(arg_cert_pem, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_trust_pem, freep);
 
+typedef enum ContentEncoding {
+        CONTENT_ENCODING_IDENTITY,
+        CONTENT_ENCODING_GZIP,
+        CONTENT_ENCODING_ZSTD,
+        _CONTENT_ENCODING_MAX,
+        _CONTENT_ENCODING_INVALID = -EINVAL,
+} ContentEncoding;
+
+typedef enum CompressFlush {
+        COMPRESS_CONTINUE,
+        COMPRESS_FLUSH,
+        COMPRESS_FINISH,
+} CompressFlush;
+
 typedef struct RequestMeta {
         sd_journal *journal;
 
         OutputMode mode;
 
+        ContentEncoding encoding;
+#if HAVE_ZLIB
+        z_stream gzip;
+#endif
+#if HAVE_ZSTD
+        ZSTD_CCtx *zstd;
+#endif
+        uint8_t *out; /* The compressed current batch */
+        size_t out_size;
+        bool finished;
+
         char *cursor;
         int64_t n_skip;
         uint64_t n_entries;
@@ -73,6 +111,12 @@ static const char* const mime_types[_OUTPUT_MODE_MAX] = {
         [OUTPUT_EXPORT] = "application/vnd.fdo.journal",
 };
 
+static const char* const content_encodings[_CONTENT_ENCODING_MAX] = {
+        [CONTENT_ENCODING_IDENTITY] = "identity",
+        [CONTENT_ENCODING_GZIP] = "gzip",
+        [CONTENT_ENCODING_ZSTD] = "zstd",
+};
+
 static RequestMeta *request_meta(void **connection_cls) {
         RequestMeta *m;
 
@@ -103,6 +147,15 @@ static void request_meta_free(
 
         safe_fclose(m->tmp);
 
+#if HAVE_ZLIB
+        if (m->encoding == CONTENT_ENCODING_GZIP)
+                deflateEnd(&m->gzip);
+#endif
+#if HAVE_ZSTD
+        ZSTD_freeCCtx(m->zstd);
+#endif
+        free(m->out);
+
         free(m->cursor);
         free(m);
 }
@@ -141,32 +194,133 @@ static int request_meta_ensure_tmp(RequestMeta *m) {
         return 0;
 }
 
-static ssize_t request_reader_entries(
-                void *cls,
-                uint64_t pos,
-                char *buf,
-                size_t max) {
+static int request_compress(RequestMeta *m, const void *data, size_t size, CompressFlush flush) {
+        assert(m);
+        assert(data || size == 0);
 
-        RequestMeta *m = cls;
+        switch (m->encoding) {
+
+#if HAVE_ZLIB
+        case CONTENT_ENCODING_GZIP: {
+                int f = flush == COMPRESS_FINISH ? Z_FINISH :
+                        flush == COMPRESS_FLUSH ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+
+                m->gzip.next_in = (Bytef*) data;
+                m->gzip.avail_in = size;
+
+                for (;;) {
+                        int r;
+
+                        if (!GREEDY_REALLOC(m->out, m->out_size + COMPRESS_CHUNK_SIZE))
+                                return -ENOMEM;
+
+                        m->gzip.next_out = m->out + m->out_size;
+                        m->gzip.avail_out = MALLOC_ELEMENTSOF(m->out) - m->out_size;
+
+                        r = deflate(&m->gzip, f);
+                        if (!IN_SET(r, Z_OK, Z_STREAM_END, Z_BUF_ERROR))
+                                return log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to compress data: %s", strna(m->gzip.msg));
+
+                        m->out_size = m->gzip.next_out - m->out;
+
+                        if (f == Z_FINISH ? r == Z_STREAM_END : m->gzip.avail_in == 0 && m->gzip.avail_out > 0)
+                                return 0;
+                }
+        }
+#endif
+
+#if HAVE_ZSTD
+        case CONTENT_ENCODING_ZSTD: {
+                ZSTD_EndDirective e = flush == COMPRESS_FINISH ? ZSTD_e_end :
+                                      flush == COMPRESS_FLUSH ? ZSTD_e_flush : ZSTD_e_continue;
+                ZSTD_inBuffer in = {
+                        .src = data,
+                        .size = size,
+                };
+
+                for (;;) {
+                        ZSTD_outBuffer out;
+                        size_t k;
+
+                        if (!GREEDY_REALLOC(m->out, m->out_size + COMPRESS_CHUNK_SIZE))
+                                return -ENOMEM;
+
+                        out = (ZSTD_outBuffer) {
+                                .dst = m->out + m->out_size,
+                                .size = MALLOC_ELEMENTSOF(m->out) - m->out_size,
+                        };
+
+                        k = ZSTD_compressStream2(m->zstd, &out, &in, e);
+                        if (ZSTD_isError(k))
+                                return log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to compress data: %s", ZSTD_getErrorName(k));
+
+                        m->out_size += out.pos;
+
+                        /* When flushing, zstd tells us how much is still pending, otherwise we are done once it
+                         * took all input */
+                        if (e == ZSTD_e_continue ? in.pos == in.size : k == 0)
+                                return 0;
+                }
+        }
+#endif
+
+        default:
+                assert_not_reached();
+        }
+}
+
+/* Compresses the current batch in m->tmp into m->out, and flushes the compressor, so that the client can
+ * decompress everything we sent so far, which matters when following. */
+static int request_compress_batch(RequestMeta *m, uint64_t size, bool finish) {
+        uint8_t buf[COMPRESS_CHUNK_SIZE];
         int r;
-        size_t n, k;
 
         assert(m);
-        assert(buf);
-        assert(max > 0);
-        assert(pos >= m->delta);
 
-        pos -= m->delta;
+        m->out_size = 0;
 
-        while (pos >= m->size) {
-                off_t sz;
+        if (size > 0)
+                rewind(m->tmp);
 
-                /* End of this entry, so let's serialize the next
-                 * one */
+        while (size > 0) {
+                size_t k;
+
+                errno = 0;
+                k = fread(buf, 1, MIN(size, sizeof(buf)), m->tmp);
+                if (k == 0)
+                        return errno_or_else(EIO);
+
+                r = request_compress(m, buf, k, COMPRESS_CONTINUE);
+                if (r < 0)
+                        return r;
+
+                size -= k;
+        }
+
+        r = request_compress(m, NULL, 0, finish ? COMPRESS_FINISH : COMPRESS_FLUSH);
+        if (r < 0)
+                return r;
+
+        m->finished = finish;
+        return 0;
+}
+
+/* Serializes as many entries as are available right away into m->tmp, up to about ENTRIES_BATCH_SIZE, so
+ * that we don't go through the temporary file and microhttpd for each entry separately. When following,
+ * the entries that arrived while we waited are hence coalesced too. Returns the number of entries
+ * serialized, 0 if there are none yet while following, and -EPIPE at the end of the stream. */
+static int request_serialize_entries(RequestMeta *m, uint64_t *ret_size) {
+        unsigned n = 0;
+        off_t sz = 0;
+        int r;
+
+        assert(m);
+        assert(ret_size);
 
+        for (;;) {
                 if (m->n_entries_set &&
                     m->n_entries <= 0)
-                        return MHD_CONTENT_READER_END_OF_STREAM;
+                        break;
 
                 if (m->n_skip < 0)
                         r = sd_journal_previous_skip(m->journal, (uint64_t) -m->n_skip + 1);
@@ -174,76 +328,112 @@ static ssize_t request_reader_entries(
                         r = sd_journal_next_skip(m->journal, (uint64_t) m->n_skip + 1);
                 else
                         r = sd_journal_next(m->journal);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to advance journal pointer: %m");
+                if (r == 0) {
+                        /* Hand out what we have before waiting for more */
+                        if (n > 0 || !m->follow)
+                                break;
 
-                if (r < 0) {
-                        log_error_errno(r, "Failed to advance journal pointer: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                } else if (r == 0) {
-
-                        if (m->follow) {
-                                r = sd_journal_wait(m->journal, (uint64_t) JOURNAL_WAIT_TIMEOUT);
-                                if (r < 0) {
-                                        log_error_errno(r, "Couldn't wait for journal event: %m");
-                                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                                }
-                                if (r == SD_JOURNAL_NOP)
-                                        break;
-
-                                continue;
-                        }
+                        r = sd_journal_wait(m->journal, (uint64_t) JOURNAL_WAIT_TIMEOUT);
+                        if (r < 0)
+                                return log_error_errno(r, "Couldn't wait for journal event: %m");
+                        if (r == SD_JOURNAL_NOP)
+                                return 0;
 
-                        return MHD_CONTENT_READER_END_OF_STREAM;
+                        continue;
                 }
 
                 if (m->discrete) {
                         assert(m->cursor);
 
                         r = sd_journal_test_cursor(m->journal, m->cursor);
-                        if (r < 0) {
-                                log_error_errno(r, "Failed to test cursor: %m");
-                                return MHD_CONTENT_READER_END_WITH_ERROR;
-                        }
-
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to test cursor: %m");
                         if (r == 0)
-                                return MHD_CONTENT_READER_END_OF_STREAM;
+                                break;
                 }
 
-                pos -= m->size;
-                m->delta += m->size;
-
                 if (m->n_entries_set)
                         m->n_entries -= 1;
 
                 m->n_skip = 0;
 
-                r = request_meta_ensure_tmp(m);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to create temporary file: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
+                if (n == 0) {
+                        r = request_meta_ensure_tmp(m);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to create temporary file: %m");
                 }
 
                 r = show_journal_entry(m->tmp, m->journal, m->mode, 0, OUTPUT_FULL_WIDTH,
                                    NULL, NULL, NULL);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to serialize item: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
+                if (r < 0)
+                        return log_error_errno(r, "Failed to serialize item: %m");
+
+                n++;
 
                 sz = ftello(m->tmp);
-                if (sz == (off_t) -1) {
-                        log_error_errno(errno, "Failed to retrieve file position: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
+                if (sz == (off_t) -1)
+                        return log_error_errno(errno, "Failed to retrieve file position: %m");
 
-                m->size = (uint64_t) sz;
+                if ((uint64_t) sz >= ENTRIES_BATCH_SIZE)
+                        break;
         }
 
-        if (m->tmp == NULL && m->follow)
-                return 0;
+        if (n == 0)
+                return -EPIPE;
 
-        if (fseeko(m->tmp, pos, SEEK_SET) < 0) {
-                log_error_errno(errno, "Failed to seek to position: %m");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
+        *ret_size = (uint64_t) sz;
+        return (int) n;
+}
+
+static ssize_t request_reader_entries(
+                void *cls,
+                uint64_t pos,
+                char *buf,
+                size_t max) {
+
+        RequestMeta *m = cls;
+        uint64_t sz = 0;
+        int r;
+        size_t n, k;
+
+        assert(m);
+        assert(buf);
+        assert(max > 0);
+        assert(pos >= m->delta);
+
+        pos -= m->delta;
+
+        while (pos >= m->size) {
+                bool eof;
+
+                /* End of this batch, so let's serialize the next one */
+
+                r = request_serialize_entries(m, &sz);
+                if (r == 0)
+                        return 0;
+                eof = r == -EPIPE;
+                if (eof && (m->encoding == CONTENT_ENCODING_IDENTITY || m->finished))
+                        return MHD_CONTENT_READER_END_OF_STREAM;
+                if (r < 0 && !eof)
+                        return MHD_CONTENT_READER_END_WITH_ERROR;
+
+                pos -= m->size;
+                m->delta += m->size;
+
+                if (m->encoding == CONTENT_ENCODING_IDENTITY)
+                        m->size = sz;
+                else {
+                        /* At the end, only the trailer of the compressed stream is left to send */
+                        r = request_compress_batch(m, eof ? 0 : sz, eof);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to compress entries: %m");
+                                return MHD_CONTENT_READER_END_WITH_ERROR;
+                        }
+
+                        m->size = m->out_size;
+                }
         }
 
         n = m->size - pos;
@@ -252,6 +442,16 @@ static ssize_t request_reader_entries(
         if (n > max)
                 n = max;
 
+        if (m->encoding != CONTENT_ENCODING_IDENTITY) {
+                memcpy(buf, m->out + pos, n);
+                return (ssize_t) n;
+        }
+
+        if (fseeko(m->tmp, pos, SEEK_SET) < 0) {
+                log_error_errno(errno, "Failed to seek to position: %m");
+                return MHD_CONTENT_READER_END_WITH_ERROR;
+        }
+
         errno = 0;
         k = fread(buf, 1, n, m->tmp);
         if (k != n) {
@@ -289,6 +489,72 @@ static int request_parse_accept(
         return 0;
 }
 
+static int request_parse_accept_encoding(
+                RequestMeta *m,
+                struct MHD_Connection *connection) {
+
+        ContentEncoding e = CONTENT_ENCODING_IDENTITY;
+        const char *header;
+        int r;
+
+        assert(m);
+        assert(connection);
+
+        header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Accept-Encoding");
+
+        for (const char *p = header;;) {
+                _cleanup_free_ char *word = NULL;
+                char *q;
+
+                r = extract_first_word(&p, &word, ",", 0);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                /* Ignore the parameters, except for explicit refusals */
+                q = strchr(word, ';');
+                if (q) {
+                        *q++ = 0;
+                        if (STR_IN_SET(strstrip(q), "q=0", "q=0.0", "q=0.00", "q=0.000"))
+                                continue;
+                }
+
+                delete_trailing_chars(word, WHITESPACE);
+
+                /* zstd is cheaper on our side at a similar ratio, hence prefer it */
+                if (HAVE_ZSTD && streq(word, content_encodings[CONTENT_ENCODING_ZSTD]))
+                        e = CONTENT_ENCODING_ZSTD;
+                else if (HAVE_ZLIB && streq(word, content_encodings[CONTENT_ENCODING_GZIP]) && e != CONTENT_ENCODING_ZSTD)
+                        e = CONTENT_ENCODING_GZIP;
+        }
+
+        switch (e) {
+
+#if HAVE_ZLIB
+        case CONTENT_ENCODING_GZIP:
+                /* 16 added to the window bits selects the gzip framing rather than the zlib one */
+                if (deflateInit2(&m->gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                        return -ENOMEM;
+                break;
+#endif
+
+#if HAVE_ZSTD
+        case CONTENT_ENCODING_ZSTD:
+                m->zstd = ZSTD_createCCtx();
+                if (!m->zstd)
+                        return -ENOMEM;
+                break;
+#endif
+
+        default:
+                e = CONTENT_ENCODING_IDENTITY;
+        }
+
+        m->encoding = e;
+        return 0;
+}
+
 static int request_parse_range(
                 RequestMeta *m,
                 struct MHD_Connection *connection) {
@@ -486,6 +752,10 @@ static int request_handler_entries(
         if (request_parse_arguments(m, connection) < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse URL arguments.");
 
+        r = request_parse_accept_encoding(m, connection);
+        if (r < 0)
+                return mhd_respondf(connection, r, MHD_HTTP_INTERNAL_SERVER_ERROR, "Failed to set up compression: %m");
+
         if (m->discrete) {
                 if (!m->cursor)
                         return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Discrete seeks require a cursor specification.");
@@ -503,13 +773,20 @@ static int request_handler_entries(
         if (r < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to seek in journal.");
 
-        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 4*1024, request_reader_entries, m, NULL);
+        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, ENTRIES_BATCH_SIZE, request_reader_entries, m, NULL);
         if (!response)
                 return respond_oom(connection);
 
         if (MHD_add_response_header(response, "Content-Type", mime_types[m->mode]) == MHD_NO)
                 return respond_oom(connection);
 
+        if (MHD_add_response_header(response, "Vary", "Accept-Encoding") == MHD_NO)
+                return respond_oom(connection);
+
+        if (m->encoding != CONTENT_ENCODING_IDENTITY &&
+            MHD_add_response_header(response, "Content-Encoding", content_encodings[m->encoding]) == MHD_NO)
+                return respond_oom(connection);
+
         return MHD_queue_response(connection, MHD_HTTP_OK, response);
 }
 
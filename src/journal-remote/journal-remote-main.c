@@ -42,6 +42,7 @@ static char** arg_gnutls_log = NULL;
 
 static JournalWriteSplitMode arg_split_mode = _JOURNAL_WRITE_SPLIT_INVALID;
 static const char* arg_output = NULL;
+static unsigned arg_writer_threads = 0;
 
 static char *arg_key = NULL;
 static char *arg_cert = NULL;
@@ -195,6 +196,54 @@ static void request_meta_free(void *cls,
         }
 }
 
+static int process_source_entries(RemoteSource *source) {
+        int r;
+
+        assert(source);
+
+        for (;;) {
+                r = process_source(source, journal_remote_server_global->file_flags);
+                if (r == -EAGAIN)
+                        return 0;
+                if (r < 0)
+                        return r;
+        }
+}
+
+/* Decompress in pieces of this size, and process the entries in each right away, so that a small
+ * compressed upload cannot make us buffer a lot of data. */
+#define DECOMPRESS_CHUNK (64U * 1024U)
+
+static int process_source_compressed(RemoteSource *source, const void *data, size_t size) {
+        int r;
+
+        assert(source);
+        assert(source->decompress);
+
+        for (;;) {
+                void *p;
+                int n;
+
+                /* Decompress right into the buffer of the importer, the entries are parsed from there */
+                r = journal_importer_reserve(&source->importer, DECOMPRESS_CHUNK, &p);
+                if (r < 0)
+                        return r;
+
+                n = decompress_context_decompress(source->decompress, &data, &size, p, DECOMPRESS_CHUNK);
+                if (n < 0)
+                        return n;
+
+                journal_importer_commit(&source->importer, n);
+
+                r = process_source_entries(source);
+                if (r < 0)
+                        return r;
+
+                if (size == 0 && (size_t) n < DECOMPRESS_CHUNK)
+                        return 0;
+        }
+}
+
 static int process_http_upload(
                 struct MHD_Connection *connection,
                 const char *upload_data,
@@ -213,31 +262,33 @@ static int process_http_upload(
         if (*upload_data_size) {
                 log_trace("Received %zu bytes", *upload_data_size);
 
-                r = journal_importer_push_data(&source->importer,
-                                               upload_data, *upload_data_size);
-                if (r < 0)
-                        return mhd_respond_oom(connection);
+                if (source->decompress)
+                        r = process_source_compressed(source, upload_data, *upload_data_size);
+                else {
+                        r = journal_importer_push_data(&source->importer, upload_data, *upload_data_size);
+                        if (r >= 0)
+                                r = process_source_entries(source);
+                }
 
                 *upload_data_size = 0;
-        } else
+        } else {
                 finished = true;
 
-        for (;;) {
-                r = process_source(source, journal_remote_server_global->file_flags);
-                if (r == -EAGAIN)
-                        break;
-                if (r < 0) {
-                        if (r == -ENOBUFS)
-                                log_warning_errno(r, "Entry is above the maximum of %u, aborting connection %p.",
-                                                  DATA_SIZE_MAX, connection);
-                        else if (r == -E2BIG)
-                                log_warning_errno(r, "Entry with more fields than the maximum of %u, aborting connection %p.",
-                                                  ENTRY_FIELD_COUNT_MAX, connection);
-                        else
-                                log_warning_errno(r, "Failed to process data, aborting connection %p: %m",
-                                                  connection);
-                        return MHD_NO;
-                }
+                r = source->decompress ? decompress_context_finish(source->decompress) : 0;
+        }
+        if (r == -ENOMEM)
+                return mhd_respond_oom(connection);
+        if (r < 0) {
+                if (r == -ENOBUFS)
+                        log_warning_errno(r, "Entry is above the maximum of %u, aborting connection %p.",
+                                          DATA_SIZE_MAX, connection);
+                else if (r == -E2BIG)
+                        log_warning_errno(r, "Entry with more fields than the maximum of %u, aborting connection %p.",
+                                          ENTRY_FIELD_COUNT_MAX, connection);
+                else
+                        log_warning_errno(r, "Failed to process data, aborting connection %p: %m",
+                                          connection);
+                return MHD_NO;
         }
 
         if (!finished)
@@ -270,6 +321,7 @@ static mhd_result request_handler(
         const char *header;
         int r, code, fd;
         _cleanup_free_ char *hostname = NULL;
+        Compression compression = COMPRESSION_NONE;
         bool chunked = false;
 
         assert(connection);
@@ -295,6 +347,15 @@ static mhd_result request_handler(
                 return mhd_respond(connection, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
                                    "Content-Type: application/vnd.fdo.journal is required.");
 
+        header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Content-Encoding");
+        if (header) {
+                if (!strcaseeq(header, "zstd"))
+                        return mhd_respondf(connection, 0, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
+                                            "Unsupported Content-Encoding type: %s", header);
+
+                compression = COMPRESSION_ZSTD;
+        }
+
         header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Transfer-Encoding");
         if (header) {
                 if (!strcaseeq(header, "chunked"))
@@ -360,6 +421,18 @@ static mhd_result request_handler(
                 return mhd_respondf(connection, r, MHD_HTTP_INTERNAL_SERVER_ERROR, "%m");
 
         hostname = NULL;
+
+        if (compression != COMPRESSION_NONE) {
+                RemoteSource *source = *connection_cls;
+
+                r = decompress_context_new(compression, &source->decompress);
+                if (r == -ENOMEM)
+                        return respond_oom(connection);
+                if (r < 0)
+                        return mhd_respondf(connection, r, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
+                                            "Cannot decompress %s: %m", compression_to_string(compression));
+        }
+
         return MHD_YES;
 }
 
@@ -606,6 +679,10 @@ static int create_remoteserver(
         if (r < 0)
                 return r;
 
+        r = journal_remote_server_start_writer_workers(s, arg_writer_threads);
+        if (r < 0)
+                return r;
+
         r = setup_signals(s);
         if (r < 0)
                 return log_error_errno(r, "Failed to set up signals: %m");
@@ -762,6 +839,7 @@ static int parse_config(void) {
         const ConfigTableItem items[] = {
                 { "Remote",  "Seal",                   config_parse_bool,             0, &arg_seal       },
                 { "Remote",  "SplitMode",              config_parse_write_split_mode, 0, &arg_split_mode },
+                { "Remote",  "WriterThreads",          config_parse_unsigned,         0, &arg_writer_threads },
                 { "Remote",  "ServerKeyFile",          config_parse_path,             0, &arg_key        },
                 { "Remote",  "ServerCertificateFile",  config_parse_path,             0, &arg_cert       },
                 { "Remote",  "TrustedCertificateFile", config_parse_path,             0, &arg_trust      },
@@ -807,6 +885,7 @@ static int help(void) {
                "     --gnutls-log=CATEGORY...\n"
                "                            Specify a list of gnutls logging categories\n"
                "     --split-mode=none|host How many output files to create\n"
+               "     --writer-threads=N     Write output files from N threads (default: 0)\n"
                "\nNote: file descriptors from sd_listen_fds() will be consumed, too.\n"
                "\nSee the %s for details.\n",
                program_invocation_short_name,
@@ -830,6 +909,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_CERT,
                 ARG_TRUST,
                 ARG_GNUTLS_LOG,
+                ARG_WRITER_THREADS,
         };
 
         static const struct option options[] = {
@@ -848,6 +928,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "cert",         required_argument, NULL, ARG_CERT         },
                 { "trust",        required_argument, NULL, ARG_TRUST        },
                 { "gnutls-log",   required_argument, NULL, ARG_GNUTLS_LOG   },
+                { "writer-threads", required_argument, NULL, ARG_WRITER_THREADS },
                 {}
         };
 
@@ -982,6 +1063,12 @@ static int parse_argv(int argc, char *argv[]) {
                                 return r;
                         break;
 
+                case ARG_WRITER_THREADS:
+                        r = safe_atou(optarg, &arg_writer_threads);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --writer-threads= argument: %s", optarg);
+                        break;
+
                 case ARG_GNUTLS_LOG:
 #if HAVE_GNUTLS
                         for (const char* p = optarg;;) {
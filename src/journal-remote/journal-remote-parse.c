@@ -12,6 +12,7 @@ void source_free(RemoteSource *source) {
                 return;
 
         journal_importer_cleanup(&source->importer);
+        decompress_context_free(source->decompress);
 
         log_debug("Writer ref count %i", source->writer->n_ref);
         writer_unref(source->writer);
@@ -3,6 +3,7 @@
 
 #include "sd-event.h"
 
+#include "compress.h"
 #include "journal-importer.h"
 #include "journal-remote-write.h"
 
@@ -11,6 +12,9 @@ typedef struct RemoteSource {
 
         Writer *writer;
 
+        /* Set if the data is compressed, e.g. as announced by Content-Encoding: for HTTP uploads */
+        DecompressContext *decompress;
+
         sd_event_source *event;
         sd_event_source *buffer_event;
 } RemoteSource;
@@ -0,0 +1,444 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "errno-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "journal-remote-worker.h"
+#include "journal-remote.h"
+#include "list.h"
+#include "memory-util.h"
+#include "pthread-util.h"
+#include "stdio-util.h"
+
+/* With SplitMode=host, a single main loop has to parse and write the entries of all hosts, and the writing
+ * part (hashing, compression, and touching the mmaps of the output file) is by far the more expensive one.
+ * Each writer is hence assigned to one of a few worker threads, which runs its own event loop and does all
+ * writing to the output file of that writer. The main loop passes parsed entries to it through a queue with
+ * a single producer and a single consumer, which does not take any locks or syscalls as long as the worker
+ * is busy. Since a writer never changes its worker, the entries of one host are written in order. */
+
+#define WRITER_QUEUE_SIZE 1024U
+assert_cc((WRITER_QUEUE_SIZE & (WRITER_QUEUE_SIZE - 1)) == 0);
+
+typedef enum WriterJobType {
+        WRITER_JOB_ENTRY,
+        WRITER_JOB_CLOSE,
+        WRITER_JOB_STOP,
+} WriterJobType;
+
+typedef struct WriterJob {
+        WriterJobType type;
+        Writer *writer;
+
+        dual_timestamp ts;
+        sd_id128_t boot_id;
+        bool have_boot_id;
+        JournalFileFlags file_flags;
+
+        size_t n_iovec;
+        struct iovec iovec[];   /* Followed by the data the iovecs point to */
+} WriterJob;
+
+struct WriterWorker {
+        RemoteServer *server;
+        unsigned index;
+
+        pthread_t thread;
+        bool thread_started;
+        sd_event *event;         /* The worker's own event loop */
+        sd_event_source *kick_event_source;
+
+        /* The queue. head is only written by the main thread, tail only by the worker, once it is done with
+         * the job. Both are only accessed atomically. */
+        WriterJob *jobs[WRITER_QUEUE_SIZE];
+        unsigned head;
+        unsigned tail;
+
+        /* Set by the worker before it goes to sleep, reset by the main thread when it kicks it */
+        bool sleeping;
+        int kick_fd;
+
+        /* Set by the main thread when it waits for the worker to make progress, reset by the worker when it
+         * wakes it up */
+        bool waiting;
+        int progress_fd;
+
+        /* Writers whose output file was closed by the worker, to be freed by the main thread */
+        pthread_mutex_t mutex;
+        LIST_HEAD(Writer, closed);
+        int reap_fd;
+        sd_event_source *reap_event_source;
+
+        /* Only accessed from the main thread */
+        size_t n_writers;
+        WriterJob *stop_job;     /* Allocated in advance, so that stopping cannot fail */
+};
+
+static void writer_worker_process(WriterWorker *w, WriterJob *j) {
+        int r;
+
+        assert(w);
+        assert(j);
+
+        switch (j->type) {
+
+        case WRITER_JOB_ENTRY: {
+                struct iovec_wrapper iovw = {
+                        .iovec = j->iovec,
+                        .count = j->n_iovec,
+                };
+
+                r = writer_write_now(j->writer, &iovw, &j->ts, j->have_boot_id ? &j->boot_id : NULL, j->file_flags);
+                if (r == -EBADMSG)
+                        log_warning_errno(r, "Entry is invalid, ignoring.");
+                else if (r < 0)
+                        log_error_errno(r, "Failed to write entry of %zu bytes: %m", iovw_size(&iovw));
+                break;
+        }
+
+        case WRITER_JOB_CLOSE:
+                if (j->writer->journal) {
+                        log_debug("Closing journal file %s.", j->writer->journal->file->path);
+                        j->writer->journal = managed_journal_file_close(j->writer->journal);
+                }
+
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+                LIST_PREPEND(closed, w->closed, j->writer);
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+                (void) eventfd_write(w->reap_fd, 1);
+                break;
+
+        case WRITER_JOB_STOP:
+                (void) sd_event_exit(w->event, 0);
+                break;
+
+        default:
+                assert_not_reached();
+        }
+}
+
+static int writer_worker_dispatch_kick(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        WriterWorker *w = ASSERT_PTR(userdata);
+        unsigned tail;
+
+        if (read(fd, &(uint64_t) {}, sizeof(uint64_t)) < 0 && !ERRNO_IS_TRANSIENT(errno))
+                log_debug_errno(errno, "Failed to read eventfd of writer worker %u, ignoring: %m", w->index);
+
+        tail = __atomic_load_n(&w->tail, __ATOMIC_RELAXED);
+
+        for (;;) {
+                WriterJob *j;
+
+                if (tail == __atomic_load_n(&w->head, __ATOMIC_ACQUIRE)) {
+                        /* Looks empty. Announce that we go to sleep, and check again, so that a job queued
+                         * in the meantime is not missed. */
+                        __atomic_store_n(&w->sleeping, true, __ATOMIC_SEQ_CST);
+                        if (tail == __atomic_load_n(&w->head, __ATOMIC_SEQ_CST))
+                                break;
+
+                        __atomic_store_n(&w->sleeping, false, __ATOMIC_RELAXED);
+                }
+
+                j = w->jobs[tail % WRITER_QUEUE_SIZE];
+                writer_worker_process(w, j);
+                free(j);
+
+                /* Only release the slot once the job is done, so that an empty queue means that all jobs
+                 * were processed. */
+                __atomic_store_n(&w->tail, ++tail, __ATOMIC_SEQ_CST);
+
+                if (__atomic_exchange_n(&w->waiting, false, __ATOMIC_SEQ_CST))
+                        (void) eventfd_write(w->progress_fd, 1);
+        }
+
+        return 0;
+}
+
+static void* writer_worker_thread(void *userdata) {
+        WriterWorker *w = ASSERT_PTR(userdata);
+        char name[16];
+        int r;
+
+        xsprintf(name, "journal-wr-%u", w->index);
+        (void) pthread_setname_np(pthread_self(), name);
+
+        r = sd_event_loop(w->event);
+        if (r < 0)
+                log_error_errno(r, "Event loop of writer worker %u failed: %m", w->index);
+
+        return NULL;
+}
+
+static int writer_worker_dispatch_reap(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        WriterWorker *w = ASSERT_PTR(userdata);
+
+        if (read(fd, &(uint64_t) {}, sizeof(uint64_t)) < 0 && !ERRNO_IS_TRANSIENT(errno))
+                log_debug_errno(errno, "Failed to read eventfd of writer worker %u, ignoring: %m", w->index);
+
+        writer_worker_reap(w);
+        return 0;
+}
+
+void writer_worker_reap(WriterWorker *w) {
+        Writer *list;
+
+        assert(w);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        list = TAKE_PTR(w->closed);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        while (list) {
+                Writer *writer = list;
+
+                LIST_REMOVE(closed, list, writer);
+                writer_release(writer);
+        }
+}
+
+static void writer_worker_wait_for(WriterWorker *w, unsigned tail) {
+        int r;
+
+        assert(w);
+
+        /* Blocks until the worker is done with all jobs before the given queue position */
+
+        for (;;) {
+                __atomic_store_n(&w->waiting, true, __ATOMIC_SEQ_CST);
+                if ((int) (__atomic_load_n(&w->tail, __ATOMIC_SEQ_CST) - tail) >= 0)
+                        break;
+
+                r = fd_wait_for_event(w->progress_fd, POLLIN, USEC_INFINITY);
+                if (r < 0 && r != -EINTR) {
+                        log_debug_errno(r, "Failed to wait for writer worker %u, retrying: %m", w->index);
+                        (void) usleep(USEC_PER_MSEC);
+                }
+
+                (void) read(w->progress_fd, &(uint64_t) {}, sizeof(uint64_t));
+        }
+
+        __atomic_store_n(&w->waiting, false, __ATOMIC_RELAXED);
+}
+
+void writer_worker_wait(WriterWorker *w) {
+        assert(w);
+
+        writer_worker_wait_for(w, __atomic_load_n(&w->head, __ATOMIC_RELAXED));
+}
+
+static int writer_worker_push(WriterWorker *w, WriterJob *j) {
+        unsigned head;
+
+        assert(w);
+        assert(j);
+
+        head = __atomic_load_n(&w->head, __ATOMIC_RELAXED);
+
+        /* Full? Then block until the worker has caught up. This throttles the sources we read from, just as
+         * writing synchronously would. */
+        while (head - __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE) >= WRITER_QUEUE_SIZE)
+                writer_worker_wait_for(w, head - WRITER_QUEUE_SIZE + 1);
+
+        w->jobs[head % WRITER_QUEUE_SIZE] = j;
+        __atomic_store_n(&w->head, head + 1, __ATOMIC_SEQ_CST);
+
+        if (__atomic_exchange_n(&w->sleeping, false, __ATOMIC_SEQ_CST) &&
+            eventfd_write(w->kick_fd, 1) < 0)
+                return log_error_errno(errno, "Failed to kick writer worker %u: %m", w->index);
+
+        return 0;
+}
+
+int writer_worker_queue_entry(
+                WriterWorker *w,
+                Writer *writer,
+                const struct iovec_wrapper *iovw,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                JournalFileFlags file_flags) {
+
+        WriterJob *j;
+        uint8_t *p;
+        size_t sz = 0;
+        int r;
+
+        assert(w);
+        assert(writer);
+        assert(iovw);
+        assert(ts);
+
+        /* The importer reuses its buffer for the next entry, hence copy everything into the job */
+        for (size_t i = 0; i < iovw->count; i++)
+                sz += iovw->iovec[i].iov_len;
+
+        j = malloc(offsetof(WriterJob, iovec) + iovw->count * sizeof(struct iovec) + sz);
+        if (!j)
+                return log_oom();
+
+        *j = (WriterJob) {
+                .type = WRITER_JOB_ENTRY,
+                .writer = writer,
+                .ts = *ts,
+                .boot_id = boot_id ? *boot_id : SD_ID128_NULL,
+                .have_boot_id = boot_id,
+                .file_flags = file_flags,
+                .n_iovec = iovw->count,
+        };
+
+        p = (uint8_t*) (j->iovec + iovw->count);
+        for (size_t i = 0; i < iovw->count; i++) {
+                j->iovec[i] = IOVEC_MAKE(p, iovw->iovec[i].iov_len);
+                p = mempcpy_safe(p, iovw->iovec[i].iov_base, iovw->iovec[i].iov_len);
+        }
+
+        r = writer_worker_push(w, j);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+int writer_worker_queue_close(WriterWorker *w, Writer *writer) {
+        WriterJob *j;
+
+        assert(w);
+        assert(writer);
+
+        j = new(WriterJob, 1);
+        if (!j)
+                return log_oom();
+
+        *j = (WriterJob) {
+                .type = WRITER_JOB_CLOSE,
+                .writer = writer,
+        };
+
+        return writer_worker_push(w, j);
+}
+
+void writer_worker_attach(WriterWorker *w) {
+        assert(w);
+
+        w->n_writers++;
+}
+
+void writer_worker_detach(WriterWorker *w) {
+        assert(w);
+        assert(w->n_writers > 0);
+
+        w->n_writers--;
+}
+
+size_t writer_worker_n_writers(WriterWorker *w) {
+        assert(w);
+
+        return w->n_writers;
+}
+
+WriterWorker* writer_worker_free(WriterWorker *w) {
+        int r;
+
+        if (!w)
+                return NULL;
+
+        if (w->thread_started) {
+                /* Everything queued so far is still written out before the worker exits */
+                (void) writer_worker_push(w, TAKE_PTR(w->stop_job));
+
+                r = pthread_join(w->thread, NULL);
+                if (r > 0)
+                        log_debug_errno(r, "Failed to join writer worker %u, ignoring: %m", w->index);
+        }
+
+        free(w->stop_job);
+        writer_worker_reap(w);
+
+        sd_event_source_disable_unref(w->reap_event_source);
+        sd_event_source_disable_unref(w->kick_event_source);
+        sd_event_unref(w->event);
+
+        safe_close(w->kick_fd);
+        safe_close(w->progress_fd);
+        safe_close(w->reap_fd);
+
+        assert_se(pthread_mutex_destroy(&w->mutex) == 0);
+
+        return mfree(w);
+}
+
+int writer_worker_new(RemoteServer *s, unsigned index, WriterWorker **ret) {
+        _cleanup_(writer_worker_freep) WriterWorker *w = NULL;
+        sigset_t ss, saved_ss;
+        int r;
+
+        assert(s);
+        assert(ret);
+
+        w = new(WriterWorker, 1);
+        if (!w)
+                return log_oom();
+
+        *w = (WriterWorker) {
+                .server = s,
+                .index = index,
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .kick_fd = -1,
+                .progress_fd = -1,
+                .reap_fd = -1,
+        };
+
+        w->stop_job = new(WriterJob, 1);
+        if (!w->stop_job)
+                return log_oom();
+
+        *w->stop_job = (WriterJob) {
+                .type = WRITER_JOB_STOP,
+        };
+
+        w->kick_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        w->progress_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        w->reap_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (w->kick_fd < 0 || w->progress_fd < 0 || w->reap_fd < 0)
+                return log_error_errno(errno, "Failed to allocate eventfd: %m");
+
+        r = sd_event_new(&w->event);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate event loop of writer worker: %m");
+
+        r = sd_event_add_io(w->event, &w->kick_event_source, w->kick_fd, EPOLLIN, writer_worker_dispatch_kick, w);
+        if (r < 0)
+                return log_error_errno(r, "Failed to watch eventfd of writer worker: %m");
+
+        r = sd_event_add_io(s->events, &w->reap_event_source, w->reap_fd, EPOLLIN, writer_worker_dispatch_reap, w);
+        if (r < 0)
+                return log_error_errno(r, "Failed to watch eventfd of writer worker: %m");
+
+        /* The worker starts out asleep, so that the first job kicks it */
+        w->sleeping = true;
+
+        /* Leave all signals to the main thread, except for SIGBUS, which is handled by the mmap cache of the
+         * thread touching the file */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return log_error_errno(r, "Failed to block signals: %m");
+
+        r = pthread_create(&w->thread, NULL, writer_worker_thread, w);
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+        if (r > 0)
+                return log_error_errno(r, "Failed to start writer worker thread: %m");
+
+        w->thread_started = true;
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
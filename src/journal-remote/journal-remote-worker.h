@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "sd-event.h"
+#include "sd-id128.h"
+
+#include "io-util.h"
+#include "journal-file.h"
+#include "time-util.h"
+
+typedef struct RemoteServer RemoteServer;
+typedef struct Writer Writer;
+typedef struct WriterWorker WriterWorker;
+
+#define WRITER_WORKERS_MAX 256U
+
+int writer_worker_new(RemoteServer *s, unsigned index, WriterWorker **ret);
+WriterWorker* writer_worker_free(WriterWorker *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(WriterWorker*, writer_worker_free);
+
+int writer_worker_queue_entry(
+                WriterWorker *w,
+                Writer *writer,
+                const struct iovec_wrapper *iovw,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                JournalFileFlags file_flags);
+int writer_worker_queue_close(WriterWorker *w, Writer *writer);
+
+void writer_worker_wait(WriterWorker *w);
+void writer_worker_reap(WriterWorker *w);
+
+void writer_worker_attach(WriterWorker *w);
+void writer_worker_detach(WriterWorker *w);
+size_t writer_worker_n_writers(WriterWorker *w);
@@ -36,7 +36,7 @@ Writer* writer_new(RemoteServer *server) {
         return w;
 }
 
-static Writer* writer_free(Writer *w) {
+Writer* writer_release(Writer *w) {
         if (!w)
                 return NULL;
 
@@ -48,6 +48,9 @@ static Writer* writer_free(Writer *w) {
         if (w->server && w->hashmap_key)
                 hashmap_remove(w->server->writers, w->hashmap_key);
 
+        if (w->worker)
+                writer_worker_detach(w->worker);
+
         free(w->hashmap_key);
 
         if (w->mmap)
@@ -56,6 +59,25 @@ static Writer* writer_free(Writer *w) {
         return mfree(w);
 }
 
+static Writer* writer_free(Writer *w) {
+        if (!w)
+                return NULL;
+
+        if (w->worker && !w->closing) {
+                /* Entries may still be queued for the worker. Let it close the journal file after them, the
+                 * rest is released once it is done, see writer_worker_reap(). Until then the writer stays in
+                 * the hashmap, so that the file is not opened twice. */
+                w->closing = true;
+
+                if (writer_worker_queue_close(w->worker, w) >= 0)
+                        return NULL;
+
+                writer_worker_wait(w->worker);
+        }
+
+        return writer_release(w);
+}
+
 DEFINE_TRIVIAL_REF_UNREF_FUNC(Writer, writer, writer_free);
 
 int writer_write(Writer *w,
@@ -63,6 +85,22 @@ int writer_write(Writer *w,
                  const dual_timestamp *ts,
                  const sd_id128_t *boot_id,
                  JournalFileFlags file_flags) {
+
+        assert(w);
+        assert(iovw);
+        assert(iovw->count > 0);
+
+        if (w->worker)
+                return writer_worker_queue_entry(w->worker, w, iovw, ts, boot_id, file_flags);
+
+        return writer_write_now(w, iovw, ts, boot_id, file_flags);
+}
+
+int writer_write_now(Writer *w,
+                     const struct iovec_wrapper *iovw,
+                     const dual_timestamp *ts,
+                     const sd_id128_t *boot_id,
+                     JournalFileFlags file_flags) {
         int r;
 
         assert(w);
@@ -82,7 +120,7 @@ int writer_write(Writer *w,
                                       &w->seqnum, NULL, NULL);
         if (r >= 0) {
                 if (w->server)
-                        w->server->event_count += 1;
+                        __atomic_add_fetch(&w->server->event_count, 1, __ATOMIC_RELAXED);
                 return 0;
         } else if (r == -EBADMSG)
                 return r;
@@ -102,6 +140,6 @@ int writer_write(Writer *w,
                 return r;
 
         if (w->server)
-                w->server->event_count += 1;
+                __atomic_add_fetch(&w->server->event_count, 1, __ATOMIC_RELAXED);
         return 0;
 }
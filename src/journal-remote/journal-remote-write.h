@@ -2,11 +2,13 @@
 #pragma once
 
 #include "journal-importer.h"
+#include "journal-remote-worker.h"
+#include "list.h"
 #include "managed-journal-file.h"
 
 typedef struct RemoteServer RemoteServer;
 
-typedef struct Writer {
+struct Writer {
         ManagedJournalFile *journal;
         JournalMetrics metrics;
 
@@ -16,20 +18,31 @@ typedef struct Writer {
 
         uint64_t seqnum;
 
+        /* If set, all writing to the journal file happens in this worker thread */
+        WriterWorker *worker;
+        bool closing;
+        LIST_FIELDS(Writer, closed);
+
         unsigned n_ref;
-} Writer;
+};
 
 Writer* writer_new(RemoteServer* server);
 Writer* writer_ref(Writer *w);
 Writer* writer_unref(Writer *w);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(Writer*, writer_unref);
+Writer* writer_release(Writer *w);
 
 int writer_write(Writer *s,
                  const struct iovec_wrapper *iovw,
                  const dual_timestamp *ts,
                  const sd_id128_t *boot_id,
                  JournalFileFlags file_flags);
+int writer_write_now(Writer *w,
+                     const struct iovec_wrapper *iovw,
+                     const dual_timestamp *ts,
+                     const sd_id128_t *boot_id,
+                     JournalFileFlags file_flags);
 
 typedef enum JournalWriteSplitMode {
         JOURNAL_WRITE_SPLIT_NONE,
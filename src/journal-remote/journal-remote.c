@@ -119,6 +119,15 @@ int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer
         }
 
         w = hashmap_get(s->writers, key);
+        if (w && w->closing) {
+                /* The worker is still about to close the file of a previous writer for this host, wait
+                 * for that, so that we do not open it a second time. */
+                WriterWorker *worker = w->worker;
+
+                writer_worker_wait(worker);
+                writer_worker_reap(worker);
+                w = NULL;
+        }
         if (w)
                 writer_ref(w);
         else {
@@ -139,6 +148,14 @@ int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer
                 r = hashmap_put(s->writers, w->hashmap_key ?: key, w);
                 if (r < 0)
                         return r;
+
+                /* Hand the writer to the worker with the fewest writers */
+                for (size_t i = 0; i < s->n_writer_workers; i++)
+                        if (!w->worker ||
+                            writer_worker_n_writers(s->writer_workers[i]) < writer_worker_n_writers(w->worker))
+                                w->worker = s->writer_workers[i];
+                if (w->worker)
+                        writer_worker_attach(w->worker);
         }
 
         *writer = TAKE_PTR(w);
@@ -339,6 +356,30 @@ int journal_remote_server_init(
         return 0;
 }
 
+int journal_remote_server_start_writer_workers(RemoteServer *s, unsigned n) {
+        int r;
+
+        assert(s);
+        assert(s->n_writer_workers == 0);
+
+        n = MIN(n, WRITER_WORKERS_MAX);
+        if (n == 0)
+                return 0;
+
+        s->writer_workers = new0(WriterWorker*, n);
+        if (!s->writer_workers)
+                return log_oom();
+
+        for (; s->n_writer_workers < n; s->n_writer_workers++) {
+                r = writer_worker_new(s, s->n_writer_workers, s->writer_workers + s->n_writer_workers);
+                if (r < 0)
+                        return r;
+        }
+
+        log_debug("Started %zu writer worker threads.", s->n_writer_workers);
+        return 0;
+}
+
 #if HAVE_MICROHTTPD
 static void MHDDaemonWrapper_free(MHDDaemonWrapper *d) {
         MHD_stop_daemon(d->daemon);
@@ -360,6 +401,12 @@ void journal_remote_server_destroy(RemoteServer *s) {
         free(s->sources);
 
         writer_unref(s->_single_writer);
+
+        /* Waits for all queued entries to be written, and releases the writers closed along the way */
+        for (size_t i = 0; i < s->n_writer_workers; i++)
+                writer_worker_free(s->writer_workers[i]);
+        free(s->writer_workers);
+
         hashmap_free(s->writers);
 
         sd_event_source_unref(s->sigterm_event);
@@ -32,6 +32,9 @@ struct RemoteServer {
         Writer *_single_writer;
         uint64_t event_count;
 
+        WriterWorker **writer_workers;
+        size_t n_writer_workers;
+
 #if HAVE_MICROHTTPD
         Hashmap *daemons;
 #endif
@@ -49,6 +52,8 @@ int journal_remote_server_init(
                 JournalWriteSplitMode split_mode,
                 JournalFileFlags file_flags);
 
+int journal_remote_server_start_writer_workers(RemoteServer *s, unsigned n);
+
 int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer);
 
 int journal_remote_add_source(RemoteServer *s, int fd, char* name, bool own_name);
@@ -234,7 +234,7 @@ static ssize_t write_entry(char *buf, size_t size, Uploader *u) {
         assert_not_reached();
 }
 
-static void check_update_watchdog(Uploader *u) {
+void check_update_watchdog(Uploader *u) {
         usec_t after;
         usec_t elapsed_time;
 
@@ -305,6 +305,73 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
         return filled;
 }
 
+/* Grow the batch buffer by at least this much at a time. Needs to be large enough for the cursor and the
+ * other fixed-size parts of an entry, which write_entry() does not split. */
+#define BATCH_BUFFER_STEP (64U * 1024U)
+
+int fill_journal_batch(Uploader *u, size_t size_max, void **ret, size_t *ret_size, char **ret_cursor) {
+        _cleanup_free_ char *buf = NULL;
+        size_t pos = 0, n = 0;
+        int r;
+
+        assert(u);
+        assert(ret);
+        assert(ret_size);
+        assert(ret_cursor);
+
+        /* Unlike journal_input_callback(), only ever serializes complete entries, so that each batch can be
+         * processed on its own by the receiver. Returns the number of entries. */
+
+        while (u->journal && pos < size_max) {
+                if (u->entry_state == ENTRY_DONE) {
+                        r = sd_journal_next(u->journal);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to move to next entry in journal: %m");
+                        if (r == 0) {
+                                if (u->input_event)
+                                        log_debug("No more entries, waiting for journal.");
+                                else {
+                                        log_info("No more entries, closing journal.");
+                                        close_journal_input(u);
+                                }
+                                break;
+                        }
+
+                        u->entry_state = ENTRY_CURSOR;
+                }
+
+                do {
+                        ssize_t w;
+
+                        if (!GREEDY_REALLOC(buf, pos + BATCH_BUFFER_STEP))
+                                return log_oom();
+
+                        w = write_entry(buf + pos, MALLOC_ELEMENTSOF(buf) - pos, u);
+                        if (w < 0)
+                                return w;
+                        pos += w;
+                } while (u->entry_state != ENTRY_DONE);
+
+                n++;
+                check_update_watchdog(u);
+        }
+
+        if (n == 0) {
+                *ret = NULL;
+                *ret_size = 0;
+                *ret_cursor = NULL;
+                return 0;
+        }
+
+        *ret_cursor = strdup(u->current_cursor);
+        if (!*ret_cursor)
+                return log_oom();
+
+        *ret = TAKE_PTR(buf);
+        *ret_size = pos;
+        return (int) MIN(n, (size_t) INT_MAX);
+}
+
 void close_journal_input(Uploader *u) {
         assert(u);
 
@@ -331,6 +398,10 @@ static int process_journal_input(Uploader *u, int skip) {
 
         /* have data */
         u->entry_state = ENTRY_CURSOR;
+
+        if (u->batched)
+                return start_batched_upload(u);
+
         return start_upload(u, journal_input_callback, u);
 }
 
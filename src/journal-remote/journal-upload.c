@@ -10,6 +10,7 @@
 #include "sd-daemon.h"
 
 #include "alloc-util.h"
+#include "compress.h"
 #include "conf-parser.h"
 #include "daemon-util.h"
 #include "def.h"
@@ -24,6 +25,7 @@
 #include "mkdir.h"
 #include "parse-argument.h"
 #include "parse-helpers.h"
+#include "parse-util.h"
 #include "pretty-print.h"
 #include "process-util.h"
 #include "rlimit-util.h"
@@ -54,11 +56,17 @@ static bool arg_merge = false;
 static int arg_follow = -1;
 static const char *arg_save_state = NULL;
 static usec_t arg_network_timeout_usec = USEC_INFINITY;
+static bool arg_compress = false;
+static uint64_t arg_batch_size = 0;
+static unsigned arg_upload_window = 1;
 
 static void close_fd_input(Uploader *u);
 
 #define SERVER_ANSWER_KEEP 2048
 
+#define DEFAULT_BATCH_SIZE (1024U * 1024U)
+#define UPLOAD_WINDOW_MAX 64U
+
 #define STATE_FILE "/var/lib/systemd/journal-upload/state"
 
 #define easy_setopt(curl, opt, value, level, cmd)                       \
@@ -74,6 +82,7 @@ static void close_fd_input(Uploader *u);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC_FULL(CURL*, curl_easy_cleanup, NULL);
 DEFINE_TRIVIAL_CLEANUP_FUNC_FULL(struct curl_slist*, curl_slist_free_all, NULL);
+DEFINE_TRIVIAL_CLEANUP_FUNC_FULL(CURLM*, curl_multi_cleanup, NULL);
 
 static size_t output_callback(char *buf,
                               size_t size,
@@ -172,102 +181,157 @@ static int load_cursor_state(Uploader *u) {
         return 0;
 }
 
-int start_upload(Uploader *u,
-                 size_t (*input_callback)(void *ptr,
+static int make_header(bool compressed, struct curl_slist **ret) {
+        _cleanup_(curl_slist_free_allp) struct curl_slist *h = NULL;
+        struct curl_slist *l;
+
+        assert(ret);
+
+        h = curl_slist_append(NULL, "Content-Type: application/vnd.fdo.journal");
+        if (!h)
+                return log_oom();
+
+        l = curl_slist_append(h, "Transfer-Encoding: chunked");
+        if (!l)
+                return log_oom();
+        h = l;
+
+        l = curl_slist_append(h, "Accept: text/plain");
+        if (!l)
+                return log_oom();
+        h = l;
+
+        if (compressed) {
+                l = curl_slist_append(h, "Content-Encoding: zstd");
+                if (!l)
+                        return log_oom();
+                h = l;
+        }
+
+        *ret = TAKE_PTR(h);
+        return 0;
+}
+
+static int make_easy(
+                Uploader *u,
+                char *error,
+                size_t (*output_callback)(char *buf,
                                           size_t size,
                                           size_t nmemb,
                                           void *userdata),
-                 void *data) {
+                size_t (*input_callback)(void *ptr,
+                                         size_t size,
+                                         size_t nmemb,
+                                         void *userdata),
+                void *data,
+                CURL **ret) {
+
+        _cleanup_(curl_easy_cleanupp) CURL *curl = NULL;
         CURLcode code;
 
         assert(u);
+        assert(error);
+        assert(output_callback);
         assert(input_callback);
+        assert(ret);
 
-        if (!u->header) {
-                _cleanup_(curl_slist_free_allp) struct curl_slist *h = NULL;
-                struct curl_slist *l;
+        curl = curl_easy_init();
+        if (!curl)
+                return log_error_errno(SYNTHETIC_ERRNO(ENOSR),
+                                       "Call to curl_easy_init failed.");
 
-                h = curl_slist_append(NULL, "Content-Type: application/vnd.fdo.journal");
-                if (!h)
-                        return log_oom();
+        /* If configured, set a timeout for the curl operation. */
+        if (arg_network_timeout_usec != USEC_INFINITY)
+                easy_setopt(curl, CURLOPT_TIMEOUT,
+                            (long) DIV_ROUND_UP(arg_network_timeout_usec, USEC_PER_SEC),
+                            LOG_ERR, return -EXFULL);
 
-                l = curl_slist_append(h, "Transfer-Encoding: chunked");
-                if (!l)
-                        return log_oom();
-                h = l;
+        /* tell it to POST to the URL */
+        easy_setopt(curl, CURLOPT_POST, 1L,
+                    LOG_ERR, return -EXFULL);
 
-                l = curl_slist_append(h, "Accept: text/plain");
-                if (!l)
-                        return log_oom();
-                h = l;
+        easy_setopt(curl, CURLOPT_ERRORBUFFER, error,
+                    LOG_ERR, return -EXFULL);
 
-                u->header = TAKE_PTR(h);
-        }
+        /* set where to write to */
+        easy_setopt(curl, CURLOPT_WRITEFUNCTION, output_callback,
+                    LOG_ERR, return -EXFULL);
 
-        if (!u->easy) {
-                _cleanup_(curl_easy_cleanupp) CURL *curl = NULL;
+        easy_setopt(curl, CURLOPT_WRITEDATA, data,
+                    LOG_ERR, return -EXFULL);
 
-                curl = curl_easy_init();
-                if (!curl)
-                        return log_error_errno(SYNTHETIC_ERRNO(ENOSR),
-                                               "Call to curl_easy_init failed.");
+        /* set where to read from */
+        easy_setopt(curl, CURLOPT_READFUNCTION, input_callback,
+                    LOG_ERR, return -EXFULL);
 
-                /* If configured, set a timeout for the curl operation. */
-                if (arg_network_timeout_usec != USEC_INFINITY)
-                        easy_setopt(curl, CURLOPT_TIMEOUT,
-                                    (long) DIV_ROUND_UP(arg_network_timeout_usec, USEC_PER_SEC),
-                                    LOG_ERR, return -EXFULL);
+        easy_setopt(curl, CURLOPT_READDATA, data,
+                    LOG_ERR, return -EXFULL);
 
-                /* tell it to POST to the URL */
-                easy_setopt(curl, CURLOPT_POST, 1L,
-                            LOG_ERR, return -EXFULL);
+        if (DEBUG_LOGGING)
+                /* enable verbose for easier tracing */
+                easy_setopt(curl, CURLOPT_VERBOSE, 1L, LOG_WARNING, );
 
-                easy_setopt(curl, CURLOPT_ERRORBUFFER, u->error,
-                            LOG_ERR, return -EXFULL);
+        easy_setopt(curl, CURLOPT_USERAGENT,
+                    "systemd-journal-upload " GIT_VERSION,
+                    LOG_WARNING, );
 
-                /* set where to write to */
-                easy_setopt(curl, CURLOPT_WRITEFUNCTION, output_callback,
+        if (!streq_ptr(arg_key, "-") && (arg_key || startswith(u->url, "https://"))) {
+                easy_setopt(curl, CURLOPT_SSLKEY, arg_key ?: PRIV_KEY_FILE,
                             LOG_ERR, return -EXFULL);
-
-                easy_setopt(curl, CURLOPT_WRITEDATA, data,
+                easy_setopt(curl, CURLOPT_SSLCERT, arg_cert ?: CERT_FILE,
                             LOG_ERR, return -EXFULL);
+        }
 
-                /* set where to read from */
-                easy_setopt(curl, CURLOPT_READFUNCTION, input_callback,
+        if (STRPTR_IN_SET(arg_trust, "-", "all"))
+                easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0,
+                            LOG_ERR, return -EUCLEAN);
+        else if (arg_trust || startswith(u->url, "https://"))
+                easy_setopt(curl, CURLOPT_CAINFO, arg_trust ?: TRUST_FILE,
                             LOG_ERR, return -EXFULL);
 
-                easy_setopt(curl, CURLOPT_READDATA, data,
-                            LOG_ERR, return -EXFULL);
+        if (arg_key || arg_trust)
+                easy_setopt(curl, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1,
+                            LOG_WARNING, );
 
-                /* use our special own mime type and chunked transfer */
-                easy_setopt(curl, CURLOPT_HTTPHEADER, u->header,
-                            LOG_ERR, return -EXFULL);
+        /* upload to this place */
+        code = curl_easy_setopt(curl, CURLOPT_URL, u->url);
+        if (code)
+                return log_error_errno(SYNTHETIC_ERRNO(EXFULL),
+                                       "curl_easy_setopt CURLOPT_URL failed: %s",
+                                       curl_easy_strerror(code));
 
-                if (DEBUG_LOGGING)
-                        /* enable verbose for easier tracing */
-                        easy_setopt(curl, CURLOPT_VERBOSE, 1L, LOG_WARNING, );
+        *ret = TAKE_PTR(curl);
+        return 0;
+}
 
-                easy_setopt(curl, CURLOPT_USERAGENT,
-                            "systemd-journal-upload " GIT_VERSION,
-                            LOG_WARNING, );
+int start_upload(Uploader *u,
+                 size_t (*input_callback)(void *ptr,
+                                          size_t size,
+                                          size_t nmemb,
+                                          void *userdata),
+                 void *data) {
+        CURLcode code;
+        int r;
 
-                if (!streq_ptr(arg_key, "-") && (arg_key || startswith(u->url, "https://"))) {
-                        easy_setopt(curl, CURLOPT_SSLKEY, arg_key ?: PRIV_KEY_FILE,
-                                    LOG_ERR, return -EXFULL);
-                        easy_setopt(curl, CURLOPT_SSLCERT, arg_cert ?: CERT_FILE,
-                                    LOG_ERR, return -EXFULL);
-                }
+        assert(u);
+        assert(input_callback);
 
-                if (STRPTR_IN_SET(arg_trust, "-", "all"))
-                        easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0,
-                                    LOG_ERR, return -EUCLEAN);
-                else if (arg_trust || startswith(u->url, "https://"))
-                        easy_setopt(curl, CURLOPT_CAINFO, arg_trust ?: TRUST_FILE,
-                                    LOG_ERR, return -EXFULL);
+        if (!u->header) {
+                r = make_header(/* compressed= */ false, &u->header);
+                if (r < 0)
+                        return r;
+        }
 
-                if (arg_key || arg_trust)
-                        easy_setopt(curl, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1,
-                                    LOG_WARNING, );
+        if (!u->easy) {
+                _cleanup_(curl_easy_cleanupp) CURL *curl = NULL;
+
+                r = make_easy(u, u->error, output_callback, input_callback, data, &curl);
+                if (r < 0)
+                        return r;
+
+                /* use our special own mime type and chunked transfer */
+                easy_setopt(curl, CURLOPT_HTTPHEADER, u->header,
+                            LOG_ERR, return -EXFULL);
 
                 u->easy = TAKE_PTR(curl);
         } else {
@@ -278,18 +342,142 @@ int start_upload(Uploader *u,
                 u->answer = 0;
         }
 
-        /* upload to this place */
-        code = curl_easy_setopt(u->easy, CURLOPT_URL, u->url);
-        if (code)
-                return log_error_errno(SYNTHETIC_ERRNO(EXFULL),
-                                       "curl_easy_setopt CURLOPT_URL failed: %s",
-                                       curl_easy_strerror(code));
-
         u->uploading = true;
 
         return 0;
 }
 
+static UploadBatch* upload_batch_free(UploadBatch *b) {
+        if (!b)
+                return NULL;
+
+        if (b->uploader) {
+                LIST_REMOVE(batches, b->uploader->batches, b);
+                assert(b->uploader->n_batches > 0);
+                b->uploader->n_batches--;
+
+                if (b->easy && b->uploader->multi)
+                        (void) curl_multi_remove_handle(b->uploader->multi, b->easy);
+        }
+
+        curl_easy_cleanup(b->easy);
+        free(b->data);
+        free(b->cursor);
+        free(b->answer);
+
+        return mfree(b);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(UploadBatch*, upload_batch_free);
+
+static size_t batch_output_callback(char *buf, size_t size, size_t nmemb, void *userp) {
+        UploadBatch *b = ASSERT_PTR(userp);
+
+        log_debug("The server answers (%zu bytes): %.*s",
+                  size*nmemb, (int)(size*nmemb), buf);
+
+        if (nmemb && !b->answer) {
+                b->answer = strndup(buf, size*nmemb);
+                if (!b->answer)
+                        log_warning("Failed to store server answer (%zu bytes): out of memory", size*nmemb);
+        }
+
+        return size * nmemb;
+}
+
+static size_t batch_input_callback(void *buf, size_t size, size_t nmemb, void *userp) {
+        UploadBatch *b = ASSERT_PTR(userp);
+        size_t n;
+
+        assert(!size_multiply_overflow(size, nmemb));
+
+        n = MIN(size * nmemb, b->size - b->pos);
+        memcpy(buf, (uint8_t*) b->data + b->pos, n);
+        b->pos += n;
+
+        return n;
+}
+
+static int upload_batch_compress(UploadBatch *b) {
+        _cleanup_free_ void *c = NULL;
+        size_t c_size;
+        int r;
+
+        assert(b);
+        assert(b->size > 0);
+
+        /* Only bother if the data actually shrinks, otherwise send it as is */
+        c = malloc(b->size);
+        if (!c)
+                return log_oom();
+
+        r = compress_blob_zstd(b->data, b->size, c, b->size - 1, &c_size);
+        if (r == -ENOBUFS)
+                return 0;
+        if (r < 0)
+                return log_error_errno(r, "Failed to compress batch: %m");
+
+        log_debug("Compressed batch of %zu entries from %zu to %zu bytes.", b->n_entries, b->size, c_size);
+
+        free_and_replace(b->data, c);
+        b->size = c_size;
+        b->compressed = true;
+        return 1;
+}
+
+/* Serializes the next entries, and queues them as a new request. Returns 0 if there are no entries left. */
+static int upload_batch_new(Uploader *u) {
+        _cleanup_(upload_batch_freep) UploadBatch *b = NULL;
+        CURLMcode mc;
+        CURLcode code;
+        int r;
+
+        assert(u);
+        assert(u->multi);
+
+        b = new0(UploadBatch, 1);
+        if (!b)
+                return log_oom();
+
+        r = fill_journal_batch(u, arg_batch_size > 0 ? arg_batch_size : DEFAULT_BATCH_SIZE,
+                               &b->data, &b->size, &b->cursor);
+        if (r <= 0)
+                return r;
+        b->n_entries = r;
+
+        if (arg_compress) {
+                r = upload_batch_compress(b);
+                if (r < 0)
+                        return r;
+        }
+
+        r = make_easy(u, b->error, batch_output_callback, batch_input_callback, b, &b->easy);
+        if (r < 0)
+                return r;
+
+        easy_setopt(b->easy, CURLOPT_HTTPHEADER,
+                    b->compressed ? u->header_compressed : u->header,
+                    LOG_ERR, return -EXFULL);
+
+        easy_setopt(b->easy, CURLOPT_PRIVATE, b,
+                    LOG_ERR, return -EXFULL);
+
+        mc = curl_multi_add_handle(u->multi, b->easy);
+        if (mc != CURLM_OK)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO),
+                                       "Failed to queue request: %s", curl_multi_strerror(mc));
+
+        b->uploader = u;
+        LIST_APPEND(batches, u->batches, b);
+        u->n_batches++;
+
+        log_debug("Queued batch of %zu entries (%zu bytes, %s), %zu requests in flight.",
+                  b->n_entries, b->size, b->compressed ? "compressed" : "uncompressed", u->n_batches);
+
+        TAKE_PTR(b);
+        return 1;
+}
+
 static size_t fd_input_callback(void *buf, size_t size, size_t nmemb, void *userp) {
         Uploader *u = userp;
         ssize_t n;
@@ -466,6 +654,11 @@ static int setup_uploader(Uploader *u, const char *url, const char *state_file)
 static void destroy_uploader(Uploader *u) {
         assert(u);
 
+        while (u->batches)
+                upload_batch_free(u->batches);
+        curl_multi_cleanup(u->multi);
+        curl_slist_free_all(u->header_compressed);
+
         curl_easy_cleanup(u->easy);
         curl_slist_free_all(u->header);
         free(u->answer);
@@ -485,25 +678,25 @@ static void destroy_uploader(Uploader *u) {
         sd_event_unref(u->events);
 }
 
-static int perform_upload(Uploader *u) {
+static int check_upload_result(Uploader *u, CURL *easy, CURLcode result, const char *error, const char *answer) {
         CURLcode code;
         long status;
 
         assert(u);
+        assert(easy);
+        assert(error);
 
-        u->watchdog_timestamp = now(CLOCK_MONOTONIC);
-        code = curl_easy_perform(u->easy);
-        if (code) {
-                if (u->error[0])
+        if (result) {
+                if (error[0])
                         log_error("Upload to %s failed: %.*s",
-                                  u->url, (int) sizeof(u->error), u->error);
+                                  u->url, CURL_ERROR_SIZE, error);
                 else
                         log_error("Upload to %s failed: %s",
-                                  u->url, curl_easy_strerror(code));
+                                  u->url, curl_easy_strerror(result));
                 return -EIO;
         }
 
-        code = curl_easy_getinfo(u->easy, CURLINFO_RESPONSE_CODE, &status);
+        code = curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
         if (code)
                 return log_error_errno(SYNTHETIC_ERRNO(EUCLEAN),
                                        "Failed to retrieve response code: %s",
@@ -512,14 +705,151 @@ static int perform_upload(Uploader *u) {
         if (status >= 300)
                 return log_error_errno(SYNTHETIC_ERRNO(EIO),
                                        "Upload to %s failed with code %ld: %s",
-                                       u->url, status, strna(u->answer));
+                                       u->url, status, strna(answer));
         else if (status < 200)
                 return log_error_errno(SYNTHETIC_ERRNO(EIO),
                                        "Upload to %s finished with unexpected code %ld: %s",
-                                       u->url, status, strna(u->answer));
+                                       u->url, status, strna(answer));
         else
                 log_debug("Upload finished successfully with code %ld: %s",
-                          status, strna(u->answer));
+                          status, strna(answer));
+
+        return 0;
+}
+
+int start_batched_upload(Uploader *u) {
+        int r;
+
+        assert(u);
+
+        if (!u->header) {
+                r = make_header(/* compressed= */ false, &u->header);
+                if (r < 0)
+                        return r;
+        }
+
+        if (!u->header_compressed) {
+                r = make_header(/* compressed= */ true, &u->header_compressed);
+                if (r < 0)
+                        return r;
+        }
+
+        if (!u->multi) {
+                _cleanup_(curl_multi_cleanupp) CURLM *multi = NULL;
+                CURLMcode mc;
+
+                multi = curl_multi_init();
+                if (!multi)
+                        return log_error_errno(SYNTHETIC_ERRNO(ENOSR),
+                                               "Call to curl_multi_init failed.");
+
+                /* Send the requests of a window over as few connections as possible */
+                mc = curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+                if (mc != CURLM_OK)
+                        log_debug("Failed to enable multiplexing, ignoring: %s", curl_multi_strerror(mc));
+
+                u->multi = TAKE_PTR(multi);
+        }
+
+        u->batch_eof = false;
+        u->uploading = true;
+
+        return 0;
+}
+
+static int perform_batched_upload(Uploader *u) {
+        int r;
+
+        assert(u);
+        assert(u->multi);
+
+        /* Keeps up to arg_upload_window requests in flight. The receiver may process them in any order,
+         * hence the saved cursor is only moved forward over batches that were all accepted. If one fails,
+         * we give up, and start over from that cursor next time, just like with a single request. */
+
+        u->watchdog_timestamp = now(CLOCK_MONOTONIC);
+
+        for (;;) {
+                CURLMcode mc;
+                CURLMsg *msg;
+                int running, n;
+
+                while (!u->batch_eof && u->n_batches < arg_upload_window) {
+                        r = upload_batch_new(u);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                u->batch_eof = true;
+                }
+
+                if (u->n_batches == 0)
+                        break;
+
+                mc = curl_multi_perform(u->multi, &running);
+                if (mc != CURLM_OK)
+                        return log_error_errno(SYNTHETIC_ERRNO(EIO),
+                                               "Failed to perform requests: %s", curl_multi_strerror(mc));
+
+                while ((msg = curl_multi_info_read(u->multi, &n))) {
+                        UploadBatch *b;
+                        char *p = NULL;
+
+                        if (msg->msg != CURLMSG_DONE)
+                                continue;
+
+                        if (curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &p) != CURLE_OK || !p)
+                                return log_error_errno(SYNTHETIC_ERRNO(EUCLEAN), "Failed to find finished request.");
+                        b = (UploadBatch*) p;
+
+                        r = check_upload_result(u, b->easy, msg->data.result, b->error, b->answer);
+                        if (r < 0)
+                                return r;
+
+                        b->done = true;
+                }
+
+                if (u->batches && u->batches->done) {
+                        while (u->batches && u->batches->done) {
+                                UploadBatch *b = u->batches;
+
+                                free_and_replace(u->last_cursor, b->cursor);
+                                upload_batch_free(b);
+                        }
+
+                        r = update_cursor_state(u);
+                        if (r < 0)
+                                return r;
+
+                        /* Make room for the next batch right away */
+                        continue;
+                }
+
+                if (running > 0) {
+                        mc = curl_multi_poll(u->multi, NULL, 0, 1000, NULL);
+                        if (mc != CURLM_OK)
+                                return log_error_errno(SYNTHETIC_ERRNO(EIO),
+                                                       "Failed to wait for requests: %s", curl_multi_strerror(mc));
+                }
+
+                check_update_watchdog(u);
+        }
+
+        u->uploading = false;
+        return 0;
+}
+
+static int perform_upload(Uploader *u) {
+        int r;
+
+        assert(u);
+
+        if (u->batched)
+                return perform_batched_upload(u);
+
+        u->watchdog_timestamp = now(CLOCK_MONOTONIC);
+        r = check_upload_result(u, u->easy, curl_easy_perform(u->easy), u->error, u->answer);
+        if (r < 0)
+                return r;
 
         free_and_replace(u->last_cursor, u->current_cursor);
 
@@ -573,6 +903,9 @@ static int parse_config(void) {
                 { "Upload",  "ServerCertificateFile",  config_parse_path_or_ignore, 0,                        &arg_cert                 },
                 { "Upload",  "TrustedCertificateFile", config_parse_path_or_ignore, 0,                        &arg_trust                },
                 { "Upload",  "NetworkTimeoutSec",      config_parse_sec,            0,                        &arg_network_timeout_usec },
+                { "Upload",  "Compress",               config_parse_bool,           0,                        &arg_compress             },
+                { "Upload",  "BatchSize",              config_parse_iec_size,       0,                        &arg_batch_size           },
+                { "Upload",  "UploadWindow",           config_parse_unsigned,       0,                        &arg_upload_window        },
                 {}
         };
 
@@ -617,6 +950,9 @@ static int help(void) {
                "     --follow[=BOOL]        Do [not] wait for input\n"
                "     --save-state[=FILE]    Save uploaded cursors (default \n"
                "                            " STATE_FILE ")\n"
+               "     --compress[=BOOL]      Compress uploaded entries with zstd\n"
+               "     --batch-size=BYTES     Upload entries in requests of about this size\n"
+               "     --upload-window=N      Keep up to N requests in flight (default: 1)\n"
                "\nSee the %s for details.\n",
                program_invocation_short_name,
                link);
@@ -637,6 +973,9 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_AFTER_CURSOR,
                 ARG_FOLLOW,
                 ARG_SAVE_STATE,
+                ARG_COMPRESS,
+                ARG_BATCH_SIZE,
+                ARG_UPLOAD_WINDOW,
         };
 
         static const struct option options[] = {
@@ -656,6 +995,9 @@ static int parse_argv(int argc, char *argv[]) {
                 { "after-cursor", required_argument, NULL, ARG_AFTER_CURSOR   },
                 { "follow",       optional_argument, NULL, ARG_FOLLOW         },
                 { "save-state",   optional_argument, NULL, ARG_SAVE_STATE     },
+                { "compress",     optional_argument, NULL, ARG_COMPRESS       },
+                { "batch-size",   required_argument, NULL, ARG_BATCH_SIZE     },
+                { "upload-window", required_argument, NULL, ARG_UPLOAD_WINDOW },
                 {}
         };
 
@@ -768,6 +1110,24 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_save_state = optarg ?: STATE_FILE;
                         break;
 
+                case ARG_COMPRESS:
+                        r = parse_boolean_argument("--compress", optarg, &arg_compress);
+                        if (r < 0)
+                                return r;
+                        break;
+
+                case ARG_BATCH_SIZE:
+                        r = parse_size(optarg, 1024, &arg_batch_size);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --batch-size= argument: %s", optarg);
+                        break;
+
+                case ARG_UPLOAD_WINDOW:
+                        r = safe_atou(optarg, &arg_upload_window);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --upload-window= argument: %s", optarg);
+                        break;
+
                 case '?':
                         return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                                "Unknown option %s.",
@@ -790,6 +1150,10 @@ static int parse_argv(int argc, char *argv[]) {
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "Options --key and --cert must be used together.");
 
+        if (arg_upload_window < 1 || arg_upload_window > UPLOAD_WINDOW_MAX)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "Upload window must be between 1 and %u.", UPLOAD_WINDOW_MAX);
+
         if (optind < argc && (arg_directory || arg_file || arg_machine || arg_journal_type))
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "Input arguments make no sense with journal input.");
@@ -856,6 +1220,11 @@ static int run(int argc, char **argv) {
         use_journal = optind >= argc;
         if (use_journal) {
                 sd_journal *j;
+
+                /* Entries read from files are forwarded as they are, only entries read from the journal
+                 * can be split up into batches. */
+                u.batched = arg_compress || arg_batch_size > 0 || arg_upload_window > 1;
+
                 r = open_journal(&j);
                 if (r < 0)
                         return r;
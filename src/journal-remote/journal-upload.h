@@ -7,6 +7,7 @@
 #include "sd-event.h"
 #include "sd-journal.h"
 
+#include "list.h"
 #include "time-util.h"
 
 typedef enum {
@@ -23,7 +24,28 @@ typedef enum {
         ENTRY_DONE,                 /* Need to move to a new field. */
 } entry_state;
 
-typedef struct Uploader {
+typedef struct Uploader Uploader;
+
+/* A self-contained request, with a number of complete entries in the export format, possibly compressed */
+typedef struct UploadBatch {
+        Uploader *uploader;
+        CURL *easy;
+
+        void *data;
+        size_t size, pos;
+        bool compressed;
+
+        size_t n_entries;
+        char *cursor;           /* Of the last entry in the batch */
+
+        bool done;
+        char error[CURL_ERROR_SIZE];
+        char *answer;
+
+        LIST_FIELDS(struct UploadBatch, batches);
+} UploadBatch;
+
+struct Uploader {
         sd_event *events;
         sd_event_source *sigint_event, *sigterm_event;
 
@@ -54,7 +76,15 @@ typedef struct Uploader {
         char *last_cursor, *current_cursor;
         usec_t watchdog_timestamp;
         usec_t watchdog_usec;
-} Uploader;
+
+        /* Batched uploads, where several requests may be in flight at the same time */
+        bool batched;
+        bool batch_eof;
+        CURLM *multi;
+        struct curl_slist *header_compressed;
+        LIST_HEAD(UploadBatch, batches);        /* In the order they were queued */
+        size_t n_batches;
+};
 
 #define JOURNAL_UPLOAD_POLL_TIMEOUT (10 * USEC_PER_SEC)
 
@@ -72,3 +102,7 @@ int open_journal_for_upload(Uploader *u,
                             bool follow);
 void close_journal_input(Uploader *u);
 int check_journal_input(Uploader *u);
+int fill_journal_batch(Uploader *u, size_t size_max, void **ret, size_t *ret_size, char **ret_cursor);
+void check_update_watchdog(Uploader *u);
+
+int start_batched_upload(Uploader *u);
@@ -5,6 +5,7 @@
 #include <fnmatch.h>
 #include <getopt.h>
 #include <linux/fs.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -29,6 +30,7 @@
 #include "catalog.h"
 #include "chase-symlinks.h"
 #include "chattr-util.h"
+#include "cpu-set-util.h"
 #include "def.h"
 #include "dissect-image.h"
 #include "fd-util.h"
@@ -37,6 +39,7 @@
 #include "format-util.h"
 #include "fs-util.h"
 #include "fsprg.h"
+#include "gcrypt-util.h"
 #include "glob-util.h"
 #include "hostname-util.h"
 #include "id128-print.h"
@@ -133,6 +136,7 @@ static uint64_t arg_vacuum_size = 0;
 static uint64_t arg_vacuum_n_files = 0;
 static usec_t arg_vacuum_time = 0;
 static char **arg_output_fields = NULL;
+static unsigned arg_output_threads = 0;
 #if HAVE_PCRE2
 static const char *arg_pattern = NULL;
 static pcre2_code *arg_compiled_pattern = NULL;
@@ -377,8 +381,9 @@ static int help(void) {
                "                               short-iso, short-iso-precise, short-full,\n"
                "                               short-monotonic, short-unix, verbose, export,\n"
                "                               json, json-pretty, json-sse, json-seq, cat,\n"
-               "                               with-unit)\n"
+               "                               with-unit, export-columnar)\n"
                "     --output-fields=LIST    Select fields to print in verbose/export/json modes\n"
+               "     --output-threads=N      Format entries on N threads in export/json modes\n"
                "     --utc                   Express time in Coordinated Universal Time (UTC)\n"
                "  -x --catalog               Add message explanations where available\n"
                "     --no-full               Ellipsize fields\n"
@@ -468,6 +473,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_VACUUM_TIME,
                 ARG_NO_HOSTNAME,
                 ARG_OUTPUT_FIELDS,
+                ARG_OUTPUT_THREADS,
                 ARG_NAMESPACE,
         };
 
@@ -535,6 +541,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "vacuum-time",          required_argument, NULL, ARG_VACUUM_TIME          },
                 { "no-hostname",          no_argument,       NULL, ARG_NO_HOSTNAME          },
                 { "output-fields",        required_argument, NULL, ARG_OUTPUT_FIELDS        },
+                { "output-threads",       required_argument, NULL, ARG_OUTPUT_THREADS       },
                 { "namespace",            required_argument, NULL, ARG_NAMESPACE            },
                 {}
         };
@@ -587,7 +594,8 @@ static int parse_argv(int argc, char *argv[]) {
                         if (arg_output < 0)
                                 return log_error_errno(arg_output, "Unknown output format '%s'.", optarg);
 
-                        if (IN_SET(arg_output, OUTPUT_EXPORT, OUTPUT_JSON, OUTPUT_JSON_PRETTY, OUTPUT_JSON_SSE, OUTPUT_JSON_SEQ, OUTPUT_CAT))
+                        if (IN_SET(arg_output, OUTPUT_EXPORT, OUTPUT_JSON, OUTPUT_JSON_PRETTY, OUTPUT_JSON_SSE, OUTPUT_JSON_SEQ, OUTPUT_CAT,
+                                   OUTPUT_EXPORT_COLUMNAR))
                                 arg_quiet = true;
 
                         if (OUTPUT_MODE_IS_JSON(arg_output))
@@ -1068,6 +1076,12 @@ static int parse_argv(int argc, char *argv[]) {
                         break;
                 }
 
+                case ARG_OUTPUT_THREADS:
+                        r = safe_atou(optarg, &arg_output_threads);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse output thread count: %s", optarg);
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -2027,42 +2041,177 @@ static int setup_keys(void) {
 #endif
 }
 
+typedef struct VerifyJob {
+        JournalFile *f;
+        int result;
+        usec_t first, validated, last;
+} VerifyJob;
+
+typedef struct VerifyQueue {
+        VerifyJob *jobs;
+        size_t n_jobs;
+        size_t next_job; /* only accessed atomically */
+        bool show_progress;
+} VerifyQueue;
+
+static int verify_job_run(VerifyJob *job, bool own_file, bool show_progress) {
+        _cleanup_(journal_file_closep) JournalFile *copy = NULL;
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(job);
+
+        if (!own_file)
+                return journal_file_verify(job->f, arg_verify_key, &job->first, &job->validated, &job->last, show_progress);
+
+        /* The files of the sd_journal object share one MMapCache, which may be used from one thread at a
+         * time only, hence open the file once more on this thread, with a cache of its own. */
+        m = mmap_cache_new();
+        if (!m)
+                return -ENOMEM;
+
+        fd = fcntl(job->f->fd, F_DUPFD_CLOEXEC, 3);
+        if (fd < 0)
+                return -errno;
+
+        r = journal_file_open(fd, job->f->path, O_RDONLY, 0, 0, 0, NULL, m, NULL, &copy);
+        if (r < 0)
+                return r;
+        TAKE_FD(fd);
+
+        return journal_file_verify(copy, arg_verify_key, &job->first, &job->validated, &job->last, show_progress);
+}
+
+static void verify_queue_work(VerifyQueue *q, bool own_files) {
+        assert(q);
+
+        for (;;) {
+                size_t i;
+
+                i = __atomic_fetch_add(&q->next_job, 1, __ATOMIC_RELAXED);
+                if (i >= q->n_jobs)
+                        break;
+
+                q->jobs[i].result = verify_job_run(q->jobs + i, own_files, q->show_progress);
+        }
+}
+
+static void* verify_thread(void *userdata) {
+        VerifyQueue *q = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "journal-verify");
+
+        verify_queue_work(q, /* own_files= */ true);
+        return NULL;
+}
+
 static int verify(sd_journal *j) {
-        int r = 0;
+        _cleanup_free_ pthread_t *threads = NULL;
+        _cleanup_free_ VerifyJob *jobs = NULL;
+        size_t n_jobs = 0, n_threads = 0;
+        VerifyQueue q;
         JournalFile *f;
+        int r = 0, n_cpus;
 
         assert(j);
 
         log_show_color(true);
 
-        ORDERED_HASHMAP_FOREACH(f, j->files) {
-                int k;
-                usec_t first = 0, validated = 0, last = 0;
+        jobs = new(VerifyJob, ordered_hashmap_size(j->files));
+        if (!jobs)
+                return log_oom();
 
+        ORDERED_HASHMAP_FOREACH(f, j->files) {
 #if HAVE_GCRYPT
                 if (!arg_verify_key && JOURNAL_HEADER_SEALED(f->header))
                         log_notice("Journal file %s has sealing enabled but verification key has not been passed using --verify-key=.", f->path);
 #endif
 
-                k = journal_file_verify(f, arg_verify_key, &first, &validated, &last, true);
-                if (k == -EINVAL)
+                jobs[n_jobs++] = (VerifyJob) {
+                        .f = f,
+                };
+        }
+
+        /* Files are independent of each other, hence verify as many in parallel as we have CPUs for. The
+         * progress bar only makes sense while verifying one file at a time though. */
+        n_cpus = cpus_in_affinity_mask();
+        if (n_cpus > 1 && n_jobs > 1)
+                n_threads = MIN((size_t) n_cpus, n_jobs) - 1;
+
+        q = (VerifyQueue) {
+                .jobs = jobs,
+                .n_jobs = n_jobs,
+                .show_progress = n_threads == 0,
+        };
+
+        if (n_threads > 0) {
+                sigset_t ss, saved_ss;
+
+#if HAVE_GCRYPT
+                /* Initialize libgcrypt the way verification of sealed files expects it, before the threads
+                 * might race for it */
+                if (arg_verify_key)
+                        initialize_libgcrypt(true);
+#endif
+
+                threads = new(pthread_t, n_threads);
+                if (!threads)
+                        return log_oom();
+
+                /* Leave signal handling to this thread, except for SIGBUS */
+                assert_se(sigfillset(&ss) >= 0);
+                assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+                r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+                if (r > 0)
+                        return log_error_errno(r, "Failed to block signals: %m");
+
+                for (size_t i = 0; i < n_threads; i++) {
+                        r = pthread_create(threads + i, NULL, verify_thread, &q);
+                        if (r > 0) {
+                                log_debug_errno(r, "Failed to start verification thread, continuing with fewer: %m");
+                                n_threads = i;
+                                break;
+                        }
+                }
+
+                r = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+                if (r > 0)
+                        log_warning_errno(r, "Failed to restore signal mask, ignoring: %m");
+        }
+
+        /* Work on the jobs on this thread too, with the files as they are */
+        verify_queue_work(&q, /* own_files= */ false);
+
+        for (size_t i = 0; i < n_threads; i++)
+                (void) pthread_join(threads[i], NULL);
+
+        r = 0;
+
+        for (size_t i = 0; i < n_jobs; i++) {
+                VerifyJob *job = jobs + i;
+
+                f = job->f;
+
+                if (job->result == -EINVAL)
                         /* If the key was invalid give up right-away. */
-                        return k;
-                else if (k < 0)
-                        r = log_warning_errno(k, "FAIL: %s (%m)", f->path);
+                        return job->result;
+                else if (job->result < 0)
+                        r = log_warning_errno(job->result, "FAIL: %s (%m)", f->path);
                 else {
                         char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX];
                         log_info("PASS: %s", f->path);
 
                         if (arg_verify_key && JOURNAL_HEADER_SEALED(f->header)) {
-                                if (validated > 0) {
+                                if (job->validated > 0) {
                                         log_info("=> Validated from %s to %s, final %s entries not sealed.",
-                                                 format_timestamp_maybe_utc(a, sizeof(a), first),
-                                                 format_timestamp_maybe_utc(b, sizeof(b), validated),
-                                                 FORMAT_TIMESPAN(last > validated ? last - validated : 0, 0));
-                                } else if (last > 0)
+                                                 format_timestamp_maybe_utc(a, sizeof(a), job->first),
+                                                 format_timestamp_maybe_utc(b, sizeof(b), job->validated),
+                                                 FORMAT_TIMESPAN(job->last > job->validated ? job->last - job->validated : 0, 0));
+                                } else if (job->last > 0)
                                         log_info("=> No sealing yet, %s of entries not sealed.",
-                                                 FORMAT_TIMESPAN(last - first, 0));
+                                                 FORMAT_TIMESPAN(job->last - job->first, 0));
                                 else
                                         log_info("=> No sealing yet, no entries in file.");
                         }
@@ -2164,8 +2313,9 @@ int main(int argc, char *argv[]) {
         bool previous_boot_id_valid = false, first_line = true, ellipsized = false, need_seek = false;
         bool use_cursor = false, after_cursor = false;
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_(output_pipeline_freep) OutputPipeline *pipeline = NULL;
         sd_id128_t previous_boot_id = {};  /* Unnecessary initialization to appease gcc */
-        int n_shown = 0, r, poll_fd = -1;
+        int n_shown = 0, r, poll_fd = -1, flags;
 
         setlocale(LC_ALL, "");
         log_setup();
@@ -2646,9 +2796,27 @@ int main(int argc, char *argv[]) {
                 }
         }
 
+        flags =
+                arg_all * OUTPUT_SHOW_ALL |
+                arg_full * OUTPUT_FULL_WIDTH |
+                colors_enabled() * OUTPUT_COLOR |
+                arg_catalog * OUTPUT_CATALOG |
+                arg_utc * OUTPUT_UTC |
+                arg_no_hostname * OUTPUT_NO_HOSTNAME;
+
+        /* Entry retrieval stays on this thread, only the formatting can be spread over several. The columnar
+         * format always needs the pipeline, as it is written in batches of entries. */
+        if (arg_output == OUTPUT_EXPORT_COLUMNAR ||
+            (arg_output_threads > 0 && output_mode_can_pipeline(arg_output))) {
+                r = output_pipeline_new(stdout, arg_output, flags, arg_output_fields, arg_output_threads, &pipeline);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to set up output pipeline: %m");
+                        goto finish;
+                }
+        }
+
         for (;;) {
                 while (arg_lines < 0 || n_shown < arg_lines || (arg_follow && !first_line)) {
-                        int flags;
                         size_t highlight[2] = {};
 
                         if (need_seek) {
@@ -2694,9 +2862,16 @@ int main(int argc, char *argv[]) {
                                 r = sd_journal_get_monotonic_usec(j, NULL, &boot_id);
                                 if (r >= 0) {
                                         if (previous_boot_id_valid &&
-                                            !sd_id128_equal(boot_id, previous_boot_id))
+                                            !sd_id128_equal(boot_id, previous_boot_id)) {
+                                                if (pipeline) {
+                                                        r = output_pipeline_flush(pipeline);
+                                                        if (r < 0)
+                                                                goto finish;
+                                                }
+
                                                 printf("%s-- Boot "SD_ID128_FORMAT_STR" --%s\n",
                                                        ansi_highlight(), SD_ID128_FORMAT_VAL(boot_id), ansi_normal());
+                                        }
 
                                         previous_boot_id = boot_id;
                                         previous_boot_id_valid = true;
@@ -2755,16 +2930,11 @@ int main(int argc, char *argv[]) {
                         }
 #endif
 
-                        flags =
-                                arg_all * OUTPUT_SHOW_ALL |
-                                arg_full * OUTPUT_FULL_WIDTH |
-                                colors_enabled() * OUTPUT_COLOR |
-                                arg_catalog * OUTPUT_CATALOG |
-                                arg_utc * OUTPUT_UTC |
-                                arg_no_hostname * OUTPUT_NO_HOSTNAME;
-
-                        r = show_journal_entry(stdout, j, arg_output, 0, flags,
-                                               arg_output_fields, highlight, &ellipsized);
+                        if (pipeline)
+                                r = output_pipeline_add(pipeline, j);
+                        else
+                                r = show_journal_entry(stdout, j, arg_output, 0, flags,
+                                                       arg_output_fields, highlight, &ellipsized);
                         need_seek = true;
                         if (r == -EADDRNOTAVAIL)
                                 break;
@@ -2788,6 +2958,12 @@ int main(int argc, char *argv[]) {
                         }
                 }
 
+                if (pipeline) {
+                        r = output_pipeline_flush(pipeline);
+                        if (r < 0)
+                                goto finish;
+                }
+
                 if (!arg_follow) {
                         if (n_shown == 0 && !arg_quiet)
                                 printf("-- No entries --\n");
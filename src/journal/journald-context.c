@@ -14,6 +14,7 @@
 #include "io-util.h"
 #include "journal-util.h"
 #include "journald-context.h"
+#include "missing_syscall.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
@@ -29,10 +30,22 @@
  * log entry was originally created. We hence just increase the "window of inaccuracy" a bit.
  *
  * The cache is indexed by the PID. Entries may be "pinned" in the cache, in which case the entries are not removed
- * until they are unpinned. Unpinned entries are kept around until cache pressure is seen. Cache entries older than 5s
- * are never used (a sad attempt to deal with the UNIX weakness of PIDs reuse), cache entries older than 1s are
- * refreshed in an incremental way (meaning: data is reread from /proc, but any old data we can't refresh is not
- * flushed out). Data newer than 1s is used immediately without refresh.
+ * until they are unpinned. Unpinned entries are kept around until cache pressure is seen.
+ *
+ * If the kernel supports pidfds, we watch one for each cached process, and hence learn when it exits. As long as it
+ * didn't, its PID cannot have been reused, and we keep the cached data around for as long as we like. Data older than
+ * 1s is revalidated cheaply: we only reread the binary, command line and cgroup of the process, and only if any of
+ * them changed (i.e. the process executed something else or was moved to another unit) all data is reread from
+ * /proc. Everything is reread every 30s nonetheless, to catch the changes that come without either (e.g.
+ * prctl(PR_SET_NAME)). After the process exited, the cached data is frozen, and is used for another 5s for messages
+ * it left behind, after which it is flushed out.
+ *
+ * Without pidfds, cache entries older than 5s are never used (a sad attempt to deal with the UNIX weakness of PIDs
+ * reuse), cache entries older than 1s are refreshed in an incremental way (meaning: data is reread from /proc, but any
+ * old data we can't refresh is not flushed out). Data newer than 1s is used immediately without refresh.
+ *
+ * The trusted fields are serialized whenever the data is reread, so that the strings can be reused for every entry
+ * logged by the client.
  *
  * Log stream clients (i.e. all clients using the AF_UNIX/SOCK_STREAM stdout/stderr transport) will pin a cache entry
  * as long as their socket is connected. Note that cache entries are shared between different transports. That means a
@@ -56,9 +69,12 @@
 /* We refresh every 1s */
 #define REFRESH_USEC (1*USEC_PER_SEC)
 
-/* Data older than 5s we flush out */
+/* Data older than 5s we flush out, unless we know the process is still around */
 #define MAX_USEC (5*USEC_PER_SEC)
 
+/* Data of processes we watch is fully reread every 30s */
+#define FULL_REFRESH_USEC (30*USEC_PER_SEC)
+
 /* Keep at most 16K entries in the cache. (Note though that this limit may be violated if enough streams pin entries in
  * the cache, in which case we *do* permit this limit to be breached. That's safe however, as the number of stream
  * clients itself is limited.) */
@@ -126,6 +142,8 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
                 .owner_uid = UID_INVALID,
                 .lru_index = PRIOQ_IDX_NULL,
                 .timestamp = USEC_INFINITY,
+                .full_timestamp = USEC_INFINITY,
+                .exit_timestamp = USEC_INFINITY,
                 .extra_fields_mtime = NSEC_INFINITY,
                 .log_level_max = -1,
                 .log_ratelimit_interval = s->ratelimit_interval,
@@ -140,18 +158,31 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         return 0;
 }
 
+static void client_context_clear_meta(ClientContext *c) {
+        assert(c);
+
+        for (size_t i = 0; i < c->n_meta; i++)
+                interned_field_unref(c->meta[i]);
+
+        c->n_meta = 0;
+}
+
 static void client_context_reset(Server *s, ClientContext *c) {
         assert(s);
         assert(c);
 
         c->timestamp = USEC_INFINITY;
+        c->full_timestamp = USEC_INFINITY;
 
         c->uid = UID_INVALID;
         c->gid = GID_INVALID;
 
+        c->pidfd_event_source = sd_event_source_disable_unref(c->pidfd_event_source);
+        c->exit_timestamp = USEC_INFINITY;
+
         c->comm = mfree(c->comm);
         c->exe = mfree(c->exe);
-        c->cmdline = mfree(c->cmdline);
+        c->cmdline_field = interned_field_unref(c->cmdline_field);
         c->capeff = mfree(c->capeff);
 
         c->auditid = AUDIT_SESSION_INVALID;
@@ -179,6 +210,8 @@ static void client_context_reset(Server *s, ClientContext *c) {
 
         c->log_ratelimit_interval = s->ratelimit_interval;
         c->log_ratelimit_burst = s->ratelimit_burst;
+
+        client_context_clear_meta(c);
 }
 
 static ClientContext* client_context_free(Server *s, ClientContext *c) {
@@ -197,6 +230,73 @@ static ClientContext* client_context_free(Server *s, ClientContext *c) {
         return mfree(c);
 }
 
+static int client_context_on_exit(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        ClientContext *c = ASSERT_PTR(userdata);
+
+        /* The process exited. Its PID may be reused from now on, but it might have left log messages behind
+         * we still want to map to it properly, hence don't flush the data yet, but only note the time. */
+
+        c->exit_timestamp = now(CLOCK_MONOTONIC);
+        c->pidfd_event_source = sd_event_source_disable_unref(c->pidfd_event_source);
+
+        return 0;
+}
+
+static int client_context_watch(Server *s, ClientContext *c, usec_t timestamp) {
+        static bool pidfd_unsupported = false;
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(s);
+        assert(c);
+        assert(!c->pidfd_event_source);
+
+        if (pidfd_unsupported)
+                return -EOPNOTSUPP;
+
+        fd = pidfd_open(c->pid, 0);
+        if (fd < 0) {
+                if (errno == ESRCH) {
+                        /* Already gone, there's nothing to read from /proc anymore */
+                        c->exit_timestamp = timestamp;
+                        return 0;
+                }
+                if (ERRNO_IS_NOT_SUPPORTED(errno) || ERRNO_IS_PRIVILEGE(errno)) {
+                        log_debug_errno(errno, "pidfds not available, falling back to time-based client context flushing: %m");
+                        pidfd_unsupported = true;
+                }
+
+                return -errno;
+        }
+
+        r = sd_event_add_io(s->event, &c->pidfd_event_source, fd, EPOLLIN, client_context_on_exit, c);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_io_fd_own(c->pidfd_event_source, true);
+        if (r < 0) {
+                c->pidfd_event_source = sd_event_source_disable_unref(c->pidfd_event_source);
+                return r;
+        }
+        TAKE_FD(fd);
+
+        (void) sd_event_source_set_description(c->pidfd_event_source, "client-context-pidfd");
+
+        return 1;
+}
+
+static bool client_context_gone(ClientContext *c, usec_t t) {
+        assert(c);
+
+        if (c->pidfd_event_source)
+                return false; /* We'd know if it exited */
+
+        if (c->exit_timestamp != USEC_INFINITY)
+                return c->exit_timestamp + MAX_USEC < t;
+
+        return !pid_is_unwaited(c->pid);
+}
+
 static void client_context_read_uid_gid(ClientContext *c, const struct ucred *ucred) {
         assert(c);
         assert(pid_is_valid(c->pid));
@@ -213,9 +313,11 @@ static void client_context_read_uid_gid(ClientContext *c, const struct ucred *uc
                 (void) get_process_gid(c->pid, &c->gid);
 }
 
-static void client_context_read_basic(ClientContext *c) {
+static void client_context_read_basic(Server *s, ClientContext *c) {
+        InternedField *f;
         char *t;
 
+        assert(s);
         assert(c);
         assert(pid_is_valid(c->pid));
 
@@ -225,8 +327,14 @@ static void client_context_read_basic(ClientContext *c) {
         if (get_process_exe(c->pid, &t) >= 0)
                 free_and_replace(c->exe, t);
 
-        if (get_process_cmdline(c->pid, SIZE_MAX, PROCESS_CMDLINE_QUOTE, &t) >= 0)
-                free_and_replace(c->cmdline, t);
+        if (get_process_cmdline(c->pid, SIZE_MAX, PROCESS_CMDLINE_QUOTE, &t) >= 0) {
+                /* At most _SC_ARG_MAX (2MB usually), let's keep it around in serialized form only */
+                if (interned_field_get_string(s, "_CMDLINE=", t, &f) >= 0) {
+                        interned_field_unref(c->cmdline_field);
+                        c->cmdline_field = f;
+                }
+                free(t);
+        }
 
         if (get_process_capeff(c->pid, &t) >= 0)
                 free_and_replace(c->capeff, t);
@@ -500,6 +608,80 @@ static int client_context_read_log_ratelimit_burst(ClientContext *c) {
         return safe_atou(value, &c->log_ratelimit_burst);
 }
 
+static int client_context_serialize(Server *s, ClientContext *c) {
+        char pid[DECIMAL_STR_MAX(pid_t)] = "", uid[DECIMAL_STR_MAX(uid_t)] = "", gid[DECIMAL_STR_MAX(gid_t)] = "",
+                auditid[DECIMAL_STR_MAX(uint32_t)] = "", loginuid[DECIMAL_STR_MAX(uid_t)] = "",
+                owner_uid[DECIMAL_STR_MAX(uid_t)] = "", invocation_id[SD_ID128_STRING_MAX] = "";
+        int r = 0;
+
+        assert(s);
+        assert(c);
+
+        /* Formats the fields we attach to each entry of this client once, instead of for each message */
+
+        client_context_clear_meta(c);
+
+        if (pid_is_valid(c->pid))
+                xsprintf(pid, PID_FMT, c->pid);
+        if (uid_is_valid(c->uid))
+                xsprintf(uid, UID_FMT, c->uid);
+        if (gid_is_valid(c->gid))
+                xsprintf(gid, GID_FMT, c->gid);
+        if (audit_session_is_valid(c->auditid))
+                xsprintf(auditid, "%" PRIu32, c->auditid);
+        if (uid_is_valid(c->loginuid))
+                xsprintf(loginuid, UID_FMT, c->loginuid);
+        if (uid_is_valid(c->owner_uid))
+                xsprintf(owner_uid, UID_FMT, c->owner_uid);
+        if (!sd_id128_is_null(c->invocation_id))
+                sd_id128_to_string(c->invocation_id, invocation_id);
+
+        const struct {
+                const char *field;
+                const char *value;
+        } fields[] = {
+                { "_PID=",                   pid              },
+                { "_UID=",                   uid              },
+                { "_GID=",                   gid              },
+                { "_COMM=",                  c->comm          },
+                { "_EXE=",                   c->exe           },
+                { "_CAP_EFFECTIVE=",         c->capeff        },
+                { "_AUDIT_SESSION=",         auditid          },
+                { "_AUDIT_LOGINUID=",        loginuid         },
+                { "_SYSTEMD_CGROUP=",        c->cgroup        },
+                { "_SYSTEMD_SESSION=",       c->session       },
+                { "_SYSTEMD_OWNER_UID=",     owner_uid        },
+                { "_SYSTEMD_UNIT=",          c->unit          },
+                { "_SYSTEMD_USER_UNIT=",     c->user_unit     },
+                { "_SYSTEMD_SLICE=",         c->slice         },
+                { "_SYSTEMD_USER_SLICE=",    c->user_slice    },
+                { "_SYSTEMD_INVOCATION_ID=", invocation_id    },
+        };
+
+        assert_cc(ELEMENTSOF(fields) + 1 <= ELEMENTSOF(c->meta));
+
+        /* Even if we run out of memory, use whatever we managed to format, like we would otherwise */
+        for (size_t i = 0; i < ELEMENTSOF(fields) && r >= 0; i++) {
+                r = interned_field_get_string(s, fields[i].field, fields[i].value, c->meta + c->n_meta);
+                if (r >= 0 && c->meta[c->n_meta])
+                        c->n_meta++;
+        }
+
+        if (r >= 0 && c->label_size > 0) {
+                char *k;
+
+                /* The label might not be NUL terminated, hence don't treat it as string */
+                k = newa(char, STRLEN("_SELINUX_CONTEXT=") + c->label_size);
+                memcpy(mempcpy(k, "_SELINUX_CONTEXT=", STRLEN("_SELINUX_CONTEXT=")), c->label, c->label_size);
+
+                r = interned_field_get(s, k, STRLEN("_SELINUX_CONTEXT=") + c->label_size, c->meta + c->n_meta);
+                if (r >= 0)
+                        c->n_meta++;
+        }
+
+        return r;
+}
+
 static void client_context_really_refresh(
                 Server *s,
                 ClientContext *c,
@@ -515,8 +697,13 @@ static void client_context_really_refresh(
         if (timestamp == USEC_INFINITY)
                 timestamp = now(CLOCK_MONOTONIC);
 
+        /* Start watching the process before reading anything, so that we can't miss it exiting and its PID
+         * getting reused afterwards. */
+        if (!c->pidfd_event_source && c->exit_timestamp == USEC_INFINITY)
+                (void) client_context_watch(s, c, timestamp);
+
         client_context_read_uid_gid(c, ucred);
-        client_context_read_basic(c);
+        client_context_read_basic(s, c);
         (void) client_context_read_label(c, label, label_size);
 
         (void) audit_session_from_pid(c->pid, &c->auditid);
@@ -529,6 +716,66 @@ static void client_context_really_refresh(
         (void) client_context_read_log_ratelimit_interval(c);
         (void) client_context_read_log_ratelimit_burst(c);
 
+        if (client_context_serialize(s, c) < 0)
+                log_oom_debug();
+
+        c->timestamp = c->full_timestamp = timestamp;
+
+        if (c->in_lru) {
+                assert(c->n_ref == 0);
+                assert_se(prioq_reshuffle(s->client_contexts_lru, c, &c->lru_index) >= 0);
+        }
+}
+
+static bool client_context_changed(Server *s, ClientContext *c) {
+        _cleanup_free_ char *exe = NULL, *cmdline = NULL, *cgroup = NULL;
+
+        assert(s);
+        assert(c);
+
+        /* Checks whether the process executed something else or moved to another cgroup since we last read
+         * its data, i.e. whether it is likely that most of what we cached is out of date. This is a lot
+         * cheaper than rereading everything. The command line is checked too, since it's the only thing
+         * that changes when the same binary is executed again. */
+
+        if (get_process_exe(c->pid, &exe) >= 0 && !streq_ptr(exe, c->exe))
+                return true;
+
+        if (get_process_cmdline(c->pid, SIZE_MAX, PROCESS_CMDLINE_QUOTE, &cmdline) >= 0 &&
+            !streq_ptr(cmdline, client_context_cmdline(c)))
+                return true;
+
+        /* See client_context_read_cgroup() for why we ignore the root cgroup */
+        if (cg_pid_get_path_shifted(c->pid, s->cgroup_root, &cgroup) >= 0 && !empty_or_root(cgroup) &&
+            !streq_ptr(cgroup, c->cgroup))
+                return true;
+
+        return false;
+}
+
+static void client_context_revalidate(
+                Server *s,
+                ClientContext *c,
+                const struct ucred *ucred,
+                const char *label, size_t label_size,
+                const char *unit_id,
+                usec_t timestamp) {
+
+        assert(s);
+        assert(c);
+
+        if (client_context_changed(s, c)) {
+                client_context_really_refresh(s, c, ucred, label, label_size, unit_id, timestamp);
+                return;
+        }
+
+        /* The per-unit settings may change at any time, but they are cheap to check, and none of them are
+         * serialized. */
+        (void) client_context_read_log_level_max(s, c);
+        (void) client_context_read_extra_fields(s, c);
+        (void) client_context_read_log_ratelimit_interval(c);
+        (void) client_context_read_log_ratelimit_burst(c);
+
         c->timestamp = timestamp;
 
         if (c->in_lru) {
@@ -545,6 +792,8 @@ void client_context_maybe_refresh(
                 const char *unit_id,
                 usec_t timestamp) {
 
+        bool mismatch;
+
         assert(s);
         assert(c);
 
@@ -555,6 +804,35 @@ void client_context_maybe_refresh(
         if (c->timestamp == USEC_INFINITY)
                 goto refresh;
 
+        /* Does the data passed along match the cached data? */
+        mismatch = (ucred && uid_is_valid(ucred->uid) && c->uid != ucred->uid) ||
+                (ucred && gid_is_valid(ucred->gid) && c->gid != ucred->gid) ||
+                (label_size > 0 && (label_size != c->label_size || memcmp(label, c->label, label_size) != 0));
+
+        if (c->exit_timestamp != USEC_INFINITY) {
+                /* The process exited, hence there's nothing to reread. Keep the data for the messages it left
+                 * behind, unless the credentials tell us someone else is using the PID now. Flush it out once
+                 * the PID is likely to be reused, unless the data is pinned, following the logic below. */
+                if (mismatch || (c->n_ref == 0 && c->exit_timestamp + MAX_USEC < timestamp)) {
+                        client_context_reset(s, c);
+                        goto refresh;
+                }
+
+                return;
+        }
+
+        if (c->pidfd_event_source) {
+                /* The process is still around, hence the PID wasn't reused and we can keep the data as long as
+                 * we like, as long as the process didn't change fundamentally. */
+                if (mismatch || c->full_timestamp + FULL_REFRESH_USEC < timestamp)
+                        goto refresh;
+
+                if (c->timestamp + REFRESH_USEC < timestamp)
+                        client_context_revalidate(s, c, ucred, label, label_size, unit_id, timestamp);
+
+                return;
+        }
+
         /* If the data isn't pinned and if the cashed data is older than the upper limit, we flush it out
          * entirely. This follows the logic that as long as an entry is pinned the PID reuse is unlikely. */
         if (c->n_ref == 0 && c->timestamp + MAX_USEC < timestamp) {
@@ -567,13 +845,7 @@ void client_context_maybe_refresh(
                 goto refresh;
 
         /* If the data passed along doesn't match the cached data we also do a refresh */
-        if (ucred && uid_is_valid(ucred->uid) && c->uid != ucred->uid)
-                goto refresh;
-
-        if (ucred && gid_is_valid(ucred->gid) && c->gid != ucred->gid)
-                goto refresh;
-
-        if (label_size > 0 && (label_size != c->label_size || memcmp(label, c->label, label_size) != 0))
+        if (mismatch)
                 goto refresh;
 
         return;
@@ -602,7 +874,7 @@ static void client_context_try_shrink_to(Server *s, size_t limit) {
 
                         assert(c->n_ref == 0);
 
-                        if (!pid_is_unwaited(c->pid))
+                        if (client_context_gone(c, t))
                                 client_context_free(s, c);
                         else
                                 idx ++;
@@ -5,27 +5,34 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include "sd-event.h"
 #include "sd-id128.h"
 
 #include "time-util.h"
 
 typedef struct ClientContext ClientContext;
 
+#include "journald-intern.h"
 #include "journald-server.h"
 
 struct ClientContext {
         unsigned n_ref;
         unsigned lru_index;
         usec_t timestamp;
+        usec_t full_timestamp;
         bool in_lru;
 
         pid_t pid;
         uid_t uid;
         gid_t gid;
 
+        /* Watches a pidfd of the process, so that we learn when it exits and its PID might get reused */
+        sd_event_source *pidfd_event_source;
+        usec_t exit_timestamp;
+
         char *comm;
         char *exe;
-        char *cmdline;
+        InternedField *cmdline_field; /* "_CMDLINE=…", use client_context_cmdline() for the plain value */
         char *capeff;
 
         uint32_t auditid;
@@ -55,6 +62,11 @@ struct ClientContext {
 
         usec_t log_ratelimit_interval;
         unsigned log_ratelimit_burst;
+
+        /* The fields above, except for the command line and the extra fields, serialized as "_FIELD=value"
+         * strings, ready to be appended to every entry we store for this client */
+        InternedField *meta[17]; /* 16 strings and the SELinux label */
+        size_t n_meta;
 };
 
 int client_context_get(
@@ -86,6 +98,10 @@ void client_context_maybe_refresh(
 void client_context_acquire_default(Server *s);
 void client_context_flush_all(Server *s);
 
+static inline const char* client_context_cmdline(const ClientContext *c) {
+        return c->cmdline_field ? c->cmdline_field->data + STRLEN("_CMDLINE=") : NULL;
+}
+
 static inline size_t client_context_extra_fields_n_iovec(const ClientContext *c) {
         return c ? c->extra_fields_n_iovec : 0;
 }
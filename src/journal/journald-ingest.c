@@ -0,0 +1,330 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+
+#include "alloc-util.h"
+#include "event-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "journal-ring.h"
+#include "journald-ingest.h"
+#include "journald-server.h"
+#include "socket-util.h"
+
+/* If ThreadedReceive= is enabled, the native and syslog datagram sockets are not read by the event loop,
+ * but each by a worker thread of its own instead. The workers receive datagrams as fast as they come in,
+ * copy them together with their ancillary data into self-contained IngestDatagram objects, and hand these
+ * to the event loop thread via a queue event source. The event loop thread is left with turning them into
+ * journal entries and writing those out, and picks up everything received so far in one go, instead of
+ * going through one epoll_wait()/recvmsg() cycle per message. Since there is exactly one reader per
+ * socket, the order of the messages from each socket is retained.
+ *
+ * Everything past the receiving, i.e. client context lookup, rate limiting, forwarding and the actual
+ * writing, stays on the event loop thread, hence none of the server state needs to be protected against
+ * concurrent access. */
+
+/* How many datagrams to receive before checking whether we shall stop */
+#define INGEST_BATCH_MAX 256U
+
+struct IngestWorker {
+        Server *server;
+        int fd;
+        pthread_t thread;
+        char *buffer;
+};
+
+typedef struct IngestDatagram {
+        int fd;               /* The socket this was received on */
+        struct ucred ucred;
+        struct timeval tv;
+        bool have_ucred:1;
+        bool have_tv:1;
+        char *label;
+        size_t label_len;
+        int *fds;
+        size_t n_fds;
+        size_t size;
+        char data[];
+} IngestDatagram;
+
+static IngestDatagram* ingest_datagram_free(IngestDatagram *d) {
+        if (!d)
+                return NULL;
+
+        close_many(d->fds, d->n_fds);
+        free(d->fds);
+        free(d->label);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(IngestDatagram*, ingest_datagram_free);
+
+static int ingest_worker_receive(IngestWorker *w) {
+        _cleanup_(ingest_datagram_freep) IngestDatagram *d = NULL;
+        struct ucred *ucred = NULL;
+        struct timeval *tv = NULL;
+        struct cmsghdr *cmsg;
+        char *label = NULL;
+        size_t label_len = 0, m, n_fds = 0;
+        struct iovec iovec;
+        int *fds = NULL, v = 0, r;
+        ssize_t n;
+
+        /* See server_process_datagram() */
+        CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct ucred)) +
+                         CMSG_SPACE_TIMEVAL +
+                         CMSG_SPACE(sizeof(int) * JOURNAL_RING_N_FDS) + /* fds */
+                         CMSG_SPACE(NAME_MAX) /* selinux label */) control = {};
+
+        struct msghdr msghdr = {
+                .msg_iov = &iovec,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+
+        assert(w);
+
+        (void) ioctl(w->fd, SIOCINQ, &v);
+
+        m = PAGE_ALIGN(MAX((size_t) v + 1, (size_t) LINE_MAX) + 1);
+
+        if (!GREEDY_REALLOC(w->buffer, m))
+                return -ENOMEM;
+
+        iovec = IOVEC_MAKE(w->buffer, MALLOC_ELEMENTSOF(w->buffer) - 1);
+
+        n = recvmsg_safe(w->fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+        if (n < 0) {
+                if (ERRNO_IS_TRANSIENT(n))
+                        return -EAGAIN;
+                if (n == -EXFULL) {
+                        log_warning("Got message with truncated control data (too many fds sent?), ignoring.");
+                        return 0;
+                }
+                return log_error_errno(n, "recvmsg() failed: %m");
+        }
+
+        CMSG_FOREACH(cmsg, &msghdr)
+                if (cmsg->cmsg_level == SOL_SOCKET &&
+                    cmsg->cmsg_type == SCM_CREDENTIALS &&
+                    cmsg->cmsg_len == CMSG_LEN(sizeof(struct ucred)))
+                        ucred = (struct ucred*) CMSG_DATA(cmsg);
+                else if (cmsg->cmsg_level == SOL_SOCKET &&
+                         cmsg->cmsg_type == SCM_SECURITY) {
+                        label = (char*) CMSG_DATA(cmsg);
+                        label_len = cmsg->cmsg_len - CMSG_LEN(0);
+                } else if (cmsg->cmsg_level == SOL_SOCKET &&
+                           cmsg->cmsg_type == SO_TIMESTAMP &&
+                           cmsg->cmsg_len == CMSG_LEN(sizeof(struct timeval)))
+                        tv = (struct timeval*) CMSG_DATA(cmsg);
+                else if (cmsg->cmsg_level == SOL_SOCKET &&
+                         cmsg->cmsg_type == SCM_RIGHTS) {
+                        fds = (int*) CMSG_DATA(cmsg);
+                        n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                }
+
+        d = malloc0(offsetof(IngestDatagram, data) + n + 1);
+        if (!d) {
+                close_many(fds, n_fds);
+                return -ENOMEM;
+        }
+
+        d->fd = w->fd;
+        d->size = n;
+        memcpy(d->data, w->buffer, n);
+        d->data[n] = 0; /* A trailing NUL, just in case */
+
+        if (n_fds > 0) {
+                d->fds = newdup(int, fds, n_fds);
+                if (!d->fds) {
+                        close_many(fds, n_fds);
+                        return -ENOMEM;
+                }
+                d->n_fds = n_fds;
+        }
+
+        if (ucred) {
+                d->ucred = *ucred;
+                d->have_ucred = true;
+        }
+
+        if (tv) {
+                d->tv = *tv;
+                d->have_tv = true;
+        }
+
+        if (label) {
+                d->label = memdup_suffix0(label, label_len);
+                if (!d->label)
+                        return -ENOMEM;
+                d->label_len = label_len;
+        }
+
+        r = sd_event_source_queue_post(w->server->ingest_event_source, d);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(d);
+        return 0;
+}
+
+static void* ingest_worker_thread(void *p) {
+        IngestWorker *w = ASSERT_PTR(p);
+        int r;
+
+        for (;;) {
+                struct pollfd pollfd[] = {
+                        { .fd = w->fd,                     .events = POLLIN },
+                        { .fd = w->server->ingest_stop_fd, .events = POLLIN },
+                };
+                bool idle = false;
+
+                for (unsigned i = 0; i < INGEST_BATCH_MAX; i++) {
+                        r = ingest_worker_receive(w);
+                        if (r == -EAGAIN) {
+                                idle = true;
+                                break;
+                        }
+                        if (r == -ENOMEM)
+                                log_oom(); /* Drop this message, but continue with the next one */
+                        else if (r < 0)
+                                /* Same as when the event loop reads the socket: give up on it */
+                                return NULL;
+                }
+
+                /* Block if there's nothing to read, otherwise just check if we shall stop */
+                r = ppoll_usec(pollfd, ELEMENTSOF(pollfd), idle ? USEC_INFINITY : 0);
+                if (r == -EINTR)
+                        continue;
+                if (r < 0) {
+                        log_error_errno(r, "Failed to wait for datagrams: %m");
+                        return NULL;
+                }
+
+                if (pollfd[1].revents != 0)
+                        return NULL;
+        }
+}
+
+static int dispatch_ingest_datagram(sd_event_source *es, void *item, void *userdata) {
+        _cleanup_(ingest_datagram_freep) IngestDatagram *d = item;
+        Server *s = ASSERT_PTR(userdata);
+
+        assert(d);
+
+        server_process_datagram_data(
+                        s,
+                        d->fd,
+                        d->data, d->size,
+                        d->have_ucred ? &d->ucred : NULL,
+                        d->have_tv ? &d->tv : NULL,
+                        d->label, d->label_len,
+                        d->fds, d->n_fds,
+                        NULL, 0);
+
+        server_refresh_idle_timer(s);
+        return 0;
+}
+
+static int ingest_worker_start(Server *s, int fd, sd_event_source *event_source) {
+        IngestWorker *w;
+        int r;
+
+        assert(s);
+        assert(s->ingest_workers);
+
+        if (fd < 0)
+                return 0;
+
+        w = s->ingest_workers + s->n_ingest_workers;
+        *w = (IngestWorker) {
+                .server = s,
+                .fd = fd,
+        };
+
+        r = pthread_create(&w->thread, NULL, ingest_worker_thread, w);
+        if (r > 0)
+                return log_warning_errno(r, "Failed to start ingest thread, reading socket from event loop: %m");
+
+        s->n_ingest_workers++;
+
+        /* From now on the thread reads the socket, not the event loop */
+        r = sd_event_source_set_enabled(event_source, SD_EVENT_OFF);
+        if (r < 0)
+                return log_error_errno(r, "Failed to disable socket event source: %m");
+
+        return 1;
+}
+
+int server_start_ingest(Server *s) {
+        int r;
+
+        assert(s);
+
+        if (!s->threaded_receive)
+                return 0;
+
+        s->ingest_stop_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (s->ingest_stop_fd < 0)
+                return log_warning_errno(errno, "Failed to allocate ingest stop eventfd: %m");
+
+        r = sd_event_add_queue(s->event, &s->ingest_event_source, dispatch_ingest_datagram, s);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to add ingest queue event source: %m");
+
+        /* Same priority as the sockets themselves */
+        r = sd_event_source_set_priority(s->ingest_event_source, SD_EVENT_PRIORITY_NORMAL+5);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to adjust ingest queue event source priority: %m");
+
+        (void) sd_event_source_set_description(s->ingest_event_source, "journal-ingest");
+
+        s->ingest_workers = new(IngestWorker, 2);
+        if (!s->ingest_workers)
+                return log_oom();
+
+        r = ingest_worker_start(s, s->native_fd, s->native_event_source);
+        if (r < 0)
+                return r;
+
+        r = ingest_worker_start(s, s->syslog_fd, s->syslog_event_source);
+        if (r < 0)
+                return r;
+
+        log_debug("Started %zu ingest threads.", s->n_ingest_workers);
+        return 0;
+}
+
+void server_stop_ingest(Server *s) {
+        int r;
+
+        assert(s);
+
+        if (s->ingest_stop_fd >= 0)
+                (void) eventfd_write(s->ingest_stop_fd, 1);
+
+        for (size_t i = 0; i < s->n_ingest_workers; i++) {
+                IngestWorker *w = s->ingest_workers + i;
+
+                r = pthread_join(w->thread, NULL);
+                if (r > 0)
+                        log_warning_errno(r, "Failed to join ingest thread, ignoring: %m");
+
+                free(w->buffer);
+        }
+
+        s->ingest_workers = mfree(s->ingest_workers);
+        s->n_ingest_workers = 0;
+
+        /* Write out whatever the threads received that the event loop didn't get to anymore */
+        if (s->ingest_event_source)
+                (void) event_source_queue_drain(s->ingest_event_source);
+
+        s->ingest_event_source = sd_event_source_unref(s->ingest_event_source);
+        s->ingest_stop_fd = safe_close(s->ingest_stop_fd);
+}
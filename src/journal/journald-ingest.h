@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+typedef struct IngestWorker IngestWorker;
+
+#include "journald-server.h"
+
+int server_start_ingest(Server *s);
+void server_stop_ingest(Server *s);
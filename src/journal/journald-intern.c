@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "hash-funcs.h"
+#include "journald-intern.h"
+#include "journald-server.h"
+#include "set.h"
+#include "siphash24.h"
+#include "string-util.h"
+
+static void interned_field_hash_func(const InternedField *f, struct siphash *state) {
+        siphash24_compress(&f->size, sizeof(f->size), state);
+        siphash24_compress(f->data, f->size, state);
+}
+
+static int interned_field_compare_func(const InternedField *a, const InternedField *b) {
+        int r;
+
+        r = CMP(a->size, b->size);
+        if (r != 0)
+                return r;
+
+        return memcmp(a->data, b->data, a->size);
+}
+
+DEFINE_PRIVATE_HASH_OPS(interned_field_hash_ops, InternedField, interned_field_hash_func, interned_field_compare_func);
+
+static InternedField* interned_field_free(InternedField *f) {
+        if (!f)
+                return NULL;
+
+        assert_se(set_remove(f->server->interned_fields, f) == f);
+
+        return mfree(f);
+}
+
+DEFINE_TRIVIAL_REF_UNREF_FUNC(InternedField, interned_field, interned_field_free);
+
+int interned_field_get(Server *s, const void *data, size_t size, InternedField **ret) {
+        _cleanup_free_ InternedField *f = NULL;
+        InternedField *existing;
+        int r;
+
+        assert(s);
+        assert(data || size == 0);
+        assert(ret);
+
+        if (size == 0)
+                return -EINVAL;
+
+        existing = set_get(s->interned_fields, &(InternedField) { .data = (char*) data, .size = size });
+        if (existing) {
+                *ret = interned_field_ref(existing);
+                return 0;
+        }
+
+        /* The data is stored right after the object, in the same allocation */
+        f = malloc(sizeof(InternedField) + size + 1);
+        if (!f)
+                return -ENOMEM;
+
+        *f = (InternedField) {
+                .n_ref = 1,
+                .server = s,
+                .data = (char*) (f + 1),
+                .size = size,
+        };
+        *((char*) mempcpy(f->data, data, size)) = 0;
+
+        r = set_ensure_put(&s->interned_fields, &interned_field_hash_ops, f);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(f);
+        return 1;
+}
+
+int interned_field_get_string(Server *s, const char *field, const char *value, InternedField **ret) {
+        _cleanup_free_ char *x = NULL;
+
+        assert(s);
+        assert(field);
+        assert(ret);
+
+        if (isempty(value)) {
+                *ret = NULL;
+                return 0;
+        }
+
+        x = strjoin(field, value);
+        if (!x)
+                return -ENOMEM;
+
+        return interned_field_get(s, x, strlen(x), ret);
+}
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <sys/uio.h>
+
+#include "io-util.h"
+#include "journal-file.h"
+#include "macro.h"
+
+typedef struct InternedField InternedField;
+typedef struct Server Server;
+
+/* A "FIELD=value" string we attach to many entries, such as the trusted fields of a client, or the hostname.
+ * Identical strings are shared, and remember where they were stored last, so that they have to be hashed and
+ * looked up only once per journal file. Queued entries hold a reference to the fields they contain. */
+struct InternedField {
+        unsigned n_ref;
+        Server *server;
+
+        JournalDataHint hint;
+
+        char *data; /* NUL terminated, but not necessarily a string */
+        size_t size;
+};
+
+int interned_field_get(Server *s, const void *data, size_t size, InternedField **ret);
+int interned_field_get_string(Server *s, const char *field, const char *value, InternedField **ret);
+
+InternedField* interned_field_ref(InternedField *f);
+InternedField* interned_field_unref(InternedField *f);
+DEFINE_TRIVIAL_CLEANUP_FUNC(InternedField*, interned_field_unref);
+
+static inline InternedField* interned_field_from_hint(JournalDataHint *hint) {
+        return container_of(hint, InternedField, hint);
+}
+
+static inline void interned_field_put(InternedField *f, struct iovec *iovec, JournalDataHint **hints, size_t *n) {
+        assert(iovec);
+        assert(hints);
+        assert(n);
+
+        if (!f)
+                return;
+
+        iovec[*n] = IOVEC_MAKE(f->data, f->size);
+        hints[(*n)++] = &f->hint;
+}
@@ -15,6 +15,7 @@
 #include "fd-util.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "hashmap.h"
 #include "io-util.h"
 #include "journald-kmsg.h"
 #include "journald-server.h"
@@ -24,6 +25,36 @@
 #include "process-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "strv.h"
+
+/* Maximum number of records to read from /dev/kmsg per wakeup, so that a storm of kernel messages doesn't
+ * starve the other event sources */
+#define DEV_KMSG_BATCH_MAX 64U
+
+/* How long the udev metadata of a _KERNEL_DEVICE= is reused. Drivers tend to log in bursts, hence even a
+ * short lifetime avoids most lookups, while devnodes and symlinks assigned by udev show up soon enough. */
+#define KERNEL_DEVICE_CACHE_USEC (1 * USEC_PER_SEC)
+#define KERNEL_DEVICE_CACHE_MAX 256U
+
+typedef struct KernelDevice {
+        char *id;
+        usec_t timestamp;
+        char **fields; /* _UDEV_DEVNODE=, _UDEV_SYSNAME=, _UDEV_DEVLINK= fields, NULL if the device is unknown */
+} KernelDevice;
+
+static KernelDevice *kernel_device_free(KernelDevice *d) {
+        if (!d)
+                return NULL;
+
+        free(d->id);
+        strv_free(d->fields);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(KernelDevice*, kernel_device_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(kernel_device_hash_ops, char, string_hash_func, string_compare_func,
+                                              KernelDevice, kernel_device_free);
 
 void server_forward_kmsg(
                 Server *s,
@@ -96,6 +127,81 @@ static bool is_us(const char *identifier, const char *pid) {
                streq(identifier, program_invocation_short_name);
 }
 
+static char **kernel_device_fields(const char *id) {
+        _cleanup_(sd_device_unrefp) sd_device *d = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        const char *g;
+        size_t j = 0;
+
+        if (sd_device_new_from_device_id(&d, id) < 0)
+                return NULL;
+
+        /* Allocation failures are ignored here, we'll just log the record without these fields then */
+
+        if (sd_device_get_devname(d, &g) >= 0)
+                (void) strv_consume(&l, strjoin("_UDEV_DEVNODE=", g));
+
+        if (sd_device_get_sysname(d, &g) >= 0)
+                (void) strv_consume(&l, strjoin("_UDEV_SYSNAME=", g));
+
+        FOREACH_DEVICE_DEVLINK(d, g) {
+
+                if (j >= N_IOVEC_UDEV_FIELDS)
+                        break;
+
+                (void) strv_consume(&l, strjoin("_UDEV_DEVLINK=", g));
+                j++;
+        }
+
+        return TAKE_PTR(l);
+}
+
+static char **server_kernel_device_fields(Server *s, const char *id) {
+        _cleanup_(kernel_device_freep) KernelDevice *d = NULL;
+        KernelDevice *cached;
+        usec_t n;
+        int r;
+
+        assert(s);
+        assert(id);
+
+        /* Returns the udev fields to attach to records of the specified device. The strings are owned by
+         * the cache and remain valid until the next call. */
+
+        n = now(CLOCK_MONOTONIC);
+
+        cached = hashmap_get(s->kernel_devices, id);
+        if (cached) {
+                if (cached->timestamp + KERNEL_DEVICE_CACHE_USEC > n)
+                        return cached->fields;
+
+                /* Expired, look it up again */
+                kernel_device_free(hashmap_remove(s->kernel_devices, id));
+        }
+
+        /* Don't grow without bounds if lots of different devices are logging, entries are short-lived anyway */
+        if (hashmap_size(s->kernel_devices) >= KERNEL_DEVICE_CACHE_MAX)
+                hashmap_clear(s->kernel_devices);
+
+        d = new(KernelDevice, 1);
+        if (!d)
+                return NULL;
+
+        *d = (KernelDevice) {
+                .id = strdup(id),
+                .timestamp = n,
+                .fields = kernel_device_fields(id),
+        };
+        if (!d->id)
+                return NULL;
+
+        r = hashmap_ensure_put(&s->kernel_devices, &kernel_device_hash_ops, d->id, d);
+        if (r < 0)
+                return NULL;
+
+        return TAKE_PTR(d)->fields;
+}
+
 void dev_kmsg_record(Server *s, char *p, size_t l) {
 
         _cleanup_free_ char *message = NULL, *syslog_priority = NULL, *syslog_pid = NULL, *syslog_facility = NULL, *syslog_identifier = NULL, *source_time = NULL, *identifier = NULL, *pid = NULL;
@@ -213,45 +319,10 @@ void dev_kmsg_record(Server *s, char *p, size_t l) {
                 k = e + 1;
         }
 
-        if (kernel_device) {
-                _cleanup_(sd_device_unrefp) sd_device *d = NULL;
-
-                if (sd_device_new_from_device_id(&d, kernel_device) >= 0) {
-                        const char *g;
-                        char *b;
-
-                        if (sd_device_get_devname(d, &g) >= 0) {
-                                b = strjoin("_UDEV_DEVNODE=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        if (sd_device_get_sysname(d, &g) >= 0) {
-                                b = strjoin("_UDEV_SYSNAME=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        j = 0;
-                        FOREACH_DEVICE_DEVLINK(d, g) {
-
-                                if (j >= N_IOVEC_UDEV_FIELDS)
-                                        break;
-
-                                b = strjoin("_UDEV_DEVLINK=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-
-                                j++;
-                        }
-                }
-        }
+        /* These are owned by the cache, hence not counted in z */
+        if (kernel_device)
+                STRV_FOREACH(g, server_kernel_device_fields(s, kernel_device))
+                        iovec[n++] = IOVEC_MAKE_STRING(*g);
 
         if (asprintf(&source_time, "_SOURCE_MONOTONIC_TIMESTAMP=%llu", usec) >= 0)
                 iovec[n++] = IOVEC_MAKE_STRING(source_time);
@@ -363,6 +434,7 @@ int server_flush_dev_kmsg(Server *s) {
 
 static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         Server *s = userdata;
+        int r;
 
         assert(es);
         assert(fd == s->dev_kmsg_fd);
@@ -374,7 +446,15 @@ static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void
         if (!(revents & EPOLLIN))
                 log_error("Got invalid event from epoll for /dev/kmsg: %"PRIx32, revents);
 
-        return server_read_dev_kmsg(s);
+        /* Each read() returns exactly one record, but there's no need to go back to the event loop for
+         * each of them */
+        for (unsigned i = 0; i < DEV_KMSG_BATCH_MAX; i++) {
+                r = server_read_dev_kmsg(s);
+                if (r <= 0)
+                        return r;
+        }
+
+        return 0;
 }
 
 int server_open_dev_kmsg(Server *s) {
@@ -7,6 +7,7 @@
 #include "journald-rate-limit.h"
 #include "list.h"
 #include "random-util.h"
+#include "siphash24.h"
 #include "string-util.h"
 #include "time-util.h"
 
@@ -14,6 +15,16 @@
 #define BUCKETS_MAX 127
 #define GROUPS_MAX 2047
 
+/* The hierarchical mode keeps its buckets in a fixed size open addressing table: a bucket is looked for in
+ * CGROUP_BUCKET_PROBES consecutive slots, and if it is not found there, the least recently used slot among
+ * them is reused for it. Hence, after the table has been allocated, the only allocation is the copy of the
+ * cgroup path made when a bucket is created. */
+#define CGROUP_BUCKETS_MAX 4096U
+#define CGROUP_BUCKET_PROBES 8U
+#define CGROUP_DEPTH_MAX 16U
+
+assert_cc((CGROUP_BUCKETS_MAX & (CGROUP_BUCKETS_MAX - 1)) == 0);
+
 static const int priority_map[] = {
         [LOG_EMERG]   = 0,
         [LOG_ALERT]   = 0,
@@ -28,6 +39,8 @@ static const int priority_map[] = {
 typedef struct JournalRateLimitPool JournalRateLimitPool;
 typedef struct JournalRateLimitGroup JournalRateLimitGroup;
 
+typedef struct JournalRateLimitBucket JournalRateLimitBucket;
+
 struct JournalRateLimitPool {
         usec_t begin;
         unsigned num;
@@ -45,10 +58,31 @@ struct JournalRateLimitGroup {
         JournalRateLimitPool pools[POOLS_MAX];
         uint64_t hash;
 
+        uint64_t n_dropped;
+
         LIST_FIELDS(JournalRateLimitGroup, bucket);
         LIST_FIELDS(JournalRateLimitGroup, lru);
 };
 
+struct JournalRateLimitBucket {
+        char *path;      /* The cgroup path, NULL if the slot is unused */
+        size_t length;
+        uint64_t hash;
+
+        /* Token buckets, one per pool. The credit is counted in µs: it is refilled with the time passing, up
+         * to one full interval, and every message costs interval/burst of it. */
+        usec_t credit[POOLS_MAX];
+        usec_t last;
+
+        /* Messages of this cgroup suppressed since the last one was let through, only used on the leaves */
+        unsigned suppressed[POOLS_MAX];
+
+        /* Messages dropped because this bucket ran out of credit */
+        uint64_t n_dropped;
+
+        bool busy;       /* Used by the journal_ratelimit_test_cgroup() call in progress, must not be reused */
+};
+
 struct JournalRateLimit {
 
         JournalRateLimitGroup* buckets[BUCKETS_MAX];
@@ -56,6 +90,8 @@ struct JournalRateLimit {
 
         unsigned n_groups;
 
+        JournalRateLimitBucket *cgroup_buckets; /* CGROUP_BUCKETS_MAX entries, allocated on first use */
+
         uint8_t hash_key[16];
 };
 
@@ -96,6 +132,11 @@ void journal_ratelimit_free(JournalRateLimit *r) {
         while (r->lru)
                 journal_ratelimit_group_free(r->lru);
 
+        if (r->cgroup_buckets)
+                for (unsigned i = 0; i < CGROUP_BUCKETS_MAX; i++)
+                        free(r->cgroup_buckets[i].path);
+        free(r->cgroup_buckets);
+
         free(r);
 }
 
@@ -252,5 +293,256 @@ int journal_ratelimit_test(JournalRateLimit *r, const char *id, usec_t rl_interv
         }
 
         p->suppressed++;
+        found->n_dropped++;
+        return 0;
+}
+
+static void journal_ratelimit_bucket_refill(JournalRateLimitBucket *b, usec_t capacity, usec_t ts) {
+        usec_t elapsed;
+
+        assert(b);
+
+        elapsed = usec_sub_unsigned(ts, b->last);
+
+        for (unsigned i = 0; i < POOLS_MAX; i++)
+                b->credit[i] = MIN(usec_add(b->credit[i], elapsed), capacity);
+
+        b->last = ts;
+}
+
+static int journal_ratelimit_bucket_get(
+                JournalRateLimit *r,
+                const char *path,
+                size_t length,
+                uint64_t hash,
+                usec_t capacity,
+                usec_t ts,
+                JournalRateLimitBucket **ret) {
+
+        JournalRateLimitBucket *victim = NULL;
+        char *copy;
+
+        assert(r);
+        assert(r->cgroup_buckets);
+        assert(path);
+        assert(ret);
+
+        for (unsigned i = 0; i < CGROUP_BUCKET_PROBES; i++) {
+                JournalRateLimitBucket *b = r->cgroup_buckets + ((hash + i) & (CGROUP_BUCKETS_MAX - 1));
+
+                if (!b->path) {
+                        if (!victim || victim->path)
+                                victim = b;
+                        continue;
+                }
+
+                if (b->hash == hash && b->length == length && memcmp(b->path, path, length) == 0) {
+                        journal_ratelimit_bucket_refill(b, capacity, ts);
+                        *ret = b;
+                        return 0;
+                }
+
+                if (!b->busy && (!victim || (victim->path && b->last < victim->last)))
+                        victim = b;
+        }
+
+        if (!victim) {
+                /* All slots are taken by the levels of the cgroup we are looking at, skip this one. */
+                *ret = NULL;
+                return 0;
+        }
+
+        copy = strndup(path, length);
+        if (!copy)
+                return -ENOMEM;
+
+        free(victim->path);
+        *victim = (JournalRateLimitBucket) {
+                .path = copy,
+                .length = length,
+                .hash = hash,
+                .last = ts,
+        };
+
+        for (unsigned i = 0; i < POOLS_MAX; i++)
+                victim->credit[i] = capacity;
+
+        *ret = victim;
+        return 0;
+}
+
+int journal_ratelimit_test_cgroup(
+                JournalRateLimit *r,
+                const char *cgroup,
+                const char *unit,
+                usec_t rl_interval,
+                unsigned rl_burst,
+                usec_t slice_interval,
+                unsigned slice_burst,
+                int priority,
+                uint64_t available) {
+
+        struct {
+                JournalRateLimitBucket *bucket;
+                usec_t cost;
+        } levels[CGROUP_DEPTH_MAX];
+        JournalRateLimitBucket *leaf = NULL, *denied = NULL;
+        size_t n_levels = 0;
+        struct siphash state;
+        const char *p;
+        unsigned pool;
+        usec_t ts;
+        int k = 0;
+
+        assert(cgroup);
+
+        /* Like journal_ratelimit_test(), but applies a token bucket to every level of the cgroup tree: one
+         * for each slice (or other cgroup) above the unit, limited by slice_interval and slice_burst, and one
+         * for the unit itself, limited by rl_interval and rl_burst. Cgroups below the unit share its bucket.
+         * A message is only let through if every level has enough credit left for it, and is then accounted
+         * to all of them. If the unit is not found in the path, the whole path is used as the unit's bucket.
+         *
+         * Returns the same as journal_ratelimit_test(). */
+
+        if (!r)
+                return 1;
+
+        if (!r->cgroup_buckets) {
+                r->cgroup_buckets = new0(JournalRateLimitBucket, CGROUP_BUCKETS_MAX);
+                if (!r->cgroup_buckets)
+                        return -ENOMEM;
+        }
+
+        ts = now(CLOCK_MONOTONIC);
+        pool = priority_map[priority];
+
+        siphash24_init(&state, r->hash_key);
+
+        p = cgroup;
+        while (!leaf) {
+                JournalRateLimitBucket *b;
+                struct siphash copy;
+                const char *e;
+                usec_t interval;
+                unsigned burst;
+                size_t n;
+                bool last;
+
+                p += strspn(p, "/");
+                n = strcspn(p, "/");
+                if (n == 0)
+                        break;
+
+                e = p + n;
+                last = e[strspn(e, "/")] == 0 || (unit && strneq(p, unit, n) && unit[n] == 0);
+
+                /* Hash the path incrementally, one component after the other */
+                siphash24_compress(p, n, &state);
+                siphash24_compress("/", 1, &state);
+                p = e;
+
+                if (!last && n_levels >= CGROUP_DEPTH_MAX - 1)
+                        continue;
+
+                copy = state;
+
+                interval = last ? rl_interval : slice_interval;
+                burst = last ? rl_burst : slice_burst;
+
+                k = journal_ratelimit_bucket_get(r, cgroup, e - cgroup, siphash24_finalize(&copy), interval, ts, &b);
+                if (k < 0)
+                        goto finish;
+                if (!b)
+                        continue;
+
+                b->busy = true;
+                levels[n_levels++] = (typeof(levels[0])) {
+                        .bucket = b,
+                        .cost = interval > 0 && burst > 0 ? MAX(interval / burst_modulate(burst, available), 1u) : 0,
+                };
+
+                if (last)
+                        leaf = b;
+        }
+
+        if (!leaf) {
+                k = 1;
+                goto finish;
+        }
+
+        /* Account the drop to the most specific level that ran out of credit */
+        for (size_t i = n_levels; i > 0; i--)
+                if (levels[i-1].bucket->credit[pool] < levels[i-1].cost) {
+                        denied = levels[i-1].bucket;
+                        break;
+                }
+
+        if (denied) {
+                denied->n_dropped++;
+                leaf->suppressed[pool]++;
+                k = 0;
+        } else {
+                for (size_t i = 0; i < n_levels; i++)
+                        levels[i].bucket->credit[pool] -= levels[i].cost;
+
+                k = 1 + leaf->suppressed[pool];
+                leaf->suppressed[pool] = 0;
+        }
+
+finish:
+        for (size_t i = 0; i < n_levels; i++)
+                levels[i].bucket->busy = false;
+
+        return k;
+}
+
+int journal_ratelimit_build_json(JournalRateLimit *r, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        int k;
+
+        assert(ret);
+
+        if (r) {
+                LIST_FOREACH(lru, g, r->lru) {
+                        _cleanup_(json_variant_unrefp) JsonVariant *w = NULL;
+
+                        k = json_build(&w, JSON_BUILD_OBJECT(
+                                                       JSON_BUILD_PAIR_STRING("unit", g->id),
+                                                       JSON_BUILD_PAIR_UNSIGNED("dropped", g->n_dropped)));
+                        if (k < 0)
+                                return k;
+
+                        k = json_variant_append_array(&v, w);
+                        if (k < 0)
+                                return k;
+                }
+
+                if (r->cgroup_buckets)
+                        for (unsigned i = 0; i < CGROUP_BUCKETS_MAX; i++) {
+                                _cleanup_(json_variant_unrefp) JsonVariant *w = NULL;
+                                JournalRateLimitBucket *b = r->cgroup_buckets + i;
+
+                                if (!b->path)
+                                        continue;
+
+                                k = json_build(&w, JSON_BUILD_OBJECT(
+                                                               JSON_BUILD_PAIR_STRING("cgroup", b->path),
+                                                               JSON_BUILD_PAIR_UNSIGNED("dropped", b->n_dropped)));
+                                if (k < 0)
+                                        return k;
+
+                                k = json_variant_append_array(&v, w);
+                                if (k < 0)
+                                        return k;
+                        }
+        }
+
+        if (!v) {
+                k = json_variant_new_array(&v, NULL, 0);
+                if (k < 0)
+                        return k;
+        }
+
+        *ret = TAKE_PTR(v);
         return 0;
 }
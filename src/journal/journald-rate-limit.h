@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 #pragma once
 
+#include "json.h"
 #include "time-util.h"
 
 typedef struct JournalRateLimit JournalRateLimit;
@@ -8,3 +9,14 @@ typedef struct JournalRateLimit JournalRateLimit;
 JournalRateLimit *journal_ratelimit_new(void);
 void journal_ratelimit_free(JournalRateLimit *r);
 int journal_ratelimit_test(JournalRateLimit *r, const char *id, usec_t rl_interval, unsigned rl_burst, int priority, uint64_t available);
+int journal_ratelimit_test_cgroup(
+                JournalRateLimit *r,
+                const char *cgroup,
+                const char *unit,
+                usec_t rl_interval,
+                unsigned rl_burst,
+                usec_t slice_interval,
+                unsigned slice_burst,
+                int priority,
+                uint64_t available);
+int journal_ratelimit_build_json(JournalRateLimit *r, JsonVariant **ret);
@@ -0,0 +1,374 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "errno-util.h"
+#include "fd-util.h"
+#include "journal-ring.h"
+#include "journald-native.h"
+#include "journald-ring.h"
+#include "journald-server.h"
+#include "missing_fcntl.h"
+#include "process-util.h"
+#include "socket-util.h"
+#include "string-util.h"
+#include "unaligned.h"
+
+/* Clients logging at high rates may hand us a shared memory ring with sd_journal_enable_ring(), and write
+ * their entries in the native protocol into it. They kick the eventfd passed along only when the ring was
+ * empty before, i.e. when we might be waiting for the next entry, hence we keep draining entries without any
+ * syscall on either side as long as the client keeps up the pace. The other end of the socket pair passed
+ * along tells us when the client went away, and is used to wake the client up when it waits for space in a
+ * full ring. See docs/JOURNAL_NATIVE_PROTOCOL.md for the protocol. */
+
+#define NATIVE_RINGS_MAX 4096U
+
+/* How many entries to take from a ring in one go, before giving other event sources a chance */
+#define NATIVE_RING_BATCH_MAX 256U
+
+struct NativeRing {
+        Server *server;
+
+        struct ucred ucred;
+        char *label;
+        ClientContext *context;
+
+        JournalRingHeader *header;
+        const uint8_t *data;
+        size_t mapped_size;
+        uint32_t size;
+        uint32_t tail;
+
+        int event_fd;
+        int control_fd;
+        sd_event_source *event_source;
+        sd_event_source *control_event_source;
+
+        char *buffer;
+
+        LIST_FIELDS(NativeRing, native_rings);
+};
+
+NativeRing* native_ring_free(NativeRing *r) {
+        if (!r)
+                return NULL;
+
+        if (r->server) {
+                if (r->context)
+                        client_context_release(r->server, r->context);
+
+                assert(r->server->n_native_rings > 0);
+                r->server->n_native_rings--;
+                LIST_REMOVE(native_rings, r->server->native_rings, r);
+
+                (void) server_start_or_stop_idle_timer(r->server); /* Maybe we are idle now? */
+        }
+
+        if (r->header) {
+                /* Tell the client to stop writing to the ring, if it is still around */
+                __atomic_store_n(&r->header->closed, 1, __ATOMIC_RELEASE);
+                (void) munmap(r->header, r->mapped_size);
+        }
+
+        sd_event_source_disable_unref(r->event_source);
+        sd_event_source_disable_unref(r->control_event_source);
+        safe_close(r->event_fd);
+        safe_close(r->control_fd);
+        free(r->label);
+        free(r->buffer);
+
+        return mfree(r);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(NativeRing*, native_ring_free);
+
+/* Processes up to max entries from the ring. Returns 0 if the ring is empty, in which case the client kicks
+ * the eventfd with the next entry, 1 if entries are left, and negative if the ring is corrupted. */
+static int native_ring_drain(NativeRing *r, size_t max) {
+        assert(r);
+
+        for (size_t n = 0;; n++) {
+                _cleanup_close_ int fd = -1;
+                uint32_t head, offset, length, avail, want;
+                uint64_t need;
+
+                /* This pairs with the client publishing its head before checking our tail: either we see
+                 * the new entry here, or the client sees that we caught up, and kicks us. */
+                head = __atomic_load_n(&r->header->head, __ATOMIC_SEQ_CST);
+                if (head == r->tail)
+                        return 0;
+                if (n >= max)
+                        return 1;
+
+                avail = head - r->tail;
+                if (avail > r->size)
+                        return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                                 "Ring of PID " PID_FMT " has invalid head, closing it.", r->ucred.pid);
+
+                /* Our tail is always 8 byte aligned, hence the record length is within the data area */
+                offset = r->tail & (r->size - 1);
+                length = unaligned_read_ne32(r->data + offset);
+
+                if (length == JOURNAL_RING_RECORD_WRAP)
+                        need = r->size - offset;
+                else {
+                        need = journal_ring_record_size(length == JOURNAL_RING_RECORD_FD ? 0 : length);
+                        if (offset + need > r->size)
+                                return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                                         "Ring of PID " PID_FMT " has record crossing its end, closing it.", r->ucred.pid);
+                }
+                if (need > avail)
+                        return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                                 "Ring of PID " PID_FMT " has truncated record, closing it.", r->ucred.pid);
+
+                if (length == JOURNAL_RING_RECORD_FD) {
+                        /* The client sent the memfd before writing the record, hence it is queued already */
+                        fd = receive_one_fd(r->control_fd, MSG_DONTWAIT);
+                        if (fd < 0)
+                                return log_warning_errno(fd, "Ring of PID " PID_FMT " refers to file descriptor that was not passed, closing it: %m", r->ucred.pid);
+
+                } else if (length != JOURNAL_RING_RECORD_WRAP) {
+                        /* The client may modify the ring at any time, hence copy the entry out first */
+                        if (!GREEDY_REALLOC(r->buffer, (size_t) length + 1))
+                                return log_oom();
+
+                        memcpy(r->buffer, r->data + offset + sizeof(uint32_t), length);
+                        r->buffer[length] = 0; /* A trailing NUL, just in case */
+                }
+
+                /* Hand the space back to the client before processing the entry */
+                r->tail += need;
+                __atomic_store_n(&r->header->tail, r->tail, __ATOMIC_SEQ_CST);
+
+                /* Wake the client up if it waits for the space that is free now. This pairs with the client
+                 * announcing that before checking our tail once more. */
+                want = __atomic_load_n(&r->header->waiting, __ATOMIC_SEQ_CST);
+                if (want > 0 && want <= r->size - (head - r->tail) &&
+                    __atomic_exchange_n(&r->header->waiting, 0, __ATOMIC_SEQ_CST) != 0)
+                        (void) send(r->control_fd, "", 1, MSG_DONTWAIT|MSG_NOSIGNAL);
+
+                if (fd >= 0)
+                        server_process_native_file(r->server, fd, &r->ucred, NULL, r->label, strlen_ptr(r->label));
+                else if (length != JOURNAL_RING_RECORD_WRAP && length > 0)
+                        server_process_native_message(r->server, r->buffer, length, &r->ucred, NULL, r->label, strlen_ptr(r->label));
+        }
+}
+
+NativeRing* native_ring_drain_and_free(NativeRing *r) {
+        if (!r)
+                return NULL;
+
+        /* Processes what is left in the ring, and frees it. Tell the client first to stop filling it up,
+         * and process no more than fits into it anyway, in case the client does not care. */
+        __atomic_store_n(&r->header->closed, 1, __ATOMIC_RELEASE);
+        (void) native_ring_drain(r, r->size / sizeof(uint64_t));
+        return native_ring_free(r);
+}
+
+static int native_ring_dispatch_event(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        NativeRing *r = ASSERT_PTR(userdata);
+        uint64_t u;
+        int k;
+
+        /* Reset the eventfd before looking at the ring, so that no kick can get lost */
+        if (read(fd, &u, sizeof(u)) < 0 && !ERRNO_IS_TRANSIENT(errno)) {
+                log_warning_errno(errno, "Failed to read eventfd of ring of PID " PID_FMT ", closing it: %m", r->ucred.pid);
+                native_ring_free(r);
+                return 0;
+        }
+
+        k = native_ring_drain(r, NATIVE_RING_BATCH_MAX);
+        if (k < 0) {
+                native_ring_free(r);
+                return 0;
+        }
+        if (k > 0)
+                /* There's more, come back to the ring after the other event sources had their turn */
+                (void) write(fd, &(uint64_t) { 1 }, sizeof(uint64_t));
+
+        return 0;
+}
+
+static int native_ring_dispatch_control(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        NativeRing *r = ASSERT_PTR(userdata);
+
+        /* The client went away */
+        native_ring_drain_and_free(r);
+
+        return 0;
+}
+
+void server_process_native_ring(
+                Server *s,
+                const int fds[],
+                const struct ucred *ucred,
+                const char *label,
+                size_t label_len) {
+
+        _cleanup_(native_ring_freep) NativeRing *r = NULL;
+        _cleanup_free_ char *path = NULL;
+        struct stat st, st_control;
+        uint32_t size;
+        void *p;
+        int seals, k;
+
+        assert(s);
+        assert(fds);
+
+        /* The ring is attributed to the process that passed it, hence we need to know who that is */
+        if (!ucred || !pid_is_valid(ucred->pid)) {
+                log_warning("Got ring without credentials via native socket. Ignoring.");
+                return;
+        }
+
+        if (s->n_native_rings >= NATIVE_RINGS_MAX) {
+                log_warning("Too many rings, refusing ring of PID " PID_FMT ".", ucred->pid);
+                return;
+        }
+
+        /* The client keeps writing to the ring, but its size must be sealed, so that it cannot trigger a
+         * SIGBUS for us by truncating it. */
+        seals = fcntl(fds[0], F_GET_SEALS);
+        if (seals < 0) {
+                log_warning_errno(errno, "Failed to get seals of ring of PID " PID_FMT ", refusing it: %m", ucred->pid);
+                return;
+        }
+        if (!FLAGS_SET(seals, F_SEAL_SHRINK)) {
+                log_warning("Ring of PID " PID_FMT " may be shrunk, refusing it.", ucred->pid);
+                return;
+        }
+
+        if (fstat(fds[0], &st) < 0) {
+                log_warning_errno(errno, "Failed to stat ring of PID " PID_FMT ", refusing it: %m", ucred->pid);
+                return;
+        }
+        if (!S_ISREG(st.st_mode) ||
+            st.st_size < JOURNAL_RING_DATA_OFFSET + JOURNAL_RING_SIZE_MIN ||
+            st.st_size > JOURNAL_RING_DATA_OFFSET + JOURNAL_RING_SIZE_MAX) {
+                log_warning("Ring of PID " PID_FMT " has invalid size, refusing it.", ucred->pid);
+                return;
+        }
+
+        k = fd_get_path(fds[1], &path);
+        if (k < 0 || !streq(path, "anon_inode:[eventfd]")) {
+                log_warning("Wakeup file descriptor of ring of PID " PID_FMT " is not an eventfd, refusing ring.", ucred->pid);
+                return;
+        }
+
+        if (fstat(fds[2], &st_control) < 0 || !S_ISSOCK(st_control.st_mode)) {
+                log_warning("Control file descriptor of ring of PID " PID_FMT " is not a socket, refusing ring.", ucred->pid);
+                return;
+        }
+
+        r = new(NativeRing, 1);
+        if (!r) {
+                log_oom();
+                return;
+        }
+
+        *r = (NativeRing) {
+                .ucred = *ucred,
+                .event_fd = -1,
+                .control_fd = -1,
+        };
+
+        p = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fds[0], 0);
+        if (p == MAP_FAILED) {
+                log_warning_errno(errno, "Failed to map ring of PID " PID_FMT ", refusing it: %m", ucred->pid);
+                return;
+        }
+
+        r->header = p;
+        r->mapped_size = st.st_size;
+        r->data = (const uint8_t*) p + JOURNAL_RING_DATA_OFFSET;
+
+        /* Read the size once, the client may change it under our feet */
+        size = __atomic_load_n(&r->header->size, __ATOMIC_RELAXED);
+        if (memcmp(r->header->signature, JOURNAL_RING_SIGNATURE, sizeof(r->header->signature)) != 0 ||
+            __builtin_popcount(size) != 1 ||
+            size != st.st_size - JOURNAL_RING_DATA_OFFSET) {
+                log_warning("Ring of PID " PID_FMT " has invalid header, refusing it.", ucred->pid);
+                return;
+        }
+
+        r->size = size;
+        r->tail = __atomic_load_n(&r->header->tail, __ATOMIC_RELAXED);
+        if (r->tail % sizeof(uint64_t) != 0) {
+                log_warning("Ring of PID " PID_FMT " has misaligned tail, refusing it.", ucred->pid);
+                return;
+        }
+
+        if (label) {
+                r->label = memdup_suffix0(label, label_len);
+                if (!r->label) {
+                        log_oom();
+                        return;
+                }
+        }
+
+        r->event_fd = fcntl(fds[1], F_DUPFD_CLOEXEC, 3);
+        if (r->event_fd < 0) {
+                log_warning_errno(errno, "Failed to duplicate eventfd of ring of PID " PID_FMT ", refusing it: %m", ucred->pid);
+                return;
+        }
+
+        r->control_fd = fcntl(fds[2], F_DUPFD_CLOEXEC, 3);
+        if (r->control_fd < 0) {
+                log_warning_errno(errno, "Failed to duplicate control socket of ring of PID " PID_FMT ", refusing it: %m", ucred->pid);
+                return;
+        }
+
+        (void) fd_nonblock(r->event_fd, true);
+        (void) fd_nonblock(r->control_fd, true);
+
+        k = sd_event_add_io(s->event, &r->event_source, r->event_fd, EPOLLIN, native_ring_dispatch_event, r);
+        if (k < 0) {
+                log_error_errno(k, "Failed to add ring event source to event loop: %m");
+                return;
+        }
+
+        /* Same priority as the native socket the entries would otherwise come in through */
+        k = sd_event_source_set_priority(r->event_source, SD_EVENT_PRIORITY_NORMAL+5);
+        if (k < 0) {
+                log_error_errno(k, "Failed to adjust ring event source priority: %m");
+                return;
+        }
+
+        /* The client passes large entries over the control socket, hence only watch for it hanging up */
+        k = sd_event_add_io(s->event, &r->control_event_source, r->control_fd, EPOLLRDHUP, native_ring_dispatch_control, r);
+        if (k < 0) {
+                log_error_errno(k, "Failed to add ring control event source to event loop: %m");
+                return;
+        }
+
+        /* Handle the client going away only after the rest of the ring was dispatched */
+        k = sd_event_source_set_priority(r->control_event_source, SD_EVENT_PRIORITY_NORMAL+10);
+        if (k < 0) {
+                log_error_errno(k, "Failed to adjust ring control event source priority: %m");
+                return;
+        }
+
+        k = client_context_acquire(s, ucred->pid, ucred, r->label, label_len, NULL, &r->context);
+        if (k < 0)
+                log_warning_errno(k, "Failed to acquire client context of PID " PID_FMT ", ignoring: %m", ucred->pid);
+
+        r->server = s;
+        LIST_PREPEND(native_rings, s->native_rings, r);
+        s->n_native_rings++;
+
+        /* Let the client know that we took the ring over */
+        if (send(r->control_fd, "", 1, MSG_DONTWAIT|MSG_NOSIGNAL) < 0) {
+                log_warning_errno(errno, "Failed to acknowledge ring of PID " PID_FMT ", closing it: %m", ucred->pid);
+                return;
+        }
+
+        (void) server_start_or_stop_idle_timer(s);
+
+        log_debug("Took over %" PRIu32 " byte ring of PID " PID_FMT ".", r->size, ucred->pid);
+        TAKE_PTR(r);
+}
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+typedef struct NativeRing NativeRing;
+
+#include "journald-server.h"
+
+NativeRing* native_ring_free(NativeRing *r);
+NativeRing* native_ring_drain_and_free(NativeRing *r);
+
+void server_process_native_ring(
+                Server *s,
+                const int fds[],
+                const struct ucred *ucred,
+                const char *label,
+                size_t label_len);
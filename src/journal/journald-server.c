@@ -19,6 +19,7 @@
 #include "cgroup-util.h"
 #include "conf-parser.h"
 #include "dirent-util.h"
+#include "event-util.h"
 #include "extract-word.h"
 #include "fd-util.h"
 #include "fileio.h"
@@ -30,9 +31,11 @@
 #include "io-util.h"
 #include "journal-authenticate.h"
 #include "journal-internal.h"
+#include "journal-ring.h"
 #include "journal-vacuum.h"
 #include "journald-audit.h"
 #include "journald-context.h"
+#include "journald-ingest.h"
 #include "journald-kmsg.h"
 #include "journald-native.h"
 #include "journald-rate-limit.h"
@@ -42,6 +45,7 @@
 #include "log.h"
 #include "missing_audit.h"
 #include "mkdir.h"
+#include "parse-helpers.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "proc-cmdline.h"
@@ -50,6 +54,7 @@
 #include "selinux-util.h"
 #include "signal-util.h"
 #include "socket-util.h"
+#include "stats-util.h"
 #include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
@@ -62,6 +67,7 @@
 #define DEFAULT_SYNC_INTERVAL_USEC (5*USEC_PER_MINUTE)
 #define DEFAULT_RATE_LIMIT_INTERVAL (30*USEC_PER_SEC)
 #define DEFAULT_RATE_LIMIT_BURST 10000
+#define DEFAULT_RATE_LIMIT_SLICE_BURST 100000
 #define DEFAULT_MAX_FILE_USEC USEC_PER_MONTH
 
 #define DEFAULT_KMSG_OWN_INTERVAL (5 * USEC_PER_SEC)
@@ -84,18 +90,21 @@
 
 static int determine_path_usage(
                 Server *s,
-                const char *path,
+                JournalStorage *storage,
                 uint64_t *ret_used,
                 uint64_t *ret_free) {
 
         _cleanup_closedir_ DIR *d = NULL;
         struct statvfs ss;
+        const char *path;
 
         assert(s);
-        assert(path);
+        assert(storage);
         assert(ret_used);
         assert(ret_free);
 
+        path = storage->path;
+
         d = opendir(path);
         if (!d)
                 return log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR,
@@ -104,7 +113,14 @@ static int determine_path_usage(
         if (fstatvfs(dirfd(d), &ss) < 0)
                 return log_error_errno(errno, "Failed to fstatvfs(%s): %m", path);
 
-        *ret_free = ss.f_bsize * ss.f_bavail;
+        /* Files queued for deletion are as good as gone */
+        *ret_free = ss.f_bsize * ss.f_bavail + __atomic_load_n(&storage->vacuum_pending, __ATOMIC_RELAXED);
+
+        if (server_vacuum_index_sync(s, storage) >= 0) {
+                *ret_used = journal_vacuum_index_get_usage(storage->vacuum_index);
+                return 0;
+        }
+
         *ret_used = 0;
         FOREACH_DIRENT_ALL(de, d, break) {
                 struct stat st;
@@ -148,7 +164,7 @@ static int cache_space_refresh(Server *s, JournalStorage *storage) {
         if (space->timestamp != 0 && usec_add(space->timestamp, RECHECK_SPACE_USEC) > ts)
                 return 0;
 
-        r = determine_path_usage(s, storage->path, &vfs_used, &vfs_avail);
+        r = determine_path_usage(s, storage, &vfs_used, &vfs_avail);
         if (r < 0)
                 return r;
 
@@ -256,6 +272,23 @@ static void server_add_acls(ManagedJournalFile *f, uid_t uid) {
 #endif
 }
 
+static void server_add_dictionary(Server *s, JournalFile *f) {
+        int r;
+
+        assert(s);
+        assert(f);
+
+        if (!s->compress_dictionary.data)
+                return;
+
+        r = journal_file_add_dictionary(f, s->compress_dictionary.data, s->compress_dictionary.size);
+        if (IN_SET(r, -EBUSY, -EOPNOTSUPP))
+                /* Not a new file, or not compressed with zstd, or sealed */
+                log_debug_errno(r, "Not adding compression dictionary to %s: %m", f->path);
+        else if (r < 0)
+                log_warning_errno(r, "Failed to add compression dictionary to %s, ignoring: %m", f->path);
+}
+
 static int open_journal(
                 Server *s,
                 bool reliably,
@@ -308,6 +341,9 @@ static int open_journal(
         if (r < 0)
                 return r;
 
+        journal_file_set_compress_pool(f->file, s->compress_pool);
+        server_add_dictionary(s, f->file);
+
         *ret = TAKE_PTR(f);
         return r;
 }
@@ -489,6 +525,20 @@ static int do_rotate(
                 (s->compress.enabled ? JOURNAL_COMPRESS : 0)|
                 (seal ? JOURNAL_SEAL : 0);
 
+        if (s->compress.enabled && s->compress_dictionary.train) {
+                _cleanup_free_ void *dictionary = NULL;
+                size_t size;
+
+                /* The file we are about to archive is the best sample of what its successor will contain */
+                r = journal_file_train_dictionary((*f)->file, &dictionary, &size);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to train compression dictionary from %s, ignoring: %m", (*f)->file->path);
+                else {
+                        free_and_replace(s->compress_dictionary.data, dictionary);
+                        s->compress_dictionary.size = size;
+                }
+        }
+
         r = managed_journal_file_rotate(f, s->mmap, file_flags, s->compress.threshold_bytes, s->deferred_closes);
         if (r < 0) {
                 if (*f)
@@ -497,6 +547,7 @@ static int do_rotate(
                         return log_error_errno(r, "Failed to create new %s journal: %m", name);
         }
 
+        server_add_dictionary(s, (*f)->file);
         server_add_acls(*f, uid);
         return r;
 }
@@ -645,6 +696,9 @@ void server_rotate(Server *s) {
 
         log_debug("Rotating...");
 
+        /* Entries still pending belong to the files we are about to rotate */
+        server_flush_pending_entries(s);
+
         /* First, rotate the system journal (either in its runtime flavour or in its runtime flavour) */
         (void) do_rotate(s, &s->runtime_journal, "runtime", false, 0);
         (void) do_rotate(s, &s->system_journal, "system", s->seal, 0);
@@ -671,6 +725,8 @@ void server_sync(Server *s) {
         ManagedJournalFile *f;
         int r;
 
+        server_flush_pending_entries(s);
+
         if (s->system_journal) {
                 r = managed_journal_file_set_offline(s->system_journal, false);
                 if (r < 0)
@@ -704,9 +760,7 @@ static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
         if (verbose)
                 server_space_usage_message(s, storage);
 
-        r = journal_directory_vacuum(storage->path, storage->space.limit,
-                                     storage->metrics.n_max_files, s->max_retention_usec,
-                                     &s->oldest_file_usec, verbose);
+        r = server_vacuum_storage(s, storage, verbose);
         if (r < 0 && r != -ENOENT)
                 log_warning_errno(r, "Failed to vacuum %s, ignoring: %m", storage->path);
 
@@ -769,6 +823,36 @@ static void server_cache_hostname(Server *s) {
         free_and_replace(s->hostname_field, x);
 }
 
+static void server_intern_fields(Server *s) {
+        const char *fields[] = {
+                s->boot_id_field,
+                s->machine_id_field,
+                s->hostname_field,
+                s->namespace_field,
+        };
+
+        assert(s);
+        assert_cc(ELEMENTSOF(fields) == ELEMENTSOF(s->server_fields));
+
+        /* The fields we attach to every entry, regardless of the client */
+
+        for (size_t i = 0; i < s->n_server_fields; i++)
+                interned_field_unref(s->server_fields[i]);
+        s->n_server_fields = 0;
+
+        for (size_t i = 0; i < ELEMENTSOF(fields); i++) {
+                if (isempty(fields[i]))
+                        continue;
+
+                if (interned_field_get(s, fields[i], strlen(fields[i]), s->server_fields + s->n_server_fields) < 0) {
+                        log_oom_debug();
+                        continue;
+                }
+
+                s->n_server_fields++;
+        }
+}
+
 static bool shall_try_append_again(JournalFile *f, int r) {
         switch (r) {
 
@@ -818,23 +902,31 @@ static bool shall_try_append_again(JournalFile *f, int r) {
         }
 }
 
-static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n, int priority) {
+DEFINE_STATS_COUNTER(stats_entries, "journal.entries");
+DEFINE_STATS_COUNTER(stats_rotations, "journal.rotations");
+DEFINE_STATS_HISTOGRAM(stats_append, "journal.append"); /* Per batch of entries */
+
+static void write_entries_to_journal(
+                Server *s,
+                uid_t uid,
+                const JournalBatchEntry entries[],
+                size_t n_entries,
+                int priority) {
+
         bool vacuumed = false, rotate = false;
-        struct dual_timestamp ts;
+        const JournalBatchEntry *e;
         ManagedJournalFile *f;
+        size_t n = 0;
+        usec_t begin;
         int r;
 
         assert(s);
-        assert(iovec);
-        assert(n > 0);
+        assert(entries);
+        assert(n_entries > 0);
 
-        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
-         * the source time, and not even the time the event was originally seen, but instead simply the time we started
-         * processing it, as we want strictly linear ordering in what we write out.) */
-        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
-        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
+        stats_counter_add(&stats_entries, n_entries);
 
-        if (ts.realtime < s->last_realtime_clock) {
+        if (entries[0].ts.realtime < s->last_realtime_clock) {
                 /* When the time jumps backwards, let's immediately rotate. Of course, this should not happen during
                  * regular operation. However, when it does happen, then we should make sure that we start fresh files
                  * to ensure that the entries in the journal files are strictly ordered by time, in order to ensure
@@ -855,6 +947,7 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
         }
 
         if (rotate) {
+                stats_counter_inc(&stats_rotations);
                 server_rotate(s);
                 server_vacuum(s, false);
                 vacuumed = true;
@@ -864,24 +957,34 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
                         return;
         }
 
-        s->last_realtime_clock = ts.realtime;
+        s->last_realtime_clock = entries[n_entries - 1].ts.realtime;
 
-        r = journal_file_append_entry(f->file, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
+        begin = now(CLOCK_MONOTONIC);
+        r = journal_file_append_entries(f->file, NULL, entries, n_entries, &s->seqnum, &n);
+        stats_histogram_add_since(&stats_append, begin);
         if (r >= 0) {
                 server_schedule_sync(s, priority);
                 return;
         }
 
-        if (vacuumed || !shall_try_append_again(f->file, r)) {
-                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes), ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
+        if (n > 0)
+                server_schedule_sync(s, priority);
+
+        /* If all entries made it into the file, and only linking some of them up failed, there's no point
+         * in writing them again. */
+        e = entries + MIN(n, n_entries - 1);
+
+        if (vacuumed || n >= n_entries || !shall_try_append_again(f->file, r)) {
+                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes), ignoring: %m", e->n_iovec, IOVEC_TOTAL_SIZE(e->iovec, e->n_iovec));
                 return;
         }
 
         if (r == -E2BIG)
                 log_debug("Journal file %s is full, rotating to a new file", f->file->path);
         else
-                log_info_errno(r, "Failed to write entry to %s (%zu items, %zu bytes), rotating before retrying: %m", f->file->path, n, IOVEC_TOTAL_SIZE(iovec, n));
+                log_info_errno(r, "Failed to write entry to %s (%zu items, %zu bytes), rotating before retrying: %m", f->file->path, e->n_iovec, IOVEC_TOTAL_SIZE(e->iovec, e->n_iovec));
 
+        stats_counter_inc(&stats_rotations);
         server_rotate(s);
         server_vacuum(s, false);
 
@@ -890,13 +993,178 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
                 return;
 
         log_debug("Retrying write.");
-        r = journal_file_append_entry(f->file, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
+        r = journal_file_append_entries(f->file, NULL, e, n_entries - n, &s->seqnum, NULL);
         if (r < 0)
-                log_error_errno(r, "Failed to write entry to %s (%zu items, %zu bytes) despite vacuuming, ignoring: %m", f->file->path, n, IOVEC_TOTAL_SIZE(iovec, n));
+                log_error_errno(r, "Failed to write entry to %s (%zu items, %zu bytes) despite vacuuming, ignoring: %m", f->file->path, e->n_iovec, IOVEC_TOTAL_SIZE(e->iovec, e->n_iovec));
         else
                 server_schedule_sync(s, priority);
 }
 
+void server_flush_pending_entries(Server *s) {
+        JournalBatchEntry *entries;
+        size_t n;
+
+        assert(s);
+
+        if (s->n_pending_entries == 0)
+                return;
+
+        /* Take the batch over first, since writing it might trigger a rotation, which flushes again */
+        entries = TAKE_PTR(s->pending_entries);
+        n = s->n_pending_entries;
+        s->n_pending_entries = 0;
+        s->pending_entries_size = 0;
+
+        (void) event_source_disable(s->write_batch_event_source);
+
+        write_entries_to_journal(s, s->pending_entries_uid, entries, n, s->pending_entries_priority);
+
+        for (size_t i = 0; i < n; i++) {
+                for (size_t j = 0; j < entries[i].n_iovec; j++)
+                        if (entries[i].hints[j])
+                                interned_field_unref(interned_field_from_hint(entries[i].hints[j]));
+
+                free((struct iovec*) entries[i].iovec);
+        }
+        free(entries);
+}
+
+static int dispatch_write_batch(sd_event_source *es, uint64_t usec, void *userdata) {
+        Server *s = ASSERT_PTR(userdata);
+
+        server_flush_pending_entries(s);
+        return 0;
+}
+
+static int server_queue_entry(
+                Server *s,
+                uid_t uid,
+                const struct iovec *iovec,
+                JournalDataHint **hints,
+                size_t n,
+                int priority,
+                const dual_timestamp *ts) {
+
+        JournalDataHint **hints_copy;
+        struct iovec *copy;
+        size_t size = 0;
+        uint8_t *p;
+        int r;
+
+        assert(s);
+        assert(iovec);
+        assert(hints);
+        assert(n > 0);
+        assert(ts);
+
+        /* All of these end up in the system journal anyway, let's batch them together */
+        if (uid_for_system_journal(uid))
+                uid = 0;
+
+        /* A batch is written to a single file, and its timestamps need to be ordered */
+        if (s->n_pending_entries > 0 &&
+            (uid != s->pending_entries_uid ||
+             ts->realtime < s->pending_entries[s->n_pending_entries - 1].ts.realtime))
+                server_flush_pending_entries(s);
+
+        if (!GREEDY_REALLOC(s->pending_entries, s->n_pending_entries + 1))
+                return -ENOMEM;
+
+        /* The fields are generally allocated on the stack of our callers, hence copy them, into a single
+         * allocation together with the iovec and hint arrays referencing them. Interned fields are not
+         * copied, we just keep a reference to them. */
+        for (size_t i = 0; i < n; i++)
+                if (!hints[i])
+                        size += iovec[i].iov_len;
+
+        copy = malloc(n * (sizeof(struct iovec) + sizeof(JournalDataHint*)) + size);
+        if (!copy)
+                return -ENOMEM;
+
+        hints_copy = (JournalDataHint**) (copy + n);
+        p = (uint8_t*) (hints_copy + n);
+        for (size_t i = 0; i < n; i++) {
+                hints_copy[i] = hints[i];
+
+                if (hints[i]) {
+                        copy[i] = iovec[i];
+                        interned_field_ref(interned_field_from_hint(hints[i]));
+                } else {
+                        copy[i] = IOVEC_MAKE(p, iovec[i].iov_len);
+                        p = mempcpy_safe(p, iovec[i].iov_base, iovec[i].iov_len);
+                }
+        }
+
+        size = IOVEC_TOTAL_SIZE(iovec, n);
+
+        if (s->n_pending_entries == 0) {
+                s->pending_entries_uid = uid;
+                s->pending_entries_priority = priority;
+        } else
+                s->pending_entries_priority = MIN(s->pending_entries_priority, priority);
+
+        s->pending_entries[s->n_pending_entries++] = (JournalBatchEntry) {
+                .ts = *ts,
+                .iovec = copy,
+                .n_iovec = n,
+                .hints = hints_copy,
+        };
+        s->pending_entries_size += size;
+
+        /* Don't hold back messages that would trigger an immediate sync */
+        if (s->n_pending_entries >= WRITE_BATCH_ENTRIES_MAX ||
+            s->pending_entries_size >= WRITE_BATCH_SIZE_MAX ||
+            priority <= LOG_CRIT) {
+                server_flush_pending_entries(s);
+                return 0;
+        }
+
+        if (s->n_pending_entries > 1)
+                return 0;
+
+        r = event_reset_time_relative(s->event, &s->write_batch_event_source,
+                                      CLOCK_MONOTONIC, s->write_batch_interval_usec, 0,
+                                      dispatch_write_batch, s,
+                                      SD_EVENT_PRIORITY_NORMAL, "journal-write-batch", /* force_reset= */ true);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to arm write batch timer, writing immediately: %m");
+                server_flush_pending_entries(s);
+        }
+
+        return 0;
+}
+
+static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, JournalDataHint **hints, size_t n, int priority) {
+        JournalBatchEntry entry = {
+                .iovec = iovec,
+                .n_iovec = n,
+                .hints = hints,
+        };
+        int r;
+
+        assert(s);
+        assert(iovec);
+        assert(n > 0);
+
+        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
+         * the source time, and not even the time the event was originally seen, but instead simply the time we started
+         * processing it, as we want strictly linear ordering in what we write out.) */
+        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &entry.ts.realtime) >= 0);
+        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &entry.ts.monotonic) >= 0);
+
+        if (s->write_batch_interval_usec > 0) {
+                r = server_queue_entry(s, uid, iovec, hints, n, priority, &entry.ts);
+                if (r >= 0)
+                        return;
+
+                /* Keep things in order if we can't queue this one */
+                log_oom();
+                server_flush_pending_entries(s);
+        }
+
+        write_entries_to_journal(s, uid, &entry, 1, priority);
+}
+
 #define IOVEC_ADD_NUMERIC_FIELD(iovec, n, value, type, isset, format, field)  \
         if (isset(value)) {                                             \
                 char *k;                                                \
@@ -937,7 +1205,8 @@ static void dispatch_message_real(
                 pid_t object_pid) {
 
         char source_time[sizeof("_SOURCE_REALTIME_TIMESTAMP=") + DECIMAL_STR_MAX(usec_t)];
-        _unused_ _cleanup_free_ char *cmdline1 = NULL, *cmdline2 = NULL;
+        _unused_ _cleanup_free_ char *cmdline = NULL;
+        JournalDataHint **hints;
         uid_t journal_uid;
         ClientContext *o;
 
@@ -949,33 +1218,15 @@ static void dispatch_message_real(
                (pid_is_valid(object_pid) ? N_IOVEC_OBJECT_FIELDS : 0) +
                client_context_extra_fields_n_iovec(c) <= m);
 
-        if (c) {
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->pid, pid_t, pid_is_valid, PID_FMT, "_PID");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->uid, uid_t, uid_is_valid, UID_FMT, "_UID");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->gid, gid_t, gid_is_valid, GID_FMT, "_GID");
-
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->comm, "_COMM"); /* At most TASK_COMM_LENGTH (16 bytes) */
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->exe, "_EXE"); /* A path, so at most PATH_MAX (4096 bytes) */
-
-                if (c->cmdline)
-                        /* At most _SC_ARG_MAX (2MB usually), which is too much to put on stack.
-                         * Let's use a heap allocation for this one. */
-                        cmdline1 = set_iovec_string_field(iovec, &n, "_CMDLINE=", c->cmdline);
+        /* Only the interned fields we add below have hints, the payload of the message has none */
+        hints = newa0(JournalDataHint*, m);
 
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->capeff, "_CAP_EFFECTIVE"); /* Read from /proc/.../status */
-                IOVEC_ADD_SIZED_FIELD(iovec, n, c->label, c->label_size, "_SELINUX_CONTEXT");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->auditid, uint32_t, audit_session_is_valid, "%" PRIu32, "_AUDIT_SESSION");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->loginuid, uid_t, uid_is_valid, UID_FMT, "_AUDIT_LOGINUID");
-
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->cgroup, "_SYSTEMD_CGROUP"); /* A path */
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->session, "_SYSTEMD_SESSION");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->owner_uid, uid_t, uid_is_valid, UID_FMT, "_SYSTEMD_OWNER_UID");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->unit, "_SYSTEMD_UNIT"); /* Unit names are bounded by UNIT_NAME_MAX */
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->user_unit, "_SYSTEMD_USER_UNIT");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->slice, "_SYSTEMD_SLICE");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->user_slice, "_SYSTEMD_USER_SLICE");
+        if (c) {
+                /* The trusted fields are interned whenever the context is refreshed, just reuse them */
+                for (size_t i = 0; i < c->n_meta; i++)
+                        interned_field_put(c->meta[i], iovec, hints, &n);
 
-                IOVEC_ADD_ID128_FIELD(iovec, n, c->invocation_id, "_SYSTEMD_INVOCATION_ID");
+                interned_field_put(c->cmdline_field, iovec, hints, &n);
 
                 if (c->extra_fields_n_iovec > 0) {
                         memcpy(iovec + n, c->extra_fields_iovec, c->extra_fields_n_iovec * sizeof(struct iovec));
@@ -991,11 +1242,13 @@ static void dispatch_message_real(
                 IOVEC_ADD_NUMERIC_FIELD(iovec, n, o->uid, uid_t, uid_is_valid, UID_FMT, "OBJECT_UID");
                 IOVEC_ADD_NUMERIC_FIELD(iovec, n, o->gid, gid_t, gid_is_valid, GID_FMT, "OBJECT_GID");
 
-                /* See above for size limits, only ->cmdline may be large, so use a heap allocation for it. */
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->comm, "OBJECT_COMM");
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->exe, "OBJECT_EXE");
-                if (o->cmdline)
-                        cmdline2 = set_iovec_string_field(iovec, &n, "OBJECT_CMDLINE=", o->cmdline);
+                IOVEC_ADD_STRING_FIELD(iovec, n, o->comm, "OBJECT_COMM"); /* At most TASK_COMM_LENGTH (16 bytes) */
+                IOVEC_ADD_STRING_FIELD(iovec, n, o->exe, "OBJECT_EXE"); /* A path, so at most PATH_MAX (4096 bytes) */
+
+                /* At most _SC_ARG_MAX (2MB usually), which is too much to put on stack.
+                 * Let's use a heap allocation for this one. */
+                if (o->cmdline_field)
+                        cmdline = set_iovec_string_field(iovec, &n, "OBJECT_CMDLINE=", client_context_cmdline(o));
 
                 IOVEC_ADD_STRING_FIELD(iovec, n, o->capeff, "OBJECT_CAP_EFFECTIVE");
                 IOVEC_ADD_SIZED_FIELD(iovec, n, o->label, o->label_size, "OBJECT_SELINUX_CONTEXT");
@@ -1020,20 +1273,11 @@ static void dispatch_message_real(
                 iovec[n++] = IOVEC_MAKE_STRING(source_time);
         }
 
-        /* Note that strictly speaking storing the boot id here is
-         * redundant since the entry includes this in-line
-         * anyway. However, we need this indexed, too. */
-        if (!isempty(s->boot_id_field))
-                iovec[n++] = IOVEC_MAKE_STRING(s->boot_id_field);
-
-        if (!isempty(s->machine_id_field))
-                iovec[n++] = IOVEC_MAKE_STRING(s->machine_id_field);
-
-        if (!isempty(s->hostname_field))
-                iovec[n++] = IOVEC_MAKE_STRING(s->hostname_field);
-
-        if (!isempty(s->namespace_field))
-                iovec[n++] = IOVEC_MAKE_STRING(s->namespace_field);
+        /* The boot ID, machine ID, hostname and namespace. Note that strictly speaking storing the boot id
+         * here is redundant since the entry includes this in-line anyway. However, we need this indexed,
+         * too. */
+        for (size_t i = 0; i < s->n_server_fields; i++)
+                interned_field_put(s->server_fields[i], iovec, hints, &n);
 
         assert(n <= m);
 
@@ -1050,7 +1294,7 @@ static void dispatch_message_real(
         else
                 journal_uid = 0;
 
-        write_to_journal(s, journal_uid, iovec, n, priority);
+        write_to_journal(s, journal_uid, iovec, hints, n, priority);
 }
 
 void server_driver_message(Server *s, pid_t object_pid, const char *message_id, const char *format, ...) {
@@ -1128,9 +1372,20 @@ void server_dispatch_message(
                 return;
 
         if (c && c->unit) {
+                const char *id;
+
                 (void) determine_space(s, &available, NULL);
 
-                rl = journal_ratelimit_test(s->ratelimit, c->unit, c->log_ratelimit_interval, c->log_ratelimit_burst, priority & LOG_PRIMASK, available);
+                if (s->ratelimit_mode == RATE_LIMIT_MODE_HIERARCHICAL && c->cgroup) {
+                        id = c->user_unit ?: c->unit;
+                        rl = journal_ratelimit_test_cgroup(s->ratelimit, c->cgroup, id,
+                                                           c->log_ratelimit_interval, c->log_ratelimit_burst,
+                                                           s->ratelimit_interval, s->ratelimit_slice_burst,
+                                                           priority & LOG_PRIMASK, available);
+                } else {
+                        id = c->unit;
+                        rl = journal_ratelimit_test(s->ratelimit, id, c->log_ratelimit_interval, c->log_ratelimit_burst, priority & LOG_PRIMASK, available);
+                }
                 if (rl == 0)
                         return;
 
@@ -1138,7 +1393,7 @@ void server_dispatch_message(
                 if (rl > 1)
                         server_driver_message(s, c->pid,
                                               "MESSAGE_ID=" SD_MESSAGE_JOURNAL_DROPPED_STR,
-                                              LOG_MESSAGE("Suppressed %i messages from %s", rl - 1, c->unit),
+                                              LOG_MESSAGE("Suppressed %i messages from %s", rl - 1, id),
                                               "N_DROPPED=%i", rl - 1,
                                               NULL);
         }
@@ -1155,6 +1410,8 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
 
         assert(s);
 
+        server_flush_pending_entries(s);
+
         if (!IN_SET(s->storage, STORAGE_AUTO, STORAGE_PERSISTENT))
                 return 0;
 
@@ -1267,6 +1524,8 @@ static int server_relinquish_var(Server *s) {
         if (s->runtime_journal && !s->system_journal)
                 return 0;
 
+        server_flush_pending_entries(s);
+
         log_debug("Relinquishing %s...", s->system_storage.path);
 
         (void) system_journal_open(s, false, true);
@@ -1283,6 +1542,55 @@ static int server_relinquish_var(Server *s) {
         return 0;
 }
 
+void server_process_datagram_data(
+                Server *s,
+                int fd,
+                const char *buffer,
+                size_t size,
+                const struct ucred *ucred,
+                const struct timeval *tv,
+                const char *label,
+                size_t label_len,
+                const int *fds,
+                size_t n_fds,
+                const union sockaddr_union *sa,
+                socklen_t salen) {
+
+        assert(s);
+        assert(buffer || size == 0);
+        assert(fds || n_fds == 0);
+
+        /* Processes a datagram received on one of our sockets, either directly from the event loop, or
+         * after it was received by one of the ingest threads. Closing the passed fds is left to the
+         * caller. */
+
+        if (fd == s->syslog_fd) {
+                if (size > 0 && n_fds == 0)
+                        server_process_syslog_message(s, buffer, size, ucred, tv, label, label_len);
+                else if (n_fds > 0)
+                        log_warning("Got file descriptors via syslog socket. Ignoring.");
+
+        } else if (fd == s->native_fd) {
+                if (size > 0 && n_fds == 0)
+                        server_process_native_message(s, buffer, size, ucred, tv, label, label_len);
+                else if (size == 0 && n_fds == 1)
+                        server_process_native_file(s, fds[0], ucred, tv, label, label_len);
+                else if (size == 0 && n_fds == JOURNAL_RING_N_FDS)
+                        server_process_native_ring(s, fds, ucred, label, label_len);
+                else if (n_fds > 0)
+                        log_warning("Got too many file descriptors via native socket. Ignoring.");
+
+        } else {
+                assert(fd == s->audit_fd);
+                assert(sa);
+
+                if (size > 0 && n_fds == 0)
+                        server_process_audit_message(s, buffer, size, ucred, sa, salen);
+                else if (n_fds > 0)
+                        log_warning("Got file descriptors via audit socket. Ignoring.");
+        }
+}
+
 int server_process_datagram(
                 sd_event_source *es,
                 int fd,
@@ -1309,7 +1617,7 @@ int server_process_datagram(
          * __convert_scm_timestamps(), which assumes the buffer is initialized. See #20741. */
         CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct ucred)) +
                          CMSG_SPACE_TIMEVAL +
-                         CMSG_SPACE(sizeof(int)) + /* fd */
+                         CMSG_SPACE(sizeof(int) * JOURNAL_RING_N_FDS) + /* fds */
                          CMSG_SPACE(NAME_MAX) /* selinux label */) control = {};
 
         union sockaddr_union sa = {};
@@ -1382,28 +1690,7 @@ int server_process_datagram(
         /* And a trailing NUL, just in case */
         s->buffer[n] = 0;
 
-        if (fd == s->syslog_fd) {
-                if (n > 0 && n_fds == 0)
-                        server_process_syslog_message(s, s->buffer, n, ucred, tv, label, label_len);
-                else if (n_fds > 0)
-                        log_warning("Got file descriptors via syslog socket. Ignoring.");
-
-        } else if (fd == s->native_fd) {
-                if (n > 0 && n_fds == 0)
-                        server_process_native_message(s, s->buffer, n, ucred, tv, label, label_len);
-                else if (n == 0 && n_fds == 1)
-                        server_process_native_file(s, fds[0], ucred, tv, label, label_len);
-                else if (n_fds > 0)
-                        log_warning("Got too many file descriptors via native socket. Ignoring.");
-
-        } else {
-                assert(fd == s->audit_fd);
-
-                if (n > 0 && n_fds == 0)
-                        server_process_audit_message(s, s->buffer, n, ucred, &sa, msghdr.msg_namelen);
-                else if (n_fds > 0)
-                        log_warning("Got file descriptors via audit socket. Ignoring.");
-        }
+        server_process_datagram_data(s, fd, s->buffer, n, ucred, tv, label, label_len, fds, n_fds, &sa, msghdr.msg_namelen);
 
         close_many(fds, n_fds);
 
@@ -1766,7 +2053,7 @@ static int server_dispatch_sync(sd_event_source *es, usec_t t, void *userdata) {
 
         assert(s);
 
-        server_sync(s);
+        (void) server_sync_async(s);
         return 0;
 }
 
@@ -1777,8 +2064,7 @@ int server_schedule_sync(Server *s, int priority) {
 
         if (priority <= LOG_CRIT) {
                 /* Immediately sync to disk when this is of priority CRIT, ALERT, EMERG */
-                server_sync(s);
-                return 0;
+                return server_sync_async(s);
         }
 
         if (s->sync_scheduled)
@@ -1819,6 +2105,7 @@ static int dispatch_hostname_change(sd_event_source *es, int fd, uint32_t revent
         assert(s);
 
         server_cache_hostname(s);
+        server_intern_fields(s);
         return 0;
 }
 
@@ -2109,6 +2396,87 @@ static int vl_method_relinquish_var(Varlink *link, JsonVariant *parameters, Varl
         return varlink_reply(link, NULL);
 }
 
+static int vl_method_get_compression_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        Server *s = userdata;
+        int r;
+
+        assert(link);
+        assert(s);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        for (Compression c = COMPRESSION_NONE + 1; c < _COMPRESSION_MAX; c++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *w = NULL;
+                CompressionStatistics st;
+
+                compression_get_statistics(c, &st);
+
+                r = json_build(&w, JSON_BUILD_OBJECT(
+                                               JSON_BUILD_PAIR_STRING("algorithm", compression_to_string(c)),
+                                               JSON_BUILD_PAIR_UNSIGNED("compressed", st.n_compressed),
+                                               JSON_BUILD_PAIR_UNSIGNED("failed", st.n_failed),
+                                               JSON_BUILD_PAIR_UNSIGNED("uncompressedBytes", st.uncompressed_bytes),
+                                               JSON_BUILD_PAIR_UNSIGNED("compressedBytes", st.compressed_bytes),
+                                               JSON_BUILD_PAIR_UNSIGNED("usec", st.usec)));
+                if (r < 0)
+                        return r;
+
+                r = json_variant_append_array(&v, w);
+                if (r < 0)
+                        return r;
+        }
+
+        return varlink_replyb(link,
+                              JSON_BUILD_OBJECT(
+                                              JSON_BUILD_PAIR_UNSIGNED("threads", s->compress_pool ? compress_pool_get_n_threads(s->compress_pool) : 0),
+                                              JSON_BUILD_PAIR("algorithms", JSON_BUILD_VARIANT(v))));
+}
+
+static int vl_method_get_rate_limit_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        Server *s = userdata;
+        int r;
+
+        assert(link);
+        assert(s);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        r = journal_ratelimit_build_json(s->ratelimit, &v);
+        if (r < 0)
+                return r;
+
+        return varlink_replyb(link,
+                              JSON_BUILD_OBJECT(
+                                              JSON_BUILD_PAIR_STRING("mode", ratelimit_mode_to_string(s->ratelimit_mode)),
+                                              JSON_BUILD_PAIR("buckets", JSON_BUILD_VARIANT(v))));
+}
+
+static int vl_method_get_sync_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        Server *s = userdata;
+        SyncStatistics st;
+
+        assert(link);
+        assert(s);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        server_get_sync_statistics(s, &st);
+
+        return varlink_replyb(link,
+                              JSON_BUILD_OBJECT(
+                                              JSON_BUILD_PAIR_UNSIGNED("batches", st.n_batches),
+                                              JSON_BUILD_PAIR_UNSIGNED("files", st.n_files),
+                                              JSON_BUILD_PAIR_UNSIGNED("failed", st.n_failed),
+                                              JSON_BUILD_PAIR_UNSIGNED("usec", st.total_usec),
+                                              JSON_BUILD_PAIR_UNSIGNED("maxUSec", st.max_usec),
+                                              JSON_BUILD_PAIR_UNSIGNED("lastUSec", st.last_usec)));
+}
+
 static int vl_connect(VarlinkServer *server, Varlink *link, void *userdata) {
         Server *s = userdata;
 
@@ -2131,6 +2499,10 @@ static void vl_disconnect(VarlinkServer *server, Varlink *link, void *userdata)
         (void) server_start_or_stop_idle_timer(s); /* maybe we are idle now */
 }
 
+static int vl_method_get_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        return stats_varlink_reply(link, parameters);
+}
+
 static int server_open_varlink(Server *s, const char *socket, int fd) {
         int r;
 
@@ -2144,10 +2516,14 @@ static int server_open_varlink(Server *s, const char *socket, int fd) {
 
         r = varlink_server_bind_method_many(
                         s->varlink_server,
-                        "io.systemd.Journal.Synchronize",   vl_method_synchronize,
-                        "io.systemd.Journal.Rotate",        vl_method_rotate,
-                        "io.systemd.Journal.FlushToVar",    vl_method_flush_to_var,
-                        "io.systemd.Journal.RelinquishVar", vl_method_relinquish_var);
+                        "io.systemd.Journal.Synchronize",              vl_method_synchronize,
+                        "io.systemd.Journal.Rotate",                   vl_method_rotate,
+                        "io.systemd.Journal.FlushToVar",               vl_method_flush_to_var,
+                        "io.systemd.Journal.RelinquishVar",            vl_method_relinquish_var,
+                        "io.systemd.Journal.GetCompressionStatistics", vl_method_get_compression_statistics,
+                        "io.systemd.Journal.GetRateLimitStatistics",   vl_method_get_rate_limit_statistics,
+                        "io.systemd.Journal.GetSyncStatistics",        vl_method_get_sync_statistics,
+                        "io.systemd.Statistics.Get",                   vl_method_get_statistics);
         if (r < 0)
                 return r;
 
@@ -2193,6 +2569,10 @@ static bool server_is_idle(Server *s) {
         if (s->n_stdout_streams > 0)
                 return false;
 
+        /* Neither if a client might write to a ring */
+        if (s->n_native_rings > 0)
+                return false;
+
         return true;
 }
 
@@ -2286,6 +2666,7 @@ int server_init(Server *s, const char *namespace) {
                 .audit_fd = -1,
                 .hostname_fd = -1,
                 .notify_fd = -1,
+                .ingest_stop_fd = -1,
 
                 .compress.enabled = true,
                 .compress.threshold_bytes = UINT64_MAX,
@@ -2300,6 +2681,7 @@ int server_init(Server *s, const char *namespace) {
 
                 .ratelimit_interval = DEFAULT_RATE_LIMIT_INTERVAL,
                 .ratelimit_burst = DEFAULT_RATE_LIMIT_BURST,
+                .ratelimit_slice_burst = DEFAULT_RATE_LIMIT_SLICE_BURST,
 
                 .forward_to_wall = true,
 
@@ -2314,7 +2696,9 @@ int server_init(Server *s, const char *namespace) {
                 .line_max = DEFAULT_LINE_MAX,
 
                 .runtime_storage.name = "Runtime Journal",
+                .runtime_storage.vacuum_inotify_fd = -1,
                 .system_storage.name = "System Journal",
+                .system_storage.vacuum_inotify_fd = -1,
 
                 .kmsg_own_ratelimit = {
                         .interval = DEFAULT_KMSG_OWN_INTERVAL,
@@ -2376,6 +2760,12 @@ int server_init(Server *s, const char *namespace) {
         if (r < 0)
                 return log_error_errno(r, "Failed to create event loop: %m");
 
+        /* During a log storm many stdout streams and sockets become ready at the same time, hence dispatch
+         * a bunch of them per iteration instead of polling again after each one. */
+        r = sd_event_set_dispatch_batch(s->event, 64);
+        if (r < 0)
+                return log_error_errno(r, "Failed to set event loop dispatch batch size: %m");
+
         n = sd_listen_fds(true);
         if (n < 0)
                 return log_error_errno(n, "Failed to read listening file descriptors from environment: %m");
@@ -2506,6 +2896,7 @@ int server_init(Server *s, const char *namespace) {
         server_cache_hostname(s);
         server_cache_boot_id(s);
         server_cache_machine_id(s);
+        server_intern_fields(s);
 
         if (s->namespace)
                 s->runtime_storage.path = strjoin("/run/log/journal/", SERVER_MACHINE_ID(s), ".", s->namespace);
@@ -2528,10 +2919,38 @@ int server_init(Server *s, const char *namespace) {
 
         (void) client_context_acquire_default(s);
 
+        if (s->compress.enabled && s->compress_threads > 0) {
+                if (s->compress_threads > COMPRESS_THREADS_MAX) {
+                        log_warning("CompressThreads=%u is too large, limiting to %u.", s->compress_threads, COMPRESS_THREADS_MAX);
+                        s->compress_threads = COMPRESS_THREADS_MAX;
+                }
+
+                r = compress_pool_new(s->compress_threads, &s->compress_pool);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to start compression threads, compressing on the main thread: %m");
+        }
+
+        if (s->compress.enabled && s->compress_dictionary.path) {
+                char *dictionary;
+                size_t size;
+
+                r = read_full_file(s->compress_dictionary.path, &dictionary, &size);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to read compression dictionary %s, ignoring: %m", s->compress_dictionary.path);
+                else {
+                        s->compress_dictionary.data = dictionary;
+                        s->compress_dictionary.size = size;
+                }
+        }
+
         r = system_journal_open(s, false, false);
         if (r < 0)
                 return r;
 
+        /* Failing to start the ingest threads is not fatal, the event loop then keeps reading the sockets
+         * itself */
+        (void) server_start_ingest(s);
+
         server_start_or_stop_idle_timer(s);
         return 0;
 }
@@ -2554,6 +2973,16 @@ void server_maybe_append_tags(Server *s) {
 void server_done(Server *s) {
         assert(s);
 
+        /* Stop the ingest threads first, so that what they received so far is still written out, and
+         * likewise take what is left in the rings */
+        server_stop_ingest(s);
+        while (s->native_rings)
+                native_ring_drain_and_free(s->native_rings);
+        server_flush_pending_entries(s);
+
+        /* The files are synced once more as they are closed below */
+        sync_worker_free(s->sync_worker);
+
         free(s->namespace);
         free(s->namespace_field);
 
@@ -2564,11 +2993,22 @@ void server_done(Server *s) {
 
         client_context_flush_all(s);
 
+        hashmap_free(s->kernel_devices);
+
+        for (size_t i = 0; i < s->n_server_fields; i++)
+                interned_field_unref(s->server_fields[i]);
+        set_free(s->interned_fields);
+
         (void) managed_journal_file_close(s->system_journal);
         (void) managed_journal_file_close(s->runtime_journal);
 
         ordered_hashmap_free_with_destructor(s->user_journals, managed_journal_file_close);
 
+        /* Let the queued deletions finish */
+        vacuum_worker_free(s->vacuum_worker);
+        server_vacuum_index_done(&s->runtime_storage);
+        server_vacuum_index_done(&s->system_storage);
+
         varlink_server_unref(s->varlink_server);
 
         sd_event_source_unref(s->syslog_event_source);
@@ -2586,6 +3026,7 @@ void server_done(Server *s) {
         sd_event_source_unref(s->notify_event_source);
         sd_event_source_unref(s->watchdog_event_source);
         sd_event_source_unref(s->idle_event_source);
+        sd_event_source_unref(s->write_batch_event_source);
         sd_event_unref(s->event);
 
         safe_close(s->syslog_fd);
@@ -2610,9 +3051,62 @@ void server_done(Server *s) {
         free(s->system_storage.path);
         free(s->runtime_directory);
 
+        free(s->compress_dictionary.path);
+        free(s->compress_dictionary.data);
+
+        compress_pool_unref(s->compress_pool);
         mmap_cache_unref(s->mmap);
 }
 
+int config_parse_compress_dictionary(
+                const char* unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        JournalCompressDictionary *d = ASSERT_PTR(data);
+        _cleanup_free_ char *path = NULL;
+        int r;
+
+        if (isempty(rvalue)) {
+                d->train = false;
+                d->path = mfree(d->path);
+                return 0;
+        }
+
+        if (streq(rvalue, "train")) {
+                d->train = true;
+                d->path = mfree(d->path);
+                return 0;
+        }
+
+        r = parse_boolean(rvalue);
+        if (r >= 0) {
+                /* "yes" is the same as "train", there's nothing else we could do without a path */
+                d->train = r;
+                d->path = mfree(d->path);
+                return 0;
+        }
+
+        path = strdup(rvalue);
+        if (!path)
+                return log_oom();
+
+        r = path_simplify_and_warn(path, PATH_CHECK_ABSOLUTE, unit, filename, line, lvalue);
+        if (r < 0)
+                return 0;
+
+        d->train = false;
+        free_and_replace(d->path, path);
+        return 0;
+}
+
 static const char* const storage_table[_STORAGE_MAX] = {
         [STORAGE_AUTO] = "auto",
         [STORAGE_VOLATILE] = "volatile",
@@ -2632,6 +3126,14 @@ static const char* const split_mode_table[_SPLIT_MAX] = {
 DEFINE_STRING_TABLE_LOOKUP(split_mode, SplitMode);
 DEFINE_CONFIG_PARSE_ENUM(config_parse_split_mode, split_mode, SplitMode, "Failed to parse split mode setting");
 
+static const char* const ratelimit_mode_table[_RATE_LIMIT_MODE_MAX] = {
+        [RATE_LIMIT_MODE_UNIT] = "unit",
+        [RATE_LIMIT_MODE_HIERARCHICAL] = "hierarchical",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(ratelimit_mode, RateLimitMode);
+DEFINE_CONFIG_PARSE_ENUM(config_parse_ratelimit_mode, ratelimit_mode, RateLimitMode, "Failed to parse rate limit mode setting");
+
 int config_parse_line_max(
                 const char* unit,
                 const char *filename,
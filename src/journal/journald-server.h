@@ -8,15 +8,23 @@
 
 typedef struct Server Server;
 
+#include "compress-pool.h"
 #include "conf-parser.h"
 #include "hashmap.h"
+#include "journal-vacuum.h"
 #include "journald-context.h"
+#include "journald-ingest.h"
+#include "journald-intern.h"
 #include "journald-rate-limit.h"
+#include "journald-ring.h"
 #include "journald-stream.h"
+#include "journald-sync.h"
+#include "journald-vacuum.h"
 #include "list.h"
 #include "managed-journal-file.h"
 #include "prioq.h"
 #include "ratelimit.h"
+#include "socket-util.h"
 #include "time-util.h"
 #include "varlink.h"
 
@@ -37,11 +45,26 @@ typedef enum SplitMode {
         _SPLIT_INVALID = -EINVAL,
 } SplitMode;
 
+typedef enum RateLimitMode {
+        RATE_LIMIT_MODE_UNIT,
+        RATE_LIMIT_MODE_HIERARCHICAL,
+        _RATE_LIMIT_MODE_MAX,
+        _RATE_LIMIT_MODE_INVALID = -EINVAL,
+} RateLimitMode;
+
 typedef struct JournalCompressOptions {
         bool enabled;
         uint64_t threshold_bytes;
 } JournalCompressOptions;
 
+typedef struct JournalCompressDictionary {
+        bool train;        /* train a dictionary from each file that is archived, for its successor */
+        char *path;        /* or, use the dictionary stored here for all new files */
+
+        void *data;        /* the dictionary to apply to new files, if any */
+        size_t size;
+} JournalCompressDictionary;
+
 typedef struct JournalStorageSpace {
         usec_t   timestamp;
 
@@ -58,6 +81,10 @@ typedef struct JournalStorage {
 
         JournalMetrics metrics;
         JournalStorageSpace space;
+
+        JournalVacuumIndex *vacuum_index;
+        int vacuum_inotify_fd;
+        uint64_t vacuum_pending; /* Bytes queued for deletion, accessed atomically */
 } JournalStorage;
 
 struct Server {
@@ -101,11 +128,16 @@ struct Server {
         usec_t sync_interval_usec;
         usec_t ratelimit_interval;
         unsigned ratelimit_burst;
+        unsigned ratelimit_slice_burst;
+        RateLimitMode ratelimit_mode;
 
         JournalStorage runtime_storage;
         JournalStorage system_storage;
 
         JournalCompressOptions compress;
+        unsigned compress_threads;
+        CompressPool *compress_pool;
+        JournalCompressDictionary compress_dictionary;
         bool seal;
         bool read_kmsg;
         int set_audit;
@@ -121,11 +153,16 @@ struct Server {
         usec_t max_retention_usec;
         usec_t max_file_usec;
         usec_t oldest_file_usec;
+        VacuumWorker *vacuum_worker;
+        SyncWorker *sync_worker;
 
         LIST_HEAD(StdoutStream, stdout_streams);
         LIST_HEAD(StdoutStream, stdout_streams_notify_queue);
         unsigned n_stdout_streams;
 
+        LIST_HEAD(NativeRing, native_rings);
+        unsigned n_native_rings;
+
         char *tty_path;
 
         int max_level_store;
@@ -145,6 +182,9 @@ struct Server {
         bool dev_kmsg_readable:1;
         RateLimit kmsg_own_ratelimit;
 
+        /* udev metadata of recently logging kernel devices, see journald-kmsg.c */
+        Hashmap *kernel_devices;
+
         bool send_watchdog:1;
         bool sent_notify_ready:1;
         bool sync_scheduled:1;
@@ -153,6 +193,12 @@ struct Server {
         char boot_id_field[sizeof("_BOOT_ID=") + 32];
         char *hostname_field;
         char *namespace_field;
+
+        /* The strings of fields attached to many entries, see journald-intern.c, and the ones of the fields
+         * above among them */
+        Set *interned_fields;
+        InternedField *server_fields[4];
+        size_t n_server_fields;
         char *runtime_directory;
 
         /* Cached cgroup root, so that we don't have to query that all the time */
@@ -174,10 +220,33 @@ struct Server {
         ClientContext *pid1_context; /* the context of PID 1 */
 
         VarlinkServer *varlink_server;
+
+        /* Entries waiting to be written to the journal in one go */
+        usec_t write_batch_interval_usec;
+        JournalBatchEntry *pending_entries;
+        size_t n_pending_entries;
+        size_t pending_entries_size;
+        uid_t pending_entries_uid;
+        int pending_entries_priority;
+        sd_event_source *write_batch_event_source;
+
+        /* Receiving datagrams in worker threads, see journald-ingest.c */
+        bool threaded_receive;
+        IngestWorker *ingest_workers;
+        size_t n_ingest_workers;
+        sd_event_source *ingest_event_source;
+        int ingest_stop_fd;
 };
 
 #define SERVER_MACHINE_ID(s) ((s)->machine_id_field + STRLEN("_MACHINE_ID="))
 
+/* Upper limit for CompressThreads= */
+#define COMPRESS_THREADS_MAX 16U
+
+/* Maximum number of entries and bytes to hold back for WriteBatchIntervalSec= */
+#define WRITE_BATCH_ENTRIES_MAX 256U
+#define WRITE_BATCH_SIZE_MAX (4U*1024U*1024U)
+
 /* Extra fields for any log messages */
 #define N_IOVEC_META_FIELDS 23
 
@@ -205,24 +274,43 @@ const struct ConfigPerfItem* journald_gperf_lookup(const char *key, GPERF_LEN_TY
 CONFIG_PARSER_PROTOTYPE(config_parse_storage);
 CONFIG_PARSER_PROTOTYPE(config_parse_line_max);
 CONFIG_PARSER_PROTOTYPE(config_parse_compress);
+CONFIG_PARSER_PROTOTYPE(config_parse_compress_dictionary);
 
 const char *storage_to_string(Storage s) _const_;
 Storage storage_from_string(const char *s) _pure_;
 
 CONFIG_PARSER_PROTOTYPE(config_parse_split_mode);
+CONFIG_PARSER_PROTOTYPE(config_parse_ratelimit_mode);
 
 const char *split_mode_to_string(SplitMode s) _const_;
 SplitMode split_mode_from_string(const char *s) _pure_;
 
+const char *ratelimit_mode_to_string(RateLimitMode m) _const_;
+RateLimitMode ratelimit_mode_from_string(const char *s) _pure_;
+
 int server_init(Server *s, const char *namespace);
 void server_done(Server *s);
 void server_sync(Server *s);
+void server_flush_pending_entries(Server *s);
 void server_vacuum(Server *s, bool verbose);
 void server_rotate(Server *s);
 int server_schedule_sync(Server *s, int priority);
 int server_flush_to_var(Server *s, bool require_flag_file);
 void server_maybe_append_tags(Server *s);
 int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata);
+void server_process_datagram_data(
+                Server *s,
+                int fd,
+                const char *buffer,
+                size_t size,
+                const struct ucred *ucred,
+                const struct timeval *tv,
+                const char *label,
+                size_t label_len,
+                const int *fds,
+                size_t n_fds,
+                const union sockaddr_union *sa,
+                socklen_t salen);
 void server_space_usage_message(Server *s, JournalStorage *storage);
 
 int server_start_or_stop_idle_timer(Server *s);
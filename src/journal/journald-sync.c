@@ -0,0 +1,374 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "errno-util.h"
+#include "fd-util.h"
+#include "format-util.h"
+#include "journald-sync.h"
+#include "pthread-util.h"
+
+/* server_sync() puts all journal files in the OFFLINE state, which takes two fsync()s per file. Since
+ * writing to a file again has to wait for that to finish and then fsync() the file once more, the main
+ * loop stalls whenever messages keep coming in. For the periodic syncs, and the ones triggered by messages
+ * of high priority, server_sync_async() is used instead: it hands an fdatasync() of each file written to
+ * since its last sync to a few worker threads, and returns right away. Once the batch is done, the files
+ * that have not been written to in the meantime are put in the OFFLINE state as before, everything else
+ * stays online and is synced again next time. */
+
+#define SYNC_THREADS_MAX 4U
+
+typedef struct SyncJob {
+        int fd;          /* A duplicate, so that the file may be closed in the meantime */
+        int result;
+} SyncJob;
+
+struct SyncWorker {
+        Server *server;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        pthread_t threads[SYNC_THREADS_MAX];
+        size_t n_threads;
+
+        /* The batch being worked on, protected by the mutex */
+        SyncJob *jobs;
+        size_t n_jobs;
+        size_t next_job;
+        size_t n_pending;
+        bool shutdown;
+
+        /* Kicked by the thread finishing the last job of a batch */
+        int event_fd;
+        sd_event_source *event_source;
+
+        /* Only accessed from the main thread */
+        uint64_t batch;         /* The batch in flight, or the last one */
+        bool busy;
+        bool again;             /* Another sync was requested while busy */
+        usec_t batch_start;
+        SyncStatistics statistics;
+};
+
+static void* sync_worker_thread(void *userdata) {
+        SyncWorker *w = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "journal-sync");
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        for (;;) {
+                SyncJob *j;
+
+                while (!w->shutdown && w->next_job >= w->n_jobs)
+                        assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+
+                if (w->shutdown)
+                        break;
+
+                j = w->jobs + w->next_job++;
+
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+                j->result = RET_NERRNO(fdatasync(j->fd));
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+                assert(w->n_pending > 0);
+                if (--w->n_pending == 0)
+                        (void) eventfd_write(w->event_fd, 1);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+        return NULL;
+}
+
+static void sync_worker_free_jobs(SyncWorker *w) {
+        assert(w);
+
+        for (size_t i = 0; i < w->n_jobs; i++)
+                safe_close(w->jobs[i].fd);
+
+        w->jobs = mfree(w->jobs);
+        w->n_jobs = w->next_job = 0;
+}
+
+SyncWorker* sync_worker_free(SyncWorker *w) {
+        if (!w)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        w->shutdown = true;
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        for (size_t i = 0; i < w->n_threads; i++)
+                (void) pthread_join(w->threads[i], NULL);
+
+        sync_worker_free_jobs(w);
+
+        sd_event_source_disable_unref(w->event_source);
+        safe_close(w->event_fd);
+
+        assert_se(pthread_cond_destroy(&w->cond) == 0);
+        assert_se(pthread_mutex_destroy(&w->mutex) == 0);
+
+        return mfree(w);
+}
+
+static void sync_worker_offline_idle_file(SyncWorker *w, ManagedJournalFile *f) {
+        int r;
+
+        assert(w);
+
+        if (!f || f->sync_batch != w->batch)
+                return;
+
+        /* Written to since? Then it stays online, and is synced again next time. */
+        if (le64toh(f->file->header->tail_object_offset) != f->sync_tail_object_offset)
+                return;
+
+        r = managed_journal_file_set_offline(f, false);
+        if (r < 0)
+                log_debug_errno(r, "Failed to set %s offline, ignoring: %m", f->file->path);
+}
+
+static int sync_worker_dispatch(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        SyncWorker *w = ASSERT_PTR(userdata);
+        Server *s = w->server;
+        ManagedJournalFile *f;
+        uint64_t u;
+        usec_t t;
+
+        if (read(fd, &u, sizeof(u)) < 0 && !ERRNO_IS_TRANSIENT(errno))
+                log_debug_errno(errno, "Failed to read sync eventfd, ignoring: %m");
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        if (!w->busy || w->n_pending > 0) {
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+                return 0;
+        }
+
+        for (size_t i = 0; i < w->n_jobs; i++)
+                if (w->jobs[i].result < 0) {
+                        log_warning_errno(w->jobs[i].result, "Failed to sync journal file, ignoring: %m");
+                        w->statistics.n_failed++;
+                }
+
+        w->statistics.n_files += w->n_jobs;
+        sync_worker_free_jobs(w);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), w->batch_start);
+        w->statistics.n_batches++;
+        w->statistics.total_usec += t;
+        w->statistics.max_usec = MAX(w->statistics.max_usec, t);
+        w->statistics.last_usec = t;
+        w->busy = false;
+
+        log_debug("Synced journal files in %s.", FORMAT_TIMESPAN(t, USEC_PER_MSEC));
+
+        sync_worker_offline_idle_file(w, s->system_journal);
+        sync_worker_offline_idle_file(w, s->runtime_journal);
+        ORDERED_HASHMAP_FOREACH(f, s->user_journals)
+                sync_worker_offline_idle_file(w, f);
+
+        if (w->again) {
+                w->again = false;
+                (void) server_sync_async(s);
+        }
+
+        return 0;
+}
+
+static int sync_worker_new(Server *s, SyncWorker **ret) {
+        _cleanup_(sync_worker_freep) SyncWorker *w = NULL;
+        int r;
+
+        assert(s);
+        assert(ret);
+
+        w = new(SyncWorker, 1);
+        if (!w)
+                return -ENOMEM;
+
+        *w = (SyncWorker) {
+                .server = s,
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+                .event_fd = -1,
+        };
+
+        w->event_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (w->event_fd < 0)
+                return -errno;
+
+        r = sd_event_add_io(s->event, &w->event_source, w->event_fd, EPOLLIN, sync_worker_dispatch, w);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_priority(w->event_source, SD_EVENT_PRIORITY_IMPORTANT);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
+
+static int sync_worker_start_threads(SyncWorker *w, size_t n) {
+        sigset_t ss, saved_ss;
+        int r = 0;
+
+        assert(w);
+
+        n = MIN(n, SYNC_THREADS_MAX);
+        if (w->n_threads >= n)
+                return 0;
+
+        /* The workers never need to handle signals, leave them all to the main thread. SIGBUS is not
+         * blocked, like for the journal offlining thread. */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        for (; w->n_threads < n; w->n_threads++) {
+                r = pthread_create(w->threads + w->n_threads, NULL, sync_worker_thread, w);
+                if (r > 0)
+                        break;
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        /* One thread is enough to get going */
+        return w->n_threads > 0 ? 0 : -r;
+}
+
+static int sync_worker_add_file(SyncWorker *w, ManagedJournalFile *f, SyncJob **jobs, size_t *n_jobs) {
+        uint64_t tail;
+        int fd;
+
+        assert(w);
+        assert(jobs);
+        assert(n_jobs);
+
+        if (!f)
+                return 0;
+
+        /* Already offline, or going to be, nothing to do */
+        if (managed_journal_file_is_offlining(f) || f->file->header->state != STATE_ONLINE)
+                return 0;
+
+        /* Nothing written since the last sync we queued */
+        tail = le64toh(f->file->header->tail_object_offset);
+        if (f->sync_batch != 0 && f->sync_tail_object_offset == tail)
+                return 0;
+
+        if (!GREEDY_REALLOC(*jobs, *n_jobs + 1))
+                return -ENOMEM;
+
+        fd = fcntl(f->file->fd, F_DUPFD_CLOEXEC, 3);
+        if (fd < 0)
+                return -errno;
+
+        (*jobs)[(*n_jobs)++] = (SyncJob) {
+                .fd = fd,
+        };
+
+        f->sync_batch = w->batch + 1;
+        f->sync_tail_object_offset = tail;
+        return 0;
+}
+
+int server_sync_async(Server *s) {
+        _cleanup_free_ SyncJob *jobs = NULL;
+        ManagedJournalFile *f;
+        size_t n_jobs = 0;
+        SyncWorker *w;
+        int r;
+
+        assert(s);
+
+        /* Entries still pending shall be part of this sync */
+        server_flush_pending_entries(s);
+
+        if (s->sync_event_source) {
+                r = sd_event_source_set_enabled(s->sync_event_source, SD_EVENT_OFF);
+                if (r < 0)
+                        log_error_errno(r, "Failed to disable sync timer source: %m");
+        }
+
+        s->sync_scheduled = false;
+
+        if (!s->sync_worker) {
+                r = sync_worker_new(s, &s->sync_worker);
+                if (r < 0)
+                        goto fallback;
+        }
+
+        w = s->sync_worker;
+
+        if (w->busy) {
+                /* Coalesce with the batch in flight */
+                w->again = true;
+                return 0;
+        }
+
+        r = sync_worker_add_file(w, s->system_journal, &jobs, &n_jobs);
+        if (r >= 0)
+                r = sync_worker_add_file(w, s->runtime_journal, &jobs, &n_jobs);
+        ORDERED_HASHMAP_FOREACH(f, s->user_journals) {
+                if (r < 0)
+                        break;
+
+                r = sync_worker_add_file(w, f, &jobs, &n_jobs);
+        }
+        if (r < 0) {
+                for (size_t i = 0; i < n_jobs; i++)
+                        safe_close(jobs[i].fd);
+                goto fallback;
+        }
+
+        if (n_jobs == 0)
+                return 0;
+
+        r = sync_worker_start_threads(w, n_jobs);
+        if (r < 0) {
+                for (size_t i = 0; i < n_jobs; i++)
+                        safe_close(jobs[i].fd);
+                goto fallback;
+        }
+
+        w->batch++;
+        w->busy = true;
+        w->batch_start = now(CLOCK_MONOTONIC);
+
+        _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_lock_ = pthread_mutex_lock_assert(&w->mutex);
+
+        assert(w->n_pending == 0);
+        assert(!w->jobs);
+
+        w->jobs = TAKE_PTR(jobs);
+        w->n_jobs = w->n_pending = n_jobs;
+        w->next_job = 0;
+
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        return 0;
+
+fallback:
+        log_debug_errno(r, "Failed to sync journal files in the background, syncing synchronously: %m");
+        server_sync(s);
+        return 0;
+}
+
+void server_get_sync_statistics(Server *s, SyncStatistics *ret) {
+        assert(s);
+        assert(ret);
+
+        *ret = s->sync_worker ? s->sync_worker->statistics : (SyncStatistics) {};
+}
@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+typedef struct SyncWorker SyncWorker;
+
+#include "journald-server.h"
+
+typedef struct SyncStatistics {
+        uint64_t n_batches;
+        uint64_t n_files;
+        uint64_t n_failed;
+        usec_t total_usec;
+        usec_t max_usec;
+        usec_t last_usec;
+} SyncStatistics;
+
+SyncWorker* sync_worker_free(SyncWorker *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(SyncWorker*, sync_worker_free);
+
+int server_sync_async(Server *s);
+void server_get_sync_statistics(Server *s, SyncStatistics *ret);
@@ -0,0 +1,380 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/inotify.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "format-util.h"
+#include "fs-util.h"
+#include "inotify-util.h"
+#include "journal-vacuum.h"
+#include "journald-vacuum.h"
+#include "list.h"
+#include "path-util.h"
+#include "pthread-util.h"
+
+/* Vacuuming used to enumerate and stat() all files of the journal directory every time, which gets slow
+ * with many archived journal files. Instead, we keep a JournalVacuumIndex of each directory, which is kept
+ * up-to-date by looking at the inotify events queued for it, whenever we need it. The rename() or unlink()
+ * that changed the directory has queued its event by the time it returns, hence the index is never behind
+ * on our own changes. The only other changes we look out for are those of the files we have open, since
+ * they grow. The files picked for deletion are then deleted by a worker thread, as freeing the blocks of
+ * large files can take a while. */
+
+#define VACUUM_INOTIFY_MASK (IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR)
+
+typedef struct VacuumJob VacuumJob;
+
+struct VacuumJob {
+        char *path;
+        uint64_t usage;
+        uint64_t *pending; /* Decreased by usage once the file is deleted, accessed atomically */
+        bool empty;
+        bool verbose;
+
+        LIST_FIELDS(VacuumJob, jobs);
+};
+
+struct VacuumWorker {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        pthread_t thread;
+
+        /* Protected by the mutex */
+        LIST_HEAD(VacuumJob, jobs);
+        VacuumJob *jobs_tail;
+        bool shutdown;
+};
+
+static VacuumJob* vacuum_job_free(VacuumJob *j) {
+        if (!j)
+                return NULL;
+
+        free(j->path);
+        return mfree(j);
+}
+
+static void vacuum_job_run(VacuumJob *j) {
+        int r;
+
+        assert(j);
+
+        r = unlinkat_deallocate(AT_FDCWD, j->path, 0);
+        if (r >= 0)
+                log_full(j->verbose ? LOG_INFO : LOG_DEBUG, "Deleted %sarchived journal %s (%s).",
+                         j->empty ? "empty " : "", j->path, FORMAT_BYTES(j->usage));
+        else if (r != -ENOENT)
+                log_warning_errno(r, "Failed to delete %sarchived journal %s: %m", j->empty ? "empty " : "", j->path);
+
+        (void) __atomic_sub_fetch(j->pending, j->usage, __ATOMIC_RELAXED);
+}
+
+static void* vacuum_worker_thread(void *userdata) {
+        VacuumWorker *w = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "journal-vacuum");
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        for (;;) {
+                VacuumJob *j;
+
+                /* Finish the queued deletions before exiting, they are not in any index anymore */
+                while (!w->shutdown && !w->jobs)
+                        assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+
+                j = w->jobs;
+                if (!j)
+                        break;
+
+                if (w->jobs_tail == j)
+                        w->jobs_tail = NULL;
+                LIST_REMOVE(jobs, w->jobs, j);
+
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+                vacuum_job_run(j);
+                vacuum_job_free(j);
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+        return NULL;
+}
+
+VacuumWorker* vacuum_worker_free(VacuumWorker *w) {
+        if (!w)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        w->shutdown = true;
+        assert_se(pthread_cond_signal(&w->cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        (void) pthread_join(w->thread, NULL);
+        assert(!w->jobs);
+
+        assert_se(pthread_cond_destroy(&w->cond) == 0);
+        assert_se(pthread_mutex_destroy(&w->mutex) == 0);
+
+        return mfree(w);
+}
+
+static int vacuum_worker_new(VacuumWorker **ret) {
+        _cleanup_free_ VacuumWorker *w = NULL;
+        sigset_t ss, saved_ss;
+        int r;
+
+        assert(ret);
+
+        w = new(VacuumWorker, 1);
+        if (!w)
+                return -ENOMEM;
+
+        *w = (VacuumWorker) {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+        };
+
+        /* Like the compression threads, leave all signals but SIGBUS to the main thread */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&w->thread, NULL, vacuum_worker_thread, w);
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+        if (r > 0)
+                return -r;
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
+
+static int vacuum_worker_submit(
+                VacuumWorker **w,
+                const char *directory,
+                const char *filename,
+                uint64_t usage,
+                uint64_t *pending,
+                bool empty,
+                bool verbose) {
+
+        VacuumJob *j;
+        int r;
+
+        assert(w);
+        assert(directory);
+        assert(filename);
+        assert(pending);
+
+        if (!*w) {
+                r = vacuum_worker_new(w);
+                if (r < 0)
+                        return r;
+        }
+
+        j = new(VacuumJob, 1);
+        if (!j)
+                return -ENOMEM;
+
+        *j = (VacuumJob) {
+                .path = path_join(directory, filename),
+                .usage = usage,
+                .pending = pending,
+                .empty = empty,
+                .verbose = verbose,
+        };
+        if (!j->path) {
+                free(j);
+                return -ENOMEM;
+        }
+
+        (void) __atomic_add_fetch(pending, usage, __ATOMIC_RELAXED);
+
+        _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_lock_ = pthread_mutex_lock_assert(&(*w)->mutex);
+
+        LIST_INSERT_AFTER(jobs, (*w)->jobs, (*w)->jobs_tail, j);
+        (*w)->jobs_tail = j;
+
+        assert_se(pthread_cond_signal(&(*w)->cond) == 0);
+        return 0;
+}
+
+void server_vacuum_index_done(JournalStorage *storage) {
+        assert(storage);
+
+        storage->vacuum_index = journal_vacuum_index_free(storage->vacuum_index);
+        storage->vacuum_inotify_fd = safe_close(storage->vacuum_inotify_fd);
+}
+
+static int vacuum_index_load(JournalStorage *storage) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(storage);
+        assert(!storage->vacuum_index);
+
+        fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        /* Watch first, so that nothing happening while we enumerate the directory is missed */
+        if (inotify_add_watch(fd, storage->path, VACUUM_INOTIFY_MASK) < 0)
+                return -errno;
+
+        r = journal_vacuum_index_load(storage->path, &storage->vacuum_index);
+        if (r < 0)
+                return r;
+
+        storage->vacuum_inotify_fd = TAKE_FD(fd);
+        return 0;
+}
+
+static int vacuum_index_process_events(JournalStorage *storage) {
+        int r;
+
+        assert(storage);
+        assert(storage->vacuum_index);
+
+        for (;;) {
+                union inotify_event_buffer buffer;
+                ssize_t l;
+
+                l = read(storage->vacuum_inotify_fd, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (ERRNO_IS_TRANSIENT(errno))
+                                return 0;
+
+                        return -errno;
+                }
+
+                FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                        /* The directory is gone, or we missed some events */
+                        if (e->mask & (IN_Q_OVERFLOW|IN_DELETE_SELF|IN_MOVE_SELF|IN_IGNORED|IN_UNMOUNT))
+                                return -ESTALE;
+
+                        if (e->len == 0)
+                                continue;
+
+                        if (e->mask & (IN_DELETE|IN_MOVED_FROM))
+                                journal_vacuum_index_remove(storage->vacuum_index, e->name);
+                        else {
+                                r = journal_vacuum_index_update(storage->vacuum_index, e->name);
+                                if (r < 0)
+                                        return r;
+                        }
+                }
+        }
+}
+
+static void vacuum_index_refresh_file(JournalStorage *storage, ManagedJournalFile *f) {
+        const char *e;
+        int r;
+
+        assert(storage);
+        assert(storage->vacuum_index);
+
+        if (!f)
+                return;
+
+        e = path_startswith(f->file->path, storage->path);
+        if (!e || !filename_is_valid(e))
+                return;
+
+        r = journal_vacuum_index_update(storage->vacuum_index, e);
+        if (r < 0)
+                log_debug_errno(r, "Failed to update disk usage of %s, ignoring: %m", f->file->path);
+}
+
+int server_vacuum_index_sync(Server *s, JournalStorage *storage) {
+        ManagedJournalFile *f;
+        int r;
+
+        assert(s);
+        assert(storage);
+
+        if (storage->vacuum_index) {
+                r = vacuum_index_process_events(storage);
+                if (r >= 0)
+                        goto refresh;
+
+                log_debug_errno(r, "Failed to process changes of %s, enumerating it again: %m", storage->path);
+                server_vacuum_index_done(storage);
+        }
+
+        r = vacuum_index_load(storage);
+        if (r < 0) {
+                server_vacuum_index_done(storage);
+                return log_full_errno(r == -ENOENT ? LOG_DEBUG : LOG_WARNING, r,
+                                      "Failed to index %s: %m", storage->path);
+        }
+
+refresh:
+        /* The files we write to are the only ones that grow */
+        vacuum_index_refresh_file(storage, s->system_journal);
+        vacuum_index_refresh_file(storage, s->runtime_journal);
+        ORDERED_HASHMAP_FOREACH(f, s->user_journals)
+                vacuum_index_refresh_file(storage, f);
+
+        return 0;
+}
+
+typedef struct VacuumContext {
+        Server *server;
+        JournalStorage *storage;
+        uint64_t freed;
+        bool verbose;
+} VacuumContext;
+
+static int vacuum_delete_later(int dir_fd, const char *directory, const char *filename, uint64_t usage, bool empty, void *userdata) {
+        VacuumContext *c = ASSERT_PTR(userdata);
+        int r;
+
+        r = vacuum_worker_submit(&c->server->vacuum_worker, directory, filename, usage,
+                                 &c->storage->vacuum_pending, empty, c->verbose);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to queue deletion of %s/%s, deleting it right away: %m", directory, filename);
+
+                r = unlinkat_deallocate(dir_fd, filename, 0);
+                if (r < 0) {
+                        if (r != -ENOENT)
+                                log_warning_errno(r, "Failed to delete %sarchived journal %s/%s: %m",
+                                                  empty ? "empty " : "", directory, filename);
+                        return r;
+                }
+        }
+
+        c->freed += usage;
+        return 0;
+}
+
+int server_vacuum_storage(Server *s, JournalStorage *storage, bool verbose) {
+        VacuumContext c = {
+                .server = s,
+                .storage = storage,
+                .verbose = verbose,
+        };
+        int r;
+
+        assert(s);
+        assert(storage);
+
+        r = server_vacuum_index_sync(s, storage);
+        if (r < 0)
+                return journal_directory_vacuum(storage->path, storage->space.limit,
+                                                storage->metrics.n_max_files, s->max_retention_usec,
+                                                &s->oldest_file_usec, verbose);
+
+        r = journal_vacuum_index_vacuum(storage->vacuum_index, storage->space.limit,
+                                        storage->metrics.n_max_files, s->max_retention_usec,
+                                        &s->oldest_file_usec, vacuum_delete_later, &c);
+
+        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freeing %s of archived journals from %s.",
+                 FORMAT_BYTES(c.freed), storage->path);
+
+        return r;
+}
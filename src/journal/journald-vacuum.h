@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+typedef struct VacuumWorker VacuumWorker;
+typedef struct JournalStorage JournalStorage;
+
+#include "journald-server.h"
+
+VacuumWorker* vacuum_worker_free(VacuumWorker *w);
+
+int server_vacuum_index_sync(Server *s, JournalStorage *storage);
+void server_vacuum_index_done(JournalStorage *storage);
+
+int server_vacuum_storage(Server *s, JournalStorage *storage, bool verbose);
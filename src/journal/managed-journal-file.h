@@ -5,6 +5,11 @@
 
 typedef struct {
         JournalFile *file;
+
+        /* The background sync the file was last part of, and its tail object at that time, see
+         * journald-sync.c */
+        uint64_t sync_batch;
+        uint64_t sync_tail_object_offset;
 } ManagedJournalFile;
 
 int managed_journal_file_open(
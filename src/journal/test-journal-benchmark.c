@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "chattr-util.h"
+#include "io-util.h"
+#include "managed-journal-file.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+
+/* Measures appending entries to journal files as journald does, and iterating through them with
+ * sd_journal_next() as journalctl does, with the entries interleaved across many files, as is the case on
+ * systems with many users or after many rotations. SYSTEMD_SLOW_TESTS=1 writes ten times as many entries
+ * into four times as many files. */
+
+/* Use fixed timestamps and a fixed boot ID, so that the files look the same on every run */
+#define START_REALTIME (1672531200 * USEC_PER_SEC) /* 2023-01-01 00:00:00 UTC */
+#define BOOT_ID SD_ID128_MAKE(0b,a2,a3,39,2b,6e,4e,0c,9d,22,ae,9e,fd,c4,3e,58)
+#define N_UNITS 20U
+
+static void append_entries(const char *dir, unsigned n_files, unsigned n_entries) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_free_ ManagedJournalFile **files = NULL;
+        sd_id128_t boot_id = BOOT_ID;
+        usec_t t;
+
+        m = mmap_cache_new();
+        assert_se(m);
+
+        files = new(ManagedJournalFile*, n_files);
+        assert_se(files);
+
+        for (unsigned i = 0; i < n_files; i++) {
+                char name[STRLEN("benchmark-.journal") + DECIMAL_STR_MAX(unsigned)];
+                _cleanup_free_ char *p = NULL;
+
+                xsprintf(name, "benchmark-%u.journal", i);
+                assert_se(p = path_join(dir, name));
+                assert_se(managed_journal_file_open(-1, p, O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0644, UINT64_MAX,
+                                                    NULL, m, NULL, NULL, &files[i]) >= 0);
+        }
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_entries; i++) {
+                char message[STRLEN("MESSAGE=Benchmark message ") + DECIMAL_STR_MAX(unsigned)],
+                        priority[STRLEN("PRIORITY=") + DECIMAL_STR_MAX(unsigned)],
+                        pid[STRLEN("_PID=") + DECIMAL_STR_MAX(unsigned)],
+                        unit[STRLEN("_SYSTEMD_UNIT=benchmark-.service") + DECIMAL_STR_MAX(unsigned)];
+                struct iovec iovec[7];
+                dual_timestamp ts = {
+                        .realtime = START_REALTIME + i * USEC_PER_MSEC,
+                        .monotonic = USEC_PER_SEC + i * USEC_PER_MSEC,
+                };
+                size_t n = 0;
+
+                xsprintf(message, "MESSAGE=Benchmark message %u", i);
+                xsprintf(priority, "PRIORITY=%u", i % 8);
+                xsprintf(pid, "_PID=%u", 1000 + i % 50);
+                xsprintf(unit, "_SYSTEMD_UNIT=benchmark-%u.service", i % N_UNITS);
+
+                iovec[n++] = IOVEC_MAKE_STRING(message);
+                iovec[n++] = IOVEC_MAKE_STRING(priority);
+                iovec[n++] = IOVEC_MAKE_STRING(pid);
+                iovec[n++] = IOVEC_MAKE_STRING(unit);
+                iovec[n++] = IOVEC_MAKE_STRING("_COMM=benchmark");
+                iovec[n++] = IOVEC_MAKE_STRING("_HOSTNAME=localhost");
+                iovec[n++] = IOVEC_MAKE_STRING("SYSLOG_IDENTIFIER=benchmark");
+
+                assert_se(journal_file_append_entry(files[i % n_files]->file, &ts, &boot_id, iovec, n,
+                                                    NULL, NULL, NULL) >= 0);
+        }
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        for (unsigned i = 0; i < n_files; i++)
+                (void) managed_journal_file_close(files[i]);
+
+        log_info("Append: %u entries to %u files, %" PRIu64 "ns per entry",
+                 n_entries, n_files, t * NSEC_PER_USEC / n_entries);
+        benchmark_report(t * NSEC_PER_USEC / n_entries, "ns", "append/%u", n_files);
+}
+
+static void iterate(const char *dir, unsigned n_files, unsigned n_entries, const char *match) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        unsigned n = 0;
+        usec_t t, topen;
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_journal_open_directory(&j, dir, 0) >= 0);
+        topen = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        if (match)
+                assert_se(sd_journal_add_match(j, match, 0) >= 0);
+
+        /* Read one field of every entry, like journalctl does */
+        t = now(CLOCK_MONOTONIC);
+        SD_JOURNAL_FOREACH(j) {
+                const void *d;
+                size_t l;
+
+                assert_se(sd_journal_get_data(j, "MESSAGE", &d, &l) >= 0);
+                n++;
+        }
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        assert_se(n == (match ? n_entries / N_UNITS : n_entries));
+
+        log_info("Iterate%s%s: %u entries in %u files, open %s, %" PRIu64 "ns per entry",
+                 match ? " matching " : "", strempty(match), n, n_files,
+                 FORMAT_TIMESPAN(topen, 1), t * NSEC_PER_USEC / n);
+        benchmark_report(topen, "us", "%s/%u", match ? "open_match" : "open", n_files);
+        benchmark_report(t * NSEC_PER_USEC / n, "ns", "%s/%u", match ? "next_match" : "next", n_files);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        unsigned n_files, n_entries;
+
+        test_setup_logging(LOG_INFO);
+
+        n_files = slow_tests_enabled() ? 64 : 16;
+        n_entries = slow_tests_enabled() ? 200000 : 20000;
+
+        assert_se(mkdtemp_malloc("/var/tmp/journal-benchmark-XXXXXX", &dir) >= 0);
+
+        /* Speed up things a bit on btrfs, ensuring that CoW is turned off for all files created in our
+         * directory during the test run */
+        (void) chattr_path(dir, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        append_entries(dir, n_files, n_entries);
+
+        iterate(dir, n_files, n_entries, NULL);
+        iterate(dir, n_files, n_entries, "_SYSTEMD_UNIT=benchmark-0.service");
+
+        return 0;
+}
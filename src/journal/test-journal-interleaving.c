@@ -13,6 +13,7 @@
 #include "managed-journal-file.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 #include "tests.h"
 #include "util.h"
 
@@ -210,6 +211,70 @@ TEST(skip) {
         test_skip_one(setup_interleaved);
 }
 
+TEST(many_files) {
+        char t[] = "/var/tmp/journal-many-XXXXXX";
+        ManagedJournalFile *files[16];
+        sd_journal *j;
+        int r;
+
+        mkdtemp_chdir_chattr(t);
+
+        for (size_t i = 0; i < ELEMENTSOF(files); i++) {
+                char fn[STRLEN("file-.journal") + DECIMAL_STR_MAX(size_t)];
+
+                xsprintf(fn, "file-%zu.journal", i);
+                files[i] = test_open(fn);
+        }
+
+        /* Spread the entries over all files in a pattern that is not plain round-robin, and leave the last
+         * file empty for now */
+        for (int n = 1; n <= 64; n++)
+                append_number(files[(n * 7) % (ELEMENTSOF(files) - 1)], n, NULL);
+
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_head(j));
+        assert_ret(sd_journal_next(j));
+        test_check_numbers_down(j, 64);
+
+        /* Iterating back from the tail must not lose anything either */
+        assert_ret(sd_journal_seek_tail(j));
+        assert_ret(sd_journal_previous(j));
+        test_check_numbers_up(j, 64);
+
+        assert_ret(sd_journal_seek_head(j));
+        assert_ret(r = sd_journal_next_skip(j, 64));
+        assert_se(r == 64);
+        test_check_number(j, 64);
+
+        /* New entries in files that hit EOF before, including one that was empty, must be picked up */
+        append_number(files[ELEMENTSOF(files) - 1], 65, NULL);
+        append_number(files[3], 66, NULL);
+
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 1);
+        test_check_number(j, 65);
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 1);
+        test_check_number(j, 66);
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 0);
+
+        sd_journal_close(j);
+
+        for (size_t i = 0; i < ELEMENTSOF(files); i++)
+                test_close(files[i]);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+}
+
 TEST(sequence_numbers) {
         _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
         char t[] = "/var/tmp/journal-seq-XXXXXX";
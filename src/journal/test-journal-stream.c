@@ -12,8 +12,10 @@
 #include "log.h"
 #include "macro.h"
 #include "managed-journal-file.h"
+#include "memory-util.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "strv.h"
 #include "tests.h"
 #include "util.h"
 
@@ -59,7 +61,53 @@ static void verify_contents(sd_journal *j, unsigned skip) {
                 assert_se(i == N_ENTRIES);
 }
 
-static void run_test(void) {
+static void verify_borrowed(sd_journal *j) {
+        static const char * const fields[] = { "NUMBER", "NOT_THERE", "LARGE", "MAGIC" };
+        const void *data[ELEMENTSOF(fields)];
+        size_t sizes[ELEMENTSOF(fields)];
+        unsigned n_large = 0;
+
+        assert_se(j);
+
+        SD_JOURNAL_FOREACH(j) {
+                _cleanup_free_ void *copy = NULL;
+                const void *first, *d;
+                size_t first_size, l;
+                int r;
+
+                sd_journal_restart_data(j);
+                assert_se(sd_journal_enumerate_borrowed_data(j, &first, &first_size) > 0);
+                assert_se(copy = memdup(first, first_size));
+
+                r = sd_journal_get_borrowed_data(j, fields, ELEMENTSOF(fields), data, sizes);
+                assert_se(r >= 2);
+
+                for (size_t i = 0; i < ELEMENTSOF(fields); i++) {
+                        if (sd_journal_get_data(j, fields[i], &d, &l) < 0) {
+                                assert_se(!data[i]);
+                                assert_se(sizes[i] == 0);
+                                continue;
+                        }
+
+                        assert_se(memcmp_nn(d, l, data[i], sizes[i]) == 0);
+                        r--;
+                }
+                assert_se(r == 0);
+
+                n_large += !!data[2];
+
+                /* Looking at other data of the entry doesn't invalidate what was borrowed */
+                assert_se(memcmp_nn(first, first_size, copy, first_size) == 0);
+                for (size_t i = 0; i < ELEMENTSOF(fields); i++)
+                        assert_se(!data[i] || (sizes[i] > strlen(fields[i]) &&
+                                               memcmp(data[i], fields[i], strlen(fields[i])) == 0 &&
+                                               ((const char*) data[i])[strlen(fields[i])] == '='));
+        }
+
+        assert_se(n_large == N_ENTRIES / 7 + 1);
+}
+
+static void run_test(int open_flags) {
         _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
         ManagedJournalFile *one, *two, *three;
         char t[] = "/var/tmp/journal-stream-XXXXXX";
@@ -69,10 +117,15 @@ static void run_test(void) {
         const void *data;
         size_t l;
         dual_timestamp previous_ts = DUAL_TIMESTAMP_NULL;
+        char large[4096];
 
         m = mmap_cache_new();
         assert_se(m != NULL);
 
+        memset(large, 'x', sizeof(large) - 1);
+        memcpy(large, "LARGE=", STRLEN("LARGE="));
+        large[sizeof(large) - 1] = 0;
+
         assert_se(mkdtemp(t));
         assert_se(chdir(t) >= 0);
         (void) chattr_path(t, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
@@ -84,7 +137,8 @@ static void run_test(void) {
         for (i = 0; i < N_ENTRIES; i++) {
                 char *p, *q;
                 dual_timestamp ts;
-                struct iovec iovec[2];
+                struct iovec iovec[3];
+                size_t n_iovec = 2;
 
                 dual_timestamp_get(&ts);
 
@@ -103,13 +157,17 @@ static void run_test(void) {
 
                 iovec[1] = IOVEC_MAKE(q, strlen(q));
 
+                /* Large enough to be compressed */
+                if (i % 7 == 0)
+                        iovec[n_iovec++] = IOVEC_MAKE_STRING(large);
+
                 if (i % 10 == 0)
-                        assert_se(journal_file_append_entry(three->file, &ts, NULL, iovec, 2, NULL, NULL, NULL) == 0);
+                        assert_se(journal_file_append_entry(three->file, &ts, NULL, iovec, n_iovec, NULL, NULL, NULL) == 0);
                 else {
                         if (i % 3 == 0)
-                                assert_se(journal_file_append_entry(two->file, &ts, NULL, iovec, 2, NULL, NULL, NULL) == 0);
+                                assert_se(journal_file_append_entry(two->file, &ts, NULL, iovec, n_iovec, NULL, NULL, NULL) == 0);
 
-                        assert_se(journal_file_append_entry(one->file, &ts, NULL, iovec, 2, NULL, NULL, NULL) == 0);
+                        assert_se(journal_file_append_entry(one->file, &ts, NULL, iovec, n_iovec, NULL, NULL, NULL) == 0);
                 }
 
                 free(p);
@@ -120,7 +178,7 @@ static void run_test(void) {
         (void) managed_journal_file_close(two);
         (void) managed_journal_file_close(three);
 
-        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        assert_se(sd_journal_open_directory(&j, t, open_flags) >= 0);
 
         assert_se(sd_journal_add_match(j, "MAGIC=quux", 0) >= 0);
         SD_JOURNAL_FOREACH_BACKWARDS(j) {
@@ -146,6 +204,7 @@ static void run_test(void) {
         sd_journal_flush_matches(j);
 
         verify_contents(j, 1);
+        verify_borrowed(j);
 
         printf("NEXT TEST\n");
         assert_se(sd_journal_add_match(j, "MAGIC=quux", 0) >= 0);
@@ -184,12 +243,19 @@ int main(int argc, char *argv[]) {
 
         test_setup_logging(LOG_DEBUG);
 
-        /* Run this test twice. Once with old hashing and once with new hashing */
-        assert_se(setenv("SYSTEMD_JOURNAL_KEYED_HASH", "1", 1) >= 0);
-        run_test();
+        /* Run this test four times: with old and new hashing, each in the regular and in the compact
+         * format. Then once more, reading the files with pread() instead of mmap(). */
+        FOREACH_STRING(compact, "0", "1") {
+                assert_se(setenv("SYSTEMD_JOURNAL_COMPACT", compact, 1) >= 0);
+
+                assert_se(setenv("SYSTEMD_JOURNAL_KEYED_HASH", "1", 1) >= 0);
+                run_test(0);
+
+                assert_se(setenv("SYSTEMD_JOURNAL_KEYED_HASH", "0", 1) >= 0);
+                run_test(0);
+        }
 
-        assert_se(setenv("SYSTEMD_JOURNAL_KEYED_HASH", "0", 1) >= 0);
-        run_test();
+        run_test(SD_JOURNAL_PREAD);
 
         return 0;
 }
@@ -3,13 +3,19 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "sd-journal.h"
+
 #include "chattr-util.h"
+#include "compress-pool.h"
 #include "io-util.h"
 #include "journal-authenticate.h"
 #include "journal-vacuum.h"
+#include "journal-verify.h"
 #include "log.h"
 #include "managed-journal-file.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
+#include "strv.h"
 #include "tests.h"
 
 static bool arg_keep = false;
@@ -158,7 +164,736 @@ TEST(empty) {
         (void) managed_journal_file_close(f4);
 }
 
+#define N_BATCH_ENTRIES 1000
+
+TEST(append_entries) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        ManagedJournalFile *one, *batch;
+        JournalBatchEntry *entries;
+        struct iovec *iovec;
+        char numbers[N_BATCH_ENTRIES][STRLEN("NUMBER=") + DECIMAL_STR_MAX(size_t)];
+        dual_timestamp ts;
+        uint64_t p, q;
+        Object *o, *d;
+        size_t n;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        m = mmap_cache_new();
+        assert_se(m != NULL);
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(managed_journal_file_open(-1, "one.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &one) == 0);
+        assert_se(managed_journal_file_open(-1, "batch.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &batch) == 0);
+
+        assert_se(entries = new(JournalBatchEntry, N_BATCH_ENTRIES));
+        assert_se(iovec = new(struct iovec, N_BATCH_ENTRIES * 4));
+
+        dual_timestamp_get(&ts);
+
+        for (size_t i = 0; i < N_BATCH_ENTRIES; i++) {
+                struct iovec *v = iovec + i * 4;
+
+                xsprintf(numbers[i], "NUMBER=%zu", i);
+
+                /* One field shared by all entries, one by every third, one unique, and one that is repeated
+                 * within the entry itself */
+                v[0] = IOVEC_MAKE_STRING("COMMON=yes");
+                v[1] = IOVEC_MAKE_STRING((i % 3 == 0 ? "THIRD=yes" : "THIRD=no"));
+                v[2] = IOVEC_MAKE_STRING(numbers[i]);
+                v[3] = IOVEC_MAKE_STRING("COMMON=yes");
+
+                entries[i] = (JournalBatchEntry) {
+                        .ts = ts,
+                        .iovec = v,
+                        .n_iovec = 4,
+                };
+
+                assert_se(journal_file_append_entry(one->file, &ts, NULL, v, 4, NULL, NULL, NULL) == 0);
+
+                ts.realtime++;
+                ts.monotonic++;
+        }
+
+        /* Append in a few batches of different sizes, to also cover linking into partially filled arrays */
+        for (size_t i = 0, k = 1; i < N_BATCH_ENTRIES; i += n, k *= 3) {
+                assert_se(journal_file_append_entries(batch->file, NULL, entries + i, MIN(k, N_BATCH_ENTRIES - i), NULL, &n) == 0);
+                assert_se(n == MIN(k, N_BATCH_ENTRIES - i));
+        }
+
+        assert_se(le64toh(batch->file->header->n_entries) == N_BATCH_ENTRIES);
+        assert_se(le64toh(batch->file->header->n_data) == le64toh(one->file->header->n_data));
+        assert_se(batch->file->header->head_entry_realtime == one->file->header->head_entry_realtime);
+        assert_se(batch->file->header->tail_entry_realtime == one->file->header->tail_entry_realtime);
+        assert_se(batch->file->header->tail_entry_monotonic == one->file->header->tail_entry_monotonic);
+
+        /* Both files must contain the same entries, in the same order */
+        assert_se(journal_file_next_entry(one->file, 0, DIRECTION_DOWN, &o, &p) == 1);
+        assert_se(journal_file_next_entry(batch->file, 0, DIRECTION_DOWN, &d, &q) == 1);
+        for (size_t i = 0;; i++) {
+                uint64_t seqnum = le64toh(o->entry.seqnum), realtime = le64toh(o->entry.realtime), xor_hash = le64toh(o->entry.xor_hash);
+
+                assert_se(seqnum == i + 1);
+                assert_se(le64toh(d->entry.seqnum) == seqnum);
+                assert_se(le64toh(d->entry.realtime) == realtime);
+                assert_se(le64toh(d->entry.xor_hash) == xor_hash);
+                assert_se(journal_file_entry_n_items(batch->file, d) == 3);
+
+                if (journal_file_next_entry(one->file, p, DIRECTION_DOWN, &o, &p) == 0) {
+                        assert_se(journal_file_next_entry(batch->file, q, DIRECTION_DOWN, &d, &q) == 0);
+                        assert_se(i + 1 == N_BATCH_ENTRIES);
+                        break;
+                }
+
+                assert_se(journal_file_next_entry(batch->file, q, DIRECTION_DOWN, &d, &q) == 1);
+        }
+
+        /* And the data objects must be linked to the same entries */
+        FOREACH_STRING(field, "COMMON=yes", "THIRD=yes", "THIRD=no", "NUMBER=0", "NUMBER=999")
+                for (direction_t direction = DIRECTION_DOWN;; direction = DIRECTION_UP) {
+                        Object *a, *b;
+                        uint64_t seqnum;
+
+                        assert_se(journal_file_find_data_object(one->file, field, strlen(field), &a, NULL) == 1);
+                        n = le64toh(a->data.n_entries);
+                        assert_se(journal_file_next_entry_for_data(one->file, a, direction, &o, NULL) == 1);
+                        seqnum = le64toh(o->entry.seqnum);
+
+                        assert_se(journal_file_find_data_object(batch->file, field, strlen(field), &b, NULL) == 1);
+                        assert_se(le64toh(b->data.n_entries) == n);
+                        assert_se(journal_file_next_entry_for_data(batch->file, b, direction, &o, NULL) == 1);
+                        assert_se(le64toh(o->entry.seqnum) == seqnum);
+
+                        if (direction == DIRECTION_UP)
+                                break;
+                }
+
+        assert_se(journal_file_verify(batch->file, NULL, NULL, NULL, NULL, false) >= 0);
+
+        free(entries);
+        free(iovec);
+
+        (void) managed_journal_file_close(one);
+        (void) managed_journal_file_close(batch);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+TEST(append_entries_hints) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        ManagedJournalFile *one, *hinted, *other;
+        JournalDataHint common = {}, third[2] = {}, *hints[16][3];
+        JournalBatchEntry entries[ELEMENTSOF(hints)];
+        struct iovec iovec[ELEMENTSOF(hints)][3];
+        char numbers[ELEMENTSOF(hints)][STRLEN("NUMBER=") + DECIMAL_STR_MAX(size_t)];
+        dual_timestamp ts;
+        uint64_t p, q;
+        Object *o, *d;
+        size_t n;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        m = mmap_cache_new();
+        assert_se(m != NULL);
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(managed_journal_file_open(-1, "one.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &one) == 0);
+        assert_se(managed_journal_file_open(-1, "hinted.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &hinted) == 0);
+        assert_se(managed_journal_file_open(-1, "other.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &other) == 0);
+
+        dual_timestamp_get(&ts);
+
+        for (size_t i = 0; i < ELEMENTSOF(entries); i++) {
+                xsprintf(numbers[i], "NUMBER=%zu", i);
+
+                /* Two hinted fields, one of them with alternating values, and one without a hint */
+                iovec[i][0] = IOVEC_MAKE_STRING("COMMON=yes");
+                iovec[i][1] = IOVEC_MAKE_STRING((i % 2 == 0 ? "THIRD=yes" : "THIRD=no"));
+                iovec[i][2] = IOVEC_MAKE_STRING(numbers[i]);
+
+                hints[i][0] = &common;
+                hints[i][1] = third + i % 2;
+                hints[i][2] = NULL;
+
+                entries[i] = (JournalBatchEntry) {
+                        .ts = ts,
+                        .iovec = iovec[i],
+                        .n_iovec = ELEMENTSOF(iovec[i]),
+                        .hints = hints[i],
+                };
+
+                assert_se(journal_file_append_entry(one->file, &ts, NULL, iovec[i], ELEMENTSOF(iovec[i]), NULL, NULL, NULL) == 0);
+
+                ts.realtime++;
+                ts.monotonic++;
+        }
+
+        /* The first batch fills in the hints, the second one uses them */
+        assert_se(journal_file_append_entries(hinted->file, NULL, entries, 2, NULL, &n) == 0);
+        assert_se(n == 2);
+
+        assert_se(sd_id128_equal(common.file_id, hinted->file->header->file_id));
+        assert_se(journal_file_find_data_object(hinted->file, "COMMON=yes", STRLEN("COMMON=yes"), &o, &p) == 1);
+        assert_se(common.offset == p);
+        assert_se(common.hash == le64toh(o->data.hash));
+        assert_se(sd_id128_equal(third[1].file_id, hinted->file->header->file_id));
+        assert_se(journal_file_find_data_object(hinted->file, "THIRD=no", STRLEN("THIRD=no"), NULL, &p) == 1);
+        assert_se(third[1].offset == p);
+
+        assert_se(journal_file_append_entries(hinted->file, NULL, entries + 2, ELEMENTSOF(entries) - 2, NULL, &n) == 0);
+        assert_se(n == ELEMENTSOF(entries) - 2);
+
+        assert_se(le64toh(hinted->file->header->n_entries) == ELEMENTSOF(entries));
+        assert_se(le64toh(hinted->file->header->n_data) == le64toh(one->file->header->n_data));
+
+        /* Using the entries with hints for a different file must not use the data of the first one */
+        assert_se(journal_file_append_entries(other->file, NULL, entries, ELEMENTSOF(entries), NULL, &n) == 0);
+        assert_se(n == ELEMENTSOF(entries));
+        assert_se(sd_id128_equal(common.file_id, other->file->header->file_id));
+        assert_se(journal_file_find_data_object(other->file, "COMMON=yes", STRLEN("COMMON=yes"), NULL, &p) == 1);
+        assert_se(common.offset == p);
+        assert_se(le64toh(other->file->header->n_data) == le64toh(one->file->header->n_data));
+
+        /* All files must contain the same entries */
+        assert_se(journal_file_next_entry(one->file, 0, DIRECTION_DOWN, &o, &p) == 1);
+        assert_se(journal_file_next_entry(hinted->file, 0, DIRECTION_DOWN, &d, &q) == 1);
+        for (size_t i = 0;; i++) {
+                uint64_t xor_hash = le64toh(o->entry.xor_hash);
+
+                assert_se(le64toh(d->entry.seqnum) == i + 1);
+                assert_se(le64toh(d->entry.xor_hash) == xor_hash);
+                assert_se(journal_file_entry_n_items(hinted->file, d) == 3);
+
+                if (journal_file_next_entry(one->file, p, DIRECTION_DOWN, &o, &p) == 0) {
+                        assert_se(journal_file_next_entry(hinted->file, q, DIRECTION_DOWN, &d, &q) == 0);
+                        assert_se(i + 1 == ELEMENTSOF(entries));
+                        break;
+                }
+
+                assert_se(journal_file_next_entry(hinted->file, q, DIRECTION_DOWN, &d, &q) == 1);
+        }
+
+        FOREACH_STRING(field, "COMMON=yes", "THIRD=yes", "THIRD=no") {
+                assert_se(journal_file_find_data_object(one->file, field, strlen(field), &o, NULL) == 1);
+                n = le64toh(o->data.n_entries);
+
+                assert_se(journal_file_find_data_object(hinted->file, field, strlen(field), &o, NULL) == 1);
+                assert_se(le64toh(o->data.n_entries) == n);
+                assert_se(journal_file_find_data_object(other->file, field, strlen(field), &o, NULL) == 1);
+                assert_se(le64toh(o->data.n_entries) == n);
+        }
+
+        assert_se(journal_file_verify(hinted->file, NULL, NULL, NULL, NULL, false) >= 0);
+        assert_se(journal_file_verify(other->file, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) managed_journal_file_close(one);
+        (void) managed_journal_file_close(hinted);
+        (void) managed_journal_file_close(other);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+TEST(compact) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        ManagedJournalFile *regular, *compact, *copy;
+        char numbers[16][STRLEN("NUMBER=") + DECIMAL_STR_MAX(size_t)];
+        uint64_t p, q;
+        Object *o, *d;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        m = mmap_cache_new();
+        assert_se(m != NULL);
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(setenv("SYSTEMD_JOURNAL_COMPACT", "0", 1) >= 0);
+        assert_se(managed_journal_file_open(-1, "regular.journal", O_RDWR|O_CREAT, 0, 0666, UINT64_MAX, NULL, m, NULL, NULL, &regular) == 0);
+        assert_se(!JOURNAL_HEADER_COMPACT(regular->file->header));
+
+        assert_se(setenv("SYSTEMD_JOURNAL_COMPACT", "1", 1) >= 0);
+        assert_se(managed_journal_file_open(-1, "compact.journal", O_RDWR|O_CREAT, 0, 0666, UINT64_MAX, NULL, m, NULL, NULL, &compact) == 0);
+        assert_se(JOURNAL_HEADER_COMPACT(compact->file->header));
+        assert_se(compact->file->metrics.max_size <= JOURNAL_COMPACT_SIZE_MAX);
+
+        assert_se(unsetenv("SYSTEMD_JOURNAL_COMPACT") >= 0);
+
+        for (size_t i = 0; i < ELEMENTSOF(numbers); i++) {
+                struct iovec iovec[2];
+                dual_timestamp ts;
+
+                dual_timestamp_get(&ts);
+                xsprintf(numbers[i], "NUMBER=%zu", i);
+                iovec[0] = IOVEC_MAKE_STRING(numbers[i]);
+                iovec[1] = IOVEC_MAKE_STRING("COMMON=yes");
+
+                assert_se(journal_file_append_entry(regular->file, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+                assert_se(journal_file_append_entry(compact->file, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        }
+
+        /* Copying across formats works both ways */
+        assert_se(managed_journal_file_open(-1, "copy.journal", O_RDWR|O_CREAT, 0, 0666, UINT64_MAX, NULL, m, NULL, NULL, &copy) == 0);
+        assert_se(JOURNAL_HEADER_COMPACT(copy->file->header));
+
+        assert_se(journal_file_next_entry(regular->file, 0, DIRECTION_DOWN, &o, &p) == 1);
+        for (;;) {
+                assert_se(journal_file_copy_entry(regular->file, copy->file, o, p) >= 0);
+                if (journal_file_next_entry(regular->file, p, DIRECTION_DOWN, &o, &p) == 0)
+                        break;
+        }
+
+        assert_se(journal_file_next_entry(regular->file, 0, DIRECTION_DOWN, &o, &p) == 1);
+        assert_se(journal_file_next_entry(compact->file, 0, DIRECTION_DOWN, &d, &q) == 1);
+        for (size_t i = 0;; i++) {
+                uint64_t size = le64toh(o->object.size), xor_hash = le64toh(o->entry.xor_hash);
+
+                /* Same entries, with the same items, but with half the size or less for each item */
+                assert_se(le64toh(d->entry.xor_hash) == xor_hash);
+                assert_se(journal_file_entry_n_items(regular->file, o) == 2);
+                assert_se(journal_file_entry_n_items(compact->file, d) == 2);
+                assert_se(le64toh(d->object.size) - offsetof(Object, entry.items) <= (size - offsetof(Object, entry.items)) / 4);
+
+                for (size_t j = 0; j < 2; j++) {
+                        Object *u;
+
+                        assert_se(journal_file_move_to_object(compact->file, OBJECT_DATA, journal_file_entry_item_object_offset(compact->file, d, j), &u) >= 0);
+                        assert_se(memcmp(u->data.payload, "NUMBER=", STRLEN("NUMBER=")) == 0 ||
+                                  memcmp(u->data.payload, "COMMON=", STRLEN("COMMON=")) == 0);
+
+                        assert_se(journal_file_move_to_object(compact->file, OBJECT_ENTRY, q, &d) >= 0);
+                }
+
+                if (journal_file_next_entry(regular->file, p, DIRECTION_DOWN, &o, &p) == 0) {
+                        assert_se(journal_file_next_entry(compact->file, q, DIRECTION_DOWN, &d, &q) == 0);
+                        assert_se(i + 1 == ELEMENTSOF(numbers));
+                        break;
+                }
+
+                assert_se(journal_file_next_entry(compact->file, q, DIRECTION_DOWN, &d, &q) == 1);
+        }
+
+        /* The entries copied to the compact file can be found by their data, too */
+        assert_se(journal_file_find_data_object(copy->file, numbers[3], strlen(numbers[3]), &o, NULL) == 1);
+        assert_se(journal_file_next_entry_for_data(copy->file, o, DIRECTION_DOWN, &o, NULL) == 1);
+
+        assert_se(le64toh(copy->file->header->n_entries) == ELEMENTSOF(numbers));
+
+        assert_se(journal_file_verify(regular->file, NULL, NULL, NULL, NULL, false) >= 0);
+        assert_se(journal_file_verify(compact->file, NULL, NULL, NULL, NULL, false) >= 0);
+        assert_se(journal_file_verify(copy->file, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) managed_journal_file_close(regular);
+        (void) managed_journal_file_close(compact);
+        (void) managed_journal_file_close(copy);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
 #if HAVE_COMPRESSION
+TEST(append_entries_compress_pool) {
+        _cleanup_(compress_pool_unrefp) CompressPool *pool = NULL;
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        ManagedJournalFile *one, *batch;
+        JournalBatchEntry entries[16];
+        struct iovec iovec[ELEMENTSOF(entries)][3];
+        char big[ELEMENTSOF(entries)][2048];
+        dual_timestamp ts;
+        size_t n;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        m = mmap_cache_new();
+        assert_se(m != NULL);
+
+        assert_se(compress_pool_new(2, &pool) >= 0);
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(managed_journal_file_open(-1, "one.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, 512, NULL, m, NULL, NULL, &one) == 0);
+        assert_se(managed_journal_file_open(-1, "batch.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, 512, NULL, m, NULL, NULL, &batch) == 0);
+        journal_file_set_compress_pool(batch->file, pool);
+
+        dual_timestamp_get(&ts);
+
+        for (size_t i = 0; i < ELEMENTSOF(entries); i++) {
+                /* A large field for each entry, with every other one repeated from the previous entry, a
+                 * large field shared by all of them, and a small one */
+                memcpy(big[i], "BIG=", STRLEN("BIG="));
+                for (size_t j = STRLEN("BIG="); j < sizeof(big[i]) - 1; j++)
+                        big[i][j] = 'a' + (j / (i / 2 + 1)) % 26;
+                big[i][sizeof(big[i]) - 1] = 0;
+
+                iovec[i][0] = IOVEC_MAKE_STRING(big[i - i % 2]);
+                iovec[i][1] = IOVEC_MAKE_STRING(big[0]);
+                iovec[i][2] = IOVEC_MAKE_STRING("SMALL=yes");
+
+                entries[i] = (JournalBatchEntry) {
+                        .ts = ts,
+                        .iovec = iovec[i],
+                        .n_iovec = ELEMENTSOF(iovec[i]),
+                };
+
+                assert_se(journal_file_append_entry(one->file, &ts, NULL, iovec[i], ELEMENTSOF(iovec[i]), NULL, NULL, NULL) == 0);
+
+                ts.realtime++;
+                ts.monotonic++;
+        }
+
+        assert_se(journal_file_append_entries(batch->file, NULL, entries, ELEMENTSOF(entries), NULL, &n) == 0);
+        assert_se(n == ELEMENTSOF(entries));
+
+        assert_se(le64toh(batch->file->header->n_entries) == ELEMENTSOF(entries));
+        assert_se(le64toh(batch->file->header->n_data) == le64toh(one->file->header->n_data));
+
+        /* Compressing on the pool must result in the very same data objects, still hashed over the
+         * uncompressed payload. Note that finding the objects also compares their decompressed payload with
+         * the original data. */
+        for (size_t i = 0; i < ELEMENTSOF(entries); i += 2) {
+                ObjectHeader header;
+                uint64_t n_entries;
+                Object *o;
+
+                assert_se(journal_file_find_data_object(one->file, big[i], strlen(big[i]), &o, NULL) == 1);
+                assert_se(o->object.flags & _OBJECT_COMPRESSED_MASK);
+                header = o->object;
+                n_entries = o->data.n_entries;
+
+                assert_se(journal_file_find_data_object(batch->file, big[i], strlen(big[i]), &o, NULL) == 1);
+                assert_se(o->object.flags == header.flags);
+                assert_se(o->object.size == header.size);
+                assert_se(le64toh(o->data.hash) == journal_file_hash_data(batch->file, big[i], strlen(big[i])));
+                assert_se(o->data.n_entries == n_entries);
+        }
+
+        assert_se(journal_file_verify(batch->file, NULL, NULL, NULL, NULL, false) >= 0);
+
+        (void) managed_journal_file_close(one);
+        (void) managed_journal_file_close(batch);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+#if HAVE_ZSTD
+TEST(dictionary) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_free_ void *dictionary = NULL;
+        ManagedJournalFile *train, *f;
+        size_t dictionary_size;
+        dual_timestamp ts;
+        struct iovec iovec[2];
+        char msg[128];
+        Object *o;
+        int r;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        m = mmap_cache_new();
+        assert_se(m != NULL);
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(managed_journal_file_open(-1, "train.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, 512, NULL, m, NULL, NULL, &train) == 0);
+        if (!JOURNAL_HEADER_COMPRESSED_ZSTD(train->file->header)) {
+                (void) managed_journal_file_close(train);
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+                return (void) log_tests_skipped("zstd is not the default compression");
+        }
+
+        dual_timestamp_get(&ts);
+
+        for (unsigned i = 0; i < 1000; i++) {
+                xsprintf(msg, "MESSAGE=Started Session %u of User user%u (uid=%u) on seat%u, without a TTY.", i * 7, i % 13, 1000 + i % 13, i % 3);
+                iovec[0] = IOVEC_MAKE_STRING(msg);
+                iovec[1] = IOVEC_MAKE_STRING("_SYSTEMD_UNIT=systemd-logind.service");
+
+                assert_se(journal_file_append_entry(train->file, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+
+                ts.realtime++;
+                ts.monotonic++;
+        }
+
+        r = journal_file_train_dictionary(train->file, &dictionary, &dictionary_size);
+        if (r == -ENODATA) {
+                (void) managed_journal_file_close(train);
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+                return (void) log_tests_skipped("zstd dictionary training failed");
+        }
+        assert_se(r >= 0);
+        assert_se(dictionary_size <= JOURNAL_DICTIONARY_SIZE_MAX);
+
+        /* Dictionaries can only be added to files without data */
+        assert_se(journal_file_add_dictionary(train->file, dictionary, dictionary_size) == -EBUSY);
+        (void) managed_journal_file_close(train);
+
+        assert_se(managed_journal_file_open(-1, "dict.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, 512, NULL, m, NULL, NULL, &f) == 0);
+        assert_se(journal_file_add_dictionary(f->file, "foobar", 6) == -EBADMSG);
+        assert_se(journal_file_add_dictionary(f->file, dictionary, dictionary_size) == 0);
+        assert_se(journal_file_add_dictionary(f->file, dictionary, dictionary_size) == -EBUSY);
+        assert_se(JOURNAL_HEADER_ZSTD_DICTIONARY(f->file->header));
+
+        /* The message is way below the compression threshold, but compressed anyway thanks to the
+         * dictionary */
+        xsprintf(msg, "MESSAGE=Started Session %u of User user%u (uid=%u) on seat%u, without a TTY.", 4711U, 5U, 1005U, 1U);
+        iovec[0] = IOVEC_MAKE_STRING(msg);
+        assert_se(journal_file_append_entry(f->file, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+
+        assert_se(journal_file_find_data_object(f->file, msg, strlen(msg), &o, NULL) == 1);
+        assert_se(COMPRESSION_FROM_OBJECT(o) == COMPRESSION_ZSTD);
+        assert_se(le64toh(o->object.size) - offsetof(Object, data.payload) < strlen(msg) / 2);
+
+        assert_se(journal_file_verify(f->file, NULL, NULL, NULL, NULL, false) >= 0);
+        (void) managed_journal_file_close(f);
+
+        /* Readers load the dictionary when they need it. Finding the object compares the decompressed
+         * payload. */
+        assert_se(managed_journal_file_open(-1, "dict.journal", O_RDONLY, 0, 0666, 0, NULL, m, NULL, NULL, &f) == 0);
+        assert_se(journal_file_find_data_object(f->file, msg, strlen(msg), &o, NULL) == 1);
+        assert_se(journal_file_verify(f->file, NULL, NULL, NULL, NULL, false) >= 0);
+        journal_file_print_header(f->file);
+        (void) managed_journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+#endif
+
+static int summary_may_contain(JournalFile *f, const char *data) {
+        return journal_file_summary_may_contain(f, data, strlen(data), journal_file_hash_data(f, data, strlen(data)));
+}
+
+TEST(summary) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        ManagedJournalFile *f;
+        dual_timestamp ts, head;
+        struct iovec iovec[3];
+        char msg[64], unit[64], priority[16];
+        unsigned n_false_positives = 0;
+        sd_journal *j;
+        int r;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        m = mmap_cache_new();
+        assert_se(m != NULL);
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(managed_journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &f) == 0);
+
+        dual_timestamp_get(&ts);
+        head = ts;
+
+        for (unsigned i = 0; i < 100; i++) {
+                xsprintf(msg, "MESSAGE=Message %u", i);
+                xsprintf(unit, "_SYSTEMD_UNIT=unit-%u.service", i % 10);
+                xsprintf(priority, "PRIORITY=%u", i % 8);
+                iovec[0] = IOVEC_MAKE_STRING(msg);
+                iovec[1] = IOVEC_MAKE_STRING(unit);
+                iovec[2] = IOVEC_MAKE_STRING(priority);
+
+                assert_se(journal_file_append_entry(f->file, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+
+                ts.realtime++;
+                ts.monotonic++;
+        }
+
+        /* Files without summary might contain anything */
+        assert_se(summary_may_contain(f->file, "_SYSTEMD_UNIT=other.service") > 0);
+
+        /* The summary is written when the file is archived */
+        assert_se(journal_file_archive(f->file, NULL) == 0);
+        assert_se(f->file->header->summary_offset != 0);
+        assert_se(journal_file_add_summary(f->file) == -EBUSY);
+
+        for (unsigned i = 0; i < 10; i++) {
+                xsprintf(unit, "_SYSTEMD_UNIT=unit-%u.service", i);
+                assert_se(summary_may_contain(f->file, unit) > 0);
+        }
+        for (unsigned i = 0; i < 8; i++) {
+                xsprintf(priority, "PRIORITY=%u", i);
+                assert_se(summary_may_contain(f->file, priority) > 0);
+        }
+        for (unsigned i = 0; i < 1000; i++) {
+                xsprintf(unit, "_SYSTEMD_UNIT=other-%u.service", i);
+                r = summary_may_contain(f->file, unit);
+                assert_se(r >= 0);
+                n_false_positives += r > 0;
+        }
+        log_info("Summary false positives: %u/1000", n_false_positives);
+        assert_se(n_false_positives < 100);
+
+        /* Fields that are not covered are always possible */
+        assert_se(summary_may_contain(f->file, "MESSAGE=Nothing") > 0);
+        assert_se(summary_may_contain(f->file, "NO_FIELD") > 0);
+
+        assert_se(journal_file_verify(f->file, NULL, NULL, NULL, NULL, false) >= 0);
+        journal_file_print_header(f->file);
+        (void) managed_journal_file_close(f);
+
+        /* Readers skip the file based on the summary or its time range, and still find everything else */
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        assert_se(sd_journal_add_match(j, "_SYSTEMD_UNIT=other.service", 0) >= 0);
+        assert_se(sd_journal_add_disjunction(j) >= 0);
+        assert_se(sd_journal_add_match(j, "PRIORITY=9", 0) >= 0);
+        assert_se(sd_journal_next(j) == 0);
+
+        sd_journal_flush_matches(j);
+        assert_se(sd_journal_add_match(j, "_SYSTEMD_UNIT=unit-3.service", 0) >= 0);
+        assert_se(sd_journal_add_match(j, "PRIORITY=3", 0) >= 0);
+        for (unsigned i = 0; i < 3; i++)
+                assert_se(sd_journal_next(j) == 1);
+        assert_se(sd_journal_next(j) == 0);
+
+        sd_journal_flush_matches(j);
+        assert_se(sd_journal_seek_realtime_usec(j, ts.realtime) >= 0);
+        assert_se(sd_journal_next(j) == 0);
+        assert_se(sd_journal_seek_realtime_usec(j, head.realtime - 1) >= 0);
+        assert_se(sd_journal_previous(j) == 0);
+        assert_se(sd_journal_seek_realtime_usec(j, head.realtime + 50) >= 0);
+        assert_se(sd_journal_next(j) == 1);
+
+        sd_journal_close(j);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static uint64_t entry_keys_lookup(JournalFile *f, bool realtime, uint64_t needle, direction_t direction) {
+        uint64_t p = 0;
+        Object *o;
+        int r;
+
+        if (realtime)
+                r = journal_file_move_to_entry_by_realtime(f, needle, direction, &o, &p);
+        else
+                r = journal_file_move_to_entry_by_seqnum(f, needle, direction, &o, &p);
+        assert_se(r >= 0);
+
+        return r > 0 ? p : 0;
+}
+
+TEST(entry_keys) {
+        _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
+        _cleanup_free_ uint64_t *expected = NULL;
+        ManagedJournalFile *f;
+        dual_timestamp ts, head;
+        struct iovec iovec;
+        char msg[64];
+        uint64_t n_needles;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        m = mmap_cache_new();
+        assert_se(m != NULL);
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(managed_journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, JOURNAL_COMPRESS, 0666, UINT64_MAX, NULL, m, NULL, NULL, &f) == 0);
+
+        dual_timestamp_get(&ts);
+        head = ts;
+
+        for (unsigned i = 0; i < 1000; i++) {
+                xsprintf(msg, "MESSAGE=Message %u", i);
+                iovec = IOVEC_MAKE_STRING(msg);
+
+                assert_se(journal_file_append_entry(f->file, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+
+                /* Leave gaps, to also look for timestamps that no entry has */
+                ts.realtime += 2;
+                ts.monotonic += 2;
+        }
+
+        /* Record where bisecting the entry arrays takes us, including before the first and beyond the last
+         * entry, and check that the entry keys take us to the same places */
+        n_needles = 2 * 2 * 1004;
+        expected = new(uint64_t, n_needles);
+        assert_se(expected);
+
+        for (unsigned pass = 0; pass < 2; pass++) {
+                uint64_t *e = expected;
+
+                for (uint64_t i = 0; i < 1004; i++)
+                        for (direction_t d = DIRECTION_UP; d <= DIRECTION_DOWN; d++) {
+                                uint64_t seqnum = i, realtime = head.realtime + 2 * i - 3;
+
+                                if (pass == 0) {
+                                        *(e++) = entry_keys_lookup(f->file, false, seqnum, d);
+                                        *(e++) = entry_keys_lookup(f->file, true, realtime, d);
+                                } else {
+                                        assert_se(*(e++) == entry_keys_lookup(f->file, false, seqnum, d));
+                                        assert_se(*(e++) == entry_keys_lookup(f->file, true, realtime, d));
+                                }
+                        }
+
+                if (pass == 0) {
+                        assert_se(journal_file_archive(f->file, NULL) == 0);
+                        assert_se(f->file->header->entry_keys_offset != 0);
+                        assert_se(journal_file_add_entry_keys(f->file) == -EBUSY);
+                }
+        }
+
+        assert_se(entry_keys_lookup(f->file, false, 0, DIRECTION_UP) == 0);
+        assert_se(entry_keys_lookup(f->file, false, 1001, DIRECTION_DOWN) == 0);
+        assert_se(entry_keys_lookup(f->file, true, head.realtime - 1, DIRECTION_UP) == 0);
+        assert_se(entry_keys_lookup(f->file, true, head.realtime, DIRECTION_UP) != 0);
+
+        assert_se(journal_file_verify(f->file, NULL, NULL, NULL, NULL, false) >= 0);
+        (void) managed_journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
 static bool check_compressed(uint64_t compress_threshold, uint64_t data_size) {
         _cleanup_(mmap_cache_unrefp) MMapCache *m = NULL;
         dual_timestamp ts;
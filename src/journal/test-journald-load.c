@@ -0,0 +1,472 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sd-id128.h"
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "errno-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "log.h"
+#include "main-func.h"
+#include "parse-util.h"
+#include "socket-util.h"
+#include "sort-util.h"
+#include "stdio-util.h"
+#include "string-table.h"
+#include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
+
+/* Generates load on the running journald and measures how long it takes until the generated messages can be
+ * read back from the journal. Every message carries the sender thread, a sequence number and the time it was
+ * sent in its text, and is tagged with a syslog identifier that is unique to this run, so that only our own
+ * messages are read back. Note that journald's rate limiting applies, hence raise RateLimitBurst= or set
+ * RateLimitIntervalSec=0 in journald.conf before generating a lot of messages. */
+
+typedef enum Transport {
+        TRANSPORT_NATIVE,
+        TRANSPORT_STREAM,
+        TRANSPORT_SYSLOG,
+        _TRANSPORT_MAX,
+        _TRANSPORT_INVALID = -EINVAL,
+} Transport;
+
+static const char* const transport_table[_TRANSPORT_MAX] = {
+        [TRANSPORT_NATIVE] = "native",
+        [TRANSPORT_STREAM] = "stream",
+        [TRANSPORT_SYSLOG] = "syslog",
+};
+
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP_FROM_STRING(transport, Transport);
+
+static Transport arg_transport = TRANSPORT_NATIVE;
+static size_t arg_size = 128;
+static unsigned arg_fields = 0;
+static unsigned arg_concurrency = 1;
+static unsigned arg_count = 10000;
+static unsigned arg_rate = 0;
+static usec_t arg_timeout = 5 * USEC_PER_SEC;
+static char arg_identifier[STRLEN("test-journald-load-") + SD_ID128_STRING_MAX];
+
+static unsigned n_finished = 0;
+
+typedef struct Worker {
+        pthread_t thread;
+        unsigned index;
+        int error;
+} Worker;
+
+static int send_message(int fd, const char *message, char **fields) {
+        _cleanup_free_ struct iovec *iovec = NULL;
+        _cleanup_free_ char *m = NULL;
+        size_t n = 0;
+
+        switch (arg_transport) {
+
+        case TRANSPORT_NATIVE:
+                iovec = new(struct iovec, 3 + arg_fields);
+                if (!iovec)
+                        return -ENOMEM;
+
+                m = strjoin("MESSAGE=", message);
+                if (!m)
+                        return -ENOMEM;
+
+                iovec[n++] = IOVEC_MAKE_STRING(m);
+                iovec[n++] = IOVEC_MAKE_STRING("PRIORITY=6");
+                iovec[n++] = IOVEC_MAKE_STRING(strjoina("SYSLOG_IDENTIFIER=", arg_identifier));
+                for (unsigned i = 0; i < arg_fields; i++)
+                        iovec[n++] = IOVEC_MAKE_STRING(fields[i]);
+
+                return sd_journal_sendv(iovec, n);
+
+        case TRANSPORT_STREAM:
+                m = strjoin(message, "\n");
+                if (!m)
+                        return -ENOMEM;
+
+                return loop_write(fd, m, strlen(m), /* do_poll= */ false);
+
+        case TRANSPORT_SYSLOG:
+                m = strjoin("<14>", arg_identifier, ": ", message);
+                if (!m)
+                        return -ENOMEM;
+
+                return RET_NERRNO(send(fd, m, strlen(m), MSG_NOSIGNAL));
+
+        default:
+                assert_not_reached();
+        }
+}
+
+static int open_transport(int *ret) {
+        _cleanup_close_ int fd = -1;
+        union sockaddr_union sa;
+        int salen;
+
+        assert(ret);
+
+        switch (arg_transport) {
+
+        case TRANSPORT_NATIVE:
+                /* sd_journal_sendv() uses its own socket */
+                *ret = -1;
+                return 0;
+
+        case TRANSPORT_STREAM:
+                fd = sd_journal_stream_fd(arg_identifier, LOG_INFO, false);
+                if (fd < 0)
+                        return fd;
+                break;
+
+        case TRANSPORT_SYSLOG:
+                fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0);
+                if (fd < 0)
+                        return -errno;
+
+                salen = sockaddr_un_set_path(&sa.un, "/run/systemd/journal/dev-log");
+                if (salen < 0)
+                        return salen;
+
+                if (connect(fd, &sa.sa, salen) < 0)
+                        return -errno;
+                break;
+
+        default:
+                assert_not_reached();
+        }
+
+        *ret = TAKE_FD(fd);
+        return 0;
+}
+
+static int worker_run(Worker *w) {
+        _cleanup_strv_free_ char **fields = NULL;
+        _cleanup_free_ char *padding = NULL;
+        _cleanup_close_ int fd = -1;
+        usec_t start, interval = 0;
+        int r;
+
+        assert(w);
+
+        r = open_transport(&fd);
+        if (r < 0)
+                return log_error_errno(r, "Failed to connect to journald: %m");
+
+        /* The extra fields are the same in every message, like most fields of real log messages */
+        for (unsigned i = 0; i < arg_fields; i++)
+                if (strv_extendf(&fields, "BENCHMARK_FIELD_%u=value-%u", i, i) < 0)
+                        return log_oom();
+
+        padding = strrep("x", arg_size);
+        if (!padding)
+                return log_oom();
+
+        if (arg_rate > 0)
+                interval = USEC_PER_SEC * arg_concurrency / arg_rate;
+
+        start = now(CLOCK_MONOTONIC);
+        for (unsigned seq = 0; seq < arg_count; seq++) {
+                _cleanup_free_ char *message = NULL;
+                usec_t n;
+
+                if (interval > 0) {
+                        usec_t deadline = usec_add(start, seq * interval);
+
+                        n = now(CLOCK_MONOTONIC);
+                        if (deadline > n)
+                                (void) usleep(deadline - n);
+                }
+
+                n = now(CLOCK_MONOTONIC);
+                if (asprintf(&message, "%u %u " USEC_FMT " ", w->index, seq, n) < 0)
+                        return log_oom();
+
+                /* Pad the message to the requested size */
+                if (strlen(message) < arg_size &&
+                    !strextend(&message, padding + strlen(message)))
+                        return log_oom();
+
+                r = send_message(fd, message, fields);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to send message: %m");
+        }
+
+        return 0;
+}
+
+static void* worker_thread(void *p) {
+        Worker *w = ASSERT_PTR(p);
+
+        w->error = worker_run(w);
+        __sync_fetch_and_add(&n_finished, 1);
+
+        return NULL;
+}
+
+static int read_message(sd_journal *j, usec_t *ret) {
+        unsigned index, seq;
+        const void *d;
+        usec_t sent;
+        size_t l;
+        int r;
+
+        assert(j);
+        assert(ret);
+
+        r = sd_journal_get_data(j, "MESSAGE", &d, &l);
+        if (r < 0)
+                return r;
+
+        if (sscanf(strndupa_safe((const char*) d + STRLEN("MESSAGE="), l - STRLEN("MESSAGE=")),
+                   "%u %u " USEC_FMT, &index, &seq, &sent) != 3)
+                return -EBADMSG;
+
+        *ret = usec_sub_unsigned(now(CLOCK_MONOTONIC), sent);
+        return 0;
+}
+
+static usec_t percentile(const usec_t *latencies, size_t n, unsigned permille) {
+        assert(n > 0);
+
+        return latencies[MIN(n * permille / 1000, n - 1)];
+}
+
+static int parse_argv(int argc, char *argv[]) {
+        enum {
+                ARG_TRANSPORT = 0x100,
+                ARG_SIZE,
+                ARG_FIELDS,
+                ARG_CONCURRENCY,
+                ARG_COUNT,
+                ARG_RATE,
+                ARG_TIMEOUT,
+        };
+
+        static const struct option options[] = {
+                { "help",        no_argument,       NULL, 'h'             },
+                { "transport",   required_argument, NULL, ARG_TRANSPORT   },
+                { "size",        required_argument, NULL, ARG_SIZE        },
+                { "fields",      required_argument, NULL, ARG_FIELDS      },
+                { "concurrency", required_argument, NULL, ARG_CONCURRENCY },
+                { "count",       required_argument, NULL, ARG_COUNT       },
+                { "rate",        required_argument, NULL, ARG_RATE        },
+                { "timeout",     required_argument, NULL, ARG_TIMEOUT     },
+                {}
+        };
+
+        uint64_t u;
+        int c, r;
+
+        assert(argc >= 0);
+        assert(argv);
+
+        while ((c = getopt_long(argc, argv, "h", options, NULL)) >= 0)
+                switch (c) {
+
+                case 'h':
+                        printf("%s [OPTIONS...]\n\n"
+                               "Generate load on journald and measure the latency until messages are readable.\n\n"
+                               "  -h --help             Show this help\n"
+                               "     --transport=TYPE   Send messages via 'native', 'stream' or 'syslog'\n"
+                               "     --size=BYTES       Size of each message text (default: 128)\n"
+                               "     --fields=N         Number of additional fields, native transport only\n"
+                               "     --concurrency=N    Number of threads sending messages (default: 1)\n"
+                               "     --count=N          Number of messages sent by each thread (default: 10000)\n"
+                               "     --rate=N           Messages per second sent by all threads together\n"
+                               "                        (default: unlimited)\n"
+                               "     --timeout=SEC      How long to wait for outstanding messages (default: 5s)\n",
+                               program_invocation_short_name);
+                        return 0;
+
+                case ARG_TRANSPORT:
+                        arg_transport = transport_from_string(optarg);
+                        if (arg_transport < 0)
+                                return log_error_errno(arg_transport, "Invalid transport: %s", optarg);
+                        break;
+
+                case ARG_SIZE:
+                        r = parse_size(optarg, 1024, &u);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse message size: %s", optarg);
+                        if (u > 1024 * 1024)
+                                return log_error_errno(SYNTHETIC_ERRNO(ERANGE), "Message size too large: %s", optarg);
+                        arg_size = u;
+                        break;
+
+                case ARG_FIELDS:
+                        r = safe_atou(optarg, &arg_fields);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse number of fields: %s", optarg);
+                        break;
+
+                case ARG_CONCURRENCY:
+                        r = safe_atou(optarg, &arg_concurrency);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse concurrency: %s", optarg);
+                        if (arg_concurrency == 0)
+                                return log_error_errno(SYNTHETIC_ERRNO(ERANGE), "Concurrency must be positive.");
+                        break;
+
+                case ARG_COUNT:
+                        r = safe_atou(optarg, &arg_count);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse message count: %s", optarg);
+                        if (arg_count == 0)
+                                return log_error_errno(SYNTHETIC_ERRNO(ERANGE), "Message count must be positive.");
+                        break;
+
+                case ARG_RATE:
+                        r = safe_atou(optarg, &arg_rate);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse rate: %s", optarg);
+                        break;
+
+                case ARG_TIMEOUT:
+                        r = parse_sec(optarg, &arg_timeout);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse timeout: %s", optarg);
+                        break;
+
+                case '?':
+                        return -EINVAL;
+
+                default:
+                        assert_not_reached();
+                }
+
+        if (arg_fields > 0 && arg_transport != TRANSPORT_NATIVE)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "--fields= is only supported for the native transport.");
+
+        if (optind < argc)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "This program takes no arguments.");
+
+        return 1;
+}
+
+static int run(int argc, char *argv[]) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ usec_t *latencies = NULL;
+        _cleanup_free_ Worker *workers = NULL;
+        usec_t start, end, last = USEC_INFINITY;
+        size_t n_expected, n_received = 0;
+        sd_id128_t id;
+        int r;
+
+        log_setup();
+
+        r = parse_argv(argc, argv);
+        if (r <= 0)
+                return r;
+
+        r = sd_id128_randomize(&id);
+        if (r < 0)
+                return log_error_errno(r, "Failed to generate run ID: %m");
+        xsprintf(arg_identifier, "test-journald-load-%s", SD_ID128_TO_STRING(id));
+
+        n_expected = (size_t) arg_count * arg_concurrency;
+        latencies = new(usec_t, n_expected);
+        if (!latencies)
+                return log_oom();
+
+        /* Open the journal before sending anything, so that sd_journal_wait() notices all new entries */
+        r = sd_journal_open(&j, SD_JOURNAL_LOCAL_ONLY);
+        if (r < 0)
+                return log_error_errno(r, "Failed to open journal: %m");
+
+        r = sd_journal_add_match(j, strjoina("SYSLOG_IDENTIFIER=", arg_identifier), 0);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add match: %m");
+
+        r = sd_journal_seek_tail(j);
+        if (r < 0)
+                return log_error_errno(r, "Failed to seek to end of journal: %m");
+
+        workers = new0(Worker, arg_concurrency);
+        if (!workers)
+                return log_oom();
+
+        log_info("Sending %zu messages of %zu bytes via %s transport from %u threads as %s.",
+                 n_expected, arg_size, transport_table[arg_transport], arg_concurrency, arg_identifier);
+
+        start = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < arg_concurrency; i++) {
+                workers[i].index = i;
+
+                r = -pthread_create(&workers[i].thread, NULL, worker_thread, workers + i);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to start thread: %m");
+        }
+
+        /* Read the messages back while they are sent, until all arrived, or all threads are done and
+         * nothing arrived for a while */
+        while (n_received < n_expected) {
+                r = sd_journal_next(j);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to iterate journal: %m");
+                if (r > 0) {
+                        r = read_message(j, latencies + n_received);
+                        if (r < 0) {
+                                log_warning_errno(r, "Failed to parse message, ignoring: %m");
+                                continue;
+                        }
+
+                        n_received++;
+                        last = USEC_INFINITY;
+                        continue;
+                }
+
+                if (last == USEC_INFINITY)
+                        last = now(CLOCK_MONOTONIC);
+                else if (__sync_fetch_and_add(&n_finished, 0) == arg_concurrency &&
+                         usec_sub_unsigned(now(CLOCK_MONOTONIC), last) >= arg_timeout)
+                        break;
+
+                r = sd_journal_wait(j, 100 * USEC_PER_MSEC);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to wait for journal changes: %m");
+        }
+        end = now(CLOCK_MONOTONIC);
+
+        for (unsigned i = 0; i < arg_concurrency; i++) {
+                (void) pthread_join(workers[i].thread, NULL);
+                if (workers[i].error < 0)
+                        return workers[i].error;
+        }
+
+        if (n_received == 0)
+                return log_error_errno(SYNTHETIC_ERRNO(ETIMEDOUT), "No messages could be read back from the journal.");
+
+        typesafe_qsort(latencies, n_received, uint64_compare_func);
+
+        printf("Messages sent:     %zu\n"
+               "Messages received: %zu\n"
+               "Throughput:        %" PRIu64 " messages/s\n"
+               "Latency p50:       %s\n"
+               "Latency p90:       %s\n"
+               "Latency p99:       %s\n"
+               "Latency p99.9:     %s\n"
+               "Latency max:       %s\n",
+               n_expected,
+               n_received,
+               (uint64_t) n_received * USEC_PER_SEC / MAX(usec_sub_unsigned(end, start), 1u),
+               FORMAT_TIMESPAN(percentile(latencies, n_received, 500), 1),
+               FORMAT_TIMESPAN(percentile(latencies, n_received, 900), 1),
+               FORMAT_TIMESPAN(percentile(latencies, n_received, 990), 1),
+               FORMAT_TIMESPAN(percentile(latencies, n_received, 999), 1),
+               FORMAT_TIMESPAN(latencies[n_received - 1], 1));
+
+        if (n_received < n_expected)
+                log_warning("%zu messages were not received, probably due to rate limiting in journald.",
+                            n_expected - n_received);
+
+        return 0;
+}
+
+DEFINE_MAIN_FUNCTION(run);
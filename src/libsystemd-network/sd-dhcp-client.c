@@ -40,6 +40,12 @@
 #define RESTART_AFTER_NAK_MIN_USEC (1 * USEC_PER_SEC)
 #define RESTART_AFTER_NAK_MAX_USEC (30 * USEC_PER_MINUTE)
 
+/* The renewal timers of the clients on many interfaces, which often got their leases at the same time,
+ * are coalesced by sd-event within this accuracy, but only a small fraction of the lease lifetime is
+ * used for short leases, so that the timers do not fire out of order. */
+#define RENEW_TIMER_ACCURACY_MAX_USEC (10 * USEC_PER_SEC)
+#define RENEW_TIMER_ACCURACY_MIN_USEC (10 * USEC_PER_MSEC)
+
 #define TRANSIENT_FAILURE_ATTEMPTS 3 /* Arbitrary limit: how many attempts are considered enough to report
                                       * transient failure. */
 
@@ -1395,7 +1401,9 @@ static int client_initialize_time_events(sd_dhcp_client *client) {
 
         if (client->start_delay > 0) {
                 assert_se(sd_event_now(client->event, CLOCK_BOOTTIME, &usec) >= 0);
-                usec += client->start_delay;
+                /* Add some jitter, so that clients on many interfaces which were NAKed at the same time,
+                 * e.g. after the carrier of all of them was lost, do not restart at the same time. */
+                usec += client->start_delay + random_u64_range(client->start_delay / 2);
         }
 
         r = event_reset_time(client->event, &client->timeout_resend,
@@ -1667,7 +1675,7 @@ static int client_handle_ack(sd_dhcp_client *client, DHCPMessage *ack, size_t le
 }
 
 static int client_set_lease_timeouts(sd_dhcp_client *client) {
-        usec_t time_now;
+        usec_t time_now, accuracy;
         int r;
 
         assert(client);
@@ -1715,6 +1723,9 @@ static int client_set_lease_timeouts(sd_dhcp_client *client) {
         /* after fuzzing, ensure t2 is still >= t1 */
         client->t2_time = MAX(client->t1_time, client->t2_time);
 
+        accuracy = CLAMP(client->lease->lifetime * USEC_PER_SEC / 20,
+                         RENEW_TIMER_ACCURACY_MIN_USEC, RENEW_TIMER_ACCURACY_MAX_USEC);
+
         /* arm lifetime timeout */
         r = event_reset_time(client->event, &client->timeout_expire,
                              CLOCK_BOOTTIME,
@@ -1734,7 +1745,7 @@ static int client_set_lease_timeouts(sd_dhcp_client *client) {
         /* arm T2 timeout */
         r = event_reset_time(client->event, &client->timeout_t2,
                              CLOCK_BOOTTIME,
-                             client->t2_time, 10 * USEC_PER_MSEC,
+                             client->t2_time, accuracy,
                              client_timeout_t2, client,
                              client->event_priority, "dhcp4-t2-timeout", true);
         if (r < 0)
@@ -1750,7 +1761,7 @@ static int client_set_lease_timeouts(sd_dhcp_client *client) {
         /* arm T1 timeout */
         r = event_reset_time(client->event, &client->timeout_t1,
                              CLOCK_BOOTTIME,
-                             client->t1_time, 10 * USEC_PER_MSEC,
+                             client->t1_time, accuracy,
                              client_timeout_t1, client,
                              client->event_priority, "dhcp4-t1-timer", true);
         if (r < 0)
@@ -20,6 +20,14 @@
 #define DEFAULT_SYSTEM_BUS_ADDRESS "unix:path=/run/dbus/system_bus_socket"
 #define DEFAULT_USER_BUS_ADDRESS_FMT "unix:path=%s/bus"
 
+/* How many freed message objects to keep around per connection for reuse */
+#define MESSAGE_CACHE_MAX 16
+
+/* How many GetAll() results to remember per connection, see bus_set_property_cache() */
+#define PROPERTY_CACHE_MAX 4096U
+
+typedef uint64_t (*bus_property_generation_t)(sd_bus *bus, const char *path, void *userdata);
+
 struct reply_callback {
         sd_bus_message_handler_t callback;
         usec_t timeout_usec; /* this is a relative timeout until we reach the BUS_HELLO state, and an absolute one right after */
@@ -102,6 +110,15 @@ struct node_vtable {
         const sd_bus_vtable *vtable;
         sd_bus_object_find_t find;
 
+        /* The methods and properties of the vtable, as indexed in bus->vtable_methods and
+         * bus->vtable_properties, allocated in one go at registration time */
+        struct vtable_member *members;
+        size_t n_members;
+
+        /* The interface's introspection data, rendered on first use. vtables are static, hence this never
+         * needs to be regenerated. */
+        char *introspection;
+
         LIST_FIELDS(struct node_vtable, vtables);
 };
 
@@ -190,6 +207,7 @@ struct sd_bus {
         int message_endian;
 
         bool can_fds:1;
+        bool can_memfd:1;
         bool bus_client:1;
         bool ucred_valid:1;
         bool is_server:1;
@@ -211,6 +229,7 @@ struct sd_bus {
         bool watch_bind:1;
         bool is_monitor:1;
         bool accept_fd:1;
+        bool accept_memfd:1;
         bool attach_timestamp:1;
         bool connected_signal:1;
         bool close_on_exit:1;
@@ -242,6 +261,16 @@ struct sd_bus {
         Hashmap *vtable_methods;
         Hashmap *vtable_properties;
 
+        /* Cached values of the properties that are announced with PropertiesChanged, per object and vtable,
+         * along with the generation of the object they were retrieved for */
+        bus_property_generation_t property_generation;
+        void *property_generation_userdata;
+        Hashmap *property_cache;
+
+        /* Allocated once statistics are enabled, and kept until the connection is freed, since messages
+         * point into it */
+        struct BusStatistics *statistics;
+
         union sockaddr_union sockaddr;
         socklen_t sockaddr_size;
 
@@ -257,7 +286,7 @@ struct sd_bus {
 
         enum bus_auth auth;
         unsigned auth_index;
-        struct iovec auth_iovec[3];
+        struct iovec auth_iovec[4];
         size_t auth_rbegin;
         char *auth_buffer;
         usec_t auth_timeout;
@@ -285,6 +314,11 @@ struct sd_bus {
         struct memfd_cache memfd_cache[MEMFD_CACHE_MAX];
         unsigned n_memfd_cache;
 
+        /* Freed message objects, kept around for reuse. Locked for the same reason as the memfd cache. */
+        pthread_mutex_t message_cache_mutex;
+        sd_bus_message *message_cache[MESSAGE_CACHE_MAX];
+        unsigned n_message_cache;
+
         pid_t original_pid;
         pid_t busexec_pid;
 
@@ -401,6 +435,11 @@ int bus_set_address_user(sd_bus *bus);
 int bus_set_address_system_remote(sd_bus *b, const char *host);
 int bus_set_address_machine(sd_bus *b, bool user, const char *machine);
 
+int bus_negotiate_memfd(sd_bus *bus, bool b);
+
+int bus_set_property_cache(sd_bus *bus, bus_property_generation_t callback, void *userdata);
+void bus_property_cache_flush(sd_bus *bus);
+
 int bus_maybe_reply_error(sd_bus_message *m, int r, sd_bus_error *error);
 
 #define bus_assert_return(expr, r, error)                               \
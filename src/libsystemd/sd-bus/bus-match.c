@@ -52,9 +52,16 @@ static bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
 }
 
 static bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
-        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
-                (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST) ||
-                (t >= BUS_MATCH_ARG_HAS && t <= BUS_MATCH_ARG_HAS_LAST);
+        /* Everything but the sender, for which we do some guesswork regarding well-known names, see
+         * value_node_test() */
+        return t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_ARG_HAS_LAST;
+}
+
+static bool BUS_MATCH_IS_PREFIX(enum bus_match_node_type t) {
+        /* Compares whose values may match a prefix of the tested string too */
+        return t == BUS_MATCH_PATH_NAMESPACE ||
+                (t >= BUS_MATCH_ARG_PATH && t <= BUS_MATCH_ARG_PATH_LAST) ||
+                (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST);
 }
 
 static void bus_match_node_free(struct bus_match_node *node) {
@@ -234,6 +241,94 @@ static bool value_node_same(
         }
 }
 
+static int bus_match_run_prefixes(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                sd_bus_message *m,
+                const char *value) {
+
+        _cleanup_free_ char *buf = NULL;
+        bool simple;
+        size_t n;
+        char c;
+        int r;
+
+        assert(node);
+        assert(BUS_MATCH_IS_PREFIX(node->type));
+        assert(value);
+
+        /* Looks up all hashed values of a path_namespace=, argNpath= or argNnamespace= compare that might
+         * match the specified string. These are the string itself plus all of its prefixes that either end
+         * in a separator, or (for the "simple" pattern checks, see simple_pattern_check()) are followed by
+         * one. This way we need O(number of labels) hash lookups instead of comparing with every single
+         * value. */
+
+        if (node->type == BUS_MATCH_PATH_NAMESPACE) {
+                c = '/';
+                simple = true;
+        } else if (node->type >= BUS_MATCH_ARG_NAMESPACE) {
+                c = '.';
+                simple = true;
+        } else {
+                c = '/';
+                simple = false;
+        }
+
+        n = strlen(value);
+
+        if (!simple && n > 0 && value[n-1] == c) {
+                struct bus_match_node *i;
+
+                /* With argNpath= a value ending in a slash also matches all patterns it is a prefix of,
+                 * which we can't look up by hash. This is rare, hence just try them all. */
+
+                HASHMAP_FOREACH(i, node->compare.children) {
+                        if (!value_node_test(i, node->type, 0, value, NULL, m))
+                                continue;
+
+                        r = bus_match_run(bus, i, m);
+                        if (r != 0)
+                                return r;
+
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
+
+                return 0;
+        }
+
+        buf = strdup(value);
+        if (!buf)
+                return -ENOMEM;
+
+        for (size_t l = 0; l <= n; l++) {
+                struct bus_match_node *found;
+                char saved;
+
+                if (!(l == n ||
+                      (l > 0 && value[l-1] == c) ||
+                      (simple && value[l] == c)))
+                        continue;
+
+                saved = buf[l];
+                buf[l] = 0;
+                found = hashmap_get(node->compare.children, buf);
+                buf[l] = saved;
+
+                if (!found)
+                        continue;
+
+                r = bus_match_run(bus, found, m);
+                if (r != 0)
+                        return r;
+
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
+
+        return 0;
+}
+
 int bus_match_run(
                 sd_bus *bus,
                 struct bus_match_node *node,
@@ -379,7 +474,13 @@ int bus_match_run(
 
                 /* Lookup via hash table, nice! So let's jump directly. */
 
-                if (test_str)
+                if (test_str && BUS_MATCH_IS_PREFIX(node->type)) {
+                        r = bus_match_run_prefixes(bus, node, m, test_str);
+                        if (r != 0)
+                                return r;
+
+                        found = NULL;
+                } else if (test_str)
                         found = hashmap_get(node->compare.children, test_str);
                 else if (test_strv) {
                         STRV_FOREACH(i, test_strv) {
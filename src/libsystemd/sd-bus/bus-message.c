@@ -40,6 +40,130 @@ static void *adjust_pointer(const void *p, void *old_base, size_t sz, void *new_
         return (uint8_t*) new_base + ((uint8_t*) p - (uint8_t*) old_base);
 }
 
+/* Size of the first arena chunk of a message, and how large the chunk of a message may be to be kept when
+ * the message object is put into the cache for reuse */
+#define ARENA_CHUNK_MIN 1024U
+#define ARENA_CHUNK_KEEP_MAX (4U * ARENA_CHUNK_MIN)
+
+/* Each arena allocation is preceded by its (aligned) size, so that allocations can be returned in LIFO order */
+#define ARENA_HEADER_SIZE ALIGN8(sizeof(size_t))
+
+static void *message_arena_alloc0(sd_bus_message *m, size_t size) {
+        struct bus_arena *a;
+        size_t need;
+        uint8_t *p;
+
+        assert(m);
+
+        size = ALIGN8(size);
+        need = ARENA_HEADER_SIZE + size;
+
+        a = m->arena;
+        if (!a || a->allocated - a->used < need) {
+                size_t sz;
+
+                sz = MAX3((size_t) ARENA_CHUNK_MIN, need, a ? a->allocated * 2 : 0);
+
+                a = malloc(offsetof(struct bus_arena, data) + sz);
+                if (!a)
+                        return NULL;
+
+                a->allocated = sz;
+                a->used = 0;
+                a->next = m->arena;
+                m->arena = a;
+        }
+
+        p = a->data + a->used;
+        *(size_t*) p = size;
+        a->used += need;
+
+        return memset(p + ARENA_HEADER_SIZE, 0, size);
+}
+
+static char *message_arena_strndup(sd_bus_message *m, const char *s, size_t n) {
+        char *p;
+
+        assert(m);
+        assert(s);
+
+        n = strnlen(s, n);
+
+        p = message_arena_alloc0(m, n + 1);
+        if (!p)
+                return NULL;
+
+        return memcpy(p, s, n);
+}
+
+static void message_arena_free(sd_bus_message *m, void *p) {
+        assert(m);
+
+        if (!p)
+                return;
+
+        /* Memory taken from the arena is released in one go when the message is freed. Only the most
+         * recent allocation of the current chunk is returned right away, which is what happens when
+         * entering and exiting containers while reading. Anything else is regular heap memory. */
+
+        for (struct bus_arena *a = m->arena; a; a = a->next) {
+                uint8_t *h;
+
+                if ((uint8_t*) p < a->data || (uint8_t*) p >= a->data + a->used)
+                        continue;
+
+                h = (uint8_t*) p - ARENA_HEADER_SIZE;
+                if (a == m->arena && (uint8_t*) p + *(size_t*) h == a->data + a->used)
+                        a->used = h - a->data;
+
+                return;
+        }
+
+        free(p);
+}
+
+static int message_arena_free_and_strndup(sd_bus_message *m, char **p, const char *s, size_t l) {
+        assert(m);
+        assert(p);
+        assert(s);
+
+        if (*p && strneq(*p, s, l) && (*p)[l] == 0)
+                return 0;
+
+        message_arena_free(m, *p);
+
+        *p = message_arena_strndup(m, s, l);
+        if (!*p)
+                return -ENOMEM;
+
+        return 1;
+}
+
+static void message_arena_reset(sd_bus_message *m, bool keep) {
+        struct bus_arena *a;
+
+        assert(m);
+
+        a = m->arena;
+        m->arena = NULL;
+
+        /* Optionally keep the most recent chunk around, if it isn't too large */
+        if (keep && a && a->allocated <= ARENA_CHUNK_KEEP_MAX) {
+                m->arena = a;
+                a = a->next;
+
+                m->arena->next = NULL;
+                m->arena->used = 0;
+        }
+
+        while (a) {
+                struct bus_arena *next = a->next;
+
+                free(a);
+                a = next;
+        }
+}
+
 static void message_free_part(sd_bus_message *m, struct bus_body_part *part) {
         assert(m);
         assert(part);
@@ -64,7 +188,7 @@ static void message_free_part(sd_bus_message *m, struct bus_body_part *part) {
         }
 
         if (part != &m->body)
-                free(part);
+                message_arena_free(m, part);
 }
 
 static void message_reset_parts(sd_bus_message *m) {
@@ -101,8 +225,9 @@ static void message_free_last_container(sd_bus_message *m) {
 
         c = message_get_last_container(m);
 
-        free(c->signature);
-        free(c->peeked_signature);
+        /* Free in reverse order of allocation, so that this can be undone in the arena */
+        message_arena_free(m, c->peeked_signature);
+        message_arena_free(m, c->signature);
 
         /* Move to previous container, but not if we are on root container */
         if (m->n_containers > 0)
@@ -119,7 +244,76 @@ static void message_reset_containers(sd_bus_message *m) {
         m->root_container.index = 0;
 }
 
-static sd_bus_message* message_free(sd_bus_message *m) {
+static sd_bus_message *message_alloc(sd_bus *bus, size_t extra) {
+        sd_bus_message *m = NULL;
+        struct bus_arena *a;
+
+        /* Message objects with space for a header (or something of the same size) are reused if we can, so
+         * that sending and receiving messages doesn't require allocating a new one every time. */
+
+        if (extra > sizeof(struct bus_header))
+                return malloc0(ALIGN(sizeof(sd_bus_message)) + extra);
+
+        if (bus) {
+                assert_se(pthread_mutex_lock(&bus->message_cache_mutex) == 0);
+                if (bus->n_message_cache > 0)
+                        m = bus->message_cache[--bus->n_message_cache];
+                assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) == 0);
+        }
+
+        if (m) {
+                a = m->arena;
+                memzero(m, ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+                m->arena = a;
+        } else {
+                m = malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+                if (!m)
+                        return NULL;
+        }
+
+        m->recyclable = true;
+        return m;
+}
+
+static sd_bus_message* message_discard(sd_bus_message *m) {
+        if (!m)
+                return NULL;
+
+        /* Frees a message object that was allocated but never set up */
+        message_arena_reset(m, false);
+        return mfree(m);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(sd_bus_message*, message_discard);
+
+static bool message_cache_put(sd_bus *bus, sd_bus_message *m) {
+        bool b = false;
+
+        assert(bus);
+        assert(m);
+
+        message_arena_reset(m, true);
+
+        assert_se(pthread_mutex_lock(&bus->message_cache_mutex) == 0);
+        if (bus->n_message_cache < MESSAGE_CACHE_MAX) {
+                bus->message_cache[bus->n_message_cache++] = m;
+                b = true;
+        }
+        assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) == 0);
+
+        return b;
+}
+
+void bus_flush_message_cache(sd_bus *bus) {
+        assert(bus);
+
+        for (unsigned i = 0; i < bus->n_message_cache; i++)
+                message_discard(bus->message_cache[i]);
+
+        bus->n_message_cache = 0;
+}
+
+static sd_bus_message* message_free(sd_bus_message *m, sd_bus *bus) {
         assert(m);
 
         message_reset_parts(m);
@@ -143,7 +337,12 @@ static sd_bus_message* message_free(sd_bus_message *m) {
         message_free_last_container(m);
 
         bus_creds_done(&m->creds);
-        return mfree(m);
+
+        /* If the connection is still around, let's keep the object for reuse */
+        if (bus && m->recyclable && message_cache_put(bus, m))
+                return NULL;
+
+        return message_discard(m);
 }
 
 static void *message_extend_fields(sd_bus_message *m, size_t sz, bool add_offset) {
@@ -319,6 +518,70 @@ static int message_append_field_uint32(sd_bus_message *m, uint64_t h, uint32_t x
         return 0;
 }
 
+static int message_append_field_memfds(sd_bus_message *m, const uint64_t *v, size_t n) {
+        uint8_t *p;
+
+        assert(m);
+        assert(v);
+        assert(n > 0);
+
+        /* (field id byte + (signature length + signature 'at' + NUL) + padding + array length + padding +
+         * values) */
+        p = message_extend_fields(m, 16 + n * 8, false);
+        if (!p)
+                return -ENOMEM;
+
+        memzero(p, 16);
+        p[0] = BUS_MESSAGE_HEADER_MEMFDS;
+        p[1] = 2;
+        p[2] = 'a';
+        p[3] = 't';
+
+        ((uint32_t*) p)[2] = n * 8;
+        memcpy(p + 16, v, n * 8);
+
+        return 0;
+}
+
+static int message_pass_memfds(sd_bus_message *m) {
+        _cleanup_free_ uint64_t *v = NULL;
+        struct bus_body_part *part;
+        size_t n = 0, offset = 0, sum = 0;
+        unsigned i;
+
+        assert(m);
+
+        /* If the peer agreed to it, pass large sealed memfd body parts as fds instead of copying them
+         * through the socket. */
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+                if (part->memfd >= 0 &&
+                    part->sealed &&
+                    part->memfd_offset == 0 &&
+                    part->size >= MEMFD_MIN_SIZE &&
+                    m->n_fds + n / 2 < BUS_FDS_MAX) {
+
+                        if (!GREEDY_REALLOC(v, n + 2))
+                                return -ENOMEM;
+
+                        v[n++] = offset;
+                        v[n++] = part->size;
+                        sum += part->size;
+                        part->passed_as_fd = true;
+                }
+
+                offset += part->size;
+        }
+
+        if (n == 0)
+                return 0;
+
+        m->n_passed_memfds = n / 2;
+        m->passed_memfd_size = sum;
+
+        return message_append_field_memfds(m, v, n);
+}
+
 static int message_append_reply_cookie(sd_bus_message *m, uint64_t cookie) {
         assert(m);
 
@@ -338,9 +601,9 @@ static int message_from_header(
                 const char *label,
                 sd_bus_message **ret) {
 
-        _cleanup_free_ sd_bus_message *m = NULL;
+        _cleanup_(message_discardp) sd_bus_message *m = NULL;
         struct bus_header *h;
-        size_t a, label_sz = 0; /* avoid false maybe-uninitialized warning */
+        size_t a = 0, label_sz = 0; /* avoid false maybe-uninitialized warning */
 
         assert(bus);
         assert(buffer || message_size <= 0);
@@ -362,14 +625,12 @@ static int message_from_header(
 
         /* Note that we are happy with unknown flags in the flags header! */
 
-        a = ALIGN(sizeof(sd_bus_message));
-
         if (label) {
                 label_sz = strlen(label);
-                a += label_sz + 1;
+                a = label_sz + 1;
         }
 
-        m = malloc0(a);
+        m = message_alloc(bus, a);
         if (!m)
                 return -ENOMEM;
 
@@ -418,6 +679,11 @@ int bus_message_from_malloc(
         size_t sz;
         int r;
 
+        /* The fds array contains the file descriptors received so far that haven't been assigned to a
+         * message yet, in the order they were received. The message takes possession of as many of them
+         * as its UNIX_FDS header field asks for, from the front of the array, and returns that number. The
+         * array itself stays owned by the caller, who should drop the consumed entries from it. */
+
         r = message_from_header(
                         bus,
                         buffer, length,
@@ -444,12 +710,22 @@ int bus_message_from_malloc(
         if (r < 0)
                 return r;
 
-        /* We take possession of the memory and fds now */
+        if (m->n_fds > 0) {
+                m->fds = newdup(int, fds, m->n_fds);
+                if (!m->fds)
+                        return -ENOMEM;
+        } else
+                m->fds = NULL;
+
+        /* We take possession of the memory and fds now. The body parts passed as memfds hold copies of
+         * their fds, hence close the originals. */
         m->free_header = true;
         m->free_fds = true;
+        close_many(fds + m->n_fds, m->n_passed_memfds);
 
+        r = (int) (m->n_fds + m->n_passed_memfds);
         *ret = TAKE_PTR(m);
-        return 0;
+        return r;
 }
 
 _public_ int sd_bus_message_new(
@@ -464,7 +740,7 @@ _public_ int sd_bus_message_new(
         /* Creation of messages with _SD_BUS_MESSAGE_TYPE_INVALID is allowed. */
         assert_return(type < _SD_BUS_MESSAGE_TYPE_MAX, -EINVAL);
 
-        sd_bus_message *t = malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+        sd_bus_message *t = message_alloc(bus, sizeof(struct bus_header));
         if (!t)
                 return -ENOMEM;
 
@@ -611,6 +887,8 @@ static int message_new_reply(
 
         t->dont_send = !!(call->header->flags & BUS_MESSAGE_NO_REPLY_EXPECTED);
         t->enforced_reply_signature = call->enforced_reply_signature;
+        t->dispatched_usec = call->dispatched_usec;
+        t->member_statistics = call->member_statistics;
 
         /* let's copy the sensitive flag over. Let's do that as a safety precaution to keep a transaction
          * wholly sensitive if already the incoming message was sensitive. This is particularly useful when a
@@ -802,6 +1080,20 @@ _public_ sd_bus_message* sd_bus_message_unref(sd_bus_message *m) {
 
         assert(m->n_ref > 0);
 
+        if (m->n_ref == 1 && m->n_queued == 0) {
+                sd_bus *bus;
+
+                /* This is the last reference and the message is not queued anywhere, hence nothing else
+                 * can get to it. Free it while we still pin the bus connection, so that the object can be
+                 * put into the connection's cache, and only drop the reference on the bus afterwards. */
+                bus = TAKE_PTR(m->bus);
+                m->n_ref = 0;
+
+                message_free(m, bus);
+                sd_bus_unref(bus);
+                return NULL;
+        }
+
         sd_bus_unref(m->bus); /* Each regular ref is also a ref on the bus connection. Let's hence drop it
                                * here. Note we have to do this before decrementing our own n_ref here, since
                                * otherwise, if this message is currently queued sd_bus_unref() might call
@@ -817,7 +1109,7 @@ _public_ sd_bus_message* sd_bus_message_unref(sd_bus_message *m) {
          * multiple references to the bus, once for each reference kept on ourselves. */
         m->bus = NULL;
 
-        return message_free(m);
+        return message_free(m, NULL);
 }
 
 sd_bus_message* bus_message_ref_queued(sd_bus_message *m, sd_bus *bus) {
@@ -852,7 +1144,7 @@ sd_bus_message* bus_message_unref_queued(sd_bus_message *m, sd_bus *bus) {
 
         m->bus = NULL;
 
-        return message_free(m);
+        return message_free(m, bus);
 }
 
 _public_ int sd_bus_message_get_type(sd_bus_message *m, uint8_t *type) {
@@ -1081,7 +1373,7 @@ static struct bus_body_part *message_append_part(sd_bus_message *m) {
         } else {
                 assert(m->body_end);
 
-                part = new0(struct bus_body_part, 1);
+                part = message_arena_alloc0(m, sizeof(struct bus_body_part));
                 if (!part) {
                         m->poisoned = true;
                         return NULL;
@@ -2340,7 +2632,7 @@ static int bus_message_close_header(sd_bus_message *m) {
         m->user_body_size = m->body_size;
 
         m->header->fields_size = m->fields_size;
-        m->header->body_size = m->body_size;
+        m->header->body_size = m->body_size - m->passed_memfd_size;
 
         return 0;
 }
@@ -2385,6 +2677,12 @@ _public_ int sd_bus_message_seal(sd_bus_message *m, uint64_t cookie, uint64_t ti
                         return r;
         }
 
+        if (m->bus && m->bus->can_memfd) {
+                r = message_pass_memfds(m);
+                if (r < 0)
+                        return r;
+        }
+
         r = bus_message_close_header(m);
         if (r < 0)
                 return r;
@@ -3007,7 +3305,7 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
                                             const char *contents) {
         struct bus_container *c;
         uint32_t *array_size = NULL;
-        _cleanup_free_ char *signature = NULL;
+        char *signature;
         size_t before;
         int r;
 
@@ -3064,7 +3362,7 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
 
         c = message_get_last_container(m);
 
-        signature = strdup(contents);
+        signature = message_arena_strndup(m, contents, SIZE_MAX);
         if (!signature)
                 return -ENOMEM;
 
@@ -3081,13 +3379,15 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
                 r = bus_message_enter_dict_entry(m, c, contents);
         else
                 r = -EINVAL;
-        if (r <= 0)
+        if (r <= 0) {
+                message_arena_free(m, signature);
                 return r;
+        }
 
         /* OK, let's fill it in */
         m->containers[m->n_containers++] = (struct bus_container) {
                  .enclosing = type,
-                 .signature = TAKE_PTR(signature),
+                 .signature = signature,
 
                  .before = before,
                  .begin = m->rindex,
@@ -3182,8 +3482,8 @@ _public_ int sd_bus_message_peek_type(sd_bus_message *m, char *type, const char
 
                         /* The array element must not be empty */
                         assert(l >= 1);
-                        if (free_and_strndup(&c->peeked_signature,
-                                             c->signature + c->index + 1, l) < 0)
+                        if (message_arena_free_and_strndup(m, &c->peeked_signature,
+                                                           c->signature + c->index + 1, l) < 0)
                                 return -ENOMEM;
 
                         *contents = c->peeked_signature;
@@ -3205,8 +3505,8 @@ _public_ int sd_bus_message_peek_type(sd_bus_message *m, char *type, const char
                                 return r;
 
                         assert(l >= 3);
-                        if (free_and_strndup(&c->peeked_signature,
-                                             c->signature + c->index + 1, l - 2) < 0)
+                        if (message_arena_free_and_strndup(m, &c->peeked_signature,
+                                                           c->signature + c->index + 1, l - 2) < 0)
                                 return -ENOMEM;
 
                         *contents = c->peeked_signature;
@@ -3985,8 +4285,106 @@ static int message_skip_fields(
         }
 }
 
+static int message_setup_passed_memfds(sd_bus_message *m, const uint64_t *v, size_t n, const int *fds) {
+        struct bus_body_part *part;
+        uint8_t *inline_data;
+        size_t inline_size, inline_index = 0, index = 0;
+        int r;
+
+        assert(m);
+        assert(v);
+        assert(n > 0);
+        assert(fds);
+
+        /* Splits up the inline body we received into the parts between the (offset, size) ranges in v, and
+         * inserts the memfds we got passed for the latter. The fds are duplicated, so that on failure the
+         * caller still owns the originals. */
+
+        inline_data = m->n_body_parts > 0 ? m->body.data : NULL;
+        inline_size = m->n_body_parts > 0 ? m->body.size : 0;
+
+        m->n_body_parts = 0;
+        m->body_end = NULL;
+
+        for (size_t i = 0; i <= n; i++) {
+                uint64_t offset, size, memfd_size;
+                size_t k;
+
+                if (i < n) {
+                        offset = BUS_MESSAGE_BSWAP64(m, v[i*2]);
+                        size = BUS_MESSAGE_BSWAP64(m, v[i*2+1]);
+                } else {
+                        /* Everything that is left of the inline data */
+                        offset = index + inline_size - inline_index;
+                        size = 0;
+                }
+
+                if (offset < index || size > BUS_MESSAGE_SIZE_MAX || offset > BUS_MESSAGE_SIZE_MAX)
+                        return -EBADMSG;
+
+                k = offset - index;
+                if (k > inline_size - inline_index)
+                        return -EBADMSG;
+                if (k > 0) {
+                        part = message_append_part(m);
+                        if (!part)
+                                return -ENOMEM;
+
+                        part->data = inline_data + inline_index;
+                        part->size = k;
+                        part->sealed = true;
+
+                        inline_index += k;
+                        index += k;
+                }
+
+                if (i == n)
+                        break;
+
+                if (size == 0)
+                        return -EBADMSG;
+
+                /* Only accept memfds which can't be modified anymore, as we are going to validate the
+                 * data only once */
+                r = memfd_get_sealed(fds[i]);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -EBADMSG;
+
+                r = memfd_get_size(fds[i], &memfd_size);
+                if (r < 0)
+                        return r;
+                if (memfd_size < size)
+                        return -EBADMSG;
+
+                part = message_append_part(m);
+                if (!part)
+                        return -ENOMEM;
+
+                part->memfd = fcntl(fds[i], F_DUPFD_CLOEXEC, 3);
+                if (part->memfd < 0)
+                        return -errno;
+
+                part->size = size;
+                part->sealed = true;
+                part->passed_as_fd = true;
+
+                index += size;
+                m->passed_memfd_size += size;
+                m->n_passed_memfds++;
+        }
+
+        if (index > BUS_MESSAGE_SIZE_MAX)
+                return -EBADMSG;
+
+        m->body_size = m->user_body_size = index;
+        return 0;
+}
+
 static int message_parse_fields(sd_bus_message *m) {
-        uint32_t unix_fds = 0;
+        const uint64_t *memfds = NULL;
+        uint32_t unix_fds = 0, n_memfds = 0;
         bool unix_fds_set = false;
         int r;
 
@@ -4147,6 +4545,38 @@ static int message_parse_fields(sd_bus_message *m) {
                         unix_fds_set = true;
                         break;
 
+                case BUS_MESSAGE_HEADER_MEMFDS: {
+                        uint32_t l;
+
+                        /* An extension that needs to be negotiated first, treat it like any unknown
+                         * field otherwise */
+                        if (!m->bus || !m->bus->can_memfd) {
+                                r = message_skip_fields(m, &ri, UINT32_MAX, (const char **) &signature);
+                                break;
+                        }
+
+                        if (memfds)
+                                return -EBADMSG;
+
+                        if (!streq(signature, "at"))
+                                return -EBADMSG;
+
+                        r = message_peek_field_uint32(m, &ri, 4, &l);
+                        if (r < 0)
+                                return -EBADMSG;
+
+                        /* Pairs of uint64_t, at least one */
+                        if (l == 0 || l % 16 != 0 || l / 16 > BUS_FDS_MAX)
+                                return -EBADMSG;
+
+                        r = message_peek_fields(m, &ri, 8, l, (void**) &memfds);
+                        if (r < 0)
+                                return -EBADMSG;
+
+                        n_memfds = l / 16;
+                        break;
+                }
+
                 default:
                         r = message_skip_fields(m, &ri, UINT32_MAX, (const char **) &signature);
                 }
@@ -4154,9 +4584,19 @@ static int message_parse_fields(sd_bus_message *m) {
                         return r;
         }
 
-        if (m->n_fds != unix_fds)
+        /* We might have been passed more fds than the message needs, in which case the rest belongs to
+         * messages following this one. */
+        if (unix_fds + n_memfds > m->n_fds)
                 return -EBADMSG;
 
+        if (memfds) {
+                r = message_setup_passed_memfds(m, memfds, n_memfds, m->fds + unix_fds);
+                if (r < 0)
+                        return r;
+        }
+
+        m->n_fds = unix_fds;
+
         switch (m->header->type) {
 
         case SD_BUS_MESSAGE_SIGNAL:
@@ -4246,7 +4686,8 @@ int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz) {
 
         e = mempcpy(p, m->header, BUS_MESSAGE_BODY_BEGIN(m));
         MESSAGE_FOREACH_PART(part, i, m)
-                e = mempcpy(e, part->data, part->size);
+                if (!part->passed_as_fd)
+                        e = mempcpy(e, part->data, part->size);
 
         assert(total == (size_t) ((uint8_t*) e - (uint8_t*) p));
 
@@ -4256,6 +4697,73 @@ int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz) {
         return 0;
 }
 
+int bus_message_copy_body_range(sd_bus_message *m, size_t start, size_t sz, void *dst) {
+        struct bus_body_part *part;
+        size_t offset = 0, i;
+        uint8_t *e = dst;
+
+        assert(m);
+        assert(dst || sz == 0);
+
+        /* Copies a part of the body written so far out of the message, regardless how it is split up into
+         * parts */
+
+        if (start > m->body_size || sz > m->body_size - start)
+                return -ERANGE;
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+                size_t a, b;
+
+                if (sz == 0)
+                        break;
+
+                if (offset + part->size > start) {
+                        a = start - offset;
+                        b = MIN(part->size - a, sz);
+
+                        e = mempcpy(e, (const uint8_t*) part->data + a, b);
+                        start += b;
+                        sz -= b;
+                }
+
+                offset += part->size;
+        }
+
+        assert(sz == 0);
+        return 0;
+}
+
+int bus_message_append_raw_array_elements(sd_bus_message *m, const void *p, size_t sz) {
+        struct bus_container *c;
+        void *a;
+
+        assert(m);
+        assert(p || sz == 0);
+
+        /* Appends complete array elements that were marshalled before by some other message, e.g. as
+         * extracted with bus_message_copy_body_range(). This is only safe if they were written at an offset
+         * with the same alignment, and if they do not refer to any fds. We only allow this for arrays whose
+         * elements start at an 8 byte boundary, i.e. arrays of dict entries or structs. */
+
+        if (m->sealed)
+                return -EPERM;
+
+        c = message_get_last_container(m);
+        if (c->enclosing != SD_BUS_TYPE_ARRAY ||
+            !IN_SET(c->signature[0], SD_BUS_TYPE_DICT_ENTRY_BEGIN, SD_BUS_TYPE_STRUCT_BEGIN))
+                return -ENXIO;
+
+        if (sz == 0)
+                return 0;
+
+        a = message_extend_body(m, 8, sz);
+        if (!a)
+                return -ENOMEM;
+
+        memcpy(a, p, sz);
+        return 0;
+}
+
 _public_ int sd_bus_message_read_strv_extend(sd_bus_message *m, char ***l) {
         char type;
         const char *contents, *s;
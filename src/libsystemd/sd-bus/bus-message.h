@@ -27,6 +27,16 @@ struct bus_container {
         char *peeked_signature;
 };
 
+/* Small allocations made on behalf of a message (descriptors of additional body parts, signatures of the
+ * containers entered while reading) are carved out of a chain of chunks, which is released in one go when
+ * the message is freed. */
+struct bus_arena {
+        struct bus_arena *next;
+        size_t allocated;
+        size_t used;
+        _alignas_(max_align_t) uint8_t data[];
+};
+
 struct bus_body_part {
         struct bus_body_part *next;
         void *data;
@@ -40,6 +50,7 @@ struct bus_body_part {
         bool munmap_this:1;
         bool sealed:1;
         bool is_zero:1;
+        bool passed_as_fd:1; /* memfd is passed as fd rather than copied inline, see BUS_MESSAGE_HEADER_MEMFDS */
 };
 
 struct sd_bus_message {
@@ -71,6 +82,12 @@ struct sd_bus_message {
         usec_t monotonic;
         usec_t realtime;
         uint64_t seqnum;
+
+        /* For bus statistics: when the message was put into the read queue, and, for method calls and
+         * their replies, when the call was first dispatched and what member it was for */
+        usec_t queued_usec;
+        usec_t dispatched_usec;
+        struct BusMemberStatistics *member_statistics;
         uint64_t verify_destination_id;
 
         bool sealed:1;
@@ -80,6 +97,7 @@ struct sd_bus_message {
         bool free_fds:1;
         bool poisoned:1;
         bool sensitive:1;
+        bool recyclable:1;
 
         /* The first bytes of the message */
         struct bus_header *header;
@@ -99,6 +117,10 @@ struct sd_bus_message {
         uint32_t n_fds;
         int *fds;
 
+        /* Body parts passed as memfds, these are not included in n_fds */
+        unsigned n_passed_memfds;
+        size_t passed_memfd_size;
+
         struct bus_container root_container, *containers;
         size_t n_containers;
 
@@ -119,6 +141,8 @@ struct sd_bus_message {
         unsigned n_header_offsets;
 
         uint64_t read_counter;
+
+        struct bus_arena *arena;
 };
 
 static inline bool BUS_MESSAGE_NEED_BSWAP(sd_bus_message *m) {
@@ -141,11 +165,13 @@ static inline uint64_t BUS_MESSAGE_COOKIE(sd_bus_message *m) {
         return BUS_MESSAGE_BSWAP32(m, m->header->serial);
 }
 
+/* The number of bytes of the message that are transferred over the socket */
 static inline size_t BUS_MESSAGE_SIZE(sd_bus_message *m) {
         return
                 sizeof(struct bus_header) +
                 ALIGN8(m->fields_size) +
-                m->body_size;
+                m->body_size -
+                m->passed_memfd_size;
 }
 
 static inline size_t BUS_MESSAGE_BODY_BEGIN(sd_bus_message *m) {
@@ -159,6 +185,8 @@ static inline void* BUS_MESSAGE_FIELDS(sd_bus_message *m) {
 }
 
 int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz);
+int bus_message_copy_body_range(sd_bus_message *m, size_t start, size_t sz, void *dst);
+int bus_message_append_raw_array_elements(sd_bus_message *m, const void *p, size_t sz);
 
 int bus_message_from_malloc(
                 sd_bus *bus,
@@ -187,3 +215,5 @@ void bus_message_set_sender_local(sd_bus *bus, sd_bus_message *m);
 
 sd_bus_message* bus_message_ref_queued(sd_bus_message *m, sd_bus *bus);
 sd_bus_message* bus_message_unref_queued(sd_bus_message *m, sd_bus *bus);
+
+void bus_flush_message_cache(sd_bus *bus);
@@ -8,6 +8,7 @@
 #include "bus-signature.h"
 #include "bus-slot.h"
 #include "bus-type.h"
+#include "hashmap.h"
 #include "missing_capability.h"
 #include "string-util.h"
 #include "strv.h"
@@ -744,6 +745,31 @@ static int vtable_append_one_property(
         return 0;
 }
 
+static bool vtable_property_in_dump(sd_bus_message *reply, const sd_bus_vtable *v) {
+        assert(reply);
+        assert(v);
+
+        if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                return false;
+
+        if (v->flags & SD_BUS_VTABLE_HIDDEN)
+                return false;
+
+        /* Let's not include properties marked as "explicit" in any message that contains a generic dump of
+         * properties, but only in those generated as a response to an explicit request. */
+        if (v->flags & SD_BUS_VTABLE_PROPERTY_EXPLICIT)
+                return false;
+
+        /* Let's not include properties marked only for invalidation on change (i.e. in contrast to those
+         * whose new values are included in PropertiesChanges message) in any signals. This is useful to
+         * ensure they aren't included in InterfacesAdded messages. */
+        if (reply->header->type != SD_BUS_MESSAGE_METHOD_RETURN &&
+            FLAGS_SET(v->flags, SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION))
+                return false;
+
+        return true;
+}
+
 static int vtable_append_all_properties(
                 sd_bus *bus,
                 sd_bus_message *reply,
@@ -765,34 +791,269 @@ static int vtable_append_all_properties(
 
         v = c->vtable;
         for (v = bus_vtable_next(c->vtable, v); v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(c->vtable, v)) {
-                if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                if (!vtable_property_in_dump(reply, v))
                         continue;
 
-                if (v->flags & SD_BUS_VTABLE_HIDDEN)
-                        continue;
+                r = vtable_append_one_property(bus, reply, path, c, v, userdata, error);
+                if (r < 0)
+                        return r;
+                if (bus->nodes_modified)
+                        return 0;
+        }
+
+        return 1;
+}
+
+struct property_cache_entry {
+        char *path;
+        const struct node_vtable *vtable;
+        uint64_t generation;
+
+        /* The marshalled dict entries of the cacheable properties, in vtable order. The properties that are
+         * not cacheable split them up into runs, with the uncacheable ones retrieved anew every time in
+         * between, so that the order of the reply is always the same. */
+        size_t *runs;
+        size_t n_runs;
+        uint8_t *data;
+};
+
+static struct property_cache_entry* property_cache_entry_free(struct property_cache_entry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->path);
+        free(e->runs);
+        free(e->data);
+
+        return mfree(e);
+}
+
+static void property_cache_entry_hash_func(const struct property_cache_entry *e, struct siphash *state) {
+        assert(e);
+
+        string_hash_func(e->path, state);
+        siphash24_compress(&e->vtable, sizeof(e->vtable), state);
+}
+
+static int property_cache_entry_compare_func(const struct property_cache_entry *x, const struct property_cache_entry *y) {
+        int r;
+
+        assert(x);
+        assert(y);
+
+        r = strcmp(x->path, y->path);
+        if (r != 0)
+                return r;
 
-                /* Let's not include properties marked as "explicit" in any message that contains a generic
-                 * dump of properties, but only in those generated as a response to an explicit request. */
-                if (v->flags & SD_BUS_VTABLE_PROPERTY_EXPLICIT)
+        return CMP(x->vtable, y->vtable);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct property_cache_entry*, property_cache_entry_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(property_cache_entry_hash_ops, struct property_cache_entry,
+                                            property_cache_entry_hash_func, property_cache_entry_compare_func,
+                                            property_cache_entry_free);
+
+static bool property_is_cacheable(const sd_bus_vtable *v) {
+        assert(v);
+
+        /* Only properties that are announced when they change can be cached: whoever installed the cache
+         * promises to bump the generation of the object whenever it does that. */
+        return (v->flags & (SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION)) &&
+                !strchr(v->x.property.signature, SD_BUS_TYPE_UNIX_FD);
+}
+
+static int property_cache_take_run(
+                sd_bus_message *reply,
+                size_t start,
+                size_t **runs,
+                size_t *n_runs,
+                uint8_t **data,
+                size_t *size) {
+
+        size_t sz;
+        int r;
+
+        sz = reply->body_size > start ? reply->body_size - start : 0;
+
+        if (!GREEDY_REALLOC(*runs, *n_runs + 1))
+                return -ENOMEM;
+
+        if (sz > 0) {
+                if (!GREEDY_REALLOC(*data, *size + sz))
+                        return -ENOMEM;
+
+                r = bus_message_copy_body_range(reply, start, sz, *data + *size);
+                if (r < 0)
+                        return r;
+
+                *size += sz;
+        }
+
+        (*runs)[(*n_runs)++] = sz;
+        return 0;
+}
+
+static int vtable_append_cached_properties(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *path,
+                struct node_vtable *c,
+                void *userdata,
+                const struct property_cache_entry *e,
+                sd_bus_error *error) {
+
+        const sd_bus_vtable *v;
+        size_t k = 0, offset = 0;
+        int r;
+
+        v = c->vtable;
+        for (v = bus_vtable_next(c->vtable, v); v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(c->vtable, v)) {
+                if (!vtable_property_in_dump(reply, v) || property_is_cacheable(v))
                         continue;
 
-                /* Let's not include properties marked only for invalidation on change (i.e. in contrast to
-                 * those whose new values are included in PropertiesChanges message) in any signals. This is
-                 * useful to ensure they aren't included in InterfacesAdded messages. */
-                if (reply->header->type != SD_BUS_MESSAGE_METHOD_RETURN &&
-                    FLAGS_SET(v->flags, SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION))
+                assert(k < e->n_runs);
+                r = bus_message_append_raw_array_elements(reply, e->data + offset, e->runs[k]);
+                if (r < 0)
+                        return r;
+                offset += e->runs[k++];
+
+                r = vtable_append_one_property(bus, reply, path, c, v, userdata, error);
+                if (r < 0)
+                        return r;
+                if (bus->nodes_modified)
+                        return 0;
+        }
+
+        assert(k + 1 == e->n_runs);
+        r = bus_message_append_raw_array_elements(reply, e->data + offset, e->runs[k]);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int vtable_append_all_properties_cached(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *path,
+                struct node_vtable *c,
+                void *userdata,
+                sd_bus_error *error) {
+
+        _cleanup_free_ size_t *runs = NULL;
+        _cleanup_free_ uint8_t *data = NULL;
+        struct property_cache_entry *e;
+        size_t n_runs = 0, size = 0, start;
+        const sd_bus_vtable *v;
+        uint64_t generation;
+        unsigned n_fds;
+        bool cacheable = true;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(path);
+        assert(c);
+
+        if (!bus->property_generation || (c->vtable[0].flags & SD_BUS_VTABLE_HIDDEN))
+                return vtable_append_all_properties(bus, reply, path, c, userdata, error);
+
+        generation = bus->property_generation(bus, path, bus->property_generation_userdata);
+        if (generation == 0)
+                return vtable_append_all_properties(bus, reply, path, c, userdata, error);
+
+        e = hashmap_get(bus->property_cache, &(struct property_cache_entry) { .path = (char*) path, .vtable = c });
+        if (e && e->generation == generation)
+                return vtable_append_cached_properties(bus, reply, path, c, userdata, e, error);
+
+        /* Not cached yet, or outdated. Let's append everything the usual way, and copy out what we may
+         * reuse next time. */
+
+        n_fds = reply->n_fds;
+        start = ALIGN_TO(reply->body_size, 8);
+
+        v = c->vtable;
+        for (v = bus_vtable_next(c->vtable, v); v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(c->vtable, v)) {
+                if (!vtable_property_in_dump(reply, v))
                         continue;
 
+                if (!property_is_cacheable(v) && cacheable &&
+                    property_cache_take_run(reply, start, &runs, &n_runs, &data, &size) < 0)
+                        cacheable = false;
+
                 r = vtable_append_one_property(bus, reply, path, c, v, userdata, error);
                 if (r < 0)
                         return r;
                 if (bus->nodes_modified)
                         return 0;
+
+                if (!property_is_cacheable(v))
+                        start = ALIGN_TO(reply->body_size, 8);
+        }
+
+        if (cacheable &&
+            property_cache_take_run(reply, start, &runs, &n_runs, &data, &size) < 0)
+                cacheable = false;
+
+        /* fds are referenced by index, the marshalled data hence cannot be reused in another message */
+        if (!cacheable || reply->n_fds != n_fds)
+                return 1;
+
+        if (!e) {
+                _cleanup_(property_cache_entry_freep) struct property_cache_entry *n = NULL;
+
+                /* Make room, but don't bother finding out what was used least recently */
+                if (hashmap_size(bus->property_cache) >= PROPERTY_CACHE_MAX)
+                        property_cache_entry_free(hashmap_steal_first(bus->property_cache));
+
+                n = new0(struct property_cache_entry, 1);
+                if (!n)
+                        return 1;
+
+                n->path = strdup(path);
+                if (!n->path)
+                        return 1;
+
+                n->vtable = c;
+
+                if (hashmap_ensure_put(&bus->property_cache, &property_cache_entry_hash_ops, n, n) < 0)
+                        return 1;
+
+                e = TAKE_PTR(n);
         }
 
+        e->generation = generation;
+        free_and_replace(e->runs, runs);
+        e->n_runs = n_runs;
+        free_and_replace(e->data, data);
+
         return 1;
 }
 
+int bus_set_property_cache(sd_bus *bus, bus_property_generation_t callback, void *userdata) {
+        assert(bus);
+
+        /* Enables caching of the properties returned by GetAll() that are announced via PropertiesChanged
+         * when they change. The callback returns the generation of the object at the specified path, which
+         * must change whenever any of these properties might have changed, or 0 if the object shall not be
+         * cached. Should be unique for the lifetime of the connection, i.e. never be reused for a different
+         * object at the same path. Not exposed publicly, since it relies on the owner of the objects never
+         * to forget to announce a property change. */
+
+        bus->property_generation = callback;
+        bus->property_generation_userdata = userdata;
+
+        bus_property_cache_flush(bus);
+        return 0;
+}
+
+void bus_property_cache_flush(sd_bus *bus) {
+        assert(bus);
+
+        hashmap_clear(bus->property_cache);
+}
+
 static int property_get_all_callbacks_run(
                 sd_bus *bus,
                 sd_bus_message *m,
@@ -843,7 +1104,7 @@ static int property_get_all_callbacks_run(
                         continue;
                 found_interface = true;
 
-                r = vtable_append_all_properties(bus, reply, m->path, c, u, &error);
+                r = vtable_append_all_properties_cached(bus, reply, m->path, c, u, &error);
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
                 if (bus->nodes_modified)
@@ -970,7 +1231,13 @@ int introspect_path(
                 if (c->vtable[0].flags & SD_BUS_VTABLE_HIDDEN)
                         continue;
 
-                r = introspect_write_interface(&intro, c->interface, c->vtable);
+                if (!c->introspection) {
+                        r = introspect_render_interface(c->vtable, bus->trusted, &c->introspection);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = introspect_write_interface_rendered(&intro, c->interface, c->introspection);
                 if (r < 0)
                         return r;
         }
@@ -1779,6 +2046,7 @@ static int add_object_vtable_internal(
         struct node_vtable *existing = NULL;
         const sd_bus_vtable *v;
         struct node *n;
+        unsigned n_methods = 0, n_properties = 0;
         int r;
         const char *names = "";
         names_flags nf;
@@ -1843,6 +2111,30 @@ static int add_object_vtable_internal(
                 goto fail;
         }
 
+        /* Count the members first, so that they can be allocated in one go, and the hashmaps be grown only
+         * once, not step by step. PID 1 registers vtables with hundreds of properties. */
+        for (v = bus_vtable_next(vtable, vtable); v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(vtable, v))
+                if (v->type == _SD_BUS_VTABLE_METHOD)
+                        n_methods++;
+                else if (IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                        n_properties++;
+
+        if (n_methods + n_properties > 0) {
+                s->node_vtable.members = new0(struct vtable_member, n_methods + n_properties);
+                if (!s->node_vtable.members) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+        }
+
+        r = hashmap_reserve(bus->vtable_methods, n_methods);
+        if (r < 0)
+                goto fail;
+
+        r = hashmap_reserve(bus->vtable_properties, n_properties);
+        if (r < 0)
+                goto fail;
+
         v = s->node_vtable.vtable;
         for (v = bus_vtable_next(vtable, v); v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(vtable, v)) {
 
@@ -1866,23 +2158,22 @@ static int add_object_vtable_internal(
                                 goto fail;
                         }
 
-                        m = new0(struct vtable_member, 1);
-                        if (!m) {
-                                r = -ENOMEM;
-                                goto fail;
-                        }
-
-                        m->parent = &s->node_vtable;
-                        m->path = n->path;
-                        m->interface = s->node_vtable.interface;
-                        m->member = v->x.method.member;
-                        m->vtable = v;
+                        m = s->node_vtable.members + s->node_vtable.n_members;
+                        *m = (struct vtable_member) {
+                                .parent = &s->node_vtable,
+                                .path = n->path,
+                                .interface = s->node_vtable.interface,
+                                .member = v->x.method.member,
+                                .vtable = v,
+                        };
 
                         r = hashmap_put(bus->vtable_methods, m, m);
-                        if (r < 0) {
-                                free(m);
+                        if (r < 0)
                                 goto fail;
-                        }
+
+                        /* Only count it once it is indexed, so that a failed registration removes exactly
+                         * what it added */
+                        s->node_vtable.n_members++;
 
                         break;
                 }
@@ -1914,23 +2205,20 @@ static int add_object_vtable_internal(
                                 goto fail;
                         }
 
-                        m = new0(struct vtable_member, 1);
-                        if (!m) {
-                                r = -ENOMEM;
-                                goto fail;
-                        }
-
-                        m->parent = &s->node_vtable;
-                        m->path = n->path;
-                        m->interface = s->node_vtable.interface;
-                        m->member = v->x.property.member;
-                        m->vtable = v;
+                        m = s->node_vtable.members + s->node_vtable.n_members;
+                        *m = (struct vtable_member) {
+                                .parent = &s->node_vtable,
+                                .path = n->path,
+                                .interface = s->node_vtable.interface,
+                                .member = v->x.property.member,
+                                .vtable = v,
+                        };
 
                         r = hashmap_put(bus->vtable_properties, m, m);
-                        if (r < 0) {
-                                free(m);
+                        if (r < 0)
                                 goto fail;
-                        }
+
+                        s->node_vtable.n_members++;
 
                         break;
                 }
@@ -58,6 +58,12 @@ enum {
         _BUS_MESSAGE_HEADER_MAX
 };
 
+/* sd-bus extension, only sent to peers which agreed to NEGOTIATE_UNIX_MEMFD during authentication: an "at"
+ * array of (offset, size) pairs of body ranges which are not transferred inline, but as sealed memfds. These
+ * are attached after the fds counted by BUS_MESSAGE_HEADER_UNIX_FDS, in the same order. The body size in the
+ * message header only covers the inline data. */
+#define BUS_MESSAGE_HEADER_MEMFDS 0xf0
+
 /* RequestName parameters */
 
 enum  {
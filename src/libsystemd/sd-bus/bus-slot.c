@@ -114,41 +114,18 @@ void bus_slot_disconnect(sd_bus_slot *slot, bool unref) {
 
         case BUS_NODE_VTABLE:
 
-                if (slot->node_vtable.node && slot->node_vtable.interface && slot->node_vtable.vtable) {
-                        const sd_bus_vtable *v;
+                for (size_t i = 0; i < slot->node_vtable.n_members; i++) {
+                        struct vtable_member *m = slot->node_vtable.members + i;
 
-                        for (v = slot->node_vtable.vtable; v->type != _SD_BUS_VTABLE_END; v = bus_vtable_next(slot->node_vtable.vtable, v)) {
-                                struct vtable_member *x = NULL;
-
-                                switch (v->type) {
-
-                                case _SD_BUS_VTABLE_METHOD: {
-                                        struct vtable_member key;
-
-                                        key.path = slot->node_vtable.node->path;
-                                        key.interface = slot->node_vtable.interface;
-                                        key.member = v->x.method.member;
-
-                                        x = hashmap_remove(slot->bus->vtable_methods, &key);
-                                        break;
-                                }
-
-                                case _SD_BUS_VTABLE_PROPERTY:
-                                case _SD_BUS_VTABLE_WRITABLE_PROPERTY: {
-                                        struct vtable_member key;
-
-                                        key.path = slot->node_vtable.node->path;
-                                        key.interface = slot->node_vtable.interface;
-                                        key.member = v->x.method.member;
-
-                                        x = hashmap_remove(slot->bus->vtable_properties, &key);
-                                        break;
-                                }}
-
-                                free(x);
-                        }
+                        (void) hashmap_remove(m->vtable->type == _SD_BUS_VTABLE_METHOD ? slot->bus->vtable_methods : slot->bus->vtable_properties, m);
                 }
 
+                /* Cached properties refer to the vtable they were retrieved through */
+                bus_property_cache_flush(slot->bus);
+
+                slot->node_vtable.members = mfree(slot->node_vtable.members);
+                slot->node_vtable.n_members = 0;
+                slot->node_vtable.introspection = mfree(slot->node_vtable.introspection);
                 slot->node_vtable.interface = mfree(slot->node_vtable.interface);
 
                 if (slot->node_vtable.node) {
@@ -12,6 +12,7 @@
 #include "bus-internal.h"
 #include "bus-message.h"
 #include "bus-socket.h"
+#include "bus-statistics.h"
 #include "escape.h"
 #include "fd-util.h"
 #include "format-util.h"
@@ -26,11 +27,18 @@
 #include "signal-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "utf8.h"
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+/* How much to read at once when waiting for small messages */
+#define READ_AHEAD_SIZE (64U*1024U)
+
+/* How many iovecs to pass to a single sendmsg() at most when coalescing queued messages */
+#define WRITE_IOVEC_MAX 64U
+
 static void iovec_advance(struct iovec iov[], unsigned *idx, size_t size) {
 
         while (size > 0) {
@@ -73,7 +81,8 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
 
         assert(!m->iovec);
 
-        n = 1 + m->n_body_parts;
+        /* Body parts passed as memfds are not part of the stream */
+        n = 1 + m->n_body_parts - m->n_passed_memfds;
         if (n < ELEMENTSOF(m->iovec_fixed))
                 m->iovec = m->iovec_fixed;
         else {
@@ -89,6 +98,9 @@ static int bus_message_setup_iovec(sd_bus_message *m) {
                 goto fail;
 
         MESSAGE_FOREACH_PART(part, i, m)  {
+                if (part->passed_as_fd)
+                        continue;
+
                 r = bus_body_part_map(part);
                 if (r < 0)
                         goto fail;
@@ -156,17 +168,18 @@ static int bus_socket_write_auth(sd_bus *b) {
 }
 
 static int bus_socket_auth_verify_client(sd_bus *b) {
-        char *d, *e, *f, *start;
+        char *d, *e, *f, *g, *start;
         sd_id128_t peer;
         int r;
 
         assert(b);
 
         /*
-         * We expect three response lines:
+         * We expect four response lines:
          *   "DATA\r\n"
          *   "OK <server-id>\r\n"
          *   "AGREE_UNIX_FD\r\n"        (optional)
+         *   "AGREE_UNIX_MEMFD\r\n"     (optional)
          */
 
         d = memmem_safe(b->rbuffer, b->rbuffer_size, "\r\n", 2);
@@ -188,6 +201,15 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                 start = e + 2;
         }
 
+        if (f && b->accept_memfd) {
+                g = memmem_safe(f + 2, b->rbuffer_size - (f - (char*) b->rbuffer) - 2, "\r\n", 2);
+                if (!g)
+                        return 0;
+
+                start = g + 2;
+        } else
+                g = NULL;
+
         /* Nice! We got all the lines we need. First check the DATA line. */
 
         if (d - (char*) b->rbuffer == 4) {
@@ -241,6 +263,15 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                         memcmp(e + 2, "AGREE_UNIX_FD",
                                STRLEN("AGREE_UNIX_FD")) == 0;
 
+        /* And the fourth */
+
+        if (g)
+                b->can_memfd =
+                        b->can_fds &&
+                        (g - f == STRLEN("\r\nAGREE_UNIX_MEMFD")) &&
+                        memcmp(f + 2, "AGREE_UNIX_MEMFD",
+                               STRLEN("AGREE_UNIX_MEMFD")) == 0;
+
         b->rbuffer_size -= (start - (char*) b->rbuffer);
         memmove(b->rbuffer, start, b->rbuffer_size);
 
@@ -490,6 +521,15 @@ static int bus_socket_auth_verify_server(sd_bus *b) {
                                 b->can_fds = true;
                                 r = bus_socket_auth_write(b, "AGREE_UNIX_FD\r\n");
                         }
+                } else if (line_equals(line, l, "NEGOTIATE_UNIX_MEMFD")) {
+                        /* Our own extension: large memfd-backed arrays are passed as fds instead of
+                         * inline. Requires fd passing to be negotiated first. */
+                        if (b->auth == _BUS_AUTH_INVALID || !b->accept_memfd || !b->can_fds)
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_memfd = true;
+                                r = bus_socket_auth_write(b, "AGREE_UNIX_MEMFD\r\n");
+                        }
                 } else
                         r = bus_socket_auth_write(b, "ERROR\r\n");
 
@@ -657,6 +697,9 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         static const char sasl_negotiate_unix_fd[] = {
                 "NEGOTIATE_UNIX_FD\r\n"
         };
+        static const char sasl_negotiate_unix_memfd[] = {
+                "NEGOTIATE_UNIX_MEMFD\r\n"
+        };
         static const char sasl_begin[] = {
                 "BEGIN\r\n"
         };
@@ -672,6 +715,9 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         if (b->accept_fd)
                 b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_unix_fd);
 
+        if (b->accept_fd && b->accept_memfd)
+                b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_unix_memfd);
+
         b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_begin);
 
         return bus_socket_write_auth(b);
@@ -1020,56 +1066,88 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
-int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **messages, size_t n_messages, size_t *idx) {
         struct iovec *iov;
+        size_t n = 0, n_iov = 0, p = 0;
         ssize_t k;
-        size_t n;
         unsigned j;
         int r;
 
         assert(bus);
-        assert(m);
+        assert(messages);
+        assert(n_messages > 0);
         assert(idx);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        if (*idx >= BUS_MESSAGE_SIZE(messages[0]))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        /* Coalesce as many of the specified messages into a single write as we can. *idx is the number of
+         * bytes already written of the first message, and is increased by the number of bytes written
+         * now, possibly beyond the end of the first message. The kernel attaches fds to the first byte of
+         * a sendmsg(), hence a message carrying fds may only ever be the first one of a batch. */
+        for (; n < n_messages; n++) {
+                sd_bus_message *m = messages[n];
+
+                if (n > 0 && (m->n_fds > 0 || m->n_passed_memfds > 0))
+                        break;
+
+                r = bus_message_setup_iovec(m);
+                if (r < 0)
+                        return r;
+
+                if (n > 0 && n_iov + m->n_iovec > WRITE_IOVEC_MAX)
+                        break;
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = newa(struct iovec, n);
-        memcpy_safe(iov, m->iovec, n);
+                n_iov += m->n_iovec;
+        }
+
+        iov = newa(struct iovec, n_iov);
+        for (size_t i = 0; i < n; i++) {
+                memcpy_safe(iov + p, messages[i]->iovec, messages[i]->n_iovec * sizeof(struct iovec));
+                p += messages[i]->n_iovec;
+        }
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, iov, n_iov);
         else {
                 struct msghdr mh = {
                         .msg_iov = iov,
-                        .msg_iovlen = m->n_iovec,
+                        .msg_iovlen = n_iov,
                 };
 
-                if (m->n_fds > 0 && *idx == 0) {
+                if ((messages[0]->n_fds > 0 || messages[0]->n_passed_memfds > 0) && *idx == 0) {
                         struct cmsghdr *control;
+                        sd_bus_message *m = messages[0];
+                        struct bus_body_part *part;
+                        size_t n_fds;
+                        unsigned i;
+                        int *f;
 
-                        mh.msg_controllen = CMSG_SPACE(sizeof(int) * m->n_fds);
+                        /* The memfds of parts passed out-of-band follow the regular fds, in order */
+                        n_fds = m->n_fds + m->n_passed_memfds;
+
+                        mh.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
                         mh.msg_control = alloca0(mh.msg_controllen);
                         control = CMSG_FIRSTHDR(&mh);
-                        control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
+                        control->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
                         control->cmsg_level = SOL_SOCKET;
                         control->cmsg_type = SCM_RIGHTS;
-                        memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+
+                        f = (int*) CMSG_DATA(control);
+                        f = mempcpy_safe(f, m->fds, sizeof(int) * m->n_fds);
+                        MESSAGE_FOREACH_PART(part, i, m)
+                                if (part->passed_as_fd)
+                                        *(f++) = part->memfd;
                 }
 
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, iov, n_iov);
                 }
         }
 
@@ -1080,16 +1158,21 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         return 1;
 }
 
-static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+        assert(m);
+
+        return bus_socket_write_messages(bus, &m, 1, idx);
+}
+
+static int bus_socket_read_message_need(const void *p, size_t size, size_t *need) {
         uint32_t a, b;
         uint8_t e;
         uint64_t sum;
 
-        assert(bus);
+        assert(p || size == 0);
         assert(need);
-        assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (bus->rbuffer_size < sizeof(struct bus_header)) {
+        if (size < sizeof(struct bus_header)) {
                 *need = sizeof(struct bus_header) + 8;
 
                 /* Minimum message size:
@@ -1111,16 +1194,15 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
                 return 0;
         }
 
-        a = ((const uint32_t*) bus->rbuffer)[1];
-        b = ((const uint32_t*) bus->rbuffer)[3];
-
-        e = ((const uint8_t*) bus->rbuffer)[0];
+        /* Messages follow each other in the read buffer without any padding, hence the header might not
+         * be aligned */
+        e = ((const uint8_t*) p)[0];
         if (e == BUS_LITTLE_ENDIAN) {
-                a = le32toh(a);
-                b = le32toh(b);
+                a = unaligned_read_le32((const uint8_t*) p + 4);
+                b = unaligned_read_le32((const uint8_t*) p + 12);
         } else if (e == BUS_BIG_ENDIAN) {
-                a = be32toh(a);
-                b = be32toh(b);
+                a = unaligned_read_be32((const uint8_t*) p + 4);
+                b = unaligned_read_be32((const uint8_t*) p + 12);
         } else
                 return -EBADMSG;
 
@@ -1132,49 +1214,84 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         return 0;
 }
 
-static int bus_socket_make_message(sd_bus *bus, size_t size) {
+static void bus_socket_drop_fds(sd_bus *bus, size_t n) {
+        assert(bus);
+        assert(n <= bus->n_fds);
+
+        /* Drops the first n entries from the queue of received fds, after they have been taken over by a
+         * message */
+
+        bus->n_fds -= n;
+        if (bus->n_fds == 0)
+                bus->fds = mfree(bus->fds);
+        else
+                memmove(bus->fds, bus->fds + n, bus->n_fds * sizeof(int));
+}
+
+static int bus_socket_make_message(sd_bus *bus, size_t offset, size_t size) {
         sd_bus_message *t = NULL;
+        bool take_rbuffer;
         void *b;
         int r;
 
         assert(bus);
-        assert(bus->rbuffer_size >= size);
+        assert(bus->rbuffer_size >= offset + size);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
         r = bus_rqueue_make_room(bus);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size > size) {
-                b = memdup((const uint8_t*) bus->rbuffer + size,
-                           bus->rbuffer_size - size);
+        /* Large messages are read into a buffer of exactly their size (see below), which we can hand over
+         * to the message object as is. Everything else is copied out of the read buffer. */
+        take_rbuffer = offset == 0 && size == bus->rbuffer_size && size >= READ_AHEAD_SIZE;
+        if (take_rbuffer)
+                b = bus->rbuffer;
+        else {
+                b = memdup((const uint8_t*) bus->rbuffer + offset, size);
                 if (!b)
                         return -ENOMEM;
-        } else
-                b = NULL;
+        }
 
         r = bus_message_from_malloc(bus,
-                                    bus->rbuffer, size,
+                                    b, size,
                                     bus->fds, bus->n_fds,
                                     NULL,
                                     &t);
         if (r == -EBADMSG) {
                 log_debug_errno(r, "Received invalid message from connection %s, dropping.", strna(bus->description));
-                free(bus->rbuffer); /* We want to drop current rbuffer and proceed with whatever remains in b */
-        } else if (r < 0) {
                 free(b);
-                return r;
-        }
 
-        /* rbuffer ownership was either transferred to t, or we got EBADMSG and dropped it. */
-        bus->rbuffer = b;
-        bus->rbuffer_size -= size;
+                /* We have no idea how many of the received fds were meant for this message, drop them all */
+                close_many(bus->fds, bus->n_fds);
+                bus_socket_drop_fds(bus, bus->n_fds);
+        } else if (r < 0) {
+                if (!take_rbuffer)
+                        free(b);
+                return r;
+        } else
+                bus_socket_drop_fds(bus, r);
 
-        bus->fds = NULL;
-        bus->n_fds = 0;
+        /* The buffer was either transferred to t, or we got EBADMSG and dropped it. */
+        if (take_rbuffer) {
+                bus->rbuffer = NULL;
+                bus->rbuffer_size = 0;
+        }
 
         if (t) {
                 t->read_counter = ++bus->read_counter;
+
+                /* The socket transports don't carry sender timestamps, hence record the time of receipt */
+                if (bus->attach_timestamp) {
+                        t->realtime = now(CLOCK_REALTIME);
+                        t->monotonic = now(CLOCK_MONOTONIC);
+                }
+
+                if (bus->statistics && bus->statistics->enabled) {
+                        bus->statistics->n_received++;
+                        t->queued_usec = now(CLOCK_MONOTONIC);
+                }
+
                 bus->rqueue[bus->rqueue_size++] = bus_message_ref_queued(t, bus);
                 sd_bus_message_unref(t);
         }
@@ -1182,11 +1299,65 @@ static int bus_socket_make_message(sd_bus *bus, size_t size) {
         return 1;
 }
 
+static int bus_socket_make_messages(sd_bus *bus) {
+        size_t offset = 0;
+        int r, ret = 0;
+
+        assert(bus);
+
+        /* Turns all complete messages at the beginning of the read buffer into message objects, and moves
+         * whatever is left to the front of the buffer. */
+
+        for (;;) {
+                size_t need;
+
+                r = bus_socket_read_message_need((const uint8_t*) bus->rbuffer + offset, bus->rbuffer_size - offset, &need);
+                if (r < 0)
+                        break;
+
+                if (bus->rbuffer_size - offset < need)
+                        break;
+
+                r = bus_socket_make_message(bus, offset, need);
+                if (r < 0)
+                        break;
+
+                ret = 1;
+
+                if (!bus->rbuffer) /* The buffer was passed on as a whole */
+                        break;
+
+                offset += need;
+        }
+
+        if (offset > 0) {
+                bus->rbuffer_size -= offset;
+                if (bus->rbuffer_size == 0)
+                        bus->rbuffer = mfree(bus->rbuffer);
+                else
+                        memmove(bus->rbuffer, (uint8_t*) bus->rbuffer + offset, bus->rbuffer_size);
+        }
+
+        if (r < 0)
+                return r;
+
+        /* The kernel passes fds along with the first byte of the message they belong to, hence if there's
+         * nothing left in the buffer but fds are, then nobody asked for them. */
+        if (bus->rbuffer_size == 0 && bus->n_fds > 0) {
+                log_debug("Received %zu file descriptors not referenced by any message on connection %s, closing.",
+                          bus->n_fds, strna(bus->description));
+                close_many(bus->fds, bus->n_fds);
+                bus_socket_drop_fds(bus, bus->n_fds);
+        }
+
+        return ret;
+}
+
 int bus_socket_read_message(sd_bus *bus) {
         struct msghdr mh;
         struct iovec iov = {};
         ssize_t k;
-        size_t need;
+        size_t need, size;
         int r;
         void *b;
         CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(int) * BUS_FDS_MAX)) control;
@@ -1195,20 +1366,27 @@ int bus_socket_read_message(sd_bus *bus) {
         assert(bus);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_read_message_need(bus->rbuffer, bus->rbuffer_size, &need);
         if (r < 0)
                 return r;
 
         if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+                return bus_socket_make_messages(bus);
+
+        /* Small messages are read with some read-ahead, so that a single syscall can pick up many of them
+         * at once on busy connections. Large messages are read to their exact size, so that the buffer can
+         * be passed on to the message object without copying. Note that this doesn't confuse fd passing:
+         * fds are queued in the order they are received, and each message takes as many of them as it
+         * declares in its header. */
+        size = MAX(need, READ_AHEAD_SIZE);
 
-        b = realloc(bus->rbuffer, need);
+        b = realloc(bus->rbuffer, size);
         if (!b)
                 return -ENOMEM;
 
         bus->rbuffer = b;
 
-        iov = IOVEC_MAKE((uint8_t *)bus->rbuffer + bus->rbuffer_size, need - bus->rbuffer_size);
+        iov = IOVEC_MAKE((uint8_t *)bus->rbuffer + bus->rbuffer_size, size - bus->rbuffer_size);
 
         if (bus->prefer_readv) {
                 k = readv(bus->input_fd, &iov, 1);
@@ -1277,16 +1455,14 @@ int bus_socket_read_message(sd_bus *bus) {
                                           cmsg->cmsg_level, cmsg->cmsg_type);
         }
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_make_messages(bus);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
-
         return 1;
 }
 
+
 int bus_socket_process_opening(sd_bus *b) {
         int error = 0, events, r;
         socklen_t slen = sizeof(error);
@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "bus-message.h"
+#include "bus-statistics.h"
+#include "log.h"
+#include "string-util.h"
+#include "util.h"
+
+void bus_histogram_add(BusHistogram *h, usec_t t) {
+        unsigned i;
+
+        assert(h);
+
+        i = t > 0 ? log2u64(t) : 0;
+        h->buckets[MIN(i, BUS_HISTOGRAM_BUCKETS - 1)]++;
+
+        h->n++;
+        h->total = usec_add(h->total, t);
+        h->max = MAX(h->max, t);
+}
+
+static BusMemberStatistics* bus_member_statistics_free(BusMemberStatistics *s) {
+        if (!s)
+                return NULL;
+
+        free(s->name);
+        return mfree(s);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(bus_member_statistics_hash_ops, char, string_hash_func, string_compare_func,
+                                              BusMemberStatistics, bus_member_statistics_free);
+
+BusStatistics* bus_statistics_free(BusStatistics *s) {
+        if (!s)
+                return NULL;
+
+        hashmap_free(s->members);
+        return mfree(s);
+}
+
+BusMemberStatistics* bus_statistics_get_member(BusStatistics *s, sd_bus_message *m) {
+        _cleanup_free_ char *name = NULL;
+        BusMemberStatistics *e;
+
+        assert(s);
+        assert(m);
+
+        name = strjoin(strempty(m->interface), ".", strempty(m->member));
+        if (!name)
+                return NULL;
+
+        e = hashmap_get(s->members, name);
+        if (e)
+                return e;
+
+        if (hashmap_size(s->members) >= BUS_STATISTICS_MEMBERS_MAX)
+                return NULL;
+
+        e = new0(BusMemberStatistics, 1);
+        if (!e)
+                return NULL;
+
+        e->name = TAKE_PTR(name);
+
+        if (hashmap_ensure_put(&s->members, &bus_member_statistics_hash_ops, e->name, e) < 0)
+                return bus_member_statistics_free(e);
+
+        return e;
+}
+
+static int append_histogram(sd_bus_message *m, const char *name, const BusHistogram *h) {
+        int r;
+
+        assert(m);
+        assert(h);
+
+        if (name) {
+                r = sd_bus_message_open_container(m, 'e', "sv");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(m, "s", name);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_open_container(m, 'v', "(tttat)");
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_open_container(m, 'r', "tttat");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(m, "ttt", h->n, h->total, h->max);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append_array(m, 't', h->buckets, sizeof(h->buckets));
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return r;
+
+        if (name) {
+                r = sd_bus_message_close_container(m);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(m);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+int bus_statistics_append(BusStatistics *s, sd_bus_message *m) {
+        BusMemberStatistics *e;
+        int r;
+
+        assert(s);
+        assert(m);
+
+        /* Histograms are serialized as (tttat): number of samples, sum and maximum of the samples in µs, and
+         * the sample counts of the buckets, see BUS_HISTOGRAM_BUCKETS. */
+
+        r = sd_bus_message_open_container(m, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(m, "{sv}{sv}{sv}",
+                                  "MessagesReceived", "t", s->n_received,
+                                  "MessagesSent", "t", s->n_sent,
+                                  "AuthenticationUSec", "t", s->auth_usec);
+        if (r < 0)
+                return r;
+
+        r = append_histogram(m, "QueueUSec", &s->queue);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(m, 'e', "sv");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(m, "s", "Members");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(m, 'v', "a(s(tttat)(tttat))");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(m, 'a', "(s(tttat)(tttat))");
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH(e, s->members) {
+                r = sd_bus_message_open_container(m, 'r', "s(tttat)(tttat)");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(m, "s", e->name);
+                if (r < 0)
+                        return r;
+
+                r = append_histogram(m, NULL, &e->handler);
+                if (r < 0)
+                        return r;
+
+                r = append_histogram(m, NULL, &e->reply);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(m);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(m);
+}
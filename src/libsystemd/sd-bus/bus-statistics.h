@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "sd-bus.h"
+
+#include "hashmap.h"
+#include "time-util.h"
+
+/* Bucket i counts durations in [2^i, 2^(i+1)) µs, the first one also counts everything shorter, the last
+ * one everything longer, i.e. everything from ~8s on */
+#define BUS_HISTOGRAM_BUCKETS 24U
+
+/* Don't let peers make us track an unbounded number of distinct members */
+#define BUS_STATISTICS_MEMBERS_MAX 1024U
+
+typedef struct BusHistogram {
+        uint64_t n;
+        usec_t total;
+        usec_t max;
+        uint64_t buckets[BUS_HISTOGRAM_BUCKETS];
+} BusHistogram;
+
+typedef struct BusMemberStatistics {
+        char *name; /* interface.member */
+
+        BusHistogram handler; /* Time the synchronous dispatching of a call took */
+        BusHistogram reply;   /* Time from the (first) dispatch of a call until its reply was enqueued */
+} BusMemberStatistics;
+
+typedef struct BusStatistics {
+        bool enabled;
+
+        uint64_t n_received;
+        uint64_t n_sent;
+
+        usec_t auth_begin;
+        usec_t auth_usec;
+
+        BusHistogram queue; /* Time incoming messages spent in the read queue */
+
+        Hashmap *members;
+} BusStatistics;
+
+void bus_histogram_add(BusHistogram *h, usec_t t);
+
+BusStatistics* bus_statistics_free(BusStatistics *s);
+DEFINE_TRIVIAL_CLEANUP_FUNC(BusStatistics*, bus_statistics_free);
+
+BusMemberStatistics* bus_statistics_get_member(BusStatistics *s, sd_bus_message *m);
+int bus_statistics_append(BusStatistics *s, sd_bus_message *m);
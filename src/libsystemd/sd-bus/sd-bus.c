@@ -24,6 +24,7 @@
 #include "bus-protocol.h"
 #include "bus-slot.h"
 #include "bus-socket.h"
+#include "bus-statistics.h"
 #include "bus-track.h"
 #include "bus-type.h"
 #include "cgroup-util.h"
@@ -214,15 +215,23 @@ static sd_bus* bus_free(sd_bus *b) {
         assert(b->match_callbacks.type == BUS_MATCH_ROOT);
         bus_match_free(&b->match_callbacks);
 
-        hashmap_free_free(b->vtable_methods);
-        hashmap_free_free(b->vtable_properties);
+        /* The members are owned by their slots, which are all disconnected by now */
+        assert(hashmap_isempty(b->vtable_methods));
+        assert(hashmap_isempty(b->vtable_properties));
+        hashmap_free(b->vtable_methods);
+        hashmap_free(b->vtable_properties);
+        hashmap_free(b->property_cache);
 
         assert(hashmap_isempty(b->nodes));
         hashmap_free(b->nodes);
 
         bus_flush_memfd(b);
+        bus_flush_message_cache(b);
+
+        bus_statistics_free(b->statistics);
 
         assert_se(pthread_mutex_destroy(&b->memfd_cache_mutex) == 0);
+        assert_se(pthread_mutex_destroy(&b->message_cache_mutex) == 0);
 
         return mfree(b);
 }
@@ -257,6 +266,7 @@ _public_ int sd_bus_new(sd_bus **ret) {
                 return -ENOMEM;
 
         assert_se(pthread_mutex_init(&b->memfd_cache_mutex, NULL) == 0);
+        assert_se(pthread_mutex_init(&b->message_cache_mutex, NULL) == 0);
 
         *ret = TAKE_PTR(b);
         return 0;
@@ -338,14 +348,29 @@ _public_ int sd_bus_negotiate_fds(sd_bus *bus, int b) {
         return 0;
 }
 
+int bus_negotiate_memfd(sd_bus *bus, bool b) {
+        assert(bus);
+
+        /* Passing large arrays as sealed memfds is an sd-bus extension of the protocol, which only makes
+         * sense on direct connections between two sd-bus peers. Hence this is not exposed publicly, and
+         * only enabled for the private connections between systemd and its tools. Requires fd passing to
+         * be negotiated as well. */
+
+        if (bus->state != BUS_UNSET)
+                return -EPERM;
+
+        bus->accept_memfd = b;
+        return 0;
+}
+
 _public_ int sd_bus_negotiate_timestamp(sd_bus *bus, int b) {
         assert_return(bus, -EINVAL);
         assert_return(bus = bus_resolve(bus), -ENOPKG);
         assert_return(!IN_SET(bus->state, BUS_CLOSING, BUS_CLOSED), -EPERM);
         assert_return(!bus_pid_changed(bus), -ECHILD);
 
-        /* This is not actually supported by any of our transports these days, but we do honour it for synthetic
-         * replies, and maybe one day classic D-Bus learns this too */
+        /* Classic D-Bus doesn't transfer sender timestamps, hence for our socket transports we record when
+         * the message was read instead. We also honour it for synthetic replies. */
         bus->attach_timestamp = !!b;
 
         return 0;
@@ -610,6 +635,10 @@ int bus_start_running(sd_bus *bus) {
          * adding a fixed value to all entries should not alter the internal order. */
 
         n = now(CLOCK_MONOTONIC);
+
+        if (bus->statistics && bus->statistics->auth_begin > 0)
+                bus->statistics->auth_usec = usec_sub_unsigned(n, bus->statistics->auth_begin);
+
         ORDERED_HASHMAP_FOREACH(c, bus->reply_callbacks) {
                 if (c->timeout_usec == 0)
                         continue;
@@ -1197,6 +1226,9 @@ _public_ int sd_bus_start(sd_bus *bus) {
 
         bus_set_state(bus, BUS_OPENING);
 
+        if (bus->statistics)
+                bus->statistics->auth_begin = now(CLOCK_MONOTONIC);
+
         if (bus->is_server && bus->bus_client)
                 return -EINVAL;
 
@@ -1972,6 +2004,23 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return sd_bus_message_seal(m, UINT32_MAX, 0);
 }
 
+static void bus_log_message_sent(sd_bus_message *m) {
+        assert(m);
+
+        log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
+                  bus_message_type_to_string(m->header->type),
+                  strna(sd_bus_message_get_sender(m)),
+                  strna(sd_bus_message_get_destination(m)),
+                  strna(sd_bus_message_get_path(m)),
+                  strna(sd_bus_message_get_interface(m)),
+                  strna(sd_bus_message_get_member(m)),
+                  BUS_MESSAGE_COOKIE(m),
+                  m->reply_cookie,
+                  strna(m->root_container.signature),
+                  strna(m->error.name),
+                  strna(m->error.message));
+}
+
 static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         int r;
 
@@ -1983,18 +2032,7 @@ static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
                 return r;
 
         if (*idx >= BUS_MESSAGE_SIZE(m))
-                log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
-                          bus_message_type_to_string(m->header->type),
-                          strna(sd_bus_message_get_sender(m)),
-                          strna(sd_bus_message_get_destination(m)),
-                          strna(sd_bus_message_get_path(m)),
-                          strna(sd_bus_message_get_interface(m)),
-                          strna(sd_bus_message_get_member(m)),
-                          BUS_MESSAGE_COOKIE(m),
-                          m->reply_cookie,
-                          strna(m->root_container.signature),
-                          strna(m->error.name),
-                          strna(m->error.message));
+                bus_log_message_sent(m);
 
         return r;
 }
@@ -2006,29 +2044,28 @@ static int dispatch_wqueue(sd_bus *bus) {
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
         while (bus->wqueue_size > 0) {
+                size_t n = 0;
 
-                r = bus_write_message(bus, bus->wqueue[0], &bus->windex);
+                /* Write as much of the queue as we can in one go */
+                r = bus_socket_write_messages(bus, bus->wqueue, bus->wqueue_size, &bus->windex);
                 if (r < 0)
                         return r;
                 else if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
-                         * the queue.
-                         *
-                         * This isn't particularly optimized, but
-                         * well, this is supposed to be our worst-case
-                         * buffer only, and the socket buffer is
-                         * supposed to be our primary buffer, and if
-                         * it got full, then all bets are off
-                         * anyway. */
-
-                        bus->wqueue_size--;
-                        bus_message_unref_queued(bus->wqueue[0], bus);
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
-                        bus->windex = 0;
 
+                /* Drop all entries that were fully written from the queue. Note that windex may point
+                 * beyond the end of the first entry now. */
+                while (n < bus->wqueue_size && bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[n])) {
+                        bus->windex -= BUS_MESSAGE_SIZE(bus->wqueue[n]);
+                        bus_log_message_sent(bus->wqueue[n]);
+                        bus_message_unref_queued(bus->wqueue[n], bus);
+                        n++;
+                }
+
+                if (n > 0) {
+                        bus->wqueue_size -= n;
+                        memmove(bus->wqueue, bus->wqueue + n, sizeof(sd_bus_message*) * bus->wqueue_size);
                         ret = 1;
                 }
         }
@@ -2134,6 +2171,15 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
         if (m->dont_send)
                 goto finish;
 
+        if (bus->statistics && bus->statistics->enabled) {
+                bus->statistics->n_sent++;
+
+                if (m->member_statistics && m->bus == bus &&
+                    IN_SET(m->header->type, SD_BUS_MESSAGE_METHOD_RETURN, SD_BUS_MESSAGE_METHOD_ERROR))
+                        bus_histogram_add(&m->member_statistics->reply,
+                                          usec_sub_unsigned(now(CLOCK_MONOTONIC), m->dispatched_usec));
+        }
+
         if (IN_SET(bus->state, BUS_RUNNING, BUS_HELLO) && bus->wqueue_size <= 0) {
                 size_t idx = 0;
 
@@ -2862,6 +2908,29 @@ static int process_builtin(sd_bus *bus, sd_bus_message *m) {
         if (m->header->type != SD_BUS_MESSAGE_METHOD_CALL)
                 return 0;
 
+        if (bus->statistics && bus->statistics->enabled &&
+            sd_bus_message_is_method_call(m, "org.freedesktop.DBus.Debug.Stats", "GetStats")) {
+
+                /* Same interface as the statistics of dbus-daemon, but about this peer's connection */
+
+                if (m->header->flags & BUS_MESSAGE_NO_REPLY_EXPECTED)
+                        return 1;
+
+                r = sd_bus_message_new_method_return(m, &reply);
+                if (r < 0)
+                        return r;
+
+                r = bus_statistics_append(bus->statistics, reply);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_send(bus, reply, NULL);
+                if (r < 0)
+                        return r;
+
+                return 1;
+        }
+
         if (!streq_ptr(m->interface, "org.freedesktop.DBus.Peer"))
                 return 0;
 
@@ -2924,12 +2993,42 @@ static int process_fd_check(sd_bus *bus, sd_bus_message *m) {
         return sd_bus_reply_method_errorf(m, SD_BUS_ERROR_INCONSISTENT_MESSAGE, "Message contains file descriptors, which I cannot accept. Sorry.");
 }
 
+static void process_message_statistics(sd_bus *bus, sd_bus_message *m, usec_t *ret_begin) {
+        usec_t n;
+
+        assert(bus);
+        assert(m);
+        assert(ret_begin);
+
+        if (!bus->statistics || !bus->statistics->enabled) {
+                *ret_begin = 0;
+                return;
+        }
+
+        n = now(CLOCK_MONOTONIC);
+
+        if (m->queued_usec > 0)
+                bus_histogram_add(&bus->statistics->queue, usec_sub_unsigned(n, m->queued_usec));
+
+        /* Calls may be dispatched more than once, e.g. when the handler waits for polkit. The reply latency
+         * is accounted from the first time on, the handler time each time. */
+        if (m->header->type == SD_BUS_MESSAGE_METHOD_CALL && m->dispatched_usec == 0) {
+                m->dispatched_usec = n;
+                m->member_statistics = bus_statistics_get_member(bus->statistics, m);
+        }
+
+        *ret_begin = n;
+}
+
 static int process_message(sd_bus *bus, sd_bus_message *m) {
+        usec_t begin;
         int r;
 
         assert(bus);
         assert(m);
 
+        process_message_statistics(bus, m, &begin);
+
         bus->current_message = m;
         bus->iteration_counter++;
 
@@ -2963,6 +3062,10 @@ static int process_message(sd_bus *bus, sd_bus_message *m) {
 
 finish:
         bus->current_message = NULL;
+
+        if (begin > 0 && m->member_statistics && m->header->type == SD_BUS_MESSAGE_METHOD_CALL)
+                bus_histogram_add(&m->member_statistics->handler, usec_sub_unsigned(now(CLOCK_MONOTONIC), begin));
+
         return r;
 }
 
@@ -4370,6 +4473,41 @@ _public_ int sd_bus_get_method_call_timeout(sd_bus *bus, uint64_t *ret) {
         return 0;
 }
 
+_public_ int sd_bus_set_statistics(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (!b) {
+                /* Keep what was collected so far, messages in flight may point into it */
+                if (bus->statistics)
+                        bus->statistics->enabled = false;
+                return 0;
+        }
+
+        if (!bus->statistics) {
+                bus->statistics = new0(BusStatistics, 1);
+                if (!bus->statistics)
+                        return -ENOMEM;
+        }
+
+        bus->statistics->enabled = true;
+        return 0;
+}
+
+_public_ int sd_bus_get_statistics(sd_bus *bus, sd_bus_message *m) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(m, -EINVAL);
+        assert_return(!m->sealed, -EPERM);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (!bus->statistics)
+                return -ENODATA;
+
+        return bus_statistics_append(bus->statistics, m);
+}
+
 _public_ int sd_bus_set_close_on_exit(sd_bus *bus, int b) {
         assert_return(bus, -EINVAL);
         assert_return(bus = bus_resolve(bus), -ENOPKG);
@@ -4405,6 +4543,9 @@ _public_ int sd_bus_enqueue_for_read(sd_bus *bus, sd_bus_message *m) {
         if (r < 0)
                 return r;
 
+        if (bus->statistics && bus->statistics->enabled)
+                m->queued_usec = now(CLOCK_MONOTONIC);
+
         bus->rqueue[bus->rqueue_size++] = bus_message_ref_queued(m, bus);
         return 0;
 }
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sd-bus.h"
+
+#include "bus-internal.h"
+#include "fd-util.h"
+#include "parse-util.h"
+#include "stdio-util.h"
+#include "tests.h"
+
+/* Sends a lot of messages in a row, some of them carrying fds, so that both the read-ahead on the receiving
+ * side and the coalescing of queued messages on the sending side get exercised, and checks that everything
+ * arrives in order, with each fd attached to the right message. */
+
+#define N_MESSAGES 2000U
+
+static bool carries_fd(unsigned i) {
+        return i % 7 == 3;
+}
+
+static void *server(void *p) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        sd_id128_t id;
+        unsigned i = 0;
+        int r;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, PTR_TO_FD(p), PTR_TO_FD(p)) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+        assert_se(sd_bus_negotiate_fds(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        while (i < N_MESSAGES) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                unsigned j;
+
+                r = sd_bus_process(bus, &m);
+                assert_se(r >= 0);
+                if (r == 0) {
+                        assert_se(sd_bus_wait(bus, UINT64_MAX) >= 0);
+                        continue;
+                }
+                if (!m || !sd_bus_message_is_signal(m, "org.freedesktop.systemd.test", "Batch"))
+                        continue;
+
+                assert_se(sd_bus_message_read(m, "u", &j) >= 0);
+                assert_se(j == i);
+
+                if (carries_fd(i)) {
+                        char buf[DECIMAL_STR_MAX(unsigned)] = {};
+                        int fd;
+
+                        /* The pipe we got passed must contain our own index */
+                        assert_se(sd_bus_message_read(m, "h", &fd) >= 0);
+                        assert_se(read(fd, buf, sizeof(buf) - 1) > 0);
+                        assert_se(safe_atou(buf, &j) >= 0);
+                        assert_se(j == i);
+                } else
+                        assert_se(sd_bus_message_at_end(m, true) > 0);
+
+                i++;
+        }
+
+        return NULL;
+}
+
+TEST(batch) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        int fds[2];
+        pthread_t s;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+        assert_se(pthread_create(&s, NULL, server, FD_TO_PTR(fds[0])) == 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[1], fds[1]) >= 0);
+        assert_se(sd_bus_negotiate_fds(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        /* Most of these will end up in the write queue, since we are still authenticating */
+        for (unsigned i = 0; i < N_MESSAGES; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                assert_se(sd_bus_message_new_signal(bus, &m, "/", "org.freedesktop.systemd.test", "Batch") >= 0);
+                assert_se(sd_bus_message_append(m, "u", i) >= 0);
+
+                if (carries_fd(i)) {
+                        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+                        char buf[DECIMAL_STR_MAX(unsigned)];
+
+                        assert_se(pipe2(pipe_fds, O_CLOEXEC) >= 0);
+                        xsprintf(buf, "%u", i);
+                        assert_se(write(pipe_fds[1], buf, strlen(buf)) == (ssize_t) strlen(buf));
+
+                        assert_se(sd_bus_message_append(m, "h", pipe_fds[0]) >= 0);
+                }
+
+                assert_se(sd_bus_send(bus, m, NULL) >= 0);
+        }
+
+        assert_se(sd_bus_flush(bus) >= 0);
+        assert_se(pthread_join(s, NULL) == 0);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
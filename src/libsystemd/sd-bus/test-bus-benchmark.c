@@ -17,6 +17,36 @@
 
 #define MAX_SIZE (2*1024*1024)
 
+#define N_ALLOCATION_CALLS 1000U
+
+#if defined(__GLIBC__) && !HAS_FEATURE_ADDRESS_SANITIZER && !HAS_FEATURE_MEMORY_SANITIZER
+/* Count heap allocations, so that we can report how many are needed per message */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static uint64_t n_allocations = 0;
+
+void *malloc(size_t size) {
+        n_allocations++;
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+        n_allocations++;
+        return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+        n_allocations++;
+        return __libc_realloc(p, size);
+}
+
+#  define HAVE_ALLOCATION_COUNTER 1
+#else
+#  define HAVE_ALLOCATION_COUNTER 0
+#endif
+
 static usec_t arg_loop_usec = 100 * USEC_PER_MSEC;
 
 typedef enum Type {
@@ -73,6 +103,20 @@ static void transaction(sd_bus *b, size_t sz, const char *server_name) {
         assert_se(sd_bus_call(b, m, 0, NULL, &reply) >= 0);
 }
 
+static void report_allocations(sd_bus *b, const char *server_name) {
+#if HAVE_ALLOCATION_COUNTER
+        uint64_t n;
+
+        /* Each call is two messages, the method call and its reply */
+        n = n_allocations;
+        for (unsigned i = 0; i < N_ALLOCATION_CALLS; i++)
+                assert_se(sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL) >= 0);
+        n = n_allocations - n;
+
+        printf("Allocations per message: %.2f\n", (double) n / (2 * N_ALLOCATION_CALLS));
+#endif
+}
+
 static void client_bisect(const char *address, const char *server_name) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *x = NULL;
         size_t lsize, rsize, csize;
@@ -91,6 +135,8 @@ static void client_bisect(const char *address, const char *server_name) {
         r = sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL);
         assert_se(r >= 0);
 
+        report_allocations(b, server_name);
+
         lsize = 1;
         rsize = MAX_SIZE;
 
@@ -173,6 +219,8 @@ static void client_chart(Type type, const char *address, const char *server_name
         r = sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL);
         assert_se(r >= 0);
 
+        report_allocations(b, server_name);
+
         switch (type) {
         case TYPE_LEGACY:
                 printf("SIZE\tLEGACY\n");
@@ -2,6 +2,7 @@
 
 #include "bus-introspect.h"
 #include "log.h"
+#include "string-util.h"
 #include "tests.h"
 
 #include "test-vtable-data.h"
@@ -21,6 +22,18 @@ static void test_manual_introspection_one(const sd_bus_vtable vtable[]) {
 
         fputs(s, stdout);
         fputs("\n", stdout);
+
+        /* Pre-rendered interfaces must result in exactly the same output */
+        _cleanup_free_ char *rendered = NULL, *t = NULL;
+
+        assert_se(introspect_render_interface(vtable, false, &rendered) >= 0);
+
+        assert_se(introspect_begin(&intro, false) >= 0);
+        assert_se(introspect_write_interface_rendered(&intro, "org.foo", rendered) >= 0);
+        assert_se(introspect_write_interface_rendered(&intro, "org.foo.bar", rendered) >= 0);
+        assert_se(introspect_finish(&intro, &t) == 0);
+
+        assert_se(streq(s, t));
 }
 
 TEST(manual_introspection) {
@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-message.h"
+#include "fd-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Measures building, sealing and parsing of typical messages without any IO, i.e. only the marshalling
+ * code. Unlike test-bus-benchmark, which measures the throughput of a connection and needs to be run by
+ * hand, this doesn't depend on anything and is reproducible. SYSTEMD_SLOW_TESTS=1 runs ten times as many
+ * iterations. */
+
+#define N_UNITS 200U
+
+/* A PropertiesChanged signal as PID 1 sends it for every unit state change */
+static void build_properties_changed(sd_bus *bus, sd_bus_message **ret) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/org/freedesktop/systemd1/unit/benchmark_2eservice",
+                                            "org.freedesktop.DBus.Properties", "PropertiesChanged") >= 0);
+        assert_se(sd_bus_message_append(m, "s", "org.freedesktop.systemd1.Unit") >= 0);
+        assert_se(sd_bus_message_append(m, "a{sv}", 10,
+                                        "ActiveState", "s", "active",
+                                        "SubState", "s", "running",
+                                        "StateChangeTimestamp", "t", UINT64_C(1672531200000000),
+                                        "StateChangeTimestampMonotonic", "t", UINT64_C(12345678),
+                                        "InactiveExitTimestamp", "t", UINT64_C(1672531199000000),
+                                        "InactiveExitTimestampMonotonic", "t", UINT64_C(12345000),
+                                        "ActiveEnterTimestamp", "t", UINT64_C(1672531200000000),
+                                        "ActiveEnterTimestampMonotonic", "t", UINT64_C(12345678),
+                                        "ConditionResult", "b", true,
+                                        "Job", "(uo)", 0, "/") >= 0);
+        assert_se(sd_bus_message_append(m, "as", 2, "ActiveExitTimestamp", "InactiveEnterTimestamp") >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        *ret = TAKE_PTR(m);
+}
+
+static void read_properties_changed(sd_bus_message *m) {
+        const char *interface, *name;
+        unsigned n = 0;
+
+        assert_se(sd_bus_message_read(m, "s", &interface) >= 0);
+        assert_se(sd_bus_message_enter_container(m, 'a', "{sv}") > 0);
+        while (sd_bus_message_enter_container(m, 'e', "sv") > 0) {
+                assert_se(sd_bus_message_read(m, "s", &name) >= 0);
+                assert_se(sd_bus_message_skip(m, "v") >= 0);
+                assert_se(sd_bus_message_exit_container(m) >= 0);
+                n++;
+        }
+        assert_se(sd_bus_message_exit_container(m) >= 0);
+        assert_se(sd_bus_message_skip(m, "as") >= 0);
+        assert_se(n == 10);
+}
+
+/* A reply to ListUnits() on a small system */
+static void build_list_units(sd_bus *bus, sd_bus_message **ret) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *call = NULL, *m = NULL;
+
+        assert_se(sd_bus_message_new_method_call(bus, &call, "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
+                                                 "org.freedesktop.systemd1.Manager", "ListUnits") >= 0);
+        assert_se(sd_bus_message_seal(call, 1, 0) >= 0);
+
+        assert_se(sd_bus_message_new_method_return(call, &m) >= 0);
+        assert_se(sd_bus_message_open_container(m, 'a', "(ssssssouso)") >= 0);
+        for (unsigned i = 0; i < N_UNITS; i++) {
+                char name[STRLEN("benchmark-.service") + DECIMAL_STR_MAX(unsigned)],
+                        path[STRLEN("/org/freedesktop/systemd1/unit/benchmark_2d_2eservice") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "benchmark-%u.service", i);
+                xsprintf(path, "/org/freedesktop/systemd1/unit/benchmark_2d%u_2eservice", i);
+
+                assert_se(sd_bus_message_append(m, "(ssssssouso)",
+                                                name, "Benchmark Service", "loaded", "active", "running", "",
+                                                path, 0, "", "/") >= 0);
+        }
+        assert_se(sd_bus_message_close_container(m) >= 0);
+        assert_se(sd_bus_message_seal(m, 2, 0) >= 0);
+
+        *ret = TAKE_PTR(m);
+}
+
+static void read_list_units(sd_bus_message *m) {
+        const char *name, *description, *load_state, *active_state, *sub_state, *following, *path, *job_type,
+                *job_path;
+        uint32_t job_id;
+        unsigned n = 0;
+
+        assert_se(sd_bus_message_enter_container(m, 'a', "(ssssssouso)") > 0);
+        while (sd_bus_message_read(m, "(ssssssouso)", &name, &description, &load_state, &active_state,
+                                   &sub_state, &following, &path, &job_id, &job_type, &job_path) > 0)
+                n++;
+        assert_se(sd_bus_message_exit_container(m) >= 0);
+        assert_se(n == N_UNITS);
+}
+
+static void benchmark(
+                sd_bus *bus,
+                const char *what,
+                void (*build)(sd_bus *bus, sd_bus_message **ret),
+                void (*read)(sd_bus_message *m),
+                unsigned n_iterations) {
+
+        _cleanup_free_ void *blob = NULL;
+        usec_t t, marshal, unmarshal;
+        size_t size;
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                build(bus, &m);
+        }
+        marshal = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                build(bus, &m);
+                assert_se(bus_message_get_blob(m, &blob, &size) >= 0);
+        }
+
+        /* The copy of the received data is part of the cost of every incoming message, hence measure it
+         * too */
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                _cleanup_free_ void *b = NULL;
+
+                assert_se(b = memdup(blob, size));
+                assert_se(bus_message_from_malloc(bus, b, size, NULL, 0, NULL, &m) >= 0);
+                TAKE_PTR(b);
+
+                read(m);
+        }
+        unmarshal = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("%s: %zu bytes, marshal %" PRIu64 "ns, unmarshal %" PRIu64 "ns per message",
+                 what, size, marshal * NSEC_PER_USEC / n_iterations, unmarshal * NSEC_PER_USEC / n_iterations);
+        benchmark_report(marshal * NSEC_PER_USEC / n_iterations, "ns", "%s/marshal", what);
+        benchmark_report(unmarshal * NSEC_PER_USEC / n_iterations, "ns", "%s/unmarshal", what);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_bus_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int fds[2] = { -1, -1 };
+        unsigned n;
+
+        test_setup_logging(LOG_INFO);
+
+        n = slow_tests_enabled() ? 100000 : 10000;
+
+        /* Messages can only be created on a bus that is started, but nothing is ever sent on it */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[0], fds[0]) >= 0);
+        TAKE_FD(fds[0]);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        benchmark(bus, "properties_changed", build_properties_changed, read_properties_changed, n);
+        benchmark(bus, "list_units", build_list_units, read_list_units, n / 10);
+
+        return 0;
+}
@@ -6,7 +6,9 @@
 #include "log.h"
 #include "macro.h"
 #include "memory-util.h"
+#include "stdio-util.h"
 #include "tests.h"
+#include "time-util.h"
 
 static bool mask[32];
 
@@ -66,6 +68,101 @@ static void test_match_scope(const char *match, enum bus_match_scope scope) {
         bus_match_parse_free(components, n_components);
 }
 
+static unsigned n_counted;
+
+static int count_filter(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        n_counted++;
+        return 0;
+}
+
+static sd_bus_message *benchmark_message(sd_bus *bus, unsigned i, const char *arg1) {
+        sd_bus_message *m;
+        char path[STRLEN("/org/freedesktop/systemd1/unit/u") + DECIMAL_STR_MAX(unsigned)],
+             arg0[STRLEN("org.example.u.sub") + DECIMAL_STR_MAX(unsigned)],
+             arg1_buf[STRLEN("/org/example/u/x") + DECIMAL_STR_MAX(unsigned)];
+
+        xsprintf(path, "/org/freedesktop/systemd1/unit/u%u", i);
+        xsprintf(arg0, "org.example.u%u.sub", i);
+        xsprintf(arg1_buf, "/org/example/u%u/x", i);
+
+        assert_se(sd_bus_message_new_signal(bus, &m, path, "org.freedesktop.DBus.Properties", "PropertiesChanged") >= 0);
+        assert_se(sd_bus_message_append(m, "ss", arg0, arg1 ?: arg1_buf) >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        return m;
+}
+
+static void test_match_benchmark(sd_bus *bus) {
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+        _cleanup_free_ sd_bus_slot *slots = NULL;
+        unsigned n, n_messages = 1000;
+        usec_t t;
+
+        /* Installs lots of rules on distinct paths, the way clients watching PropertiesChanged of many
+         * units do, and measures how long dispatching a message takes. Each message matches exactly one
+         * rule, which only stays cheap if the compare nodes are looked up by hash rather than scanned. */
+
+        n = slow_tests_enabled() ? 100000 : 10000;
+        assert_se(slots = new0(sd_bus_slot, n));
+
+        for (unsigned i = 0; i < n; i++) {
+                struct bus_match_component *components;
+                unsigned n_components;
+                char match[STRLEN("type='signal',interface='org.freedesktop.DBus.Properties',member='PropertiesChanged',path='/org/freedesktop/systemd1/unit/u'") + DECIMAL_STR_MAX(unsigned) + 1];
+
+                switch (i % 4) {
+                case 0:
+                        xsprintf(match, "type='signal',interface='org.freedesktop.DBus.Properties',member='PropertiesChanged',path='/org/freedesktop/systemd1/unit/u%u'", i);
+                        break;
+                case 1:
+                        xsprintf(match, "type='signal',path_namespace='/org/freedesktop/systemd1/unit/u%u'", i);
+                        break;
+                case 2:
+                        xsprintf(match, "type='signal',arg0namespace='org.example.u%u'", i);
+                        break;
+                case 3:
+                        xsprintf(match, "type='signal',arg1path='/org/example/u%u/'", i);
+                        break;
+                }
+
+                assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+                slots[i].match_callback.callback = count_filter;
+                assert_se(bus_match_add(&root, components, n_components, &slots[i].match_callback) >= 0);
+                bus_match_parse_free(components, n_components);
+        }
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (unsigned k = 0; k < n_messages; k++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                /* Spread the messages over all four kinds of rules */
+                m = benchmark_message(bus, k * (n / n_messages) + k % 4, NULL);
+
+                n_counted = 0;
+                assert_se(bus_match_run(NULL, &root, m) == 0);
+                assert_se(n_counted == 1);
+        }
+
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+        log_info("Dispatched %u messages against %u matches in %s.", n_messages, n, FORMAT_TIMESPAN(t, 1));
+
+        /* A path ending in a slash matches all arg1path= rules below it */
+        {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                m = benchmark_message(bus, n, "/org/example/");
+
+                n_counted = 0;
+                assert_se(bus_match_run(NULL, &root, m) == 0);
+                assert_se(n_counted == n / 4);
+        }
+
+        bus_match_free(&root);
+}
+
 int main(int argc, char *argv[]) {
         struct bus_match_node root = {
                 .type = BUS_MATCH_ROOT,
@@ -134,6 +231,8 @@ int main(int argc, char *argv[]) {
 
         bus_match_free(&root);
 
+        test_match_benchmark(bus);
+
         test_match_scope("interface='foobar'", BUS_MATCH_GENERIC);
         test_match_scope("", BUS_MATCH_GENERIC);
         test_match_scope("interface='org.freedesktop.DBus.Local'", BUS_MATCH_LOCAL);
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "sd-bus.h"
+
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "fd-util.h"
+#include "memfd-util.h"
+#include "tests.h"
+
+/* Sends a large memfd-backed array with memfd passing negotiated, and checks that it arrives intact, was
+ * passed as fd rather than inline, and that the rest of the body around it is still in the right place. */
+
+#define ARRAY_SIZE (1024U * 1024U)
+
+static uint8_t pattern(size_t i) {
+        return (uint8_t) (i * 7 + i / 4096);
+}
+
+static void *server(void *p) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        sd_id128_t id;
+        int r;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, PTR_TO_FD(p), PTR_TO_FD(p)) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+        assert_se(bus_negotiate_memfd(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        for (;;) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                struct bus_body_part *part;
+                const uint8_t *a;
+                const char *s;
+                size_t sz;
+                unsigned i;
+                bool found = false;
+
+                r = sd_bus_process(bus, &m);
+                assert_se(r >= 0);
+                if (r == 0) {
+                        assert_se(sd_bus_wait(bus, UINT64_MAX) >= 0);
+                        continue;
+                }
+                if (!m || !sd_bus_message_is_signal(m, "org.freedesktop.systemd.test", "Memfd"))
+                        continue;
+
+                assert_se(m->n_passed_memfds == 1);
+                MESSAGE_FOREACH_PART(part, i, m)
+                        if (part->passed_as_fd) {
+                                assert_se(part->size == ARRAY_SIZE);
+                                found = true;
+                        }
+                assert_se(found);
+
+                assert_se(sd_bus_message_read(m, "s", &s) >= 0);
+                assert_se(streq(s, "before"));
+
+                assert_se(sd_bus_message_read_array(m, 'y', (const void**) &a, &sz) >= 0);
+                assert_se(sz == ARRAY_SIZE);
+                for (size_t j = 0; j < sz; j++)
+                        assert_se(a[j] == pattern(j));
+
+                assert_se(sd_bus_message_read(m, "s", &s) >= 0);
+                assert_se(streq(s, "after"));
+                assert_se(sd_bus_message_at_end(m, true) > 0);
+
+                return NULL;
+        }
+}
+
+TEST(memfd_pass) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_close_ int memfd = -1;
+        int fds[2];
+        pthread_t s;
+        uint8_t *a;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+        assert_se(pthread_create(&s, NULL, server, FD_TO_PTR(fds[0])) == 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[1], fds[1]) >= 0);
+        assert_se(bus_negotiate_memfd(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        /* Wait for the authentication to finish, so that we know whether memfds may be passed */
+        while (!IN_SET(bus->state, BUS_RUNNING, BUS_HELLO))
+                assert_se(sd_bus_process(bus, NULL) >= 0 && sd_bus_wait(bus, UINT64_MAX) >= 0);
+        assert_se(bus->can_memfd);
+
+        memfd = memfd_new_and_map("test-memfd-pass", ARRAY_SIZE, (void**) &a);
+        assert_se(memfd >= 0);
+        for (size_t j = 0; j < ARRAY_SIZE; j++)
+                a[j] = pattern(j);
+        assert_se(munmap(a, ARRAY_SIZE) >= 0);
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/", "org.freedesktop.systemd.test", "Memfd") >= 0);
+        assert_se(sd_bus_message_append(m, "s", "before") >= 0);
+        assert_se(sd_bus_message_append_array_memfd(m, 'y', memfd, 0, ARRAY_SIZE) >= 0);
+        assert_se(sd_bus_message_append(m, "s", "after") >= 0);
+        assert_se(sd_bus_send(bus, m, NULL) >= 0);
+
+        /* The array is not part of what goes over the socket */
+        assert_se(m->n_passed_memfds == 1);
+        assert_se(BUS_MESSAGE_SIZE(m) < ARRAY_SIZE);
+
+        assert_se(sd_bus_flush(bus) >= 0);
+        assert_se(pthread_join(s, NULL) == 0);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
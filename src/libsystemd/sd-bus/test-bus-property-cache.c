@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+
+#include "sd-bus.h"
+
+#include "bus-internal.h"
+#include "fd-util.h"
+#include "tests.h"
+
+/* Checks that GetAll() replies are served from the cache for properties that announce their changes, as long
+ * as the generation of the object doesn't change, while the others are always retrieved anew, and that the
+ * order of the properties in the reply is the same either way. */
+
+static uint32_t value_a = 1, value_b = 2, value_c = 3;
+static uint64_t generation = 1;
+static bool quit = false;
+
+static int method_quit(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        quit = true;
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("A", "u", NULL, PTR_TO_SIZE(&value_a), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_ABSOLUTE_OFFSET),
+        SD_BUS_PROPERTY("B", "u", NULL, PTR_TO_SIZE(&value_b), SD_BUS_VTABLE_ABSOLUTE_OFFSET),
+        SD_BUS_PROPERTY("C", "u", NULL, PTR_TO_SIZE(&value_c), SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION|SD_BUS_VTABLE_ABSOLUTE_OFFSET),
+        SD_BUS_METHOD("Quit", NULL, NULL, method_quit, 0),
+        SD_BUS_VTABLE_END,
+};
+
+static uint64_t get_generation(sd_bus *bus, const char *path, void *userdata) {
+        return generation;
+}
+
+static void *server(void *p) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        sd_id128_t id;
+        int r;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, PTR_TO_FD(p), PTR_TO_FD(p)) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/test", "org.freedesktop.systemd.test", vtable, NULL) >= 0);
+        assert_se(bus_set_property_cache(bus, get_generation, NULL) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        while (!quit) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, UINT64_MAX) >= 0);
+        }
+
+        return NULL;
+}
+
+static void check_get_all(sd_bus *bus, uint32_t a, uint32_t b, uint32_t c) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        const char *names[] = { "A", "B", "C" };
+        uint32_t values[] = { a, b, c };
+
+        assert_se(sd_bus_call_method(bus, NULL, "/test", "org.freedesktop.DBus.Properties", "GetAll",
+                                     NULL, &reply, "s", "org.freedesktop.systemd.test") >= 0);
+
+        assert_se(sd_bus_message_enter_container(reply, 'a', "{sv}") > 0);
+        for (size_t i = 0; i < ELEMENTSOF(names); i++) {
+                const char *name;
+                uint32_t v;
+
+                assert_se(sd_bus_message_read(reply, "{sv}", &name, "u", &v) > 0);
+                assert_se(streq(name, names[i]));
+                assert_se(v == values[i]);
+        }
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+        assert_se(sd_bus_message_at_end(reply, true) > 0);
+}
+
+TEST(property_cache) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        int fds[2];
+        pthread_t s;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+        assert_se(pthread_create(&s, NULL, server, FD_TO_PTR(fds[0])) == 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[1], fds[1]) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        check_get_all(bus, 1, 2, 3);
+
+        /* Without a new generation only the property that does not announce changes is retrieved anew. The
+         * server thread only reads these while processing our calls, which are synchronous. */
+        value_a = 10;
+        value_b = 20;
+        value_c = 30;
+        check_get_all(bus, 1, 20, 3);
+
+        generation++;
+        check_get_all(bus, 10, 20, 30);
+
+        value_b = 200;
+        check_get_all(bus, 10, 200, 30);
+
+        assert_se(sd_bus_call_method(bus, NULL, "/test", "org.freedesktop.systemd.test", "Quit", NULL, NULL, NULL) >= 0);
+        assert_se(pthread_join(s, NULL) == 0);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+
+#include "sd-bus.h"
+
+#include "fd-util.h"
+#include "string-util.h"
+#include "tests.h"
+
+/* Calls a method a couple of times and checks that the peer accounts for them, and reports that through
+ * org.freedesktop.DBus.Debug.Stats.GetStats(). */
+
+#define N_CALLS 5U
+
+static bool quit = false;
+
+static int method_ping(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int method_quit(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        quit = true;
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Ping", NULL, NULL, method_ping, 0),
+        SD_BUS_METHOD("Quit", NULL, NULL, method_quit, 0),
+        SD_BUS_VTABLE_END,
+};
+
+static void *server(void *p) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        sd_id128_t id;
+        int r;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, PTR_TO_FD(p), PTR_TO_FD(p)) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/test", "org.freedesktop.systemd.test", vtable, NULL) >= 0);
+        assert_se(sd_bus_set_statistics(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        while (!quit) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, UINT64_MAX) >= 0);
+        }
+
+        return NULL;
+}
+
+static void check_histogram(sd_bus_message *m, uint64_t n) {
+        const uint64_t *buckets;
+        uint64_t k, total, max, sum = 0;
+        size_t sz;
+
+        assert_se(sd_bus_message_enter_container(m, 'r', "tttat") > 0);
+        assert_se(sd_bus_message_read(m, "ttt", &k, &total, &max) > 0);
+        assert_se(sd_bus_message_read_array(m, 't', (const void**) &buckets, &sz) > 0);
+        assert_se(sd_bus_message_exit_container(m) >= 0);
+
+        for (size_t i = 0; i < sz / sizeof(uint64_t); i++)
+                sum += buckets[i];
+
+        assert_se(k == n);
+        assert_se(sum == n);
+        assert_se(max <= total);
+}
+
+TEST(statistics) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        uint64_t n_received = 0;
+        bool found = false;
+        int fds[2];
+        pthread_t s;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+        assert_se(pthread_create(&s, NULL, server, FD_TO_PTR(fds[0])) == 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[1], fds[1]) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        for (unsigned i = 0; i < N_CALLS; i++)
+                assert_se(sd_bus_call_method(bus, NULL, "/test", "org.freedesktop.systemd.test", "Ping", NULL, NULL, NULL) >= 0);
+
+        assert_se(sd_bus_call_method(bus, NULL, "/", "org.freedesktop.DBus.Debug.Stats", "GetStats", NULL, &reply, NULL) >= 0);
+
+        assert_se(sd_bus_message_enter_container(reply, 'a', "{sv}") > 0);
+        for (;;) {
+                const char *name;
+                int r;
+
+                r = sd_bus_message_enter_container(reply, 'e', "sv");
+                assert_se(r >= 0);
+                if (r == 0)
+                        break;
+
+                assert_se(sd_bus_message_read(reply, "s", &name) > 0);
+
+                if (streq(name, "MessagesReceived"))
+                        assert_se(sd_bus_message_read(reply, "v", "t", &n_received) > 0);
+                else if (streq(name, "Members")) {
+                        const char *member;
+
+                        assert_se(sd_bus_message_enter_container(reply, 'v', "a(s(tttat)(tttat))") > 0);
+                        assert_se(sd_bus_message_enter_container(reply, 'a', "(s(tttat)(tttat))") > 0);
+
+                        while (sd_bus_message_enter_container(reply, 'r', "s(tttat)(tttat)") > 0) {
+                                assert_se(sd_bus_message_read(reply, "s", &member) > 0);
+
+                                if (streq(member, "org.freedesktop.systemd.test.Ping")) {
+                                        check_histogram(reply, N_CALLS);
+                                        check_histogram(reply, N_CALLS);
+                                        found = true;
+                                } else
+                                        assert_se(sd_bus_message_skip(reply, "(tttat)(tttat)") >= 0);
+
+                                assert_se(sd_bus_message_exit_container(reply) >= 0);
+                        }
+
+                        assert_se(sd_bus_message_exit_container(reply) >= 0);
+                        assert_se(sd_bus_message_exit_container(reply) >= 0);
+                } else
+                        assert_se(sd_bus_message_skip(reply, "v") >= 0);
+
+                assert_se(sd_bus_message_exit_container(reply) >= 0);
+        }
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+
+        assert_se(found);
+
+        /* The pings and GetStats() itself, possibly also Hello() or so */
+        assert_se(n_received >= N_CALLS + 1);
+
+        assert_se(sd_bus_call_method(bus, NULL, "/test", "org.freedesktop.systemd.test", "Quit", NULL, NULL, NULL) >= 0);
+        assert_se(pthread_join(s, NULL) == 0);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
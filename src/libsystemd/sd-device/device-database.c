@@ -0,0 +1,368 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-database.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "sort-util.h"
+#include "string-util.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+
+/* The modification time of a directory has the granularity of the kernel's timer ticks, hence a change
+ * made right after the snapshot was taken might not change it. Do not take a snapshot of a directory
+ * which was modified more recently than this. */
+#define DEVICE_DATABASE_SETTLE_USEC (100 * USEC_PER_MSEC)
+
+typedef struct DatabaseFile {
+        char *id;
+        char *data;
+        size_t size;
+} DatabaseFile;
+
+typedef struct DatabaseFiles {
+        DatabaseFile *files;
+        size_t n_files;
+} DatabaseFiles;
+
+static void database_files_done(DatabaseFiles *d) {
+        assert(d);
+
+        for (size_t i = 0; i < d->n_files; i++) {
+                free(d->files[i].id);
+                free(d->files[i].data);
+        }
+
+        d->files = mfree(d->files);
+        d->n_files = 0;
+}
+
+static int database_file_compare(const DatabaseFile *a, const DatabaseFile *b) {
+        return strcmp(a->id, b->id);
+}
+
+static bool dir_stat_equal(const struct stat *a, const struct stat *b) {
+        return a->st_ino == b->st_ino &&
+                timespec_load_nsec(&a->st_mtim) == timespec_load_nsec(&b->st_mtim);
+}
+
+int device_database_snapshot_write(const char *dir, const char *path) {
+        _cleanup_(database_files_done) DatabaseFiles d = {};
+        _cleanup_(unlink_and_freep) char *path_tmp = NULL;
+        _cleanup_closedir_ DIR *dirp = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        struct device_database_header_f h = {
+                .signature = DEVICE_DATABASE_SIG,
+                .header_size = htole64(sizeof(struct device_database_header_f)),
+                .entry_size = htole64(sizeof(struct device_database_entry_f)),
+                .entries_off = htole64(sizeof(struct device_database_header_f)),
+        };
+        struct stat st, st_after;
+        uint64_t off;
+        int r;
+
+        assert(dir);
+        assert(path);
+
+        /* Returns -EAGAIN if the database was changed recently or while the snapshot was taken, in which
+         * case this should be tried again later. */
+
+        dirp = opendir(dir);
+        if (!dirp)
+                return -errno;
+
+        if (fstat(dirfd(dirp), &st) < 0)
+                return -errno;
+
+        if (usec_add(timespec_load(&st.st_mtim), DEVICE_DATABASE_SETTLE_USEC) > now(CLOCK_REALTIME))
+                return -EAGAIN;
+
+        /* Temporary files of device_update_db() are hidden, and hence skipped here. */
+        FOREACH_DIRENT(de, dirp, return -errno) {
+                _cleanup_free_ char *id = NULL, *data = NULL;
+                size_t size;
+
+                if (de->d_type != DT_REG)
+                        continue;
+
+                r = read_full_file_full(dirfd(dirp), de->d_name, UINT64_MAX, SIZE_MAX, 0, NULL, &data, &size);
+                if (r == -ENOENT) /* Removed in the meantime? Then the check below fails anyway. */
+                        continue;
+                if (r < 0)
+                        return r;
+
+                id = strdup(de->d_name);
+                if (!id)
+                        return -ENOMEM;
+
+                if (!GREEDY_REALLOC(d.files, d.n_files + 1))
+                        return -ENOMEM;
+
+                d.files[d.n_files++] = (DatabaseFile) {
+                        .id = TAKE_PTR(id),
+                        .data = TAKE_PTR(data),
+                        .size = size,
+                };
+        }
+
+        if (fstat(dirfd(dirp), &st_after) < 0)
+                return -errno;
+
+        if (!dir_stat_equal(&st, &st_after))
+                return -EAGAIN;
+
+        typesafe_qsort(d.files, d.n_files, database_file_compare);
+
+        h.dir_inode = htole64(st.st_ino);
+        h.dir_mtime_nsec = htole64(timespec_load_nsec(&st.st_mtim));
+        h.n_entries = htole64(d.n_files);
+
+        off = sizeof(struct device_database_header_f) + d.n_files * sizeof(struct device_database_entry_f);
+        for (size_t i = 0; i < d.n_files; i++)
+                off += strlen(d.files[i].id) + 1 + d.files[i].size;
+        h.file_size = htole64(off);
+
+        r = fopen_temporary(path, &f, &path_tmp);
+        if (r < 0)
+                return r;
+
+        if (fchmod(fileno(f), 0644) < 0)
+                return -errno;
+
+        fwrite(&h, sizeof(h), 1, f);
+
+        off = sizeof(struct device_database_header_f) + d.n_files * sizeof(struct device_database_entry_f);
+        for (size_t i = 0; i < d.n_files; i++) {
+                struct device_database_entry_f e = {
+                        .id_off = htole64(off),
+                        .data_off = htole64(off + strlen(d.files[i].id) + 1),
+                        .data_len = htole64(d.files[i].size),
+                };
+
+                fwrite(&e, sizeof(e), 1, f);
+                off += strlen(d.files[i].id) + 1 + d.files[i].size;
+        }
+
+        for (size_t i = 0; i < d.n_files; i++) {
+                fwrite(d.files[i].id, strlen(d.files[i].id) + 1, 1, f);
+                fwrite(d.files[i].data, d.files[i].size, 1, f);
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        if (rename(path_tmp, path) < 0)
+                return -errno;
+
+        path_tmp = mfree(path_tmp);
+
+        log_debug("sd-device: Wrote snapshot of %zu db files in %s to %s.", d.n_files, dir, path);
+        return 0;
+}
+
+typedef struct DatabaseSnapshot {
+        char *path;
+
+        /* The mapped snapshot, and the file it was mapped from */
+        const uint8_t *map;
+        size_t size;
+        ino_t inode;
+        nsec_t mtime;
+
+        /* The last state of the database directory which the snapshot was found not to be taken of, so
+         * that the snapshot is not looked at again as long as the directory is in that state. */
+        ino_t stale_dir_inode;
+        nsec_t stale_dir_mtime;
+} DatabaseSnapshot;
+
+static thread_local DatabaseSnapshot snapshot = {};
+
+void device_database_snapshot_unmap(void) {
+        if (snapshot.map)
+                (void) munmap((void*) snapshot.map, snapshot.size);
+
+        free(snapshot.path);
+        snapshot = (DatabaseSnapshot) {};
+}
+
+static const struct device_database_header_f* snapshot_header(void) {
+        return (const struct device_database_header_f*) snapshot.map;
+}
+
+static bool snapshot_matches(const char *path, const struct stat *st) {
+        return snapshot.map &&
+                streq_ptr(snapshot.path, path) &&
+                le64toh(snapshot_header()->dir_inode) == (uint64_t) st->st_ino &&
+                le64toh(snapshot_header()->dir_mtime_nsec) == timespec_load_nsec(&st->st_mtim);
+}
+
+static int snapshot_map(const char *path) {
+        static const uint8_t sig[] = DEVICE_DATABASE_SIG;
+        const struct device_database_header_f *h;
+        _cleanup_close_ int fd = -1;
+        uint64_t entries_off, n_entries, entry_size;
+        struct stat st;
+        void *map;
+
+        assert(path);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (snapshot.map &&
+            streq_ptr(snapshot.path, path) &&
+            snapshot.inode == st.st_ino &&
+            snapshot.mtime == timespec_load_nsec(&st.st_mtim))
+                return 0; /* Mapped already */
+
+        if (st.st_size < (off_t) sizeof(struct device_database_header_f))
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "sd-device: Database snapshot %s is too short.", path);
+        if (file_offset_beyond_memory_size(st.st_size))
+                return log_debug_errno(SYNTHETIC_ERRNO(EFBIG), "sd-device: Database snapshot %s is too long.", path);
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return log_debug_errno(errno, "sd-device: Failed to map database snapshot %s: %m", path);
+
+        h = map;
+        entries_off = le64toh(h->entries_off);
+        n_entries = le64toh(h->n_entries);
+        entry_size = le64toh(h->entry_size);
+
+        if (memcmp(h->signature, sig, sizeof(h->signature)) != 0 ||
+            le64toh(h->file_size) != (uint64_t) st.st_size ||
+            le64toh(h->header_size) < sizeof(struct device_database_header_f) ||
+            entry_size < sizeof(struct device_database_entry_f) ||
+            entries_off > (uint64_t) st.st_size ||
+            n_entries > ((uint64_t) st.st_size - entries_off) / entry_size) {
+                (void) munmap(map, st.st_size);
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "sd-device: Failed to recognize the format of %s.", path);
+        }
+
+        device_database_snapshot_unmap();
+
+        snapshot = (DatabaseSnapshot) {
+                .path = strdup(path),
+                .map = map,
+                .size = st.st_size,
+                .inode = st.st_ino,
+                .mtime = timespec_load_nsec(&st.st_mtim),
+        };
+        if (!snapshot.path) {
+                device_database_snapshot_unmap();
+                return -ENOMEM;
+        }
+
+        return 0;
+}
+
+static const struct device_database_entry_f* snapshot_entry(uint64_t i) {
+        const struct device_database_header_f *h = snapshot_header();
+
+        return (const struct device_database_entry_f*)
+                (snapshot.map + le64toh(h->entries_off) + i * le64toh(h->entry_size));
+}
+
+static const char* snapshot_string(uint64_t off) {
+        if (off >= snapshot.size || !memchr(snapshot.map + off, 0, snapshot.size - off))
+                return NULL;
+
+        return (const char*) snapshot.map + off;
+}
+
+int device_database_snapshot_lookup(const char *dir, const char *path, const char *id, char **ret_data, size_t *ret_size) {
+        const struct device_database_entry_f *e = NULL;
+        uint64_t left, right, data_off, data_len;
+        struct stat st;
+        char *data;
+        int r;
+
+        assert(dir);
+        assert(path);
+        assert(id);
+        assert(ret_data);
+        assert(ret_size);
+
+        /* Returns 1 and a copy of the database entry of the device if the snapshot is current and contains
+         * it, 0 if the snapshot is current and the device has no database entry, and -ESTALE if the
+         * snapshot is not current or does not exist, in which case the database file needs to be read. */
+
+        if (stat(dir, &st) < 0)
+                return -errno;
+
+        if (!snapshot_matches(path, &st)) {
+                if (streq_ptr(snapshot.path, path) &&
+                    snapshot.stale_dir_inode == st.st_ino &&
+                    snapshot.stale_dir_mtime == timespec_load_nsec(&st.st_mtim))
+                        return -ESTALE;
+
+                r = snapshot_map(path);
+                if (r < 0 && r != -ENOENT)
+                        log_debug_errno(r, "sd-device: Failed to open database snapshot %s, ignoring: %m", path);
+
+                if (!snapshot_matches(path, &st)) {
+                        if (!streq_ptr(snapshot.path, path)) {
+                                device_database_snapshot_unmap();
+                                snapshot.path = strdup(path);
+                                if (!snapshot.path)
+                                        return -ENOMEM;
+                        }
+
+                        snapshot.stale_dir_inode = st.st_ino;
+                        snapshot.stale_dir_mtime = timespec_load_nsec(&st.st_mtim);
+                        return -ESTALE;
+                }
+        }
+
+        /* Binary search for the ID */
+        left = 0;
+        right = le64toh(snapshot_header()->n_entries);
+        while (left < right) {
+                const struct device_database_entry_f *m;
+                uint64_t i = left + (right - left) / 2;
+                const char *s;
+                int c;
+
+                m = snapshot_entry(i);
+                s = snapshot_string(le64toh(m->id_off));
+                if (!s)
+                        return -EBADMSG;
+
+                c = strcmp(id, s);
+                if (c == 0) {
+                        e = m;
+                        break;
+                }
+                if (c < 0)
+                        right = i;
+                else
+                        left = i + 1;
+        }
+
+        if (!e)
+                return 0;
+
+        data_off = le64toh(e->data_off);
+        data_len = le64toh(e->data_len);
+        if (data_off > snapshot.size || data_len > snapshot.size - data_off)
+                return -EBADMSG;
+
+        data = memdup_suffix0(snapshot.map + data_off, data_len);
+        if (!data)
+                return -ENOMEM;
+
+        *ret_data = data;
+        *ret_size = data_len;
+        return 1;
+}
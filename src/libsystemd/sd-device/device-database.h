@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stddef.h>
+
+#include "macro.h"
+#include "sparse-endian.h"
+
+/* A snapshot of the udev database, i.e. of all files in /run/udev/data/, in a single file. It is written
+ * by udevd once the event queue has been empty for a while, and mapped by readers, which then look up the
+ * database entries of devices in it rather than opening a file for each of them. As the database files
+ * are replaced by renaming a new file over them, any change to the database changes the modification
+ * time of the directory, and the snapshot is only used as long as that is the same as when the snapshot
+ * was taken. */
+
+#define DEVICE_DATABASE_DIR      "/run/udev/data"
+#define DEVICE_DATABASE_SNAPSHOT "/run/udev/data.snapshot"
+
+#define DEVICE_DATABASE_SIG { 'U', 'D', 'E', 'V', 'D', 'B', 'S', '1' }
+
+/* on-disk objects */
+struct device_database_header_f {
+        uint8_t signature[8];
+        le64_t file_size;
+        le64_t header_size;
+        le64_t entry_size;
+
+        /* the database directory the snapshot was taken of */
+        le64_t dir_inode;
+        le64_t dir_mtime_nsec;
+
+        /* array of entries sorted by device ID */
+        le64_t entries_off;
+        le64_t n_entries;
+} _packed_;
+
+struct device_database_entry_f {
+        /* NUL terminated device ID, e.g. "b8:0" */
+        le64_t id_off;
+        /* contents of the database file */
+        le64_t data_off;
+        le64_t data_len;
+} _packed_;
+
+int device_database_snapshot_write(const char *dir, const char *path);
+int device_database_snapshot_lookup(const char *dir, const char *path, const char *id, char **ret_data, size_t *ret_size);
+void device_database_snapshot_unmap(void);
@@ -10,6 +10,7 @@
 #include "device-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "path-util.h"
 #include "set.h"
 #include "sort-util.h"
 #include "string-util.h"
@@ -46,6 +47,9 @@ struct sd_device_enumerator {
         Set *match_tag;
         Set *match_parent;
         MatchInitializedType match_initialized;
+
+        /* The directories above the scanned devices which have been looked at already while scanning */
+        Set *parents_checked;
 };
 
 _public_ int sd_device_enumerator_new(sd_device_enumerator **ret) {
@@ -79,6 +83,7 @@ static void device_enumerator_unref_devices(sd_device_enumerator *enumerator) {
         assert(enumerator);
 
         hashmap_clear_with_destructor(enumerator->devices_by_syspath, sd_device_unref);
+        set_clear(enumerator->parents_checked);
         device_unref_many(enumerator->devices, enumerator->n_devices);
         enumerator->devices = mfree(enumerator->devices);
         enumerator->n_devices = 0;
@@ -90,6 +95,7 @@ static sd_device_enumerator *device_enumerator_free(sd_device_enumerator *enumer
         device_enumerator_unref_devices(enumerator);
 
         hashmap_free(enumerator->devices_by_syspath);
+        set_free(enumerator->parents_checked);
         strv_free(enumerator->prioritized_subsystems);
         set_free(enumerator->match_subsystem);
         set_free(enumerator->nomatch_subsystem);
@@ -594,23 +600,63 @@ static int enumerator_add_parent_devices(
                 sd_device *device,
                 bool ignore_parent_match) {
 
+        _cleanup_free_ char *path = NULL;
+        const char *syspath;
         int k, r = 0;
 
         assert(enumerator);
         assert(device);
 
+        /* Walks up the directories above the device rather than calling sd_device_get_parent(), so that
+         * directories which were looked at for an earlier device during the same scan are recognized
+         * before a device object is created for them: many devices share their parents, and creating the
+         * object, i.e. resolving the path and reading the uevent file, is what the walk is spending its
+         * time on. The remembered directories are only used when the parent matches are applied, as
+         * those decide which parents have been added. */
+
+        r = sd_device_get_syspath(device, &syspath);
+        if (r < 0)
+                return r;
+
         for (;;) {
+                _cleanup_(sd_device_unrefp) sd_device *parent = NULL;
+                _cleanup_free_ char *p = NULL;
                 const char *ss, *usn;
 
-                k = sd_device_get_parent(device, &device);
-                if (k == -ENOENT) /* Reached the top? */
+                k = path_extract_directory(path ?: syspath, &p);
+                if (k < 0) {
+                        r = k;
+                        break;
+                }
+
+                if (path_equal(p, "/sys")) /* Reached the top? */
                         break;
+
+                if (hashmap_contains(enumerator->devices_by_syspath, p))
+                        break; /* Exists already? Then no need to go further up. */
+
+                if (!ignore_parent_match) {
+                        if (set_contains(enumerator->parents_checked, p))
+                                break; /* Checked already, together with everything above it. */
+
+                        k = set_put_strdup(&enumerator->parents_checked, p);
+                        if (k < 0) {
+                                r = k;
+                                break;
+                        }
+                }
+
+                free_and_replace(path, p);
+
+                k = sd_device_new_from_syspath(&parent, path);
+                if (k == -ENODEV) /* Not a device, e.g. a class directory below a virtual device? */
+                        continue;
                 if (k < 0) {
                         r = k;
                         break;
                 }
 
-                k = sd_device_get_subsystem(device, &ss);
+                k = sd_device_get_subsystem(parent, &ss);
                 if (k == -ENOENT) /* Has no subsystem? */
                         continue;
                 if (k < 0) {
@@ -621,7 +667,7 @@ static int enumerator_add_parent_devices(
                 if (!match_subsystem(enumerator, ss))
                         continue;
 
-                k = sd_device_get_sysname(device, &usn);
+                k = sd_device_get_sysname(parent, &usn);
                 if (k < 0) {
                         r = k;
                         break;
@@ -630,7 +676,7 @@ static int enumerator_add_parent_devices(
                 if (!match_sysname(enumerator, usn))
                         continue;
 
-                k = test_matches(enumerator, device, ignore_parent_match);
+                k = test_matches(enumerator, parent, ignore_parent_match);
                 if (k < 0) {
                         r = k;
                         break;
@@ -638,7 +684,7 @@ static int enumerator_add_parent_devices(
                 if (k == 0)
                         continue;
 
-                k = device_enumerator_add_device(enumerator, device);
+                k = device_enumerator_add_device(enumerator, parent);
                 if (k < 0) {
                         r = k;
                         break;
@@ -25,10 +25,15 @@ int device_get_devnode_mode(sd_device *device, mode_t *ret);
 int device_get_devnode_uid(sd_device *device, uid_t *ret);
 int device_get_devnode_gid(sd_device *device, gid_t *ret);
 
+void device_shared_sysattr_cache_enable(size_t max_entries);
+void device_shared_sysattr_cache_flush(void);
+void device_shared_sysattr_cache_invalidate(const char *syspath);
+
 int device_cache_sysattr_value(sd_device *device, const char *key, char *value);
 int device_get_cached_sysattr_value(sd_device *device, const char *key, const char **ret_value);
 
 void device_seal(sd_device *device);
+void device_set_parent(sd_device *device, sd_device *parent);
 void device_set_is_initialized(sd_device *device);
 int device_set_watch_handle(sd_device *device, int wd);
 void device_set_db_persist(sd_device *device);
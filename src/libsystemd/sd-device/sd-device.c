@@ -9,6 +9,7 @@
 
 #include "alloc-util.h"
 #include "chase-symlinks.h"
+#include "device-database.h"
 #include "device-internal.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -912,6 +913,17 @@ _public_ int sd_device_get_parent(sd_device *child, sd_device **ret) {
         return 0;
 }
 
+void device_set_parent(sd_device *device, sd_device *parent) {
+        assert(device);
+
+        /* Sets the parent, e.g. one that was looked up for an earlier device and whose attributes have
+         * been read already, instead of looking it up again when it is requested. */
+
+        sd_device_unref(device->parent);
+        device->parent = sd_device_ref(parent);
+        device->parent_set = true;
+}
+
 int device_set_subsystem(sd_device *device, const char *subsystem) {
         _cleanup_free_ char *s = NULL;
         int r;
@@ -1482,10 +1494,8 @@ int device_get_device_id(sd_device *device, const char **ret) {
         return 0;
 }
 
-int device_read_db_internal_filename(sd_device *device, const char *filename) {
-        _cleanup_free_ char *db = NULL;
+static int device_parse_db(sd_device *device, char *db, size_t db_len) {
         const char *value;
-        size_t db_len;
         char key = '\0';  /* Unnecessary initialization to appease gcc-12.0.0-0.4.fc36 */
         int r;
 
@@ -1498,15 +1508,7 @@ int device_read_db_internal_filename(sd_device *device, const char *filename) {
         } state = PRE_KEY;
 
         assert(device);
-        assert(filename);
-
-        r = read_full_file(filename, &db, &db_len);
-        if (r < 0) {
-                if (r == -ENOENT)
-                        return 0;
-
-                return log_device_debug_errno(device, r, "sd-device: Failed to read db '%s': %m", filename);
-        }
+        assert(db || db_len == 0);
 
         /* devices with a database entry are initialized */
         device->is_initialized = true;
@@ -1565,8 +1567,29 @@ int device_read_db_internal_filename(sd_device *device, const char *filename) {
         return 0;
 }
 
+int device_read_db_internal_filename(sd_device *device, const char *filename) {
+        _cleanup_free_ char *db = NULL;
+        size_t db_len;
+        int r;
+
+        assert(device);
+        assert(filename);
+
+        r = read_full_file(filename, &db, &db_len);
+        if (r < 0) {
+                if (r == -ENOENT)
+                        return 0;
+
+                return log_device_debug_errno(device, r, "sd-device: Failed to read db '%s': %m", filename);
+        }
+
+        return device_parse_db(device, db, db_len);
+}
+
 int device_read_db_internal(sd_device *device, bool force) {
+        _cleanup_free_ char *db = NULL;
         const char *id, *path;
+        size_t db_len;
         int r;
 
         assert(device);
@@ -1578,7 +1601,17 @@ int device_read_db_internal(sd_device *device, bool force) {
         if (r < 0)
                 return r;
 
-        path = strjoina("/run/udev/data/", id);
+        /* Look at the snapshot of the whole database first, which avoids opening the file of each device
+         * when going through many of them, e.g. when enumerating. */
+        r = device_database_snapshot_lookup(DEVICE_DATABASE_DIR, DEVICE_DATABASE_SNAPSHOT, id, &db, &db_len);
+        if (r == 0)
+                return 0;
+        if (r > 0)
+                return device_parse_db(device, db, db_len);
+        if (!IN_SET(r, -ESTALE, -ENOENT))
+                log_device_debug_errno(device, r, "sd-device: Failed to look up db in snapshot, ignoring: %m");
+
+        path = strjoina(DEVICE_DATABASE_DIR "/", id);
 
         return device_read_db_internal_filename(device, path);
 }
@@ -2044,6 +2077,143 @@ _public_ int sd_device_get_trigger_uuid(sd_device *device, sd_id128_t *ret) {
         return 0;
 }
 
+/* Attribute values shared by all device objects of the thread, keyed by syspath and then by attribute. This is
+ * off by default, and meant for processes like udev workers, which create new device objects for the same
+ * devices again and again, and know when the attributes of a device may have changed. */
+static thread_local Hashmap *shared_sysattr_values = NULL;
+static thread_local size_t shared_sysattr_values_size = 0, shared_sysattr_values_max = 0;
+
+DEFINE_PRIVATE_HASH_OPS_FULL(shared_sysattr_hash_ops, char, path_hash_func, path_compare, free,
+                             Hashmap, hashmap_free_free_free);
+
+void device_shared_sysattr_cache_flush(void) {
+        shared_sysattr_values = hashmap_free(shared_sysattr_values);
+        shared_sysattr_values_size = 0;
+}
+
+void device_shared_sysattr_cache_enable(size_t max_entries) {
+        /* Takes the maximum number of cached values, 0 disables the cache. */
+
+        shared_sysattr_values_max = max_entries;
+        if (shared_sysattr_values_size > max_entries)
+                device_shared_sysattr_cache_flush();
+}
+
+void device_shared_sysattr_cache_invalidate(const char *syspath) {
+        _cleanup_free_ char *key = NULL;
+        Hashmap *values;
+
+        assert(syspath);
+
+        values = hashmap_remove2(shared_sysattr_values, syspath, (void**) &key);
+        if (!values)
+                return;
+
+        assert(shared_sysattr_values_size >= hashmap_size(values));
+        shared_sysattr_values_size -= hashmap_size(values);
+        hashmap_free_free_free(values);
+}
+
+static int shared_sysattr_cache_get(const char *syspath, const char *sysattr, const char **ret_value) {
+        const char *k = NULL, *value;
+
+        assert(syspath);
+        assert(sysattr);
+        assert(ret_value);
+
+        /* Same return values as device_get_cached_sysattr_value() */
+
+        value = hashmap_get2(hashmap_get(shared_sysattr_values, syspath), sysattr, (void**) &k);
+        if (!k)
+                return -ESTALE;
+        if (!value)
+                return -ENOENT;
+
+        *ret_value = value;
+        return 0;
+}
+
+static void shared_sysattr_cache_put(const char *syspath, const char *sysattr, const char *value) {
+        _cleanup_free_ char *k = NULL, *v = NULL;
+        Hashmap *values;
+        int r;
+
+        assert(syspath);
+        assert(sysattr);
+
+        /* This is best effort, the value (which may be NULL for attributes which do not exist) is copied. */
+
+        if (shared_sysattr_values_max == 0)
+                return;
+
+        /* Make room by dropping the values of whole devices, in no particular order. */
+        while (shared_sysattr_values_size >= shared_sysattr_values_max) {
+                _cleanup_free_ char *key = NULL;
+
+                values = hashmap_steal_first_key_and_value(shared_sysattr_values, (void**) &key);
+                if (!values)
+                        break;
+
+                shared_sysattr_values_size -= hashmap_size(values);
+                hashmap_free_free_free(values);
+        }
+
+        values = hashmap_get(shared_sysattr_values, syspath);
+        if (!values) {
+                _cleanup_hashmap_free_ Hashmap *h = NULL;
+                _cleanup_free_ char *p = NULL;
+
+                h = hashmap_new(&string_hash_ops);
+                if (!h)
+                        return;
+
+                p = strdup(syspath);
+                if (!p)
+                        return;
+
+                r = hashmap_ensure_put(&shared_sysattr_values, &shared_sysattr_hash_ops, p, h);
+                if (r < 0)
+                        return;
+
+                TAKE_PTR(p);
+                values = TAKE_PTR(h);
+        }
+
+        k = strdup(sysattr);
+        if (!k)
+                return;
+
+        if (value) {
+                v = strdup(value);
+                if (!v)
+                        return;
+        }
+
+        r = hashmap_put(values, k, v);
+        if (r <= 0)
+                return;
+
+        TAKE_PTR(k);
+        TAKE_PTR(v);
+        shared_sysattr_values_size++;
+}
+
+static void shared_sysattr_cache_remove(const char *syspath, const char *sysattr) {
+        _cleanup_free_ char *k = NULL;
+        Hashmap *values;
+
+        assert(syspath);
+        assert(sysattr);
+
+        values = hashmap_get(shared_sysattr_values, syspath);
+        if (!values)
+                return;
+
+        free(hashmap_remove2(values, sysattr, (void**) &k));
+        if (k)
+                shared_sysattr_values_size--;
+}
+
 int device_cache_sysattr_value(sd_device *device, const char *key, char *value) {
         _unused_ _cleanup_free_ char *old_value = NULL;
         _cleanup_free_ char *new_key = NULL;
@@ -2092,7 +2262,7 @@ int device_get_cached_sysattr_value(sd_device *device, const char *key, const ch
  * with a NULL value in the cache, otherwise the returned string is stored */
 _public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr, const char **ret_value) {
         _cleanup_free_ char *value = NULL;
-        const char *path, *syspath;
+        const char *path, *syspath, *cached;
         struct stat statbuf;
         int r;
 
@@ -2108,11 +2278,24 @@ _public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr,
         if (r < 0)
                 return r;
 
+        /* then for the values read through other objects of the same device */
+        r = shared_sysattr_cache_get(syspath, sysattr, &cached);
+        if (r >= 0) {
+                value = strdup(cached);
+                if (!value)
+                        return -ENOMEM;
+
+                goto cache;
+        }
+
         path = prefix_roota(syspath, sysattr);
-        if (lstat(path, &statbuf) < 0) {
+        if (r == -ENOENT || lstat(path, &statbuf) < 0) {
                 int k;
 
-                r = -errno;
+                if (r != -ENOENT) {
+                        r = -errno;
+                        shared_sysattr_cache_put(syspath, sysattr, NULL);
+                }
 
                 /* remember that we could not access the sysattr */
                 k = device_cache_sysattr_value(device, sysattr, NULL);
@@ -2151,6 +2334,9 @@ _public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr,
                         value[size] = '\0';
         }
 
+        shared_sysattr_cache_put(syspath, sysattr, value);
+
+cache:
         /* Unfortunately, we need to return 'const char*' instead of 'char*'. Hence, failure in caching
          * sysattr value is critical unlike the other places. */
         r = device_cache_sysattr_value(device, sysattr, value);
@@ -2160,8 +2346,12 @@ _public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr,
                                        sysattr, value, ret_value ? "" : ", ignoring");
                 if (ret_value)
                         return r;
-        } else if (ret_value)
-                *ret_value = TAKE_PTR(value);
+        } else {
+                /* The cache owns the value now */
+                if (ret_value)
+                        *ret_value = value;
+                TAKE_PTR(value);
+        }
 
         return 0;
 }
@@ -2186,6 +2376,10 @@ _public_ int sd_device_set_sysattr_value(sd_device *device, const char *sysattr,
 
         /* Set the attribute and save it in the cache. */
 
+        if (device->syspath)
+                /* The kernel may report something else than what was written, hence just forget it. */
+                shared_sysattr_cache_remove(device->syspath, sysattr);
+
         if (!_value) {
                 /* If input value is NULL, then clear cache and not write anything. */
                 device_remove_cached_sysattr_value(device, sysattr);
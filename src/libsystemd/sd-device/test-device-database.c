@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "device-database.h"
+#include "fileio.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static void set_dir_mtime(const char *dir, usec_t ago) {
+        struct timespec ts[2];
+
+        /* Pretend the directory was last modified a while ago, as snapshots are not taken of directories
+         * which were modified just now. */
+        timespec_store(&ts[0], usec_sub_unsigned(now(CLOCK_REALTIME), ago));
+        ts[1] = ts[0];
+        assert_se(utimensat(AT_FDCWD, dir, ts, 0) >= 0);
+}
+
+static void test_lookup_one(const char *dir, const char *path, const char *id, const char *expected) {
+        _cleanup_free_ char *data = NULL;
+        size_t size;
+
+        assert_se(device_database_snapshot_lookup(dir, path, id, &data, &size) == !!expected);
+        if (expected) {
+                assert_se(size == strlen(expected));
+                assert_se(streq(data, expected));
+        }
+}
+
+TEST(snapshot) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmp = NULL;
+        _cleanup_free_ char *dir = NULL, *path = NULL, *data = NULL;
+        size_t size;
+
+        assert_se(mkdtemp_malloc("/tmp/test-device-database-XXXXXX", &tmp) >= 0);
+        assert_se(dir = path_join(tmp, "data"));
+        assert_se(path = path_join(tmp, "data.snapshot"));
+        assert_se(mkdir(dir, 0755) >= 0);
+
+        assert_se(write_string_file(strjoina(dir, "/b8:0"), "S:disk/by-id/foo\nE:ID_FOO=1\nV:1", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(write_string_file(strjoina(dir, "/n1"), "I:123456\nV:1", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(write_string_file(strjoina(dir, "/c1:3"), "", WRITE_STRING_FILE_CREATE) >= 0);
+
+        /* Modified just now */
+        assert_se(device_database_snapshot_write(dir, path) == -EAGAIN);
+        assert_se(device_database_snapshot_lookup(dir, path, "b8:0", &data, &size) == -ESTALE);
+
+        set_dir_mtime(dir, 10 * USEC_PER_SEC);
+        assert_se(device_database_snapshot_write(dir, path) >= 0);
+
+        test_lookup_one(dir, path, "b8:0", "S:disk/by-id/foo\nE:ID_FOO=1\nV:1\n");
+        test_lookup_one(dir, path, "n1", "I:123456\nV:1\n");
+        test_lookup_one(dir, path, "c1:3", "\n");
+        test_lookup_one(dir, path, "b8:1", NULL);
+        test_lookup_one(dir, path, "+usb:1-1", NULL);
+
+        /* Any change of the database makes the snapshot stale */
+        assert_se(write_string_file(strjoina(dir, "/b8:1"), "V:1", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(device_database_snapshot_lookup(dir, path, "b8:0", &data, &size) == -ESTALE);
+        assert_se(device_database_snapshot_lookup(dir, path, "b8:1", &data, &size) == -ESTALE);
+
+        set_dir_mtime(dir, 5 * USEC_PER_SEC);
+        assert_se(device_database_snapshot_write(dir, path) >= 0);
+        test_lookup_one(dir, path, "b8:0", "S:disk/by-id/foo\nE:ID_FOO=1\nV:1\n");
+        test_lookup_one(dir, path, "b8:1", "V:1\n");
+
+        /* A broken snapshot is not used */
+        device_database_snapshot_unmap();
+        assert_se(write_string_file(path, "garbage", WRITE_STRING_FILE_TRUNCATE) >= 0);
+        assert_se(device_database_snapshot_lookup(dir, path, "b8:0", &data, &size) == -ESTALE);
+
+        device_database_snapshot_unmap();
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
@@ -349,4 +349,31 @@ TEST(sd_device_new_from_nulstr) {
         }
 }
 
+TEST(shared_sysattr_cache) {
+        _cleanup_(sd_device_unrefp) sd_device *a = NULL, *b = NULL;
+        const char *syspath, *x, *y;
+
+        device_shared_sysattr_cache_enable(2);
+
+        assert_se(sd_device_new_from_syspath(&a, "/sys/class/net/lo") >= 0);
+        assert_se(sd_device_new_from_syspath(&b, "/sys/class/net/lo") >= 0);
+
+        /* Read through one object, looked up in the cache through the other */
+        assert_se(sd_device_get_sysattr_value(a, "ifindex", &x) >= 0);
+        assert_se(sd_device_get_sysattr_value(a, "no-such-attribute", NULL) == -ENOENT);
+        assert_se(sd_device_get_sysattr_value(b, "ifindex", &y) >= 0);
+        assert_se(streq(x, y));
+        assert_se(x != y);
+        assert_se(sd_device_get_sysattr_value(b, "no-such-attribute", NULL) == -ENOENT);
+
+        /* More than fit */
+        assert_se(sd_device_get_sysattr_value(a, "mtu", NULL) >= 0);
+        assert_se(sd_device_get_sysattr_value(a, "address", NULL) >= 0);
+
+        assert_se(sd_device_get_syspath(a, &syspath) >= 0);
+        device_shared_sysattr_cache_invalidate(syspath);
+        device_shared_sysattr_cache_invalidate(syspath);
+        device_shared_sysattr_cache_enable(0);
+}
+
 DEFINE_TEST_MAIN(LOG_INFO);
@@ -7,6 +7,7 @@
 
 #include "sd-event.h"
 
+#include "event-util.h"
 #include "hashmap.h"
 #include "inotify-util.h"
 #include "list.h"
@@ -27,6 +28,7 @@ typedef enum EventSourceType {
         SOURCE_EXIT,
         SOURCE_WATCHDOG,
         SOURCE_INOTIFY,
+        SOURCE_QUEUE,
         _SOURCE_EVENT_SOURCE_TYPE_MAX,
         _SOURCE_EVENT_SOURCE_TYPE_INVALID = -EINVAL,
 } EventSourceType;
@@ -69,6 +71,7 @@ struct sd_event_source {
         unsigned prepare_index;
         uint64_t pending_iteration;
         uint64_t prepare_iteration;
+        uint64_t dispatch_iteration;
 
         sd_event_destroy_t destroy_callback;
         sd_event_handler_t ratelimit_expire_callback;
@@ -77,11 +80,19 @@ struct sd_event_source {
 
         RateLimit rate_limit;
 
+        /* When this source was last marked pending, and what it cost us to dispatch it so far */
+        usec_t pending_usec;
+        EventSourceStatistics statistics;
+
         /* These are primarily fields relevant for time event sources, but since any event source can
          * effectively become one when rate-limited, this is part of the common fields. */
         unsigned earliest_index;
         unsigned latest_index;
 
+        /* Time event sources with a coarse accuracy are kept in a timer bucket instead of the prioqs */
+        struct timer_bucket *timer_bucket;
+        LIST_FIELDS(sd_event_source, timer_bucket);
+
         union {
                 struct {
                         sd_event_io_handler_t callback;
@@ -128,9 +139,32 @@ struct sd_event_source {
                         struct inode_data *inode_data;
                         LIST_FIELDS(sd_event_source, by_inode_data);
                 } inotify;
+                struct {
+                        sd_event_queue_handler_t callback;
+                        int fd; /* eventfd, signalled when the first item is posted to an empty queue */
+                        bool registered:1;
+                        /* Items posted from other threads, pushed atomically, in reverse order */
+                        struct event_queue_item *posted;
+                        /* Items taken over by the event loop thread, but not dispatched yet, in order */
+                        struct event_queue_item *ready;
+                } queue;
         };
 };
 
+struct event_queue_item {
+        struct event_queue_item *next;
+        void *data;
+};
+
+/* A set of time event sources whose latest dispatch time falls into the same TIMER_BUCKET_USEC long slot */
+struct timer_bucket {
+        uint64_t slot;
+        unsigned queue_index;
+
+        LIST_HEAD(sd_event_source, sources);
+        LIST_FIELDS(struct timer_bucket, spare);
+};
+
 struct clock_data {
         WakeupType wakeup;
         int fd;
@@ -146,6 +180,15 @@ struct clock_data {
         Prioq *latest;
         usec_t next;
 
+        /* Time event sources with a coarse accuracy are not kept in the two prioqs, but in buckets indexed
+         * by the slot their latest time falls into, so that moving them around in time is O(1) as long as
+         * they stay in the same slot. Only the buckets themselves are ordered in a prioq. One bucket object
+         * is preallocated for each time event source, so that none of this can fail with ENOMEM. */
+        Hashmap *buckets;
+        Prioq *bucket_queue;
+        LIST_HEAD(struct timer_bucket, spare_buckets);
+        unsigned n_spare_buckets;
+
         bool needs_rearm:1;
 };
 
@@ -0,0 +1,579 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+#include "alloc-util.h"
+#include "errno-util.h"
+#include "event-uring.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "list.h"
+#include "log.h"
+#include "missing_syscall.h"
+
+#if HAVE_LINUX_IO_URING_H && defined(IORING_FEAT_EXT_ARG)
+
+#define URING_SQ_ENTRIES 256U
+#define URING_CQ_ENTRIES 4096U
+
+#define URING_REQUIRED_FEATURES (IORING_FEAT_SINGLE_MMAP|IORING_FEAT_NODROP|IORING_FEAT_EXT_ARG)
+
+/* Used as user_data for requests whose completions we are not interested in, i.e. poll removals */
+#define URING_USER_DATA_IGNORE UINT64_C(0)
+
+typedef struct UringPoll UringPoll;
+
+struct UringPoll {
+        int fd;
+        uint32_t events;     /* The epoll event mask, including EPOLLET/EPOLLONESHOT */
+        void *data;          /* The epoll user data, NULL once the fd has been removed */
+
+        bool armed:1;        /* A poll request is queued in the submission ring or in flight in the kernel */
+        bool queued:1;       /* A poll request needs to be submitted on the next flush */
+
+        /* Either in the queue of polls to submit, or in the list of detached polls still in flight */
+        LIST_FIELDS(UringPoll, queue);
+};
+
+struct EventUring {
+        int fd;
+
+        void *ring;
+        size_t ring_size;
+        struct io_uring_sqe *sqes;
+        size_t sqes_size;
+
+        unsigned *sq_head, *sq_tail, *sq_array;
+        unsigned sq_mask, sq_entries;
+        unsigned *cq_head, *cq_tail;
+        unsigned cq_mask;
+        struct io_uring_cqe *cqes;
+
+        unsigned sq_tail_local;
+
+        Hashmap *polls; /* fd → UringPoll */
+        LIST_HEAD(UringPoll, queue);
+        LIST_HEAD(UringPoll, detached);
+
+        bool no_multishot:1;
+};
+
+static void uring_poll_enqueue(EventUring *u, UringPoll *p) {
+        assert(u);
+        assert(p);
+
+        if (p->queued)
+                return;
+
+        LIST_PREPEND(queue, u->queue, p);
+        p->queued = true;
+}
+
+static void uring_poll_dequeue(EventUring *u, UringPoll *p) {
+        assert(u);
+        assert(p);
+
+        if (!p->queued)
+                return;
+
+        LIST_REMOVE(queue, u->queue, p);
+        p->queued = false;
+}
+
+EventUring *event_uring_free(EventUring *u) {
+        UringPoll *p;
+
+        if (!u)
+                return NULL;
+
+        /* Closing the ring cancels all requests still in flight, hence we can free everything here. */
+        while ((p = hashmap_steal_first(u->polls))) {
+                uring_poll_dequeue(u, p);
+                free(p);
+        }
+        hashmap_free(u->polls);
+
+        while ((p = u->detached)) {
+                LIST_REMOVE(queue, u->detached, p);
+                free(p);
+        }
+
+        if (u->sqes)
+                (void) munmap(u->sqes, u->sqes_size);
+        if (u->ring)
+                (void) munmap(u->ring, u->ring_size);
+
+        safe_close(u->fd);
+        return mfree(u);
+}
+
+int event_uring_new(EventUring **ret) {
+        _cleanup_(event_uring_freep) EventUring *u = NULL;
+        struct io_uring_params p = {
+                .flags = IORING_SETUP_CQSIZE,
+                .cq_entries = URING_CQ_ENTRIES,
+        };
+        int r;
+
+        assert(ret);
+
+        u = new(EventUring, 1);
+        if (!u)
+                return -ENOMEM;
+
+        *u = (EventUring) {
+                .fd = -1,
+        };
+
+        r = RET_NERRNO(io_uring_setup(URING_SQ_ENTRIES, &p));
+        if (r < 0)
+                return r;
+
+        u->fd = fd_move_above_stdio(r);
+
+        /* We rely on the submission and completion rings sharing one mapping, on the kernel never dropping
+         * completions and on being able to pass a timeout to io_uring_enter(). That's kernel 5.11. */
+        if ((p.features & URING_REQUIRED_FEATURES) != URING_REQUIRED_FEATURES)
+                return -EOPNOTSUPP;
+
+        u->ring_size = MAX(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                           p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe));
+        u->ring = mmap(NULL, u->ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+        if (u->ring == MAP_FAILED) {
+                u->ring = NULL;
+                return -errno;
+        }
+
+        u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        u->sqes = mmap(NULL, u->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+        if (u->sqes == MAP_FAILED) {
+                u->sqes = NULL;
+                return -errno;
+        }
+
+        u->sq_head = (unsigned*) ((uint8_t*) u->ring + p.sq_off.head);
+        u->sq_tail = (unsigned*) ((uint8_t*) u->ring + p.sq_off.tail);
+        u->sq_array = (unsigned*) ((uint8_t*) u->ring + p.sq_off.array);
+        u->sq_mask = *(unsigned*) ((uint8_t*) u->ring + p.sq_off.ring_mask);
+        u->sq_entries = p.sq_entries;
+        u->cq_head = (unsigned*) ((uint8_t*) u->ring + p.cq_off.head);
+        u->cq_tail = (unsigned*) ((uint8_t*) u->ring + p.cq_off.tail);
+        u->cq_mask = *(unsigned*) ((uint8_t*) u->ring + p.cq_off.ring_mask);
+        u->cqes = (struct io_uring_cqe*) ((uint8_t*) u->ring + p.cq_off.cqes);
+
+        u->sq_tail_local = *u->sq_tail;
+
+        *ret = TAKE_PTR(u);
+        return 0;
+}
+
+int event_uring_get_fd(EventUring *u) {
+        assert(u);
+
+        return u->fd;
+}
+
+static unsigned uring_sq_pending(EventUring *u) {
+        assert(u);
+
+        return u->sq_tail_local - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static unsigned uring_cq_ready(EventUring *u) {
+        assert(u);
+
+        return __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) - *u->cq_head;
+}
+
+static int uring_submit(EventUring *u, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+        unsigned n;
+        int r;
+
+        assert(u);
+
+        n = uring_sq_pending(u);
+        if (n == 0 && !FLAGS_SET(flags, IORING_ENTER_GETEVENTS))
+                return 0;
+
+        r = RET_NERRNO(io_uring_enter(u->fd, n, min_complete, flags, arg, argsz));
+        if (r == -EBUSY)
+                /* The completion ring overflowed, and the kernel refuses new submissions until we reaped
+                 * completions. Those are left in the submission ring, and will be handed over again with
+                 * the next call. */
+                return 0;
+
+        return r;
+}
+
+static int uring_get_sqe(EventUring *u, struct io_uring_sqe **ret) {
+        unsigned idx;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        if (uring_sq_pending(u) >= u->sq_entries) {
+                r = uring_submit(u, 0, 0, NULL, 0);
+                if (r < 0)
+                        return r;
+                if (uring_sq_pending(u) >= u->sq_entries)
+                        return -EBUSY;
+        }
+
+        idx = u->sq_tail_local & u->sq_mask;
+        u->sqes[idx] = (struct io_uring_sqe) {};
+        u->sq_array[idx] = idx;
+
+        *ret = u->sqes + idx;
+        return 0;
+}
+
+static void uring_commit_sqe(EventUring *u) {
+        assert(u);
+
+        u->sq_tail_local++;
+        __atomic_store_n(u->sq_tail, u->sq_tail_local, __ATOMIC_RELEASE);
+}
+
+static int uring_arm_poll(EventUring *u, UringPoll *p) {
+        struct io_uring_sqe *sqe;
+        uint32_t mask;
+        int r;
+
+        assert(u);
+        assert(p);
+        assert(p->data);
+        assert(!p->armed);
+
+        r = uring_get_sqe(u, &sqe);
+        if (r < 0)
+                return r;
+
+        mask = p->events & ~(EPOLLET|EPOLLONESHOT);
+#if __BYTE_ORDER == __BIG_ENDIAN
+        mask = (mask << 16) | (mask >> 16);
+#endif
+
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = p->fd;
+        sqe->poll32_events = mask;
+        sqe->user_data = PTR_TO_UINT64(p);
+
+        /* Level-triggered fds get a one-shot poll that we re-arm after each completion, as the kernel checks
+         * the current readiness state when a poll is armed. That way we get exactly the epoll semantics. For
+         * edge-triggered fds a multishot poll is the natural fit, as it fires on each wakeup. */
+#ifdef IORING_POLL_ADD_MULTI
+        if (FLAGS_SET(p->events, EPOLLET) && !u->no_multishot)
+                sqe->len = IORING_POLL_ADD_MULTI;
+#endif
+
+        uring_commit_sqe(u);
+        p->armed = true;
+        return 0;
+}
+
+static int uring_cancel_poll(EventUring *u, UringPoll *p) {
+        struct io_uring_sqe *sqe;
+        int r;
+
+        assert(u);
+        assert(p);
+        assert(p->armed);
+
+        r = uring_get_sqe(u, &sqe);
+        if (r < 0)
+                return r;
+
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = PTR_TO_UINT64(p);
+        sqe->user_data = URING_USER_DATA_IGNORE;
+
+        uring_commit_sqe(u);
+        return 0;
+}
+
+static int uring_detach_poll(EventUring *u, UringPoll *p) {
+        assert(u);
+        assert(p);
+
+        /* Removes a poll from its fd. If there's no request in flight we can free it right away, otherwise
+         * we ask the kernel to cancel it, and free it once its final completion shows up. */
+
+        uring_poll_dequeue(u, p);
+        p->data = NULL;
+
+        if (!p->armed) {
+                free(p);
+                return 0;
+        }
+
+        LIST_PREPEND(queue, u->detached, p);
+
+        /* If this fails the request stays in flight until the fd triggers, and its completion will be
+         * ignored. The fd is removed from our table in any case. */
+        return uring_cancel_poll(u, p);
+}
+
+int event_uring_flush(EventUring *u) {
+        int r;
+
+        assert(u);
+
+        while (u->queue) {
+                UringPoll *p = u->queue;
+
+                r = uring_arm_poll(u, p);
+                if (r < 0)
+                        return r;
+
+                uring_poll_dequeue(u, p);
+        }
+
+        return uring_submit(u, 0, 0, NULL, 0);
+}
+
+int event_uring_ctl(EventUring *u, int op, int fd, const struct epoll_event *ev) {
+        _cleanup_free_ UringPoll *n = NULL;
+        struct stat st;
+        UringPoll *p;
+        int r;
+
+        assert(u);
+        assert(fd >= 0);
+
+        p = hashmap_get(u->polls, INT_TO_PTR(fd));
+
+        switch (op) {
+
+        case EPOLL_CTL_ADD:
+                assert(ev);
+
+                if (p)
+                        return -EEXIST;
+
+                /* epoll refuses fds that don't support polling, while poll requests would complete on them
+                 * immediately. Stay compatible, the callers rely on that. */
+                if (fstat(fd, &st) < 0)
+                        return -errno;
+                if (S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))
+                        return -EPERM;
+
+                n = new(UringPoll, 1);
+                if (!n)
+                        return -ENOMEM;
+
+                *n = (UringPoll) {
+                        .fd = fd,
+                        .events = ev->events,
+                        .data = ev->data.ptr,
+                };
+
+                r = hashmap_ensure_put(&u->polls, NULL, INT_TO_PTR(fd), n);
+                if (r < 0)
+                        return r;
+
+                uring_poll_enqueue(u, n);
+                TAKE_PTR(n);
+                return 0;
+
+        case EPOLL_CTL_MOD:
+                assert(ev);
+
+                if (!p)
+                        return -ENOENT;
+
+                if (p->armed) {
+                        /* The request in flight was set up with the old mask, hence replace it */
+                        n = new(UringPoll, 1);
+                        if (!n)
+                                return -ENOMEM;
+
+                        *n = (UringPoll) {
+                                .fd = fd,
+                                .events = ev->events,
+                                .data = ev->data.ptr,
+                        };
+
+                        assert_se(hashmap_replace(u->polls, INT_TO_PTR(fd), n) >= 0);
+                        (void) uring_detach_poll(u, p);
+
+                        uring_poll_enqueue(u, n);
+                        TAKE_PTR(n);
+                        return 0;
+                }
+
+                p->events = ev->events;
+                p->data = ev->data.ptr;
+                uring_poll_enqueue(u, p);
+                return 0;
+
+        case EPOLL_CTL_DEL:
+                if (!p)
+                        return -ENOENT;
+
+                assert_se(hashmap_remove(u->polls, INT_TO_PTR(fd)) == p);
+                return uring_detach_poll(u, p);
+
+        default:
+                return -EINVAL;
+        }
+}
+
+static size_t uring_reap(EventUring *u, struct epoll_event *events, size_t n_events) {
+        unsigned head, tail;
+        size_t m = 0;
+
+        assert(u);
+        assert(events || n_events == 0);
+
+        head = *u->cq_head;
+        tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail && m < n_events; head++) {
+                const struct io_uring_cqe *cqe = u->cqes + (head & u->cq_mask);
+                UringPoll *p;
+                bool final;
+
+                if (cqe->user_data == URING_USER_DATA_IGNORE)
+                        continue;
+
+                p = UINT64_TO_PTR(cqe->user_data);
+                final = !FLAGS_SET(cqe->flags, IORING_CQE_F_MORE);
+
+                if (final)
+                        p->armed = false;
+
+                if (!p->data) {
+                        /* This fd was removed in the meantime */
+                        if (final) {
+                                LIST_REMOVE(queue, u->detached, p);
+                                free(p);
+                        }
+                        continue;
+                }
+
+                if (cqe->res == -EINVAL && FLAGS_SET(p->events, EPOLLET) && !u->no_multishot) {
+                        /* Multishot polls were added in kernel 5.13, fall back to one-shot polls on older
+                         * kernels. */
+                        log_debug("sd-event: io_uring doesn't support multishot polls, using one-shot polls.");
+                        u->no_multishot = true;
+                        uring_poll_enqueue(u, p);
+                        continue;
+                }
+
+                if (cqe->res < 0) {
+                        /* Most likely the fd got closed without being removed first. epoll silently forgets
+                         * about such fds, hence do the same and don't re-arm. */
+                        if (cqe->res != -ECANCELED)
+                                log_debug_errno(cqe->res, "sd-event: io_uring poll on fd %i failed, not re-arming: %m", p->fd);
+                        continue;
+                }
+
+                events[m++] = (struct epoll_event) {
+                        .events = (uint32_t) cqe->res,
+                        .data.ptr = p->data,
+                };
+
+                /* Re-arm the poll, unless the fd was registered for a single event only, in which case it is
+                 * up to the caller to re-enable it with EPOLL_CTL_MOD. */
+                if (final && !FLAGS_SET(p->events, EPOLLONESHOT))
+                        uring_poll_enqueue(u, p);
+        }
+
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+        return m;
+}
+
+int event_uring_wait(EventUring *u, struct epoll_event *events, size_t n_events, usec_t timeout) {
+        usec_t until = USEC_INFINITY;
+        int r;
+
+        assert(u);
+        assert(events);
+        assert(n_events > 0);
+
+        if (timeout != USEC_INFINITY && timeout > 0)
+                until = usec_add(now(CLOCK_MONOTONIC), timeout);
+
+        for (;;) {
+                size_t m;
+
+                /* Convert the queued (re-)registrations into poll requests, they are submitted below
+                 * together with the wait itself. */
+                while (u->queue) {
+                        UringPoll *p = u->queue;
+
+                        r = uring_arm_poll(u, p);
+                        if (r < 0)
+                                return r;
+
+                        uring_poll_dequeue(u, p);
+                }
+
+                if (uring_cq_ready(u) > 0 || timeout == 0)
+                        /* Something to reap, or not supposed to wait: only submit, if we have anything */
+                        r = uring_submit(u, 0, 0, NULL, 0);
+                else if (timeout == USEC_INFINITY)
+                        r = uring_submit(u, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+                else {
+                        usec_t left = usec_sub_unsigned(until, now(CLOCK_MONOTONIC));
+                        struct __kernel_timespec ts = {
+                                .tv_sec = left / USEC_PER_SEC,
+                                .tv_nsec = (left % USEC_PER_SEC) * NSEC_PER_USEC,
+                        };
+                        struct io_uring_getevents_arg arg = {
+                                .ts = PTR_TO_UINT64(&ts),
+                        };
+
+                        r = uring_submit(u, 1, IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+                }
+                if (r < 0 && r != -ETIME)
+                        return r;
+
+                m = uring_reap(u, events, n_events);
+                if (m > 0 || timeout == 0)
+                        return (int) m;
+
+                /* Only completions we don't care about (e.g. of removed fds) showed up, but epoll_wait() only
+                 * returns early if there actually is an event to report. Let's wait again, for the time
+                 * that's left. */
+                if (timeout != USEC_INFINITY && now(CLOCK_MONOTONIC) >= until)
+                        return 0;
+        }
+}
+
+#else
+
+EventUring *event_uring_free(EventUring *u) {
+        assert(!u);
+        return NULL;
+}
+
+int event_uring_new(EventUring **ret) {
+        return -EOPNOTSUPP;
+}
+
+int event_uring_get_fd(EventUring *u) {
+        assert_not_reached();
+}
+
+int event_uring_ctl(EventUring *u, int op, int fd, const struct epoll_event *ev) {
+        assert_not_reached();
+}
+
+int event_uring_wait(EventUring *u, struct epoll_event *events, size_t n_events, usec_t timeout) {
+        assert_not_reached();
+}
+
+int event_uring_flush(EventUring *u) {
+        assert_not_reached();
+}
+
+#endif
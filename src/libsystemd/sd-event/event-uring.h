@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <sys/epoll.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+/* An alternative to epoll for the sd-event loop, built on io_uring poll requests. The interface
+ * deliberately mirrors epoll_ctl()/epoll_wait(), so that sd-event can pick either backend at
+ * sd_event_new() time without changing how event sources are registered or dispatched. Unlike epoll,
+ * registration changes are not applied synchronously, but are queued as submission entries and handed
+ * to the kernel together with the next wait, so that they don't cost a syscall of their own. */
+
+typedef struct EventUring EventUring;
+
+int event_uring_new(EventUring **ret);
+EventUring *event_uring_free(EventUring *u);
+DEFINE_TRIVIAL_CLEANUP_FUNC(EventUring*, event_uring_free);
+
+int event_uring_get_fd(EventUring *u);
+
+/* Same semantics as epoll_ctl(), but returns a negative errno on failure */
+int event_uring_ctl(EventUring *u, int op, int fd, const struct epoll_event *ev);
+
+/* Same semantics as epoll_wait(), but takes a timeout in µs and returns a negative errno on failure */
+int event_uring_wait(EventUring *u, struct epoll_event *events, size_t n_events, usec_t timeout);
+
+/* Hands all queued registration changes to the kernel, without waiting for completions */
+int event_uring_flush(EventUring *u);
@@ -109,6 +109,17 @@ int event_reset_time_relative(
         return event_reset_time(e, s, clock, usec_add(usec_now, usec), accuracy, callback, userdata, priority, description, force_reset);
 }
 
+void event_source_statistics_merge(EventSourceStatistics *a, const EventSourceStatistics *b) {
+        assert(a);
+        assert(b);
+
+        a->n_dispatched += b->n_dispatched;
+        a->runtime_usec = usec_add(a->runtime_usec, b->runtime_usec);
+        a->runtime_max_usec = MAX(a->runtime_max_usec, b->runtime_max_usec);
+        a->latency_usec = usec_add(a->latency_usec, b->latency_usec);
+        a->latency_max_usec = MAX(a->latency_max_usec, b->latency_max_usec);
+}
+
 int event_add_time_change(sd_event *e, sd_event_source **ret, sd_event_io_handler_t callback, void *userdata) {
         _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
         _cleanup_close_ int fd = -1;
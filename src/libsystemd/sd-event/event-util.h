@@ -5,6 +5,9 @@
 
 #include "sd-event.h"
 
+#include "hashmap.h"
+#include "time-util.h"
+
 int event_reset_time(
                 sd_event *e,
                 sd_event_source **s,
@@ -32,3 +35,23 @@ static inline int event_source_disable(sd_event_source *s) {
 }
 
 int event_add_time_change(sd_event *e, sd_event_source **ret, sd_event_io_handler_t callback, void *userdata);
+
+typedef struct EventSourceStatistics {
+        uint64_t n_dispatched;
+        usec_t runtime_usec;      /* Cumulative time spent in the callback */
+        usec_t runtime_max_usec;
+        usec_t latency_usec;      /* Cumulative time between the source becoming pending and its dispatch */
+        usec_t latency_max_usec;
+} EventSourceStatistics;
+
+void event_source_statistics_merge(EventSourceStatistics *a, const EventSourceStatistics *b);
+
+/* Returns a Hashmap, keyed by source description (or type, if no description is set), of
+ * EventSourceStatistics objects, covering both current sources and those already freed. */
+int event_get_statistics(sd_event *e, Hashmap **ret);
+
+/* Synchronously invokes the handler of a queue event source for every item posted to it so far, regardless
+ * of its enablement state and of the state of the event loop. Useful for not losing items when shutting
+ * down, after all threads posting to the source have been stopped. Returns the first error returned by
+ * the handler, but continues with the remaining items nonetheless. */
+int event_source_queue_drain(sd_event_source *s);
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/timerfd.h>
 #include <sys/wait.h>
 
@@ -11,6 +12,7 @@
 #include "alloc-util.h"
 #include "env-util.h"
 #include "event-source.h"
+#include "event-uring.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "glyph-util.h"
@@ -30,6 +32,12 @@
 
 #define DEFAULT_ACCURACY_USEC (250 * USEC_PER_MSEC)
 
+/* Time event sources with an accuracy of at least TIMER_BUCKET_ACCURACY_MIN_USEC are sorted into buckets
+ * of this width, by their latest time. Since the accuracy is at least twice the bucket width, the start of
+ * a bucket's slot is always within the dispatch window of each of its sources. */
+#define TIMER_BUCKET_USEC (500 * USEC_PER_MSEC)
+#define TIMER_BUCKET_ACCURACY_MIN_USEC (2 * TIMER_BUCKET_USEC)
+
 static bool EVENT_SOURCE_WATCH_PIDFD(sd_event_source *s) {
         /* Returns true if this is a PID event source and can be implemented by watching EPOLLIN */
         return s &&
@@ -62,6 +70,7 @@ static const char* const event_source_type_table[_SOURCE_EVENT_SOURCE_TYPE_MAX]
         [SOURCE_EXIT]                = "exit",
         [SOURCE_WATCHDOG]            = "watchdog",
         [SOURCE_INOTIFY]             = "inotify",
+        [SOURCE_QUEUE]               = "queue",
 };
 
 DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(event_source_type, int);
@@ -97,6 +106,9 @@ struct sd_event {
         int epoll_fd;
         int watchdog_fd;
 
+        /* Set if io_uring is used instead of epoll for waiting, see event-uring.h */
+        EventUring *uring;
+
         Prioq *pending;
         Prioq *prepare;
 
@@ -123,6 +135,9 @@ struct sd_event {
 
         Hashmap *inotify_data; /* indexed by priority */
 
+        /* Accumulated dispatch statistics of sources already freed, indexed by description */
+        Hashmap *retired_statistics;
+
         /* A list of inode structures that still have an fd open, that we need to close before the next loop iteration */
         LIST_HEAD(struct inode_data, inode_data_to_close_list);
 
@@ -139,6 +154,7 @@ struct sd_event {
         bool need_process_child:1;
         bool watchdog:1;
         bool profile_delays:1;
+        bool uring_fd_exported:1;
 
         int exit_code;
 
@@ -147,6 +163,9 @@ struct sd_event {
 
         usec_t watchdog_last, watchdog_period;
 
+        /* Maximum number of pending sources of the same priority to dispatch per iteration */
+        unsigned dispatch_batch;
+
         unsigned n_sources;
 
         struct epoll_event *event_queue;
@@ -166,6 +185,21 @@ static sd_event *event_resolve(sd_event *e) {
         return e == SD_EVENT_DEFAULT ? default_event : e;
 }
 
+static bool shall_use_io_uring(void) {
+        /* Opt-in for now, as the io_uring backend is not as widely tested as the epoll one. Also used in
+         * test-event.c to test the event loop once with and once without io_uring. */
+        return getenv_bool_secure("SYSTEMD_IO_URING") > 0;
+}
+
+static int event_poll_ctl(sd_event *e, int op, int fd, struct epoll_event *ev) {
+        assert(e);
+
+        if (e->uring)
+                return event_uring_ctl(e->uring, op, fd, ev);
+
+        return RET_NERRNO(epoll_ctl(e->epoll_fd, op, fd, ev));
+}
+
 static int pending_prioq_compare(const void *a, const void *b) {
         const sd_event_source *x = a, *y = b;
         int r;
@@ -293,6 +327,12 @@ static int latest_time_prioq_compare(const void *a, const void *b) {
         return time_prioq_compare(a, b, time_event_source_latest);
 }
 
+static int timer_bucket_compare(const void *a, const void *b) {
+        const struct timer_bucket *x = a, *y = b;
+
+        return CMP(x->slot, y->slot);
+}
+
 static int exit_prioq_compare(const void *a, const void *b) {
         const sd_event_source *x = a, *y = b;
         int r;
@@ -316,6 +356,13 @@ static void free_clock_data(struct clock_data *d) {
         safe_close(d->fd);
         prioq_free(d->earliest);
         prioq_free(d->latest);
+
+        /* All event sources are gone by now, hence all buckets are spare ones */
+        assert(hashmap_isempty(d->buckets));
+        hashmap_free(d->buckets);
+        prioq_free(d->bucket_queue);
+        LIST_FOREACH(spare, b, d->spare_buckets)
+                free(b);
 }
 
 static sd_event *event_free(sd_event *e) {
@@ -336,6 +383,7 @@ static sd_event *event_free(sd_event *e) {
 
         safe_close(e->epoll_fd);
         safe_close(e->watchdog_fd);
+        event_uring_free(e->uring);
 
         free_clock_data(&e->realtime);
         free_clock_data(&e->boottime);
@@ -355,6 +403,8 @@ static sd_event *event_free(sd_event *e) {
         hashmap_free(e->child_sources);
         set_free(e->post_sources);
 
+        hashmap_free(e->retired_statistics);
+
         free(e->event_queue);
 
         return mfree(e);
@@ -391,19 +441,28 @@ _public_ int sd_event_new(sd_event** ret) {
                 .boottime_alarm.next = USEC_INFINITY,
                 .perturb = USEC_INFINITY,
                 .original_pid = getpid_cached(),
+                .dispatch_batch = 1,
         };
 
         r = prioq_ensure_allocated(&e->pending, pending_prioq_compare);
         if (r < 0)
                 goto fail;
 
-        e->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
-        if (e->epoll_fd < 0) {
-                r = -errno;
-                goto fail;
+        if (shall_use_io_uring()) {
+                r = event_uring_new(&e->uring);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to set up io_uring, falling back to epoll: %m");
         }
 
-        e->epoll_fd = fd_move_above_stdio(e->epoll_fd);
+        if (!e->uring) {
+                e->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+                if (e->epoll_fd < 0) {
+                        r = -errno;
+                        goto fail;
+                }
+
+                e->epoll_fd = fd_move_above_stdio(e->epoll_fd);
+        }
 
         if (secure_getenv("SD_EVENT_PROFILE_DELAYS")) {
                 log_debug("Event loop profiling enabled. Logarithmic histogram of event loop iterations in the range 2^0 %s 2^63 us will be logged every 5s.",
@@ -437,6 +496,8 @@ static bool event_pid_changed(sd_event *e) {
 }
 
 static void source_io_unregister(sd_event_source *s) {
+        int r;
+
         assert(s);
         assert(s->type == SOURCE_IO);
 
@@ -446,8 +507,9 @@ static void source_io_unregister(sd_event_source *s) {
         if (!s->io.registered)
                 return;
 
-        if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->io.fd, NULL) < 0)
-                log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
+        r = event_poll_ctl(s->event, EPOLL_CTL_DEL, s->io.fd, NULL);
+        if (r < 0)
+                log_debug_errno(r, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
                                 strna(s->description), event_source_type_to_string(s->type));
 
         s->io.registered = false;
@@ -458,6 +520,8 @@ static int source_io_register(
                 int enabled,
                 uint32_t events) {
 
+        int r;
+
         assert(s);
         assert(s->type == SOURCE_IO);
         assert(enabled != SD_EVENT_OFF);
@@ -467,17 +531,67 @@ static int source_io_register(
                 .data.ptr = s,
         };
 
-        if (epoll_ctl(s->event->epoll_fd,
-                      s->io.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-                      s->io.fd, &ev) < 0)
-                return -errno;
+        r = event_poll_ctl(s->event,
+                           s->io.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                           s->io.fd, &ev);
+        if (r < 0)
+                return r;
 
         s->io.registered = true;
 
         return 0;
 }
 
+static void source_queue_unregister(sd_event_source *s) {
+        int r;
+
+        assert(s);
+        assert(s->type == SOURCE_QUEUE);
+
+        if (event_pid_changed(s->event))
+                return;
+
+        if (!s->queue.registered)
+                return;
+
+        r = event_poll_ctl(s->event, EPOLL_CTL_DEL, s->queue.fd, NULL);
+        if (r < 0)
+                log_debug_errno(r, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
+                                strna(s->description), event_source_type_to_string(s->type));
+
+        s->queue.registered = false;
+}
+
+static int source_queue_register(sd_event_source *s) {
+        int r;
+
+        assert(s);
+        assert(s->type == SOURCE_QUEUE);
+
+        if (!s->queue.registered) {
+                struct epoll_event ev = {
+                        .events = EPOLLIN,
+                        .data.ptr = s,
+                };
+
+                r = event_poll_ctl(s->event, EPOLL_CTL_ADD, s->queue.fd, &ev);
+                if (r < 0)
+                        return r;
+
+                s->queue.registered = true;
+        }
+
+        /* Items might have been posted while we were offline, or not all of them might have been
+         * dispatched, hence make sure we look at the queue again. */
+        if (s->queue.ready || __sync_val_compare_and_swap(&s->queue.posted, NULL, NULL))
+                (void) eventfd_write(s->queue.fd, 1);
+
+        return 0;
+}
+
 static void source_child_pidfd_unregister(sd_event_source *s) {
+        int r;
+
         assert(s);
         assert(s->type == SOURCE_CHILD);
 
@@ -487,15 +601,19 @@ static void source_child_pidfd_unregister(sd_event_source *s) {
         if (!s->child.registered)
                 return;
 
-        if (EVENT_SOURCE_WATCH_PIDFD(s))
-                if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->child.pidfd, NULL) < 0)
-                        log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
+        if (EVENT_SOURCE_WATCH_PIDFD(s)) {
+                r = event_poll_ctl(s->event, EPOLL_CTL_DEL, s->child.pidfd, NULL);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to remove source %s (type %s) from epoll, ignoring: %m",
                                         strna(s->description), event_source_type_to_string(s->type));
+        }
 
         s->child.registered = false;
 }
 
 static int source_child_pidfd_register(sd_event_source *s, int enabled) {
+        int r;
+
         assert(s);
         assert(s->type == SOURCE_CHILD);
         assert(enabled != SD_EVENT_OFF);
@@ -506,10 +624,11 @@ static int source_child_pidfd_register(sd_event_source *s, int enabled) {
                         .data.ptr = s,
                 };
 
-                if (epoll_ctl(s->event->epoll_fd,
-                              s->child.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-                              s->child.pidfd, &ev) < 0)
-                        return -errno;
+                r = event_poll_ctl(s->event,
+                                   s->child.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                                   s->child.pidfd, &ev);
+                if (r < 0)
+                        return r;
         }
 
         s->child.registered = true;
@@ -596,6 +715,11 @@ static void event_free_signal_data(sd_event *e, struct signal_data *d) {
                 return;
 
         hashmap_remove(e->signal_data, &d->priority);
+
+        /* With epoll closing the fd is enough to remove it, but io_uring keeps its own reference to it */
+        if (d->fd >= 0 && e->uring && !event_pid_changed(e))
+                (void) event_poll_ctl(e, EPOLL_CTL_DEL, d->fd, NULL);
+
         safe_close(d->fd);
         free(d);
 }
@@ -672,10 +796,9 @@ static int event_make_signal_data(
                 .data.ptr = d,
         };
 
-        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, d->fd, &ev) < 0) {
-                r = -errno;
+        r = event_poll_ctl(e, EPOLL_CTL_ADD, d->fd, &ev);
+        if (r < 0)
                 goto fail;
-        }
 
         if (ret)
                 *ret = d;
@@ -775,6 +898,124 @@ static void event_source_pp_prioq_reshuffle(sd_event_source *s) {
                 prioq_reshuffle(s->event->prepare, s, &s->prepare_index);
 }
 
+static bool event_source_uses_timer_bucket(const sd_event_source *s) {
+        assert(s);
+
+        return EVENT_SOURCE_IS_TIME(s->type) && s->time.accuracy >= TIMER_BUCKET_ACCURACY_MIN_USEC;
+}
+
+static void timer_bucket_remove(struct clock_data *d, sd_event_source *s) {
+        struct timer_bucket *b;
+
+        assert(d);
+        assert(s);
+
+        b = s->timer_bucket;
+        if (!b)
+                return;
+
+        LIST_REMOVE(timer_bucket, b->sources, s);
+        s->timer_bucket = NULL;
+
+        if (!b->sources) {
+                /* Last one out, return the bucket to the spare list */
+                assert_se(hashmap_remove(d->buckets, &b->slot) == b);
+                assert_se(prioq_remove(d->bucket_queue, b, &b->queue_index) > 0);
+                LIST_PREPEND(spare, d->spare_buckets, b);
+                d->n_spare_buckets++;
+        }
+
+        d->needs_rearm = true;
+}
+
+static void timer_bucket_update(struct clock_data *d, sd_event_source *s) {
+        struct timer_bucket *b;
+        uint64_t slot;
+
+        assert(d);
+        assert(s);
+        assert(event_source_uses_timer_bucket(s));
+
+        /* Event sources that are not eligible for being marked pending right now aren't kept in any
+         * bucket at all, they are added back once that changes. */
+        if (s->ratelimited || s->enabled == SD_EVENT_OFF || s->pending || s->time.next == USEC_INFINITY) {
+                timer_bucket_remove(d, s);
+                return;
+        }
+
+        slot = time_event_source_latest(s) / TIMER_BUCKET_USEC;
+        if (s->timer_bucket && s->timer_bucket->slot == slot)
+                return; /* This is the fast path, nothing to do */
+
+        timer_bucket_remove(d, s);
+
+        b = hashmap_get(d->buckets, &slot);
+        if (!b) {
+                /* There's one spare bucket for each time event source, and the hashmap and prioq have
+                 * been sized accordingly, hence none of this can fail. */
+                b = ASSERT_PTR(d->spare_buckets);
+                LIST_REMOVE(spare, d->spare_buckets, b);
+                d->n_spare_buckets--;
+
+                b->slot = slot;
+                assert_se(hashmap_put(d->buckets, &b->slot, b) > 0);
+                assert_se(prioq_put(d->bucket_queue, b, &b->queue_index) >= 0);
+        }
+
+        LIST_PREPEND(timer_bucket, b->sources, s);
+        s->timer_bucket = b;
+        d->needs_rearm = true;
+}
+
+static int clock_data_reserve_bucket(struct clock_data *d) {
+        struct timer_bucket *b;
+        int r;
+
+        assert(d);
+
+        r = hashmap_ensure_allocated(&d->buckets, &uint64_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = prioq_ensure_allocated(&d->bucket_queue, timer_bucket_compare);
+        if (r < 0)
+                return r;
+
+        r = hashmap_reserve(d->buckets, d->n_spare_buckets + 1);
+        if (r < 0)
+                return r;
+
+        r = prioq_reserve(d->bucket_queue, d->n_spare_buckets + 1);
+        if (r < 0)
+                return r;
+
+        b = new(struct timer_bucket, 1);
+        if (!b)
+                return -ENOMEM;
+
+        *b = (struct timer_bucket) {
+                .queue_index = PRIOQ_IDX_NULL,
+        };
+
+        LIST_PREPEND(spare, d->spare_buckets, b);
+        d->n_spare_buckets++;
+        return 0;
+}
+
+static void clock_data_release_bucket(struct clock_data *d) {
+        struct timer_bucket *b;
+
+        assert(d);
+
+        b = d->spare_buckets;
+        if (!b)
+                return;
+
+        LIST_REMOVE(spare, d->spare_buckets, b);
+        d->n_spare_buckets--;
+        free(b);
+}
+
 static void event_source_time_prioq_reshuffle(sd_event_source *s) {
         struct clock_data *d;
 
@@ -786,9 +1027,14 @@ static void event_source_time_prioq_reshuffle(sd_event_source *s) {
 
         if (s->ratelimited)
                 d = &s->event->monotonic;
-        else if (EVENT_SOURCE_IS_TIME(s->type))
+        else if (EVENT_SOURCE_IS_TIME(s->type)) {
                 assert_se(d = event_get_clock_data(s->event, s->type));
-        else
+
+                if (event_source_uses_timer_bucket(s)) {
+                        timer_bucket_update(d, s);
+                        return;
+                }
+        } else
                 return; /* no-op for an event source which is neither a timer nor ratelimited. */
 
         prioq_reshuffle(d->earliest, s, &s->earliest_index);
@@ -803,14 +1049,68 @@ static void event_source_time_prioq_remove(
         assert(s);
         assert(d);
 
+        timer_bucket_remove(d, s);
+
         prioq_remove(d->earliest, s, &s->earliest_index);
         prioq_remove(d->latest, s, &s->latest_index);
         s->earliest_index = s->latest_index = PRIOQ_IDX_NULL;
         d->needs_rearm = true;
 }
 
+static const char* event_source_statistics_key(sd_event_source *s) {
+        assert(s);
+
+        return s->description ?: event_source_type_to_string(s->type);
+}
+
+static int statistics_hashmap_merge(Hashmap **h, const char *key, const EventSourceStatistics *st) {
+        _cleanup_free_ EventSourceStatistics *copy = NULL;
+        _cleanup_free_ char *k = NULL;
+        EventSourceStatistics *existing;
+        int r;
+
+        assert(h);
+        assert(key);
+        assert(st);
+
+        existing = hashmap_get(*h, key);
+        if (existing) {
+                event_source_statistics_merge(existing, st);
+                return 0;
+        }
+
+        k = strdup(key);
+        if (!k)
+                return -ENOMEM;
+
+        copy = newdup(EventSourceStatistics, st, 1);
+        if (!copy)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(h, &string_hash_ops_free_free, k, copy);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(k);
+        TAKE_PTR(copy);
+        return 0;
+}
+
+static int event_source_retire_statistics(sd_event_source *s) {
+        assert(s);
+        assert(s->event);
+
+        /* Keep the statistics of sources that go away around, so that short-lived sources (such as
+         * connections) still show up. Not worth it if the event loop itself is being destroyed. */
+        if (s->statistics.n_dispatched == 0 || s->event->n_ref == 0)
+                return 0;
+
+        return statistics_hashmap_merge(&s->event->retired_statistics, event_source_statistics_key(s), &s->statistics);
+}
+
 static void source_disconnect(sd_event_source *s) {
         sd_event *event;
+        int r;
 
         assert(s);
 
@@ -819,6 +1119,11 @@ static void source_disconnect(sd_event_source *s) {
 
         assert(s->event->n_sources > 0);
 
+        r = event_source_retire_statistics(s);
+        if (r < 0)
+                log_debug_errno(r, "Failed to save statistics of event source %s, ignoring: %m",
+                                strna(s->description));
+
         switch (s->type) {
 
         case SOURCE_IO:
@@ -842,6 +1147,7 @@ static void source_disconnect(sd_event_source *s) {
                         event_source_time_prioq_remove(s, d);
                 }
 
+                clock_data_release_bucket(event_get_clock_data(s->event, s->type));
                 break;
 
         case SOURCE_SIGNAL:
@@ -883,6 +1189,10 @@ static void source_disconnect(sd_event_source *s) {
                 set_remove(s->event->post_sources, s);
                 break;
 
+        case SOURCE_QUEUE:
+                source_queue_unregister(s);
+                break;
+
         case SOURCE_EXIT:
                 prioq_remove(s->event->exit, s, &s->exit.prioq_index);
                 break;
@@ -946,6 +1256,15 @@ static void source_disconnect(sd_event_source *s) {
                 sd_event_unref(event);
 }
 
+static void event_queue_item_free_all(struct event_queue_item *i) {
+        while (i) {
+                struct event_queue_item *n = i->next;
+
+                free(i);
+                i = n;
+        }
+}
+
 static sd_event_source* source_free(sd_event_source *s) {
         assert(s);
 
@@ -954,6 +1273,14 @@ static sd_event_source* source_free(sd_event_source *s) {
         if (s->type == SOURCE_IO && s->io.owned)
                 s->io.fd = safe_close(s->io.fd);
 
+        if (s->type == SOURCE_QUEUE) {
+                /* Items still queued are dropped, the event source is gone and nobody can post anymore */
+                event_queue_item_free_all(s->queue.ready);
+                event_queue_item_free_all(s->queue.posted);
+
+                s->queue.fd = safe_close(s->queue.fd);
+        }
+
         if (s->type == SOURCE_CHILD) {
                 /* Eventually the kernel will do this automatically for us, but for now let's emulate this (unreliably) in userspace. */
 
@@ -1014,6 +1341,11 @@ static int source_set_pending(sd_event_source *s, bool b) {
         if (b) {
                 s->pending_iteration = s->event->iteration;
 
+                /* While collecting events in sd_event_wait() the wakeup timestamp is fresh, otherwise
+                 * we are called from some callback, hence take a new one. */
+                s->pending_usec = s->event->state == SD_EVENT_ARMED ?
+                        s->event->timestamp.monotonic : now(CLOCK_MONOTONIC);
+
                 r = prioq_put(s->event->pending, s, &s->pending_index);
                 if (r < 0) {
                         s->pending = false;
@@ -1149,6 +1481,8 @@ static int event_setup_timer_fd(
                 struct clock_data *d,
                 clockid_t clock) {
 
+        int r;
+
         assert(e);
         assert(d);
 
@@ -1168,8 +1502,9 @@ static int event_setup_timer_fd(
                 .data.ptr = d,
         };
 
-        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
-                return -errno;
+        r = event_poll_ctl(e, EPOLL_CTL_ADD, fd, &ev);
+        if (r < 0)
+                return r;
 
         d->fd = TAKE_FD(fd);
         return 0;
@@ -1228,6 +1563,24 @@ static int event_source_time_prioq_put(
         return 0;
 }
 
+static int event_source_time_queue_put(
+                sd_event_source *s,
+                struct clock_data *d) {
+
+        assert(s);
+        assert(d);
+
+        /* Like event_source_time_prioq_put(), but for a time event source on its own clock, where it might
+         * go into a timer bucket instead. */
+
+        if (event_source_uses_timer_bucket(s)) {
+                timer_bucket_update(d, s);
+                return 0;
+        }
+
+        return event_source_time_prioq_put(s, d);
+}
+
 _public_ int sd_event_add_time(
                 sd_event *e,
                 sd_event_source **ret,
@@ -1264,6 +1617,10 @@ _public_ int sd_event_add_time(
         if (r < 0)
                 return r;
 
+        r = clock_data_reserve_bucket(d);
+        if (r < 0)
+                return r;
+
         s = source_new(e, !ret, type);
         if (!s)
                 return -ENOMEM;
@@ -1275,7 +1632,7 @@ _public_ int sd_event_add_time(
         s->userdata = userdata;
         s->enabled = SD_EVENT_ONESHOT;
 
-        r = event_source_time_prioq_put(s, d);
+        r = event_source_time_queue_put(s, d);
         if (r < 0)
                 return r;
 
@@ -1682,7 +2039,77 @@ _public_ int sd_event_add_exit(
         return 0;
 }
 
+_public_ int sd_event_add_queue(
+                sd_event *e,
+                sd_event_source **ret,
+                sd_event_queue_handler_t callback,
+                void *userdata) {
+
+        _cleanup_(source_freep) sd_event_source *s = NULL;
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(callback, -EINVAL);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        s = source_new(e, !ret, SOURCE_QUEUE);
+        if (!s)
+                return -ENOMEM;
+
+        s->wakeup = WAKEUP_EVENT_SOURCE;
+        s->queue.callback = callback;
+        s->userdata = userdata;
+        s->enabled = SD_EVENT_ON;
+
+        s->queue.fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (s->queue.fd < 0)
+                return -errno;
+
+        r = source_queue_register(s);
+        if (r < 0)
+                return r;
+
+        if (ret)
+                *ret = s;
+        TAKE_PTR(s);
+
+        return 0;
+}
+
+_public_ int sd_event_source_queue_post(sd_event_source *s, void *item) {
+        struct event_queue_item *i, *old;
+
+        /* This may be called from any thread, hence we don't look at anything in the event loop object
+         * here, and only touch the list of posted items, atomically. The caller has to make sure the event
+         * source stays around while doing so. */
+
+        assert_return(s, -EINVAL);
+        assert_return(s->type == SOURCE_QUEUE, -EDOM);
+
+        i = new(struct event_queue_item, 1);
+        if (!i)
+                return -ENOMEM;
+
+        i->data = item;
+
+        do {
+                old = s->queue.posted;
+                i->next = old;
+        } while (!__sync_bool_compare_and_swap(&s->queue.posted, old, i));
+
+        /* Only the first item of a batch needs to wake up the event loop, the others will be picked up
+         * together with it. */
+        if (!old && eventfd_write(s->queue.fd, 1) < 0 && errno != EAGAIN)
+                return -errno;
+
+        return 0;
+}
+
 static void event_free_inotify_data(sd_event *e, struct inotify_data *d) {
+        int r;
+
         assert(e);
 
         if (!d)
@@ -1700,9 +2127,11 @@ static void event_free_inotify_data(sd_event *e, struct inotify_data *d) {
         assert_se(hashmap_remove(e->inotify_data, &d->priority) == d);
 
         if (d->fd >= 0) {
-                if (!event_pid_changed(e) &&
-                    epoll_ctl(e->epoll_fd, EPOLL_CTL_DEL, d->fd, NULL) < 0)
-                        log_debug_errno(errno, "Failed to remove inotify fd from epoll, ignoring: %m");
+                if (!event_pid_changed(e)) {
+                        r = event_poll_ctl(e, EPOLL_CTL_DEL, d->fd, NULL);
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to remove inotify fd from epoll, ignoring: %m");
+                }
 
                 safe_close(d->fd);
         }
@@ -1755,8 +2184,8 @@ static int event_make_inotify_data(
                 .data.ptr = d,
         };
 
-        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, d->fd, &ev) < 0) {
-                r = -errno;
+        r = event_poll_ctl(e, EPOLL_CTL_ADD, d->fd, &ev);
+        if (r < 0) {
                 d->fd = safe_close(d->fd); /* let's close this ourselves, as event_free_inotify_data() would otherwise
                                             * remove the fd from the epoll first, which we don't want as we couldn't
                                             * add it in the first place. */
@@ -2224,7 +2653,7 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
                         return r;
                 }
 
-                (void) epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, saved_fd, NULL);
+                (void) event_poll_ctl(s->event, EPOLL_CTL_DEL, saved_fd, NULL);
         }
 
         return 0;
@@ -2456,6 +2885,10 @@ static int event_source_offline(
                 source_io_unregister(s);
                 break;
 
+        case SOURCE_QUEUE:
+                source_queue_unregister(s);
+                break;
+
         case SOURCE_SIGNAL:
                 event_gc_signal_data(s->event, &s->priority, s->signal.sig);
                 break;
@@ -2533,6 +2966,12 @@ static int event_source_online(
                         return r;
                 break;
 
+        case SOURCE_QUEUE:
+                r = source_queue_register(s);
+                if (r < 0)
+                        return r;
+                break;
+
         case SOURCE_SIGNAL:
                 r = event_make_signal_data(s->event, s->signal.sig, NULL);
                 if (r < 0) {
@@ -2701,6 +3140,29 @@ _public_ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec
         if (usec == 0)
                 usec = DEFAULT_ACCURACY_USEC;
 
+        if (!s->ratelimited &&
+            event_source_uses_timer_bucket(s) != (usec >= TIMER_BUCKET_ACCURACY_MIN_USEC)) {
+                struct clock_data *d;
+                usec_t old = s->time.accuracy;
+
+                /* The event source moves between the prioqs and the timer buckets */
+
+                assert_se(d = event_get_clock_data(s->event, s->type));
+                event_source_time_prioq_remove(s, d);
+
+                s->time.accuracy = usec;
+
+                r = event_source_time_queue_put(s, d);
+                if (r < 0) {
+                        /* Moving into the prioqs failed, hence go back to the bucket, which cannot fail */
+                        s->time.accuracy = old;
+                        assert_se(event_source_time_queue_put(s, d) >= 0);
+                        return r;
+                }
+
+                return 0;
+        }
+
         s->time.accuracy = usec;
 
         event_source_time_prioq_reshuffle(s);
@@ -2921,7 +3383,7 @@ fail:
         /* Reinstall time event sources in the priority queue as before. This shouldn't fail, since the queue
          * space for it should already be allocated. */
         if (EVENT_SOURCE_IS_TIME(s->type))
-                assert_se(event_source_time_prioq_put(s, event_get_clock_data(s->event, s->type)) >= 0);
+                assert_se(event_source_time_queue_put(s, event_get_clock_data(s->event, s->type)) >= 0);
 
         return r;
 }
@@ -2939,7 +3401,7 @@ static int event_source_leave_ratelimit(sd_event_source *s, bool run_callback) {
 
         /* Let's then add the event source to its native clock prioq again — if this is a timer event source */
         if (EVENT_SOURCE_IS_TIME(s->type)) {
-                r = event_source_time_prioq_put(s, event_get_clock_data(s->event, s->type));
+                r = event_source_time_queue_put(s, event_get_clock_data(s->event, s->type));
                 if (r < 0)
                         goto fail;
         }
@@ -3076,9 +3538,10 @@ static int event_arm_timer(
                 sd_event *e,
                 struct clock_data *d) {
 
+        usec_t earliest = USEC_INFINITY, latest = USEC_INFINITY, t;
         struct itimerspec its = {};
+        struct timer_bucket *bucket;
         sd_event_source *a, *b;
-        usec_t t;
 
         assert(e);
         assert(d);
@@ -3090,7 +3553,26 @@ static int event_arm_timer(
 
         a = prioq_peek(d->earliest);
         assert(!a || EVENT_SOURCE_USES_TIME_PRIOQ(a->type));
-        if (!a || a->enabled == SD_EVENT_OFF || time_event_source_next(a) == USEC_INFINITY) {
+        if (a && a->enabled != SD_EVENT_OFF && time_event_source_next(a) != USEC_INFINITY) {
+                b = prioq_peek(d->latest);
+                assert(!b || EVENT_SOURCE_USES_TIME_PRIOQ(b->type));
+                assert(b && b->enabled != SD_EVENT_OFF);
+
+                earliest = time_event_source_next(a);
+                latest = time_event_source_latest(b);
+        }
+
+        /* The first bucket contains the source with the earliest latest time of all buckets, and its slot
+         * starts before that. Any of its sources is a good candidate for the earliest time. */
+        bucket = prioq_peek(d->bucket_queue);
+        if (bucket) {
+                LIST_FOREACH(timer_bucket, z, bucket->sources)
+                        earliest = MIN(earliest, z->time.next);
+
+                latest = MIN(latest, bucket->slot * TIMER_BUCKET_USEC);
+        }
+
+        if (earliest == USEC_INFINITY) {
 
                 if (d->fd < 0)
                         return 0;
@@ -3106,11 +3588,7 @@ static int event_arm_timer(
                 return 0;
         }
 
-        b = prioq_peek(d->latest);
-        assert(!b || EVENT_SOURCE_USES_TIME_PRIOQ(b->type));
-        assert(b && b->enabled != SD_EVENT_OFF);
-
-        t = sleep_between(e, time_event_source_next(a), time_event_source_latest(b));
+        t = sleep_between(e, earliest, latest);
         if (d->next == t)
                 return 0;
 
@@ -3149,6 +3627,23 @@ static int process_io(sd_event *e, sd_event_source *s, uint32_t revents) {
         return source_set_pending(s, true);
 }
 
+static int process_queue(sd_event *e, sd_event_source *s, uint32_t revents) {
+        eventfd_t x;
+
+        assert(e);
+        assert(s);
+        assert(s->type == SOURCE_QUEUE);
+
+        assert_return(revents == EPOLLIN, -EIO);
+
+        /* Reset the eventfd before looking at the queue, so that items posted after we took over the
+         * queue in source_dispatch() will wake us up again. */
+        if (eventfd_read(s->queue.fd, &x) < 0 && !ERRNO_IS_TRANSIENT(errno))
+                return -errno;
+
+        return source_set_pending(s, true);
+}
+
 static int flush_timer(sd_event *e, int fd, uint32_t events, usec_t *next) {
         uint64_t x;
         ssize_t ss;
@@ -3218,6 +3713,28 @@ static int process_timer(
                 event_source_time_prioq_reshuffle(s);
         }
 
+        for (;;) {
+                struct timer_bucket *b;
+
+                b = prioq_peek(d->bucket_queue);
+                if (!b)
+                        break;
+
+                /* Marking a source pending removes it from its bucket. Once the bucket is empty, it is
+                 * recycled, and we continue with the next one. */
+                LIST_FOREACH(timer_bucket, z, b->sources) {
+                        if (z->time.next > n)
+                                continue;
+
+                        r = source_set_pending(z, true);
+                        if (r < 0)
+                                return r;
+                }
+
+                if (prioq_peek(d->bucket_queue) == b)
+                        break;
+        }
+
         return callback_invoked;
 }
 
@@ -3541,9 +4058,85 @@ static int process_inotify(sd_event *e) {
         return done;
 }
 
+static void event_source_account_dispatch(sd_event_source *s, usec_t start, usec_t latency) {
+        usec_t runtime;
+
+        assert(s);
+
+        runtime = usec_sub_unsigned(now(CLOCK_MONOTONIC), start);
+
+        s->statistics.n_dispatched++;
+        s->statistics.runtime_usec = usec_add(s->statistics.runtime_usec, runtime);
+        s->statistics.runtime_max_usec = MAX(s->statistics.runtime_max_usec, runtime);
+        s->statistics.latency_usec = usec_add(s->statistics.latency_usec, latency);
+        s->statistics.latency_max_usec = MAX(s->statistics.latency_max_usec, latency);
+
+        /* Defer sources stay pending, and are dispatched again on the next iteration. Measure their
+         * latency from now on. */
+        if (s->pending)
+                s->pending_usec = usec_add(start, runtime);
+}
+
+static void source_queue_collect(sd_event_source *s) {
+        struct event_queue_item *l, *reversed = NULL;
+
+        assert(s);
+        assert(s->type == SOURCE_QUEUE);
+
+        /* Take over everything posted so far, and append it to what we still have queued, in the order
+         * it was posted in. */
+        do
+                l = s->queue.posted;
+        while (!__sync_bool_compare_and_swap(&s->queue.posted, l, NULL));
+
+        while (l) {
+                struct event_queue_item *n = l->next;
+
+                l->next = reversed;
+                reversed = l;
+                l = n;
+        }
+
+        if (s->queue.ready) {
+                struct event_queue_item *tail;
+
+                for (tail = s->queue.ready; tail->next; tail = tail->next)
+                        ;
+                tail->next = reversed;
+        } else
+                s->queue.ready = reversed;
+}
+
+static int source_dispatch_queue(sd_event_source *s) {
+        bool oneshot;
+        int r = 0;
+
+        assert(s);
+        assert(s->type == SOURCE_QUEUE);
+
+        /* Oneshot sources have already been disabled by source_dispatch(), those get one full batch */
+        oneshot = s->enabled == SD_EVENT_OFF;
+
+        source_queue_collect(s);
+
+        /* Stop if the handler fails, or disables or releases the event source */
+        while (s->queue.ready && (oneshot || s->enabled != SD_EVENT_OFF) && s->n_ref > 0) {
+                _cleanup_free_ struct event_queue_item *i = s->queue.ready;
+
+                s->queue.ready = i->next;
+
+                r = s->queue.callback(s, i->data, s->userdata);
+                if (r < 0)
+                        break;
+        }
+
+        return r;
+}
+
 static int source_dispatch(sd_event_source *s) {
         _cleanup_(sd_event_unrefp) sd_event *saved_event = NULL;
         EventSourceType saved_type;
+        usec_t start, latency;
         int r = 0;
 
         assert(s);
@@ -3596,6 +4189,9 @@ static int source_dispatch(sd_event_source *s) {
 
         s->dispatching = true;
 
+        start = now(CLOCK_MONOTONIC);
+        latency = s->pending_usec > 0 ? usec_sub_unsigned(start, s->pending_usec) : 0;
+
         switch (s->type) {
 
         case SOURCE_IO:
@@ -3638,6 +4234,10 @@ static int source_dispatch(sd_event_source *s) {
                 r = s->post.callback(s, s->userdata);
                 break;
 
+        case SOURCE_QUEUE:
+                r = source_dispatch_queue(s);
+                break;
+
         case SOURCE_EXIT:
                 r = s->exit.callback(s, s->userdata);
                 break;
@@ -3682,6 +4282,8 @@ static int source_dispatch(sd_event_source *s) {
 
         s->dispatching = false;
 
+        event_source_account_dispatch(s, start, latency);
+
         if (r < 0) {
                 log_debug_errno(r, "Event source %s (type %s) returned error, %s: %m",
                                 strna(s->description),
@@ -3888,6 +4490,14 @@ _public_ int sd_event_prepare(sd_event *e) {
         if (event_next_pending(e) || e->need_process_child || e->buffered_inotify_data_list)
                 goto pending;
 
+        /* Normally queued poll requests are submitted with the wait itself. But if the caller polls on
+         * sd_event_get_fd() on its own, they need to be in the kernel before that. */
+        if (e->uring && e->uring_fd_exported) {
+                r = event_uring_flush(e->uring);
+                if (r < 0)
+                        return r;
+        }
+
         e->state = SD_EVENT_ARMED;
 
         return 0;
@@ -3969,11 +4579,18 @@ static int process_epoll(sd_event *e, usec_t timeout, int64_t threshold, int64_t
                 timeout = 0;
 
         for (;;) {
-                r = epoll_wait_usec(
-                                e->epoll_fd,
-                                e->event_queue,
-                                n_event_max,
-                                timeout);
+                if (e->uring)
+                        r = event_uring_wait(
+                                        e->uring,
+                                        e->event_queue,
+                                        n_event_max,
+                                        timeout);
+                else
+                        r = epoll_wait_usec(
+                                        e->epoll_fd,
+                                        e->event_queue,
+                                        n_event_max,
+                                        timeout);
                 if (r < 0)
                         return r;
 
@@ -4025,6 +4642,10 @@ static int process_epoll(sd_event *e, usec_t timeout, int64_t threshold, int64_t
                                         r = process_pidfd(e, s, e->event_queue[i].events);
                                         break;
 
+                                case SOURCE_QUEUE:
+                                        r = process_queue(e, s, e->event_queue[i].events);
+                                        break;
+
                                 default:
                                         assert_not_reached();
                                 }
@@ -4077,6 +4698,10 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
                 return 1;
         }
 
+        /* If our log messages are buffered, send them out before we possibly go to sleep */
+        if (timeout != 0)
+                log_flush();
+
         for (int64_t threshold = INT64_MAX; ; threshold--) {
                 int64_t epoll_min_priority, child_min_priority;
 
@@ -4181,9 +4806,27 @@ _public_ int sd_event_dispatch(sd_event *e) {
         p = event_next_pending(e);
         if (p) {
                 _unused_ _cleanup_(sd_event_unrefp) sd_event *ref = sd_event_ref(e);
+                int64_t priority = p->priority;
 
                 e->state = SD_EVENT_RUNNING;
-                r = source_dispatch(p);
+
+                /* If batching is enabled, keep dispatching further pending sources of the same priority
+                 * until we hit the limit, before going back to polling. We stop as soon as a source of a
+                 * different priority ends up at the head of the queue, so that priority ordering is
+                 * retained. Defer sources stay pending after dispatching, hence we also stop when we
+                 * encounter a source a second time in the same iteration. */
+                for (unsigned n = 1;; n++) {
+                        p->dispatch_iteration = e->iteration;
+
+                        r = source_dispatch(p);
+                        if (r < 0 || n >= e->dispatch_batch || e->exit_requested)
+                                break;
+
+                        p = event_next_pending(e);
+                        if (!p || p->priority != priority || p->dispatch_iteration == e->iteration)
+                                break;
+                }
+
                 e->state = SD_EVENT_INITIAL;
                 return r;
         }
@@ -4278,6 +4921,12 @@ _public_ int sd_event_get_fd(sd_event *e) {
         assert_return(e = event_resolve(e), -ENOPKG);
         assert_return(!event_pid_changed(e), -ECHILD);
 
+        if (e->uring) {
+                /* The io_uring fd becomes readable as soon as completions are queued */
+                e->uring_fd_exported = true;
+                return event_uring_get_fd(e->uring);
+        }
+
         return e->epoll_fd;
 }
 
@@ -4403,14 +5052,13 @@ _public_ int sd_event_set_watchdog(sd_event *e, int b) {
                         .data.ptr = INT_TO_PTR(SOURCE_WATCHDOG),
                 };
 
-                if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, e->watchdog_fd, &ev) < 0) {
-                        r = -errno;
+                r = event_poll_ctl(e, EPOLL_CTL_ADD, e->watchdog_fd, &ev);
+                if (r < 0)
                         goto fail;
-                }
 
         } else {
                 if (e->watchdog_fd >= 0) {
-                        (void) epoll_ctl(e->epoll_fd, EPOLL_CTL_DEL, e->watchdog_fd, NULL);
+                        (void) event_poll_ctl(e, EPOLL_CTL_DEL, e->watchdog_fd, NULL);
                         e->watchdog_fd = safe_close(e->watchdog_fd);
                 }
         }
@@ -4440,6 +5088,26 @@ _public_ int sd_event_get_iteration(sd_event *e, uint64_t *ret) {
         return 0;
 }
 
+_public_ int sd_event_set_dispatch_batch(sd_event *e, unsigned max) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(max > 0, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        e->dispatch_batch = max;
+        return 0;
+}
+
+_public_ int sd_event_get_dispatch_batch(sd_event *e, unsigned *ret) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(ret, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        *ret = e->dispatch_batch;
+        return 0;
+}
+
 _public_ int sd_event_source_set_destroy_callback(sd_event_source *s, sd_event_destroy_t callback) {
         assert_return(s, -EINVAL);
 
@@ -4547,6 +5215,83 @@ _public_ int sd_event_source_get_ratelimit(sd_event_source *s, uint64_t *ret_int
         return 0;
 }
 
+_public_ int sd_event_source_get_statistics(
+                sd_event_source *s,
+                uint64_t *ret_n_dispatched,
+                uint64_t *ret_runtime_usec,
+                uint64_t *ret_runtime_max_usec,
+                uint64_t *ret_latency_max_usec) {
+
+        assert_return(s, -EINVAL);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        if (ret_n_dispatched)
+                *ret_n_dispatched = s->statistics.n_dispatched;
+        if (ret_runtime_usec)
+                *ret_runtime_usec = s->statistics.runtime_usec;
+        if (ret_runtime_max_usec)
+                *ret_runtime_max_usec = s->statistics.runtime_max_usec;
+        if (ret_latency_max_usec)
+                *ret_latency_max_usec = s->statistics.latency_max_usec;
+
+        return 0;
+}
+
+int event_source_queue_drain(sd_event_source *s) {
+        int r = 0;
+
+        assert(s);
+        assert(s->type == SOURCE_QUEUE);
+        assert(!event_pid_changed(s->event));
+
+        source_queue_collect(s);
+
+        while (s->queue.ready) {
+                _cleanup_free_ struct event_queue_item *i = s->queue.ready;
+                int k;
+
+                s->queue.ready = i->next;
+
+                k = s->queue.callback(s, i->data, s->userdata);
+                if (k < 0 && r >= 0)
+                        r = k;
+        }
+
+        return r;
+}
+
+int event_get_statistics(sd_event *e, Hashmap **ret) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        EventSourceStatistics *st;
+        const char *key;
+        int r;
+
+        assert(e);
+        assert(ret);
+
+        e = event_resolve(e);
+        if (!e)
+                return -ENOPKG;
+
+        HASHMAP_FOREACH_KEY(st, key, e->retired_statistics) {
+                r = statistics_hashmap_merge(&h, key, st);
+                if (r < 0)
+                        return r;
+        }
+
+        LIST_FOREACH(sources, s, e->sources) {
+                if (s->statistics.n_dispatched == 0)
+                        continue;
+
+                r = statistics_hashmap_merge(&h, event_source_statistics_key(s), &s->statistics);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(h);
+        return 0;
+}
+
 _public_ int sd_event_source_is_ratelimited(sd_event_source *s) {
         assert_return(s, -EINVAL);
 
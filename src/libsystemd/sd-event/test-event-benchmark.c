@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Measures the cost of one event loop iteration for the common kinds of event sources: defer sources that
+ * are always pending, timers that are rearmed from their handler and an IO source that is woken up over and
+ * over again through a pipe. Each is measured with many sources of the same kind registered, as PID 1 and
+ * the bigger daemons have. SYSTEMD_SLOW_TESTS=1 dispatches ten times as many events. */
+
+#define N_SOURCES 256U
+
+typedef struct Context {
+        unsigned n_dispatched;
+        unsigned n_max;
+        int pipe[2];
+} Context;
+
+static int defer_handler(sd_event_source *s, void *userdata) {
+        Context *c = ASSERT_PTR(userdata);
+
+        if (++c->n_dispatched >= c->n_max)
+                return sd_event_exit(sd_event_source_get_event(s), 0);
+
+        /* Defer sources are oneshot by default, but stay pending, hence are dispatched again right away */
+        return sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+}
+
+static int time_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        Context *c = ASSERT_PTR(userdata);
+
+        if (++c->n_dispatched >= c->n_max)
+                return sd_event_exit(sd_event_source_get_event(s), 0);
+
+        /* Rearm right away, which moves the source from the front to the back of the prioq */
+        assert_se(sd_event_source_set_time(s, usec + 1) >= 0);
+        return sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+}
+
+static int io_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        Context *c = ASSERT_PTR(userdata);
+        char x;
+
+        assert_se(read(fd, &x, 1) == 1);
+
+        if (++c->n_dispatched >= c->n_max)
+                return sd_event_exit(sd_event_source_get_event(s), 0);
+
+        assert_se(write(c->pipe[1], &x, 1) == 1);
+        return 0;
+}
+
+static void report(const char *what, Context *c, usec_t t) {
+        log_info("%s: %u sources, %u events, %" PRIu64 "ns per event",
+                 what, N_SOURCES, c->n_dispatched, t * NSEC_PER_USEC / c->n_dispatched);
+        benchmark_report(t * NSEC_PER_USEC / c->n_dispatched, "ns", "%s/%u", what, N_SOURCES);
+}
+
+static void benchmark_defer(unsigned n_max) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        Context c = { .n_max = n_max };
+        usec_t t;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        for (unsigned i = 0; i < N_SOURCES; i++)
+                assert_se(sd_event_add_defer(e, NULL, defer_handler, &c) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_event_loop(e) >= 0);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        report("defer", &c, t);
+}
+
+static void benchmark_time(unsigned n_max) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        Context c = { .n_max = n_max };
+        usec_t t;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* All timers are elapsed from the beginning, hence none of them ever waits */
+        for (unsigned i = 0; i < N_SOURCES; i++)
+                assert_se(sd_event_add_time(e, NULL, CLOCK_MONOTONIC, i + 1, 0, time_handler, &c) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_event_loop(e) >= 0);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        report("time", &c, t);
+}
+
+static void benchmark_io(unsigned n_max) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_close_pair_ int idle[2] = { -1, -1 };
+        Context c = { .n_max = n_max, .pipe = { -1, -1 } };
+        usec_t t;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* One busy pipe among many idle ones. The idle sources all watch the same pipe, to not run out
+         * of fds. */
+        assert_se(pipe2(idle, O_CLOEXEC|O_NONBLOCK) >= 0);
+        for (unsigned i = 0; i < N_SOURCES - 1; i++) {
+                sd_event_source *s;
+
+                assert_se(sd_event_add_io(e, &s, fcntl(idle[0], F_DUPFD_CLOEXEC, 3), EPOLLIN, io_handler, &c) >= 0);
+                assert_se(sd_event_source_set_io_fd_own(s, true) >= 0);
+                assert_se(sd_event_source_set_floating(s, true) >= 0);
+                sd_event_source_unref(s);
+        }
+
+        assert_se(pipe2(c.pipe, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(sd_event_add_io(e, NULL, c.pipe[0], EPOLLIN, io_handler, &c) >= 0);
+        assert_se(write(c.pipe[1], "x", 1) == 1);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_event_loop(e) >= 0);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        e = sd_event_unref(e);
+        safe_close_pair(c.pipe);
+
+        report("io", &c, t);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n_max;
+
+        test_setup_logging(LOG_INFO);
+
+        n_max = slow_tests_enabled() ? 10000000 : 1000000;
+
+        benchmark_defer(n_max);
+        benchmark_time(n_max);
+        benchmark_io(n_max / 10);
+
+        return 0;
+}
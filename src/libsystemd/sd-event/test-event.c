@@ -1,10 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <pthread.h>
 #include <sys/wait.h>
 
 #include "sd-event.h"
 
 #include "alloc-util.h"
+#include "event-util.h"
 #include "exec-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
@@ -195,7 +197,7 @@ static int post_handler(sd_event_source *s, void *userdata) {
         return 2;
 }
 
-static void test_basic_one(bool with_pidfd) {
+static void test_basic_one(bool with_pidfd, bool with_io_uring) {
         sd_event *e = NULL;
         sd_event_source *w = NULL, *x = NULL, *y = NULL, *z = NULL, *q = NULL, *t = NULL;
         static const char ch = 'x';
@@ -203,9 +205,10 @@ static void test_basic_one(bool with_pidfd) {
         uint64_t event_now;
         int64_t priority;
 
-        log_info("/* %s(pidfd=%s) */", __func__, yes_no(with_pidfd));
+        log_info("/* %s(pidfd=%s, io_uring=%s) */", __func__, yes_no(with_pidfd), yes_no(with_io_uring));
 
         assert_se(setenv("SYSTEMD_PIDFD", yes_no(with_pidfd), 1) >= 0);
+        assert_se(setenv("SYSTEMD_IO_URING", yes_no(with_io_uring), 1) >= 0);
 
         assert_se(pipe(a) >= 0);
         assert_se(pipe(b) >= 0);
@@ -300,11 +303,14 @@ static void test_basic_one(bool with_pidfd) {
         safe_close_pair(k);
 
         assert_se(unsetenv("SYSTEMD_PIDFD") >= 0);
+        assert_se(unsetenv("SYSTEMD_IO_URING") >= 0);
 }
 
 TEST(basic) {
-        test_basic_one(true);   /* test with pidfd */
-        test_basic_one(false);  /* test without pidfd */
+        test_basic_one(true, false);   /* test with pidfd */
+        test_basic_one(false, false);  /* test without pidfd */
+        test_basic_one(true, true);    /* test with pidfd and io_uring (falls back to epoll if unsupported) */
+        test_basic_one(false, true);   /* test with io_uring only */
 }
 
 TEST(sd_event_now) {
@@ -809,4 +815,278 @@ TEST(inotify_process_buffered_data) {
         assert_se(sd_event_wait(e, 0) == 0);
 }
 
+static int dispatch_batch_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        unsigned *c = ASSERT_PTR(userdata);
+        char x;
+
+        assert_se(read(fd, &x, 1) == 1);
+        (*c)++;
+
+        return 1;
+}
+
+static int dispatch_batch_defer_handler(sd_event_source *s, void *userdata) {
+        unsigned *c = ASSERT_PTR(userdata);
+
+        (*c)++;
+
+        return 1;
+}
+
+TEST(dispatch_batch) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *low = NULL, *defer = NULL;
+        sd_event_source *s[4] = {};
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_close_pair_ int q[2] = { -1, -1 };
+        int p[ELEMENTSOF(s)][2];
+        unsigned count = 0, low_count = 0, defer_count = 0, max;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(sd_event_get_dispatch_batch(e, &max) >= 0);
+        assert_se(max == 1);
+        assert_se(sd_event_set_dispatch_batch(e, 0) == -EINVAL);
+
+        for (size_t i = 0; i < ELEMENTSOF(s); i++) {
+                assert_se(pipe2(p[i], O_CLOEXEC|O_NONBLOCK) >= 0);
+                assert_se(sd_event_add_io(e, &s[i], p[i][0], EPOLLIN, dispatch_batch_handler, &count) >= 0);
+                assert_se(write(p[i][1], "x", 1) == 1);
+        }
+
+        assert_se(pipe2(q, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(sd_event_add_io(e, &low, q[0], EPOLLIN, dispatch_batch_handler, &low_count) >= 0);
+        assert_se(sd_event_source_set_priority(low, SD_EVENT_PRIORITY_IDLE) >= 0);
+        assert_se(write(q[1], "x", 1) == 1);
+
+        /* By default only a single source is dispatched per iteration */
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(count == 1);
+        assert_se(low_count == 0);
+
+        /* With a limit of two, the next iteration dispatches two sources */
+        assert_se(sd_event_set_dispatch_batch(e, 2) >= 0);
+        assert_se(sd_event_get_dispatch_batch(e, &max) >= 0);
+        assert_se(max == 2);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(count == 3);
+        assert_se(low_count == 0);
+
+        /* Without a limit, the remaining source of the same priority is dispatched, but the lower
+         * priority one isn't */
+        assert_se(sd_event_set_dispatch_batch(e, UINT_MAX) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(count == 4);
+        assert_se(low_count == 0);
+
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(low_count == 1);
+
+        /* Defer sources remain pending after dispatching, make sure they are invoked only once per
+         * iteration */
+        assert_se(sd_event_add_defer(e, &defer, dispatch_batch_defer_handler, &defer_count) >= 0);
+        assert_se(sd_event_source_set_enabled(defer, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(defer_count == 1);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(defer_count == 2);
+
+        for (size_t i = 0; i < ELEMENTSOF(s); i++) {
+                s[i] = sd_event_source_unref(s[i]);
+                safe_close_pair(p[i]);
+        }
+}
+
+static int statistics_handler(sd_event_source *s, void *userdata) {
+        (void) usleep(10 * USEC_PER_MSEC);
+        return 1;
+}
+
+TEST(statistics) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *a = NULL, *b = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        uint64_t n, runtime, runtime_max, latency_max;
+        EventSourceStatistics *st;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(sd_event_add_defer(e, &a, statistics_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_description(a, "statistics-a") >= 0);
+        assert_se(sd_event_add_defer(e, &b, statistics_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_description(b, "statistics-b") >= 0);
+
+        assert_se(sd_event_source_get_statistics(a, &n, NULL, NULL, NULL) >= 0);
+        assert_se(n == 0);
+
+        /* Both are oneshot and of the same priority, hence 'a' goes first, and 'b' has to wait for it */
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(sd_event_run(e, 0) > 0);
+
+        assert_se(sd_event_source_get_statistics(a, &n, &runtime, &runtime_max, &latency_max) >= 0);
+        assert_se(n == 1);
+        assert_se(runtime >= 10 * USEC_PER_MSEC);
+        assert_se(runtime == runtime_max);
+
+        assert_se(sd_event_source_get_statistics(b, &n, &runtime, &runtime_max, &latency_max) >= 0);
+        assert_se(n == 1);
+        assert_se(runtime >= 10 * USEC_PER_MSEC);
+        assert_se(latency_max >= 10 * USEC_PER_MSEC);
+
+        /* Statistics of freed sources are retained, and aggregated by description */
+        assert_se(sd_event_source_set_description(b, "statistics-a") >= 0);
+        a = sd_event_source_unref(a);
+
+        assert_se(event_get_statistics(e, &h) >= 0);
+        assert_se(hashmap_size(h) == 1);
+        assert_se(st = hashmap_get(h, "statistics-a"));
+        assert_se(st->n_dispatched == 2);
+        assert_se(st->runtime_usec >= 20 * USEC_PER_MSEC);
+        assert_se(st->latency_max_usec >= 10 * USEC_PER_MSEC);
+}
+
+struct coarse_timer {
+        sd_event_source *source;
+        usec_t next, accuracy, fired;
+};
+
+static int coarse_timer_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        struct coarse_timer *t = ASSERT_PTR(userdata);
+
+        assert_se(t->fired == USEC_INFINITY);
+        assert_se(usec == t->next);
+
+        t->fired = now(CLOCK_MONOTONIC);
+        return 0;
+}
+
+TEST(coarse_timers) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        struct coarse_timer timers[64];
+        unsigned n_fired = 0;
+        usec_t start;
+
+        /* Exercises the timer buckets used for time event sources with a coarse accuracy, mixed with
+         * finer grained ones, which are still kept in the prioqs */
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+
+        for (size_t i = 0; i < ELEMENTSOF(timers); i++) {
+                struct coarse_timer *t = timers + i;
+
+                *t = (struct coarse_timer) {
+                        .next = start + random_u64_range(300 * USEC_PER_MSEC),
+                        .accuracy = i % 4 == 0 ? 10 * USEC_PER_MSEC : USEC_PER_SEC + random_u64_range(USEC_PER_SEC),
+                        .fired = USEC_INFINITY,
+                };
+
+                assert_se(sd_event_add_time(e, &t->source, CLOCK_MONOTONIC, USEC_INFINITY, t->accuracy, coarse_timer_handler, t) >= 0);
+                assert_se(sd_event_source_set_time(t->source, t->next) >= 0);
+
+                /* Move some back and forth, and between the buckets and the prioqs */
+                if (i % 3 == 0) {
+                        assert_se(sd_event_source_set_time(t->source, t->next + 10 * USEC_PER_SEC) >= 0);
+                        assert_se(sd_event_source_set_time(t->source, t->next) >= 0);
+                }
+                if (i % 5 == 0) {
+                        assert_se(sd_event_source_set_enabled(t->source, SD_EVENT_OFF) >= 0);
+                        assert_se(sd_event_source_set_enabled(t->source, SD_EVENT_ONESHOT) >= 0);
+                }
+                if (i % 7 == 0) {
+                        t->accuracy = t->accuracy < USEC_PER_SEC ? 2 * USEC_PER_SEC : 20 * USEC_PER_MSEC;
+                        assert_se(sd_event_source_set_time_accuracy(t->source, t->accuracy) >= 0);
+                }
+        }
+
+        while (n_fired < ELEMENTSOF(timers)) {
+                assert_se(sd_event_run(e, UINT64_MAX) > 0);
+
+                n_fired = 0;
+                for (size_t i = 0; i < ELEMENTSOF(timers); i++)
+                        if (timers[i].fired != USEC_INFINITY)
+                                n_fired++;
+        }
+
+        for (size_t i = 0; i < ELEMENTSOF(timers); i++) {
+                struct coarse_timer *t = timers + i;
+
+                /* Never too early, and not much later than the accuracy allows for */
+                assert_se(t->fired >= t->next);
+                assert_se(t->fired <= t->next + t->accuracy + 100 * USEC_PER_MSEC);
+
+                t->source = sd_event_source_unref(t->source);
+        }
+}
+
+#define QUEUE_THREADS 4U
+#define QUEUE_ITEMS_PER_THREAD 10000U
+
+struct queue_context {
+        sd_event_source *source;
+        unsigned next[QUEUE_THREADS];
+        unsigned n_received;
+};
+
+static void *queue_thread(void *p) {
+        struct queue_context *c = ASSERT_PTR(p);
+        static unsigned n_threads = 0;
+        unsigned t;
+
+        t = __sync_fetch_and_add(&n_threads, 1);
+        assert_se(t < QUEUE_THREADS);
+
+        for (unsigned i = 0; i < QUEUE_ITEMS_PER_THREAD; i++)
+                assert_se(sd_event_source_queue_post(c->source, UINT_TO_PTR(t * QUEUE_ITEMS_PER_THREAD + i + 1)) >= 0);
+
+        return NULL;
+}
+
+static int queue_handler(sd_event_source *s, void *item, void *userdata) {
+        struct queue_context *c = ASSERT_PTR(userdata);
+        unsigned v, t;
+
+        assert_se(item);
+
+        v = PTR_TO_UINT(item) - 1;
+        t = v / QUEUE_ITEMS_PER_THREAD;
+        assert_se(t < QUEUE_THREADS);
+
+        /* Items posted by the same thread must arrive in order */
+        assert_se(c->next[t] == v % QUEUE_ITEMS_PER_THREAD);
+        c->next[t]++;
+
+        if (++c->n_received == QUEUE_THREADS * QUEUE_ITEMS_PER_THREAD)
+                assert_se(sd_event_exit(sd_event_source_get_event(s), 0) >= 0);
+
+        return 0;
+}
+
+TEST(queue) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        struct queue_context c = {};
+        pthread_t threads[QUEUE_THREADS];
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_add_queue(e, &s, queue_handler, &c) >= 0);
+        c.source = s;
+
+        /* Items posted while the source is disabled are delivered once it is enabled again */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        for (unsigned i = 0; i < QUEUE_THREADS; i++)
+                assert_se(pthread_create(threads + i, NULL, queue_thread, &c) == 0);
+
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(c.n_received == 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+
+        assert_se(sd_event_loop(e) >= 0);
+
+        for (unsigned i = 0; i < QUEUE_THREADS; i++) {
+                assert_se(pthread_join(threads[i], NULL) == 0);
+                assert_se(c.next[i] == QUEUE_ITEMS_PER_THREAD);
+        }
+}
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
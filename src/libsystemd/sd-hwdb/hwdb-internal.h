@@ -6,6 +6,7 @@
 
 #include "def.h"
 #include "hashmap.h"
+#include "sha256.h"
 #include "sparse-endian.h"
 
 #define HWDB_SIG { 'K', 'S', 'L', 'P', 'H', 'H', 'R', 'H' }
@@ -23,6 +24,11 @@ struct sd_hwdb {
         OrderedHashmap *properties;
         Iterator properties_iterator;
         bool properties_modified;
+
+        /* The modalias the properties were looked up for, and the properties of modaliases looked up
+         * earlier, see properties_prepare(). */
+        char *properties_modalias;
+        Hashmap *properties_cache;
 };
 
 /* on-disk trie objects */
@@ -45,6 +51,11 @@ struct trie_header_f {
         /* size of the nodes and string section */
         le64_t nodes_len;
         le64_t strings_len;
+
+        /* SHA256 digest of the source files the database was compiled from, all zeroes if unknown. Used
+         * to skip recompilation when nothing changed. Readers must not rely on it, as it was only added
+         * later on and is covered by header_size. */
+        uint8_t sources_digest[SHA256_DIGEST_SIZE];
 } _packed_;
 
 struct trie_node_f {
@@ -22,6 +22,18 @@
 #include "string-util.h"
 #include "time-util.h"
 
+/* Many devices share their modaliases, e.g. USB hubs or PCI bridges, and udev looks up the same
+ * modalias several times per device, hence remember the properties of recently looked up modaliases. */
+#define PROPERTIES_CACHE_MAX 4096U
+
+typedef struct PropertiesCacheEntry {
+        size_t n_entries;
+        const struct trie_value_entry_f *entries[];
+} PropertiesCacheEntry;
+
+DEFINE_PRIVATE_HASH_OPS_FULL(properties_cache_hash_ops, char, string_hash_func, string_compare_func, free,
+                             PropertiesCacheEntry, free);
+
 struct linebuf {
         char bytes[LINE_MAX];
         size_t size;
@@ -359,19 +371,107 @@ static sd_hwdb *hwdb_free(sd_hwdb *hwdb) {
                 munmap((void *)hwdb->map, hwdb->st.st_size);
         safe_fclose(hwdb->f);
         ordered_hashmap_free(hwdb->properties);
+        free(hwdb->properties_modalias);
+        hashmap_free(hwdb->properties_cache);
         return mfree(hwdb);
 }
 
 DEFINE_PUBLIC_TRIVIAL_REF_UNREF_FUNC(sd_hwdb, sd_hwdb, hwdb_free)
 
+static int properties_cache_put(sd_hwdb *hwdb, const char *modalias) {
+        _cleanup_free_ PropertiesCacheEntry *c = NULL;
+        _cleanup_free_ char *key = NULL;
+        const struct trie_value_entry_f *entry;
+        size_t n;
+        int r;
+
+        assert(hwdb);
+        assert(modalias);
+
+        if (hashmap_size(hwdb->properties_cache) >= PROPERTIES_CACHE_MAX)
+                hashmap_clear(hwdb->properties_cache);
+
+        n = ordered_hashmap_size(hwdb->properties);
+
+        c = malloc(offsetof(PropertiesCacheEntry, entries) + n * sizeof(c->entries[0]));
+        if (!c)
+                return -ENOMEM;
+
+        /* The properties are stored in the order they are enumerated in. */
+        c->n_entries = 0;
+        ORDERED_HASHMAP_FOREACH(entry, hwdb->properties)
+                c->entries[c->n_entries++] = entry;
+
+        key = strdup(modalias);
+        if (!key)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(&hwdb->properties_cache, &properties_cache_hash_ops, key, c);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(key);
+        TAKE_PTR(c);
+        return 0;
+}
+
+static int properties_cache_get(sd_hwdb *hwdb, const char *modalias) {
+        PropertiesCacheEntry *c;
+        int r;
+
+        assert(hwdb);
+        assert(modalias);
+
+        c = hashmap_get(hwdb->properties_cache, modalias);
+        if (!c)
+                return 0;
+
+        r = ordered_hashmap_ensure_allocated(&hwdb->properties, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        for (size_t i = 0; i < c->n_entries; i++) {
+                /* See hwdb_add_property() */
+                r = ordered_hashmap_put(hwdb->properties, trie_string(hwdb, c->entries[i]->key_off) + 1,
+                                        (void *) c->entries[i]);
+                if (r < 0)
+                        return r;
+        }
+
+        return 1;
+}
+
 static int properties_prepare(sd_hwdb *hwdb, const char *modalias) {
+        int r;
+
         assert(hwdb);
         assert(modalias);
 
-        ordered_hashmap_clear(hwdb->properties);
         hwdb->properties_modified = true;
 
-        return trie_search_f(hwdb, modalias);
+        /* Same modalias as last time? E.g. when sd_hwdb_get() is called for several keys. */
+        if (streq_ptr(hwdb->properties_modalias, modalias))
+                return 0;
+
+        ordered_hashmap_clear(hwdb->properties);
+        hwdb->properties_modalias = mfree(hwdb->properties_modalias);
+
+        r = properties_cache_get(hwdb, modalias);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                r = trie_search_f(hwdb, modalias);
+                if (r < 0)
+                        return r;
+
+                r = properties_cache_put(hwdb, modalias);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to cache hwdb properties of '%s', ignoring: %m", modalias);
+        }
+
+        /* Not remembering the modalias only means that it is looked up again next time. */
+        hwdb->properties_modalias = strdup(modalias);
+        return 0;
 }
 
 _public_ int sd_hwdb_get(sd_hwdb *hwdb, const char *modalias, const char *key, const char **_value) {
@@ -17,6 +17,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "hashmap.h"
+#include "id128-util.h"
 #include "log.h"
 #include "memory-util.h"
 #include "mkdir.h"
@@ -24,6 +25,7 @@
 #include "siphash24.h"
 #include "sort-util.h"
 #include "sparse-endian.h"
+#include "stat-util.h"
 #include "strbuf.h"
 #include "string-util.h"
 #include "strv.h"
@@ -636,6 +638,122 @@ finish:
         return r;
 }
 
+/* Upper bound for the number of entries in the lookup cache, the least recently used ones are dropped first.
+ * The catalog has only a few hundred entries, but lookups for ids without catalog entry are cached too. */
+#define CATALOG_CACHE_MAX 1024U
+
+typedef struct CatalogCacheEntry {
+        sd_id128_t id;
+        char *text; /* NULL if there is no catalog entry for the id */
+} CatalogCacheEntry;
+
+struct CatalogCache {
+        /* Ordered from least to most recently used */
+        OrderedHashmap *entries;
+
+        /* The database and locale the entries were looked up for */
+        struct stat st;
+        char *locale;
+};
+
+static CatalogCacheEntry *catalog_cache_entry_free(CatalogCacheEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->text);
+        return mfree(e);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(catalog_cache_hash_ops, sd_id128_t, id128_hash_func, id128_compare_func,
+                                              CatalogCacheEntry, catalog_cache_entry_free);
+
+CatalogCache *catalog_cache_free(CatalogCache *c) {
+        if (!c)
+                return NULL;
+
+        ordered_hashmap_free(c->entries);
+        free(c->locale);
+        return mfree(c);
+}
+
+int catalog_get_cached(CatalogCache **cache, const char *database, sd_id128_t id, char **ret) {
+        _cleanup_free_ char *text = NULL;
+        CatalogCacheEntry *e;
+        const char *loc;
+        struct stat st;
+        int r;
+
+        assert(cache);
+        assert(database);
+        assert(ret);
+
+        /* Like catalog_get(), but remembers the results, so that callers which look up the same few ids
+         * over and over again, like "journalctl -x" does for each entry, do not have to open, map and
+         * search the database every time. The cache is flushed when the database is replaced or the
+         * locale changes. */
+
+        if (stat(database, &st) < 0)
+                return -errno;
+
+        loc = setlocale(LC_MESSAGES, NULL);
+
+        if (*cache && (!stat_inode_unmodified(&(*cache)->st, &st) || !streq_ptr((*cache)->locale, loc)))
+                *cache = catalog_cache_free(*cache);
+
+        if (!*cache) {
+                _cleanup_(catalog_cache_freep) CatalogCache *c = NULL;
+
+                c = new0(CatalogCache, 1);
+                if (!c)
+                        return -ENOMEM;
+
+                c->st = st;
+                if (loc) {
+                        c->locale = strdup(loc);
+                        if (!c->locale)
+                                return -ENOMEM;
+                }
+
+                *cache = TAKE_PTR(c);
+        }
+
+        e = ordered_hashmap_remove((*cache)->entries, &id);
+        if (!e) {
+                r = catalog_get(database, id, &text);
+                if (r < 0 && r != -ENOENT)
+                        return r;
+
+                e = new(CatalogCacheEntry, 1);
+                if (!e)
+                        return -ENOMEM;
+
+                *e = (CatalogCacheEntry) {
+                        .id = id,
+                        .text = TAKE_PTR(text),
+                };
+
+                if (ordered_hashmap_size((*cache)->entries) >= CATALOG_CACHE_MAX)
+                        catalog_cache_entry_free(ordered_hashmap_steal_first((*cache)->entries));
+        }
+
+        /* (Re-)add at the end, i.e. as most recently used entry */
+        r = ordered_hashmap_ensure_put(&(*cache)->entries, &catalog_cache_hash_ops, &e->id, e);
+        if (r < 0) {
+                catalog_cache_entry_free(e);
+                return r;
+        }
+
+        if (!e->text)
+                return -ENOENT;
+
+        text = strdup(e->text);
+        if (!text)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(text);
+        return 0;
+}
+
 static char *find_header(const char *s, const char *header) {
 
         for (;;) {
@@ -273,6 +273,21 @@ int journal_file_hmac_put_object(JournalFile *f, ObjectType type, Object *o, uin
                 gcry_md_write(f->hmac, &o->tag.seqnum, sizeof(o->tag.seqnum));
                 gcry_md_write(f->hmac, &o->tag.epoch, sizeof(o->tag.epoch));
                 break;
+
+        case OBJECT_DICTIONARY:
+                /* All */
+                gcry_md_write(f->hmac, &o->dictionary.id, le64toh(o->object.size) - offsetof(Object, dictionary.id));
+                break;
+
+        case OBJECT_SUMMARY:
+                /* All */
+                gcry_md_write(f->hmac, &o->summary.n_hash_functions, le64toh(o->object.size) - offsetof(Object, summary.n_hash_functions));
+                break;
+
+        case OBJECT_ENTRY_KEYS:
+                /* All */
+                gcry_md_write(f->hmac, &o->entry_keys.n_keys, le64toh(o->object.size) - offsetof(Object, entry_keys.n_keys));
+                break;
         default:
                 return -EINVAL;
         }
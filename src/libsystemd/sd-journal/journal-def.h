@@ -23,8 +23,10 @@ typedef struct EntryObject EntryObject;
 typedef struct HashTableObject HashTableObject;
 typedef struct EntryArrayObject EntryArrayObject;
 typedef struct TagObject TagObject;
+typedef struct DictionaryObject DictionaryObject;
+typedef struct SummaryObject SummaryObject;
+typedef struct EntryKeysObject EntryKeysObject;
 
-typedef struct EntryItem EntryItem;
 typedef struct HashItem HashItem;
 
 typedef struct FSSHeader FSSHeader;
@@ -39,6 +41,9 @@ typedef enum ObjectType {
         OBJECT_FIELD_HASH_TABLE,
         OBJECT_ENTRY_ARRAY,
         OBJECT_TAG,
+        OBJECT_DICTIONARY,
+        OBJECT_SUMMARY,
+        OBJECT_ENTRY_KEYS,
         _OBJECT_TYPE_MAX
 } ObjectType;
 
@@ -85,19 +90,24 @@ struct FieldObject FieldObject__contents;
 struct FieldObject__packed FieldObject__contents _packed_;
 assert_cc(sizeof(struct FieldObject) == sizeof(struct FieldObject__packed));
 
-struct EntryItem {
-        le64_t object_offset;
-        le64_t hash;
-} _packed_;
-
-#define EntryObject__contents { \
-        ObjectHeader object;    \
-        le64_t seqnum;          \
-        le64_t realtime;        \
-        le64_t monotonic;       \
-        sd_id128_t boot_id;     \
-        le64_t xor_hash;        \
-        EntryItem items[];      \
+/* In files with HEADER_INCOMPATIBLE_COMPACT set, entry items only carry a 32-bit offset, the hash is
+ * taken from the data object. Otherwise the regular 64-bit layout is used. */
+#define EntryObject__contents {                         \
+        ObjectHeader object;                            \
+        le64_t seqnum;                                  \
+        le64_t realtime;                                \
+        le64_t monotonic;                               \
+        sd_id128_t boot_id;                             \
+        le64_t xor_hash;                                \
+        union {                                         \
+                struct {                                \
+                        le64_t object_offset;           \
+                        le64_t hash;                    \
+                } regular[0];                           \
+                struct {                                \
+                        le32_t object_offset;           \
+                } compact[0];                           \
+        } items;                                        \
         }
 
 struct EntryObject EntryObject__contents;
@@ -117,7 +127,10 @@ struct HashTableObject {
 struct EntryArrayObject {
         ObjectHeader object;
         le64_t next_entry_array_offset;
-        le64_t items[];
+        union {
+                le64_t regular[0];
+                le32_t compact[0];
+        } items;
 } _packed_;
 
 #define TAG_LENGTH (256/8)
@@ -129,6 +142,33 @@ struct TagObject {
         uint8_t tag[TAG_LENGTH]; /* SHA-256 HMAC */
 } _packed_;
 
+/* A zstd dictionary that zstd compressed data objects in the same file may refer to */
+struct DictionaryObject {
+        ObjectHeader object;
+        le32_t id;
+        uint8_t reserved[4];
+        uint8_t payload[];
+} _packed_;
+
+/* A bloom filter over the values of a few fields that are commonly matched on, written when the file is
+ * archived, so that readers can skip files that cannot contain matching entries. The payload is a NUL
+ * separated list of the covered field names, fields_size bytes in total, followed by the filter. */
+struct SummaryObject {
+        ObjectHeader object;
+        le32_t n_hash_functions;
+        le32_t fields_size;
+        uint8_t payload[];
+} _packed_;
+
+/* The sequence numbers and realtime timestamps of all entries of the file, in the order of the global entry
+ * array, written when the file is archived, so that seeking by them doesn't need to look at entry objects.
+ * keys[] contains n_keys sequence numbers, followed by n_keys realtime timestamps. */
+struct EntryKeysObject {
+        ObjectHeader object;
+        le64_t n_keys;
+        le64_t keys[];
+} _packed_;
+
 union Object {
         ObjectHeader object;
         DataObject data;
@@ -137,6 +177,9 @@ union Object {
         HashTableObject hash_table;
         EntryArrayObject entry_array;
         TagObject tag;
+        DictionaryObject dictionary;
+        SummaryObject summary;
+        EntryKeysObject entry_keys;
 };
 
 enum {
@@ -152,19 +195,25 @@ enum {
         HEADER_INCOMPATIBLE_COMPRESSED_LZ4  = 1 << 1,
         HEADER_INCOMPATIBLE_KEYED_HASH      = 1 << 2,
         HEADER_INCOMPATIBLE_COMPRESSED_ZSTD = 1 << 3,
+        HEADER_INCOMPATIBLE_ZSTD_DICTIONARY = 1 << 4,
+        HEADER_INCOMPATIBLE_COMPACT         = 1 << 5,
 };
 
-#define HEADER_INCOMPATIBLE_ANY               \
-        (HEADER_INCOMPATIBLE_COMPRESSED_XZ |  \
-         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 | \
-         HEADER_INCOMPATIBLE_KEYED_HASH |     \
-         HEADER_INCOMPATIBLE_COMPRESSED_ZSTD)
+#define HEADER_INCOMPATIBLE_ANY                \
+        (HEADER_INCOMPATIBLE_COMPRESSED_XZ |   \
+         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 |  \
+         HEADER_INCOMPATIBLE_KEYED_HASH |      \
+         HEADER_INCOMPATIBLE_COMPRESSED_ZSTD | \
+         HEADER_INCOMPATIBLE_ZSTD_DICTIONARY | \
+         HEADER_INCOMPATIBLE_COMPACT)
 
 #define HEADER_INCOMPATIBLE_SUPPORTED                            \
         ((HAVE_XZ ? HEADER_INCOMPATIBLE_COMPRESSED_XZ : 0) |     \
          (HAVE_LZ4 ? HEADER_INCOMPATIBLE_COMPRESSED_LZ4 : 0) |   \
          (HAVE_ZSTD ? HEADER_INCOMPATIBLE_COMPRESSED_ZSTD : 0) | \
-         HEADER_INCOMPATIBLE_KEYED_HASH)
+         (HAVE_ZSTD ? HEADER_INCOMPATIBLE_ZSTD_DICTIONARY : 0) | \
+         HEADER_INCOMPATIBLE_KEYED_HASH |                        \
+         HEADER_INCOMPATIBLE_COMPACT)
 
 enum {
         HEADER_COMPATIBLE_SEALED = 1 << 0,
@@ -214,12 +263,19 @@ enum {
         /* Added in 246 */                              \
         le64_t data_hash_chain_depth;                   \
         le64_t field_hash_chain_depth;                  \
+        /* Added in 252 */                              \
+        le64_t dictionary_offset;                       \
+        le64_t summary_offset;                          \
+        le64_t entry_keys_offset;                       \
         }
 
 struct Header struct_Header__contents;
 struct Header__packed struct_Header__contents _packed_;
 assert_cc(sizeof(struct Header) == sizeof(struct Header__packed));
-assert_cc(sizeof(struct Header) == 256);
+assert_cc(sizeof(struct Header) == 280);
+
+/* Offsets in compact files are 32-bit, hence they may not grow beyond this size */
+#define JOURNAL_COMPACT_SIZE_MAX UINT32_MAX
 
 #define FSS_HEADER_SIGNATURE                                            \
         ((const char[]) { 'K', 'S', 'H', 'H', 'R', 'H', 'L', 'P' })
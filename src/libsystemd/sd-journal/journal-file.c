@@ -15,6 +15,7 @@
 
 #include "alloc-util.h"
 #include "chattr-util.h"
+#include "compress-pool.h"
 #include "compress.h"
 #include "env-util.h"
 #include "fd-util.h"
@@ -25,6 +26,7 @@
 #include "journal-file.h"
 #include "lookup3.h"
 #include "memory-util.h"
+#include "nulstr-util.h"
 #include "path-util.h"
 #include "random-util.h"
 #include "set.h"
@@ -260,6 +262,8 @@ JournalFile* journal_file_close(JournalFile *f) {
         if (f->cache_fd)
                 mmap_cache_fd_free(f->cache_fd);
 
+        pread_cache_free(f->pread_cache);
+
         if (f->close_fd)
                 safe_close(f->fd);
         free(f->path);
@@ -268,6 +272,8 @@ JournalFile* journal_file_close(JournalFile *f) {
 
 #if HAVE_COMPRESSION
         free(f->compress_buffer);
+        compress_pool_unref(f->compress_pool);
+        compress_dictionary_free(f->compress_dictionary);
 #endif
 
 #if HAVE_GCRYPT
@@ -288,7 +294,7 @@ JournalFile* journal_file_close(JournalFile *f) {
 static int journal_file_init_header(JournalFile *f, JournalFileFlags file_flags, JournalFile *template) {
         Header h = {};
         ssize_t k;
-        bool keyed_hash, seal = false;
+        bool keyed_hash, compact, seal = false;
         int r;
 
         assert(f);
@@ -303,6 +309,16 @@ static int journal_file_init_header(JournalFile *f, JournalFileFlags file_flags,
         } else
                 keyed_hash = r;
 
+        /* Same for the compact format, which uses 32-bit offsets for entry items and entry array items and
+         * is limited to 4 GiB files */
+        r = getenv_bool("SYSTEMD_JOURNAL_COMPACT");
+        if (r < 0) {
+                if (r != -ENXIO)
+                        log_debug_errno(r, "Failed to parse $SYSTEMD_JOURNAL_COMPACT environment variable, ignoring: %m");
+                compact = true;
+        } else
+                compact = r;
+
 #if HAVE_GCRYPT
         /* Try to load the FSPRG state, and if we can't, then just don't do sealing */
         seal = FLAGS_SET(file_flags, JOURNAL_SEAL) && journal_file_fss_load(f) >= 0;
@@ -314,7 +330,8 @@ static int journal_file_init_header(JournalFile *f, JournalFileFlags file_flags,
         h.incompatible_flags |= htole32(
                         FLAGS_SET(file_flags, JOURNAL_COMPRESS) *
                         COMPRESSION_TO_HEADER_INCOMPATIBLE_FLAG(DEFAULT_COMPRESSION) |
-                        keyed_hash * HEADER_INCOMPATIBLE_KEYED_HASH);
+                        keyed_hash * HEADER_INCOMPATIBLE_KEYED_HASH |
+                        compact * HEADER_INCOMPATIBLE_COMPACT);
 
         h.compatible_flags = htole32(seal * HEADER_COMPATIBLE_SEALED);
 
@@ -378,7 +395,7 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                   f->path, type, flags & ~any);
                 flags = (flags & any) & ~supported;
                 if (flags) {
-                        const char* strv[5];
+                        const char* strv[7];
                         size_t n = 0;
                         _cleanup_free_ char *t = NULL;
 
@@ -394,6 +411,10 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                         strv[n++] = "zstd-compressed";
                                 if (flags & HEADER_INCOMPATIBLE_KEYED_HASH)
                                         strv[n++] = "keyed-hash";
+                                if (flags & HEADER_INCOMPATIBLE_ZSTD_DICTIONARY)
+                                        strv[n++] = "zstd-dictionary";
+                                if (flags & HEADER_INCOMPATIBLE_COMPACT)
+                                        strv[n++] = "compact";
                         }
                         strv[n] = NULL;
                         assert(n < ELEMENTSOF(strv));
@@ -438,11 +459,29 @@ static int journal_file_verify_header(JournalFile *f) {
         if (JOURNAL_HEADER_SEALED(f->header) && !JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
                 return -EBADMSG;
 
+        if (JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) &&
+            (!JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset) ||
+             !JOURNAL_HEADER_COMPRESSED_ZSTD(f->header) ||
+             !VALID64(le64toh(f->header->dictionary_offset)) ||
+             le64toh(f->header->dictionary_offset) == 0))
+                return -EBADMSG;
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, summary_offset) &&
+            !VALID64(le64toh(f->header->summary_offset)))
+                return -EBADMSG;
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, entry_keys_offset) &&
+            !VALID64(le64toh(f->header->entry_keys_offset)))
+                return -EBADMSG;
+
         arena_size = le64toh(READ_NOW(f->header->arena_size));
 
         if (UINT64_MAX - header_size < arena_size || header_size + arena_size > (uint64_t) f->last_stat.st_size)
                 return -ENODATA;
 
+        if (JOURNAL_HEADER_COMPACT(f->header) && header_size + arena_size > JOURNAL_COMPACT_SIZE_MAX)
+                return -EBADMSG;
+
         if (le64toh(f->header->tail_object_offset) > header_size + arena_size)
                 return -ENODATA;
 
@@ -559,6 +598,10 @@ static int journal_file_allocate(JournalFile *f, uint64_t offset, uint64_t size)
         if (f->metrics.max_size > 0 && new_size > f->metrics.max_size)
                 return -E2BIG;
 
+        /* Offsets beyond this can't be stored in compact files */
+        if (JOURNAL_HEADER_COMPACT(f->header) && new_size > JOURNAL_COMPACT_SIZE_MAX)
+                return -E2BIG;
+
         if (new_size > f->metrics.min_size && f->metrics.keep_free > 0) {
                 struct statvfs svfs;
 
@@ -628,9 +671,34 @@ static int journal_file_move_to(
                         return -EADDRNOTAVAIL;
         }
 
+        if (f->pread_cache) {
+                if (size > SIZE_MAX)
+                        return -EFBIG;
+
+                /* Any object might have been linked up since we last looked, but the header is updated
+                 * whenever an object is appended, hence use the object counter as generation. */
+                return pread_cache_get(f->pread_cache, type_to_context(type), keep_always, offset, size,
+                                       f->last_stat.st_size, le64toh(READ_NOW(f->header->n_objects)), ret);
+        }
+
         return mmap_cache_fd_get(f->cache_fd, type_to_context(type), keep_always, offset, size, &f->last_stat, ret);
 }
 
+int journal_file_pin_object(JournalFile *f, ObjectType type) {
+        assert(f);
+
+        if (f->pread_cache)
+                return -EOPNOTSUPP;
+
+        return mmap_cache_fd_pin(f->cache_fd, type_to_context(type));
+}
+
+void journal_file_unpin_objects(JournalFile *f) {
+        assert(f);
+
+        mmap_cache_fd_unpin_all(f->cache_fd);
+}
+
 static uint64_t minimum_header_size(Object *o) {
 
         static const uint64_t table[] = {
@@ -641,6 +709,9 @@ static uint64_t minimum_header_size(Object *o) {
                 [OBJECT_FIELD_HASH_TABLE] = sizeof(HashTableObject),
                 [OBJECT_ENTRY_ARRAY]      = sizeof(EntryArrayObject),
                 [OBJECT_TAG]              = sizeof(TagObject),
+                [OBJECT_DICTIONARY]       = sizeof(DictionaryObject),
+                [OBJECT_SUMMARY]          = sizeof(SummaryObject),
+                [OBJECT_ENTRY_KEYS]       = sizeof(EntryKeysObject),
         };
 
         if (o->object.type >= ELEMENTSOF(table) || table[o->object.type] <= 0)
@@ -685,7 +756,7 @@ static int check_object_header(Object *o, ObjectType type, uint64_t offset) {
 
 /* Lightweight object checks. We want this to be fast, so that we won't
  * slowdown every journal_file_move_to_object() call too much. */
-static int check_object(Object *o, uint64_t offset) {
+static int check_object(JournalFile *f, Object *o, uint64_t offset) {
         assert(o);
 
         switch (o->object.type) {
@@ -740,17 +811,17 @@ static int check_object(Object *o, uint64_t offset) {
 
                 sz = le64toh(READ_NOW(o->object.size));
                 if (sz < offsetof(Object, entry.items) ||
-                    (sz - offsetof(Object, entry.items)) % sizeof(EntryItem) != 0)
+                    (sz - offsetof(Object, entry.items)) % journal_file_entry_item_size(f) != 0)
                         return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
                                                "Bad entry size (<= %zu): %" PRIu64 ": %" PRIu64,
                                                offsetof(Object, entry.items),
                                                sz,
                                                offset);
 
-                if ((sz - offsetof(Object, entry.items)) / sizeof(EntryItem) <= 0)
+                if ((sz - offsetof(Object, entry.items)) / journal_file_entry_item_size(f) <= 0)
                         return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
                                                "Invalid number items in entry: %" PRIu64 ": %" PRIu64,
-                                               (sz - offsetof(Object, entry.items)) / sizeof(EntryItem),
+                                               (sz - offsetof(Object, entry.items)) / journal_file_entry_item_size(f),
                                                offset);
 
                 if (le64toh(o->entry.seqnum) <= 0)
@@ -796,8 +867,8 @@ static int check_object(Object *o, uint64_t offset) {
 
                 sz = le64toh(READ_NOW(o->object.size));
                 if (sz < offsetof(Object, entry_array.items) ||
-                    (sz - offsetof(Object, entry_array.items)) % sizeof(le64_t) != 0 ||
-                    (sz - offsetof(Object, entry_array.items)) / sizeof(le64_t) <= 0)
+                    (sz - offsetof(Object, entry_array.items)) % journal_file_entry_array_item_size(f) != 0 ||
+                    (sz - offsetof(Object, entry_array.items)) / journal_file_entry_array_item_size(f) <= 0)
                         return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
                                                "Invalid object entry array size: %" PRIu64 ": %" PRIu64,
                                                sz,
@@ -825,6 +896,54 @@ static int check_object(Object *o, uint64_t offset) {
                                                le64toh(o->tag.epoch), offset);
 
                 break;
+
+        case OBJECT_DICTIONARY:
+                if (le64toh(o->object.size) <= offsetof(Object, dictionary.payload))
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid object dictionary size: %" PRIu64 ": %" PRIu64,
+                                               le64toh(o->object.size),
+                                               offset);
+
+                if (le32toh(o->dictionary.id) == 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid object dictionary id: %" PRIu64,
+                                               offset);
+
+                break;
+
+        case OBJECT_SUMMARY: {
+                uint64_t sz = le64toh(READ_NOW(o->object.size)), fields_size = le32toh(o->summary.fields_size);
+
+                if (sz < offsetof(Object, summary.payload) ||
+                    fields_size > sz - offsetof(Object, summary.payload))
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid object summary size: %" PRIu64 ": %" PRIu64,
+                                               sz,
+                                               offset);
+
+                if (le32toh(o->summary.n_hash_functions) == 0 ||
+                    le32toh(o->summary.n_hash_functions) > JOURNAL_SUMMARY_HASH_FUNCTIONS_MAX)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid object summary hash function count: %" PRIu32 ": %" PRIu64,
+                                               le32toh(o->summary.n_hash_functions),
+                                               offset);
+
+                break;
+        }
+
+        case OBJECT_ENTRY_KEYS: {
+                uint64_t sz = le64toh(READ_NOW(o->object.size)), n = le64toh(o->entry_keys.n_keys);
+
+                if (sz < offsetof(Object, entry_keys.keys) ||
+                    (sz - offsetof(Object, entry_keys.keys)) % (2 * sizeof(le64_t)) != 0 ||
+                    (sz - offsetof(Object, entry_keys.keys)) / (2 * sizeof(le64_t)) != n)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid object entry keys size: %" PRIu64 ": %" PRIu64,
+                                               sz,
+                                               offset);
+
+                break;
+        }
         }
 
         return 0;
@@ -864,7 +983,7 @@ int journal_file_move_to_object(JournalFile *f, ObjectType type, uint64_t offset
         if (r < 0)
                 return r;
 
-        r = check_object(o, offset);
+        r = check_object(f, o, offset);
         if (r < 0)
                 return r;
 
@@ -913,7 +1032,7 @@ int journal_file_read_object_header(JournalFile *f, ObjectType type, uint64_t of
                                        "Short read while reading object: %" PRIu64,
                                        offset);
 
-        r = check_object(&o, offset);
+        r = check_object(f, &o, offset);
         if (r < 0)
                 return r;
 
@@ -1074,7 +1193,8 @@ int journal_file_map_data_hash_table(JournalFile *f) {
         assert(f);
         assert(f->header);
 
-        if (f->data_hash_table)
+        /* In pread() mode the table is refreshed by journal_file_move_to(), so always go through it */
+        if (f->data_hash_table && !f->pread_cache)
                 return 0;
 
         p = le64toh(f->header->data_hash_table_offset);
@@ -1100,7 +1220,8 @@ int journal_file_map_field_hash_table(JournalFile *f) {
         assert(f);
         assert(f->header);
 
-        if (f->field_hash_table)
+        /* In pread() mode the table is refreshed by journal_file_move_to(), so always go through it */
+        if (f->field_hash_table && !f->pread_cache)
                 return 0;
 
         p = le64toh(f->header->field_hash_table_offset);
@@ -1318,6 +1439,484 @@ uint64_t journal_file_hash_data(
         return jenkins_hash64(data, sz);
 }
 
+int journal_file_get_dictionary(JournalFile *f, CompressDictionary **ret) {
+        assert(f);
+        assert(f->header);
+        assert(ret);
+
+        if (!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header)) {
+                *ret = NULL;
+                return 0;
+        }
+
+#if HAVE_COMPRESSION
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+        uint64_t p, size;
+        Object *o;
+        int r;
+
+        /* The dictionary is loaded lazily for readers, as many files are never looked at in a way that
+         * requires decompression. Writers load it when the file is opened. */
+
+        if (f->compress_dictionary) {
+                *ret = f->compress_dictionary;
+                return 1;
+        }
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset))
+                return -EBADMSG;
+
+        p = le64toh(READ_NOW(f->header->dictionary_offset));
+        if (p == 0)
+                return -EBADMSG;
+
+        r = journal_file_move_to_object(f, OBJECT_DICTIONARY, p, &o);
+        if (r < 0)
+                return r;
+
+        size = le64toh(READ_NOW(o->object.size)) - offsetof(Object, dictionary.payload);
+
+        r = compress_dictionary_new(o->dictionary.payload, size, journal_file_writable(f), &d);
+        if (r < 0)
+                return r;
+
+        if (compress_dictionary_get_id(d) != le32toh(o->dictionary.id))
+                return -EBADMSG;
+
+        *ret = f->compress_dictionary = TAKE_PTR(d);
+        return 1;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int journal_file_add_dictionary(JournalFile *f, const void *data, size_t size) {
+        assert(f);
+        assert(f->header);
+        assert(data || size == 0);
+
+#if HAVE_ZSTD
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL;
+        uint64_t p;
+        Object *o;
+        int r;
+
+        if (!journal_file_writable(f))
+                return -EPERM;
+
+        /* The dictionary must be known before the first data object is written, and it is only used with
+         * zstd. Sealed files are not supported, as the header was already covered by the first tag. */
+        if (!JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset) ||
+            !JOURNAL_HEADER_COMPRESSED_ZSTD(f->header) ||
+            JOURNAL_HEADER_SEALED(f->header))
+                return -EOPNOTSUPP;
+
+        if (JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) ||
+            f->header->dictionary_offset != 0 ||
+            f->header->n_data != 0 ||
+            f->header->n_entries != 0)
+                return -EBUSY;
+
+        r = compress_dictionary_new(data, size, /* compress= */ true, &d);
+        if (r < 0)
+                return r;
+
+        r = journal_file_append_object(f, OBJECT_DICTIONARY, offsetof(Object, dictionary.payload) + size, &o, &p);
+        if (r < 0)
+                return r;
+
+        o->dictionary.id = htole32(compress_dictionary_get_id(d));
+        memcpy(o->dictionary.payload, data, size);
+
+        f->header->dictionary_offset = htole64(p);
+        f->header->incompatible_flags |= htole32(HEADER_INCOMPATIBLE_ZSTD_DICTIONARY);
+
+        log_debug("Added zstd dictionary %"PRIu32" of %zu bytes to %s.",
+                  compress_dictionary_get_id(d), size, f->path);
+
+        f->compress_dictionary = TAKE_PTR(d);
+        return 0;
+#else
+        return -EOPNOTSUPP;
+#endif
+}
+
+int journal_file_train_dictionary(JournalFile *f, void **ret, size_t *ret_size) {
+        assert(f);
+        assert(f->header);
+        assert(ret);
+        assert(ret_size);
+
+#if HAVE_ZSTD
+        /* Do not feed more than this to the trainer, it gets slow quickly and the result hardly improves */
+        const uint64_t samples_max = 1U * 1024U * 1024U, sample_min = 16U, sample_max = 4U * 1024U;
+
+        _cleanup_free_ size_t *sizes = NULL;
+        _cleanup_free_ uint8_t *samples = NULL;
+        size_t n_samples = 0, samples_size = 0;
+        uint64_t m;
+        int r;
+
+        /* Trains a dictionary from the (decompressed) payloads of the shorter data objects of the file,
+         * which is where a dictionary helps. Walks the data hash table rather than the entries, so that
+         * every distinct payload is seen once. */
+
+        if (le64toh(f->header->data_hash_table_size) <= 0)
+                return -ENODATA;
+
+        r = journal_file_map_data_hash_table(f);
+        if (r < 0)
+                return r;
+
+        m = le64toh(READ_NOW(f->header->data_hash_table_size)) / sizeof(HashItem);
+
+        for (uint64_t h = 0; h < m && samples_size < samples_max; h++) {
+                uint64_t p = le64toh(f->data_hash_table[h].head_hash_offset);
+
+                while (p > 0 && samples_size < samples_max) {
+                        const void *payload;
+                        size_t payload_size;
+                        uint64_t l;
+                        Object *o;
+                        int c;
+
+                        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                        if (r < 0)
+                                return r;
+
+                        p = le64toh(o->data.next_hash_offset);
+                        l = le64toh(READ_NOW(o->object.size)) - offsetof(Object, data.payload);
+                        c = COMPRESSION_FROM_OBJECT(o);
+                        if (c < 0)
+                                return -EPROTONOSUPPORT;
+
+                        if (c != COMPRESSION_NONE) {
+                                size_t rsize;
+
+                                r = journal_file_decompress(f, c, o->data.payload, l, &f->compress_buffer, &rsize, 0);
+                                if (r < 0)
+                                        return r;
+
+                                payload = f->compress_buffer;
+                                payload_size = rsize;
+                        } else {
+                                payload = o->data.payload;
+                                payload_size = l;
+                        }
+
+                        if (payload_size < sample_min || payload_size > sample_max)
+                                continue;
+
+                        if (!GREEDY_REALLOC(sizes, n_samples + 1) ||
+                            !GREEDY_REALLOC(samples, samples_size + payload_size))
+                                return -ENOMEM;
+
+                        memcpy(samples + samples_size, payload, payload_size);
+                        samples_size += payload_size;
+                        sizes[n_samples++] = payload_size;
+                }
+        }
+
+        if (n_samples == 0)
+                return -ENODATA;
+
+        /* The trainer needs a lot more sample data than the size of the dictionary, and a large dictionary
+         * doesn't help much for a file with little data anyway */
+        return compress_dictionary_train(samples, sizes, n_samples,
+                                         CLAMP(samples_size / 16, 1024U, JOURNAL_DICTIONARY_SIZE_MAX),
+                                         ret, ret_size);
+#else
+        return -EOPNOTSUPP;
+#endif
+}
+
+/* The fields covered by summaries we write: the ones journalctl matches on for -u/--user-unit, -b and -p */
+static const char summary_fields[] =
+        "_SYSTEMD_UNIT\0"
+        "_SYSTEMD_USER_UNIT\0"
+        "_SYSTEMD_SLICE\0"
+        "UNIT\0"
+        "USER_UNIT\0"
+        "COREDUMP_UNIT\0"
+        "COREDUMP_USER_UNIT\0"
+        "OBJECT_SYSTEMD_UNIT\0"
+        "OBJECT_SYSTEMD_USER_UNIT\0"
+        "_BOOT_ID\0"
+        "PRIORITY\0";
+
+static uint64_t summary_bit(uint64_t hash, unsigned i, uint64_t n_bits) {
+        /* Derive the k hash functions from the two halves of the data hash */
+        return ((hash & UINT32_MAX) + i * ((hash >> 32) | 1)) % n_bits;
+}
+
+int journal_file_add_summary(JournalFile *f) {
+        _cleanup_free_ uint64_t *hashes = NULL;
+        size_t n_hashes = 0, fields_size = sizeof(summary_fields) - 1, bloom_size;
+        const char *field;
+        uint64_t p, n_data;
+        uint8_t *bloom;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        if (!journal_file_writable(f))
+                return -EPERM;
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, summary_offset))
+                return -EOPNOTSUPP;
+
+        if (f->header->summary_offset != 0)
+                return -EBUSY;
+
+        /* Collect the hashes of all values of the covered fields, by following the per-field lists of data
+         * objects. Don't trust the lists to be free of loops. */
+        n_data = le64toh(f->header->n_data);
+
+        NULSTR_FOREACH(field, summary_fields) {
+                uint64_t q;
+
+                r = journal_file_find_field_object(f, field, strlen(field), &o, NULL);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                q = le64toh(o->field.head_data_offset);
+                while (q != 0) {
+                        if (n_hashes >= n_data)
+                                return -EBADMSG;
+
+                        r = journal_file_move_to_object(f, OBJECT_DATA, q, &o);
+                        if (r < 0)
+                                return r;
+
+                        if (!GREEDY_REALLOC(hashes, n_hashes + 1))
+                                return -ENOMEM;
+
+                        hashes[n_hashes++] = le64toh(o->data.hash);
+                        q = le64toh(o->data.next_field_offset);
+                }
+        }
+
+        /* About 10 bits per value keep false positives at around 1% */
+        bloom_size = ALIGN64(CLAMP(DIV_ROUND_UP(n_hashes * 10, 8), 8U, JOURNAL_SUMMARY_BLOOM_SIZE_MAX));
+
+        r = journal_file_append_object(f, OBJECT_SUMMARY, offsetof(Object, summary.payload) + fields_size + bloom_size, &o, &p);
+        if (r < 0)
+                return r;
+
+        o->summary.n_hash_functions = htole32(JOURNAL_SUMMARY_HASH_FUNCTIONS);
+        o->summary.fields_size = htole32(fields_size);
+        memcpy(o->summary.payload, summary_fields, fields_size);
+
+        bloom = o->summary.payload + fields_size;
+        memzero(bloom, bloom_size);
+
+        for (size_t i = 0; i < n_hashes; i++)
+                for (unsigned k = 0; k < JOURNAL_SUMMARY_HASH_FUNCTIONS; k++) {
+                        uint64_t b = summary_bit(hashes[i], k, bloom_size * 8);
+
+                        bloom[b / 8] |= 1U << (b % 8);
+                }
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_SUMMARY, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        f->header->summary_offset = htole64(p);
+
+        log_debug("Added summary of %zu values in %zu bytes to %s.", n_hashes, bloom_size, f->path);
+        return 0;
+}
+
+int journal_file_summary_may_contain(JournalFile *f, const void *data, size_t size, uint64_t hash) {
+        const uint8_t *bloom;
+        const char *eq;
+        uint64_t p, payload_size, n_bits;
+        size_t fields_size, field_size;
+        bool covered = false;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(data || size == 0);
+
+        /* Returns 0 if the file definitely contains no data object with the specified payload, and > 0 if
+         * it might, including when the file has no summary or the field is not covered by it. */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, summary_offset))
+                return 1;
+
+        p = le64toh(READ_NOW(f->header->summary_offset));
+        if (p == 0)
+                return 1;
+
+        eq = memchr(data, '=', size);
+        if (!eq)
+                return 1;
+        field_size = eq - (const char*) data;
+
+        r = journal_file_move_to_object(f, OBJECT_SUMMARY, p, &o);
+        if (r < 0)
+                return r;
+
+        fields_size = le32toh(o->summary.fields_size);
+        payload_size = le64toh(READ_NOW(o->object.size)) - offsetof(Object, summary.payload);
+
+        /* check_object() made sure that the list of fields is within the object */
+        if (fields_size > 0 && o->summary.payload[fields_size - 1] != 0)
+                return -EBADMSG;
+
+        for (const char *q = (const char*) o->summary.payload; q < (const char*) o->summary.payload + fields_size; q += strlen(q) + 1)
+                if (memcmp_nn(q, strlen(q), data, field_size) == 0) {
+                        covered = true;
+                        break;
+                }
+        if (!covered)
+                return 1;
+
+        bloom = o->summary.payload + fields_size;
+        n_bits = (payload_size - fields_size) * 8;
+        if (n_bits == 0)
+                return 1;
+
+        for (unsigned k = 0; k < le32toh(o->summary.n_hash_functions); k++) {
+                uint64_t b = summary_bit(hash, k, n_bits);
+
+                if (!(bloom[b / 8] & (1U << (b % 8))))
+                        return 0;
+        }
+
+        return 1;
+}
+
+int journal_file_add_entry_keys(JournalFile *f) {
+        _cleanup_free_ le64_t *keys = NULL;
+        uint64_t n, a, i = 0, p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        if (!journal_file_writable(f))
+                return -EPERM;
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, entry_keys_offset))
+                return -EOPNOTSUPP;
+
+        if (f->header->entry_keys_offset != 0)
+                return -EBUSY;
+
+        n = le64toh(f->header->n_entries);
+        if (n == 0)
+                return 0;
+
+        if (n > (UINT64_MAX - offsetof(Object, entry_keys.keys)) / (2 * sizeof(le64_t)) || n > SIZE_MAX / 2)
+                return -EFBIG;
+
+        /* Collect the keys first, as moving to the entries might invalidate the new object */
+        keys = new(le64_t, n * 2);
+        if (!keys)
+                return -ENOMEM;
+
+        for (a = le64toh(f->header->entry_array_offset); a != 0; a = le64toh(o->entry_array.next_entry_array_offset)) {
+                uint64_t k;
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
+                if (r < 0)
+                        return r;
+
+                k = journal_file_entry_array_n_items(f, o);
+                for (uint64_t j = 0; j < k && i < n; j++) {
+                        Object *e;
+
+                        p = journal_file_entry_array_item(f, o, j);
+                        if (p == 0)
+                                break;
+
+                        r = journal_file_move_to_object(f, OBJECT_ENTRY, p, &e);
+                        if (r < 0)
+                                return r;
+
+                        keys[i] = e->entry.seqnum;
+                        keys[n + i] = e->entry.realtime;
+                        i++;
+                }
+
+                if (i >= n)
+                        break;
+        }
+
+        if (i != n)
+                return -EBADMSG;
+
+        r = journal_file_append_object(f, OBJECT_ENTRY_KEYS, offsetof(Object, entry_keys.keys) + n * 2 * sizeof(le64_t), &o, &p);
+        if (r < 0)
+                return r;
+
+        o->entry_keys.n_keys = htole64(n);
+        memcpy(o->entry_keys.keys, keys, n * 2 * sizeof(le64_t));
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_ENTRY_KEYS, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        f->header->entry_keys_offset = htole64(p);
+
+        log_debug("Added keys of %" PRIu64 " entries to %s.", n, f->path);
+        return 0;
+}
+
+int journal_file_decompress(
+                JournalFile *f,
+                Compression compression,
+                const void *src, uint64_t src_size,
+                void **dst, size_t *dst_size, size_t dst_max) {
+
+        CompressDictionary *d = NULL;
+        int r;
+
+        assert(f);
+
+        if (compression == COMPRESSION_ZSTD) {
+                r = journal_file_get_dictionary(f, &d);
+                if (r < 0)
+                        return r;
+        }
+
+        return decompress_blob_with_dictionary(compression, d, src, src_size, dst, dst_size, dst_max);
+}
+
+int journal_file_decompress_startswith(
+                JournalFile *f,
+                Compression compression,
+                const void *src, uint64_t src_size,
+                void **buffer,
+                const void *prefix, size_t prefix_len,
+                uint8_t extra) {
+
+        CompressDictionary *d = NULL;
+        int r;
+
+        assert(f);
+
+        if (compression == COMPRESSION_ZSTD) {
+                r = journal_file_get_dictionary(f, &d);
+                if (r < 0)
+                        return r;
+        }
+
+        return decompress_startswith_with_dictionary(compression, d, src, src_size, buffer, prefix, prefix_len, extra);
+}
+
 int journal_file_find_field_object(
                 JournalFile *f,
                 const void *field, uint64_t size,
@@ -1388,7 +1987,7 @@ int journal_file_find_data_object_with_hash(
 
                         l -= offsetof(Object, data.payload);
 
-                        r = decompress_blob(c, o->data.payload, l, &f->compress_buffer, &rsize, 0);
+                        r = journal_file_decompress(f, c, o->data.payload, l, &f->compress_buffer, &rsize, 0);
                         if (r < 0)
                                 return r;
 
@@ -1540,12 +2139,28 @@ static int journal_file_append_field(
         return 0;
 }
 
-static int journal_file_append_data(
+#if HAVE_COMPRESSION
+static bool journal_file_should_compress(JournalFile *f, uint64_t size) {
+        assert(f);
+
+        if (!JOURNAL_FILE_COMPRESS(f))
+                return false;
+
+        /* With a dictionary, even short fields are worth compressing */
+        if (f->compress_dictionary)
+                return size >= MIN(f->compress_threshold_bytes, JOURNAL_DICTIONARY_COMPRESS_THRESHOLD_BYTES);
+
+        return size >= f->compress_threshold_bytes;
+}
+#endif
+
+static int journal_file_append_data_with_hash(
                 JournalFile *f,
-                const void *data, uint64_t size,
+                const void *data, uint64_t size, uint64_t hash,
+                const CompressJob *precompressed,
                 Object **ret, uint64_t *ret_offset) {
 
-        uint64_t hash, p, fp, osize;
+        uint64_t p, fp, osize;
         Object *o, *fo;
         int r, compression = 0;
         const void *eq;
@@ -1555,8 +2170,6 @@ static int journal_file_append_data(
         if (!data || size == 0)
                 return -EINVAL;
 
-        hash = journal_file_hash_data(f, data, size);
-
         r = journal_file_find_data_object_with_hash(f, data, size, hash, ret, ret_offset);
         if (r < 0)
                 return r;
@@ -1567,7 +2180,14 @@ static int journal_file_append_data(
         if (!eq)
                 return -EINVAL;
 
-        osize = offsetof(Object, data.payload) + size;
+        /* If the payload was already compressed by the compression pool, there's no need to reserve space
+         * for the uncompressed payload. Note that the hash is always the one of the uncompressed data. */
+        assert(!precompressed || (precompressed->src == data && precompressed->src_size == size));
+        if (precompressed && precompressed->result > COMPRESSION_NONE)
+                osize = offsetof(Object, data.payload) + precompressed->dst_size;
+        else
+                osize = offsetof(Object, data.payload) + size;
+
         r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
         if (r < 0)
                 return r;
@@ -1575,10 +2195,21 @@ static int journal_file_append_data(
         o->data.hash = htole64(hash);
 
 #if HAVE_COMPRESSION
-        if (JOURNAL_FILE_COMPRESS(f) && size >= f->compress_threshold_bytes) {
+        if (precompressed && precompressed->result > COMPRESSION_NONE) {
+                compression = precompressed->result;
+
+                memcpy(o->data.payload, precompressed->dst, precompressed->dst_size);
+                o->object.flags |= COMPRESSION_TO_OBJECT_FLAG(compression);
+
+                log_debug("Compressed data object %"PRIu64" -> %zu using %s",
+                          size, precompressed->dst_size, compression_to_string(compression));
+        } else if (!precompressed && journal_file_should_compress(f, size)) {
                 size_t rsize = 0;
 
-                compression = compress_blob(data, size, o->data.payload, size - 1, &rsize);
+                if (f->compress_dictionary)
+                        compression = compress_blob_with_dictionary(f->compress_dictionary, data, size, o->data.payload, size - 1, &rsize);
+                else
+                        compression = compress_blob(data, size, o->data.payload, size - 1, &rsize);
                 if (compression > COMPRESSION_NONE) {
                         o->object.size = htole64(offsetof(Object, data.payload) + rsize);
                         o->object.flags |= COMPRESSION_TO_OBJECT_FLAG(compression);
@@ -1627,8 +2258,28 @@ static int journal_file_append_data(
         return 0;
 }
 
-uint64_t journal_file_entry_n_items(Object *o) {
+static int journal_file_append_data(
+                JournalFile *f,
+                const void *data, uint64_t size,
+                Object **ret, uint64_t *ret_offset) {
+
+        assert(f);
+
+        if (!data || size == 0)
+                return -EINVAL;
+
+        return journal_file_append_data_with_hash(
+                        f,
+                        data, size,
+                        journal_file_hash_data(f, data, size),
+                        NULL,
+                        ret, ret_offset);
+}
+
+uint64_t journal_file_entry_n_items(JournalFile *f, Object *o) {
         uint64_t sz;
+
+        assert(f);
         assert(o);
 
         if (o->object.type != OBJECT_ENTRY)
@@ -1638,12 +2289,13 @@ uint64_t journal_file_entry_n_items(Object *o) {
         if (sz < offsetof(Object, entry.items))
                 return 0;
 
-        return (sz - offsetof(Object, entry.items)) / sizeof(EntryItem);
+        return (sz - offsetof(Object, entry.items)) / journal_file_entry_item_size(f);
 }
 
-uint64_t journal_file_entry_array_n_items(Object *o) {
+uint64_t journal_file_entry_array_n_items(JournalFile *f, Object *o) {
         uint64_t sz;
 
+        assert(f);
         assert(o);
 
         if (o->object.type != OBJECT_ENTRY_ARRAY)
@@ -1653,7 +2305,32 @@ uint64_t journal_file_entry_array_n_items(Object *o) {
         if (sz < offsetof(Object, entry_array.items))
                 return 0;
 
-        return (sz - offsetof(Object, entry_array.items)) / sizeof(uint64_t);
+        return (sz - offsetof(Object, entry_array.items)) / journal_file_entry_array_item_size(f);
+}
+
+static void write_entry_array_item(JournalFile *f, Object *o, uint64_t i, uint64_t p) {
+        assert(f);
+        assert(o);
+
+        if (JOURNAL_HEADER_COMPACT(f->header)) {
+                assert(p <= UINT32_MAX);
+                o->entry_array.items.compact[i] = htole32(p);
+        } else
+                o->entry_array.items.regular[i] = htole64(p);
+}
+
+static void write_entry_item(JournalFile *f, Object *o, uint64_t i, const EntryItem *item) {
+        assert(f);
+        assert(o);
+        assert(item);
+
+        if (JOURNAL_HEADER_COMPACT(f->header)) {
+                assert(item->object_offset <= UINT32_MAX);
+                o->entry.items.compact[i].object_offset = htole32(item->object_offset);
+        } else {
+                o->entry.items.regular[i].object_offset = htole64(item->object_offset);
+                o->entry.items.regular[i].hash = htole64(item->hash);
+        }
 }
 
 uint64_t journal_file_hash_table_n_items(Object *o) {
@@ -1671,19 +2348,29 @@ uint64_t journal_file_hash_table_n_items(Object *o) {
         return (sz - offsetof(Object, hash_table.items)) / sizeof(HashItem);
 }
 
-static int link_entry_into_array(JournalFile *f,
-                                 le64_t *first,
-                                 le64_t *idx,
-                                 uint64_t p) {
-        int r;
+static int link_entries_into_array(
+                JournalFile *f,
+                le64_t *first,
+                le64_t *idx,
+                const uint64_t p[],
+                size_t n_p) {
+
         uint64_t n = 0, ap = 0, q, i, a, hidx;
-        Object *o;
+        Object *o = NULL;
+        int r;
 
         assert(f);
         assert(f->header);
         assert(first);
         assert(idx);
-        assert(p > 0);
+        assert(p || n_p == 0);
+
+        if (n_p == 0)
+                return 0;
+
+        /* Appends the specified entry offsets to the chain of entry arrays starting at *first, which
+         * currently holds *idx items. The chain is only walked once, regardless of how many offsets are
+         * appended. */
 
         a = le64toh(*first);
         i = hidx = le64toh(READ_NOW(*idx));
@@ -1693,89 +2380,129 @@ static int link_entry_into_array(JournalFile *f,
                 if (r < 0)
                         return r;
 
-                n = journal_file_entry_array_n_items(o);
-                if (i < n) {
-                        o->entry_array.items[i] = htole64(p);
-                        *idx = htole64(hidx + 1);
-                        return 0;
-                }
+                n = journal_file_entry_array_n_items(f, o);
+                if (i < n)
+                        break;
 
                 i -= n;
                 ap = a;
                 a = le64toh(o->entry_array.next_entry_array_offset);
         }
 
-        if (hidx > n)
-                n = (hidx+1) * 2;
-        else
-                n = n * 2;
+        for (size_t k = 0; k < n_p; k++) {
+                assert(p[k] > 0);
 
-        if (n < 4)
-                n = 4;
+                if (a == 0) {
+                        /* All arrays are full, allocate a new one */
 
-        r = journal_file_append_object(f, OBJECT_ENTRY_ARRAY,
-                                       offsetof(Object, entry_array.items) + n * sizeof(uint64_t),
-                                       &o, &q);
-        if (r < 0)
-                return r;
+                        if (hidx > n)
+                                n = (hidx+1) * 2;
+                        else
+                                n = n * 2;
+
+                        if (n < 4)
+                                n = 4;
+
+                        r = journal_file_append_object(f, OBJECT_ENTRY_ARRAY,
+                                                       offsetof(Object, entry_array.items) + n * journal_file_entry_array_item_size(f),
+                                                       &o, &q);
+                        if (r < 0)
+                                return r;
 
 #if HAVE_GCRYPT
-        r = journal_file_hmac_put_object(f, OBJECT_ENTRY_ARRAY, o, q);
-        if (r < 0)
-                return r;
+                        r = journal_file_hmac_put_object(f, OBJECT_ENTRY_ARRAY, o, q);
+                        if (r < 0)
+                                return r;
 #endif
 
-        o->entry_array.items[i] = htole64(p);
+                        write_entry_array_item(f, o, i, p[k]);
 
-        if (ap == 0)
-                *first = htole64(q);
-        else {
-                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, ap, &o);
-                if (r < 0)
-                        return r;
+                        if (ap == 0)
+                                *first = htole64(q);
+                        else {
+                                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, ap, &o);
+                                if (r < 0)
+                                        return r;
 
-                o->entry_array.next_entry_array_offset = htole64(q);
-        }
+                                o->entry_array.next_entry_array_offset = htole64(q);
+                        }
 
-        if (JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
-                f->header->n_entry_arrays = htole64(le64toh(f->header->n_entry_arrays) + 1);
+                        if (JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
+                                f->header->n_entry_arrays = htole64(le64toh(f->header->n_entry_arrays) + 1);
 
-        *idx = htole64(hidx + 1);
+                        *idx = htole64(++hidx);
+
+                        if (k + 1 >= n_p)
+                                break;
+
+                        /* Linking in the new array might have altered the window, refresh our pointer */
+                        a = q;
+                        r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
+                        if (r < 0)
+                                return r;
+                } else {
+                        write_entry_array_item(f, o, i, p[k]);
+                        *idx = htole64(++hidx);
+                }
+
+                if (++i < n)
+                        continue;
+
+                /* This array is full now, continue with the next one, if there is one */
+                i = 0;
+                ap = a;
+                a = le64toh(o->entry_array.next_entry_array_offset);
+                if (a > 0) {
+                        r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
+                        if (r < 0)
+                                return r;
+
+                        n = journal_file_entry_array_n_items(f, o);
+                }
+        }
 
         return 0;
 }
 
-static int link_entry_into_array_plus_one(JournalFile *f,
-                                          le64_t *extra,
-                                          le64_t *first,
-                                          le64_t *idx,
-                                          uint64_t p) {
+static int link_entries_into_array_plus_one(
+                JournalFile *f,
+                le64_t *extra,
+                le64_t *first,
+                le64_t *idx,
+                const uint64_t p[],
+                size_t n_p) {
 
         uint64_t hidx;
+        le64_t i;
         int r;
 
         assert(f);
         assert(extra);
         assert(first);
         assert(idx);
-        assert(p > 0);
+        assert(p || n_p == 0);
+
+        if (n_p == 0)
+                return 0;
 
         hidx = le64toh(READ_NOW(*idx));
         if (hidx == UINT64_MAX)
                 return -EBADMSG;
-        if (hidx == 0)
-                *extra = htole64(p);
-        else {
-                le64_t i;
+        if (hidx == 0) {
+                *extra = htole64(p[0]);
+                *idx = htole64(1);
 
-                i = htole64(hidx - 1);
-                r = link_entry_into_array(f, first, &i, p);
-                if (r < 0)
-                        return r;
+                p++;
+                n_p--;
+                hidx = 1;
         }
 
-        *idx = htole64(hidx + 1);
-        return 0;
+        i = htole64(hidx - 1);
+        r = link_entries_into_array(f, first, &i, p, n_p);
+
+        /* Also account for what we managed to link in case of failure */
+        *idx = htole64(le64toh(i) + 1);
+        return r;
 }
 
 static int journal_file_link_entry_item(JournalFile *f, Object *o, uint64_t offset, uint64_t i) {
@@ -1786,16 +2513,16 @@ static int journal_file_link_entry_item(JournalFile *f, Object *o, uint64_t offs
         assert(o);
         assert(offset > 0);
 
-        p = le64toh(o->entry.items[i].object_offset);
+        p = journal_file_entry_item_object_offset(f, o, i);
         r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
         if (r < 0)
                 return r;
 
-        return link_entry_into_array_plus_one(f,
-                                              &o->data.entry_offset,
-                                              &o->data.entry_array_offset,
-                                              &o->data.n_entries,
-                                              offset);
+        return link_entries_into_array_plus_one(f,
+                                                &o->data.entry_offset,
+                                                &o->data.entry_array_offset,
+                                                &o->data.n_entries,
+                                                &offset, 1);
 }
 
 static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
@@ -1813,10 +2540,10 @@ static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
         __sync_synchronize();
 
         /* Link up the entry itself */
-        r = link_entry_into_array(f,
-                                  &f->header->entry_array_offset,
-                                  &f->header->n_entries,
-                                  offset);
+        r = link_entries_into_array(f,
+                                    &f->header->entry_array_offset,
+                                    &f->header->n_entries,
+                                    &offset, 1);
         if (r < 0)
                 return r;
 
@@ -1829,7 +2556,7 @@ static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
         f->header->tail_entry_monotonic = o->entry.monotonic;
 
         /* Link up the items */
-        n = journal_file_entry_n_items(o);
+        n = journal_file_entry_n_items(f, o);
         for (uint64_t i = 0; i < n; i++) {
                 int k;
 
@@ -1847,12 +2574,12 @@ static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
         return r;
 }
 
-static int journal_file_append_entry_internal(
+static int journal_file_append_entry_object(
                 JournalFile *f,
                 const dual_timestamp *ts,
                 const sd_id128_t *boot_id,
                 uint64_t xor_hash,
-                const EntryItem items[], unsigned n_items,
+                const EntryItem items[], size_t n_items,
                 uint64_t *seqnum,
                 Object **ret, uint64_t *ret_offset) {
         uint64_t np;
@@ -1865,14 +2592,17 @@ static int journal_file_append_entry_internal(
         assert(items || n_items == 0);
         assert(ts);
 
-        osize = offsetof(Object, entry.items) + (n_items * sizeof(EntryItem));
+        /* Appends the entry object, without linking it up */
+
+        osize = offsetof(Object, entry.items) + (n_items * journal_file_entry_item_size(f));
 
         r = journal_file_append_object(f, OBJECT_ENTRY, osize, &o, &np);
         if (r < 0)
                 return r;
 
         o->entry.seqnum = htole64(journal_file_entry_seqnum(f, seqnum));
-        memcpy_safe(o->entry.items, items, n_items * sizeof(EntryItem));
+        for (size_t i = 0; i < n_items; i++)
+                write_entry_item(f, o, i, &items[i]);
         o->entry.realtime = htole64(ts->realtime);
         o->entry.monotonic = htole64(ts->monotonic);
         o->entry.xor_hash = htole64(xor_hash);
@@ -1886,6 +2616,27 @@ static int journal_file_append_entry_internal(
                 return r;
 #endif
 
+        *ret = o;
+        *ret_offset = np;
+        return 0;
+}
+
+static int journal_file_append_entry_internal(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                uint64_t xor_hash,
+                const EntryItem items[], unsigned n_items,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *ret_offset) {
+        uint64_t np;
+        Object *o;
+        int r;
+
+        r = journal_file_append_entry_object(f, ts, boot_id, xor_hash, items, n_items, seqnum, &o, &np);
+        if (r < 0)
+                return r;
+
         r = journal_file_link_entry(f, o, np);
         if (r < 0)
                 return r;
@@ -1989,7 +2740,7 @@ int journal_file_enable_post_change_timer(JournalFile *f, sd_event *e, usec_t t)
 }
 
 static int entry_item_cmp(const EntryItem *a, const EntryItem *b) {
-        return CMP(le64toh(a->object_offset), le64toh(b->object_offset));
+        return CMP(a->object_offset, b->object_offset);
 }
 
 static size_t remove_duplicate_entry_items(EntryItem items[], size_t n) {
@@ -2007,6 +2758,21 @@ static size_t remove_duplicate_entry_items(EntryItem items[], size_t n) {
         return j;
 }
 
+static int verify_entry_timestamp(const dual_timestamp *ts) {
+        assert(ts);
+
+        if (!VALID_REALTIME(ts->realtime))
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                       "Invalid realtime timestamp %" PRIu64 ", refusing entry.",
+                                       ts->realtime);
+        if (!VALID_MONOTONIC(ts->monotonic))
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                       "Invalid monotomic timestamp %" PRIu64 ", refusing entry.",
+                                       ts->monotonic);
+
+        return 0;
+}
+
 int journal_file_append_entry(
                 JournalFile *f,
                 const dual_timestamp *ts,
@@ -2025,14 +2791,9 @@ int journal_file_append_entry(
         assert(iovec && n_iovec > 0);
 
         if (ts) {
-                if (!VALID_REALTIME(ts->realtime))
-                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
-                                               "Invalid realtime timestamp %" PRIu64 ", refusing entry.",
-                                               ts->realtime);
-                if (!VALID_MONOTONIC(ts->monotonic))
-                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
-                                               "Invalid monotomic timestamp %" PRIu64 ", refusing entry.",
-                                               ts->monotonic);
+                r = verify_entry_timestamp(ts);
+                if (r < 0)
+                        return r;
         } else {
                 dual_timestamp_get(&_ts);
                 ts = &_ts;
@@ -2069,8 +2830,8 @@ int journal_file_append_entry(
                         xor_hash ^= le64toh(o->data.hash);
 
                 items[i] = (EntryItem) {
-                        .object_offset = htole64(p),
-                        .hash = o->data.hash,
+                        .object_offset = p,
+                        .hash = le64toh(o->data.hash),
                 };
         }
 
@@ -2097,6 +2858,428 @@ int journal_file_append_entry(
         return r;
 }
 
+typedef struct EntryLink {
+        uint64_t data_offset;
+        uint64_t entry_offset;
+} EntryLink;
+
+static int entry_link_cmp(const EntryLink *a, const EntryLink *b) {
+        int r;
+
+        r = CMP(a->data_offset, b->data_offset);
+        if (r != 0)
+                return r;
+
+        return CMP(a->entry_offset, b->entry_offset);
+}
+
+static int journal_file_link_entries(
+                JournalFile *f,
+                const uint64_t offsets[], size_t n_offsets,
+                const dual_timestamp *first_ts,
+                const dual_timestamp *last_ts,
+                EntryLink links[], size_t n_links) {
+
+        _cleanup_free_ uint64_t *p = NULL;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(offsets && n_offsets > 0);
+        assert(first_ts);
+        assert(last_ts);
+        assert(links || n_links == 0);
+
+        /* Like journal_file_link_entry(), but for a series of entries at once: the main entry array chain
+         * is walked only once for all of them, and each data object referenced by any of them is moved
+         * to only once, with all entries referencing it appended in one go. */
+
+        __sync_synchronize();
+
+        r = link_entries_into_array(f,
+                                    &f->header->entry_array_offset,
+                                    &f->header->n_entries,
+                                    offsets, n_offsets);
+        if (r < 0)
+                return r;
+
+        if (f->header->head_entry_realtime == 0)
+                f->header->head_entry_realtime = htole64(first_ts->realtime);
+
+        f->header->tail_entry_realtime = htole64(last_ts->realtime);
+        f->header->tail_entry_monotonic = htole64(last_ts->monotonic);
+
+        if (n_links == 0)
+                return 0;
+
+        /* Group the links by data object, keeping the entries of each group in the order they were
+         * appended in. */
+        typesafe_qsort(links, n_links, entry_link_cmp);
+
+        p = new(uint64_t, n_links);
+        if (!p)
+                return -ENOMEM;
+
+        for (size_t i = 0, j; i < n_links; i = j) {
+                Object *o;
+                int k;
+
+                for (j = i; j < n_links && links[j].data_offset == links[i].data_offset; j++)
+                        p[j - i] = links[j].entry_offset;
+
+                k = journal_file_move_to_object(f, OBJECT_DATA, links[i].data_offset, &o);
+                if (k < 0)
+                        return k;
+
+                /* Same as in journal_file_link_entry(): if we can't allocate a new entry array for one data
+                 * object, still try the others. */
+                k = link_entries_into_array_plus_one(f,
+                                                     &o->data.entry_offset,
+                                                     &o->data.entry_array_offset,
+                                                     &o->data.n_entries,
+                                                     p, j - i);
+                if (k == -E2BIG)
+                        r = k;
+                else if (k < 0)
+                        return k;
+        }
+
+        return r;
+}
+
+void journal_file_set_compress_pool(JournalFile *f, CompressPool *pool) {
+        assert(f);
+
+#if HAVE_COMPRESSION
+        compress_pool_unref(f->compress_pool);
+        f->compress_pool = compress_pool_ref(pool);
+#endif
+}
+
+typedef struct BatchDataItem {
+        uint64_t hash;
+        const struct iovec *iovec;
+        uint64_t offset;
+} BatchDataItem;
+
+typedef struct BatchCompression {
+        CompressJob *jobs;
+        uint64_t *hashes;
+        size_t n_jobs;
+        Hashmap *by_hash;
+} BatchCompression;
+
+static JournalDataHint* batch_entry_hint(const JournalBatchEntry *e, size_t i) {
+        assert(e);
+        assert(i < e->n_iovec);
+
+        return e->hints ? e->hints[i] : NULL;
+}
+
+static bool journal_data_hint_valid(JournalFile *f, const JournalDataHint *hint) {
+        assert(f);
+
+        return hint && sd_id128_equal(hint->file_id, f->header->file_id);
+}
+
+static void batch_compression_done(BatchCompression *c) {
+        assert(c);
+
+        for (size_t i = 0; i < c->n_jobs; i++)
+                free(c->jobs[i].dst);
+
+        c->jobs = mfree(c->jobs);
+        c->hashes = mfree(c->hashes);
+        c->by_hash = hashmap_free(c->by_hash);
+        c->n_jobs = 0;
+}
+
+static const CompressJob* batch_compression_find(BatchCompression *c, uint64_t hash, const struct iovec *iovec) {
+        CompressJob *j;
+
+        assert(c);
+        assert(iovec);
+
+        j = hashmap_get(c->by_hash, &hash);
+        if (!j || j->src_size != iovec->iov_len)
+                return NULL;
+
+        if (j->src != iovec->iov_base && memcmp(j->src, iovec->iov_base, iovec->iov_len) != 0)
+                return NULL;
+
+        return j;
+}
+
+static int journal_file_precompress_entries(
+                JournalFile *f,
+                const JournalBatchEntry entries[], size_t n_entries,
+                const uint64_t hashes[],
+                BatchCompression *c) {
+
+#if HAVE_COMPRESSION
+        size_t n_candidates = 0, k = 0;
+        int r;
+
+        assert(f);
+        assert(entries);
+        assert(hashes);
+        assert(c);
+
+        /* Compresses all new data objects of the batch that are above the threshold in parallel on the
+         * compression pool, before any of them is appended. The objects are then appended in order by the
+         * caller, so the file layout is the same as without the pool, only the waiting is shorter. */
+
+        if (!f->compress_pool || !JOURNAL_FILE_COMPRESS(f))
+                return 0;
+
+        for (size_t i = 0; i < n_entries; i++)
+                for (size_t j = 0; j < entries[i].n_iovec; j++)
+                        if (journal_file_should_compress(f, entries[i].iovec[j].iov_len) &&
+                            !journal_data_hint_valid(f, batch_entry_hint(entries + i, j)))
+                                n_candidates++;
+
+        /* With a single large field there's nothing to parallelize, compress it inline as usual */
+        if (n_candidates < 2)
+                return 0;
+
+        c->jobs = new(CompressJob, n_candidates);
+        c->hashes = new(uint64_t, n_candidates);
+        c->by_hash = hashmap_new(&uint64_hash_ops);
+        if (!c->jobs || !c->hashes || !c->by_hash)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < n_entries; i++)
+                for (size_t j = 0; j < entries[i].n_iovec; j++, k++) {
+                        const struct iovec *iovec = entries[i].iovec + j;
+                        void *dst;
+
+                        if (!journal_file_should_compress(f, iovec->iov_len))
+                                continue;
+
+                        /* Hinted data is in the file already */
+                        if (journal_data_hint_valid(f, batch_entry_hint(entries + i, j)))
+                                continue;
+
+                        if (batch_compression_find(c, hashes[k], iovec))
+                                continue;
+
+                        r = journal_file_find_data_object_with_hash(f, iovec->iov_base, iovec->iov_len, hashes[k], NULL, NULL);
+                        if (r < 0)
+                                return r;
+                        if (r > 0)
+                                continue;
+
+                        /* Like in journal_file_append_data_with_hash(), only keep the result if it's smaller */
+                        dst = malloc(iovec->iov_len - 1);
+                        if (!dst)
+                                return -ENOMEM;
+
+                        c->jobs[c->n_jobs] = (CompressJob) {
+                                .compression = f->compress_dictionary ? COMPRESSION_ZSTD : DEFAULT_COMPRESSION,
+                                .dictionary = f->compress_dictionary,
+                                .src = iovec->iov_base,
+                                .src_size = iovec->iov_len,
+                                .dst = dst,
+                                .dst_alloc_size = iovec->iov_len - 1,
+                        };
+                        c->hashes[c->n_jobs] = hashes[k];
+
+                        /* Failing to index a job just means it's compressed once more later */
+                        (void) hashmap_put(c->by_hash, c->hashes + c->n_jobs, c->jobs + c->n_jobs);
+
+                        c->n_jobs++;
+                }
+
+        compress_pool_run(f->compress_pool, c->jobs, c->n_jobs);
+#endif
+
+        return 0;
+}
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const sd_id128_t *boot_id,
+                const JournalBatchEntry entries[], size_t n_entries,
+                uint64_t *seqnum,
+                size_t *ret_n_appended) {
+
+        _cleanup_(batch_compression_done) BatchCompression compression = {};
+        _cleanup_hashmap_free_ Hashmap *cache = NULL;
+        _cleanup_free_ BatchDataItem *data = NULL;
+        _cleanup_free_ EntryLink *links = NULL;
+        _cleanup_free_ EntryItem *items = NULL;
+        _cleanup_free_ uint64_t *offsets = NULL, *hashes = NULL;
+        size_t n_data = 0, n_links = 0, n_appended, n_iovec_total = 0, n_iovec_max = 0, n_hashed = 0;
+        int r = 0;
+
+        assert(f);
+        assert(f->header);
+        assert(entries || n_entries == 0);
+
+        /* Appends a series of entries, linking all of them up only once they have all been written. Data
+         * objects shared between the entries are looked up only once, and hinted ones not at all. If
+         * appending an entry fails, the ones before it are still linked up, and their number is returned in
+         * ret_n_appended. */
+
+        for (size_t i = 0; i < n_entries; i++) {
+                assert(entries[i].iovec && entries[i].n_iovec > 0);
+
+                n_iovec_total += entries[i].n_iovec;
+                n_iovec_max = MAX(n_iovec_max, entries[i].n_iovec);
+        }
+
+        if (n_entries == 0) {
+                if (ret_n_appended)
+                        *ret_n_appended = 0;
+                return 0;
+        }
+
+        data = new(BatchDataItem, n_iovec_total);
+        links = new(EntryLink, n_iovec_total);
+        items = new(EntryItem, n_iovec_max);
+        offsets = new(uint64_t, n_entries);
+        hashes = new(uint64_t, n_iovec_total);
+        cache = hashmap_new(&uint64_hash_ops);
+        if (!data || !links || !items || !offsets || !hashes || !cache)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < n_entries; i++)
+                for (size_t j = 0; j < entries[i].n_iovec; j++) {
+                        const JournalDataHint *hint = batch_entry_hint(entries + i, j);
+
+                        hashes[n_hashed++] = journal_data_hint_valid(f, hint) ? hint->hash :
+                                journal_file_hash_data(f, entries[i].iovec[j].iov_base, entries[i].iovec[j].iov_len);
+                }
+
+        r = journal_file_precompress_entries(f, entries, n_entries, hashes, &compression);
+        if (r < 0)
+                return r;
+
+        n_hashed = 0;
+
+        for (n_appended = 0; n_appended < n_entries; n_appended++) {
+                const JournalBatchEntry *e = entries + n_appended;
+                uint64_t xor_hash = 0, offset;
+                size_t n_items;
+                Object *o;
+
+                r = verify_entry_timestamp(&e->ts);
+                if (r < 0)
+                        break;
+
+#if HAVE_GCRYPT
+                r = journal_file_maybe_append_tag(f, e->ts.realtime);
+                if (r < 0)
+                        break;
+#endif
+
+                for (size_t i = 0; i < e->n_iovec; i++, n_hashed++) {
+                        JournalDataHint *hint = batch_entry_hint(e, i);
+                        const struct iovec *iovec = e->iovec + i;
+                        uint64_t hash = hashes[n_hashed], p, x;
+                        BatchDataItem *d;
+
+                        if (journal_data_hint_valid(f, hint)) {
+                                /* We know where the data is already, no need to look it up at all */
+                                xor_hash ^= hint->xor_hash;
+                                items[i] = (EntryItem) {
+                                        .object_offset = hint->offset,
+                                        .hash = hash,
+                                };
+                                continue;
+                        }
+
+                        /* Fields such as the hostname or the unit name tend to be repeated in many entries
+                         * of a batch, only look them up in the file once. */
+                        d = hashmap_get(cache, &hash);
+                        if (d &&
+                            d->iovec->iov_len == iovec->iov_len &&
+                            memcmp_safe(d->iovec->iov_base, iovec->iov_base, iovec->iov_len) == 0)
+                                p = d->offset;
+                        else {
+                                r = journal_file_append_data_with_hash(
+                                                f,
+                                                iovec->iov_base, iovec->iov_len, hash,
+                                                batch_compression_find(&compression, hash, iovec),
+                                                NULL, &p);
+                                if (r < 0)
+                                        break;
+
+                                if (!d) {
+                                        d = data + n_data++;
+                                        *d = (BatchDataItem) {
+                                                .hash = hash,
+                                                .iovec = iovec,
+                                                .offset = p,
+                                        };
+
+                                        /* Failing to cache is not fatal */
+                                        (void) hashmap_put(cache, &d->hash, d);
+                                }
+                        }
+
+                        /* See journal_file_append_entry() */
+                        x = JOURNAL_HEADER_KEYED_HASH(f->header) ? jenkins_hash64(iovec->iov_base, iovec->iov_len) : hash;
+                        xor_hash ^= x;
+
+                        if (hint)
+                                *hint = (JournalDataHint) {
+                                        .file_id = f->header->file_id,
+                                        .hash = hash,
+                                        .xor_hash = x,
+                                        .offset = p,
+                                };
+
+                        items[i] = (EntryItem) {
+                                .object_offset = p,
+                                .hash = hash,
+                        };
+                }
+                if (r < 0)
+                        break;
+
+                typesafe_qsort(items, e->n_iovec, entry_item_cmp);
+                n_items = remove_duplicate_entry_items(items, e->n_iovec);
+
+                r = journal_file_append_entry_object(f, &e->ts, boot_id, xor_hash, items, n_items, seqnum, &o, &offset);
+                if (r < 0)
+                        break;
+
+                offsets[n_appended] = offset;
+
+                for (size_t i = 0; i < n_items; i++)
+                        links[n_links++] = (EntryLink) {
+                                .data_offset = le64toh(items[i].object_offset),
+                                .entry_offset = offset,
+                        };
+        }
+
+        if (n_appended > 0) {
+                int k;
+
+                k = journal_file_link_entries(f,
+                                              offsets, n_appended,
+                                              &entries[0].ts, &entries[n_appended - 1].ts,
+                                              links, n_links);
+                if (k < 0 && r >= 0)
+                        r = k;
+        }
+
+        /* See journal_file_append_entry() */
+        if (mmap_cache_fd_got_sigbus(f->cache_fd))
+                r = -EIO;
+
+        if (f->post_change_timer)
+                schedule_post_change(f);
+        else
+                journal_file_post_change(f);
+
+        if (ret_n_appended)
+                *ret_n_appended = n_appended;
+
+        return r;
+}
+
 typedef struct ChainCacheItem {
         uint64_t first; /* the array at the beginning of the chain */
         uint64_t array; /* the cached array */
@@ -2246,7 +3429,7 @@ static int generic_array_get(
                 if (r < 0)
                         return r;
 
-                k = journal_file_entry_array_n_items(o);
+                k = journal_file_entry_array_n_items(f, o);
                 if (i < k)
                         break;
 
@@ -2266,7 +3449,7 @@ static int generic_array_get(
                         if (r < 0)
                                 return r;
 
-                        k = journal_file_entry_array_n_items(o);
+                        k = journal_file_entry_array_n_items(f, o);
                         if (k == 0)
                                 break;
 
@@ -2274,12 +3457,12 @@ static int generic_array_get(
                 }
 
                 do {
-                        p = le64toh(o->entry_array.items[i]);
+                        p = journal_file_entry_array_item(f, o, i);
 
                         r = journal_file_move_to_object(f, OBJECT_ENTRY, p, ret);
                         if (r >= 0) {
                                 /* Let's cache this item for the next invocation */
-                                chain_cache_put(f->chain_cache, ci, first, a, le64toh(o->entry_array.items[0]), t, i);
+                                chain_cache_put(f->chain_cache, ci, first, a, journal_file_entry_array_item(f, o, 0), t, i);
 
                                 if (ret_offset)
                                         *ret_offset = p;
@@ -2407,13 +3590,13 @@ static int generic_array_bisect(
                 if (r < 0)
                         return r;
 
-                k = journal_file_entry_array_n_items(array);
+                k = journal_file_entry_array_n_items(f, array);
                 right = MIN(k, n);
                 if (right <= 0)
                         return 0;
 
                 i = right - 1;
-                lp = p = le64toh(array->entry_array.items[i]);
+                lp = p = journal_file_entry_array_item(f, array, i);
                 if (p <= 0)
                         r = -EBADMSG;
                 else
@@ -2446,7 +3629,7 @@ static int generic_array_bisect(
                                 if (last_index > 0) {
                                         uint64_t x = last_index - 1;
 
-                                        p = le64toh(array->entry_array.items[x]);
+                                        p = journal_file_entry_array_item(f, array, x);
                                         if (p <= 0)
                                                 return -EBADMSG;
 
@@ -2466,7 +3649,7 @@ static int generic_array_bisect(
                                 if (last_index < right) {
                                         uint64_t y = last_index + 1;
 
-                                        p = le64toh(array->entry_array.items[y]);
+                                        p = journal_file_entry_array_item(f, array, y);
                                         if (p <= 0)
                                                 return -EBADMSG;
 
@@ -2496,7 +3679,7 @@ static int generic_array_bisect(
                                 assert(left < right);
                                 i = (left + right) / 2;
 
-                                p = le64toh(array->entry_array.items[i]);
+                                p = journal_file_entry_array_item(f, array, i);
                                 if (p <= 0)
                                         r = -EBADMSG;
                                 else
@@ -2544,14 +3727,14 @@ found:
                 return 0;
 
         /* Let's cache this item for the next invocation */
-        chain_cache_put(f->chain_cache, ci, first, a, le64toh(array->entry_array.items[0]), t, subtract_one ? (i > 0 ? i-1 : UINT64_MAX) : i);
+        chain_cache_put(f->chain_cache, ci, first, a, journal_file_entry_array_item(f, array, 0), t, subtract_one ? (i > 0 ? i-1 : UINT64_MAX) : i);
 
         if (subtract_one && i == 0)
                 p = last_p;
         else if (subtract_one)
-                p = le64toh(array->entry_array.items[i-1]);
+                p = journal_file_entry_array_item(f, array, i-1);
         else
-                p = le64toh(array->entry_array.items[i]);
+                p = journal_file_entry_array_item(f, array, i);
 
         if (ret) {
                 r = journal_file_move_to_object(f, OBJECT_ENTRY, p, ret);
@@ -2671,6 +3854,86 @@ int journal_file_move_to_entry_by_offset(
                         ret, ret_offset, NULL);
 }
 
+/* Below this many keys, bisecting the entry keys switches to a linear scan */
+#define ENTRY_KEYS_SCAN_MAX 32U
+
+typedef enum EntryKey {
+        ENTRY_KEY_SEQNUM,
+        ENTRY_KEY_REALTIME,
+} EntryKey;
+
+static uint64_t entry_keys_rank(const le64_t *keys, uint64_t n, uint64_t needle, bool inclusive) {
+        const le64_t *base = keys;
+        uint64_t c = 0;
+
+        /* Returns the number of keys smaller than the needle, or not larger than it if 'inclusive' is set.
+         * The bisection is branch-free, and the final linear scan over a few adjacent keys is easily
+         * vectorized by the compiler. */
+
+        while (n > ENTRY_KEYS_SCAN_MAX) {
+                uint64_t half = n / 2, k = le64toh(base[half]);
+
+                base += (k < needle || (inclusive && k == needle)) ? half : 0;
+                n -= half;
+        }
+
+        for (uint64_t i = 0; i < n; i++) {
+                uint64_t k = le64toh(base[i]);
+
+                c += k < needle || (inclusive && k == needle);
+        }
+
+        return (uint64_t) (base - keys) + c;
+}
+
+static int journal_file_bisect_entry_keys(
+                JournalFile *f,
+                EntryKey key,
+                uint64_t needle,
+                direction_t direction,
+                Object **ret,
+                uint64_t *ret_offset) {
+
+        uint64_t p, n, i;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Looks up the first entry with a key not smaller than the needle when going down, and the last one
+         * with a key not larger than it when going up, using the entry keys object. Returns -EOPNOTSUPP if
+         * the file has none, or if it doesn't cover all entries. */
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, entry_keys_offset))
+                return -EOPNOTSUPP;
+
+        p = le64toh(READ_NOW(f->header->entry_keys_offset));
+        if (p == 0)
+                return -EOPNOTSUPP;
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY_KEYS, p, &o);
+        if (r < 0)
+                return r;
+
+        n = le64toh(o->entry_keys.n_keys);
+        if (n != le64toh(READ_NOW(f->header->n_entries)))
+                return -EOPNOTSUPP;
+
+        i = entry_keys_rank(o->entry_keys.keys + (key == ENTRY_KEY_REALTIME ? n : 0), n, needle,
+                            direction == DIRECTION_UP);
+        if (direction == DIRECTION_DOWN) {
+                if (i >= n)
+                        return 0;
+        } else {
+                if (i == 0)
+                        return 0;
+                i--;
+        }
+
+        return generic_array_get(f, le64toh(f->header->entry_array_offset), i, direction, ret, ret_offset);
+}
+
 static int test_object_seqnum(JournalFile *f, uint64_t p, uint64_t needle) {
         uint64_t sq;
         Object *o;
@@ -2698,9 +3961,15 @@ int journal_file_move_to_entry_by_seqnum(
                 direction_t direction,
                 Object **ret,
                 uint64_t *ret_offset) {
+        int r;
+
         assert(f);
         assert(f->header);
 
+        r = journal_file_bisect_entry_keys(f, ENTRY_KEY_SEQNUM, seqnum, direction, ret, ret_offset);
+        if (r != -EOPNOTSUPP)
+                return r;
+
         return generic_array_bisect(
                         f,
                         le64toh(f->header->entry_array_offset),
@@ -2738,9 +4007,15 @@ int journal_file_move_to_entry_by_realtime(
                 direction_t direction,
                 Object **ret,
                 uint64_t *ret_offset) {
+        int r;
+
         assert(f);
         assert(f->header);
 
+        r = journal_file_bisect_entry_keys(f, ENTRY_KEY_REALTIME, realtime, direction, ret, ret_offset);
+        if (r != -EOPNOTSUPP)
+                return r;
+
         return generic_array_bisect(
                         f,
                         le64toh(f->header->entry_array_offset),
@@ -3220,7 +4495,7 @@ void journal_file_print_header(JournalFile *f) {
                "Sequential number ID: %s\n"
                "State: %s\n"
                "Compatible flags:%s%s\n"
-               "Incompatible flags:%s%s%s%s%s\n"
+               "Incompatible flags:%s%s%s%s%s%s%s\n"
                "Header size: %"PRIu64"\n"
                "Arena size: %"PRIu64"\n"
                "Data hash table size: %"PRIu64"\n"
@@ -3247,6 +4522,8 @@ void journal_file_print_header(JournalFile *f) {
                JOURNAL_HEADER_COMPRESSED_LZ4(f->header) ? " COMPRESSED-LZ4" : "",
                JOURNAL_HEADER_COMPRESSED_ZSTD(f->header) ? " COMPRESSED-ZSTD" : "",
                JOURNAL_HEADER_KEYED_HASH(f->header) ? " KEYED-HASH" : "",
+               JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) ? " ZSTD-DICTIONARY" : "",
+               JOURNAL_HEADER_COMPACT(f->header) ? " COMPACT" : "",
                (le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_ANY) ? " ???" : "",
                le64toh(f->header->header_size),
                le64toh(f->header->arena_size),
@@ -3288,6 +4565,23 @@ void journal_file_print_header(JournalFile *f) {
                 printf("Deepest data hash chain: %" PRIu64"\n",
                        f->header->data_hash_chain_depth);
 
+        if (JOURNAL_HEADER_ZSTD_DICTIONARY(f->header)) {
+                CompressDictionary *d;
+
+                if (journal_file_get_dictionary(f, &d) > 0) {
+                        size_t size;
+
+                        (void) compress_dictionary_get_data(d, &size);
+                        printf("Dictionary: %"PRIu32" (%s)\n", compress_dictionary_get_id(d), FORMAT_BYTES(size));
+                }
+        }
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, summary_offset) && f->header->summary_offset != 0)
+                printf("Summary: %"PRIu64"\n", le64toh(f->header->summary_offset));
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, entry_keys_offset) && f->header->entry_keys_offset != 0)
+                printf("Entry keys: %"PRIu64"\n", le64toh(f->header->entry_keys_offset));
+
         if (fstat(f->fd, &st) >= 0)
                 printf("Disk usage: %s\n", FORMAT_BYTES((uint64_t) st.st_blocks * 512ULL));
 }
@@ -3327,7 +4621,7 @@ static int journal_file_warn_btrfs(JournalFile *f) {
         return 1;
 }
 
-static void journal_default_metrics(JournalMetrics *m, int fd) {
+static void journal_default_metrics(JournalMetrics *m, int fd, bool compact) {
         struct statvfs ss;
         uint64_t fs_size = 0;
 
@@ -3370,6 +4664,9 @@ static void journal_default_metrics(JournalMetrics *m, int fd) {
         else
                 m->max_size = PAGE_ALIGN(m->max_size);
 
+        if (compact && (m->max_size == 0 || m->max_size > JOURNAL_COMPACT_SIZE_MAX))
+                m->max_size = PAGE_ALIGN_DOWN(JOURNAL_COMPACT_SIZE_MAX);
+
         if (m->max_size != 0) {
                 if (m->max_size < JOURNAL_FILE_SIZE_MIN)
                         m->max_size = JOURNAL_FILE_SIZE_MIN;
@@ -3432,6 +4729,9 @@ int journal_file_open(
         if ((open_flags & O_ACCMODE) == O_RDONLY && FLAGS_SET(open_flags, O_CREAT))
                 return -EINVAL;
 
+        if ((open_flags & O_ACCMODE) != O_RDONLY && FLAGS_SET(file_flags, JOURNAL_PREAD))
+                return -EINVAL;
+
         if (fname && (open_flags & O_CREAT) && !endswith(fname, ".journal"))
                 return -EINVAL;
 
@@ -3508,6 +4808,18 @@ int journal_file_open(
                 goto fail;
         }
 
+        if (FLAGS_SET(file_flags, JOURNAL_PREAD)) {
+                /* The header is still accessed through the mmap cache, so that we always see the current
+                 * counters and offsets without having to reread it. But that's all that is mapped. */
+                mmap_cache_fd_set_window_size_max(f->cache_fd, sizeof(Header));
+
+                f->pread_cache = pread_cache_new(f->fd);
+                if (!f->pread_cache) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+        }
+
         if (newly_created) {
                 (void) journal_file_warn_btrfs(f);
 
@@ -3561,7 +4873,7 @@ int journal_file_open(
 
         if (journal_file_writable(f)) {
                 if (metrics) {
-                        journal_default_metrics(metrics, f->fd);
+                        journal_default_metrics(metrics, f->fd, JOURNAL_HEADER_COMPACT(f->header));
                         f->metrics = *metrics;
                 } else if (template)
                         f->metrics = template->metrics;
@@ -3598,6 +4910,20 @@ int journal_file_open(
                 goto fail;
         }
 
+#if HAVE_COMPRESSION
+        if (template)
+                journal_file_set_compress_pool(f, template->compress_pool);
+
+        /* Writers need the dictionary for every data object, hence load it right away */
+        if (journal_file_writable(f) && JOURNAL_HEADER_ZSTD_DICTIONARY(f->header)) {
+                CompressDictionary *d;
+
+                r = journal_file_get_dictionary(f, &d);
+                if (r < 0)
+                        goto fail;
+        }
+#endif
+
         if (template && template->post_change_timer) {
                 r = journal_file_enable_post_change_timer(
                                 f,
@@ -3647,6 +4973,7 @@ fail:
 
 int journal_file_archive(JournalFile *f, char **ret_previous_path) {
         _cleanup_free_ char *p = NULL;
+        int r;
 
         assert(f);
 
@@ -3661,6 +4988,17 @@ int journal_file_archive(JournalFile *f, char **ret_previous_path) {
         if (!endswith(f->path, ".journal"))
                 return -EINVAL;
 
+        /* The file won't change anymore, hence this is the time to write down a summary of what it contains,
+         * so that readers can skip it quickly when it cannot match, and the keys of its entries, so that
+         * they can seek in it quickly. */
+        r = journal_file_add_summary(f);
+        if (r < 0 && r != -EOPNOTSUPP)
+                log_debug_errno(r, "Failed to add summary to journal file %s, ignoring: %m", f->path);
+
+        r = journal_file_add_entry_keys(f);
+        if (r < 0 && r != -EOPNOTSUPP)
+                log_debug_errno(r, "Failed to add entry keys to journal file %s, ignoring: %m", f->path);
+
         if (asprintf(&p, "%.*s@" SD_ID128_FORMAT_STR "-%016"PRIx64"-%016"PRIx64".journal",
                      (int) strlen(f->path) - 8, f->path,
                      SD_ID128_FORMAT_VAL(f->header->seqnum_id),
@@ -3739,7 +5077,7 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
         };
         boot_id = &o->entry.boot_id;
 
-        n = journal_file_entry_n_items(o);
+        n = journal_file_entry_n_items(from, o);
         items = newa(EntryItem, n);
 
         for (uint64_t i = 0; i < n; i++) {
@@ -3749,7 +5087,7 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 void *data;
                 Object *u;
 
-                q = le64toh(o->entry.items[i].object_offset);
+                q = journal_file_entry_item_object_offset(from, o, i);
 
                 r = journal_file_move_to_object(from, OBJECT_DATA, q, &o);
                 if (r < 0)
@@ -3773,7 +5111,8 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
 #if HAVE_COMPRESSION
                         size_t rsize = 0;
 
-                        r = decompress_blob(
+                        r = journal_file_decompress(
+                                        from,
                                         c,
                                         o->data.payload, l,
                                         &from->compress_buffer, &rsize,
@@ -3802,8 +5141,8 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                         xor_hash ^= le64toh(u->data.hash);
 
                 items[i] = (EntryItem) {
-                        .object_offset = htole64(h),
-                        .hash = u->data.hash,
+                        .object_offset = h,
+                        .hash = le64toh(u->data.hash),
                 };
 
                 r = journal_file_move_to_object(from, OBJECT_ENTRY, p, &o);
@@ -3993,6 +5332,9 @@ static const char * const journal_object_type_table[] = {
         [OBJECT_FIELD_HASH_TABLE] = "field hash table",
         [OBJECT_ENTRY_ARRAY] = "entry array",
         [OBJECT_TAG] = "tag",
+        [OBJECT_DICTIONARY] = "dictionary",
+        [OBJECT_SUMMARY] = "summary",
+        [OBJECT_ENTRY_KEYS] = "entry keys",
 };
 
 DEFINE_STRING_TABLE_LOOKUP_TO_STRING(journal_object_type, ObjectType);
@@ -12,10 +12,12 @@
 #include "sd-event.h"
 #include "sd-id128.h"
 
+#include "compress-pool.h"
 #include "compress.h"
 #include "hashmap.h"
 #include "journal-def.h"
 #include "mmap-cache.h"
+#include "pread-cache.h"
 #include "sparse-endian.h"
 #include "time-util.h"
 
@@ -61,6 +63,7 @@ typedef enum OfflineState {
 typedef struct JournalFile {
         int fd;
         MMapFileDescriptor *cache_fd;
+        PReadCache *pread_cache; /* if set, objects are read with pread() instead of through cache_fd */
 
         mode_t mode;
 
@@ -71,6 +74,7 @@ typedef struct JournalFile {
         direction_t last_direction;
         LocationType location_type;
         uint64_t last_n_entries;
+        unsigned location_prioq_idx; /* index in sd_journal.files_by_location */
 
         char *path;
         struct stat last_stat;
@@ -102,6 +106,8 @@ typedef struct JournalFile {
         uint64_t compress_threshold_bytes;
 #if HAVE_COMPRESSION
         void *compress_buffer;
+        CompressPool *compress_pool;
+        CompressDictionary *compress_dictionary;
 #endif
 
 #if HAVE_GCRYPT
@@ -125,6 +131,7 @@ typedef struct JournalFile {
 typedef enum JournalFileFlags {
         JOURNAL_COMPRESS = 1 << 0,
         JOURNAL_SEAL     = 1 << 1,
+        JOURNAL_PREAD    = 1 << 2, /* read objects with pread() rather than mmap(), only for read-only files */
 } JournalFileFlags;
 
 int journal_file_open(
@@ -184,14 +191,61 @@ static inline bool VALID_EPOCH(uint64_t u) {
 #define JOURNAL_HEADER_KEYED_HASH(h) \
         FLAGS_SET(le32toh((h)->incompatible_flags), HEADER_INCOMPATIBLE_KEYED_HASH)
 
+#define JOURNAL_HEADER_ZSTD_DICTIONARY(h) \
+        FLAGS_SET(le32toh((h)->incompatible_flags), HEADER_INCOMPATIBLE_ZSTD_DICTIONARY)
+
+#define JOURNAL_HEADER_COMPACT(h) \
+        FLAGS_SET(le32toh((h)->incompatible_flags), HEADER_INCOMPATIBLE_COMPACT)
+
 int journal_file_move_to_object(JournalFile *f, ObjectType type, uint64_t offset, Object **ret);
 int journal_file_read_object_header(JournalFile *f, ObjectType type, uint64_t offset, Object *ret);
 
+/* Keeps the object of the given type that was moved to last accessible at its current address, until
+ * journal_file_unpin_objects() is called. Fails with -EOPNOTSUPP if the file is not accessed through memory
+ * maps. */
+int journal_file_pin_object(JournalFile *f, ObjectType type);
+void journal_file_unpin_objects(JournalFile *f);
+
 int journal_file_tail_end_by_pread(JournalFile *f, uint64_t *ret_offset);
 int journal_file_tail_end_by_mmap(JournalFile *f, uint64_t *ret_offset);
 
-uint64_t journal_file_entry_n_items(Object *o) _pure_;
-uint64_t journal_file_entry_array_n_items(Object *o) _pure_;
+/* An entry item in host byte order, independently of the on-disk layout of the file */
+typedef struct EntryItem {
+        uint64_t object_offset;
+        uint64_t hash;
+} EntryItem;
+
+static inline size_t journal_file_entry_item_size(JournalFile *f) {
+        assert(f);
+
+        return JOURNAL_HEADER_COMPACT(f->header) ? sizeof_field(Object, entry.items.compact[0]) :
+                                                   sizeof_field(Object, entry.items.regular[0]);
+}
+
+static inline uint64_t journal_file_entry_item_object_offset(JournalFile *f, Object *o, size_t i) {
+        assert(f);
+        assert(o);
+
+        return JOURNAL_HEADER_COMPACT(f->header) ? le32toh(o->entry.items.compact[i].object_offset) :
+                                                   le64toh(o->entry.items.regular[i].object_offset);
+}
+
+static inline size_t journal_file_entry_array_item_size(JournalFile *f) {
+        assert(f);
+
+        return JOURNAL_HEADER_COMPACT(f->header) ? sizeof(le32_t) : sizeof(le64_t);
+}
+
+static inline uint64_t journal_file_entry_array_item(JournalFile *f, Object *o, size_t i) {
+        assert(f);
+        assert(o);
+
+        return JOURNAL_HEADER_COMPACT(f->header) ? le32toh(o->entry_array.items.compact[i]) :
+                                                   le64toh(o->entry_array.items.regular[i]);
+}
+
+uint64_t journal_file_entry_n_items(JournalFile *f, Object *o) _pure_;
+uint64_t journal_file_entry_array_n_items(JournalFile *f, Object *o) _pure_;
 uint64_t journal_file_hash_table_n_items(Object *o) _pure_;
 
 int journal_file_append_object(JournalFile *f, ObjectType type, uint64_t size, Object **ret, uint64_t *ret_offset);
@@ -204,6 +258,37 @@ int journal_file_append_entry(
                 Object **ret,
                 uint64_t *ret_offset);
 
+/* The hash of a data object and its offset in a specific file, so that data that is appended over and over
+ * again needs to be hashed and looked up in the file only once. */
+typedef struct JournalDataHint {
+        sd_id128_t file_id;             /* The file the fields below are valid for */
+        uint64_t hash;
+        uint64_t xor_hash;              /* What the data contributes to the XOR hash of entries */
+        uint64_t offset;
+} JournalDataHint;
+
+typedef struct JournalBatchEntry {
+        dual_timestamp ts;
+        const struct iovec *iovec;
+        size_t n_iovec;
+
+        /* Optional, with one hint per iovec, each of which may be NULL. The hints are used if they are valid
+         * for the file, and updated otherwise. Hinted data must not change for the lifetime of the hint. */
+        JournalDataHint **hints;
+} JournalBatchEntry;
+
+/* Makes journal_file_append_entries() compress large fields of a batch in parallel on the specified pool.
+ * Files opened with this file as template inherit the pool. */
+void journal_file_set_compress_pool(JournalFile *f, CompressPool *pool);
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const sd_id128_t *boot_id,
+                const JournalBatchEntry entries[],
+                size_t n_entries,
+                uint64_t *seqno,
+                size_t *ret_n_appended);
+
 int journal_file_find_data_object(JournalFile *f, const void *data, uint64_t size, Object **ret, uint64_t *ret_offset);
 int journal_file_find_data_object_with_hash(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret, uint64_t *ret_offset);
 
@@ -258,6 +343,40 @@ static inline bool JOURNAL_FILE_COMPRESS(JournalFile *f) {
 
 uint64_t journal_file_hash_data(JournalFile *f, const void *data, size_t sz);
 
+/* Data objects at least this large are compressed with the dictionary, if the file has one */
+#define JOURNAL_DICTIONARY_COMPRESS_THRESHOLD_BYTES 64U
+
+/* The maximum size of dictionaries trained by journal_file_train_dictionary() */
+#define JOURNAL_DICTIONARY_SIZE_MAX (64U * 1024U)
+
+int journal_file_get_dictionary(JournalFile *f, CompressDictionary **ret);
+int journal_file_add_dictionary(JournalFile *f, const void *data, size_t size);
+int journal_file_train_dictionary(JournalFile *f, void **ret, size_t *ret_size);
+
+/* Summaries are bloom filters, see SummaryObject */
+#define JOURNAL_SUMMARY_HASH_FUNCTIONS 7U
+#define JOURNAL_SUMMARY_HASH_FUNCTIONS_MAX 32U
+#define JOURNAL_SUMMARY_BLOOM_SIZE_MAX (64U * 1024U)
+
+int journal_file_add_summary(JournalFile *f);
+int journal_file_summary_may_contain(JournalFile *f, const void *data, size_t size, uint64_t hash);
+
+int journal_file_add_entry_keys(JournalFile *f);
+
+/* Like decompress_blob() and decompress_startswith(), but use the file's dictionary as needed */
+int journal_file_decompress(
+                JournalFile *f,
+                Compression compression,
+                const void *src, uint64_t src_size,
+                void **dst, size_t *dst_size, size_t dst_max);
+int journal_file_decompress_startswith(
+                JournalFile *f,
+                Compression compression,
+                const void *src, uint64_t src_size,
+                void **buffer,
+                const void *prefix, size_t prefix_len,
+                uint8_t extra);
+
 bool journal_field_valid(const char *p, size_t l, bool allow_protected);
 
 const char* journal_object_type_to_string(ObjectType type) _const_;
@@ -8,10 +8,12 @@
 #include "sd-id128.h"
 #include "sd-journal.h"
 
+#include "catalog.h"
 #include "hashmap.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "list.h"
+#include "prioq.h"
 #include "set.h"
 
 typedef struct Match Match;
@@ -80,6 +82,20 @@ struct sd_journal {
         JournalFile *current_file;
         uint64_t current_field;
 
+        /* The entry whose data was most recently handed out by sd_journal_enumerate_borrowed_data() or
+         * sd_journal_get_borrowed_data(), and the buffers for the payloads that had to be copied */
+        JournalFile *borrowed_file;
+        uint64_t borrowed_offset;
+        void **borrowed_buffers;
+        size_t n_borrowed_buffers, n_borrowed_buffers_used;
+
+        /* Files with a candidate entry beyond current_location, ordered by that entry, and files that hit
+         * EOF but might still grow, see real_journal_next(). Both are only valid for one direction, and
+         * are rebuilt from scratch whenever the location is reset or new files show up. */
+        Prioq *files_by_location;
+        Set *files_at_tail;
+        direction_t files_by_location_direction;
+
         Match *level0, *level1, *level2;
 
         pid_t original_pid;
@@ -112,6 +128,7 @@ struct sd_journal {
         bool fields_file_lost:1;
         bool has_runtime_files:1;
         bool has_persistent_files:1;
+        bool files_by_location_valid:1;
 
         size_t data_threshold;
 
@@ -119,6 +136,8 @@ struct sd_journal {
         Hashmap *directories_by_wd;
 
         Hashmap *errors;
+
+        CatalogCache *catalog_cache;
 };
 
 char *journal_make_match_string(sd_journal *j);
@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+/* The shared memory ring a client may set up with sd_journal_enable_ring() to pass log entries to journald
+ * without a syscall per entry. See docs/JOURNAL_NATIVE_PROTOCOL.md for the protocol.
+ *
+ * The ring is a memfd consisting of the header below, followed by the data area at offset
+ * JOURNAL_RING_DATA_OFFSET. The client is the only producer, and journald the only consumer. Both sides run on
+ * the same host, hence all fields are in native endianness. */
+
+#define JOURNAL_RING_SIGNATURE ((const char[]) { 'J', 'R', 'N', 'L', 'R', 'I', 'N', 'G' })
+
+#define JOURNAL_RING_DATA_OFFSET 4096U
+
+/* The size of the data area is a power of two in this range */
+#define JOURNAL_RING_SIZE_MIN (64U*1024U)
+#define JOURNAL_RING_SIZE_MAX (64U*1024U*1024U)
+#define JOURNAL_RING_SIZE_DEFAULT (4U*1024U*1024U)
+
+/* The memfd, the eventfd to kick journald with, and the client's end of a socket pair, in this order */
+#define JOURNAL_RING_N_FDS 3U
+
+/* How long the client waits for journald to accept the ring */
+#define JOURNAL_RING_SETUP_TIMEOUT_USEC (5*USEC_PER_SEC)
+
+typedef struct JournalRingHeader {
+        char signature[8];
+        uint32_t size;                   /* Size of the data area */
+        uint8_t reserved0[52];
+
+        /* Byte positions in the data area since the ring was set up, modulo 2^32. Each is only ever written
+         * by one side, and only accessed atomically. They are kept on separate cache lines, since they are
+         * written concurrently. */
+        uint32_t head;                   /* Written by the client */
+        uint8_t reserved1[60];
+        uint32_t tail;                   /* Written by journald */
+        uint8_t reserved2[60];
+
+        /* Set by journald when it stops draining the ring, after which the client shall cease to use it */
+        uint32_t closed;
+
+        /* Set by the client to the number of bytes it waits to become free when the ring is full. Reset by
+         * journald when it wakes the client up, by sending a byte on the socket pair. */
+        uint32_t waiting;
+} JournalRingHeader;
+
+assert_cc(offsetof(JournalRingHeader, head) == 64);
+assert_cc(offsetof(JournalRingHeader, tail) == 128);
+assert_cc(offsetof(JournalRingHeader, closed) == 192);
+assert_cc(offsetof(JournalRingHeader, waiting) == 196);
+assert_cc(sizeof(JournalRingHeader) <= JOURNAL_RING_DATA_OFFSET);
+
+/* Each record in the data area starts at an 8 byte aligned position and consists of a 32-bit length
+ * followed by that many bytes of an entry in the native protocol. A record never wraps around: if it does
+ * not fit at the end of the data area, the producer writes JOURNAL_RING_RECORD_WRAP as length instead, and
+ * places the record at the beginning. Entries too large for the ring are passed in a sealed memfd over the
+ * socket pair instead, and a record with length JOURNAL_RING_RECORD_FD and no data refers to that. */
+#define JOURNAL_RING_RECORD_WRAP UINT32_MAX
+#define JOURNAL_RING_RECORD_FD (UINT32_MAX-1)
+
+static inline uint64_t journal_ring_record_size(uint32_t length) {
+        return ALIGN8(sizeof(uint32_t) + (uint64_t) length);
+}
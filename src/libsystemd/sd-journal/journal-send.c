@@ -2,8 +2,11 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <printf.h>
 #include <stddef.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/un.h>
 #include <unistd.h>
 #if HAVE_VALGRIND_VALGRIND_H
@@ -19,15 +22,25 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "io-util.h"
+#include "journal-ring.h"
 #include "journal-send.h"
 #include "memfd-util.h"
+#include "missing_fcntl.h"
+#include "process-util.h"
+#include "pthread-util.h"
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
 #include "tmpfile-util.h"
+#include "unaligned.h"
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+static const union sockaddr_union journal_socket_sa = {
+        .un.sun_family = AF_UNIX,
+        .un.sun_path = "/run/systemd/journal/socket",
+};
+
 #define ALLOCA_CODE_FUNC(f, func)                 \
         do {                                      \
                 size_t _fl;                       \
@@ -66,6 +79,290 @@ retry:
         return fd;
 }
 
+/* The ring set up with sd_journal_enable_ring(), shared by all threads of the process. The threads
+ * serialize on the mutex, so that there is a single producer at any time. */
+static struct {
+        pthread_mutex_t mutex;
+        bool active; /* may be read atomically without holding the mutex */
+        pid_t pid;
+
+        JournalRingHeader *header;
+        uint8_t *data;
+        size_t mapped_size;
+        uint32_t size;
+        uint32_t head;
+
+        int event_fd;
+        int control_fd;
+} journal_ring = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .event_fd = -1,
+        .control_fd = -1,
+};
+
+static void journal_ring_reset_locked(void) {
+        __atomic_store_n(&journal_ring.active, false, __ATOMIC_RELAXED);
+
+        if (journal_ring.header)
+                (void) munmap(journal_ring.header, journal_ring.mapped_size);
+
+        journal_ring.header = NULL;
+        journal_ring.data = NULL;
+        journal_ring.mapped_size = journal_ring.size = journal_ring.head = 0;
+        journal_ring.event_fd = safe_close(journal_ring.event_fd);
+        journal_ring.control_fd = safe_close(journal_ring.control_fd);
+}
+
+/* Waits until journald consumed enough of the ring for need bytes to be free. If journald went away in the
+ * meantime, the ring is dropped, and -ENOTCONN returned. */
+static int journal_ring_wait_locked(uint32_t need) {
+        assert(need <= journal_ring.size);
+
+        for (;;) {
+                uint32_t used;
+                char buf[16];
+                ssize_t k;
+                int r;
+
+                /* Tell journald how much space we need, so that it wakes us up once it is available. This
+                 * pairs with journald publishing its tail before checking whether we wait. */
+                __atomic_store_n(&journal_ring.header->waiting, need, __ATOMIC_SEQ_CST);
+
+                used = journal_ring.head - __atomic_load_n(&journal_ring.header->tail, __ATOMIC_SEQ_CST);
+                if (used > journal_ring.size || __atomic_load_n(&journal_ring.header->closed, __ATOMIC_ACQUIRE))
+                        break;
+
+                if (need <= journal_ring.size - used) {
+                        __atomic_store_n(&journal_ring.header->waiting, 0, __ATOMIC_RELAXED);
+                        return 0;
+                }
+
+                r = fd_wait_for_event(journal_ring.control_fd, POLLIN, USEC_INFINITY);
+                if (r == -EINTR)
+                        continue;
+                if (r < 0)
+                        break;
+
+                /* journald sends a byte whenever it wakes us up, and closes its end when it is done with the
+                 * ring */
+                k = recv(journal_ring.control_fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (k == 0 || (k < 0 && !ERRNO_IS_TRANSIENT(errno)))
+                        break;
+        }
+
+        journal_ring_reset_locked();
+        return -ENOTCONN;
+}
+
+static int journal_ring_send_memfd_locked(const struct iovec *iov, size_t n) {
+        _cleanup_close_ int buffer_fd = -1;
+        int r;
+
+        buffer_fd = memfd_new(NULL);
+        if (buffer_fd < 0)
+                return buffer_fd;
+
+        if (writev(buffer_fd, iov, n) < 0)
+                return -errno;
+
+        r = memfd_set_sealed(buffer_fd);
+        if (r < 0)
+                return r;
+
+        return send_one_fd(journal_ring.control_fd, buffer_fd, MSG_DONTWAIT);
+}
+
+static int journal_ring_write(const struct iovec *iov, size_t n) {
+        uint32_t offset, tail, used, length;
+        uint64_t size = 0, record, need;
+        uint8_t *p;
+        bool wrap;
+        int r;
+
+        assert(iov || n == 0);
+
+        if (!__atomic_load_n(&journal_ring.active, __ATOMIC_ACQUIRE))
+                return -ENOTCONN;
+
+        _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_lock_ = pthread_mutex_lock_assert(&journal_ring.mutex);
+
+        /* Check again with the mutex held, and never write to a ring our parent set up */
+        if (!journal_ring.active || journal_ring.pid != getpid_cached())
+                return -ENOTCONN;
+
+        if (__atomic_load_n(&journal_ring.header->closed, __ATOMIC_ACQUIRE)) {
+                journal_ring_reset_locked();
+                return -ENOTCONN;
+        }
+
+        for (size_t i = 0; i < n; i++)
+                size += iov[i].iov_len;
+
+        /* Large entries would fill up the ring, hence they are passed in a memfd over the socket pair
+         * instead, which a record in the ring refers to, so that journald processes them in order. */
+        if (size > journal_ring.size / 2) {
+                length = JOURNAL_RING_RECORD_FD;
+                record = journal_ring_record_size(0);
+        } else {
+                length = size;
+                record = journal_ring_record_size(length);
+        }
+
+        /* If the record does not fit at the end, it goes to the beginning */
+        offset = journal_ring.head & (journal_ring.size - 1);
+        wrap = offset + record > journal_ring.size;
+        need = wrap ? record + journal_ring.size - offset : record;
+
+        /* If the ring is full, wait for journald to catch up, like sending on the socket would */
+        tail = __atomic_load_n(&journal_ring.header->tail, __ATOMIC_ACQUIRE);
+        used = journal_ring.head - tail;
+        if (used > journal_ring.size || need > journal_ring.size - used) {
+                r = journal_ring_wait_locked(need);
+                if (r < 0)
+                        return r;
+        }
+
+        if (length == JOURNAL_RING_RECORD_FD) {
+                r = journal_ring_send_memfd_locked(iov, n);
+                if (r < 0)
+                        return r;
+        }
+
+        if (wrap) {
+                unaligned_write_ne32(journal_ring.data + offset, JOURNAL_RING_RECORD_WRAP);
+                offset = 0;
+        }
+
+        p = journal_ring.data + offset;
+        unaligned_write_ne32(p, length);
+        if (length != JOURNAL_RING_RECORD_FD) {
+                p += sizeof(uint32_t);
+                for (size_t i = 0; i < n; i++)
+                        p = mempcpy(p, iov[i].iov_base, iov[i].iov_len);
+        }
+
+        tail = journal_ring.head;
+        journal_ring.head += need;
+        __atomic_store_n(&journal_ring.header->head, journal_ring.head, __ATOMIC_SEQ_CST);
+
+        /* If journald had consumed everything before this entry, it might be waiting for a wakeup. This
+         * pairs with journald publishing its tail before checking the head one last time. */
+        if (__atomic_load_n(&journal_ring.header->tail, __ATOMIC_SEQ_CST) == tail)
+                (void) write(journal_ring.event_fd, &(uint64_t) { 1 }, sizeof(uint64_t));
+
+        return 0;
+}
+
+static int journal_ring_negotiate(int fd, int memfd, int event_fd, int peer_fd, int control_fd) {
+        CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(int) * JOURNAL_RING_N_FDS)) control = {};
+        struct msghdr mh = {
+                .msg_name = (struct sockaddr*) &journal_socket_sa.sa,
+                .msg_namelen = SOCKADDR_UN_LEN(journal_socket_sa.un),
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        struct cmsghdr *cmsg;
+        ssize_t k;
+        char ack;
+        int r;
+
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * JOURNAL_RING_N_FDS);
+        memcpy(CMSG_DATA(cmsg), (const int[JOURNAL_RING_N_FDS]) { memfd, event_fd, peer_fd }, sizeof(int) * JOURNAL_RING_N_FDS);
+
+        if (sendmsg(fd, &mh, MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        /* journald sends a single byte once it took the ring over. If it refuses the ring, or does not know
+         * about rings at all, it closes its end of the socket pair instead. */
+        r = fd_wait_for_event(control_fd, POLLIN, JOURNAL_RING_SETUP_TIMEOUT_USEC);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -ETIMEDOUT;
+
+        k = recv(control_fd, &ack, 1, MSG_DONTWAIT);
+        if (k < 0)
+                return -errno;
+        if (k == 0)
+                return -EOPNOTSUPP;
+
+        return 0;
+}
+
+_public_ int sd_journal_enable_ring(size_t size) {
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        _cleanup_close_ int memfd = -1, event_fd = -1;
+        JournalRingHeader *header;
+        size_t mapped_size;
+        int fd, r;
+
+        assert_return(size == 0 || (__builtin_popcountll(size) == 1 && size >= JOURNAL_RING_SIZE_MIN && size <= JOURNAL_RING_SIZE_MAX), -EINVAL);
+
+        if (size == 0)
+                size = JOURNAL_RING_SIZE_DEFAULT;
+
+        _unused_ _cleanup_(pthread_mutex_unlock_assertp) pthread_mutex_t *_lock_ = pthread_mutex_lock_assert(&journal_ring.mutex);
+
+        if (journal_ring.active && journal_ring.pid == getpid_cached())
+                return 0;
+
+        /* Drop whatever we inherited from our parent, or a ring journald closed */
+        journal_ring_reset_locked();
+
+        fd = journal_fd();
+        if (fd < 0)
+                return fd;
+
+        memfd = memfd_new("journal-ring");
+        if (memfd < 0)
+                return memfd;
+
+        mapped_size = JOURNAL_RING_DATA_OFFSET + size;
+        r = memfd_set_size(memfd, mapped_size);
+        if (r < 0)
+                return r;
+
+        /* The ring stays writable, but seal its size, so that journald can map it without having to fear
+         * SIGBUS */
+        if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+                return -errno;
+
+        event_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (event_fd < 0)
+                return -errno;
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, pair) < 0)
+                return -errno;
+
+        header = mmap(NULL, mapped_size, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (header == MAP_FAILED)
+                return -errno;
+
+        memcpy(header->signature, JOURNAL_RING_SIGNATURE, sizeof(header->signature));
+        header->size = size;
+
+        r = journal_ring_negotiate(fd, memfd, event_fd, pair[1], pair[0]);
+        if (r < 0) {
+                (void) munmap(header, mapped_size);
+                return r;
+        }
+
+        journal_ring.pid = getpid_cached();
+        journal_ring.header = header;
+        journal_ring.data = (uint8_t*) header + JOURNAL_RING_DATA_OFFSET;
+        journal_ring.mapped_size = mapped_size;
+        journal_ring.size = size;
+        journal_ring.head = 0;
+        journal_ring.event_fd = TAKE_FD(event_fd);
+        journal_ring.control_fd = TAKE_FD(pair[0]);
+
+        __atomic_store_n(&journal_ring.active, true, __ATOMIC_RELEASE);
+        return 0;
+}
+
 #if VALGRIND
 void close_journal_fd(void) {
         /* Be nice to valgrind. This is not atomic. This must be used only in tests. */
@@ -81,6 +378,8 @@ void close_journal_fd(void) {
 
         safe_close(fd_plus_one - 1);
         fd_plus_one = 0;
+
+        journal_ring_reset_locked();
 }
 #endif
 
@@ -232,13 +531,9 @@ _public_ int sd_journal_sendv(const struct iovec *iov, int n) {
         struct iovec *w;
         uint64_t *l;
         int i, j = 0;
-        static const union sockaddr_union sa = {
-                .un.sun_family = AF_UNIX,
-                .un.sun_path = "/run/systemd/journal/socket",
-        };
         struct msghdr mh = {
-                .msg_name = (struct sockaddr*) &sa.sa,
-                .msg_namelen = SOCKADDR_UN_LEN(sa.un),
+                .msg_name = (struct sockaddr*) &journal_socket_sa.sa,
+                .msg_namelen = SOCKADDR_UN_LEN(journal_socket_sa.un),
         };
         ssize_t k;
         bool have_syslog_identifier = false;
@@ -303,6 +598,10 @@ _public_ int sd_journal_sendv(const struct iovec *iov, int n) {
                 w[j++] = IOVEC_MAKE_STRING("\n");
         }
 
+        /* If a ring is set up, try that first, it takes no syscall for most entries */
+        if (journal_ring_write(w, j) >= 0)
+                return 0;
+
         fd = journal_fd();
         if (_unlikely_(fd < 0))
                 return fd;
@@ -9,28 +9,57 @@
 #include "alloc-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "hashmap.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-vacuum.h"
-#include "sort-util.h"
+#include "list.h"
+#include "prioq.h"
 #include "string-util.h"
 #include "time-util.h"
 #include "xattr-util.h"
 
-struct vacuum_info {
-        uint64_t usage;
+typedef enum JournalVacuumFileType {
+        JOURNAL_VACUUM_FILE_ACTIVE,      /* Never vacuumed, only counted */
+        JOURNAL_VACUUM_FILE_ARCHIVED,
+        JOURNAL_VACUUM_FILE_EMPTY,       /* Archived, but without entries, always vacuumed */
+        JOURNAL_VACUUM_FILE_UNREADABLE,  /* Archived, but we could not tell whether it is empty, left alone */
+} JournalVacuumFileType;
+
+typedef struct JournalVacuumFile JournalVacuumFile;
+
+struct JournalVacuumFile {
         char *filename;
+        JournalVacuumFileType type;
+        uint64_t usage;
 
         uint64_t realtime;
 
         sd_id128_t seqnum_id;
         uint64_t seqnum;
         bool have_seqnum;
+
+        unsigned prioq_idx;
+        LIST_FIELDS(JournalVacuumFile, list);
 };
 
-static int vacuum_compare(const struct vacuum_info *a, const struct vacuum_info *b) {
+struct JournalVacuumIndex {
+        char *directory;
+        int dir_fd;
+
+        Hashmap *files;                           /* All journal files in the directory, by file name */
+        Prioq *archived;                          /* The ones of type JOURNAL_VACUUM_FILE_ARCHIVED, oldest first */
+        LIST_HEAD(JournalVacuumFile, empty);      /* The ones of type JOURNAL_VACUUM_FILE_EMPTY */
+
+        uint64_t usage;                           /* Disk usage of all files */
+        uint64_t archived_usage;                  /* Disk usage of the files in 'archived' */
+        uint64_t n_active;
+};
+
+static int vacuum_compare(const JournalVacuumFile *a, const JournalVacuumFile *b) {
         int r;
 
         if (a->have_seqnum && b->have_seqnum &&
@@ -47,11 +76,15 @@ static int vacuum_compare(const struct vacuum_info *a, const struct vacuum_info
         return strcmp(a->filename, b->filename);
 }
 
+static int vacuum_prioq_compare(const void *a, const void *b) {
+        return vacuum_compare(a, b);
+}
+
 static void patch_realtime(
                 int fd,
                 const char *fn,
                 const struct stat *st,
-                unsigned long long *realtime) {
+                uint64_t *realtime) {
 
         usec_t x;
 
@@ -114,43 +147,231 @@ static int journal_file_empty(int dir_fd, const char *name) {
         return le64toh(n_entries) <= 0;
 }
 
-int journal_directory_vacuum(
-                const char *directory,
-                uint64_t max_use,
-                uint64_t n_max_files,
-                usec_t max_retention_usec,
-                usec_t *oldest_usec,
-                bool verbose) {
+static int journal_vacuum_file_parse(const char *name, JournalVacuumFile *f) {
+        unsigned long long seqnum, realtime, tmp;
+        char id[SD_ID128_STRING_MAX];
+        size_t q;
+
+        assert(name);
+        assert(f);
+
+        /* Returns 1 if the name is the one of an archived or disposed journal file, 0 if of some other journal
+         * file, which is considered active, and -EINVAL if it does not look like a journal file at all. */
+
+        q = strlen(name);
+
+        if (endswith(name, ".journal")) {
+
+                /* Vacuum archived files. Active files are left around */
+
+                if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8)
+                        return 0;
+
+                if (name[q-8-16-1] != '-' ||
+                    name[q-8-16-1-16-1] != '-' ||
+                    name[q-8-16-1-16-1-32-1] != '@')
+                        return 0;
+
+                memcpy(id, name + q-8-16-1-16-1-32, 32);
+                id[32] = 0;
+                if (sd_id128_from_string(id, &f->seqnum_id) < 0)
+                        return 0;
+
+                if (sscanf(name + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2)
+                        return 0;
+
+                f->seqnum = seqnum;
+                f->realtime = realtime;
+                f->have_seqnum = true;
+                return 1;
+        }
+
+        if (endswith(name, ".journal~")) {
+
+                /* Vacuum corrupted files */
+
+                if (q < 1 + 16 + 1 + 16 + 8 + 1)
+                        return 0;
+
+                if (name[q-1-8-16-1] != '-' ||
+                    name[q-1-8-16-1-16-1] != '@')
+                        return 0;
+
+                if (sscanf(name + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2)
+                        return 0;
+
+                /* seqnum_id won't be used, so set to 0 */
+                f->seqnum_id = SD_ID128_NULL;
+                f->realtime = realtime;
+                f->have_seqnum = false;
+                return 1;
+        }
+
+        return -EINVAL;
+}
+
+static void journal_vacuum_index_drop(JournalVacuumIndex *i, JournalVacuumFile *f) {
+        assert(i);
+        assert(f);
+
+        switch (f->type) {
 
-        uint64_t sum = 0, freed = 0, n_active_files = 0;
-        size_t n_list = 0, i;
+        case JOURNAL_VACUUM_FILE_ACTIVE:
+                assert(i->n_active > 0);
+                i->n_active--;
+                break;
+
+        case JOURNAL_VACUUM_FILE_ARCHIVED:
+                if (f->prioq_idx != PRIOQ_IDX_NULL)
+                        assert_se(prioq_remove(i->archived, f, &f->prioq_idx) > 0);
+                i->archived_usage = LESS_BY(i->archived_usage, f->usage);
+                break;
+
+        case JOURNAL_VACUUM_FILE_EMPTY:
+                LIST_REMOVE(list, i->empty, f);
+                break;
+
+        case JOURNAL_VACUUM_FILE_UNREADABLE:
+                break;
+        }
+
+        assert_se(hashmap_remove(i->files, f->filename) == f);
+        i->usage = LESS_BY(i->usage, f->usage);
+
+        free(f->filename);
+        free(f);
+}
+
+static int journal_vacuum_index_add(JournalVacuumIndex *i, const char *name, const struct stat *st) {
+        JournalVacuumFile *f, parsed = {};
+        int r, k;
+
+        assert(i);
+        assert(name);
+        assert(st);
+
+        r = journal_vacuum_file_parse(name, &parsed);
+        if (r < 0) {
+                /* We do not vacuum unknown files! */
+                log_debug("Not vacuuming unknown file %s.", name);
+                return 0;
+        }
+
+        f = new(JournalVacuumFile, 1);
+        if (!f)
+                return -ENOMEM;
+
+        *f = parsed;
+        f->usage = 512UL * (uint64_t) st->st_blocks;
+        f->prioq_idx = PRIOQ_IDX_NULL;
+        LIST_INIT(list, f);
+
+        f->filename = strdup(name);
+        if (!f->filename) {
+                free(f);
+                return -ENOMEM;
+        }
+
+        if (r == 0)
+                f->type = JOURNAL_VACUUM_FILE_ACTIVE;
+        else {
+                k = journal_file_empty(i->dir_fd, name);
+                if (k < 0) {
+                        log_debug_errno(k, "Failed check if %s is empty, ignoring: %m", name);
+                        f->type = JOURNAL_VACUUM_FILE_UNREADABLE;
+                } else if (k > 0)
+                        f->type = JOURNAL_VACUUM_FILE_EMPTY;
+                else {
+                        f->type = JOURNAL_VACUUM_FILE_ARCHIVED;
+                        patch_realtime(i->dir_fd, name, st, &f->realtime);
+                }
+        }
+
+        r = hashmap_ensure_put(&i->files, &string_hash_ops, f->filename, f);
+        if (r < 0) {
+                free(f->filename);
+                free(f);
+                return r;
+        }
+
+        switch (f->type) {
+
+        case JOURNAL_VACUUM_FILE_ACTIVE:
+                i->n_active++;
+                break;
+
+        case JOURNAL_VACUUM_FILE_ARCHIVED:
+                r = prioq_ensure_put(&i->archived, vacuum_prioq_compare, f, &f->prioq_idx);
+                if (r < 0) {
+                        assert_se(hashmap_remove(i->files, f->filename) == f);
+                        free(f->filename);
+                        free(f);
+                        return r;
+                }
+                i->archived_usage += f->usage;
+                break;
+
+        case JOURNAL_VACUUM_FILE_EMPTY:
+                LIST_PREPEND(list, i->empty, f);
+                break;
+
+        case JOURNAL_VACUUM_FILE_UNREADABLE:
+                break;
+        }
+
+        i->usage += f->usage;
+        return 0;
+}
+
+JournalVacuumIndex* journal_vacuum_index_free(JournalVacuumIndex *i) {
+        JournalVacuumFile *f;
+
+        if (!i)
+                return NULL;
+
+        while ((f = hashmap_first(i->files)))
+                journal_vacuum_index_drop(i, f);
+
+        hashmap_free(i->files);
+        prioq_free(i->archived);
+        safe_close(i->dir_fd);
+        free(i->directory);
+
+        return mfree(i);
+}
+
+int journal_vacuum_index_load(const char *directory, JournalVacuumIndex **ret) {
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *i = NULL;
         _cleanup_closedir_ DIR *d = NULL;
-        struct vacuum_info *list = NULL;
-        usec_t retention_limit = 0;
         int r;
 
         assert(directory);
+        assert(ret);
 
-        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
-                return 0;
+        i = new(JournalVacuumIndex, 1);
+        if (!i)
+                return -ENOMEM;
 
-        if (max_retention_usec > 0)
-                retention_limit = usec_sub_unsigned(now(CLOCK_REALTIME), max_retention_usec);
+        *i = (JournalVacuumIndex) {
+                .dir_fd = -1,
+        };
+
+        i->directory = strdup(directory);
+        if (!i->directory)
+                return -ENOMEM;
 
-        d = opendir(directory);
+        i->dir_fd = open(directory, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (i->dir_fd < 0)
+                return -errno;
+
+        d = xopendirat(i->dir_fd, ".", 0);
         if (!d)
                 return -errno;
 
-        FOREACH_DIRENT_ALL(de, d, r = -errno; goto finish) {
-                unsigned long long seqnum = 0, realtime;
-                _cleanup_free_ char *p = NULL;
-                sd_id128_t seqnum_id;
-                bool have_seqnum;
-                uint64_t size;
+        FOREACH_DIRENT_ALL(de, d, return -errno) {
                 struct stat st;
-                size_t q;
 
-                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                if (fstatat(i->dir_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
                         log_debug_errno(errno, "Failed to stat file %s while vacuuming, ignoring: %m", de->d_name);
                         continue;
                 }
@@ -158,162 +379,196 @@ int journal_directory_vacuum(
                 if (!S_ISREG(st.st_mode))
                         continue;
 
-                q = strlen(de->d_name);
-
-                if (endswith(de->d_name, ".journal")) {
-
-                        /* Vacuum archived files. Active files are
-                         * left around */
-
-                        if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8) {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        if (de->d_name[q-8-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1-32-1] != '@') {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        p = strdup(de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto finish;
-                        }
-
-                        de->d_name[q-8-16-1-16-1] = 0;
-                        if (sd_id128_from_string(de->d_name + q-8-16-1-16-1-32, &seqnum_id) < 0) {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        if (sscanf(de->d_name + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2) {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        have_seqnum = true;
-
-                } else if (endswith(de->d_name, ".journal~")) {
-                        unsigned long long tmp;
-
-                        /* seqnum_id won't be initialised before use below, so set to 0 */
-                        seqnum_id = SD_ID128_NULL;
-
-                        /* Vacuum corrupted files */
-
-                        if (q < 1 + 16 + 1 + 16 + 8 + 1) {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        if (de->d_name[q-1-8-16-1] != '-' ||
-                            de->d_name[q-1-8-16-1-16-1] != '@') {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        p = strdup(de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto finish;
-                        }
-
-                        if (sscanf(de->d_name + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2) {
-                                n_active_files++;
-                                continue;
-                        }
-
-                        have_seqnum = false;
-                } else {
-                        /* We do not vacuum unknown files! */
-                        log_debug("Not vacuuming unknown file %s.", de->d_name);
-                        continue;
-                }
+                r = journal_vacuum_index_add(i, de->d_name, &st);
+                if (r < 0)
+                        return r;
+        }
 
-                size = 512UL * (uint64_t) st.st_blocks;
+        *ret = TAKE_PTR(i);
+        return 0;
+}
 
-                r = journal_file_empty(dirfd(d), p);
-                if (r < 0) {
-                        log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", p);
-                        continue;
-                }
-                if (r > 0) {
-                        /* Always vacuum empty non-online files. */
+int journal_vacuum_index_update(JournalVacuumIndex *i, const char *filename) {
+        JournalVacuumFile *f;
+        struct stat st;
 
-                        r = unlinkat_deallocate(dirfd(d), p, 0);
-                        if (r >= 0) {
+        assert(i);
+        assert(filename);
 
-                                log_full(verbose ? LOG_INFO : LOG_DEBUG,
-                                         "Deleted empty archived journal %s/%s (%s).", directory, p, FORMAT_BYTES(size));
+        /* Looks at the specified file in the directory again, after it was created, changed, renamed or
+         * removed. */
 
-                                freed += size;
-                        } else if (r != -ENOENT)
-                                log_warning_errno(r, "Failed to delete empty archived journal %s/%s: %m", directory, p);
+        f = hashmap_get(i->files, filename);
 
-                        continue;
-                }
+        if (fstatat(i->dir_fd, filename, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                if (errno != ENOENT)
+                        return -errno;
 
-                patch_realtime(dirfd(d), p, &st, &realtime);
+                if (f)
+                        journal_vacuum_index_drop(i, f);
+                return 0;
+        }
 
-                if (!GREEDY_REALLOC(list, n_list + 1)) {
-                        r = -ENOMEM;
-                        goto finish;
+        if (f) {
+                /* Active files are the only ones that grow, fix up their usage without further ado */
+                if (f->type == JOURNAL_VACUUM_FILE_ACTIVE && S_ISREG(st.st_mode)) {
+                        i->usage = LESS_BY(i->usage, f->usage);
+                        f->usage = 512UL * (uint64_t) st.st_blocks;
+                        i->usage += f->usage;
+                        return 0;
                 }
 
-                list[n_list++] = (struct vacuum_info) {
-                        .filename = TAKE_PTR(p),
-                        .usage = size,
-                        .seqnum = seqnum,
-                        .realtime = realtime,
-                        .seqnum_id = seqnum_id,
-                        .have_seqnum = have_seqnum,
-                };
-
-                sum += size;
+                journal_vacuum_index_drop(i, f);
         }
 
-        typesafe_qsort(list, n_list, vacuum_compare);
+        if (!S_ISREG(st.st_mode))
+                return 0;
+
+        return journal_vacuum_index_add(i, filename, &st);
+}
+
+void journal_vacuum_index_remove(JournalVacuumIndex *i, const char *filename) {
+        JournalVacuumFile *f;
+
+        assert(i);
+        assert(filename);
+
+        f = hashmap_get(i->files, filename);
+        if (f)
+                journal_vacuum_index_drop(i, f);
+}
+
+const char* journal_vacuum_index_get_directory(JournalVacuumIndex *i) {
+        assert(i);
+
+        return i->directory;
+}
+
+uint64_t journal_vacuum_index_get_usage(JournalVacuumIndex *i) {
+        assert(i);
+
+        return i->usage;
+}
+
+int journal_vacuum_index_vacuum(
+                JournalVacuumIndex *i,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                journal_vacuum_delete_t delete_func,
+                void *userdata) {
+
+        LIST_HEAD(JournalVacuumFile, failed) = NULL;
+        usec_t retention_limit = 0;
+        JournalVacuumFile *f;
+        int r;
+
+        assert(i);
+        assert(delete_func);
+
+        /* Picks the files to delete, oldest first, and hands them to delete_func() one by one. They are
+         * dropped from the index right away, unless delete_func() fails. Since the archived files are kept
+         * sorted, this only looks at the files that are deleted, and at the next one. */
+
+        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+                return 0;
+
+        if (max_retention_usec > 0)
+                retention_limit = usec_sub_unsigned(now(CLOCK_REALTIME), max_retention_usec);
+
+        /* Always vacuum empty non-online files. */
+        LIST_FOREACH(list, e, i->empty) {
+                r = delete_func(i->dir_fd, i->directory, e->filename, e->usage, /* empty= */ true, userdata);
+                if (r >= 0 || r == -ENOENT)
+                        journal_vacuum_index_drop(i, e);
+        }
 
-        for (i = 0; i < n_list; i++) {
+        while ((f = prioq_peek(i->archived))) {
                 uint64_t left;
 
-                left = n_active_files + n_list - i;
+                left = i->n_active + prioq_size(i->archived);
 
-                if ((max_retention_usec <= 0 || list[i].realtime >= retention_limit) &&
-                    (max_use <= 0 || sum <= max_use) &&
+                if ((max_retention_usec <= 0 || f->realtime >= retention_limit) &&
+                    (max_use <= 0 || i->archived_usage <= max_use) &&
                     (n_max_files <= 0 || left <= n_max_files))
                         break;
 
-                r = unlinkat_deallocate(dirfd(d), list[i].filename, 0);
-                if (r >= 0) {
-                        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).",
-                                 directory, list[i].filename, FORMAT_BYTES(list[i].usage));
-                        freed += list[i].usage;
+                r = delete_func(i->dir_fd, i->directory, f->filename, f->usage, /* empty= */ false, userdata);
+                if (r < 0 && r != -ENOENT) {
+                        /* Keep it out of the way for now, and try the next one */
+                        assert_se(prioq_remove(i->archived, f, &f->prioq_idx) > 0);
+                        LIST_PREPEND(list, failed, f);
+                        continue;
+                }
+
+                journal_vacuum_index_drop(i, f);
+        }
+
+        if (oldest_usec && f && (*oldest_usec == 0 || f->realtime < *oldest_usec))
+                *oldest_usec = f->realtime;
 
-                        if (list[i].usage < sum)
-                                sum -= list[i].usage;
-                        else
-                                sum = 0;
+        while ((f = failed)) {
+                LIST_REMOVE(list, failed, f);
 
-                } else if (r != -ENOENT)
-                        log_warning_errno(r, "Failed to delete archived journal %s/%s: %m", directory, list[i].filename);
+                r = prioq_put(i->archived, f, &f->prioq_idx);
+                if (r < 0) {
+                        f->type = JOURNAL_VACUUM_FILE_UNREADABLE;
+                        i->archived_usage = LESS_BY(i->archived_usage, f->usage);
+                }
         }
 
-        if (oldest_usec && i < n_list && (*oldest_usec == 0 || list[i].realtime < *oldest_usec))
-                *oldest_usec = list[i].realtime;
+        return 0;
+}
 
-        r = 0;
+typedef struct VacuumDeleteContext {
+        uint64_t freed;
+        bool verbose;
+} VacuumDeleteContext;
+
+static int vacuum_delete_now(int dir_fd, const char *directory, const char *filename, uint64_t usage, bool empty, void *userdata) {
+        VacuumDeleteContext *c = ASSERT_PTR(userdata);
+        int r;
+
+        r = unlinkat_deallocate(dir_fd, filename, 0);
+        if (r < 0) {
+                if (r != -ENOENT)
+                        log_warning_errno(r, "Failed to delete %sarchived journal %s/%s: %m",
+                                          empty ? "empty " : "", directory, filename);
+                return r;
+        }
+
+        log_full(c->verbose ? LOG_INFO : LOG_DEBUG, "Deleted %sarchived journal %s/%s (%s).",
+                 empty ? "empty " : "", directory, filename, FORMAT_BYTES(usage));
+        c->freed += usage;
+        return 0;
+}
+
+int journal_directory_vacuum(
+                const char *directory,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                bool verbose) {
+
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *i = NULL;
+        VacuumDeleteContext c = {
+                .verbose = verbose,
+        };
+        int r;
+
+        assert(directory);
+
+        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+                return 0;
 
-finish:
-        for (i = 0; i < n_list; i++)
-                free(list[i].filename);
-        free(list);
+        r = journal_vacuum_index_load(directory, &i);
+        if (r >= 0)
+                r = journal_vacuum_index_vacuum(i, max_use, n_max_files, max_retention_usec, oldest_usec, vacuum_delete_now, &c);
 
         log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.",
-                 FORMAT_BYTES(freed), directory);
+                 FORMAT_BYTES(c.freed), directory);
 
         return r;
 }
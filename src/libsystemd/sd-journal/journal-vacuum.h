@@ -4,6 +4,34 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include "macro.h"
 #include "time-util.h"
 
+/* An index of the journal files in a directory, which allows to decide which files to vacuum without
+ * looking at all of them again. It has to be told about changes in the directory via
+ * journal_vacuum_index_update(). */
+typedef struct JournalVacuumIndex JournalVacuumIndex;
+
+/* Called for each file picked for deletion. Shall return < 0 if the file could not be deleted. */
+typedef int (*journal_vacuum_delete_t)(int dir_fd, const char *directory, const char *filename, uint64_t usage, bool empty, void *userdata);
+
+int journal_vacuum_index_load(const char *directory, JournalVacuumIndex **ret);
+JournalVacuumIndex* journal_vacuum_index_free(JournalVacuumIndex *i);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalVacuumIndex*, journal_vacuum_index_free);
+
+int journal_vacuum_index_update(JournalVacuumIndex *i, const char *filename);
+void journal_vacuum_index_remove(JournalVacuumIndex *i, const char *filename);
+
+const char* journal_vacuum_index_get_directory(JournalVacuumIndex *i);
+uint64_t journal_vacuum_index_get_usage(JournalVacuumIndex *i);
+
+int journal_vacuum_index_vacuum(
+                JournalVacuumIndex *i,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                journal_vacuum_delete_t delete_func,
+                void *userdata);
+
 int journal_directory_vacuum(const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -125,7 +127,7 @@ static int hash_payload(JournalFile *f, Object *o, uint64_t offset, const uint8_
                 _cleanup_free_ void *b = NULL;
                 size_t b_size;
 
-                r = decompress_blob(c, src, size, &b, &b_size, 0);
+                r = journal_file_decompress(f, c, src, size, &b, &b_size, 0);
                 if (r < 0) {
                         error_errno(offset, r, "%s decompression failed: %m",
                                     compression_to_string(c));
@@ -240,7 +242,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
         }
 
         case OBJECT_ENTRY:
-                if ((le64toh(o->object.size) - offsetof(Object, entry.items)) % sizeof(EntryItem) != 0) {
+                if ((le64toh(o->object.size) - offsetof(Object, entry.items)) % journal_file_entry_item_size(f) != 0) {
                         error(offset,
                               "Bad entry size (<= %zu): %"PRIu64,
                               offsetof(Object, entry.items),
@@ -248,10 +250,10 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         return -EBADMSG;
                 }
 
-                if ((le64toh(o->object.size) - offsetof(Object, entry.items)) / sizeof(EntryItem) <= 0) {
+                if ((le64toh(o->object.size) - offsetof(Object, entry.items)) / journal_file_entry_item_size(f) <= 0) {
                         error(offset,
                               "Invalid number items in entry: %"PRIu64,
-                              (le64toh(o->object.size) - offsetof(Object, entry.items)) / sizeof(EntryItem));
+                              (le64toh(o->object.size) - offsetof(Object, entry.items)) / journal_file_entry_item_size(f));
                         return -EBADMSG;
                 }
 
@@ -276,13 +278,13 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         return -EBADMSG;
                 }
 
-                for (uint64_t i = 0; i < journal_file_entry_n_items(o); i++) {
-                        if (le64toh(o->entry.items[i].object_offset) == 0 ||
-                            !VALID64(le64toh(o->entry.items[i].object_offset))) {
+                for (uint64_t i = 0; i < journal_file_entry_n_items(f, o); i++) {
+                        if (journal_file_entry_item_object_offset(f, o, i) == 0 ||
+                            !VALID64(journal_file_entry_item_object_offset(f, o, i))) {
                                 error(offset,
                                       "Invalid entry item (%"PRIu64"/%"PRIu64") offset: "OFSfmt,
-                                      i, journal_file_entry_n_items(o),
-                                      le64toh(o->entry.items[i].object_offset));
+                                      i, journal_file_entry_n_items(f, o),
+                                      journal_file_entry_item_object_offset(f, o, i));
                                 return -EBADMSG;
                         }
                 }
@@ -335,8 +337,8 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 break;
 
         case OBJECT_ENTRY_ARRAY:
-                if ((le64toh(o->object.size) - offsetof(Object, entry_array.items)) % sizeof(le64_t) != 0 ||
-                    (le64toh(o->object.size) - offsetof(Object, entry_array.items)) / sizeof(le64_t) <= 0) {
+                if ((le64toh(o->object.size) - offsetof(Object, entry_array.items)) % journal_file_entry_array_item_size(f) != 0 ||
+                    (le64toh(o->object.size) - offsetof(Object, entry_array.items)) / journal_file_entry_array_item_size(f) <= 0) {
                         error(offset,
                               "Invalid object entry array size: %"PRIu64,
                               le64toh(o->object.size));
@@ -350,13 +352,13 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         return -EBADMSG;
                 }
 
-                for (uint64_t i = 0; i < journal_file_entry_array_n_items(o); i++)
-                        if (le64toh(o->entry_array.items[i]) != 0 &&
-                            !VALID64(le64toh(o->entry_array.items[i]))) {
+                for (uint64_t i = 0; i < journal_file_entry_array_n_items(f, o); i++)
+                        if (journal_file_entry_array_item(f, o, i) != 0 &&
+                            !VALID64(journal_file_entry_array_item(f, o, i))) {
                                 error(offset,
                                       "Invalid object entry array item (%"PRIu64"/%"PRIu64"): "OFSfmt,
-                                      i, journal_file_entry_array_n_items(o),
-                                      le64toh(o->entry_array.items[i]));
+                                      i, journal_file_entry_array_n_items(f, o),
+                                      journal_file_entry_array_item(f, o, i));
                                 return -EBADMSG;
                         }
 
@@ -378,6 +380,65 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 }
 
                 break;
+
+        case OBJECT_DICTIONARY:
+                if (le64toh(o->object.size) <= offsetof(Object, dictionary.payload)) {
+                        error(offset,
+                              "Invalid object dictionary size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                if (le32toh(o->dictionary.id) == 0) {
+                        error(offset, "Invalid object dictionary id: 0");
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_SUMMARY:
+                if (le64toh(o->object.size) < offsetof(Object, summary.payload) ||
+                    le32toh(o->summary.fields_size) > le64toh(o->object.size) - offsetof(Object, summary.payload)) {
+                        error(offset,
+                              "Invalid object summary size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                if (le32toh(o->summary.n_hash_functions) == 0) {
+                        error(offset, "Invalid object summary hash function count: 0");
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_ENTRY_KEYS: {
+                uint64_t n = le64toh(o->entry_keys.n_keys);
+
+                if (le64toh(o->object.size) < offsetof(Object, entry_keys.keys) ||
+                    (le64toh(o->object.size) - offsetof(Object, entry_keys.keys)) / (2 * sizeof(le64_t)) != n ||
+                    (le64toh(o->object.size) - offsetof(Object, entry_keys.keys)) % (2 * sizeof(le64_t)) != 0) {
+                        error(offset,
+                              "Invalid object entry keys size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                if (n != le64toh(f->header->n_entries)) {
+                        error(offset,
+                              "Entry keys cover %"PRIu64" entries, but there are %"PRIu64,
+                              n, le64toh(f->header->n_entries));
+                        return -EBADMSG;
+                }
+
+                for (uint64_t i = 1; i < n; i++)
+                        if (le64toh(o->entry_keys.keys[i]) <= le64toh(o->entry_keys.keys[i - 1])) {
+                                error(offset, "Entry keys sequence numbers not increasing");
+                                return -EBADMSG;
+                        }
+
+                break;
+        }
         }
 
         return 0;
@@ -490,10 +551,10 @@ static int verify_data(
                         return -EBADMSG;
                 }
 
-                m = journal_file_entry_array_n_items(o);
+                m = journal_file_entry_array_n_items(f, o);
                 for (j = 0; i < n && j < m; i++, j++) {
 
-                        q = le64toh(o->entry_array.items[j]);
+                        q = journal_file_entry_array_item(f, o, j);
                         if (q <= last) {
                                 error(p, "Data object's entry array not sorted (%"PRIu64" <= %"PRIu64")", q, last);
                                 return -EBADMSG;
@@ -601,6 +662,116 @@ static int verify_data_hash_table(
         return 0;
 }
 
+/* Below this many data objects and entries the second iteration is not worth a thread of its own */
+#define VERIFY_THREAD_MIN 4096U
+
+/* The checks of the entry array and of the data hash table only read the file and the offset lists from the
+ * first iteration, hence can run in parallel. A JournalFile and its MMapCache may be used from one thread at
+ * a time only though, so the thread checking the data hash table gets its own of both. */
+typedef struct HashTableCheck {
+        MMapCache *mmap;
+        JournalFile *f;
+        MMapFileDescriptor *cache_data_fd, *cache_entry_fd, *cache_entry_array_fd;
+        uint64_t n_data, n_entries, n_entry_arrays;
+
+        pthread_t thread;
+        bool thread_started;
+        int result;
+} HashTableCheck;
+
+static void hash_table_check_done(HashTableCheck *c) {
+        assert(c);
+
+        if (c->thread_started) {
+                assert_se(pthread_join(c->thread, NULL) == 0);
+                c->thread_started = false;
+        }
+
+        if (c->cache_data_fd)
+                mmap_cache_fd_free(TAKE_PTR(c->cache_data_fd));
+        if (c->cache_entry_fd)
+                mmap_cache_fd_free(TAKE_PTR(c->cache_entry_fd));
+        if (c->cache_entry_array_fd)
+                mmap_cache_fd_free(TAKE_PTR(c->cache_entry_array_fd));
+
+        c->f = journal_file_close(c->f);
+        c->mmap = mmap_cache_unref(c->mmap);
+}
+
+static void* hash_table_check_thread(void *userdata) {
+        HashTableCheck *c = ASSERT_PTR(userdata);
+        usec_t last_usec = 0;
+
+        (void) pthread_setname_np(pthread_self(), "journal-verify");
+
+        c->result = verify_data_hash_table(c->f,
+                                           c->cache_data_fd, c->n_data,
+                                           c->cache_entry_fd, c->n_entries,
+                                           c->cache_entry_array_fd, c->n_entry_arrays,
+                                           &last_usec,
+                                           /* show_progress= */ false);
+        return NULL;
+}
+
+static int hash_table_check_start(
+                HashTableCheck *c,
+                JournalFile *f,
+                int data_fd, uint64_t n_data,
+                int entry_fd, uint64_t n_entries,
+                int entry_array_fd, uint64_t n_entry_arrays) {
+
+        _cleanup_close_ int fd = -1;
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(c);
+        assert(f);
+
+        *c = (HashTableCheck) {
+                .n_data = n_data,
+                .n_entries = n_entries,
+                .n_entry_arrays = n_entry_arrays,
+        };
+
+        c->mmap = mmap_cache_new();
+        if (!c->mmap)
+                return -ENOMEM;
+
+        fd = fcntl(f->fd, F_DUPFD_CLOEXEC, 3);
+        if (fd < 0)
+                return -errno;
+
+        r = journal_file_open(fd, f->path, O_RDONLY, 0, 0, 0, NULL, c->mmap, NULL, &c->f);
+        if (r < 0)
+                return r;
+        TAKE_FD(fd);
+
+        c->cache_data_fd = mmap_cache_add_fd(c->mmap, data_fd, PROT_READ);
+        c->cache_entry_fd = mmap_cache_add_fd(c->mmap, entry_fd, PROT_READ);
+        c->cache_entry_array_fd = mmap_cache_add_fd(c->mmap, entry_array_fd, PROT_READ);
+        if (!c->cache_data_fd || !c->cache_entry_fd || !c->cache_entry_array_fd)
+                return -ENOMEM;
+
+        /* Like the compression pool, leave signal handling to the calling thread, except for SIGBUS */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&c->thread, NULL, hash_table_check_thread, c);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+        c->thread_started = true;
+        if (k > 0)
+                return -k;
+
+        return 0;
+}
+
 static int data_object_in_hash_table(JournalFile *f, uint64_t hash, uint64_t p) {
         uint64_t n, h, q;
         int r;
@@ -646,12 +817,12 @@ static int verify_entry(
         assert(o);
         assert(cache_data_fd);
 
-        n = journal_file_entry_n_items(o);
+        n = journal_file_entry_n_items(f, o);
         for (i = 0; i < n; i++) {
                 uint64_t q;
                 Object *u;
 
-                q = le64toh(o->entry.items[i].object_offset);
+                q = journal_file_entry_item_object_offset(f, o, i);
 
                 if (!contains_uint64(cache_data_fd, n_data, q)) {
                         error(p, "Invalid data object of entry");
@@ -737,11 +908,11 @@ static int verify_entry_array(
                         return -EBADMSG;
                 }
 
-                m = journal_file_entry_array_n_items(o);
+                m = journal_file_entry_array_n_items(f, o);
                 for (j = 0; i < n && j < m; i++, j++) {
                         uint64_t p;
 
-                        p = le64toh(o->entry_array.items[j]);
+                        p = journal_file_entry_array_item(f, o, j);
                         if (p <= last) {
                                 error(a, "Entry array not sorted at %"PRIu64" of %"PRIu64, i, n);
                                 return -EBADMSG;
@@ -821,12 +992,14 @@ int journal_file_verify(
 
         uint64_t entry_seqnum = 0, entry_monotonic = 0, entry_realtime = 0;
         sd_id128_t entry_boot_id = {};  /* Unnecessary initialization to appease gcc */
-        bool entry_seqnum_set = false, entry_monotonic_set = false, entry_realtime_set = false, found_main_entry_array = false;
+        bool entry_seqnum_set = false, entry_monotonic_set = false, entry_realtime_set = false, found_main_entry_array = false,
+                found_dictionary = false, found_summary = false, found_entry_keys = false;
         uint64_t n_weird = 0, n_objects = 0, n_entries = 0, n_data = 0, n_fields = 0, n_data_hash_tables = 0, n_field_hash_tables = 0, n_entry_arrays = 0, n_tags = 0;
         usec_t last_usec = 0;
         _cleanup_close_ int data_fd = -1, entry_fd = -1, entry_array_fd = -1;
         _cleanup_fclose_ FILE *data_fp = NULL, *entry_fp = NULL, *entry_array_fp = NULL;
         MMapFileDescriptor *cache_data_fd = NULL, *cache_entry_fd = NULL, *cache_entry_array_fd = NULL;
+        HashTableCheck hash_table_check = {};
         unsigned i;
         bool found_last = false;
         const char *tmp_dir = NULL;
@@ -1206,6 +1379,58 @@ int journal_file_verify(
                         n_tags++;
                         break;
 
+                case OBJECT_DICTIONARY:
+                        if (!JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) ||
+                            !JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset) ||
+                            p != le64toh(f->header->dictionary_offset)) {
+                                error(p, "Dictionary object not referenced by the header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        if (found_dictionary) {
+                                error(p, "More than one dictionary");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        found_dictionary = true;
+                        break;
+
+                case OBJECT_SUMMARY:
+                        if (!JOURNAL_HEADER_CONTAINS(f->header, summary_offset) ||
+                            p != le64toh(f->header->summary_offset)) {
+                                error(p, "Summary object not referenced by the header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        if (found_summary) {
+                                error(p, "More than one summary");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        found_summary = true;
+                        break;
+
+                case OBJECT_ENTRY_KEYS:
+                        if (!JOURNAL_HEADER_CONTAINS(f->header, entry_keys_offset) ||
+                            p != le64toh(f->header->entry_keys_offset)) {
+                                error(p, "Entry keys object not referenced by the header");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        if (found_entry_keys) {
+                                error(p, "More than one entry keys object");
+                                r = -EBADMSG;
+                                goto fail;
+                        }
+
+                        found_entry_keys = true;
+                        break;
+
                 default:
                         n_weird++;
                 }
@@ -1284,6 +1509,24 @@ int journal_file_verify(
                 goto fail;
         }
 
+        if (JOURNAL_HEADER_ZSTD_DICTIONARY(f->header) && !found_dictionary) {
+                error(offsetof(Header, dictionary_offset), "Missing dictionary");
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, summary_offset) && f->header->summary_offset != 0 && !found_summary) {
+                error(offsetof(Header, summary_offset), "Missing summary");
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, entry_keys_offset) && f->header->entry_keys_offset != 0 && !found_entry_keys) {
+                error(offsetof(Header, entry_keys_offset), "Missing entry keys");
+                r = -EBADMSG;
+                goto fail;
+        }
+
         if (!found_main_entry_array && le64toh(f->header->entry_array_offset) != 0) {
                 error(0, "Missing main entry array");
                 r = -EBADMSG;
@@ -1343,6 +1586,17 @@ int journal_file_verify(
          * unreferenced objects. We only care that everything that is
          * referenced is consistent. */
 
+        if (n_data >= VERIFY_THREAD_MIN && n_entries >= VERIFY_THREAD_MIN) {
+                r = hash_table_check_start(&hash_table_check, f,
+                                           fileno(data_fp), n_data,
+                                           fileno(entry_fp), n_entries,
+                                           fileno(entry_array_fp), n_entry_arrays);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to check data hash table in parallel, continuing sequentially: %m");
+                        hash_table_check_done(&hash_table_check);
+                }
+        }
+
         r = verify_entry_array(f,
                                cache_data_fd, n_data,
                                cache_entry_fd, n_entries,
@@ -1352,12 +1606,19 @@ int journal_file_verify(
         if (r < 0)
                 goto fail;
 
-        r = verify_data_hash_table(f,
-                                   cache_data_fd, n_data,
-                                   cache_entry_fd, n_entries,
-                                   cache_entry_array_fd, n_entry_arrays,
-                                   &last_usec,
-                                   show_progress);
+        if (hash_table_check.thread_started) {
+                assert_se(pthread_join(hash_table_check.thread, NULL) == 0);
+                hash_table_check.thread_started = false;
+
+                r = hash_table_check.result;
+                hash_table_check_done(&hash_table_check);
+        } else
+                r = verify_data_hash_table(f,
+                                           cache_data_fd, n_data,
+                                           cache_entry_fd, n_entries,
+                                           cache_entry_array_fd, n_entry_arrays,
+                                           &last_usec,
+                                           show_progress);
         if (r < 0)
                 goto fail;
 
@@ -1378,6 +1639,8 @@ int journal_file_verify(
         return 0;
 
 fail:
+        hash_table_check_done(&hash_table_check);
+
         if (show_progress)
                 flush_progress();
 
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <errno.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 
@@ -24,6 +25,7 @@ struct Window {
         bool invalidated:1;
         bool keep_always:1;
         bool in_unused:1;
+        bool pinned:1;
 
         void *ptr;
         uint64_t offset;
@@ -43,19 +45,36 @@ struct Context {
         LIST_FIELDS(Context, by_window);
 };
 
+typedef enum Access {
+        ACCESS_UNKNOWN,
+        ACCESS_RANDOM,
+        ACCESS_FORWARD,
+        ACCESS_BACKWARD,
+} Access;
+
+/* How a context last accessed a file, to tell sequential from random access */
+typedef struct AccessState {
+        uint64_t last_offset, last_size; /* the window the context last used */
+        uint64_t window_size;            /* the size of new windows for this context, 0 if not known yet */
+} AccessState;
+
 struct MMapFileDescriptor {
         MMapCache *cache;
         int fd;
         int prot;
         bool sigbus;
         LIST_HEAD(Window, windows);
+
+        AccessState access[MMAP_CACHE_MAX_CONTEXTS];
+        uint64_t window_size_max; /* 0 if unlimited */
 };
 
 struct MMapCache {
         unsigned n_ref;
         unsigned n_windows;
 
-        unsigned n_context_cache_hit, n_window_list_hit, n_missed;
+        uint64_t n_context_cache_hit, n_window_list_hit, n_missed;
+        uint64_t n_sequential, n_random;
 
         Hashmap *fds;
 
@@ -70,8 +89,14 @@ struct MMapCache {
 #if ENABLE_DEBUG_MMAP_CACHE
 /* Tiny windows increase mmap activity and the chance of exposing unsafe use. */
 # define WINDOW_SIZE (page_size())
+# define WINDOW_SIZE_MIN (page_size())
+# define WINDOW_SIZE_MAX (page_size())
 #else
+/* Windows start out at WINDOW_SIZE, and then grow for sequential access, to fault in and read ahead more at
+ * once, and shrink for random access, to not waste address space for data we'll never look at. */
 # define WINDOW_SIZE (8ULL*1024ULL*1024ULL)
+# define WINDOW_SIZE_MIN (1ULL*1024ULL*1024ULL)
+# define WINDOW_SIZE_MAX (sizeof(void*) > 4 ? 64ULL*1024ULL*1024ULL : WINDOW_SIZE)
 #endif
 
 MMapCache* mmap_cache_new(void) {
@@ -184,6 +209,27 @@ static Window *window_add(MMapCache *m, MMapFileDescriptor *f, bool keep_always,
         return w;
 }
 
+static void window_release(MMapCache *m, Window *w) {
+        assert(m);
+        assert(w);
+
+        if (w->contexts || w->keep_always || w->pinned)
+                return;
+
+        /* Not used anymore */
+#if ENABLE_DEBUG_MMAP_CACHE
+        /* Unmap unused windows immediately to expose use-after-unmap
+         * by SIGSEGV. */
+        window_free(w);
+#else
+        LIST_PREPEND(unused, m->unused, w);
+        if (!m->last_unused)
+                m->last_unused = w;
+
+        w->in_unused = true;
+#endif
+}
+
 static void context_detach_window(MMapCache *m, Context *c) {
         Window *w;
 
@@ -196,20 +242,7 @@ static void context_detach_window(MMapCache *m, Context *c) {
         w = TAKE_PTR(c->window);
         LIST_REMOVE(by_window, w->contexts, c);
 
-        if (!w->contexts && !w->keep_always) {
-                /* Not used anymore? */
-#if ENABLE_DEBUG_MMAP_CACHE
-                /* Unmap unused windows immediately to expose use-after-unmap
-                 * by SIGSEGV. */
-                window_free(w);
-#else
-                LIST_PREPEND(unused, m->unused, w);
-                if (!m->last_unused)
-                        m->last_unused = w;
-
-                w->in_unused = true;
-#endif
-        }
+        window_release(m, w);
 }
 
 static void context_attach_window(MMapCache *m, Context *c, Window *w) {
@@ -360,9 +393,55 @@ static int mmap_try_harder(MMapFileDescriptor *f, void *addr, int flags, uint64_
         return 0;
 }
 
+static Access access_classify(const AccessState *a, uint64_t offset, size_t size) {
+        uint64_t end;
+
+        assert(a);
+
+        if (a->last_size == 0)
+                return ACCESS_UNKNOWN;
+
+        /* Sequential access means that the requested range begins right behind (or ends right before) the
+         * window we used last time, but crosses its border. */
+        end = a->last_offset + a->last_size;
+
+        if (offset >= a->last_offset && offset + size > end && offset < end + a->window_size)
+                return ACCESS_FORWARD;
+
+        if (offset < a->last_offset && offset + size <= end && offset + size + a->window_size > a->last_offset)
+                return ACCESS_BACKWARD;
+
+        return ACCESS_RANDOM;
+}
+
+static void window_advise(Window *w, Access access, uint64_t offset, size_t size) {
+        uint64_t begin, end;
+
+        assert(w);
+
+        if (!IN_SET(access, ACCESS_FORWARD, ACCESS_BACKWARD))
+                return;
+
+        /* Let the kernel read ahead aggressively, and start reading the part of the window ahead of us
+         * right away, instead of faulting it in page by page. */
+        (void) madvise(w->ptr, w->size, MADV_SEQUENTIAL);
+
+        if (access == ACCESS_FORWARD) {
+                begin = PAGE_ALIGN(offset + size);
+                end = w->offset + w->size;
+        } else {
+                begin = w->offset;
+                end = offset & ~((uint64_t) page_size() - 1ULL);
+        }
+
+        if (begin < end)
+                (void) madvise((uint8_t*) w->ptr + (begin - w->offset), end - begin, MADV_WILLNEED);
+}
+
 static int add_mmap(
                 MMapFileDescriptor *f,
                 Context *c,
+                AccessState *a,
                 bool keep_always,
                 uint64_t offset,
                 size_t size,
@@ -370,6 +449,7 @@ static int add_mmap(
                 void **ret) {
 
         uint64_t woffset, wsize;
+        Access access;
         Window *w;
         void *d;
         int r;
@@ -378,24 +458,45 @@ static int add_mmap(
         assert(f->cache);
         assert(f->cache->n_ref > 0);
         assert(c);
+        assert(a);
         assert(size > 0);
         assert(ret);
 
+        access = access_classify(a, offset, size);
+        if (a->window_size == 0)
+                a->window_size = WINDOW_SIZE;
+        if (IN_SET(access, ACCESS_FORWARD, ACCESS_BACKWARD)) {
+                a->window_size = MIN(a->window_size * 2, WINDOW_SIZE_MAX);
+                f->cache->n_sequential++;
+        } else if (access == ACCESS_RANDOM) {
+                a->window_size = MAX(a->window_size / 2, WINDOW_SIZE_MIN);
+                f->cache->n_random++;
+        }
+        if (f->window_size_max > 0)
+                a->window_size = MIN(a->window_size, f->window_size_max);
+
         woffset = offset & ~((uint64_t) page_size() - 1ULL);
         wsize = size + (offset - woffset);
         wsize = PAGE_ALIGN(wsize);
 
-        if (wsize < WINDOW_SIZE) {
+        if (wsize < a->window_size) {
                 uint64_t delta;
 
-                delta = PAGE_ALIGN((WINDOW_SIZE - wsize) / 2);
+                /* Place the window so that it extends in the direction we are going, or around the
+                 * requested range if we don't know. */
+                if (access == ACCESS_FORWARD)
+                        delta = 0;
+                else if (access == ACCESS_BACKWARD)
+                        delta = a->window_size - wsize;
+                else
+                        delta = PAGE_ALIGN((a->window_size - wsize) / 2);
 
-                if (delta > offset)
+                if (delta > woffset)
                         woffset = 0;
                 else
                         woffset -= delta;
 
-                wsize = WINDOW_SIZE;
+                wsize = a->window_size;
         }
 
         if (st) {
@@ -418,6 +519,8 @@ static int add_mmap(
         if (!w)
                 goto outofmem;
 
+        window_advise(w, access, offset, size);
+
         context_attach_window(f->cache, c, w);
 
         *ret = (uint8_t*) w->ptr + (offset - w->offset);
@@ -438,6 +541,7 @@ int mmap_cache_fd_get(
                 struct stat *st,
                 void **ret) {
 
+        AccessState *a;
         Context *c;
         int r;
 
@@ -449,6 +553,7 @@ int mmap_cache_fd_get(
         assert(context < MMAP_CACHE_MAX_CONTEXTS);
 
         c = &f->cache->contexts[context];
+        a = &f->access[context];
 
         /* Check whether the current context is the right one already */
         r = try_context(f, c, keep_always, offset, size, ret);
@@ -457,19 +562,41 @@ int mmap_cache_fd_get(
 
         /* Search for a matching mmap */
         r = find_mmap(f, c, keep_always, offset, size, ret);
-        if (r != 0)
+        if (r == 0) {
+                f->cache->n_missed++;
+
+                /* Create a new mmap */
+                r = add_mmap(f, c, a, keep_always, offset, size, st, ret);
+        }
+        if (r <= 0)
                 return r;
 
-        f->cache->n_missed++;
+        a->last_offset = c->window->offset;
+        a->last_size = c->window->size;
+        return r;
+}
 
-        /* Create a new mmap */
-        return add_mmap(f, c, keep_always, offset, size, st, ret);
+void mmap_cache_get_statistics(MMapCache *m, MMapCacheStatistics *ret) {
+        assert(m);
+        assert(ret);
+
+        *ret = (MMapCacheStatistics) {
+                .n_context_cache_hit = m->n_context_cache_hit,
+                .n_window_list_hit = m->n_window_list_hit,
+                .n_missed = m->n_missed,
+                .n_sequential = m->n_sequential,
+                .n_random = m->n_random,
+                .n_windows = m->n_windows,
+        };
 }
 
 void mmap_cache_stats_log_debug(MMapCache *m) {
         assert(m);
 
-        log_debug("mmap cache statistics: %u context cache hit, %u window list hit, %u miss", m->n_context_cache_hit, m->n_window_list_hit, m->n_missed);
+        log_debug("mmap cache statistics: %" PRIu64 " context cache hit, %" PRIu64 " window list hit, %" PRIu64 " miss "
+                  "(%" PRIu64 " sequential, %" PRIu64 " random), %u windows",
+                  m->n_context_cache_hit, m->n_window_list_hit, m->n_missed,
+                  m->n_sequential, m->n_random, m->n_windows);
 }
 
 static void mmap_cache_process_sigbus(MMapCache *m) {
@@ -594,3 +721,41 @@ MMapCache* mmap_cache_fd_cache(MMapFileDescriptor *f) {
 
         return f->cache;
 }
+
+int mmap_cache_fd_pin(MMapFileDescriptor *f, unsigned context) {
+        Window *w;
+
+        assert(f);
+        assert(f->cache);
+        assert(context < MMAP_CACHE_MAX_CONTEXTS);
+
+        /* Keeps the window last returned for the context mapped, even after the context moves on, until
+         * mmap_cache_fd_unpin_all() is called. */
+
+        w = f->cache->contexts[context].window;
+        if (!w || w->fd != f)
+                return -ENOMEDIUM;
+
+        w->pinned = true;
+        return 0;
+}
+
+void mmap_cache_fd_unpin_all(MMapFileDescriptor *f) {
+        assert(f);
+        assert(f->cache);
+
+        LIST_FOREACH(by_fd, w, f->windows) {
+                if (!w->pinned)
+                        continue;
+
+                w->pinned = false;
+                window_release(f->cache, w);
+        }
+}
+
+void mmap_cache_fd_set_window_size_max(MMapFileDescriptor *f, uint64_t size) {
+        assert(f);
+
+        /* Windows are never made larger than this, unless a single request needs more */
+        f->window_size_max = size > 0 ? PAGE_ALIGN(size) : 0;
+}
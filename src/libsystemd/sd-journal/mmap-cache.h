@@ -2,10 +2,11 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/stat.h>
 
 /* One context per object type, plus one of the header, plus one "additional" one */
-#define MMAP_CACHE_MAX_CONTEXTS 9
+#define MMAP_CACHE_MAX_CONTEXTS 12
 
 typedef struct MMapCache MMapCache;
 typedef struct MMapFileDescriptor MMapFileDescriptor;
@@ -25,8 +26,21 @@ int mmap_cache_fd_get(
         void **ret);
 MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd, int prot);
 MMapCache* mmap_cache_fd_cache(MMapFileDescriptor *f);
+void mmap_cache_fd_set_window_size_max(MMapFileDescriptor *f, uint64_t size);
+int mmap_cache_fd_pin(MMapFileDescriptor *f, unsigned context);
+void mmap_cache_fd_unpin_all(MMapFileDescriptor *f);
 void mmap_cache_fd_free(MMapFileDescriptor *f);
 
+typedef struct MMapCacheStatistics {
+        uint64_t n_context_cache_hit;
+        uint64_t n_window_list_hit;
+        uint64_t n_missed;
+        uint64_t n_sequential; /* misses while accessing a file sequentially, in either direction */
+        uint64_t n_random;     /* misses while accessing a file randomly */
+        unsigned n_windows;
+} MMapCacheStatistics;
+
+void mmap_cache_get_statistics(MMapCache *m, MMapCacheStatistics *ret);
 void mmap_cache_stats_log_debug(MMapCache *m);
 
 bool mmap_cache_fd_got_sigbus(MMapFileDescriptor *f);
@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "pread-cache.h"
+
+/* Reads smaller than this are rounded up, so that neighbouring objects can be served from the same buffer */
+#define BLOCK_SIZE (64U * 1024U)
+
+/* Buffers that had to be enlarged beyond this for a single large object are shrunk again afterwards */
+#define BUFFER_SIZE_KEEP (1024U * 1024U)
+
+#define BUFFERS_PER_CONTEXT 2U
+
+typedef struct Buffer {
+        void *data;
+        size_t allocated;
+
+        uint64_t offset;
+        size_t size;
+        uint64_t generation;
+} Buffer;
+
+struct PReadCache {
+        int fd;
+
+        Buffer contexts[MMAP_CACHE_MAX_CONTEXTS][BUFFERS_PER_CONTEXT];
+        unsigned next[MMAP_CACHE_MAX_CONTEXTS];
+
+        /* For keep_always requests. The Buffer structures may move, the data they point to does not. */
+        Buffer *kept;
+        size_t n_kept;
+};
+
+PReadCache* pread_cache_new(int fd) {
+        PReadCache *c;
+
+        assert(fd >= 0);
+
+        c = new0(PReadCache, 1);
+        if (!c)
+                return NULL;
+
+        c->fd = fd;
+        return c;
+}
+
+PReadCache* pread_cache_free(PReadCache *c) {
+        if (!c)
+                return NULL;
+
+        for (unsigned i = 0; i < MMAP_CACHE_MAX_CONTEXTS; i++)
+                for (unsigned k = 0; k < BUFFERS_PER_CONTEXT; k++)
+                        free(c->contexts[i][k].data);
+
+        for (size_t i = 0; i < c->n_kept; i++)
+                free(c->kept[i].data);
+        free(c->kept);
+
+        return mfree(c);
+}
+
+static bool buffer_contains(const Buffer *b, uint64_t offset, size_t size) {
+        assert(b);
+
+        return b->data &&
+                offset >= b->offset &&
+                offset + size <= b->offset + b->size;
+}
+
+static int buffer_fill(
+                PReadCache *c,
+                Buffer *b,
+                uint64_t offset,
+                size_t size,
+                size_t n,
+                uint64_t generation) {
+
+        ssize_t l;
+
+        assert(c);
+        assert(b);
+        assert(n >= size);
+
+        if (n > b->allocated || (b->allocated > BUFFER_SIZE_KEEP && n <= BUFFER_SIZE_KEEP)) {
+                void *d;
+
+                /* The old contents are overwritten anyway, hence don't bother with realloc() */
+                d = malloc(n);
+                if (!d)
+                        return -ENOMEM;
+
+                free_and_replace(b->data, d);
+                b->allocated = n;
+        }
+
+        /* Invalidate first, in case the read fails halfway */
+        b->size = 0;
+
+        l = pread(c->fd, b->data, n, offset);
+        if (l < 0)
+                return -errno;
+        if ((size_t) l < size) /* The file was truncated under our feet */
+                return -EIO;
+
+        b->offset = offset;
+        b->size = l;
+        b->generation = generation;
+        return 0;
+}
+
+static int pread_cache_get_kept(
+                PReadCache *c,
+                uint64_t offset,
+                size_t size,
+                uint64_t generation,
+                void **ret) {
+
+        Buffer *b;
+        int r;
+
+        assert(c);
+        assert(ret);
+
+        for (size_t i = 0; i < c->n_kept; i++) {
+                b = c->kept + i;
+
+                if (b->offset != offset || b->allocated < size)
+                        continue;
+
+                if (b->generation != generation || b->size < size) {
+                        /* Refresh in place, so that previously returned pointers see the new contents */
+                        r = buffer_fill(c, b, offset, size, b->allocated, generation);
+                        if (r < 0)
+                                return r;
+                }
+
+                *ret = b->data;
+                return 0;
+        }
+
+        if (!GREEDY_REALLOC(c->kept, c->n_kept + 1))
+                return -ENOMEM;
+
+        b = c->kept + c->n_kept;
+        *b = (Buffer) {};
+
+        r = buffer_fill(c, b, offset, size, size, generation);
+        if (r < 0) {
+                free(b->data);
+                return r;
+        }
+
+        c->n_kept++;
+
+        *ret = b->data;
+        return 0;
+}
+
+int pread_cache_get(
+                PReadCache *c,
+                unsigned context,
+                bool keep_always,
+                uint64_t offset,
+                size_t size,
+                uint64_t file_size,
+                uint64_t generation,
+                void **ret) {
+
+        uint64_t start, n;
+        Buffer *b;
+        int r;
+
+        assert(c);
+        assert(context < MMAP_CACHE_MAX_CONTEXTS);
+        assert(size > 0);
+        assert(offset + size <= file_size);
+        assert(ret);
+
+        if (keep_always)
+                return pread_cache_get_kept(c, offset, size, generation, ret);
+
+        for (unsigned k = 0; k < BUFFERS_PER_CONTEXT; k++) {
+                b = c->contexts[context] + k;
+
+                if (b->generation == generation && buffer_contains(b, offset, size)) {
+                        *ret = (uint8_t*) b->data + (offset - b->offset);
+                        return 0;
+                }
+        }
+
+        /* Read a whole aligned block around the requested range, or exactly the requested range if it is
+         * larger than that, but never beyond the end of the file. */
+        start = offset & ~((uint64_t) BLOCK_SIZE - 1);
+        n = MIN(MAX(offset + size - start, (uint64_t) BLOCK_SIZE), file_size - start);
+        if (n > SIZE_MAX)
+                return -EFBIG;
+
+        b = c->contexts[context] + c->next[context];
+        c->next[context] = (c->next[context] + 1) % BUFFERS_PER_CONTEXT;
+
+        r = buffer_fill(c, b, start, offset + size - start, n, generation);
+        if (r < 0)
+                return r;
+
+        *ret = (uint8_t*) b->data + (offset - start);
+        return 0;
+}
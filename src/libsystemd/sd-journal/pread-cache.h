@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "macro.h"
+#include "mmap-cache.h"
+
+/* An alternative to the mmap cache for reading journal files, that copies objects into small per-context
+ * buffers with pread(). This trades a copy for not having to set up, fault in and tear down memory maps, and
+ * for not having to deal with SIGBUS: I/O errors are reported as -EIO instead.
+ *
+ * Like with the mmap cache, a pointer returned for a context remains valid until the context is used again
+ * for a different range. Each context has two buffers, so that the pointer from the previous request in the
+ * same context also remains valid for one more request. Pointers returned for keep_always requests remain
+ * valid until the cache is freed, their contents are refreshed in place when the generation changes. */
+
+typedef struct PReadCache PReadCache;
+
+PReadCache* pread_cache_new(int fd);
+PReadCache* pread_cache_free(PReadCache *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(PReadCache*, pread_cache_free);
+
+/* The generation must change whenever previously read data might have changed in the file. */
+int pread_cache_get(
+                PReadCache *c,
+                unsigned context,
+                bool keep_always,
+                uint64_t offset,
+                size_t size,
+                uint64_t file_size,
+                uint64_t generation,
+                void **ret);
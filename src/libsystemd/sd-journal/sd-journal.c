@@ -99,11 +99,28 @@ static int journal_put_error(sd_journal *j, int r, const char *path) {
         return 0;
 }
 
+static void reset_location_queue(sd_journal *j) {
+        JournalFile *f;
+
+        assert(j);
+
+        /* Drop the queue wholesale rather than popping files off it one by one, as the latter compares
+         * locations, which might have been reset already. */
+        PRIOQ_FOREACH_ITEM(j->files_by_location, f)
+                f->location_prioq_idx = PRIOQ_IDX_NULL;
+        j->files_by_location = prioq_free(j->files_by_location);
+
+        set_clear(j->files_at_tail);
+        j->files_by_location_valid = false;
+}
+
 static void detach_location(sd_journal *j) {
         JournalFile *f;
 
         assert(j);
 
+        reset_location_queue(j);
+
         j->current_file = NULL;
         j->current_field = 0;
 
@@ -684,6 +701,67 @@ static int find_location_for_match(
         }
 }
 
+static bool match_possible_in_file(Match *m, JournalFile *f) {
+        assert(m);
+        assert(f);
+
+        /* Consults the summary of the file, if it has one, to figure out whether the file can contain any
+         * entries matching m at all. Errors are treated as "maybe", the actual lookup will deal with them. */
+
+        switch (m->type) {
+
+        case MATCH_DISCRETE: {
+                uint64_t hash;
+
+                if (JOURNAL_HEADER_KEYED_HASH(f->header))
+                        hash = journal_file_hash_data(f, m->data, m->size);
+                else
+                        hash = m->hash;
+
+                return journal_file_summary_may_contain(f, m->data, m->size, hash) != 0;
+        }
+
+        case MATCH_OR_TERM:
+                LIST_FOREACH(matches, i, m->matches)
+                        if (match_possible_in_file(i, f))
+                                return true;
+
+                return false;
+
+        case MATCH_AND_TERM:
+                LIST_FOREACH(matches, i, m->matches)
+                        if (!match_possible_in_file(i, f))
+                                return false;
+
+                return true;
+
+        default:
+                assert_not_reached();
+        }
+}
+
+static bool location_possible_in_file(const Location *l, JournalFile *f, direction_t direction) {
+        assert(l);
+        assert(f);
+
+        /* If we are looking for a wallclock time only, files whose entries are all before or after it can be
+         * skipped without bisecting them, based on the header alone. */
+
+        if (l->type != LOCATION_SEEK || !l->realtime_set || l->monotonic_set)
+                return true;
+
+        if (l->seqnum_set && sd_id128_equal(l->seqnum_id, f->header->seqnum_id))
+                return true;
+
+        if (f->header->n_entries == 0)
+                return false;
+
+        if (direction == DIRECTION_DOWN)
+                return le64toh(f->header->tail_entry_realtime) >= l->realtime;
+        else
+                return le64toh(f->header->head_entry_realtime) <= l->realtime;
+}
+
 static int find_location_with_matches(
                 sd_journal *j,
                 JournalFile *f,
@@ -698,6 +776,12 @@ static int find_location_with_matches(
         assert(ret);
         assert(offset);
 
+        if (!location_possible_in_file(&j->current_location, f, direction))
+                return 0;
+
+        if (j->level0 && !match_possible_in_file(j->level0, f))
+                return 0;
+
         if (!j->level0) {
                 /* No matches is simple */
 
@@ -813,54 +897,158 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         }
 }
 
-static int real_journal_next(sd_journal *j, direction_t direction) {
-        JournalFile *new_file = NULL;
-        unsigned n_files;
-        const void **files;
-        Object *o;
+static int files_by_location_compare(const void *a, const void *b) {
+        JournalFile *x = (JournalFile*) a, *y = (JournalFile*) b;
         int r;
 
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
+        /* All files in the queue have been advanced in the same direction */
+        assert(x->last_direction == y->last_direction);
 
-        r = iterated_cache_get(j->files_cache, NULL, &files, &n_files);
-        if (r < 0)
-                return r;
+        r = journal_file_compare_locations(x, y);
+        return x->last_direction == DIRECTION_DOWN ? r : -r;
+}
 
-        for (unsigned i = 0; i < n_files; i++) {
-                JournalFile *f = (JournalFile *)files[i];
-                bool found;
+static int advance_file(sd_journal *j, JournalFile *f, direction_t direction) {
+        int r;
 
-                r = next_beyond_location(j, f, direction);
-                if (r < 0) {
-                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
-                        remove_file_real(j, f);
-                        continue;
-                } else if (r == 0) {
-                        f->location_type = LOCATION_TAIL;
-                        continue;
+        assert(j);
+        assert(f);
+
+        /* Moves the file to its next candidate entry beyond the current location, and files it either in
+         * the location queue or among the files that hit EOF. Returns 0 if the file was dropped. */
+
+        r = next_beyond_location(j, f, direction);
+        if (r < 0) {
+                log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                remove_file_real(j, f);
+                return 0;
+        }
+        if (r == 0) {
+                f->location_type = LOCATION_TAIL;
+
+                if (f->location_prioq_idx != PRIOQ_IDX_NULL) {
+                        assert_se(prioq_remove(j->files_by_location, f, &f->location_prioq_idx) > 0);
+                        f->location_prioq_idx = PRIOQ_IDX_NULL;
                 }
 
-                if (!new_file)
-                        found = true;
-                else {
-                        int k;
+                /* Archived files will never see new entries, no need to look at them again */
+                if (f->header->state == STATE_ARCHIVED) {
+                        set_remove(j->files_at_tail, f);
+                        return 0;
+                }
+
+                r = set_ensure_put(&j->files_at_tail, NULL, f);
+                if (r < 0)
+                        return r;
 
-                        k = journal_file_compare_locations(f, new_file);
+                return 0;
+        }
+
+        set_remove(j->files_at_tail, f);
 
-                        found = direction == DIRECTION_DOWN ? k < 0 : k > 0;
+        if (f->location_prioq_idx != PRIOQ_IDX_NULL)
+                assert_se(prioq_reshuffle(j->files_by_location, f, &f->location_prioq_idx) > 0);
+        else {
+                r = prioq_ensure_put(&j->files_by_location, files_by_location_compare, f, &f->location_prioq_idx);
+                if (r < 0)
+                        return r;
+        }
+
+        return 1;
+}
+
+static int update_location_queue(sd_journal *j, direction_t direction) {
+        JournalFile *f;
+        int r;
+
+        assert(j);
+
+        if (!j->files_by_location_valid || j->files_by_location_direction != direction) {
+                unsigned n_files;
+                const void **files;
+
+                /* The location was reset, new files showed up or we changed direction, hence look at all
+                 * files again. */
+
+                reset_location_queue(j);
+
+                r = iterated_cache_get(j->files_cache, NULL, &files, &n_files);
+                if (r < 0)
+                        return r;
+
+                for (unsigned i = 0; i < n_files; i++) {
+                        r = advance_file(j, (JournalFile*) files[i], direction);
+                        if (r < 0)
+                                return r;
                 }
 
-                if (found)
-                        new_file = f;
+                j->files_by_location_direction = direction;
+                j->files_by_location_valid = true;
+                return 0;
         }
 
+        /* Otherwise the candidates of all queued files are still good, only the file we picked last time
+         * needs to move on, and files that hit EOF before might have grown in the meantime. */
+
+        if (j->current_file && j->current_file->location_type == LOCATION_DISCRETE) {
+                r = advance_file(j, j->current_file, direction);
+                if (r < 0)
+                        return r;
+        }
+
+        SET_FOREACH(f, j->files_at_tail) {
+                if (le64toh(f->header->n_entries) == f->last_n_entries)
+                        continue;
+
+                r = advance_file(j, f, direction);
+                if (r < 0)
+                        return r;
+        }
+
+        /* The queued candidates were found relative to an earlier location, hence the head of the queue
+         * might be the very entry we just looked at, if it is stored in more than one file. Skip over
+         * those. */
+        while (j->current_location.type == LOCATION_DISCRETE &&
+               (f = prioq_peek(j->files_by_location))) {
+                int k;
+
+                k = compare_with_location(f, &j->current_location, j->current_file);
+                if (direction == DIRECTION_DOWN ? k > 0 : k < 0)
+                        break;
+
+                r = advance_file(j, f, direction);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int real_journal_next(sd_journal *j, direction_t direction) {
+        JournalFile *new_file;
+        Object *o;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        r = update_location_queue(j, direction);
+        if (r < 0) {
+                reset_location_queue(j);
+                return r;
+        }
+
+        new_file = prioq_pop(j->files_by_location);
         if (!new_file)
                 return 0;
 
+        new_file->location_prioq_idx = PRIOQ_IDX_NULL;
+
         r = journal_file_move_to_object(new_file, OBJECT_ENTRY, new_file->current_offset, &o);
-        if (r < 0)
+        if (r < 0) {
+                reset_location_queue(j);
                 return r;
+        }
 
         set_location(j, new_file, o);
 
@@ -1335,12 +1523,16 @@ static int add_any_file(
                 goto error;
         }
 
-        r = journal_file_open(fd, path, O_RDONLY, 0, 0, 0, NULL, j->mmap, NULL, &f);
+        r = journal_file_open(fd, path, O_RDONLY,
+                              FLAGS_SET(j->flags, SD_JOURNAL_PREAD) ? JOURNAL_PREAD : 0,
+                              0, 0, NULL, j->mmap, NULL, &f);
         if (r < 0) {
                 log_debug_errno(r, "Failed to open journal file %s: %m", path ?: "from fd");
                 goto error;
         }
 
+        f->location_prioq_idx = PRIOQ_IDX_NULL;
+
         /* journal_file_dump(f); */
 
         /* journal_file_open() generates an replacement fname if necessary, so we can use f->path. */
@@ -1356,6 +1548,9 @@ static int add_any_file(
 
         f->last_seen_generation = j->generation;
 
+        /* The new file might have entries interleaved with the ones of the files we already know */
+        reset_location_queue(j);
+
         track_file_disposition(j, f);
         check_network(j, f->fd);
 
@@ -1419,11 +1614,22 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
 
         log_debug("File %s removed.", f->path);
 
+        if (f->location_prioq_idx != PRIOQ_IDX_NULL) {
+                assert_se(prioq_remove(j->files_by_location, f, &f->location_prioq_idx) > 0);
+                f->location_prioq_idx = PRIOQ_IDX_NULL;
+        }
+        set_remove(j->files_at_tail, f);
+
         if (j->current_file == f) {
                 j->current_file = NULL;
                 j->current_field = 0;
         }
 
+        if (j->borrowed_file == f) {
+                j->borrowed_file = NULL;
+                j->borrowed_offset = 0;
+        }
+
         if (j->unique_file == f) {
                 /* Jump to the next unique_file or NULL if that one was last */
                 j->unique_file = ordered_hashmap_next(j->files, j->unique_file->path);
@@ -1926,7 +2132,8 @@ static sd_journal *journal_new(int flags, const char *path, const char *namespac
          SD_JOURNAL_SYSTEM |                            \
          SD_JOURNAL_CURRENT_USER |                      \
          SD_JOURNAL_ALL_NAMESPACES |                    \
-         SD_JOURNAL_INCLUDE_DEFAULT_NAMESPACE)
+         SD_JOURNAL_INCLUDE_DEFAULT_NAMESPACE |         \
+         SD_JOURNAL_PREAD)
 
 _public_ int sd_journal_open_namespace(sd_journal **ret, const char *namespace, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -1952,7 +2159,7 @@ _public_ int sd_journal_open(sd_journal **ret, int flags) {
 }
 
 #define OPEN_CONTAINER_ALLOWED_FLAGS                    \
-        (SD_JOURNAL_LOCAL_ONLY | SD_JOURNAL_SYSTEM)
+        (SD_JOURNAL_LOCAL_ONLY | SD_JOURNAL_SYSTEM | SD_JOURNAL_PREAD)
 
 _public_ int sd_journal_open_container(sd_journal **ret, const char *machine, int flags) {
         _cleanup_free_ char *root = NULL, *class = NULL;
@@ -1996,7 +2203,8 @@ _public_ int sd_journal_open_container(sd_journal **ret, const char *machine, in
 
 #define OPEN_DIRECTORY_ALLOWED_FLAGS                    \
         (SD_JOURNAL_OS_ROOT |                           \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER )
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         SD_JOURNAL_PREAD)
 
 _public_ int sd_journal_open_directory(sd_journal **ret, const char *path, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -2021,12 +2229,15 @@ _public_ int sd_journal_open_directory(sd_journal **ret, const char *path, int f
         return 0;
 }
 
+#define OPEN_FILES_ALLOWED_FLAGS                        \
+        (SD_JOURNAL_PREAD)
+
 _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
         int r;
 
         assert_return(ret, -EINVAL);
-        assert_return(flags == 0, -EINVAL);
+        assert_return((flags & ~OPEN_FILES_ALLOWED_FLAGS) == 0, -EINVAL);
 
         j = journal_new(flags, NULL, NULL);
         if (!j)
@@ -2046,7 +2257,8 @@ _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int fla
 
 #define OPEN_DIRECTORY_FD_ALLOWED_FLAGS         \
         (SD_JOURNAL_OS_ROOT |                           \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER )
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         SD_JOURNAL_PREAD)
 
 _public_ int sd_journal_open_directory_fd(sd_journal **ret, int fd, int flags) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
@@ -2087,7 +2299,7 @@ _public_ int sd_journal_open_files_fd(sd_journal **ret, int fds[], unsigned n_fd
 
         assert_return(ret, -EINVAL);
         assert_return(n_fds > 0, -EBADF);
-        assert_return(flags == 0, -EINVAL);
+        assert_return((flags & ~OPEN_FILES_ALLOWED_FLAGS) == 0, -EINVAL);
 
         j = journal_new(flags, NULL, NULL);
         if (!j)
@@ -2140,6 +2352,8 @@ _public_ void sd_journal_close(sd_journal *j) {
 
         ordered_hashmap_free_with_destructor(j->files, journal_file_close);
         iterated_cache_free(j->files_cache);
+        prioq_free(j->files_by_location);
+        set_free(j->files_at_tail);
 
         while ((d = hashmap_first(j->directories_by_path)))
                 remove_directory(j, d);
@@ -2159,11 +2373,16 @@ _public_ void sd_journal_close(sd_journal *j) {
 
         hashmap_free_free(j->errors);
 
+        catalog_cache_free(j->catalog_cache);
+
         free(j->path);
         free(j->prefix);
         free(j->namespace);
         free(j->unique_field);
         free(j->fields_buffer);
+        for (size_t i = 0; i < j->n_borrowed_buffers; i++)
+                free(j->borrowed_buffers[i]);
+        free(j->borrowed_buffers);
         free(j);
 }
 
@@ -2281,14 +2500,14 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
         field_length = strlen(field);
 
-        uint64_t n = journal_file_entry_n_items(o);
+        uint64_t n = journal_file_entry_n_items(f, o);
         for (uint64_t i = 0; i < n; i++) {
                 Object *d;
                 uint64_t p, l;
                 size_t t;
                 Compression c;
 
-                p = le64toh(o->entry.items[i].object_offset);
+                p = journal_file_entry_item_object_offset(f, o, i);
                 r = journal_file_move_to_object(f, OBJECT_DATA, p, &d);
                 if (IN_SET(r, -EADDRNOTAVAIL, -EBADMSG)) {
                         log_debug_errno(r, "Entry item %"PRIu64" data object is bad, skipping over it: %m", i);
@@ -2304,8 +2523,8 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
                         return -EPROTONOSUPPORT;
                 if (c != COMPRESSION_NONE) {
 #if HAVE_COMPRESSION
-                        r = decompress_startswith(
-                                        c,
+                        r = journal_file_decompress_startswith(
+                                        f, c,
                                         d->data.payload, l,
                                         &f->compress_buffer,
                                         field, field_length, '=');
@@ -2316,8 +2535,8 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                                 size_t rsize;
 
-                                r = decompress_blob(
-                                                c,
+                                r = journal_file_decompress(
+                                                f, c,
                                                 d->data.payload, l,
                                                 &f->compress_buffer, &rsize,
                                                 j->data_threshold);
@@ -2383,8 +2602,8 @@ static int return_data(
                 size_t rsize;
                 int r;
 
-                r = decompress_blob(
-                                c,
+                r = journal_file_decompress(
+                                f, c,
                                 o->data.payload, l,
                                 &f->compress_buffer, &rsize,
                                 j->data_threshold);
@@ -2429,10 +2648,10 @@ _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t
         if (r < 0)
                 return r;
 
-        for (uint64_t n = journal_file_entry_n_items(o); j->current_field < n; j->current_field++) {
+        for (uint64_t n = journal_file_entry_n_items(f, o); j->current_field < n; j->current_field++) {
                 uint64_t p;
 
-                p = le64toh(o->entry.items[j->current_field].object_offset);
+                p = journal_file_entry_item_object_offset(f, o, j->current_field);
                 r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
                 if (IN_SET(r, -EADDRNOTAVAIL, -EBADMSG)) {
                         log_debug_errno(r, "Entry item %"PRIu64" data object is bad, skipping over it: %m", j->current_field);
@@ -2477,6 +2696,280 @@ _public_ void sd_journal_restart_data(sd_journal *j) {
         j->current_field = 0;
 }
 
+static int borrow_entry(sd_journal *j, JournalFile **ret_file, Object **ret) {
+        JournalFile *f;
+
+        assert(j);
+        assert(ret_file);
+        assert(ret);
+
+        f = j->current_file;
+        if (!f)
+                return -EADDRNOTAVAIL;
+
+        if (f->current_offset <= 0)
+                return -EADDRNOTAVAIL;
+
+        /* Data of the previous entry doesn't need to be kept around anymore once we are asked about
+         * another one */
+        if (j->borrowed_file != f || j->borrowed_offset != f->current_offset) {
+                if (j->borrowed_file)
+                        journal_file_unpin_objects(j->borrowed_file);
+
+                j->borrowed_file = f;
+                j->borrowed_offset = f->current_offset;
+                j->n_borrowed_buffers_used = 0;
+        }
+
+        *ret_file = f;
+        return journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, ret);
+}
+
+static void** borrow_buffer(sd_journal *j) {
+        assert(j);
+
+        if (j->n_borrowed_buffers_used >= j->n_borrowed_buffers) {
+                if (!GREEDY_REALLOC(j->borrowed_buffers, j->n_borrowed_buffers + 1))
+                        return NULL;
+
+                j->borrowed_buffers[j->n_borrowed_buffers++] = NULL;
+        }
+
+        return j->borrowed_buffers + j->n_borrowed_buffers_used++;
+}
+
+static int return_borrowed_data(
+                sd_journal *j,
+                JournalFile *f,
+                Object *o,
+                const void **ret_data,
+                size_t *ret_size) {
+
+        Compression c;
+        void **buffer;
+        uint64_t l;
+        size_t t;
+        int r;
+
+        assert(j);
+        assert(f);
+        assert(o);
+        assert(ret_data);
+        assert(ret_size);
+
+        l = le64toh(READ_NOW(o->object.size));
+        if (l < offsetof(Object, data.payload))
+                return -EBADMSG;
+        l -= offsetof(Object, data.payload);
+
+        /* We can't read objects larger than 4G on a 32bit machine */
+        t = (size_t) l;
+        if ((uint64_t) t != l)
+                return -E2BIG;
+
+        c = COMPRESSION_FROM_OBJECT(o);
+        if (c < 0)
+                return -EPROTONOSUPPORT;
+
+        if (c == COMPRESSION_NONE) {
+                /* The common case: hand out the payload right where it is mapped */
+                r = journal_file_pin_object(f, OBJECT_DATA);
+                if (r >= 0) {
+                        *ret_data = o->data.payload;
+                        *ret_size = t;
+                        return 0;
+                }
+                if (r != -EOPNOTSUPP)
+                        return r;
+        }
+
+        /* Otherwise the payload needs to be decompressed, or copied out of the short-lived buffers of the
+         * file, into a buffer of our own that stays around as long as the entry is borrowed */
+        buffer = borrow_buffer(j);
+        if (!buffer)
+                return -ENOMEM;
+
+        if (c != COMPRESSION_NONE) {
+#if HAVE_COMPRESSION
+                size_t rsize;
+
+                r = journal_file_decompress(
+                                f, c,
+                                o->data.payload, l,
+                                buffer, &rsize,
+                                j->data_threshold);
+                if (r < 0)
+                        return r;
+
+                t = rsize;
+#else
+                return -EPROTONOSUPPORT;
+#endif
+        } else {
+                if (!greedy_realloc(buffer, t, 1))
+                        return -ENOMEM;
+
+                memcpy(*buffer, o->data.payload, t);
+        }
+
+        *ret_data = *buffer;
+        *ret_size = t;
+        return 0;
+}
+
+_public_ int sd_journal_enumerate_borrowed_data(sd_journal *j, const void **data, size_t *size) {
+        JournalFile *f;
+        Object *o;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(data, -EINVAL);
+        assert_return(size, -EINVAL);
+
+        r = borrow_entry(j, &f, &o);
+        if (r < 0)
+                return r;
+
+        for (uint64_t n = journal_file_entry_n_items(f, o); j->current_field < n; j->current_field++) {
+                Object *d;
+                uint64_t p;
+
+                p = journal_file_entry_item_object_offset(f, o, j->current_field);
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &d);
+                if (IN_SET(r, -EADDRNOTAVAIL, -EBADMSG)) {
+                        log_debug_errno(r, "Entry item %"PRIu64" data object is bad, skipping over it: %m", j->current_field);
+                        continue;
+                }
+                if (r < 0)
+                        return r;
+
+                r = return_borrowed_data(j, f, d, data, size);
+                if (r == -EBADMSG) {
+                        log_debug("Entry item %"PRIu64" data payload is bad, skipping over it.", j->current_field);
+                        continue;
+                }
+                if (r < 0)
+                        return r;
+
+                j->current_field++;
+
+                return 1;
+        }
+
+        return 0;
+}
+
+static ssize_t find_borrowed_field(
+                const char * const *fields,
+                size_t n_fields,
+                const void **data,
+                const void *payload,
+                size_t size) {
+
+        /* Returns the index of the first field that the payload belongs to and that wasn't found yet */
+
+        for (size_t i = 0; i < n_fields; i++) {
+                size_t l;
+
+                if (data[i])
+                        continue;
+
+                l = strlen(fields[i]);
+                if (size > l && memcmp(payload, fields[i], l) == 0 && ((const char*) payload)[l] == '=')
+                        return i;
+        }
+
+        return -1;
+}
+
+_public_ int sd_journal_get_borrowed_data(
+                sd_journal *j,
+                const char * const *fields,
+                size_t n_fields,
+                const void **data,
+                size_t *sizes) {
+
+        size_t n_found = 0;
+        JournalFile *f;
+        Object *o;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(fields || n_fields == 0, -EINVAL);
+        assert_return(data || n_fields == 0, -EINVAL);
+        assert_return(sizes || n_fields == 0, -EINVAL);
+        assert_return(n_fields <= INT_MAX, -E2BIG);
+
+        for (size_t i = 0; i < n_fields; i++) {
+                assert_return(fields[i] && field_is_valid(fields[i]), -EINVAL);
+
+                data[i] = NULL;
+                sizes[i] = 0;
+        }
+
+        r = borrow_entry(j, &f, &o);
+        if (r < 0)
+                return r;
+
+        /* Resolve all requested fields in a single pass over the entry items */
+        uint64_t n = journal_file_entry_n_items(f, o);
+        for (uint64_t i = 0; i < n && n_found < n_fields; i++) {
+                const void *payload;
+                size_t size;
+                ssize_t k;
+                Compression c;
+                uint64_t p, l;
+                Object *d;
+
+                p = journal_file_entry_item_object_offset(f, o, i);
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &d);
+                if (IN_SET(r, -EADDRNOTAVAIL, -EBADMSG)) {
+                        log_debug_errno(r, "Entry item %"PRIu64" data object is bad, skipping over it: %m", i);
+                        continue;
+                }
+                if (r < 0)
+                        return r;
+
+                l = le64toh(READ_NOW(d->object.size));
+                if (l < offsetof(Object, data.payload))
+                        continue;
+                l -= offsetof(Object, data.payload);
+
+                c = COMPRESSION_FROM_OBJECT(d);
+                if (c == COMPRESSION_NONE) {
+                        /* Check the field name before doing anything else with the payload */
+                        k = find_borrowed_field(fields, n_fields, data, d->data.payload, MIN(l, (uint64_t) SIZE_MAX));
+                        if (k < 0)
+                                continue;
+                }
+
+                r = return_borrowed_data(j, f, d, &payload, &size);
+                if (JOURNAL_ERRNO_IS_UNAVAILABLE_FIELD(r) || r == -EBADMSG) {
+                        log_debug_errno(r, "Entry item %"PRIu64" data payload is not available, skipping over it: %m", i);
+                        continue;
+                }
+                if (r < 0)
+                        return r;
+
+                if (c != COMPRESSION_NONE) {
+                        k = find_borrowed_field(fields, n_fields, data, payload, size);
+                        if (k < 0) {
+                                /* Not interested after all, give the buffer back */
+                                j->n_borrowed_buffers_used--;
+                                continue;
+                        }
+                }
+
+                data[k] = payload;
+                sizes[k] = size;
+                n_found++;
+        }
+
+        return (int) n_found;
+}
+
 static int reiterate_all_paths(sd_journal *j) {
         assert(j);
 
@@ -3243,7 +3736,7 @@ _public_ int sd_journal_get_catalog(sd_journal *j, char **ret) {
         if (r < 0)
                 return r;
 
-        r = catalog_get(CATALOG_DATABASE, id, &text);
+        r = catalog_get_cached(&j->catalog_cache, CATALOG_DATABASE, id, &text);
         if (r < 0)
                 return r;
 
@@ -166,6 +166,28 @@ static void test_catalog_update(const char *database) {
         assert_se(r == 0);
 }
 
+static void test_catalog_get_cached(const char *database) {
+        _cleanup_(catalog_cache_freep) CatalogCache *cache = NULL;
+        _cleanup_free_ char *expected = NULL;
+        char *text = NULL;
+
+        assert_se(catalog_get(database, SD_MESSAGE_COREDUMP, &expected) >= 0);
+
+        /* The second and third lookups are served from the cache, including the negative ones */
+        for (unsigned i = 0; i < 3; i++) {
+                assert_se(catalog_get_cached(&cache, database, SD_MESSAGE_COREDUMP, &text) >= 0);
+                assert_se(streq(text, expected));
+                text = mfree(text);
+
+                assert_se(catalog_get_cached(&cache, database,
+                                             SD_ID128_MAKE(ba,df,00,d0,00,00,00,00,00,00,00,00,00,00,00,00),
+                                             &text) == -ENOENT);
+                assert_se(!text);
+        }
+
+        assert_se(catalog_get_cached(&cache, "/no/such/catalog", SD_MESSAGE_COREDUMP, &text) == -ENOENT);
+}
+
 static void test_catalog_file_lang(void) {
         _cleanup_free_ char *lang = NULL, *lang2 = NULL, *lang3 = NULL, *lang4 = NULL;
 
@@ -232,5 +254,7 @@ int main(int argc, char *argv[]) {
         assert_se(catalog_get(database, SD_MESSAGE_COREDUMP, &text) >= 0);
         printf(">>>%s<<<\n", text);
 
+        test_catalog_get_cached(database);
+
         return 0;
 }
@@ -99,6 +99,38 @@ TEST(journal_send) {
         closelog();
 }
 
+TEST(journal_ring) {
+        _cleanup_free_ char *huge = NULL;
+        int r;
+
+        assert_se(sd_journal_enable_ring(1) == -EINVAL);
+        assert_se(sd_journal_enable_ring(3 * 64 * 1024) == -EINVAL);
+
+        r = sd_journal_enable_ring(64 * 1024);
+        if (r < 0)
+                return (void) log_tests_skipped_errno(r, "Failed to set up journal ring");
+
+        /* Setting it up again is a NOP */
+        assert_se(sd_journal_enable_ring(0) == 0);
+
+        for (unsigned i = 0; i < 1000; i++)
+                assert_se(sd_journal_send("MESSAGE=ring test %u", i,
+                                          "SINGLETON=1",
+                                          NULL) == 0);
+
+        /* Entries too large for the ring go through it by reference */
+        assert_se(huge = malloc(HUGE_SIZE));
+        memcpy(huge, "HUGE=", STRLEN("HUGE="));
+        memset(&huge[STRLEN("HUGE=")], 'x', HUGE_SIZE - STRLEN("HUGE=") - 1);
+        huge[HUGE_SIZE - 1] = '\0';
+
+        assert_se(sd_journal_send("MESSAGE=Huge field attached to ring",
+                                  huge,
+                                  NULL) == 0);
+
+        assert_se(sd_journal_print(LOG_NOTICE, "Hello Ring") == 0);
+}
+
 static int outro(void) {
         /* Sleep a bit to make it easy for journald to collect metadata. */
         sleep(1);
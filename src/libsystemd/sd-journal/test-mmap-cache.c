@@ -1,11 +1,13 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
 #include "fd-util.h"
+#include "log.h"
 #include "macro.h"
 #include "mmap-cache.h"
 #include "tmpfile-util.h"
@@ -55,6 +57,58 @@ int main(int argc, char *argv[]) {
 
         assert_se((uint8_t*) p + 1 == (uint8_t*) q);
 
+        /* Scanning a file sequentially grows the windows, hence we need fewer of them than for the same data
+         * accessed randomly */
+        MMapCacheStatistics stats;
+        MMapFileDescriptor *fy, *fz;
+        struct stat st;
+        uint64_t missed;
+
+        assert_se(ftruncate(y, 256ULL*1024ULL*1024ULL) >= 0);
+        assert_se(fstat(y, &st) >= 0);
+        assert_se(fy = mmap_cache_add_fd(m, y, PROT_READ));
+
+        mmap_cache_get_statistics(m, &stats);
+        missed = stats.n_missed;
+
+        for (uint64_t o = 0; o < (uint64_t) st.st_size; o += 4096) {
+                r = mmap_cache_fd_get(fy, 2, false, o, 64, &st, &p);
+                assert_se(r >= 0);
+                assert_se(*(uint8_t*) p == 0);
+        }
+
+        mmap_cache_get_statistics(m, &stats);
+        log_info("Sequential scan: %" PRIu64 " misses, %" PRIu64 " sequential", stats.n_missed - missed, stats.n_sequential);
+        assert_se(stats.n_missed - missed < (uint64_t) st.st_size / (8ULL*1024ULL*1024ULL));
+        assert_se(stats.n_sequential > 0);
+
+        /* Same backwards, on a different file so that we can't reuse the windows */
+        assert_se(ftruncate(z, st.st_size) >= 0);
+        assert_se(fz = mmap_cache_add_fd(m, z, PROT_READ));
+
+        missed = stats.n_missed;
+        for (uint64_t o = st.st_size; o > 0; o -= 4096) {
+                r = mmap_cache_fd_get(fz, 3, false, o - 64, 64, &st, &p);
+                assert_se(r >= 0);
+        }
+
+        mmap_cache_get_statistics(m, &stats);
+        log_info("Backward scan: %" PRIu64 " misses, %" PRIu64 " sequential", stats.n_missed - missed, stats.n_sequential);
+        assert_se(stats.n_missed - missed < (uint64_t) st.st_size / (8ULL*1024ULL*1024ULL));
+
+        /* Jumping around is classified as random access */
+        for (unsigned i = 0; i < 16; i++) {
+                r = mmap_cache_fd_get(fy, 4, false, (i * 7919ULL % 256) * 1024ULL*1024ULL, 64, &st, &p);
+                assert_se(r >= 0);
+        }
+
+        mmap_cache_get_statistics(m, &stats);
+        assert_se(stats.n_random > 0);
+
+        mmap_cache_stats_log_debug(m);
+        mmap_cache_fd_free(fy);
+        mmap_cache_fd_free(fz);
+
         mmap_cache_fd_free(fx);
         mmap_cache_unref(m);
 
@@ -14,6 +14,11 @@
 
 #define NETLINK_RQUEUE_MAX 64*1024
 
+/* Limits of messages written to the socket at once while a batch is open. The kernel refuses writes
+ * larger than the send buffer of the socket. */
+#define NETLINK_WQUEUE_MAX 512U
+#define NETLINK_WQUEUE_BYTES_MAX (32U * 1024U)
+
 #define NETLINK_CONTAINER_DEPTH 32
 
 struct reply_callback {
@@ -80,6 +85,12 @@ struct sd_netlink {
 
         struct nlmsghdr *rbuffer;
 
+        /* Messages sent while a batch is open, see netlink_batch_begin(). */
+        sd_netlink_message **wqueue;
+        size_t wqueue_size;
+        size_t wqueue_bytes;
+        unsigned n_batches;
+
         bool processing:1;
 
         uint32_t serial;
@@ -125,6 +136,7 @@ struct sd_netlink_message {
         unsigned n_containers; /* number of containers */
         uint32_t multicast_group;
         bool sealed:1;
+        bool parse_pending:1; /* top-level attributes are parsed on first access */
 
         sd_netlink_message *next; /* next in a chain of multi-part messages */
 };
@@ -150,11 +162,13 @@ int netlink_open_family(sd_netlink **ret, int family);
 bool netlink_pid_changed(sd_netlink *nl);
 int netlink_rqueue_make_room(sd_netlink *nl);
 int netlink_rqueue_partial_make_room(sd_netlink *nl);
+void netlink_flush_wqueue(sd_netlink *nl);
 
 int socket_bind(sd_netlink *nl);
 int socket_broadcast_group_ref(sd_netlink *nl, unsigned group);
 int socket_broadcast_group_unref(sd_netlink *nl, unsigned group);
 int socket_write_message(sd_netlink *nl, sd_netlink_message *m);
+int socket_write_messages(sd_netlink *nl, sd_netlink_message **m, size_t n);
 int socket_read_message(sd_netlink *nl);
 
 int netlink_add_match_internal(
@@ -695,6 +695,8 @@ _public_ int sd_netlink_message_cancel_array(sd_netlink_message *m) {
         return 0;
 }
 
+static int netlink_message_parse_pending(sd_netlink_message *m);
+
 static int netlink_message_read_internal(
                 sd_netlink_message *m,
                 unsigned short type,
@@ -703,12 +705,17 @@ static int netlink_message_read_internal(
 
         struct netlink_attribute *attribute;
         struct rtattr *rta;
+        int r;
 
         assert_return(m, -EINVAL);
         assert_return(m->sealed, -EPERM);
 
         assert(m->n_containers < NETLINK_CONTAINER_DEPTH);
 
+        r = netlink_message_parse_pending(m);
+        if (r < 0)
+                return r;
+
         if (!m->containers[m->n_containers].attributes)
                 return -ENODATA;
 
@@ -1138,19 +1145,31 @@ static int netlink_container_parse(
 
         _cleanup_free_ struct netlink_attribute *attributes = NULL;
         uint16_t max_attr = 0;
+        bool found = false;
 
         /* RTA_OK() macro compares with rta->rt_len, which is unsigned short, and
          * LGTM.com analysis does not like the type difference. Hence, here we
          * introduce an unsigned short variable as a workaround. */
         unsigned short len = rt_len;
+
+        /* Find the maximum attribute first, so that the table is allocated only once, rather than grown
+         * for each attribute with a larger type. */
+        for (struct rtattr *i = rta; RTA_OK(i, len); i = RTA_NEXT(i, len)) {
+                max_attr = MAX(max_attr, (uint16_t) RTA_TYPE(i));
+                found = true;
+        }
+
+        if (found) {
+                attributes = new0(struct netlink_attribute, (size_t) max_attr + 1);
+                if (!attributes)
+                        return -ENOMEM;
+        }
+
+        len = rt_len;
         for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
                 uint16_t attr;
 
                 attr = RTA_TYPE(rta);
-                max_attr = MAX(max_attr, attr);
-
-                if (!GREEDY_REALLOC0(attributes, (size_t) max_attr + 1))
-                        return -ENOMEM;
 
                 if (attributes[attr].offset != 0)
                         log_debug("sd-netlink: message parse - overwriting repeated attribute");
@@ -1305,10 +1324,16 @@ _public_ int sd_netlink_message_exit_container(sd_netlink_message *m) {
 }
 
 _public_ int sd_netlink_message_get_max_attribute(sd_netlink_message *m, uint16_t *ret) {
+        int r;
+
         assert_return(m, -EINVAL);
         assert_return(m->sealed, -EINVAL);
         assert_return(ret, -EINVAL);
 
+        r = netlink_message_parse_pending(m);
+        if (r < 0)
+                return r;
+
         *ret = m->containers[m->n_containers].max_attribute;
         return 0;
 }
@@ -1370,8 +1395,8 @@ _public_ int sd_netlink_message_rewind(sd_netlink_message *m, sd_netlink *nl) {
 
         m->n_containers = 0;
 
-        if (m->containers[0].attributes)
-                /* top-level attributes have already been parsed */
+        if (m->containers[0].attributes || m->parse_pending)
+                /* top-level attributes have already been parsed, or will be on first access */
                 return 0;
 
         assert(m->hdr);
@@ -1384,10 +1409,37 @@ _public_ int sd_netlink_message_rewind(sd_netlink_message *m, sd_netlink *nl) {
         if (sd_netlink_message_is_error(m))
                 return netlink_message_parse_error(m);
 
-        return netlink_container_parse(m,
-                                       &m->containers[0],
-                                       (struct rtattr*)((uint8_t*) NLMSG_DATA(m->hdr) + NLMSG_ALIGN(size)),
-                                       NLMSG_PAYLOAD(m->hdr, size));
+        /* Many received messages are dropped by their handlers after looking at the header only, e.g.
+         * those for interfaces we do not manage. Hence, defer building the attribute table until an
+         * attribute is actually read. */
+        m->containers[0].offset = NLMSG_SPACE(size);
+        m->parse_pending = true;
+        return 0;
+}
+
+static int netlink_message_parse_pending(sd_netlink_message *m) {
+        struct netlink_container *c;
+        int r;
+
+        assert(m);
+        assert(m->hdr);
+
+        if (!m->parse_pending)
+                return 0;
+
+        /* Attributes of nested containers can only be read after the top-level ones. */
+        assert(m->n_containers == 0);
+
+        c = &m->containers[0];
+        r = netlink_container_parse(m,
+                                    c,
+                                    (struct rtattr*)((uint8_t*) m->hdr + c->offset),
+                                    m->hdr->nlmsg_len > c->offset ? m->hdr->nlmsg_len - c->offset : 0);
+        if (r < 0)
+                return r;
+
+        m->parse_pending = false;
+        return 0;
 }
 
 void message_seal(sd_netlink_message *m) {
@@ -182,6 +182,44 @@ int socket_write_message(sd_netlink *nl, sd_netlink_message *m) {
         return k;
 }
 
+int socket_write_messages(sd_netlink *nl, sd_netlink_message **m, size_t n) {
+        static const uint8_t padding[NLMSG_ALIGNTO] = {};
+        union sockaddr_union addr = {
+                .nl.nl_family = AF_NETLINK,
+        };
+        struct iovec *iovs;
+        struct msghdr mh = {
+                .msg_name = &addr.sa,
+                .msg_namelen = sizeof(addr.nl),
+        };
+        ssize_t k;
+
+        assert(nl);
+        assert(m);
+        assert(n > 0);
+        assert(n <= NETLINK_WQUEUE_MAX);
+
+        /* Writes multiple messages with a single syscall. The kernel processes them one after another, and
+         * sends a reply or an acknowledgement for each of them. Each message needs to start at an aligned
+         * offset, hence pad them if necessary. */
+
+        iovs = newa(struct iovec, n * 2);
+        for (size_t i = 0; i < n; i++) {
+                size_t len = m[i]->hdr->nlmsg_len;
+
+                iovs[mh.msg_iovlen++] = IOVEC_MAKE(m[i]->hdr, len);
+                if (NLMSG_ALIGN(len) > len)
+                        iovs[mh.msg_iovlen++] = IOVEC_MAKE((void*) padding, NLMSG_ALIGN(len) - len);
+        }
+        mh.msg_iov = iovs;
+
+        k = sendmsg(nl->fd, &mh, 0);
+        if (k < 0)
+                return -errno;
+
+        return k;
+}
+
 static int socket_recv_message(int fd, struct iovec *iov, uint32_t *ret_mcast_group, bool peek) {
         union sockaddr_union sender;
         CMSG_BUFFER_TYPE(CMSG_SPACE(sizeof(struct nl_pktinfo))) control;
@@ -234,6 +272,21 @@ static int socket_recv_message(int fd, struct iovec *iov, uint32_t *ret_mcast_gr
         return (int) n;
 }
 
+static bool netlink_has_match(sd_netlink *nl, uint16_t type, uint32_t group) {
+        assert(nl);
+
+        LIST_FOREACH(match_callbacks, c, nl->match_callbacks) {
+                if (c->type != type)
+                        continue;
+
+                for (size_t i = 0; i < c->n_groups; i++)
+                        if (c->groups[i] == group)
+                                return true;
+        }
+
+        return false;
+}
+
 /* On success, the number of bytes received is returned and *ret points to the received message
  * which has a valid header and the correct size.
  * If nothing useful was received 0 is returned.
@@ -299,6 +352,12 @@ int socket_read_message(sd_netlink *nl) {
                         /* silently drop noop messages */
                         continue;
 
+                if (group != 0 && !netlink_has_match(nl, new_msg->nlmsg_type, group))
+                        /* Broadcast messages are only passed to match callbacks. Drop the ones nobody is
+                         * interested in before copying and parsing them, as e.g. route notifications may
+                         * arrive at a high rate on busy routers. */
+                        continue;
+
                 if (new_msg->nlmsg_type == NLMSG_DONE) {
                         /* finished reading multi-part message */
                         done = true;
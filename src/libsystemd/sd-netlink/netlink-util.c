@@ -632,6 +632,22 @@ int rtattr_read_nexthop(const struct rtnexthop *rtnh, size_t size, int family, O
         return 0;
 }
 
+void netlink_batch_begin(sd_netlink *nl) {
+        assert(nl);
+
+        nl->n_batches++;
+}
+
+void netlink_batch_end(sd_netlink *nl) {
+        assert(nl);
+        assert(nl->n_batches > 0);
+
+        if (--nl->n_batches > 0)
+                return;
+
+        netlink_flush_wqueue(nl);
+}
+
 bool netlink_pid_changed(sd_netlink *nl) {
         /* We don't support people creating an nl connection and
          * keeping it around over a fork(). Let's complain. */
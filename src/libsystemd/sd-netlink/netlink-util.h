@@ -101,6 +101,12 @@ int rtnl_get_link_info(
 int rtnl_log_parse_error(int r);
 int rtnl_log_create_error(int r);
 
+/* While a batch is open, messages sent on the connection are queued, and written to the socket with as few
+ * syscalls as possible when the batch is closed. Replies are still dispatched to the callback of each
+ * message. Batches may be nested. */
+void netlink_batch_begin(sd_netlink *nl);
+void netlink_batch_end(sd_netlink *nl);
+
 #define netlink_call_async(nl, ret_slot, message, callback, destroy_callback, userdata) \
         ({                                                              \
                 int (*_callback_)(sd_netlink *, sd_netlink_message *, typeof(userdata)) = callback; \
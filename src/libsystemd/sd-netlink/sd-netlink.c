@@ -159,6 +159,10 @@ static sd_netlink *netlink_free(sd_netlink *nl) {
 
         free(nl->rbuffer);
 
+        for (size_t j = 0; j < nl->wqueue_size; j++)
+                sd_netlink_message_unref(nl->wqueue[j]);
+        free(nl->wqueue);
+
         while ((s = nl->slots)) {
                 assert(s->floating);
                 netlink_slot_disconnect(s, true);
@@ -180,6 +184,85 @@ static sd_netlink *netlink_free(sd_netlink *nl) {
 
 DEFINE_TRIVIAL_REF_UNREF_FUNC(sd_netlink, sd_netlink, netlink_free);
 
+static void netlink_fail_message(sd_netlink *nl, sd_netlink_message *m, int error) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *reply = NULL;
+        uint32_t serial;
+        int r;
+
+        assert(nl);
+        assert(m);
+        assert(error < 0);
+
+        /* A queued message could not be written. If somebody waits for the reply, queue an error reply
+         * for them, as sd_netlink_send() already returned successfully. */
+
+        serial = message_get_serial(m);
+        log_debug_errno(error, "sd-netlink: Failed to write message with serial %"PRIu32": %m", serial);
+
+        if (!hashmap_contains(nl->reply_callbacks, UINT32_TO_PTR(serial)))
+                return;
+
+        r = message_new_synthetic_error(nl, error, serial, &reply);
+        if (r < 0)
+                return (void) log_debug_errno(r, "sd-netlink: Failed to create error reply, ignoring: %m");
+
+        r = netlink_rqueue_make_room(nl);
+        if (r < 0)
+                return (void) log_debug_errno(r, "sd-netlink: Failed to queue error reply, ignoring: %m");
+
+        nl->rqueue[nl->rqueue_size++] = TAKE_PTR(reply);
+}
+
+void netlink_flush_wqueue(sd_netlink *nl) {
+        int r;
+
+        assert(nl);
+
+        if (nl->wqueue_size == 0)
+                return;
+
+        r = socket_write_messages(nl, nl->wqueue, nl->wqueue_size);
+        if (r == -EMSGSIZE)
+                /* The send buffer is smaller than expected. Write the messages one by one. */
+                for (size_t i = 0; i < nl->wqueue_size; i++) {
+                        r = socket_write_message(nl, nl->wqueue[i]);
+                        if (r < 0)
+                                netlink_fail_message(nl, nl->wqueue[i], r);
+                }
+        else if (r < 0)
+                for (size_t i = 0; i < nl->wqueue_size; i++)
+                        netlink_fail_message(nl, nl->wqueue[i], r);
+
+        for (size_t i = 0; i < nl->wqueue_size; i++)
+                sd_netlink_message_unref(nl->wqueue[i]);
+        nl->wqueue_size = 0;
+        nl->wqueue_bytes = 0;
+}
+
+static int netlink_wqueue_push(sd_netlink *nl, sd_netlink_message *m) {
+        size_t len;
+
+        assert(nl);
+        assert(m);
+        assert(m->hdr);
+
+        len = NLMSG_ALIGN(m->hdr->nlmsg_len);
+
+        if (nl->wqueue_size >= NETLINK_WQUEUE_MAX ||
+            nl->wqueue_bytes + len > NETLINK_WQUEUE_BYTES_MAX)
+                netlink_flush_wqueue(nl);
+
+        if (len > NETLINK_WQUEUE_BYTES_MAX)
+                return socket_write_message(nl, m);
+
+        if (!GREEDY_REALLOC(nl->wqueue, nl->wqueue_size + 1))
+                return -ENOMEM;
+
+        nl->wqueue[nl->wqueue_size++] = sd_netlink_message_ref(m);
+        nl->wqueue_bytes += len;
+        return 0;
+}
+
 _public_ int sd_netlink_send(
                 sd_netlink *nl,
                 sd_netlink_message *message,
@@ -194,7 +277,10 @@ _public_ int sd_netlink_send(
 
         netlink_seal_message(nl, message);
 
-        r = socket_write_message(nl, message);
+        if (nl->n_batches > 0)
+                r = netlink_wqueue_push(nl, message);
+        else
+                r = socket_write_message(nl, message);
         if (r < 0)
                 return r;
 
@@ -669,6 +755,9 @@ _public_ int sd_netlink_call(
         if (r < 0)
                 return r;
 
+        /* Do not wait for a reply to a message which is not written yet. */
+        netlink_flush_wqueue(nl);
+
         return sd_netlink_read(nl, serial, usec, ret);
 }
 
@@ -419,6 +419,68 @@ static void test_pipe(int ifindex) {
         assert_se((rtnl = sd_netlink_unref(rtnl)) == NULL);
 }
 
+static void test_batch(int ifindex) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *reply = NULL;
+        int counter = 0;
+
+        log_debug("/* %s */", __func__);
+
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+
+        netlink_batch_begin(rtnl);
+
+        for (unsigned i = 0; i < 10; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+                assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, ifindex) >= 0);
+                assert_se(sd_netlink_message_append_string(m, IFLA_IFNAME, "lo") >= 0);
+
+                counter++;
+                assert_se(sd_netlink_call_async(rtnl, NULL, m, pipe_handler, NULL, &counter, 0, NULL) >= 0);
+        }
+
+        assert_se(rtnl->wqueue_size == 10);
+
+        netlink_batch_end(rtnl);
+        assert_se(rtnl->wqueue_size == 0);
+
+        while (counter > 0) {
+                assert_se(sd_netlink_wait(rtnl, 0) >= 0);
+                assert_se(sd_netlink_process(rtnl, NULL) >= 0);
+        }
+
+        /* A synchronous call in a batch does not wait for the batch to be closed. */
+        netlink_batch_begin(rtnl);
+        {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+                assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, ifindex) >= 0);
+                assert_se(sd_netlink_call(rtnl, m, 0, &reply) == 1);
+        }
+        netlink_batch_end(rtnl);
+
+        assert_se((rtnl = sd_netlink_unref(rtnl)) == NULL);
+
+        /* Queued messages are written once too many are queued. Replies are not read here, as there are
+         * more than fit into the receive buffer. */
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+
+        netlink_batch_begin(rtnl);
+
+        for (unsigned i = 0; i < NETLINK_WQUEUE_MAX + 1; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+                assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, ifindex) >= 0);
+                assert_se(sd_netlink_send(rtnl, m, NULL) >= 0);
+        }
+
+        assert_se(rtnl->wqueue_size == 1);
+
+        netlink_batch_end(rtnl);
+        assert_se(rtnl->wqueue_size == 0);
+}
+
 static void test_container(sd_netlink *rtnl) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         uint16_t u16_data;
@@ -695,6 +757,7 @@ int main(void) {
         test_slot_set(if_loopback);
         test_async_destroy_callback(if_loopback);
         test_pipe(if_loopback);
+        test_batch(if_loopback);
         test_event_loop(if_loopback);
         test_link_configure(rtnl, if_loopback);
 
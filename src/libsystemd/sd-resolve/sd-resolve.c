@@ -25,9 +25,14 @@
 #include "process-util.h"
 #include "resolve-private.h"
 #include "socket-util.h"
+#include "time-util.h"
 
+/* The pool of worker threads grows with the number of outstanding queries, and workers that have been idle
+ * for a while exit again, so that bursts of lookups (e.g. at boot) don't queue up behind a few blocking NSS
+ * calls, and idle resolvers don't keep lots of threads around. */
 #define WORKERS_MIN 1U
-#define WORKERS_MAX 16U
+#define WORKERS_MAX 64U
+#define WORKER_IDLE_TIMEOUT_USEC (30 * USEC_PER_SEC)
 #define QUERIES_MAX 256U
 #define BUFSIZE 10240U
 
@@ -37,7 +42,8 @@ typedef enum {
         REQUEST_NAMEINFO,
         RESPONSE_NAMEINFO,
         REQUEST_TERMINATE,
-        RESPONSE_DIED
+        RESPONSE_DIED,
+        RESPONSE_RETIRED,
 } QueryType;
 
 enum {
@@ -150,12 +156,18 @@ typedef struct NameInfoResponse {
         int _h_errno;
 } NameInfoResponse;
 
+typedef struct RetiredResponse {
+        struct RHeader header;
+        pthread_t thread;
+} RetiredResponse;
+
 typedef union Packet {
         RHeader rheader;
         AddrInfoRequest addrinfo_request;
         AddrInfoResponse addrinfo_response;
         NameInfoRequest nameinfo_request;
         NameInfoResponse nameinfo_response;
+        RetiredResponse retired_response;
 } Packet;
 
 static int getaddrinfo_done(sd_resolve_query* q);
@@ -188,6 +200,21 @@ static int send_died(int out_fd) {
         return 0;
 }
 
+static int send_retired(int out_fd) {
+        RetiredResponse resp = {
+                .header.type = RESPONSE_RETIRED,
+                .header.length = sizeof(RetiredResponse),
+                .thread = pthread_self(),
+        };
+
+        assert(out_fd >= 0);
+
+        if (send(out_fd, &resp, resp.header.length, MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        return 0;
+}
+
 static void *serialize_addrinfo(void *p, const struct addrinfo *ai, size_t *length, size_t maxlength) {
         AddrInfoSerialization s;
         size_t cnl, l;
@@ -418,6 +445,12 @@ static void* thread_worker(void *p) {
 
                 length = recv(resolve->fds[REQUEST_RECV_FD], &buf, sizeof buf, 0);
                 if (length < 0) {
+                        if (errno == EAGAIN) {
+                                /* SO_RCVTIMEO hit, i.e. there was nothing to do for a while. Ask the main
+                                 * thread to reap us. */
+                                send_retired(resolve->fds[RESPONSE_SEND_FD]);
+                                return NULL;
+                        }
                         if (ERRNO_IS_TRANSIENT(errno))
                                 continue;
 
@@ -471,6 +504,27 @@ finish:
         return r;
 }
 
+static int reap_thread(sd_resolve *resolve, pthread_t thread) {
+        assert(resolve);
+
+        for (unsigned i = 0; i < resolve->n_valid_workers; i++) {
+                if (!pthread_equal(resolve->workers[i], thread))
+                        continue;
+
+                (void) pthread_join(thread, NULL);
+                resolve->workers[i] = resolve->workers[--resolve->n_valid_workers];
+
+                /* A query might have been enqueued right when the worker gave up waiting for one, make
+                 * sure somebody is around to process it. */
+                if (resolve->n_outstanding > 0)
+                        return start_threads(resolve, 0);
+
+                return 0;
+        }
+
+        return 0;
+}
+
 static bool resolve_pid_changed(sd_resolve *r) {
         assert(r);
 
@@ -512,6 +566,11 @@ _public_ int sd_resolve_new(sd_resolve **ret) {
 
         (void) fd_nonblock(resolve->fds[RESPONSE_RECV_FD], true);
 
+        /* Let idle workers time out, see thread_worker() */
+        if (setsockopt(resolve->fds[REQUEST_RECV_FD], SOL_SOCKET, SO_RCVTIMEO,
+                       TIMEVAL_STORE(WORKER_IDLE_TIMEOUT_USEC), sizeof(struct timeval)) < 0)
+                return -errno;
+
         *ret = TAKE_PTR(resolve);
         return 0;
 }
@@ -748,6 +807,11 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
                 return 0;
         }
 
+        if (resp->type == RESPONSE_RETIRED) {
+                assert_return(length >= sizeof(RetiredResponse), -EBADMSG);
+                return reap_thread(resolve, packet->retired_response.thread);
+        }
+
         assert(resolve->n_outstanding > 0);
         resolve->n_outstanding--;
 
@@ -1241,9 +1305,17 @@ static int io_callback(sd_event_source *s, int fd, uint32_t revents, void *userd
 
         assert(resolve);
 
-        r = sd_resolve_process(resolve);
-        if (r < 0)
-                return r;
+        RESOLVE_DONT_DESTROY(resolve);
+
+        /* Process the responses in batches, so that a burst of completed queries doesn't need one event
+         * loop iteration each. Stop after a while, to not starve other event sources. */
+        for (unsigned i = 0; i < QUERIES_MAX; i++) {
+                r = sd_resolve_process(resolve);
+                if (r < 0)
+                        return r;
+                if (r == 0 || !resolve->event_source)
+                        break;
+        }
 
         return 1;
 }
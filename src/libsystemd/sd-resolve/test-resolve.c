@@ -16,6 +16,7 @@
 #include "time-util.h"
 
 #define TEST_TIMEOUT_USEC (20*USEC_PER_SEC)
+#define TEST_N_BURST 200U
 
 static int getaddrinfo_handler(sd_resolve_query *q, int ret, const struct addrinfo *ai, void *userdata) {
         const struct addrinfo *i;
@@ -39,6 +40,17 @@ static int getaddrinfo_handler(sd_resolve_query *q, int ret, const struct addrin
         return 0;
 }
 
+static int burst_handler(sd_resolve_query *q, int ret, const struct addrinfo *ai, void *userdata) {
+        unsigned *n_done = ASSERT_PTR(userdata);
+
+        assert_se(ret == 0);
+        assert_se(ai);
+        assert_se(ai->ai_family == AF_INET);
+
+        (*n_done)++;
+        return 0;
+}
+
 static int getnameinfo_handler(sd_resolve_query *q, int ret, const char *host, const char *serv, void *userdata) {
         assert_se(q);
 
@@ -54,6 +66,7 @@ static int getnameinfo_handler(sd_resolve_query *q, int ret, const char *host, c
 int main(int argc, char *argv[]) {
         _cleanup_(sd_resolve_query_unrefp) sd_resolve_query *q1 = NULL, *q2 = NULL;
         _cleanup_(sd_resolve_unrefp) sd_resolve *resolve = NULL;
+        unsigned n_burst_done = 0;
         int r;
 
         struct addrinfo hints = {
@@ -85,6 +98,12 @@ int main(int argc, char *argv[]) {
         if (r < 0)
                 log_error_errno(r, "sd_resolve_getnameinfo(): %m");
 
+        /* Issue more queries at once than there are workers, these don't need DNS */
+        for (unsigned i = 0; i < TEST_N_BURST; i++)
+                assert_se(sd_resolve_getaddrinfo(resolve, NULL, "127.0.0.1", NULL,
+                                                 &(struct addrinfo) { .ai_flags = AI_NUMERICHOST, .ai_family = AF_INET },
+                                                 burst_handler, &n_burst_done) >= 0);
+
         /* Wait until all queries are completed */
         for (;;) {
                 r = sd_resolve_wait(resolve, TEST_TIMEOUT_USEC);
@@ -104,5 +123,7 @@ int main(int argc, char *argv[]) {
                 }
         }
 
+        assert_se(n_burst_done == TEST_N_BURST);
+
         return 0;
 }
@@ -3805,7 +3805,7 @@ int match_job_removed(sd_bus_message *message, void *userdata, sd_bus_error *err
                         (void) session_jobs_reply(session, id, unit, result);
 
                         session_save(session);
-                        user_save(session->user);
+                        user_add_to_save_queue(session->user);
                 }
 
                 session_add_to_gc_queue(session);
@@ -3819,7 +3819,7 @@ int match_job_removed(sd_bus_message *message, void *userdata, sd_bus_error *err
                         LIST_FOREACH(sessions_by_user, s, user->sessions)
                                 (void) session_jobs_reply(s, id, unit, NULL /* don't propagate user service failures to the client */);
 
-                        user_save(user);
+                        user_add_to_save_queue(user);
                 }
 
                 user_add_to_gc_queue(user);
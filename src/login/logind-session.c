@@ -727,7 +727,7 @@ int session_start(Session *s, sd_bus_message *properties, sd_bus_error *error) {
 
         /* Save data */
         session_save(s);
-        user_save(s->user);
+        user_add_to_save_queue(s->user);
         if (s->seat)
                 seat_save(s->seat);
 
@@ -822,7 +822,7 @@ int session_stop(Session *s, bool force) {
         user_elect_display(s->user);
 
         session_save(s);
-        user_save(s->user);
+        user_add_to_save_queue(s->user);
 
         return r;
 }
@@ -868,7 +868,7 @@ int session_finalize(Session *s) {
                 seat_save(s->seat);
         }
 
-        user_save(s->user);
+        user_add_to_save_queue(s->user);
         user_send_changed(s->user, "Display", NULL);
 
         return 0;
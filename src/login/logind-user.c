@@ -111,6 +111,9 @@ User *user_free(User *u) {
         if (u->in_gc_queue)
                 LIST_REMOVE(gc_queue, u->manager->user_gc_queue, u);
 
+        if (u->in_save_queue)
+                LIST_REMOVE(save_queue, u->manager->user_save_queue, u);
+
         while (u->sessions)
                 session_free(u->sessions);
 
@@ -303,6 +306,20 @@ int user_save(User *u) {
         return user_save_internal(u);
 }
 
+void user_add_to_save_queue(User *u) {
+        assert(u);
+
+        /* The user state file lists all sessions of the user, hence it's rewritten whenever any of them comes
+         * or goes, often several times while handling a single event. Instead of writing it out each time,
+         * queue the user and write the file once, when we are done with the current event loop iteration. */
+
+        if (u->in_save_queue)
+                return;
+
+        LIST_PREPEND(save_queue, u->manager->user_save_queue, u);
+        u->in_save_queue = true;
+}
+
 int user_load(User *u) {
         _cleanup_free_ char *realtime = NULL, *monotonic = NULL, *stopping = NULL, *last_session_timestamp = NULL;
         int r;
@@ -476,7 +493,7 @@ int user_start(User *u, bool want_user_instance) {
         }
 
         /* Save new user data */
-        user_save(u);
+        user_add_to_save_queue(u);
 
         return 0;
 }
@@ -512,7 +529,7 @@ int user_stop(User *u, bool force) {
                 return 0;
 
         if (u->stopping) { /* Stop jobs have already been queued */
-                user_save(u);
+                user_add_to_save_queue(u);
                 return 0;
         }
 
@@ -528,7 +545,7 @@ int user_stop(User *u, bool force) {
 
         u->stopping = true;
 
-        user_save(u);
+        user_add_to_save_queue(u);
 
         return r;
 }
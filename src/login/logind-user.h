@@ -42,12 +42,14 @@ struct User {
         sd_event_source *timer_event_source;
 
         bool in_gc_queue:1;
+        bool in_save_queue:1;
 
         bool started:1;       /* Whenever the user being started, has been started or is being stopped again. */
         bool stopping:1;      /* Whenever the user is being stopped or has been stopped. */
 
         LIST_HEAD(Session, sessions);
         LIST_FIELDS(User, gc_queue);
+        LIST_FIELDS(User, save_queue);
 };
 
 int user_new(User **out, Manager *m, UserRecord *ur);
@@ -63,6 +65,7 @@ int user_finalize(User *u);
 UserState user_get_state(User *u);
 int user_get_idle_hint(User *u, dual_timestamp *t);
 int user_save(User *u);
+void user_add_to_save_queue(User *u);
 int user_load(User *u);
 int user_kill(User *u, int signo);
 int user_check_linger_file(User *u);
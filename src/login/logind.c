@@ -1139,6 +1139,19 @@ static int manager_startup(Manager *m) {
         return 0;
 }
 
+static void manager_dispatch_save_queue(Manager *m) {
+        User *user;
+
+        assert(m);
+
+        while ((user = m->user_save_queue)) {
+                LIST_REMOVE(save_queue, m->user_save_queue, user);
+                user->in_save_queue = false;
+
+                (void) user_save(user);
+        }
+}
+
 static int manager_run(Manager *m) {
         int r;
 
@@ -1148,11 +1161,15 @@ static int manager_run(Manager *m) {
                 r = sd_event_get_state(m->event);
                 if (r < 0)
                         return r;
-                if (r == SD_EVENT_FINISHED)
+                if (r == SD_EVENT_FINISHED) {
+                        manager_dispatch_save_queue(m);
                         return 0;
+                }
 
                 manager_gc(m, true);
 
+                manager_dispatch_save_queue(m);
+
                 r = manager_dispatch_delayed(m, false);
                 if (r < 0)
                         return r;
@@ -39,6 +39,9 @@ struct Manager {
         LIST_HEAD(Session, session_gc_queue);
         LIST_HEAD(User, user_gc_queue);
 
+        /* Users whose state file needs to be rewritten, see user_add_to_save_queue() */
+        LIST_HEAD(User, user_save_queue);
+
         sd_device_monitor *device_seat_monitor, *device_monitor, *device_vcsa_monitor, *device_button_monitor;
 
         sd_event_source *console_active_event_source;
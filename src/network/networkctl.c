@@ -2716,6 +2716,88 @@ static int link_force_renew(int argc, char *argv[], void *userdata) {
         return k;
 }
 
+static int verb_requests(int argc, char *argv[], void *userdata) {
+        sd_bus *bus = ASSERT_PTR(userdata);
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_(table_unrefp) Table *table = NULL;
+        JsonVariant *requests, *statistics, *i;
+        int r;
+
+        r = get_description(bus, &v);
+        if (r < 0)
+                return r;
+
+        requests = json_variant_by_key(v, "Requests");
+        if (!requests)
+                return log_error_errno(SYNTHETIC_ERRNO(EOPNOTSUPP),
+                                       "systemd-networkd does not provide request statistics.");
+
+        if (arg_json_format_flags != JSON_FORMAT_OFF) {
+                json_variant_dump(requests, arg_json_format_flags, NULL, NULL);
+                return 0;
+        }
+
+        pager_open(arg_pager_flags);
+
+        table = table_new("type", "queued", "failed", "sent", "pending", "wait avg", "wait max", "reply avg", "reply max");
+        if (!table)
+                return log_oom();
+
+        if (arg_full)
+                table_set_width(table, 0);
+
+        table_set_header(table, arg_legend);
+        if (table_set_empty_string(table, "n/a") < 0)
+                return log_oom();
+
+        statistics = json_variant_by_key(requests, "Statistics");
+        JSON_VARIANT_ARRAY_FOREACH(i, statistics) {
+                uint64_t n_processed, n_sent, n_replied;
+
+                n_processed = json_variant_unsigned(json_variant_by_key(i, "Processed"));
+                n_sent = json_variant_unsigned(json_variant_by_key(i, "Sent"));
+                n_replied = json_variant_unsigned(json_variant_by_key(i, "Replied"));
+
+                r = table_add_many(table,
+                                   TABLE_STRING, json_variant_string(json_variant_by_key(i, "Type")),
+                                   TABLE_UINT64, json_variant_unsigned(json_variant_by_key(i, "Queued")),
+                                   TABLE_UINT64, json_variant_unsigned(json_variant_by_key(i, "Failed")),
+                                   TABLE_UINT64, n_sent,
+                                   TABLE_UINT64, n_sent - n_replied);
+                if (r < 0)
+                        return table_log_add_error(r);
+
+                if (n_processed > 0)
+                        r = table_add_many(table,
+                                           TABLE_TIMESPAN, json_variant_unsigned(json_variant_by_key(i, "WaitUSec")) / n_processed,
+                                           TABLE_TIMESPAN, json_variant_unsigned(json_variant_by_key(i, "WaitMaxUSec")));
+                else
+                        r = table_add_many(table, TABLE_EMPTY, TABLE_EMPTY);
+                if (r < 0)
+                        return table_log_add_error(r);
+
+                if (n_replied > 0)
+                        r = table_add_many(table,
+                                           TABLE_TIMESPAN, json_variant_unsigned(json_variant_by_key(i, "ReplyUSec")) / n_replied,
+                                           TABLE_TIMESPAN, json_variant_unsigned(json_variant_by_key(i, "ReplyMaxUSec")));
+                else
+                        r = table_add_many(table, TABLE_EMPTY, TABLE_EMPTY);
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+
+        r = table_print(table, NULL);
+        if (r < 0)
+                return table_log_print_error(r);
+
+        if (arg_legend)
+                printf("\n%" PRIu64 " requests queued, %" PRIu64 " replies pending.\n",
+                       json_variant_unsigned(json_variant_by_key(requests, "QueueLength")),
+                       json_variant_unsigned(json_variant_by_key(requests, "PendingReplies")));
+
+        return 0;
+}
+
 static int verb_reload(int argc, char *argv[], void *userdata) {
         sd_bus *bus = ASSERT_PTR(userdata);
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
@@ -2784,6 +2866,7 @@ static int help(void) {
                "  forcerenew DEVICES...  Trigger DHCP reconfiguration of all connected clients\n"
                "  reconfigure DEVICES... Reconfigure interfaces\n"
                "  reload                 Reload .network and .netdev files\n"
+               "  requests               Show statistics of configuration requests\n"
                "\nOptions:\n"
                "  -h --help              Show this help\n"
                "     --version           Show package version\n"
@@ -2897,6 +2980,7 @@ static int networkctl_main(sd_bus *bus, int argc, char *argv[]) {
                 { "forcerenew",  2,        VERB_ANY, 0,            link_force_renew    },
                 { "reconfigure", 2,        VERB_ANY, 0,            verb_reconfigure    },
                 { "reload",      1,        1,        0,            verb_reload         },
+                { "requests",    1,        1,        0,            verb_requests       },
                 {}
         };
 
@@ -1113,8 +1113,10 @@ static int address_process_request(Request *req, Link *link, Address *address) {
         assert(link);
         assert(address);
 
-        if (!address_is_ready_to_configure(link, address))
+        if (!address_is_ready_to_configure(link, address)) {
+                request_wait_for_link(req);
                 return 0;
+        }
 
         r = address_configure(address, link, req);
         if (r < 0)
@@ -1343,6 +1345,9 @@ int manager_rtnl_process_address(sd_netlink *rtnl, sd_netlink_message *message,
                 return 0;
         }
 
+        /* Queued addresses and routes may wait for the addresses of the link. */
+        link_wakeup_requests(link);
+
         r = address_new(&tmp);
         if (r < 0)
                 return log_oom();
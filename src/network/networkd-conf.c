@@ -34,5 +34,13 @@ int manager_parse_config_file(Manager *m) {
                 m->speed_meter_interval_usec = SPEED_METER_MINIMUM_TIME_INTERVAL;
         }
 
+        if (m->rtnl && !set_isempty(m->ignored_route_tables)) {
+                /* The filter was attached before the config file is parsed. Update it to drop routes in
+                 * the ignored tables. */
+                r = manager_setup_rtnl_filter(m);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to update netlink filter to drop routes in ignored tables, ignoring: %m");
+        }
+
         return 0;
 }
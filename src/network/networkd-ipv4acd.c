@@ -8,6 +8,7 @@
 #include "networkd-ipv4acd.h"
 #include "networkd-link.h"
 #include "networkd-manager.h"
+#include "networkd-queue.h"
 
 static int static_ipv4acd_address_remove(Link *link, Address *address, bool on_conflict) {
         int r;
@@ -93,6 +94,7 @@ static void on_acd(sd_ipv4acd *acd, int event, void *userdata) {
                                IPV4_ADDRESS_FMT_VAL(address->in_addr.in));
 
                 address_cancel_probing(address);
+                link_wakeup_requests(link); /* The address may be queued and waiting for this. */
                 break;
 
         case SD_IPV4ACD_EVENT_CONFLICT:
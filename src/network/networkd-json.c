@@ -12,6 +12,7 @@
 #include "networkd-neighbor.h"
 #include "networkd-nexthop.h"
 #include "networkd-network.h"
+#include "networkd-queue.h"
 #include "networkd-route-util.h"
 #include "networkd-route.h"
 #include "networkd-routing-policy-rule.h"
@@ -1379,6 +1380,49 @@ finalize:
         return r;
 }
 
+static int requests_build_json(Manager *manager, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *array = NULL;
+        uint64_t n_pending = 0;
+        int r;
+
+        assert(manager);
+        assert(ret);
+
+        for (RequestType t = 0; t < _REQUEST_TYPE_MAX; t++) {
+                const RequestStatistics *s = &manager->request_statistics[t];
+                _cleanup_(json_variant_unrefp) JsonVariant *e = NULL;
+
+                if (s->n_queued == 0)
+                        continue;
+
+                n_pending += s->n_sent - s->n_replied;
+
+                r = json_build(&e, JSON_BUILD_OBJECT(
+                                JSON_BUILD_PAIR_STRING("Type", request_type_to_string(t)),
+                                JSON_BUILD_PAIR_UNSIGNED("Queued", s->n_queued),
+                                JSON_BUILD_PAIR_UNSIGNED("Processed", s->n_processed),
+                                JSON_BUILD_PAIR_UNSIGNED("Failed", s->n_failed),
+                                JSON_BUILD_PAIR_UNSIGNED("Sent", s->n_sent),
+                                JSON_BUILD_PAIR_UNSIGNED("Replied", s->n_replied),
+                                JSON_BUILD_PAIR_UNSIGNED("WaitUSec", s->wait_usec),
+                                JSON_BUILD_PAIR_UNSIGNED("WaitMaxUSec", s->wait_usec_max),
+                                JSON_BUILD_PAIR_UNSIGNED("ReplyUSec", s->reply_usec),
+                                JSON_BUILD_PAIR_UNSIGNED("ReplyMaxUSec", s->reply_usec_max)));
+                if (r < 0)
+                        return r;
+
+                r = json_variant_append_array(&array, e);
+                if (r < 0)
+                        return r;
+        }
+
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                JSON_BUILD_PAIR("Requests", JSON_BUILD_OBJECT(
+                                                JSON_BUILD_PAIR_UNSIGNED("QueueLength", ordered_set_size(manager->request_queue)),
+                                                JSON_BUILD_PAIR_UNSIGNED("PendingReplies", n_pending),
+                                                JSON_BUILD_PAIR_CONDITION(!!array, "Statistics", JSON_BUILD_VARIANT(array))))));
+}
+
 int manager_build_json(Manager *manager, JsonVariant **ret) {
         _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL;
         int r;
@@ -1418,6 +1462,16 @@ int manager_build_json(Manager *manager, JsonVariant **ret) {
         if (r < 0)
                 return r;
 
+        w = json_variant_unref(w);
+
+        r = requests_build_json(manager, &w);
+        if (r < 0)
+                return r;
+
+        r = json_variant_merge(&v, w);
+        if (r < 0)
+                return r;
+
         *ret = TAKE_PTR(v);
         return 0;
 }
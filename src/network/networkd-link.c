@@ -313,6 +313,7 @@ void link_set_state(Link *link, LinkState state) {
                        link_state_to_string(state));
 
         link->state = state;
+        link_wakeup_requests(link);
 
         link_send_changed(link, "AdministrativeState", NULL);
         link_dirty(link);
@@ -2439,6 +2440,9 @@ static int link_update(Link *link, sd_netlink_message *message) {
         if (r < 0)
                 return r;
 
+        /* The carrier state, the flags, or so may be changed. */
+        link_wakeup_requests(link);
+
         return link_update_flags(link, message);
 }
 
@@ -109,6 +109,9 @@ typedef struct Link {
         unsigned set_flags_messages;
         unsigned create_stacked_netdev_messages;
 
+        /* Bumped by link_wakeup_requests(), see networkd-queue.h. */
+        uint64_t request_generation;
+
         Set *addresses;
         Set *neighbors;
         Set *routes;
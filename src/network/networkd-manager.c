@@ -32,6 +32,7 @@
 #include "networkd-dhcp6.h"
 #include "networkd-link-bus.h"
 #include "networkd-manager-bus.h"
+#include "networkd-manager-varlink.h"
 #include "networkd-manager.h"
 #include "networkd-neighbor.h"
 #include "networkd-network-bus.h"
@@ -247,38 +248,98 @@ static int manager_connect_genl(Manager *m) {
         return 0;
 }
 
-static int manager_setup_rtnl_filter(Manager *manager) {
-        struct sock_filter filter[] = {
-                /* Check the packet length. */
-                BPF_STMT(BPF_LD + BPF_W + BPF_LEN, 0),                                      /* A <- packet length */
-                BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, sizeof(struct nlmsghdr), 1, 0),         /* A (packet length) >= sizeof(struct nlmsghdr) ? */
-                BPF_STMT(BPF_RET + BPF_K, 0),                                               /* reject */
-                /* Always accept multipart message. */
-                BPF_STMT(BPF_LD + BPF_H + BPF_ABS, offsetof(struct nlmsghdr, nlmsg_flags)), /* A <- message flags */
-                BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K, htobe16(NLM_F_MULTI), 0, 1),           /* message flags has NLM_F_MULTI ? */
-                BPF_STMT(BPF_RET + BPF_K, UINT32_MAX),                                      /* accept */
-                /* Accept all message types except for RTM_NEWNEIGH or RTM_DELNEIGH. */
-                BPF_STMT(BPF_LD + BPF_H + BPF_ABS, offsetof(struct nlmsghdr, nlmsg_type)),  /* A <- message type */
-                BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htobe16(RTM_NEWNEIGH), 2, 0),           /* message type == RTM_NEWNEIGH ? */
-                BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htobe16(RTM_DELNEIGH), 1, 0),           /* message type == RTM_DELNEIGH ? */
-                BPF_STMT(BPF_RET + BPF_K, UINT32_MAX),                                      /* accept */
-                /* Check the packet length. */
-                BPF_STMT(BPF_LD + BPF_W + BPF_LEN, 0),                                      /* A <- packet length */
-                BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, sizeof(struct nlmsghdr) + sizeof(struct ndmsg), 1, 0),
-                                                                                            /* packet length >= sizeof(struct nlmsghdr) + sizeof(struct ndmsg) ? */
-                BPF_STMT(BPF_RET + BPF_K, 0),                                               /* reject */
-                /* Reject the message when the neighbor state does not have NUD_PERMANENT flag. */
-                BPF_STMT(BPF_LD + BPF_H + BPF_ABS, sizeof(struct nlmsghdr) + offsetof(struct ndmsg, ndm_state)),
-                                                                                            /* A <- neighbor state */
-                BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K, htobe16(NUD_PERMANENT), 1, 0),         /* neighbor state has NUD_PERMANENT ? */
-                BPF_STMT(BPF_RET + BPF_K, 0),                                               /* reject */
-                BPF_STMT(BPF_RET + BPF_K, UINT32_MAX),                                      /* accept */
-        };
+/* The jump offsets of BPF instructions are 8 bit, hence the number of route tables which can be checked in
+ * the filter is limited. Routes in other ignored tables are dropped when they are received. */
+#define RTNL_FILTER_ROUTE_TABLES_MAX 200U
+
+int manager_setup_rtnl_filter(Manager *manager) {
+        struct sock_filter filter[28 + RTNL_FILTER_ROUTE_TABLES_MAX];
+        size_t i = 0, n_tables;
+        void *p;
 
         assert(manager);
         assert(manager->rtnl);
 
-        return sd_netlink_attach_filter(manager->rtnl, ELEMENTSOF(filter), filter);
+        n_tables = set_size(manager->ignored_route_tables);
+        if (n_tables > RTNL_FILTER_ROUTE_TABLES_MAX) {
+                log_debug("Too many route tables are ignored, routes in some of them will be dropped after being received.");
+                n_tables = RTNL_FILTER_ROUTE_TABLES_MAX;
+        }
+
+        /* Check the packet length. */
+        filter[i++] = (struct sock_filter) BPF_STMT(BPF_LD + BPF_W + BPF_LEN, 0);                        /* A <- packet length */
+        filter[i++] = (struct sock_filter) BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, sizeof(struct nlmsghdr), 1, 0);
+                                                                                                          /* A (packet length) >= sizeof(struct nlmsghdr) ? */
+        filter[i++] = (struct sock_filter) BPF_STMT(BPF_RET + BPF_K, 0);                                 /* reject */
+        /* Always accept multipart message. */
+        filter[i++] = (struct sock_filter) BPF_STMT(BPF_LD + BPF_H + BPF_ABS, offsetof(struct nlmsghdr, nlmsg_flags));
+                                                                                                          /* A <- message flags */
+        filter[i++] = (struct sock_filter) BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K, htobe16(NLM_F_MULTI), 0, 1);
+                                                                                                          /* message flags has NLM_F_MULTI ? */
+        filter[i++] = (struct sock_filter) BPF_STMT(BPF_RET + BPF_K, UINT32_MAX);                        /* accept */
+        /* Accept all message types except for RTM_NEWNEIGH or RTM_DELNEIGH, and RTM_NEWROUTE or
+         * RTM_DELROUTE if some route tables are ignored. */
+        filter[i++] = (struct sock_filter) BPF_STMT(BPF_LD + BPF_H + BPF_ABS, offsetof(struct nlmsghdr, nlmsg_type));
+                                                                                                          /* A <- message type */
+        filter[i++] = (struct sock_filter) BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htobe16(RTM_NEWNEIGH), n_tables > 0 ? 4 : 2, 0);
+                                                                                                          /* message type == RTM_NEWNEIGH ? */
+        filter[i++] = (struct sock_filter) BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htobe16(RTM_DELNEIGH), n_tables > 0 ? 3 : 1, 0);
+                                                                                                          /* message type == RTM_DELNEIGH ? */
+        if (n_tables > 0) {
+                filter[i++] = (struct sock_filter) BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htobe16(RTM_NEWROUTE), 9, 0);
+                                                                                                          /* message type == RTM_NEWROUTE ? */
+                filter[i++] = (struct sock_filter) BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htobe16(RTM_DELROUTE), 8, 0);
+                                                                                                          /* message type == RTM_DELROUTE ? */
+        }
+        filter[i++] = (struct sock_filter) BPF_STMT(BPF_RET + BPF_K, UINT32_MAX);                        /* accept */
+        /* Check the packet length. */
+        filter[i++] = (struct sock_filter) BPF_STMT(BPF_LD + BPF_W + BPF_LEN, 0);                        /* A <- packet length */
+        filter[i++] = (struct sock_filter) BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, sizeof(struct nlmsghdr) + sizeof(struct ndmsg), 1, 0);
+                                                                                                          /* packet length >= sizeof(struct nlmsghdr) + sizeof(struct ndmsg) ? */
+        filter[i++] = (struct sock_filter) BPF_STMT(BPF_RET + BPF_K, 0);                                 /* reject */
+        /* Reject the message when the neighbor state does not have NUD_PERMANENT flag. */
+        filter[i++] = (struct sock_filter) BPF_STMT(BPF_LD + BPF_H + BPF_ABS, sizeof(struct nlmsghdr) + offsetof(struct ndmsg, ndm_state));
+                                                                                                          /* A <- neighbor state */
+        filter[i++] = (struct sock_filter) BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K, htobe16(NUD_PERMANENT), 1, 0);
+                                                                                                          /* neighbor state has NUD_PERMANENT ? */
+        filter[i++] = (struct sock_filter) BPF_STMT(BPF_RET + BPF_K, 0);                                 /* reject */
+        filter[i++] = (struct sock_filter) BPF_STMT(BPF_RET + BPF_K, UINT32_MAX);                        /* accept */
+
+        if (n_tables > 0) {
+                size_t k = 0;
+
+                /* The kernel puts RTA_TABLE first in route notifications of both IPv4 and IPv6. If it is
+                 * not there, then accept the message, and let manager_rtnl_process_route() decide. */
+                filter[i++] = (struct sock_filter) BPF_STMT(BPF_LD + BPF_W + BPF_LEN, 0);                /* A <- packet length */
+                filter[i++] = (struct sock_filter) BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K,
+                                                            NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(struct rtmsg)) + RTA_LENGTH(sizeof(uint32_t)),
+                                                            0, n_tables + 3);
+                                                                                                          /* packet length is enough for the first attribute ? */
+                filter[i++] = (struct sock_filter) BPF_STMT(BPF_LD + BPF_H + BPF_ABS,
+                                                            NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(struct rtmsg)) + offsetof(struct rtattr, rta_type));
+                                                                                                          /* A <- type of the first attribute */
+                filter[i++] = (struct sock_filter) BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htobe16(RTA_TABLE), 0, n_tables + 1);
+                                                                                                          /* attribute type == RTA_TABLE ? */
+                filter[i++] = (struct sock_filter) BPF_STMT(BPF_LD + BPF_W + BPF_ABS,
+                                                            NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(struct rtmsg)) + RTA_LENGTH(0));
+                                                                                                          /* A <- route table */
+                SET_FOREACH(p, manager->ignored_route_tables) {
+                        if (k >= n_tables)
+                                break;
+
+                        filter[i++] = (struct sock_filter) BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, htobe32(PTR_TO_UINT32(p)), n_tables - k, 0);
+                                                                                                          /* route table == ignored table ? */
+                        k++;
+                }
+                assert(k == n_tables);
+
+                filter[i++] = (struct sock_filter) BPF_STMT(BPF_RET + BPF_K, UINT32_MAX);                /* accept */
+                filter[i++] = (struct sock_filter) BPF_STMT(BPF_RET + BPF_K, 0);                         /* reject */
+        }
+
+        assert(i <= ELEMENTSOF(filter));
+
+        return sd_netlink_attach_filter(manager->rtnl, i, filter);
 }
 
 static int manager_connect_rtnl(Manager *m) {
@@ -485,6 +546,10 @@ int manager_setup(Manager *m) {
         if (r < 0)
                 return r;
 
+        r = manager_connect_varlink(m);
+        if (r < 0)
+                return r;
+
         r = sd_resolve_default(&m->resolve);
         if (r < 0)
                 return r;
@@ -563,6 +628,7 @@ Manager* manager_free(Manager *m) {
 
         hashmap_free(m->route_table_names_by_number);
         hashmap_free(m->route_table_numbers_by_name);
+        set_free(m->ignored_route_tables);
 
         set_free(m->rules);
 
@@ -588,6 +654,8 @@ Manager* manager_free(Manager *m) {
         bus_verify_polkit_async_registry_free(m->polkit_registry);
         sd_bus_flush_close_unref(m->bus);
 
+        manager_varlink_done(m);
+
         free(m->dynamic_timezone);
         free(m->dynamic_hostname);
 
@@ -645,6 +713,29 @@ bool manager_should_reload(Manager *m) {
         return paths_check_timestamp(NETWORK_DIRS, &m->network_dirs_ts_usec, false);
 }
 
+static int manager_enumerate_process(
+                Manager *m,
+                sd_netlink *nl,
+                sd_netlink_message *reply,
+                int (*process)(sd_netlink *, sd_netlink_message *, Manager *)) {
+
+        int k, r = 0;
+
+        assert(m);
+        assert(nl);
+        assert(process);
+
+        m->enumerating = true;
+        for (sd_netlink_message *reply_one = reply; reply_one; reply_one = sd_netlink_message_next(reply_one)) {
+                k = process(nl, reply_one, m);
+                if (k < 0 && r >= 0)
+                        r = k;
+        }
+        m->enumerating = false;
+
+        return r;
+}
+
 static int manager_enumerate_internal(
                 Manager *m,
                 sd_netlink *nl,
@@ -652,7 +743,7 @@ static int manager_enumerate_internal(
                 int (*process)(sd_netlink *, sd_netlink_message *, Manager *)) {
 
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *reply = NULL;
-        int k, r;
+        int r;
 
         assert(m);
         assert(nl);
@@ -667,15 +758,65 @@ static int manager_enumerate_internal(
         if (r < 0)
                 return r;
 
-        m->enumerating = true;
-        for (sd_netlink_message *reply_one = reply; reply_one; reply_one = sd_netlink_message_next(reply_one)) {
-                k = process(nl, reply_one, m);
-                if (k < 0 && r >= 0)
-                        r = k;
-        }
-        m->enumerating = false;
+        return manager_enumerate_process(m, nl, reply, process);
+}
 
-        return r;
+/* A dump requested on its own netlink socket. A socket can only run one dump at a time, hence the dumps
+ * of addresses, routes, and so on are requested on separate sockets before the links are enumerated, and
+ * the kernel prepares them while the links are processed. The replies are still processed one by one and
+ * in the order the objects depend on each other, e.g. nexthops before routes. */
+typedef struct EnumerationDump {
+        sd_netlink *nl;
+        uint32_t serial;
+} EnumerationDump;
+
+static void enumeration_dump_done(EnumerationDump *d) {
+        assert(d);
+
+        d->nl = sd_netlink_unref(d->nl);
+}
+
+static int enumeration_dump_open(EnumerationDump *d) {
+        assert(d);
+        assert(!d->nl);
+
+        return sd_netlink_open(&d->nl);
+}
+
+static int enumeration_dump_send(EnumerationDump *d, sd_netlink_message *req) {
+        int r;
+
+        assert(d);
+        assert(d->nl);
+        assert(req);
+
+        r = sd_netlink_message_request_dump(req, true);
+        if (r < 0)
+                return r;
+
+        return sd_netlink_send(d->nl, req, &d->serial);
+}
+
+static int manager_enumerate_finish(
+                Manager *m,
+                EnumerationDump *d,
+                int (*process)(sd_netlink *, sd_netlink_message *, Manager *)) {
+
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *reply = NULL;
+        int r;
+
+        assert(m);
+        assert(d);
+        assert(process);
+
+        if (!d->nl)
+                return 0; /* not requested */
+
+        r = sd_netlink_read(d->nl, d->serial, 0, &reply);
+        if (r < 0)
+                return r;
+
+        return manager_enumerate_process(m, d->nl, reply, process);
 }
 
 static int manager_enumerate_links(Manager *m) {
@@ -692,108 +833,131 @@ static int manager_enumerate_links(Manager *m) {
         return manager_enumerate_internal(m, m->rtnl, req, manager_rtnl_process_link);
 }
 
-static int manager_enumerate_qdisc(Manager *m) {
+static int manager_enumerate_qdisc(EnumerationDump *d) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
         int r;
 
-        assert(m);
-        assert(m->rtnl);
+        assert(d);
 
-        r = sd_rtnl_message_new_traffic_control(m->rtnl, &req, RTM_GETQDISC, 0, 0, 0);
+        r = enumeration_dump_open(d);
         if (r < 0)
                 return r;
 
-        return manager_enumerate_internal(m, m->rtnl, req, manager_rtnl_process_qdisc);
+        r = sd_rtnl_message_new_traffic_control(d->nl, &req, RTM_GETQDISC, 0, 0, 0);
+        if (r < 0)
+                return r;
+
+        return enumeration_dump_send(d, req);
 }
 
-static int manager_enumerate_tclass(Manager *m) {
+static int manager_enumerate_tclass(EnumerationDump *d) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
         int r;
 
-        assert(m);
-        assert(m->rtnl);
+        assert(d);
+
+        r = enumeration_dump_open(d);
+        if (r < 0)
+                return r;
 
-        r = sd_rtnl_message_new_traffic_control(m->rtnl, &req, RTM_GETTCLASS, 0, 0, 0);
+        r = sd_rtnl_message_new_traffic_control(d->nl, &req, RTM_GETTCLASS, 0, 0, 0);
         if (r < 0)
                 return r;
 
-        return manager_enumerate_internal(m, m->rtnl, req, manager_rtnl_process_tclass);
+        return enumeration_dump_send(d, req);
 }
 
-static int manager_enumerate_addresses(Manager *m) {
+static int manager_enumerate_addresses(EnumerationDump *d) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
         int r;
 
-        assert(m);
-        assert(m->rtnl);
+        assert(d);
 
-        r = sd_rtnl_message_new_addr(m->rtnl, &req, RTM_GETADDR, 0, 0);
+        r = enumeration_dump_open(d);
         if (r < 0)
                 return r;
 
-        return manager_enumerate_internal(m, m->rtnl, req, manager_rtnl_process_address);
+        r = sd_rtnl_message_new_addr(d->nl, &req, RTM_GETADDR, 0, 0);
+        if (r < 0)
+                return r;
+
+        return enumeration_dump_send(d, req);
 }
 
-static int manager_enumerate_neighbors(Manager *m) {
+static int manager_enumerate_neighbors(EnumerationDump *d) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
         int r;
 
-        assert(m);
-        assert(m->rtnl);
+        assert(d);
 
-        r = sd_rtnl_message_new_neigh(m->rtnl, &req, RTM_GETNEIGH, 0, AF_UNSPEC);
+        r = enumeration_dump_open(d);
         if (r < 0)
                 return r;
 
-        return manager_enumerate_internal(m, m->rtnl, req, manager_rtnl_process_neighbor);
+        r = sd_rtnl_message_new_neigh(d->nl, &req, RTM_GETNEIGH, 0, AF_UNSPEC);
+        if (r < 0)
+                return r;
+
+        return enumeration_dump_send(d, req);
 }
 
-static int manager_enumerate_routes(Manager *m) {
+static int manager_enumerate_routes(Manager *m, EnumerationDump *d) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
         int r;
 
         assert(m);
-        assert(m->rtnl);
+        assert(d);
 
         if (!m->manage_foreign_routes)
                 return 0;
 
-        r = sd_rtnl_message_new_route(m->rtnl, &req, RTM_GETROUTE, 0, 0);
+        r = enumeration_dump_open(d);
         if (r < 0)
                 return r;
 
-        return manager_enumerate_internal(m, m->rtnl, req, manager_rtnl_process_route);
+        r = sd_rtnl_message_new_route(d->nl, &req, RTM_GETROUTE, 0, 0);
+        if (r < 0)
+                return r;
+
+        return enumeration_dump_send(d, req);
 }
 
-static int manager_enumerate_rules(Manager *m) {
+static int manager_enumerate_rules(Manager *m, EnumerationDump *d) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
         int r;
 
         assert(m);
-        assert(m->rtnl);
+        assert(d);
 
         if (!m->manage_foreign_rules)
                 return 0;
 
-        r = sd_rtnl_message_new_routing_policy_rule(m->rtnl, &req, RTM_GETRULE, 0);
+        r = enumeration_dump_open(d);
         if (r < 0)
                 return r;
 
-        return manager_enumerate_internal(m, m->rtnl, req, manager_rtnl_process_rule);
+        r = sd_rtnl_message_new_routing_policy_rule(d->nl, &req, RTM_GETRULE, 0);
+        if (r < 0)
+                return r;
+
+        return enumeration_dump_send(d, req);
 }
 
-static int manager_enumerate_nexthop(Manager *m) {
+static int manager_enumerate_nexthop(EnumerationDump *d) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
         int r;
 
-        assert(m);
-        assert(m->rtnl);
+        assert(d);
+
+        r = enumeration_dump_open(d);
+        if (r < 0)
+                return r;
 
-        r = sd_rtnl_message_new_nexthop(m->rtnl, &req, RTM_GETNEXTHOP, 0, 0);
+        r = sd_rtnl_message_new_nexthop(d->nl, &req, RTM_GETNEXTHOP, 0, 0);
         if (r < 0)
                 return r;
 
-        return manager_enumerate_internal(m, m->rtnl, req, manager_rtnl_process_nexthop);
+        return enumeration_dump_send(d, req);
 }
 
 static int manager_enumerate_nl80211_wiphy(Manager *m) {
@@ -854,46 +1018,76 @@ static int manager_enumerate_nl80211_mlme(Manager *m) {
 }
 
 int manager_enumerate(Manager *m) {
+        _cleanup_(enumeration_dump_done) EnumerationDump
+                qdisc = {}, tclass = {}, addresses = {}, neighbors = {}, nexthops = {}, routes = {}, rules = {};
         int r;
 
+        r = manager_enumerate_qdisc(&qdisc);
+        if (r < 0)
+                return log_error_errno(r, "Could not request QDiscs: %m");
+
+        r = manager_enumerate_tclass(&tclass);
+        if (r < 0)
+                return log_error_errno(r, "Could not request TClasses: %m");
+
+        r = manager_enumerate_addresses(&addresses);
+        if (r < 0)
+                return log_error_errno(r, "Could not request addresses: %m");
+
+        r = manager_enumerate_neighbors(&neighbors);
+        if (r < 0)
+                return log_error_errno(r, "Could not request neighbors: %m");
+
+        r = manager_enumerate_nexthop(&nexthops);
+        if (r < 0)
+                return log_error_errno(r, "Could not request nexthops: %m");
+
+        r = manager_enumerate_routes(m, &routes);
+        if (r < 0)
+                return log_error_errno(r, "Could not request routes: %m");
+
+        r = manager_enumerate_rules(m, &rules);
+        if (r < 0)
+                return log_error_errno(r, "Could not request routing policy rules: %m");
+
         r = manager_enumerate_links(m);
         if (r < 0)
                 return log_error_errno(r, "Could not enumerate links: %m");
 
-        r = manager_enumerate_qdisc(m);
+        r = manager_enumerate_finish(m, &qdisc, manager_rtnl_process_qdisc);
         if (r == -EOPNOTSUPP)
                 log_debug_errno(r, "Could not enumerate QDiscs, ignoring: %m");
         else if (r < 0)
                 return log_error_errno(r, "Could not enumerate QDisc: %m");
 
-        r = manager_enumerate_tclass(m);
+        r = manager_enumerate_finish(m, &tclass, manager_rtnl_process_tclass);
         if (r == -EOPNOTSUPP)
                 log_debug_errno(r, "Could not enumerate TClasses, ignoring: %m");
         else if (r < 0)
                 return log_error_errno(r, "Could not enumerate TClass: %m");
 
-        r = manager_enumerate_addresses(m);
+        r = manager_enumerate_finish(m, &addresses, manager_rtnl_process_address);
         if (r < 0)
                 return log_error_errno(r, "Could not enumerate addresses: %m");
 
-        r = manager_enumerate_neighbors(m);
+        r = manager_enumerate_finish(m, &neighbors, manager_rtnl_process_neighbor);
         if (r < 0)
                 return log_error_errno(r, "Could not enumerate neighbors: %m");
 
         /* NextHop support is added in kernel v5.3 (65ee00a9409f751188a8cdc0988167858eb4a536),
          * and older kernels return -EOPNOTSUPP, or -EINVAL if SELinux is enabled. */
-        r = manager_enumerate_nexthop(m);
+        r = manager_enumerate_finish(m, &nexthops, manager_rtnl_process_nexthop);
         if (r == -EOPNOTSUPP || (r == -EINVAL && mac_selinux_enforcing()))
                 log_debug_errno(r, "Could not enumerate nexthops, ignoring: %m");
         else if (r < 0)
                 return log_error_errno(r, "Could not enumerate nexthops: %m");
 
-        r = manager_enumerate_routes(m);
+        r = manager_enumerate_finish(m, &routes, manager_rtnl_process_route);
         if (r < 0)
                 return log_error_errno(r, "Could not enumerate routes: %m");
 
         /* If kernel is built with CONFIG_FIB_RULES=n, it returns -EOPNOTSUPP. */
-        r = manager_enumerate_rules(m);
+        r = manager_enumerate_finish(m, &rules, manager_rtnl_process_rule);
         if (r == -EOPNOTSUPP)
                 log_debug_errno(r, "Could not enumerate routing policy rules, ignoring: %m");
         else if (r < 0)
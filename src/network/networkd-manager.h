@@ -13,9 +13,11 @@
 #include "hashmap.h"
 #include "networkd-link.h"
 #include "networkd-network.h"
+#include "networkd-queue.h"
 #include "ordered-set.h"
 #include "set.h"
 #include "time-util.h"
+#include "varlink.h"
 
 struct Manager {
         sd_netlink *rtnl;
@@ -24,6 +26,7 @@ struct Manager {
         sd_event *event;
         sd_resolve *resolve;
         sd_bus *bus;
+        VarlinkServer *varlink_server;
         sd_device_monitor *device_monitor;
         Hashmap *polkit_registry;
         int ethtool_fd;
@@ -84,6 +87,9 @@ struct Manager {
         Hashmap *route_table_numbers_by_name;
         Hashmap *route_table_names_by_number;
 
+        /* Route tables managed by other daemons, whose routes are never received */
+        Set *ignored_route_tables;
+
         /* Wiphy */
         Hashmap *wiphy_by_index;
         Hashmap *wiphy_by_name;
@@ -100,12 +106,14 @@ struct Manager {
         FirewallContext *fw_ctx;
 
         OrderedSet *request_queue;
+        RequestStatistics request_statistics[_REQUEST_TYPE_MAX];
 };
 
 int manager_new(Manager **ret, bool test_mode);
 Manager* manager_free(Manager *m);
 
 int manager_setup(Manager *m);
+int manager_setup_rtnl_filter(Manager *manager);
 int manager_start(Manager *m);
 
 int manager_load_config(Manager *m);
@@ -219,9 +219,44 @@ static int ndisc_route_handler(sd_netlink *rtnl, sd_netlink_message *m, Request
         return 1;
 }
 
+/* Routers typically send RAs every few seconds, and each of them carries the same information with
+ * refreshed lifetimes. The addresses and routes already configured for the router are used to detect that,
+ * and they are only updated in the kernel when anything but the lifetime changed, when the lifetime is
+ * shortened, or when less than half of the newly advertised lifetime is left. */
+static bool ndisc_lifetime_is_up_to_date(usec_t existing_usec, usec_t new_usec, usec_t timestamp_usec) {
+        if (existing_usec == new_usec)
+                return true;
+        if (existing_usec > new_usec)
+                return false; /* Shortened. */
+        if (new_usec == USEC_INFINITY)
+                return false;
+
+        return usec_sub_unsigned(existing_usec, timestamp_usec) >= usec_sub_unsigned(new_usec, timestamp_usec) / 2;
+}
+
+static bool ndisc_route_is_up_to_date(Route *existing, const Route *route, usec_t timestamp_usec) {
+        assert(existing);
+        assert(route);
+
+        return route_exists(existing) &&
+                !route_is_requesting(existing) &&
+                existing->source == NETWORK_CONFIG_SOURCE_NDISC &&
+                in6_addr_equal(&existing->provider.in6, &route->provider.in6) &&
+                existing->pref == route->pref &&
+                existing->mtu == route->mtu &&
+                existing->initcwnd == route->initcwnd &&
+                existing->initrwnd == route->initrwnd &&
+                existing->advmss == route->advmss &&
+                existing->quickack == route->quickack &&
+                existing->fast_open_no_cookie == route->fast_open_no_cookie &&
+                existing->ttl_propagate == route->ttl_propagate &&
+                ndisc_lifetime_is_up_to_date(existing->lifetime_usec, route->lifetime_usec, timestamp_usec);
+}
+
 static int ndisc_request_route(Route *in, Link *link, sd_ndisc_router *rt) {
         _cleanup_(route_freep) Route *route = in;
         struct in6_addr router;
+        usec_t timestamp_usec;
         Route *existing;
         int r;
 
@@ -233,6 +268,10 @@ static int ndisc_request_route(Route *in, Link *link, sd_ndisc_router *rt) {
         if (r < 0)
                 return r;
 
+        r = sd_ndisc_router_get_timestamp(rt, CLOCK_BOOTTIME, &timestamp_usec);
+        if (r < 0)
+                return r;
+
         route->source = NETWORK_CONFIG_SOURCE_NDISC;
         route->provider.in6 = router;
         if (!route->table_set)
@@ -244,9 +283,13 @@ static int ndisc_request_route(Route *in, Link *link, sd_ndisc_router *rt) {
 
         if (route_get(NULL, link, route, &existing) < 0)
                 link->ndisc_configured = false;
-        else
+        else {
                 route_unmark(existing);
 
+                if (ndisc_route_is_up_to_date(existing, route, timestamp_usec))
+                        return 0;
+        }
+
         return link_request_route(link, TAKE_PTR(route), true, &link->ndisc_messages,
                                   ndisc_route_handler, NULL);
 }
@@ -267,9 +310,25 @@ static int ndisc_address_handler(sd_netlink *rtnl, sd_netlink_message *m, Reques
         return 1;
 }
 
+static bool ndisc_address_is_up_to_date(Address *existing, const Address *address, usec_t timestamp_usec) {
+        assert(existing);
+        assert(address);
+
+        /* The kernel may add flags like IFA_F_TENTATIVE, hence only check that ours are set. */
+        return address_exists(existing) &&
+                !address_is_requesting(existing) &&
+                existing->source == NETWORK_CONFIG_SOURCE_NDISC &&
+                in6_addr_equal(&existing->provider.in6, &address->provider.in6) &&
+                existing->prefixlen == address->prefixlen &&
+                FLAGS_SET(existing->flags, address->flags) &&
+                ndisc_lifetime_is_up_to_date(existing->lifetime_valid_usec, address->lifetime_valid_usec, timestamp_usec) &&
+                ndisc_lifetime_is_up_to_date(existing->lifetime_preferred_usec, address->lifetime_preferred_usec, timestamp_usec);
+}
+
 static int ndisc_request_address(Address *in, Link *link, sd_ndisc_router *rt) {
         _cleanup_(address_freep) Address *address = in;
         struct in6_addr router;
+        usec_t timestamp_usec;
         Address *existing;
         int r;
 
@@ -281,14 +340,22 @@ static int ndisc_request_address(Address *in, Link *link, sd_ndisc_router *rt) {
         if (r < 0)
                 return r;
 
+        r = sd_ndisc_router_get_timestamp(rt, CLOCK_BOOTTIME, &timestamp_usec);
+        if (r < 0)
+                return r;
+
         address->source = NETWORK_CONFIG_SOURCE_NDISC;
         address->provider.in6 = router;
 
         if (address_get(link, address, &existing) < 0)
                 link->ndisc_configured = false;
-        else
+        else {
                 address_unmark(existing);
 
+                if (ndisc_address_is_up_to_date(existing, address, timestamp_usec))
+                        return 0;
+        }
+
         return link_request_address(link, TAKE_PTR(address), true, &link->ndisc_messages,
                                  ndisc_address_handler, NULL);
 }
@@ -225,8 +225,10 @@ static int neighbor_process_request(Request *req, Link *link, Neighbor *neighbor
         assert(link);
         assert(neighbor);
 
-        if (!link_is_ready_to_configure(link, false))
+        if (!link_is_ready_to_configure(link, false)) {
+                request_wait_for_link(req);
                 return 0;
+        }
 
         r = neighbor_configure(neighbor, link, req);
         if (r < 0)
@@ -553,6 +553,12 @@ int network_load_one(Manager *manager, OrderedHashmap **networks, const char *fi
         if (r < 0)
                 return r; /* config_parse_many() logs internally. */
 
+        r = config_get_digest_by_path(network->stats_by_path, network->config_digest);
+        if (r < 0)
+                log_debug_errno(r, "%s: Failed to calculate digest of configuration, ignoring: %m", network->filename);
+        else
+                network->config_digest_set = true;
+
         r = network_add_ipv4ll_route(network);
         if (r < 0)
                 return log_warning_errno(r, "%s: Failed to add IPv4LL route: %m", network->filename);
@@ -611,8 +617,18 @@ int network_reload(Manager *manager) {
                 }
 
                 if (!stats_by_path_equal(n->stats_by_path, old->stats_by_path)) {
-                        log_debug("Found updated .network file: %s", n->filename);
-                        continue;
+                        if (!n->config_digest_set || !old->config_digest_set ||
+                            memcmp(n->config_digest, old->config_digest, SHA256_DIGEST_SIZE) != 0) {
+                                log_debug("Found updated .network file: %s", n->filename);
+                                continue;
+                        }
+
+                        /* The files were rewritten with the same contents. Keep the old Network object,
+                         * so that links using it are not reconfigured, but take the new stats, so that
+                         * the files need not be read again on the next reload. */
+                        log_debug("Found .network file with unchanged contents: %s", n->filename);
+                        hashmap_free(old->stats_by_path);
+                        old->stats_by_path = TAKE_PTR(n->stats_by_path);
                 }
 
                 r = ordered_hashmap_replace(new_networks, old->name, old);
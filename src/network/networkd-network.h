@@ -66,6 +66,8 @@ struct Network {
         char *name;
         char *filename;
         Hashmap *stats_by_path;
+        uint8_t config_digest[SHA256_DIGEST_SIZE];
+        bool config_digest_set;
         char *description;
 
         /* [Match] section */
@@ -5,8 +5,13 @@
 #include "networkd-link.h"
 #include "networkd-manager.h"
 #include "networkd-queue.h"
+#include "stats-util.h"
 #include "string-table.h"
 
+DEFINE_STATS_COUNTER(stats_requests, "network.requests");
+DEFINE_STATS_COUNTER(stats_requests_failed, "network.requests_failed");
+DEFINE_STATS_HISTOGRAM(stats_process_requests, "network.process_requests"); /* Per run that processed anything */
+
 static Request *request_free(Request *req) {
         if (!req)
                 return NULL;
@@ -44,6 +49,30 @@ void request_detach(Manager *manager, Request *req) {
         request_unref(req);
 }
 
+void request_wait_for_link(Request *req) {
+        assert(req);
+        assert(req->link);
+
+        req->waiting_for_link = true;
+        req->link_generation = req->link->request_generation;
+}
+
+void link_wakeup_requests(Link *link) {
+        assert(link);
+
+        /* Called when something changed which the queued requests of the link may wait for, e.g. the
+         * state or flags of the link, or its addresses or routes. */
+        link->request_generation++;
+}
+
+static bool request_is_waiting(Request *req) {
+        assert(req);
+
+        return req->waiting_for_link &&
+                req->link &&
+                req->link_generation == req->link->request_generation;
+}
+
 static void request_hash_func(const Request *req, struct siphash *state) {
         assert(req);
         assert(state);
@@ -153,6 +182,9 @@ static int request_new(
                 return r;
 
         req->manager = manager;
+        req->statistics = &manager->request_statistics[type];
+        req->statistics->n_queued++;
+        req->queued_usec = now(CLOCK_MONOTONIC);
         req->counter = counter;
         if (req->counter)
                 (*req->counter)++;
@@ -196,26 +228,60 @@ int link_queue_request_full(
                            process, counter, netlink_handler, ret);
 }
 
+static void request_update_statistics(Request *req, int r) {
+        usec_t t;
+
+        assert(req);
+        assert(req->statistics);
+
+        if (r < 0) {
+                req->statistics->n_failed++;
+                return;
+        }
+
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), req->queued_usec);
+
+        req->statistics->n_processed++;
+        req->statistics->wait_usec = usec_add(req->statistics->wait_usec, t);
+        req->statistics->wait_usec_max = MAX(req->statistics->wait_usec_max, t);
+}
+
 int manager_process_requests(sd_event_source *s, void *userdata) {
         Manager *manager = ASSERT_PTR(userdata);
+        usec_t begin = now(CLOCK_MONOTONIC);
+        bool processed_any = false;
         int r;
 
+        /* Most requests send a netlink message. Write them to the kernel together, rather than one by
+         * one, when many requests are processed at once. */
+        netlink_batch_begin(manager->rtnl);
+
         for (;;) {
                 bool processed = false;
                 Request *req;
 
                 ORDERED_SET_FOREACH(req, manager->request_queue) {
+                        if (request_is_waiting(req))
+                                continue;
+
                         _unused_ _cleanup_(request_unrefp) Request *ref = request_ref(req);
                         _cleanup_(link_unrefp) Link *link = link_ref(req->link);
 
                         assert(req->process);
 
+                        req->waiting_for_link = false;
                         r = req->process(req, link, req->userdata);
                         if (r == 0)
                                 continue;
 
-                        processed = true;
+                        processed = processed_any = true;
+                        stats_counter_inc(&stats_requests);
+                        if (r < 0)
+                                stats_counter_inc(&stats_requests_failed);
+                        request_update_statistics(req, r);
                         request_detach(manager, req);
+                        if (link)
+                                link_wakeup_requests(link);
 
                         if (r < 0 && link) {
                                 link_enter_failed(link);
@@ -230,18 +296,34 @@ int manager_process_requests(sd_event_source *s, void *userdata) {
                         break;
         }
 
+        netlink_batch_end(manager->rtnl);
+
+        if (processed_any)
+                stats_histogram_add_since(&stats_process_requests, begin);
         return 0;
 }
 
 static int request_netlink_handler(sd_netlink *nl, sd_netlink_message *m, Request *req) {
         assert(req);
 
+        if (req->statistics) {
+                usec_t t = usec_sub_unsigned(now(CLOCK_MONOTONIC), req->sent_usec);
+
+                req->statistics->n_replied++;
+                req->statistics->reply_usec = usec_add(req->statistics->reply_usec, t);
+                req->statistics->reply_usec_max = MAX(req->statistics->reply_usec_max, t);
+        }
+
         if (req->counter) {
                 assert(*req->counter > 0);
                 (*req->counter)--;
                 req->counter = NULL; /* To prevent double decrement on free. */
         }
 
+        /* The reply may change the state of the link or of its addresses or routes. */
+        if (req->link)
+                link_wakeup_requests(req->link);
+
         if (req->link && IN_SET(req->link->state, LINK_STATE_FAILED, LINK_STATE_LINGER))
                 return 0;
 
@@ -262,6 +344,11 @@ int request_call_netlink_async(sd_netlink *nl, sd_netlink_message *m, Request *r
         if (r < 0)
                 return r;
 
+        if (req->statistics) {
+                req->statistics->n_sent++;
+                req->sent_usec = now(CLOCK_MONOTONIC);
+        }
+
         request_ref(req);
         return 0;
 }
@@ -6,6 +6,7 @@
 
 #include "alloc-util.h"
 #include "hash-funcs.h"
+#include "time-util.h"
 
 typedef struct Link Link;
 typedef struct NetDev NetDev;
@@ -52,6 +53,19 @@ typedef enum RequestType {
         _REQUEST_TYPE_INVALID = -EINVAL,
 } RequestType;
 
+/* Per request type statistics, exposed through the Describe() D-Bus method and "networkctl requests". */
+typedef struct RequestStatistics {
+        uint64_t n_queued;      /* Number of requests queued (duplicates are not counted) */
+        uint64_t n_processed;   /* Number of requests processed successfully */
+        uint64_t n_failed;      /* Number of requests whose processing failed */
+        uint64_t n_sent;        /* Number of netlink messages sent for requests */
+        uint64_t n_replied;     /* Number of replies received for them */
+        usec_t wait_usec;       /* Total time requests spent in the queue before being processed */
+        usec_t wait_usec_max;
+        usec_t reply_usec;      /* Total time from sending a netlink message until the reply arrived */
+        usec_t reply_usec_max;
+} RequestStatistics;
+
 struct Request {
         unsigned n_ref;
 
@@ -80,6 +94,17 @@ struct Request {
          * request, and pass this request to the netlink_call_async(), and set the destroy function
          * to the slot. */
         request_netlink_handler_t netlink_handler;
+
+        /* Set by request_wait_for_link() when 'process' found that the request cannot be processed yet,
+         * and only the state of the link it is for blocks it. Then, the request is not processed again
+         * until link_wakeup_requests() is called for the link, rather than after every event. */
+        bool waiting_for_link;
+        uint64_t link_generation;
+
+        /* Points to the entry for the type of the request in Manager.request_statistics. */
+        RequestStatistics *statistics;
+        usec_t queued_usec;
+        usec_t sent_usec;
 };
 
 Request *request_ref(Request *req);
@@ -87,6 +112,8 @@ Request *request_unref(Request *req);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Request*, request_unref);
 
 void request_detach(Manager *manager, Request *req);
+void request_wait_for_link(Request *req);
+void link_wakeup_requests(Link *link);
 
 int netdev_queue_request(
                 NetDev *netdev,
@@ -552,3 +552,60 @@ int config_parse_route_table_names(
                 TAKE_PTR(name);
         }
 }
+
+int config_parse_ignore_route_tables(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        Manager *m = ASSERT_PTR(userdata);
+        int r;
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+
+        if (isempty(rvalue)) {
+                m->ignored_route_tables = set_free(m->ignored_route_tables);
+                return 0;
+        }
+
+        for (const char *p = rvalue;;) {
+                _cleanup_free_ char *word = NULL;
+                uint32_t table;
+
+                r = extract_first_word(&p, &word, NULL, 0);
+                if (r == -ENOMEM)
+                        return log_oom();
+                if (r < 0) {
+                        log_syntax(unit, LOG_WARNING, filename, line, r,
+                                   "Invalid %s=, ignoring assignment: %s", lvalue, rvalue);
+                        return 0;
+                }
+                if (r == 0)
+                        return 0;
+
+                r = manager_get_route_table_from_string(m, word, &table);
+                if (r < 0) {
+                        log_syntax(unit, LOG_WARNING, filename, line, r,
+                                   "Failed to parse route table '%s', ignoring: %m", word);
+                        continue;
+                }
+                if (IN_SET(table, RT_TABLE_MAIN, RT_TABLE_LOCAL)) {
+                        log_syntax(unit, LOG_WARNING, filename, line, 0,
+                                   "Route table '%s' cannot be ignored, ignoring assignment.", word);
+                        continue;
+                }
+
+                r = set_ensure_put(&m->ignored_route_tables, NULL, UINT32_TO_PTR(table));
+                if (r < 0)
+                        return log_oom();
+        }
+}
@@ -47,3 +47,4 @@ int manager_get_route_table_from_string(const Manager *m, const char *table, uin
 int manager_get_route_table_to_string(const Manager *m, uint32_t table, char **ret);
 
 CONFIG_PARSER_PROTOTYPE(config_parse_route_table_names);
+CONFIG_PARSER_PROTOTYPE(config_parse_ignore_route_tables);
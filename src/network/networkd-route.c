@@ -1323,8 +1323,15 @@ static int route_process_request(Request *req, Link *link, Route *route) {
         r = route_is_ready_to_configure(route, link);
         if (r < 0)
                 return log_link_warning_errno(link, r, "Failed to check if route is ready to configure: %m");
-        if (r == 0)
+        if (r == 0) {
+                /* Unless the route also depends on nexthops, addresses, or other links, it can only become
+                 * ready when the link or its addresses and routes change. */
+                if (route->nexthop_id == 0 &&
+                    !in_addr_is_set(route->family, &route->prefsrc) &&
+                    ordered_set_isempty(route->multipath_routes))
+                        request_wait_for_link(req);
                 return 0;
+        }
 
         if (route_needs_convert(route)) {
                 r = route_convert(link->manager, route, &converted);
@@ -1641,7 +1648,7 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, Ma
         struct rta_cacheinfo cacheinfo;
         bool has_cacheinfo;
         Link *link = NULL;
-        uint32_t ifindex;
+        uint32_t ifindex, table;
         uint16_t type;
         size_t rta_len;
         int r;
@@ -1667,6 +1674,23 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, Ma
                 return 0;
         }
 
+        r = sd_netlink_message_read_u32(message, RTA_TABLE, &table);
+        if (r == -ENODATA) {
+                unsigned char t;
+
+                r = sd_rtnl_message_route_get_table(message, &t);
+                if (r >= 0)
+                        table = t;
+        }
+        if (r < 0) {
+                log_warning_errno(r, "rtnl: received route message with invalid table, ignoring: %m");
+                return 0;
+        }
+
+        /* Usually already dropped by the netlink filter, unless too many tables are ignored. */
+        if (set_contains(m->ignored_route_tables, UINT32_TO_PTR(table)))
+                return 0;
+
         r = sd_netlink_message_read_u32(message, RTA_OIF, &ifindex);
         if (r < 0 && r != -ENODATA) {
                 log_warning_errno(r, "rtnl: could not get ifindex from route message, ignoring: %m");
@@ -1685,6 +1709,9 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, Ma
                                 log_warning("rtnl: received route message for link (%d) we do not know about, ignoring", ifindex);
                         return 0;
                 }
+
+                /* Queued routes may wait for a route to their gateway. */
+                link_wakeup_requests(link);
         }
 
         r = route_new(&tmp);
@@ -1779,18 +1806,7 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, Ma
                 return 0;
         }
 
-        r = sd_netlink_message_read_u32(message, RTA_TABLE, &tmp->table);
-        if (r == -ENODATA) {
-                unsigned char table;
-
-                r = sd_rtnl_message_route_get_table(message, &table);
-                if (r >= 0)
-                        tmp->table = table;
-        }
-        if (r < 0) {
-                log_link_warning_errno(link, r, "rtnl: received route message with invalid table, ignoring: %m");
-                return 0;
-        }
+        tmp->table = table;
 
         r = sd_netlink_message_read_u32(message, RTA_PRIORITY, &tmp->priority);
         if (r < 0 && r != -ENODATA) {
@@ -2824,6 +2840,12 @@ static int route_section_verify(Route *route, Network *network) {
         if (!route->table_set && IN_SET(route->type, RTN_LOCAL, RTN_BROADCAST, RTN_ANYCAST, RTN_NAT))
                 route->table = RT_TABLE_LOCAL;
 
+        if (set_contains(network->manager->ignored_route_tables, UINT32_TO_PTR(route->table)))
+                return log_warning_errno(SYNTHETIC_ERRNO(EINVAL),
+                                         "%s: Route table %"PRIu32" is ignored by IgnoreRouteTables= in networkd.conf. "
+                                         "Ignoring [Route] section from line %u.",
+                                         route->section->filename, route->table, route->section->line);
+
         if (!route->scope_set && route->family != AF_INET6) {
                 if (IN_SET(route->type, RTN_LOCAL, RTN_NAT))
                         route->scope = RT_SCOPE_HOST;
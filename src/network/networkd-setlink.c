@@ -30,6 +30,7 @@ static int get_link_update_flag_handler(sd_netlink *rtnl, sd_netlink_message *m,
         assert(link->set_flags_messages > 0);
 
         link->set_flags_messages--;
+        link_wakeup_requests(link);
 
         return get_link_default_handler(rtnl, m, link);
 }
@@ -973,6 +974,7 @@ static int link_up_or_down_handler(sd_netlink *rtnl, sd_netlink_message *m, Requ
 
         if (on_activate) {
                 link->activated = true;
+                link_wakeup_requests(link);
                 link_check_ready(link);
         }
 
@@ -1049,6 +1051,7 @@ int link_request_to_activate(Link *link) {
                 _fallthrough_;
         case ACTIVATION_POLICY_MANUAL:
                 link->activated = true;
+                link_wakeup_requests(link);
                 link_check_ready(link);
                 return 0;
         case ACTIVATION_POLICY_UP:
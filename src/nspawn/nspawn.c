@@ -3088,7 +3088,11 @@ static int chase_symlinks_and_update(char **p, unsigned flags) {
         return free_and_replace(*p, chased);
 }
 
-static int determine_uid_shift(const char *directory) {
+static int determine_uid_shift(const char *directory, uid_t *ret_uid_base) {
+
+        assert(ret_uid_base);
+
+        *ret_uid_base = 0;
 
         if (arg_userns_mode == USER_NAMESPACE_NO) {
                 arg_uid_shift = 0;
@@ -3111,9 +3115,16 @@ static int determine_uid_shift(const char *directory) {
 
                 arg_uid_range = UINT32_C(0x10000);
 
-                if (arg_uid_shift != 0) {
+                if (arg_uid_shift != 0 && !arg_image) {
+                        /* If the directory tree is shifted already, we can still map it to whatever range
+                         * we end up using, so that we never have to chown it again, even if its range is
+                         * taken by another container by now. */
+                        log_debug("UID base of %s is " UID_FMT ", mapping from there.", directory, arg_uid_shift);
+                        *ret_uid_base = arg_uid_shift;
+                } else if (arg_uid_shift != 0) {
                         /* If the image is shifted already, then we'll fall back to classic chowning, for
-                         * compatibility (and simplicity), or refuse if mapping is explicitly requested.  */
+                         * compatibility (and simplicity), or refuse if mapping is explicitly requested. The
+                         * partitions of an image are always mapped from UID 0. */
 
                         if (arg_userns_ownership == USER_NAMESPACE_OWNERSHIP_AUTO) {
                                 log_debug("UID base of %s is non-zero, not using UID mapping.", directory);
@@ -3636,6 +3647,7 @@ static int outer_child(
         _cleanup_strv_free_ char **os_release_pairs = NULL;
         _cleanup_close_ int fd = -1;
         bool idmap = false;
+        uid_t uid_base;
         const char *p;
         pid_t pid;
         ssize_t l;
@@ -3694,7 +3706,7 @@ static int outer_child(
                         return r;
         }
 
-        r = determine_uid_shift(directory);
+        r = determine_uid_shift(directory, &uid_base);
         if (r < 0)
                 return r;
 
@@ -3804,9 +3816,9 @@ static int outer_child(
 
         if (arg_userns_mode != USER_NAMESPACE_NO &&
             IN_SET(arg_userns_ownership, USER_NAMESPACE_OWNERSHIP_MAP, USER_NAMESPACE_OWNERSHIP_AUTO) &&
-            arg_uid_shift != 0) {
+            arg_uid_shift != uid_base) {
 
-                r = remount_idmap(directory, arg_uid_shift, arg_uid_range, REMOUNT_IDMAP_HOST_ROOT);
+                r = remount_idmap_full(directory, uid_base, arg_uid_shift, arg_uid_range, REMOUNT_IDMAP_HOST_ROOT);
                 if (r == -EINVAL || ERRNO_IS_NOT_SUPPORTED(r)) {
                         /* This might fail because the kernel or file system doesn't support idmapping. We
                          * can't really distinguish this nicely, nor do we have any guarantees about the
@@ -4883,6 +4895,18 @@ static int run_container(
         uid_shift_socket_pair[1] = safe_close(uid_shift_socket_pair[1]);
         unified_cgroup_hierarchy_socket_pair[1] = safe_close(unified_cgroup_hierarchy_socket_pair[1]);
 
+        /* Connect to the bus now, so that the connection is set up and authenticated while the child is
+         * busy setting up the container's file system, rather than after it. */
+        if (arg_register || !arg_keep_unit) {
+                r = sd_bus_default_system(&bus);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to open system bus: %m");
+
+                r = sd_bus_set_close_on_exit(bus, false);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to disable close-on-exit behaviour: %m");
+        }
+
         if (arg_userns_mode != USER_NAMESPACE_NO) {
                 /* The child just let us know the UID shift it might have read from the image. */
                 l = recv(uid_shift_socket_pair[0], &arg_uid_shift, sizeof arg_uid_shift, 0);
@@ -5041,16 +5065,6 @@ static int run_container(
                         return r;
         }
 
-        if (arg_register || !arg_keep_unit) {
-                r = sd_bus_default_system(&bus);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to open system bus: %m");
-
-                r = sd_bus_set_close_on_exit(bus, false);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to disable close-on-exit behaviour: %m");
-        }
-
         if (!arg_keep_unit) {
                 /* When a new scope is created for this container, then we'll be registered as its controller, in which
                  * case PID 1 will send us a friendly RequestStop signal, when it is asked to terminate the
@@ -7,9 +7,12 @@
 #include "user-record-nss.h"
 #include "user-record.h"
 #include "user-util.h"
+#include "userdb-cache.h"
 #include "userdb-glue.h"
 #include "userdb.h"
 
+static UserDBCache userdb_cache = USERDB_CACHE_INIT(USERDB_CACHE_PATH);
+
 UserDBFlags nss_glue_userdb_flags(void) {
         UserDBFlags flags = USERDB_EXCLUDE_NSS;
 
@@ -20,6 +23,15 @@ UserDBFlags nss_glue_userdb_flags(void) {
         return flags;
 }
 
+static bool nss_glue_use_cache(void) {
+        /* The cache covers all services, hence don't use it if we are asked to skip some of them, e.g. in
+         * the services themselves. */
+        if (getenv("SYSTEMD_BYPASS_USERDB") || getenv("SYSTEMD_ONLY_USERDB"))
+                return false;
+
+        return getenv_bool_secure("SYSTEMD_NSS_USERDB_CACHE") != 0;
+}
+
 int nss_pack_user_record(
                 UserRecord *hr,
                 struct passwd *pwd,
@@ -81,6 +93,16 @@ enum nss_status userdb_getpwnam(
         if (_nss_systemd_is_blocked())
                 return NSS_STATUS_NOTFOUND;
 
+        if (nss_glue_use_cache()) {
+                r = userdb_cache_get_user(&userdb_cache, name, UID_INVALID, pwd, buffer, buflen);
+                if (r < 0) {
+                        *errnop = -r;
+                        return NSS_STATUS_TRYAGAIN;
+                }
+                if (r > 0)
+                        return NSS_STATUS_SUCCESS;
+        }
+
         r = userdb_by_name(name, nss_glue_userdb_flags()|USERDB_SUPPRESS_SHADOW, &hr);
         if (r == -ESRCH)
                 return NSS_STATUS_NOTFOUND;
@@ -114,6 +136,16 @@ enum nss_status userdb_getpwuid(
         if (_nss_systemd_is_blocked())
                 return NSS_STATUS_NOTFOUND;
 
+        if (nss_glue_use_cache()) {
+                r = userdb_cache_get_user(&userdb_cache, NULL, uid, pwd, buffer, buflen);
+                if (r < 0) {
+                        *errnop = -r;
+                        return NSS_STATUS_TRYAGAIN;
+                }
+                if (r > 0)
+                        return NSS_STATUS_SUCCESS;
+        }
+
         r = userdb_by_uid(uid, nss_glue_userdb_flags()|USERDB_SUPPRESS_SHADOW, &hr);
         if (r == -ESRCH)
                 return NSS_STATUS_NOTFOUND;
@@ -290,6 +322,16 @@ enum nss_status userdb_getgrnam(
         if (_nss_systemd_is_blocked())
                 return NSS_STATUS_NOTFOUND;
 
+        if (nss_glue_use_cache()) {
+                r = userdb_cache_get_group(&userdb_cache, name, GID_INVALID, gr, buffer, buflen);
+                if (r < 0) {
+                        *errnop = -r;
+                        return NSS_STATUS_TRYAGAIN;
+                }
+                if (r > 0)
+                        return NSS_STATUS_SUCCESS;
+        }
+
         r = groupdb_by_name(name, nss_glue_userdb_flags()|USERDB_SUPPRESS_SHADOW, &g);
         if (r < 0 && r != -ESRCH) {
                 *errnop = -r;
@@ -358,6 +400,16 @@ enum nss_status userdb_getgrgid(
         if (_nss_systemd_is_blocked())
                 return NSS_STATUS_NOTFOUND;
 
+        if (nss_glue_use_cache()) {
+                r = userdb_cache_get_group(&userdb_cache, NULL, gid, gr, buffer, buflen);
+                if (r < 0) {
+                        *errnop = -r;
+                        return NSS_STATUS_TRYAGAIN;
+                }
+                if (r > 0)
+                        return NSS_STATUS_SUCCESS;
+        }
+
         r = groupdb_by_gid(gid, nss_glue_userdb_flags()|USERDB_SUPPRESS_SHADOW, &g);
         if (r < 0 && r != -ESRCH) {
                 *errnop = -r;
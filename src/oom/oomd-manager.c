@@ -1,5 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <sys/epoll.h>
+
 #include "sd-daemon.h"
 
 #include "bus-log-control-api.h"
@@ -14,6 +16,7 @@
 #include "oomd-manager.h"
 #include "path-util.h"
 #include "percent-util.h"
+#include "strv.h"
 
 typedef struct ManagedOOMMessage {
         ManagedOOMMode mode;
@@ -43,8 +46,30 @@ static int managed_oom_mode(const char *name, JsonVariant *v, JsonDispatchFlags
         return 0;
 }
 
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(event_source_hash_ops, void, trivial_hash_func, trivial_compare_func, sd_event_source_disable_unref);
+
+static int monitor_memory_pressure_wakeup(Manager *m) {
+        int r;
+
+        assert(m);
+
+        /* Resumes polling memory pressure right away. The triggers are not needed while polling. */
+
+        m->mem_pressure_triggers = set_free(m->mem_pressure_triggers);
+
+        if (!m->mem_pressure_context_event_source)
+                return 0;
+
+        r = sd_event_source_set_time(m->mem_pressure_context_event_source, 0);
+        if (r < 0)
+                return r;
+
+        return sd_event_source_set_enabled(m->mem_pressure_context_event_source, SD_EVENT_ON);
+}
+
 static int process_managed_oom_message(Manager *m, uid_t uid, JsonVariant *parameters) {
         JsonVariant *c, *cgroups;
+        bool mem_pressure_changed = false;
         int r;
 
         static const JsonDispatch dispatch_table[] = {
@@ -97,6 +122,8 @@ static int process_managed_oom_message(Manager *m, uid_t uid, JsonVariant *param
 
                 monitor_hm = streq(message.property, "ManagedOOMSwap") ?
                                 m->monitored_swap_cgroup_contexts : m->monitored_mem_pressure_cgroup_contexts;
+                if (monitor_hm == m->monitored_mem_pressure_cgroup_contexts)
+                        mem_pressure_changed = true;
 
                 if (message.mode == MANAGED_OOM_AUTO) {
                         (void) oomd_cgroup_context_free(hashmap_remove(monitor_hm, empty_to_root(message.path)));
@@ -126,6 +153,13 @@ static int process_managed_oom_message(Manager *m, uid_t uid, JsonVariant *param
                         ctx->mem_pressure_limit = limit;
         }
 
+        /* The PSI triggers need to be set up for the new set of cgroups and limits. */
+        if (mem_pressure_changed) {
+                r = monitor_memory_pressure_wakeup(m);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to resume memory pressure monitoring: %m");
+        }
+
         return 0;
 }
 
@@ -183,11 +217,13 @@ finish:
 /* Fill 'new_h' with 'path's descendant OomdCGroupContexts. Only include descendant cgroups that are possible
  * candidates for action. That is, only leaf cgroups or cgroups with memory.oom.group set to "1".
  *
+ * 'old_h' may contain the contexts of the previous interval, whose open files are then taken over.
+ *
  * This function ignores most errors in order to handle cgroups that may have been cleaned up while
  * populating the hashmap.
  *
  * 'new_h' is of the form { key: cgroup paths -> value: OomdCGroupContext } */
-static int recursively_get_cgroup_context(Hashmap *new_h, const char *path) {
+static int recursively_get_cgroup_context(Hashmap *old_h, Hashmap *new_h, const char *path) {
         _cleanup_free_ char *subpath = NULL;
         _cleanup_closedir_ DIR *d = NULL;
         int r;
@@ -203,7 +239,7 @@ static int recursively_get_cgroup_context(Hashmap *new_h, const char *path) {
         if (r < 0)
                 return r;
         else if (r == 0) { /* No subgroups? We're a leaf node */
-                r = oomd_insert_cgroup_context(NULL, new_h, path);
+                r = oomd_insert_cgroup_context(old_h, new_h, path);
                 if (r == -ENOMEM)
                         return r;
                 if (r < 0)
@@ -231,9 +267,9 @@ static int recursively_get_cgroup_context(Hashmap *new_h, const char *path) {
                 }
 
                 if (oom_group)
-                        r = oomd_insert_cgroup_context(NULL, new_h, cg_path);
+                        r = oomd_insert_cgroup_context(old_h, new_h, cg_path);
                 else
-                        r = recursively_get_cgroup_context(new_h, cg_path);
+                        r = recursively_get_cgroup_context(old_h, new_h, cg_path);
                 if (r == -ENOMEM)
                         return r;
                 if (r < 0)
@@ -269,7 +305,7 @@ static int update_monitored_cgroup_contexts(Hashmap **monitored_cgroups) {
         return 0;
 }
 
-static int get_monitored_cgroup_contexts_candidates(Hashmap *monitored_cgroups, Hashmap **ret_candidates) {
+static int get_monitored_cgroup_contexts_candidates(Hashmap *monitored_cgroups, Hashmap *old_candidates, Hashmap **ret_candidates) {
         _cleanup_hashmap_free_ Hashmap *candidates = NULL;
         OomdCGroupContext *ctx;
         int r;
@@ -282,7 +318,7 @@ static int get_monitored_cgroup_contexts_candidates(Hashmap *monitored_cgroups,
                 return -ENOMEM;
 
         HASHMAP_FOREACH(ctx, monitored_cgroups) {
-                r = recursively_get_cgroup_context(candidates, ctx->path);
+                r = recursively_get_cgroup_context(old_candidates, candidates, ctx->path);
                 if (r == -ENOMEM)
                         return r;
                 if (r < 0)
@@ -302,12 +338,11 @@ static int update_monitored_cgroup_contexts_candidates(Hashmap *monitored_cgroup
         assert(candidates);
         assert(*candidates);
 
-        r = get_monitored_cgroup_contexts_candidates(monitored_cgroups, &new_candidates);
+        /* This also carries over the data of the previous interval, see oomd_insert_cgroup_context(). */
+        r = get_monitored_cgroup_contexts_candidates(monitored_cgroups, *candidates, &new_candidates);
         if (r < 0)
                 return log_debug_errno(r, "Failed to get candidate contexts: %m");
 
-        oomd_update_cgroup_contexts_between_hashmaps(*candidates, new_candidates);
-
         hashmap_free(*candidates);
         *candidates = TAKE_PTR(new_candidates);
 
@@ -397,7 +432,7 @@ static int monitor_swap_contexts_handler(sd_event_source *s, uint64_t usec, void
                           m->system_context.swap_used, m->system_context.swap_total,
                           PERMYRIAD_AS_PERCENT_FORMAT_VAL(m->swap_used_limit_permyriad));
 
-                r = get_monitored_cgroup_contexts_candidates(m->monitored_swap_cgroup_contexts, &candidates);
+                r = get_monitored_cgroup_contexts_candidates(m->monitored_swap_cgroup_contexts, NULL, &candidates);
                 if (r == -ENOMEM)
                         return log_oom();
                 if (r < 0)
@@ -430,6 +465,101 @@ static void clear_candidate_hashmapp(Manager **m) {
                 hashmap_clear((*m)->monitored_mem_pressure_cgroup_contexts_candidates);
 }
 
+static int monitor_memory_pressure_trigger_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        Manager *m = ASSERT_PTR(userdata);
+        int r;
+
+        /* EPOLLERR is reported when the cgroup was removed. Resume polling in either case, which also
+         * updates the monitored cgroups. */
+        if (FLAGS_SET(revents, EPOLLPRI))
+                log_debug("Memory pressure trigger fired, resuming polling.");
+
+        r = monitor_memory_pressure_wakeup(m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to resume memory pressure monitoring: %m");
+
+        return 0;
+}
+
+static int monitor_memory_pressure_sleep(Manager *m) {
+        _cleanup_set_free_ Set *triggers = NULL;
+        OomdCGroupContext *ctx;
+        int r;
+
+        assert(m);
+
+        HASHMAP_FOREACH(ctx, m->monitored_mem_pressure_cgroup_contexts) {
+                _cleanup_(sd_event_source_disable_unrefp) sd_event_source *s = NULL;
+                _cleanup_close_ int fd = -1;
+
+                fd = oomd_cgroup_pressure_trigger_open(ctx->path, ctx->mem_pressure_limit, MEM_PRESSURE_TRIGGER_WINDOW_USEC);
+                if (fd < 0)
+                        return fd;
+
+                r = sd_event_add_io(m->event, &s, fd, EPOLLPRI, monitor_memory_pressure_trigger_handler, m);
+                if (r < 0)
+                        return r;
+
+                r = sd_event_source_set_io_fd_own(s, true);
+                if (r < 0)
+                        return r;
+
+                TAKE_FD(fd);
+
+                r = sd_event_source_set_exit_on_failure(s, true);
+                if (r < 0)
+                        return r;
+
+                (void) sd_event_source_set_description(s, "oomd-memory-pressure-trigger");
+
+                r = set_ensure_consume(&triggers, &event_source_hash_ops, TAKE_PTR(s));
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_event_source_set_enabled(m->mem_pressure_context_event_source, SD_EVENT_OFF);
+        if (r < 0)
+                return r;
+
+        set_free(m->mem_pressure_triggers);
+        m->mem_pressure_triggers = TAKE_PTR(triggers);
+        return 0;
+}
+
+static int monitor_memory_pressure_maybe_sleep(Manager *m) {
+        OomdCGroupContext *ctx;
+        int r;
+
+        assert(m);
+
+        /* Reading memory.pressure and memory.stat of all monitored cgroups every interval is wasteful while
+         * there is no pressure at all. Hence, once no monitored cgroup is close to its limit, stop polling
+         * and let PSI triggers wake us up again when pressure builds up. If triggers are not supported,
+         * e.g. because the kernel refuses unprivileged triggers, keep polling. */
+
+        if (m->mem_pressure_triggers_unsupported)
+                return 0;
+
+        HASHMAP_FOREACH(ctx, m->monitored_mem_pressure_cgroup_contexts)
+                if (ctx->mem_pressure_limit_hit_start > 0 ||
+                    ctx->memory_pressure.avg10 > ctx->mem_pressure_limit / 2)
+                        return 0;
+
+        r = monitor_memory_pressure_sleep(m);
+        if (r == -ENOMEM)
+                return log_oom();
+        if (r == -ENOENT) /* The cgroup is gone, try again in the next interval. */
+                return 0;
+        if (r < 0) {
+                log_debug_errno(r, "Failed to set up memory pressure triggers, polling memory pressure instead: %m");
+                m->mem_pressure_triggers_unsupported = true;
+                return 0;
+        }
+
+        log_debug("No memory pressure on monitored cgroups, waiting for memory pressure triggers.");
+        return 0;
+}
+
 static int monitor_memory_pressure_contexts_handler(sd_event_source *s, uint64_t usec, void *userdata) {
         /* Don't want to use stale candidate data. Setting this will clear the candidate hashmap on return unless we
          * update the candidate data (in which case clear_candidates will be NULL). */
@@ -461,7 +591,7 @@ static int monitor_memory_pressure_contexts_handler(sd_event_source *s, uint64_t
 
         /* Return early if nothing is requesting memory pressure monitoring */
         if (hashmap_isempty(m->monitored_mem_pressure_cgroup_contexts))
-                return 0;
+                return monitor_memory_pressure_maybe_sleep(m);
 
         /* Update the cgroups used for detection/action */
         r = update_monitored_cgroup_contexts(&m->monitored_mem_pressure_cgroup_contexts);
@@ -479,7 +609,10 @@ static int monitor_memory_pressure_contexts_handler(sd_event_source *s, uint64_t
                         m->mem_pressure_post_action_delay_start = 0;
         }
 
-        r = oomd_pressure_above(m->monitored_mem_pressure_cgroup_contexts, m->default_mem_pressure_duration_usec, &targets);
+        r = oomd_pressure_above(m->monitored_mem_pressure_cgroup_contexts,
+                                m->default_mem_pressure_duration_usec,
+                                m->default_mem_pressure_projection_usec,
+                                &targets);
         if (r == -ENOMEM)
                 return log_oom();
         if (r < 0)
@@ -488,6 +621,7 @@ static int monitor_memory_pressure_contexts_handler(sd_event_source *s, uint64_t
                 OomdCGroupContext *t;
                 SET_FOREACH(t, targets) {
                         _cleanup_free_ char *selected = NULL;
+                        bool projected;
 
                         /* Check if there was reclaim activity in the given interval. The concern is the following case:
                          * Pressure climbed, a lot of high-frequency pages were reclaimed, and we killed the offending
@@ -497,9 +631,14 @@ static int monitor_memory_pressure_contexts_handler(sd_event_source *s, uint64_t
                         if ((now(CLOCK_MONOTONIC) - t->last_had_mem_reclaim) > RECLAIM_DURATION_USEC)
                                 continue;
 
-                        log_debug("Memory pressure for %s is %lu.%02lu%% > %lu.%02lu%% for > %s with reclaim activity",
+                        /* The pressure might not have exceeded the limit yet, but be projected to, see
+                         * DefaultMemoryPressureProjectionSec=. */
+                        projected = t->memory_pressure.avg10 <= t->mem_pressure_limit;
+
+                        log_debug("Memory pressure for %s is %lu.%02lu%% %s %lu.%02lu%% for > %s with reclaim activity",
                                   t->path,
                                   LOADAVG_INT_SIDE(t->memory_pressure.avg10), LOADAVG_DECIMAL_SIDE(t->memory_pressure.avg10),
+                                  projected ? "and projected to exceed" : ">",
                                   LOADAVG_INT_SIDE(t->mem_pressure_limit), LOADAVG_DECIMAL_SIDE(t->mem_pressure_limit),
                                   FORMAT_TIMESPAN(m->default_mem_pressure_duration_usec, USEC_PER_SEC));
 
@@ -525,10 +664,11 @@ static int monitor_memory_pressure_contexts_handler(sd_event_source *s, uint64_t
                                  * pressure is still high. */
                                 m->mem_pressure_post_action_delay_start = usec_now;
                                 if (selected && r > 0)
-                                        log_notice("Killed %s due to memory pressure for %s being %lu.%02lu%% > %lu.%02lu%%"
+                                        log_notice("Killed %s due to memory pressure for %s being %lu.%02lu%% %s %lu.%02lu%%"
                                                    " for > %s with reclaim activity",
                                                    selected, t->path,
                                                    LOADAVG_INT_SIDE(t->memory_pressure.avg10), LOADAVG_DECIMAL_SIDE(t->memory_pressure.avg10),
+                                                   projected ? "and projected to exceed" : ">",
                                                    LOADAVG_INT_SIDE(t->mem_pressure_limit), LOADAVG_DECIMAL_SIDE(t->mem_pressure_limit),
                                                    FORMAT_TIMESPAN(m->default_mem_pressure_duration_usec, USEC_PER_SEC));
                                 return 0;
@@ -558,7 +698,10 @@ static int monitor_memory_pressure_contexts_handler(sd_event_source *s, uint64_t
                 }
         }
 
-        return 0;
+        if (in_post_action_delay)
+                return 0;
+
+        return monitor_memory_pressure_maybe_sleep(m);
 }
 
 static int monitor_swap_contexts(Manager *m) {
@@ -611,6 +754,82 @@ static int monitor_memory_pressure_contexts(Manager *m) {
         return 0;
 }
 
+static int reclaim_contexts_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        _cleanup_hashmap_free_ Hashmap *new_h = NULL;
+        Manager *m = ASSERT_PTR(userdata);
+        OomdCGroupContext *ctx;
+        int r;
+
+        assert(s);
+
+        r = sd_event_source_set_time_relative(s, PROACTIVE_RECLAIM_INTERVAL_USEC);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to set relative time for timer: %m");
+
+        new_h = hashmap_new(&oomd_cgroup_ctx_hash_ops);
+        if (!new_h)
+                return log_oom();
+
+        STRV_FOREACH(p, m->reclaim_cgroups) {
+                /* The slice might not exist (yet), skip it until it does. */
+                r = oomd_insert_cgroup_context(m->reclaim_cgroup_contexts, new_h, *p);
+                if (r == -ENOMEM)
+                        return log_oom();
+                if (r < 0 && r != -ENOENT)
+                        log_debug_errno(r, "Failed to insert context for %s, ignoring: %m", *p);
+        }
+
+        hashmap_free(m->reclaim_cgroup_contexts);
+        m->reclaim_cgroup_contexts = TAKE_PTR(new_h);
+
+        HASHMAP_FOREACH(ctx, m->reclaim_cgroup_contexts) {
+                uint64_t step;
+
+                step = oomd_reclaim_step(ctx, m->reclaim_mem_pressure_target);
+                if (step == 0)
+                        continue;
+
+                r = oomd_cgroup_reclaim(ctx->path, step, m->dry_run);
+                if (r == -ENOENT) {
+                        log_notice("Kernel does not support memory.reclaim, disabling proactive reclaim.");
+                        return sd_event_source_set_enabled(s, SD_EVENT_OFF);
+                }
+                if (r < 0)
+                        log_debug_errno(r, "Failed to reclaim memory from %s, ignoring: %m", ctx->path);
+                else if (r > 0) {
+                        ctx->reclaimed += step;
+                        log_debug("Proactively reclaimed %s from %s", FORMAT_BYTES(step), ctx->path);
+                }
+        }
+
+        return 0;
+}
+
+static int reclaim_contexts(Manager *m) {
+        _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+        int r;
+
+        assert(m);
+        assert(m->event);
+
+        r = sd_event_add_time(m->event, &s, CLOCK_MONOTONIC, 0, 0, reclaim_contexts_handler, m);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_exit_on_failure(s, true);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_enabled(s, SD_EVENT_ON);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(s, "oomd-reclaim-timer");
+
+        m->reclaim_context_event_source = TAKE_PTR(s);
+        return 0;
+}
+
 Manager* manager_free(Manager *m) {
         assert(m);
 
@@ -618,6 +837,8 @@ Manager* manager_free(Manager *m) {
         varlink_close_unref(m->varlink_client);
         sd_event_source_unref(m->swap_context_event_source);
         sd_event_source_unref(m->mem_pressure_context_event_source);
+        sd_event_source_unref(m->reclaim_context_event_source);
+        set_free(m->mem_pressure_triggers);
         sd_event_unref(m->event);
 
         bus_verify_polkit_async_registry_free(m->polkit_registry);
@@ -626,6 +847,8 @@ Manager* manager_free(Manager *m) {
         hashmap_free(m->monitored_swap_cgroup_contexts);
         hashmap_free(m->monitored_mem_pressure_cgroup_contexts);
         hashmap_free(m->monitored_mem_pressure_cgroup_contexts_candidates);
+        hashmap_free(m->reclaim_cgroup_contexts);
+        strv_free(m->reclaim_cgroups);
 
         return mfree(m);
 }
@@ -739,6 +962,9 @@ int manager_start(
                 int swap_used_limit_permyriad,
                 int mem_pressure_limit_permyriad,
                 usec_t mem_pressure_usec,
+                usec_t mem_pressure_projection_usec,
+                char **reclaim_slices,
+                int reclaim_mem_pressure_target_permyriad,
                 int fd) {
 
         unsigned long l, f;
@@ -765,6 +991,34 @@ int manager_start(
                 return r;
 
         m->default_mem_pressure_duration_usec = mem_pressure_usec ?: DEFAULT_MEM_PRESSURE_DURATION_USEC;
+        m->default_mem_pressure_projection_usec = mem_pressure_projection_usec;
+
+        if (reclaim_mem_pressure_target_permyriad < 0)
+                reclaim_mem_pressure_target_permyriad = DEFAULT_PROACTIVE_RECLAIM_MEM_PRESSURE_TARGET_PERMYRIAD;
+        assert(reclaim_mem_pressure_target_permyriad <= 10000);
+        r = store_loadavg_fixed_point(reclaim_mem_pressure_target_permyriad / 100,
+                                      reclaim_mem_pressure_target_permyriad % 100,
+                                      &m->reclaim_mem_pressure_target);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(s, reclaim_slices) {
+                _cleanup_free_ char *p = NULL, *cg = NULL;
+
+                r = cg_slice_to_path(*s, &p);
+                if (r < 0) {
+                        log_warning_errno(r, "Invalid slice name '%s' in ProactiveReclaimSlices=, ignoring: %m", *s);
+                        continue;
+                }
+
+                cg = strjoin("/", p);
+                if (!cg)
+                        return -ENOMEM;
+
+                r = strv_consume(&m->reclaim_cgroups, TAKE_PTR(cg));
+                if (r < 0)
+                        return r;
+        }
 
         r = manager_connect_bus(m);
         if (r < 0)
@@ -786,6 +1040,12 @@ int manager_start(
         if (r < 0)
                 return r;
 
+        if (!strv_isempty(m->reclaim_cgroups)) {
+                r = reclaim_contexts(m);
+                if (r < 0)
+                        return r;
+        }
+
         return 0;
 }
 
@@ -809,11 +1069,13 @@ int manager_get_dump_string(Manager *m, char **ret) {
                 "Swap Used Limit: " PERMYRIAD_AS_PERCENT_FORMAT_STR "\n"
                 "Default Memory Pressure Limit: %lu.%02lu%%\n"
                 "Default Memory Pressure Duration: %s\n"
+                "Default Memory Pressure Projection: %s\n"
                 "System Context:\n",
                 yes_no(m->dry_run),
                 PERMYRIAD_AS_PERCENT_FORMAT_VAL(m->swap_used_limit_permyriad),
                 LOADAVG_INT_SIDE(m->default_mem_pressure_limit), LOADAVG_DECIMAL_SIDE(m->default_mem_pressure_limit),
-                FORMAT_TIMESPAN(m->default_mem_pressure_duration_usec, USEC_PER_SEC));
+                FORMAT_TIMESPAN(m->default_mem_pressure_duration_usec, USEC_PER_SEC),
+                FORMAT_TIMESPAN(m->default_mem_pressure_projection_usec, USEC_PER_SEC));
         oomd_dump_system_context(&m->system_context, f, "\t");
 
         fprintf(f, "Swap Monitored CGroups:\n");
@@ -824,6 +1086,15 @@ int manager_get_dump_string(Manager *m, char **ret) {
         HASHMAP_FOREACH_KEY(c, key, m->monitored_mem_pressure_cgroup_contexts)
                 oomd_dump_memory_pressure_cgroup_context(c, f, "\t");
 
+        if (!strv_isempty(m->reclaim_cgroups)) {
+                fprintf(f,
+                        "Proactive Reclaim Memory Pressure Target: %lu.%02lu%%\n"
+                        "Proactive Reclaim CGroups:\n",
+                        LOADAVG_INT_SIDE(m->reclaim_mem_pressure_target), LOADAVG_DECIMAL_SIDE(m->reclaim_mem_pressure_target));
+                HASHMAP_FOREACH_KEY(c, key, m->reclaim_cgroup_contexts)
+                        oomd_dump_reclaim_cgroup_context(c, f, "\t");
+        }
+
         r = fflush_and_check(f);
         if (r < 0)
                 return r;
@@ -12,6 +12,9 @@
 #define SWAP_INTERVAL_USEC 150000 /* 0.15 seconds */
 /* Pressure counters are lagging (~2 seconds) compared to swap so polling too frequently just wastes CPU */
 #define MEM_PRESSURE_INTERVAL_USEC (1 * USEC_PER_SEC)
+/* While no monitored cgroup is under memory pressure, polling is stopped and PSI triggers with this window
+ * are used to wake up. Unprivileged triggers must use a multiple of 2s. */
+#define MEM_PRESSURE_TRIGGER_WINDOW_USEC (2 * USEC_PER_SEC)
 
 /* Take action if 10s of memory pressure > 60 for more than 30s. We use the "full" value from PSI so this is the
  * percentage of time all tasks were delayed (i.e. unproductive).
@@ -27,6 +30,11 @@
 #define RECLAIM_DURATION_USEC (30 * USEC_PER_SEC)
 #define POST_ACTION_DELAY_USEC (15 * USEC_PER_SEC)
 
+/* Proactive reclaim is done in small steps, leaving enough time in between for the "full" avg10 memory
+ * pressure to reflect the previous step. By default, reclaim as long as it stays below 1%. */
+#define PROACTIVE_RECLAIM_INTERVAL_USEC (5 * USEC_PER_SEC)
+#define DEFAULT_PROACTIVE_RECLAIM_MEM_PRESSURE_TARGET_PERMYRIAD 100
+
 typedef struct Manager Manager;
 
 struct Manager {
@@ -39,6 +47,7 @@ struct Manager {
         int swap_used_limit_permyriad;
         loadavg_t default_mem_pressure_limit;
         usec_t default_mem_pressure_duration_usec;
+        usec_t default_mem_pressure_projection_usec;
 
         /* k: cgroup paths -> v: OomdCGroupContext
          * Used to detect when to take action. */
@@ -46,12 +55,21 @@ struct Manager {
         Hashmap *monitored_mem_pressure_cgroup_contexts;
         Hashmap *monitored_mem_pressure_cgroup_contexts_candidates;
 
+        /* Cgroup paths of the slices listed in ProactiveReclaimSlices=, and their contexts. */
+        char **reclaim_cgroups;
+        loadavg_t reclaim_mem_pressure_target;
+        Hashmap *reclaim_cgroup_contexts;
+
         OomdSystemContext system_context;
 
         usec_t mem_pressure_post_action_delay_start;
 
         sd_event_source *swap_context_event_source;
         sd_event_source *mem_pressure_context_event_source;
+        sd_event_source *reclaim_context_event_source;
+        /* PSI triggers on the monitored cgroups, set up while the timer above is disabled. */
+        Set *mem_pressure_triggers;
+        bool mem_pressure_triggers_unsupported;
 
         /* This varlink object is used to manage the subscription from systemd-oomd to PID1 which it uses to
          * listen for changes in ManagedOOM settings (oomd client - systemd server). */
@@ -66,7 +84,16 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(Manager*, manager_free);
 
 int manager_new(Manager **ret);
 
-int manager_start(Manager *m, bool dry_run, int swap_used_limit_permyriad, int mem_pressure_limit_permyriad, usec_t mem_pressure_usec, int fd);
+int manager_start(
+                Manager *m,
+                bool dry_run,
+                int swap_used_limit_permyriad,
+                int mem_pressure_limit_permyriad,
+                usec_t mem_pressure_usec,
+                usec_t mem_pressure_projection_usec,
+                char **reclaim_slices,
+                int reclaim_mem_pressure_target_permyriad,
+                int fd);
 
 int manager_get_dump_string(Manager *m, char **ret);
 
@@ -1,11 +1,13 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <fcntl.h>
 #include <sys/xattr.h>
 #include <unistd.h>
 
 #include "fd-util.h"
 #include "fileio.h"
 #include "format-util.h"
+#include "memory-util.h"
 #include "oomd-util.h"
 #include "parse-util.h"
 #include "path-util.h"
@@ -14,6 +16,7 @@
 #include "sort-util.h"
 #include "stat-util.h"
 #include "stdio-util.h"
+#include "xattr-util.h"
 
 DEFINE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
                 oomd_cgroup_ctx_hash_ops,
@@ -58,15 +61,7 @@ static int increment_oomd_xattr(const char *path, const char *xattr, uint64_t nu
         return 0;
 }
 
-OomdCGroupContext *oomd_cgroup_context_free(OomdCGroupContext *ctx) {
-        if (!ctx)
-                return NULL;
-
-        free(ctx->path);
-        return mfree(ctx);
-}
-
-int oomd_pressure_above(Hashmap *h, usec_t duration, Set **ret) {
+int oomd_pressure_above(Hashmap *h, usec_t duration, usec_t projection, Set **ret) {
         _cleanup_set_free_ Set *targets = NULL;
         OomdCGroupContext *ctx;
         char *key;
@@ -80,7 +75,8 @@ int oomd_pressure_above(Hashmap *h, usec_t duration, Set **ret) {
                 return -ENOMEM;
 
         HASHMAP_FOREACH_KEY(ctx, key, h) {
-                if (ctx->memory_pressure.avg10 > ctx->mem_pressure_limit) {
+                if (ctx->memory_pressure.avg10 > ctx->mem_pressure_limit ||
+                    (projection > 0 && oomd_pressure_projected_crossing(ctx) <= projection)) {
                         usec_t diff;
 
                         if (ctx->mem_pressure_limit_hit_start == 0)
@@ -105,6 +101,91 @@ int oomd_pressure_above(Hashmap *h, usec_t duration, Set **ret) {
         return 0;
 }
 
+static const OomdCGroupSample* cgroup_context_sample(const OomdCGroupContext *ctx, size_t i) {
+        assert(ctx);
+        assert(i < ctx->n_history);
+
+        /* Returns the i-th most recent sample. */
+        return ctx->history + (ctx->history_next + OOMD_CGROUP_HISTORY_SIZE - 1 - i) % OOMD_CGROUP_HISTORY_SIZE;
+}
+
+void oomd_cgroup_context_record_sample(OomdCGroupContext *ctx, usec_t timestamp) {
+        assert(ctx);
+
+        ctx->history[ctx->history_next] = (OomdCGroupSample) {
+                .timestamp = timestamp,
+                .memory_pressure = ctx->memory_pressure.avg10,
+                .current_memory_usage = ctx->current_memory_usage,
+                .pgscan = ctx->pgscan,
+        };
+
+        ctx->history_next = (ctx->history_next + 1) % OOMD_CGROUP_HISTORY_SIZE;
+        ctx->n_history = MIN(ctx->n_history + 1, (size_t) OOMD_CGROUP_HISTORY_SIZE);
+}
+
+int oomd_cgroup_context_get_trend(const OomdCGroupContext *ctx, OomdCGroupTrend *ret) {
+        const OomdCGroupSample *newest, *oldest = NULL;
+        usec_t window;
+
+        assert(ctx);
+        assert(ret);
+
+        if (ctx->n_history < 2)
+                return -ENODATA;
+
+        /* Samples might be missing or old, e.g. when polling was stopped while there was no memory
+         * pressure, hence only look at the samples which were taken recently. */
+        newest = cgroup_context_sample(ctx, 0);
+        for (size_t i = 1; i < ctx->n_history; i++) {
+                const OomdCGroupSample *s = cgroup_context_sample(ctx, i);
+
+                if (s->timestamp >= newest->timestamp ||
+                    newest->timestamp - s->timestamp > OOMD_CGROUP_TREND_WINDOW_USEC)
+                        break;
+
+                oldest = s;
+        }
+        if (!oldest)
+                return -ENODATA;
+
+        window = newest->timestamp - oldest->timestamp;
+
+        *ret = (OomdCGroupTrend) {
+                .window_usec = window,
+                .memory_pressure_rate =
+                        ((int64_t) newest->memory_pressure - (int64_t) oldest->memory_pressure) * (int64_t) USEC_PER_SEC / (int64_t) window,
+                /* Scale in milliseconds, so that large amounts of memory do not overflow. */
+                .memory_usage_rate =
+                        ((int64_t) newest->current_memory_usage - (int64_t) oldest->current_memory_usage) *
+                        (int64_t) MSEC_PER_SEC / (int64_t) DIV_ROUND_UP(window, USEC_PER_MSEC),
+                /* pgscan is monotonic, unless the cgroup was recreated. */
+                .pgscan_rate = newest->pgscan >= oldest->pgscan ?
+                        (newest->pgscan - oldest->pgscan) * USEC_PER_SEC / window : 0,
+        };
+
+        return 0;
+}
+
+usec_t oomd_pressure_projected_crossing(const OomdCGroupContext *ctx) {
+        OomdCGroupTrend trend;
+
+        assert(ctx);
+
+        if (ctx->memory_pressure.avg10 > ctx->mem_pressure_limit)
+                return 0;
+
+        if (oomd_cgroup_context_get_trend(ctx, &trend) < 0)
+                return USEC_INFINITY;
+
+        /* Rising pressure without any reclaim activity will not be relieved by killing anything, see the
+         * check of last_had_mem_reclaim in the manager. */
+        if (trend.memory_pressure_rate <= 0 || trend.pgscan_rate == 0)
+                return USEC_INFINITY;
+
+        return (usec_t) (ctx->mem_pressure_limit - ctx->memory_pressure.avg10) * USEC_PER_SEC /
+                (usec_t) trend.memory_pressure_rate;
+}
+
 uint64_t oomd_pgscan_rate(const OomdCGroupContext *c) {
         uint64_t last_pgscan;
 
@@ -171,6 +252,24 @@ int oomd_sort_cgroup_contexts(Hashmap *h, oomd_compare_t compare_func, const cha
         return (int) k;
 }
 
+uint64_t oomd_reclaim_step(const OomdCGroupContext *ctx, loadavg_t target) {
+        loadavg_t pressure;
+        uint64_t step;
+
+        assert(ctx);
+
+        pressure = ctx->memory_pressure.avg10;
+        if (target == 0 || pressure >= target)
+                return 0;
+
+        /* Reclaim more the further the pressure is below the target, so that it settles near it rather than
+         * oscillating around it. */
+        step = ctx->current_memory_usage / 10000 * OOMD_RECLAIM_STEP_MAX_PERMYRIAD;
+        step = step / target * (target - pressure);
+
+        return step / page_size() * page_size();
+}
+
 int oomd_cgroup_kill(const char *path, bool recurse, bool dry_run) {
         _cleanup_set_free_ Set *pids_killed = NULL;
         int r;
@@ -220,6 +319,28 @@ int oomd_cgroup_kill(const char *path, bool recurse, bool dry_run) {
         return set_size(pids_killed) != 0;
 }
 
+int oomd_cgroup_reclaim(const char *path, uint64_t bytes, bool dry_run) {
+        char buf[DECIMAL_STR_MAX(uint64_t)];
+        int r;
+
+        assert(path);
+
+        if (dry_run) {
+                log_debug("oomd dry-run: Would have tried to reclaim %s from %s", FORMAT_BYTES(bytes), path);
+                return 0;
+        }
+
+        xsprintf(buf, "%" PRIu64, bytes);
+
+        r = cg_set_attribute("memory", path, "memory.reclaim", buf);
+        if (r == -EAGAIN) /* Reclaimed less than requested. */
+                return 0;
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
 typedef void (*dump_candidate_func)(const OomdCGroupContext *ctx, FILE *f, const char *prefix);
 
 static int dump_kill_candidates(OomdCGroupContext **sorted, int n, int dump_until, dump_candidate_func dump_func) {
@@ -330,82 +451,245 @@ int oomd_kill_by_swap_usage(Hashmap *h, uint64_t threshold_usage, bool dry_run,
         return ret;
 }
 
-int oomd_cgroup_context_acquire(const char *path, OomdCGroupContext **ret) {
-        _cleanup_(oomd_cgroup_context_freep) OomdCGroupContext *ctx = NULL;
-        _cleanup_free_ char *p = NULL, *val = NULL;
-        bool is_root;
-        uid_t uid;
+static const char* const oomd_cgroup_file_table[_OOMD_CGROUP_FILE_MAX] = {
+        [OOMD_CGROUP_FILE_MEMORY_PRESSURE]     = "memory.pressure",
+        [OOMD_CGROUP_FILE_MEMORY_CURRENT]      = "memory.current",
+        [OOMD_CGROUP_FILE_MEMORY_MIN]          = "memory.min",
+        [OOMD_CGROUP_FILE_MEMORY_LOW]          = "memory.low",
+        [OOMD_CGROUP_FILE_MEMORY_SWAP_CURRENT] = "memory.swap.current",
+        [OOMD_CGROUP_FILE_MEMORY_STAT]         = "memory.stat",
+};
+
+static void cgroup_context_close_fds(OomdCGroupContext *ctx) {
+        assert(ctx);
+
+        ctx->dir_fd = safe_close(ctx->dir_fd);
+        for (OomdCGroupFile f = 0; f < _OOMD_CGROUP_FILE_MAX; f++)
+                ctx->fds[f] = safe_close(ctx->fds[f]);
+}
+
+OomdCGroupContext *oomd_cgroup_context_free(OomdCGroupContext *ctx) {
+        if (!ctx)
+                return NULL;
+
+        cgroup_context_close_fds(ctx);
+        free(ctx->path);
+        return mfree(ctx);
+}
+
+static int cgroup_context_open(OomdCGroupContext *ctx, OomdCGroupFile f) {
+        assert(ctx);
+        assert(ctx->dir_fd >= 0);
+        assert(f >= 0 && f < _OOMD_CGROUP_FILE_MAX);
+
+        if (ctx->fds[f] >= 0)
+                return ctx->fds[f];
+
+        ctx->fds[f] = openat(ctx->dir_fd, oomd_cgroup_file_table[f], O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (ctx->fds[f] < 0)
+                return -errno;
+
+        return ctx->fds[f];
+}
+
+static int cgroup_context_read(OomdCGroupContext *ctx, OomdCGroupFile f, char **ret) {
+        int fd, r;
+
+        assert(ret);
+
+        fd = cgroup_context_open(ctx, f);
+        if (fd < 0)
+                return fd;
+
+        if (lseek(fd, 0, SEEK_SET) < 0)
+                return -errno;
+
+        r = read_virtual_file_fd(fd, SIZE_MAX, ret, NULL);
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
+static int cgroup_context_read_uint64(OomdCGroupContext *ctx, OomdCGroupFile f, uint64_t *ret) {
+        _cleanup_free_ char *val = NULL;
         int r;
 
-        assert(path);
         assert(ret);
 
-        ctx = new0(OomdCGroupContext, 1);
-        if (!ctx)
-                return -ENOMEM;
+        r = cgroup_context_read(ctx, f, &val);
+        if (r == -ENOENT)
+                return -ENODATA;
+        if (r < 0)
+                return r;
 
-        is_root = empty_or_root(path);
-        ctx->preference = MANAGED_OOM_PREFERENCE_NONE;
+        delete_trailing_chars(val, NEWLINE);
 
-        r = cg_get_path(SYSTEMD_CGROUP_CONTROLLER, path, "memory.pressure", &p);
+        if (streq(val, "max")) {
+                *ret = CGROUP_LIMIT_MAX;
+                return 0;
+        }
+
+        return safe_atou64(val, ret);
+}
+
+static int cgroup_context_read_pgscan(OomdCGroupContext *ctx, uint64_t *ret) {
+        _cleanup_free_ char *contents = NULL;
+        int r;
+
+        assert(ret);
+
+        r = cgroup_context_read(ctx, OOMD_CGROUP_FILE_MEMORY_STAT, &contents);
         if (r < 0)
-                return log_debug_errno(r, "Error getting cgroup memory pressure path from %s: %m", path);
+                return r;
+
+        for (const char *p = contents; *p; p += strspn(p, NEWLINE)) {
+                _cleanup_free_ char *val = NULL;
+                const char *w;
+
+                w = first_word(p, "pgscan");
+                if (!w) {
+                        p += strcspn(p, NEWLINE);
+                        continue;
+                }
+
+                val = strndup(w, strcspn(w, NEWLINE));
+                if (!val)
+                        return -ENOMEM;
+
+                return safe_atou64(val, ret);
+        }
+
+        return -ENXIO;
+}
 
-        r = read_resource_pressure(p, PRESSURE_TYPE_FULL, &ctx->memory_pressure);
+static int cgroup_context_read_xattr_bool(OomdCGroupContext *ctx, const char *name) {
+        _cleanup_free_ char *val = NULL;
+        int r;
+
+        assert(ctx);
+        assert(name);
+
+        r = fgetxattr_malloc(ctx->dir_fd, name, &val);
         if (r < 0)
-                return log_debug_errno(r, "Error parsing memory pressure from %s: %m", p);
+                return r;
+
+        return parse_boolean(val);
+}
+
+static int cgroup_context_read_state(OomdCGroupContext *ctx, const char *path) {
+        struct stat st;
+        int fd, r;
 
-        r = cg_get_owner(SYSTEMD_CGROUP_CONTROLLER, path, &uid);
+        assert(ctx);
+        assert(path);
+
+        if (ctx->dir_fd < 0) {
+                _cleanup_free_ char *p = NULL;
+
+                r = cg_get_path(SYSTEMD_CGROUP_CONTROLLER, path, NULL, &p);
+                if (r < 0)
+                        return log_debug_errno(r, "Error getting cgroup path from %s: %m", path);
+
+                ctx->dir_fd = open(p, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+                if (ctx->dir_fd < 0)
+                        return log_debug_errno(errno, "Failed to open cgroup %s: %m", p);
+        }
+
+        fd = cgroup_context_open(ctx, OOMD_CGROUP_FILE_MEMORY_PRESSURE);
+        if (fd < 0)
+                return log_debug_errno(fd, "Error opening memory pressure of %s: %m", path);
+
+        r = read_resource_pressure_fd(fd, PRESSURE_TYPE_FULL, &ctx->memory_pressure);
         if (r < 0)
-                log_debug_errno(r, "Failed to get owner/group from %s: %m", path);
-        else if (uid == 0) {
+                return log_debug_errno(r, "Error parsing memory pressure of %s: %m", path);
+
+        if (fstat(ctx->dir_fd, &st) < 0)
+                log_debug_errno(errno, "Failed to get owner/group from %s: %m", path);
+        else if (st.st_uid == 0) {
                 /* Ignore most errors when reading the xattr since it is usually unset and cgroup xattrs are only used
                  * as an optional feature of systemd-oomd (and the system might not even support them). */
-                r = cg_get_xattr_bool(SYSTEMD_CGROUP_CONTROLLER, path, "user.oomd_avoid");
+                r = cgroup_context_read_xattr_bool(ctx, "user.oomd_avoid");
                 if (r == -ENOMEM)
                         return r;
                 ctx->preference = r == 1 ? MANAGED_OOM_PREFERENCE_AVOID : ctx->preference;
 
-                r = cg_get_xattr_bool(SYSTEMD_CGROUP_CONTROLLER, path, "user.oomd_omit");
+                r = cgroup_context_read_xattr_bool(ctx, "user.oomd_omit");
                 if (r == -ENOMEM)
                         return r;
                 ctx->preference = r == 1 ? MANAGED_OOM_PREFERENCE_OMIT : ctx->preference;
         }
 
-        if (is_root) {
+        if (empty_or_root(path)) {
                 r = procfs_memory_get_used(&ctx->current_memory_usage);
                 if (r < 0)
                         return log_debug_errno(r, "Error getting memory used from procfs: %m");
-        } else {
-                r = cg_get_attribute_as_uint64(SYSTEMD_CGROUP_CONTROLLER, path, "memory.current", &ctx->current_memory_usage);
-                if (r < 0)
-                        return log_debug_errno(r, "Error getting memory.current from %s: %m", path);
 
-                r = cg_get_attribute_as_uint64(SYSTEMD_CGROUP_CONTROLLER, path, "memory.min", &ctx->memory_min);
-                if (r < 0)
-                        return log_debug_errno(r, "Error getting memory.min from %s: %m", path);
+                return 0;
+        }
 
-                r = cg_get_attribute_as_uint64(SYSTEMD_CGROUP_CONTROLLER, path, "memory.low", &ctx->memory_low);
-                if (r < 0)
-                        return log_debug_errno(r, "Error getting memory.low from %s: %m", path);
+        r = cgroup_context_read_uint64(ctx, OOMD_CGROUP_FILE_MEMORY_CURRENT, &ctx->current_memory_usage);
+        if (r < 0)
+                return log_debug_errno(r, "Error getting memory.current from %s: %m", path);
 
-                r = cg_get_attribute_as_uint64(SYSTEMD_CGROUP_CONTROLLER, path, "memory.swap.current", &ctx->swap_usage);
-                if (r == -ENODATA)
-                        /* The kernel can be compiled without support for memory.swap.* files,
-                         * or it can be disabled with boot param 'swapaccount=0' */
-                        log_once(LOG_WARNING, "No kernel support for memory.swap.current from %s (try boot param swapaccount=1), ignoring.", path);
-                else if (r < 0)
-                        return log_debug_errno(r, "Error getting memory.swap.current from %s: %m", path);
+        r = cgroup_context_read_uint64(ctx, OOMD_CGROUP_FILE_MEMORY_MIN, &ctx->memory_min);
+        if (r < 0)
+                return log_debug_errno(r, "Error getting memory.min from %s: %m", path);
 
-                r = cg_get_keyed_attribute(SYSTEMD_CGROUP_CONTROLLER, path, "memory.stat", STRV_MAKE("pgscan"), &val);
-                if (r < 0)
-                        return log_debug_errno(r, "Error getting pgscan from memory.stat under %s: %m", path);
+        r = cgroup_context_read_uint64(ctx, OOMD_CGROUP_FILE_MEMORY_LOW, &ctx->memory_low);
+        if (r < 0)
+                return log_debug_errno(r, "Error getting memory.low from %s: %m", path);
 
-                r = safe_atou64(val, &ctx->pgscan);
-                if (r < 0)
-                        return log_debug_errno(r, "Error converting pgscan value to uint64_t: %m");
+        r = cgroup_context_read_uint64(ctx, OOMD_CGROUP_FILE_MEMORY_SWAP_CURRENT, &ctx->swap_usage);
+        if (r == -ENODATA)
+                /* The kernel can be compiled without support for memory.swap.* files,
+                 * or it can be disabled with boot param 'swapaccount=0' */
+                log_once(LOG_WARNING, "No kernel support for memory.swap.current from %s (try boot param swapaccount=1), ignoring.", path);
+        else if (r < 0)
+                return log_debug_errno(r, "Error getting memory.swap.current from %s: %m", path);
+
+        r = cgroup_context_read_pgscan(ctx, &ctx->pgscan);
+        if (r < 0)
+                return log_debug_errno(r, "Error getting pgscan from memory.stat under %s: %m", path);
+
+        return 0;
+}
+
+int oomd_cgroup_context_acquire_full(const char *path, OomdCGroupContext *old, OomdCGroupContext **ret) {
+        _cleanup_(oomd_cgroup_context_freep) OomdCGroupContext *ctx = NULL;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        ctx = new(OomdCGroupContext, 1);
+        if (!ctx)
+                return -ENOMEM;
+
+        *ctx = (OomdCGroupContext) {
+                .dir_fd = -1,
+                .preference = MANAGED_OOM_PREFERENCE_NONE,
+        };
+        for (OomdCGroupFile f = 0; f < _OOMD_CGROUP_FILE_MAX; f++)
+                ctx->fds[f] = -1;
+
+        /* Opening every file of every cgroup by path on each interval is expensive with many cgroups,
+         * hence the files are kept open and read again. */
+        if (old) {
+                ctx->dir_fd = TAKE_FD(old->dir_fd);
+                for (OomdCGroupFile f = 0; f < _OOMD_CGROUP_FILE_MAX; f++)
+                        ctx->fds[f] = TAKE_FD(old->fds[f]);
         }
 
+        r = cgroup_context_read_state(ctx, path);
+        if (r < 0 && r != -ENOMEM && old && ctx->dir_fd >= 0) {
+                /* The cgroup might have been removed and created again, try again with its new files. */
+                cgroup_context_close_fds(ctx);
+                r = cgroup_context_read_state(ctx, path);
+        }
+        if (r < 0)
+                return r;
+
         ctx->path = strdup(empty_to_root(path));
         if (!ctx->path)
                 return -ENOMEM;
@@ -414,6 +698,36 @@ int oomd_cgroup_context_acquire(const char *path, OomdCGroupContext **ret) {
         return 0;
 }
 
+int oomd_cgroup_pressure_trigger_open(const char *path, loadavg_t limit, usec_t window_usec) {
+        char buf[STRLEN("full ") + DECIMAL_STR_MAX(usec_t) + 1 + DECIMAL_STR_MAX(usec_t)];
+        _cleanup_free_ char *p = NULL;
+        _cleanup_close_ int fd = -1;
+        usec_t threshold_usec;
+        int r;
+
+        assert(path);
+        assert(window_usec > 0);
+
+        r = cg_get_path(SYSTEMD_CGROUP_CONTROLLER, path, "memory.pressure", &p);
+        if (r < 0)
+                return log_debug_errno(r, "Error getting cgroup memory pressure path from %s: %m", path);
+
+        fd = open(p, O_RDWR|O_NONBLOCK|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return log_debug_errno(errno, "Failed to open %s: %m", p);
+
+        /* Fire once tasks were fully stalled for half of the limit within the window, so that pressure is
+         * noticed well before its 10s average reaches the limit. */
+        threshold_usec = CLAMP(window_usec * LOADAVG_INT_SIDE(limit) / 200, USEC_PER_MSEC, window_usec);
+
+        /* The kernel expects the trigger in a single write. */
+        xsprintf(buf, "full " USEC_FMT " " USEC_FMT, threshold_usec, window_usec);
+        if (write(fd, buf, strlen(buf) + 1) < 0)
+                return log_debug_errno(errno, "Failed to set up memory pressure trigger on %s: %m", p);
+
+        return TAKE_FD(fd);
+}
+
 int oomd_system_context_acquire(const char *proc_meminfo_path, OomdSystemContext *ret) {
         _cleanup_fclose_ FILE *f = NULL;
         unsigned field_filled = 0;
@@ -500,23 +814,30 @@ int oomd_insert_cgroup_context(Hashmap *old_h, Hashmap *new_h, const char *path)
 
         path = empty_to_root(path);
 
-        r = oomd_cgroup_context_acquire(path, &curr_ctx);
+        old_ctx = hashmap_get(old_h, path);
+
+        r = oomd_cgroup_context_acquire_full(path, old_ctx, &curr_ctx);
         if (r < 0)
                 return log_debug_errno(r, "Failed to get OomdCGroupContext for %s: %m", path);
 
         assert_se(streq(path, curr_ctx->path));
 
-        old_ctx = hashmap_get(old_h, path);
         if (old_ctx) {
                 curr_ctx->last_pgscan = old_ctx->pgscan;
                 curr_ctx->mem_pressure_limit = old_ctx->mem_pressure_limit;
                 curr_ctx->mem_pressure_limit_hit_start = old_ctx->mem_pressure_limit_hit_start;
                 curr_ctx->last_had_mem_reclaim = old_ctx->last_had_mem_reclaim;
+                memcpy(curr_ctx->history, old_ctx->history, sizeof(curr_ctx->history));
+                curr_ctx->history_next = old_ctx->history_next;
+                curr_ctx->n_history = old_ctx->n_history;
+                curr_ctx->reclaimed = old_ctx->reclaimed;
         }
 
         if (oomd_pgscan_rate(curr_ctx) > 0)
                 curr_ctx->last_had_mem_reclaim = now(CLOCK_MONOTONIC);
 
+        oomd_cgroup_context_record_sample(curr_ctx, now(CLOCK_MONOTONIC));
+
         r = hashmap_put(new_h, curr_ctx->path, curr_ctx);
         if (r < 0)
                 return r;
@@ -542,9 +863,15 @@ void oomd_update_cgroup_contexts_between_hashmaps(Hashmap *old_h, Hashmap *curr_
                 ctx->mem_pressure_limit = old_ctx->mem_pressure_limit;
                 ctx->mem_pressure_limit_hit_start = old_ctx->mem_pressure_limit_hit_start;
                 ctx->last_had_mem_reclaim = old_ctx->last_had_mem_reclaim;
+                memcpy(ctx->history, old_ctx->history, sizeof(ctx->history));
+                ctx->history_next = old_ctx->history_next;
+                ctx->n_history = old_ctx->n_history;
+                ctx->reclaimed = old_ctx->reclaimed;
 
                 if (oomd_pgscan_rate(ctx) > 0)
                         ctx->last_had_mem_reclaim = now(CLOCK_MONOTONIC);
+
+                oomd_cgroup_context_record_sample(ctx, now(CLOCK_MONOTONIC));
         }
 }
 
@@ -567,6 +894,8 @@ void oomd_dump_swap_cgroup_context(const OomdCGroupContext *ctx, FILE *f, const
 }
 
 void oomd_dump_memory_pressure_cgroup_context(const OomdCGroupContext *ctx, FILE *f, const char *prefix) {
+        OomdCGroupTrend trend;
+
         assert(ctx);
         assert(f);
 
@@ -594,6 +923,39 @@ void oomd_dump_memory_pressure_cgroup_context(const OomdCGroupContext *ctx, FILE
                         strempty(prefix), FORMAT_BYTES_CGROUP_PROTECTION(ctx->memory_low),
                         strempty(prefix), ctx->pgscan,
                         strempty(prefix), ctx->last_pgscan);
+
+        if (oomd_cgroup_context_get_trend(ctx, &trend) >= 0) {
+                loadavg_t p = (loadavg_t) (trend.memory_pressure_rate < 0 ? -trend.memory_pressure_rate : trend.memory_pressure_rate);
+                uint64_t u = (uint64_t) (trend.memory_usage_rate < 0 ? -trend.memory_usage_rate : trend.memory_usage_rate);
+                usec_t crossing = oomd_pressure_projected_crossing(ctx);
+
+                fprintf(f,
+                        "%s\tTrend over %s: Pressure: %s%lu.%02lu%%/s Memory Usage: %s%s/s Pgscan: %" PRIu64 "/s\n"
+                        "%s\tProjected To Exceed Limit In: %s\n",
+                        strempty(prefix), FORMAT_TIMESPAN(trend.window_usec, USEC_PER_MSEC),
+                        trend.memory_pressure_rate < 0 ? "-" : "", LOADAVG_INT_SIDE(p), LOADAVG_DECIMAL_SIDE(p),
+                        trend.memory_usage_rate < 0 ? "-" : "", FORMAT_BYTES(u),
+                        trend.pgscan_rate,
+                        strempty(prefix), crossing == USEC_INFINITY ? "never" : FORMAT_TIMESPAN(crossing, USEC_PER_SEC));
+        }
+}
+
+void oomd_dump_reclaim_cgroup_context(const OomdCGroupContext *ctx, FILE *f, const char *prefix) {
+        assert(ctx);
+        assert(f);
+
+        fprintf(f,
+                "%sPath: %s\n"
+                "%s\tPressure: Avg10: %lu.%02lu Avg60: %lu.%02lu Avg300: %lu.%02lu\n"
+                "%s\tCurrent Memory Usage: %s\n"
+                "%s\tReclaimed: %s\n",
+                strempty(prefix), ctx->path,
+                strempty(prefix),
+                LOADAVG_INT_SIDE(ctx->memory_pressure.avg10), LOADAVG_DECIMAL_SIDE(ctx->memory_pressure.avg10),
+                LOADAVG_INT_SIDE(ctx->memory_pressure.avg60), LOADAVG_DECIMAL_SIDE(ctx->memory_pressure.avg60),
+                LOADAVG_INT_SIDE(ctx->memory_pressure.avg300), LOADAVG_DECIMAL_SIDE(ctx->memory_pressure.avg300),
+                strempty(prefix), FORMAT_BYTES(ctx->current_memory_usage),
+                strempty(prefix), FORMAT_BYTES(ctx->reclaimed));
 }
 
 void oomd_dump_system_context(const OomdSystemContext *ctx, FILE *f, const char *prefix) {
@@ -10,6 +10,15 @@
 #define DUMP_ON_KILL_COUNT 10
 #define GROWING_SIZE_PERCENTILE 80
 
+/* The number of samples kept per cgroup, and the maximum age of the samples used to determine trends. PSI
+ * avg10 is averaged over 10s already, looking further back only makes projections lag behind. */
+#define OOMD_CGROUP_HISTORY_SIZE 16
+#define OOMD_CGROUP_TREND_WINDOW_USEC (10 * USEC_PER_SEC)
+
+/* The largest share of a cgroup's memory usage which is reclaimed proactively in one interval, when its
+ * memory pressure is zero. Less is reclaimed the closer the pressure is to the target. */
+#define OOMD_RECLAIM_STEP_MAX_PERMYRIAD 50
+
 extern const struct hash_ops oomd_cgroup_ctx_hash_ops;
 
 typedef struct OomdCGroupContext OomdCGroupContext;
@@ -17,9 +26,40 @@ typedef struct OomdSystemContext OomdSystemContext;
 
 typedef int (oomd_compare_t)(OomdCGroupContext * const *, OomdCGroupContext * const *);
 
+/* The files of a cgroup which are read on every interval */
+typedef enum OomdCGroupFile {
+        OOMD_CGROUP_FILE_MEMORY_PRESSURE,
+        OOMD_CGROUP_FILE_MEMORY_CURRENT,
+        OOMD_CGROUP_FILE_MEMORY_MIN,
+        OOMD_CGROUP_FILE_MEMORY_LOW,
+        OOMD_CGROUP_FILE_MEMORY_SWAP_CURRENT,
+        OOMD_CGROUP_FILE_MEMORY_STAT,
+        _OOMD_CGROUP_FILE_MAX,
+} OomdCGroupFile;
+
+typedef struct OomdCGroupSample {
+        usec_t timestamp;
+        loadavg_t memory_pressure; /* avg10 */
+        uint64_t current_memory_usage;
+        uint64_t pgscan;
+} OomdCGroupSample;
+
+/* Rates of change per second, computed from the samples of the last OOMD_CGROUP_TREND_WINDOW_USEC. */
+typedef struct OomdCGroupTrend {
+        usec_t window_usec;
+        int64_t memory_pressure_rate; /* in loadavg_t fixed point units */
+        int64_t memory_usage_rate;
+        uint64_t pgscan_rate;
+} OomdCGroupTrend;
+
 struct OomdCGroupContext {
         char *path;
 
+        /* The cgroup directory and the files in it are kept open, and are taken over by the context acquired
+         * for the same cgroup in the next interval, see oomd_insert_cgroup_context(). */
+        int dir_fd;
+        int fds[_OOMD_CGROUP_FILE_MAX];
+
         ResourcePressure memory_pressure;
 
         uint64_t current_memory_usage;
@@ -37,6 +77,14 @@ struct OomdCGroupContext {
         loadavg_t mem_pressure_limit;
         usec_t mem_pressure_limit_hit_start;
         usec_t last_had_mem_reclaim;
+
+        /* Ring buffer of the samples taken in the previous intervals, including the current one. */
+        OomdCGroupSample history[OOMD_CGROUP_HISTORY_SIZE];
+        size_t history_next;
+        size_t n_history;
+
+        /* Total bytes reclaimed proactively via memory.reclaim */
+        uint64_t reclaimed;
 };
 
 struct OomdSystemContext {
@@ -54,11 +102,27 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(OomdCGroupContext*, oomd_cgroup_context_free);
 
 /* Scans all the OomdCGroupContexts in `h` and returns 1 and a set of pointers to those OomdCGroupContexts in `ret`
  * if any of them have exceeded their supplied memory pressure limits for the `duration` length of time.
+ * If `projection` is non-zero, memory pressure which is projected to exceed the limit within `projection` based on
+ * its trend counts as exceeding the limit already.
  * `mem_pressure_limit_hit_start` is updated accordingly for the first time the limit is exceeded, and when it returns
  * below the limit.
  * Returns 0 and sets `ret` to an empty set if no entries exceeded limits for `duration`.
  * Returns -ENOMEM for allocation errors. */
-int oomd_pressure_above(Hashmap *h, usec_t duration, Set **ret);
+int oomd_pressure_above(Hashmap *h, usec_t duration, usec_t projection, Set **ret);
+
+/* Appends the current state of `ctx` to its history. */
+void oomd_cgroup_context_record_sample(OomdCGroupContext *ctx, usec_t timestamp);
+
+/* Returns -ENODATA if there are not enough recent samples to determine a trend. */
+int oomd_cgroup_context_get_trend(const OomdCGroupContext *ctx, OomdCGroupTrend *ret);
+
+/* Returns the time until the memory pressure of `ctx` reaches its limit if its trend continues, 0 if it is above
+ * the limit already, or USEC_INFINITY if it is not rising or its trend is unknown. */
+usec_t oomd_pressure_projected_crossing(const OomdCGroupContext *ctx);
+
+/* Returns the number of bytes to reclaim proactively from `ctx` so that its memory pressure approaches
+ * `target`, rounded down to full pages. Returns 0 if its memory pressure is at or above `target`. */
+uint64_t oomd_reclaim_step(const OomdCGroupContext *ctx, loadavg_t target);
 
 /* Returns true if the amount of memory available (see proc(5)) is below the permyriad of memory specified by `threshold_permyriad`. */
 bool oomd_mem_available_below(const OomdSystemContext *ctx, int threshold_permyriad);
@@ -112,6 +176,11 @@ int oomd_sort_cgroup_contexts(Hashmap *h, oomd_compare_t compare_func, const cha
 /* Returns a negative value on error, 0 if no processes were killed, or 1 if processes were killed. */
 int oomd_cgroup_kill(const char *path, bool recurse, bool dry_run);
 
+/* Asks the kernel to reclaim `bytes` from the cgroup `path` via memory.reclaim. Returns 1 if that much was
+ * reclaimed, 0 if the kernel could not reclaim as much, or a negative value on error, in particular -ENOENT
+ * if the kernel does not support memory.reclaim. */
+int oomd_cgroup_reclaim(const char *path, uint64_t bytes, bool dry_run);
+
 /* The following oomd_kill_by_* functions return 1 if processes were killed, or negative otherwise. */
 /* If `prefix` is supplied, only cgroups whose paths start with `prefix` are eligible candidates. Otherwise,
  * everything in `h` is a candidate.
@@ -119,9 +188,18 @@ int oomd_cgroup_kill(const char *path, bool recurse, bool dry_run);
 int oomd_kill_by_pgscan_rate(Hashmap *h, const char *prefix, bool dry_run, char **ret_selected);
 int oomd_kill_by_swap_usage(Hashmap *h, uint64_t threshold_usage, bool dry_run, char **ret_selected);
 
-int oomd_cgroup_context_acquire(const char *path, OomdCGroupContext **ret);
+/* Reads the state of the cgroup `path`. If `old` is specified, the file descriptors opened for the cgroup
+ * by it are taken over. */
+int oomd_cgroup_context_acquire_full(const char *path, OomdCGroupContext *old, OomdCGroupContext **ret);
+static inline int oomd_cgroup_context_acquire(const char *path, OomdCGroupContext **ret) {
+        return oomd_cgroup_context_acquire_full(path, NULL, ret);
+}
 int oomd_system_context_acquire(const char *proc_swaps_path, OomdSystemContext *ret);
 
+/* Installs a PSI trigger on memory.pressure of the cgroup `path`, scaled to the memory pressure `limit`, and
+ * returns the file descriptor, which reports EPOLLPRI when the trigger fires. */
+int oomd_cgroup_pressure_trigger_open(const char *path, loadavg_t limit, usec_t window_usec);
+
 /* Get the OomdCGroupContext of `path` and insert it into `new_h`. The key for the inserted context will be `path`.
  *
  * `old_h` is used to get data used to calculate prior interval information. `old_h` can be NULL in which case there
@@ -133,4 +211,5 @@ void oomd_update_cgroup_contexts_between_hashmaps(Hashmap *old_h, Hashmap *curr_
 
 void oomd_dump_swap_cgroup_context(const OomdCGroupContext *ctx, FILE *f, const char *prefix);
 void oomd_dump_memory_pressure_cgroup_context(const OomdCGroupContext *ctx, FILE *f, const char *prefix);
+void oomd_dump_reclaim_cgroup_context(const OomdCGroupContext *ctx, FILE *f, const char *prefix);
 void oomd_dump_system_context(const OomdSystemContext *ctx, FILE *f, const char *prefix);
@@ -14,18 +14,28 @@
 #include "parse-util.h"
 #include "pretty-print.c"
 #include "psi-util.h"
+#include "rlimit-util.h"
 #include "signal-util.h"
+#include "strv.h"
 
 static bool arg_dry_run = false;
 static int arg_swap_used_limit_permyriad = -1;
 static int arg_mem_pressure_limit_permyriad = -1;
 static usec_t arg_mem_pressure_usec = 0;
+static usec_t arg_mem_pressure_projection_usec = 0;
+static char **arg_reclaim_slices = NULL;
+static int arg_reclaim_mem_pressure_target_permyriad = -1;
+
+STATIC_DESTRUCTOR_REGISTER(arg_reclaim_slices, strv_freep);
 
 static int parse_config(void) {
         static const ConfigTableItem items[] = {
-                { "OOM", "SwapUsedLimit",                    config_parse_permyriad, 0, &arg_swap_used_limit_permyriad    },
-                { "OOM", "DefaultMemoryPressureLimit",       config_parse_permyriad, 0, &arg_mem_pressure_limit_permyriad },
-                { "OOM", "DefaultMemoryPressureDurationSec", config_parse_sec,       0, &arg_mem_pressure_usec            },
+                { "OOM", "SwapUsedLimit",                        config_parse_permyriad, 0, &arg_swap_used_limit_permyriad             },
+                { "OOM", "DefaultMemoryPressureLimit",           config_parse_permyriad, 0, &arg_mem_pressure_limit_permyriad          },
+                { "OOM", "DefaultMemoryPressureDurationSec",     config_parse_sec,       0, &arg_mem_pressure_usec                     },
+                { "OOM", "DefaultMemoryPressureProjectionSec",   config_parse_sec,       0, &arg_mem_pressure_projection_usec          },
+                { "OOM", "ProactiveReclaimSlices",               config_parse_strv,      0, &arg_reclaim_slices                        },
+                { "OOM", "ProactiveReclaimMemoryPressureTarget", config_parse_permyriad, 0, &arg_reclaim_mem_pressure_target_permyriad },
                 {}
         };
 
@@ -169,6 +179,9 @@ static int run(int argc, char *argv[]) {
 
         assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGTERM, SIGINT, -1) >= 0);
 
+        /* The files of all monitored cgroups and their descendants are kept open. */
+        (void) rlimit_nofile_bump(HIGH_RLIMIT_NOFILE);
+
         if (arg_mem_pressure_usec > 0 && arg_mem_pressure_usec < 1 * USEC_PER_SEC)
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "DefaultMemoryPressureDurationSec= must be 0 or at least 1s");
 
@@ -182,6 +195,9 @@ static int run(int argc, char *argv[]) {
                         arg_swap_used_limit_permyriad,
                         arg_mem_pressure_limit_permyriad,
                         arg_mem_pressure_usec,
+                        arg_mem_pressure_projection_usec,
+                        arg_reclaim_slices,
+                        arg_reclaim_mem_pressure_target_permyriad,
                         fd);
         if (r < 0)
                 return log_error_errno(r, "Failed to start up daemon: %m");
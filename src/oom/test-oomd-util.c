@@ -8,6 +8,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
+#include "memory-util.h"
 #include "oomd-util.h"
 #include "parse-util.h"
 #include "path-util.h"
@@ -310,7 +311,7 @@ static void test_oomd_pressure_above(void) {
         /* High memory pressure */
         assert_se(h1 = hashmap_new(&string_hash_ops));
         assert_se(hashmap_put(h1, "/herp.slice", &ctx[0]) >= 0);
-        assert_se(oomd_pressure_above(h1, 0 /* duration */, &t1) == 1);
+        assert_se(oomd_pressure_above(h1, 0 /* duration */, 0 /* projection */, &t1) == 1);
         assert_se(set_contains(t1, &ctx[0]));
         assert_se(c = hashmap_get(h1, "/herp.slice"));
         assert_se(c->mem_pressure_limit_hit_start > 0);
@@ -318,14 +319,14 @@ static void test_oomd_pressure_above(void) {
         /* Low memory pressure */
         assert_se(h2 = hashmap_new(&string_hash_ops));
         assert_se(hashmap_put(h2, "/derp.slice", &ctx[1]) >= 0);
-        assert_se(oomd_pressure_above(h2, 0 /* duration */, &t2) == 0);
+        assert_se(oomd_pressure_above(h2, 0 /* duration */, 0 /* projection */, &t2) == 0);
         assert_se(!t2);
         assert_se(c = hashmap_get(h2, "/derp.slice"));
         assert_se(c->mem_pressure_limit_hit_start == 0);
 
         /* High memory pressure w/ multiple cgroups */
         assert_se(hashmap_put(h1, "/derp.slice", &ctx[1]) >= 0);
-        assert_se(oomd_pressure_above(h1, 0 /* duration */, &t3) == 1);
+        assert_se(oomd_pressure_above(h1, 0 /* duration */, 0 /* projection */, &t3) == 1);
         assert_se(set_contains(t3, &ctx[0]));
         assert_se(set_size(t3) == 1);
         assert_se(c = hashmap_get(h1, "/herp.slice"));
@@ -334,6 +335,99 @@ static void test_oomd_pressure_above(void) {
         assert_se(c->mem_pressure_limit_hit_start == 0);
 }
 
+static void test_oomd_pressure_trend(void) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        _cleanup_set_free_ Set *t = NULL;
+        OomdCGroupContext ctx = {};
+        OomdCGroupTrend trend;
+        usec_t ts = 100 * USEC_PER_SEC;
+
+        assert_se(store_loadavg_fixed_point(50, 0, &ctx.mem_pressure_limit) == 0);
+
+        /* No trend without history */
+        assert_se(oomd_cgroup_context_get_trend(&ctx, &trend) == -ENODATA);
+        assert_se(oomd_pressure_projected_crossing(&ctx) == USEC_INFINITY);
+
+        /* Pressure rising by 5% per second with reclaim activity and growing memory usage */
+        for (unsigned i = 0; i <= 6; i++) {
+                assert_se(store_loadavg_fixed_point(i * 5, 0, &ctx.memory_pressure.avg10) == 0);
+                ctx.current_memory_usage = 1024 * 1024 * (i + 1);
+                ctx.pgscan = 100 * i;
+                oomd_cgroup_context_record_sample(&ctx, ts + i * USEC_PER_SEC);
+        }
+
+        assert_se(ctx.n_history == 7);
+        assert_se(oomd_cgroup_context_get_trend(&ctx, &trend) >= 0);
+        assert_se(trend.window_usec == 6 * USEC_PER_SEC);
+        assert_se(LOADAVG_INT_SIDE(trend.memory_pressure_rate) == 5);
+        assert_se(trend.memory_usage_rate == 1024 * 1024);
+        assert_se(trend.pgscan_rate == 100);
+
+        /* 30% now, hence the limit of 50% is reached in 4s */
+        assert_se(oomd_pressure_projected_crossing(&ctx) >= 3 * USEC_PER_SEC);
+        assert_se(oomd_pressure_projected_crossing(&ctx) <= 4 * USEC_PER_SEC);
+
+        assert_se(h = hashmap_new(&string_hash_ops));
+        assert_se(hashmap_put(h, "/herp.slice", &ctx) >= 0);
+        assert_se(oomd_pressure_above(h, 0 /* duration */, 0 /* projection */, &t) == 0);
+        assert_se(ctx.mem_pressure_limit_hit_start == 0);
+        assert_se(oomd_pressure_above(h, 0 /* duration */, 2 * USEC_PER_SEC, &t) == 0);
+        assert_se(oomd_pressure_above(h, 0 /* duration */, 10 * USEC_PER_SEC, &t) == 1);
+        assert_se(set_contains(t, &ctx));
+        assert_se(ctx.mem_pressure_limit_hit_start > 0);
+        t = set_free(t);
+
+        /* Samples older than the trend window are not used */
+        oomd_cgroup_context_record_sample(&ctx, ts + 6 * USEC_PER_SEC + OOMD_CGROUP_TREND_WINDOW_USEC + 1);
+        assert_se(oomd_cgroup_context_get_trend(&ctx, &trend) == -ENODATA);
+
+        /* Rising pressure without reclaim activity is not projected to cross the limit */
+        oomd_cgroup_context_record_sample(&ctx, ts + 8 * USEC_PER_SEC + OOMD_CGROUP_TREND_WINDOW_USEC);
+        assert_se(store_loadavg_fixed_point(40, 0, &ctx.memory_pressure.avg10) == 0);
+        oomd_cgroup_context_record_sample(&ctx, ts + 9 * USEC_PER_SEC + OOMD_CGROUP_TREND_WINDOW_USEC);
+        assert_se(oomd_cgroup_context_get_trend(&ctx, &trend) >= 0);
+        assert_se(trend.memory_pressure_rate > 0);
+        assert_se(trend.pgscan_rate == 0);
+        assert_se(trend.memory_usage_rate == 0);
+        assert_se(oomd_pressure_projected_crossing(&ctx) == USEC_INFINITY);
+}
+
+static void test_oomd_reclaim_step(void) {
+        OomdCGroupContext ctx = {
+                .current_memory_usage = 4096ULL * 1024 * 1024,
+        };
+        loadavg_t target;
+        uint64_t full, half;
+
+        assert_se(store_loadavg_fixed_point(1, 0, &target) == 0);
+
+        /* No pressure: reclaim the maximum step */
+        full = oomd_reclaim_step(&ctx, target);
+        assert_se(full > 0);
+        assert_se(full <= ctx.current_memory_usage / 10000 * OOMD_RECLAIM_STEP_MAX_PERMYRIAD);
+        assert_se(full % page_size() == 0);
+
+        /* Halfway to the target: reclaim about half as much */
+        ctx.memory_pressure.avg10 = target / 2;
+        half = oomd_reclaim_step(&ctx, target);
+        assert_se(half > 0 && half < full);
+        assert_se(half % page_size() == 0);
+
+        /* At or above the target: don't reclaim */
+        ctx.memory_pressure.avg10 = target;
+        assert_se(oomd_reclaim_step(&ctx, target) == 0);
+        ctx.memory_pressure.avg10 = target * 2;
+        assert_se(oomd_reclaim_step(&ctx, target) == 0);
+
+        /* No target: don't reclaim */
+        ctx.memory_pressure.avg10 = 0;
+        assert_se(oomd_reclaim_step(&ctx, 0) == 0);
+
+        /* Tiny cgroups: less than a page to reclaim */
+        ctx.current_memory_usage = 4096;
+        assert_se(oomd_reclaim_step(&ctx, target) == 0);
+}
+
 static void test_oomd_mem_and_swap_free_below(void) {
         OomdSystemContext ctx = (OomdSystemContext) {
                 .mem_total = 20971512 * 1024U,
@@ -459,6 +553,8 @@ int main(void) {
         test_oomd_update_cgroup_contexts_between_hashmaps();
         test_oomd_system_context_acquire();
         test_oomd_pressure_above();
+        test_oomd_pressure_trend();
+        test_oomd_reclaim_step();
         test_oomd_mem_and_swap_free_below();
         test_oomd_sort_cgroups();
 
@@ -6,6 +6,7 @@
 
 #include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <linux/fs.h>
 #include <linux/loop.h>
 #include <sys/file.h>
@@ -43,6 +44,7 @@
 #include "list.h"
 #include "loop-util.h"
 #include "main-func.h"
+#include "memory-util.h"
 #include "mkdir.h"
 #include "mkfs-util.h"
 #include "mount-util.h"
@@ -2730,19 +2732,195 @@ static int deactivate_luks(struct crypt_device *cd, const char *node) {
 #endif
 }
 
-static int context_copy_blocks(Context *context) {
+#define COPY_BLOCKS_BUFFER_SIZE (4U*1024U*1024U)
+
+typedef struct CopyBlocksJob {
+        Partition *partition;
+
+        struct crypt_device *cd;
+        LoopDevice *loop;
+        char *encrypted;
+        int encrypted_dev_fd;
+
+        int target_fd;          /* either encrypted_dev_fd or the whole disk */
+        uint64_t target_offset;
+
+        pthread_t thread;
+        bool started;
+        int result;
+} CopyBlocksJob;
+
+static void copy_blocks_jobs_free(CopyBlocksJob *jobs, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+                safe_close(jobs[i].encrypted_dev_fd);
+                sym_crypt_free(jobs[i].cd);
+                loop_device_unref(jobs[i].loop);
+                free(jobs[i].encrypted);
+        }
+
+        free(jobs);
+}
+
+static int copy_blocks_zero(int fd, uint64_t offset, uint64_t size, void *buffer) {
+        assert(fd >= 0);
+        assert(buffer);
+
+        /* Both regular files and block devices guarantee that punched holes read back as zeros, so try
+         * that first, it doesn't have to write anything. Otherwise, e.g. for dm-crypt, write zeros. */
+        if (fallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, offset, size) >= 0)
+                return 0;
+        if (!ERRNO_IS_NOT_SUPPORTED(errno) && errno != EINVAL)
+                return -errno;
+
+        memzero(buffer, MIN(size, (uint64_t) COPY_BLOCKS_BUFFER_SIZE));
+
+        while (size > 0) {
+                ssize_t n;
+
+                n = pwrite(fd, buffer, MIN(size, (uint64_t) COPY_BLOCKS_BUFFER_SIZE), offset);
+                if (n < 0)
+                        return -errno;
+                if (n == 0)
+                        return -EIO;
+
+                offset += n;
+                size -= n;
+        }
+
+        return 0;
+}
+
+static int copy_blocks_data(int source_fd, uint64_t offset, int target_fd, uint64_t target_offset, uint64_t size, bool *try_cfr, void *buffer) {
+        assert(source_fd >= 0);
+        assert(target_fd >= 0);
+        assert(try_cfr);
+        assert(buffer);
+
+        while (size > 0) {
+                ssize_t n, k;
+
+                /* Let the kernel copy (or reflink) if it can, this needs explicit offsets on both sides,
+                 * since the whole disk fd is shared between partitions copied concurrently. */
+                if (*try_cfr) {
+                        loff_t in = offset, out = target_offset;
+
+                        n = copy_file_range(source_fd, &in, target_fd, &out, MIN(size, (uint64_t) SSIZE_MAX), 0);
+                        if (n > 0) {
+                                offset += n;
+                                target_offset += n;
+                                size -= n;
+                                continue;
+                        }
+                        if (n == 0)
+                                return -EIO; /* The source is shorter than expected */
+                        if (!ERRNO_IS_NOT_SUPPORTED(errno) && !IN_SET(errno, EINVAL, EXDEV, EBADF))
+                                return -errno;
+
+                        *try_cfr = false;
+                }
+
+                n = pread(source_fd, buffer, MIN(size, (uint64_t) COPY_BLOCKS_BUFFER_SIZE), offset);
+                if (n < 0)
+                        return -errno;
+                if (n == 0)
+                        return -EIO;
+
+                k = pwrite(target_fd, buffer, n, target_offset);
+                if (k < 0)
+                        return -errno;
+                if (k != n)
+                        return -EIO;
+
+                offset += n;
+                target_offset += n;
+                size -= n;
+        }
+
+        return 0;
+}
+
+static void* copy_blocks_thread(void *userdata) {
+        CopyBlocksJob *j = ASSERT_PTR(userdata);
+        Partition *p = ASSERT_PTR(j->partition);
+        _cleanup_free_ void *buffer = NULL;
+        uint64_t offset = 0, size = p->copy_blocks_size;
+        unsigned last_percent = 0;
+        bool try_cfr = true;
+        int r;
+
+        /* Copies only the data extents of the source, and makes holes (or writes zeros) for everything else,
+         * so that sparse images don't cause the whole partition to be read. */
+
+        buffer = aligned_alloc(page_size(), COPY_BLOCKS_BUFFER_SIZE);
+        if (!buffer) {
+                j->result = -ENOMEM;
+                return NULL;
+        }
+
+        while (offset < size) {
+                uint64_t data_start, data_end;
+                off_t o;
+                unsigned percent;
+
+                o = lseek(p->copy_blocks_fd, offset, SEEK_DATA);
+                if (o < 0 && errno == ENXIO)
+                        data_start = size; /* Only a hole left */
+                else if (o < 0)
+                        data_start = offset; /* No support for SEEK_DATA, copy everything */
+                else
+                        data_start = MIN((uint64_t) o, size);
+
+                if (data_start > offset) {
+                        r = copy_blocks_zero(j->target_fd, j->target_offset + offset, data_start - offset, buffer);
+                        if (r < 0)
+                                goto finish;
+
+                        offset = data_start;
+                        if (offset >= size)
+                                break;
+                }
+
+                o = lseek(p->copy_blocks_fd, offset, SEEK_HOLE);
+                data_end = o < 0 ? size : MIN((uint64_t) o, size);
+                if (data_end <= offset)
+                        data_end = size;
+
+                /* Copy in chunks, so that we can report progress */
+                data_end = MIN(data_end, offset + 16 * (uint64_t) COPY_BLOCKS_BUFFER_SIZE);
+
+                r = copy_blocks_data(p->copy_blocks_fd, offset, j->target_fd, j->target_offset + offset, data_end - offset, &try_cfr, buffer);
+                if (r < 0)
+                        goto finish;
+
+                offset = data_end;
+
+                percent = (unsigned) (offset * 100 / size);
+                if (percent / 10 > last_percent / 10 && offset < size) {
+                        log_info("Copied %u%% of '%s'.", percent, p->copy_blocks_path);
+                        last_percent = percent;
+                }
+        }
+
+        r = 0;
+
+finish:
+        j->result = r;
+        return NULL;
+}
+
+static int context_copy_blocks_internal(Context *context, CopyBlocksJob **jobs_ptr, size_t *n_jobs_ptr) {
+        sigset_t ss, saved_ss;
         int whole_fd = -1, r;
 
         assert(context);
+        assert(jobs_ptr);
+        assert(n_jobs_ptr);
 
-        /* Copy in file systems on the block level */
+        /* Copy in file systems on the block level. First set up all targets, then copy the partitions
+         * concurrently, since they are independent of each other, then tear down what we set up again. */
 
         LIST_FOREACH(partitions, p, context->partitions) {
-                _cleanup_(sym_crypt_freep) struct crypt_device *cd = NULL;
-                _cleanup_(loop_device_unrefp) LoopDevice *d = NULL;
-                _cleanup_free_ char *encrypted = NULL;
-                _cleanup_close_ int encrypted_dev_fd = -1;
-                int target_fd;
+                CopyBlocksJob *j;
 
                 if (p->copy_blocks_fd < 0)
                         continue;
@@ -2760,51 +2938,99 @@ static int context_copy_blocks(Context *context) {
                 if (whole_fd < 0)
                         assert_se((whole_fd = fdisk_get_devfd(context->fdisk_context)) >= 0);
 
+                if (!GREEDY_REALLOC(*jobs_ptr, *n_jobs_ptr + 1))
+                        return log_oom();
+
+                j = *jobs_ptr + (*n_jobs_ptr)++;
+                *j = (CopyBlocksJob) {
+                        .partition = p,
+                        .encrypted_dev_fd = -1,
+                };
+
                 if (p->encrypt != ENCRYPT_OFF) {
-                        r = loop_device_make(whole_fd, O_RDWR, p->offset, p->new_size, 0, &d);
+                        r = loop_device_make(whole_fd, O_RDWR, p->offset, p->new_size, 0, &j->loop);
                         if (r < 0)
                                 return log_error_errno(r, "Failed to make loopback device of future partition %" PRIu64 ": %m", p->partno);
 
-                        r = loop_device_flock(d, LOCK_EX);
+                        r = loop_device_flock(j->loop, LOCK_EX);
                         if (r < 0)
                                 return log_error_errno(r, "Failed to lock loopback device: %m");
 
-                        r = partition_encrypt(context, p, d->node, &cd, &encrypted, &encrypted_dev_fd);
+                        r = partition_encrypt(context, p, j->loop->node, &j->cd, &j->encrypted, &j->encrypted_dev_fd);
                         if (r < 0)
                                 return log_error_errno(r, "Failed to encrypt device: %m");
 
-                        if (flock(encrypted_dev_fd, LOCK_EX) < 0)
+                        if (flock(j->encrypted_dev_fd, LOCK_EX) < 0)
                                 return log_error_errno(errno, "Failed to lock LUKS device: %m");
 
-                        target_fd = encrypted_dev_fd;
-                }  else {
-                        if (lseek(whole_fd, p->offset, SEEK_SET) == (off_t) -1)
-                                return log_error_errno(errno, "Failed to seek to partition offset: %m");
-
-                        target_fd = whole_fd;
+                        j->target_fd = j->encrypted_dev_fd;
+                        j->target_offset = 0;
+                } else {
+                        j->target_fd = whole_fd;
+                        j->target_offset = p->offset;
                 }
+        }
+
+        CopyBlocksJob *jobs = *jobs_ptr;
+        size_t n_jobs = *n_jobs_ptr;
+
+        if (n_jobs == 0)
+                return 0;
+
+        /* The threads must not handle signals, leave that to us */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return log_error_errno(r, "Failed to block signals: %m");
+
+        for (size_t i = 0; i < n_jobs; i++) {
+                CopyBlocksJob *j = jobs + i;
 
                 log_info("Copying in '%s' (%s) on block level into future partition %" PRIu64 ".",
-                         p->copy_blocks_path, FORMAT_BYTES(p->copy_blocks_size), p->partno);
+                         j->partition->copy_blocks_path, FORMAT_BYTES(j->partition->copy_blocks_size), j->partition->partno);
 
-                r = copy_bytes_full(p->copy_blocks_fd, target_fd, p->copy_blocks_size, 0, NULL, NULL, NULL, NULL);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to copy in data from '%s': %m", p->copy_blocks_path);
+                r = pthread_create(&j->thread, NULL, copy_blocks_thread, j);
+                if (r > 0) {
+                        /* Copy this one on our own thread then, once the others are running */
+                        log_debug_errno(r, "Failed to start thread for copying, copying serially: %m");
+                        continue;
+                }
 
-                if (fsync(target_fd) < 0)
+                j->started = true;
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        for (size_t i = 0; i < n_jobs; i++) {
+                CopyBlocksJob *j = jobs + i;
+
+                if (j->started)
+                        assert_se(pthread_join(j->thread, NULL) == 0);
+                else
+                        (void) copy_blocks_thread(j);
+        }
+
+        for (size_t i = 0; i < n_jobs; i++) {
+                CopyBlocksJob *j = jobs + i;
+                Partition *p = j->partition;
+
+                if (j->result < 0)
+                        return log_error_errno(j->result, "Failed to copy in data from '%s': %m", p->copy_blocks_path);
+
+                if (fsync(j->target_fd) < 0)
                         return log_error_errno(errno, "Failed to synchronize copied data blocks: %m");
 
                 if (p->encrypt != ENCRYPT_OFF) {
-                        encrypted_dev_fd = safe_close(encrypted_dev_fd);
+                        j->encrypted_dev_fd = safe_close(j->encrypted_dev_fd);
 
-                        r = deactivate_luks(cd, encrypted);
+                        r = deactivate_luks(j->cd, j->encrypted);
                         if (r < 0)
                                 return r;
 
-                        sym_crypt_free(cd);
-                        cd = NULL;
+                        sym_crypt_free(j->cd);
+                        j->cd = NULL;
 
-                        r = loop_device_sync(d);
+                        r = loop_device_sync(j->loop);
                         if (r < 0)
                                 return log_error_errno(r, "Failed to sync loopback device: %m");
                 }
@@ -2815,6 +3041,16 @@ static int context_copy_blocks(Context *context) {
         return 0;
 }
 
+static int context_copy_blocks(Context *context) {
+        CopyBlocksJob *jobs = NULL;
+        size_t n_jobs = 0;
+        int r;
+
+        r = context_copy_blocks_internal(context, &jobs, &n_jobs);
+        copy_blocks_jobs_free(jobs, n_jobs);
+        return r;
+}
+
 static int do_copy_files(Partition *p, const char *fs) {
         int r;
 
@@ -2861,13 +3097,13 @@ static int do_copy_files(Partition *p, const char *fs) {
                                                 sfd, ".",
                                                 pfd, fn,
                                                 UID_INVALID, GID_INVALID,
-                                                COPY_REFLINK|COPY_MERGE|COPY_REPLACE|COPY_SIGINT|COPY_HARDLINKS|COPY_ALL_XATTRS);
+                                                COPY_REFLINK|COPY_MERGE|COPY_REPLACE|COPY_SIGINT|COPY_HARDLINKS|COPY_ALL_XATTRS|COPY_PARALLEL);
                         } else
                                 r = copy_tree_at(
                                                 sfd, ".",
                                                 tfd, ".",
                                                 UID_INVALID, GID_INVALID,
-                                                COPY_REFLINK|COPY_MERGE|COPY_REPLACE|COPY_SIGINT|COPY_HARDLINKS|COPY_ALL_XATTRS);
+                                                COPY_REFLINK|COPY_MERGE|COPY_REPLACE|COPY_SIGINT|COPY_HARDLINKS|COPY_ALL_XATTRS|COPY_PARALLEL);
                         if (r < 0)
                                 return log_error_errno(r, "Failed to copy '%s' to '%s%s': %m", *source, strempty(arg_root), *target);
                 } else {
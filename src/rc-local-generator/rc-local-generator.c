@@ -8,6 +8,7 @@
 #include "log.h"
 #include "mkdir-label.h"
 #include "string-util.h"
+#include "strv.h"
 #include "util.h"
 
 static const char *arg_dest = NULL;
@@ -59,6 +60,8 @@ static int run(const char *dest, const char *dest_early, const char *dest_late)
 
         assert_se(arg_dest = dest);
 
+        (void) generator_declare_inputs(STRV_MAKE(RC_LOCAL_PATH));
+
         if (check_executable(RC_LOCAL_PATH) >= 0) {
                 log_debug("Automatically adding rc-local.service.");
 
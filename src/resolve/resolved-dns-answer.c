@@ -346,6 +346,18 @@ bool dns_answer_contains(DnsAnswer *answer, DnsResourceRecord *rr) {
         return false;
 }
 
+DnsAnswerItem *dns_answer_get_item(DnsAnswer *answer, DnsResourceRecord *rr, int ifindex) {
+        assert(rr);
+
+        /* Unlike dns_answer_contains() this only finds items with the same ifindex, but needs no linear
+         * search. */
+
+        if (!answer)
+                return NULL;
+
+        return ordered_set_get(answer->items, &(DnsAnswerItem) { .rr = rr, .ifindex = ifindex });
+}
+
 int dns_answer_find_soa(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
@@ -11,9 +11,9 @@
 #include "resolved-dns-packet.h"
 #include "string-util.h"
 
-/* Never cache more than 4K entries. RFC 1536, Section 5 suggests to
+/* Never cache more than 4K entries by default. RFC 1536, Section 5 suggests to
  * leave DNS caches unbounded, but that's crazy. */
-#define CACHE_MAX 4096
+#define CACHE_MAX 4096U
 
 /* We never keep any item longer than 2h in our cache */
 #define CACHE_TTL_MAX_USEC (2 * USEC_PER_HOUR)
@@ -24,6 +24,9 @@
 
 #define CACHEABLE_QUERY_FLAGS (SD_RESOLVED_AUTHENTICATED|SD_RESOLVED_CONFIDENTIAL)
 
+/* Counts the cache flushes, so that data derived from cache contents knows when it is outdated */
+static uint64_t cache_flush_generation = 0;
+
 typedef enum DnsCacheItemType DnsCacheItemType;
 typedef struct DnsCacheItem DnsCacheItem;
 
@@ -51,6 +54,11 @@ struct DnsCacheItem {
         union in_addr_union owner_address;
 
         unsigned prioq_idx;
+
+        /* The value of the cache's use counter when this item was last looked up */
+        uint64_t last_use;
+        unsigned use_prioq_idx;
+
         LIST_FIELDS(DnsCacheItem, by_key);
 
         bool shared_owner;
@@ -112,6 +120,7 @@ static void dns_cache_item_unlink_and_free(DnsCache *c, DnsCacheItem *i) {
                 hashmap_remove(c->by_key, i->key);
 
         prioq_remove(c->by_expiry, i, &i->prioq_idx);
+        prioq_remove(c->by_use, i, &i->use_prioq_idx);
 
         dns_cache_item_free(i);
 }
@@ -146,6 +155,7 @@ static bool dns_cache_remove_by_key(DnsCache *c, DnsResourceKey *key) {
 
         LIST_FOREACH(by_key, i, first) {
                 prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                prioq_remove(c->by_use, i, &i->use_prioq_idx);
                 dns_cache_item_free(i);
         }
 
@@ -157,38 +167,54 @@ void dns_cache_flush(DnsCache *c) {
 
         assert(c);
 
+        cache_flush_generation++;
+
         while ((key = hashmap_first_key(c->by_key)))
                 dns_cache_remove_by_key(c, key);
 
         assert(hashmap_size(c->by_key) == 0);
         assert(prioq_size(c->by_expiry) == 0);
+        assert(prioq_size(c->by_use) == 0);
 
         c->by_key = hashmap_free(c->by_key);
         c->by_expiry = prioq_free(c->by_expiry);
+        c->by_use = prioq_free(c->by_use);
 }
 
 static void dns_cache_make_space(DnsCache *c, unsigned add) {
+        unsigned max;
+
         assert(c);
 
         if (add <= 0)
                 return;
 
+        max = c->max_entries > 0 ? c->max_entries : CACHE_MAX;
+
         /* Makes space for n new entries. Note that we actually allow
-         * the cache to grow beyond CACHE_MAX, but only when we shall
-         * add more RRs to the cache than CACHE_MAX at once. In that
-         * case the cache will be emptied completely otherwise. */
+         * the cache to grow beyond the maximum, but only when we shall
+         * add more RRs to the cache than that at once. In that
+         * case the cache will be emptied completely otherwise.
+         *
+         * Entries that expired already are dropped first, and then
+         * those that were not looked up for the longest time, so that
+         * frequently used entries are not pushed out by entries nobody
+         * asks for again. */
+
+        if (prioq_size(c->by_expiry) + add >= max)
+                dns_cache_prune(c);
 
         for (;;) {
                 _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
                 DnsCacheItem *i;
 
-                if (prioq_size(c->by_expiry) <= 0)
+                if (prioq_size(c->by_use) <= 0)
                         break;
 
-                if (prioq_size(c->by_expiry) + add < CACHE_MAX)
+                if (prioq_size(c->by_use) + add < max)
                         break;
 
-                i = prioq_peek(c->by_expiry);
+                i = prioq_peek(c->by_use);
                 assert(i);
 
                 /* Take an extra reference to the key so that it
@@ -245,6 +271,20 @@ static int dns_cache_item_prioq_compare_func(const void *a, const void *b) {
         return CMP(x->until, y->until);
 }
 
+static int dns_cache_item_use_prioq_compare_func(const void *a, const void *b) {
+        const DnsCacheItem *x = a, *y = b;
+
+        return CMP(x->last_use, y->last_use);
+}
+
+static void dns_cache_item_use(DnsCache *c, DnsCacheItem *i) {
+        assert(c);
+        assert(i);
+
+        i->last_use = ++c->n_use;
+        prioq_reshuffle(c->by_use, i, &i->use_prioq_idx);
+}
+
 static int dns_cache_init(DnsCache *c) {
         int r;
 
@@ -254,6 +294,10 @@ static int dns_cache_init(DnsCache *c) {
         if (r < 0)
                 return r;
 
+        r = prioq_ensure_allocated(&c->by_use, dns_cache_item_use_prioq_compare_func);
+        if (r < 0)
+                return r;
+
         r = hashmap_ensure_allocated(&c->by_key, &dns_resource_key_hash_ops);
         if (r < 0)
                 return r;
@@ -272,6 +316,13 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
         if (r < 0)
                 return r;
 
+        i->last_use = ++c->n_use;
+        r = prioq_put(c->by_use, i, &i->use_prioq_idx);
+        if (r < 0) {
+                prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                return r;
+        }
+
         first = hashmap_get(c->by_key, i->key);
         if (first) {
                 _unused_ _cleanup_(dns_resource_key_unrefp) DnsResourceKey *k = NULL;
@@ -293,6 +344,7 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
                 r = hashmap_put(c->by_key, i->key, i);
                 if (r < 0) {
                         prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                        prioq_remove(c->by_use, i, &i->use_prioq_idx);
                         return r;
                 }
         }
@@ -397,6 +449,7 @@ static void dns_cache_item_update_positive(
         i->owner_address = *owner_address;
 
         prioq_reshuffle(c->by_expiry, i, &i->prioq_idx);
+        dns_cache_item_use(c, i);
 }
 
 static int dns_cache_put_positive(
@@ -486,6 +539,7 @@ static int dns_cache_put_positive(
                 .owner_family = owner_family,
                 .owner_address = *owner_address,
                 .prioq_idx = PRIOQ_IDX_NULL,
+                .use_prioq_idx = PRIOQ_IDX_NULL,
         };
 
         r = dns_cache_link_item(c, i);
@@ -568,6 +622,7 @@ static int dns_cache_put_negative(
                 .owner_family = owner_family,
                 .owner_address = *owner_address,
                 .prioq_idx = PRIOQ_IDX_NULL,
+                .use_prioq_idx = PRIOQ_IDX_NULL,
                 .rcode = rcode,
                 .answer = dns_answer_ref(answer),
                 .full_packet = dns_packet_ref(full_packet),
@@ -1017,6 +1072,8 @@ int dns_cache_lookup(
                         goto miss;
                 }
 
+                dns_cache_item_use(c, j);
+
                 if (j->type == DNS_CACHE_NXDOMAIN)
                         nxdomain = true;
                 else if (j->type == DNS_CACHE_RCODE)
@@ -1343,3 +1400,7 @@ unsigned dns_cache_size(DnsCache *cache) {
 
         return hashmap_size(cache->by_key);
 }
+
+uint64_t dns_cache_flush_generation(void) {
+        return cache_flush_generation;
+}
@@ -11,6 +11,9 @@
 typedef struct DnsCache {
         Hashmap *by_key;
         Prioq *by_expiry;
+        Prioq *by_use;
+        uint64_t n_use;
+        unsigned max_entries; /* 0 means the built-in default */
         unsigned n_hit;
         unsigned n_miss;
 } DnsCache;
@@ -52,5 +55,6 @@ void dns_cache_dump(DnsCache *cache, FILE *f);
 bool dns_cache_is_empty(DnsCache *cache);
 
 unsigned dns_cache_size(DnsCache *cache);
+uint64_t dns_cache_flush_generation(void);
 
 int dns_cache_export_shared_to_packet(DnsCache *cache, DnsPacket *p);
@@ -10,6 +10,8 @@
 #include "openssl-util.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
+#include "set.h"
+#include "siphash24.h"
 #include "sort-util.h"
 #include "string-table.h"
 
@@ -30,6 +32,9 @@ DEFINE_TRIVIAL_CLEANUP_FUNC_FULL(EC_KEY*, EC_KEY_free, NULL);
 /* Maximum number of NSEC3 iterations we'll do. RFC5155 says 2500 shall be the maximum useful value */
 #define NSEC3_ITERATIONS_MAX 2500
 
+/* Maximum number of successfully verified signatures we remember */
+#define VERIFY_CACHE_MAX 1024U
+
 /*
  * The DNSSEC Chain of trust:
  *
@@ -978,6 +983,119 @@ static int dnssec_rrset_verify_sig(
         }
 }
 
+/* The public key operations are by far the most expensive part of validation, and the same signatures
+ * are checked over and over again, e.g. those of the DNSKEY RRsets of popular zones, or those of RRsets
+ * looked up again after their TTL elapsed but before their signature expired. Hence, remember which
+ * signatures were found to be valid. The signed data includes the validity window of the signature and
+ * the key tag, so the outcome depends on nothing but the signed data, the signature and the key, which
+ * are all part of the entry. Whether the signature is currently valid is still checked each time. */
+
+typedef struct VerifyCacheEntry {
+        size_t sig_data_size;
+        size_t signature_size;
+        size_t key_size;
+        uint8_t data[];
+} VerifyCacheEntry;
+
+static void verify_cache_entry_hash_func(const VerifyCacheEntry *e, struct siphash *state) {
+        siphash24_compress(&e->sig_data_size, sizeof(e->sig_data_size), state);
+        siphash24_compress(&e->signature_size, sizeof(e->signature_size), state);
+        siphash24_compress(&e->key_size, sizeof(e->key_size), state);
+        siphash24_compress(e->data, e->sig_data_size + e->signature_size + e->key_size, state);
+}
+
+static int verify_cache_entry_compare_func(const VerifyCacheEntry *a, const VerifyCacheEntry *b) {
+        int r;
+
+        r = CMP(a->sig_data_size, b->sig_data_size);
+        if (r != 0)
+                return r;
+
+        r = CMP(a->signature_size, b->signature_size);
+        if (r != 0)
+                return r;
+
+        r = CMP(a->key_size, b->key_size);
+        if (r != 0)
+                return r;
+
+        return memcmp(a->data, b->data, a->sig_data_size + a->signature_size + a->key_size);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(
+                verify_cache_hash_ops,
+                VerifyCacheEntry,
+                verify_cache_entry_hash_func,
+                verify_cache_entry_compare_func,
+                free);
+
+static Set *verify_cache = NULL;
+
+static VerifyCacheEntry* verify_cache_entry_new(
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey,
+                const char *sig_data,
+                size_t sig_size) {
+
+        VerifyCacheEntry *e;
+
+        assert(rrsig);
+        assert(dnskey);
+        assert(sig_data);
+
+        e = malloc(offsetof(VerifyCacheEntry, data) + sig_size + rrsig->rrsig.signature_size + dnskey->dnskey.key_size);
+        if (!e)
+                return NULL;
+
+        e->sig_data_size = sig_size;
+        e->signature_size = rrsig->rrsig.signature_size;
+        e->key_size = dnskey->dnskey.key_size;
+
+        mempcpy_safe(mempcpy_safe(mempcpy_safe(e->data, sig_data, sig_size),
+                                  rrsig->rrsig.signature, rrsig->rrsig.signature_size),
+                     dnskey->dnskey.key, dnskey->dnskey.key_size);
+
+        return e;
+}
+
+static int dnssec_rrset_verify_sig_cached(
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey,
+                const char *sig_data,
+                size_t sig_size) {
+
+        _cleanup_free_ VerifyCacheEntry *e = NULL;
+        int r;
+
+        assert(rrsig);
+        assert(dnskey);
+
+        e = verify_cache_entry_new(rrsig, dnskey, sig_data, sig_size);
+        if (!e)
+                return -ENOMEM;
+
+        if (set_contains(verify_cache, e))
+                return 1;
+
+        r = dnssec_rrset_verify_sig(rrsig, dnskey, sig_data, sig_size);
+        if (r <= 0)
+                return r;
+
+        /* Only remember valid signatures, forged ones are cheap to come up with, and would only push out
+         * the valid ones. */
+        if (set_size(verify_cache) >= VERIFY_CACHE_MAX)
+                set_clear(verify_cache);
+
+        if (set_ensure_consume(&verify_cache, &verify_cache_hash_ops, TAKE_PTR(e)) < 0)
+                log_debug("Failed to remember verified signature, ignoring.");
+
+        return r;
+}
+
+void dnssec_verify_cache_flush(void) {
+        verify_cache = set_free(verify_cache);
+}
+
 int dnssec_verify_rrset(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
@@ -1099,7 +1217,7 @@ int dnssec_verify_rrset(
         if (r < 0)
                 return r;
 
-        r = dnssec_rrset_verify_sig(rrsig, dnskey, sig_data, sig_size);
+        r = dnssec_rrset_verify_sig_cached(rrsig, dnskey, sig_data, sig_size);
         if (r == -EOPNOTSUPP) {
                 *result = DNSSEC_UNSUPPORTED_ALGORITHM;
                 return 0;
@@ -2490,6 +2608,9 @@ int dnssec_test_positive_wildcard(
 
 #else
 
+void dnssec_verify_cache_flush(void) {
+}
+
 int dnssec_verify_rrset(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
@@ -725,10 +725,40 @@ int dns_packet_append_opt(
                 bool edns0_do,
                 bool include_rfc6975,
                 const char *nsid,
+                bool tcp_keepalive,
                 int rcode,
                 size_t *ret_start) {
 
-        size_t saved_size;
+        static const uint8_t rfc6975[] = {
+
+                0, 5, /* OPTION_CODE: DAU */
+#if PREFER_OPENSSL || (HAVE_GCRYPT && GCRYPT_VERSION_NUMBER >= 0x010600)
+                0, 7, /* LIST_LENGTH */
+#else
+                0, 6, /* LIST_LENGTH */
+#endif
+                DNSSEC_ALGORITHM_RSASHA1,
+                DNSSEC_ALGORITHM_RSASHA1_NSEC3_SHA1,
+                DNSSEC_ALGORITHM_RSASHA256,
+                DNSSEC_ALGORITHM_RSASHA512,
+                DNSSEC_ALGORITHM_ECDSAP256SHA256,
+                DNSSEC_ALGORITHM_ECDSAP384SHA384,
+#if PREFER_OPENSSL || (HAVE_GCRYPT && GCRYPT_VERSION_NUMBER >= 0x010600)
+                DNSSEC_ALGORITHM_ED25519,
+#endif
+
+                0, 6, /* OPTION_CODE: DHU */
+                0, 3, /* LIST_LENGTH */
+                DNSSEC_DIGEST_SHA1,
+                DNSSEC_DIGEST_SHA256,
+                DNSSEC_DIGEST_SHA384,
+
+                0, 7, /* OPTION_CODE: N3U */
+                0, 1, /* LIST_LENGTH */
+                NSEC3_ALGORITHM_SHA1,
+        };
+
+        size_t saved_size, rdlength;
         int r;
 
         assert(p);
@@ -769,70 +799,55 @@ int dns_packet_append_opt(
         if (r < 0)
                 goto fail;
 
-        if (edns0_do && include_rfc6975) {
-                /* If DO is on and this is requested, also append RFC6975 Algorithm data. This is supposed to
-                 * be done on queries, not on replies, hencer callers should turn this off when finishing off
-                 * replies. */
-
-                static const uint8_t rfc6975[] = {
-
-                        0, 5, /* OPTION_CODE: DAU */
-#if PREFER_OPENSSL || (HAVE_GCRYPT && GCRYPT_VERSION_NUMBER >= 0x010600)
-                        0, 7, /* LIST_LENGTH */
-#else
-                        0, 6, /* LIST_LENGTH */
-#endif
-                        DNSSEC_ALGORITHM_RSASHA1,
-                        DNSSEC_ALGORITHM_RSASHA1_NSEC3_SHA1,
-                        DNSSEC_ALGORITHM_RSASHA256,
-                        DNSSEC_ALGORITHM_RSASHA512,
-                        DNSSEC_ALGORITHM_ECDSAP256SHA256,
-                        DNSSEC_ALGORITHM_ECDSAP384SHA384,
-#if PREFER_OPENSSL || (HAVE_GCRYPT && GCRYPT_VERSION_NUMBER >= 0x010600)
-                        DNSSEC_ALGORITHM_ED25519,
-#endif
-
-                        0, 6, /* OPTION_CODE: DHU */
-                        0, 3, /* LIST_LENGTH */
-                        DNSSEC_DIGEST_SHA1,
-                        DNSSEC_DIGEST_SHA256,
-                        DNSSEC_DIGEST_SHA384,
+        /* If DO is on and this is requested, also append RFC6975 Algorithm data. This is supposed to be done
+         * on queries, not on replies, hencer callers should turn this off when finishing off replies. */
+        include_rfc6975 = include_rfc6975 && edns0_do;
+
+        rdlength = 0;
+        if (include_rfc6975)
+                rdlength += sizeof(rfc6975);
+        else if (nsid)
+                rdlength += 4 + strlen(nsid);
+        if (tcp_keepalive)
+                rdlength += 4;
+        if (rdlength > UINT16_MAX) {
+                r = -E2BIG;
+                goto fail;
+        }
 
-                        0, 7, /* OPTION_CODE: N3U */
-                        0, 1, /* LIST_LENGTH */
-                        NSEC3_ALGORITHM_SHA1,
-                };
+        r = dns_packet_append_uint16(p, rdlength, NULL); /* RDLENGTH */
+        if (r < 0)
+                goto fail;
 
-                r = dns_packet_append_uint16(p, sizeof(rfc6975), NULL); /* RDLENGTH */
+        if (include_rfc6975) {
+                r = dns_packet_append_blob(p, rfc6975, sizeof(rfc6975), NULL); /* the payload, as defined above */
                 if (r < 0)
                         goto fail;
 
-                r = dns_packet_append_blob(p, rfc6975, sizeof(rfc6975), NULL); /* the payload, as defined above */
-
         } else if (nsid) {
-
-                if (strlen(nsid) > UINT16_MAX - 4) {
-                        r = -E2BIG;
+                r = dns_packet_append_uint16(p, 3, NULL); /* OPTION-CODE: NSID */
+                if (r < 0)
                         goto fail;
-                }
 
-                r = dns_packet_append_uint16(p, 4 + strlen(nsid), NULL); /* RDLENGTH */
+                r = dns_packet_append_uint16(p, strlen(nsid), NULL); /* OPTION-LENGTH */
                 if (r < 0)
                         goto fail;
 
-                r = dns_packet_append_uint16(p, 3, NULL); /* OPTION-CODE: NSID */
+                r = dns_packet_append_blob(p, nsid, strlen(nsid), NULL);
                 if (r < 0)
                         goto fail;
+        }
 
-                r = dns_packet_append_uint16(p, strlen(nsid), NULL); /* OPTION-LENGTH */
+        if (tcp_keepalive) {
+                /* RFC7828: signal that we'd like to keep the TCP connection open. Queries carry no timeout. */
+                r = dns_packet_append_uint16(p, 11, NULL); /* OPTION-CODE: edns-tcp-keepalive */
                 if (r < 0)
                         goto fail;
 
-                r = dns_packet_append_blob(p, nsid, strlen(nsid), NULL);
-        } else
-                r = dns_packet_append_uint16(p, 0, NULL);
-        if (r < 0)
-                goto fail;
+                r = dns_packet_append_uint16(p, 0, NULL); /* OPTION-LENGTH */
+                if (r < 0)
+                        goto fail;
+        }
 
         DNS_PACKET_HEADER(p)->arcount = htobe16(DNS_PACKET_ARCOUNT(p) + 1);
 
@@ -1469,6 +1484,10 @@ int dns_packet_read_name(
                         if (r < 0)
                                 return r;
 
+                        /* If the caller just wants to skip over the name, don't bother with the string */
+                        if (!ret)
+                                continue;
+
                         if (!GREEDY_REALLOC(name, n + !first + DNS_LABEL_ESCAPED_MAX))
                                 return -ENOMEM;
 
@@ -1505,16 +1524,16 @@ int dns_packet_read_name(
                         return -EBADMSG;
         }
 
-        if (!GREEDY_REALLOC(name, n + 1))
-                return -ENOMEM;
-
-        name[n] = 0;
-
         if (after_rindex != 0)
                 p->rindex= after_rindex;
 
-        if (ret)
+        if (ret) {
+                if (!GREEDY_REALLOC(name, n + 1))
+                        return -ENOMEM;
+
+                name[n] = 0;
                 *ret = TAKE_PTR(name);
+        }
         if (ret_start)
                 *ret_start = rewinder.saved_rindex;
 
@@ -1630,7 +1649,7 @@ int dns_packet_read_key(
         uint16_t class, type;
         int r;
 
-        r = dns_packet_read_name(p, &name, true, NULL);
+        r = dns_packet_read_name(p, ret ? &name : NULL, true, NULL);
         if (r < 0)
                 return r;
 
@@ -2567,6 +2586,53 @@ bool dns_packet_equal(const DnsPacket *a, const DnsPacket *b) {
         return dns_packet_compare_func(a, b) == 0;
 }
 
+int dns_packet_get_tcp_keepalive(DnsPacket *p, usec_t *ret) {
+        const uint8_t *d;
+        size_t l;
+
+        assert(p);
+        assert(ret);
+
+        /* Returns 1 and the idle timeout if the packet carries an RFC7828 edns-tcp-keepalive option with a
+         * timeout, i.e. if this is a reply of a server that supports it, and 0 otherwise. */
+
+        if (!p->opt)
+                return false;
+
+        d = p->opt->opt.data;
+        l = p->opt->opt.data_size;
+
+        while (l > 0) {
+                uint16_t code, length;
+
+                if (l < 4U)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "EDNS0 variable part has invalid size.");
+
+                code = unaligned_read_be16(d);
+                length = unaligned_read_be16(d + 2);
+
+                if (l < 4U + length)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Truncated option in EDNS0 variable part.");
+
+                if (code == 11) {
+                        if (length != 2)
+                                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                                       "TCP keepalive option without timeout in DNS reply.");
+
+                        /* The timeout is in units of 100ms */
+                        *ret = unaligned_read_be16(d + 4) * 100 * USEC_PER_MSEC;
+                        return true;
+                }
+
+                d += 4U + length;
+                l -= 4U + length;
+        }
+
+        return false;
+}
+
 int dns_packet_has_nsid_request(DnsPacket *p) {
         bool has_nsid = false;
         const uint8_t *d;
@@ -10,6 +10,7 @@
 #include "resolved-dns-query.h"
 #include "resolved-dns-synthesize.h"
 #include "resolved-etc-hosts.h"
+#include "stats-util.h"
 #include "string-util.h"
 
 #define QUERIES_MAX 2048
@@ -575,6 +576,10 @@ int dns_query_make_auxiliary(DnsQuery *q, DnsQuery *auxiliary_for) {
         return 0;
 }
 
+DEFINE_STATS_COUNTER(stats_queries, "resolve.queries");
+DEFINE_STATS_COUNTER(stats_queries_failed, "resolve.queries_failed");
+DEFINE_STATS_HISTOGRAM(stats_query, "resolve.query");
+
 void dns_query_complete(DnsQuery *q, DnsTransactionState state) {
         assert(q);
         assert(!DNS_TRANSACTION_IS_LIVE(state));
@@ -585,6 +590,12 @@ void dns_query_complete(DnsQuery *q, DnsTransactionState state) {
 
         q->state = state;
 
+        stats_counter_inc(&stats_queries);
+        if (state != DNS_TRANSACTION_SUCCESS)
+                stats_counter_inc(&stats_queries_failed);
+        if (q->begin_usec > 0)
+                stats_histogram_add_since(&stats_query, q->begin_usec);
+
         dns_query_stop(q);
         if (q->complete)
                 q->complete(q);
@@ -725,6 +736,9 @@ int dns_query_go(DnsQuery *q) {
         if (q->state != DNS_TRANSACTION_NULL)
                 return 0;
 
+        if (q->begin_usec == 0)
+                q->begin_usec = now(CLOCK_MONOTONIC);
+
         r = dns_query_try_etc_hosts(q);
         if (r < 0)
                 return r;
@@ -1131,6 +1145,8 @@ int dns_query_process_cname_one(DnsQuery *q) {
                 q->previous_redirect_non_confidential = true;
         if (!FLAGS_SET(q->answer_query_flags, SD_RESOLVED_SYNTHETIC))
                 q->previous_redirect_non_synthetic = true;
+        if ((q->answer_query_flags & SD_RESOLVED_FROM_MASK) != SD_RESOLVED_FROM_CACHE)
+                q->previous_redirect_non_cached = true;
 
         /* OK, let's actually follow the CNAME */
         r = dns_query_cname_redirect(q, cname);
@@ -1267,3 +1283,10 @@ bool dns_query_fully_authoritative(DnsQuery *q) {
          * explicitly check previous redirects here.) */
         return (q->answer_query_flags & SD_RESOLVED_FROM_MASK & ~(SD_RESOLVED_FROM_TRUST_ANCHOR | SD_RESOLVED_FROM_ZONE)) == 0;
 }
+
+bool dns_query_fully_cached(DnsQuery *q) {
+        assert(q);
+
+        /* Returns true if the answer, including all CNAME/DNAME redirections, was taken from the cache only */
+        return (q->answer_query_flags & SD_RESOLVED_FROM_MASK) == SD_RESOLVED_FROM_CACHE && !q->previous_redirect_non_cached;
+}
@@ -77,6 +77,7 @@ struct DnsQuery {
 
         DnsTransactionState state;
         int answer_errno; /* if state is DNS_TRANSACTION_ERRNO */
+        usec_t begin_usec; /* CLOCK_MONOTONIC, when the query was started */
 
         unsigned block_ready;
 
@@ -86,6 +87,7 @@ struct DnsQuery {
         bool previous_redirect_unauthenticated:1;
         bool previous_redirect_non_confidential:1;
         bool previous_redirect_non_synthetic:1;
+        bool previous_redirect_non_cached:1;
         bool request_address_valid:1;
 
         /* Bus + Varlink client information */
@@ -149,6 +151,7 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(DnsQuery*, dns_query_free);
 bool dns_query_fully_authenticated(DnsQuery *q);
 bool dns_query_fully_confidential(DnsQuery *q);
 bool dns_query_fully_authoritative(DnsQuery *q);
+bool dns_query_fully_cached(DnsQuery *q);
 
 static inline uint64_t dns_query_reply_flags_make(DnsQuery *q) {
         assert(q);
@@ -8,6 +8,7 @@
 #include "escape.h"
 #include "hexdecoct.h"
 #include "memory-util.h"
+#include "mempool.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
 #include "resolved-dns-rr.h"
@@ -368,10 +369,16 @@ bool dns_resource_key_reduce(DnsResourceKey **a, DnsResourceKey **b) {
         return true;
 }
 
+/* The cache holds lots of these, with the rest of their data allocated separately, hence keep them together
+ * rather than scattered between the short-lived allocations of packet processing, see
+ * dns_resource_record_trim_pool() */
+DEFINE_MEMPOOL(dns_resource_record_pool, DnsResourceRecord, 64);
+
 DnsResourceRecord* dns_resource_record_new(DnsResourceKey *key) {
         DnsResourceRecord *rr;
+        bool from_pool;
 
-        rr = new(DnsResourceRecord, 1);
+        rr = mempool_alloc0_tile_or_malloc(&dns_resource_record_pool, &from_pool);
         if (!rr)
                 return NULL;
 
@@ -381,6 +388,7 @@ DnsResourceRecord* dns_resource_record_new(DnsResourceKey *key) {
                 .expiry = USEC_INFINITY,
                 .n_skip_labels_signer = UINT8_MAX,
                 .n_skip_labels_source = UINT8_MAX,
+                .from_pool = from_pool,
         };
 
         return rr;
@@ -488,11 +496,15 @@ static DnsResourceRecord* dns_resource_record_free(DnsResourceRecord *rr) {
         }
 
         free(rr->to_string);
-        return mfree(rr);
+        return mempool_free_tile_or_free(&dns_resource_record_pool, rr, rr->from_pool);
 }
 
 DEFINE_TRIVIAL_REF_UNREF_FUNC(DnsResourceRecord, dns_resource_record, dns_resource_record_free);
 
+void dns_resource_record_trim_pool(void) {
+        (void) mempool_trim(&dns_resource_record_pool);
+}
+
 int dns_resource_record_new_reverse(DnsResourceRecord **ret, int family, const union in_addr_union *address, const char *hostname) {
         _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
         _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
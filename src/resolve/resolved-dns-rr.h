@@ -105,6 +105,7 @@ struct DnsResourceRecord {
 
         bool unparsable;
         bool wire_format_canonical;
+        bool from_pool;
 
         void *wire_format;
         size_t wire_format_size;
@@ -328,6 +329,7 @@ DnsResourceRecord* dns_resource_record_new(DnsResourceKey *key);
 DnsResourceRecord* dns_resource_record_new_full(uint16_t class, uint16_t type, const char *name);
 DnsResourceRecord* dns_resource_record_ref(DnsResourceRecord *rr);
 DnsResourceRecord* dns_resource_record_unref(DnsResourceRecord *rr);
+void dns_resource_record_trim_pool(void);
 
 #define DNS_RR_REPLACE(a, b)                    \
         do {                                    \
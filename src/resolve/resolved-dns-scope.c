@@ -41,6 +41,7 @@ int dns_scope_new(Manager *m, DnsScope **ret, Link *l, DnsProtocol protocol, int
                 .protocol = protocol,
                 .family = family,
                 .resend_timeout = MULTICAST_RESEND_TIMEOUT_MIN_USEC,
+                .cache.max_entries = m->cache_max_entries,
         };
 
         if (protocol == DNS_PROTOCOL_DNS) {
@@ -115,6 +116,9 @@ DnsScope* dns_scope_free(DnsScope *s) {
 
         sd_event_source_disable_unref(s->announce_event_source);
 
+        dns_answer_unref(s->mdns_delayed_answer);
+        sd_event_source_disable_unref(s->mdns_delayed_answer_event_source);
+
         dns_cache_flush(&s->cache);
         dns_zone_flush(&s->zone);
 
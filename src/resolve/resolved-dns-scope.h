@@ -45,6 +45,10 @@ struct DnsScope {
 
         sd_event_source *announce_event_source;
 
+        /* mDNS answers with shared records, which are sent together after a random delay */
+        DnsAnswer *mdns_delayed_answer;
+        sd_event_source *mdns_delayed_answer_event_source;
+
         RateLimit ratelimit;
 
         usec_t resend_timeout;
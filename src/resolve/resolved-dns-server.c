@@ -11,6 +11,7 @@
 #include "siphash24.h"
 #include "string-table.h"
 #include "string-util.h"
+#include "util.h"
 
 /* The amount of time to wait before retrying with a full feature set */
 #define DNS_SERVER_FEATURE_GRACE_PERIOD_MAX_USEC (6 * USEC_PER_HOUR)
@@ -290,6 +291,33 @@ void dns_server_packet_received(DnsServer *s, int protocol, DnsServerFeatureLeve
                 s->received_udp_fragment_max = fragsize;
 }
 
+unsigned dns_server_rtt_histogram_bucket(usec_t rtt) {
+        usec_t msec = rtt / USEC_PER_MSEC;
+
+        if (msec == 0)
+                return 0;
+
+        return MIN(1U + log2u64(msec), DNS_SERVER_RTT_HISTOGRAM_MAX - 1U);
+}
+
+void dns_server_packet_rtt(DnsServer *s, usec_t rtt) {
+        assert(s);
+
+        /* Invoked with the time it took to get a reply to a UDP query, or the time we waited in vain for
+         * one. Keep a smoothed average and its variation, as TCP does (RFC 6298, section 2), so that we
+         * know which of the configured servers reply the fastest. */
+
+        if (s->rtt_usec == 0) {
+                s->rtt_usec = MAX(rtt, 1U);
+                s->rtt_var_usec = rtt / 2;
+        } else {
+                s->rtt_var_usec = (3 * s->rtt_var_usec + (s->rtt_usec > rtt ? s->rtt_usec - rtt : rtt - s->rtt_usec)) / 4;
+                s->rtt_usec = MAX((7 * s->rtt_usec + rtt) / 8, 1U);
+        }
+
+        s->n_rtt_histogram[dns_server_rtt_histogram_bucket(rtt)]++;
+}
+
 void dns_server_packet_lost(DnsServer *s, int protocol, DnsServerFeatureLevel level) {
         assert(s);
         assert(s->manager);
@@ -591,7 +619,7 @@ DnsServerFeatureLevel dns_server_possible_feature_level(DnsServer *s) {
         return s->possible_feature_level;
 }
 
-int dns_server_adjust_opt(DnsServer *server, DnsPacket *packet, DnsServerFeatureLevel level) {
+int dns_server_adjust_opt(DnsServer *server, DnsPacket *packet, DnsServerFeatureLevel level, bool tcp) {
         size_t packet_size, udp_size;
         bool edns_do;
         int r;
@@ -642,7 +670,9 @@ int dns_server_adjust_opt(DnsServer *server, DnsPacket *packet, DnsServerFeature
 
         log_debug("Announcing packet size %zu in egress EDNS(0) packet.", packet_size);
 
-        return dns_packet_append_opt(packet, packet_size, edns_do, /* include_rfc6975 = */ true, NULL, 0, NULL);
+        /* On TCP connections, ask the server to keep the connection open for further queries, see RFC7828.
+         * This must not be sent via UDP. */
+        return dns_packet_append_opt(packet, packet_size, edns_do, /* include_rfc6975 = */ true, NULL, /* tcp_keepalive = */ tcp, 0, NULL);
 }
 
 int dns_server_ifindex(const DnsServer *s) {
@@ -827,6 +857,26 @@ DnsServer *dns_server_find(DnsServer *first, int family, const union in_addr_uni
         return NULL;
 }
 
+DnsServer *dns_server_pick_next(DnsServer *first, DnsServer *current) {
+        DnsServer *best = NULL;
+
+        assert(current);
+
+        /* Picks the server to switch to when the current one failed: the one with the lowest round-trip
+         * time among the others, where servers we never measured are tried first. Servers which are
+         * equally fast are picked in the configured order, starting after the current one, hence if we
+         * know nothing about the round-trip times the servers are simply tried in turn. */
+
+        if (!current->linked)
+                return first;
+
+        for (DnsServer *s = current->servers_next ?: first; s && s != current; s = s->servers_next ?: first)
+                if (!best || s->rtt_usec < best->rtt_usec)
+                        best = s;
+
+        return best ?: first;
+}
+
 DnsServer *manager_get_first_dns_server(Manager *m, DnsServerType t) {
         assert(m);
 
@@ -879,12 +929,10 @@ DnsServer *manager_get_dns_server(Manager *m) {
             manager_server_is_stub(m, m->current_dns_server))
                 manager_set_dns_server(m, m->dns_servers);
 
+        /* Skip over our own stubs strictly in the configured order, so that we stop once we reached the end */
         while (m->current_dns_server &&
-               manager_server_is_stub(m, m->current_dns_server)) {
-                manager_next_dns_server(m, NULL);
-                if (m->current_dns_server == m->dns_servers)
-                        manager_set_dns_server(m, NULL);
-        }
+               manager_server_is_stub(m, m->current_dns_server))
+                manager_set_dns_server(m, m->current_dns_server->linked ? m->current_dns_server->servers_next : NULL);
 
         if (!m->current_dns_server) {
                 bool found = false;
@@ -917,18 +965,11 @@ void manager_next_dns_server(Manager *m, DnsServer *if_current) {
         if (!m->current_dns_server)
                 return;
 
-        /* Change to the next one, but make sure to follow the linked list only if the server is still
-         * linked. */
-        if (m->current_dns_server->linked && m->current_dns_server->servers_next) {
-                manager_set_dns_server(m, m->current_dns_server->servers_next);
-                return;
-        }
-
-        /* If there was no next one, then start from the beginning of the list */
-        if (m->current_dns_server->type == DNS_SERVER_FALLBACK)
-                manager_set_dns_server(m, m->fallback_dns_servers);
-        else
-                manager_set_dns_server(m, m->dns_servers);
+        /* Change to the fastest other one, or start from the beginning of the list if the server is not
+         * linked anymore. */
+        manager_set_dns_server(m, dns_server_pick_next(
+                                       m->current_dns_server->type == DNS_SERVER_FALLBACK ? m->fallback_dns_servers : m->dns_servers,
+                                       m->current_dns_server));
 }
 
 DnssecMode dns_server_get_dnssec_mode(DnsServer *s) {
@@ -1031,6 +1072,10 @@ void dns_server_dump(DnsServer *s, FILE *f) {
         fputs(yes_no(dns_server_dnssec_supported(s)), f);
         fputc('\n', f);
 
+        fputs("\tRound-trip time: ", f);
+        fputs(s->rtt_usec > 0 ? FORMAT_TIMESPAN(s->rtt_usec, USEC_PER_MSEC) : "n/a", f);
+        fputc('\n', f);
+
         fprintf(f,
                 "\tMaximum UDP fragment size received: %zu\n"
                 "\tFailed UDP attempts: %u\n"
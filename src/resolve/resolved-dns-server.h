@@ -44,6 +44,9 @@ typedef enum DnsServerFeatureLevel {
 #define DNS_SERVER_FEATURE_LEVEL_IS_DNSSEC(x) ((x) >= DNS_SERVER_FEATURE_LEVEL_DO)
 #define DNS_SERVER_FEATURE_LEVEL_IS_UDP(x) IN_SET(x, DNS_SERVER_FEATURE_LEVEL_UDP, DNS_SERVER_FEATURE_LEVEL_EDNS0, DNS_SERVER_FEATURE_LEVEL_DO)
 
+/* <1ms, <2ms, <4ms, … <2048ms, and anything longer */
+#define DNS_SERVER_RTT_HISTOGRAM_MAX 13U
+
 const char* dns_server_feature_level_to_string(int i) _const_;
 int dns_server_feature_level_from_string(const char *s) _pure_;
 
@@ -76,6 +79,14 @@ struct DnsServer {
 
         size_t received_udp_fragment_max;   /* largest packet or fragment (without IP/UDP header) we saw so far */
 
+        /* Smoothed round-trip time of UDP queries and its variation, as in RFC 6298. Zero if not measured yet. */
+        usec_t rtt_usec;
+        usec_t rtt_var_usec;
+
+        /* Number of round-trip times measured, by their binary logarithm in milliseconds. The first bucket
+         * counts replies within 1ms, the last one replies which took longer and timeouts. */
+        unsigned n_rtt_histogram[DNS_SERVER_RTT_HISTOGRAM_MAX];
+
         unsigned n_failed_udp;
         unsigned n_failed_tcp;
         unsigned n_failed_tls;
@@ -127,10 +138,12 @@ void dns_server_packet_rcode_downgrade(DnsServer *s, DnsServerFeatureLevel level
 void dns_server_packet_invalid(DnsServer *s, DnsServerFeatureLevel level);
 void dns_server_packet_do_off(DnsServer *s, DnsServerFeatureLevel level);
 void dns_server_packet_udp_fragmented(DnsServer *s, size_t fragsize);
+unsigned dns_server_rtt_histogram_bucket(usec_t rtt);
+void dns_server_packet_rtt(DnsServer *s, usec_t rtt);
 
 DnsServerFeatureLevel dns_server_possible_feature_level(DnsServer *s);
 
-int dns_server_adjust_opt(DnsServer *server, DnsPacket *packet, DnsServerFeatureLevel level);
+int dns_server_adjust_opt(DnsServer *server, DnsPacket *packet, DnsServerFeatureLevel level, bool tcp);
 
 const char *dns_server_string(DnsServer *server);
 const char *dns_server_string_full(DnsServer *server);
@@ -142,6 +155,7 @@ bool dns_server_dnssec_supported(DnsServer *server);
 void dns_server_warn_downgrade(DnsServer *server);
 
 DnsServer *dns_server_find(DnsServer *first, int family, const union in_addr_union *in_addr, uint16_t port, int ifindex, const char *name);
+DnsServer *dns_server_pick_next(DnsServer *first, DnsServer *current);
 
 void dns_server_unlink_all(DnsServer *first);
 bool dns_server_unlink_marked(DnsServer *first);
@@ -27,6 +27,9 @@ typedef struct DnsStubListenerExtra DnsStubListenerExtra;
 /* Once connections are established apply this timeout once nothing happens anymore */
 #define DNS_STREAM_ESTABLISHED_TIMEOUT_USEC (10 * USEC_PER_SEC)
 
+/* Never keep idle connections open longer than this, even if the server would permit it (RFC7828) */
+#define DNS_STREAM_KEEPALIVE_TIMEOUT_MAX_USEC (2 * USEC_PER_MINUTE)
+
 typedef enum DnsStreamType {
         DNS_STREAM_LOOKUP,        /* Outgoing connection to a classic DNS server */
         DNS_STREAM_LLMNR_SEND,    /* Outgoing LLMNR TCP lookup */
@@ -74,6 +77,7 @@ struct DnsStream {
 
         sd_event_source *io_event_source;
         sd_event_source *timeout_event_source;
+        usec_t established_timeout_usec;
 
         be16_t write_size, read_size;
         DnsPacket *write_packet, *read_packet;
@@ -20,6 +20,25 @@
 /* On the extra stubs, use a more conservative choice */
 #define ADVERTISE_EXTRA_DATAGRAM_SIZE_MAX DNS_PACKET_UNICAST_SIZE_LARGE_MAX
 
+/* How many UDP queries to read from a stub socket in one event loop iteration. Reading them in one go avoids
+ * going through the event loop for each of them when many clients send queries at the same time, while
+ * keeping the latency of other event sources bounded. */
+#define DNS_STUB_UDP_BATCH_MAX 64U
+
+/* The receive buffer of the UDP stub sockets, so that bursts of queries are not dropped while we are busy. */
+#define DNS_STUB_UDP_RCVBUF_SIZE (4U*1024U*1024U)
+
+/* How many replies to remember per stub listener, see dns_stub_remember_reply() */
+#define DNS_STUB_REPLIES_MAX 1024U
+
+typedef struct DnsStubReply {
+        DnsPacket *request;
+        DnsPacket *reply;
+        usec_t timestamp;
+        usec_t until;
+        uint64_t cache_generation;
+} DnsStubReply;
+
 static int manager_dns_stub_fd_extra(Manager *m, DnsStubListenerExtra *l, int type);
 static int manager_dns_stub_fd(Manager *m, int family, const union in_addr_union *listen_address, int type);
 
@@ -86,6 +105,7 @@ DnsStubListenerExtra *dns_stub_listener_extra_free(DnsStubListenerExtra *p) {
         p->tcp_event_source = sd_event_source_disable_unref(p->tcp_event_source);
 
         hashmap_free(p->queries_by_packet);
+        hashmap_free(p->replies_by_packet);
 
         return mfree(p);
 }
@@ -131,6 +151,42 @@ static int stub_packet_compare_func(const DnsPacket *x, const DnsPacket *y) {
 
 DEFINE_HASH_OPS(stub_packet_hash_ops, DnsPacket, stub_packet_hash_func, stub_packet_compare_func);
 
+static DnsStubReply* dns_stub_reply_free(DnsStubReply *r) {
+        if (!r)
+                return NULL;
+
+        dns_packet_unref(r->request);
+        dns_packet_unref(r->reply);
+        return mfree(r);
+}
+DEFINE_TRIVIAL_CLEANUP_FUNC(DnsStubReply*, dns_stub_reply_free);
+
+static void stub_reply_hash_func(const DnsPacket *p, struct siphash *state) {
+        assert(p);
+        assert(p->size >= DNS_PACKET_HEADER_SIZE);
+
+        /* Hash everything but the ID, as identical queries get identical replies */
+        siphash24_compress(&p->ipproto, sizeof(p->ipproto), state);
+        siphash24_compress(DNS_PACKET_DATA(p) + sizeof(uint16_t), p->size - sizeof(uint16_t), state);
+}
+
+static int stub_reply_compare_func(const DnsPacket *x, const DnsPacket *y) {
+        int r;
+
+        r = CMP(x->ipproto, y->ipproto);
+        if (r != 0)
+                return r;
+
+        r = CMP(x->size, y->size);
+        if (r != 0)
+                return r;
+
+        return memcmp(DNS_PACKET_DATA(x) + sizeof(uint16_t), DNS_PACKET_DATA(y) + sizeof(uint16_t), x->size - sizeof(uint16_t));
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(stub_reply_hash_ops, DnsPacket, stub_reply_hash_func, stub_reply_compare_func,
+                                              DnsStubReply, dns_stub_reply_free);
+
 static int reply_add_with_rrsig(
                 DnsAnswer **reply,
                 DnsResourceRecord *rr,
@@ -447,7 +503,7 @@ static int dns_stub_finish_reply_packet(
         assert(p);
 
         if (add_opt) {
-                r = dns_packet_append_opt(p, max_udp_size, edns0_do, /* include_rfc6975 = */ false, nsid ? nsid_string() : NULL, rcode, NULL);
+                r = dns_packet_append_opt(p, max_udp_size, edns0_do, /* include_rfc6975 = */ false, nsid ? nsid_string() : NULL, /* tcp_keepalive = */ false, rcode, NULL);
                 if (r == -EMSGSIZE) /* Hit the size limit? then indicate truncation */
                         tc = true;
                 else if (r < 0)
@@ -588,6 +644,109 @@ static void dns_stub_suppress_duplicate_section_rrs(DnsQuery *q) {
         dns_answer_remove_by_answer_keys(&q->reply_additional, q->reply_authoritative);
 }
 
+static void dns_stub_remember_reply(DnsQuery *q, int rcode, DnsPacket *reply) {
+        _cleanup_(dns_stub_reply_freep) DnsStubReply *e = NULL;
+        Hashmap **replies_by_packet;
+        uint32_t ttl;
+        usec_t ts;
+        int r;
+
+        assert(q);
+        assert(reply);
+
+        /* Remembers replies that were built entirely from cached data, so that identical queries can be
+         * answered by copying the reply, rather than by going through a full lookup and building the reply
+         * packet again. A remembered reply is used as long as all RRs in it are valid, and as long as no
+         * cache was flushed. */
+
+        if (q->question_bypass)
+                return;
+
+        if (!IN_SET(rcode, DNS_RCODE_SUCCESS, DNS_RCODE_NXDOMAIN))
+                return;
+
+        if (!dns_query_fully_cached(q))
+                return;
+
+        if (DNS_PACKET_TC(reply))
+                return;
+
+        ttl = MIN3(dns_answer_min_ttl(q->reply_answer),
+                   dns_answer_min_ttl(q->reply_authoritative),
+                   dns_answer_min_ttl(q->reply_additional));
+        if (IN_SET(ttl, 0, UINT32_MAX)) /* No RRs with a TTL, hence we wouldn't know when to forget this */
+                return;
+
+        replies_by_packet = q->stub_listener_extra ? &q->stub_listener_extra->replies_by_packet : &q->manager->stub_replies_by_packet;
+        if (hashmap_size(*replies_by_packet) >= DNS_STUB_REPLIES_MAX)
+                hashmap_clear(*replies_by_packet);
+
+        ts = now(CLOCK_BOOTTIME);
+
+        e = new(DnsStubReply, 1);
+        if (!e)
+                return (void) log_oom_debug();
+
+        *e = (DnsStubReply) {
+                .request = dns_packet_ref(q->request_packet),
+                .reply = dns_packet_ref(reply),
+                .timestamp = ts,
+                .until = usec_add(ts, ttl * USEC_PER_SEC),
+                .cache_generation = dns_cache_flush_generation(),
+        };
+
+        dns_stub_reply_free(hashmap_remove(*replies_by_packet, e->request));
+
+        r = hashmap_ensure_put(replies_by_packet, &stub_reply_hash_ops, e->request, e);
+        if (r < 0)
+                return (void) log_debug_errno(r, "Failed to remember reply packet, ignoring: %m");
+
+        TAKE_PTR(e);
+}
+
+static int dns_stub_send_remembered_reply(Manager *m, DnsStubListenerExtra *l, DnsStream *s, DnsPacket *p) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *reply = NULL;
+        Hashmap *replies_by_packet;
+        DnsStubReply *e;
+        int r;
+
+        assert(m);
+        assert(p);
+
+        /* Returns 1 if the query was answered with a reply remembered by dns_stub_remember_reply(), and 0 if
+         * it needs to be looked up. */
+
+        replies_by_packet = l ? l->replies_by_packet : m->stub_replies_by_packet;
+
+        e = hashmap_get(replies_by_packet, p);
+        if (!e)
+                return 0;
+
+        if (now(CLOCK_BOOTTIME) >= e->until ||
+            e->cache_generation != dns_cache_flush_generation()) {
+                dns_stub_reply_free(hashmap_remove(replies_by_packet, p));
+                return 0;
+        }
+
+        r = dns_packet_dup(&reply, e->reply);
+        if (r < 0)
+                return r;
+
+        DNS_PACKET_HEADER(reply)->id = DNS_PACKET_ID(p);
+
+        r = dns_packet_patch_ttls(reply, e->timestamp);
+        if (r < 0)
+                return r;
+
+        log_debug("Replying to query for id %u with remembered reply.", DNS_PACKET_ID(p));
+
+        r = dns_stub_send(m, l, s, p, reply);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
 static int dns_stub_send_reply(
                 DnsQuery *q,
                 int rcode) {
@@ -636,6 +795,8 @@ static int dns_stub_send_reply(
         if (r < 0)
                 return log_debug_errno(r, "Failed to build failure packet: %m");
 
+        dns_stub_remember_reply(q, rcode, reply);
+
         return dns_stub_send(q->manager, q->stub_listener_extra, q->request_stream, q->request_packet, reply);
 }
 
@@ -692,15 +853,19 @@ static int dns_stub_patch_bypass_reply_packet(
         assert(original);
         assert(request);
 
-        r = dns_packet_dup(&c, original);
+        /* Extract the packet, so that we know where the OPT field is. The transaction did that already, hence
+         * this is cheap, and we can take the location over to the copy instead of parsing the copy again. */
+        r = dns_packet_extract(original);
         if (r < 0)
                 return r;
 
-        /* Extract the packet, so that we know where the OPT field is */
-        r = dns_packet_extract(c);
+        r = dns_packet_dup(&c, original);
         if (r < 0)
                 return r;
 
+        c->opt_start = original->opt_start;
+        c->opt_size = original->opt_size;
+
         /* Copy over the original client request ID, so that we can make the upstream query look like our own reply. */
         DNS_PACKET_HEADER(c)->id = DNS_PACKET_HEADER(request)->id;
 
@@ -962,6 +1127,14 @@ static void dns_stub_process_query(Manager *m, DnsStubListenerExtra *l, DnsStrea
                 bypass = true;
         }
 
+        if (!bypass) {
+                r = dns_stub_send_remembered_reply(m, l, s, p);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to reply with remembered reply packet, ignoring: %m");
+                else if (r > 0)
+                        return;
+        }
+
         if (bypass)
                 r = dns_query_new(m, &q, NULL, NULL, p, 0,
                                   protocol_flags|
@@ -1016,19 +1189,22 @@ static void dns_stub_process_query(Manager *m, DnsStubListenerExtra *l, DnsStrea
 }
 
 static int on_dns_stub_packet_internal(sd_event_source *s, int fd, uint32_t revents, Manager *m, DnsStubListenerExtra *l) {
-        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
         int r;
 
-        r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
-        if (r <= 0)
-                return r;
+        for (unsigned i = 0; i < DNS_STUB_UDP_BATCH_MAX; i++) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
 
-        if (dns_packet_validate_query(p) > 0) {
-                log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+                r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
+                if (r <= 0)
+                        return r;
 
-                dns_stub_process_query(m, l, NULL, p);
-        } else
-                log_debug("Invalid DNS stub UDP packet, ignoring.");
+                if (dns_packet_validate_query(p) > 0) {
+                        log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+
+                        dns_stub_process_query(m, l, NULL, p);
+                } else
+                        log_debug("Invalid DNS stub UDP packet, ignoring.");
+        }
 
         return 0;
 }
@@ -1170,7 +1346,8 @@ static int manager_dns_stub_fd(
                 r = set_dns_stub_common_tcp_socket_options(fd);
                 if (r < 0)
                         return r;
-        }
+        } else
+                (void) fd_increase_rxbuf(fd, DNS_STUB_UDP_RCVBUF_SIZE);
 
         /* Set slightly different socket options for the non-proxy and the proxy binding. The former we want
          * to be accessible only from the local host, for the latter it's OK if people use NAT redirects or
@@ -1267,7 +1444,8 @@ static int manager_dns_stub_fd_extra(Manager *m, DnsStubListenerExtra *l, int ty
                 r = set_dns_stub_common_tcp_socket_options(fd);
                 if (r < 0)
                         goto fail;
-        }
+        } else
+                (void) fd_increase_rxbuf(fd, DNS_STUB_UDP_RCVBUF_SIZE);
 
         /* Do not set IP_TTL for extra DNS stub listeners, as the address may not be local and in that case
          * people may want ttl > 1. */
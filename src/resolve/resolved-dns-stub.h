@@ -29,6 +29,7 @@ struct DnsStubListenerExtra {
         sd_event_source *tcp_event_source;
 
         Hashmap *queries_by_packet;
+        Hashmap *replies_by_packet;
 };
 
 extern const struct hash_ops dns_stub_listener_extra_hash_ops;
@@ -640,6 +640,36 @@ static int on_stream_complete(DnsStream *s, int error) {
         return 0;
 }
 
+static void dns_stream_apply_tcp_keepalive(DnsStream *s, DnsPacket *p) {
+        usec_t timeout;
+        int r;
+
+        assert(s);
+        assert(p);
+
+        /* If the server told us for how long it keeps the connection open when idle, then keep the
+         * connection around for that long too, so that further lookups can reuse it rather than having
+         * to set up a new connection, which is particularly expensive for DNS-over-TLS. */
+
+        if (!s->server || dns_packet_extract(p) < 0)
+                return;
+
+        r = dns_packet_get_tcp_keepalive(p, &timeout);
+        if (r <= 0)
+                return;
+
+        if (timeout == 0) /* The server is about to close the connection, let's not rely on it. */
+                timeout = DNS_STREAM_ESTABLISHED_TIMEOUT_USEC;
+
+        timeout = MIN(timeout, DNS_STREAM_KEEPALIVE_TIMEOUT_MAX_USEC);
+        if (timeout != s->established_timeout_usec)
+                log_debug("Server %s keeps idle connections open for %s.",
+                          strna(dns_server_string_full(s->server)),
+                          FORMAT_TIMESPAN(timeout, USEC_PER_MSEC));
+
+        s->established_timeout_usec = timeout;
+}
+
 static int on_stream_packet(DnsStream *s, DnsPacket *p) {
         DnsTransaction *t;
 
@@ -648,9 +678,11 @@ static int on_stream_packet(DnsStream *s, DnsPacket *p) {
         assert(p);
 
         t = hashmap_get(s->manager->dns_transactions, UINT_TO_PTR(DNS_PACKET_ID(p)));
-        if (t && t->stream == s) /* Validate that the stream we got this on actually is the stream the
-                                  * transaction was using. */
+        if (t && t->stream == s) { /* Validate that the stream we got this on actually is the stream the
+                                    * transaction was using. */
+                dns_stream_apply_tcp_keepalive(s, p);
                 return dns_transaction_on_stream_packet(t, s, p);
+        }
 
         /* Ignore incorrect transaction id as an old transaction can have been canceled. */
         log_debug("Received unexpected TCP reply packet with id %" PRIu16 ", ignoring.", DNS_PACKET_ID(p));
@@ -693,7 +725,7 @@ static int dns_transaction_emit_tcp(DnsTransaction *t) {
                         if (!dns_server_dnssec_supported(t->server) && dns_type_is_dnssec(dns_transaction_key(t)->type))
                                 return -EOPNOTSUPP;
 
-                        r = dns_server_adjust_opt(t->server, t->sent, t->current_feature_level);
+                        r = dns_server_adjust_opt(t->server, t->sent, t->current_feature_level, /* tcp = */ true);
                         if (r < 0)
                                 return r;
                 }
@@ -787,6 +819,13 @@ static int dns_transaction_emit_tcp(DnsTransaction *t) {
                 return r;
         }
 
+        if (t->scope->protocol == DNS_PROTOCOL_DNS) {
+                if (DNS_SERVER_FEATURE_LEVEL_IS_TLS(t->current_feature_level))
+                        t->scope->manager->n_queries_tls++;
+                else
+                        t->scope->manager->n_queries_tcp++;
+        }
+
         dns_transaction_reset_answer(t);
 
         t->tried_stream = true;
@@ -914,6 +953,7 @@ fail:
 }
 
 static void dns_transaction_process_dnssec(DnsTransaction *t) {
+        usec_t ts;
         int r;
 
         assert(t);
@@ -935,7 +975,9 @@ static void dns_transaction_process_dnssec(DnsTransaction *t) {
 
         /* All our auxiliary DNSSEC transactions are complete now. Try
          * to validate our RRset now. */
+        ts = now(CLOCK_MONOTONIC);
         r = dns_transaction_validate_dnssec(t);
+        t->scope->manager->dnssec_validation_usec += usec_sub_unsigned(now(CLOCK_MONOTONIC), ts);
         if (r == -EBADMSG) {
                 dns_transaction_complete(t, DNS_TRANSACTION_INVALID_REPLY);
                 return;
@@ -1335,6 +1377,11 @@ void dns_transaction_process_reply(DnsTransaction *t, DnsPacket *p, bool encrypt
                  * size/fragment size we got. Which is useful for announcing the EDNS(0) packet size we can
                  * receive to our server. */
                 dns_server_packet_received(t->server, p->ipproto, t->current_feature_level, dns_packet_size_unfragmented(p));
+
+                /* Only take replies to the first attempt into account for the round-trip time, as we cannot
+                 * tell which attempt later replies belong to. */
+                if (p->ipproto == IPPROTO_UDP && t->n_attempts == 1)
+                        dns_server_packet_rtt(t->server, p->timestamp - t->start_usec);
         }
 
         /* See if we know things we didn't know before that indicate we better restart the lookup immediately. */
@@ -1499,7 +1546,7 @@ static int dns_transaction_emit_udp(DnsTransaction *t) {
                 }
 
                 if (!t->bypass) {
-                        r = dns_server_adjust_opt(t->server, t->sent, t->current_feature_level);
+                        r = dns_server_adjust_opt(t->server, t->sent, t->current_feature_level, /* tcp = */ false);
                         if (r < 0)
                                 return r;
                 }
@@ -1510,6 +1557,9 @@ static int dns_transaction_emit_udp(DnsTransaction *t) {
         if (r < 0)
                 return r;
 
+        if (t->scope->protocol == DNS_PROTOCOL_DNS)
+                t->scope->manager->n_queries_udp++;
+
         dns_transaction_reset_answer(t);
 
         return 0;
@@ -1531,6 +1581,8 @@ static int on_transaction_timeout(sd_event_source *s, usec_t usec, void *userdat
                 case DNS_PROTOCOL_DNS:
                         assert(t->server);
                         dns_server_packet_lost(t->server, t->stream ? IPPROTO_TCP : IPPROTO_UDP, t->current_feature_level);
+                        if (!t->stream)
+                                dns_server_packet_rtt(t->server, usec - t->start_usec);
                         break;
 
                 case DNS_PROTOCOL_LLMNR:
@@ -1726,6 +1778,9 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
                                 &t->answer_dnssec_result);
                 if (r < 0)
                         return r;
+
+                manager_cache_lookup_done(t->scope->manager, dns_transaction_key(t)->type, r > 0);
+
                 if (r > 0) {
                         dns_transaction_randomize_answer(t);
 
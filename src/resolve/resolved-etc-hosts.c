@@ -9,6 +9,7 @@
 #include "hostname-util.h"
 #include "resolved-dns-synthesize.h"
 #include "resolved-etc-hosts.h"
+#include "siphash24.h"
 #include "socket-netlink.h"
 #include "stat-util.h"
 #include "string-util.h"
@@ -18,6 +19,9 @@
 /* Recheck /etc/hosts at most once every 2s */
 #define ETC_HOSTS_RECHECK_USEC (2*USEC_PER_SEC)
 
+/* Used to detect when /etc/hosts got replaced by a file with the same contents */
+#define ETC_HOSTS_HASH_KEY SD_ID128_MAKE(5c,0e,6a,93,d1,47,4b,27,8e,31,f2,0b,7d,a5,c4,19)
+
 static void etc_hosts_item_free(EtcHostsItem *item) {
         strv_free(item->names);
         free(item);
@@ -250,28 +254,34 @@ static void strip_localhost(EtcHosts *hosts) {
         }
 }
 
-int etc_hosts_parse(EtcHosts *hosts, FILE *f) {
+static int etc_hosts_parse_buffer(EtcHosts *hosts, char *data, size_t size) {
         _cleanup_(etc_hosts_free) EtcHosts t = {};
         unsigned nr = 0;
         int r;
 
-        for (;;) {
-                _cleanup_free_ char *line = NULL;
-                char *l;
+        assert(hosts);
+        assert(data);
 
-                r = read_line(f, LONG_LINE_MAX, &line);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to read /etc/hosts: %m");
-                if (r == 0)
-                        break;
+        /* Parses the lines in place, which is a lot faster for large files than reading them one by one.
+         * Lines are terminated the same way as for read_line(). */
+
+        for (char *p = data, *end = data + size; p < end; ) {
+                char *e, *l;
+
+                e = p + strcspn(p, "\r\n");
+                if (e < end && *e == '\r' && e + 1 < end && e[1] == '\n')
+                        *(e++) = '\0';
+                *e = '\0';
 
+                l = p;
+                p = e + 1;
                 nr++;
 
-                l = strchr(line, '#');
-                if (l)
-                        *l = '\0';
+                e = strchr(l, '#');
+                if (e)
+                        *e = '\0';
 
-                l = strstrip(line);
+                l = strstrip(l);
                 if (isempty(l))
                         continue;
 
@@ -288,9 +298,27 @@ int etc_hosts_parse(EtcHosts *hosts, FILE *f) {
         return 0;
 }
 
+int etc_hosts_parse(EtcHosts *hosts, FILE *f) {
+        _cleanup_free_ char *data = NULL;
+        size_t size;
+        int r;
+
+        assert(hosts);
+        assert(f);
+
+        r = read_full_stream(f, &data, &size);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read /etc/hosts: %m");
+
+        return etc_hosts_parse_buffer(hosts, data, size);
+}
+
 static int manager_etc_hosts_read(Manager *m) {
         _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *data = NULL;
         struct stat st;
+        uint64_t hash;
+        size_t size;
         usec_t ts;
         int r;
 
@@ -331,11 +359,21 @@ static int manager_etc_hosts_read(Manager *m) {
         if (r < 0)
                 return log_error_errno(errno, "Failed to fstat() /etc/hosts: %m");
 
-        r = etc_hosts_parse(&m->etc_hosts, f);
+        r = read_full_stream(f, &data, &size);
         if (r < 0)
-                return r;
+                return log_error_errno(r, "Failed to read /etc/hosts: %m");
+
+        /* Configuration management tools tend to replace the file even if nothing changed, hence check
+         * whether the contents are actually different before parsing them all over again. */
+        hash = siphash24(data, size, ETC_HOSTS_HASH_KEY.bytes);
+        if (m->etc_hosts_stat.st_mode == 0 || hash != m->etc_hosts_hash) {
+                r = etc_hosts_parse_buffer(&m->etc_hosts, data, size);
+                if (r < 0)
+                        return r;
+        }
 
         m->etc_hosts_stat = st;
+        m->etc_hosts_hash = hash;
         m->etc_hosts_last = ts;
 
         return 1;
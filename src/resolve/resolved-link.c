@@ -759,15 +759,9 @@ void link_next_dns_server(Link *l, DnsServer *if_current) {
         if (!l->current_dns_server)
                 return;
 
-        /* Change to the next one, but make sure to follow the linked list only if this server is actually
-         * still linked. */
-        if (l->current_dns_server->linked && l->current_dns_server->servers_next) {
-                link_set_dns_server(l, l->current_dns_server->servers_next);
-                return;
-        }
-
-        /* Pick the first one again, after we reached the end */
-        link_set_dns_server(l, l->dns_servers);
+        /* Change to the fastest other one, or pick the first one again if this server is not linked
+         * anymore. */
+        link_set_dns_server(l, dns_server_pick_next(l->dns_servers, l->current_dns_server));
 }
 
 DnsOverTlsMode link_get_dns_over_tls_mode(Link *l) {
@@ -682,6 +682,8 @@ Manager *manager_free(Manager *m) {
                 dns_query_free(m->dns_queries);
 
         m->stub_queries_by_packet = hashmap_free(m->stub_queries_by_packet);
+        m->stub_replies_by_packet = hashmap_free(m->stub_replies_by_packet);
+        dnssec_verify_cache_flush();
 
         dns_scope_free(m->unicast_scope);
 
@@ -696,6 +698,7 @@ Manager *manager_free(Manager *m) {
 
         hashmap_free(m->links);
         hashmap_free(m->dns_transactions);
+        hashmap_free(m->cache_statistics_by_type);
 
         sd_event_source_unref(m->network_event_source);
         sd_network_monitor_unref(m->network_monitor);
@@ -1474,6 +1477,60 @@ void manager_dnssec_verdict(Manager *m, DnssecVerdict verdict, const DnsResource
         m->n_dnssec_verdict[verdict]++;
 }
 
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(
+                cache_type_statistics_hash_ops,
+                void, trivial_hash_func, trivial_compare_func,
+                CacheTypeStatistics, free);
+
+void manager_cache_lookup_done(Manager *m, uint16_t type, bool hit) {
+        CacheTypeStatistics *c;
+
+        assert(m);
+
+        c = hashmap_get(m->cache_statistics_by_type, UINT_TO_PTR(type));
+        if (!c) {
+                _cleanup_free_ CacheTypeStatistics *n = NULL;
+
+                n = new0(CacheTypeStatistics, 1);
+                if (!n)
+                        return (void) log_oom_debug();
+
+                if (hashmap_ensure_put(&m->cache_statistics_by_type, &cache_type_statistics_hash_ops, UINT_TO_PTR(type), n) < 0)
+                        return (void) log_oom_debug();
+
+                c = TAKE_PTR(n);
+        }
+
+        if (hit)
+                c->n_hit++;
+        else
+                c->n_miss++;
+}
+
+void manager_reset_statistics(Manager *m) {
+        Link *l;
+
+        assert(m);
+
+        LIST_FOREACH(scopes, s, m->dns_scopes)
+                s->cache.n_hit = s->cache.n_miss = 0;
+
+        LIST_FOREACH(servers, s, m->dns_servers)
+                zero(s->n_rtt_histogram);
+        LIST_FOREACH(servers, s, m->fallback_dns_servers)
+                zero(s->n_rtt_histogram);
+        HASHMAP_FOREACH(l, m->links)
+                LIST_FOREACH(servers, s, l->dns_servers)
+                        zero(s->n_rtt_histogram);
+
+        m->n_transactions_total = 0;
+        zero(m->n_dnssec_verdict);
+
+        m->n_queries_udp = m->n_queries_tcp = m->n_queries_tls = 0;
+        m->cache_statistics_by_type = hashmap_free(m->cache_statistics_by_type);
+        m->dnssec_validation_usec = 0;
+}
+
 bool manager_routable(Manager *m) {
         Link *l;
 
@@ -1494,6 +1551,8 @@ void manager_flush_caches(Manager *m, int log_level) {
         LIST_FOREACH(scopes, scope, m->dns_scopes)
                 dns_cache_flush(&scope->cache);
 
+        dns_resource_record_trim_pool();
+
         log_full(log_level, "Flushed all caches.");
 }
 
@@ -26,6 +26,11 @@ typedef struct Manager Manager;
 #define MANAGER_SEARCH_DOMAINS_MAX 256
 #define MANAGER_DNS_SERVERS_MAX 256
 
+typedef struct CacheTypeStatistics {
+        unsigned n_hit;
+        unsigned n_miss;
+} CacheTypeStatistics;
+
 typedef struct EtcHosts {
         Hashmap *by_address;
         Hashmap *by_name;
@@ -41,6 +46,7 @@ struct Manager {
         DnsOverTlsMode dns_over_tls_mode;
         DnsCacheMode enable_cache;
         bool cache_from_localhost;
+        unsigned cache_max_entries;
         DnsStubListenerMode dns_stub_listener_mode;
 
 #if ENABLE_DNS_OVER_TLS
@@ -61,6 +67,7 @@ struct Manager {
         LIST_HEAD(DnsQuery, dns_queries);
         unsigned n_dns_queries;
         Hashmap *stub_queries_by_packet;
+        Hashmap *stub_replies_by_packet;
 
         LIST_HEAD(DnsStream, dns_streams);
         unsigned n_dns_streams[_DNS_STREAM_TYPE_MAX];
@@ -128,10 +135,19 @@ struct Manager {
         unsigned n_transactions_total;
         unsigned n_dnssec_verdict[_DNSSEC_VERDICT_MAX];
 
+        /* Statistics of unicast DNS queries sent per transport, of cache lookups per RR type, and of the
+         * time spent validating DNSSEC signatures. */
+        unsigned n_queries_udp;
+        unsigned n_queries_tcp;
+        unsigned n_queries_tls;
+        Hashmap *cache_statistics_by_type;
+        usec_t dnssec_validation_usec;
+
         /* Data from /etc/hosts */
         EtcHosts etc_hosts;
         usec_t etc_hosts_last;
         struct stat etc_hosts_stat;
+        uint64_t etc_hosts_hash;
         bool read_etc_hosts;
 
         OrderedSet *dns_extra_stub_listeners;
@@ -197,6 +213,8 @@ bool manager_dnssec_supported(Manager *m);
 DnsOverTlsMode manager_get_dns_over_tls_mode(Manager *m);
 
 void manager_dnssec_verdict(Manager *m, DnssecVerdict verdict, const DnsResourceKey *key);
+void manager_cache_lookup_done(Manager *m, uint16_t type, bool hit);
+void manager_reset_statistics(Manager *m);
 
 bool manager_routable(Manager *m);
 
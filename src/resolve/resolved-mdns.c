@@ -6,12 +6,16 @@
 
 #include "alloc-util.h"
 #include "fd-util.h"
+#include "random-util.h"
 #include "resolved-manager.h"
 #include "resolved-mdns.h"
 #include "sort-util.h"
 
 #define CLEAR_CACHE_FLUSH(x) (~MDNS_RR_CACHE_FLUSH_OR_QU & (x))
 
+/* How many packets to read from an mDNS socket in one event loop iteration */
+#define MDNS_PACKETS_BATCH_MAX 64U
+
 void manager_mdns_stop(Manager *m) {
         assert(m);
 
@@ -239,6 +243,114 @@ static bool sender_on_local_subnet(DnsScope *s, DnsPacket *p) {
 }
 
 
+static bool mdns_answer_is_known(DnsPacket *p, DnsResourceRecord *rr) {
+        DnsAnswerItem *known;
+
+        assert(p);
+        assert(rr);
+
+        /* Known-answer suppression, see RFC 6762, section 7.1: don't reply with records the querier listed
+         * in the answer section of its query already, unless their TTL there is less than half of the
+         * true TTL. The known answers are looked up by hash, as queries may list hundreds of them. */
+
+        known = dns_answer_get_item(p->answer, rr, p->ifindex);
+
+        return known &&
+                FLAGS_SET(known->flags, DNS_ANSWER_SECTION_ANSWER) &&
+                known->rr->ttl >= rr->ttl / 2;
+}
+
+static int mdns_scope_send_answer(DnsScope *s, DnsAnswer *answer) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *first = NULL, *second = NULL;
+        _cleanup_(dns_packet_unrefp) DnsPacket *reply = NULL;
+        DnsAnswerItem *item;
+        size_t n = 0;
+        int r;
+
+        assert(s);
+
+        r = dns_scope_make_reply_packet(s, 0, DNS_RCODE_SUCCESS, NULL, answer, NULL, false, &reply);
+        if (r == -EMSGSIZE && dns_answer_size(answer) > 1) {
+                /* Does not fit into a single packet, split it */
+                DNS_ANSWER_FOREACH_ITEM(item, answer) {
+                        r = dns_answer_add_extend(n++ < dns_answer_size(answer) / 2 ? &first : &second,
+                                                  item->rr, item->ifindex, item->flags, item->rrsig);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = mdns_scope_send_answer(s, first);
+                if (r < 0)
+                        return r;
+
+                return mdns_scope_send_answer(s, second);
+        }
+        if (r < 0)
+                return log_debug_errno(r, "Failed to build reply packet: %m");
+
+        if (!ratelimit_below(&s->ratelimit))
+                return 0;
+
+        r = dns_scope_emit_udp(s, -1, AF_UNSPEC, reply);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to send reply packet: %m");
+
+        return 0;
+}
+
+static int on_mdns_delayed_answer(sd_event_source *es, usec_t usec, void *userdata) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        DnsScope *s = ASSERT_PTR(userdata);
+
+        s->mdns_delayed_answer_event_source = sd_event_source_disable_unref(s->mdns_delayed_answer_event_source);
+        answer = TAKE_PTR(s->mdns_delayed_answer);
+
+        if (dns_answer_isempty(answer))
+                return 0;
+
+        (void) mdns_scope_send_answer(s, answer);
+        return 0;
+}
+
+static int mdns_scope_delay_shared_answer(DnsScope *s, DnsAnswer **answer) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *immediate = NULL;
+        DnsAnswerItem *item;
+        int r;
+
+        assert(s);
+        assert(answer);
+
+        /* Records which may be owned by multiple hosts are replied to after a random delay of 20-120ms, see
+         * RFC 6762, section 6. The records asked for by all queries received in the meantime are sent in a
+         * single packet then, so that a burst of queries from many devices only results in one reply. The
+         * remaining records are returned, to be replied with immediately. */
+
+        DNS_ANSWER_FOREACH_ITEM(item, *answer) {
+                DnsAnswer **target = FLAGS_SET(item->flags, DNS_ANSWER_SHARED_OWNER) ? &s->mdns_delayed_answer : &immediate;
+
+                r = dns_answer_add_extend(target, item->rr, item->ifindex, item->flags, item->rrsig);
+                if (r < 0)
+                        return r;
+        }
+
+        if (s->mdns_delayed_answer && !s->mdns_delayed_answer_event_source) {
+                r = sd_event_add_time_relative(
+                                s->manager->event,
+                                &s->mdns_delayed_answer_event_source,
+                                CLOCK_BOOTTIME,
+                                usec_add(random_u64_range(MDNS_JITTER_RANGE_USEC), MDNS_JITTER_MIN_USEC),
+                                USEC_PER_MSEC,
+                                on_mdns_delayed_answer, s);
+                if (r < 0)
+                        return r;
+
+                (void) sd_event_source_set_description(s->mdns_delayed_answer_event_source, "mdns-delayed-answer");
+        }
+
+        DNS_ANSWER_REPLACE(*answer, TAKE_PTR(immediate));
+        return 0;
+}
+
 static int mdns_scope_process_query(DnsScope *s, DnsPacket *p) {
         _cleanup_(dns_answer_unrefp) DnsAnswer *full_answer = NULL;
         _cleanup_(dns_packet_unrefp) DnsPacket *reply = NULL;
@@ -316,6 +428,10 @@ static int mdns_scope_process_query(DnsScope *s, DnsPacket *p) {
 
                 DNS_ANSWER_FOREACH_ITEM(item, answer) {
                         DnsAnswerFlags flags = item->flags;
+
+                        if (!legacy_query && mdns_answer_is_known(p, item->rr))
+                                continue;
+
                         /* The cache-flush bit must not be set in legacy unicast responses.
                          * See section 6.7 of RFC 6762. */
                         if (legacy_query)
@@ -326,6 +442,12 @@ static int mdns_scope_process_query(DnsScope *s, DnsPacket *p) {
                 }
         }
 
+        if (!unicast_reply && !legacy_query) {
+                r = mdns_scope_delay_shared_answer(s, &full_answer);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to delay reply with shared records: %m");
+        }
+
         if (dns_answer_isempty(full_answer))
                 return 0;
 
@@ -349,15 +471,12 @@ static int mdns_scope_process_query(DnsScope *s, DnsPacket *p) {
         return 0;
 }
 
-static int on_mdns_packet(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
-        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
-        Manager *m = userdata;
+static int mdns_process_packet(Manager *m, DnsPacket *p) {
         DnsScope *scope;
         int r;
 
-        r = manager_recv(m, fd, DNS_PROTOCOL_MDNS, &p);
-        if (r <= 0)
-                return r;
+        assert(m);
+        assert(p);
 
         if (manager_packet_from_local_address(m, p))
                 return 0;
@@ -434,6 +553,24 @@ static int on_mdns_packet(sd_event_source *s, int fd, uint32_t revents, void *us
         return 0;
 }
 
+static int on_mdns_packet(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        /* Read several packets in one go, as on busy networks many of them arrive at about the same time */
+        for (unsigned i = 0; i < MDNS_PACKETS_BATCH_MAX; i++) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+
+                r = manager_recv(m, fd, DNS_PROTOCOL_MDNS, &p);
+                if (r <= 0)
+                        return r;
+
+                (void) mdns_process_packet(m, p);
+        }
+
+        return 0;
+}
+
 int manager_mdns_ipv4_fd(Manager *m) {
         union sockaddr_union sa = {
                 .in.sin_family = AF_INET,
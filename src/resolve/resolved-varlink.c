@@ -5,6 +5,7 @@
 #include "resolved-dns-synthesize.h"
 #include "resolved-varlink.h"
 #include "socket-netlink.h"
+#include "stats-util.h"
 
 typedef struct LookupParameters {
         int ifindex;
@@ -519,6 +520,144 @@ static int vl_method_resolve_address(Varlink *link, JsonVariant *parameters, Var
         return 1;
 }
 
+static int dump_server_statistics(DnsServer *s, JsonVariant **array) {
+        _cleanup_(json_variant_unrefp) JsonVariant *histogram = NULL, *entry = NULL;
+        int r;
+
+        assert(s);
+        assert(array);
+
+        for (unsigned i = 0; i < DNS_SERVER_RTT_HISTOGRAM_MAX; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+                r = json_variant_new_unsigned(&v, s->n_rtt_histogram[i]);
+                if (r < 0)
+                        return r;
+
+                r = json_variant_append_array(&histogram, v);
+                if (r < 0)
+                        return r;
+        }
+
+        r = json_build(&entry,
+                       JSON_BUILD_OBJECT(
+                                       JSON_BUILD_PAIR_STRING("server", dns_server_string_full(s)),
+                                       JSON_BUILD_PAIR_STRING("type", dns_server_type_to_string(s->type)),
+                                       JSON_BUILD_PAIR_CONDITION(s->link, "ifindex", JSON_BUILD_INTEGER(s->link ? s->link->ifindex : 0)),
+                                       JSON_BUILD_PAIR_UNSIGNED("rttUSec", s->rtt_usec),
+                                       JSON_BUILD_PAIR_UNSIGNED("rttVarUSec", s->rtt_var_usec),
+                                       JSON_BUILD_PAIR("rttHistogram", JSON_BUILD_VARIANT(histogram)),
+                                       JSON_BUILD_PAIR_UNSIGNED("failedUDP", s->n_failed_udp),
+                                       JSON_BUILD_PAIR_UNSIGNED("failedTCP", s->n_failed_tcp),
+                                       JSON_BUILD_PAIR_UNSIGNED("failedTLS", s->n_failed_tls)));
+        if (r < 0)
+                return r;
+
+        return json_variant_append_array(array, entry);
+}
+
+static int vl_method_dump_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        _cleanup_(json_variant_unrefp) JsonVariant *by_type = NULL, *servers = NULL, *verdicts = NULL;
+        uint64_t cache_size = 0, cache_hit = 0, cache_miss = 0, stub_queries = 0;
+        CacheTypeStatistics *c;
+        Manager *m;
+        void *type;
+        uid_t uid;
+        Link *l;
+        int r;
+
+        assert(link);
+
+        m = varlink_server_get_userdata(varlink_get_server(link));
+        assert(m);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        /* The socket is accessible to everybody, but the statistics reveal which names are looked up how
+         * often, hence only hand them out to privileged clients. */
+        r = varlink_get_peer_uid(link, &uid);
+        if (r < 0)
+                return r;
+        if (uid != 0)
+                return varlink_error_errno(link, -EPERM);
+
+        LIST_FOREACH(scopes, s, m->dns_scopes) {
+                cache_size += dns_cache_size(&s->cache);
+                cache_hit += s->cache.n_hit;
+                cache_miss += s->cache.n_miss;
+        }
+
+        HASHMAP_FOREACH_KEY(c, type, m->cache_statistics_by_type) {
+                _cleanup_(json_variant_unrefp) JsonVariant *entry = NULL;
+                const char *name = dns_type_to_string(PTR_TO_UINT(type));
+
+                r = json_build(&entry,
+                               JSON_BUILD_OBJECT(
+                                               JSON_BUILD_PAIR_UNSIGNED("type", PTR_TO_UINT(type)),
+                                               JSON_BUILD_PAIR_CONDITION(name, "name", JSON_BUILD_STRING(name)),
+                                               JSON_BUILD_PAIR_UNSIGNED("hits", c->n_hit),
+                                               JSON_BUILD_PAIR_UNSIGNED("misses", c->n_miss)));
+                if (r < 0)
+                        return r;
+
+                r = json_variant_append_array(&by_type, entry);
+                if (r < 0)
+                        return r;
+        }
+
+        for (DnssecVerdict v = 0; v < _DNSSEC_VERDICT_MAX; v++) {
+                r = json_variant_set_field_unsigned(&verdicts, dnssec_verdict_to_string(v), m->n_dnssec_verdict[v]);
+                if (r < 0)
+                        return r;
+        }
+
+        LIST_FOREACH(queries, q, m->dns_queries)
+                if (q->request_packet)
+                        stub_queries++;
+
+        LIST_FOREACH(servers, s, m->dns_servers) {
+                r = dump_server_statistics(s, &servers);
+                if (r < 0)
+                        return r;
+        }
+        LIST_FOREACH(servers, s, m->fallback_dns_servers) {
+                r = dump_server_statistics(s, &servers);
+                if (r < 0)
+                        return r;
+        }
+        HASHMAP_FOREACH(l, m->links)
+                LIST_FOREACH(servers, s, l->dns_servers) {
+                        r = dump_server_statistics(s, &servers);
+                        if (r < 0)
+                                return r;
+                }
+
+        return varlink_replyb(link,
+                              JSON_BUILD_OBJECT(
+                                              JSON_BUILD_PAIR("transactions", JSON_BUILD_OBJECT(
+                                                                              JSON_BUILD_PAIR_UNSIGNED("current", hashmap_size(m->dns_transactions)),
+                                                                              JSON_BUILD_PAIR_UNSIGNED("total", m->n_transactions_total),
+                                                                              JSON_BUILD_PAIR_UNSIGNED("queriesUDP", m->n_queries_udp),
+                                                                              JSON_BUILD_PAIR_UNSIGNED("queriesTCP", m->n_queries_tcp),
+                                                                              JSON_BUILD_PAIR_UNSIGNED("queriesTLS", m->n_queries_tls))),
+                                              JSON_BUILD_PAIR("stub", JSON_BUILD_OBJECT(
+                                                                              JSON_BUILD_PAIR_UNSIGNED("pendingQueries", stub_queries))),
+                                              JSON_BUILD_PAIR("cache", JSON_BUILD_OBJECT(
+                                                                              JSON_BUILD_PAIR_UNSIGNED("size", cache_size),
+                                                                              JSON_BUILD_PAIR_UNSIGNED("hits", cache_hit),
+                                                                              JSON_BUILD_PAIR_UNSIGNED("misses", cache_miss),
+                                                                              JSON_BUILD_PAIR("byType", JSON_BUILD_VARIANT(by_type)))),
+                                              JSON_BUILD_PAIR("dnssec", JSON_BUILD_OBJECT(
+                                                                              JSON_BUILD_PAIR("verdicts", JSON_BUILD_VARIANT(verdicts)),
+                                                                              JSON_BUILD_PAIR_UNSIGNED("validationUSec", m->dnssec_validation_usec))),
+                                              JSON_BUILD_PAIR("servers", JSON_BUILD_VARIANT(servers))));
+}
+
+static int vl_method_get_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        return stats_varlink_reply(link, parameters);
+}
+
 int manager_varlink_init(Manager *m) {
         _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
         int r;
@@ -537,7 +676,9 @@ int manager_varlink_init(Manager *m) {
         r = varlink_server_bind_method_many(
                         s,
                         "io.systemd.Resolve.ResolveHostname",  vl_method_resolve_hostname,
-                        "io.systemd.Resolve.ResolveAddress", vl_method_resolve_address);
+                        "io.systemd.Resolve.ResolveAddress", vl_method_resolve_address,
+                        "io.systemd.Resolve.DumpStatistics", vl_method_dump_statistics,
+                        "io.systemd.Statistics.Get", vl_method_get_statistics);
         if (r < 0)
                 return log_error_errno(r, "Failed to register varlink methods: %m");
 
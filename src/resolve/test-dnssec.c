@@ -175,6 +175,30 @@ TEST(dnssec_verify_rfc8080_ed25519_example1) {
                                       rrsig->rrsig.inception * USEC_PER_SEC, &result) >= 0);
 #if PREFER_OPENSSL || GCRYPT_VERSION_NUMBER >= 0x010600
         assert_se(result == DNSSEC_VALIDATED);
+
+        /* The second time, the remembered result is used, but only as long as the RRset is the same */
+        assert_se(dnssec_verify_rrset(answer, mx->key, rrsig, dnskey,
+                                      rrsig->rrsig.inception * USEC_PER_SEC, &result) >= 0);
+        assert_se(result == DNSSEC_VALIDATED);
+
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *mx2 = NULL;
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer2 = NULL;
+
+        mx2 = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_MX, "example.com.");
+        assert_se(mx2);
+        mx2->mx.priority = 20;
+        mx2->mx.exchange = strdup("mail.example.com.");
+        assert_se(mx2->mx.exchange);
+
+        answer2 = dns_answer_new(1);
+        assert_se(answer2);
+        assert_se(dns_answer_add(answer2, mx2, 0, DNS_ANSWER_AUTHENTICATED, NULL) >= 0);
+
+        assert_se(dnssec_verify_rrset(answer2, mx2->key, rrsig, dnskey,
+                                      rrsig->rrsig.inception * USEC_PER_SEC, &result) >= 0);
+        assert_se(result == DNSSEC_INVALID);
+
+        dnssec_verify_cache_flush();
 #else
         assert_se(result == DNSSEC_UNSUPPORTED_ALGORITHM);
 #endif
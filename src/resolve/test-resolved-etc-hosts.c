@@ -12,6 +12,7 @@
 #include "resolved-etc-hosts.h"
 #include "strv.h"
 #include "tests.h"
+#include "time-util.h"
 #include "tmpfile-util.h"
 
 TEST(parse_etc_hosts_system) {
@@ -123,6 +124,49 @@ TEST(parse_etc_hosts) {
         assert_se(!set_contains(hosts.no_address, "foobar.foo.foo"));
 }
 
+TEST(parse_etc_hosts_large) {
+        _cleanup_(unlink_tempfilep) char t[] = "/tmp/test-resolved-etc-hosts.XXXXXX";
+        _cleanup_(etc_hosts_free) EtcHosts hosts = {};
+        _cleanup_fclose_ FILE *f = NULL;
+        EtcHostsItemByName *bn;
+        EtcHostsItem *item;
+        usec_t ts;
+        int fd;
+
+        fd = mkostemp_safe(t);
+        assert_se(fd >= 0);
+
+        f = fdopen(fd, "r+");
+        assert_se(f);
+
+        /* Mixed line endings, and no newline at the end */
+        for (unsigned i = 0; i < 100000; i++)
+                fprintf(f, "10.%u.%u.%u host%u.example.com alias%u%s",
+                        i >> 16, (i >> 8) & 0xff, i & 0xff, i, i,
+                        i % 3 == 0 ? "\r\n" : i < 99999 ? "\n" : "");
+
+        assert_se(fflush_and_check(f) >= 0);
+        rewind(f);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(etc_hosts_parse(&hosts, f) == 0);
+        log_info("Parsed 100000 lines in %s.", FORMAT_TIMESPAN(now(CLOCK_MONOTONIC) - ts, USEC_PER_MSEC));
+
+        assert_se(hashmap_size(hosts.by_address) == 100000);
+        assert_se(hashmap_size(hosts.by_name) == 200000);
+
+        assert_se(bn = hashmap_get(hosts.by_name, "host99999.example.com"));
+        assert_se(bn->n_addresses == 1);
+        assert_se(address_equal_4(bn->addresses[0], inet_addr("10.1.134.159")));
+
+        assert_se(bn = hashmap_get(hosts.by_name, "alias3"));
+        assert_se(bn->n_addresses == 1);
+        assert_se(address_equal_4(bn->addresses[0], inet_addr("10.0.0.3")));
+
+        assert_se(item = hashmap_get(hosts.by_address, &(struct in_addr_data) { .family = AF_INET, .address.in.s_addr = inet_addr("10.0.0.4") }));
+        assert_se(strv_equal(item->names, STRV_MAKE("host4.example.com", "alias4")));
+}
+
 static void test_parse_file_one(const char *fname) {
         _cleanup_(etc_hosts_free) EtcHosts hosts = {};
         _cleanup_fclose_ FILE *f;
@@ -4,6 +4,7 @@
 #include "bus-get-properties.h"
 #include "bus-log-control-api.h"
 #include "bus-util.h"
+#include "event-util.h"
 #include "log.h"
 #include "sd-bus.h"
 #include "syslog-util.h"
@@ -94,12 +95,57 @@ int bus_property_set_log_target(
 
 BUS_DEFINE_PROPERTY_GET_GLOBAL(bus_property_get_syslog_identifier, "s", program_invocation_short_name);
 
+static int property_get_event_loop_statistics(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        EventSourceStatistics *st;
+        const char *key;
+        sd_event *e;
+        int r;
+
+        assert(bus);
+        assert(reply);
+
+        e = sd_bus_get_event(bus);
+        if (e) {
+                r = event_get_statistics(e, &h);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_open_container(reply, 'a', "(sttttt)");
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(st, key, h) {
+                r = sd_bus_message_append(reply, "(sttttt)",
+                                          key,
+                                          st->n_dispatched,
+                                          st->runtime_usec,
+                                          st->runtime_max_usec,
+                                          st->latency_usec,
+                                          st->latency_max_usec);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
 static const sd_bus_vtable log_control_vtable[] = {
         SD_BUS_VTABLE_START(0),
 
         SD_BUS_WRITABLE_PROPERTY("LogLevel", "s", bus_property_get_log_level, bus_property_set_log_level, 0, 0),
         SD_BUS_WRITABLE_PROPERTY("LogTarget", "s", bus_property_get_log_target, bus_property_set_log_target, 0, 0),
         SD_BUS_PROPERTY("SyslogIdentifier", "s", bus_property_get_syslog_identifier, 0, 0),
+        SD_BUS_PROPERTY("EventLoopStatistics", "a(sttttt)", property_get_event_loop_statistics, 0, 0),
 
         /* One of those days we might want to add a similar, second interface to cover common service
          * operations such as Reload(), Reexecute(), Exit() …  and maybe some properties exposing version
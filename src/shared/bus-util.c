@@ -217,6 +217,10 @@ int bus_connect_system_systemd(sd_bus **ret_bus) {
         if (r < 0)
                 return r;
 
+        r = bus_negotiate_memfd(bus, true);
+        if (r < 0)
+                return r;
+
         r = sd_bus_start(bus);
         if (r < 0)
                 return sd_bus_default_system(ret_bus);
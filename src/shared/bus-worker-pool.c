@@ -0,0 +1,322 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "bus-worker-pool.h"
+#include "cpu-set-util.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "io-util.h"
+#include "list.h"
+#include "string-util.h"
+
+#define WORKERS_MAX 64U
+
+typedef struct BusWorkerJob BusWorkerJob;
+
+struct BusWorkerJob {
+        sd_bus_message *message;
+        char *key; /* Connection and sender the call came from, what ordering is guaranteed for */
+
+        bus_worker_work_t work;
+        bus_worker_done_t done;
+        void *userdata;
+        free_func_t destroy;
+
+        int result;
+
+        /* In the run queue or the done queue of the pool, while in flight */
+        LIST_FIELDS(BusWorkerJob, queue);
+
+        /* All jobs of the same sender, in submission order. Only the first one is ever in flight. */
+        LIST_FIELDS(BusWorkerJob, sender);
+};
+
+struct BusWorkerPool {
+        sd_event_source *event_source;
+        int event_fd;
+
+        pthread_t *workers;
+        unsigned n_workers;
+
+        /* Everything below the mutex is shared with the workers and protected by it, except for the senders
+         * hashmap, which is only ever touched from the thread owning the pool. */
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        bool quit;
+
+        LIST_HEAD(BusWorkerJob, run_queue);
+        LIST_HEAD(BusWorkerJob, done_queue);
+
+        Hashmap *senders; /* key → first job of the sender */
+};
+
+static BusWorkerJob* bus_worker_job_free(BusWorkerJob *j) {
+        if (!j)
+                return NULL;
+
+        if (j->destroy)
+                j->destroy(j->userdata);
+
+        sd_bus_message_unref(j->message);
+        free(j->key);
+
+        return mfree(j);
+}
+
+static void bus_worker_pool_queue(BusWorkerPool *p, BusWorkerJob *j) {
+        assert(p);
+        assert(j);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        LIST_APPEND(queue, p->run_queue, j);
+        assert_se(pthread_cond_signal(&p->cond) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+}
+
+static void* bus_worker_thread(void *userdata) {
+        BusWorkerPool *p = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "bus-worker");
+
+        for (;;) {
+                BusWorkerJob *j;
+
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+                while (!p->quit && !p->run_queue)
+                        assert_se(pthread_cond_wait(&p->cond, &p->mutex) == 0);
+                if (p->quit) {
+                        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+                        return NULL;
+                }
+                j = p->run_queue;
+                LIST_REMOVE(queue, p->run_queue, j);
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+                j->result = j->work(j->userdata);
+
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+                LIST_PREPEND(queue, p->done_queue, j);
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+                (void) eventfd_write(p->event_fd, 1);
+        }
+}
+
+static void bus_worker_pool_complete(BusWorkerPool *p, BusWorkerJob *j) {
+        BusWorkerJob *next;
+        int r;
+
+        assert(p);
+        assert(j);
+
+        /* Pass the turn on to the next job of the same sender, if there is one, so that it may be processed
+         * while we are replying to this one */
+        next = j->sender_next;
+        if (next) {
+                BusWorkerJob *head = j;
+
+                LIST_REMOVE(sender, head, j);
+
+                /* Replaces the key pointer too, which is owned by the job we are about to free */
+                assert_se(hashmap_replace(p->senders, next->key, next) == 0);
+
+                bus_worker_pool_queue(p, next);
+        } else
+                assert_se(hashmap_remove(p->senders, j->key) == j);
+
+        if (j->done)
+                r = j->done(j->message, j->result, j->userdata);
+        else if (j->result < 0)
+                r = j->result;
+        else
+                r = sd_bus_reply_method_return(j->message, NULL);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to complete %s() call from %s: %m",
+                                strna(sd_bus_message_get_member(j->message)),
+                                strna(sd_bus_message_get_sender(j->message)));
+
+                (void) sd_bus_reply_method_errno(j->message, r, NULL);
+        }
+
+        bus_worker_job_free(j);
+}
+
+static int on_worker_done(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        BusWorkerPool *p = ASSERT_PTR(userdata);
+        BusWorkerJob *done;
+
+        (void) flush_fd(fd);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        done = TAKE_PTR(p->done_queue);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        LIST_FOREACH(queue, j, done)
+                bus_worker_pool_complete(p, j);
+
+        return 0;
+}
+
+static int bus_worker_pool_start_threads(BusWorkerPool *p, unsigned n) {
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(p);
+
+        p->workers = new(pthread_t, n);
+        if (!p->workers)
+                return -ENOMEM;
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        /* Workers must never get signals, they are supposed to be handled by the event loop */
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        for (; p->n_workers < n; p->n_workers++) {
+                r = pthread_create(p->workers + p->n_workers, NULL, bus_worker_thread, p);
+                if (r > 0) {
+                        r = -r;
+                        break;
+                }
+        }
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (k > 0 && r >= 0)
+                r = -k;
+
+        return r;
+}
+
+int bus_worker_pool_new(sd_event *event, unsigned n_threads, BusWorkerPool **ret) {
+        _cleanup_(bus_worker_pool_freep) BusWorkerPool *p = NULL;
+        int r;
+
+        assert(event);
+        assert(ret);
+
+        if (n_threads == 0) {
+                r = cpus_in_affinity_mask();
+                n_threads = r > 0 ? (unsigned) r : 1;
+        }
+        n_threads = MIN(n_threads, WORKERS_MAX);
+
+        p = new(BusWorkerPool, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (BusWorkerPool) {
+                .event_fd = -EBADF,
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+        };
+
+        p->event_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (p->event_fd < 0)
+                return -errno;
+
+        r = sd_event_add_io(event, &p->event_source, p->event_fd, EPOLLIN, on_worker_done, p);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(p->event_source, "bus-worker-pool");
+
+        r = bus_worker_pool_start_threads(p, n_threads);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+BusWorkerPool* bus_worker_pool_free(BusWorkerPool *p) {
+        BusWorkerJob *j;
+
+        if (!p)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        p->quit = true;
+        assert_se(pthread_cond_broadcast(&p->cond) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        /* Workers finish what they are doing right now, but won't pick up anything new */
+        for (unsigned i = 0; i < p->n_workers; i++)
+                (void) pthread_join(p->workers[i], NULL);
+        free(p->workers);
+
+        /* Every job is on the list of its sender, whether it is in flight or not */
+        while ((j = hashmap_steal_first(p->senders)))
+                LIST_FOREACH(sender, i, j) {
+                        (void) sd_bus_reply_method_errno(i->message, -ECANCELED, NULL);
+                        bus_worker_job_free(i);
+                }
+        hashmap_free(p->senders);
+
+        sd_event_source_disable_unref(p->event_source);
+        safe_close(p->event_fd);
+
+        assert_se(pthread_mutex_destroy(&p->mutex) == 0);
+        assert_se(pthread_cond_destroy(&p->cond) == 0);
+
+        return mfree(p);
+}
+
+int bus_worker_pool_submit(
+                BusWorkerPool *p,
+                sd_bus_message *m,
+                bus_worker_work_t work,
+                bus_worker_done_t done,
+                void *userdata,
+                free_func_t destroy) {
+
+        BusWorkerJob *j, *first;
+        int r;
+
+        assert(p);
+        assert(m);
+        assert(work);
+
+        j = new(BusWorkerJob, 1);
+        if (!j)
+                return -ENOMEM;
+
+        *j = (BusWorkerJob) {
+                .message = sd_bus_message_ref(m),
+                .work = work,
+                .done = done,
+                .userdata = userdata,
+        };
+        /* On direct connections there's no sender, everything coming in on the same connection is treated
+         * as coming from the same peer then */
+        if (asprintf(&j->key, "%p/%s", sd_bus_message_get_bus(m), strempty(sd_bus_message_get_sender(m))) < 0) {
+                bus_worker_job_free(j);
+                return -ENOMEM;
+        }
+
+        first = hashmap_get(p->senders, j->key);
+        if (first) {
+                /* Something from this sender is already being processed, queue behind it */
+                LIST_APPEND(sender, first, j);
+                j->destroy = destroy;
+                return 0;
+        }
+
+        r = hashmap_ensure_put(&p->senders, &string_hash_ops, j->key, j);
+        if (r < 0) {
+                bus_worker_job_free(j);
+                return r;
+        }
+
+        /* Only take ownership of the userdata once we can't fail anymore */
+        j->destroy = destroy;
+
+        bus_worker_pool_queue(p, j);
+        return 0;
+}
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include "sd-bus.h"
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "macro.h"
+
+/* Offloads the expensive part of handling method calls to a pool of worker threads. sd-bus connections and
+ * messages are not thread-safe, hence the split: a method handler parses its arguments on the thread
+ * owning the connection, then submits the call with a work function that only operates on its userdata,
+ * and is run in a worker thread. Once that is done the done function is invoked back on the owning thread,
+ * with the result of the work function, and is supposed to reply to the call. Calls from the same sender
+ * (or the same connection, for direct connections) are processed strictly one after the other, in the order
+ * they were submitted, so that replies to a single client never get reordered; calls from different senders
+ * are processed in parallel. */
+
+typedef struct BusWorkerPool BusWorkerPool;
+
+typedef int (*bus_worker_work_t)(void *userdata);
+typedef int (*bus_worker_done_t)(sd_bus_message *m, int result, void *userdata);
+
+int bus_worker_pool_new(sd_event *event, unsigned n_threads, BusWorkerPool **ret);
+BusWorkerPool* bus_worker_pool_free(BusWorkerPool *p);
+
+int bus_worker_pool_submit(
+                BusWorkerPool *p,
+                sd_bus_message *m,
+                bus_worker_work_t work,
+                bus_worker_done_t done,
+                void *userdata,
+                free_func_t destroy);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(BusWorkerPool*, bus_worker_pool_free);
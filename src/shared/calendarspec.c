@@ -1363,6 +1363,104 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                                  "Infinite loop in calendar calculation: %s", strna(s));
 }
 
+static bool calendar_spec_is_time_of_day(const CalendarSpec *spec) {
+        assert(spec);
+
+        /* Whether the spec only restricts the time of day, and possibly the day of the week, as "daily",
+         * "weekly", "hourly", "Mon..Fri 08:00" and most other timers in the wild do. */
+
+        return !spec->year && !spec->month && !spec->day && !spec->end_of_month && spec->dst < 0;
+}
+
+static int find_next_time_of_day(const CalendarSpec *spec, usec_t usec, usec_t *ret_next) {
+        struct tm tm, found;
+        int hour, minute, us, wday, sod;
+        unsigned days = 0;
+        usec_t next;
+        time_t t;
+        int r;
+
+        assert(spec);
+        assert(calendar_spec_is_time_of_day(spec));
+
+        /* For specs that only match on the time of day and the weekday we can simply step through the
+         * hours, minutes and seconds as plain numbers, and add whole days, without normalizing a struct tm
+         * with mktime() over and over again as find_next() does. That's much cheaper, as mktime() checks
+         * whether the time zone file changed each time it is called. This is only correct if the UTC offset
+         * stays the same between the start and the result, hence verify that in the end. Returns 1 if the
+         * next elapse was found, 0 if the caller has to take the slow path. */
+
+        t = (time_t) (usec / USEC_PER_SEC);
+        if (!localtime_or_gmtime_r(&t, &tm, spec->utc))
+                return 0;
+        if (tm.tm_sec >= 60) /* leap second */
+                return 0;
+
+        sod = tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+        if (t < sod)
+                return 0;
+
+        hour = tm.tm_hour;
+        minute = tm.tm_min;
+        us = tm.tm_sec * USEC_PER_SEC + usec % USEC_PER_SEC;
+        wday = tm.tm_wday == 0 ? 6 : tm.tm_wday - 1;
+
+        for (unsigned iteration = 0; iteration < 32; iteration++) {
+                if (spec->weekdays_bits >= 0 && spec->weekdays_bits < BITS_WEEKDAYS &&
+                    !(spec->weekdays_bits & (1 << wday)))
+                        goto next_day;
+
+                r = find_matching_component(spec, spec->hour, &tm, &hour);
+                if (r < 0 || hour > 23)
+                        goto next_day;
+                if (r > 0)
+                        minute = us = 0;
+
+                r = find_matching_component(spec, spec->minute, &tm, &minute);
+                if (r < 0 || minute > 59) {
+                        hour++;
+                        minute = us = 0;
+                        continue;
+                }
+                if (r > 0)
+                        us = 0;
+
+                r = find_matching_component(spec, spec->microsecond, &tm, &us);
+                if (r < 0 || us >= 60 * (int) USEC_PER_SEC) {
+                        minute++;
+                        us = 0;
+                        continue;
+                }
+
+                next = ((usec_t) (t - sod) + (usec_t) days * 24 * 3600 + hour * 3600 + minute * 60) * USEC_PER_SEC + us;
+
+                t = (time_t) (next / USEC_PER_SEC);
+                if (!localtime_or_gmtime_r(&t, &found, spec->utc))
+                        return 0;
+
+                /* A time zone transition in between? */
+                if (found.tm_gmtoff != tm.tm_gmtoff ||
+                    found.tm_hour != hour ||
+                    found.tm_min != minute ||
+                    found.tm_sec != us / (int) USEC_PER_SEC)
+                        return 0;
+
+                if (found.tm_year + 1900 > MAX_YEAR)
+                        return 0;
+
+                if (ret_next)
+                        *ret_next = next;
+                return 1;
+
+        next_day:
+                days++;
+                wday = (wday + 1) % 7;
+                hour = minute = us = 0;
+        }
+
+        return 0;
+}
+
 static int calendar_spec_next_usec_impl(const CalendarSpec *spec, usec_t usec, usec_t *ret_next) {
         struct tm tm;
         time_t t;
@@ -1375,6 +1473,10 @@ static int calendar_spec_next_usec_impl(const CalendarSpec *spec, usec_t usec, u
                 return -EINVAL;
 
         usec++;
+
+        if (calendar_spec_is_time_of_day(spec) &&
+            find_next_time_of_day(spec, usec, ret_next) > 0)
+                return 0;
         t = (time_t) (usec / USEC_PER_SEC);
         assert_se(localtime_or_gmtime_r(&t, &tm, spec->utc));
         tm_usec = usec % USEC_PER_SEC;
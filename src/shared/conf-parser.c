@@ -268,58 +268,25 @@ static int parse_line(
                                userdata);
 }
 
-/* Go through the file and parse each line */
-int config_parse(
-                const char *unit,
+typedef int (*config_line_handler_t)(unsigned line, char *l, void *userdata);
+
+/* Go through the file and pass each logical line (i.e. with comments dropped and continuation lines
+ * joined) to the handler */
+static int config_read_lines(
                 const char *filename,
                 FILE *f,
-                const char *sections,
-                ConfigItemLookup lookup,
-                const void *table,
                 ConfigParseFlags flags,
-                void *userdata,
-                struct stat *ret_stat) {
+                config_line_handler_t handler,
+                void *userdata) {
 
-        _cleanup_free_ char *section = NULL, *continuation = NULL;
-        _cleanup_fclose_ FILE *ours = NULL;
-        unsigned line = 0, section_line = 0;
-        bool section_ignored = false, bom_seen = false;
-        struct stat st;
-        int r, fd;
+        _cleanup_free_ char *continuation = NULL;
+        unsigned line = 0;
+        bool bom_seen = false;
+        int r;
 
         assert(filename);
-        assert(lookup);
-
-        if (!f) {
-                f = ours = fopen(filename, "re");
-                if (!f) {
-                        /* Only log on request, except for ENOENT,
-                         * since we return 0 to the caller. */
-                        if ((flags & CONFIG_PARSE_WARN) || errno == ENOENT)
-                                log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR, errno,
-                                               "Failed to open configuration file '%s': %m", filename);
-
-                        if (errno == ENOENT) {
-                                if (ret_stat)
-                                        *ret_stat = (struct stat) {};
-
-                                return 0;
-                        }
-
-                        return -errno;
-                }
-        }
-
-        fd = fileno(f);
-        if (fd >= 0) { /* stream might not have an fd, let's be careful hence */
-
-                if (fstat(fd, &st) < 0)
-                        return log_full_errno(FLAGS_SET(flags, CONFIG_PARSE_WARN) ? LOG_ERR : LOG_DEBUG, errno,
-                                              "Failed to fstat(%s): %m", filename);
-
-                (void) stat_warn_permissions(filename, &st);
-        } else
-                st = (struct stat) {};
+        assert(f);
+        assert(handler);
 
         for (;;) {
                 _cleanup_free_ char *buf = NULL;
@@ -398,53 +365,369 @@ int config_parse(
                         continue;
                 }
 
-                r = parse_line(unit,
-                               filename,
-                               line,
-                               sections,
-                               lookup,
-                               table,
-                               flags,
-                               &section,
-                               &section_line,
-                               &section_ignored,
-                               p,
-                               userdata);
-                if (r < 0) {
-                        if (flags & CONFIG_PARSE_WARN)
-                                log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, line);
+                r = handler(line, p, userdata);
+                if (r < 0)
                         return r;
-                }
 
                 continuation = mfree(continuation);
         }
 
         if (continuation) {
-                r = parse_line(unit,
-                               filename,
-                               ++line,
-                               sections,
-                               lookup,
-                               table,
-                               flags,
-                               &section,
-                               &section_line,
-                               &section_ignored,
-                               continuation,
-                               userdata);
-                if (r < 0) {
-                        if (flags & CONFIG_PARSE_WARN)
-                                log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, line);
+                r = handler(++line, continuation, userdata);
+                if (r < 0)
                         return r;
+        }
+
+        return 0;
+}
+
+typedef struct ConfigParseState {
+        const char *unit;
+        const char *filename;
+        const char *sections;
+        ConfigItemLookup lookup;
+        const void *table;
+        ConfigParseFlags flags;
+        void *userdata;
+
+        char *section;
+        unsigned section_line;
+        bool section_ignored;
+} ConfigParseState;
+
+static void config_parse_state_done(ConfigParseState *s) {
+        assert(s);
+
+        s->section = mfree(s->section);
+}
+
+static int config_parse_line_handler(unsigned line, char *l, void *userdata) {
+        ConfigParseState *s = ASSERT_PTR(userdata);
+        int r;
+
+        r = parse_line(s->unit,
+                       s->filename,
+                       line,
+                       s->sections,
+                       s->lookup,
+                       s->table,
+                       s->flags,
+                       &s->section,
+                       &s->section_line,
+                       &s->section_ignored,
+                       l,
+                       s->userdata);
+        if (r < 0) {
+                if (s->flags & CONFIG_PARSE_WARN)
+                        log_warning_errno(r, "%s:%u: Failed to parse file: %m", s->filename, line);
+                return r;
+        }
+
+        return 0;
+}
+
+/* Same as config_parse_line_handler(), but for a line already split into key and value */
+static int config_parse_assignment_handler(unsigned line, const char *lvalue, const char *rvalue, ConfigParseState *s) {
+        int r;
+
+        assert(lvalue);
+        assert(rvalue);
+        assert(s);
+
+        /* This mirrors the tail of parse_line() */
+        if (s->sections && !s->section) {
+                if (!(s->flags & CONFIG_PARSE_RELAXED) && !s->section_ignored)
+                        log_syntax(s->unit, LOG_WARNING, s->filename, line, 0, "Assignment outside of section. Ignoring.");
+
+                return 0;
+        }
+
+        r = next_assignment(s->unit,
+                            s->filename,
+                            line,
+                            s->lookup,
+                            s->table,
+                            s->section,
+                            s->section_line,
+                            lvalue,
+                            rvalue,
+                            s->flags,
+                            s->userdata);
+        if (r < 0) {
+                if (s->flags & CONFIG_PARSE_WARN)
+                        log_warning_errno(r, "%s:%u: Failed to parse file: %m", s->filename, line);
+                return r;
+        }
+
+        return 0;
+}
+
+/* Go through the file and parse each line */
+int config_parse(
+                const char *unit,
+                const char *filename,
+                FILE *f,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata,
+                struct stat *ret_stat) {
+
+        _cleanup_(config_parse_state_done) ConfigParseState state = {
+                .unit = unit,
+                .filename = filename,
+                .sections = sections,
+                .lookup = lookup,
+                .table = table,
+                .flags = flags,
+                .userdata = userdata,
+        };
+        _cleanup_fclose_ FILE *ours = NULL;
+        struct stat st;
+        int r, fd;
+
+        assert(filename);
+        assert(lookup);
+
+        if (!f) {
+                f = ours = fopen(filename, "re");
+                if (!f) {
+                        /* Only log on request, except for ENOENT,
+                         * since we return 0 to the caller. */
+                        if ((flags & CONFIG_PARSE_WARN) || errno == ENOENT)
+                                log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR, errno,
+                                               "Failed to open configuration file '%s': %m", filename);
+
+                        if (errno == ENOENT) {
+                                if (ret_stat)
+                                        *ret_stat = (struct stat) {};
+
+                                return 0;
+                        }
+
+                        return -errno;
                 }
         }
 
+        fd = fileno(f);
+        if (fd >= 0) { /* stream might not have an fd, let's be careful hence */
+
+                if (fstat(fd, &st) < 0)
+                        return log_full_errno(FLAGS_SET(flags, CONFIG_PARSE_WARN) ? LOG_ERR : LOG_DEBUG, errno,
+                                              "Failed to fstat(%s): %m", filename);
+
+                (void) stat_warn_permissions(filename, &st);
+        } else
+                st = (struct stat) {};
+
+        r = config_read_lines(filename, f, flags, config_parse_line_handler, &state);
+        if (r < 0)
+                return r;
+
         if (ret_stat)
                 *ret_stat = st;
 
         return 1;
 }
 
+static void config_assignments_free(ConfigAssignment *a, size_t n) {
+        if (!a)
+                return;
+
+        for (size_t i = 0; i < n; i++) {
+                free(a[i].lvalue);
+                free(a[i].rvalue);
+        }
+
+        free(a);
+}
+
+ConfigFile* config_file_free(ConfigFile *c) {
+        if (!c)
+                return NULL;
+
+        free(c->filename);
+        config_assignments_free(c->assignments, c->n_lines);
+        strv_free(c->lines);
+        free(c->line_numbers);
+
+        return mfree(c);
+}
+
+static int config_file_split_assignments(ConfigFile *c) {
+        ConfigAssignment *a;
+
+        assert(c);
+
+        /* Splits all lines that parse_line() would pass on to next_assignment() as they are, without
+         * logging anything, into key and value. Everything else, i.e. section headers and anything that
+         * parse_line() complains about, is left to parse_line(). */
+
+        if (c->assignments || c->n_lines == 0)
+                return 0;
+
+        a = new0(ConfigAssignment, c->n_lines);
+        if (!a)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < c->n_lines; i++) {
+                _cleanup_free_ char *copy = NULL;
+                char *l, *e;
+
+                copy = strdup(c->lines[i]);
+                if (!copy)
+                        goto oom;
+
+                l = strstrip(copy);
+                if (isempty(l) || IN_SET(l[0], '\n', '[') || !utf8_is_valid(l))
+                        continue;
+
+                e = strchr(l, '=');
+                if (!e || e == l)
+                        continue;
+
+                *e = 0;
+
+                a[i].lvalue = strdup(strstrip(l));
+                a[i].rvalue = strdup(strstrip(e + 1));
+                if (!a[i].lvalue || !a[i].rvalue)
+                        goto oom;
+        }
+
+        c->assignments = a;
+        return 0;
+
+oom:
+        config_assignments_free(a, c->n_lines);
+        return -ENOMEM;
+}
+
+static int config_file_line_handler(unsigned line, char *l, void *userdata) {
+        ConfigFile *c = ASSERT_PTR(userdata);
+        _cleanup_free_ char *copy = NULL;
+
+        copy = strdup(l);
+        if (!copy)
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(c->line_numbers, c->n_lines + 1))
+                return -ENOMEM;
+
+        if (strv_consume_with_size(&c->lines, &c->n_lines, TAKE_PTR(copy)) < 0)
+                return -ENOMEM;
+
+        c->line_numbers[c->n_lines - 1] = line;
+        return 0;
+}
+
+int config_file_read(const char *filename, FILE *f, ConfigFile **ret) {
+        _cleanup_(config_file_freep) ConfigFile *c = NULL;
+        _cleanup_fclose_ FILE *ours = NULL;
+        int r;
+
+        assert(filename);
+        assert(ret);
+
+        /* Reads the file and splits it into logical lines, without interpreting them. This does not log and
+         * does not touch any global state, and hence may be called from any thread. */
+
+        if (!f) {
+                f = ours = fopen(filename, "re");
+                if (!f)
+                        return -errno;
+        }
+
+        c = new(ConfigFile, 1);
+        if (!c)
+                return -ENOMEM;
+
+        *c = (ConfigFile) {
+                .filename = strdup(filename),
+        };
+        if (!c->filename)
+                return -ENOMEM;
+
+        if (fstat(fileno(f), &c->st) < 0)
+                return -errno;
+
+        r = config_read_lines(filename, f, 0, config_file_line_handler, c);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+bool config_file_is_current(const ConfigFile *c, const struct stat *st) {
+        assert(c);
+        assert(st);
+
+        /* Checks whether the file is still the one we read, judging by its inode and timestamps */
+
+        return stat_inode_same(&c->st, st) &&
+                c->st.st_size == st->st_size &&
+                timespec_load_nsec(&c->st.st_mtim) == timespec_load_nsec(&st->st_mtim) &&
+                timespec_load_nsec(&c->st.st_ctim) == timespec_load_nsec(&st->st_ctim);
+}
+
+/* Parse a file previously read with config_file_read() */
+int config_parse_file(
+                const char *unit,
+                ConfigFile *c,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata) {
+
+        _cleanup_(config_parse_state_done) ConfigParseState state = {
+                .unit = unit,
+                .filename = c->filename,
+                .sections = sections,
+                .lookup = lookup,
+                .table = table,
+                .flags = flags,
+                .userdata = userdata,
+        };
+        int r;
+
+        assert(c);
+        assert(lookup);
+
+        (void) stat_warn_permissions(c->filename, &c->st);
+
+        /* Not fatal, we'll just do it the slow way then */
+        (void) config_file_split_assignments(c);
+
+        for (size_t i = 0; i < c->n_lines; i++) {
+                _cleanup_free_ char *l = NULL;
+
+                if (c->assignments && c->assignments[i].lvalue) {
+                        r = config_parse_assignment_handler(
+                                        c->line_numbers[i],
+                                        c->assignments[i].lvalue,
+                                        c->assignments[i].rvalue,
+                                        &state);
+                        if (r < 0)
+                                return r;
+
+                        continue;
+                }
+
+                /* parse_line() modifies the line, hence work on a copy */
+                l = strdup(c->lines[i]);
+                if (!l)
+                        return log_oom();
+
+                r = config_parse_line_handler(c->line_numbers[i], l, &state);
+                if (r < 0)
+                        return r;
+        }
+
+        return 1;
+}
+
 static int hashmap_put_stats_by_path(Hashmap **stats_by_path, const char *path, const struct stat *st) {
         _cleanup_free_ struct stat *st_copy = NULL;
         _cleanup_free_ char *path_copy = NULL;
@@ -712,6 +995,46 @@ bool stats_by_path_equal(Hashmap *a, Hashmap *b) {
         return true;
 }
 
+int config_get_digest_by_path(Hashmap *stats_by_path, uint8_t ret[static SHA256_DIGEST_SIZE]) {
+        _cleanup_strv_free_ char **paths = NULL;
+        struct sha256_ctx ctx;
+        struct stat *st;
+        const char *path;
+        int r;
+
+        assert(ret);
+
+        /* Calculates a digest of the paths and the contents of the files a configuration was loaded from.
+         * Unlike stats_by_path_equal(), this detects files which were rewritten with the same contents,
+         * e.g. by configuration management tools. */
+
+        HASHMAP_FOREACH_KEY(st, path, stats_by_path) {
+                r = strv_extend(&paths, path);
+                if (r < 0)
+                        return r;
+        }
+
+        strv_sort(paths);
+
+        sha256_init_ctx(&ctx);
+
+        STRV_FOREACH(p, paths) {
+                _cleanup_free_ char *data = NULL;
+                size_t size;
+
+                r = read_full_file(*p, &data, &size);
+                if (r < 0)
+                        return r;
+
+                sha256_process_bytes(*p, strlen(*p) + 1, &ctx);
+                sha256_process_bytes(&size, sizeof(size), &ctx);
+                sha256_process_bytes(data, size, &ctx);
+        }
+
+        sha256_finish_ctx(&ctx, ret);
+        return 0;
+}
+
 static void config_section_hash_func(const ConfigSection *c, struct siphash *state) {
         siphash24_compress_string(c->filename, state);
         siphash24_compress(&c->line, sizeof(c->line), state);
@@ -12,6 +12,7 @@
 #include "hashmap.h"
 #include "log.h"
 #include "macro.h"
+#include "sha256.h"
 #include "time-util.h"
 
 /* An abstract parser for simple, line based, shallow configuration files consisting of variable assignments only. */
@@ -93,6 +94,42 @@ int config_parse(
                 void *userdata,
                 struct stat *ret_stat);     /* possibly NULL */
 
+typedef struct ConfigAssignment {
+        char *lvalue;
+        char *rvalue;
+} ConfigAssignment;
+
+/* A configuration file split into its logical lines, i.e. with comments dropped and continuation lines
+ * joined, but otherwise uninterpreted. Reading this is independent of the parser tables and any state, and
+ * may hence be done ahead of time, from any thread. */
+typedef struct ConfigFile {
+        char *filename;
+        struct stat st;
+        char **lines;
+        unsigned *line_numbers;
+        size_t n_lines;
+
+        /* One entry per line: the key and value if the line is a well-formed assignment, NULL otherwise.
+         * Filled in when the file is parsed the first time, so that parsing it again (e.g. for every
+         * instance of a template unit) can skip straight to the assignments. */
+        ConfigAssignment *assignments;
+} ConfigFile;
+
+ConfigFile* config_file_free(ConfigFile *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(ConfigFile*, config_file_free);
+
+int config_file_read(const char *filename, FILE *f, ConfigFile **ret);
+bool config_file_is_current(const ConfigFile *c, const struct stat *st);
+
+int config_parse_file(
+                const char *unit,
+                ConfigFile *c,
+                const char *sections,       /* nulstr */
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata);
+
 int config_parse_many_nulstr(
                 const char *conf_file,      /* possibly NULL */
                 const char *conf_file_dirs, /* nulstr */
@@ -122,6 +159,7 @@ int config_get_stats_by_path(
                 Hashmap **ret);
 
 bool stats_by_path_equal(Hashmap *a, Hashmap *b);
+int config_get_digest_by_path(Hashmap *stats_by_path, uint8_t ret[static SHA256_DIGEST_SIZE]);
 
 typedef struct ConfigSection {
         unsigned line;
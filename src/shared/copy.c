@@ -2,6 +2,8 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,6 +15,7 @@
 #include "btrfs-util.h"
 #include "chattr-util.h"
 #include "copy.h"
+#include "cpu-set-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
 #include "fileio.h"
@@ -44,6 +47,11 @@
  * case of bind mount cycles and suchlike. */
 #define COPY_DEPTH_MAX 2048U
 
+/* With COPY_PARALLEL, at most this many worker threads are used, and at most this many files are queued for
+ * them. Every queued file holds three fds. */
+#define COPY_QUEUE_THREADS_MAX 16U
+#define COPY_QUEUE_JOBS_MAX 128U
+
 static ssize_t try_copy_file_range(
                 int fd_in, loff_t *off_in,
                 int fd_out, loff_t *off_out,
@@ -676,50 +684,33 @@ static int memorize_hardlink(
         return 1;
 }
 
-static int fd_copy_regular(
-                int df,
-                const char *from,
+static int fd_copy_regular_contents(
+                int fdf,
+                int fdt,
                 const struct stat *st,
                 int dt,
                 const char *to,
                 uid_t override_uid,
                 gid_t override_gid,
                 CopyFlags copy_flags,
-                HardlinkContext *hardlink_context,
                 copy_progress_bytes_t progress,
                 void *userdata) {
 
-        _cleanup_close_ int fdf = -1, fdt = -1;
         int r, q;
 
-        assert(from);
+        assert(fdf >= 0);
+        assert(fdt >= 0);
         assert(st);
         assert(to);
 
-        r = try_hardlink(hardlink_context, st, dt, to);
-        if (r < 0)
-                return r;
-        if (r > 0) /* worked! */
-                return 0;
-
-        fdf = openat(df, from, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
-        if (fdf < 0)
-                return -errno;
-
-        if (copy_flags & COPY_MAC_CREATE) {
-                r = mac_selinux_create_file_prepare_at(dt, to, S_IFREG);
-                if (r < 0)
-                        return r;
-        }
-        fdt = openat(dt, to, O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW, st->st_mode & 07777);
-        if (copy_flags & COPY_MAC_CREATE)
-                mac_selinux_create_file_clear();
-        if (fdt < 0)
-                return -errno;
+        /* Copies contents and metadata of a freshly created file, and closes fdt. If that fails, the file is
+         * removed again. */
 
         r = copy_bytes_full(fdf, fdt, UINT64_MAX, copy_flags, NULL, NULL, progress, userdata);
-        if (r < 0)
+        if (r < 0) {
+                safe_close(fdt);
                 goto fail;
+        }
 
         if (fchown(fdt,
                    uid_is_valid(override_uid) ? override_uid : st->st_uid,
@@ -735,17 +726,17 @@ static int fd_copy_regular(
         if (copy_flags & COPY_FSYNC) {
                 if (fsync(fdt) < 0) {
                         r = -errno;
+                        safe_close(fdt);
                         goto fail;
                 }
         }
 
-        q = close_nointr(TAKE_FD(fdt)); /* even if this fails, the fd is now invalidated */
+        q = close_nointr(fdt); /* even if this fails, the fd is now invalidated */
         if (q < 0) {
                 r = q;
                 goto fail;
         }
 
-        (void) memorize_hardlink(hardlink_context, st, dt, to);
         return r;
 
 fail:
@@ -753,6 +744,364 @@ fail:
         return r;
 }
 
+/* With COPY_PARALLEL, the tree is still walked and all inodes are created on the calling thread, in the
+ * usual order, but copying the contents and metadata of regular files is handed to worker threads. For
+ * trees of many small files that is dominated by the latency of the syscalls involved, not by bandwidth,
+ * hence doing it for several files at the same time helps a lot. */
+
+typedef struct CopyJob {
+        struct CopyJob *next;
+        int fdf;
+        int fdt;
+        int dt;
+        char *to;
+        struct stat st;
+        uid_t override_uid;
+        gid_t override_gid;
+} CopyJob;
+
+typedef struct CopyQueue {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        pthread_t *threads;
+        size_t n_threads;
+
+        CopyJob *head, *tail;
+        size_t n_queued;
+        bool done;
+        bool cancelled;
+        int error;
+
+        CopyFlags copy_flags;
+
+        /* The progress callback is invoked with this lock taken, so that it never runs concurrently */
+        pthread_mutex_t progress_mutex;
+        copy_progress_bytes_t progress;
+        void *userdata;
+} CopyQueue;
+
+static CopyJob* copy_job_free(CopyJob *j) {
+        if (!j)
+                return NULL;
+
+        safe_close(j->fdf);
+        safe_close(j->fdt);
+        if (j->dt >= 0)
+                safe_close(j->dt);
+        free(j->to);
+        return mfree(j);
+}
+
+static int copy_queue_progress(uint64_t n_bytes, void *userdata) {
+        CopyQueue *q = ASSERT_PTR(userdata);
+        int r;
+
+        assert_se(pthread_mutex_lock(&q->progress_mutex) == 0);
+        r = q->progress(n_bytes, q->userdata);
+        assert_se(pthread_mutex_unlock(&q->progress_mutex) == 0);
+
+        return r;
+}
+
+static void* copy_queue_thread(void *userdata) {
+        CopyQueue *q = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "copy-worker");
+
+        for (;;) {
+                CopyJob *j;
+                bool cancelled;
+                int r;
+
+                assert_se(pthread_mutex_lock(&q->mutex) == 0);
+
+                while (!q->head && !q->done)
+                        assert_se(pthread_cond_wait(&q->cond, &q->mutex) == 0);
+
+                j = q->head;
+                if (j) {
+                        q->head = j->next;
+                        if (!q->head)
+                                q->tail = NULL;
+                        q->n_queued--;
+
+                        /* There's room in the queue again */
+                        assert_se(pthread_cond_broadcast(&q->cond) == 0);
+                }
+
+                cancelled = q->cancelled;
+                assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+
+                if (!j)
+                        break;
+
+                if (cancelled) {
+                        /* Don't leave empty files behind */
+                        (void) unlinkat(j->dt, j->to, 0);
+                        copy_job_free(j);
+                        continue;
+                }
+
+                r = fd_copy_regular_contents(
+                                j->fdf, TAKE_FD(j->fdt),
+                                &j->st,
+                                j->dt, j->to,
+                                j->override_uid, j->override_gid,
+                                q->copy_flags,
+                                q->progress ? copy_queue_progress : NULL, q);
+                if (r < 0) {
+                        assert_se(pthread_mutex_lock(&q->mutex) == 0);
+                        /* Remember the first error, but make sure an interruption is always propagated */
+                        if (q->error >= 0 || r == -EINTR)
+                                q->error = r;
+                        assert_se(pthread_cond_broadcast(&q->cond) == 0);
+                        assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+                }
+
+                copy_job_free(j);
+        }
+
+        return NULL;
+}
+
+static int copy_queue_wait(CopyQueue *q, bool cancel) {
+        assert(q);
+
+        /* Waits until all queued files are copied, or removed again if cancel is true, and returns the first
+         * error a worker ran into. */
+
+        assert_se(pthread_mutex_lock(&q->mutex) == 0);
+        q->done = true;
+        if (cancel)
+                q->cancelled = true;
+        assert_se(pthread_cond_broadcast(&q->cond) == 0);
+        assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+
+        for (size_t i = 0; i < q->n_threads; i++)
+                assert_se(pthread_join(q->threads[i], NULL) == 0);
+        q->n_threads = 0;
+
+        assert(!q->head);
+        return q->error;
+}
+
+static CopyQueue* copy_queue_free(CopyQueue *q) {
+        if (!q)
+                return NULL;
+
+        if (q->n_threads > 0)
+                (void) copy_queue_wait(q, /* cancel= */ true);
+
+        assert_se(pthread_cond_destroy(&q->cond) == 0);
+        assert_se(pthread_mutex_destroy(&q->mutex) == 0);
+        assert_se(pthread_mutex_destroy(&q->progress_mutex) == 0);
+
+        free(q->threads);
+        return mfree(q);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(CopyQueue*, copy_queue_free);
+
+static int copy_queue_new(
+                CopyFlags copy_flags,
+                copy_progress_bytes_t progress,
+                void *userdata,
+                CopyQueue **ret) {
+
+        _cleanup_(copy_queue_freep) CopyQueue *q = NULL;
+        sigset_t ss, saved_ss;
+        size_t n;
+        int r, k;
+
+        assert(ret);
+
+        /* The workers mostly wait for the disk, hence use a couple more than there are CPUs */
+        r = cpus_in_affinity_mask();
+        n = r > 0 ? MIN((unsigned) r * 2, COPY_QUEUE_THREADS_MAX) : 2;
+
+        q = new(CopyQueue, 1);
+        if (!q)
+                return -ENOMEM;
+
+        *q = (CopyQueue) {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+                .progress_mutex = PTHREAD_MUTEX_INITIALIZER,
+                .copy_flags = copy_flags,
+                .progress = progress,
+                .userdata = userdata,
+        };
+
+        q->threads = new(pthread_t, n);
+        if (!q->threads)
+                return -ENOMEM;
+
+        /* Workers must never get signals. With COPY_SIGINT/COPY_SIGTERM the caller blocked them already, and
+         * copy_bytes() checks for them being pending in the workers too. */
+        assert_se(sigfillset(&ss) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        for (; q->n_threads < n; q->n_threads++) {
+                r = pthread_create(q->threads + q->n_threads, NULL, copy_queue_thread, q);
+                if (r > 0) {
+                        r = -r;
+                        break;
+                }
+        }
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (k > 0 && r >= 0)
+                r = -k;
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(q);
+        return 0;
+}
+
+static int copy_queue_submit(
+                CopyQueue *q,
+                int *fdf,
+                int *fdt,
+                const struct stat *st,
+                int dt,
+                const char *to,
+                uid_t override_uid,
+                gid_t override_gid) {
+
+        _cleanup_free_ char *t = NULL;
+        _cleanup_close_ int dt_copy = -1;
+        CopyJob *j;
+        int r;
+
+        assert(q);
+        assert(fdf);
+        assert(fdt);
+        assert(st);
+        assert(to);
+
+        /* Takes over both fds on success */
+
+        if (dt == AT_FDCWD)
+                dt_copy = AT_FDCWD;
+        else {
+                dt_copy = fcntl(dt, F_DUPFD_CLOEXEC, 3);
+                if (dt_copy < 0)
+                        return -errno;
+        }
+
+        t = strdup(to);
+        if (!t)
+                return -ENOMEM;
+
+        j = new(CopyJob, 1);
+        if (!j)
+                return -ENOMEM;
+
+        *j = (CopyJob) {
+                .fdf = TAKE_FD(*fdf),
+                .fdt = TAKE_FD(*fdt),
+                .dt = TAKE_FD(dt_copy),
+                .to = TAKE_PTR(t),
+                .st = *st,
+                .override_uid = override_uid,
+                .override_gid = override_gid,
+        };
+
+        assert_se(pthread_mutex_lock(&q->mutex) == 0);
+
+        /* Don't keep more fds open than necessary, wait for the workers if they can't keep up */
+        while (q->n_queued >= COPY_QUEUE_JOBS_MAX && q->error != -EINTR)
+                assert_se(pthread_cond_wait(&q->cond, &q->mutex) == 0);
+
+        r = q->error;
+        if (r != -EINTR) {
+                if (q->tail)
+                        q->tail->next = j;
+                else
+                        q->head = j;
+                q->tail = j;
+                q->n_queued++;
+
+                assert_se(pthread_cond_broadcast(&q->cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+
+        if (r == -EINTR) {
+                /* A worker saw SIGINT/SIGTERM, hand the fds back, so that the caller cleans up */
+                *fdf = TAKE_FD(j->fdf);
+                *fdt = TAKE_FD(j->fdt);
+                copy_job_free(j);
+                return r;
+        }
+
+        return 0;
+}
+
+static int fd_copy_regular(
+                int df,
+                const char *from,
+                const struct stat *st,
+                int dt,
+                const char *to,
+                uid_t override_uid,
+                gid_t override_gid,
+                CopyFlags copy_flags,
+                HardlinkContext *hardlink_context,
+                CopyQueue *queue,
+                copy_progress_bytes_t progress,
+                void *userdata) {
+
+        _cleanup_close_ int fdf = -1, fdt = -1;
+        int r;
+
+        assert(from);
+        assert(st);
+        assert(to);
+
+        r = try_hardlink(hardlink_context, st, dt, to);
+        if (r < 0)
+                return r;
+        if (r > 0) /* worked! */
+                return 0;
+
+        fdf = openat(df, from, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
+        if (fdf < 0)
+                return -errno;
+
+        if (copy_flags & COPY_MAC_CREATE) {
+                r = mac_selinux_create_file_prepare_at(dt, to, S_IFREG);
+                if (r < 0)
+                        return r;
+        }
+        fdt = openat(dt, to, O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW, st->st_mode & 07777);
+        if (copy_flags & COPY_MAC_CREATE)
+                mac_selinux_create_file_clear();
+        if (fdt < 0)
+                return -errno;
+
+        if (queue) {
+                r = copy_queue_submit(queue, &fdf, &fdt, st, dt, to, override_uid, override_gid);
+                if (r < 0) {
+                        (void) unlinkat(dt, to, 0);
+                        return r;
+                }
+
+                /* The inode exists already, even if the worker hasn't filled it yet */
+                (void) memorize_hardlink(hardlink_context, st, dt, to);
+                return 0;
+        }
+
+        r = fd_copy_regular_contents(fdf, TAKE_FD(fdt), st, dt, to, override_uid, override_gid, copy_flags, progress, userdata);
+        if (r >= 0)
+                (void) memorize_hardlink(hardlink_context, st, dt, to);
+        return r;
+}
+
 static int fd_copy_fifo(
                 int df,
                 const char *from,
@@ -861,6 +1210,7 @@ static int fd_copy_directory(
                 gid_t override_gid,
                 CopyFlags copy_flags,
                 HardlinkContext *hardlink_context,
+                CopyQueue *queue,
                 const char *display_path,
                 copy_progress_path_t progress_path,
                 copy_progress_bytes_t progress_bytes,
@@ -870,6 +1220,7 @@ static int fd_copy_directory(
                 .dir_fd = -1,
                 .parent_fd = -1,
         };
+        _cleanup_(copy_queue_freep) CopyQueue *our_queue = NULL;
 
         _cleanup_close_ int fdf = -1, fdt = -1;
         _cleanup_closedir_ DIR *d = NULL;
@@ -899,6 +1250,15 @@ static int fd_copy_directory(
                         hardlink_context = &our_hardlink_context;
         }
 
+        if (!queue && FLAGS_SET(copy_flags, COPY_PARALLEL)) {
+                /* Likewise, start the worker threads for the whole tree here */
+                r = copy_queue_new(copy_flags, progress_bytes, userdata, &our_queue);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to start copy worker threads, copying serially: %m");
+
+                queue = our_queue;
+        }
+
         d = take_fdopendir(&fdf);
         if (!d)
                 return -errno;
@@ -993,9 +1353,9 @@ static int fd_copy_directory(
                                         continue;
                         }
 
-                        q = fd_copy_directory(dirfd(d), de->d_name, &buf, fdt, de->d_name, original_device, depth_left-1, override_uid, override_gid, copy_flags, hardlink_context, child_display_path, progress_path, progress_bytes, userdata);
+                        q = fd_copy_directory(dirfd(d), de->d_name, &buf, fdt, de->d_name, original_device, depth_left-1, override_uid, override_gid, copy_flags, hardlink_context, queue, child_display_path, progress_path, progress_bytes, userdata);
                 } else if (S_ISREG(buf.st_mode))
-                        q = fd_copy_regular(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags, hardlink_context, progress_bytes, userdata);
+                        q = fd_copy_regular(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags, hardlink_context, queue, progress_bytes, userdata);
                 else if (S_ISLNK(buf.st_mode))
                         q = fd_copy_symlink(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags);
                 else if (S_ISFIFO(buf.st_mode))
@@ -1013,6 +1373,14 @@ static int fd_copy_directory(
                         r = q;
         }
 
+        if (our_queue) {
+                int q;
+
+                q = copy_queue_wait(our_queue, /* cancel= */ false);
+                if (q < 0)
+                        r = q;
+        }
+
         if (created) {
                 if (fchown(fdt,
                            uid_is_valid(override_uid) ? override_uid : st->st_uid,
@@ -1056,9 +1424,9 @@ int copy_tree_at_full(
                 return -errno;
 
         if (S_ISREG(st.st_mode))
-                r = fd_copy_regular(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags, NULL, progress_bytes, userdata);
+                r = fd_copy_regular(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags, NULL, NULL, progress_bytes, userdata);
         else if (S_ISDIR(st.st_mode))
-                r = fd_copy_directory(fdf, from, &st, fdt, to, st.st_dev, COPY_DEPTH_MAX, override_uid, override_gid, copy_flags, NULL, NULL, progress_path, progress_bytes, userdata);
+                r = fd_copy_directory(fdf, from, &st, fdt, to, st.st_dev, COPY_DEPTH_MAX, override_uid, override_gid, copy_flags, NULL, NULL, NULL, progress_path, progress_bytes, userdata);
         else if (S_ISLNK(st.st_mode))
                 r = fd_copy_symlink(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags);
         else if (S_ISFIFO(st.st_mode))
@@ -1128,7 +1496,7 @@ int copy_directory_fd_full(
                         COPY_DEPTH_MAX,
                         UID_INVALID, GID_INVALID,
                         copy_flags,
-                        NULL, NULL,
+                        NULL, NULL, NULL,
                         progress_path,
                         progress_bytes,
                         userdata);
@@ -1171,7 +1539,7 @@ int copy_directory_full(
                         COPY_DEPTH_MAX,
                         UID_INVALID, GID_INVALID,
                         copy_flags,
-                        NULL, NULL,
+                        NULL, NULL, NULL,
                         progress_path,
                         progress_bytes,
                         userdata);
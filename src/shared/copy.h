@@ -25,6 +25,7 @@ typedef enum CopyFlags {
         COPY_SYNCFS      = 1 << 12, /* syncfs() the *top-level* dir after we are done */
         COPY_ALL_XATTRS  = 1 << 13, /* Preserve all xattrs when copying, not just those in the user namespace */
         COPY_HOLES       = 1 << 14, /* Copy holes */
+        COPY_PARALLEL    = 1 << 15, /* Copy the contents of regular files on a pool of worker threads */
 } CopyFlags;
 
 typedef int (*copy_progress_bytes_t)(uint64_t n_bytes, void *userdata);
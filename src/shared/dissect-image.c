@@ -4,6 +4,7 @@
 #include <valgrind/memcheck.h>
 #endif
 
+#include <fcntl.h>
 #include <linux/blkpg.h>
 #include <linux/dm-ioctl.h>
 #include <linux/loop.h>
@@ -74,6 +75,10 @@
 /* how many times to wait for the device nodes to appear */
 #define N_DEVICE_NODE_LIST_ATTEMPTS 10
 
+/* How much to read ahead of each partition before probing it. Covers the superblocks of all file systems we
+ * care about, the btrfs one at 64K being the furthest away from the start. */
+#define PROBE_READAHEAD_BYTES (128U * 1024U)
+
 int probe_filesystem(const char *node, char **ret_fstype) {
         /* Try to find device content type and return it in *ret_fstype. If nothing is found,
          * 0/NULL will be returned. -EUCLEAN will be returned for ambiguous results, and an
@@ -127,6 +132,55 @@ not_found:
 }
 
 #if HAVE_BLKID
+static int probe_filesystems(DissectedImage *m) {
+        int fds[_PARTITION_DESIGNATOR_MAX];
+        int r = 0;
+
+        assert(m);
+
+        /* Probing is dominated by reading the superblocks, one partition after the other. Hence, kick off
+         * reading the beginning of all partitions we need to probe at once first, so that the I/O is done
+         * concurrently and the probes are served from the page cache. We keep the devices open until we are
+         * done, as the page cache of a block device is dropped when it is closed for the last time. */
+
+        for (PartitionDesignator i = 0; i < _PARTITION_DESIGNATOR_MAX; i++) {
+                DissectedPartition *p = m->partitions + i;
+
+                fds[i] = -1;
+
+                if (!p->found || p->fstype || !p->node)
+                        continue;
+
+                fds[i] = open(p->node, O_RDONLY|O_CLOEXEC|O_NONBLOCK|O_NOCTTY);
+                if (fds[i] < 0) {
+                        log_debug_errno(errno, "Failed to open %s for readahead, ignoring: %m", p->node);
+                        continue;
+                }
+
+                r = posix_fadvise(fds[i], 0, PROBE_READAHEAD_BYTES, POSIX_FADV_WILLNEED);
+                if (r != 0)
+                        log_debug_errno(r, "Failed to initiate readahead on %s, ignoring: %m", p->node);
+        }
+
+        r = 0;
+
+        for (PartitionDesignator i = 0; i < _PARTITION_DESIGNATOR_MAX; i++) {
+                DissectedPartition *p = m->partitions + i;
+
+                if (!p->found || p->fstype || !p->node)
+                        continue;
+
+                r = probe_filesystem(p->node, &p->fstype);
+                if (r < 0 && r != -EUCLEAN)
+                        break;
+
+                r = 0;
+        }
+
+        close_many(fds, _PARTITION_DESIGNATOR_MAX);
+        return r;
+}
+
 static void check_partition_flags(
                 const char *node,
                 unsigned long long pflags,
@@ -1192,18 +1246,16 @@ int dissect_image(
         b = NULL;
 
         /* Fill in file system types if we don't know them yet. */
+        r = probe_filesystems(m);
+        if (r < 0)
+                return r;
+
         for (PartitionDesignator i = 0; i < _PARTITION_DESIGNATOR_MAX; i++) {
                 DissectedPartition *p = m->partitions + i;
 
                 if (!p->found)
                         continue;
 
-                if (!p->fstype && p->node) {
-                        r = probe_filesystem(p->node, &p->fstype);
-                        if (r < 0 && r != -EUCLEAN)
-                                return r;
-                }
-
                 if (streq_ptr(p->fstype, "crypto_LUKS"))
                         m->encrypted = true;
 
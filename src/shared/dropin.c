@@ -224,6 +224,7 @@ int unit_file_find_dropin_paths(
                 const char *original_root,
                 char **lookup_path,
                 Set *unit_path_cache,
+                Hashmap **dir_cache,
                 const char *dir_suffix,
                 const char *file_suffix,
                 const char *name,
@@ -270,7 +271,12 @@ int unit_file_find_dropin_paths(
                 return 0;
         }
 
-        r = conf_files_list_strv(ret, file_suffix, NULL, 0, (const char**) dirs);
+        /* The same drop-in directories (e.g. the top-level "service.d/") are looked at for many units, hence
+         * let's reuse their listings if we can. */
+        if (dir_cache)
+                r = conf_files_list_strv_cached(ret, file_suffix, NULL, 0, (const char**) dirs, dir_cache);
+        else
+                r = conf_files_list_strv(ret, file_suffix, NULL, 0, (const char**) dirs);
         if (r < 0)
                 return log_warning_errno(r, "Failed to create the list of configuration files: %m");
 
@@ -19,6 +19,7 @@ int unit_file_find_dropin_paths(
                 const char *original_root,
                 char **lookup_path,
                 Set *unit_path_cache,
+                Hashmap **dir_cache,
                 const char *dir_suffix,
                 const char *file_suffix,
                 const char *name,
@@ -18,6 +18,7 @@
 #include "hashmap.h"
 #include "macro.h"
 #include "missing_syscall.h"
+#include "path-util.h"
 #include "process-util.h"
 #include "rlimit-util.h"
 #include "serialize.h"
@@ -34,7 +35,24 @@
 /* Put this test here for a lack of better place */
 assert_cc(EAGAIN == EWOULDBLOCK);
 
-static int do_spawn(const char *path, char *argv[], int stdout_fd, pid_t *pid, bool set_systemd_exec_pid) {
+static exec_builtin_main_t find_builtin(const ExecBuiltin *builtins, const char *path) {
+        assert(path);
+
+        for (const ExecBuiltin *b = builtins; b && b->path; b++)
+                if (path_equal(b->path, path))
+                        return b->main;
+
+        return NULL;
+}
+
+static int do_spawn(
+                const char *path,
+                char *argv[],
+                int stdout_fd,
+                pid_t *pid,
+                bool set_systemd_exec_pid,
+                exec_builtin_main_t builtin) {
+
         pid_t _pid;
         int r;
 
@@ -70,6 +88,13 @@ static int do_spawn(const char *path, char *argv[], int stdout_fd, pid_t *pid, b
                 } else
                         argv[0] = (char*) path;
 
+                if (builtin) {
+                        /* Saves the execve() and the dynamic linking. We are a copy of a process in which the
+                         * built-in program never ran, hence its global state is still pristine. */
+                        log_debug("Running %s built in.", path);
+                        _exit(builtin(strv_length(argv), argv));
+                }
+
                 execv(path, argv);
                 log_error_errno(errno, "Failed to execute %s: %m", path);
                 _exit(EXIT_FAILURE);
@@ -87,7 +112,8 @@ static int do_execute(
                 int output_fd,
                 char *argv[],
                 char *envp[],
-                ExecDirFlags flags) {
+                ExecDirFlags flags,
+                const ExecBuiltin *builtins) {
 
         _cleanup_hashmap_free_free_ Hashmap *pids = NULL;
         _cleanup_strv_free_ char **paths = NULL;
@@ -137,7 +163,7 @@ static int do_execute(
                                 return log_error_errno(fd, "Failed to open serialization file: %m");
                 }
 
-                r = do_spawn(t, argv, fd, &pid, FLAGS_SET(flags, EXEC_DIR_SET_SYSTEMD_EXEC_PID));
+                r = do_spawn(t, argv, fd, &pid, FLAGS_SET(flags, EXEC_DIR_SET_SYSTEMD_EXEC_PID), find_builtin(builtins, *path));
                 if (r <= 0)
                         continue;
 
@@ -190,14 +216,15 @@ static int do_execute(
         return 0;
 }
 
-int execute_directories(
+int execute_directories_full(
                 const char* const* directories,
                 usec_t timeout,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 char *argv[],
                 char *envp[],
-                ExecDirFlags flags) {
+                ExecDirFlags flags,
+                const ExecBuiltin *builtins) {
 
         char **dirs = (char**) directories;
         _cleanup_close_ int fd = -1;
@@ -229,7 +256,7 @@ int execute_directories(
         if (r < 0)
                 return r;
         if (r == 0) {
-                r = do_execute(dirs, timeout, callbacks, callback_args, fd, argv, envp, flags);
+                r = do_execute(dirs, timeout, callbacks, callback_args, fd, argv, envp, flags, builtins);
                 _exit(r < 0 ? EXIT_FAILURE : r);
         }
 
@@ -6,6 +6,7 @@
 #include "time-util.h"
 
 typedef int (*gather_stdout_callback_t) (int fd, void *arg);
+typedef int (*exec_builtin_main_t) (int argc, char *argv[]);
 
 enum {
         STDOUT_GENERATE,   /* from generators to helper process */
@@ -30,14 +31,33 @@ typedef enum ExecCommandFlags {
         _EXEC_COMMAND_FLAGS_INVALID   = -EINVAL,
 } ExecCommandFlags;
 
-int execute_directories(
+/* A program linked into the calling binary. If the executable found in the directories is the one at `path`,
+ * `main` is called in the forked child instead of executing it. The array is terminated by an entry with
+ * path set to NULL. */
+typedef struct ExecBuiltin {
+        const char *path;
+        exec_builtin_main_t main;
+} ExecBuiltin;
+
+int execute_directories_full(
+                const char* const* directories,
+                usec_t timeout,
+                gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
+                void* const callback_args[_STDOUT_CONSUME_MAX],
+                char *argv[],
+                char *envp[],
+                ExecDirFlags flags,
+                const ExecBuiltin *builtins);
+static inline int execute_directories(
                 const char* const* directories,
                 usec_t timeout,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 char *argv[],
                 char *envp[],
-                ExecDirFlags flags);
+                ExecDirFlags flags) {
+        return execute_directories_full(directories, timeout, callbacks, callback_args, argv, envp, flags, NULL);
+}
 
 int exec_command_flags_from_strv(char **ex_opts, ExecCommandFlags *flags);
 int exec_command_flags_to_strv(ExecCommandFlags flags, char ***ex_opts);
@@ -18,6 +18,7 @@
 #include "special.h"
 #include "specifier.h"
 #include "string-util.h"
+#include "strv.h"
 #include "time-util.h"
 #include "unit-name.h"
 #include "util.h"
@@ -736,6 +737,33 @@ int generator_write_veritysetup_service_section(
         return 0;
 }
 
+int generator_declare_inputs(char * const *paths) {
+        _cleanup_free_ char *j = NULL, *data = NULL;
+        const char *e;
+        int r;
+
+        /* Tells the manager which paths our output depends on, so that it can skip running the generators
+         * on reload if none of them changed. See $SYSTEMD_GENERATOR_INPUTS_DIR in systemd.generator(7). */
+
+        e = getenv("SYSTEMD_GENERATOR_INPUTS_DIR");
+        if (!e)
+                return 0;
+
+        j = path_join(e, program_invocation_short_name);
+        if (!j)
+                return log_oom();
+
+        data = strv_join((char**) paths, "\n");
+        if (!data)
+                return log_oom();
+
+        r = write_string_file(j, data, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to declare generator inputs in %s, ignoring: %m", j);
+
+        return 1;
+}
+
 void log_setup_generator(void) {
         /* Disable talking to syslog/journal (i.e. the two IPC-based loggers) if we run in system context. */
         if (cg_pid_get_owner_uid(0, NULL) == -ENXIO /* not running in a per-user slice */)
@@ -79,6 +79,8 @@ int generator_hook_up_growfs(
 
 int generator_enable_remount_fs_service(const char *dir);
 
+int generator_declare_inputs(char * const *paths);
+
 void log_setup_generator(void);
 
 /* Similar to DEFINE_MAIN_FUNCTION, but initializes logging and assigns positional arguments. */
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <sys/stat.h>
 
@@ -11,6 +12,7 @@
 #include "fs-util.h"
 #include "hwdb-internal.h"
 #include "hwdb-util.h"
+#include "io-util.h"
 #include "label.h"
 #include "mkdir-label.h"
 #include "nulstr-util.h"
@@ -76,19 +78,22 @@ static int trie_children_cmp(const struct trie_child_entry *a, const struct trie
 }
 
 static int node_add_child(struct trie *trie, struct trie_node *node, struct trie_node *node_child, uint8_t c) {
-        struct trie_child_entry *child;
+        size_t i;
 
-        /* extend array, add new entry, sort for bisection */
-        child = reallocarray(node->children, node->children_count + 1, sizeof(struct trie_child_entry));
-        if (!child)
+        /* extend array, insert new entry at its sorted position for bisection */
+        if (!GREEDY_REALLOC(node->children, node->children_count + 1))
                 return -ENOMEM;
 
-        node->children = child;
-        trie->children_count++;
-        node->children[node->children_count].c = c;
-        node->children[node->children_count].child = node_child;
+        for (i = node->children_count; i > 0 && node->children[i-1].c > c; i--)
+                ;
+        memmove(node->children + i + 1, node->children + i, (node->children_count - i) * sizeof(struct trie_child_entry));
+
+        node->children[i] = (struct trie_child_entry) {
+                .c = c,
+                .child = node_child,
+        };
         node->children_count++;
-        typesafe_qsort(node->children, node->children_count, trie_children_cmp);
+        trie->children_count++;
         trie->nodes_count++;
 
         return 0;
@@ -127,16 +132,11 @@ static struct trie* trie_free(struct trie *trie) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct trie*, trie_free);
 
-static int trie_values_cmp(const struct trie_value_entry *a, const struct trie_value_entry *b, struct trie *trie) {
-        return strcmp(trie->strings->buf + a->key_off,
-                      trie->strings->buf + b->key_off);
-}
-
 static int trie_node_add_value(struct trie *trie, struct trie_node *node,
                                const char *key, const char *value,
                                const char *filename, uint16_t file_priority, uint32_t line_number, bool compat) {
         ssize_t k, v, fn = 0;
-        struct trie_value_entry *val;
+        size_t lo = 0, hi;
 
         k = strbuf_add_string(trie->strings, key, strlen(key));
         if (k < 0)
@@ -151,31 +151,34 @@ static int trie_node_add_value(struct trie *trie, struct trie_node *node,
                         return fn;
         }
 
-        if (node->values_count) {
-                struct trie_value_entry search = {
-                        .key_off = k,
-                        .value_off = v,
-                };
+        /* bisect for the key, which yields the insertion point if it is not there yet */
+        hi = node->values_count;
+        while (lo < hi) {
+                size_t m = lo + (hi - lo) / 2;
+                int d;
 
-                val = typesafe_bsearch_r(&search, node->values, node->values_count, trie_values_cmp, trie);
-                if (val) {
+                d = strcmp(trie->strings->buf + node->values[m].key_off, trie->strings->buf + k);
+                if (d == 0) {
                         /* At this point we have 2 identical properties on the same match-string.
                          * Since we process files in order, we just replace the previous value. */
-                        val->value_off = v;
-                        val->filename_off = fn;
-                        val->file_priority = file_priority;
-                        val->line_number = line_number;
+                        node->values[m].value_off = v;
+                        node->values[m].filename_off = fn;
+                        node->values[m].file_priority = file_priority;
+                        node->values[m].line_number = line_number;
                         return 0;
                 }
+                if (d < 0)
+                        lo = m + 1;
+                else
+                        hi = m;
         }
 
-        /* extend array, add new entry, sort for bisection */
-        val = reallocarray(node->values, node->values_count + 1, sizeof(struct trie_value_entry));
-        if (!val)
+        /* extend array, insert new entry at its sorted position for bisection */
+        if (!GREEDY_REALLOC(node->values, node->values_count + 1))
                 return -ENOMEM;
-        trie->values_count++;
-        node->values = val;
-        node->values[node->values_count] = (struct trie_value_entry) {
+
+        memmove(node->values + lo + 1, node->values + lo, (node->values_count - lo) * sizeof(struct trie_value_entry));
+        node->values[lo] = (struct trie_value_entry) {
                 .key_off = k,
                 .value_off = v,
                 .filename_off = fn,
@@ -183,7 +186,7 @@ static int trie_node_add_value(struct trie *trie, struct trie_node *node,
                 .line_number = line_number,
         };
         node->values_count++;
-        typesafe_qsort_r(node->values, node->values_count, trie_values_cmp, trie);
+        trie->values_count++;
         return 0;
 }
 
@@ -353,7 +356,7 @@ static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node, boo
         return node_off;
 }
 
-static int trie_store(struct trie *trie, const char *filename, bool compat) {
+static int trie_store(struct trie *trie, const char *filename, const uint8_t *sources_digest, bool compat) {
         struct trie_f t = {
                 .trie = trie,
         };
@@ -371,6 +374,9 @@ static int trie_store(struct trie *trie, const char *filename, bool compat) {
         };
         int r;
 
+        if (sources_digest)
+                memcpy(h.sources_digest, sources_digest, sizeof(h.sources_digest));
+
         /* calculate size of header, nodes, children entries, value entries */
         t.strings_off = sizeof(struct trie_header_f);
         trie_store_nodes_size(&t, trie->root, compat);
@@ -579,11 +585,71 @@ static int import_file(struct trie *trie, const char *filename, uint16_t file_pr
         return r;
 }
 
+static int hwdb_sources_digest(char * const *files, bool compat, uint8_t ret[static SHA256_DIGEST_SIZE]) {
+        struct sha256_ctx ctx;
+        int r;
+
+        assert(ret);
+
+        /* Covers the paths, order and contents of the source files, as well as the format the database is
+         * written in. Hashing the contents rather than comparing timestamps also catches files which were
+         * rewritten with the same mtime, e.g. when installed from a package. */
+
+        sha256_init_ctx(&ctx);
+        sha256_process_bytes(&compat, sizeof(compat), &ctx);
+
+        STRV_FOREACH(f, files) {
+                _cleanup_free_ char *data = NULL;
+                size_t size;
+
+                r = read_full_file(*f, &data, &size);
+                if (r < 0)
+                        return r;
+
+                sha256_process_bytes(*f, strlen(*f) + 1, &ctx);
+                sha256_process_bytes(&size, sizeof(size), &ctx);
+                sha256_process_bytes(data, size, &ctx);
+        }
+
+        sha256_finish_ctx(&ctx, ret);
+        return 0;
+}
+
+static bool hwdb_bin_up_to_date(const char *hwdb_bin, const uint8_t sources_digest[static SHA256_DIGEST_SIZE], bool compat) {
+        static const uint8_t sig[] = HWDB_SIG;
+        _cleanup_close_ int fd = -1;
+        struct trie_header_f h;
+        struct stat st;
+
+        assert(hwdb_bin);
+        assert(sources_digest);
+
+        fd = open(hwdb_bin, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return false;
+
+        if (fstat(fd, &st) < 0)
+                return false;
+
+        /* Databases written by older versions have a shorter header, hence this fails for them */
+        if (loop_read_exact(fd, &h, sizeof(h), false) < 0)
+                return false;
+
+        return memcmp(h.signature, sig, sizeof(h.signature)) == 0 &&
+                le64toh(h.tool_version) == PROJECT_VERSION &&
+                le64toh(h.file_size) == (uint64_t) st.st_size &&
+                le64toh(h.header_size) >= sizeof(struct trie_header_f) &&
+                le64toh(h.value_entry_size) == (compat ? sizeof(struct trie_value_entry_f) : sizeof(struct trie_value_entry2_f)) &&
+                memcmp(h.sources_digest, sources_digest, sizeof(h.sources_digest)) == 0;
+}
+
 int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool compat) {
         _cleanup_free_ char *hwdb_bin = NULL;
         _cleanup_(trie_freep) struct trie *trie = NULL;
         _cleanup_strv_free_ char **files = NULL;
+        uint8_t sources_digest[SHA256_DIGEST_SIZE];
         uint16_t file_priority = 1;
+        bool clean = true;
         int r = 0, err;
 
         /* The argument 'compat' controls the format version of database. If false, then hwdb.bin will be
@@ -591,6 +657,23 @@ int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool co
          * source. If true, then hwdb.bin will be created without the information. systemd-hwdb command
          * should set the argument false, and 'udevadm hwdb' command should set it true. */
 
+        err = conf_files_list_strv(&files, ".hwdb", root, 0, conf_file_dirs);
+        if (err < 0)
+                return log_error_errno(err, "Failed to enumerate hwdb files: %m");
+
+        hwdb_bin = path_join(root, hwdb_bin_dir ?: default_hwdb_bin_dir, "hwdb.bin");
+        if (!hwdb_bin)
+                return -ENOMEM;
+
+        err = hwdb_sources_digest(files, compat, sources_digest);
+        if (err < 0)
+                return log_error_errno(err, "Failed to calculate digest of hwdb files: %m");
+
+        if (hwdb_bin_up_to_date(hwdb_bin, sources_digest, compat)) {
+                log_debug("%s is up to date, not recompiling.", hwdb_bin);
+                return 0;
+        }
+
         trie = new0(struct trie, 1);
         if (!trie)
                 return -ENOMEM;
@@ -607,15 +690,15 @@ int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool co
 
         trie->nodes_count++;
 
-        err = conf_files_list_strv(&files, ".hwdb", root, 0, conf_file_dirs);
-        if (err < 0)
-                return log_error_errno(err, "Failed to enumerate hwdb files: %m");
-
         STRV_FOREACH(f, files) {
                 log_debug("Reading file \"%s\"", *f);
                 err = import_file(trie, *f, file_priority++, compat);
-                if (err < 0 && strict)
-                        r = err;
+                if (err < 0) {
+                        /* Do not record the digest, so that the warnings are shown again on the next run */
+                        clean = false;
+                        if (strict)
+                                r = err;
+                }
         }
 
         strbuf_complete(trie->strings);
@@ -634,12 +717,8 @@ int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool co
         log_debug("strings dedup'ed: %8zu bytes (%8zu)",
                   trie->strings->dedup_len, trie->strings->dedup_count);
 
-        hwdb_bin = path_join(root, hwdb_bin_dir ?: default_hwdb_bin_dir, "hwdb.bin");
-        if (!hwdb_bin)
-                return -ENOMEM;
-
         (void) mkdir_parents_label(hwdb_bin, 0755);
-        err = trie_store(trie, hwdb_bin, compat);
+        err = trie_store(trie, hwdb_bin, clean ? sources_digest : NULL, compat);
         if (err < 0)
                 return log_error_errno(err, "Failed to write database %s: %m", hwdb_bin);
 
@@ -20,6 +20,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
+#include "glob-util.h"
 #include "hashmap.h"
 #include "install-printf.h"
 #include "install.h"
@@ -46,10 +47,17 @@ typedef enum SearchFlags {
         SEARCH_DROPIN                 = 1 << 2,
 } SearchFlags;
 
+/* Listings of the unit search path directories, so that an operation on many units doesn't have to look for
+ * each of them in each directory. Only used while nothing is written to the directories. */
+typedef struct {
+        Hashmap *entries;      /* directory → Set of entry names, NULL if the directory doesn't exist */
+} InstallDirCache;
+
 typedef struct {
         LookupScope scope;
         OrderedHashmap *will_process;
         OrderedHashmap *have_processed;
+        InstallDirCache *dir_cache;
 } InstallContext;
 
 typedef enum {
@@ -62,8 +70,64 @@ struct UnitFilePresetRule {
         char *pattern;
         PresetAction action;
         char **instances;
+        bool glob;
 };
 
+DEFINE_PRIVATE_HASH_OPS_FULL(install_dir_cache_hash_ops, char, path_hash_func, path_compare, free,
+                             Set, set_free_free);
+
+static void install_dir_cache_done(InstallDirCache *c) {
+        assert(c);
+
+        c->entries = hashmap_free(c->entries);
+}
+
+static int install_dir_cache_has(InstallDirCache *c, const char *dir, const char *name) {
+        _cleanup_set_free_free_ Set *s = NULL;
+        _cleanup_closedir_ DIR *d = NULL;
+        _cleanup_free_ char *key = NULL;
+        Set *cached;
+        int r;
+
+        assert(dir);
+        assert(name);
+
+        /* Returns > 0 if the directory has an entry of that name, 0 if not, and < 0 if we don't know, in
+         * which case the caller should just look. */
+
+        if (!c)
+                return -EOPNOTSUPP;
+
+        cached = hashmap_get(c->entries, dir);
+        if (cached || hashmap_contains(c->entries, dir))
+                return set_contains(cached, name);
+
+        d = opendir(dir);
+        if (!d) {
+                if (!IN_SET(errno, ENOENT, ENOTDIR, EACCES))
+                        return -errno;
+        } else
+                FOREACH_DIRENT_ALL(de, d, return -errno) {
+                        if (dot_or_dot_dot(de->d_name))
+                                continue;
+
+                        r = set_put_strdup(&s, de->d_name);
+                        if (r < 0)
+                                return r;
+                }
+
+        key = strdup(dir);
+        if (!key)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(&c->entries, &install_dir_cache_hash_ops, key, s);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(key);
+        return set_contains(TAKE_PTR(s), name);
+}
+
 static bool unit_file_install_info_has_rules(const UnitFileInstallInfo *i) {
         assert(i);
 
@@ -1481,6 +1545,9 @@ static int unit_file_search(
         STRV_FOREACH(p, lp->search_path) {
                 _cleanup_free_ char *path = NULL;
 
+                if (install_dir_cache_has(ctx ? ctx->dir_cache : NULL, *p, info->name) == 0)
+                        continue;
+
                 path = path_join(*p, info->name);
                 if (!path)
                         return -ENOMEM;
@@ -1504,6 +1571,9 @@ static int unit_file_search(
                 STRV_FOREACH(p, lp->search_path) {
                         _cleanup_free_ char *path = NULL;
 
+                        if (install_dir_cache_has(ctx ? ctx->dir_cache : NULL, *p, template) == 0)
+                                continue;
+
                         path = path_join(*p, template);
                         if (!path)
                                 return -ENOMEM;
@@ -1533,6 +1603,9 @@ static int unit_file_search(
         STRV_FOREACH(p, lp->search_path) {
                 char *path;
 
+                if (install_dir_cache_has(ctx ? ctx->dir_cache : NULL, *p, dropin_dir_name) == 0)
+                        continue;
+
                 path = path_join(*p, dropin_dir_name);
                 if (!path)
                         return -ENOMEM;
@@ -1547,6 +1620,9 @@ static int unit_file_search(
                 STRV_FOREACH(p, lp->search_path) {
                         char *path;
 
+                        if (install_dir_cache_has(ctx ? ctx->dir_cache : NULL, *p, dropin_template_dir_name) == 0)
+                                continue;
+
                         path = path_join(*p, dropin_template_dir_name);
                         if (!path)
                                 return -ENOMEM;
@@ -3198,6 +3274,7 @@ static int read_presets(LookupScope scope, const char *root_dir, UnitFilePresets
                                         .pattern = unit_name,
                                         .action = PRESET_ENABLE,
                                         .instances = instances,
+                                        .glob = string_is_glob(unit_name),
                                 };
                         }
 
@@ -3212,6 +3289,7 @@ static int read_presets(LookupScope scope, const char *root_dir, UnitFilePresets
                                 rule = (UnitFilePresetRule) {
                                         .pattern = pattern,
                                         .action = PRESET_DISABLE,
+                                        .glob = string_is_glob(pattern),
                                 };
                         }
 
@@ -3235,29 +3313,26 @@ static int read_presets(LookupScope scope, const char *root_dir, UnitFilePresets
 }
 
 static int pattern_match_multiple_instances(
-                        const UnitFilePresetRule rule,
+                        const UnitFilePresetRule *rule,
                         const char *unit_name,
+                        const char *templated_name,
                         char ***ret) {
 
-        _cleanup_free_ char *templated_name = NULL;
         int r;
 
         /* If no ret is needed or the rule itself does not have instances
          * initialized, we return not matching */
-        if (!ret || !rule.instances)
+        if (!ret || !rule->instances || !templated_name)
                 return 0;
 
-        r = unit_name_template(unit_name, &templated_name);
-        if (r < 0)
-                return r;
-        if (!streq(rule.pattern, templated_name))
+        if (!streq(rule->pattern, templated_name))
                 return 0;
 
         /* Compose a list of specified instances when unit name is a template  */
         if (unit_name_is_valid(unit_name, UNIT_NAME_TEMPLATE)) {
                 _cleanup_strv_free_ char **out_strv = NULL;
 
-                STRV_FOREACH(iter, rule.instances) {
+                STRV_FOREACH(iter, rule->instances) {
                         _cleanup_free_ char *name = NULL;
 
                         r = unit_name_replace_instance(unit_name, *iter, &name);
@@ -3279,21 +3354,42 @@ static int pattern_match_multiple_instances(
                 if (r < 0)
                         return r;
 
-                if (strv_find(rule.instances, instance_name))
+                if (strv_find(rule->instances, instance_name))
                         return 1;
         }
         return 0;
 }
 
+static bool preset_rule_matches(const UnitFilePresetRule *rule, const char *name) {
+        assert(rule);
+        assert(name);
+
+        /* Most rules name a single unit, for which fnmatch() is needlessly slow. */
+        if (!rule->glob)
+                return streq(rule->pattern, name);
+
+        return fnmatch(rule->pattern, name, FNM_NOESCAPE) == 0;
+}
+
 static int query_presets(const char *name, const UnitFilePresets *presets, char ***instance_name_list) {
         PresetAction action = PRESET_UNKNOWN;
+        _cleanup_free_ char *template = NULL;
 
         if (!unit_name_is_valid(name, UNIT_NAME_ANY))
                 return -EINVAL;
 
+        /* Only needed for rules with instances, hence determined once here rather than for each rule. */
+        if (instance_name_list && unit_name_is_valid(name, UNIT_NAME_INSTANCE|UNIT_NAME_TEMPLATE)) {
+                int r;
+
+                r = unit_name_template(name, &template);
+                if (r < 0)
+                        return r;
+        }
+
         for (size_t i = 0; i < presets->n_rules; i++)
-                if (pattern_match_multiple_instances(presets->rules[i], name, instance_name_list) > 0 ||
-                    fnmatch(presets->rules[i].pattern, name, FNM_NOESCAPE) == 0) {
+                if (pattern_match_multiple_instances(presets->rules + i, name, template, instance_name_list) > 0 ||
+                    preset_rule_matches(presets->rules + i, name)) {
                         action = presets->rules[i].action;
                         break;
                 }
@@ -3390,7 +3486,7 @@ static int preset_prepare_one(
                 UnitFileChange **changes,
                 size_t *n_changes) {
 
-        _cleanup_(install_context_done) InstallContext tmp = { .scope = scope };
+        _cleanup_(install_context_done) InstallContext tmp = { .scope = scope, .dir_cache = plus->dir_cache };
         _cleanup_strv_free_ char **instance_name_list = NULL;
         UnitFileInstallInfo *info;
         int r;
@@ -3442,7 +3538,8 @@ int unit_file_preset(
                 UnitFileChange **changes,
                 size_t *n_changes) {
 
-        _cleanup_(install_context_done) InstallContext plus = {}, minus = {};
+        _cleanup_(install_dir_cache_done) InstallDirCache cache = {};
+        _cleanup_(install_context_done) InstallContext plus = { .dir_cache = &cache }, minus = { .dir_cache = &cache };
         _cleanup_(lookup_paths_free) LookupPaths lp = {};
         _cleanup_(unit_file_presets_freep) UnitFilePresets presets = {};
         const char *config_path;
@@ -3470,6 +3567,9 @@ int unit_file_preset(
                         return r;
         }
 
+        /* The directories are modified from now on */
+        plus.dir_cache = minus.dir_cache = NULL;
+
         return execute_preset(file_flags, &plus, &minus, &lp, config_path, files, mode, changes, n_changes);
 }
 
@@ -3481,7 +3581,8 @@ int unit_file_preset_all(
                 UnitFileChange **changes,
                 size_t *n_changes) {
 
-        _cleanup_(install_context_done) InstallContext plus = {}, minus = {};
+        _cleanup_(install_dir_cache_done) InstallDirCache cache = {};
+        _cleanup_(install_context_done) InstallContext plus = { .dir_cache = &cache }, minus = { .dir_cache = &cache };
         _cleanup_(lookup_paths_free) LookupPaths lp = {};
         _cleanup_(unit_file_presets_freep) UnitFilePresets presets = {};
         const char *config_path = NULL;
@@ -3531,6 +3632,9 @@ int unit_file_preset_all(
                 }
         }
 
+        /* The directories are modified from now on */
+        plus.dir_cache = minus.dir_cache = NULL;
+
         return execute_preset(file_flags, &plus, &minus, &lp, config_path, NULL, mode, changes, n_changes);
 }
 
@@ -324,9 +324,13 @@ int journal_importer_process_data(JournalImporter *imp) {
                         }
 
                         line[n] = '\0';
-                        r = process_special_field(imp, line);
-                        if (r != 0)
-                                return r < 0 ? r : 0;
+
+                        /* All special fields start with an underscore, don't bother with the rest */
+                        if (line[0] == '_') {
+                                r = process_special_field(imp, line);
+                                if (r != 0)
+                                        return r < 0 ? r : 0;
+                        }
 
                         r = iovw_put(&imp->iovw, line, n);
                         if (r < 0)
@@ -421,9 +425,10 @@ int journal_importer_process_data(JournalImporter *imp) {
         }
 }
 
-int journal_importer_push_data(JournalImporter *imp, const char *data, size_t size) {
+int journal_importer_reserve(JournalImporter *imp, size_t size, void **ret) {
         assert(imp);
         assert(imp->state != IMPORTER_STATE_EOF);
+        assert(ret);
 
         if (!realloc_buffer(imp, imp->filled + size))
                 return log_error_errno(SYNTHETIC_ERRNO(ENOMEM),
@@ -432,8 +437,27 @@ int journal_importer_push_data(JournalImporter *imp, const char *data, size_t si
                                        size, MALLOC_SIZEOF_SAFE(imp->buf), imp->filled,
                                        strerror_safe(ENOMEM));
 
-        memcpy(imp->buf + imp->filled, data, size);
+        *ret = imp->buf + imp->filled;
+        return 0;
+}
+
+void journal_importer_commit(JournalImporter *imp, size_t size) {
+        assert(imp);
+        assert(imp->filled + size <= MALLOC_SIZEOF_SAFE(imp->buf));
+
         imp->filled += size;
+}
+
+int journal_importer_push_data(JournalImporter *imp, const char *data, size_t size) {
+        void *p;
+        int r;
+
+        r = journal_importer_reserve(imp, size, &p);
+        if (r < 0)
+                return r;
+
+        memcpy(p, data, size);
+        journal_importer_commit(imp, size);
 
         return 0;
 }
@@ -51,6 +51,12 @@ typedef struct JournalImporter {
 void journal_importer_cleanup(JournalImporter *);
 int journal_importer_process_data(JournalImporter *);
 int journal_importer_push_data(JournalImporter *, const char *data, size_t size);
+
+/* Returns space for at least size bytes at the end of the buffer, so that data can be received or
+ * decompressed right into it rather than copied in with journal_importer_push_data(). Fields are then
+ * referenced right where they were received. */
+int journal_importer_reserve(JournalImporter *imp, size_t size, void **ret);
+void journal_importer_commit(JournalImporter *imp, size_t size);
 void journal_importer_drop_iovw(JournalImporter *);
 bool journal_importer_eof(const JournalImporter *);
 
@@ -19,10 +19,12 @@
 #include "json.h"
 #include "macro.h"
 #include "memory-util.h"
+#include "sort-util.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "utf8.h"
 
@@ -37,6 +39,15 @@
  * https://github.com/systemd/systemd/issues/14396 */
 
 #define DEPTH_MAX (2U*1024U)
+
+/* Objects with at least this many fields that are not sorted by key get a key index, i.e. an array of the field
+ * positions ordered by key, which is placed right after the fields and filled in on the first lookup. Below that
+ * a linear scan is cheaper anyway. */
+#define OBJECT_INDEX_MIN 16U
+
+/* Chunk sizes of the arenas JSON_PARSE_ARENA places parsed variants in */
+#define ARENA_CHUNK_MIN (4U*1024U)
+#define ARENA_CHUNK_MAX (1024U*1024U)
 assert_cc(DEPTH_MAX <= UINT16_MAX);
 
 typedef struct JsonSource {
@@ -90,6 +101,17 @@ struct JsonVariant {
         /* If in addition to this object all objects referenced by it are also ordered strictly by name */
         bool normalized:1;
 
+        /* If this is an object that is not sorted, whether space for a key index follows the fields, see
+         * OBJECT_INDEX_MIN */
+        bool indexed:1;
+
+        /* Allocated in a JsonArena rather than individually, hence never freed on its own */
+        bool arena:1;
+
+        /* The root of a tree parsed with JSON_PARSE_ARENA. It owns the arena, which is found right in front of
+         * it, and all other variants in the arena are 'embedded' into it, i.e. share its reference counter */
+        bool arena_root:1;
+
         union {
                 /* For simple types we store the value in-line. */
                 JsonValue value;
@@ -157,6 +179,119 @@ static bool json_source_equal(JsonSource *a, JsonSource *b) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(JsonSource*, json_source_unref);
 
+typedef struct JsonArenaChunk JsonArenaChunk;
+
+struct JsonArenaChunk {
+        JsonArenaChunk *next;
+        size_t size;
+        size_t used;
+        uint8_t data[] _alignas_(JsonVariant);
+};
+
+typedef struct JsonArena {
+        JsonArenaChunk *chunks;
+} JsonArena;
+
+/* Type tags of the binary encoding, see json_variant_format_binary(). Never change the values, these are
+ * on the wire. */
+enum {
+        JSON_BINARY_NULL     = 0x01,
+        JSON_BINARY_FALSE    = 0x02,
+        JSON_BINARY_TRUE     = 0x03,
+        JSON_BINARY_INTEGER  = 0x04,
+        JSON_BINARY_UNSIGNED = 0x05,
+        JSON_BINARY_REAL     = 0x06,
+        JSON_BINARY_STRING   = 0x07,
+        JSON_BINARY_ARRAY    = 0x08,
+        JSON_BINARY_OBJECT   = 0x09,
+};
+
+/* The root variant of an arena is preceded by a pointer to the arena */
+#define ARENA_HEADER_SIZE ALIGN_TO(sizeof(JsonArena*), __alignof__(JsonVariant))
+
+static JsonArena* json_arena_free(JsonArena *a, bool sensitive) {
+        if (!a)
+                return NULL;
+
+        while (a->chunks) {
+                JsonArenaChunk *c = a->chunks;
+
+                a->chunks = c->next;
+
+                if (sensitive)
+                        explicit_bzero_safe(c->data, c->used);
+                free(c);
+        }
+
+        return mfree(a);
+}
+
+static JsonArena* json_arena_free_plain(JsonArena *a) {
+        return json_arena_free(a, false);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(JsonArena*, json_arena_free_plain);
+
+static void *json_arena_alloc(JsonArena *a, size_t size) {
+        JsonArenaChunk *c;
+        void *p;
+
+        assert(a);
+
+        size = ALIGN_TO(size, __alignof__(JsonVariant));
+        if (size == SIZE_MAX)
+                return NULL;
+
+        c = a->chunks;
+        if (!c || c->size - c->used < size) {
+                size_t n;
+
+                /* Start small, as most things we parse are small, and grow the chunks with the tree */
+                n = MAX(size, c ? MIN(c->size * 2, ARENA_CHUNK_MAX) : ARENA_CHUNK_MIN);
+                if (n > SIZE_MAX - offsetof(JsonArenaChunk, data))
+                        return NULL;
+
+                c = malloc(offsetof(JsonArenaChunk, data) + n);
+                if (!c)
+                        return NULL;
+
+                *c = (JsonArenaChunk) {
+                        .next = a->chunks,
+                        .size = n,
+                };
+
+                a->chunks = c;
+        }
+
+        p = c->data + c->used;
+        c->used += size;
+
+        return p;
+}
+
+static JsonVariant *json_variant_alloc(JsonArena *arena, bool arena_root, size_t size) {
+        uint8_t *p;
+
+        /* Allocates memory for a variant, on the heap or in the arena if one is specified. Note that this
+         * does not initialize the memory. */
+
+        if (!arena)
+                return malloc(size);
+
+        if (!arena_root)
+                return json_arena_alloc(arena, size);
+
+        if (size > SIZE_MAX - ARENA_HEADER_SIZE)
+                return NULL;
+
+        p = json_arena_alloc(arena, ARENA_HEADER_SIZE + size);
+        if (!p)
+                return NULL;
+
+        *(JsonArena**) p = arena;
+        return (JsonVariant*) (p + ARENA_HEADER_SIZE);
+}
+
 /* There are four kind of JsonVariant* pointers:
  *
  *    1. NULL
@@ -288,18 +423,22 @@ static JsonVariant *json_variant_conservative_formalize(JsonVariant *v) {
         return json_variant_formalize(v);
 }
 
-static int json_variant_new(JsonVariant **ret, JsonVariantType type, size_t space) {
+static int json_variant_new(JsonArena *arena, JsonVariant **ret, JsonVariantType type, size_t space) {
         JsonVariant *v;
+        size_t size;
 
         assert_return(ret, -EINVAL);
 
-        v = malloc0(MAX(sizeof(JsonVariant),
-                        offsetof(JsonVariant, value) + space));
+        size = MAX(sizeof(JsonVariant), offsetof(JsonVariant, value) + space);
+
+        v = json_variant_alloc(arena, false, size);
         if (!v)
                 return -ENOMEM;
 
+        memzero(v, size);
         v->n_ref = 1;
         v->type = type;
+        v->arena = !!arena;
 
         *ret = v;
         return 0;
@@ -316,7 +455,7 @@ int json_variant_new_integer(JsonVariant **ret, int64_t i) {
                 return 0;
         }
 
-        r = json_variant_new(&v, JSON_VARIANT_INTEGER, sizeof(i));
+        r = json_variant_new(NULL, &v, JSON_VARIANT_INTEGER, sizeof(i));
         if (r < 0)
                 return r;
 
@@ -336,7 +475,7 @@ int json_variant_new_unsigned(JsonVariant **ret, uint64_t u) {
                 return 0;
         }
 
-        r = json_variant_new(&v, JSON_VARIANT_UNSIGNED, sizeof(u));
+        r = json_variant_new(NULL, &v, JSON_VARIANT_UNSIGNED, sizeof(u));
         if (r < 0)
                 return r;
 
@@ -365,7 +504,7 @@ int json_variant_new_real(JsonVariant **ret, double d) {
                 return 0;
         }
 
-        r = json_variant_new(&v, JSON_VARIANT_REAL, sizeof(d));
+        r = json_variant_new(NULL, &v, JSON_VARIANT_REAL, sizeof(d));
         if (r < 0)
                 return r;
 
@@ -393,7 +532,7 @@ int json_variant_new_null(JsonVariant **ret) {
         return 0;
 }
 
-int json_variant_new_stringn(JsonVariant **ret, const char *s, size_t n) {
+static int json_variant_new_stringn_internal(JsonArena *arena, JsonVariant **ret, const char *s, size_t n) {
         JsonVariant *v;
         int r;
 
@@ -414,7 +553,7 @@ int json_variant_new_stringn(JsonVariant **ret, const char *s, size_t n) {
         if (!utf8_is_valid_n(s, n)) /* JSON strings must be valid UTF-8 */
                 return -EUCLEAN;
 
-        r = json_variant_new(&v, JSON_VARIANT_STRING, n + 1);
+        r = json_variant_new(arena, &v, JSON_VARIANT_STRING, n + 1);
         if (r < 0)
                 return r;
 
@@ -425,6 +564,10 @@ int json_variant_new_stringn(JsonVariant **ret, const char *s, size_t n) {
         return 0;
 }
 
+int json_variant_new_stringn(JsonVariant **ret, const char *s, size_t n) {
+        return json_variant_new_stringn_internal(NULL, ret, s, n);
+}
+
 int json_variant_new_base64(JsonVariant **ret, const void *p, size_t n) {
         _cleanup_free_ char *s = NULL;
         ssize_t k;
@@ -524,7 +667,13 @@ static void json_variant_copy_source(JsonVariant *v, JsonVariant *from) {
         v->source = json_source_ref(from->source);
 }
 
-int json_variant_new_array(JsonVariant **ret, JsonVariant **array, size_t n) {
+static int json_variant_new_array_internal(
+                JsonArena *arena,
+                bool arena_root,
+                JsonVariant **ret,
+                JsonVariant **array,
+                size_t n) {
+
         _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
         bool normalized = true;
 
@@ -535,13 +684,17 @@ int json_variant_new_array(JsonVariant **ret, JsonVariant **array, size_t n) {
         }
         assert_return(array, -EINVAL);
 
-        v = new(JsonVariant, n + 1);
+        if (size_multiply_overflow(sizeof(JsonVariant), n + 1))
+                return -ENOMEM;
+
+        v = json_variant_alloc(arena, arena_root, sizeof(JsonVariant) * (n + 1));
         if (!v)
                 return -ENOMEM;
 
         *v = (JsonVariant) {
                 .n_ref = 1,
                 .type = JSON_VARIANT_ARRAY,
+                .arena = !!arena,
         };
 
         for (v->n_elements = 0; v->n_elements < n; v->n_elements++) {
@@ -573,6 +726,10 @@ int json_variant_new_array(JsonVariant **ret, JsonVariant **array, size_t n) {
         return 0;
 }
 
+int json_variant_new_array(JsonVariant **ret, JsonVariant **array, size_t n) {
+        return json_variant_new_array_internal(NULL, false, ret, array, n);
+}
+
 int json_variant_new_array_bytes(JsonVariant **ret, const void *p, size_t n) {
         assert_return(ret, -EINVAL);
         if (n == 0) {
@@ -666,10 +823,25 @@ int json_variant_new_array_strv(JsonVariant **ret, char **l) {
         return 0;
 }
 
-int json_variant_new_object(JsonVariant **ret, JsonVariant **array, size_t n) {
+static uint32_t *json_variant_object_index(JsonVariant *v) {
+        assert(v);
+        assert(v->type == JSON_VARIANT_OBJECT);
+        assert(v->indexed);
+
+        return (uint32_t*) (v + 1 + v->n_elements);
+}
+
+static int json_variant_new_object_internal(
+                JsonArena *arena,
+                bool arena_root,
+                JsonVariant **ret,
+                JsonVariant **array,
+                size_t n) {
+
         _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        size_t k;
         const char *prev = NULL;
-        bool sorted = true, normalized = true;
+        bool sorted = true, normalized = true, indexed;
 
         assert_return(ret, -EINVAL);
         if (n == 0) {
@@ -679,13 +851,35 @@ int json_variant_new_object(JsonVariant **ret, JsonVariant **array, size_t n) {
         assert_return(array, -EINVAL);
         assert_return(n % 2 == 0, -EINVAL);
 
-        v = new(JsonVariant, n + 1);
+        /* Check the keys first, so that we know whether to reserve space for an index */
+        for (size_t i = 0; i < n; i += 2) {
+                const char *k;
+
+                if (!json_variant_is_string(array[i]))
+                        return -EINVAL; /* Every second one needs to be a string, as it is the key name */
+
+                assert_se(k = json_variant_string(array[i]));
+
+                if (prev && strcmp(k, prev) <= 0)
+                        sorted = normalized = false;
+
+                prev = k;
+        }
+
+        indexed = !sorted && n / 2 >= OBJECT_INDEX_MIN && n / 2 < UINT32_MAX;
+
+        k = n + 1 + (indexed ? DIV_ROUND_UP(n / 2 * sizeof(uint32_t), sizeof(JsonVariant)) : 0);
+        if (size_multiply_overflow(sizeof(JsonVariant), k))
+                return -ENOMEM;
+
+        v = json_variant_alloc(arena, arena_root, sizeof(JsonVariant) * k);
         if (!v)
                 return -ENOMEM;
 
         *v = (JsonVariant) {
                 .n_ref = 1,
                 .type = JSON_VARIANT_OBJECT,
+                .arena = !!arena,
         };
 
         for (v->n_elements = 0; v->n_elements < n; v->n_elements++) {
@@ -693,19 +887,7 @@ int json_variant_new_object(JsonVariant **ret, JsonVariant **array, size_t n) {
                             *c = array[v->n_elements];
                 uint16_t d;
 
-                if ((v->n_elements & 1) == 0) {
-                        const char *k;
-
-                        if (!json_variant_is_string(c))
-                                return -EINVAL; /* Every second one needs to be a string, as it is the key name */
-
-                        assert_se(k = json_variant_string(c));
-
-                        if (prev && strcmp(k, prev) <= 0)
-                                sorted = normalized = false;
-
-                        prev = k;
-                } else if (!json_variant_is_normalized(c))
+                if ((v->n_elements & 1) != 0 && !json_variant_is_normalized(c))
                         normalized = false;
 
                 d = json_variant_depth(c);
@@ -725,11 +907,20 @@ int json_variant_new_object(JsonVariant **ret, JsonVariant **array, size_t n) {
 
         v->normalized = normalized;
         v->sorted = sorted;
+        v->indexed = indexed;
+
+        /* Mark the index as not built yet */
+        if (indexed)
+                json_variant_object_index(v)[0] = UINT32_MAX;
 
         *ret = TAKE_PTR(v);
         return 0;
 }
 
+int json_variant_new_object(JsonVariant **ret, JsonVariant **array, size_t n) {
+        return json_variant_new_object_internal(NULL, false, ret, array, n);
+}
+
 static size_t json_variant_size(JsonVariant* v) {
         if (!json_variant_is_regular(v))
                 return 0;
@@ -794,6 +985,45 @@ static void json_variant_free_inner(JsonVariant *v, bool force_sensitive) {
                 explicit_bzero_safe(v, json_variant_size(v));
 }
 
+static void json_variant_free_arena(JsonVariant *v) {
+        assert(v);
+        assert(v->arena_root);
+
+        /* Everything in the arena is embedded into the root, hence there's nothing to unref, except what
+         * might have been attached to the root itself */
+        json_source_unref(v->source);
+
+        json_arena_free(*(JsonArena**) ((uint8_t*) v - ARENA_HEADER_SIZE), v->sensitive);
+}
+
+static void json_variant_arena_adopt(JsonVariant *root, JsonVariant *v) {
+        assert(root);
+        assert(v);
+
+        /* Makes the root the owner of all variants of the tree below it, which all are in its arena: their
+         * references on each other are replaced by embedding them into the root directly. */
+
+        if (!IN_SET(v->type, JSON_VARIANT_ARRAY, JSON_VARIANT_OBJECT))
+                return;
+
+        for (size_t i = 0; i < v->n_elements; i++) {
+                JsonVariant *e = v + 1 + i, *c;
+
+                if (!e->is_reference || !json_variant_is_regular(e->reference))
+                        continue;
+
+                c = e->reference;
+                assert(c->arena);
+                assert(!c->is_embedded);
+                assert(c->n_ref == 1);
+
+                c->is_embedded = true;
+                c->parent = root;
+
+                json_variant_arena_adopt(root, c);
+        }
+}
+
 JsonVariant *json_variant_ref(JsonVariant *v) {
         if (!v)
                 return NULL;
@@ -823,8 +1053,17 @@ JsonVariant *json_variant_unref(JsonVariant *v) {
                 v->n_ref--;
 
                 if (v->n_ref == 0) {
-                        json_variant_free_inner(v, false);
-                        free(v);
+                        if (v->arena_root)
+                                json_variant_free_arena(v);
+                        else {
+                                bool arena = v->arena; /* The variant might get erased below */
+
+                                json_variant_free_inner(v, false);
+
+                                /* If this is in an arena, it's freed with it */
+                                if (!arena)
+                                        free(v);
+                        }
                 }
         }
 
@@ -1208,6 +1447,33 @@ mismatch:
         return NULL;
 }
 
+static int object_index_compare(const uint32_t *a, const uint32_t *b, JsonVariant *v) {
+        int r;
+
+        r = strcmp(json_variant_string(json_variant_dereference(v + 1 + *a*2)),
+                   json_variant_string(json_variant_dereference(v + 1 + *b*2)));
+        if (r != 0)
+                return r;
+
+        /* Keep duplicate keys in the order they appear in */
+        return CMP(*a, *b);
+}
+
+static void json_variant_object_build_index(JsonVariant *v) {
+        uint32_t *idx;
+        size_t n;
+
+        assert(v);
+
+        idx = json_variant_object_index(v);
+        n = v->n_elements / 2;
+
+        for (size_t i = 0; i < n; i++)
+                idx[i] = i;
+
+        typesafe_qsort_r(idx, n, object_index_compare, v);
+}
+
 JsonVariant *json_variant_by_key_full(JsonVariant *v, const char *key, JsonVariant **ret_key) {
         if (!v)
                 goto not_found;
@@ -1253,6 +1519,42 @@ JsonVariant *json_variant_by_key_full(JsonVariant *v, const char *key, JsonVaria
                 goto not_found;
         }
 
+        if (v->indexed) {
+                size_t a = 0, b = v->n_elements/2;
+                uint32_t *idx;
+
+                /* Large unsorted objects get an index of their fields ordered by key, which we bisect just
+                 * like above */
+
+                idx = json_variant_object_index(v);
+                if (idx[0] == UINT32_MAX)
+                        json_variant_object_build_index(v);
+
+                while (b > a) {
+                        size_t i;
+                        int c;
+
+                        i = (a + b) / 2;
+
+                        c = strcmp(key, json_variant_string(json_variant_dereference(v + 1 + idx[i]*2)));
+                        if (c == 0) {
+                                /* With duplicate keys, return the first one, like the linear search does */
+                                while (i > 0 && streq(key, json_variant_string(json_variant_dereference(v + 1 + idx[i-1]*2))))
+                                        i--;
+
+                                if (ret_key)
+                                        *ret_key = json_variant_conservative_formalize(v + 1 + idx[i]*2);
+
+                                return json_variant_conservative_formalize(v + 1 + idx[i]*2 + 1);
+                        } else if (c < 0)
+                                b = i;
+                        else
+                                a = i + 1;
+                }
+
+                goto not_found;
+        }
+
         /* The variant is not sorted, hence search for the field linearly */
         for (size_t i = 0; i < v->n_elements; i += 2) {
                 JsonVariant *p;
@@ -1403,6 +1705,12 @@ void json_variant_sensitive(JsonVariant *v) {
                 return;
 
         v->sensitive = true;
+
+        /* An arena is only erased as a whole, when the root goes away, hence mark that too */
+        while (v->is_embedded)
+                v = v->parent;
+        if (v->arena_root)
+                v->sensitive = true;
 }
 
 bool json_variant_is_sensitive(JsonVariant *v) {
@@ -1492,7 +1800,19 @@ static void json_format_string(FILE *f, const char *q, JsonFormatFlags flags) {
         if (flags & JSON_FORMAT_COLOR)
                 fputs(ansi_green(), f);
 
-        for (; *q; q++)
+        for (; *q; q++) {
+                size_t n;
+
+                /* Write runs of characters that need no escaping in one go, rather than one fputc() each */
+                n = strcspn(q, "\"\\"
+                            "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+                            "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f");
+                if (n > 0) {
+                        fwrite(q, 1, n, f);
+                        q += n - 1;
+                        continue;
+                }
+
                 switch (*q) {
                 case '"':
                         fputs("\\\"", f);
@@ -1529,6 +1849,7 @@ static void json_format_string(FILE *f, const char *q, JsonFormatFlags flags) {
                                 fputc(*q, f);
                         break;
                 }
+        }
 
         if (flags & JSON_FORMAT_COLOR)
                 fputs(ANSI_NORMAL, f);
@@ -1801,6 +2122,147 @@ void json_variant_dump(JsonVariant *v, JsonFormatFlags flags, FILE *f, const cha
                 fflush(f);
 }
 
+static int binary_write(uint8_t **buf, size_t *size, const void *p, size_t n) {
+        assert(buf);
+        assert(size);
+
+        if (!GREEDY_REALLOC(*buf, *size + n))
+                return -ENOMEM;
+
+        memcpy_safe(*buf + *size, p, n);
+        *size += n;
+        return 0;
+}
+
+static int binary_write_varint(uint8_t **buf, size_t *size, uint8_t tag, uint64_t u) {
+        uint8_t b[1 + 10]; /* tag plus LEB128 of 64bit */
+        size_t n = 0;
+
+        if (tag != 0)
+                b[n++] = tag;
+
+        do {
+                b[n] = u & 0x7F;
+                u >>= 7;
+                if (u != 0)
+                        b[n] |= 0x80;
+                n++;
+        } while (u != 0);
+
+        return binary_write(buf, size, b, n);
+}
+
+static int binary_write_string(uint8_t **buf, size_t *size, uint8_t tag, const char *s) {
+        size_t l;
+        int r;
+
+        l = strlen(s);
+
+        r = binary_write_varint(buf, size, tag, l);
+        if (r < 0)
+                return r;
+
+        return binary_write(buf, size, s, l);
+}
+
+static int json_format_binary(uint8_t **buf, size_t *size, JsonVariant *v) {
+        int r;
+
+        assert(buf);
+        assert(size);
+
+        switch (json_variant_type(v)) {
+
+        case JSON_VARIANT_NULL:
+                return binary_write(buf, size, &(const uint8_t) { JSON_BINARY_NULL }, 1);
+
+        case JSON_VARIANT_BOOLEAN:
+                return binary_write(buf, size, &(const uint8_t) { json_variant_boolean(v) ? JSON_BINARY_TRUE : JSON_BINARY_FALSE }, 1);
+
+        case JSON_VARIANT_INTEGER: {
+                int64_t i = json_variant_integer(v);
+
+                /* zig-zag encoding, so that small negative numbers are short too */
+                return binary_write_varint(buf, size, JSON_BINARY_INTEGER, ((uint64_t) i << 1) ^ (uint64_t) (i >> 63));
+        }
+
+        case JSON_VARIANT_UNSIGNED:
+                return binary_write_varint(buf, size, JSON_BINARY_UNSIGNED, json_variant_unsigned(v));
+
+        case JSON_VARIANT_REAL: {
+                uint8_t b[1 + sizeof(uint64_t)] = { JSON_BINARY_REAL };
+                double d = json_variant_real(v);
+                uint64_t u;
+
+                memcpy(&u, &d, sizeof(u));
+                unaligned_write_le64(b + 1, u);
+
+                return binary_write(buf, size, b, sizeof(b));
+        }
+
+        case JSON_VARIANT_STRING:
+                return binary_write_string(buf, size, JSON_BINARY_STRING, json_variant_string(v));
+
+        case JSON_VARIANT_ARRAY:
+                r = binary_write_varint(buf, size, JSON_BINARY_ARRAY, json_variant_elements(v));
+                if (r < 0)
+                        return r;
+
+                for (size_t i = 0; i < json_variant_elements(v); i++) {
+                        r = json_format_binary(buf, size, json_variant_by_index(v, i));
+                        if (r < 0)
+                                return r;
+                }
+
+                return 0;
+
+        case JSON_VARIANT_OBJECT:
+                r = binary_write_varint(buf, size, JSON_BINARY_OBJECT, json_variant_elements(v) / 2);
+                if (r < 0)
+                        return r;
+
+                for (size_t i = 0; i < json_variant_elements(v); i += 2) {
+                        r = binary_write_string(buf, size, 0, json_variant_string(json_variant_by_index(v, i)));
+                        if (r < 0)
+                                return r;
+
+                        r = json_format_binary(buf, size, json_variant_by_index(v, i + 1));
+                        if (r < 0)
+                                return r;
+                }
+
+                return 0;
+
+        default:
+                assert_not_reached();
+        }
+}
+
+int json_variant_format_binary(JsonVariant *v, void **ret, size_t *ret_size) {
+        _cleanup_free_ uint8_t *buf = NULL;
+        size_t size = 0;
+        int r;
+
+        assert_return(v, -EINVAL);
+        assert_return(ret, -EINVAL);
+        assert_return(ret_size, -EINVAL);
+
+        /* Serializes the variant in a compact binary form that is much cheaper to generate and to parse than
+         * the JSON text, for local IPC. Every value starts with one of the JSON_BINARY_xyz type tags, followed
+         * by its payload: integers as zig-zag LEB128, unsigned integers and the lengths of strings, arrays
+         * and objects as LEB128, reals as little-endian IEEE 754 doubles. Strings are UTF-8 without
+         * terminating NUL. Arrays are followed by their elements, objects by their key/value pairs, where the
+         * keys are just length plus string, without tag. */
+
+        r = json_format_binary(&buf, &size, v);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(buf);
+        *ret_size = size;
+        return 0;
+}
+
 int json_variant_filter(JsonVariant **v, char **to_remove) {
         _cleanup_(json_variant_unrefp) JsonVariant *w = NULL;
         _cleanup_free_ JsonVariant **array = NULL;
@@ -2380,8 +2842,23 @@ static int json_parse_string(const char **p, char **ret) {
         c++;
 
         for (;;) {
+                size_t k;
                 int len;
 
+                /* Copy runs of plain ASCII characters, which is what strings mostly consist of, in one go,
+                 * rather than validating and appending them one by one */
+                for (k = 0; (uint8_t) c[k] >= ' ' && (uint8_t) c[k] < 0x7f && !IN_SET(c[k], '"', '\\'); k++)
+                        ;
+                if (k > 0) {
+                        if (!GREEDY_REALLOC(s, n + k + 1))
+                                return -ENOMEM;
+
+                        memcpy(s + n, c, k);
+                        n += k;
+                        c += k;
+                        continue;
+                }
+
                 /* Check for EOF */
                 if (*c == 0)
                         return -EINVAL;
@@ -2813,6 +3290,7 @@ static int json_parse_internal(
                 unsigned *column,
                 bool continue_end) {
 
+        _cleanup_(json_arena_free_plainp) JsonArena *arena = NULL;
         size_t n_stack = 1;
         unsigned line_buffer = 0, column_buffer = 0;
         void *tokenizer_state = NULL;
@@ -2825,6 +3303,12 @@ static int json_parse_internal(
 
         p = *input;
 
+        if (FLAGS_SET(flags, JSON_PARSE_ARENA)) {
+                arena = new0(JsonArena, 1);
+                if (!arena)
+                        return -ENOMEM;
+        }
+
         if (!GREEDY_REALLOC(stack, n_stack))
                 return -ENOMEM;
 
@@ -2932,7 +3416,8 @@ static int json_parse_internal(
 
                         assert(n_stack > 1);
 
-                        r = json_variant_new_object(&add, current->elements, current->n_elements);
+                        /* If the parent is the top-level, this is the root */
+                        r = json_variant_new_object_internal(arena, arena && n_stack == 2, &add, current->elements, current->n_elements);
                         if (r < 0)
                                 goto finish;
 
@@ -2982,7 +3467,7 @@ static int json_parse_internal(
 
                         assert(n_stack > 1);
 
-                        r = json_variant_new_array(&add, current->elements, current->n_elements);
+                        r = json_variant_new_array_internal(arena, arena && n_stack == 2, &add, current->elements, current->n_elements);
                         if (r < 0)
                                 goto finish;
 
@@ -2999,7 +3484,12 @@ static int json_parse_internal(
                                 goto finish;
                         }
 
-                        r = json_variant_new_string(&add, string);
+                        /* Strings that are too long to be stored inline in the array or object they are part
+                         * of stay around, hence put them in the arena. A string at the top-level is the root
+                         * though, which is better off on its own. */
+                        r = json_variant_new_stringn_internal(
+                                        current->expect != EXPECT_TOPLEVEL && strlen(string) > INLINE_STRING_MAX ? arena : NULL,
+                                        &add, string, SIZE_MAX);
                         if (r < 0)
                                 goto finish;
 
@@ -3132,7 +3622,8 @@ static int json_parse_internal(
                         if (FLAGS_SET(flags, JSON_PARSE_SENSITIVE))
                                 json_variant_sensitive(add);
 
-                        (void) json_variant_set_source(&add, source, line_token, column_token);
+                        if (!arena)
+                                (void) json_variant_set_source(&add, source, line_token, column_token);
 
                         if (!GREEDY_REALLOC(current->elements, current->n_elements + 1)) {
                                 r = -ENOMEM;
@@ -3147,6 +3638,13 @@ done:
         assert(n_stack == 1);
         assert(stack[0].n_elements == 1);
 
+        if (arena && json_variant_is_regular(stack[0].elements[0]) && stack[0].elements[0]->arena) {
+                /* Hand the arena over to the root */
+                json_variant_arena_adopt(stack[0].elements[0], stack[0].elements[0]);
+                stack[0].elements[0]->arena_root = true;
+                TAKE_PTR(arena);
+        }
+
         *ret = json_variant_ref(stack[0].elements[0]);
         *input = p;
         r = 0;
@@ -3193,6 +3691,222 @@ int json_parse_file_at(FILE *f, int dir_fd, const char *path, JsonParseFlags fla
         return json_parse_internal(&p, source, flags, ret, ret_line, ret_column, false);
 }
 
+static int binary_read_varint(const uint8_t **p, const uint8_t *end, uint64_t *ret) {
+        uint64_t u = 0;
+
+        assert(p);
+        assert(ret);
+
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+                uint8_t b;
+
+                if (*p >= end)
+                        return -EBADMSG;
+
+                b = *((*p)++);
+                if (shift == 63 && b > 1)
+                        return -EBADMSG;
+
+                u |= (uint64_t) (b & 0x7F) << shift;
+                if ((b & 0x80) == 0) {
+                        *ret = u;
+                        return 0;
+                }
+        }
+
+        return -EBADMSG;
+}
+
+static int binary_read_string(const uint8_t **p, const uint8_t *end, const char **ret, size_t *ret_size) {
+        uint64_t n;
+        int r;
+
+        r = binary_read_varint(p, end, &n);
+        if (r < 0)
+                return r;
+        if (n > (uint64_t) (end - *p))
+                return -EBADMSG;
+
+        *ret = (const char*) *p;
+        *ret_size = n;
+        *p += n;
+        return 0;
+}
+
+static int json_parse_binary_internal(
+                const uint8_t **p,
+                const uint8_t *end,
+                JsonArena *arena,
+                bool root,
+                JsonParseFlags flags,
+                unsigned depth,
+                JsonVariant **ret) {
+
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        uint64_t u, n;
+        const char *s;
+        size_t l;
+        int r;
+
+        assert(p);
+        assert(ret);
+
+        if (depth >= DEPTH_MAX)
+                return -ELNRNG;
+
+        if (*p >= end)
+                return -EBADMSG;
+
+        switch (*((*p)++)) {
+
+        case JSON_BINARY_NULL:
+                v = JSON_VARIANT_MAGIC_NULL;
+                break;
+
+        case JSON_BINARY_FALSE:
+        case JSON_BINARY_TRUE:
+                v = (*p)[-1] == JSON_BINARY_TRUE ? JSON_VARIANT_MAGIC_TRUE : JSON_VARIANT_MAGIC_FALSE;
+                break;
+
+        case JSON_BINARY_INTEGER:
+                r = binary_read_varint(p, end, &u);
+                if (r < 0)
+                        return r;
+
+                /* zig-zag encoded */
+                r = json_variant_new_integer(&v, (int64_t) (u >> 1) ^ -(int64_t) (u & 1));
+                if (r < 0)
+                        return r;
+                break;
+
+        case JSON_BINARY_UNSIGNED:
+                r = binary_read_varint(p, end, &u);
+                if (r < 0)
+                        return r;
+
+                /* The text parser makes everything that fits an integer one, let's do the same */
+                r = u <= INT64_MAX ? json_variant_new_integer(&v, (int64_t) u) : json_variant_new_unsigned(&v, u);
+                if (r < 0)
+                        return r;
+                break;
+
+        case JSON_BINARY_REAL: {
+                double d;
+
+                if (end - *p < (ptrdiff_t) sizeof(u))
+                        return -EBADMSG;
+
+                u = unaligned_read_le64(*p);
+                *p += sizeof(u);
+
+                memcpy(&d, &u, sizeof(d));
+                r = json_variant_new_real(&v, d);
+                if (r < 0)
+                        return r;
+                break;
+        }
+
+        case JSON_BINARY_STRING:
+                r = binary_read_string(p, end, &s, &l);
+                if (r < 0)
+                        return r;
+
+                /* Like the text parser: only strings that end up being references go into the arena */
+                r = json_variant_new_stringn_internal(!root && l > INLINE_STRING_MAX ? arena : NULL, &v, s, l);
+                if (r < 0)
+                        return r;
+                break;
+
+        case JSON_BINARY_ARRAY:
+        case JSON_BINARY_OBJECT: {
+                bool object = (*p)[-1] == JSON_BINARY_OBJECT;
+                JsonVariant **elements;
+
+                r = binary_read_varint(p, end, &n);
+                if (r < 0)
+                        return r;
+
+                /* Every element takes at least one byte, every pair two. This also puts a bound on how much
+                 * we allocate below. */
+                if (n > (uint64_t) (end - *p) / (object ? 2 : 1))
+                        return -EBADMSG;
+                if (object)
+                        n *= 2;
+
+                elements = new0(JsonVariant*, n);
+                if (!elements)
+                        return -ENOMEM;
+
+                r = 0;
+                for (size_t i = 0; i < n; i++) {
+                        if (object && i % 2 == 0) {
+                                r = binary_read_string(p, end, &s, &l);
+                                if (r < 0)
+                                        break;
+
+                                r = json_variant_new_stringn_internal(l > INLINE_STRING_MAX ? arena : NULL, elements + i, s, l);
+                        } else
+                                r = json_parse_binary_internal(p, end, arena, false, flags, depth + 1, elements + i);
+                        if (r < 0)
+                                break;
+                }
+
+                if (r >= 0)
+                        r = (object ? json_variant_new_object_internal : json_variant_new_array_internal)(
+                                        arena, arena && root, &v, elements, n);
+
+                json_variant_unref_many(elements, n);
+                free(elements);
+                if (r < 0)
+                        return r;
+                break;
+        }
+
+        default:
+                return -EBADMSG;
+        }
+
+        if (FLAGS_SET(flags, JSON_PARSE_SENSITIVE))
+                json_variant_sensitive(v);
+
+        *ret = TAKE_PTR(v);
+        return 0;
+}
+
+int json_parse_binary(const void *data, size_t size, JsonParseFlags flags, JsonVariant **ret) {
+        _cleanup_(json_arena_free_plainp) JsonArena *arena = NULL;
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        const uint8_t *p = data;
+        int r;
+
+        assert_return(data || size == 0, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        /* Parses what json_variant_format_binary() generated. The result is indistinguishable from what
+         * json_parse() makes of the text form of the same variant. */
+
+        if (FLAGS_SET(flags, JSON_PARSE_ARENA)) {
+                arena = new0(JsonArena, 1);
+                if (!arena)
+                        return -ENOMEM;
+        }
+
+        r = json_parse_binary_internal(&p, p + size, arena, true, flags, 0, &v);
+        if (r < 0)
+                return r;
+        if (p != (const uint8_t*) data + size) /* Trailing garbage */
+                return -EBADMSG;
+
+        if (arena && json_variant_is_regular(v) && v->arena) {
+                json_variant_arena_adopt(v, v);
+                v->arena_root = true;
+                TAKE_PTR(arena);
+        }
+
+        *ret = TAKE_PTR(v);
+        return 0;
+}
+
 int json_buildv(JsonVariant **ret, va_list ap) {
         JsonStack *stack = NULL;
         size_t n_stack = 1;
@@ -196,6 +196,7 @@ typedef enum JsonFormatFlags {
 
 int json_variant_format(JsonVariant *v, JsonFormatFlags flags, char **ret);
 void json_variant_dump(JsonVariant *v, JsonFormatFlags flags, FILE *f, const char *prefix);
+int json_variant_format_binary(JsonVariant *v, void **ret, size_t *ret_size);
 
 int json_variant_filter(JsonVariant **v, char **to_remove);
 
@@ -217,10 +218,12 @@ int json_variant_normalize(JsonVariant **v);
 
 typedef enum JsonParseFlags {
         JSON_PARSE_SENSITIVE = 1 << 0, /* mark variant as "sensitive", i.e. something containing secret key material or such */
+        JSON_PARSE_ARENA     = 1 << 1, /* place the parsed tree in one arena, freed as a whole with the root, without line/column info */
 } JsonParseFlags;
 
 int json_parse(const char *string, JsonParseFlags flags, JsonVariant **ret, unsigned *ret_line, unsigned *ret_column);
 int json_parse_continue(const char **p, JsonParseFlags flags, JsonVariant **ret, unsigned *ret_line, unsigned *ret_column);
+int json_parse_binary(const void *data, size_t size, JsonParseFlags flags, JsonVariant **ret);
 int json_parse_file_at(FILE *f, int dir_fd, const char *path, JsonParseFlags flags, JsonVariant **ret, unsigned *ret_line, unsigned *ret_column);
 
 static inline int json_parse_file(FILE *f, const char *path, JsonParseFlags flags, JsonVariant **ret, unsigned *ret_line, unsigned *ret_column) {
@@ -2,6 +2,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -14,6 +15,7 @@
 
 #include "alloc-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "glyph-util.h"
 #include "hashmap.h"
@@ -27,6 +29,7 @@
 #include "log.h"
 #include "logs-show.h"
 #include "macro.h"
+#include "memory-util.h"
 #include "namespace-util.h"
 #include "output-mode.h"
 #include "parse-util.h"
@@ -744,50 +747,124 @@ static int output_verbose(
         return 0;
 }
 
-static int output_export(
-                FILE *f,
+/* Everything needed to format an entry in the export or JSON formats, so that this can be done without
+ * access to the journal, and hence also on another thread than the one reading it. */
+typedef struct EntrySnapshot {
+        char *cursor;
+        usec_t realtime;
+        usec_t monotonic;
+        sd_id128_t boot_id;
+
+        /* The "FIELD=value" pairs of the entry, either borrowed from the journal or pointing into buffer */
+        struct iovec *fields;
+        size_t n_fields;
+
+        uint8_t *buffer;
+        size_t buffer_size;
+} EntrySnapshot;
+
+static void entry_snapshot_done(EntrySnapshot *s) {
+        assert(s);
+
+        s->cursor = mfree(s->cursor);
+        s->fields = mfree(s->fields);
+        s->buffer = mfree(s->buffer);
+        s->n_fields = s->buffer_size = 0;
+}
+
+static int entry_snapshot_fill(
+                EntrySnapshot *s,
                 sd_journal *j,
                 OutputMode mode,
-                unsigned n_columns,
                 OutputFlags flags,
-                const Set *output_fields,
-                const size_t highlight[2]) {
+                bool copy) {
 
-        _cleanup_free_ char *cursor = NULL;
-        usec_t realtime, monotonic;
-        sd_id128_t boot_id;
         const void *data;
-        size_t length;
+        size_t size;
         int r;
 
+        assert(s);
         assert(j);
 
-        sd_journal_set_data_threshold(j, 0);
+        (void) sd_journal_set_data_threshold(j, IN_SET(mode, OUTPUT_EXPORT, OUTPUT_EXPORT_COLUMNAR) || (flags & OUTPUT_SHOW_ALL) ? 0 : JSON_THRESHOLD);
 
-        r = sd_journal_get_realtime_usec(j, &realtime);
+        r = sd_journal_get_realtime_usec(j, &s->realtime);
         if (r < 0)
                 return log_error_errno(r, "Failed to get realtime timestamp: %m");
 
-        r = sd_journal_get_monotonic_usec(j, &monotonic, &boot_id);
+        r = sd_journal_get_monotonic_usec(j, &s->monotonic, &s->boot_id);
         if (r < 0)
                 return log_error_errno(r, "Failed to get monotonic timestamp: %m");
 
-        r = sd_journal_get_cursor(j, &cursor);
+        s->cursor = mfree(s->cursor);
+        r = sd_journal_get_cursor(j, &s->cursor);
         if (r < 0)
                 return log_error_errno(r, "Failed to get cursor: %m");
 
+        s->n_fields = s->buffer_size = 0;
+
+        /* The borrowed data stays valid until we move to another entry, hence unless asked to make a copy
+         * we can refer to all fields at once without copying anything. */
+        sd_journal_restart_data(j);
+        for (;;) {
+                r = sd_journal_enumerate_borrowed_data(j, &data, &size);
+                if (r == -EBADMSG)
+                        return r;
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read journal: %m");
+                if (r == 0)
+                        break;
+
+                if (!GREEDY_REALLOC(s->fields, s->n_fields + 1))
+                        return log_oom();
+
+                if (!copy) {
+                        s->fields[s->n_fields++] = IOVEC_MAKE((void*) data, size);
+                        continue;
+                }
+
+                if (!GREEDY_REALLOC(s->buffer, s->buffer_size + size))
+                        return log_oom();
+
+                memcpy(s->buffer + s->buffer_size, data, size);
+
+                /* The buffer might still move, store the offset for now */
+                s->fields[s->n_fields++] = IOVEC_MAKE(SIZE_TO_PTR(s->buffer_size), size);
+                s->buffer_size += size;
+        }
+
+        if (copy)
+                for (size_t i = 0; i < s->n_fields; i++)
+                        s->fields[i].iov_base = s->buffer + PTR_TO_SIZE(s->fields[i].iov_base);
+
+        return 0;
+}
+
+static int output_export_snapshot(
+                FILE *f,
+                const EntrySnapshot *s,
+                OutputMode mode,
+                OutputFlags flags,
+                const Set *output_fields) {
+
+        int r;
+
+        assert(f);
+        assert(s);
+
         fprintf(f,
                 "__CURSOR=%s\n"
                 "__REALTIME_TIMESTAMP="USEC_FMT"\n"
                 "__MONOTONIC_TIMESTAMP="USEC_FMT"\n"
                 "_BOOT_ID=%s\n",
-                cursor,
-                realtime,
-                monotonic,
-                SD_ID128_TO_STRING(boot_id));
-
-        JOURNAL_FOREACH_DATA_RETVAL(j, data, length, r) {
-                size_t fieldlen;
+                s->cursor,
+                s->realtime,
+                s->monotonic,
+                SD_ID128_TO_STRING(s->boot_id));
+
+        for (size_t i = 0; i < s->n_fields; i++) {
+                const void *data = s->fields[i].iov_base;
+                size_t length = s->fields[i].iov_len, fieldlen;
                 const char *c;
 
                 /* We already printed the boot id from the data in the header, hence let's suppress it here */
@@ -822,13 +899,6 @@ static int output_export(
 
                 fputc('\n', f);
         }
-        if (r == -EBADMSG) {
-                log_debug_errno(r, "Skipping message we can't read: %m");
-                return 0;
-        }
-
-        if (r < 0)
-                return r;
 
         fputc('\n', f);
 
@@ -887,23 +957,39 @@ void json_escape(
         }
 }
 
-struct json_data {
-        JsonVariant* name;
+typedef struct JsonData {
+        JsonVariant *name;
+        JsonVariant **values;
         size_t n_values;
-        JsonVariant* values[];
-};
+} JsonData;
+
+static void json_data_free_many(JsonData *d, size_t n) {
+        assert(d || n == 0);
+
+        for (size_t i = 0; i < n; i++) {
+                json_variant_unref(d[i].name);
+                json_variant_unref_many(d[i].values, d[i].n_values);
+                free(d[i].values);
+        }
+
+        free(d);
+}
 
 static int update_json_data(
-                Hashmap *h,
+                JsonData **data,
+                size_t *n_data,
                 OutputFlags flags,
                 const char *name,
                 const void *value,
                 size_t size) {
 
         _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
-        struct json_data *d;
+        JsonData *d = NULL;
         int r;
 
+        assert(data);
+        assert(n_data);
+
         if (!(flags & OUTPUT_SHOW_ALL) && strlen(name) + 1 + size >= JSON_THRESHOLD)
                 r = json_variant_new_null(&v);
         else if (utf8_is_printable(value, size))
@@ -913,160 +999,121 @@ static int update_json_data(
         if (r < 0)
                 return log_error_errno(r, "Failed to allocate JSON data: %m");
 
-        d = hashmap_get(h, name);
-        if (d) {
-                struct json_data *w;
-
-                w = realloc(d, offsetof(struct json_data, values) + sizeof(JsonVariant*) * (d->n_values + 1));
-                if (!w)
-                        return log_oom();
+        /* Entries carry a few dozen fields at most, hence a linear search is good enough here. This also
+         * keeps the fields in the order they were first seen, so that the output does not depend on hash
+         * order. */
+        for (size_t i = 0; i < *n_data; i++)
+                if (streq(json_variant_string((*data)[i].name), name)) {
+                        d = *data + i;
+                        break;
+                }
 
-                d = w;
-                assert_se(hashmap_update(h, json_variant_string(d->name), d) >= 0);
-        } else {
+        if (!d) {
                 _cleanup_(json_variant_unrefp) JsonVariant *n = NULL;
 
                 r = json_variant_new_string(&n, name);
                 if (r < 0)
                         return log_error_errno(r, "Failed to allocate JSON name variant: %m");
 
-                d = malloc0(offsetof(struct json_data, values) + sizeof(JsonVariant*));
-                if (!d)
+                if (!GREEDY_REALLOC(*data, *n_data + 1))
                         return log_oom();
 
-                r = hashmap_put(h, json_variant_string(n), d);
-                if (r < 0) {
-                        free(d);
-                        return log_error_errno(r, "Failed to insert JSON name into hashmap: %m");
-                }
-
-                d->name = TAKE_PTR(n);
+                d = *data + (*n_data)++;
+                *d = (JsonData) {
+                        .name = TAKE_PTR(n),
+                };
         }
 
+        if (!GREEDY_REALLOC(d->values, d->n_values + 1))
+                return log_oom();
+
         d->values[d->n_values++] = TAKE_PTR(v);
         return 0;
 }
 
 static int update_json_data_split(
-                Hashmap *h,
+                JsonData **data,
+                size_t *n_data,
                 OutputFlags flags,
                 const Set *output_fields,
-                const void *data,
+                const void *value,
                 size_t size) {
 
         size_t fieldlen;
         const char *eq;
         char *name;
 
-        assert(h);
-        assert(data || size == 0);
+        assert(value || size == 0);
 
-        if (memory_startswith(data, size, "_BOOT_ID="))
+        if (memory_startswith(value, size, "_BOOT_ID="))
                 return 0;
 
-        eq = memchr(data, '=', MIN(size, JSON_THRESHOLD));
+        eq = memchr(value, '=', MIN(size, JSON_THRESHOLD));
         if (!eq)
                 return 0;
 
-        fieldlen = eq - (const char*) data;
-        if (!journal_field_valid(data, fieldlen, true))
+        fieldlen = eq - (const char*) value;
+        if (!journal_field_valid(value, fieldlen, true))
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Invalid field.");
 
-        name = strndupa_safe(data, fieldlen);
+        name = strndupa_safe(value, fieldlen);
         if (output_fields && !set_contains(output_fields, name))
                 return 0;
 
-        return update_json_data(h, flags, name, eq + 1, size - fieldlen - 1);
+        return update_json_data(data, n_data, flags, name, eq + 1, size - fieldlen - 1);
 }
 
-static int output_json(
+static int output_json_snapshot(
                 FILE *f,
-                sd_journal *j,
+                const EntrySnapshot *s,
                 OutputMode mode,
-                unsigned n_columns,
                 OutputFlags flags,
-                const Set *output_fields,
-                const size_t highlight[2]) {
+                const Set *output_fields) {
 
         char sid[SD_ID128_STRING_MAX], usecbuf[DECIMAL_STR_MAX(usec_t)];
         _cleanup_(json_variant_unrefp) JsonVariant *object = NULL;
-        _cleanup_free_ char *cursor = NULL;
-        uint64_t realtime, monotonic;
         JsonVariant **array = NULL;
-        struct json_data *d;
-        sd_id128_t boot_id;
-        Hashmap *h = NULL;
-        size_t n = 0;
+        JsonData *data = NULL;
+        size_t n = 0, n_data = 0;
         int r;
 
-        assert(j);
-
-        (void) sd_journal_set_data_threshold(j, flags & OUTPUT_SHOW_ALL ? 0 : JSON_THRESHOLD);
-
-        r = sd_journal_get_realtime_usec(j, &realtime);
-        if (r < 0)
-                return log_error_errno(r, "Failed to get realtime timestamp: %m");
-
-        r = sd_journal_get_monotonic_usec(j, &monotonic, &boot_id);
-        if (r < 0)
-                return log_error_errno(r, "Failed to get monotonic timestamp: %m");
-
-        r = sd_journal_get_cursor(j, &cursor);
-        if (r < 0)
-                return log_error_errno(r, "Failed to get cursor: %m");
-
-        h = hashmap_new(&string_hash_ops);
-        if (!h)
-                return log_oom();
+        assert(f);
+        assert(s);
 
-        r = update_json_data(h, flags, "__CURSOR", cursor, strlen(cursor));
+        r = update_json_data(&data, &n_data, flags, "__CURSOR", s->cursor, strlen(s->cursor));
         if (r < 0)
                 goto finish;
 
-        xsprintf(usecbuf, USEC_FMT, realtime);
-        r = update_json_data(h, flags, "__REALTIME_TIMESTAMP", usecbuf, strlen(usecbuf));
+        xsprintf(usecbuf, USEC_FMT, s->realtime);
+        r = update_json_data(&data, &n_data, flags, "__REALTIME_TIMESTAMP", usecbuf, strlen(usecbuf));
         if (r < 0)
                 goto finish;
 
-        xsprintf(usecbuf, USEC_FMT, monotonic);
-        r = update_json_data(h, flags, "__MONOTONIC_TIMESTAMP", usecbuf, strlen(usecbuf));
+        xsprintf(usecbuf, USEC_FMT, s->monotonic);
+        r = update_json_data(&data, &n_data, flags, "__MONOTONIC_TIMESTAMP", usecbuf, strlen(usecbuf));
         if (r < 0)
                 goto finish;
 
-        sd_id128_to_string(boot_id, sid);
-        r = update_json_data(h, flags, "_BOOT_ID", sid, strlen(sid));
+        sd_id128_to_string(s->boot_id, sid);
+        r = update_json_data(&data, &n_data, flags, "_BOOT_ID", sid, strlen(sid));
         if (r < 0)
                 goto finish;
 
-        for (;;) {
-                const void *data;
-                size_t size;
-
-                r = sd_journal_enumerate_data(j, &data, &size);
-                if (r == -EBADMSG) {
-                        log_debug_errno(r, "Skipping message we can't read: %m");
-                        r = 0;
-                        goto finish;
-                }
-                if (r < 0) {
-                        log_error_errno(r, "Failed to read journal: %m");
-                        goto finish;
-                }
-                if (r == 0)
-                        break;
-
-                r = update_json_data_split(h, flags, output_fields, data, size);
+        for (size_t i = 0; i < s->n_fields; i++) {
+                r = update_json_data_split(&data, &n_data, flags, output_fields, s->fields[i].iov_base, s->fields[i].iov_len);
                 if (r < 0)
                         goto finish;
         }
 
-        array = new(JsonVariant*, hashmap_size(h)*2);
+        array = new(JsonVariant*, n_data*2);
         if (!array) {
                 r = log_oom();
                 goto finish;
         }
 
-        HASHMAP_FOREACH(d, h) {
+        for (size_t i = 0; i < n_data; i++) {
+                JsonData *d = data + i;
+
                 assert(d->n_values > 0);
 
                 array[n++] = json_variant_ref(d->name);
@@ -1100,24 +1147,487 @@ static int output_json(
         r = 0;
 
 finish:
-        while ((d = hashmap_steal_first(h))) {
-                size_t k;
+        json_data_free_many(data, n_data);
 
-                json_variant_unref(d->name);
-                for (k = 0; k < d->n_values; k++)
-                        json_variant_unref(d->values[k]);
+        json_variant_unref_many(array, n);
+        free(array);
+
+        return r;
+}
 
-                free(d);
+static int (*output_snapshot_funcs[_OUTPUT_MODE_MAX])(
+                FILE *f,
+                const EntrySnapshot *s,
+                OutputMode mode,
+                OutputFlags flags,
+                const Set *output_fields) = {
+
+        [OUTPUT_EXPORT]            = output_export_snapshot,
+        [OUTPUT_JSON]              = output_json_snapshot,
+        [OUTPUT_JSON_PRETTY]       = output_json_snapshot,
+        [OUTPUT_JSON_SSE]          = output_json_snapshot,
+        [OUTPUT_JSON_SEQ]          = output_json_snapshot,
+};
+
+bool output_mode_can_pipeline(OutputMode mode) {
+        assert(mode >= 0);
+        assert(mode < _OUTPUT_MODE_MAX);
+
+        return output_snapshot_funcs[mode] || mode == OUTPUT_EXPORT_COLUMNAR;
+}
+
+static int output_snapshot(
+                FILE *f,
+                sd_journal *j,
+                OutputMode mode,
+                unsigned n_columns,
+                OutputFlags flags,
+                const Set *output_fields,
+                const size_t highlight[2]) {
+
+        _cleanup_(entry_snapshot_done) EntrySnapshot s = {};
+        int r;
+
+        assert(f);
+        assert(j);
+
+        r = entry_snapshot_fill(&s, j, mode, flags, /* copy= */ false);
+        if (r == -EBADMSG) {
+                log_debug_errno(r, "Skipping message we can't read: %m");
+                return 0;
         }
+        if (r < 0)
+                return r;
+
+        return output_snapshot_funcs[mode](f, &s, mode, flags, output_fields);
+}
 
-        hashmap_free(h);
+/* The columnar export format, see docs/JOURNAL_EXPORT_FORMATS.md. Values of a field are dictionary encoded
+ * in a batch if at most a quarter of them are not in the field's dictionary yet. */
+#define COLUMNAR_MAGIC "SDJCOL01"
+#define COLUMNAR_DICTIONARY_MAX 65536U
 
-        json_variant_unref_many(array, n);
-        free(array);
+typedef struct ColumnarDictionary {
+        Hashmap *values; /* struct iovec → index + 1 */
+        size_t n_values;
+} ColumnarDictionary;
+
+typedef struct ColumnarColumn {
+        char *name;
+        size_t *entries; /* the entry each value belongs to, in ascending order */
+        struct iovec *values;
+        size_t n_values;
+} ColumnarColumn;
+
+static void iovec_hash_func(const struct iovec *v, struct siphash *state) {
+        siphash24_compress_safe(v->iov_base, v->iov_len, state);
+}
+
+static int iovec_compare_func(const struct iovec *a, const struct iovec *b) {
+        return memcmp_nn(a->iov_base, a->iov_len, b->iov_base, b->iov_len);
+}
+
+DEFINE_PRIVATE_HASH_OPS(iovec_hash_ops, struct iovec, iovec_hash_func, iovec_compare_func);
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(iovec_hash_ops_free, struct iovec, iovec_hash_func, iovec_compare_func, free);
+
+static ColumnarDictionary* columnar_dictionary_free(ColumnarDictionary *d) {
+        if (!d)
+                return NULL;
+
+        hashmap_free(d->values);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ColumnarDictionary*, columnar_dictionary_free);
+
+DEFINE_PRIVATE_HASH_OPS_FULL(columnar_dictionary_hash_ops, char, string_hash_func, string_compare_func, free,
+                             ColumnarDictionary, columnar_dictionary_free);
+
+static void columnar_columns_free(ColumnarColumn *c, size_t n) {
+        assert(c || n == 0);
+
+        for (size_t i = 0; i < n; i++) {
+                free(c[i].name);
+                free(c[i].entries);
+                free(c[i].values);
+        }
+
+        free(c);
+}
+
+static void columnar_put_varint(FILE *f, uint64_t v) {
+        assert(f);
+
+        while (v >= 0x80) {
+                fputc((v & 0x7f) | 0x80, f);
+                v >>= 7;
+        }
+
+        fputc(v, f);
+}
+
+static void columnar_put_blob(FILE *f, const void *p, size_t n) {
+        assert(f);
+
+        columnar_put_varint(f, n);
+        fwrite(p, 1, n, f);
+}
+
+static void columnar_put_delta(FILE *f, uint64_t *previous, uint64_t v) {
+        int64_t d;
+
+        assert(f);
+        assert(previous);
+
+        /* Zigzag encoded, so that small steps backwards stay small too */
+        d = (int64_t) (v - *previous);
+        columnar_put_varint(f, ((uint64_t) d << 1) ^ (uint64_t) (d >> 63));
+        *previous = v;
+}
+
+static void columnar_write_frame(FILE *f, char type, const char *body, size_t size) {
+        assert(f);
+        assert(body || size == 0);
+
+        fputc(type, f);
+        columnar_put_blob(f, body, size);
+}
+
+static int columnar_add_value(
+                ColumnarColumn **columns,
+                size_t *n_columns,
+                Hashmap **column_index,
+                const char *name,
+                size_t entry,
+                struct iovec value) {
+
+        ColumnarColumn *c;
+        void *i;
+        int r;
+
+        assert(columns);
+        assert(n_columns);
+        assert(column_index);
+        assert(name);
+
+        i = hashmap_get(*column_index, name);
+        if (i)
+                c = *columns + PTR_TO_SIZE(i) - 1;
+        else {
+                _cleanup_free_ char *n = NULL;
+
+                n = strdup(name);
+                if (!n)
+                        return log_oom();
+
+                if (!GREEDY_REALLOC(*columns, *n_columns + 1))
+                        return log_oom();
+
+                r = hashmap_ensure_put(column_index, &string_hash_ops, n, SIZE_TO_PTR(*n_columns + 1));
+                if (r < 0)
+                        return log_oom();
+
+                c = *columns + (*n_columns)++;
+                *c = (ColumnarColumn) {
+                        .name = TAKE_PTR(n),
+                };
+        }
+
+        if (!GREEDY_REALLOC(c->entries, c->n_values + 1) ||
+            !GREEDY_REALLOC(c->values, c->n_values + 1))
+                return log_oom();
+
+        c->entries[c->n_values] = entry;
+        c->values[c->n_values++] = value;
+        return 0;
+}
+
+/* Returns the dictionary to encode the column with, after writing out a dictionary frame for the values it
+ * is lacking, or NULL if the column is better stored as is. */
+static int columnar_prepare_dictionary(
+                FILE *f,
+                Hashmap *dictionaries,
+                const ColumnarColumn *c,
+                ColumnarDictionary **ret) {
+
+        _cleanup_set_free_ Set *new_values = NULL;
+        _cleanup_free_ char *body = NULL;
+        _cleanup_fclose_ FILE *b = NULL;
+        ColumnarDictionary *d;
+        size_t body_size = 0, n_new;
+        int r;
+
+        assert(f);
+        assert(dictionaries);
+        assert(c);
+        assert(ret);
+
+        d = hashmap_get(dictionaries, c->name);
+
+        for (size_t i = 0; i < c->n_values; i++) {
+                if (d && hashmap_contains(d->values, c->values + i))
+                        continue;
+
+                r = set_ensure_put(&new_values, &iovec_hash_ops, c->values + i);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        n_new = set_size(new_values);
+        if (n_new * 4 > c->n_values ||
+            (d ? d->n_values : 0) + n_new > COLUMNAR_DICTIONARY_MAX) {
+                *ret = NULL;
+                return 0;
+        }
+
+        if (!d) {
+                _cleanup_(columnar_dictionary_freep) ColumnarDictionary *n = NULL;
+                _cleanup_free_ char *name = NULL;
+
+                n = new0(ColumnarDictionary, 1);
+                if (!n)
+                        return log_oom();
+
+                name = strdup(c->name);
+                if (!name)
+                        return log_oom();
+
+                r = hashmap_put(dictionaries, name, n);
+                if (r < 0)
+                        return log_oom();
+
+                TAKE_PTR(name);
+                d = TAKE_PTR(n);
+        }
+
+        if (n_new == 0) {
+                *ret = d;
+                return 0;
+        }
+
+        b = open_memstream_unlocked(&body, &body_size);
+        if (!b)
+                return log_oom();
+
+        columnar_put_blob(b, c->name, strlen(c->name));
+        columnar_put_varint(b, n_new);
+
+        /* Add the new values in the order they appear in, that's the order the reader assigns indexes in */
+        for (size_t i = 0; i < c->n_values; i++) {
+                _cleanup_free_ struct iovec *v = NULL;
+
+                if (hashmap_contains(d->values, c->values + i))
+                        continue;
+
+                v = malloc(sizeof(struct iovec) + c->values[i].iov_len);
+                if (!v)
+                        return log_oom();
+
+                *v = IOVEC_MAKE((uint8_t*) v + sizeof(struct iovec), c->values[i].iov_len);
+                memcpy_safe(v->iov_base, c->values[i].iov_base, v->iov_len);
+
+                r = hashmap_ensure_put(&d->values, &iovec_hash_ops_free, v, SIZE_TO_PTR(d->n_values + 1));
+                if (r < 0)
+                        return log_oom();
+
+                TAKE_PTR(v);
+                d->n_values++;
+
+                columnar_put_blob(b, c->values[i].iov_base, c->values[i].iov_len);
+        }
+
+        r = fflush_and_check(b);
+        if (r < 0)
+                return log_error_errno(r, "Failed to write dictionary: %m");
+
+        b = safe_fclose(b);
+
+        columnar_write_frame(f, 'D', body, body_size);
+
+        *ret = d;
+        return 0;
+}
+
+static int output_columnar_write_batch(
+                FILE *f,
+                Hashmap **dictionaries,
+                const Set *output_fields,
+                const EntrySnapshot *entries,
+                size_t n_entries) {
+
+        _cleanup_hashmap_free_ Hashmap *column_index = NULL;
+        char *boot_ids = NULL;
+        uint64_t realtime = 0, monotonic = 0;
+        _cleanup_free_ char *body = NULL;
+        _cleanup_fclose_ FILE *b = NULL;
+        ColumnarColumn *columns = NULL;
+        size_t n_columns = 0, body_size = 0;
+        int r;
+
+        assert(f);
+        assert(dictionaries);
+        assert(entries || n_entries == 0);
+
+        if (n_entries == 0)
+                return 0;
+
+        /* The first batch of a stream is preceded by the header, which also starts out with empty
+         * dictionaries on the reader side */
+        if (!*dictionaries) {
+                *dictionaries = hashmap_new(&columnar_dictionary_hash_ops);
+                if (!*dictionaries)
+                        return log_oom();
+
+                columnar_write_frame(f, 'H', COLUMNAR_MAGIC, STRLEN(COLUMNAR_MAGIC));
+        }
+
+        boot_ids = malloc_multiply(SD_ID128_STRING_MAX, n_entries);
+        if (!boot_ids)
+                return log_oom();
+
+        for (size_t e = 0; e < n_entries; e++) {
+                const EntrySnapshot *s = entries + e;
+                char *sid = boot_ids + e * SD_ID128_STRING_MAX;
+
+                /* Like in the other export formats, the boot id is taken from the entry header */
+                r = columnar_add_value(&columns, &n_columns, &column_index, "_BOOT_ID", e,
+                                       IOVEC_MAKE_STRING(sd_id128_to_string(s->boot_id, sid)));
+                if (r < 0)
+                        goto finish;
+
+                for (size_t i = 0; i < s->n_fields; i++) {
+                        const char *data = s->fields[i].iov_base, *c;
+                        size_t length = s->fields[i].iov_len, fieldlen;
+
+                        if (memory_startswith(data, length, "_BOOT_ID="))
+                                continue;
+
+                        c = memchr(data, '=', length);
+                        if (!c) {
+                                r = log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Invalid field.");
+                                goto finish;
+                        }
+
+                        fieldlen = c - data;
+                        if (!journal_field_valid(data, fieldlen, true)) {
+                                r = log_error_errno(SYNTHETIC_ERRNO(EINVAL), "Invalid field.");
+                                goto finish;
+                        }
+
+                        r = field_set_test(output_fields, data, fieldlen);
+                        if (r < 0)
+                                goto finish;
+                        if (!r)
+                                continue;
+
+                        r = columnar_add_value(&columns, &n_columns, &column_index, strndupa_safe(data, fieldlen), e,
+                                               IOVEC_MAKE((char*) c + 1, length - fieldlen - 1));
+                        if (r < 0)
+                                goto finish;
+                }
+        }
+
+        b = open_memstream_unlocked(&body, &body_size);
+        if (!b) {
+                r = log_oom();
+                goto finish;
+        }
+
+        columnar_put_varint(b, n_entries);
+
+        /* Cursors of consecutive entries mostly share their beginning, hence only store what differs */
+        for (size_t e = 0; e < n_entries; e++) {
+                const char *c = entries[e].cursor, *previous = e > 0 ? entries[e - 1].cursor : "";
+                size_t n = 0;
+
+                while (c[n] != 0 && c[n] == previous[n])
+                        n++;
+
+                columnar_put_varint(b, n);
+                columnar_put_blob(b, c + n, strlen(c + n));
+        }
+        for (size_t e = 0; e < n_entries; e++)
+                columnar_put_delta(b, &realtime, entries[e].realtime);
+        for (size_t e = 0; e < n_entries; e++)
+                columnar_put_delta(b, &monotonic, entries[e].monotonic);
+
+        columnar_put_varint(b, n_columns);
+
+        for (size_t i = 0; i < n_columns; i++) {
+                const ColumnarColumn *c = columns + i;
+                ColumnarDictionary *d;
+                size_t k = 0;
+
+                r = columnar_prepare_dictionary(f, *dictionaries, c, &d);
+                if (r < 0)
+                        goto finish;
+
+                columnar_put_blob(b, c->name, strlen(c->name));
+                fputc(d ? 'D' : 'P', b);
+
+                for (size_t e = 0; e < n_entries; e++) {
+                        size_t n = 0;
+
+                        while (k + n < c->n_values && c->entries[k + n] == e)
+                                n++;
+
+                        columnar_put_varint(b, n);
+
+                        for (; n > 0; n--, k++)
+                                if (d)
+                                        columnar_put_varint(b, PTR_TO_SIZE(hashmap_get(d->values, c->values + k)) - 1);
+                                else
+                                        columnar_put_blob(b, c->values[k].iov_base, c->values[k].iov_len);
+                }
+        }
+
+        r = fflush_and_check(b);
+        if (r < 0) {
+                log_error_errno(r, "Failed to write batch: %m");
+                goto finish;
+        }
+
+        b = safe_fclose(b);
+
+        columnar_write_frame(f, 'B', body, body_size);
+        r = 0;
+
+finish:
+        columnar_columns_free(columns, n_columns);
+        free(boot_ids);
 
         return r;
 }
 
+static int output_export_columnar(
+                FILE *f,
+                sd_journal *j,
+                OutputMode mode,
+                unsigned n_columns,
+                OutputFlags flags,
+                const Set *output_fields,
+                const size_t highlight[2]) {
+
+        _cleanup_hashmap_free_ Hashmap *dictionaries = NULL;
+        _cleanup_(entry_snapshot_done) EntrySnapshot s = {};
+        int r;
+
+        assert(f);
+        assert(j);
+
+        /* Without a stream to add to, every entry becomes a stream of its own */
+
+        r = entry_snapshot_fill(&s, j, mode, flags, /* copy= */ false);
+        if (r == -EBADMSG) {
+                log_debug_errno(r, "Skipping message we can't read: %m");
+                return 0;
+        }
+        if (r < 0)
+                return r;
+
+        return output_columnar_write_batch(f, &dictionaries, output_fields, &s, 1);
+}
+
 static int output_cat_field(
                 FILE *f,
                 sd_journal *j,
@@ -1245,13 +1755,14 @@ static int (*output_funcs[_OUTPUT_MODE_MAX])(
         [OUTPUT_SHORT_UNIX]        = output_short,
         [OUTPUT_SHORT_FULL]        = output_short,
         [OUTPUT_VERBOSE]           = output_verbose,
-        [OUTPUT_EXPORT]            = output_export,
-        [OUTPUT_JSON]              = output_json,
-        [OUTPUT_JSON_PRETTY]       = output_json,
-        [OUTPUT_JSON_SSE]          = output_json,
-        [OUTPUT_JSON_SEQ]          = output_json,
+        [OUTPUT_EXPORT]            = output_snapshot,
+        [OUTPUT_JSON]              = output_snapshot,
+        [OUTPUT_JSON_PRETTY]       = output_snapshot,
+        [OUTPUT_JSON_SSE]          = output_snapshot,
+        [OUTPUT_JSON_SEQ]          = output_snapshot,
         [OUTPUT_CAT]               = output_cat,
         [OUTPUT_WITH_UNIT]         = output_short,
+        [OUTPUT_EXPORT_COLUMNAR]   = output_export_columnar,
 };
 
 int show_journal_entry(
@@ -1285,6 +1796,334 @@ int show_journal_entry(
         return r;
 }
 
+/* Entries are read into batches of snapshots on the main thread, and formatted in chunks of consecutive
+ * entries by the workers while the main thread reads the next batch. Each chunk is formatted into a buffer
+ * of its own, which are written out in order once the whole batch is done. */
+#define OUTPUT_PIPELINE_BATCH 256U
+#define OUTPUT_PIPELINE_CHUNK 16U
+
+typedef struct OutputChunk {
+        char *buf;
+        size_t size;
+        int result;
+} OutputChunk;
+
+typedef struct OutputBatch {
+        EntrySnapshot entries[OUTPUT_PIPELINE_BATCH];
+        size_t n_entries;
+
+        OutputChunk chunks[OUTPUT_PIPELINE_BATCH / OUTPUT_PIPELINE_CHUNK];
+        size_t n_chunks;
+} OutputBatch;
+
+struct OutputPipeline {
+        FILE *f;
+        OutputMode mode;
+        OutputFlags flags;
+        Set *output_fields;
+
+        /* For OUTPUT_EXPORT_COLUMNAR, the dictionaries of the stream so far */
+        Hashmap *dictionaries;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t work_cond; /* signalled when a batch is queued, or when shutting down */
+        pthread_cond_t done_cond; /* signalled when the last chunk of the queued batch is done */
+
+        pthread_t *threads;
+        size_t n_threads;
+
+        OutputBatch batches[2];
+        OutputBatch *filling; /* only accessed by the main thread */
+
+        /* The batch being formatted, protected by the mutex */
+        OutputBatch *queued;
+        size_t next_chunk;
+        size_t n_pending;
+
+        bool shutdown;
+};
+
+static void output_chunk_run(OutputPipeline *p, OutputBatch *b, size_t i) {
+        _cleanup_fclose_ FILE *f = NULL;
+        OutputChunk *c;
+        int r;
+
+        assert(p);
+        assert(b);
+        assert(i < b->n_chunks);
+
+        c = b->chunks + i;
+        c->result = 0;
+
+        f = open_memstream_unlocked(&c->buf, &c->size);
+        if (!f) {
+                c->result = -ENOMEM;
+                return;
+        }
+
+        for (size_t k = i * OUTPUT_PIPELINE_CHUNK; k < MIN((i + 1) * OUTPUT_PIPELINE_CHUNK, b->n_entries); k++) {
+                r = output_snapshot_funcs[p->mode](f, b->entries + k, p->mode, p->flags, p->output_fields);
+                if (r < 0) {
+                        c->result = r;
+                        break;
+                }
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0 && c->result >= 0)
+                c->result = r;
+}
+
+/* Picks up and runs chunks of the queued batch until there are none left. Called with the mutex held. */
+static void output_pipeline_work_locked(OutputPipeline *p) {
+        assert(p);
+
+        while (p->queued && p->next_chunk < p->queued->n_chunks) {
+                OutputBatch *b = p->queued;
+                size_t i = p->next_chunk++;
+
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+                output_chunk_run(p, b, i);
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+                assert(p->n_pending > 0);
+                if (--p->n_pending == 0)
+                        assert_se(pthread_cond_signal(&p->done_cond) == 0);
+        }
+}
+
+static void* output_pipeline_thread(void *userdata) {
+        OutputPipeline *p = ASSERT_PTR(userdata);
+
+        (void) pthread_setname_np(pthread_self(), "output-pipeline");
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        for (;;) {
+                while (!p->shutdown && (!p->queued || p->next_chunk >= p->queued->n_chunks))
+                        assert_se(pthread_cond_wait(&p->work_cond, &p->mutex) == 0);
+
+                if (p->shutdown)
+                        break;
+
+                output_pipeline_work_locked(p);
+        }
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+        return NULL;
+}
+
+OutputPipeline* output_pipeline_free(OutputPipeline *p) {
+        if (!p)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        p->shutdown = true;
+        assert_se(pthread_cond_broadcast(&p->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        for (size_t i = 0; i < p->n_threads; i++)
+                (void) pthread_join(p->threads[i], NULL);
+
+        free(p->threads);
+
+        assert_se(pthread_cond_destroy(&p->work_cond) == 0);
+        assert_se(pthread_cond_destroy(&p->done_cond) == 0);
+        assert_se(pthread_mutex_destroy(&p->mutex) == 0);
+
+        for (size_t i = 0; i < ELEMENTSOF(p->batches); i++) {
+                for (size_t k = 0; k < OUTPUT_PIPELINE_BATCH; k++)
+                        entry_snapshot_done(p->batches[i].entries + k);
+                for (size_t k = 0; k < ELEMENTSOF(p->batches[i].chunks); k++)
+                        free(p->batches[i].chunks[k].buf);
+        }
+
+        set_free(p->output_fields);
+        hashmap_free(p->dictionaries);
+
+        return mfree(p);
+}
+
+int output_pipeline_new(
+                FILE *f,
+                OutputMode mode,
+                OutputFlags flags,
+                char **output_fields,
+                unsigned n_threads,
+                OutputPipeline **ret) {
+
+        _cleanup_(output_pipeline_freep) OutputPipeline *p = NULL;
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(f);
+        assert(output_mode_can_pipeline(mode));
+        assert(ret);
+
+        p = new(OutputPipeline, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (OutputPipeline) {
+                .f = f,
+                .mode = mode,
+                .flags = flags,
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .work_cond = PTHREAD_COND_INITIALIZER,
+                .done_cond = PTHREAD_COND_INITIALIZER,
+        };
+        p->filling = p->batches;
+
+        r = set_put_strdupv(&p->output_fields, output_fields);
+        if (r < 0)
+                return r;
+
+        /* The columnar format is encoded a batch at a time with dictionaries shared between them, and
+         * formatting on zero threads means on the calling one */
+        if (mode == OUTPUT_EXPORT_COLUMNAR || n_threads == 0) {
+                *ret = TAKE_PTR(p);
+                return 0;
+        }
+
+        p->threads = new(pthread_t, n_threads);
+        if (!p->threads)
+                return -ENOMEM;
+
+        /* Leave all signal handling to the main thread, except for SIGBUS, like for the compression pool */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        for (; p->n_threads < n_threads; p->n_threads++) {
+                r = pthread_create(p->threads + p->n_threads, NULL, output_pipeline_thread, p);
+                if (r > 0)
+                        break;
+        }
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+        if (k > 0)
+                return -k;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+/* Waits for the queued batch, if there is one, and writes it out. */
+static int output_pipeline_wait(OutputPipeline *p) {
+        OutputBatch *b;
+        int r = 0;
+
+        assert(p);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        /* Instead of idling, help the workers */
+        output_pipeline_work_locked(p);
+
+        while (p->n_pending > 0)
+                assert_se(pthread_cond_wait(&p->done_cond, &p->mutex) == 0);
+
+        b = TAKE_PTR(p->queued);
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        if (!b)
+                return 0;
+
+        /* Stop at the first chunk that failed, like we'd have stopped at the failing entry when formatting
+         * them one by one */
+        for (size_t i = 0; i < b->n_chunks; i++) {
+                OutputChunk *c = b->chunks + i;
+
+                if (r >= 0) {
+                        fwrite(c->buf, 1, c->size, p->f);
+                        r = c->result;
+                }
+
+                c->buf = mfree(c->buf);
+                c->size = 0;
+        }
+
+        b->n_entries = b->n_chunks = 0;
+
+        return r;
+}
+
+static int output_pipeline_submit(OutputPipeline *p) {
+        OutputBatch *b;
+        int r;
+
+        assert(p);
+
+        b = p->filling;
+        if (b->n_entries == 0)
+                return 0;
+
+        if (p->mode == OUTPUT_EXPORT_COLUMNAR) {
+                r = output_columnar_write_batch(p->f, &p->dictionaries, p->output_fields, b->entries, b->n_entries);
+                b->n_entries = 0;
+                return r;
+        }
+
+        /* Only one batch is formatted at a time, so that they are written out in order */
+        r = output_pipeline_wait(p);
+        if (r < 0)
+                return r;
+
+        b->n_chunks = DIV_ROUND_UP(b->n_entries, OUTPUT_PIPELINE_CHUNK);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        p->queued = b;
+        p->next_chunk = 0;
+        p->n_pending = b->n_chunks;
+        assert_se(pthread_cond_broadcast(&p->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        p->filling = b == p->batches ? p->batches + 1 : p->batches;
+        return 0;
+}
+
+int output_pipeline_add(OutputPipeline *p, sd_journal *j) {
+        OutputBatch *b;
+        int r;
+
+        assert(p);
+        assert(j);
+
+        b = p->filling;
+        assert(b->n_entries < OUTPUT_PIPELINE_BATCH);
+
+        r = entry_snapshot_fill(b->entries + b->n_entries, j, p->mode, p->flags, /* copy= */ true);
+        if (r == -EBADMSG) {
+                log_debug_errno(r, "Skipping message we can't read: %m");
+                return 0;
+        }
+        if (r < 0)
+                return r;
+
+        if (++b->n_entries < OUTPUT_PIPELINE_BATCH)
+                return 0;
+
+        return output_pipeline_submit(p);
+}
+
+int output_pipeline_flush(OutputPipeline *p) {
+        int r;
+
+        assert(p);
+
+        r = output_pipeline_submit(p);
+        if (r < 0)
+                return r;
+
+        return output_pipeline_wait(p);
+}
+
 static int maybe_print_begin_newline(FILE *f, OutputFlags *flags) {
         assert(f);
         assert(flags);
@@ -32,6 +32,26 @@ int show_journal(
                 OutputFlags flags,
                 bool *ellipsized);
 
+/* Formats entries in the modes that support it on worker threads, while the caller keeps reading the
+ * journal. Output is written in order, but lags behind: call output_pipeline_flush() before writing
+ * anything else to the stream, or waiting for new entries. */
+typedef struct OutputPipeline OutputPipeline;
+
+bool output_mode_can_pipeline(OutputMode mode);
+
+int output_pipeline_new(
+                FILE *f,
+                OutputMode mode,
+                OutputFlags flags,
+                char **output_fields,
+                unsigned n_threads,
+                OutputPipeline **ret);
+OutputPipeline* output_pipeline_free(OutputPipeline *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(OutputPipeline*, output_pipeline_free);
+
+int output_pipeline_add(OutputPipeline *p, sd_journal *j);
+int output_pipeline_flush(OutputPipeline *p);
+
 int add_match_this_boot(sd_journal *j, const char *machine);
 
 int add_matches_for_unit(
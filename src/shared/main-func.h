@@ -12,8 +12,14 @@
 #include "static-destruct.h"
 #include "util.h"
 
+/* Programs which are also linked into another binary, see the builtin-generators meson option, are compiled
+ * with a different name for their entry point. */
+#ifndef MAIN_FUNCTION_NAME
+#  define MAIN_FUNCTION_NAME main
+#endif
+
 #define _DEFINE_MAIN_FUNCTION(intro, impl, ret)                         \
-        int main(int argc, char *argv[]) {                              \
+        int MAIN_FUNCTION_NAME(int argc, char *argv[]) {                \
                 int r;                                                  \
                 assert_se(argc > 0 && !isempty(argv[0]));               \
                 save_argc_argv(argc, argv);                             \
@@ -1051,14 +1051,14 @@ int make_mount_point(const char *path) {
         return 1;
 }
 
-static int make_userns(uid_t uid_shift, uid_t uid_range, RemountIdmapFlags flags) {
+static int make_userns(uid_t uid_base, uid_t uid_shift, uid_t uid_range, RemountIdmapFlags flags) {
         _cleanup_close_ int userns_fd = -1;
         _cleanup_free_ char *line = NULL;
 
         /* Allocates a userns file descriptor with the mapping we need. For this we'll fork off a child
          * process whose only purpose is to give us a new user namespace. It's killed when we got it. */
 
-        if (asprintf(&line, UID_FMT " " UID_FMT " " UID_FMT "\n", 0, uid_shift, uid_range) < 0)
+        if (asprintf(&line, UID_FMT " " UID_FMT " " UID_FMT "\n", uid_base, uid_shift, uid_range) < 0)
                 return log_oom_debug();
 
         /* If requested we'll include an entry in the mapping so that the host root user can make changes to
@@ -1085,8 +1085,9 @@ static int make_userns(uid_t uid_shift, uid_t uid_range, RemountIdmapFlags flags
         return TAKE_FD(userns_fd);
 }
 
-int remount_idmap(
+int remount_idmap_full(
                 const char *p,
+                uid_t uid_base,
                 uid_t uid_shift,
                 uid_t uid_range,
                 RemountIdmapFlags flags) {
@@ -1096,7 +1097,11 @@ int remount_idmap(
 
         assert(p);
 
-        if (!userns_shift_range_valid(uid_shift, uid_range))
+        /* Maps the UIDs/GIDs uid_base…uid_base+uid_range-1 on the backing fs to uid_shift…, i.e. files
+         * owned by uid_base show up as owned by uid_shift on the mount. */
+
+        if (!userns_shift_range_valid(uid_base, uid_range) ||
+            !userns_shift_range_valid(uid_shift, uid_range))
                 return -EINVAL;
 
         /* Clone the mount point */
@@ -1105,7 +1110,7 @@ int remount_idmap(
                 return log_debug_errno(errno, "Failed to open tree of mounted filesystem '%s': %m", p);
 
         /* Create a user namespace mapping */
-        userns_fd = make_userns(uid_shift, uid_range, flags);
+        userns_fd = make_userns(uid_base, uid_shift, uid_range, flags);
         if (userns_fd < 0)
                 return userns_fd;
 
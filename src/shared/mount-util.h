@@ -123,7 +123,10 @@ typedef enum RemountIdmapFlags {
         REMOUNT_IDMAP_HOST_ROOT = 1 << 0,
 } RemountIdmapFlags;
 
-int remount_idmap(const char *p, uid_t uid_shift, uid_t uid_range, RemountIdmapFlags flags);
+int remount_idmap_full(const char *p, uid_t uid_base, uid_t uid_shift, uid_t uid_range, RemountIdmapFlags flags);
+static inline int remount_idmap(const char *p, uid_t uid_shift, uid_t uid_range, RemountIdmapFlags flags) {
+        return remount_idmap_full(p, 0, uid_shift, uid_range, flags);
+}
 
 /* Creates a mount point (not parents) based on the source path or stat - ie, a file or a directory */
 int make_mount_point_inode_from_stat(const struct stat *st, const char *dest, mode_t mode);
@@ -11,8 +11,10 @@
 #include "macro.h"
 #include "missing_syscall.h"
 #include "numa-util.h"
+#include "parse-util.h"
 #include "stdio-util.h"
 #include "string-table.h"
+#include "string-util.h"
 
 bool numa_policy_is_valid(const NUMAPolicy *policy) {
         assert(policy);
@@ -89,6 +91,62 @@ int apply_numa_policy(const NUMAPolicy *policy) {
         return 0;
 }
 
+int numa_node_get_cpus(unsigned node, CPUSet *ret) {
+        char p[STRLEN("/sys/devices/system/node/node//cpulist") + DECIMAL_STR_MAX(unsigned) + 1];
+        _cleanup_free_ char *l = NULL;
+        int r;
+
+        assert(ret);
+
+        xsprintf(p, "/sys/devices/system/node/node%u/cpulist", node);
+
+        r = read_one_line_file(p, &l);
+        if (r < 0)
+                return r;
+
+        return parse_cpu_set(l, ret);
+}
+
+int numa_node_get_free_memory(unsigned node, uint64_t *ret) {
+        char p[STRLEN("/sys/devices/system/node/node//meminfo") + DECIMAL_STR_MAX(unsigned) + 1],
+                pattern[STRLEN("Node  MemFree") + DECIMAL_STR_MAX(unsigned) + 1];
+        _cleanup_free_ char *v = NULL;
+        uint64_t kb;
+        int r;
+
+        assert(ret);
+
+        xsprintf(p, "/sys/devices/system/node/node%u/meminfo", node);
+        xsprintf(pattern, "Node %u MemFree", node);
+
+        r = get_proc_field(p, pattern, WHITESPACE, &v);
+        if (r < 0)
+                return r;
+
+        r = safe_atou64(v, &kb);
+        if (r < 0)
+                return r;
+
+        if (kb > UINT64_MAX / 1024)
+                return -ERANGE;
+
+        *ret = kb * 1024;
+        return 0;
+}
+
+int numa_get_online_nodes(CPUSet *ret) {
+        _cleanup_free_ char *l = NULL;
+        int r;
+
+        assert(ret);
+
+        r = read_one_line_file("/sys/devices/system/node/online", &l);
+        if (r < 0)
+                return r;
+
+        return parse_cpu_set(l, ret);
+}
+
 int numa_to_cpu_set(const NUMAPolicy *policy, CPUSet *ret) {
         int r;
         size_t i;
@@ -98,20 +156,12 @@ int numa_to_cpu_set(const NUMAPolicy *policy, CPUSet *ret) {
         assert(ret);
 
         for (i = 0; i < policy->nodes.allocated * 8; i++) {
-                _cleanup_free_ char *l = NULL;
-                char p[STRLEN("/sys/devices/system/node/node//cpulist") + DECIMAL_STR_MAX(size_t) + 1];
                 _cleanup_(cpu_set_reset) CPUSet part = {};
 
                 if (!CPU_ISSET_S(i, policy->nodes.allocated, policy->nodes.set))
                         continue;
 
-                xsprintf(p, "/sys/devices/system/node/node%zu/cpulist", i);
-
-                r = read_one_line_file(p, &l);
-                if (r < 0)
-                        return r;
-
-                r = parse_cpu_set(l, &part);
+                r = numa_node_get_cpus(i, &part);
                 if (r < 0)
                         return r;
 
@@ -29,6 +29,10 @@ static inline void numa_policy_reset(NUMAPolicy *p) {
 int apply_numa_policy(const NUMAPolicy *policy);
 int numa_to_cpu_set(const NUMAPolicy *policy, CPUSet *set);
 
+int numa_node_get_cpus(unsigned node, CPUSet *ret);
+int numa_node_get_free_memory(unsigned node, uint64_t *ret);
+int numa_get_online_nodes(CPUSet *ret);
+
 int numa_mask_add_all(CPUSet *mask);
 
 const char* mpol_to_string(int i) _const_;
@@ -294,13 +294,15 @@ bool pager_have(void) {
         return pager_pid > 0;
 }
 
-int show_man_page(const char *desc, bool null_stdio) {
+int show_man_page_async(const char *desc, bool null_stdio, pid_t *ret_pid) {
         const char *args[4] = { "man", NULL, NULL, NULL };
         char *e = NULL;
-        pid_t pid;
         size_t k;
         int r;
 
+        assert(desc);
+        assert(ret_pid);
+
         k = strlen(desc);
 
         if (desc[k-1] == ')')
@@ -317,7 +319,7 @@ int show_man_page(const char *desc, bool null_stdio) {
         } else
                 args[1] = desc;
 
-        r = safe_fork("(man)", FORK_RESET_SIGNALS|FORK_DEATHSIG|(null_stdio ? FORK_NULL_STDIO : 0)|FORK_RLIMIT_NOFILE_SAFE|FORK_LOG, &pid);
+        r = safe_fork("(man)", FORK_RESET_SIGNALS|FORK_DEATHSIG|(null_stdio ? FORK_NULL_STDIO : 0)|FORK_RLIMIT_NOFILE_SAFE|FORK_LOG, ret_pid);
         if (r < 0)
                 return r;
         if (r == 0) {
@@ -327,5 +329,16 @@ int show_man_page(const char *desc, bool null_stdio) {
                 _exit(EXIT_FAILURE);
         }
 
+        return 0;
+}
+
+int show_man_page(const char *desc, bool null_stdio) {
+        pid_t pid;
+        int r;
+
+        r = show_man_page_async(desc, null_stdio, &pid);
+        if (r < 0)
+                return r;
+
         return wait_for_terminate_and_check(NULL, pid, 0);
 }
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <sys/types.h>
 
 #include "macro.h"
 
@@ -14,4 +15,5 @@ void pager_open(PagerFlags flags);
 void pager_close(void);
 bool pager_have(void) _pure_;
 
+int show_man_page_async(const char *page, bool null_stdio, pid_t *ret_pid);
 int show_man_page(const char *page, bool null_stdio);
@@ -14,16 +14,15 @@
 #include "stat-util.h"
 #include "strv.h"
 
-int read_resource_pressure(const char *path, PressureType type, ResourcePressure *ret) {
-        _cleanup_free_ char *line = NULL;
-        _cleanup_fclose_ FILE *f = NULL;
+static int parse_resource_pressure(const char *contents, PressureType type, ResourcePressure *ret) {
+        _cleanup_strv_free_ char **lines = NULL;
         unsigned field_filled = 0;
         ResourcePressure rp = {};
-        const char *t, *cline;
+        const char *t, *cline = NULL;
         char *word;
         int r;
 
-        assert(path);
+        assert(contents);
         assert(IN_SET(type, PRESSURE_TYPE_SOME, PRESSURE_TYPE_FULL));
         assert(ret);
 
@@ -34,29 +33,17 @@ int read_resource_pressure(const char *path, PressureType type, ResourcePressure
         else
                 return -EINVAL;
 
-        r = fopen_unlocked(path, "re", &f);
-        if (r < 0)
-                return r;
-
-        for (;;) {
-                _cleanup_free_ char *l = NULL;
-                char *w;
-
-                r = read_line(f, LONG_LINE_MAX, &l);
-                if (r < 0)
-                        return r;
-                if (r == 0)
-                        break;
+        lines = strv_split_newlines(contents);
+        if (!lines)
+                return -ENOMEM;
 
-                w = first_word(l, t);
-                if (w) {
-                        line = TAKE_PTR(l);
-                        cline = w;
+        STRV_FOREACH(l, lines) {
+                cline = first_word(*l, t);
+                if (cline)
                         break;
-                }
         }
 
-        if (!line)
+        if (!cline)
                 return -ENODATA;
 
         /* extracts either avgX=Y.Z or total=X */
@@ -105,6 +92,36 @@ int read_resource_pressure(const char *path, PressureType type, ResourcePressure
         return 0;
 }
 
+int read_resource_pressure(const char *path, PressureType type, ResourcePressure *ret) {
+        _cleanup_free_ char *contents = NULL;
+        int r;
+
+        assert(path);
+
+        r = read_full_virtual_file(path, &contents, NULL);
+        if (r < 0)
+                return r;
+
+        return parse_resource_pressure(contents, type, ret);
+}
+
+int read_resource_pressure_fd(int fd, PressureType type, ResourcePressure *ret) {
+        _cleanup_free_ char *contents = NULL;
+        int r;
+
+        assert(fd >= 0);
+
+        /* Reads the pressure file again from the beginning, so that the file can be kept open. */
+        if (lseek(fd, 0, SEEK_SET) < 0)
+                return -errno;
+
+        r = read_virtual_file_fd(fd, SIZE_MAX, &contents, NULL);
+        if (r < 0)
+                return r;
+
+        return parse_resource_pressure(contents, type, ret);
+}
+
 int is_pressure_supported(void) {
         /* The pressure files, both under /proc and in cgroups, will exist
          * even if the kernel has PSI support disabled; we have to read
@@ -25,6 +25,7 @@ typedef struct ResourcePressure {
  *  full avg10=0.23 avg60=0.16 avg300=1.08 total=58464525
  */
 int read_resource_pressure(const char *path, PressureType type, ResourcePressure *ret);
+int read_resource_pressure_fd(int fd, PressureType type, ResourcePressure *ret);
 
 /* Was the kernel compiled with CONFIG_PSI=y? 1 if yes, 0 if not, negative on error. */
 int is_pressure_supported(void);
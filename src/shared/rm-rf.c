@@ -2,6 +2,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <unistd.h>
@@ -9,10 +10,13 @@
 #include "alloc-util.h"
 #include "btrfs-util.h"
 #include "cgroup-util.h"
+#include "cpu-set-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "list.h"
 #include "log.h"
 #include "macro.h"
+#include "missing_syscall.h"
 #include "mountpoint-util.h"
 #include "path-util.h"
 #include "rm-rf.h"
@@ -188,6 +192,304 @@ static int rm_rf_inner_child(
         return 1;
 }
 
+#define REMOVE_QUEUE_THREADS_MAX 16U
+
+typedef struct RemoveDir RemoveDir;
+
+struct RemoveDir {
+        RemoveDir *parent; /* NULL for the top-level directory */
+        char *name;        /* The filename of this directory in the parent */
+        int fd;            /* Opened when we get to enumerate it, closed once everything below it is gone */
+        unsigned n_ref;    /* One for the enumeration, plus one for each subdirectory not removed yet */
+
+        LIST_FIELDS(RemoveDir, queue);
+};
+
+typedef struct RemoveQueue {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        /* Directories not enumerated yet. We operate on the most recently added one first, i.e. go depth
+         * first, so that the number of directories we need to keep open stays small. */
+        LIST_HEAD(RemoveDir, queue);
+        unsigned n_busy;
+        bool cancelled;
+        int ret;
+
+        RemoveFlags flags;
+        const struct stat *root_dev;
+} RemoveQueue;
+
+static void remove_queue_error(RemoveQueue *q, int error, bool cancel) {
+        assert(q);
+        assert(error < 0);
+
+        assert_se(pthread_mutex_lock(&q->mutex) == 0);
+        if (q->ret == 0)
+                q->ret = error;
+        if (cancel)
+                q->cancelled = true;
+        assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+}
+
+static void remove_dir_unref(RemoveQueue *q, RemoveDir *d) {
+        assert(q);
+
+        /* Drops one reference, and if this was the last one, removes the (now empty) directory from its
+         * parent, which in turn drops a reference on the parent. */
+
+        while (d) {
+                RemoveDir *parent;
+                bool cancelled;
+                unsigned n;
+                int r;
+
+                assert_se(pthread_mutex_lock(&q->mutex) == 0);
+                assert(d->n_ref > 0);
+                n = --d->n_ref;
+                cancelled = q->cancelled;
+                assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+
+                if (n > 0)
+                        return;
+
+                parent = d->parent;
+
+                /* Only remove directories we actually managed to enumerate */
+                if (parent && d->fd >= 0 && !cancelled) {
+                        r = unlinkat_harder(parent->fd, d->name, AT_REMOVEDIR, q->flags);
+                        if (r < 0 && r != -ENOENT)
+                                remove_queue_error(q, r, /* cancel= */ false);
+                }
+
+                safe_close(d->fd);
+                free(d->name);
+                free(d);
+
+                d = parent;
+        }
+}
+
+static int remove_dir_enqueue(RemoveQueue *q, RemoveDir *parent, const char *name) {
+        _cleanup_free_ char *n = NULL;
+        RemoveDir *d;
+
+        assert(q);
+        assert(parent);
+        assert(name);
+
+        n = strdup(name);
+        if (!n)
+                return -ENOMEM;
+
+        d = new(RemoveDir, 1);
+        if (!d)
+                return -ENOMEM;
+
+        *d = (RemoveDir) {
+                .parent = parent,
+                .name = TAKE_PTR(n),
+                .fd = -1,
+                .n_ref = 1,
+        };
+
+        assert_se(pthread_mutex_lock(&q->mutex) == 0);
+        parent->n_ref++;
+        LIST_PREPEND(queue, q->queue, d);
+        assert_se(pthread_cond_signal(&q->cond) == 0);
+        assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+
+        return 0;
+}
+
+static int remove_dir_enumerate(RemoveQueue *q, RemoveDir *d, void *buffer, size_t size) {
+        int r, ret = 0;
+
+        assert(q);
+        assert(d);
+        assert(buffer);
+
+        if (d->fd < 0) {
+                assert(d->parent);
+
+                d->fd = openat(d->parent->fd, d->name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW|O_NOATIME);
+                if (d->fd < 0)
+                        return errno == ENOENT ? 0 : -errno;
+        }
+
+        if (!(q->flags & REMOVE_PHYSICAL)) {
+                struct statfs sfs;
+
+                if (fstatfs(d->fd, &sfs) < 0)
+                        return -errno;
+
+                if (is_physical_fs(&sfs)) {
+                        _cleanup_free_ char *path = NULL;
+
+                        (void) fd_get_path(d->fd, &path);
+                        return log_error_errno(SYNTHETIC_ERRNO(EPERM),
+                                               "Attempted to remove disk file system under \"%s\", and we can't allow that.",
+                                               strna(path));
+                }
+        }
+
+        /* Read many entries at once, so that we need fewer getdents64() calls than with readdir() */
+        for (;;) {
+                struct dirent *de;
+                ssize_t n;
+
+                n = getdents64(d->fd, buffer, size);
+                if (n < 0)
+                        return -errno;
+                if (n == 0)
+                        break;
+
+                assert((size_t) n <= size);
+                msan_unpoison(buffer, n);
+
+                FOREACH_DIRENT_IN_BUFFER(de, buffer, n) {
+                        int is_dir;
+
+                        if (dot_or_dot_dot(de->d_name))
+                                continue;
+
+                        is_dir = de->d_type == DT_UNKNOWN ? -1 : de->d_type == DT_DIR;
+
+                        r = rm_rf_inner_child(d->fd, de->d_name, is_dir, q->flags, q->root_dev, false);
+                        if (r == -EISDIR) {
+                                /* Leave the subdirectory to whichever thread is idle first */
+                                r = remove_dir_enqueue(q, d, de->d_name);
+                                if (r < 0)
+                                        return r;
+                        } else if (r < 0 && r != -ENOENT && ret == 0)
+                                ret = r;
+                }
+        }
+
+        if (FLAGS_SET(q->flags, REMOVE_SYNCFS) && syncfs(d->fd) < 0 && ret == 0)
+                ret = -errno;
+
+        return ret;
+}
+
+static void* remove_queue_thread(void *userdata) {
+        RemoveQueue *q = ASSERT_PTR(userdata);
+        DEFINE_DIRENT_BUFFER(buffer, 128);
+
+        for (;;) {
+                RemoveDir *d;
+                bool cancelled;
+                int r;
+
+                assert_se(pthread_mutex_lock(&q->mutex) == 0);
+
+                /* As long as somebody is still enumerating a directory, more work might show up */
+                while (!q->queue && q->n_busy > 0)
+                        assert_se(pthread_cond_wait(&q->cond, &q->mutex) == 0);
+
+                d = LIST_POP(queue, q->queue);
+                if (d)
+                        q->n_busy++;
+                else
+                        /* We are done, wake up everybody else, so that they notice too */
+                        assert_se(pthread_cond_broadcast(&q->cond) == 0);
+
+                cancelled = q->cancelled;
+                assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+
+                if (!d)
+                        break;
+
+                if (!cancelled) {
+                        r = remove_dir_enumerate(q, d, &buffer, sizeof(buffer));
+                        if (r < 0)
+                                /* Refusing to remove physical file systems and running out of memory are
+                                 * fatal, everything else we try to continue after. */
+                                remove_queue_error(q, r, IN_SET(r, -EPERM, -ENOMEM));
+                }
+
+                remove_dir_unref(q, d);
+
+                assert_se(pthread_mutex_lock(&q->mutex) == 0);
+                q->n_busy--;
+                if (q->n_busy == 0 && !q->queue)
+                        assert_se(pthread_cond_broadcast(&q->cond) == 0);
+                assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+        }
+
+        return NULL;
+}
+
+static int rm_rf_children_parallel(
+                int fd,
+                RemoveFlags flags,
+                const struct stat *root_dev) {
+
+        _cleanup_free_ pthread_t *threads = NULL;
+        RemoveQueue q = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+                .flags = flags,
+                .root_dev = root_dev,
+        };
+        sigset_t ss, saved_ss;
+        size_t n = 0, n_threads;
+        RemoveDir *top;
+        int r;
+
+        assert(fd >= 0);
+
+        /* Like rm_rf_children(), but enumerates and removes subdirectories on a pool of threads. Mostly
+         * useful for large trees on physical file systems, where we'd otherwise wait for each directory
+         * in turn. This thread works on the queue too, the others just help. */
+
+        top = new(RemoveDir, 1);
+        if (!top) {
+                safe_close(fd);
+                return -ENOMEM;
+        }
+
+        *top = (RemoveDir) {
+                .fd = fd,
+                .n_ref = 1,
+        };
+        LIST_PREPEND(queue, q.queue, top);
+
+        r = cpus_in_affinity_mask();
+        n_threads = r > 0 ? MIN((unsigned) r * 2, REMOVE_QUEUE_THREADS_MAX) - 1 : 1;
+
+        threads = new(pthread_t, n_threads);
+        if (threads) {
+                /* Worker threads must never get signals */
+                assert_se(sigfillset(&ss) >= 0);
+
+                if (pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0) {
+                        for (; n < n_threads; n++) {
+                                r = pthread_create(threads + n, NULL, remove_queue_thread, &q);
+                                if (r > 0) {
+                                        log_debug_errno(r, "Failed to start removal thread, continuing with fewer: %m");
+                                        break;
+                                }
+                        }
+
+                        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+                }
+        }
+
+        (void) remove_queue_thread(&q);
+
+        for (size_t i = 0; i < n; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        assert(!q.queue);
+        assert(q.n_busy == 0);
+
+        assert_se(pthread_cond_destroy(&q.cond) == 0);
+        assert_se(pthread_mutex_destroy(&q.mutex) == 0);
+
+        return q.ret;
+}
+
 typedef struct TodoEntry {
         DIR *dir;         /* A directory that we were operating on. */
         char *dirname;    /* The filename of that directory itself. */
@@ -215,6 +517,9 @@ int rm_rf_children(
         /* Return the first error we run into, but nevertheless try to go on.
          * The passed fd is closed in all cases, including on failure. */
 
+        if (FLAGS_SET(flags, REMOVE_PARALLEL))
+                return rm_rf_children_parallel(fd, flags, root_dev);
+
         for (;;) {  /* This loop corresponds to the directory nesting level. */
                 _cleanup_closedir_ DIR *d = NULL;
 
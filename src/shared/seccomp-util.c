@@ -2,6 +2,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/filter.h>
 #include <linux/seccomp.h>
 #include <stddef.h>
 #include <sys/mman.h>
@@ -17,12 +18,16 @@
 #include "alloc-util.h"
 #include "env-util.h"
 #include "errno-list.h"
+#include "fd-util.h"
+#include "hexdecoct.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "nsflags.h"
 #include "nulstr-util.h"
 #include "process-util.h"
 #include "seccomp-util.h"
 #include "set.h"
+#include "sort-util.h"
 #include "string-util.h"
 #include "strv.h"
 
@@ -1090,6 +1095,46 @@ int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilter
         return 0;
 }
 
+static int add_syscall_filter_raw(scmp_filter_ctx seccomp, Hashmap *filter, uint32_t action, bool log_missing) {
+        void *syscall_id, *val;
+        int r;
+
+        assert(seccomp);
+
+        HASHMAP_FOREACH_KEY(val, syscall_id, filter) {
+                uint32_t a = action;
+                int id = PTR_TO_INT(syscall_id) - 1;
+                int error = PTR_TO_INT(val);
+
+                if (error == SECCOMP_ERROR_NUMBER_KILL)
+                        a = scmp_act_kill_process();
+#ifdef SCMP_ACT_LOG
+                else if (action == SCMP_ACT_LOG)
+                        a = SCMP_ACT_LOG;
+#endif
+                else if (error >= 0)
+                        a = SCMP_ACT_ERRNO(error);
+
+                r = seccomp_rule_add_exact(seccomp, a, id, 0);
+                if (r < 0) {
+                        /* If the system call is not known on this architecture, then that's
+                         * fine, let's ignore it */
+                        _cleanup_free_ char *n = NULL;
+                        bool ignore;
+
+                        n = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, id);
+                        ignore = r == -EDOM;
+                        if (!ignore || log_missing)
+                                log_debug_errno(r, "Failed to add rule for system call %s() / %d%s: %m",
+                                                strna(n), id, ignore ? ", ignoring" : "");
+                        if (!ignore)
+                                return r;
+                }
+        }
+
+        return 0;
+}
+
 int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* filter, uint32_t action, bool log_missing) {
         uint32_t arch;
         int r;
@@ -1102,7 +1147,6 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* filter
 
         SECCOMP_FOREACH_LOCAL_ARCH(arch) {
                 _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
-                void *syscall_id, *val;
 
                 log_debug("Operating on architecture: %s", seccomp_arch_to_string(arch));
 
@@ -1110,36 +1154,9 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* filter
                 if (r < 0)
                         return r;
 
-                HASHMAP_FOREACH_KEY(val, syscall_id, filter) {
-                        uint32_t a = action;
-                        int id = PTR_TO_INT(syscall_id) - 1;
-                        int error = PTR_TO_INT(val);
-
-                        if (error == SECCOMP_ERROR_NUMBER_KILL)
-                                a = scmp_act_kill_process();
-#ifdef SCMP_ACT_LOG
-                        else if (action == SCMP_ACT_LOG)
-                                a = SCMP_ACT_LOG;
-#endif
-                        else if (error >= 0)
-                                a = SCMP_ACT_ERRNO(error);
-
-                        r = seccomp_rule_add_exact(seccomp, a, id, 0);
-                        if (r < 0) {
-                                /* If the system call is not known on this architecture, then that's
-                                 * fine, let's ignore it */
-                                _cleanup_free_ char *n = NULL;
-                                bool ignore;
-
-                                n = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, id);
-                                ignore = r == -EDOM;
-                                if (!ignore || log_missing)
-                                        log_debug_errno(r, "Failed to add rule for system call %s() / %d%s: %m",
-                                                        strna(n), id, ignore ? ", ignoring" : "");
-                                if (!ignore)
-                                        return r;
-                        }
-                }
+                r = add_syscall_filter_raw(seccomp, filter, action, log_missing);
+                if (r < 0)
+                        return r;
 
                 r = seccomp_load(seccomp);
                 if (ERRNO_IS_SECCOMP_FATAL(r))
@@ -1152,6 +1169,217 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* filter
         return 0;
 }
 
+typedef struct SeccompProgram {
+        uint32_t arch;
+        struct sock_filter *instructions;
+        unsigned short n_instructions;
+} SeccompProgram;
+
+struct SeccompCompiledFilter {
+        SeccompProgram *programs;
+        size_t n_programs;
+};
+
+SeccompCompiledFilter* seccomp_compiled_filter_free(SeccompCompiledFilter *f) {
+        if (!f)
+                return NULL;
+
+        for (size_t i = 0; i < f->n_programs; i++)
+                free(f->programs[i].instructions);
+
+        free(f->programs);
+        return mfree(f);
+}
+
+DEFINE_HASH_OPS_FULL(seccomp_compiled_filter_hash_ops, char, string_hash_func, string_compare_func, free,
+                     SeccompCompiledFilter, seccomp_compiled_filter_free);
+
+static int export_program(scmp_filter_ctx seccomp, uint32_t arch, SeccompProgram *ret) {
+        _cleanup_free_ struct sock_filter *instructions = NULL;
+        _cleanup_close_ int fd = -1;
+        off_t size;
+        ssize_t n;
+        int r;
+
+        assert(seccomp);
+        assert(ret);
+
+        fd = memfd_new("seccomp-filter");
+        if (fd < 0)
+                return fd;
+
+        r = seccomp_export_bpf(seccomp, fd);
+        if (r < 0)
+                return r;
+
+        size = lseek(fd, 0, SEEK_END);
+        if (size < 0)
+                return -errno;
+        if (size == 0 ||
+            size % sizeof(struct sock_filter) != 0 ||
+            size / sizeof(struct sock_filter) > BPF_MAXINSNS)
+                return -EBADMSG;
+
+        instructions = malloc(size);
+        if (!instructions)
+                return -ENOMEM;
+
+        n = pread(fd, instructions, size, 0);
+        if (n < 0)
+                return -errno;
+        if (n != size)
+                return -EIO;
+
+        *ret = (SeccompProgram) {
+                .arch = arch,
+                .instructions = TAKE_PTR(instructions),
+                .n_instructions = size / sizeof(struct sock_filter),
+        };
+
+        return 0;
+}
+
+int seccomp_compile_syscall_filter_set_raw(
+                uint32_t default_action,
+                Hashmap *filter,
+                uint32_t action,
+                SeccompCompiledFilter **ret) {
+
+        _cleanup_(seccomp_compiled_filter_freep) SeccompCompiledFilter *f = NULL;
+        uint32_t arch;
+        int r;
+
+        assert(ret);
+
+        /* Like seccomp_load_syscall_filter_set_raw(), but only compiles the filter to BPF, for each local
+         * arch, so that it can be loaded with seccomp_load_compiled_filter() later on, possibly many times
+         * and in a different process. */
+
+        /* Logging of seccomp events is requested when loading a filter, keep things simple and don't
+         * support it here. */
+        if (getenv_bool("SYSTEMD_LOG_SECCOMP") > 0)
+                return -EOPNOTSUPP;
+
+        f = new0(SeccompCompiledFilter, 1);
+        if (!f)
+                return -ENOMEM;
+
+        if (hashmap_isempty(filter) && default_action == SCMP_ACT_ALLOW) {
+                *ret = TAKE_PTR(f);
+                return 0;
+        }
+
+        SECCOMP_FOREACH_LOCAL_ARCH(arch) {
+                _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
+
+                r = seccomp_init_for_arch(&seccomp, arch, default_action);
+                if (r < 0)
+                        return r;
+
+                r = add_syscall_filter_raw(seccomp, filter, action, false);
+                if (r < 0)
+                        return r;
+
+                if (!GREEDY_REALLOC(f->programs, f->n_programs + 1))
+                        return -ENOMEM;
+
+                r = export_program(seccomp, arch, f->programs + f->n_programs);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to export system call filter for architecture %s: %m",
+                                               seccomp_arch_to_string(arch));
+
+                f->n_programs++;
+        }
+
+        *ret = TAKE_PTR(f);
+        return 0;
+}
+
+int seccomp_load_compiled_filter(const SeccompCompiledFilter *f) {
+        uint32_t arch;
+
+        assert(f);
+
+        /* seccomp_restrict_archs() might have removed architectures from the list of local ones since the
+         * filter was compiled, hence only load the programs for the ones still listed. */
+
+        SECCOMP_FOREACH_LOCAL_ARCH(arch)
+                for (size_t i = 0; i < f->n_programs; i++) {
+                        const SeccompProgram *p = f->programs + i;
+                        struct sock_fprog prog;
+
+                        if (p->arch != arch)
+                                continue;
+
+                        prog = (struct sock_fprog) {
+                                .len = p->n_instructions,
+                                .filter = p->instructions,
+                        };
+
+                        if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog, 0, 0) < 0) {
+                                if (ERRNO_IS_SECCOMP_FATAL(errno))
+                                        return -errno;
+
+                                log_debug_errno(errno, "Failed to install system call filter for architecture %s, skipping: %m",
+                                                seccomp_arch_to_string(arch));
+                        }
+                }
+
+        return 0;
+}
+
+typedef struct SyscallRule {
+        uint32_t id;
+        uint32_t error;
+} SyscallRule;
+
+static int syscall_rule_compare(const SyscallRule *a, const SyscallRule *b) {
+        int r;
+
+        r = CMP(a->id, b->id);
+        if (r != 0)
+                return r;
+
+        return CMP(a->error, b->error);
+}
+
+int seccomp_syscall_filter_key(uint32_t default_action, Hashmap *filter, uint32_t action, char **ret) {
+        _cleanup_free_ SyscallRule *rules = NULL;
+        void *syscall_id, *val;
+        size_t n = 0;
+        char *k;
+
+        assert(ret);
+
+        /* Generates a string that identifies the filter by its contents, independently of the order of the
+         * hashmap, so that identical filters can share the compiled program. */
+
+        /* The first entry carries the actions, the rest the system calls and their error numbers */
+        rules = new(SyscallRule, hashmap_size(filter) + 1);
+        if (!rules)
+                return -ENOMEM;
+
+        rules[n++] = (SyscallRule) {
+                .id = default_action,
+                .error = action,
+        };
+
+        HASHMAP_FOREACH_KEY(val, syscall_id, filter)
+                rules[n++] = (SyscallRule) {
+                        .id = PTR_TO_INT(syscall_id),
+                        .error = PTR_TO_INT(val),
+                };
+
+        typesafe_qsort(rules + 1, n - 1, syscall_rule_compare);
+
+        k = hexmem(rules, n * sizeof(rules[0]));
+        if (!k)
+                return -ENOMEM;
+
+        *ret = k;
+        return 0;
+}
+
 int seccomp_parse_syscall_filter(
                 const char *name,
                 int errno_num,
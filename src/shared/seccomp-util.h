@@ -76,6 +76,17 @@ int seccomp_add_syscall_filter_item(
 int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilterSet *set, uint32_t action, bool log_missing);
 int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, uint32_t action, bool log_missing);
 
+/* A system call filter compiled to BPF for each local architecture, ready to be loaded */
+typedef struct SeccompCompiledFilter SeccompCompiledFilter;
+
+SeccompCompiledFilter* seccomp_compiled_filter_free(SeccompCompiledFilter *f);
+DEFINE_TRIVIAL_CLEANUP_FUNC(SeccompCompiledFilter*, seccomp_compiled_filter_free);
+extern const struct hash_ops seccomp_compiled_filter_hash_ops;
+
+int seccomp_compile_syscall_filter_set_raw(uint32_t default_action, Hashmap *filter, uint32_t action, SeccompCompiledFilter **ret);
+int seccomp_load_compiled_filter(const SeccompCompiledFilter *f);
+int seccomp_syscall_filter_key(uint32_t default_action, Hashmap *filter, uint32_t action, char **ret);
+
 typedef enum SeccompParseFlags {
         SECCOMP_PARSE_INVERT     = 1 << 0,
         SECCOMP_PARSE_ALLOW_LIST = 1 << 1,
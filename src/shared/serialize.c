@@ -4,6 +4,7 @@
 
 #include "alloc-util.h"
 #include "env-util.h"
+#include "errno-util.h"
 #include "escape.h"
 #include "fileio.h"
 #include "missing_mman.h"
@@ -194,6 +195,46 @@ int deserialize_environment(const char *value, char ***list) {
         return 0;
 }
 
+int deserialize_read_line(FILE *f, char **ret) {
+        _cleanup_free_ char *line = NULL;
+        size_t allocated = 0, k;
+        ssize_t n;
+        int r;
+
+        assert(f);
+        assert(ret);
+
+        /* Like read_line(f, LONG_LINE_MAX, ret), but only considers \n a line delimiter, as that's the only
+         * one serialize_item() ever writes. This allows us to use getline(), which looks for the delimiter
+         * in the stdio buffer with memchr(), instead of reading byte by byte. On big serializations that
+         * makes a difference. */
+
+        errno = 0;
+        n = getline(&line, &allocated, f);
+        if (n < 0) {
+                if (ferror(f))
+                        return errno_or_else(EIO);
+
+                /* EOF, return an empty line, like read_line() does */
+                r = free_and_strdup(&line, "");
+                if (r < 0)
+                        return r;
+
+                *ret = TAKE_PTR(line);
+                return 0;
+        }
+
+        k = n;
+        if (k > 0 && line[k-1] == '\n')
+                line[--k] = 0;
+
+        if (k > LONG_LINE_MAX || n > INT_MAX)
+                return -ENOBUFS;
+
+        *ret = TAKE_PTR(line);
+        return (int) n;
+}
+
 int open_serialization_fd(const char *ident) {
         int fd;
 
@@ -46,6 +46,21 @@ int specifier_printf(const char *text, size_t max_length, const Specifier table[
         assert(table);
 
         l = strlen(text);
+
+        /* Most strings we get here (e.g. when loading unit files) contain no specifiers at all, hence let's
+         * not bother with the table then. */
+        if (!memchr(text, '%', l)) {
+                if (l > max_length)
+                        return -ENAMETOOLONG;
+
+                result = memdup(text, l + 1);
+                if (!result)
+                        return -ENOMEM;
+
+                *ret = TAKE_PTR(result);
+                return 0;
+        }
+
         if (!GREEDY_REALLOC(result, l + 1))
                 return -ENOMEM;
         t = result;
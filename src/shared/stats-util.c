@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <unistd.h>
+
+#include "stats-util.h"
+#include "util.h"
+
+void stats_histogram_add(StatsHistogram *h, usec_t t) {
+        unsigned i;
+        usec_t m;
+
+        assert(h);
+
+        i = t > 0 ? log2u64(t) : 0;
+        __sync_fetch_and_add(&h->buckets[MIN(i, STATS_HISTOGRAM_BUCKETS - 1)], 1);
+
+        __sync_fetch_and_add(&h->n, 1);
+        __sync_fetch_and_add(&h->total, t);
+
+        m = h->max;
+        while (t > m && !__sync_bool_compare_and_swap(&h->max, m, t))
+                m = h->max;
+}
+
+static int stats_histogram_build_json(const StatsHistogram *h, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *buckets = NULL;
+        size_t n = STATS_HISTOGRAM_BUCKETS;
+        int r;
+
+        assert(h);
+        assert(ret);
+
+        /* Skip the empty buckets at the end, the number of buckets may grow later anyway */
+        while (n > 0 && h->buckets[n - 1] == 0)
+                n--;
+
+        r = json_variant_new_array(&buckets, NULL, 0);
+        if (r < 0)
+                return r;
+
+        for (size_t i = 0; i < n; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *b = NULL;
+
+                r = json_variant_new_unsigned(&b, h->buckets[i]);
+                if (r < 0)
+                        return r;
+
+                r = json_variant_append_array(&buckets, b);
+                if (r < 0)
+                        return r;
+        }
+
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                          JSON_BUILD_PAIR_UNSIGNED("count", h->n),
+                                          JSON_BUILD_PAIR_UNSIGNED("totalUSec", h->total),
+                                          JSON_BUILD_PAIR_UNSIGNED("maxUSec", h->max),
+                                          JSON_BUILD_PAIR_VARIANT("buckets", buckets)));
+}
+
+int stats_build_json_internal(const StatsEntry *start, const StatsEntry *stop, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *counters = NULL, *histograms = NULL;
+        int r;
+
+        assert(ret);
+
+        r = json_variant_new_object(&counters, NULL, 0);
+        if (r < 0)
+                return r;
+
+        r = json_variant_new_object(&histograms, NULL, 0);
+        if (r < 0)
+                return r;
+
+        if (start)
+                for (const StatsEntry *e = ALIGN_PTR(start); e < stop; e = ALIGN_PTR(e + 1))
+                        switch (e->type) {
+
+                        case STATS_COUNTER:
+                                r = json_variant_set_field_unsigned(&counters, e->name, ((const StatsCounter*) e->data)->value);
+                                if (r < 0)
+                                        return r;
+                                break;
+
+                        case STATS_HISTOGRAM: {
+                                _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+                                r = stats_histogram_build_json(e->data, &v);
+                                if (r < 0)
+                                        return r;
+
+                                r = json_variant_set_field(&histograms, e->name, v);
+                                if (r < 0)
+                                        return r;
+                                break;
+                        }
+
+                        default:
+                                assert_not_reached();
+                        }
+
+        return json_build(ret, JSON_BUILD_OBJECT(
+                                          JSON_BUILD_PAIR_VARIANT("counters", counters),
+                                          JSON_BUILD_PAIR_VARIANT("histograms", histograms)));
+}
+
+int stats_varlink_reply_internal(Varlink *link, JsonVariant *parameters, const StatsEntry *start, const StatsEntry *stop) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        uid_t uid;
+        int r;
+
+        assert(link);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        /* Some of the sockets are accessible to everybody, but the counters reveal what the daemon is doing,
+         * hence only hand them out to privileged clients and our own user. */
+        r = varlink_get_peer_uid(link, &uid);
+        if (r < 0)
+                return r;
+        if (uid != 0 && uid != getuid())
+                return varlink_error_errno(link, -EPERM);
+
+        r = stats_build_json_internal(start, stop, &v);
+        if (r < 0)
+                return r;
+
+        return varlink_reply(link, v);
+}
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <inttypes.h>
+
+#include "json.h"
+#include "macro.h"
+#include "time-util.h"
+#include "varlink.h"
+
+/* A framework for cheap, always-on counters and latency histograms in daemons. Counters are static variables
+ * that are registered in a special section, like STATIC_DESTRUCTOR_REGISTER() does it, hence they need no
+ * setup, and any code that wants to be instrumented simply defines its own. Updates are single lock-free
+ * atomic operations, so that the counters may also be bumped from threads. Daemons hand out all counters
+ * of their binary via the io.systemd.Statistics.Get() varlink method, see stats_varlink_reply() below, and
+ * "systemd-analyze stats" shows them. Like static destructors, this does not cover counters in .so's, as
+ * the section is private to the linking unit. */
+
+/* Bucket i counts durations in [2^i, 2^(i+1)) µs, the first one also counts everything shorter, the last
+ * one everything longer, i.e. everything from ~8s on */
+#define STATS_HISTOGRAM_BUCKETS 24U
+
+typedef enum StatsType {
+        STATS_COUNTER,
+        STATS_HISTOGRAM,
+        _STATS_TYPE_MAX,
+        _STATS_TYPE_INVALID = -EINVAL,
+} StatsType;
+
+typedef struct StatsCounter {
+        uint64_t value;
+} StatsCounter;
+
+typedef struct StatsHistogram {
+        uint64_t n;
+        usec_t total;
+        usec_t max;
+        uint64_t buckets[STATS_HISTOGRAM_BUCKETS];
+} StatsHistogram;
+
+typedef struct StatsEntry {
+        const char *name;
+        StatsType type;
+        void *data;
+} StatsEntry;
+
+/* Defines a static counter or histogram "variable", exported under "name", e.g. "manager.jobs_installed" */
+#define DEFINE_STATS_COUNTER(variable, name)                            \
+        static StatsCounter variable;                                   \
+        _STATS_REGISTER(UNIQ, variable, name, STATS_COUNTER)
+
+#define DEFINE_STATS_HISTOGRAM(variable, name)                          \
+        static StatsHistogram variable;                                 \
+        _STATS_REGISTER(UNIQ, variable, name, STATS_HISTOGRAM)
+
+#define _STATS_REGISTER(uq, variable, n, t)                             \
+        /* Older compilers don't know "retain" attribute. */            \
+        _Pragma("GCC diagnostic ignored \"-Wattributes\"")              \
+        _section_("SYSTEMD_STATS")                                      \
+        _alignptr_                                                      \
+        _used_                                                          \
+        _retain_                                                        \
+        _variable_no_sanitize_address_                                  \
+        static const StatsEntry UNIQ_T(stats_entry, uq) = {             \
+                .name = (n),                                            \
+                .type = (t),                                            \
+                .data = &(variable),                                    \
+        }
+
+extern const StatsEntry _weak_ __start_SYSTEMD_STATS[];
+extern const StatsEntry _weak_ __stop_SYSTEMD_STATS[];
+
+static inline void stats_counter_add(StatsCounter *c, uint64_t n) {
+        __sync_fetch_and_add(&c->value, n);
+}
+
+static inline void stats_counter_inc(StatsCounter *c) {
+        stats_counter_add(c, 1);
+}
+
+void stats_histogram_add(StatsHistogram *h, usec_t t);
+
+/* Adds the time passed since "begin", which was taken from CLOCK_MONOTONIC */
+static inline void stats_histogram_add_since(StatsHistogram *h, usec_t begin) {
+        stats_histogram_add(h, usec_sub_unsigned(now(CLOCK_MONOTONIC), begin));
+}
+
+int stats_build_json_internal(const StatsEntry *start, const StatsEntry *stop, JsonVariant **ret);
+int stats_varlink_reply_internal(Varlink *link, JsonVariant *parameters, const StatsEntry *start, const StatsEntry *stop);
+
+/* These must be static inline, so that they enumerate the section of the linking unit they are called from */
+static inline int stats_build_json(JsonVariant **ret) {
+        return stats_build_json_internal(__start_SYSTEMD_STATS, __stop_SYSTEMD_STATS, ret);
+}
+
+/* Implements the io.systemd.Statistics.Get() varlink method */
+static inline int stats_varlink_reply(Varlink *link, JsonVariant *parameters) {
+        return stats_varlink_reply_internal(link, parameters, __start_SYSTEMD_STATS, __stop_SYSTEMD_STATS);
+}
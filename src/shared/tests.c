@@ -2,6 +2,7 @@
 
 #include <sched.h>
 #include <signal.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/mount.h>
@@ -26,7 +27,9 @@
 #include "env-file.h"
 #include "env-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
+#include "json.h"
 #include "log.h"
 #include "namespace-util.h"
 #include "path-util.h"
@@ -137,6 +140,56 @@ int log_tests_skipped_errno(int r, const char *message) {
         return EXIT_TEST_SKIP;
 }
 
+void benchmark_report(uint64_t value, const char *unit, const char *format, ...) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_free_ char *name = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *p;
+        va_list ap;
+        int r;
+
+        assert(unit);
+        assert(format);
+
+        va_start(ap, format);
+        r = vasprintf(&name, format, ap);
+        va_end(ap);
+        if (r < 0) {
+                log_oom_debug();
+                return;
+        }
+
+        log_debug("%s: %" PRIu64 " %s", name, value, unit);
+
+        /* If requested, append the result as a JSON line to the given file, so that results can be collected
+         * from a whole "meson test --suite benchmark" run and compared between builds by a script. */
+        p = getenv("SYSTEMD_BENCHMARK_RESULTS");
+        if (!p)
+                return;
+
+        r = json_build(&v, JSON_BUILD_OBJECT(
+                                       JSON_BUILD_PAIR_STRING("benchmark", program_invocation_short_name),
+                                       JSON_BUILD_PAIR_STRING("name", name),
+                                       JSON_BUILD_PAIR_UNSIGNED("value", value),
+                                       JSON_BUILD_PAIR_STRING("unit", unit)));
+        if (r < 0) {
+                log_warning_errno(r, "Failed to build benchmark result, ignoring: %m");
+                return;
+        }
+
+        f = fopen(p, "ae");
+        if (!f) {
+                log_warning_errno(errno, "Failed to open %s, ignoring: %m", p);
+                return;
+        }
+
+        json_variant_dump(v, JSON_FORMAT_NEWLINE, f, NULL);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                log_warning_errno(r, "Failed to write benchmark result to %s, ignoring: %m", p);
+}
+
 int write_tmpfile(char *pattern, const char *contents) {
         _cleanup_close_ int fd = -1;
 
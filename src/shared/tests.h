@@ -30,6 +30,10 @@ void test_setup_logging(int level);
 int log_tests_skipped(const char *message);
 int log_tests_skipped_errno(int r, const char *message);
 
+/* Records a benchmark result under the given name (a format string). If $SYSTEMD_BENCHMARK_RESULTS is set,
+ * the result is appended to that file as a JSON line. */
+void benchmark_report(uint64_t value, const char *unit, const char *format, ...) _printf_(3, 4);
+
 int write_tmpfile(char *pattern, const char *contents);
 
 bool have_namespaces(void);
@@ -12,18 +12,25 @@
 #include "dirent-util.h"
 #include "dlfcn-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-table.h"
 #include "fs-util.h"
 #include "hexdecoct.h"
+#include "io-util.h"
+#include "lockfile-util.h"
 #include "memory-util.h"
+#include "mkdir.h"
 #include "random-util.h"
 #include "sha256.h"
 #include "time-util.h"
+#include "tmpfile-util.h"
 
 static void *libtss2_esys_dl = NULL;
 static void *libtss2_rc_dl = NULL;
 static void *libtss2_mu_dl = NULL;
 
+TSS2_RC (*sym_Esys_ContextLoad)(ESYS_CONTEXT *esysContext, TPMS_CONTEXT const *context, ESYS_TR *loadedHandle) = NULL;
+TSS2_RC (*sym_Esys_ContextSave)(ESYS_CONTEXT *esysContext, ESYS_TR saveHandle, TPMS_CONTEXT **context) = NULL;
 TSS2_RC (*sym_Esys_Create)(ESYS_CONTEXT *esysContext, ESYS_TR parentHandle, ESYS_TR shandle1, ESYS_TR shandle2, ESYS_TR shandle3, const TPM2B_SENSITIVE_CREATE *inSensitive, const TPM2B_PUBLIC *inPublic, const TPM2B_DATA *outsideInfo, const TPML_PCR_SELECTION *creationPCR, TPM2B_PRIVATE **outPrivate, TPM2B_PUBLIC **outPublic, TPM2B_CREATION_DATA **creationData, TPM2B_DIGEST **creationHash, TPMT_TK_CREATION **creationTicket) = NULL;
 TSS2_RC (*sym_Esys_CreatePrimary)(ESYS_CONTEXT *esysContext, ESYS_TR primaryHandle, ESYS_TR shandle1, ESYS_TR shandle2, ESYS_TR shandle3, const TPM2B_SENSITIVE_CREATE *inSensitive, const TPM2B_PUBLIC *inPublic, const TPM2B_DATA *outsideInfo, const TPML_PCR_SELECTION *creationPCR, ESYS_TR *objectHandle, TPM2B_PUBLIC **outPublic, TPM2B_CREATION_DATA **creationData, TPM2B_DIGEST **creationHash, TPMT_TK_CREATION **creationTicket) = NULL;
 void (*sym_Esys_Finalize)(ESYS_CONTEXT **context) = NULL;
@@ -37,6 +44,7 @@ TSS2_RC (*sym_Esys_PCR_Read)(ESYS_CONTEXT *esysContext, ESYS_TR shandle1,ESYS_TR
 TSS2_RC (*sym_Esys_PolicyAuthValue)(ESYS_CONTEXT *esysContext, ESYS_TR policySession, ESYS_TR shandle1, ESYS_TR shandle2, ESYS_TR shandle3) = NULL;
 TSS2_RC (*sym_Esys_PolicyGetDigest)(ESYS_CONTEXT *esysContext, ESYS_TR policySession, ESYS_TR shandle1, ESYS_TR shandle2, ESYS_TR shandle3, TPM2B_DIGEST **policyDigest) = NULL;
 TSS2_RC (*sym_Esys_PolicyPCR)(ESYS_CONTEXT *esysContext, ESYS_TR policySession, ESYS_TR shandle1, ESYS_TR shandle2, ESYS_TR shandle3, const TPM2B_DIGEST *pcrDigest, const TPML_PCR_SELECTION *pcrs) = NULL;
+TSS2_RC (*sym_Esys_ReadPublic)(ESYS_CONTEXT *esysContext, ESYS_TR objectHandle, ESYS_TR shandle1, ESYS_TR shandle2, ESYS_TR shandle3, TPM2B_PUBLIC **outPublic, TPM2B_NAME **name, TPM2B_NAME **qualifiedName) = NULL;
 TSS2_RC (*sym_Esys_StartAuthSession)(ESYS_CONTEXT *esysContext, ESYS_TR tpmKey, ESYS_TR bind, ESYS_TR shandle1, ESYS_TR shandle2, ESYS_TR shandle3, const TPM2B_NONCE *nonceCaller, TPM2_SE sessionType, const TPMT_SYM_DEF *symmetric, TPMI_ALG_HASH authHash, ESYS_TR *sessionHandle) = NULL;
 TSS2_RC (*sym_Esys_Startup)(ESYS_CONTEXT *esysContext, TPM2_SU startupType) = NULL;
 TSS2_RC (*sym_Esys_TRSess_SetAttributes)(ESYS_CONTEXT *esysContext, ESYS_TR session, TPMA_SESSION flags, TPMA_SESSION mask);
@@ -49,12 +57,16 @@ TSS2_RC (*sym_Tss2_MU_TPM2B_PRIVATE_Marshal)(TPM2B_PRIVATE const *src, uint8_t b
 TSS2_RC (*sym_Tss2_MU_TPM2B_PRIVATE_Unmarshal)(uint8_t const buffer[], size_t buffer_size, size_t *offset, TPM2B_PRIVATE  *dest) = NULL;
 TSS2_RC (*sym_Tss2_MU_TPM2B_PUBLIC_Marshal)(TPM2B_PUBLIC const *src, uint8_t buffer[], size_t buffer_size, size_t *offset) = NULL;
 TSS2_RC (*sym_Tss2_MU_TPM2B_PUBLIC_Unmarshal)(uint8_t const buffer[], size_t buffer_size, size_t *offset, TPM2B_PUBLIC *dest) = NULL;
+TSS2_RC (*sym_Tss2_MU_TPMS_CONTEXT_Marshal)(TPMS_CONTEXT const *src, uint8_t buffer[], size_t buffer_size, size_t *offset) = NULL;
+TSS2_RC (*sym_Tss2_MU_TPMS_CONTEXT_Unmarshal)(uint8_t const buffer[], size_t buffer_size, size_t *offset, TPMS_CONTEXT *dest) = NULL;
 
 int dlopen_tpm2(void) {
         int r;
 
         r = dlopen_many_sym_or_warn(
                         &libtss2_esys_dl, "libtss2-esys.so.0", LOG_DEBUG,
+                        DLSYM_ARG(Esys_ContextLoad),
+                        DLSYM_ARG(Esys_ContextSave),
                         DLSYM_ARG(Esys_Create),
                         DLSYM_ARG(Esys_CreatePrimary),
                         DLSYM_ARG(Esys_Finalize),
@@ -68,6 +80,7 @@ int dlopen_tpm2(void) {
                         DLSYM_ARG(Esys_PolicyAuthValue),
                         DLSYM_ARG(Esys_PolicyGetDigest),
                         DLSYM_ARG(Esys_PolicyPCR),
+                        DLSYM_ARG(Esys_ReadPublic),
                         DLSYM_ARG(Esys_StartAuthSession),
                         DLSYM_ARG(Esys_Startup),
                         DLSYM_ARG(Esys_TRSess_SetAttributes),
@@ -87,7 +100,9 @@ int dlopen_tpm2(void) {
                         DLSYM_ARG(Tss2_MU_TPM2B_PRIVATE_Marshal),
                         DLSYM_ARG(Tss2_MU_TPM2B_PRIVATE_Unmarshal),
                         DLSYM_ARG(Tss2_MU_TPM2B_PUBLIC_Marshal),
-                        DLSYM_ARG(Tss2_MU_TPM2B_PUBLIC_Unmarshal));
+                        DLSYM_ARG(Tss2_MU_TPM2B_PUBLIC_Unmarshal),
+                        DLSYM_ARG(Tss2_MU_TPMS_CONTEXT_Marshal),
+                        DLSYM_ARG(Tss2_MU_TPMS_CONTEXT_Unmarshal));
 }
 
 struct tpm2_context {
@@ -267,6 +282,11 @@ static int tpm2_credit_random(ESYS_CONTEXT *c) {
         return 0;
 }
 
+#define PRIMARY_OBJECT_ATTRIBUTES                                       \
+        (TPMA_OBJECT_RESTRICTED|TPMA_OBJECT_DECRYPT|TPMA_OBJECT_FIXEDTPM|      \
+         TPMA_OBJECT_FIXEDPARENT|TPMA_OBJECT_SENSITIVEDATAORIGIN|              \
+         TPMA_OBJECT_USERWITHAUTH)
+
 static int tpm2_make_primary(
                 ESYS_CONTEXT *c,
                 ESYS_TR *ret_primary,
@@ -279,7 +299,7 @@ static int tpm2_make_primary(
                 .publicArea = {
                         .type = TPM2_ALG_ECC,
                         .nameAlg = TPM2_ALG_SHA256,
-                        .objectAttributes = TPMA_OBJECT_RESTRICTED|TPMA_OBJECT_DECRYPT|TPMA_OBJECT_FIXEDTPM|TPMA_OBJECT_FIXEDPARENT|TPMA_OBJECT_SENSITIVEDATAORIGIN|TPMA_OBJECT_USERWITHAUTH,
+                        .objectAttributes = PRIMARY_OBJECT_ATTRIBUTES,
                         .parameters = {
                                 .eccDetail = {
                                         .symmetric = {
@@ -299,7 +319,7 @@ static int tpm2_make_primary(
                 .publicArea = {
                         .type = TPM2_ALG_RSA,
                         .nameAlg = TPM2_ALG_SHA256,
-                        .objectAttributes = TPMA_OBJECT_RESTRICTED|TPMA_OBJECT_DECRYPT|TPMA_OBJECT_FIXEDTPM|TPMA_OBJECT_FIXEDPARENT|TPMA_OBJECT_SENSITIVEDATAORIGIN|TPMA_OBJECT_USERWITHAUTH,
+                        .objectAttributes = PRIMARY_OBJECT_ATTRIBUTES,
                         .parameters = {
                                 .rsaDetail = {
                                         .symmetric = {
@@ -393,6 +413,143 @@ static int tpm2_make_primary(
         return 0;
 }
 
+/* Creating the primary key is by far the slowest part of unsealing, in particular with RSA, and at boot all
+ * systemd-cryptsetup instances do it at the same time, serialized by the TPM. Hence the first one to create
+ * it saves its context, which the TPM encrypts and integrity protects, so that it can only be loaded into the
+ * same TPM again, until the TPM is reset or the storage hierarchy cleared. */
+#define PRIMARY_CACHE_DIR "/run/systemd/tpm2"
+
+static const char *primary_cache_path(TPMI_ALG_PUBLIC alg) {
+        return alg == TPM2_ALG_ECC ? PRIMARY_CACHE_DIR "/primary-ecc.ctx" : PRIMARY_CACHE_DIR "/primary-rsa.ctx";
+}
+
+static int tpm2_load_cached_primary(ESYS_CONTEXT *c, TPMI_ALG_PUBLIC alg, ESYS_TR *ret_primary) {
+        _cleanup_(Esys_Freep) TPM2B_PUBLIC *public = NULL;
+        _cleanup_free_ char *data = NULL;
+        ESYS_TR primary = ESYS_TR_NONE;
+        TPMS_CONTEXT context = {};
+        size_t size, offset = 0;
+        TSS2_RC rc;
+        int r;
+
+        assert(c);
+        assert(IN_SET(alg, TPM2_ALG_ECC, TPM2_ALG_RSA));
+        assert(ret_primary);
+
+        r = read_full_file(primary_cache_path(alg), &data, &size);
+        if (r < 0)
+                return r;
+
+        rc = sym_Tss2_MU_TPMS_CONTEXT_Unmarshal((const uint8_t*) data, size, &offset, &context);
+        if (rc != TSS2_RC_SUCCESS)
+                return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                       "Failed to unmarshal cached primary key context: %s", sym_Tss2_RC_Decode(rc));
+
+        rc = sym_Esys_ContextLoad(c, &context, &primary);
+        if (rc != TSS2_RC_SUCCESS)
+                return log_debug_errno(SYNTHETIC_ERRNO(ESTALE),
+                                       "Failed to load cached primary key context: %s", sym_Tss2_RC_Decode(rc));
+
+        /* Only a storage key with the attributes we'd create the primary key with will do, in particular it
+         * must have been generated in the TPM, and can never have left it. */
+        rc = sym_Esys_ReadPublic(c, primary, ESYS_TR_NONE, ESYS_TR_NONE, ESYS_TR_NONE, &public, NULL, NULL);
+        if (rc != TSS2_RC_SUCCESS) {
+                r = log_debug_errno(SYNTHETIC_ERRNO(ENOTRECOVERABLE),
+                                    "Failed to read public part of cached primary key: %s", sym_Tss2_RC_Decode(rc));
+                goto fail;
+        }
+
+        if (public->publicArea.type != alg ||
+            public->publicArea.nameAlg != TPM2_ALG_SHA256 ||
+            public->publicArea.objectAttributes != PRIMARY_OBJECT_ATTRIBUTES) {
+                r = log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "Cached primary key does not match template, ignoring.");
+                goto fail;
+        }
+
+        log_debug("Loaded cached %s primary key.", tpm2_primary_alg_to_string(alg));
+
+        *ret_primary = primary;
+        return 0;
+
+fail:
+        flush_context_verbose(c, primary);
+        return r;
+}
+
+static int tpm2_save_cached_primary(ESYS_CONTEXT *c, ESYS_TR primary, TPMI_ALG_PUBLIC alg) {
+        _cleanup_(Esys_Freep) TPMS_CONTEXT *context = NULL;
+        _cleanup_(unlink_and_freep) char *tmp = NULL;
+        _cleanup_close_ int fd = -1;
+        uint8_t buf[sizeof(TPMS_CONTEXT)];
+        size_t size = 0;
+        const char *p;
+        TSS2_RC rc;
+        int r;
+
+        assert(c);
+        assert(IN_SET(alg, TPM2_ALG_ECC, TPM2_ALG_RSA));
+
+        rc = sym_Esys_ContextSave(c, primary, &context);
+        if (rc != TSS2_RC_SUCCESS)
+                return log_debug_errno(SYNTHETIC_ERRNO(ENOTRECOVERABLE),
+                                       "Failed to save primary key context: %s", sym_Tss2_RC_Decode(rc));
+
+        rc = sym_Tss2_MU_TPMS_CONTEXT_Marshal(context, buf, sizeof(buf), &size);
+        if (rc != TSS2_RC_SUCCESS)
+                return log_debug_errno(SYNTHETIC_ERRNO(ENOTRECOVERABLE),
+                                       "Failed to marshal primary key context: %s", sym_Tss2_RC_Decode(rc));
+
+        p = primary_cache_path(alg);
+
+        fd = open_tmpfile_linkable(p, O_WRONLY|O_CLOEXEC, &tmp);
+        if (fd < 0)
+                return log_debug_errno(fd, "Failed to create temporary file for %s: %m", p);
+
+        r = loop_write(fd, buf, size, false);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to write %s: %m", p);
+
+        /* We hold the lock, and only get here if the cached context didn't work, hence replace it */
+        (void) unlink(p);
+
+        r = link_tmpfile(fd, tmp, p);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to move %s into place: %m", p);
+
+        tmp = mfree(tmp);
+        return 0;
+}
+
+static int tpm2_make_primary_cached(ESYS_CONTEXT *c, ESYS_TR *ret_primary, TPMI_ALG_PUBLIC alg) {
+        _cleanup_(release_lock_file) LockFile lock = LOCK_FILE_INIT;
+        TPMI_ALG_PUBLIC created_alg;
+        int r;
+
+        assert(c);
+        assert(ret_primary);
+
+        /* If the algorithm isn't known (old metadata), tpm2_make_primary() picks ECC whenever the TPM
+         * supports it, hence only an ECC key may be taken from the cache then. */
+
+        r = mkdir_p(PRIMARY_CACHE_DIR, 0700);
+        if (r >= 0)
+                r = make_lock_file(PRIMARY_CACHE_DIR "/primary.lck", LOCK_EX, &lock);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to lock primary key cache, not using it: %m");
+                return tpm2_make_primary(c, ret_primary, alg, NULL);
+        }
+
+        if (tpm2_load_cached_primary(c, alg == 0 ? TPM2_ALG_ECC : alg, ret_primary) >= 0)
+                return 0;
+
+        r = tpm2_make_primary(c, ret_primary, alg, &created_alg);
+        if (r < 0)
+                return r;
+
+        (void) tpm2_save_cached_primary(c, *ret_primary, created_alg);
+        return 0;
+}
+
 static void tpm2_pcr_mask_to_selecion(uint32_t mask, uint16_t bank, TPML_PCR_SELECTION *ret) {
         assert(ret);
 
@@ -1093,7 +1250,7 @@ int tpm2_unseal(
         if (r < 0)
                 return r;
 
-        r = tpm2_make_primary(c.esys_context, &primary, primary_alg, NULL);
+        r = tpm2_make_primary_cached(c.esys_context, &primary, primary_alg);
         if (r < 0)
                 return r;
 
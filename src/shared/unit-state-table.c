@@ -0,0 +1,297 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fs-util.h"
+#include "memory-util.h"
+#include "string-util.h"
+#include "tmpfile-util.h"
+#include "unit-state-table.h"
+
+#define UNIT_STATE_TABLE_MAGIC "USTATE01"
+#define UNIT_STATE_TABLE_SLOTS_MIN 256U
+#define UNIT_STATE_TABLE_READ_TRIES 64U
+
+assert_cc(sizeof(UnitStateTableHeader) == 24);
+assert_cc(sizeof(UnitStateTableEntry) % 8 == 0);
+
+struct UnitStateTable {
+        int fd;
+        void *map;
+        size_t map_size;
+        size_t n_slots;
+        size_t n_used;                 /* slots below this index have been handed out at some point */
+        size_t *free_slots;
+        size_t n_free_slots;
+};
+
+static size_t unit_state_table_size(size_t n_slots) {
+        return sizeof(UnitStateTableHeader) + n_slots * sizeof(UnitStateTableEntry);
+}
+
+static UnitStateTableHeader* unit_state_table_header(UnitStateTable *t) {
+        return t->map;
+}
+
+static UnitStateTableEntry* unit_state_table_entry(UnitStateTable *t, size_t slot) {
+        return (UnitStateTableEntry*) ((uint8_t*) t->map + sizeof(UnitStateTableHeader)) + slot;
+}
+
+static void unit_state_table_write_begin(UnitStateTable *t) {
+        UnitStateTableHeader *h = unit_state_table_header(t);
+
+        __atomic_store_n(&h->seqnum, h->seqnum + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void unit_state_table_write_end(UnitStateTable *t) {
+        UnitStateTableHeader *h = unit_state_table_header(t);
+
+        __atomic_store_n(&h->seqnum, h->seqnum + 1, __ATOMIC_RELEASE);
+}
+
+static int unit_state_table_grow(UnitStateTable *t, size_t n_slots) {
+        size_t size;
+        void *p;
+
+        assert(t);
+
+        if (n_slots <= t->n_slots)
+                return 0;
+
+        size = PAGE_ALIGN(unit_state_table_size(n_slots));
+
+        if (ftruncate(t->fd, size) < 0)
+                return -errno;
+
+        if (t->map)
+                p = mremap(t->map, t->map_size, size, MREMAP_MAYMOVE);
+        else
+                p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, t->fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        t->map = p;
+        t->map_size = size;
+        t->n_slots = (size - sizeof(UnitStateTableHeader)) / sizeof(UnitStateTableEntry);
+
+        /* Readers only look at as many slots as they have mapped, so the new slots are only announced
+         * after the file was extended. */
+        unit_state_table_write_begin(t);
+        unit_state_table_header(t)->n_slots = t->n_slots;
+        unit_state_table_write_end(t);
+
+        return 0;
+}
+
+int unit_state_table_new(const char *path, UnitStateTable **ret) {
+        _cleanup_(unit_state_table_freep) UnitStateTable *t = NULL;
+        _cleanup_(unlink_and_freep) char *tmp = NULL;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        /* The table is created under a temporary name and then moved into place, so that readers never
+         * see a half-initialized one, nor a stale one from a previous instance of the service manager
+         * mixed with ours. */
+
+        r = tempfn_random(path, NULL, &tmp);
+        if (r < 0)
+                return r;
+
+        t = new(UnitStateTable, 1);
+        if (!t)
+                return -ENOMEM;
+
+        *t = (UnitStateTable) {
+                .fd = open(tmp, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC|O_NOFOLLOW, 0644),
+        };
+        if (t->fd < 0)
+                return -errno;
+
+        r = unit_state_table_grow(t, UNIT_STATE_TABLE_SLOTS_MIN);
+        if (r < 0)
+                return r;
+
+        memcpy(unit_state_table_header(t)->magic, UNIT_STATE_TABLE_MAGIC, sizeof(unit_state_table_header(t)->magic));
+
+        if (rename(tmp, path) < 0)
+                return -errno;
+
+        tmp = mfree(tmp);
+
+        *ret = TAKE_PTR(t);
+        return 0;
+}
+
+UnitStateTable* unit_state_table_free(UnitStateTable *t) {
+        if (!t)
+                return NULL;
+
+        if (t->map)
+                (void) munmap(t->map, t->map_size);
+
+        safe_close(t->fd);
+        free(t->free_slots);
+        return mfree(t);
+}
+
+int unit_state_table_update(
+                UnitStateTable *t,
+                size_t *slot,
+                const char *name,
+                UnitLoadState load_state,
+                UnitActiveState active_state,
+                const char *sub_state,
+                usec_t state_change_timestamp) {
+
+        UnitStateTableEntry *e;
+        int r;
+
+        assert(t);
+        assert(slot);
+        assert(name);
+
+        if (strlen(name) >= sizeof_field(UnitStateTableEntry, name))
+                return -ENAMETOOLONG;
+
+        if (*slot == SIZE_MAX) {
+                if (t->n_free_slots > 0)
+                        *slot = t->free_slots[--t->n_free_slots];
+                else {
+                        if (t->n_used >= t->n_slots) {
+                                r = unit_state_table_grow(t, t->n_slots * 2);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        *slot = t->n_used++;
+                }
+        }
+
+        assert(*slot < t->n_slots);
+        e = unit_state_table_entry(t, *slot);
+
+        unit_state_table_write_begin(t);
+        strncpy(e->name, name, sizeof(e->name));
+        strncpy(e->sub_state, strempty(sub_state), sizeof(e->sub_state) - 1);
+        e->load_state = load_state;
+        e->active_state = active_state;
+        e->state_change_timestamp = state_change_timestamp;
+        unit_state_table_write_end(t);
+
+        return 0;
+}
+
+void unit_state_table_remove(UnitStateTable *t, size_t *slot) {
+        assert(slot);
+
+        if (!t || *slot == SIZE_MAX)
+                return;
+
+        assert(*slot < t->n_slots);
+
+        unit_state_table_write_begin(t);
+        memzero(unit_state_table_entry(t, *slot), sizeof(UnitStateTableEntry));
+        unit_state_table_write_end(t);
+
+        /* If we cannot remember the slot for reuse, it is simply leaked. */
+        if (GREEDY_REALLOC(t->free_slots, t->n_free_slots + 1))
+                t->free_slots[t->n_free_slots++] = *slot;
+
+        *slot = SIZE_MAX;
+}
+
+int unit_state_table_lookup(const char *path, const char *name, UnitStateTableEntry *ret) {
+        _cleanup_close_ int fd = -1;
+        const UnitStateTableHeader *h;
+        const UnitStateTableEntry *entries;
+        size_t n_slots, size;
+        struct stat st;
+        void *map;
+        int r;
+
+        assert(path);
+        assert(name);
+        assert(ret);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (!S_ISREG(st.st_mode))
+                return -EBADMSG;
+        if ((uint64_t) st.st_size < unit_state_table_size(0) || (uint64_t) st.st_size > SIZE_MAX)
+                return -EBADMSG;
+
+        size = st.st_size;
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+
+        h = map;
+        entries = (const UnitStateTableEntry*) ((const uint8_t*) map + sizeof(UnitStateTableHeader));
+
+        if (memcmp(h->magic, UNIT_STATE_TABLE_MAGIC, sizeof(h->magic)) != 0) {
+                r = -EBADMSG;
+                goto finish;
+        }
+
+        for (unsigned try = 0;; try++) {
+                uint64_t seqnum;
+                bool found = false;
+
+                if (try >= UNIT_STATE_TABLE_READ_TRIES) {
+                        r = -EBUSY;
+                        goto finish;
+                }
+
+                seqnum = __atomic_load_n(&h->seqnum, __ATOMIC_ACQUIRE);
+                if (seqnum % 2 != 0)
+                        continue;
+
+                n_slots = MIN(h->n_slots, (size - sizeof(UnitStateTableHeader)) / sizeof(UnitStateTableEntry));
+
+                for (size_t i = 0; i < n_slots; i++)
+                        if (strneq(entries[i].name, name, sizeof(entries[i].name))) {
+                                memcpy(ret, entries + i, sizeof(UnitStateTableEntry));
+                                found = true;
+                                break;
+                        }
+
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if (__atomic_load_n(&h->seqnum, __ATOMIC_RELAXED) != seqnum)
+                        continue;
+
+                if (!found) {
+                        r = -ENOENT;
+                        goto finish;
+                }
+
+                break;
+        }
+
+        /* The entry was copied while the writer may have changed it, make sure it is terminated. */
+        ret->name[sizeof(ret->name) - 1] = 0;
+        ret->sub_state[sizeof(ret->sub_state) - 1] = 0;
+
+        if (ret->load_state >= _UNIT_LOAD_STATE_MAX || ret->active_state >= _UNIT_ACTIVE_STATE_MAX) {
+                r = -EBADMSG;
+                goto finish;
+        }
+
+        r = 0;
+
+finish:
+        (void) munmap(map, size);
+        return r;
+}
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <inttypes.h>
+
+#include "macro.h"
+#include "time-util.h"
+#include "unit-def.h"
+#include "unit-name.h"
+
+/* The system service manager publishes the states of its units in a memory mapped file, so that clients
+ * such as "systemctl is-active" can look them up without a round trip through D-Bus into PID 1. The table
+ * is protected by a sequence lock: the writer makes the sequence number odd while updating it, and readers
+ * retry if it was odd or changed while they copied an entry. Unit names are only published under their
+ * main ID, readers have to fall back to D-Bus for anything not found in the table. */
+
+#define UNIT_STATE_TABLE_PATH "/run/systemd/unit-states"
+
+typedef struct UnitStateTableHeader {
+        uint8_t magic[8];              /* "USTATE01" */
+        uint64_t seqnum;               /* odd while an update is in progress */
+        uint64_t n_slots;
+} UnitStateTableHeader;
+
+typedef struct UnitStateTableEntry {
+        char name[UNIT_NAME_MAX];      /* empty if the slot is unused */
+        char sub_state[32];
+        uint8_t load_state;
+        uint8_t active_state;
+        uint8_t reserved[6];
+        uint64_t state_change_timestamp; /* CLOCK_REALTIME */
+} UnitStateTableEntry;
+
+typedef struct UnitStateTable UnitStateTable;
+
+/* Writer side, used by PID 1 */
+int unit_state_table_new(const char *path, UnitStateTable **ret);
+UnitStateTable* unit_state_table_free(UnitStateTable *t);
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitStateTable*, unit_state_table_free);
+
+int unit_state_table_update(
+                UnitStateTable *t,
+                size_t *slot,
+                const char *name,
+                UnitLoadState load_state,
+                UnitActiveState active_state,
+                const char *sub_state,
+                usec_t state_change_timestamp);
+void unit_state_table_remove(UnitStateTable *t, size_t *slot);
+
+/* Reader side. Returns -ENOENT if the unit is not in the table. */
+int unit_state_table_lookup(const char *path, const char *name, UnitStateTableEntry *ret);
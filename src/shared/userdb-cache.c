@@ -0,0 +1,699 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "log.h"
+#include "memory-util.h"
+#include "random-util.h"
+#include "siphash24.h"
+#include "strv.h"
+#include "user-util.h"
+#include "userdb-cache.h"
+#include "userdb.h"
+
+/* Don't try to map a missing or invalid cache file again on every single lookup */
+#define USERDB_CACHE_RETRY_USEC (5 * USEC_PER_SEC)
+
+static const uint8_t userdb_cache_signature[8] = { 'U', 'S', 'R', 'D', 'B', 'C', 'H', '1' };
+
+enum {
+        INDEX_USER_NAME,
+        INDEX_USER_UID,
+        INDEX_GROUP_NAME,
+        INDEX_GROUP_GID,
+        _INDEX_MAX,
+};
+
+/* The file starts with the header, followed by _INDEX_MAX hash tables of n_buckets slots each, which use
+ * linear probing and contain the offsets of the entries (relative to the beginning of the file, 0 for an
+ * empty slot), followed by the entries. All of this is in native byte order, the file never leaves the
+ * machine. */
+typedef struct Header {
+        uint8_t signature[8];
+        uint64_t generation;    /* Odd while the file is being updated */
+        uint64_t timestamp;     /* CLOCK_MONOTONIC of the last time the contents were confirmed, 0 if never */
+        uint8_t hash_key[16];
+        uint32_t n_buckets;     /* Power of two, or 0 if nothing is cached */
+        uint32_t data_size;     /* Size of everything following the header */
+} Header;
+
+/* User entries contain the strings name, PASSWORD_SEE_SHADOW, real name, home directory and shell, exactly
+ * as nss-systemd would pack them into struct passwd. Group entries contain the group name followed by the
+ * members. The next entry follows on the next 4 byte boundary. */
+typedef struct Entry {
+        uint32_t id;            /* UID or GID */
+        uint32_t aux;           /* Primary GID of users, number of members of groups */
+        uint32_t size;          /* Size of the strings */
+        char strings[];
+} Entry;
+
+assert_cc(sizeof(Header) % sizeof(uint32_t) == 0);
+
+struct UserDBCacheBuilder {
+        uint8_t *data;          /* The entries, concatenated */
+        size_t size;
+
+        uint32_t *users;        /* Offsets of the user entries in data */
+        size_t n_users;
+        uint32_t *groups;       /* Offsets of the group entries in data */
+        size_t n_groups;
+};
+
+static uint64_t cache_hash(const uint8_t key[static 16], const char *name, uint32_t id) {
+        if (name)
+                return siphash24(name, strlen(name), key);
+
+        return siphash24(&id, sizeof(id), key);
+}
+
+static bool cache_entry_get(const uint8_t *p, size_t size, uint32_t offset, Entry *ret) {
+        Entry e;
+
+        assert(p);
+        assert(ret);
+
+        /* The cache may be modified while we look at it, hence copy the entry header once and validate it,
+         * so that whatever we find there, we never access anything outside of the mapping. */
+
+        if (offset < sizeof(Header) || offset % sizeof(uint32_t) != 0 || offset > size || size - offset < sizeof(Entry))
+                return false;
+
+        memcpy(&e, p + offset, sizeof(e));
+        if (e.size == 0 || e.size > size - offset - sizeof(Entry))
+                return false;
+
+        *ret = e;
+        return true;
+}
+
+static uint32_t cache_find(
+                const uint8_t *p,
+                size_t size,
+                const Header *h,
+                unsigned idx,
+                const char *name,
+                uint32_t id,
+                Entry *ret) {
+
+        const uint8_t *buckets;
+        size_t l = 0;
+        uint64_t hash;
+
+        assert(p);
+        assert(h);
+        assert(idx < _INDEX_MAX);
+        assert(ret);
+
+        /* The caller verified that the hash tables fit into the mapping */
+
+        if (h->n_buckets == 0)
+                return 0;
+
+        if (name)
+                l = strlen(name) + 1;
+
+        buckets = p + sizeof(Header) + (size_t) idx * h->n_buckets * sizeof(uint32_t);
+        hash = cache_hash(h->hash_key, name, id);
+
+        for (uint32_t i = 0; i < h->n_buckets; i++) {
+                uint32_t offset;
+                Entry e;
+
+                memcpy(&offset, buckets + ((hash + i) & (h->n_buckets - 1)) * sizeof(uint32_t), sizeof(offset));
+                if (offset == 0)
+                        break;
+
+                if (!cache_entry_get(p, size, offset, &e))
+                        break;
+
+                if (name ? e.size >= l && memcmp(p + offset + sizeof(Entry), name, l) == 0 : e.id == id) {
+                        *ret = e;
+                        return offset;
+                }
+        }
+
+        return 0;
+}
+
+int userdb_cache_builder_new(UserDBCacheBuilder **ret) {
+        UserDBCacheBuilder *b;
+
+        assert(ret);
+
+        b = new0(UserDBCacheBuilder, 1);
+        if (!b)
+                return -ENOMEM;
+
+        *ret = b;
+        return 0;
+}
+
+UserDBCacheBuilder* userdb_cache_builder_free(UserDBCacheBuilder *b) {
+        if (!b)
+                return NULL;
+
+        free(b->data);
+        free(b->users);
+        free(b->groups);
+        return mfree(b);
+}
+
+static int builder_add(
+                UserDBCacheBuilder *b,
+                uint32_t **offsets,
+                size_t *n_offsets,
+                uint32_t id,
+                uint32_t aux,
+                const char *name,
+                char **strings) {
+
+        size_t offset, l, end;
+        Entry *e;
+        char *p;
+
+        assert(b);
+        assert(offsets);
+        assert(n_offsets);
+        assert(name);
+
+        l = strlen(name) + 1;
+        STRV_FOREACH(s, strings)
+                l += strlen(*s) + 1;
+
+        offset = b->size;
+        end = ALIGN4(offset + sizeof(Entry) + l);
+        if (end > USERDB_CACHE_SIZE) /* Let's not bother with entries that can never make it into the file */
+                return -E2BIG;
+
+        if (!GREEDY_REALLOC(b->data, end))
+                return -ENOMEM;
+        if (!GREEDY_REALLOC(*offsets, *n_offsets + 1))
+                return -ENOMEM;
+
+        e = (Entry*) (b->data + offset);
+        *e = (Entry) {
+                .id = id,
+                .aux = aux,
+                .size = l,
+        };
+
+        p = stpcpy(e->strings, name) + 1;
+        STRV_FOREACH(s, strings)
+                p = stpcpy(p, *s) + 1;
+        memzero(p, b->data + end - (uint8_t*) p);
+
+        (*offsets)[(*n_offsets)++] = offset;
+        b->size = end;
+
+        return 0;
+}
+
+int userdb_cache_builder_add_user(UserDBCacheBuilder *b, UserRecord *ur) {
+        assert(b);
+        assert(ur);
+
+        if (!ur->user_name || !uid_is_valid(ur->uid))
+                return 0;
+
+        return builder_add(b, &b->users, &b->n_users,
+                           ur->uid, user_record_gid(ur),
+                           ur->user_name,
+                           STRV_MAKE(PASSWORD_SEE_SHADOW,
+                                     user_record_real_name(ur),
+                                     user_record_home_directory(ur),
+                                     user_record_shell(ur)));
+}
+
+int userdb_cache_builder_add_group(UserDBCacheBuilder *b, GroupRecord *gr, char **extra_members) {
+        _cleanup_strv_free_ char **members = NULL;
+        int r;
+
+        assert(b);
+        assert(gr);
+
+        if (!gr->group_name || !gid_is_valid(gr->gid))
+                return 0;
+
+        /* Merge the members the same way nss-systemd does when packing group records */
+        members = strv_copy(gr->members);
+        if (!members)
+                return -ENOMEM;
+
+        r = strv_extend_strv(&members, extra_members, /* filter_duplicates= */ true);
+        if (r < 0)
+                return r;
+
+        return builder_add(b, &b->groups, &b->n_groups,
+                           gr->gid, strv_length(members),
+                           gr->group_name,
+                           members);
+}
+
+static void builder_index(
+                uint8_t *image,
+                size_t size,
+                const Header *h,
+                unsigned idx,
+                uint32_t offset) {
+
+        const char *name = NULL;
+        uint32_t *buckets;
+        uint64_t hash;
+        Entry e;
+
+        assert(image);
+        assert(h);
+
+        memcpy(&e, image + offset, sizeof(e));
+
+        if (IN_SET(idx, INDEX_USER_NAME, INDEX_GROUP_NAME))
+                name = (const char*) image + offset + sizeof(Entry);
+
+        /* If multiple services define the same user or group, the first one wins */
+        if (cache_find(image, size, h, idx, name, e.id, &e) > 0)
+                return;
+
+        buckets = (uint32_t*) (image + sizeof(Header)) + (size_t) idx * h->n_buckets;
+        hash = cache_hash(h->hash_key, name, e.id);
+
+        for (uint32_t i = 0;; i++) {
+                uint32_t *slot = buckets + ((hash + i) & (h->n_buckets - 1));
+
+                /* There are at least twice as many slots as entries, hence this terminates */
+                if (*slot == 0) {
+                        *slot = offset;
+                        return;
+                }
+        }
+}
+
+int userdb_cache_builder_write(UserDBCacheBuilder *b, const char *path) {
+        _cleanup_free_ uint8_t *image = NULL;
+        _cleanup_close_ int fd = -1;
+        uint32_t n_buckets = 0;
+        size_t image_size, base;
+        uint64_t generation;
+        struct stat st;
+        Header *h, *old;
+        void *map;
+        bool valid;
+
+        assert(b);
+        assert(path);
+
+        fd = open(path, O_RDWR|O_CREAT|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW, 0644);
+        if (fd < 0)
+                return log_debug_errno(errno, "Failed to open %s: %m", path);
+
+        /* Serialize against other writers, readers never take the lock */
+        if (flock(fd, LOCK_EX) < 0)
+                return log_debug_errno(errno, "Failed to lock %s: %m", path);
+
+        if (fstat(fd, &st) < 0)
+                return log_debug_errno(errno, "Failed to stat %s: %m", path);
+
+        if (st.st_size != USERDB_CACHE_SIZE && ftruncate(fd, USERDB_CACHE_SIZE) < 0)
+                return log_debug_errno(errno, "Failed to resize %s: %m", path);
+
+        map = mmap(NULL, USERDB_CACHE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return log_debug_errno(errno, "Failed to map %s: %m", path);
+
+        old = map;
+        valid = memcmp(old->signature, userdb_cache_signature, sizeof(userdb_cache_signature)) == 0;
+
+        if (MAX(b->n_users, b->n_groups) > 0) {
+                n_buckets = 16;
+                while (n_buckets < MAX(b->n_users, b->n_groups) * 2)
+                        n_buckets <<= 1;
+        }
+
+        base = sizeof(Header) + (size_t) _INDEX_MAX * n_buckets * sizeof(uint32_t);
+        image_size = base + b->size;
+        if (image_size > USERDB_CACHE_SIZE) {
+                log_warning("Too many user and group records to cache (%zu bytes), not caching any.", image_size);
+
+                n_buckets = 0;
+                base = image_size = sizeof(Header);
+        }
+
+        image = malloc0(image_size);
+        if (!image) {
+                (void) munmap(map, USERDB_CACHE_SIZE);
+                return log_oom_debug();
+        }
+
+        h = (Header*) image;
+        memcpy(h->signature, userdb_cache_signature, sizeof(h->signature));
+        h->n_buckets = n_buckets;
+        h->data_size = image_size - sizeof(Header);
+
+        /* Keep the hash key of the previous snapshot, so that unchanged contents result in an identical
+         * image, which we don't have to invalidate the readers for */
+        if (valid)
+                memcpy(h->hash_key, old->hash_key, sizeof(h->hash_key));
+        else
+                random_bytes(h->hash_key, sizeof(h->hash_key));
+
+        if (n_buckets > 0) {
+                memcpy(image + base, b->data, b->size);
+
+                for (size_t i = 0; i < b->n_users; i++) {
+                        builder_index(image, image_size, h, INDEX_USER_NAME, base + b->users[i]);
+                        builder_index(image, image_size, h, INDEX_USER_UID, base + b->users[i]);
+                }
+
+                for (size_t i = 0; i < b->n_groups; i++) {
+                        builder_index(image, image_size, h, INDEX_GROUP_NAME, base + b->groups[i]);
+                        builder_index(image, image_size, h, INDEX_GROUP_GID, base + b->groups[i]);
+                }
+        }
+
+        generation = valid ? __atomic_load_n(&old->generation, __ATOMIC_RELAXED) : 0;
+
+        if (!valid ||
+            generation % 2 != 0 || /* A previous writer died half-way */
+            memcmp((uint8_t*) map + offsetof(Header, hash_key), image + offsetof(Header, hash_key), image_size - offsetof(Header, hash_key)) != 0) {
+
+                generation += generation % 2 + 1;
+
+                __atomic_store_n(&old->generation, generation, __ATOMIC_RELAXED);
+                __atomic_thread_fence(__ATOMIC_RELEASE);
+
+                memcpy((uint8_t*) map + offsetof(Header, hash_key), image + offsetof(Header, hash_key), image_size - offsetof(Header, hash_key));
+                memcpy(old->signature, userdb_cache_signature, sizeof(old->signature));
+
+                __atomic_store_n(&old->generation, generation + 1, __ATOMIC_RELEASE);
+
+                log_debug("Published %zu users and %zu groups in %s, generation %" PRIu64 ".",
+                          b->n_users, b->n_groups, path, generation + 1);
+        } else
+                log_debug("User and group records unchanged, refreshing timestamp of %s.", path);
+
+        __atomic_store_n(&old->timestamp, now(CLOCK_MONOTONIC), __ATOMIC_RELEASE);
+
+        (void) munmap(map, USERDB_CACHE_SIZE);
+        return 0;
+}
+
+int userdb_cache_publish(const char *path) {
+        _cleanup_(userdb_cache_builder_freep) UserDBCacheBuilder *b = NULL;
+        _cleanup_hashmap_free_ Hashmap *members = NULL;
+        UserDBFlags flags;
+        int r;
+
+        assert(path);
+
+        /* Cache what nss-systemd would find via Varlink, except for the dynamic users, which come and go
+         * too quickly for this, and without going through the multiplexer, i.e. ourselves. */
+        flags = USERDB_EXCLUDE_NSS|USERDB_AVOID_MULTIPLEXER|USERDB_EXCLUDE_DYNAMIC_USER|
+                USERDB_SUPPRESS_SHADOW|USERDB_DONT_SYNTHESIZE;
+
+        r = userdb_cache_builder_new(&b);
+        if (r < 0)
+                return log_oom();
+
+        {
+                _cleanup_(userdb_iterator_freep) UserDBIterator *iterator = NULL;
+
+                r = membershipdb_all(flags, &iterator);
+                if (r < 0 && !IN_SET(r, -ESRCH, -ENOLINK))
+                        return log_error_errno(r, "Failed to enumerate memberships: %m");
+
+                while (r >= 0) {
+                        _cleanup_free_ char *user = NULL, *group = NULL;
+
+                        r = membershipdb_iterator_get(iterator, &user, &group);
+                        if (r == -ESRCH)
+                                break;
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to acquire next membership: %m");
+
+                        r = string_strv_hashmap_put(&members, group, user);
+                        if (r < 0)
+                                return log_oom();
+                }
+        }
+
+        {
+                _cleanup_(userdb_iterator_freep) UserDBIterator *iterator = NULL;
+
+                r = userdb_all(flags, &iterator);
+                if (r < 0 && !IN_SET(r, -ESRCH, -ENOLINK))
+                        return log_error_errno(r, "Failed to enumerate users: %m");
+
+                while (r >= 0) {
+                        _cleanup_(user_record_unrefp) UserRecord *ur = NULL;
+
+                        r = userdb_iterator_get(iterator, &ur);
+                        if (r == -ESRCH)
+                                break;
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to acquire next user: %m");
+
+                        r = userdb_cache_builder_add_user(b, ur);
+                        if (r == -E2BIG)
+                                log_debug_errno(r, "User record of %s too large to cache, skipping.", ur->user_name);
+                        else if (r < 0)
+                                return log_oom();
+                }
+        }
+
+        {
+                _cleanup_(userdb_iterator_freep) UserDBIterator *iterator = NULL;
+
+                r = groupdb_all(flags, &iterator);
+                if (r < 0 && !IN_SET(r, -ESRCH, -ENOLINK))
+                        return log_error_errno(r, "Failed to enumerate groups: %m");
+
+                while (r >= 0) {
+                        _cleanup_(group_record_unrefp) GroupRecord *gr = NULL;
+
+                        r = groupdb_iterator_get(iterator, &gr);
+                        if (r == -ESRCH)
+                                break;
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to acquire next group: %m");
+
+                        r = userdb_cache_builder_add_group(b, gr, gr->group_name ? hashmap_get(members, gr->group_name) : NULL);
+                        if (r == -E2BIG)
+                                log_debug_errno(r, "Group record of %s too large to cache, skipping.", gr->group_name);
+                        else if (r < 0)
+                                return log_oom();
+                }
+        }
+
+        r = userdb_cache_builder_write(b, path);
+        if (r < 0)
+                return log_error_errno(r, "Failed to write user and group record cache %s: %m", path);
+
+        return 0;
+}
+
+static const uint8_t* userdb_cache_map(UserDBCache *c) {
+        _cleanup_close_ int fd = -1;
+        void *p, *expected = NULL;
+        usec_t n, last;
+        struct stat st;
+
+        assert(c);
+
+        p = __atomic_load_n(&c->map, __ATOMIC_ACQUIRE);
+        if (p)
+                return p;
+
+        n = now(CLOCK_MONOTONIC);
+        last = __atomic_load_n(&c->last_attempt, __ATOMIC_RELAXED);
+        if (last > 0 && n < usec_add(last, USERDB_CACHE_RETRY_USEC))
+                return NULL;
+
+        __atomic_store_n(&c->last_attempt, n, __ATOMIC_RELAXED);
+
+        fd = open(c->path, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
+        if (fd < 0)
+                return NULL;
+
+        /* Only trust files nobody but the owner can write to, and only if that's root or ourselves. The
+         * writer never shrinks the file, hence accessing the mapping is always safe. */
+        if (fstat(fd, &st) < 0 ||
+            !S_ISREG(st.st_mode) ||
+            st.st_size != USERDB_CACHE_SIZE ||
+            (st.st_mode & 0022) != 0 ||
+            (st.st_uid != 0 && st.st_uid != getuid()))
+                return NULL;
+
+        p = mmap(NULL, USERDB_CACHE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return NULL;
+
+        /* Another thread might have been quicker */
+        if (!__atomic_compare_exchange_n(&c->map, &expected, p, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                (void) munmap(p, USERDB_CACHE_SIZE);
+                return expected;
+        }
+
+        return p;
+}
+
+static int userdb_cache_lookup(
+                UserDBCache *c,
+                unsigned idx,
+                const char *name,
+                uint32_t id,
+                char *buffer,
+                size_t buflen,
+                Entry *ret,
+                size_t *ret_prefix) {
+
+        uint64_t generation, timestamp;
+        const uint8_t *p;
+        size_t prefix;
+        uint32_t offset;
+        Header h;
+        Entry e;
+
+        assert(c);
+        assert(ret);
+        assert(ret_prefix);
+
+        p = userdb_cache_map(c);
+        if (!p)
+                return 0;
+
+        generation = __atomic_load_n(&((const Header*) p)->generation, __ATOMIC_ACQUIRE);
+        if (generation % 2 != 0) /* Update in progress, don't bother */
+                return 0;
+
+        timestamp = __atomic_load_n(&((const Header*) p)->timestamp, __ATOMIC_RELAXED);
+        if (timestamp == 0 || usec_sub_unsigned(now(CLOCK_MONOTONIC), timestamp) > USERDB_CACHE_MAX_AGE_USEC)
+                return 0;
+
+        memcpy(&h, p, sizeof(h));
+        if (memcmp(h.signature, userdb_cache_signature, sizeof(h.signature)) != 0 ||
+            h.n_buckets == 0 ||
+            (h.n_buckets & (h.n_buckets - 1)) != 0 ||
+            h.n_buckets > (USERDB_CACHE_SIZE - sizeof(Header)) / (_INDEX_MAX * sizeof(uint32_t)))
+                return 0;
+
+        offset = cache_find(p, USERDB_CACHE_SIZE, &h, idx, name, id, &e);
+        if (offset == 0)
+                return 0;
+
+        /* Group members are preceded by the pointer array in the buffer. Every member takes at least one
+         * byte, which also keeps the size calculation from overflowing. */
+        if (IN_SET(idx, INDEX_GROUP_NAME, INDEX_GROUP_GID)) {
+                if (e.aux >= e.size)
+                        return 0;
+
+                prefix = ((size_t) e.aux + 1) * sizeof(char*);
+        } else
+                prefix = 0;
+
+        if (buflen >= prefix && buflen - prefix >= e.size)
+                memcpy(buffer + prefix, p + offset + sizeof(Entry), e.size);
+
+        /* Only now that we copied everything we know whether what we saw was consistent */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&((const Header*) p)->generation, __ATOMIC_RELAXED) != generation)
+                return 0;
+
+        if (buflen < prefix || buflen - prefix < e.size)
+                return -ERANGE;
+
+        *ret = e;
+        *ret_prefix = prefix;
+        return 1;
+}
+
+static bool split_strings(char *s, size_t size, char **ret, size_t n) {
+        char *end = s + size;
+
+        assert(s);
+        assert(ret);
+
+        /* Verifies that the copied entry consists of exactly n NUL terminated strings */
+
+        for (size_t i = 0; i < n; i++) {
+                char *z;
+
+                if (s >= end)
+                        return false;
+
+                z = memchr(s, 0, end - s);
+                if (!z)
+                        return false;
+
+                ret[i] = s;
+                s = z + 1;
+        }
+
+        return s == end;
+}
+
+int userdb_cache_get_user(UserDBCache *c, const char *name, uid_t uid, struct passwd *pwd, char *buffer, size_t buflen) {
+        char *strings[5];
+        size_t prefix;
+        Entry e;
+        int r;
+
+        assert(c);
+        assert(name || uid_is_valid(uid));
+        assert(pwd);
+
+        r = userdb_cache_lookup(c, name ? INDEX_USER_NAME : INDEX_USER_UID, name, uid, buffer, buflen, &e, &prefix);
+        if (r <= 0)
+                return r;
+
+        if (!split_strings(buffer, e.size, strings, ELEMENTSOF(strings)))
+                return 0;
+
+        *pwd = (struct passwd) {
+                .pw_name = strings[0],
+                .pw_passwd = strings[1],
+                .pw_uid = e.id,
+                .pw_gid = e.aux,
+                .pw_gecos = strings[2],
+                .pw_dir = strings[3],
+                .pw_shell = strings[4],
+        };
+
+        return 1;
+}
+
+int userdb_cache_get_group(UserDBCache *c, const char *name, gid_t gid, struct group *gr, char *buffer, size_t buflen) {
+        char **array;
+        size_t prefix;
+        Entry e;
+        int r;
+
+        assert(c);
+        assert(name || gid_is_valid(gid));
+        assert(gr);
+
+        r = userdb_cache_lookup(c, name ? INDEX_GROUP_NAME : INDEX_GROUP_GID, name, gid, buffer, buflen, &e, &prefix);
+        if (r <= 0)
+                return r;
+
+        /* Place the pointer array at the beginning of the buffer, under the assumption it is aligned, and
+         * use its last slot to temporarily store the group name */
+        array = (char**) buffer;
+        if (!split_strings(buffer + prefix, e.size, array, e.aux + 1))
+                return 0;
+
+        *gr = (struct group) {
+                .gr_name = array[0],
+                .gr_gid = e.id,
+                .gr_passwd = (char*) PASSWORD_SEE_SHADOW,
+                .gr_mem = array,
+        };
+
+        memmove(array, array + 1, e.aux * sizeof(char*));
+        array[e.aux] = NULL;
+
+        return 1;
+}
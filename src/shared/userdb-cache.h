@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+#pragma once
+
+#include <grp.h>
+#include <pwd.h>
+
+#include "group-record.h"
+#include "macro.h"
+#include "time-util.h"
+#include "user-record.h"
+
+/* A read-mostly snapshot of the user and group records known to userdb (minus NSS and dynamic users), which
+ * systemd-userdbd regularly publishes in a shared file and nss-systemd consults before doing a Varlink
+ * round trip per lookup. The file is updated in place, protected by a generation counter that is odd while
+ * an update is in progress (i.e. a seqlock), so that readers never take a lock: they copy the entry they
+ * are interested in into the caller's buffer and simply retry via Varlink if the generation changed
+ * meanwhile. Snapshots that haven't been refreshed for a while (e.g. because systemd-userdbd is gone) are
+ * ignored. */
+
+#define USERDB_CACHE_PATH "/run/systemd/userdb-cache"
+
+/* The file is allocated with a fixed size, so that readers can map it once and never have to remap it
+ * underneath concurrent lookups. It lives on tmpfs, hence pages never written don't take up any memory. */
+#define USERDB_CACHE_SIZE (4U * 1024U * 1024U)
+
+#define USERDB_CACHE_REFRESH_USEC (15 * USEC_PER_SEC)
+#define USERDB_CACHE_MAX_AGE_USEC (3 * USERDB_CACHE_REFRESH_USEC)
+
+typedef struct UserDBCacheBuilder UserDBCacheBuilder;
+
+int userdb_cache_builder_new(UserDBCacheBuilder **ret);
+UserDBCacheBuilder* userdb_cache_builder_free(UserDBCacheBuilder *b);
+DEFINE_TRIVIAL_CLEANUP_FUNC(UserDBCacheBuilder*, userdb_cache_builder_free);
+
+int userdb_cache_builder_add_user(UserDBCacheBuilder *b, UserRecord *ur);
+int userdb_cache_builder_add_group(UserDBCacheBuilder *b, GroupRecord *gr, char **extra_members);
+int userdb_cache_builder_write(UserDBCacheBuilder *b, const char *path);
+
+/* Enumerates all users, groups and memberships via userdb and writes them out */
+int userdb_cache_publish(const char *path);
+
+typedef struct UserDBCache {
+        const char *path;
+        void *map;              /* Mapped once, never unmapped again while the process is running */
+        usec_t last_attempt;    /* When we last tried to map the file, to not try it for every lookup */
+} UserDBCache;
+
+#define USERDB_CACHE_INIT(p) { .path = (p) }
+
+/* These return > 0 and fill in the passed structure on success, 0 if the record is not in the cache (or the
+ * cache is currently not usable), in which case the caller shall look the record up via Varlink, and
+ * -ERANGE if the buffer is too small. Exactly one of name and uid/gid shall be specified. */
+int userdb_cache_get_user(UserDBCache *c, const char *name, uid_t uid, struct passwd *pwd, char *buffer, size_t buflen);
+int userdb_cache_get_group(UserDBCache *c, const char *name, gid_t gid, struct group *gr, char *buffer, size_t buflen);
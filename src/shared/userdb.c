@@ -21,6 +21,10 @@
 
 DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(link_hash_ops, void, trivial_hash_func, trivial_compare_func, Varlink, varlink_unref);
 
+/* See userdb_enable_connection_pool() */
+static VarlinkPool *connection_pool = NULL;
+static sd_event *connection_pool_event = NULL;
+
 typedef enum LookupWhat {
         LOOKUP_USER,
         LOOKUP_GROUP,
@@ -28,10 +32,13 @@ typedef enum LookupWhat {
         _LOOKUP_WHAT_MAX,
 } LookupWhat;
 
+typedef struct UserDBCall UserDBCall;
+
 struct UserDBIterator {
         LookupWhat what;
         UserDBFlags flags;
         Set *links;
+        Set *calls;                               /* calls pending on pooled connections */
         bool nss_covered:1;
         bool nss_iterating:1;
         bool dropin_covered:1;
@@ -52,11 +59,24 @@ struct UserDBIterator {
         char *filter_user_name, *filter_group_name;
 };
 
+/* A call on a pooled connection. The connection outlives the iterator, and so might the call, if the
+ * iterator was done before all services replied, hence the iterator is detached from it then and the reply
+ * ignored once it comes in. */
+struct UserDBCall {
+        UserDBIterator *iterator;
+};
+
 UserDBIterator* userdb_iterator_free(UserDBIterator *iterator) {
+        UserDBCall *call;
+
         if (!iterator)
                 return NULL;
 
         set_free(iterator->links);
+
+        SET_FOREACH(call, iterator->calls)
+                call->iterator = NULL;
+        set_free(iterator->calls);
         strv_free(iterator->dropins);
 
         switch (iterator->what) {
@@ -146,35 +166,33 @@ static void user_group_data_release(struct user_group_data *d) {
         json_variant_unref(d->record);
 }
 
-static int userdb_on_query_reply(
-                Varlink *link,
+static int userdb_process_reply(
+                UserDBIterator *iterator,
                 JsonVariant *parameters,
                 const char *error_id,
-                VarlinkReplyFlags flags,
-                void *userdata) {
+                VarlinkReplyFlags flags) {
 
-        UserDBIterator *iterator = userdata;
         int r;
 
         assert(iterator);
 
+        /* Returns > 0 if more replies are coming on this call, 0 if it's done, and < 0 if it failed */
+
         if (error_id) {
                 log_debug("Got lookup error: %s", error_id);
 
                 if (STR_IN_SET(error_id,
                                "io.systemd.UserDatabase.NoRecordFound",
                                "io.systemd.UserDatabase.ConflictingRecordFound"))
-                        r = -ESRCH;
-                else if (streq(error_id, "io.systemd.UserDatabase.ServiceNotAvailable"))
-                        r = -EHOSTDOWN;
-                else if (streq(error_id, "io.systemd.UserDatabase.EnumerationNotSupported"))
-                        r = -EOPNOTSUPP;
-                else if (streq(error_id, VARLINK_ERROR_TIMEOUT))
-                        r = -ETIMEDOUT;
-                else
-                        r = -EIO;
-
-                goto finish;
+                        return -ESRCH;
+                if (streq(error_id, "io.systemd.UserDatabase.ServiceNotAvailable"))
+                        return -EHOSTDOWN;
+                if (streq(error_id, "io.systemd.UserDatabase.EnumerationNotSupported"))
+                        return -EOPNOTSUPP;
+                if (streq(error_id, VARLINK_ERROR_TIMEOUT))
+                        return -ETIMEDOUT;
+
+                return -EIO;
         }
 
         switch (iterator->what) {
@@ -193,27 +211,21 @@ static int userdb_on_query_reply(
 
                 r = json_dispatch(parameters, dispatch_table, NULL, 0, &user_data);
                 if (r < 0)
-                        goto finish;
+                        return r;
 
-                if (!user_data.record) {
-                        r = log_debug_errno(SYNTHETIC_ERRNO(EIO), "Reply is missing record key");
-                        goto finish;
-                }
+                if (!user_data.record)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EIO), "Reply is missing record key");
 
                 hr = user_record_new();
-                if (!hr) {
-                        r = -ENOMEM;
-                        goto finish;
-                }
+                if (!hr)
+                        return -ENOMEM;
 
                 r = user_record_load(hr, user_data.record, USER_RECORD_LOAD_REFUSE_SECRET|USER_RECORD_PERMISSIVE);
                 if (r < 0)
-                        goto finish;
+                        return r;
 
-                if (!hr->service) {
-                        r = log_debug_errno(SYNTHETIC_ERRNO(EINVAL), "User record does not carry service information, refusing.");
-                        goto finish;
-                }
+                if (!hr->service)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EINVAL), "User record does not carry service information, refusing.");
 
                 hr->incomplete = user_data.incomplete;
 
@@ -227,13 +239,8 @@ static int userdb_on_query_reply(
                 iterator->found_user = TAKE_PTR(hr);
                 iterator->n_found++;
 
-                /* More stuff coming? then let's just exit cleanly here */
-                if (FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
-                        return 0;
-
-                /* Otherwise, let's remove this link and exit cleanly then */
-                r = 0;
-                goto finish;
+                /* More stuff coming? Otherwise this call is done */
+                return FLAGS_SET(flags, VARLINK_REPLY_CONTINUES);
         }
 
         case LOOKUP_GROUP: {
@@ -250,27 +257,21 @@ static int userdb_on_query_reply(
 
                 r = json_dispatch(parameters, dispatch_table, NULL, 0, &group_data);
                 if (r < 0)
-                        goto finish;
+                        return r;
 
-                if (!group_data.record) {
-                        r = log_debug_errno(SYNTHETIC_ERRNO(EIO), "Reply is missing record key");
-                        goto finish;
-                }
+                if (!group_data.record)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EIO), "Reply is missing record key");
 
                 g = group_record_new();
-                if (!g) {
-                        r = -ENOMEM;
-                        goto finish;
-                }
+                if (!g)
+                        return -ENOMEM;
 
                 r = group_record_load(g, group_data.record, USER_RECORD_LOAD_REFUSE_SECRET|USER_RECORD_PERMISSIVE);
                 if (r < 0)
-                        goto finish;
+                        return r;
 
-                if (!g->service) {
-                        r = log_debug_errno(SYNTHETIC_ERRNO(EINVAL), "Group record does not carry service information, refusing.");
-                        goto finish;
-                }
+                if (!g->service)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EINVAL), "Group record does not carry service information, refusing.");
 
                 g->incomplete = group_data.incomplete;
 
@@ -282,11 +283,7 @@ static int userdb_on_query_reply(
                 iterator->found_group = TAKE_PTR(g);
                 iterator->n_found++;
 
-                if (FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
-                        return 0;
-
-                r = 0;
-                goto finish;
+                return FLAGS_SET(flags, VARLINK_REPLY_CONTINUES);
         }
 
         case LOOKUP_MEMBERSHIP: {
@@ -306,47 +303,140 @@ static int userdb_on_query_reply(
 
                 r = json_dispatch(parameters, dispatch_table, NULL, 0, &membership_data);
                 if (r < 0)
-                        goto finish;
+                        return r;
 
                 iterator->found_user_name = mfree(iterator->found_user_name);
                 iterator->found_group_name = mfree(iterator->found_group_name);
 
                 iterator->found_user_name = strdup(membership_data.user_name);
-                if (!iterator->found_user_name) {
-                        r = -ENOMEM;
-                        goto finish;
-                }
+                if (!iterator->found_user_name)
+                        return -ENOMEM;
 
                 iterator->found_group_name = strdup(membership_data.group_name);
-                if (!iterator->found_group_name) {
-                        r = -ENOMEM;
-                        goto finish;
-                }
+                if (!iterator->found_group_name)
+                        return -ENOMEM;
 
                 iterator->n_found++;
 
-                if (FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
-                        return 0;
-
-                r = 0;
-                goto finish;
+                return FLAGS_SET(flags, VARLINK_REPLY_CONTINUES);
         }
 
         default:
                 assert_not_reached();
         }
+}
+
+static void userdb_iterator_call_done(UserDBIterator *iterator, int r) {
+        assert(iterator);
 
-finish:
         /* If we got one ESRCH, let that win. This way when we do a wild dump we won't be tripped up by bad
          * errors if at least one connection ended cleanly */
         if (r == -ESRCH || iterator->error == 0)
                 iterator->error = -r;
+}
+
+static int userdb_on_query_reply(
+                Varlink *link,
+                JsonVariant *parameters,
+                const char *error_id,
+                VarlinkReplyFlags flags,
+                void *userdata) {
+
+        UserDBIterator *iterator = ASSERT_PTR(userdata);
+        int r;
+
+        r = userdb_process_reply(iterator, parameters, error_id, flags);
+        if (r > 0)
+                return 0;
+
+        userdb_iterator_call_done(iterator, r);
 
         assert_se(set_remove(iterator->links, link) == link);
         link = varlink_unref(link);
         return 0;
 }
 
+static int userdb_on_pooled_reply(
+                Varlink *link,
+                JsonVariant *parameters,
+                const char *error_id,
+                VarlinkReplyFlags flags,
+                void *userdata) {
+
+        UserDBCall *call = ASSERT_PTR(userdata);
+        UserDBIterator *iterator = call->iterator;
+        int r;
+
+        if (!iterator) { /* The lookup is over already */
+                if (!FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
+                        free(call);
+                return 0;
+        }
+
+        r = userdb_process_reply(iterator, parameters, error_id, flags);
+        if (r > 0)
+                return 0;
+
+        userdb_iterator_call_done(iterator, r);
+
+        assert_se(set_remove(iterator->calls, call) == call);
+        free(call);
+        return 0;
+}
+
+static int userdb_connect_pooled(
+                UserDBIterator *iterator,
+                const char *path,
+                const char *method,
+                JsonVariant *query) {
+
+        _cleanup_(varlink_unrefp) Varlink *vl = NULL;
+        _cleanup_free_ UserDBCall *call = NULL;
+        int r;
+
+        assert(iterator);
+        assert(path);
+        assert(method);
+        assert(connection_pool);
+
+        /* Single lookups are pipelined on the connections we keep around, which are all attached to the
+         * same event loop, hence use that for the iterator too */
+        if (!iterator->event)
+                iterator->event = sd_event_ref(connection_pool_event);
+        else
+                assert(iterator->event == connection_pool_event);
+
+        r = varlink_pool_get(connection_pool, path, &vl);
+        if (r < 0)
+                return log_debug_errno(r, "Unable to connect to %s: %m", path);
+        if (r > 0) {
+                r = varlink_negotiate_binary(vl);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to enqueue encoding request: %m");
+        }
+
+        call = new(UserDBCall, 1);
+        if (!call)
+                return log_oom_debug();
+
+        *call = (UserDBCall) {
+                .iterator = iterator,
+        };
+
+        r = set_ensure_put(&iterator->calls, NULL, call);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to add call to set: %m");
+
+        r = varlink_invoke_full(vl, method, query, userdb_on_pooled_reply, call);
+        if (r < 0) {
+                assert_se(set_remove(iterator->calls, call) == call);
+                return log_debug_errno(r, "Failed to invoke varlink method: %m");
+        }
+
+        TAKE_PTR(call);
+        return 0;
+}
+
 static int userdb_connect(
                 UserDBIterator *iterator,
                 const char *path,
@@ -361,6 +451,9 @@ static int userdb_connect(
         assert(path);
         assert(method);
 
+        if (connection_pool && !more)
+                return userdb_connect_pooled(iterator, path, method, query);
+
         r = varlink_connect_address(&vl, path);
         if (r < 0)
                 return log_debug_errno(r, "Unable to connect to %s: %m", path);
@@ -383,6 +476,11 @@ static int userdb_connect(
         if (r < 0)
                 return log_debug_errno(r, "Failed to bind reply callback: %m");
 
+        /* Records are sizable, let's not format and parse them as JSON where the service can do better */
+        r = varlink_negotiate_binary(vl);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to enqueue encoding request: %m");
+
         if (more)
                 r = varlink_observe(vl, method, query);
         else
@@ -510,7 +608,7 @@ static int userdb_start_query(
                         ret = r;
         }
 
-        if (set_isempty(iterator->links))
+        if (set_isempty(iterator->links) && set_isempty(iterator->calls))
                 return ret < 0 ? ret : -ESRCH; /* propagate last error we saw if we couldn't connect to anything. */
 
         /* We connected to some services, in this case, ignore the ones we failed on */
@@ -580,7 +678,7 @@ static int userdb_process(
                         return 0;
                 }
 
-                if (set_isempty(iterator->links)) {
+                if (set_isempty(iterator->links) && set_isempty(iterator->calls)) {
                         if (iterator->error == 0)
                                 return -ESRCH;
 
@@ -1471,3 +1569,33 @@ int userdb_block_nss_systemd(int b) {
 
         return call(b);
 }
+
+int userdb_enable_connection_pool(void) {
+        _cleanup_(varlink_pool_freep) VarlinkPool *pool = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *event = NULL;
+        int r;
+
+        if (connection_pool)
+                return 0;
+
+        r = sd_event_new(&event);
+        if (r < 0)
+                return r;
+
+        r = varlink_pool_new(&pool);
+        if (r < 0)
+                return r;
+
+        r = varlink_pool_attach_event(pool, event, SD_EVENT_PRIORITY_NORMAL);
+        if (r < 0)
+                return r;
+
+        connection_pool = TAKE_PTR(pool);
+        connection_pool_event = TAKE_PTR(event);
+        return 1;
+}
+
+void userdb_disable_connection_pool(void) {
+        connection_pool = varlink_pool_free(connection_pool);
+        connection_pool_event = sd_event_unref(connection_pool_event);
+}
@@ -56,3 +56,9 @@ int membershipdb_iterator_get(UserDBIterator *iterator, char **user, char **grou
 int membershipdb_by_group_strv(const char *name, UserDBFlags flags, char ***ret);
 
 int userdb_block_nss_systemd(int b);
+
+/* Keeps the connections to the services around between single record lookups, and pipelines further
+ * lookups on them, instead of connecting anew each time. Not thread-safe, only for single-threaded programs
+ * doing lots of lookups, such as the workers of systemd-userdbd. */
+int userdb_enable_connection_pool(void);
+void userdb_disable_connection_pool(void);
@@ -4,6 +4,7 @@
 #include <poll.h>
 
 #include "alloc-util.h"
+#include "env-util.h"
 #include "errno-util.h"
 #include "fd-util.h"
 #include "glyph-util.h"
@@ -19,6 +20,7 @@
 #include "strv.h"
 #include "time-util.h"
 #include "umask-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "varlink.h"
 
@@ -29,6 +31,19 @@
 #define VARLINK_BUFFER_MAX (16U*1024U*1024U)
 #define VARLINK_READ_SIZE (64U*1024U)
 
+/* How many messages already sitting in the input buffer to dispatch in one go */
+#define VARLINK_DISPATCH_BATCH_MAX 32U
+
+/* Messages in binary encoding (see json_variant_format_binary()) are framed by this byte, which can never
+ * start a JSON text, followed by the size of the payload as 32bit little endian. Which encoding a message
+ * uses is determined on each message, hence each side can switch on its own. */
+#define VARLINK_BINARY_MARKER 0xFFU
+#define VARLINK_BINARY_HEADER_SIZE (1U + sizeof(uint32_t))
+
+/* The method the client calls to ask the server to switch to the binary encoding. Servers that do not know
+ * it return an error, and things just stay as they are. */
+#define VARLINK_METHOD_SET_ENCODING "io.systemd.Varlink.SetEncoding"
+
 typedef enum VarlinkState {
         /* Client side states */
         VARLINK_IDLE_CLIENT,
@@ -79,6 +94,15 @@ typedef enum VarlinkState {
                VARLINK_PENDING_METHOD,                  \
                VARLINK_PENDING_METHOD_MORE)
 
+/* Method calls we sent and expect a reply to, in the order we sent them. Since the server processes calls
+ * strictly in order, the next reply we get always belongs to the first of these. */
+typedef struct VarlinkPendingCall {
+        VarlinkReply callback; /* if NULL, the reply callback bound to the connection is used */
+        void *userdata;
+        bool call;             /* varlink_call() waits for this one */
+        bool more;             /* varlink_observe() call, which may get more than one reply */
+} VarlinkPendingCall;
+
 struct Varlink {
         unsigned n_ref;
 
@@ -112,6 +136,9 @@ struct Varlink {
                           * at most. */
         unsigned n_pending;
 
+        VarlinkPendingCall *pending_calls; /* valid entries start at pending_calls_index, n_pending of them */
+        size_t pending_calls_index;
+
         int fd;
 
         char *input_buffer; /* valid data starts at input_buffer_index, ends at input_buffer_index+input_buffer_size */
@@ -135,6 +162,7 @@ struct Varlink {
         bool read_disconnected:1;
         bool prefer_read_write:1;
         bool got_pollhup:1;
+        bool write_binary:1; /* the peer agreed to receive the binary encoding */
 
         usec_t timestamp;
         usec_t timeout;
@@ -369,6 +397,13 @@ static void varlink_clear(Varlink *v) {
         v->input_buffer = mfree(v->input_buffer);
         v->output_buffer = mfree(v->output_buffer);
 
+        v->input_buffer_index = v->input_buffer_size = v->input_buffer_unscanned = 0;
+        v->output_buffer_index = v->output_buffer_size = 0;
+
+        v->pending_calls = mfree(v->pending_calls);
+        v->pending_calls_index = 0;
+        v->n_pending = 0;
+
         v->current = json_variant_unref(v->current);
         v->reply = json_variant_unref(v->reply);
 
@@ -586,6 +621,27 @@ static int varlink_parse_message(Varlink *v) {
 
         begin = v->input_buffer + v->input_buffer_index;
 
+        if ((uint8_t) begin[0] == VARLINK_BINARY_MARKER) {
+                if (v->input_buffer_size < VARLINK_BINARY_HEADER_SIZE ||
+                    v->input_buffer_size - VARLINK_BINARY_HEADER_SIZE < unaligned_read_le32(begin + 1)) {
+                        /* Incomplete, wait for more */
+                        v->input_buffer_unscanned = 0;
+                        return 0;
+                }
+
+                sz = VARLINK_BINARY_HEADER_SIZE + unaligned_read_le32(begin + 1);
+
+                varlink_log(v, "New incoming binary message of %zu bytes.", sz);
+
+                r = json_parse_binary(begin + VARLINK_BINARY_HEADER_SIZE, sz - VARLINK_BINARY_HEADER_SIZE, JSON_PARSE_ARENA, &v->current);
+                if (r < 0) {
+                        v->input_buffer_index = v->input_buffer_size = v->input_buffer_unscanned = 0;
+                        return varlink_log_errno(v, r, "Failed to parse binary message: %m");
+                }
+
+                goto consumed;
+        }
+
         e = memchr(begin + v->input_buffer_size - v->input_buffer_unscanned, 0, v->input_buffer_unscanned);
         if (!e) {
                 v->input_buffer_unscanned = 0;
@@ -598,7 +654,8 @@ static int varlink_parse_message(Varlink *v) {
                                                             * This may produce a non-printable journal entry if the message
                                                             * is invalid. We may also expose privileged information. */
 
-        r = json_parse(begin, 0, &v->current, NULL, NULL);
+        /* Messages are parsed once and then only read, hence place each in an arena of its own */
+        r = json_parse(begin, JSON_PARSE_ARENA, &v->current, NULL, NULL);
         if (r < 0) {
                 /* If we encounter a parse failure flush all data. We cannot possibly recover from this,
                  * hence drop all buffered data now. */
@@ -606,6 +663,7 @@ static int varlink_parse_message(Varlink *v) {
                 return varlink_log_errno(v, r, "Failed to parse JSON: %m");
         }
 
+consumed:
         v->input_buffer_size -= sz;
 
         if (v->input_buffer_size == 0)
@@ -633,12 +691,74 @@ static int varlink_test_timeout(Varlink *v) {
         return 1;
 }
 
+static int varlink_push_pending_call(Varlink *v, VarlinkReply callback, void *userdata, bool call, bool more) {
+        assert(v);
+
+        if (v->pending_calls_index > 0 &&
+            v->pending_calls_index + v->n_pending >= MALLOC_ELEMENTSOF(v->pending_calls)) {
+                memmove(v->pending_calls, v->pending_calls + v->pending_calls_index, v->n_pending * sizeof(VarlinkPendingCall));
+                v->pending_calls_index = 0;
+        }
+
+        if (!GREEDY_REALLOC(v->pending_calls, v->pending_calls_index + v->n_pending + 1))
+                return -ENOMEM;
+
+        v->pending_calls[v->pending_calls_index + v->n_pending++] = (VarlinkPendingCall) {
+                .callback = callback,
+                .userdata = userdata,
+                .call = call,
+                .more = more,
+        };
+
+        return 0;
+}
+
+static VarlinkPendingCall varlink_pop_pending_call(Varlink *v) {
+        VarlinkPendingCall p;
+
+        assert(v);
+        assert(v->n_pending > 0);
+
+        p = v->pending_calls[v->pending_calls_index];
+
+        if (--v->n_pending == 0)
+                v->pending_calls_index = 0;
+        else
+                v->pending_calls_index++;
+
+        return p;
+}
+
+static VarlinkState varlink_pending_state(Varlink *v) {
+        assert(v);
+
+        /* The client state that matches the calls still pending */
+
+        if (v->n_pending == 0)
+                return VARLINK_IDLE_CLIENT;
+
+        return v->pending_calls[v->pending_calls_index].more ? VARLINK_AWAITING_REPLY_MORE : VARLINK_AWAITING_REPLY;
+}
+
 static int varlink_dispatch_local_error(Varlink *v, const char *error) {
         int r;
 
         assert(v);
         assert(error);
 
+        /* First tell everybody who has a call of their own pending on this connection, then whoever bound
+         * the connection's reply callback */
+        while (v->n_pending > 0) {
+                VarlinkPendingCall p = varlink_pop_pending_call(v);
+
+                if (!p.callback)
+                        continue;
+
+                r = p.callback(v, NULL, error, VARLINK_REPLY_ERROR|VARLINK_REPLY_LOCAL, p.userdata);
+                if (r < 0)
+                        log_debug_errno(r, "Reply callback returned error, ignoring: %m");
+        }
+
         if (!v->reply_callback)
                 return 0;
 
@@ -690,6 +810,7 @@ static int varlink_sanitize_parameters(JsonVariant **v) {
 static int varlink_dispatch_reply(Varlink *v) {
         _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL;
         VarlinkReplyFlags flags = 0;
+        VarlinkPendingCall p;
         const char *error = NULL;
         JsonVariant *e;
         const char *k;
@@ -740,7 +861,7 @@ static int varlink_dispatch_reply(Varlink *v) {
         }
 
         /* Replies with 'continue' set are only OK if we set 'more' when the method call was initiated */
-        if (v->state != VARLINK_AWAITING_REPLY_MORE && FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
+        if (!v->pending_calls[v->pending_calls_index].more && FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
                 goto invalid;
 
         /* An error is final */
@@ -751,32 +872,33 @@ static int varlink_dispatch_reply(Varlink *v) {
         if (r < 0)
                 goto invalid;
 
-        if (IN_SET(v->state, VARLINK_AWAITING_REPLY, VARLINK_AWAITING_REPLY_MORE)) {
-                varlink_set_state(v, VARLINK_PROCESSING_REPLY);
+        if (v->pending_calls[v->pending_calls_index].call) {
+                /* varlink_call() is waiting for this one, it takes the reply from here. This might happen in
+                 * VARLINK_AWAITING_REPLY state too, if there were other calls pipelined before it. */
+                varlink_set_state(v, VARLINK_CALLED);
+                return 1;
+        }
 
-                if (v->reply_callback) {
-                        r = v->reply_callback(v, parameters, error, flags, v->userdata);
-                        if (r < 0)
-                                log_debug_errno(r, "Reply callback returned error, ignoring: %m");
-                }
+        assert(IN_SET(v->state, VARLINK_AWAITING_REPLY, VARLINK_AWAITING_REPLY_MORE));
 
-                v->current = json_variant_unref(v->current);
+        /* The call stays pending as long as more replies are to come */
+        p = FLAGS_SET(flags, VARLINK_REPLY_CONTINUES) ?
+                v->pending_calls[v->pending_calls_index] :
+                varlink_pop_pending_call(v);
 
-                if (v->state == VARLINK_PROCESSING_REPLY) {
+        varlink_set_state(v, VARLINK_PROCESSING_REPLY);
 
-                        assert(v->n_pending > 0);
+        if (p.callback || v->reply_callback) {
+                r = p.callback ? p.callback(v, parameters, error, flags, p.userdata) :
+                                 v->reply_callback(v, parameters, error, flags, v->userdata);
+                if (r < 0)
+                        log_debug_errno(r, "Reply callback returned error, ignoring: %m");
+        }
 
-                        if (!FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
-                                v->n_pending--;
+        v->current = json_variant_unref(v->current);
 
-                        varlink_set_state(v,
-                                          FLAGS_SET(flags, VARLINK_REPLY_CONTINUES) ? VARLINK_AWAITING_REPLY_MORE :
-                                          v->n_pending == 0 ? VARLINK_IDLE_CLIENT : VARLINK_AWAITING_REPLY);
-                }
-        } else {
-                assert(v->state == VARLINK_CALLING);
-                varlink_set_state(v, VARLINK_CALLED);
-        }
+        if (v->state == VARLINK_PROCESSING_REPLY)
+                varlink_set_state(v, varlink_pending_state(v));
 
         return 1;
 
@@ -788,6 +910,26 @@ invalid:
         return 1;
 }
 
+static int method_set_encoding(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        JsonVariant *e;
+        int r;
+
+        /* Only the binary encoding can be asked for for now, JSON is what we start with */
+        e = json_variant_by_key(parameters, "encoding");
+        if (!streq_ptr(json_variant_string(e), "binary"))
+                return varlink_error_invalid_parameter(link, JSON_VARIANT_STRING_CONST("encoding"));
+
+        if (!FLAGS_SET(flags, VARLINK_METHOD_ONEWAY)) {
+                r = varlink_reply(link, NULL);
+                if (r < 0)
+                        return r;
+        }
+
+        /* The reply above still goes out as JSON, everything after it in binary */
+        link->write_binary = true;
+        return 0;
+}
+
 static int varlink_dispatch_method(Varlink *v) {
         _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL;
         VarlinkMethodFlags flags = 0;
@@ -864,7 +1006,10 @@ static int varlink_dispatch_method(Varlink *v) {
 
         assert(v->server);
 
-        if (STR_IN_SET(method, "org.varlink.service.GetInfo", "org.varlink.service.GetInterface")) {
+        if (streq(method, VARLINK_METHOD_SET_ENCODING)) {
+                callback = method_set_encoding;
+                error = NULL;
+        } else if (STR_IN_SET(method, "org.varlink.service.GetInfo", "org.varlink.service.GetInterface")) {
                 /* For now, we don't implement a single of varlink's own methods */
                 callback = NULL;
                 error = VARLINK_ERROR_METHOD_NOT_IMPLEMENTED;
@@ -917,7 +1062,7 @@ static int varlink_dispatch_method(Varlink *v) {
 
         }
 
-        return r;
+        return 1;
 
 invalid:
         r = -EINVAL;
@@ -930,6 +1075,40 @@ fail:
         return r;
 }
 
+static int varlink_dispatch_buffered(Varlink *v) {
+        int r;
+
+        assert(v);
+
+        /* Called after a message was dispatched: go on with further complete messages that are already
+         * sitting in the input buffer right away, instead of returning to the event loop for each of them,
+         * so that the replies to calls a client pipelined are collected in the output buffer and written
+         * in one go. Bounded, so that a single busy peer can't starve everybody else. Replies to a
+         * varlink_observe() call are not batched though: their consumers typically process one reply per
+         * event loop iteration (e.g. the userdb iterators), and rely on that. */
+
+        for (unsigned i = 1; i < VARLINK_DISPATCH_BATCH_MAX; i++) {
+                if (!IN_SET(v->state, VARLINK_AWAITING_REPLY, VARLINK_IDLE_SERVER))
+                        break;
+
+                r = varlink_parse_message(v);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                r = varlink_dispatch_reply(v);
+                if (r != 0)
+                        continue;
+
+                r = varlink_dispatch_method(v);
+                if (r < 0)
+                        return r;
+        }
+
+        return 1;
+}
+
 int varlink_process(Varlink *v) {
         int r;
 
@@ -947,12 +1126,16 @@ int varlink_process(Varlink *v) {
                 goto finish;
 
         r = varlink_dispatch_reply(v);
+        if (r > 0)
+                r = varlink_dispatch_buffered(v);
         if (r < 0)
                 varlink_log_errno(v, r, "Reply dispatch failed: %m");
         if (r != 0)
                 goto finish;
 
         r = varlink_dispatch_method(v);
+        if (r > 0)
+                r = varlink_dispatch_buffered(v);
         if (r < 0)
                 varlink_log_errno(v, r, "Method dispatch failed: %m");
         if (r != 0)
@@ -1241,6 +1424,46 @@ Varlink* varlink_flush_close_unref(Varlink *v) {
         return varlink_close_unref(v);
 }
 
+static int varlink_enqueue_binary(Varlink *v, JsonVariant *m) {
+        uint8_t header[VARLINK_BINARY_HEADER_SIZE] = { VARLINK_BINARY_MARKER };
+        _cleanup_free_ void *data = NULL;
+        size_t n;
+        int r;
+
+        assert(v);
+        assert(m);
+
+        r = json_variant_format_binary(m, &data, &n);
+        if (r < 0)
+                return r;
+
+        if (n > VARLINK_BUFFER_MAX ||
+            v->output_buffer_size + sizeof(header) + n > VARLINK_BUFFER_MAX)
+                return -ENOBUFS;
+
+        if (DEBUG_LOGGING) {
+                _cleanup_free_ char *text = NULL;
+
+                (void) json_variant_format(m, 0, &text);
+                varlink_log(v, "Sending binary message: %s", strna(text));
+        }
+
+        unaligned_write_le32(header + 1, n);
+
+        if (v->output_buffer_index > 0) {
+                memmove(v->output_buffer, v->output_buffer + v->output_buffer_index, v->output_buffer_size);
+                v->output_buffer_index = 0;
+        }
+
+        if (!GREEDY_REALLOC(v->output_buffer, v->output_buffer_size + sizeof(header) + n))
+                return -ENOMEM;
+
+        memcpy(mempcpy(v->output_buffer + v->output_buffer_size, header, sizeof(header)), data, n);
+        v->output_buffer_size += sizeof(header) + n;
+
+        return 0;
+}
+
 static int varlink_enqueue_json(Varlink *v, JsonVariant *m) {
         _cleanup_free_ char *text = NULL;
         int r;
@@ -1248,6 +1471,9 @@ static int varlink_enqueue_json(Varlink *v, JsonVariant *m) {
         assert(v);
         assert(m);
 
+        if (v->write_binary)
+                return varlink_enqueue_binary(v, m);
+
         r = json_variant_format(m, 0, &text);
         if (r < 0)
                 return r;
@@ -1342,7 +1568,7 @@ int varlink_sendb(Varlink *v, const char *method, ...) {
         return varlink_send(v, method, parameters);
 }
 
-int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters) {
+int varlink_invoke_full(Varlink *v, const char *method, JsonVariant *parameters, VarlinkReply callback, void *userdata) {
         _cleanup_(json_variant_unrefp) JsonVariant *m = NULL;
         int r;
 
@@ -1366,17 +1592,68 @@ int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters) {
         if (r < 0)
                 return varlink_log_errno(v, r, "Failed to build json message: %m");
 
-        r = varlink_enqueue_json(v, m);
+        r = varlink_push_pending_call(v, callback, userdata, /* call= */ false, /* more= */ false);
         if (r < 0)
+                return varlink_log_errno(v, r, "Failed to allocate pending call: %m");
+
+        r = varlink_enqueue_json(v, m);
+        if (r < 0) {
+                v->n_pending--;
                 return varlink_log_errno(v, r, "Failed to enqueue json message: %m");
+        }
 
         varlink_set_state(v, VARLINK_AWAITING_REPLY);
-        v->n_pending++;
         v->timestamp = now(CLOCK_MONOTONIC);
 
         return 0;
 }
 
+int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters) {
+        return varlink_invoke_full(v, method, parameters, NULL, NULL);
+}
+
+static int set_encoding_reply(Varlink *v, JsonVariant *parameters, const char *error_id, VarlinkReplyFlags flags, void *userdata) {
+        assert(v);
+
+        if (FLAGS_SET(flags, VARLINK_REPLY_LOCAL))
+                return 0;
+
+        if (error_id) {
+                varlink_log(v, "Peer doesn't support the binary encoding (%s), continuing with JSON.", error_id);
+                return 0;
+        }
+
+        varlink_log(v, "Switching to binary encoding.");
+        v->write_binary = true;
+        return 0;
+}
+
+int varlink_negotiate_binary(Varlink *v) {
+        _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL;
+        int r;
+
+        assert_return(v, -EINVAL);
+
+        /* Asks the server to send the binary encoding from now on, and switches to it ourselves once it
+         * agreed. This is asynchronous: the request is just put in front of whatever is enqueued next, hence
+         * costs no extra round trip. */
+
+        if (v->write_binary)
+                return 0;
+
+        r = getenv_bool("SYSTEMD_VARLINK_BINARY");
+        if (r < 0 && r != -ENXIO)
+                varlink_log_errno(v, r, "Failed to parse $SYSTEMD_VARLINK_BINARY, ignoring: %m");
+        if (r == 0)
+                return 0;
+
+        r = json_build(&parameters, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("encoding", JSON_BUILD_CONST_STRING("binary"))));
+        if (r < 0)
+                return varlink_log_errno(v, r, "Failed to build json message: %m");
+
+        return varlink_invoke_full(v, VARLINK_METHOD_SET_ENCODING, parameters, set_encoding_reply, NULL);
+}
+
 int varlink_invokeb(Varlink *v, const char *method, ...) {
         _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL;
         va_list ap;
@@ -1405,8 +1682,8 @@ int varlink_observe(Varlink *v, const char *method, JsonVariant *parameters) {
                 return varlink_log_errno(v, SYNTHETIC_ERRNO(ENOTCONN), "Not connected.");
 
         /* Note that we don't allow enqueuing multiple method calls when we are in more/continues mode! We
-         * thus insist on an idle client here. */
-        if (v->state != VARLINK_IDLE_CLIENT)
+         * thus insist on a client that is idle, or only waits for regular replies. */
+        if (!IN_SET(v->state, VARLINK_IDLE_CLIENT, VARLINK_AWAITING_REPLY))
                 return varlink_log_errno(v, SYNTHETIC_ERRNO(EBUSY), "Connection busy.");
 
         r = varlink_sanitize_parameters(&parameters);
@@ -1420,12 +1697,17 @@ int varlink_observe(Varlink *v, const char *method, JsonVariant *parameters) {
         if (r < 0)
                 return varlink_log_errno(v, r, "Failed to build json message: %m");
 
-        r = varlink_enqueue_json(v, m);
+        r = varlink_push_pending_call(v, NULL, NULL, /* call= */ false, /* more= */ true);
         if (r < 0)
+                return varlink_log_errno(v, r, "Failed to allocate pending call: %m");
+
+        r = varlink_enqueue_json(v, m);
+        if (r < 0) {
+                v->n_pending--;
                 return varlink_log_errno(v, r, "Failed to enqueue json message: %m");
+        }
 
-        varlink_set_state(v, VARLINK_AWAITING_REPLY_MORE);
-        v->n_pending++;
+        varlink_set_state(v, varlink_pending_state(v));
         v->timestamp = now(CLOCK_MONOTONIC);
 
         return 0;
@@ -1464,10 +1746,11 @@ int varlink_call(
 
         if (v->state == VARLINK_DISCONNECTED)
                 return varlink_log_errno(v, SYNTHETIC_ERRNO(ENOTCONN), "Not connected.");
-        if (!IN_SET(v->state, VARLINK_IDLE_CLIENT))
-                return varlink_log_errno(v, SYNTHETIC_ERRNO(EBUSY), "Connection busy.");
 
-        assert(v->n_pending == 0); /* n_pending can't be > 0 if we are in VARLINK_IDLE_CLIENT state */
+        /* The call may be pipelined after others that were invoked before, their replies are dispatched to
+         * their callbacks while we wait for ours. */
+        if (!IN_SET(v->state, VARLINK_IDLE_CLIENT, VARLINK_AWAITING_REPLY))
+                return varlink_log_errno(v, SYNTHETIC_ERRNO(EBUSY), "Connection busy.");
 
         r = varlink_sanitize_parameters(&parameters);
         if (r < 0)
@@ -1479,15 +1762,21 @@ int varlink_call(
         if (r < 0)
                 return varlink_log_errno(v, r, "Failed to build json message: %m");
 
-        r = varlink_enqueue_json(v, m);
+        r = varlink_push_pending_call(v, NULL, NULL, /* call= */ true, /* more= */ false);
         if (r < 0)
+                return varlink_log_errno(v, r, "Failed to allocate pending call: %m");
+
+        r = varlink_enqueue_json(v, m);
+        if (r < 0) {
+                v->n_pending--;
                 return varlink_log_errno(v, r, "Failed to enqueue json message: %m");
+        }
 
-        varlink_set_state(v, VARLINK_CALLING);
-        v->n_pending++;
+        if (v->state == VARLINK_IDLE_CLIENT)
+                varlink_set_state(v, VARLINK_CALLING);
         v->timestamp = now(CLOCK_MONOTONIC);
 
-        while (v->state == VARLINK_CALLING) {
+        while (IN_SET(v->state, VARLINK_CALLING, VARLINK_AWAITING_REPLY, VARLINK_AWAITING_REPLY_MORE)) {
 
                 r = varlink_process(v);
                 if (r < 0)
@@ -1508,9 +1797,10 @@ int varlink_call(
                 json_variant_unref(v->reply);
                 v->reply = TAKE_PTR(v->current);
 
-                varlink_set_state(v, VARLINK_IDLE_CLIENT);
-                assert(v->n_pending == 1);
-                v->n_pending--;
+                assert(v->pending_calls[v->pending_calls_index].call);
+                (void) varlink_pop_pending_call(v);
+
+                varlink_set_state(v, varlink_pending_state(v));
 
                 if (ret_parameters)
                         *ret_parameters = json_variant_by_key(v->reply, "parameters");
@@ -2534,3 +2824,114 @@ int varlink_server_set_description(VarlinkServer *s, const char *description) {
 
         return free_and_strdup(&s->description, description);
 }
+
+struct VarlinkPool {
+        Hashmap *links; /* address → Varlink */
+
+        sd_event *event;
+        int64_t event_priority;
+};
+
+static Varlink* varlink_pool_close_unref(Varlink *v) {
+        if (!v)
+                return NULL;
+
+        /* Calls of others might still be pending on the connection, let them know they won't get a reply */
+        (void) varlink_dispatch_local_error(v, VARLINK_ERROR_DISCONNECTED);
+
+        return varlink_close_unref(v);
+}
+
+DEFINE_PRIVATE_HASH_OPS_FULL(varlink_pool_hash_ops, char, string_hash_func, string_compare_func, free,
+                             Varlink, varlink_pool_close_unref);
+
+int varlink_pool_new(VarlinkPool **ret) {
+        VarlinkPool *p;
+
+        assert_return(ret, -EINVAL);
+
+        p = new0(VarlinkPool, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *ret = p;
+        return 0;
+}
+
+VarlinkPool* varlink_pool_free(VarlinkPool *p) {
+        if (!p)
+                return NULL;
+
+        hashmap_free(p->links);
+        sd_event_unref(p->event);
+        return mfree(p);
+}
+
+int varlink_pool_attach_event(VarlinkPool *p, sd_event *e, int64_t priority) {
+        assert_return(p, -EINVAL);
+        assert_return(e, -EINVAL);
+        assert_return(!p->event, -EBUSY);
+        assert_return(hashmap_isempty(p->links), -EBUSY);
+
+        p->event = sd_event_ref(e);
+        p->event_priority = priority;
+        return 0;
+}
+
+static bool varlink_is_reusable(Varlink *v) {
+        assert(v);
+
+        /* Only connections we can put further calls on right away and which the peer didn't hang up on
+         * yet. Notably, a connection some observer is still subscribed on via varlink_observe() is not. */
+        return IN_SET(v->state, VARLINK_IDLE_CLIENT, VARLINK_AWAITING_REPLY) &&
+                !v->read_disconnected &&
+                !v->write_disconnected &&
+                !v->got_pollhup;
+}
+
+int varlink_pool_get(VarlinkPool *p, const char *address, Varlink **ret) {
+        _cleanup_(varlink_close_unrefp) Varlink *v = NULL;
+        _cleanup_free_ char *a = NULL;
+        Varlink *existing;
+        int r;
+
+        assert_return(p, -EINVAL);
+        assert_return(address, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        existing = hashmap_get(p->links, address);
+        if (existing) {
+                if (varlink_is_reusable(existing)) {
+                        *ret = varlink_ref(existing);
+                        return 0;
+                }
+
+                /* Drop the connection that went bad, and get a new one */
+                varlink_pool_close_unref(hashmap_remove2(p->links, address, (void**) &a));
+                a = mfree(a);
+        }
+
+        r = varlink_connect_address(&v, address);
+        if (r < 0)
+                return r;
+
+        (void) varlink_set_description(v, address);
+
+        if (p->event) {
+                r = varlink_attach_event(v, p->event, p->event_priority);
+                if (r < 0)
+                        return r;
+        }
+
+        a = strdup(address);
+        if (!a)
+                return -ENOMEM;
+
+        r = hashmap_ensure_put(&p->links, &varlink_pool_hash_ops, a, v);
+        if (r < 0)
+                return r;
+        TAKE_PTR(a);
+
+        *ret = varlink_ref(TAKE_PTR(v));
+        return 1;
+}
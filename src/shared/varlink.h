@@ -28,6 +28,7 @@
 
 typedef struct Varlink Varlink;
 typedef struct VarlinkServer VarlinkServer;
+typedef struct VarlinkPool VarlinkPool;
 
 typedef enum VarlinkReplyFlags {
         VARLINK_REPLY_ERROR     = 1 << 0,
@@ -81,13 +82,21 @@ Varlink* varlink_close_unref(Varlink *v);
 int varlink_send(Varlink *v, const char *method, JsonVariant *parameters);
 int varlink_sendb(Varlink *v, const char *method, ...);
 
-/* Send method call and wait for reply */
+/* Send method call and wait for reply. Calls invoked earlier on the same connection that are still pending
+ * are dispatched to their reply callbacks meanwhile. */
 int varlink_call(Varlink *v, const char *method, JsonVariant *parameters, JsonVariant **ret_parameters, const char **ret_error_id, VarlinkReplyFlags *ret_flags);
 int varlink_callb(Varlink *v, const char *method, JsonVariant **ret_parameters, const char **ret_error_id, VarlinkReplyFlags *ret_flags, ...);
 
 /* Enqueue method call, expect a reply, which is eventually delivered to the reply callback */
 int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters);
 int varlink_invokeb(Varlink *v, const char *method, ...);
+/* Same, but the reply is delivered to the specified callback instead. Any number of calls may be pipelined
+ * this way on a single connection, their replies are dispatched in the order the calls were enqueued. */
+int varlink_invoke_full(Varlink *v, const char *method, JsonVariant *parameters, VarlinkReply callback, void *userdata);
+
+/* Enqueue a request to switch to the more efficient binary encoding, both ways, in case the server supports
+ * it. Doesn't wait for the reply. */
+int varlink_negotiate_binary(Varlink *v);
 
 /* Enqueue method call, expect a reply now, and possibly more later, which are all delivered to the reply callback */
 int varlink_observe(Varlink *v, const char *method, JsonVariant *parameters);
@@ -158,10 +167,20 @@ unsigned varlink_server_current_connections(VarlinkServer *s);
 
 int varlink_server_set_description(VarlinkServer *s, const char *description);
 
+/* Keeps one client connection per address around, to be shared by everybody pipelining calls on it via
+ * varlink_call() or varlink_invoke_full(). Users of pooled connections hence must not bind a reply callback
+ * or userdata to them. Returns a new reference to a usable connection, and reconnects if the previous one
+ * went away. */
+int varlink_pool_new(VarlinkPool **ret);
+VarlinkPool* varlink_pool_free(VarlinkPool *p);
+int varlink_pool_attach_event(VarlinkPool *p, sd_event *e, int64_t priority);
+int varlink_pool_get(VarlinkPool *p, const char *address, Varlink **ret);
+
 DEFINE_TRIVIAL_CLEANUP_FUNC(Varlink *, varlink_unref);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Varlink *, varlink_close_unref);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Varlink *, varlink_flush_close_unref);
 DEFINE_TRIVIAL_CLEANUP_FUNC(VarlinkServer *, varlink_server_unref);
+DEFINE_TRIVIAL_CLEANUP_FUNC(VarlinkPool *, varlink_pool_free);
 
 #define VARLINK_ERROR_DISCONNECTED "io.systemd.Disconnected"
 #define VARLINK_ERROR_TIMEOUT "io.systemd.TimedOut"
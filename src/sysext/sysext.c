@@ -20,6 +20,7 @@
 #include "format-table.h"
 #include "fs-util.h"
 #include "hashmap.h"
+#include "hexdecoct.h"
 #include "log.h"
 #include "main-func.h"
 #include "missing_magic.h"
@@ -32,6 +33,7 @@
 #include "parse-util.h"
 #include "pretty-print.h"
 #include "process-util.h"
+#include "sha256.h"
 #include "sort-util.h"
 #include "terminal-util.h"
 #include "user-util.h"
@@ -277,6 +279,7 @@ static int merge_hierarchy(
                 const char *hierarchy,
                 char **extensions,
                 char **paths,
+                const char *fingerprint,
                 const char *meta_path,
                 const char *overlay_path) {
 
@@ -390,6 +393,19 @@ static int merge_hierarchy(
         if (r < 0)
                 return log_error_errno(r, "Failed to write '%s': %m", f);
 
+        /* Remember what went into this merge, so that a later refresh can tell whether there's anything to
+         * do at all. */
+        if (fingerprint) {
+                free(f);
+                f = path_join(meta_path, ".systemd-sysext/fingerprint");
+                if (!f)
+                        return log_oom();
+
+                r = write_string_file(f, fingerprint, WRITE_STRING_FILE_CREATE);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to write '%s': %m", f);
+        }
+
         /* Make sure the top-level dir has an mtime marking the point we established the merge */
         if (utimensat(AT_FDCWD, meta_path, NULL, AT_SYMLINK_NOFOLLOW) < 0)
                 return log_error_errno(r, "Failed fix mtime of '%s': %m", meta_path);
@@ -443,7 +459,7 @@ static int validate_version(
         return r;
 }
 
-static int merge_subprocess(Hashmap *images, const char *workspace) {
+static int merge_subprocess(Hashmap *images, const char *fingerprint, const char *workspace) {
         _cleanup_free_ char *host_os_release_id = NULL, *host_os_release_version_id = NULL, *host_os_release_sysext_level = NULL,
                 *buf = NULL;
         _cleanup_strv_free_ char **extensions = NULL, **paths = NULL;
@@ -675,7 +691,7 @@ static int merge_subprocess(Hashmap *images, const char *workspace) {
                 if (!overlay_path)
                         return log_oom();
 
-                r = merge_hierarchy(*h, extensions, paths, meta_path, overlay_path);
+                r = merge_hierarchy(*h, extensions, paths, fingerprint, meta_path, overlay_path);
                 if (r < 0)
                         return r;
         }
@@ -714,7 +730,7 @@ static int merge_subprocess(Hashmap *images, const char *workspace) {
         return 1;
 }
 
-static int merge(Hashmap *images) {
+static int merge(Hashmap *images, const char *fingerprint) {
         pid_t pid;
         int r;
 
@@ -724,7 +740,7 @@ static int merge(Hashmap *images) {
         if (r == 0) {
                 /* Child with its own mount namespace */
 
-                r = merge_subprocess(images, "/run/systemd/sysext");
+                r = merge_subprocess(images, fingerprint, "/run/systemd/sysext");
                 if (r < 0)
                         _exit(EXIT_FAILURE);
 
@@ -741,6 +757,129 @@ static int merge(Hashmap *images) {
         return r != 123; /* exit code 123 means: didn't do anything */
 }
 
+static int extensions_fingerprint(Hashmap *images, char **ret) {
+        _cleanup_free_ char *host_os_release_id = NULL, *host_os_release_version_id = NULL, *host_os_release_sysext_level = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        struct sha256_ctx ctx;
+        char *s;
+        Image *img;
+        int r;
+
+        assert(ret);
+
+        /* Calculates a digest of everything that determines the outcome of a merge: the host's OS release
+         * data the extensions are validated against, the merge settings, and the identity of each
+         * extension. Images are identified by inode, size and timestamps rather than by their contents,
+         * which would be way too expensive to hash. For directory extensions we also include the
+         * extension-release data, so that bumping the version in place is noticed too. */
+
+        r = parse_os_release(
+                        arg_root,
+                        "ID", &host_os_release_id,
+                        "VERSION_ID", &host_os_release_version_id,
+                        "SYSEXT_LEVEL", &host_os_release_sysext_level);
+        if (r < 0)
+                return log_error_errno(r, "Failed to acquire 'os-release' data of OS tree '%s': %m", empty_to_root(arg_root));
+
+        HASHMAP_FOREACH(img, images)
+                if (strv_extend(&names, img->name) < 0)
+                        return log_oom();
+
+        strv_sort(names);
+
+        sha256_init_ctx(&ctx);
+
+        sha256_process_bytes(strempty(host_os_release_id), strlen(strempty(host_os_release_id)) + 1, &ctx);
+        sha256_process_bytes(strempty(host_os_release_version_id), strlen(strempty(host_os_release_version_id)) + 1, &ctx);
+        sha256_process_bytes(strempty(host_os_release_sysext_level), strlen(strempty(host_os_release_sysext_level)) + 1, &ctx);
+        sha256_process_bytes(&arg_force, sizeof(arg_force), &ctx);
+
+        STRV_FOREACH(h, arg_hierarchies)
+                sha256_process_bytes(*h, strlen(*h) + 1, &ctx);
+
+        STRV_FOREACH(n, names) {
+                struct stat st;
+                uint64_t v[6];
+
+                assert_se(img = hashmap_get(images, *n));
+
+                if (stat(img->path, &st) < 0)
+                        return log_error_errno(errno, "Failed to stat '%s': %m", img->path);
+
+                v[0] = st.st_dev;
+                v[1] = st.st_ino;
+                v[2] = st.st_size;
+                v[3] = timespec_load_nsec(&st.st_mtim);
+                v[4] = timespec_load_nsec(&st.st_ctim);
+                v[5] = img->type;
+
+                sha256_process_bytes(img->name, strlen(img->name) + 1, &ctx);
+                sha256_process_bytes(img->path, strlen(img->path) + 1, &ctx);
+                sha256_process_bytes(v, sizeof(v), &ctx);
+
+                STRV_FOREACH(e, img->extension_release)
+                        sha256_process_bytes(*e, strlen(*e) + 1, &ctx);
+        }
+
+        sha256_finish_ctx(&ctx, digest);
+
+        s = hexmem(digest, sizeof(digest));
+        if (!s)
+                return log_oom();
+
+        *ret = s;
+        return 0;
+}
+
+static int merged_fingerprint_matches(const char *fingerprint) {
+        bool found = false;
+        int r;
+
+        assert(fingerprint);
+
+        /* Returns > 0 if the hierarchies are currently merged from exactly the set of extensions described
+         * by the fingerprint, and 0 if there's anything to do, i.e. if nothing is merged, or if any of the
+         * merged hierarchies was created from a different set. */
+
+        STRV_FOREACH(p, arg_hierarchies) {
+                _cleanup_free_ char *resolved = NULL, *f = NULL, *buf = NULL;
+
+                r = chase_symlinks(*p, arg_root, CHASE_PREFIX_ROOT, &resolved, NULL);
+                if (r == -ENOENT)
+                        continue;
+                if (r < 0)
+                        return log_error_errno(r, "Failed to resolve path to hierarchy '%s%s': %m", strempty(arg_root), *p);
+
+                r = is_our_mount_point(resolved);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                f = path_join(resolved, ".systemd-sysext/fingerprint");
+                if (!f)
+                        return log_oom();
+
+                r = read_one_line_file(f, &buf);
+                if (r == -ENOENT) {
+                        log_debug("Hierarchy '%s' carries no fingerprint, need to refresh.", resolved);
+                        return 0;
+                }
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read '%s': %m", f);
+
+                if (!streq(buf, fingerprint)) {
+                        log_debug("Set of extensions merged into '%s' changed, need to refresh.", resolved);
+                        return 0;
+                }
+
+                found = true;
+        }
+
+        return found;
+}
+
 static int image_discover_and_read_metadata(Hashmap **ret_images) {
         _cleanup_(hashmap_freep) Hashmap *images = NULL;
         Image *img;
@@ -769,6 +908,7 @@ static int image_discover_and_read_metadata(Hashmap **ret_images) {
 
 static int verb_merge(int argc, char **argv, void *userdata) {
         _cleanup_(hashmap_freep) Hashmap *images = NULL;
+        _cleanup_free_ char *fingerprint = NULL;
         int r;
 
         if (!have_effective_cap(CAP_SYS_ADMIN))
@@ -799,11 +939,16 @@ static int verb_merge(int argc, char **argv, void *userdata) {
                                                "Hierarchy '%s' is already merged.", *p);
         }
 
-        return merge(images);
+        r = extensions_fingerprint(images, &fingerprint);
+        if (r < 0)
+                return r;
+
+        return merge(images, fingerprint);
 }
 
 static int verb_refresh(int argc, char **argv, void *userdata) {
         _cleanup_(hashmap_freep) Hashmap *images = NULL;
+        _cleanup_free_ char *fingerprint = NULL;
         int r;
 
         if (!have_effective_cap(CAP_SYS_ADMIN))
@@ -813,7 +958,21 @@ static int verb_refresh(int argc, char **argv, void *userdata) {
         if (r < 0)
                 return r;
 
-        r = merge(images); /* Returns > 0 if it did something, i.e. a new overlayfs is mounted now. When it
+        r = extensions_fingerprint(images, &fingerprint);
+        if (r < 0)
+                return r;
+
+        /* If everything is merged already from the very same set of extensions, there's no point in tearing
+         * down and rebuilding the overlayfs stack, which is visible to all processes on the host. */
+        r = merged_fingerprint_matches(fingerprint);
+        if (r < 0)
+                return r;
+        if (r > 0) {
+                log_info("Set of extensions unchanged, not refreshing.");
+                return 0;
+        }
+
+        r = merge(images, fingerprint); /* Returns > 0 if it did something, i.e. a new overlayfs is mounted now. When it
                             * does so it implicitly unmounts any overlayfs placed there before. Returns == 0
                             * if it did nothing, i.e. no extension images found. In this case the old
                             * overlayfs remains in place if there was one. */
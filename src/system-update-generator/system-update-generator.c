@@ -9,6 +9,7 @@
 #include "proc-cmdline.h"
 #include "special.h"
 #include "string-util.h"
+#include "strv.h"
 #include "unit-file.h"
 #include "util.h"
 
@@ -57,6 +58,8 @@ static int run(const char *dest, const char *dest_early, const char *dest_late)
 
         assert_se(arg_dest = dest_early);
 
+        (void) generator_declare_inputs(STRV_MAKE("/system-update"));
+
         r = generate_symlink();
         if (r <= 0)
                 return r;
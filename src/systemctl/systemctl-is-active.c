@@ -1,21 +1,82 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include "alloc-util.h"
 #include "bus-error.h"
 #include "bus-locator.h"
+#include "glob-util.h"
 #include "pretty-print.h"
 #include "syslog-util.h"
 #include "systemctl-is-active.h"
 #include "systemctl-sysv-compat.h"
 #include "systemctl-util.h"
 #include "systemctl.h"
+#include "unit-state-table.h"
+
+static int get_states_from_table(char **args, UnitActiveState **ret) {
+        _cleanup_free_ UnitActiveState *states = NULL;
+        size_t n = 0;
+        int r;
+
+        assert(ret);
+
+        /* Looks up the states in the table published by the system service manager, so that PID 1 is not
+         * woken up at all. Returns -EAGAIN if we need to go through the bus instead, because a name is a
+         * glob or is not in the table. */
+
+        if (arg_transport != BUS_TRANSPORT_LOCAL || arg_scope != LOOKUP_SCOPE_SYSTEM)
+                return -EAGAIN;
+
+        states = new(UnitActiveState, strv_length(args));
+        if (!states)
+                return log_oom();
+
+        STRV_FOREACH(name, args) {
+                _cleanup_free_ char *mangled = NULL;
+                UnitStateTableEntry e;
+
+                /* No warnings here, expand_unit_names() will log them if we fall back to the bus. */
+                r = unit_name_mangle_with_suffix(*name, NULL, UNIT_NAME_MANGLE_GLOB, ".service", &mangled);
+                if (r < 0 || string_is_glob(mangled))
+                        return -EAGAIN;
+
+                r = unit_state_table_lookup(UNIT_STATE_TABLE_PATH, mangled, &e);
+                if (r < 0) {
+                        if (r != -ENOENT)
+                                log_debug_errno(r, "Failed to look up %s in unit state table, using the bus: %m", mangled);
+                        return -EAGAIN;
+                }
+
+                states[n++] = e.active_state;
+        }
+
+        *ret = TAKE_PTR(states);
+        return 0;
+}
 
 static int check_unit_generic(int code, const UnitActiveState good_states[], int nb_states, char **args) {
         _cleanup_strv_free_ char **names = NULL;
+        _cleanup_free_ UnitActiveState *states = NULL;
         UnitActiveState active_state;
         sd_bus *bus;
         int r;
         bool found = false;
 
+        r = get_states_from_table(args, &states);
+        if (r >= 0) {
+                for (size_t i = 0; args[i]; i++) {
+                        if (!arg_quiet)
+                                puts(unit_active_state_to_string(states[i]));
+
+                        for (int j = 0; j < nb_states; ++j)
+                                if (good_states[j] == states[i])
+                                        found = true;
+                }
+
+                return found ? 0 : code;
+        }
+        if (r != -EAGAIN)
+                return r;
+
         r = acquire_bus(BUS_MANAGER, &bus);
         if (r < 0)
                 return r;
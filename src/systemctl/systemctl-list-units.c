@@ -12,10 +12,6 @@
 #include "systemctl.h"
 #include "terminal-util.h"
 
-static void message_set_freep(Set **set) {
-        set_free_with_destructor(*set, sd_bus_message_unref);
-}
-
 static int get_unit_list_recursive(
                 sd_bus *bus,
                 char **patterns,
@@ -25,7 +21,6 @@ static int get_unit_list_recursive(
 
         _cleanup_free_ UnitInfo *unit_infos = NULL;
         _cleanup_(message_set_freep) Set *replies = NULL;
-        sd_bus_message *reply;
         int c, r;
 
         assert(bus);
@@ -37,16 +32,10 @@ static int get_unit_list_recursive(
         if (!replies)
                 return log_oom();
 
-        c = get_unit_list(bus, NULL, patterns, &unit_infos, 0, &reply);
+        c = get_unit_list(bus, NULL, patterns, &unit_infos, 0, replies);
         if (c < 0)
                 return c;
 
-        r = set_put(replies, reply);
-        if (r < 0) {
-                sd_bus_message_unref(reply);
-                return log_oom();
-        }
-
         if (arg_recursive) {
                 _cleanup_strv_free_ char **machines = NULL;
 
@@ -64,17 +53,11 @@ static int get_unit_list_recursive(
                                 continue;
                         }
 
-                        k = get_unit_list(container, *i, patterns, &unit_infos, c, &reply);
+                        k = get_unit_list(container, *i, patterns, &unit_infos, c, replies);
                         if (k < 0)
                                 return k;
 
                         c = k;
-
-                        r = set_put(replies, reply);
-                        if (r < 0) {
-                                sd_bus_message_unref(reply);
-                                return log_oom();
-                        }
                 }
 
                 *ret_machines = TAKE_PTR(machines);
@@ -2071,12 +2071,16 @@ static int show_all(
                 bool *new_line,
                 bool *ellipsized) {
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(message_set_freep) Set *replies = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
         unsigned c;
         int r, ret = 0;
 
-        r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, &reply);
+        replies = set_new(NULL);
+        if (!replies)
+                return log_oom();
+
+        r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, replies);
         if (r < 0)
                 return r;
 
@@ -28,6 +28,9 @@
 #include "terminal-util.h"
 #include "verbs.h"
 
+/* How many units to request from the manager at a time */
+#define UNIT_LIST_PAGE_SIZE 1000U
+
 static sd_bus *buses[_BUS_FOCUS_MAX] = {};
 
 int acquire_bus(BusFocus focus, sd_bus **ret) {
@@ -148,24 +151,151 @@ int get_state_one_unit(sd_bus *bus, const char *unit, UnitActiveState *ret_activ
         return 0;
 }
 
+void message_set_freep(Set **set) {
+        set_free_with_destructor(*set, sd_bus_message_unref);
+}
+
+static int parse_unit_list(
+                sd_bus_message *reply,
+                const char *machine,
+                char **patterns,
+                UnitInfo **unit_infos,
+                int c,
+                size_t *ret_n,
+                const char **ret_last) {
+
+        const char *last = NULL;
+        size_t n = 0;
+        int r;
+
+        assert(reply);
+        assert(unit_infos);
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(ssssssouso)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (;;) {
+                UnitInfo u;
+
+                r = bus_parse_unit_info(reply, &u);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0)
+                        break;
+
+                n++;
+                last = u.id;
+
+                u.machine = machine;
+
+                if (!output_show_unit(&u, patterns))
+                        continue;
+
+                if (!GREEDY_REALLOC(*unit_infos, c+1))
+                        return log_oom();
+
+                (*unit_infos)[c++] = u;
+        }
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        if (ret_n)
+                *ret_n = n;
+        if (ret_last)
+                *ret_last = last;
+
+        return c;
+}
+
+static int get_unit_list_paged(
+                sd_bus *bus,
+                const char *machine,
+                char **patterns,
+                UnitInfo **unit_infos,
+                int c,
+                Set *replies) {
+
+        const char *after = "";
+        int r;
+
+        assert(bus);
+        assert(replies);
+
+        /* Fetch the unit list in batches, so that the manager doesn't have to build one huge reply. Returns
+         * -EOPNOTSUPP without logging if the manager doesn't support this. */
+
+        for (;;) {
+                _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+                size_t n;
+
+                r = bus_message_new_method_call(bus, &m, bus_systemd_mgr, "ListUnitsPaged");
+                if (r < 0)
+                        return bus_log_create_error(r);
+
+                r = sd_bus_message_append_strv(m, arg_states);
+                if (r < 0)
+                        return bus_log_create_error(r);
+
+                r = sd_bus_message_append_strv(m, patterns);
+                if (r < 0)
+                        return bus_log_create_error(r);
+
+                r = sd_bus_message_append(m, "su", after, (uint32_t) UNIT_LIST_PAGE_SIZE);
+                if (r < 0)
+                        return bus_log_create_error(r);
+
+                r = sd_bus_call(bus, m, 0, &error, &reply);
+                if (r < 0 && isempty(after) &&
+                    sd_bus_error_has_names(&error, SD_BUS_ERROR_UNKNOWN_METHOD, SD_BUS_ERROR_ACCESS_DENIED)) {
+                        log_debug_errno(r, "Failed to list units: %s Falling back to ListUnitsByPatterns method.",
+                                        bus_error_message(&error, r));
+                        return -EOPNOTSUPP;
+                }
+                if (r < 0)
+                        return log_error_errno(r, "Failed to list units: %s", bus_error_message(&error, r));
+
+                c = parse_unit_list(reply, machine, NULL, unit_infos, c, &n, &after);
+                if (c < 0)
+                        return c;
+
+                /* The unit infos point into the reply, keep it around */
+                r = set_put(replies, reply);
+                if (r < 0)
+                        return log_oom();
+                TAKE_PTR(reply);
+
+                if (n < UNIT_LIST_PAGE_SIZE)
+                        return c;
+        }
+}
+
 int get_unit_list(
                 sd_bus *bus,
                 const char *machine,
                 char **patterns,
                 UnitInfo **unit_infos,
                 int c,
-                sd_bus_message **ret_reply) {
+                Set *replies) {
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
-        int r;
         bool fallback = false;
+        int r;
 
         assert(bus);
         assert(unit_infos);
-        assert(ret_reply);
+        assert(replies);
 
+        r = get_unit_list_paged(bus, machine, patterns, unit_infos, c, replies);
+        if (r != -EOPNOTSUPP)
+                return r;
+
+        /* Fallback to ListUnitsByPatterns method, for older managers */
         r = bus_message_new_method_call(bus, &m, bus_systemd_mgr, "ListUnitsByPatterns");
         if (r < 0)
                 return bus_log_create_error(r);
@@ -200,35 +330,15 @@ int get_unit_list(
         if (r < 0)
                 return log_error_errno(r, "Failed to list units: %s", bus_error_message(&error, r));
 
-        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(ssssssouso)");
-        if (r < 0)
-                return bus_log_parse_error(r);
-
-        for (;;) {
-                UnitInfo u;
-
-                r = bus_parse_unit_info(reply, &u);
-                if (r < 0)
-                        return bus_log_parse_error(r);
-                if (r == 0)
-                        break;
-
-                u.machine = machine;
-
-                if (!output_show_unit(&u, fallback ? patterns : NULL))
-                        continue;
-
-                if (!GREEDY_REALLOC(*unit_infos, c+1))
-                        return log_oom();
-
-                (*unit_infos)[c++] = u;
-        }
+        c = parse_unit_list(reply, machine, fallback ? patterns : NULL, unit_infos, c, NULL, NULL);
+        if (c < 0)
+                return c;
 
-        r = sd_bus_message_exit_container(reply);
+        r = set_put(replies, reply);
         if (r < 0)
-                return bus_log_parse_error(r);
+                return log_oom();
+        TAKE_PTR(reply);
 
-        *ret_reply = TAKE_PTR(reply);
         return c;
 }
 
@@ -258,11 +368,15 @@ int expand_unit_names(sd_bus *bus, char **names, const char* suffix, char ***ret
         /* Query the manager only if any of the names are a glob, since this is fairly expensive */
         bool expanded = !strv_isempty(globs);
         if (expanded) {
-                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+                _cleanup_(message_set_freep) Set *replies = NULL;
                 _cleanup_free_ UnitInfo *unit_infos = NULL;
                 size_t n;
 
-                r = get_unit_list(bus, NULL, globs, &unit_infos, 0, &reply);
+                replies = set_new(NULL);
+                if (!replies)
+                        return log_oom();
+
+                r = get_unit_list(bus, NULL, globs, &unit_infos, 0, replies);
                 if (r < 0)
                         return r;
 
@@ -505,7 +619,9 @@ int unit_find_paths(
                 _cleanup_set_free_free_ Set *names = NULL;
 
                 if (!*cached_name_map) {
-                        r = unit_file_build_name_map(lp, NULL, cached_id_map, cached_name_map, NULL);
+                        r = unit_file_build_name_map(lp,
+                                                     arg_scope == LOOKUP_SCOPE_SYSTEM && !arg_root ? UNIT_NAME_MAP_CACHE_PATH : NULL,
+                                                     NULL, cached_id_map, cached_name_map, NULL);
                         if (r < 0)
                                 return r;
                 }
@@ -521,7 +637,7 @@ int unit_find_paths(
                 }
 
                 if (ret_dropin_paths) {
-                        r = unit_file_find_dropin_paths(arg_root, lp->search_path, NULL,
+                        r = unit_file_find_dropin_paths(arg_root, lp->search_path, NULL, NULL,
                                                         ".d", ".conf",
                                                         NULL, names, &dropins);
                         if (r < 0)
@@ -5,6 +5,7 @@
 
 #include "bus-unit-util.h"
 #include "format-table.h"
+#include "set.h"
 #include "systemctl.h"
 
 typedef enum BusFocus {
@@ -22,7 +23,8 @@ void polkit_agent_open_maybe(void);
 int translate_bus_error_to_exit_status(int r, const sd_bus_error *error);
 
 int get_state_one_unit(sd_bus *bus, const char *name, UnitActiveState *ret_active_state);
-int get_unit_list(sd_bus *bus, const char *machine, char **patterns, UnitInfo **unit_infos, int c, sd_bus_message **ret_reply);
+void message_set_freep(Set **set);
+int get_unit_list(sd_bus *bus, const char *machine, char **patterns, UnitInfo **unit_infos, int c, Set *replies);
 int expand_unit_names(sd_bus *bus, char **names, const char* suffix, char ***ret, bool *ret_expanded);
 
 int check_triggering_units(sd_bus *bus, const char *unit);
@@ -58,6 +58,8 @@ int sd_journal_perror_with_location(const char *file, const char *line, const ch
 
 int sd_journal_stream_fd(const char *identifier, int priority, int level_prefix);
 
+int sd_journal_enable_ring(size_t size);
+
 /* Browse journal stream */
 
 typedef struct sd_journal sd_journal;
@@ -71,6 +73,7 @@ enum {
         SD_JOURNAL_OS_ROOT                   = 1 << 4,
         SD_JOURNAL_ALL_NAMESPACES            = 1 << 5, /* Show all namespaces, not just the default or specified one */
         SD_JOURNAL_INCLUDE_DEFAULT_NAMESPACE = 1 << 6, /* Show default namespace in addition to specified one */
+        SD_JOURNAL_PREAD                     = 1 << 7, /* Read journal files with pread() instead of mmap() */
 
         SD_JOURNAL_SYSTEM_ONLY _sd_deprecated_ = SD_JOURNAL_SYSTEM /* old name */
 };
@@ -107,6 +110,8 @@ int sd_journal_get_data(sd_journal *j, const char *field, const void **data, siz
 int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t *l);
 int sd_journal_enumerate_available_data(sd_journal *j, const void **data, size_t *l);
 void sd_journal_restart_data(sd_journal *j);
+int sd_journal_enumerate_borrowed_data(sd_journal *j, const void **data, size_t *l);
+int sd_journal_get_borrowed_data(sd_journal *j, const char * const *fields, size_t n_fields, const void **data, size_t *l);
 
 int sd_journal_add_match(sd_journal *j, const void *data, size_t size);
 int sd_journal_add_disjunction(sd_journal *j);
@@ -45,6 +45,9 @@ _SD_BEGIN_DECLARATIONS;
 #define SD_MESSAGE_TRUNCATED_CORE_STR     SD_ID128_MAKE_STR(5a,ad,d8,e9,54,dc,4b,1a,8c,95,4d,63,fd,9e,11,37)
 #define SD_MESSAGE_BACKTRACE              SD_ID128_MAKE(1f,4e,0a,44,a8,86,49,93,9a,ae,a3,4f,c6,da,8c,95)
 #define SD_MESSAGE_BACKTRACE_STR          SD_ID128_MAKE_STR(1f,4e,0a,44,a8,86,49,93,9a,ae,a3,4f,c6,da,8c,95)
+#define SD_MESSAGE_COREDUMP_STACKTRACE    SD_ID128_MAKE(76,d4,25,09,e5,0e,43,cc,81,e4,5e,29,f4,38,c6,3b)
+#define SD_MESSAGE_COREDUMP_STACKTRACE_STR \
+                                          SD_ID128_MAKE_STR(76,d4,25,09,e5,0e,43,cc,81,e4,5e,29,f4,38,c6,3b)
 
 #define SD_MESSAGE_SESSION_START          SD_ID128_MAKE(8d,45,62,0c,1a,43,48,db,b1,74,10,da,57,c6,0c,66)
 #define SD_MESSAGE_SESSION_START_STR      SD_ID128_MAKE_STR(8d,45,62,0c,1a,43,48,db,b1,74,10,da,57,c6,0c,66)
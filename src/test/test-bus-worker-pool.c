@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sd-bus.h"
+#include "sd-event.h"
+
+#include "bus-worker-pool.h"
+#include "random-util.h"
+#include "tests.h"
+
+/* Issues a bunch of calls from two clients at once, each of which is handled in the worker pool with a random
+ * delay, and checks that every client gets its replies in order and with the right result. */
+
+#define N_CLIENTS 2U
+#define N_CALLS 200U
+
+typedef struct Square {
+        uint32_t x;
+        uint64_t result;
+} Square;
+
+typedef struct Client {
+        sd_bus *bus;
+        sd_bus *server;
+        unsigned n_replies;
+} Client;
+
+static unsigned n_done = 0;
+
+static int work_square(void *userdata) {
+        Square *s = ASSERT_PTR(userdata);
+
+        /* Make sure later calls regularly finish before earlier ones, if they were not ordered */
+        (void) usleep(random_u64_range(500));
+
+        s->result = (uint64_t) s->x * s->x;
+        return 0;
+}
+
+static int done_square(sd_bus_message *m, int result, void *userdata) {
+        Square *s = ASSERT_PTR(userdata);
+
+        assert_se(result == 0);
+
+        return sd_bus_reply_method_return(m, "t", s->result);
+}
+
+static int method_square(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        BusWorkerPool *p = ASSERT_PTR(userdata);
+        _cleanup_free_ Square *s = NULL;
+        int r;
+
+        s = new0(Square, 1);
+        if (!s)
+                return -ENOMEM;
+
+        r = sd_bus_message_read(m, "u", &s->x);
+        if (r < 0)
+                return r;
+
+        r = bus_worker_pool_submit(p, m, work_square, done_square, s, free);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(s);
+        return 1;
+}
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Square", "u", "t", method_square, 0),
+        SD_BUS_VTABLE_END,
+};
+
+static int on_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        Client *c = ASSERT_PTR(userdata);
+        uint64_t result;
+
+        assert_se(!sd_bus_message_is_method_error(m, NULL));
+        assert_se(sd_bus_message_read(m, "t", &result) >= 0);
+        assert_se(result == (uint64_t) c->n_replies * c->n_replies);
+
+        c->n_replies++;
+        if (c->n_replies == N_CALLS && ++n_done == N_CLIENTS)
+                return sd_event_exit(sd_bus_get_event(sd_bus_message_get_bus(m)), 0);
+
+        return 0;
+}
+
+static void client_setup(Client *c, sd_event *e, BusWorkerPool *p) {
+        sd_id128_t id;
+        int fds[2];
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, fds) >= 0);
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&c->server) >= 0);
+        assert_se(sd_bus_set_fd(c->server, fds[0], fds[0]) >= 0);
+        assert_se(sd_bus_set_server(c->server, 1, id) >= 0);
+        assert_se(sd_bus_add_object_vtable(c->server, NULL, "/test", "org.freedesktop.systemd.test", vtable, p) >= 0);
+        assert_se(sd_bus_attach_event(c->server, e, SD_EVENT_PRIORITY_NORMAL) >= 0);
+        assert_se(sd_bus_start(c->server) >= 0);
+
+        assert_se(sd_bus_new(&c->bus) >= 0);
+        assert_se(sd_bus_set_fd(c->bus, fds[1], fds[1]) >= 0);
+        assert_se(sd_bus_attach_event(c->bus, e, SD_EVENT_PRIORITY_NORMAL) >= 0);
+        assert_se(sd_bus_start(c->bus) >= 0);
+
+        for (unsigned i = 0; i < N_CALLS; i++)
+                assert_se(sd_bus_call_method_async(c->bus, NULL, NULL, "/test", "org.freedesktop.systemd.test",
+                                                   "Square", on_reply, c, "u", i) >= 0);
+}
+
+TEST(worker_pool) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(bus_worker_pool_freep) BusWorkerPool *p = NULL;
+        Client clients[N_CLIENTS] = {};
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(bus_worker_pool_new(e, 4, &p) >= 0);
+
+        for (unsigned i = 0; i < N_CLIENTS; i++)
+                client_setup(clients + i, e, p);
+
+        assert_se(sd_event_loop(e) >= 0);
+
+        for (unsigned i = 0; i < N_CLIENTS; i++) {
+                assert_se(clients[i].n_replies == N_CALLS);
+
+                sd_bus_flush_close_unref(clients[i].bus);
+                sd_bus_flush_close_unref(clients[i].server);
+        }
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
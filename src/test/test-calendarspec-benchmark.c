@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "calendarspec.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Measures how long it takes to calculate the next elapse of typical calendar specs, i.e. what PID 1 does
+ * for every timer unit at boot and after the clock or the time zone changed. Most of these are taken from
+ * test-calendarspec.c. SYSTEMD_SLOW_TESTS=1 calculates more elapses per spec. */
+
+static const char *const specs[] = {
+        "minutely",
+        "hourly",
+        "daily",
+        "weekly",
+        "monthly",
+        "quarterly",
+        "annually",
+        "Mon..Fri *-*-* 08:00:00",
+        "Sat,Sun 08:05:40",
+        "*:2/3",
+        "*:20..39/5",
+        "9..11,13:00,30",
+        "*:4,30:0..3",
+        "00:00:01/2,02..03",
+        "*-*-* 02:30:00 Europe/Berlin",
+        "Mon,Fri *-*-3,1,2 *:30:45",
+        "mon,fri *-1/2-1,3 *:30:45",
+        "*-*~1",
+        "*-*-01/5 04:00:00 UTC",
+        "Sun *-*-* 01:00:00",
+};
+
+/* Start at the same point in time every time, to make the numbers comparable between runs */
+#define START_USEC (1672531200 * USEC_PER_SEC) /* 2023-01-01 00:00:00 UTC */
+
+static void benchmark(const char *s, unsigned n) {
+        _cleanup_(calendar_spec_freep) CalendarSpec *c = NULL;
+        usec_t t, u = START_USEC;
+
+        assert_se(calendar_spec_from_string(s, &c) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n; i++) {
+                int r;
+
+                r = calendar_spec_next_usec(c, u, &u);
+                if (r == -ENOENT) /* We ran past the year 2199, start over */
+                        u = START_USEC;
+                else
+                        assert_se(r >= 0);
+        }
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("%-32s %u elapses, %" PRIu64 "ns per elapse", s, n, t * NSEC_PER_USEC / n);
+        benchmark_report(t * NSEC_PER_USEC / n, "ns", "%s", s);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n;
+
+        test_setup_logging(LOG_INFO);
+
+        n = slow_tests_enabled() ? 100000 : 5000;
+
+        for (size_t i = 0; i < ELEMENTSOF(specs); i++)
+                /* The specs with an explicit time zone fork off a child for each calculation */
+                benchmark(specs[i], endswith(specs[i], "Berlin") ? n / 100 : n);
+
+        return 0;
+}
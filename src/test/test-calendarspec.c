@@ -227,6 +227,90 @@ TEST(calendar_spec_next) {
         test_next("Sun *-*-* 01:00:00 Europe/Dublin", "IST", 1616412478000000, 1617494400000000);
 }
 
+static void test_time_of_day_one(const char *weekdays, const char *time, const char *tz) {
+        _cleanup_(calendar_spec_freep) CalendarSpec *a = NULL, *b = NULL;
+        _cleanup_free_ char *p = NULL, *q = NULL;
+        static const usec_t starts[] = {
+                86400 * USEC_PER_SEC,
+                1459040400000000, /* 2016-03-27 01:00 UTC, DST starts in Europe */
+                1477789200000001, /* 2016-10-30 01:00 UTC, DST ends in Europe */
+                1491049800000000, /* 2017-04-01 12:30 UTC, DST ends in New Zealand */
+                1506171600000000, /* 2017-09-23 13:00 UTC, DST starts in New Zealand */
+                1616412478000000,
+        };
+
+        /* Specs that only restrict the time of day take a shortcut in calendar_spec_next_usec(). Compare
+         * with the results of the same spec with an explicit (but all-encompassing) year range, which
+         * goes the long way. */
+
+        assert_se(p = strjoin(weekdays, isempty(weekdays) ? "" : " ", "*-*-* ", time));
+        assert_se(q = strjoin(weekdays, isempty(weekdays) ? "" : " ", "1970..2199-*-* ", time));
+        assert_se(calendar_spec_from_string(p, &a) >= 0);
+        assert_se(calendar_spec_from_string(q, &b) >= 0);
+
+        log_info("\"%s\" TZ=%s", p, strnull(tz));
+
+        for (size_t i = 0; i < ELEMENTSOF(starts); i++) {
+                usec_t u = starts[i];
+
+                for (unsigned n = 0; n < 100; n++) {
+                        usec_t x, y;
+                        int r, s;
+
+                        r = calendar_spec_next_usec(a, u, &x);
+                        s = calendar_spec_next_usec(b, u, &y);
+                        if (r != s || (r >= 0 && x != y))
+                                log_error("After %s: %s vs. %s",
+                                          FORMAT_TIMESTAMP_STYLE(u, TIMESTAMP_US),
+                                          r < 0 ? strerror_safe(r) : FORMAT_TIMESTAMP_STYLE(x, TIMESTAMP_US),
+                                          s < 0 ? strerror_safe(s) : FORMAT_TIMESTAMP_STYLE(y, TIMESTAMP_US));
+                        assert_se(r == s);
+                        if (r < 0)
+                                break;
+                        assert_se(x == y);
+                        assert_se(x > u);
+
+                        u = x;
+                }
+        }
+}
+
+TEST(calendar_spec_next_time_of_day) {
+        static const char *const tzs[] = { "", "UTC", "CET", "EET", "Pacific/Auckland", "Australia/Lord_Howe", "America/Caracas" };
+        static const char *const times[] = {
+                "00:00:00",
+                "*:00:00",
+                "*:*:00",
+                "02:30:00",
+                "01,02,03:15,45:00",
+                "*:2/3:00",
+                "*:20..35/5:00",
+                "00,12:00:01.125..02.125",
+                "23:59:59.999999",
+                "*:*:20..40/7.5",
+        };
+        static const char *const weekdays[] = { "", "Mon", "Sun", "Mon..Fri", "Sat,Sun" };
+        char *old_tz;
+
+        old_tz = getenv("TZ");
+        if (old_tz)
+                old_tz = strdupa_safe(old_tz);
+
+        for (size_t i = 0; i < ELEMENTSOF(tzs); i++) {
+                const char *tz = isempty(tzs[i]) ? NULL : strjoina(":", tzs[i]);
+
+                assert_se(set_unset_env("TZ", tz, true) == 0);
+                tzset();
+
+                for (size_t j = 0; j < ELEMENTSOF(times); j++)
+                        for (size_t k = 0; k < ELEMENTSOF(weekdays); k++)
+                                test_time_of_day_one(weekdays[k], times[j], tz);
+        }
+
+        assert_se(set_unset_env("TZ", old_tz, true) == 0);
+        tzset();
+}
+
 TEST(calendar_spec_from_string) {
         CalendarSpec *c;
 
@@ -5,15 +5,19 @@
 #include "dirent-util.h"
 #include "errno-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
+#include "fs-util.h"
 #include "parse-util.h"
 #include "proc-cmdline.h"
 #include "process-util.h"
+#include "rm-rf.h"
 #include "special.h"
 #include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "tests.h"
+#include "tmpfile-util.h"
 #include "user-util.h"
 #include "util.h"
 #include "version.h"
@@ -159,10 +163,14 @@ TEST(path_get_user_slice) {
 }
 
 TEST(get_paths, .sd_booted = true) {
-        _cleanup_free_ char *a = NULL;
+        _cleanup_free_ char *a = NULL, *b = NULL;
 
         assert_se(cg_get_root_path(&a) >= 0);
         log_info("Root = %s", a);
+
+        /* The second call might be served from the cache, but must return the same */
+        assert_se(cg_get_root_path(&b) >= 0);
+        assert_se(streq(a, b));
 }
 
 TEST(proc) {
@@ -361,6 +369,38 @@ TEST(cg_tests) {
                 assert_se(!systemd);
 }
 
+TEST(cg_read_pids) {
+        _cleanup_free_ char *cgroup = NULL;
+        _cleanup_free_ pid_t *pids = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        size_t n_pids = 0, n = 0;
+        bool found = false;
+        pid_t pid;
+        int r;
+
+        r = cg_pid_get_path(SYSTEMD_CGROUP_CONTROLLER, 0, &cgroup);
+        if (IN_SET(r, -ENOMEDIUM, -ENOENT)) {
+                log_tests_skipped("cgroup not mounted");
+                return;
+        }
+        assert_se(r >= 0);
+
+        assert_se(cg_read_pids(SYSTEMD_CGROUP_CONTROLLER, cgroup, &pids, &n_pids) >= 0);
+        for (size_t i = 0; i < n_pids; i++) {
+                assert_se(pids[i] > 0);
+                if (pids[i] == getpid_cached())
+                        found = true;
+        }
+        assert_se(found);
+
+        /* Same result as reading the PIDs one by one, unless processes come and go in the meantime */
+        assert_se(cg_enumerate_processes(SYSTEMD_CGROUP_CONTROLLER, cgroup, &f) >= 0);
+        while ((r = cg_read_pid(f, &pid)) > 0)
+                n++;
+        assert_se(r == 0);
+        log_debug("Read %zu PIDs at once and %zu one by one from %s", n_pids, n, cgroup);
+}
+
 TEST(cg_get_keyed_attribute) {
         _cleanup_free_ char *val = NULL;
         char *vals3[3] = {}, *vals3a[3] = {};
@@ -426,6 +466,29 @@ TEST(cg_get_keyed_attribute) {
         }
 }
 
+TEST(cg_set_attribute_at) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_close_ int dfd = -1;
+        _cleanup_free_ char *v = NULL;
+
+        assert_se(mkdtemp_malloc(NULL, &t) >= 0);
+        assert_se((dfd = open(t, O_PATH|O_DIRECTORY|O_CLOEXEC)) >= 0);
+
+        /* Attributes are never created, only written to */
+        assert_se(cg_set_attribute_at(dfd, "pids.max", "max\n") == -ENOENT);
+        assert_se(touch_file(strjoina(t, "/pids.max"), false, USEC_INFINITY, UID_INVALID, GID_INVALID, 0644) >= 0);
+
+        /* A trailing newline is added if missing */
+        assert_se(cg_set_attribute_at(dfd, "pids.max", "1") >= 0);
+        assert_se(read_full_file(strjoina(t, "/pids.max"), &v, NULL) >= 0);
+        assert_se(streq(v, "1\n"));
+        v = mfree(v);
+
+        assert_se(cg_set_attribute_at(dfd, "pids.max", "max\n") >= 0);
+        assert_se(read_full_file(strjoina(t, "/pids.max"), &v, NULL) >= 0);
+        assert_se(streq(v, "max\n"));
+}
+
 TEST(bfq_weight_conversion) {
         assert_se(BFQ_WEIGHT(1) == 1);
         assert_se(BFQ_WEIGHT(50) == 50);
@@ -137,6 +137,7 @@ static void test_compress_decompress(const char* label, const char* type,
                  total / 1024. / 1024 / dt,
                  100 - compressed * 100. / total,
                  skipped);
+        benchmark_report(dt > 0 ? (uint64_t) (total / dt) : 0, "bytes/s", "%s/%s", label, type);
 }
 #endif
 
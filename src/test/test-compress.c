@@ -7,6 +7,7 @@
 #endif
 
 #include "alloc-util.h"
+#include "compress-pool.h"
 #include "compress.h"
 #include "fd-util.h"
 #include "fs-util.h"
@@ -14,6 +15,7 @@
 #include "memory-util.h"
 #include "path-util.h"
 #include "random-util.h"
+#include "stdio-util.h"
 #include "tests.h"
 #include "tmpfile-util.h"
 
@@ -270,6 +272,192 @@ static void test_lz4_decompress_partial(void) {
 }
 #endif
 
+#if HAVE_COMPRESSION
+static void test_compress_pool(void) {
+        _cleanup_(compress_pool_unrefp) CompressPool *pool = NULL;
+        CompressionStatistics before, after;
+        CompressJob jobs[16];
+        char src[ELEMENTSOF(jobs)][4096], dst[ELEMENTSOF(jobs)][4096], check[4096];
+        size_t n_ok = 0;
+
+        log_debug("/* %s */", __func__);
+
+        assert_se(compress_pool_new(3, &pool) >= 0);
+        assert_se(compress_pool_get_n_threads(pool) == 3);
+
+        for (size_t i = 0; i < ELEMENTSOF(jobs); i++) {
+                /* Make every fourth blob incompressible, so that failures are reported per job */
+                if (i % 4 == 3)
+                        random_bytes(src[i], sizeof(src[i]));
+                else
+                        for (size_t j = 0; j < sizeof(src[i]); j++)
+                                src[i][j] = 'a' + (j / (i + 1)) % 26;
+
+                jobs[i] = (CompressJob) {
+                        .compression = DEFAULT_COMPRESSION,
+                        .src = src[i],
+                        .src_size = sizeof(src[i]),
+                        .dst = dst[i],
+                        .dst_alloc_size = sizeof(src[i]) - 1,
+                };
+        }
+
+        compression_get_statistics(DEFAULT_COMPRESSION, &before);
+
+        compress_pool_run(pool, jobs, ELEMENTSOF(jobs));
+
+        /* The pool must give the exact same results as compressing on the calling thread */
+        for (size_t i = 0; i < ELEMENTSOF(jobs); i++) {
+                size_t check_size = 0;
+                int r;
+
+                r = compress_blob_explicit(DEFAULT_COMPRESSION, src[i], sizeof(src[i]), check, sizeof(src[i]) - 1, &check_size);
+                assert_se(jobs[i].result == r);
+
+                if (r < 0)
+                        continue;
+
+                assert_se(r == (int) DEFAULT_COMPRESSION);
+                assert_se(jobs[i].dst_size == check_size);
+                assert_se(memcmp(jobs[i].dst, check, check_size) == 0);
+                n_ok++;
+        }
+
+        assert_se(n_ok >= ELEMENTSOF(jobs) * 3 / 4);
+
+        compression_get_statistics(DEFAULT_COMPRESSION, &after);
+        assert_se(after.n_compressed == before.n_compressed + 2 * n_ok);
+        assert_se(after.n_failed == before.n_failed + 2 * (ELEMENTSOF(jobs) - n_ok));
+        assert_se(after.uncompressed_bytes == before.uncompressed_bytes + 2 * n_ok * sizeof(src[0]));
+        assert_se(after.compressed_bytes > before.compressed_bytes);
+
+        /* A pool can be reused for further batches */
+        compress_pool_run(pool, jobs, 2);
+        compress_pool_run(pool, jobs, 0);
+}
+#endif
+
+#if HAVE_ZSTD
+static void test_zstd_dictionary(void) {
+        _cleanup_(compress_dictionary_freep) CompressDictionary *d = NULL, *ro = NULL;
+        _cleanup_free_ char *samples = NULL, *dictionary = NULL;
+        _cleanup_free_ void *decompressed = NULL;
+        size_t sizes[2000], n_samples = 0, dictionary_size, compressed_size, plain_size, decompressed_size;
+        char msg[128], compressed[128], plain[128];
+        int n, r;
+
+        log_debug("/* %s */", __func__);
+
+        /* Garbage is refused, we need the dictionary ID to decide which frames need the dictionary */
+        assert_se(compress_dictionary_new("foobar", 6, true, &d) == -EBADMSG);
+
+        for (size_t i = 0; i < ELEMENTSOF(sizes); i++) {
+                xsprintf(msg, "MESSAGE=Started Session %zu of User user%zu (uid=%zu), seat%zu.",
+                         i * 7, i % 13, 1000 + i % 13, i % 3);
+                n = strlen(msg);
+
+                assert_se(GREEDY_REALLOC(samples, n_samples + n));
+                memcpy(samples + n_samples, msg, n);
+                n_samples += n;
+                sizes[i] = n;
+        }
+
+        r = compress_dictionary_train(samples, sizes, ELEMENTSOF(sizes), 4096, (void**) &dictionary, &dictionary_size);
+        if (r == -ENODATA)
+                return (void) log_tests_skipped("zstd dictionary training failed");
+        assert_se(r >= 0);
+        assert_se(dictionary_size > 0 && dictionary_size <= 4096);
+
+        assert_se(compress_dictionary_new(dictionary, dictionary_size, true, &d) >= 0);
+        assert_se(compress_dictionary_get_id(d) != 0);
+        assert_se(compress_dictionary_new(dictionary, dictionary_size, false, &ro) >= 0);
+        assert_se(compress_dictionary_get_id(ro) == compress_dictionary_get_id(d));
+
+        /* A short message that was not among the samples */
+        xsprintf(msg, "MESSAGE=Started Session %i of User user5 (uid=1005), seat1.", 4711);
+        n = strlen(msg);
+
+        r = compress_blob_with_dictionary(d, msg, n, compressed, n - 1, &compressed_size);
+        assert_se(r == COMPRESSION_ZSTD);
+        log_info("zstd dictionary: %i bytes → %zu", n, compressed_size);
+
+        /* It compresses much better than without the dictionary */
+        r = compress_blob_zstd(msg, n, plain, sizeof(plain), &plain_size);
+        assert_se(r == COMPRESSION_ZSTD);
+        assert_se(compressed_size < plain_size);
+
+        /* The reader side of the dictionary is enough for decompression */
+        assert_se(decompress_blob_with_dictionary(COMPRESSION_ZSTD, ro, compressed, compressed_size,
+                                                  &decompressed, &decompressed_size, 0) == 0);
+        assert_se(decompressed_size == (size_t) n);
+        assert_se(memcmp(decompressed, msg, n) == 0);
+
+        assert_se(decompress_startswith_with_dictionary(COMPRESSION_ZSTD, ro, compressed, compressed_size,
+                                                        &decompressed, "MESSAGE", STRLEN("MESSAGE"), '=') > 0);
+        assert_se(decompress_startswith_with_dictionary(COMPRESSION_ZSTD, ro, compressed, compressed_size,
+                                                        &decompressed, "MESSAGE", STRLEN("MESSAGE"), 'x') == 0);
+
+        /* Without the dictionary the frame cannot be decoded */
+        assert_se(decompress_blob(COMPRESSION_ZSTD, compressed, compressed_size,
+                                  &decompressed, &decompressed_size, 0) < 0);
+
+        /* Frames compressed without the dictionary decode fine if one is passed */
+        decompressed_size = 0;
+        assert_se(decompress_blob_with_dictionary(COMPRESSION_ZSTD, ro, plain, plain_size,
+                                                  &decompressed, &decompressed_size, 0) == 0);
+        assert_se(decompressed_size == (size_t) n);
+        assert_se(memcmp(decompressed, msg, n) == 0);
+}
+
+static void test_decompress_context(const char *huge) {
+        _cleanup_(decompress_context_freep) DecompressContext *c = NULL;
+        _cleanup_free_ char *compressed = NULL, *out = NULL;
+        size_t compressed_size, out_size = 0;
+        const void *p;
+        size_t left;
+        char buf[4096];
+        int n;
+
+        log_debug("/* %s */", __func__);
+
+        assert_se(decompress_context_new(COMPRESSION_XZ, &c) == -EPROTONOSUPPORT);
+
+        assert_se(compressed = malloc(HUGE_SIZE));
+        assert_se(compress_blob_zstd(huge, HUGE_SIZE, compressed, HUGE_SIZE, &compressed_size) == COMPRESSION_ZSTD);
+        assert_se(out = malloc(HUGE_SIZE));
+
+        /* Feed the frame in small pieces, and drain the output of each in pieces of limited size */
+        assert_se(decompress_context_new(COMPRESSION_ZSTD, &c) >= 0);
+        for (size_t i = 0; i < compressed_size; i += 7) {
+                p = compressed + i;
+                left = MIN(compressed_size - i, 7u);
+
+                do {
+                        n = decompress_context_decompress(c, &p, &left, buf, sizeof(buf));
+                        assert_se(n >= 0);
+                        assert_se(out_size + n <= HUGE_SIZE);
+                        memcpy(out + out_size, buf, n);
+                        out_size += n;
+                } while (left > 0 || (size_t) n == sizeof(buf));
+
+                /* A truncated frame is refused */
+                if (i == 0)
+                        assert_se(decompress_context_finish(c) == -EBADMSG);
+        }
+        assert_se(decompress_context_finish(c) == 0);
+
+        assert_se(out_size == HUGE_SIZE);
+        assert_se(memcmp(out, huge, HUGE_SIZE) == 0);
+
+        /* Garbage is refused */
+        c = decompress_context_free(c);
+        assert_se(decompress_context_new(COMPRESSION_ZSTD, &c) >= 0);
+        p = "garbage!";
+        left = 8;
+        assert_se(decompress_context_decompress(c, &p, &left, buf, sizeof(buf)) < 0);
+}
+#endif
+
 int main(int argc, char *argv[]) {
 #if HAVE_COMPRESSION
         _unused_ const char text[] =
@@ -374,6 +562,12 @@ int main(int argc, char *argv[]) {
         log_info("/* ZSTD test skipped */");
 #endif
 
+        test_compress_pool();
+#if HAVE_ZSTD
+        test_zstd_dictionary();
+        test_decompress_context(huge);
+#endif
+
         return 0;
 #else
         log_info("/* XZ, LZ4 and ZSTD tests skipped */");
@@ -94,6 +94,49 @@ TEST(conf_files_list) {
         test_conf_files_list_one(true);
 }
 
+TEST(conf_files_list_strv_cached) {
+        char tmp_dir[] = "/tmp/test-conf-files-XXXXXX";
+        _cleanup_hashmap_free_ Hashmap *cache = NULL;
+        _cleanup_strv_free_ char **found = NULL;
+        const char *dir1, *dir2, *missing;
+        struct timespec ts[2] = {
+                { .tv_sec = 1 },
+                { .tv_sec = 1 },
+        };
+
+        setup_test_dir(tmp_dir,
+                       "/dir1/a.conf",
+                       "/dir1/c.foo",
+                       "/dir2/a.conf",
+                       "/dir2/b.conf",
+                       NULL);
+
+        dir1 = strjoina(tmp_dir, "/dir1");
+        dir2 = strjoina(tmp_dir, "/dir2");
+        missing = strjoina(tmp_dir, "/missing");
+
+        /* Make sure that adding a file below changes the mtime */
+        assert_se(utimensat(AT_FDCWD, dir1, ts, 0) >= 0);
+
+        assert_se(conf_files_list_strv_cached(&found, ".conf", NULL, 0, STRV_MAKE_CONST(dir1, missing, dir2), &cache) == 0);
+        assert_se(strv_equal(found, STRV_MAKE(strjoina(dir1, "/a.conf"), strjoina(dir2, "/b.conf"))));
+        assert_se(hashmap_size(cache) == 2);
+        found = strv_free(found);
+
+        /* Served from the cache, but filtered differently */
+        assert_se(conf_files_list_strv_cached(&found, NULL, NULL, CONF_FILES_BASENAME, STRV_MAKE_CONST(dir1), &cache) == 0);
+        assert_se(strv_equal(found, STRV_MAKE("a.conf", "c.foo")));
+        found = strv_free(found);
+
+        /* Changes are picked up */
+        assert_se(write_string_file(strjoina(dir1, "/0.conf"), "foobar", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(conf_files_list_strv_cached(&found, ".conf", NULL, 0, STRV_MAKE_CONST(dir1), &cache) == 0);
+        assert_se(strv_equal(found, STRV_MAKE(strjoina(dir1, "/0.conf"), strjoina(dir1, "/a.conf"))));
+        assert_se(hashmap_size(cache) == 2);
+
+        assert_se(rm_rf(tmp_dir, REMOVE_ROOT|REMOVE_PHYSICAL) == 0);
+}
+
 static void test_conf_files_insert_one(const char *root) {
         _cleanup_strv_free_ char **s = NULL;
 
@@ -2,9 +2,11 @@
 
 #include "conf-parser.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "log.h"
 #include "macro.h"
+#include "rm-rf.h"
 #include "string-util.h"
 #include "strv.h"
 #include "tests.h"
@@ -311,10 +313,51 @@ static const char* const config_file[] = {
         "setting1=3\n",
 };
 
+static void check_config_parse_result(unsigned i, int r, const char *setting1) {
+        switch (i) {
+        case 0 ... 4:
+                assert_se(r == 1);
+                assert_se(streq(setting1, "1"));
+                break;
+
+        case 5 ... 10:
+                assert_se(r == 1);
+                assert_se(streq(setting1, "1 2 3"));
+                break;
+
+        case 11:
+                assert_se(r == 1);
+                assert_se(streq(setting1, "1\\\\ \\\\2"));
+                break;
+
+        case 12:
+                assert_se(r == 1);
+                assert_se(streq(setting1, x1000("ABCD")));
+                break;
+
+        case 13 ... 14:
+                assert_se(r == 1);
+                assert_se(streq(setting1, x1000("ABCD") " foobar"));
+                break;
+
+        case 15 ... 16:
+                assert_se(r == -ENOBUFS);
+                assert_se(setting1 == NULL);
+                break;
+
+        case 17:
+                assert_se(r == 1);
+                assert_se(streq(setting1, "2"));
+                break;
+        }
+}
+
 static void test_config_parse_one(unsigned i, const char *s) {
         _cleanup_(unlink_tempfilep) char name[] = "/tmp/test-conf-parser.XXXXXX";
+        _cleanup_(config_file_freep) ConfigFile *c = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_free_ char *setting1 = NULL;
+        struct stat st;
         int r;
 
         const ConfigTableItem items[] = {
@@ -347,42 +390,37 @@ static void test_config_parse_one(unsigned i, const char *s) {
                          CONFIG_PARSE_WARN,
                          NULL,
                          NULL);
+        check_config_parse_result(i, r, setting1);
 
-        switch (i) {
-        case 0 ... 4:
-                assert_se(r == 1);
-                assert_se(streq(setting1, "1"));
-                break;
-
-        case 5 ... 10:
-                assert_se(r == 1);
-                assert_se(streq(setting1, "1 2 3"));
-                break;
-
-        case 11:
-                assert_se(r == 1);
-                assert_se(streq(setting1, "1\\\\ \\\\2"));
-                break;
-
-        case 12:
-                assert_se(r == 1);
-                assert_se(streq(setting1, x1000("ABCD")));
-                break;
-
-        case 13 ... 14:
-                assert_se(r == 1);
-                assert_se(streq(setting1, x1000("ABCD") " foobar"));
-                break;
-
-        case 15 ... 16:
-                assert_se(r == -ENOBUFS);
-                assert_se(setting1 == NULL);
-                break;
+        /* And once more, reading the file ahead of parsing it */
+        setting1 = mfree(setting1);
+        rewind(f);
 
-        case 17:
-                assert_se(r == 1);
-                assert_se(streq(setting1, "2"));
-                break;
+        r = config_file_read(name, f, &c);
+        if (r >= 0) {
+                assert_se(fstat(fileno(f), &st) >= 0);
+                assert_se(config_file_is_current(c, &st));
+
+                r = config_parse_file(NULL, c,
+                                      "Section\0"
+                                      "-NoWarnSection\0",
+                                      config_item_table_lookup, items,
+                                      CONFIG_PARSE_WARN,
+                                      NULL);
+        }
+        check_config_parse_result(i, r, setting1);
+
+        /* And a second time from the same object, which now uses the assignments split out before */
+        if (c) {
+                setting1 = mfree(setting1);
+
+                r = config_parse_file(NULL, c,
+                                      "Section\0"
+                                      "-NoWarnSection\0",
+                                      config_item_table_lookup, items,
+                                      CONFIG_PARSE_WARN,
+                                      NULL);
+                check_config_parse_result(i, r, setting1);
         }
 }
 
@@ -391,4 +429,43 @@ TEST(config_parse) {
                 test_config_parse_one(i, config_file[i]);
 }
 
+TEST(config_get_digest_by_path) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmp = NULL;
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        uint8_t a[SHA256_DIGEST_SIZE], b[SHA256_DIGEST_SIZE];
+        struct stat st = {};
+        const char *p, *q;
+
+        assert_se(mkdtemp_malloc("/tmp/test-conf-parser-XXXXXX", &tmp) >= 0);
+        p = strjoina(tmp, "/a.conf");
+        q = strjoina(tmp, "/b.conf");
+
+        assert_se(write_string_file(p, "[Section]\nsetting1=1", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(write_string_file(q, "[Section]\nsetting1=2", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(hashmap_ensure_put(&h, &string_hash_ops, p, &st) > 0);
+        assert_se(hashmap_ensure_put(&h, &string_hash_ops, q, &st) > 0);
+
+        assert_se(config_get_digest_by_path(h, a) >= 0);
+
+        /* Rewriting a file with the same contents does not change the digest */
+        assert_se(write_string_file(p, "[Section]\nsetting1=1", WRITE_STRING_FILE_TRUNCATE) >= 0);
+        assert_se(config_get_digest_by_path(h, b) >= 0);
+        assert_se(memcmp(a, b, SHA256_DIGEST_SIZE) == 0);
+
+        assert_se(write_string_file(q, "[Section]\nsetting1=3", WRITE_STRING_FILE_TRUNCATE) >= 0);
+        assert_se(config_get_digest_by_path(h, b) >= 0);
+        assert_se(memcmp(a, b, SHA256_DIGEST_SIZE) != 0);
+
+        /* Neither does the order of the paths in the hashmap matter */
+        assert_se(write_string_file(q, "[Section]\nsetting1=2", WRITE_STRING_FILE_TRUNCATE) >= 0);
+        h = hashmap_free(h);
+        assert_se(hashmap_ensure_put(&h, &string_hash_ops, q, &st) > 0);
+        assert_se(hashmap_ensure_put(&h, &string_hash_ops, p, &st) > 0);
+        assert_se(config_get_digest_by_path(h, b) >= 0);
+        assert_se(memcmp(a, b, SHA256_DIGEST_SIZE) == 0);
+
+        assert_se(config_get_digest_by_path(NULL, b) >= 0);
+        assert_se(memcmp(a, b, SHA256_DIGEST_SIZE) != 0);
+}
+
 DEFINE_TEST_MAIN(LOG_INFO);
@@ -187,6 +187,52 @@ TEST(copy_tree) {
         (void) rm_rf(original_dir, REMOVE_ROOT|REMOVE_PHYSICAL);
 }
 
+TEST(copy_tree_parallel) {
+        _cleanup_(rm_rf_physical_and_freep) char *p = NULL;
+        _cleanup_free_ char *original_dir = NULL, *copy_dir = NULL;
+
+        assert_se(mkdtemp_malloc(NULL, &p) >= 0);
+        assert_se(original_dir = path_join(p, "original"));
+        assert_se(copy_dir = path_join(p, "copy"));
+
+        /* Enough files to keep the queue of the workers full for a while */
+        for (unsigned i = 0; i < 20; i++)
+                for (unsigned j = 0; j < 20; j++) {
+                        _cleanup_free_ char *f = NULL, *c = NULL;
+
+                        assert_se(asprintf(&f, "%s/dir%u/file%u", original_dir, i, j) >= 0);
+                        assert_se(asprintf(&c, "%u-%u", i, j) >= 0);
+                        assert_se(write_string_file(f, c, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_MKDIR_0755) == 0);
+                        assert_se(chmod(f, j % 2 == 0 ? 0600 : 0644) >= 0);
+                }
+
+        assert_se(link(strjoina(original_dir, "/dir0/file0"), strjoina(original_dir, "/hlink")) >= 0);
+
+        assert_se(copy_tree(original_dir, copy_dir, UID_INVALID, GID_INVALID, COPY_REFLINK|COPY_HARDLINKS|COPY_PARALLEL) == 0);
+
+        for (unsigned i = 0; i < 20; i++)
+                for (unsigned j = 0; j < 20; j++) {
+                        _cleanup_free_ char *f = NULL, *c = NULL, *buf = NULL;
+                        struct stat st;
+
+                        assert_se(asprintf(&f, "%s/dir%u/file%u", copy_dir, i, j) >= 0);
+                        assert_se(asprintf(&c, "%u-%u\n", i, j) >= 0);
+                        assert_se(read_full_file(f, &buf, NULL) == 0);
+                        assert_se(streq(buf, c));
+
+                        assert_se(stat(f, &st) >= 0);
+                        assert_se((st.st_mode & 07777) == (j % 2 == 0 ? 0600 : 0644));
+                }
+
+        struct stat a, b;
+        assert_se(stat(strjoina(copy_dir, "/dir0/file0"), &a) >= 0);
+        assert_se(stat(strjoina(copy_dir, "/hlink"), &b) >= 0);
+        assert_se(a.st_ino == b.st_ino);
+
+        /* Errors are still propagated */
+        assert_se(copy_tree(original_dir, copy_dir, UID_INVALID, GID_INVALID, COPY_PARALLEL) < 0);
+}
+
 TEST(copy_bytes) {
         _cleanup_close_pair_ int pipefd[2] = {-1, -1};
         _cleanup_close_ int infd = -1;
@@ -247,6 +247,10 @@ int main(int argc, char *argv[]) {
         assert_se(!unit_has_dependency(a, UNIT_ATOM_ON_SUCCESS_OF, manager_get_unit(m, "basic.target")));
         assert_se(!unit_has_dependency(a, UNIT_ATOM_PROPAGATES_RELOAD_TO, manager_get_unit(m, "non-existing-on-failure.target")));
 
+        assert_se(FLAGS_SET(a->dependency_atoms, UNIT_ATOM_AFTER|UNIT_ATOM_ON_FAILURE|UNIT_ATOM_ON_SUCCESS));
+        assert_se(stub->dependency_atoms == 0);
+        assert_se(!unit_has_dependency(stub, UNIT_ATOM_AFTER, NULL));
+
         assert_se(unit_has_name(a, "a.service"));
         assert_se(unit_has_name(a, "merged.service"));
 
@@ -411,6 +411,52 @@ TEST(error_catching) {
         assert_se(r == 42);
 }
 
+static int builtin_exit_argc(int argc, char *argv[]) {
+        /* Exits with a status the script would never return, proving this ran instead of it. */
+        assert_se(argv[argc] == NULL);
+        return 100 + argc;
+}
+
+TEST(execution_builtin) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmpdir = NULL;
+        const char *name;
+        int r;
+
+        assert_se(mkdtemp_malloc("/tmp/test-exec-util.XXXXXXX", &tmpdir) >= 0);
+
+        const char *dirs[] = { tmpdir, NULL };
+
+        name = strjoina(tmpdir, "/10-foo");
+        assert_se(write_string_file(name, "#!/bin/sh\nexit 42\n", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(chmod(name, 0755) == 0);
+
+        if (access(name, X_OK) < 0 && ERRNO_IS_PRIVILEGE(errno))
+                return;
+
+        const ExecBuiltin builtins[] = {
+                { name, builtin_exit_argc },
+                {}
+        };
+        const ExecBuiltin other_builtins[] = {
+                { "/nonexistent/10-foo", builtin_exit_argc },
+                {}
+        };
+        char *argv[] = { NULL, (char*) "a", (char*) "b", NULL };
+
+        r = execute_directories_full(dirs, DEFAULT_TIMEOUT_USEC, NULL, NULL, argv, NULL, EXEC_DIR_NONE, builtins);
+        assert_se(r == 103);
+
+        /* Only the exact path is replaced by the builtin */
+        r = execute_directories_full(dirs, DEFAULT_TIMEOUT_USEC, NULL, NULL, argv, NULL, EXEC_DIR_NONE, other_builtins);
+        assert_se(r == 42);
+
+        /* Masking still works */
+        assert_se(unlink(name) >= 0);
+        assert_se(symlink("/dev/null", name) >= 0);
+        r = execute_directories_full(dirs, DEFAULT_TIMEOUT_USEC, NULL, NULL, argv, NULL, EXEC_DIR_NONE, builtins);
+        assert_se(r == 0);
+}
+
 TEST(exec_command_flags_from_strv) {
         ExecCommandFlags flags = 0;
         char **valid_strv = STRV_MAKE("no-env-expand", "no-setuid", "ignore-failure");
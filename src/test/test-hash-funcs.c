@@ -1,10 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
-#include "tests.h"
+#include "alloc-util.h"
+#include "fast-hash.h"
 #include "hash-funcs.h"
 #include "set.h"
+#include "tests.h"
 
-TEST(path_hash_set) {
+static void test_path_hash_set_one(const struct hash_ops *ops) {
         /* The goal is to make sure that non-simplified path are hashed as expected,
          * and that we don't need to simplify them beforehand. */
 
@@ -12,14 +14,14 @@ TEST(path_hash_set) {
         _cleanup_set_free_ Set *set = NULL;
 
         assert_se(set_isempty(set));
-        assert_se(set_ensure_put(&set, &path_hash_ops, "foo") == 1);
-        assert_se(set_ensure_put(&set, &path_hash_ops, "foo") == 0);
-        assert_se(set_ensure_put(&set, &path_hash_ops, "bar") == 1);
-        assert_se(set_ensure_put(&set, &path_hash_ops, "bar") == 0);
-        assert_se(set_ensure_put(&set, &path_hash_ops, "/foo") == 1);
-        assert_se(set_ensure_put(&set, &path_hash_ops, "/bar") == 1);
-        assert_se(set_ensure_put(&set, &path_hash_ops, "/foo/.") == 0);
-        assert_se(set_ensure_put(&set, &path_hash_ops, "/./bar/./.") == 0);
+        assert_se(set_ensure_put(&set, ops, "foo") == 1);
+        assert_se(set_ensure_put(&set, ops, "foo") == 0);
+        assert_se(set_ensure_put(&set, ops, "bar") == 1);
+        assert_se(set_ensure_put(&set, ops, "bar") == 0);
+        assert_se(set_ensure_put(&set, ops, "/foo") == 1);
+        assert_se(set_ensure_put(&set, ops, "/bar") == 1);
+        assert_se(set_ensure_put(&set, ops, "/foo/.") == 0);
+        assert_se(set_ensure_put(&set, ops, "/./bar/./.") == 0);
 
         assert_se(set_contains(set, "foo"));
         assert_se(set_contains(set, "bar"));
@@ -74,4 +76,32 @@ TEST(path_hash_set) {
         assert_se(!set_contains(set, "/////../bar/./"));
 }
 
+TEST(path_hash_set) {
+        test_path_hash_set_one(&path_hash_ops);
+        test_path_hash_set_one(&fast_path_hash_ops);
+}
+
+TEST(fast_hash) {
+        static const char text[] = "The quick brown fox jumps over the lazy dog, repeatedly.";
+        _cleanup_set_free_free_ Set *seen = NULL;
+        uint64_t h;
+
+        /* Every prefix and every seed gives a different hash value */
+        for (size_t n = 0; n < sizeof(text); n++)
+                for (uint64_t seed = 0; seed < 4; seed++) {
+                        h = fast_hash(text, n, seed);
+                        assert_se(h == fast_hash(text, n, seed));
+                        assert_se(set_ensure_put(&seen, &uint64_hash_ops, newdup(uint64_t, &h, 1)) == 1);
+                }
+
+        /* Only the contents matter, not where and how aligned they are */
+        assert_se(fast_hash(text + 1, 20, 7) == fast_hash(strdupa_safe(text + 1), 20, 7));
+
+        assert_se(string_fast_hash_func("foo", 1) == fast_hash("foo", 3, 1));
+        assert_se(string_fast_hash_func("foo", 1) != string_fast_hash_func("foo", 2));
+        assert_se(path_fast_hash_func("/foo//bar/", 1) == path_fast_hash_func("/foo/bar", 1));
+        assert_se(path_fast_hash_func("foo/bar", 1) != path_fast_hash_func("/foo/bar", 1));
+        assert_se(path_fast_hash_func("foo/bar", 1) != path_fast_hash_func("foobar", 1));
+}
+
 DEFINE_TEST_MAIN(LOG_INFO);
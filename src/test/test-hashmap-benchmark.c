@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "stdio-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Measures inserting, looking up (both keys that are and that are not in the hashmap), iterating and removing
+ * entries, with string keys and with plain pointers as keys, hashed with SipHash and fast_hash(), for sizes
+ * that result in different load factors of the table. Compare the numbers between builds to see the effect of
+ * changes to the hashmap implementation. SYSTEMD_SLOW_TESTS=1 uses bigger tables. */
+
+static void benchmark(const char *what, const struct hash_ops *hash_ops, void **keys, void **missing, unsigned n) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        usec_t t, insert, hit, miss, iterate, remove;
+        unsigned n_buckets, n_iterations;
+        void *v;
+
+        /* Repeat the lookups on small tables, to get meaningful numbers */
+        n_iterations = MAX(1U, 100000U / n);
+
+        h = hashmap_new(hash_ops);
+        assert_se(h);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n; i++)
+                assert_se(hashmap_put(h, keys[i], keys[i]) > 0);
+        insert = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        n_buckets = hashmap_buckets(h);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned j = 0; j < n_iterations; j++)
+                for (unsigned i = 0; i < n; i++)
+                        assert_se(hashmap_get(h, keys[i]) == keys[i]);
+        hit = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned j = 0; j < n_iterations; j++)
+                for (unsigned i = 0; i < n; i++)
+                        assert_se(!hashmap_get(h, missing[i]));
+        miss = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned j = 0; j < n_iterations; j++) {
+                unsigned k = 0;
+
+                HASHMAP_FOREACH(v, h)
+                        k++;
+                assert_se(k == n);
+        }
+        iterate = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n; i++)
+                assert_se(hashmap_remove(h, keys[i]) == keys[i]);
+        remove = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        assert_se(hashmap_isempty(h));
+
+        log_info("%s: %u entries, load %.2f, insert %" PRIu64 "ns, hit %" PRIu64 "ns, miss %" PRIu64 "ns, "
+                 "iterate %" PRIu64 "ns, remove %" PRIu64 "ns per entry",
+                 what, n, (double) n / n_buckets,
+                 insert * NSEC_PER_USEC / n,
+                 hit * NSEC_PER_USEC / ((uint64_t) n * n_iterations),
+                 miss * NSEC_PER_USEC / ((uint64_t) n * n_iterations),
+                 iterate * NSEC_PER_USEC / ((uint64_t) n * n_iterations),
+                 remove * NSEC_PER_USEC / n);
+
+        benchmark_report(insert * NSEC_PER_USEC / n, "ns", "%s/%u/insert", what, n);
+        benchmark_report(hit * NSEC_PER_USEC / ((uint64_t) n * n_iterations), "ns", "%s/%u/hit", what, n);
+        benchmark_report(miss * NSEC_PER_USEC / ((uint64_t) n * n_iterations), "ns", "%s/%u/miss", what, n);
+        benchmark_report(iterate * NSEC_PER_USEC / ((uint64_t) n * n_iterations), "ns", "%s/%u/iterate", what, n);
+        benchmark_report(remove * NSEC_PER_USEC / n, "ns", "%s/%u/remove", what, n);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_free_ void **strings = NULL, **missing_strings = NULL, **pointers = NULL, **missing_pointers = NULL;
+        unsigned n_max;
+
+        test_setup_logging(LOG_INFO);
+
+        n_max = slow_tests_enabled() ? 1U << 20 : 1U << 14;
+
+        strings = new(void*, n_max);
+        missing_strings = new(void*, n_max);
+        pointers = new(void*, n_max);
+        missing_pointers = new(void*, n_max);
+        assert_se(strings && missing_strings && pointers && missing_pointers);
+
+        for (unsigned i = 0; i < n_max; i++) {
+                /* Like unit names, which share a long prefix */
+                assert_se(asprintf((char**) &strings[i], "systemd-benchmark-%u.service", i) >= 0);
+                assert_se(asprintf((char**) &missing_strings[i], "systemd-benchmark-%u.socket", i) >= 0);
+                pointers[i] = UINT_TO_PTR(i + 1);
+                missing_pointers[i] = UINT_TO_PTR(n_max + i + 1);
+        }
+
+        /* The table grows by doubling (roughly) whenever it would be more than 80% full, hence go through the
+         * load factors in between for each size */
+        for (unsigned n = 64; n <= n_max; n *= 4)
+                for (unsigned k = 4; k < 8 && n * k / 4 <= n_max; k++) {
+                        benchmark("string_hash_ops", &string_hash_ops, strings, missing_strings, n * k / 4);
+                        benchmark("fast_string_hash_ops", &fast_string_hash_ops, strings, missing_strings, n * k / 4);
+                        benchmark("trivial_hash_ops", &trivial_hash_ops, pointers, missing_pointers, n * k / 4);
+                        benchmark("fast_trivial_hash_ops", &fast_trivial_hash_ops, pointers, missing_pointers, n * k / 4);
+                }
+
+        for (unsigned i = 0; i < n_max; i++) {
+                free(strings[i]);
+                free(missing_strings[i]);
+        }
+
+        return 0;
+}
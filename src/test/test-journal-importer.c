@@ -68,4 +68,48 @@ TEST(bad_input) {
         assert_se(journal_importer_eof(&imp));
 }
 
+TEST(reserve_commit) {
+        _cleanup_(journal_importer_cleanup) JournalImporter imp = JOURNAL_IMPORTER_INIT(0);
+        static const char text[] =
+                "__REALTIME_TIMESTAMP=1478389147837945\n"
+                "_BOOT_ID=1531fd22ec84429e85ae888b12fadb91\n"
+                "MESSAGE=hello\n"
+                "BINARY\n"
+                "\x05\x00\x00\x00\x00\x00\x00\x00" "a\nb=c\n"
+                "\n";
+        const char *p = text;
+        void *buf;
+        int r;
+
+        imp.passive_fd = true;
+
+        /* Hand the data over in pieces, written right into the buffer of the importer */
+        for (;;) {
+                size_t n = MIN(sizeof(text) - 1 - (p - text), 5u);
+
+                if (n == 0)
+                        break;
+
+                assert_se(journal_importer_reserve(&imp, n, &buf) >= 0);
+                memcpy(buf, p, n);
+                journal_importer_commit(&imp, n);
+                p += n;
+
+                do
+                        r = journal_importer_process_data(&imp);
+                while (r == 0);
+                if (r == 1)
+                        break;
+                assert_se(r == -EAGAIN);
+        }
+        assert_se(r == 1);
+
+        assert_se(imp.ts.realtime == 1478389147837945);
+        assert_se(imp.iovw.count == 3);
+        assert_iovec_entry(&imp.iovw.iovec[0], "_BOOT_ID=1531fd22ec84429e85ae888b12fadb91");
+        assert_iovec_entry(&imp.iovw.iovec[1], "MESSAGE=hello");
+        assert_se(imp.iovw.iovec[2].iov_len == STRLEN("BINARY=") + 5);
+        assert_se(memcmp(imp.iovw.iovec[2].iov_base, "BINARY=a\nb=c", imp.iovw.iovec[2].iov_len) == 0);
+}
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "json.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Measures how long it takes to parse user records as userdb passes them around via Varlink, with and without
+ * JSON_PARSE_ARENA, and in the binary encoding, to format them as text and binary, and to look up their
+ * fields, as well as the same for a wide object, where the key index kicks in. Compare the numbers between builds to see the effect of changes to the parser or the lookup
+ * logic. SYSTEMD_SLOW_TESTS=1 runs ten times as many iterations. */
+
+static JsonVariant *make_user_record(void) {
+        JsonVariant *v;
+
+        /* Field order as in records we get from the wire, i.e. not sorted */
+        assert_se(json_build(&v, JSON_BUILD_OBJECT(
+                        JSON_BUILD_PAIR("userName", JSON_BUILD_STRING("foobar")),
+                        JSON_BUILD_PAIR("realName", JSON_BUILD_STRING("Foo Bar")),
+                        JSON_BUILD_PAIR("emailAddress", JSON_BUILD_STRING("foobar@example.com")),
+                        JSON_BUILD_PAIR("uid", JSON_BUILD_UNSIGNED(60010)),
+                        JSON_BUILD_PAIR("gid", JSON_BUILD_UNSIGNED(60010)),
+                        JSON_BUILD_PAIR("memberOf", JSON_BUILD_STRV(STRV_MAKE("wheel", "audio", "video", "kvm"))),
+                        JSON_BUILD_PAIR("disposition", JSON_BUILD_STRING("regular")),
+                        JSON_BUILD_PAIR("homeDirectory", JSON_BUILD_STRING("/home/foobar")),
+                        JSON_BUILD_PAIR("shell", JSON_BUILD_STRING("/bin/zsh")),
+                        JSON_BUILD_PAIR("storage", JSON_BUILD_STRING("luks")),
+                        JSON_BUILD_PAIR("diskSize", JSON_BUILD_UNSIGNED(UINT64_C(256) * 1024 * 1024 * 1024)),
+                        JSON_BUILD_PAIR("lastChangeUSec", JSON_BUILD_UNSIGNED(UINT64_C(1665000000000000))),
+                        JSON_BUILD_PAIR("lastPasswordChangeUSec", JSON_BUILD_UNSIGNED(UINT64_C(1665000000000000))),
+                        JSON_BUILD_PAIR("service", JSON_BUILD_STRING("io.systemd.Home")),
+                        JSON_BUILD_PAIR("preferredLanguage", JSON_BUILD_STRING("de_DE.UTF-8")),
+                        JSON_BUILD_PAIR("timeZone", JSON_BUILD_STRING("Europe/Berlin")),
+                        JSON_BUILD_PAIR("environment", JSON_BUILD_STRV(STRV_MAKE("EDITOR=vim", "PAGER=less"))),
+                        JSON_BUILD_PAIR("enforcePasswordPolicy", JSON_BUILD_BOOLEAN(true)),
+                        JSON_BUILD_PAIR("privileged", JSON_BUILD_OBJECT(
+                                        JSON_BUILD_PAIR("hashedPassword", JSON_BUILD_STRV(STRV_MAKE(
+                                                        "$6$kZPySaQnrCp0x/dn$07fNsN6qZQXI8J5wTOMtjHrwdlGEfWZbfrgAKOSRqNbxMOIGBQ1ayrfqIZZcMOGW8qsUUgTi6prGTQz6Iyh2G/"))))),
+                        JSON_BUILD_PAIR("perMachine", JSON_BUILD_ARRAY(
+                                        JSON_BUILD_OBJECT(
+                                                JSON_BUILD_PAIR("matchMachineId", JSON_BUILD_STRING("b7e2c2d0a1d24b6b9b5ef5d2c0d5c8a1")),
+                                                JSON_BUILD_PAIR("memoryMax", JSON_BUILD_UNSIGNED(UINT64_C(8) * 1024 * 1024 * 1024)),
+                                                JSON_BUILD_PAIR("tasksMax", JSON_BUILD_UNSIGNED(4096))))),
+                        JSON_BUILD_PAIR("binding", JSON_BUILD_OBJECT(
+                                        JSON_BUILD_PAIR("b7e2c2d0a1d24b6b9b5ef5d2c0d5c8a1", JSON_BUILD_OBJECT(
+                                                        JSON_BUILD_PAIR("imagePath", JSON_BUILD_STRING("/home/foobar.home")),
+                                                        JSON_BUILD_PAIR("fileSystemType", JSON_BUILD_STRING("btrfs")),
+                                                        JSON_BUILD_PAIR("partitionUuid", JSON_BUILD_STRING("5f4a1c5c-1b4a-4a35-a5ff-df3a3a0d2b6f")),
+                                                        JSON_BUILD_PAIR("luksUuid", JSON_BUILD_STRING("0d5f6f3e-b3a3-4c1b-9c3c-7e1a6a0c8b9a")),
+                                                        JSON_BUILD_PAIR("fileSystemUuid", JSON_BUILD_STRING("2a7e3e0b-9a2c-4c1f-8f0b-6f3c1d2e5a7b")),
+                                                        JSON_BUILD_PAIR("uid", JSON_BUILD_UNSIGNED(60010)),
+                                                        JSON_BUILD_PAIR("gid", JSON_BUILD_UNSIGNED(60010)))))),
+                        JSON_BUILD_PAIR("status", JSON_BUILD_OBJECT(
+                                        JSON_BUILD_PAIR("b7e2c2d0a1d24b6b9b5ef5d2c0d5c8a1", JSON_BUILD_OBJECT(
+                                                        JSON_BUILD_PAIR("state", JSON_BUILD_STRING("active")),
+                                                        JSON_BUILD_PAIR("service", JSON_BUILD_STRING("io.systemd.Home")),
+                                                        JSON_BUILD_PAIR("diskUsage", JSON_BUILD_UNSIGNED(UINT64_C(107374182400))),
+                                                        JSON_BUILD_PAIR("diskFree", JSON_BUILD_UNSIGNED(UINT64_C(161061273600))),
+                                                        JSON_BUILD_PAIR("signedLocally", JSON_BUILD_BOOLEAN(true)))))),
+                        JSON_BUILD_PAIR("signature", JSON_BUILD_ARRAY(
+                                        JSON_BUILD_OBJECT(
+                                                JSON_BUILD_PAIR("data", JSON_BUILD_STRING("MEUCIQDl8cM1ZmmX0xSGxsCdkG8L9kP0hYx8A5T0yM6ZkMj7WAIgQ2N0g7H4t3zRzvY5wJkPz6c4Y4qL+Xk3m1QKp9b7NUw=")),
+                                                JSON_BUILD_PAIR("key", JSON_BUILD_STRING("-----BEGIN PUBLIC KEY-----\nMCowBQYDK2VwAyEAbs7ELeiEYBxkUQhxZ+5NGyu6J7gXtZ5+5Ji5LeaF4yU=\n-----END PUBLIC KEY-----\n"))))))) >= 0);
+
+        return v;
+}
+
+static JsonVariant *make_wide_object(void) {
+        JsonVariant *v = NULL;
+
+        /* Like the list of all properties of a unit or similar */
+        for (unsigned i = 0; i < 256; i++) {
+                char key[STRLEN("Property") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(key, "Property%u", i * 7919 % 256);
+                assert_se(json_variant_set_field_unsigned(&v, key, i) >= 0);
+        }
+
+        return v;
+}
+
+static void benchmark(const char *what, JsonVariant *v, unsigned n_iterations) {
+        _cleanup_free_ char *text = NULL;
+        _cleanup_free_ void *binary = NULL;
+        _cleanup_free_ const char **keys = NULL;
+        JsonVariant *value, *key;
+        usec_t t, parse, parse_arena, parse_binary, format, format_binary, lookup;
+        size_t n_keys = 0, binary_size;
+        const char *k;
+
+        assert_se(json_variant_format(v, 0, &text) >= 0);
+        assert_se(json_variant_format_binary(v, &binary, &binary_size) >= 0);
+
+        keys = new(const char*, json_variant_elements(v) / 2);
+        assert_se(keys);
+        JSON_VARIANT_OBJECT_FOREACH(k, value, v)
+                keys[n_keys++] = k;
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *w = NULL;
+
+                assert_se(json_parse(text, 0, &w, NULL, NULL) >= 0);
+        }
+        parse = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *w = NULL;
+
+                assert_se(json_parse(text, JSON_PARSE_ARENA, &w, NULL, NULL) >= 0);
+        }
+        parse_arena = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *w = NULL;
+
+                assert_se(json_parse_binary(binary, binary_size, JSON_PARSE_ARENA, &w) >= 0);
+        }
+        parse_binary = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_free_ char *f = NULL;
+
+                assert_se(json_variant_format(v, 0, &f) >= 0);
+        }
+        format = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_free_ void *b = NULL;
+                size_t sz;
+
+                assert_se(json_variant_format_binary(v, &b, &sz) >= 0);
+        }
+        format_binary = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        /* Look up every field once per iteration, on one parsed instance, as consumers of the records do */
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++)
+                for (size_t j = 0; j < n_keys; j++) {
+                        assert_se(json_variant_by_key_full(v, keys[j], &key));
+                        assert_se(key);
+                }
+        lookup = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("%s: %zu bytes, %zu fields, parse %s per object (%.1f MB/s), in arena %s, lookup %" PRIu64 "ns per field",
+                 what, strlen(text), n_keys,
+                 FORMAT_TIMESPAN(parse / n_iterations, 1),
+                 parse > 0 ? (double) strlen(text) * n_iterations / parse : 0.0,
+                 FORMAT_TIMESPAN(parse_arena / n_iterations, 1),
+                 lookup * NSEC_PER_USEC / (n_iterations * n_keys));
+        log_info("%s: binary %zu bytes, parse in arena %s, format %s, as text %s",
+                 what, binary_size,
+                 FORMAT_TIMESPAN(parse_binary / n_iterations, 1),
+                 FORMAT_TIMESPAN(format_binary / n_iterations, 1),
+                 FORMAT_TIMESPAN(format / n_iterations, 1));
+
+        benchmark_report(parse * NSEC_PER_USEC / n_iterations, "ns", "%s/parse", what);
+        benchmark_report(parse_arena * NSEC_PER_USEC / n_iterations, "ns", "%s/parse_arena", what);
+        benchmark_report(parse_binary * NSEC_PER_USEC / n_iterations, "ns", "%s/parse_binary", what);
+        benchmark_report(format * NSEC_PER_USEC / n_iterations, "ns", "%s/format", what);
+        benchmark_report(format_binary * NSEC_PER_USEC / n_iterations, "ns", "%s/format_binary", what);
+        benchmark_report(lookup * NSEC_PER_USEC / (n_iterations * n_keys), "ns", "%s/lookup", what);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(json_variant_unrefp) JsonVariant *user = NULL, *wide = NULL;
+        unsigned n;
+
+        test_setup_logging(LOG_INFO);
+
+        n = slow_tests_enabled() ? 100000 : 10000;
+
+        user = make_user_record();
+        benchmark("user_record", user, n);
+
+        wide = make_wide_object();
+        benchmark("wide_object", wide, n / 10);
+
+        return 0;
+}
@@ -625,4 +625,118 @@ TEST(variant) {
         test_variant_one("[ 0, -0, 0.0, -0.0, 0.000, -0.000, 0e0, -0e0, 0e+0, -0e-0, 0e-0, -0e000, 0e+000 ]", test_zeroes);
 }
 
+TEST(by_key_index) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_free_ char *fields = NULL, *text = NULL;
+        JsonVariant *k;
+
+        /* Large unsorted objects are looked up via an index, make sure that behaves like the linear search,
+         * including for duplicate keys, of which the first one wins */
+
+        for (unsigned i = 0; i < 64; i++)
+                assert_se(strextendf_with_separator(&fields, ", ", "\"field%u\": %u", i, 63 - i) >= 0);
+        assert_se(text = strjoin("{ ", fields, ", \"field7\": 1000, \"\": 2000 }"));
+
+        assert_se(json_parse(text, 0, &v, NULL, NULL) >= 0);
+        assert_se(!json_variant_is_sorted(v));
+
+        for (unsigned i = 0; i < 64; i++) {
+                char key[STRLEN("field") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(key, "field%u", i);
+                assert_se(json_variant_unsigned(json_variant_by_key(v, key)) == 63 - i);
+        }
+
+        assert_se(json_variant_unsigned(json_variant_by_key_full(v, "", &k)) == 2000);
+        assert_se(streq(json_variant_string(k), ""));
+
+        assert_se(!json_variant_by_key(v, "field64"));
+        assert_se(!json_variant_by_key(v, "aaa"));
+        assert_se(!json_variant_by_key(v, "zzz"));
+}
+
+static void test_arena_one(const char *text) {
+        _cleanup_(json_variant_unrefp) JsonVariant *a = NULL, *b = NULL;
+
+        log_info("/* %s (%s) */", __func__, text);
+
+        assert_se(json_parse(text, 0, &a, NULL, NULL) >= 0);
+        assert_se(json_parse(text, JSON_PARSE_ARENA, &b, NULL, NULL) >= 0);
+        assert_se(json_variant_equal(a, b));
+}
+
+TEST(arena) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL, *s = NULL;
+        const char *text = "{ \"some long key\" : [ 1, -2, 3.5, \"short\", \"a much longer string\", null, true ], "
+                           "\"other\" : { \"nested object\" : { \"deeper still\" : [ [], {}, [ \"xxxxxxxxxxxx\" ] ] } } }";
+
+        test_arena_one(text);
+        test_arena_one("[ \"xxxxxxxxxxxx\", { \"yyyyyyyyyyyy\" : \"zzzzzzzzzzzz\" } ]");
+        test_arena_one("\"a string at the top-level\"");
+        test_arena_one("4711");
+        test_arena_one("[]");
+
+        /* Variants from within the tree keep the whole tree alive */
+        assert_se(json_parse(text, JSON_PARSE_ARENA, &v, NULL, NULL) >= 0);
+        w = json_variant_ref(json_variant_by_key(json_variant_by_key(v, "other"), "nested object"));
+        s = json_variant_ref(json_variant_by_index(json_variant_by_key(v, "some long key"), 4));
+        v = json_variant_unref(v);
+        assert_se(streq(json_variant_string(s), "a much longer string"));
+        assert_se(json_variant_elements(json_variant_by_key(w, "deeper still")) == 3);
+
+        /* Failures half-way through must not leak or double free anything */
+        assert_se(json_parse("{ \"xxxxxxxxxxxx\" : [ \"yyyyyyyyyyyy\" ] } garbage", JSON_PARSE_ARENA, &v, NULL, NULL) < 0);
+        assert_se(json_parse("{ \"xxxxxxxxxxxx\" : [ \"yyyyyyyyyyyy\" ", JSON_PARSE_ARENA|JSON_PARSE_SENSITIVE, &v, NULL, NULL) < 0);
+        assert_se(!v);
+}
+
+static void test_binary_one(const char *text) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL, *a = NULL;
+        _cleanup_free_ char *x = NULL, *y = NULL;
+        _cleanup_free_ void *b = NULL;
+        size_t n;
+
+        log_debug("/* %s(%s) */", __func__, text);
+
+        assert_se(json_parse(text, 0, &v, NULL, NULL) >= 0);
+        assert_se(json_variant_format_binary(v, &b, &n) >= 0);
+
+        assert_se(json_parse_binary(b, n, 0, &w) >= 0);
+        assert_se(json_parse_binary(b, n, JSON_PARSE_ARENA, &a) >= 0);
+        assert_se(json_variant_equal(v, w));
+        assert_se(json_variant_equal(v, a));
+
+        assert_se(json_variant_format(v, 0, &x) >= 0);
+        assert_se(json_variant_format(w, 0, &y) >= 0);
+        assert_se(streq(x, y));
+
+        /* Anything cut short is refused */
+        for (size_t i = 0; i < n; i++)
+                assert_se(json_parse_binary(b, i, JSON_PARSE_ARENA, &a) == -EBADMSG);
+}
+
+TEST(binary) {
+        static const uint8_t bad_utf8[] = { 0x07, 0x02, 0xC3, 0x28 },
+                             embedded_nul[] = { 0x07, 0x02, 'a', 0x00 },
+                             bad_tag[] = { 0x42 },
+                             trailing[] = { 0x01, 0x01 },
+                             huge_array[] = { 0x08, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0x01 };
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+        test_binary_one("{ \"some long key\" : [ 1, -2, 3.5, \"short\", \"a much longer string\", null, true, false ], "
+                        "\"other\" : { \"nested object\" : { \"deeper still\" : [ [], {}, [ \"xxxxxxxxxxxx\" ] ] } } }");
+        test_binary_one("[ 0, -1, 127, 128, -9223372036854775808, 9223372036854775807, 18446744073709551615, 0.0, -1e300 ]");
+        test_binary_one("\"a string at the top-level, with ünicode\"");
+        test_binary_one("4711");
+        test_binary_one("[]");
+        test_binary_one("{}");
+
+        assert_se(json_parse_binary(bad_utf8, sizeof(bad_utf8), 0, &v) == -EUCLEAN);
+        assert_se(json_parse_binary(embedded_nul, sizeof(embedded_nul), 0, &v) == -EINVAL);
+        assert_se(json_parse_binary(bad_tag, sizeof(bad_tag), 0, &v) == -EBADMSG);
+        assert_se(json_parse_binary(trailing, sizeof(trailing), 0, &v) == -EBADMSG);
+        assert_se(json_parse_binary(huge_array, sizeof(huge_array), 0, &v) == -EBADMSG);
+        assert_se(!v);
+}
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
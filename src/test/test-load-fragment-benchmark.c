@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "fileio.h"
+#include "manager.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "stdio-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Writes a large number of synthetic but typical unit files, and measures how long it takes to load them,
+ * i.e. mostly the parsers in load-fragment.c and the specifier expansion in unit-printf.c. Compare the
+ * numbers with SYSTEMD_SLOW_TESTS=1, which makes the set of units ten times as large. */
+
+static const char unit_template[] =
+        "[Unit]\n"
+        "Description=Benchmark service %1$u for %%n\n"
+        "Documentation=man:benchmark(8) https://example.com/benchmark/%1$u\n"
+        "Wants=benchmark-%2$u.service network-online.target\n"
+        "After=benchmark-%2$u.service network-online.target basic.target\n"
+        "Before=benchmark-%3$u.service\n"
+        "ConditionPathExists=!/run/benchmark/%%N.disabled\n"
+        "\n"
+        "[Service]\n"
+        "Type=notify\n"
+        "ExecStartPre=-/usr/bin/true --prepare %1$u\n"
+        "ExecStart=/usr/bin/sleep infinity\n"
+        "ExecReload=/bin/kill -HUP $MAINPID\n"
+        "Restart=on-failure\n"
+        "RestartSec=5s\n"
+        "TimeoutStartSec=90s\n"
+        "Environment=FOO=bar BAZ=%1$u\n"
+        "RuntimeDirectory=benchmark-%1$u\n"
+        "StateDirectory=benchmark/%%p\n"
+        "WorkingDirectory=/var/lib/benchmark\n"
+        "ProtectSystem=strict\n"
+        "ProtectHome=yes\n"
+        "PrivateTmp=yes\n"
+        "NoNewPrivileges=yes\n"
+        "CapabilityBoundingSet=CAP_NET_BIND_SERVICE CAP_NET_RAW\n"
+        "SystemCallFilter=@system-service\n"
+        "RestrictAddressFamilies=AF_UNIX AF_INET AF_INET6\n"
+        "MemoryMax=512M\n"
+        "TasksMax=64\n"
+        "\n"
+        "[Install]\n"
+        "WantedBy=multi-user.target\n";
+
+static void write_units(const char *dir, unsigned n) {
+        for (unsigned i = 0; i < n; i++) {
+                _cleanup_free_ char *contents = NULL, *p = NULL;
+                char name[STRLEN("benchmark-.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "benchmark-%u.service", i);
+                assert_se(p = path_join(dir, name));
+                assert_se(asprintf(&contents, unit_template, i, i / 2, i + 1) >= 0);
+                assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+        }
+}
+
+static void benchmark_load(Manager *m, unsigned n, const char *what) {
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (unsigned i = 0; i < n; i++) {
+                char name[STRLEN("benchmark-.service") + DECIMAL_STR_MAX(unsigned)];
+                Unit *u;
+
+                xsprintf(name, "benchmark-%u.service", i);
+                assert_se(manager_load_unit(m, name, NULL, NULL, &u) >= 0);
+                assert_se(u->load_state == UNIT_LOADED);
+        }
+
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("%s: %u units, %s, %s per unit", what, n, FORMAT_TIMESPAN(t, 1), FORMAT_TIMESPAN(t / n, 1));
+        benchmark_report(t * NSEC_PER_USEC / n, "ns", "%s/%u", what, n);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        unsigned n;
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        r = enter_cgroup_subroot(NULL);
+        if (r == -ENOMEDIUM)
+                return log_tests_skipped("cgroupfs not available");
+
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        assert_se(set_unit_path(runtime_dir) >= 0);
+
+        n = slow_tests_enabled() ? 20000 : 2000;
+        write_units(runtime_dir, n);
+        log_info("Wrote %u unit files.", n);
+
+        r = manager_new(LOOKUP_SCOPE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (manager_errno_skip_test(r))
+                return log_tests_skipped_errno(r, "manager_new");
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL, NULL) >= 0);
+
+        benchmark_load(m, n, "load");
+
+        return 0;
+}
@@ -75,14 +75,22 @@ int main(int argc, char* argv[]) {
 
         assert_se(log_info_errno(SYNTHETIC_ERRNO(EUCLEAN), "foo") == -EUCLEAN);
 
-        for (int target = 0; target < _LOG_TARGET_MAX; target++) {
-                log_set_target(target);
-                log_open();
+        for (int buffered = false; buffered <= true; buffered++) {
+                log_set_buffered(buffered);
 
-                test_log_struct();
-                test_long_lines();
-                test_log_syntax();
+                for (int target = 0; target < _LOG_TARGET_MAX; target++) {
+                        log_set_target(target);
+                        log_open();
+
+                        test_log_struct();
+                        test_long_lines();
+                        test_log_syntax();
+
+                        log_flush();
+                }
         }
 
+        log_set_buffered(false);
+
         return 0;
 }
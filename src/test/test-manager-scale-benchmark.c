@@ -0,0 +1,343 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <malloc.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sd-bus.h"
+
+#include "dbus.h"
+#include "fileio.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Runs the manager in test mode on a large synthetic unit graph, and measures the operations whose cost
+ * grows with the number of units: loading all units, daemon-reload, building and dispatching a transaction
+ * that starts all units, ListUnits() over the private bus, creating transient units over the bus, and a
+ * storm of timers elapsing at the same time. Nothing is forked, as all services are Type=oneshot without
+ * ExecStart=. The size of the graph may be passed as argument, otherwise it has 2000 units, or 50000 with
+ * SYSTEMD_SLOW_TESTS=1. Compare the numbers for different sizes to spot super-linear behaviour. */
+
+#define TIMEOUT_USEC (5 * USEC_PER_MINUTE)
+
+static const char target_template[] =
+        "[Unit]\n"
+        "Description=Scale test target\n";
+
+/* Each service pulls in and is ordered after a few others, so that the transaction has to deal with a
+ * good number of redundant requirement and ordering edges */
+static const char service_template[] =
+        "[Unit]\n"
+        "Description=Scale test service %1$u\n"
+        "Wants=scale-%2$u.service\n"
+        "After=scale-%2$u.service scale-%3$u.service\n"
+        "\n"
+        "[Service]\n"
+        "Type=oneshot\n"
+        "RemainAfterExit=yes\n";
+
+static const char timer_template[] =
+        "[Unit]\n"
+        "Description=Scale test timer %1$u\n"
+        "\n"
+        "[Timer]\n"
+        "OnActiveSec=10ms\n"
+        "AccuracySec=1us\n";
+
+static const char timer_service_template[] =
+        "[Unit]\n"
+        "Description=Scale test timer service %1$u\n"
+        "\n"
+        "[Service]\n"
+        "Type=oneshot\n"
+        "RemainAfterExit=yes\n";
+
+static size_t malloc_usage(void) {
+#if HAVE_MALLINFO2
+        return mallinfo2().uordblks;
+#else
+        return 0;
+#endif
+}
+
+static void write_unit(const char *dir, const char *target, const char *name, const char *template, unsigned i) {
+        _cleanup_free_ char *contents = NULL, *p = NULL, *wants = NULL, *link = NULL;
+
+        /* The first service would depend on itself, hence use the next two instead */
+        assert_se(asprintf(&contents, template, i, i > 0 ? i / 2 : 1, i > 0 ? i - 1 : 2) >= 0);
+        assert_se(p = path_join(dir, name));
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+        if (!target)
+                return;
+
+        /* Pull in the unit from the target the same way as "systemctl enable" does */
+        assert_se(wants = strjoin(dir, "/", target, ".wants"));
+        assert_se(mkdir(wants, 0755) >= 0 || errno == EEXIST);
+        assert_se(link = path_join(wants, name));
+        assert_se(symlink(p, link) >= 0);
+}
+
+static void write_units(const char *dir, unsigned n_services, unsigned n_timers) {
+        write_unit(dir, NULL, "scale.target", target_template, 0);
+        write_unit(dir, NULL, "scale-timers.target", target_template, 0);
+
+        for (unsigned i = 0; i < n_services; i++) {
+                char name[STRLEN("scale-.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "scale-%u.service", i);
+                write_unit(dir, "scale.target", name, service_template, i);
+        }
+
+        for (unsigned i = 0; i < n_timers; i++) {
+                char name[STRLEN("scale-timer-.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "scale-timer-%u.timer", i);
+                write_unit(dir, "scale-timers.target", name, timer_template, i);
+                xsprintf(name, "scale-timer-%u.service", i);
+                write_unit(dir, NULL, name, timer_service_template, i);
+        }
+}
+
+static void run_until(Manager *m, bool (*done)(Manager *m, void *userdata), void *userdata) {
+        usec_t deadline = usec_add(now(CLOCK_MONOTONIC), TIMEOUT_USEC);
+
+        while (!done(m, userdata)) {
+                assert_se(now(CLOCK_MONOTONIC) < deadline);
+                assert_se(sd_event_run(m->event, USEC_PER_SEC) >= 0);
+        }
+}
+
+static bool jobs_done(Manager *m, void *userdata) {
+        return hashmap_isempty(m->jobs);
+}
+
+static bool flag_set(Manager *m, void *userdata) {
+        return *(bool*) userdata;
+}
+
+typedef struct TimerProgress {
+        unsigned n_timers;
+        unsigned n_active;
+} TimerProgress;
+
+static bool timers_done(Manager *m, void *userdata) {
+        TimerProgress *p = ASSERT_PTR(userdata);
+
+        /* The services are activated roughly in order, hence only look at the ones that were not active
+         * yet the last time, to not turn this check into a quadratic operation itself */
+        for (; p->n_active < p->n_timers; p->n_active++) {
+                char name[STRLEN("scale-timer-.service") + DECIMAL_STR_MAX(unsigned)];
+                Unit *u;
+
+                xsprintf(name, "scale-timer-%u.service", p->n_active);
+                u = manager_get_unit(m, name);
+                if (!u || unit_active_state(u) != UNIT_ACTIVE)
+                        return false;
+        }
+
+        return hashmap_isempty(m->jobs);
+}
+
+static void benchmark_load(Manager *m, unsigned n) {
+        size_t mem;
+        usec_t t;
+        Unit *u;
+
+        mem = malloc_usage();
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_load_unit(m, "scale.target", NULL, NULL, &u) >= 0);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+        mem = LESS_BY(malloc_usage(), mem);
+
+        assert_se(u->load_state == UNIT_LOADED);
+        assert_se(hashmap_size(m->units) > n);
+
+        log_info("Load: %u units, %s, %s per unit, %zu bytes per unit",
+                 n, FORMAT_TIMESPAN(t, 1), FORMAT_TIMESPAN(t / n, 1), mem / n);
+        benchmark_report(t * NSEC_PER_USEC / n, "ns", "load/%u", n);
+        if (mem > 0)
+                benchmark_report(mem / n, "bytes", "memory/%u", n);
+}
+
+static void benchmark_reload(Manager *m, unsigned n) {
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_reload(m) >= 0);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("Reload: %u units, %s", n, FORMAT_TIMESPAN(t, 1));
+        benchmark_report(t, "us", "reload/%u", n);
+}
+
+static void benchmark_start(Manager *m, unsigned n) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        usec_t t, dispatch;
+        unsigned n_jobs;
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job_by_name(m, JOB_START, "scale.target", JOB_REPLACE, NULL, &error, NULL) >= 0);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+        n_jobs = hashmap_size(m->jobs);
+
+        dispatch = now(CLOCK_MONOTONIC);
+        run_until(m, jobs_done, NULL);
+        dispatch = usec_sub_unsigned(now(CLOCK_MONOTONIC), dispatch);
+
+        assert_se(unit_active_state(manager_get_unit(m, "scale-0.service")) == UNIT_ACTIVE);
+
+        log_info("Start: %u units, transaction %s, %u jobs dispatched in %s, %s per job",
+                 n, FORMAT_TIMESPAN(t, 1), n_jobs, FORMAT_TIMESPAN(dispatch, 1),
+                 FORMAT_TIMESPAN(dispatch / n_jobs, 1));
+        benchmark_report(t, "us", "transaction/%u", n);
+        benchmark_report(dispatch * NSEC_PER_USEC / n_jobs, "ns", "dispatch/%u", n);
+}
+
+static int reply_handler(sd_bus_message *reply, void *userdata, sd_bus_error *ret_error) {
+        bool *done = ASSERT_PTR(userdata);
+
+        if (sd_bus_message_is_method_error(reply, NULL))
+                log_error("Method call failed: %s", sd_bus_message_get_error(reply)->message);
+        assert_se(!sd_bus_message_is_method_error(reply, NULL));
+
+        *done = true;
+        return 0;
+}
+
+static void call_and_wait(Manager *m, sd_bus_message *call) {
+        bool done = false;
+
+        assert_se(sd_bus_call_async(sd_bus_message_get_bus(call), NULL, call, reply_handler, &done, 0) >= 0);
+        run_until(m, flag_set, &done);
+}
+
+static void benchmark_list_units(Manager *m, sd_bus *bus, unsigned n) {
+        unsigned n_calls = 10;
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_calls; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *call = NULL;
+
+                assert_se(sd_bus_message_new_method_call(bus, &call, "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
+                                                         "org.freedesktop.systemd1.Manager", "ListUnits") >= 0);
+                call_and_wait(m, call);
+        }
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("ListUnits(): %u units, %s per call", n, FORMAT_TIMESPAN(t / n_calls, 1));
+        benchmark_report(t / n_calls, "us", "list_units/%u", n);
+}
+
+static void benchmark_transient(Manager *m, sd_bus *bus, unsigned n, unsigned n_transient) {
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_transient; i++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *call = NULL;
+                char name[STRLEN("scale-transient-.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "scale-transient-%u.service", i);
+
+                assert_se(sd_bus_message_new_method_call(bus, &call, "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
+                                                         "org.freedesktop.systemd1.Manager", "StartTransientUnit") >= 0);
+                assert_se(sd_bus_message_append(call, "ss", name, "fail") >= 0);
+                assert_se(sd_bus_message_append(call, "a(sv)", 3,
+                                                "Description", "s", "Scale test transient service",
+                                                "Type", "s", "oneshot",
+                                                "RemainAfterExit", "b", true) >= 0);
+                assert_se(sd_bus_message_append(call, "a(sa(sv))", 0) >= 0);
+                call_and_wait(m, call);
+        }
+        run_until(m, jobs_done, NULL);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("StartTransientUnit(): %u units, %u transient units, %s per unit",
+                 n, n_transient, FORMAT_TIMESPAN(t / n_transient, 1));
+        benchmark_report(t * NSEC_PER_USEC / n_transient, "ns", "start_transient/%u", n);
+}
+
+static void benchmark_timers(Manager *m, unsigned n, unsigned n_timers) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        TimerProgress p = { .n_timers = n_timers };
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job_by_name(m, JOB_START, "scale-timers.target", JOB_REPLACE, NULL, &error, NULL) >= 0);
+        run_until(m, timers_done, &p);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("Timer storm: %u units, %u timers elapsed in %s, %s per timer",
+                 n, n_timers, FORMAT_TIMESPAN(t, 1), FORMAT_TIMESPAN(t / n_timers, 1));
+        benchmark_report(t * NSEC_PER_USEC / n_timers, "ns", "timers/%u", n);
+}
+
+static void connect_private_bus(Manager *m, const char *runtime_dir, sd_bus **ret) {
+        _cleanup_(sd_bus_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_free_ char *address = NULL;
+
+        assert_se(bus_init_private(m) >= 0);
+
+        assert_se(address = strjoin("unix:path=", runtime_dir, "/systemd/private"));
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_address(bus, address) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        /* Both ends of the connection are dispatched by the manager's event loop */
+        assert_se(sd_bus_attach_event(bus, m->event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        *ret = TAKE_PTR(bus);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_(sd_bus_close_unrefp) sd_bus *bus = NULL;
+        unsigned n, n_small;
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n > 0);
+        else
+                n = slow_tests_enabled() ? 50000 : 2000;
+
+        /* Transient units and timers are created in smaller numbers, but they are measured against the
+         * full graph */
+        n_small = MAX(n / 10, 1u);
+
+        r = enter_cgroup_subroot(NULL);
+        if (r == -ENOMEDIUM)
+                return log_tests_skipped("cgroupfs not available");
+
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        assert_se(set_unit_path(runtime_dir) >= 0);
+
+        write_units(runtime_dir, n, n_small);
+        log_info("Wrote %u service and %u timer units.", n, n_small);
+
+        r = manager_new(LOOKUP_SCOPE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (manager_errno_skip_test(r))
+                return log_tests_skipped_errno(r, "manager_new");
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL, NULL) >= 0);
+
+        benchmark_load(m, n);
+        benchmark_reload(m, n);
+        benchmark_start(m, n);
+
+        connect_private_bus(m, runtime_dir, &bus);
+        benchmark_list_units(m, bus, n);
+        benchmark_transient(m, bus, n, n_small);
+
+        benchmark_timers(m, n, n_small);
+
+        return 0;
+}
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "mempool.h"
+#include "tests.h"
+
+struct tile {
+        unsigned value;
+        void *padding[3];
+};
+
+DEFINE_MEMPOOL(test_pool, struct tile, 8);
+
+TEST(mempool_trim) {
+        struct tile *t[1000];
+        size_t n_tiles;
+
+        for (size_t i = 0; i < ELEMENTSOF(t); i++) {
+                t[i] = mempool_alloc0_tile(&test_pool);
+                assert_se(t[i]);
+                assert_se(t[i]->value == 0);
+                t[i]->value = i;
+        }
+
+        assert_se(test_pool.n_used == ELEMENTSOF(t));
+        assert_se(test_pool.n_tiles >= ELEMENTSOF(t));
+        n_tiles = test_pool.n_tiles;
+
+        /* Everything is in use, nothing to release */
+        assert_se(mempool_trim(&test_pool) == 0);
+        assert_se(test_pool.n_tiles == n_tiles);
+
+        /* Free the later half, which covers the last pools, but not the first ones */
+        for (size_t i = ELEMENTSOF(t) / 2; i < ELEMENTSOF(t); i++)
+                mempool_free_tile(&test_pool, t[i]);
+        assert_se(test_pool.n_used == ELEMENTSOF(t) / 2);
+
+        assert_se(mempool_trim(&test_pool) > 0);
+        assert_se(test_pool.n_tiles < n_tiles);
+        assert_se(test_pool.n_tiles >= ELEMENTSOF(t) / 2);
+
+        /* The remaining tiles are untouched, and we can allocate again */
+        for (size_t i = 0; i < ELEMENTSOF(t) / 2; i++)
+                assert_se(t[i]->value == i);
+        for (size_t i = ELEMENTSOF(t) / 2; i < ELEMENTSOF(t); i++) {
+                t[i] = mempool_alloc_tile(&test_pool);
+                assert_se(t[i]);
+                t[i]->value = i;
+        }
+        for (size_t i = 0; i < ELEMENTSOF(t); i++)
+                assert_se(t[i]->value == i);
+
+        /* Free everything in random-ish order, then all pools go */
+        for (size_t i = 0; i < ELEMENTSOF(t); i++)
+                mempool_free_tile(&test_pool, t[i * 7 % ELEMENTSOF(t)]);
+        assert_se(test_pool.n_used == 0);
+
+        assert_se(mempool_trim(&test_pool) > 0);
+        assert_se(test_pool.n_tiles == 0);
+        assert_se(!test_pool.first_pool);
+        assert_se(!test_pool.freelist);
+}
+
+TEST(mempool_alloc0_tile_or_malloc) {
+        struct tile *t;
+        bool from_pool;
+
+        t = mempool_alloc0_tile_or_malloc(&test_pool, &from_pool);
+        assert_se(t);
+        assert_se(t->value == 0);
+        /* Only programs linking libshared have pools enabled, on their main thread */
+        assert_se(from_pool == (mempool_enabled && mempool_enabled()));
+        assert_se(test_pool.n_used == (from_pool ? 1U : 0U));
+
+        assert_se(!mempool_free_tile_or_free(&test_pool, t, from_pool));
+        assert_se(test_pool.n_used == 0);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
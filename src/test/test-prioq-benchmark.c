@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "prioq.h"
+#include "random-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Measures the typical uses of priority queues in sd-event: adding and removing items, changing their
+ * priority (as timers being rearmed do), and popping the first one, for queues of different sizes. Compare
+ * the numbers between builds to see the effect of changes to the implementation. SYSTEMD_SLOW_TESTS=1 uses
+ * bigger queues. */
+
+typedef struct Item {
+        usec_t time;
+        unsigned idx;
+} Item;
+
+static int item_compare(const Item *x, const Item *y) {
+        return CMP(x->time, y->time);
+}
+
+static void benchmark(unsigned n) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        _cleanup_free_ Item *items = NULL;
+        _cleanup_free_ usec_t *times = NULL;
+        usec_t t, put, reshuffle, reshuffle_all, pop;
+        unsigned n_reshuffle = MAX(n, 100000U);
+
+        /* Generate the random times beforehand, so that we don't measure the random number generator */
+        items = new(Item, n);
+        times = new(usec_t, n_reshuffle);
+        assert_se(items && times);
+
+        for (unsigned i = 0; i < n_reshuffle; i++)
+                times[i] = random_u64_range(USEC_PER_HOUR);
+
+        assert_se(q = prioq_new((compare_func_t) item_compare));
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n; i++) {
+                items[i].time = times[i];
+                assert_se(prioq_put(q, items + i, &items[i].idx) >= 0);
+        }
+        put = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        /* Like a timer that is rearmed after it elapsed, which moves it from the front to the back */
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_reshuffle; i++) {
+                Item *first = prioq_peek(q);
+
+                first->time += times[i];
+                assert_se(prioq_reshuffle(q, first, &first->idx) == 1);
+        }
+        reshuffle = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n; i++)
+                items[i].time = times[n_reshuffle - i - 1];
+        prioq_reshuffle_all(q);
+        reshuffle_all = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n; i++)
+                assert_se(prioq_pop(q));
+        pop = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        assert_se(prioq_isempty(q));
+
+        log_info("%u items: put %" PRIu64 "ns, reshuffle first %" PRIu64 "ns, reshuffle all %" PRIu64 "ns, "
+                 "pop %" PRIu64 "ns per item",
+                 n,
+                 put * NSEC_PER_USEC / n,
+                 reshuffle * NSEC_PER_USEC / n_reshuffle,
+                 reshuffle_all * NSEC_PER_USEC / n,
+                 pop * NSEC_PER_USEC / n);
+
+        benchmark_report(put * NSEC_PER_USEC / n, "ns", "%u/put", n);
+        benchmark_report(reshuffle * NSEC_PER_USEC / n_reshuffle, "ns", "%u/reshuffle", n);
+        benchmark_report(reshuffle_all * NSEC_PER_USEC / n, "ns", "%u/reshuffle_all", n);
+        benchmark_report(pop * NSEC_PER_USEC / n, "ns", "%u/pop", n);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n_max;
+
+        test_setup_logging(LOG_INFO);
+
+        n_max = slow_tests_enabled() ? 1U << 22 : 1U << 16;
+
+        for (unsigned n = 16; n <= n_max; n *= 4)
+                benchmark(n);
+
+        return 0;
+}
@@ -120,4 +120,62 @@ TEST(struct) {
         assert_se(set_isempty(s));
 }
 
+TEST(reshuffle) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        struct test t[SET_SIZE];
+        unsigned previous = 0;
+
+        srand(0);
+
+        assert_se(q = prioq_new((compare_func_t) test_compare));
+
+        for (unsigned i = 0; i < SET_SIZE; i++) {
+                t[i].value = (unsigned) rand();
+                assert_se(prioq_put(q, t + i, &t[i].idx) >= 0);
+        }
+
+        /* Change some priorities one by one, and then most of them at once */
+        for (unsigned i = 0; i < SET_SIZE; i += 3) {
+                t[i].value = (unsigned) rand();
+                assert_se(prioq_reshuffle(q, t + i, &t[i].idx) == 1);
+        }
+
+        for (unsigned i = 0; i < SET_SIZE; i++)
+                if (i % 5 != 0)
+                        t[i].value = (unsigned) rand();
+        prioq_reshuffle_all(q);
+
+        for (unsigned i = 0; i < SET_SIZE; i++)
+                assert_se(prioq_peek_by_index(q, t[i].idx) == t + i);
+
+        for (unsigned i = 0; i < SET_SIZE; i++) {
+                struct test *p;
+
+                assert_se(p = prioq_pop(q));
+                assert_se(previous <= p->value);
+                previous = p->value;
+        }
+
+        assert_se(prioq_isempty(q));
+        prioq_reshuffle_all(q);
+        prioq_reshuffle_all(NULL);
+}
+
+TEST(reserve) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+
+        assert_se(q = prioq_new(trivial_compare_func));
+
+        assert_se(prioq_reserve(q, 0) >= 0);
+        assert_se(prioq_reserve(q, SET_SIZE) >= 0);
+
+        for (unsigned i = 0; i < SET_SIZE; i++)
+                assert_se(prioq_put(q, UINT_TO_PTR(SET_SIZE - i), NULL) >= 0);
+
+        /* Reserving less than what is already allocated is a NOP */
+        assert_se(prioq_reserve(q, 1) >= 0);
+        assert_se(prioq_size(q) == SET_SIZE);
+        assert_se(PTR_TO_UINT(prioq_peek(q)) == 1);
+}
+
 DEFINE_TEST_MAIN(LOG_INFO);
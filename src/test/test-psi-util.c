@@ -73,6 +73,16 @@ TEST(read_mem_pressure) {
         assert_se(LOADAVG_INT_SIDE(rp.avg300) == 1);
         assert_se(LOADAVG_DECIMAL_SIDE(rp.avg300) == 8);
         assert_se(rp.total == 58464525);
+
+        /* The same fd can be read repeatedly */
+        assert_se(read_resource_pressure_fd(fd, PRESSURE_TYPE_FULL, &rp) == 0);
+        assert_se(rp.total == 58464525);
+        assert_se(write_string_file(path, "some avg10=0.22 avg60=0.17 avg300=1.11 total=58761460\n"
+                                          "full avg10=0.23 avg60=0.16 avg300=1.08 total=58464526", WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(read_resource_pressure_fd(fd, PRESSURE_TYPE_FULL, &rp) == 0);
+        assert_se(rp.total == 58464526);
+        assert_se(read_resource_pressure_fd(fd, PRESSURE_TYPE_SOME, &rp) == 0);
+        assert_se(rp.total == 58761460);
 }
 
 DEFINE_TEST_MAIN(LOG_DEBUG);
@@ -3,8 +3,11 @@
 #include <unistd.h>
 
 #include "alloc-util.h"
+#include "fs-util.h"
+#include "mkdir.h"
 #include "process-util.h"
 #include "rm-rf.h"
+#include "stat-util.h"
 #include "string-util.h"
 #include "tests.h"
 #include "tmpfile-util.h"
@@ -63,4 +66,30 @@ TEST(rm_rf_chmod) {
         test_rm_rf_chmod_inner();
 }
 
+TEST(rm_rf_parallel) {
+        _cleanup_free_ char *d = NULL;
+
+        assert_se(mkdtemp_malloc(NULL, &d) >= 0);
+
+        for (unsigned i = 0; i < 8; i++)
+                for (unsigned j = 0; j < 8; j++)
+                        for (unsigned k = 0; k < 4; k++) {
+                                _cleanup_free_ char *p = NULL;
+
+                                assert_se(asprintf(&p, "%s/%u/%u/%u", d, i, j, k) >= 0);
+                                assert_se(mkdir_p(p, 0755) >= 0);
+                                assert_se(touch(strjoina(p, "/file")) >= 0);
+                                assert_se(symlinkat("file", AT_FDCWD, strjoina(p, "/link")) >= 0);
+                        }
+
+        assert_se(rm_rf(d, REMOVE_PHYSICAL|REMOVE_PARALLEL) >= 0);
+        assert_se(dir_is_empty(d, /* ignore_hidden_or_backup= */ false) > 0);
+
+        assert_se(mkdir_p(strjoina(d, "/a/b/c"), 0755) >= 0);
+        assert_se(rm_rf(d, REMOVE_PHYSICAL|REMOVE_PARALLEL|REMOVE_ROOT) >= 0);
+
+        errno = 0;
+        assert_se(access(d, F_OK) < 0 && errno == ENOENT);
+}
+
 DEFINE_TEST_MAIN(LOG_DEBUG);
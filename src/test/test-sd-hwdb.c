@@ -7,7 +7,9 @@
 #include "errno.h"
 #include "hwdb-internal.h"
 #include "nulstr-util.h"
+#include "strv.h"
 #include "tests.h"
+#include "time-util.h"
 
 TEST(failed_enumerate) {
         _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
@@ -72,6 +74,101 @@ TEST(sd_hwdb_new_from_path) {
         assert_se(r >= 0);
 }
 
+static const char* const modaliases[] = {
+        DELL_MODALIAS,
+        "usb:v1D6Bp0002d0515dc09dsc00dp01ic09isc00ip00in00",
+        "usb:v046Dp082Dd0011dcEFdsc02dp01ic0Eisc01ip00in00",
+        "pci:v00008086d00001237sv00001AF4sd00001100bc06sc00i00",
+        "pci:v000010DEd00001C82sv00001043sd00008613bc03sc00i00",
+        "acpi:PNP0A03:",
+        "input:b0003v046Dp4024e0111-e0,1,2,3,4,11,14,k71,72,73,74,75,77,ram4,lsfw",
+        "evdev:input:b0003v046Dp4024e0111",
+        "no-such-modalias-should-exist",
+};
+
+static char** properties_strv(sd_hwdb *hwdb, const char *modalias) {
+        _cleanup_strv_free_ char **l = NULL;
+        const char *key, *value;
+
+        SD_HWDB_FOREACH_PROPERTY(hwdb, modalias, key, value)
+                assert_se(strv_extendf(&l, "%s=%s", key, value) >= 0);
+
+        return TAKE_PTR(l);
+}
+
+TEST(properties_cache) {
+        _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
+
+        assert_se(sd_hwdb_new(&hwdb) == 0);
+
+        /* The properties of a modalias looked up before must not change, also not when it was looked up
+         * right before, or when other modaliases were looked up in between. */
+        for (unsigned k = 0; k < 3; k++)
+                for (size_t i = 0; i < ELEMENTSOF(modaliases); i++) {
+                        _cleanup_(sd_hwdb_unrefp) sd_hwdb *fresh = NULL;
+                        _cleanup_strv_free_ char **a = NULL, **b = NULL, **c = NULL;
+                        const char *value;
+
+                        assert_se(sd_hwdb_new(&fresh) == 0);
+
+                        a = properties_strv(fresh, modaliases[i]);
+                        b = properties_strv(hwdb, modaliases[i]);
+                        c = properties_strv(hwdb, modaliases[i]);
+
+                        assert_se(strv_equal(a, b));
+                        assert_se(strv_equal(a, c));
+
+                        if (!strv_isempty(a)) {
+                                _cleanup_free_ char *key = NULL;
+
+                                assert_se(key = strndup(a[0], strchr(a[0], '=') - a[0]));
+                                assert_se(sd_hwdb_get(hwdb, modaliases[i], key, &value) >= 0);
+                                assert_se(streq(value, a[0] + strlen(key) + 1));
+                        } else
+                                assert_se(sd_hwdb_get(hwdb, modaliases[i], "ID_VENDOR_FROM_DATABASE", &value) == -ENOENT);
+                }
+}
+
+static usec_t lookup_many(sd_hwdb *hwdb, unsigned n, bool cached) {
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (unsigned k = 0; k < n; k++)
+                for (size_t i = 0; i < ELEMENTSOF(modaliases); i++) {
+                        const char *value;
+
+                        if (!cached) {
+                                hwdb->properties_cache = hashmap_free(hwdb->properties_cache);
+                                hwdb->properties_modalias = mfree(hwdb->properties_modalias);
+                        }
+
+                        /* Like the hwdb builtin of udev does */
+                        (void) sd_hwdb_get(hwdb, modaliases[i], "ID_VENDOR_FROM_DATABASE", &value);
+                        (void) sd_hwdb_get(hwdb, modaliases[i], "ID_MODEL_FROM_DATABASE", &value);
+                }
+
+        return usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+}
+
+TEST(lookup_benchmark) {
+        _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
+        unsigned n = slow_tests_enabled() ? 10000 : 1000;
+        usec_t t;
+
+        assert_se(sd_hwdb_new(&hwdb) == 0);
+
+        t = lookup_many(hwdb, n, false);
+        log_info("%zu uncached lookups: %s, %" PRIu64 "ns per lookup",
+                 n * ELEMENTSOF(modaliases), FORMAT_TIMESPAN(t, USEC_PER_MSEC),
+                 t * NSEC_PER_USEC / (n * ELEMENTSOF(modaliases)));
+
+        t = lookup_many(hwdb, n, true);
+        log_info("%zu cached lookups: %s, %" PRIu64 "ns per lookup",
+                 n * ELEMENTSOF(modaliases), FORMAT_TIMESPAN(t, USEC_PER_MSEC),
+                 t * NSEC_PER_USEC / (n * ELEMENTSOF(modaliases)));
+}
+
 static int intro(void) {
         _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
         int r;
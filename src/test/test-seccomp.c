@@ -864,6 +864,60 @@ TEST(load_syscall_filter_set_raw) {
         assert_se(wait_for_terminate_and_check("syscallrawseccomp", pid, WAIT_LOG) == EXIT_SUCCESS);
 }
 
+TEST(compile_syscall_filter_set_raw) {
+        _cleanup_(seccomp_compiled_filter_freep) SeccompCompiledFilter *f = NULL;
+        _cleanup_free_ char *k1 = NULL, *k2 = NULL, *k3 = NULL;
+        _cleanup_hashmap_free_ Hashmap *s = NULL, *t = NULL;
+        pid_t pid;
+
+        assert_se(s = hashmap_new(NULL));
+        assert_se(t = hashmap_new(NULL));
+#if defined __NR_access && __NR_access >= 0
+        assert_se(hashmap_put(s, UINT32_TO_PTR(__NR_access + 1), INT_TO_PTR(-1)) >= 0);
+#endif
+        assert_se(hashmap_put(s, UINT32_TO_PTR(__NR_faccessat + 1), INT_TO_PTR(-1)) >= 0);
+        assert_se(hashmap_put(t, UINT32_TO_PTR(__NR_faccessat + 1), INT_TO_PTR(-1)) >= 0);
+#if defined __NR_access && __NR_access >= 0
+        assert_se(hashmap_put(t, UINT32_TO_PTR(__NR_access + 1), INT_TO_PTR(-1)) >= 0);
+#endif
+
+        /* The key must not depend on the insertion order, but on the actions and error numbers */
+        assert_se(seccomp_syscall_filter_key(SCMP_ACT_ALLOW, s, SCMP_ACT_ERRNO(EUCLEAN), &k1) >= 0);
+        assert_se(seccomp_syscall_filter_key(SCMP_ACT_ALLOW, t, SCMP_ACT_ERRNO(EUCLEAN), &k2) >= 0);
+        assert_se(seccomp_syscall_filter_key(SCMP_ACT_ALLOW, t, SCMP_ACT_ERRNO(EILSEQ), &k3) >= 0);
+        assert_se(streq(k1, k2));
+        assert_se(!streq(k1, k3));
+
+        if (!is_seccomp_available()) {
+                log_notice("Seccomp not available, skipping remaining tests in %s", __func__);
+                return;
+        }
+        if (!have_seccomp_privs()) {
+                log_notice("Not privileged, skipping remaining tests in %s", __func__);
+                return;
+        }
+
+        assert_se(seccomp_compile_syscall_filter_set_raw(SCMP_ACT_ALLOW, s, SCMP_ACT_ERRNO(EUCLEAN), &f) >= 0);
+
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                assert_se(access("/", F_OK) >= 0);
+
+                assert_se(seccomp_load_compiled_filter(f) >= 0);
+
+                assert_se(access("/", F_OK) < 0);
+                assert_se(errno == EUCLEAN);
+
+                assert_se(poll(NULL, 0, 0) == 0);
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(wait_for_terminate_and_check("syscallcompiledseccomp", pid, WAIT_LOG) == EXIT_SUCCESS);
+}
+
 TEST(native_syscalls_filtered) {
         pid_t pid;
 
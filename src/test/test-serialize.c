@@ -37,6 +37,30 @@ TEST(serialize_item) {
         assert_se(streq(line3, ""));
 }
 
+TEST(deserialize_read_line) {
+        _cleanup_(unlink_tempfilep) char fn[] = "/tmp/test-serialize.XXXXXX";
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *line1 = NULL, *line2 = NULL, *line3 = NULL, *line4 = NULL;
+
+        assert_se(fmkostemp_safe(fn, "r+", &f) == 0);
+        log_info("/* %s (%s) */", __func__, fn);
+
+        assert_se(serialize_item(f, "a", "bbb") == 1);
+        fputc('\n', f);
+        assert_se(serialize_item(f, "c", "d\\ne") == 1);
+
+        rewind(f);
+
+        assert_se(deserialize_read_line(f, &line1) == 6);
+        assert_se(streq(line1, "a=bbb"));
+        assert_se(deserialize_read_line(f, &line2) == 1);
+        assert_se(streq(line2, ""));
+        assert_se(deserialize_read_line(f, &line3) > 0);
+        assert_se(streq(line3, "c=d\\ne"));
+        assert_se(deserialize_read_line(f, &line4) == 0);
+        assert_se(streq(line4, ""));
+}
+
 TEST(serialize_item_escaped) {
         _cleanup_(unlink_tempfilep) char fn[] = "/tmp/test-serialize.XXXXXX";
         _cleanup_fclose_ FILE *f = NULL;
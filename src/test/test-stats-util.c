@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "stats-util.h"
+#include "tests.h"
+
+DEFINE_STATS_COUNTER(test_counter, "test.counter");
+DEFINE_STATS_COUNTER(test_other_counter, "test.other_counter");
+DEFINE_STATS_HISTOGRAM(test_histogram, "test.histogram");
+
+TEST(stats_histogram_add) {
+        StatsHistogram h = {};
+
+        stats_histogram_add(&h, 0);
+        stats_histogram_add(&h, 1);
+        stats_histogram_add(&h, 3);
+        stats_histogram_add(&h, 1000);
+        stats_histogram_add(&h, USEC_INFINITY - 1);
+
+        assert_se(h.n == 5);
+        assert_se(h.max == USEC_INFINITY - 1);
+        assert_se(h.buckets[0] == 2);
+        assert_se(h.buckets[1] == 1);
+        assert_se(h.buckets[9] == 1);
+        assert_se(h.buckets[STATS_HISTOGRAM_BUCKETS - 1] == 1);
+}
+
+TEST(stats_build_json) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        JsonVariant *counters, *histogram, *buckets;
+
+        stats_counter_inc(&test_counter);
+        stats_counter_add(&test_counter, 41);
+        stats_histogram_add(&test_histogram, 5);
+        stats_histogram_add(&test_histogram, 7);
+
+        assert_se(stats_build_json(&v) >= 0);
+        json_variant_dump(v, JSON_FORMAT_PRETTY_AUTO|JSON_FORMAT_COLOR_AUTO, NULL, NULL);
+
+        assert_se(counters = json_variant_by_key(v, "counters"));
+        assert_se(json_variant_unsigned(json_variant_by_key(counters, "test.counter")) == 42);
+        assert_se(json_variant_unsigned(json_variant_by_key(counters, "test.other_counter")) == 0);
+
+        assert_se(histogram = json_variant_by_key(json_variant_by_key(v, "histograms"), "test.histogram"));
+        assert_se(json_variant_unsigned(json_variant_by_key(histogram, "count")) == 2);
+        assert_se(json_variant_unsigned(json_variant_by_key(histogram, "totalUSec")) == 12);
+        assert_se(json_variant_unsigned(json_variant_by_key(histogram, "maxUSec")) == 7);
+
+        /* Trailing empty buckets are left out */
+        assert_se(buckets = json_variant_by_key(histogram, "buckets"));
+        assert_se(json_variant_elements(buckets) == 3);
+        assert_se(json_variant_unsigned(json_variant_by_index(buckets, 2)) == 2);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
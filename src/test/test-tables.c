@@ -44,6 +44,7 @@ int main(int argc, char **argv) {
         test_table(assert_type, CONDITION_TYPE);
         test_table(automount_result, AUTOMOUNT_RESULT);
         test_table(automount_state, AUTOMOUNT_STATE);
+        test_table(cgroup_accounting_metric, CGROUP_ACCOUNTING_METRIC);
         test_table(cgroup_controller, CGROUP_CONTROLLER);
         test_table(cgroup_device_policy, CGROUP_DEVICE_POLICY);
         test_table(cgroup_io_limit_type, CGROUP_IO_LIMIT_TYPE);
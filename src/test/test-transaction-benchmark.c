@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "manager.h"
+#include "rm-rf.h"
+#include "service.h"
+#include "stdio-util.h"
+#include "target.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Builds a large synthetic unit graph, and measures how long it takes to build and activate transactions
+ * on it. This is mostly useful to spot super-linear behaviour in the transaction engine: compare the
+ * numbers with SYSTEMD_SLOW_TESTS=1, which makes the graph ten times as large. */
+
+static Unit *make_unit(Manager *m, const char *name, size_t size) {
+        Unit *u;
+
+        assert_se(unit_new_for_name(m, size, name, &u) >= 0);
+        u->load_state = UNIT_LOADED;
+
+        return u;
+}
+
+static Unit **make_graph(Manager *m, unsigned n, Unit **ret_target) {
+        Unit *target, **units;
+
+        units = new(Unit*, n);
+        assert_se(units);
+
+        target = make_unit(m, "benchmark.target", sizeof(Target));
+
+        for (unsigned i = 0; i < n; i++) {
+                char name[STRLEN("benchmark-.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(name, "benchmark-%u.service", i);
+                units[i] = make_unit(m, name, sizeof(Service));
+
+                /* The target pulls in everything, and each unit pulls in a few others too, and is ordered
+                 * after them, so that the transaction has to deal with a good number of redundant
+                 * requirement and ordering edges. */
+                assert_se(unit_add_two_dependencies(target, UNIT_AFTER, UNIT_WANTS, units[i], true, UNIT_DEPENDENCY_FILE) >= 0);
+
+                if (i > 0)
+                        assert_se(unit_add_two_dependencies(units[i], UNIT_AFTER, UNIT_REQUIRES, units[i / 2], true, UNIT_DEPENDENCY_FILE) >= 0);
+                if (i > 1)
+                        assert_se(unit_add_two_dependencies(units[i], UNIT_AFTER, UNIT_WANTS, units[i - 1], true, UNIT_DEPENDENCY_FILE) >= 0);
+                if (i > 2)
+                        assert_se(unit_add_dependency(units[i], UNIT_AFTER, units[i * 7 % (i - 1)], true, UNIT_DEPENDENCY_FILE) >= 0);
+        }
+
+        *ret_target = target;
+        return units;
+}
+
+static void benchmark_job(Manager *m, JobType type, Unit *u, JobMode mode, const char *id, const char *what) {
+        _cleanup_(sd_bus_error_free) sd_bus_error err = SD_BUS_ERROR_NULL;
+        usec_t t;
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(manager_add_job(m, type, u, mode, NULL, &err, NULL) >= 0);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("%s: %u jobs, %s", what, hashmap_size(m->jobs), FORMAT_TIMESPAN(t, 1));
+        benchmark_report(t, "us", "%s", id);
+
+        manager_clear_jobs(m);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_free_ Unit **units = NULL;
+        Unit *target;
+        unsigned n;
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        r = enter_cgroup_subroot(NULL);
+        if (r == -ENOMEDIUM)
+                return log_tests_skipped("cgroupfs not available");
+
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+        assert_se(set_unit_path(runtime_dir) >= 0);
+
+        r = manager_new(LOOKUP_SCOPE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (manager_errno_skip_test(r))
+                return log_tests_skipped_errno(r, "manager_new");
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL, NULL) >= 0);
+
+        n = slow_tests_enabled() ? 20000 : 2000;
+        units = make_graph(m, n, &target);
+        log_info("Built graph of %u units.", n);
+
+        /* Everything is down, hence everything needs to be started */
+        benchmark_job(m, JOB_START, target, JOB_REPLACE, "start_inactive", "Start, all units inactive");
+
+        /* Now mark everything as running: all jobs but the anchor are redundant and need to be dropped */
+        for (unsigned i = 0; i < n; i++)
+                SERVICE(units[i])->state = SERVICE_RUNNING;
+
+        benchmark_job(m, JOB_START, target, JOB_REPLACE, "start_active", "Start, all units active");
+        benchmark_job(m, JOB_RESTART, units[0], JOB_FAIL, "restart_root", "Restart of the root of the graph");
+        benchmark_job(m, JOB_STOP, units[0], JOB_REPLACE, "stop_root", "Stop of the root of the graph");
+
+        return 0;
+}
@@ -1,10 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
 #include "path-lookup.h"
+#include "rm-rf.h"
 #include "set.h"
 #include "special.h"
 #include "strv.h"
 #include "tests.h"
+#include "tmpfile-util.h"
 #include "unit-file.h"
 
 TEST(unit_validate_alias_symlink_and_warn) {
@@ -37,7 +39,7 @@ TEST(unit_file_build_name_map) {
 
         assert_se(lookup_paths_init(&lp, LOOKUP_SCOPE_SYSTEM, 0, NULL) >= 0);
 
-        assert_se(unit_file_build_name_map(&lp, &mtime, &unit_ids, &unit_names, NULL) == 1);
+        assert_se(unit_file_build_name_map(&lp, NULL, &mtime, &unit_ids, &unit_names, NULL) == 1);
 
         HASHMAP_FOREACH_KEY(dst, k, unit_ids)
                 log_info("ids: %s → %s", k, dst);
@@ -50,7 +52,7 @@ TEST(unit_file_build_name_map) {
         char buf[FORMAT_TIMESTAMP_MAX];
         log_debug("Last modification time: %s", format_timestamp(buf, sizeof buf, mtime));
 
-        r = unit_file_build_name_map(&lp, &mtime, &unit_ids, &unit_names, NULL);
+        r = unit_file_build_name_map(&lp, NULL, &mtime, &unit_ids, &unit_names, NULL);
         assert_se(IN_SET(r, 0, 1));
         if (r == 0)
                 log_debug("Cache rebuild skipped based on mtime.");
@@ -85,6 +87,46 @@ TEST(unit_file_build_name_map) {
         }
 }
 
+TEST(unit_file_build_name_map_cache) {
+        _cleanup_(rm_rf_physical_and_freep) char *d = NULL;
+        _cleanup_(lookup_paths_free) LookupPaths lp = {};
+        _cleanup_hashmap_free_ Hashmap *ids1 = NULL, *names1 = NULL, *ids2 = NULL, *names2 = NULL;
+        _cleanup_set_free_ Set *paths1 = NULL, *paths2 = NULL;
+        const char *k, *v, *p;
+        char **l;
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-file.XXXXXX", &d) >= 0);
+        const char *cache = strjoina(d, "/unit-name-map");
+
+        assert_se(lookup_paths_init(&lp, LOOKUP_SCOPE_SYSTEM, 0, NULL) >= 0);
+
+        /* The first run writes the cache, the second one reads it */
+        assert_se(unit_file_build_name_map(&lp, cache, NULL, &ids1, &names1, &paths1) == 1);
+        assert_se(access(cache, F_OK) >= 0);
+        assert_se(unit_file_build_name_map(&lp, cache, NULL, &ids2, &names2, &paths2) == 1);
+
+        assert_se(hashmap_size(ids1) == hashmap_size(ids2));
+        HASHMAP_FOREACH_KEY(v, k, ids1)
+                assert_se(streq_ptr(hashmap_get(ids2, k), v));
+
+        assert_se(hashmap_size(names1) == hashmap_size(names2));
+        HASHMAP_FOREACH_KEY(l, k, names1)
+                assert_se(strv_equal(hashmap_get(names2, k), l));
+
+        assert_se(set_size(paths1) == set_size(paths2));
+        SET_FOREACH(p, paths1)
+                assert_se(set_contains(paths2, p));
+
+        /* A cache without the path cache is not good enough if that's requested */
+        ids1 = hashmap_free(ids1);
+        names1 = hashmap_free(names1);
+        assert_se(unlink(cache) >= 0);
+        assert_se(unit_file_build_name_map(&lp, cache, NULL, &ids1, &names1, NULL) == 1);
+        paths2 = set_free(paths2);
+        assert_se(unit_file_build_name_map(&lp, cache, NULL, &ids2, &names2, &paths2) == 1);
+        assert_se(set_size(paths1) == set_size(paths2));
+}
+
 TEST(runlevel_to_target) {
         in_initrd_force(false);
         assert_se(streq_ptr(runlevel_to_target(NULL), NULL));
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "path-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+#include "unit-state-table.h"
+
+TEST(unit_state_table) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmp = NULL;
+        _cleanup_(unit_state_table_freep) UnitStateTable *t = NULL;
+        _cleanup_free_ char *path = NULL;
+        size_t a = SIZE_MAX, b = SIZE_MAX, slots[1000];
+        UnitStateTableEntry e;
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-state-table-XXXXXX", &tmp) >= 0);
+        assert_se(path = path_join(tmp, "unit-states"));
+
+        assert_se(unit_state_table_lookup(path, "foo.service", &e) == -ENOENT);
+
+        assert_se(unit_state_table_new(path, &t) >= 0);
+        assert_se(unit_state_table_lookup(path, "foo.service", &e) == -ENOENT);
+
+        assert_se(unit_state_table_update(t, &a, "foo.service", UNIT_LOADED, UNIT_ACTIVATING, "start", 4711) >= 0);
+        assert_se(unit_state_table_update(t, &b, "bar.socket", UNIT_LOADED, UNIT_ACTIVE, "listening", 4712) >= 0);
+        assert_se(a != SIZE_MAX && b != SIZE_MAX && a != b);
+
+        assert_se(unit_state_table_lookup(path, "foo.service", &e) >= 0);
+        assert_se(streq(e.name, "foo.service"));
+        assert_se(streq(e.sub_state, "start"));
+        assert_se(e.load_state == UNIT_LOADED);
+        assert_se(e.active_state == UNIT_ACTIVATING);
+        assert_se(e.state_change_timestamp == 4711);
+
+        assert_se(unit_state_table_update(t, &a, "foo.service", UNIT_LOADED, UNIT_FAILED, "failed", 4713) >= 0);
+        assert_se(unit_state_table_lookup(path, "foo.service", &e) >= 0);
+        assert_se(e.active_state == UNIT_FAILED);
+        assert_se(streq(e.sub_state, "failed"));
+
+        /* Removed slots are reused */
+        unit_state_table_remove(t, &a);
+        assert_se(a == SIZE_MAX);
+        assert_se(unit_state_table_lookup(path, "foo.service", &e) == -ENOENT);
+        assert_se(unit_state_table_update(t, &a, "baz.mount", UNIT_LOADED, UNIT_INACTIVE, "dead", 0) >= 0);
+        assert_se(unit_state_table_lookup(path, "baz.mount", &e) >= 0);
+        assert_se(unit_state_table_lookup(path, "bar.socket", &e) >= 0);
+        assert_se(streq(e.sub_state, "listening"));
+
+        /* The table grows as needed */
+        for (size_t i = 0; i < ELEMENTSOF(slots); i++) {
+                char name[STRLEN("test-.service") + DECIMAL_STR_MAX(size_t)];
+
+                xsprintf(name, "test-%zu.service", i);
+                slots[i] = SIZE_MAX;
+                assert_se(unit_state_table_update(t, slots + i, name, UNIT_LOADED, UNIT_ACTIVE, "running", i) >= 0);
+        }
+
+        assert_se(unit_state_table_lookup(path, "test-999.service", &e) >= 0);
+        assert_se(e.state_change_timestamp == 999);
+        assert_se(unit_state_table_lookup(path, "bar.socket", &e) >= 0);
+
+        /* A new instance replaces the table */
+        t = unit_state_table_free(t);
+        assert_se(unit_state_table_new(path, &t) >= 0);
+        assert_se(unit_state_table_lookup(path, "bar.socket", &e) == -ENOENT);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
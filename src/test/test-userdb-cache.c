@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "fd-util.h"
+#include "fs-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+#include "user-util.h"
+#include "userdb-cache.h"
+
+static void add_user(UserDBCacheBuilder *b, const char *name, uid_t uid, const char *shell) {
+        _cleanup_(user_record_unrefp) UserRecord *ur = NULL;
+
+        assert_se(user_record_build(
+                                  &ur,
+                                  JSON_BUILD_OBJECT(JSON_BUILD_PAIR("userName", JSON_BUILD_STRING(name)),
+                                                    JSON_BUILD_PAIR("uid", JSON_BUILD_UNSIGNED(uid)),
+                                                    JSON_BUILD_PAIR("realName", JSON_BUILD_CONST_STRING("Some One")),
+                                                    JSON_BUILD_PAIR("homeDirectory", JSON_BUILD_CONST_STRING("/home/someone")),
+                                                    JSON_BUILD_PAIR("shell", JSON_BUILD_STRING(shell)))) >= 0);
+
+        assert_se(userdb_cache_builder_add_user(b, ur) >= 0);
+}
+
+static void add_group(UserDBCacheBuilder *b, const char *name, gid_t gid, char **members, char **extra_members) {
+        _cleanup_(group_record_unrefp) GroupRecord *gr = NULL;
+
+        assert_se(group_record_build(
+                                  &gr,
+                                  JSON_BUILD_OBJECT(JSON_BUILD_PAIR("groupName", JSON_BUILD_STRING(name)),
+                                                    JSON_BUILD_PAIR("gid", JSON_BUILD_UNSIGNED(gid)),
+                                                    JSON_BUILD_PAIR_CONDITION(!strv_isempty(members), "members", JSON_BUILD_STRV(members)))) >= 0);
+
+        assert_se(userdb_cache_builder_add_group(b, gr, extra_members) >= 0);
+}
+
+TEST(userdb_cache) {
+        _cleanup_(unlink_tempfilep) char path[] = "/tmp/test-userdb-cache.XXXXXX";
+        _cleanup_(userdb_cache_builder_freep) UserDBCacheBuilder *b = NULL;
+        _cleanup_close_ int fd = -1;
+        UserDBCache c = USERDB_CACHE_INIT(path);
+        struct passwd pwd;
+        struct group gr;
+        char buffer[1024];
+
+        fd = mkostemp_safe(path);
+        assert_se(fd >= 0);
+
+        assert_se(userdb_cache_builder_new(&b) >= 0);
+        add_user(b, "alice", 60001, "/bin/bash");
+        add_user(b, "bob", 60002, "/bin/zsh");
+        add_user(b, "alice", 60003, "/bin/sh"); /* Duplicate name, first one wins */
+        add_group(b, "alice", 60001, STRV_MAKE("alice"), STRV_MAKE("alice", "bob"));
+        add_group(b, "empty", 60010, NULL, NULL);
+        assert_se(userdb_cache_builder_write(b, path) >= 0);
+        b = userdb_cache_builder_free(b);
+
+        assert_se(userdb_cache_get_user(&c, "alice", UID_INVALID, &pwd, buffer, sizeof(buffer)) > 0);
+        assert_se(streq(pwd.pw_name, "alice"));
+        assert_se(streq(pwd.pw_passwd, "x"));
+        assert_se(pwd.pw_uid == 60001);
+        assert_se(pwd.pw_gid == 60001);
+        assert_se(streq(pwd.pw_gecos, "Some One"));
+        assert_se(streq(pwd.pw_dir, "/home/someone"));
+        assert_se(streq(pwd.pw_shell, "/bin/bash"));
+
+        assert_se(userdb_cache_get_user(&c, NULL, 60002, &pwd, buffer, sizeof(buffer)) > 0);
+        assert_se(streq(pwd.pw_name, "bob"));
+        assert_se(streq(pwd.pw_shell, "/bin/zsh"));
+
+        /* The duplicate is still found by its UID */
+        assert_se(userdb_cache_get_user(&c, NULL, 60003, &pwd, buffer, sizeof(buffer)) > 0);
+        assert_se(streq(pwd.pw_name, "alice"));
+        assert_se(streq(pwd.pw_shell, "/bin/sh"));
+
+        assert_se(userdb_cache_get_user(&c, "carol", UID_INVALID, &pwd, buffer, sizeof(buffer)) == 0);
+        assert_se(userdb_cache_get_user(&c, "alic", UID_INVALID, &pwd, buffer, sizeof(buffer)) == 0);
+        assert_se(userdb_cache_get_user(&c, NULL, 60004, &pwd, buffer, sizeof(buffer)) == 0);
+        assert_se(userdb_cache_get_user(&c, "bob", UID_INVALID, &pwd, buffer, 8) == -ERANGE);
+
+        assert_se(userdb_cache_get_group(&c, "alice", GID_INVALID, &gr, buffer, sizeof(buffer)) > 0);
+        assert_se(streq(gr.gr_name, "alice"));
+        assert_se(gr.gr_gid == 60001);
+        assert_se(streq(gr.gr_passwd, "x"));
+        assert_se(strv_equal(gr.gr_mem, STRV_MAKE("alice", "bob")));
+
+        assert_se(userdb_cache_get_group(&c, NULL, 60010, &gr, buffer, sizeof(buffer)) > 0);
+        assert_se(streq(gr.gr_name, "empty"));
+        assert_se(strv_isempty(gr.gr_mem));
+
+        assert_se(userdb_cache_get_group(&c, "bob", GID_INVALID, &gr, buffer, sizeof(buffer)) == 0);
+        assert_se(userdb_cache_get_group(&c, "alice", GID_INVALID, &gr, buffer, 16) == -ERANGE);
+
+        /* Updates are picked up through the existing mapping */
+        assert_se(userdb_cache_builder_new(&b) >= 0);
+        add_user(b, "carol", 60005, "/bin/fish");
+        assert_se(userdb_cache_builder_write(b, path) >= 0);
+
+        assert_se(userdb_cache_get_user(&c, "alice", UID_INVALID, &pwd, buffer, sizeof(buffer)) == 0);
+        assert_se(userdb_cache_get_user(&c, "carol", UID_INVALID, &pwd, buffer, sizeof(buffer)) > 0);
+        assert_se(pwd.pw_uid == 60005);
+        assert_se(userdb_cache_get_group(&c, NULL, 60001, &gr, buffer, sizeof(buffer)) == 0);
+
+        /* Writing the same contents again only refreshes the timestamp */
+        assert_se(userdb_cache_builder_write(b, path) >= 0);
+        assert_se(userdb_cache_get_user(&c, NULL, 60005, &pwd, buffer, sizeof(buffer)) > 0);
+        assert_se(streq(pwd.pw_name, "carol"));
+}
+
+TEST(userdb_cache_missing) {
+        UserDBCache c = USERDB_CACHE_INIT("/tmp/test-userdb-cache-does-not-exist");
+        struct passwd pwd;
+        char buffer[256];
+
+        assert_se(userdb_cache_get_user(&c, "root", UID_INVALID, &pwd, buffer, sizeof(buffer)) == 0);
+        assert_se(userdb_cache_get_user(&c, NULL, 0, &pwd, buffer, sizeof(buffer)) == 0);
+}
+
+DEFINE_TEST_MAIN(LOG_DEBUG);
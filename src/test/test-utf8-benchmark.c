@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "escape.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "utf8.h"
+
+/* Measures UTF-8 validation and C-style escaping of strings as journald and the journal output code see
+ * them: mostly ASCII log messages, with the occasional non-ASCII character or control character thrown in.
+ * Compare the numbers between builds to see the effect of changes. SYSTEMD_SLOW_TESTS=1 runs ten times as
+ * many iterations. */
+
+static const char *const strings[] = {
+        "Started Journal Service.",
+        "pam_unix(sshd:session): session opened for user root(uid=0) by (uid=0)",
+        "Listening on D-Bus System Message Bus Socket. This is a rather long message, as they tend to be when "
+        "services log their configuration or some stack trace, and it goes on like that for quite a while.",
+        "Sprache auf \"Deutsch (Österreich)\" geändert, Zeitzone ist Europe/Vienna.",
+        "Line one\nLine two\n\tindented line three\n",
+};
+
+static void benchmark(const char *str, unsigned n_iterations) {
+        usec_t t, valid, valid_ascii, printable, escape;
+        /* Functions declared _pure_ would be hoisted out of the loops otherwise */
+        const char * volatile s = str;
+        size_t l = strlen(str);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++)
+                assert_se(utf8_is_valid_n(s, l));
+        valid = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++)
+                (void) ascii_is_valid_n(s, l);
+        valid_ascii = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++)
+                assert_se(utf8_is_printable(s, l));
+        printable = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_free_ char *e = NULL;
+
+                assert_se(e = cescape_length(s, l));
+        }
+        escape = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("%3zu bytes: utf8_is_valid_n() %" PRIu64 "ns, ascii_is_valid_n() %" PRIu64 "ns, "
+                 "utf8_is_printable() %" PRIu64 "ns, cescape_length() %" PRIu64 "ns",
+                 l,
+                 valid * NSEC_PER_USEC / n_iterations,
+                 valid_ascii * NSEC_PER_USEC / n_iterations,
+                 printable * NSEC_PER_USEC / n_iterations,
+                 escape * NSEC_PER_USEC / n_iterations);
+
+        benchmark_report(valid * NSEC_PER_USEC / n_iterations, "ns", "%zu/utf8_is_valid_n", l);
+        benchmark_report(valid_ascii * NSEC_PER_USEC / n_iterations, "ns", "%zu/ascii_is_valid_n", l);
+        benchmark_report(printable * NSEC_PER_USEC / n_iterations, "ns", "%zu/utf8_is_printable", l);
+        benchmark_report(escape * NSEC_PER_USEC / n_iterations, "ns", "%zu/cescape_length", l);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n_iterations;
+
+        test_setup_logging(LOG_INFO);
+
+        n_iterations = slow_tests_enabled() ? 1000000 : 100000;
+
+        for (size_t i = 0; i < ELEMENTSOF(strings); i++)
+                benchmark(strings[i], n_iterations);
+
+        return 0;
+}
@@ -56,6 +56,42 @@ TEST(ascii_is_valid_n) {
         assert_se( ascii_is_valid_n("\342\204\242", 0));
 }
 
+TEST(utf8_is_valid_n_long) {
+        char buf[67];
+
+        /* Longer strings are checked a word at a time, make sure we notice bad bytes in any position */
+
+        memset(buf, 'a', sizeof(buf));
+        assert_se(utf8_is_valid_n(buf, sizeof(buf)));
+        assert_se(ascii_is_valid_n(buf, sizeof(buf)));
+
+        for (size_t i = 0; i < sizeof(buf); i++) {
+                buf[i] = 0;
+                assert_se(!utf8_is_valid_n(buf, sizeof(buf)));
+                assert_se(!ascii_is_valid_n(buf, sizeof(buf)));
+                assert_se(utf8_is_valid_n(buf, i));
+                assert_se(ascii_is_valid_n(buf, i));
+
+                buf[i] = '\377';
+                assert_se(!utf8_is_valid_n(buf, sizeof(buf)));
+                assert_se(!ascii_is_valid_n(buf, sizeof(buf)));
+
+                buf[i] = '\177';
+                assert_se(utf8_is_valid_n(buf, sizeof(buf)));
+                assert_se(ascii_is_valid_n(buf, sizeof(buf)));
+
+                if (i + 2 <= sizeof(buf)) {
+                        memcpy(buf + i, "\303\244", 2);
+                        assert_se(utf8_is_valid_n(buf, sizeof(buf)));
+                        assert_se(!ascii_is_valid_n(buf, sizeof(buf)));
+                        assert_se(!utf8_is_valid_n(buf, i + 1));
+                        buf[i + 1] = 'a';
+                }
+
+                buf[i] = 'a';
+        }
+}
+
 static void test_utf8_to_ascii_one(const char *s, int r_expected, const char *expected) {
         _cleanup_free_ char *ans = NULL;
         int r;
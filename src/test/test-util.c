@@ -4,6 +4,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
 #include "limits-util.h"
@@ -157,6 +158,35 @@ TEST(raw_clone) {
         assert_se(errno == EINVAL || ERRNO_IS_PRIVILEGE(errno)); /* Certain container environments prohibit namespaces to us, don't fail in that case */
 }
 
+TEST(raw_clone3) {
+        _cleanup_close_ int pidfd = -1;
+        pid_t parent, pid;
+        struct systemd_clone_args args = {
+                .flags = CLONE_PIDFD,
+                .pidfd = PTR_TO_UINT64(&pidfd),
+                .exit_signal = SIGCHLD,
+        };
+        siginfo_t si = {};
+
+        parent = getpid();
+
+        pid = raw_clone3(&args);
+        if (pid < 0 && (ERRNO_IS_NOT_SUPPORTED(errno) || ERRNO_IS_PRIVILEGE(errno)))
+                return (void) log_tests_skipped_errno(errno, "clone3() not available");
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                assert_se(raw_getpid() != parent);
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(raw_getpid() == parent);
+        assert_se(pidfd >= 0);
+
+        assert_se(waitid(P_PID, pid, &si, WEXITED) >= 0);
+        assert_se(si.si_code == CLD_EXITED && si.si_status == EXIT_SUCCESS);
+}
+
 TEST(physical_memory) {
         uint64_t p;
 
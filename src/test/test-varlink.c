@@ -69,6 +69,82 @@ static int reply(Varlink *link, JsonVariant *parameters, const char *error_id, V
         return 0;
 }
 
+#define N_PIPELINED 16U
+
+static unsigned n_pipelined = 0;
+
+static int pipelined_reply(Varlink *link, JsonVariant *parameters, const char *error_id, VarlinkReplyFlags flags, void *userdata) {
+        unsigned k = PTR_TO_UINT(userdata);
+
+        /* Replies must arrive in the order the calls were made */
+        assert_se(!error_id);
+        assert_se(k == n_pipelined++);
+        assert_se(json_variant_integer(json_variant_by_key(parameters, "sum")) == k + 1);
+
+        return 0;
+}
+
+static void pipeline_test(Varlink *c) {
+        JsonVariant *o = NULL;
+        const char *e;
+
+        /* Switch to the binary encoding on the way, which takes effect for the replies right away, and for
+         * our own calls once the server's reply to that was processed */
+        assert_se(varlink_negotiate_binary(c) >= 0);
+
+        /* Enqueue a bunch of calls at once, and then a synchronous one behind them, which should see all
+         * the others dispatched first */
+        for (unsigned k = 0; k < N_PIPELINED; k++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *i = NULL;
+
+                assert_se(json_build(&i, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("a", JSON_BUILD_UNSIGNED(k)),
+                                                           JSON_BUILD_PAIR("b", JSON_BUILD_INTEGER(1)))) >= 0);
+                assert_se(varlink_invoke_full(c, "io.test.DoSomething", i, pipelined_reply, UINT_TO_PTR(k)) >= 0);
+        }
+
+        assert_se(varlink_callb(c, "io.test.DoSomething", &o, &e, NULL,
+                                JSON_BUILD_OBJECT(JSON_BUILD_PAIR("a", JSON_BUILD_INTEGER(1)),
+                                                  JSON_BUILD_PAIR("b", JSON_BUILD_INTEGER(2)))) >= 0);
+        assert_se(!e);
+        assert_se(json_variant_integer(json_variant_by_key(o, "sum")) == 3);
+        assert_se(n_pipelined == N_PIPELINED);
+
+        /* This one goes out in binary */
+        assert_se(varlink_callb(c, "io.test.DoSomething", &o, &e, NULL,
+                                JSON_BUILD_OBJECT(JSON_BUILD_PAIR("a", JSON_BUILD_STRING("äöü")),
+                                                  JSON_BUILD_PAIR("b", JSON_BUILD_INTEGER(-2)))) >= 0);
+        assert_se(!e);
+        assert_se(json_variant_integer(json_variant_by_key(o, "sum")) == -2);
+}
+
+static void pool_test(const char *address) {
+        _cleanup_(varlink_pool_freep) VarlinkPool *pool = NULL;
+        _cleanup_(varlink_unrefp) Varlink *a = NULL, *b = NULL, *c = NULL;
+        JsonVariant *o = NULL;
+        const char *e;
+
+        assert_se(varlink_pool_new(&pool) >= 0);
+
+        assert_se(varlink_pool_get(pool, address, &a) == 1);
+        assert_se(varlink_pool_get(pool, address, &b) == 0);
+        assert_se(a == b);
+
+        assert_se(varlink_callb(a, "io.test.DoSomething", &o, &e, NULL,
+                                JSON_BUILD_OBJECT(JSON_BUILD_PAIR("a", JSON_BUILD_INTEGER(4)),
+                                                  JSON_BUILD_PAIR("b", JSON_BUILD_INTEGER(5)))) >= 0);
+        assert_se(json_variant_integer(json_variant_by_key(o, "sum")) == 9);
+
+        /* A connection that went away is replaced */
+        assert_se(varlink_close(a) > 0);
+        assert_se(varlink_pool_get(pool, address, &c) == 1);
+        assert_se(c != a);
+
+        assert_se(varlink_callb(c, "io.test.DoSomething", &o, &e, NULL,
+                                JSON_BUILD_OBJECT(JSON_BUILD_PAIR("a", JSON_BUILD_INTEGER(6)),
+                                                  JSON_BUILD_PAIR("b", JSON_BUILD_INTEGER(7)))) >= 0);
+        assert_se(json_variant_integer(json_variant_by_key(o, "sum")) == 13);
+}
+
 static int on_connect(VarlinkServer *s, Varlink *link, void *userdata) {
         uid_t uid = UID_INVALID;
 
@@ -160,6 +236,9 @@ static void *thread(void *arg) {
         assert_se(streq_ptr(json_variant_string(json_variant_by_key(o, "method")), "io.test.IDontExist"));
         assert_se(streq(e, VARLINK_ERROR_METHOD_NOT_FOUND));
 
+        pipeline_test(c);
+        pool_test(arg);
+
         flood_test(arg);
 
         assert_se(varlink_send(c, "io.test.Done", NULL) >= 0);
@@ -223,6 +223,7 @@ static int manager_clock_watch(sd_event_source *source, int fd, uint32_t revents
         /* resync */
         log_debug("System time changed. Resyncing.");
         m->poll_resync = true;
+        m->burst_remaining = NTP_BURST_PACKETS;
 
         return manager_send_request(m);
 }
@@ -314,7 +315,7 @@ static int manager_adjust_clock(Manager *m, double offset, int leap_sec) {
 }
 
 static bool manager_sample_spike_detection(Manager *m, double offset, double delay) {
-        unsigned i, idx_cur, idx_new, idx_min;
+        unsigned i, idx_cur, idx_new, idx_min, n = 0;
         double jitter;
         double j;
 
@@ -339,10 +340,18 @@ static bool manager_sample_spike_detection(Manager *m, double offset, double del
                 if (m->samples[i].delay > 0 && m->samples[i].delay < m->samples[idx_min].delay)
                         idx_min = i;
 
+        /* Only consider the slots that were filled already, the empty ones would otherwise inflate the
+         * jitter by the offset of the best sample, until the history is complete */
         j = 0;
-        for (i = 0; i < ELEMENTSOF(m->samples); i++)
+        for (i = 0; i < ELEMENTSOF(m->samples); i++) {
+                if (m->samples[i].delay <= 0)
+                        continue;
+
                 j += pow(m->samples[i].offset - m->samples[idx_min].offset, 2);
-        m->samples_jitter = sqrt(j / (ELEMENTSOF(m->samples) - 1));
+                n++;
+        }
+        if (n > 1)
+                m->samples_jitter = sqrt(j / (n - 1));
 
         /* ignore samples when resyncing */
         if (m->poll_resync)
@@ -547,10 +556,10 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                   "  receive      : %.3f\n"
                   "  transmit     : %.3f\n"
                   "  dest         : %.3f\n"
-                  "  offset       : %+.3f sec\n"
-                  "  delay        : %+.3f sec\n"
+                  "  offset       : %+.6f sec\n"
+                  "  delay        : %+.6f sec\n"
                   "  packet count : %"PRIu64"\n"
-                  "  jitter       : %.3f%s\n"
+                  "  jitter       : %.6f%s\n"
                   "  poll interval: " USEC_FMT "\n",
                   NTP_FIELD_LEAP(ntpmsg.field),
                   NTP_FIELD_VERSION(ntpmsg.field),
@@ -628,7 +637,10 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                            "BOOTIME_USEC=" USEC_FMT, dts.boottime);
         }
 
-        r = manager_arm_timer(m, m->poll_interval_usec);
+        if (m->burst_remaining > 0)
+                m->burst_remaining--;
+
+        r = manager_arm_timer(m, m->burst_remaining > 0 ? MIN(NTP_BURST_INTERVAL_USEC, m->poll_interval_usec) : m->poll_interval_usec);
         if (r < 0)
                 return log_error_errno(r, "Failed to rearm timer: %m");
 
@@ -684,6 +696,7 @@ static int manager_begin(Manager *m) {
 
         m->talking = false;
         m->missed_replies = NTP_MAX_MISSED_REPLIES;
+        m->burst_remaining = NTP_BURST_PACKETS;
         if (m->poll_interval_usec == 0)
                 m->poll_interval_usec = m->poll_interval_min_usec;
 
@@ -25,6 +25,11 @@ typedef struct Manager Manager;
 #define NTP_POLL_INTERVAL_MIN_USEC      (32 * USEC_PER_SEC)
 #define NTP_POLL_INTERVAL_MAX_USEC      (2048 * USEC_PER_SEC)
 
+/* Right after connecting to a server and after the system clock was changed, a few requests are sent in
+ * quick succession, like NTP's "iburst" does, so that the sample history is populated early on. */
+#define NTP_BURST_PACKETS               4U
+#define NTP_BURST_INTERVAL_USEC         (2 * USEC_PER_SEC)
+
 #define NTP_RETRY_INTERVAL_MIN_USEC     (15 * USEC_PER_SEC)
 #define NTP_RETRY_INTERVAL_MAX_USEC     (6 * 60 * USEC_PER_SEC) /* 6 minutes */
 
@@ -81,6 +86,7 @@ struct Manager {
         usec_t poll_interval_min_usec;
         usec_t poll_interval_max_usec;
         bool poll_resync;
+        unsigned burst_remaining;
 
         /* history data */
         struct {
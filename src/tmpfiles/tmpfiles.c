@@ -6,6 +6,7 @@
 #include <getopt.h>
 #include <limits.h>
 #include <linux/fs.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -25,6 +26,7 @@
 #include "chattr-util.h"
 #include "conf-files.h"
 #include "copy.h"
+#include "cpu-set-util.h"
 #include "def.h"
 #include "devnum-util.h"
 #include "dirent-util.h"
@@ -36,6 +38,7 @@
 #include "format-util.h"
 #include "fs-util.h"
 #include "glob-util.h"
+#include "hashmap.h"
 #include "io-util.h"
 #include "label.h"
 #include "log.h"
@@ -64,6 +67,7 @@
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "tmpfile-util.h"
 #include "umask-util.h"
 #include "user-util.h"
 
@@ -190,12 +194,28 @@ static char *arg_replace = NULL;
 
 #define MAX_DEPTH 256
 
+#define CLEAN_THREADS_MAX 8U
+
+/* Where we remember what we found in each directory we cleaned, see dir_cleanup() */
+#define CLEAN_STATE_PATH "/var/lib/systemd/tmpfiles/clean-state"
+
+typedef struct CleanState {
+        nsec_t mtime;    /* The directory's mtime when we enumerated it */
+        nsec_t oldest;   /* The oldest age-relevant timestamp of any non-directory in it */
+        usec_t scanned;  /* When we last looked at all of its entries */
+        AgeBy age_by;    /* The timestamps 'oldest' is based on */
+} CleanState;
+
 static OrderedHashmap *items = NULL, *globs = NULL;
 static Set *unix_sockets = NULL;
+static Hashmap *clean_state = NULL, *clean_state_new = NULL;
+static pthread_mutex_t clean_state_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 STATIC_DESTRUCTOR_REGISTER(items, ordered_hashmap_freep);
 STATIC_DESTRUCTOR_REGISTER(globs, ordered_hashmap_freep);
 STATIC_DESTRUCTOR_REGISTER(unix_sockets, set_freep);
+STATIC_DESTRUCTOR_REGISTER(clean_state, hashmap_freep);
+STATIC_DESTRUCTOR_REGISTER(clean_state_new, hashmap_freep);
 STATIC_DESTRUCTOR_REGISTER(arg_include_prefixes, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_exclude_prefixes, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_root, freep);
@@ -461,6 +481,152 @@ static bool unix_socket_alive(const char *fn) {
         return set_contains(unix_sockets, fn);
 }
 
+static int load_clean_state(void) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        int r;
+
+        /* Reads what we recorded about the directories we cleaned on the previous run. If anything is off
+         * with the file we just forget about it, the worst that happens is that we look at everything
+         * again. */
+
+        f = fopen(CLEAN_STATE_PATH, "re");
+        if (!f) {
+                if (errno != ENOENT)
+                        log_debug_errno(errno, "Failed to open %s, ignoring: %m", CLEAN_STATE_PATH);
+                return 0;
+        }
+
+        for (unsigned line = 1;; line++) {
+                _cleanup_free_ char *l = NULL, *path = NULL;
+                _cleanup_free_ CleanState *state = NULL;
+                uint64_t mtime, oldest, scanned;
+                unsigned age_by;
+                int k = 0;
+
+                r = read_line(f, LONG_LINE_MAX, &l);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to read %s, ignoring: %m", CLEAN_STATE_PATH);
+                if (r == 0)
+                        break;
+
+                if (sscanf(l, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %u %n", &mtime, &oldest, &scanned, &age_by, &k) != 4 || k <= 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "%s:%u: Invalid line, ignoring file.", CLEAN_STATE_PATH, line);
+
+                if (cunescape(l + k, 0, &path) < 0 || !path_is_absolute(path))
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG), "%s:%u: Invalid path, ignoring file.", CLEAN_STATE_PATH, line);
+
+                state = new(CleanState, 1);
+                if (!state)
+                        return log_oom();
+
+                *state = (CleanState) {
+                        .mtime = mtime,
+                        .oldest = oldest,
+                        .scanned = scanned,
+                        .age_by = age_by,
+                };
+
+                r = hashmap_ensure_put(&h, &path_hash_ops_free_free, path, state);
+                if (r == -ENOMEM)
+                        return log_oom();
+                if (r < 0)
+                        continue; /* Duplicate, ignore */
+
+                TAKE_PTR(path);
+                TAKE_PTR(state);
+        }
+
+        log_debug("Loaded cleanup state of %u directories.", hashmap_size(h));
+
+        clean_state = TAKE_PTR(h);
+        return 0;
+}
+
+static void remember_clean_state(const char *path, const CleanState *state) {
+        _cleanup_free_ CleanState *copy = NULL;
+        _cleanup_free_ char *p = NULL;
+        int r;
+
+        assert(path);
+        assert(state);
+
+        p = strdup(path);
+        copy = newdup(CleanState, state, 1);
+        if (!p || !copy) {
+                log_oom_debug();
+                return;
+        }
+
+        assert_se(pthread_mutex_lock(&clean_state_mutex) == 0);
+        r = hashmap_ensure_put(&clean_state_new, &path_hash_ops_free_free, p, copy);
+        assert_se(pthread_mutex_unlock(&clean_state_mutex) == 0);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to remember cleanup state of \"%s\", ignoring: %m", path);
+                return;
+        }
+
+        TAKE_PTR(p);
+        TAKE_PTR(copy);
+}
+
+static int save_clean_state(void) {
+        _cleanup_(unlink_and_freep) char *t = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        CleanState *state;
+        const char *path;
+        int r;
+
+        r = mkdir_parents(CLEAN_STATE_PATH, 0755);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to create parent directories of %s: %m", CLEAN_STATE_PATH);
+
+        r = fopen_temporary(CLEAN_STATE_PATH, &f, &t);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to create %s: %m", CLEAN_STATE_PATH);
+
+        (void) fchmod(fileno(f), 0600);
+
+        HASHMAP_FOREACH_KEY(state, path, clean_state_new) {
+                _cleanup_free_ char *e = NULL;
+
+                e = cescape(path);
+                if (!e)
+                        return log_oom();
+
+                fprintf(f, "%" PRIu64 " %" PRIu64 " %" PRIu64 " %u %s\n",
+                        state->mtime, state->oldest, state->scanned, (unsigned) state->age_by, e);
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to write %s: %m", CLEAN_STATE_PATH);
+
+        if (rename(t, CLEAN_STATE_PATH) < 0)
+                return log_debug_errno(errno, "Failed to move %s into place: %m", CLEAN_STATE_PATH);
+
+        t = mfree(t);
+        return 0;
+}
+
+static nsec_t age_by_timestamp(nsec_t atime, nsec_t btime, nsec_t ctime, nsec_t mtime, AgeBy age_by) {
+        nsec_t t = 0;
+
+        /* Returns the timestamp needs_cleanup() effectively compares with the cutoff, i.e. the newest of
+         * the ones we care about. */
+
+        if (FLAGS_SET(age_by, AGE_BY_MTIME) && mtime != NSEC_INFINITY)
+                t = MAX(t, mtime);
+        if (FLAGS_SET(age_by, AGE_BY_ATIME) && atime != NSEC_INFINITY)
+                t = MAX(t, atime);
+        if (FLAGS_SET(age_by, AGE_BY_CTIME) && ctime != NSEC_INFINITY)
+                t = MAX(t, ctime);
+        if (FLAGS_SET(age_by, AGE_BY_BTIME) && btime != NSEC_INFINITY)
+                t = MAX(t, btime);
+
+        return t;
+}
+
 static DIR* xopendirat_nomod(int dirfd, const char *path) {
         DIR *dir;
 
@@ -564,16 +730,49 @@ static int dir_cleanup(
                 AgeBy age_by_file,
                 AgeBy age_by_dir) {
 
+        const CleanState *hint = NULL;
+        CleanState state = {
+                .mtime = self_mtime_nsec,
+                .oldest = NSEC_INFINITY,
+                .scanned = now(CLOCK_REALTIME),
+                .age_by = age_by_file,
+        };
         bool deleted = false;
         int r = 0;
 
+        /* Directories only change their mtime when entries are added, removed or renamed, and timestamps of
+         * the entries themselves generally only move forward. Hence, if the directory didn't change since
+         * the last run and none of the files in it were old enough to be removed at the cutoff we are using
+         * now, we can skip looking at the files again, and only descend into the subdirectories. To catch
+         * files whose timestamps were explicitly set into the past, we look at everything again once per
+         * cleanup interval. */
+        if (clean_state) {
+                hint = hashmap_get(clean_state, p);
+                if (hint &&
+                    (hint->age_by != age_by_file ||
+                     hint->mtime != self_mtime_nsec ||
+                     hint->oldest < cutoff_nsec ||
+                     hint->scanned * NSEC_PER_USEC < cutoff_nsec))
+                        hint = NULL;
+                if (hint) {
+                        log_debug("Directory \"%s\" did not change since %s, only looking at subdirectories.",
+                                  p, FORMAT_TIMESTAMP_STYLE(hint->scanned, TIMESTAMP_US));
+
+                        state.oldest = hint->oldest;
+                        state.scanned = hint->scanned;
+                }
+        }
+
         FOREACH_DIRENT_ALL(de, d, break) {
                 _cleanup_free_ char *sub_path = NULL;
-                nsec_t atime_nsec, mtime_nsec, ctime_nsec, btime_nsec;
+                nsec_t atime_nsec, mtime_nsec, ctime_nsec, btime_nsec, age_nsec;
 
                 if (dot_or_dot_dot(de->d_name))
                         continue;
 
+                if (hint && !IN_SET(de->d_type, DT_DIR, DT_UNKNOWN))
+                        continue;
+
                 /* If statx() is supported, use it. It's preferable over fstatat() since it tells us
                  * explicitly where we are looking at a mount point, for free as side information. Determining
                  * the same information without statx() is hard, see the complexity of path_is_mount_point(),
@@ -598,6 +797,7 @@ static int dir_cleanup(
                         /* FUSE, NFS mounts, SELinux might return EACCES */
                         r = log_full_errno(r == -EACCES ? LOG_DEBUG : LOG_ERR, r,
                                            "statx(%s/%s) failed: %m", p, de->d_name);
+                        state.oldest = 0; /* Try again next time */
                         continue;
                 }
 
@@ -637,6 +837,13 @@ static int dir_cleanup(
                 ctime_nsec = FLAGS_SET(sx.stx_mask, STATX_CTIME) ? load_statx_timestamp_nsec(&sx.stx_ctime) : 0;
                 btime_nsec = FLAGS_SET(sx.stx_mask, STATX_BTIME) ? load_statx_timestamp_nsec(&sx.stx_btime) : 0;
 
+                /* Remember the oldest file we keep because it is too new. Files we keep for other reasons
+                 * (sticky bit, devices, …) will be kept next time too, hence don't need to be looked at
+                 * again. */
+                age_nsec = age_by_timestamp(atime_nsec, btime_nsec, ctime_nsec, mtime_nsec, age_by_file);
+                if (!S_ISDIR(sx.stx_mode) && age_nsec >= cutoff_nsec)
+                        state.oldest = MIN(state.oldest, age_nsec);
+
                 sub_path = path_join(p, de->d_name);
                 if (!sub_path) {
                         r = log_oom();
@@ -737,6 +944,7 @@ static int dir_cleanup(
                         /* Ignore sockets that are listed in /proc/net/unix */
                         if (S_ISSOCK(sx.stx_mode) && unix_socket_alive(sub_path)) {
                                 log_debug("Skipping \"%s\": live socket.", sub_path);
+                                state.oldest = MIN(state.oldest, age_nsec); /* Might be gone next time */
                                 continue;
                         }
 
@@ -758,13 +966,18 @@ static int dir_cleanup(
 
                         log_debug("Removing \"%s\".", sub_path);
                         if (unlinkat(dirfd(d), de->d_name, 0) < 0)
-                                if (errno != ENOENT)
+                                if (errno != ENOENT) {
                                         r = log_warning_errno(errno, "Failed to remove \"%s\", ignoring: %m", sub_path);
+                                        state.oldest = 0;
+                                }
 
                         deleted = true;
                 }
         }
 
+        if (clean_state_new)
+                remember_clean_state(p, &state);
+
 finish:
         if (deleted) {
                 struct timespec ts[2];
@@ -2074,7 +2287,7 @@ static int rm_if_wrong_type_safe(
                 if (child_fd < 0)
                         return log_error_errno(errno, "Failed to open \"%s\" at \"%s\": %m", name, strna(parent_name));
 
-                r = rm_rf_children(TAKE_FD(child_fd), REMOVE_ROOT|REMOVE_SUBVOLUME|REMOVE_PHYSICAL, &st);
+                r = rm_rf_children(TAKE_FD(child_fd), REMOVE_ROOT|REMOVE_SUBVOLUME|REMOVE_PHYSICAL|REMOVE_PARALLEL, &st);
                 if (r < 0)
                         return log_error_errno(r, "Failed to remove contents of \"%s\" at \"%s\": %m", name, strna(parent_name));
 
@@ -2409,7 +2622,7 @@ static int remove_item_instance(Item *i, const char *instance) {
         case RECURSIVE_REMOVE_PATH:
                 /* FIXME: we probably should use dir_cleanup() here instead of rm_rf() so that 'x' is honoured. */
                 log_debug("rm -rf \"%s\"", instance);
-                r = rm_rf(instance, REMOVE_ROOT|REMOVE_SUBVOLUME|REMOVE_PHYSICAL);
+                r = rm_rf(instance, REMOVE_ROOT|REMOVE_SUBVOLUME|REMOVE_PHYSICAL|REMOVE_PARALLEL);
                 if (r < 0 && r != -ENOENT)
                         return log_error_errno(r, "rm_rf(%s): %m", instance);
 
@@ -2434,7 +2647,7 @@ static int remove_item(Item *i) {
         case TRUNCATE_DIRECTORY:
                 /* FIXME: we probably should use dir_cleanup() here instead of rm_rf() so that 'x' is honoured. */
                 log_debug("rm -rf \"%s\"", i->path);
-                r = rm_rf(i->path, REMOVE_PHYSICAL);
+                r = rm_rf(i->path, REMOVE_PHYSICAL|REMOVE_PARALLEL);
                 if (r < 0 && r != -ENOENT)
                         return log_error_errno(r, "rm_rf(%s): %m", i->path);
 
@@ -2608,6 +2821,114 @@ static int process_item(Item *i, OperationMask operation) {
                 p;
 }
 
+static int process_item_array(ItemArray *array, OperationMask operation);
+
+typedef struct CleanQueue {
+        pthread_mutex_t mutex;
+        ItemArray **arrays;
+        size_t n_arrays, next;
+        int ret;
+} CleanQueue;
+
+static void* clean_thread(void *userdata) {
+        CleanQueue *q = ASSERT_PTR(userdata);
+
+        for (;;) {
+                ItemArray *a = NULL;
+                int r;
+
+                assert_se(pthread_mutex_lock(&q->mutex) == 0);
+                if (q->next < q->n_arrays)
+                        a = q->arrays[q->next++];
+                assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+
+                if (!a)
+                        break;
+
+                r = process_item_array(a, OPERATION_CLEAN);
+                if (r < 0) {
+                        assert_se(pthread_mutex_lock(&q->mutex) == 0);
+                        if (q->ret >= 0)
+                                q->ret = r;
+                        assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+                }
+        }
+
+        return NULL;
+}
+
+static int clean_parallel(void) {
+        _cleanup_free_ ItemArray **arrays = NULL;
+        _cleanup_free_ pthread_t *threads = NULL;
+        size_t n_arrays = 0, n_threads = 0;
+        sigset_t ss, saved_ss;
+        ItemArray *a;
+        int r;
+
+        /* Cleaning only reads the configuration and removes old files, hence independent item arrays can be
+         * cleaned concurrently. Each top-level array is processed by a single thread, together with all
+         * arrays below it, so that children are still cleaned before their parents. Creating and removing
+         * is left serial, since it needs to play games with the umask and the SELinux context. */
+
+        ORDERED_HASHMAP_FOREACH(a, items)
+                if (!a->parent) {
+                        if (!GREEDY_REALLOC(arrays, n_arrays + 1))
+                                return log_oom();
+                        arrays[n_arrays++] = a;
+                }
+        ORDERED_HASHMAP_FOREACH(a, globs)
+                if (!a->parent) {
+                        if (!GREEDY_REALLOC(arrays, n_arrays + 1))
+                                return log_oom();
+                        arrays[n_arrays++] = a;
+                }
+
+        r = cpus_in_affinity_mask();
+        n_threads = MIN3(r > 0 ? (size_t) r : 1, n_arrays, (size_t) CLEAN_THREADS_MAX);
+        if (n_threads <= 1)
+                return 0; /* The serial loop will take care of it */
+
+        /* Populate the cache before we start threads */
+        (void) load_unix_sockets();
+
+        threads = new(pthread_t, n_threads - 1);
+        if (!threads)
+                return log_oom();
+
+        CleanQueue q = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .arrays = arrays,
+                .n_arrays = n_arrays,
+        };
+        size_t n_started = 0;
+
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return log_error_errno(r, "Failed to block signals: %m");
+
+        for (; n_started < n_threads - 1; n_started++) {
+                r = pthread_create(threads + n_started, NULL, clean_thread, &q);
+                if (r > 0) {
+                        log_debug_errno(r, "Failed to start cleanup thread, continuing with fewer: %m");
+                        break;
+                }
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        log_debug("Cleaning %zu independent trees on %zu threads.", n_arrays, n_started + 1);
+
+        (void) clean_thread(&q);
+
+        for (size_t i = 0; i < n_started; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        assert_se(pthread_mutex_destroy(&q.mutex) == 0);
+
+        return q.ret;
+}
+
 static int process_item_array(ItemArray *array, OperationMask operation) {
         int r = 0;
         size_t n;
@@ -3835,6 +4156,15 @@ static int run(int argc, char *argv[]) {
         if (r < 0)
                 return r;
 
+        /* Only for the host, where we run periodically from systemd-tmpfiles-clean.service */
+        if (FLAGS_SET(arg_operation, OPERATION_CLEAN) && !arg_user && !arg_root) {
+                (void) load_clean_state();
+
+                clean_state_new = hashmap_new(&path_hash_ops_free_free);
+                if (!clean_state_new)
+                        return log_oom();
+        }
+
         /* Let's now link up all child/parent relationships */
         ORDERED_HASHMAP_FOREACH(a, items) {
                 r = link_parent(a);
@@ -3862,6 +4192,13 @@ static int run(int argc, char *argv[]) {
                 if (op == 0) /* Nothing requested in this phase */
                         continue;
 
+                if (op == OPERATION_CLEAN) {
+                        /* Everything the threads processed is marked as done, and is skipped below */
+                        k = clean_parallel();
+                        if (k < 0 && r >= 0)
+                                r = k;
+                }
+
                 /* The non-globbing ones usually create things, hence we apply them first */
                 ORDERED_HASHMAP_FOREACH(a, items) {
                         k = process_item_array(a, op);
@@ -3877,6 +4214,9 @@ static int run(int argc, char *argv[]) {
                 }
         }
 
+        if (clean_state_new)
+                (void) save_clean_state();
+
         if (ERRNO_IS_RESOURCE(r))
                 return r;
         if (invalid_config)
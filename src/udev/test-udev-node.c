@@ -1,6 +1,18 @@
 /* SPDX-License-Identifier: LGPL-2.1-or-later */
 
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "random-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
 #include "udev-node.h"
 
 static void test_udev_node_escape_path_one(const char *path, const char *expected) {
@@ -47,4 +59,116 @@ TEST(udev_node_escape_path) {
         test_udev_node_escape_path_one(a, b);
 }
 
+static int open_stack_directory(char **ret_path) {
+        int fd;
+
+        assert_se(mkdtemp_malloc("/tmp/test-udev-node-XXXXXX", ret_path) >= 0);
+        assert_se((fd = open(*ret_path, O_CLOEXEC|O_DIRECTORY|O_RDONLY)) >= 0);
+        return fd;
+}
+
+static void test_stack_update_one(int dirfd, const char *id, const char *devnode, int priority, const char *expected) {
+        _cleanup_free_ char *target = NULL;
+
+        assert_se(udev_node_stack_update(dirfd, id, devnode, priority, &target) == !!expected);
+        assert_se(streq_ptr(target, expected));
+}
+
+TEST(stack_update) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmp = NULL;
+        _cleanup_close_ int fd = -1;
+
+        fd = open_stack_directory(&tmp);
+
+        test_stack_update_one(fd, "b8:0", "/dev/sda", 0, "/dev/sda");
+        test_stack_update_one(fd, "b8:16", "/dev/sdb", 10, "/dev/sdb");
+        test_stack_update_one(fd, "b8:32", "/dev/sdc", 5, "/dev/sdb");
+        test_stack_update_one(fd, "b8:32", "/dev/sdc", 10, "/dev/sdb"); /* same priority, no change */
+        test_stack_update_one(fd, "b8:16", NULL, 0, "/dev/sdc");
+        test_stack_update_one(fd, "b8:32", "/dev/sdc", -1, "/dev/sda"); /* priority lowered */
+        test_stack_update_one(fd, "b8:32", "/dev/sdc", 1, "/dev/sdc");
+
+        /* An outdated hint is ignored */
+        assert_se(unlinkat(fd, ".best", 0) >= 0);
+        assert_se(symlinkat("b8:48", fd, ".best") >= 0);
+        test_stack_update_one(fd, "b8:0", "/dev/sda", 0, "/dev/sdc");
+
+        test_stack_update_one(fd, "b8:32", NULL, 0, "/dev/sda");
+        test_stack_update_one(fd, "b8:0", NULL, 0, NULL);
+        test_stack_update_one(fd, "b8:0", NULL, 0, NULL);
+}
+
+#define PRIORITY_MAX 5
+
+static int max_priority(const unsigned *counts) {
+        for (int p = PRIORITY_MAX; p > -PRIORITY_MAX; p--)
+                if (counts[p + PRIORITY_MAX] > 0)
+                        return p;
+
+        return -PRIORITY_MAX;
+}
+
+TEST(stack_update_benchmark) {
+        _cleanup_(rm_rf_physical_and_freep) char *tmp = NULL;
+        _cleanup_free_ unsigned *order = NULL;
+        _cleanup_free_ int *priorities = NULL;
+        _cleanup_close_ int fd = -1;
+        unsigned counts[2 * PRIORITY_MAX + 1] = {}, n;
+        usec_t t;
+
+        /* Many devices claiming the same symlink, e.g. the paths of a multipath device, being added and
+         * removed in random order. */
+
+        n = slow_tests_enabled() ? 20000 : 2000;
+
+        fd = open_stack_directory(&tmp);
+        assert_se(order = new(unsigned, n));
+        assert_se(priorities = new(int, n));
+
+        for (unsigned i = 0; i < n; i++) {
+                order[i] = i;
+                priorities[i] = (int) random_u64_range(2 * PRIORITY_MAX + 1) - PRIORITY_MAX;
+        }
+
+        t = now(CLOCK_MONOTONIC);
+
+        for (unsigned k = 0; k < 2 * n; k++) {
+                _cleanup_free_ char *target = NULL;
+                char id[DECIMAL_STR_MAX(unsigned) + 6], devnode[DECIMAL_STR_MAX(unsigned) + 7];
+                unsigned i, j;
+                bool add = k < n;
+
+                /* Add them in order, and remove them in random order */
+                if (!add) {
+                        j = k - n + random_u64_range(2 * n - k);
+                        SWAP_TWO(order[k - n], order[j]);
+                }
+                i = order[k % n];
+
+                xsprintf(id, "b259:%u", i);
+                xsprintf(devnode, "/dev/n%u", i);
+
+                assert_se(udev_node_stack_update(fd, id, add ? devnode : NULL, priorities[i], &target) >= 0);
+
+                if (add)
+                        counts[priorities[i] + PRIORITY_MAX]++;
+                else
+                        counts[priorities[i] + PRIORITY_MAX]--;
+
+                if (k == 2 * n - 1)
+                        assert_se(!target);
+                else {
+                        assert_se(target);
+                        assert_se(sscanf(target, "/dev/n%u", &j) == 1);
+                        assert_se(j < n);
+                        assert_se(priorities[j] == max_priority(counts));
+                }
+        }
+
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("%u devices added and removed in %s, %" PRIu64 "us per update",
+                 n, FORMAT_TIMESPAN(t, USEC_PER_MSEC), t / (2 * n));
+}
+
 DEFINE_TEST_MAIN(LOG_INFO);
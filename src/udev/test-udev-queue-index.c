@@ -0,0 +1,225 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include "alloc-util.h"
+#include "random-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "udev-queue-index.h"
+#include "udev-util.h"
+
+typedef struct TestEvent {
+        UdevQueueIndexEntry entry;
+        uint64_t seqnum;
+        char *id;
+        char *devnode;
+        char *devpath;
+        char *devpath_old;
+        bool queued;
+} TestEvent;
+
+static void test_event_done(TestEvent *e) {
+        e->id = mfree(e->id);
+        e->devnode = mfree(e->devnode);
+        e->devpath = mfree(e->devpath);
+        e->devpath_old = mfree(e->devpath_old);
+}
+
+static void test_event_add(UdevQueueIndex *index, TestEvent *e) {
+        assert_se(!e->queued);
+        assert_se(udev_queue_index_add(index, &e->entry, e->seqnum, e->id, e->devnode, e->devpath, e->devpath_old) >= 0);
+        e->queued = true;
+}
+
+static void test_event_remove(UdevQueueIndex *index, TestEvent *e) {
+        assert_se(e->queued);
+        udev_queue_index_remove(index, &e->entry);
+        e->queued = false;
+}
+
+static bool test_event_conflict(const TestEvent *a, const TestEvent *b) {
+        /* What the index considers to conflict, see udev_queue_index_find_blocker() */
+        return (a->id && streq_ptr(a->id, b->id)) ||
+                (a->devnode && streq_ptr(a->devnode, b->devnode)) ||
+                devpath_conflict(a->devpath, b->devpath) ||
+                devpath_conflict(a->devpath, b->devpath_old) ||
+                devpath_conflict(a->devpath_old, b->devpath) ||
+                devpath_conflict(a->devpath_old, b->devpath_old);
+}
+
+TEST(basic) {
+        _cleanup_(udev_queue_index_freep) UdevQueueIndex *index = NULL;
+        TestEvent e[] = {
+                { .seqnum = 1, .devpath = (char*) "/devices/pci0000:00/0000:00:1d.0" },
+                { .seqnum = 2, .devpath = (char*) "/devices/pci0000:00/0000:00:1d.0/usb2" },
+                { .seqnum = 3, .devpath = (char*) "/devices/pci0000:00/0000:00:1d.00" },
+                { .seqnum = 4, .devpath = (char*) "/devices/virtual/block/loop0", .id = (char*) "b7:0", .devnode = (char*) "/dev/loop0" },
+                { .seqnum = 5, .devpath = (char*) "/devices/virtual/block/loop1", .id = (char*) "b7:0" },
+                { .seqnum = 6, .devpath = (char*) "/devices/virtual/block/loop2", .devnode = (char*) "/dev/loop0" },
+                { .seqnum = 7, .devpath = (char*) "/devices/virtual/net/eth1", .devpath_old = (char*) "/devices/virtual/net/eth0" },
+                { .seqnum = 8, .devpath = (char*) "/devices/virtual/net/eth0/queues/rx-0" },
+                { .seqnum = 9, .devpath = (char*) "/devices" },
+        };
+
+        assert_se(index = udev_queue_index_new());
+
+        for (size_t i = 0; i < ELEMENTSOF(e); i++)
+                assert_se(udev_queue_index_add(index, &e[i].entry, e[i].seqnum, e[i].id, e[i].devnode, e[i].devpath, e[i].devpath_old) >= 0);
+
+        assert_se(udev_queue_index_find_blocker(index, &e[0].entry) == 0);
+        assert_se(udev_queue_index_find_blocker(index, &e[1].entry) == 1); /* parent */
+        assert_se(udev_queue_index_find_blocker(index, &e[2].entry) == 0); /* only a string prefix */
+        assert_se(udev_queue_index_find_blocker(index, &e[3].entry) == 0);
+        assert_se(udev_queue_index_find_blocker(index, &e[4].entry) == 4); /* same ID */
+        assert_se(udev_queue_index_find_blocker(index, &e[5].entry) == 4); /* same devnode */
+        assert_se(udev_queue_index_find_blocker(index, &e[6].entry) == 0);
+        assert_se(udev_queue_index_find_blocker(index, &e[7].entry) == 7); /* below the old devpath */
+        assert_se(udev_queue_index_find_blocker(index, &e[8].entry) > 0);  /* everything is below */
+
+        udev_queue_index_remove(index, &e[0].entry);
+        assert_se(udev_queue_index_find_blocker(index, &e[1].entry) == 0);
+
+        udev_queue_index_remove(index, &e[3].entry);
+        assert_se(udev_queue_index_find_blocker(index, &e[4].entry) == 0);
+        assert_se(udev_queue_index_find_blocker(index, &e[5].entry) == 0);
+
+        udev_queue_index_remove(index, &e[6].entry);
+        assert_se(udev_queue_index_find_blocker(index, &e[7].entry) == 0);
+
+        for (size_t i = 1; i < 8; i++) {
+                if (!e[i].entry.devpath.node)
+                        continue;
+
+                assert_se(udev_queue_index_find_blocker(index, &e[8].entry) > 0);
+                udev_queue_index_remove(index, &e[i].entry);
+        }
+
+        assert_se(udev_queue_index_find_blocker(index, &e[8].entry) == 0);
+        udev_queue_index_remove(index, &e[8].entry);
+}
+
+static void generate_storm(TestEvent *events, unsigned n) {
+        /* Like coldplug: mostly devices added below devices added earlier, some of them getting another
+         * event, some of them with devnodes and IDs shared by several events, and a few being moved. */
+
+        for (unsigned i = 0; i < n; i++) {
+                _cleanup_free_ char *p = NULL;
+                unsigned k;
+
+                k = random_u64_range(i + 1);
+                if (k == i)
+                        assert_se(asprintf(&p, "/devices/d%u", i % 4) >= 0);
+                else if (random_u64_range(10) == 0)
+                        assert_se(p = strdup(events[k].devpath));
+                else
+                        assert_se(asprintf(&p, "%s/d%u", events[k].devpath, i) >= 0);
+
+                events[i] = (TestEvent) {
+                        .seqnum = i + 1,
+                        .devpath = TAKE_PTR(p),
+                };
+
+                if (random_u64_range(3) == 0)
+                        assert_se(asprintf(&events[i].devnode, "/dev/n%u", (unsigned) random_u64_range(n)) >= 0);
+                if (random_u64_range(3) == 0)
+                        assert_se(asprintf(&events[i].id, "c%u", (unsigned) random_u64_range(n)) >= 0);
+                if (random_u64_range(100) == 0)
+                        assert_se(asprintf(&events[i].devpath_old, "/devices/d%u/m%u",
+                                           (unsigned) random_u64_range(4), (unsigned) random_u64_range(8)) >= 0);
+        }
+}
+
+static unsigned process_storm(UdevQueueIndex *index, TestEvent *events, unsigned n, unsigned batch, bool verify, unsigned *ret_checks) {
+        unsigned n_queued = 0, n_passes = 0, n_checks = 0, next = 0;
+
+        /* Queue the events in batches, and after each batch go through the queue like event_queue_start()
+         * does, and process half of the events which are not blocked. */
+
+        while (next < n || n_queued > 0) {
+                bool removed = false;
+
+                for (unsigned end = MIN(next + batch, n); next < end; next++) {
+                        test_event_add(index, events + next);
+                        n_queued++;
+                }
+
+                for (unsigned i = 0; i < next; i++) {
+                        TestEvent *e = events + i;
+                        uint64_t s;
+
+                        if (!e->queued)
+                                continue;
+
+                        s = udev_queue_index_find_blocker(index, &e->entry);
+                        n_checks++;
+
+                        if (verify) {
+                                if (s > 0) {
+                                        assert_se(s < e->seqnum);
+                                        assert_se(events[s - 1].queued);
+                                        assert_se(test_event_conflict(e, events + s - 1));
+                                } else
+                                        for (unsigned j = 0; j < i; j++)
+                                                assert_se(!events[j].queued || !test_event_conflict(e, events + j));
+                        }
+
+                        /* The first queued event is never blocked, hence this always makes progress */
+                        if (s == 0 && (!removed || random_u64_range(2) == 0)) {
+                                test_event_remove(index, e);
+                                n_queued--;
+                                removed = true;
+                        }
+                }
+
+                n_passes++;
+        }
+
+        if (ret_checks)
+                *ret_checks = n_checks;
+
+        return n_passes;
+}
+
+TEST(storm) {
+        _cleanup_(udev_queue_index_freep) UdevQueueIndex *index = NULL;
+        _cleanup_free_ TestEvent *events = NULL;
+        unsigned n = 2000, n_passes;
+
+        assert_se(index = udev_queue_index_new());
+        assert_se(events = new(TestEvent, n));
+
+        generate_storm(events, n);
+        n_passes = process_storm(index, events, n, 100, /* verify = */ true, NULL);
+        log_debug("%u events processed in %u passes", n, n_passes);
+
+        for (unsigned i = 0; i < n; i++)
+                test_event_done(events + i);
+}
+
+TEST(storm_benchmark) {
+        _cleanup_(udev_queue_index_freep) UdevQueueIndex *index = NULL;
+        _cleanup_free_ TestEvent *events = NULL;
+        unsigned n, n_passes, n_checks;
+        usec_t t;
+
+        /* Like coldplug of a large machine: many events queued at once, most of which wait for others. */
+
+        n = slow_tests_enabled() ? 200000 : 20000;
+
+        assert_se(index = udev_queue_index_new());
+        assert_se(events = new(TestEvent, n));
+
+        generate_storm(events, n);
+
+        t = now(CLOCK_MONOTONIC);
+        n_passes = process_storm(index, events, n, n / 10, /* verify = */ false, &n_checks);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        log_info("%u events processed in %u passes, %u blocker checks, %s total, %" PRIu64 "ns per check",
+                 n, n_passes, n_checks, FORMAT_TIMESPAN(t, USEC_PER_MSEC), t * NSEC_PER_USEC / n_checks);
+
+        for (unsigned i = 0; i < n; i++)
+                test_event_done(events + i);
+}
+
+DEFINE_TEST_MAIN(LOG_INFO);
@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+
+#include <signal.h>
+
+#include "device-private.h"
+#include "fileio.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+#include "udev-event.h"
+#include "udev-rules.h"
+
+/* Measures parsing a rules file and evaluating its rules against a device, i.e. what udevd does for every
+ * uevent, minus running programs and touching /dev. The rules are generated, and modelled after what
+ * typical rules files contain: mostly rules for other subsystems and devices that are skipped early, and a
+ * few that match and assign properties and tags. The loopback network interface is used as device, as it
+ * exists everywhere. SYSTEMD_SLOW_TESTS=1 evaluates the rules ten times as often. */
+
+#define N_GROUPS 200U
+#define N_RULES (N_GROUPS * 7U) /* rules_template has seven lines */
+
+static const char rules_template[] =
+        "SUBSYSTEM==\"block\", KERNEL==\"sd%1$u*\", ENV{ID_BENCHMARK_DISK_%1$u}=\"1\"\n"
+        "ACTION==\"remove\", GOTO=\"benchmark_end_%1$u\"\n"
+        "KERNEL==\"eth*|wlan*|en*\", ATTR{address}==\"?*\", ENV{ID_BENCHMARK_NET_%1$u}=\"1\"\n"
+        "DRIVERS==\"usb-storage\", ENV{ID_BENCHMARK_USB_%1$u}=\"1\"\n"
+        "SUBSYSTEM==\"net\", KERNEL==\"%2$s\", ATTR{flags}==\"?*\", ENV{BENCHMARK_%1$u}=\"%1$u\"\n"
+        "ENV{BENCHMARK_%1$u}==\"%1$u\", TAG+=\"benchmark%1$u\"\n"
+        "LABEL=\"benchmark_end_%1$u\"\n";
+
+static char *write_rules(const char *dir) {
+        _cleanup_free_ char *contents = NULL, *p = NULL;
+
+        for (unsigned i = 0; i < N_GROUPS; i++) {
+                _cleanup_free_ char *s = NULL;
+
+                /* Only every tenth group matches, so that the device ends up with a realistic number of
+                 * properties and tags */
+                assert_se(asprintf(&s, rules_template, i, i % 10 == 0 ? "lo" : "dummy*") >= 0);
+                assert_se(strextend(&contents, s));
+        }
+
+        assert_se(p = path_join(dir, "99-benchmark.rules"));
+        assert_se(write_string_file(p, contents, WRITE_STRING_FILE_CREATE) >= 0);
+
+        return TAKE_PTR(p);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_(udev_rules_freep) UdevRules *rules = NULL;
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        _cleanup_free_ char *path = NULL;
+        unsigned n_iterations, n_parse;
+        usec_t t, parse, apply;
+        const char *value;
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        n_iterations = slow_tests_enabled() ? 20000 : 2000;
+        n_parse = slow_tests_enabled() ? 500 : 50;
+
+        r = sd_device_new_from_syspath(&dev, "/sys/class/net/lo");
+        if (r < 0)
+                return log_tests_skipped_errno(r, "Failed to open loopback device");
+        assert_se(device_read_uevent_file(dev) >= 0);
+        assert_se(device_set_action(dev, SD_DEVICE_ADD) >= 0);
+
+        assert_se(mkdtemp_malloc("/tmp/test-udev-rules-benchmark-XXXXXX", &dir) >= 0);
+        path = write_rules(dir);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_parse; i++) {
+                rules = udev_rules_free(rules);
+                assert_se(rules = udev_rules_new(RESOLVE_NAME_EARLY));
+                assert_se(udev_rules_parse_file(rules, path) >= 0);
+        }
+        parse = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        t = now(CLOCK_MONOTONIC);
+        for (unsigned i = 0; i < n_iterations; i++) {
+                _cleanup_(udev_event_freep) UdevEvent *event = NULL;
+
+                assert_se(event = udev_event_new(dev, 0, NULL, LOG_INFO));
+                assert_se(udev_rules_apply_to_event(rules, event, 5 * USEC_PER_SEC, SIGKILL, NULL) >= 0);
+        }
+        apply = usec_sub_unsigned(now(CLOCK_MONOTONIC), t);
+
+        /* Verify that the matching rules actually matched */
+        assert_se(sd_device_get_property_value(dev, "BENCHMARK_0", &value) >= 0);
+        assert_se(streq(value, "0"));
+        assert_se(sd_device_has_current_tag(dev, "benchmark0") > 0);
+        assert_se(sd_device_get_property_value(dev, "BENCHMARK_1", &value) == -ENOENT);
+        assert_se(sd_device_get_property_value(dev, "ID_BENCHMARK_NET_0", &value) == -ENOENT);
+
+        log_info("%u rules: parse %s, apply %s per event",
+                 N_RULES, FORMAT_TIMESPAN(parse / n_parse, 1), FORMAT_TIMESPAN(apply / n_iterations, 1));
+        benchmark_report(parse * NSEC_PER_USEC / n_parse, "ns", "parse/%u", N_RULES);
+        benchmark_report(apply * NSEC_PER_USEC / n_iterations, "ns", "apply/%u", N_RULES);
+
+        return 0;
+}
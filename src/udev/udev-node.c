@@ -4,6 +4,7 @@
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -16,29 +17,24 @@
 #include "dirent-util.h"
 #include "escape.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
 #include "hexdecoct.h"
 #include "mkdir-label.h"
 #include "parse-util.h"
 #include "path-util.h"
-#include "random-util.h"
 #include "selinux-util.h"
 #include "smack-util.h"
-#include "stat-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
 #include "strxcpyx.h"
-#include "time-util.h"
 #include "udev-node.h"
 #include "user-util.h"
 
 #define CREATE_LINK_MAX_RETRIES        128
-#define LINK_UPDATE_MAX_RETRIES        128
-#define CREATE_STACK_LINK_MAX_RETRIES  128
-#define UPDATE_TIMESTAMP_MAX_RETRIES   128
-#define MAX_RANDOM_DELAY (250 * USEC_PER_MSEC)
-#define MIN_RANDOM_DELAY ( 50 * USEC_PER_MSEC)
+#define STACK_DIRECTORY_LOCK           ".lock"
+#define STACK_DIRECTORY_BEST           ".best"
 #define UDEV_NODE_HASH_KEY SD_ID128_MAKE(b9,6a,f1,ce,40,31,44,1a,9e,19,ec,8b,ae,f3,e3,2f)
 
 static int create_symlink(const char *target, const char *slink) {
@@ -110,118 +106,6 @@ static int node_symlink(sd_device *dev, const char *node, const char *slink) {
         return 0;
 }
 
-static int link_find_prioritized(sd_device *dev, bool add, const char *stackdir, char **ret) {
-        _cleanup_closedir_ DIR *dir = NULL;
-        _cleanup_free_ char *target = NULL;
-        int r, priority = 0;
-        const char *id;
-
-        assert(dev);
-        assert(stackdir);
-        assert(ret);
-
-        /* Find device node of device with highest priority. This returns 1 if a device found, 0 if no
-         * device found, or a negative errno. */
-
-        if (add) {
-                const char *devnode;
-
-                r = device_get_devlink_priority(dev, &priority);
-                if (r < 0)
-                        return r;
-
-                r = sd_device_get_devname(dev, &devnode);
-                if (r < 0)
-                        return r;
-
-                target = strdup(devnode);
-                if (!target)
-                        return -ENOMEM;
-        }
-
-        dir = opendir(stackdir);
-        if (!dir) {
-                if (add) /* The stack directory must exist. */
-                        return -errno;
-                if (errno != ENOENT)
-                        return -errno;
-
-                *ret = NULL;
-                return 0;
-        }
-
-        r = device_get_device_id(dev, &id);
-        if (r < 0)
-                return r;
-
-        FOREACH_DIRENT_ALL(de, dir, break) {
-                _cleanup_free_ char *path = NULL, *buf = NULL;
-                int tmp_prio;
-
-                if (de->d_name[0] == '.')
-                        continue;
-
-                /* skip ourself */
-                if (streq(de->d_name, id))
-                        continue;
-
-                path = path_join(stackdir, de->d_name);
-                if (!path)
-                        return -ENOMEM;
-
-                if (readlink_malloc(path, &buf) >= 0) {
-                        char *devnode;
-
-                        /* New format. The devnode and priority can be obtained from symlink. */
-
-                        devnode = strchr(buf, ':');
-                        if (!devnode || devnode == buf)
-                                continue;
-
-                        *(devnode++) = '\0';
-                        if (!path_startswith(devnode, "/dev"))
-                                continue;
-
-                        if (safe_atoi(buf, &tmp_prio) < 0)
-                                continue;
-
-                        if (target && tmp_prio <= priority)
-                                continue;
-
-                        r = free_and_strdup(&target, devnode);
-                        if (r < 0)
-                                return r;
-                } else {
-                        _cleanup_(sd_device_unrefp) sd_device *tmp_dev = NULL;
-                        const char *devnode;
-
-                        /* Old format. The devnode and priority must be obtained from uevent and
-                         * udev database files. */
-
-                        if (sd_device_new_from_device_id(&tmp_dev, de->d_name) < 0)
-                                continue;
-
-                        if (device_get_devlink_priority(tmp_dev, &tmp_prio) < 0)
-                                continue;
-
-                        if (target && tmp_prio <= priority)
-                                continue;
-
-                        if (sd_device_get_devname(tmp_dev, &devnode) < 0)
-                                continue;
-
-                        r = free_and_strdup(&target, devnode);
-                        if (r < 0)
-                                return r;
-                }
-
-                priority = tmp_prio;
-        }
-
-        *ret = TAKE_PTR(target);
-        return !!*ret;
-}
-
 size_t udev_node_escape_path(const char *src, char *dest, size_t size) {
         size_t i, j;
         uint64_t h;
@@ -264,162 +148,287 @@ toolong:
         return size - 1;
 }
 
-static int update_timestamp(sd_device *dev, const char *path, struct stat *prev) {
-        assert(path);
-        assert(prev);
+static int stack_entry_read(int dirfd, const char *id, int *ret_priority, char **ret_devnode) {
+        _cleanup_free_ char *buf = NULL;
+        char *devnode;
+        int r;
 
-        /* Even if a symlink in the stack directory is created/removed, the mtime of the directory may
-         * not be changed. Why? Let's consider the following situation. For simplicity, let's assume
-         * there exist two udev workers (A and B) and all of them calls link_update() for the same
-         * devlink simultaneously.
-         *
-         * 1. A creates/removes a symlink in the stack directory.
-         * 2. A calls the first stat() in the loop of link_update().
-         * 3. A calls link_find_prioritized().
-         * 4. B creates/removes another symlink in the stack directory, so the result of the step 3 is outdated.
-         * 5. B finishes link_update().
-         * 6. A creates/removes devlink according to the outdated result in the step 3.
-         * 7. A calls the second stat() in the loop of link_update().
-         *
-         * If these 7 steps are processed in this order within a short time period that kernel's timer
-         * does not increase, then even if the contents in the stack directory is changed, the results
-         * of two stat() called by A shows the same timestamp, and A cannot detect the change.
-         *
-         * By calling this function after creating/removing symlinks in the stack directory, the
-         * timestamp of the stack directory is always increased at least in the above step 5, so A can
-         * detect the update. */
+        assert(dirfd >= 0);
+        assert(id);
+        assert(ret_priority);
 
-        if ((prev->st_mode & S_IFMT) == 0)
-                return 0; /* Does not exist, or previous stat() failed. */
+        /* New format. The devnode and priority can be obtained from symlink. Returns -EINVAL if the entry
+         * is not a symlink. */
 
-        for (unsigned i = 0; i < UPDATE_TIMESTAMP_MAX_RETRIES; i++) {
-                struct stat st;
+        r = readlinkat_malloc(dirfd, id, &buf);
+        if (r < 0)
+                return r;
 
-                if (stat(path, &st) < 0)
-                        return -errno;
+        devnode = strchr(buf, ':');
+        if (!devnode || devnode == buf)
+                return -EBADMSG;
 
-                if (!stat_inode_unmodified(prev, &st))
-                        return 0;
+        *(devnode++) = '\0';
+        if (!path_startswith(devnode, "/dev"))
+                return -EBADMSG;
 
-                log_device_debug(dev,
-                                 "%s is modified, but its timestamp is not changed, "
-                                 "updating timestamp after 10ms.",
-                                 path);
+        r = safe_atoi(buf, ret_priority);
+        if (r < 0)
+                return r;
 
-                (void) usleep(10 * USEC_PER_MSEC);
-                if (utimensat(AT_FDCWD, path, NULL, 0) < 0)
-                        return -errno;
+        if (ret_devnode) {
+                char *d;
+
+                d = strdup(devnode);
+                if (!d)
+                        return -ENOMEM;
+
+                *ret_devnode = d;
         }
 
-        return -ELOOP;
+        return 0;
 }
 
-static int update_stack_directory(sd_device *dev, const char *dirname, bool add) {
-        _cleanup_free_ char *filename = NULL, *data = NULL, *buf = NULL;
-        const char *devname, *id;
-        struct stat st = {};
-        int priority, r;
+static int stack_entry_read_old(const char *id, int *ret_priority, char **ret_devnode) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        const char *devnode;
+        int r;
 
-        assert(dev);
-        assert(dirname);
+        assert(id);
+        assert(ret_priority);
+        assert(ret_devnode);
 
-        r = device_get_device_id(dev, &id);
+        /* Old format. The devnode and priority must be obtained from uevent and udev database files. */
+
+        r = sd_device_new_from_device_id(&dev, id);
         if (r < 0)
-                return log_device_debug_errno(dev, r, "Failed to get device id: %m");
+                return r;
 
-        filename = path_join(dirname, id);
-        if (!filename)
-                return log_oom_debug();
+        r = device_get_devlink_priority(dev, ret_priority);
+        if (r < 0)
+                return r;
 
-        if (!add) {
-                int unlink_error = 0, stat_error = 0;
+        r = sd_device_get_devname(dev, &devnode);
+        if (r < 0)
+                return r;
 
-                if (stat(dirname, &st) < 0) {
-                        if (errno == ENOENT)
-                                return 0; /* The stack directory is already removed. That's OK. */
-                        stat_error = -errno;
-                }
+        return free_and_strdup(ret_devnode, devnode);
+}
 
-                if (unlink(filename) < 0)
-                        unlink_error = -errno;
+static int stack_directory_find_prioritized(int dirfd, char **ret_id, char **ret_devnode) {
+        _cleanup_free_ char *id = NULL, *devnode = NULL;
+        _cleanup_closedir_ DIR *dir = NULL;
+        int priority = 0;
 
-                if (rmdir(dirname) >= 0 || errno == ENOENT)
-                        return 0;
+        assert(dirfd >= 0);
+        assert(ret_id);
+        assert(ret_devnode);
 
-                if (unlink_error < 0) {
-                        if (unlink_error == -ENOENT)
-                                return 0;
+        /* Find device node of device with highest priority. This returns 1 if a device found, 0 if no
+         * device found, or a negative errno. */
 
-                        /* If we failed to remove the symlink, then there is almost nothing we can do. */
-                        return log_device_debug_errno(dev, unlink_error, "Failed to remove %s: %m", filename);
-                }
+        dir = xopendirat(dirfd, ".", O_NOFOLLOW);
+        if (!dir)
+                return -errno;
 
-                if (stat_error < 0)
-                        return log_device_debug_errno(dev, stat_error, "Failed to stat %s: %m", dirname);
+        FOREACH_DIRENT_ALL(de, dir, break) {
+                _cleanup_free_ char *buf = NULL;
+                int tmp_prio, r;
 
-                /* The symlink was removed. Check if the timestamp of directory is changed. */
-                r = update_timestamp(dev, dirname, &st);
-                if (r < 0 && r != -ENOENT)
-                        return log_device_debug_errno(dev, r, "Failed to update timestamp of %s: %m", dirname);
+                /* Also skips the lock file and the hint, see udev_node_stack_update(). */
+                if (de->d_name[0] == '.')
+                        continue;
 
-                return 0;
+                r = stack_entry_read(dirfd, de->d_name, &tmp_prio, &buf);
+                if (r == -EINVAL)
+                        r = stack_entry_read_old(de->d_name, &tmp_prio, &buf);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0)
+                        continue;
+
+                if (id && tmp_prio <= priority)
+                        continue;
+
+                r = free_and_strdup(&id, de->d_name);
+                if (r < 0)
+                        return r;
+
+                free_and_replace(devnode, buf);
+                priority = tmp_prio;
         }
 
-        r = sd_device_get_devname(dev, &devname);
-        if (r < 0)
-                return log_device_debug_errno(dev, r, "Failed to get device node: %m");
+        *ret_id = TAKE_PTR(id);
+        *ret_devnode = TAKE_PTR(devnode);
+        return !!*ret_devnode;
+}
 
-        r = device_get_devlink_priority(dev, &priority);
-        if (r < 0)
-                return log_device_debug_errno(dev, r, "Failed to get priority of device node symlink: %m");
+static int stack_directory_set_best(int dirfd, const char *id) {
+        assert(dirfd >= 0);
 
-        if (asprintf(&data, "%i:%s", priority, devname) < 0)
-                return log_oom_debug();
+        if (unlinkat(dirfd, STACK_DIRECTORY_BEST, 0) < 0 && errno != ENOENT)
+                return -errno;
+
+        if (id && symlinkat(id, dirfd, STACK_DIRECTORY_BEST) < 0)
+                return -errno;
 
-        if (readlink_malloc(filename, &buf) >= 0 && streq(buf, data))
+        return 0;
+}
+
+static int stack_directory_use_best(
+                int dirfd,
+                const char *id,
+                const char *devnode,
+                int priority,
+                bool lowered,
+                char **ret_devnode) {
+
+        _cleanup_free_ char *best_id = NULL, *best_devnode = NULL;
+        int best_priority, r;
+
+        assert(dirfd >= 0);
+        assert(id);
+        assert(ret_devnode);
+
+        /* Returns 1 and the device node with the highest priority if it can be determined from the hint,
+         * and 0 if all entries need to be looked at. */
+
+        if (readlinkat_malloc(dirfd, STACK_DIRECTORY_BEST, &best_id) < 0)
                 return 0;
 
-        if (unlink(filename) < 0 && errno != ENOENT)
-                log_device_debug_errno(dev, errno, "Failed to remove %s, ignoring: %m", filename);
+        if (streq(best_id, id)) {
+                /* This device had the highest priority, and still has unless it was removed or its priority
+                 * was lowered. */
+                if (!devnode || lowered)
+                        return 0;
+        } else {
+                if (stack_entry_read(dirfd, best_id, &best_priority, &best_devnode) < 0)
+                        return 0; /* The hint is outdated. */
 
-        for (unsigned j = 0; j < CREATE_STACK_LINK_MAX_RETRIES; j++) {
-                /* This may fail with -ENOENT when the parent directory is removed during
-                 * creating the file by another udevd worker. */
-                r = mkdir_p(dirname, 0755);
-                if (r == -ENOENT)
-                        continue;
+                if (!devnode || priority <= best_priority) {
+                        *ret_devnode = TAKE_PTR(best_devnode);
+                        return 1;
+                }
+
+                /* This device has a higher priority now. */
+                r = stack_directory_set_best(dirfd, id);
                 if (r < 0)
-                        return log_device_debug_errno(dev, r, "Failed to create directory %s: %m", dirname);
+                        return r;
+        }
 
-                if (stat(dirname, &st) < 0) {
-                        if (errno == ENOENT)
-                                continue;
-                        return log_device_debug_errno(dev, errno, "Failed to stat %s: %m", dirname);
-                }
+        r = free_and_strdup(&best_devnode, devnode);
+        if (r < 0)
+                return r;
+
+        *ret_devnode = TAKE_PTR(best_devnode);
+        return 1;
+}
+
+int udev_node_stack_update(int dirfd, const char *id, const char *devnode, int priority, char **ret_devnode) {
+        _cleanup_free_ char *old_devnode = NULL, *best_id = NULL, *best_devnode = NULL;
+        int old_priority, r;
+        bool has_old;
+
+        assert(dirfd >= 0);
+        assert(id);
+        assert(ret_devnode);
+
+        /* Adds or updates the entry of the device with the given ID in the stack directory, or removes it
+         * if no device node is specified, and then finds the device node with the highest priority. This
+         * returns 1 if a device found, 0 if no device found, or a negative errno. The caller must hold the
+         * lock of the stack directory.
+         *
+         * The ID of the device with the highest priority is stored in a hidden symlink in the directory,
+         * so that all entries only need to be read when that device is removed or its priority is lowered,
+         * rather than on every update. Otherwise, adding many devices claiming the same symlink, e.g. the
+         * paths of a multipath device, takes quadratic time. */
 
-                if (symlink(data, filename) < 0) {
-                        if (errno == ENOENT)
-                                continue;
-                        return log_device_debug_errno(dev, errno, "Failed to create symbolic link %s: %m", filename);
+        has_old = stack_entry_read(dirfd, id, &old_priority, &old_devnode) >= 0;
+
+        if (devnode) {
+                if (!has_old || old_priority != priority || !streq(old_devnode, devnode)) {
+                        _cleanup_free_ char *data = NULL;
+
+                        if (asprintf(&data, "%i:%s", priority, devnode) < 0)
+                                return -ENOMEM;
+
+                        if (unlinkat(dirfd, id, 0) < 0 && errno != ENOENT)
+                                return -errno;
+
+                        if (symlinkat(data, dirfd, id) < 0)
+                                return -errno;
                 }
+        } else if (unlinkat(dirfd, id, 0) < 0 && errno != ENOENT)
+                return -errno;
+
+        r = stack_directory_use_best(dirfd, id, devnode, priority,
+                                     /* lowered = */ !has_old || priority < old_priority,
+                                     ret_devnode);
+        if (r != 0)
+                return r;
+
+        r = stack_directory_find_prioritized(dirfd, &best_id, &best_devnode);
+        if (r < 0)
+                return r;
+
+        r = stack_directory_set_best(dirfd, best_id);
+        if (r < 0)
+                return r;
 
-                /* The symlink was created. Check if the timestamp of directory is changed. */
-                r = update_timestamp(dev, dirname, &st);
+        *ret_devnode = TAKE_PTR(best_devnode);
+        return !!*ret_devnode;
+}
+
+static int stack_directory_open(sd_device *dev, const char *dirname, bool add) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(dev);
+        assert(dirname);
+
+        if (add) {
+                r = mkdir_p(dirname, 0755);
                 if (r < 0)
-                        return log_device_debug_errno(dev, r, "Failed to update timestamp of %s: %m", dirname);
+                        return log_device_debug_errno(dev, r, "Failed to create stack directory '%s': %m", dirname);
+        }
 
-                return 0;
+        fd = open(dirname, O_CLOEXEC|O_DIRECTORY|O_NOFOLLOW|O_RDONLY);
+        if (fd < 0) {
+                if (!add && errno == ENOENT)
+                        return -ENOENT; /* No device ever claimed the symlink. That's OK. */
+
+                return log_device_debug_errno(dev, errno, "Failed to open stack directory '%s': %m", dirname);
         }
 
-        return log_device_debug_errno(dev, SYNTHETIC_ERRNO(ELOOP), "Failed to create symbolic link %s: %m", filename);
+        return TAKE_FD(fd);
+}
+
+static int stack_directory_lock(sd_device *dev, int dirfd) {
+        _cleanup_close_ int fd = -1;
+
+        assert(dev);
+        assert(dirfd >= 0);
+
+        /* Serializes the updates of the stack directory and of the symlink by workers processing events of
+         * different devices claiming the same symlink. */
+
+        fd = openat(dirfd, STACK_DIRECTORY_LOCK, O_CLOEXEC|O_NOFOLLOW|O_RDONLY|O_CREAT, 0600);
+        if (fd < 0)
+                return log_device_debug_errno(dev, errno, "Failed to open lock file in stack directory: %m");
+
+        if (flock(fd, LOCK_EX) < 0)
+                return log_device_debug_errno(dev, errno, "Failed to lock stack directory: %m");
+
+        return TAKE_FD(fd);
 }
 
 /* manage "stack of names" with possibly specified device priorities */
 static int link_update(sd_device *dev, const char *slink_in, bool add) {
-        _cleanup_free_ char *slink = NULL, *dirname = NULL;
-        const char *slink_name;
+        _cleanup_free_ char *slink = NULL, *dirname = NULL, *target = NULL;
+        _cleanup_close_ int dirfd = -1, lockfd = -1;
+        const char *slink_name, *id, *devnode = NULL;
         char name_enc[NAME_MAX+1];
-        int r;
+        int priority = 0, r;
 
         assert(dev);
         assert(slink_in);
@@ -437,56 +446,52 @@ static int link_update(sd_device *dev, const char *slink_in, bool add) {
                 return log_device_debug_errno(dev, SYNTHETIC_ERRNO(EINVAL),
                                               "Invalid symbolic link of device node: %s", slink);
 
-        (void) udev_node_escape_path(slink_name, name_enc, sizeof(name_enc));
-        dirname = path_join("/run/udev/links", name_enc);
-        if (!dirname)
-                return log_oom_debug();
-
-        r = update_stack_directory(dev, dirname, add);
+        r = device_get_device_id(dev, &id);
         if (r < 0)
-                return r;
-
-        for (unsigned i = 0; i < LINK_UPDATE_MAX_RETRIES; i++) {
-                _cleanup_free_ char *target = NULL;
-                struct stat st1 = {}, st2 = {};
-
-                if (i > 0) {
-                        usec_t delay = MIN_RANDOM_DELAY + random_u64_range(MAX_RANDOM_DELAY - MIN_RANDOM_DELAY);
-
-                        log_device_debug(dev, "Directory %s was updated, retrying to update devlink %s after %s.",
-                                         dirname, slink, FORMAT_TIMESPAN(delay, USEC_PER_MSEC));
-                        (void) usleep(delay);
-                }
-
-                if (stat(dirname, &st1) < 0 && errno != ENOENT)
-                        return log_device_debug_errno(dev, errno, "Failed to stat %s: %m", dirname);
+                return log_device_debug_errno(dev, r, "Failed to get device id: %m");
 
-                r = link_find_prioritized(dev, add, dirname, &target);
+        if (add) {
+                r = sd_device_get_devname(dev, &devnode);
                 if (r < 0)
-                        return log_device_debug_errno(dev, r, "Failed to determine device node with the highest priority for '%s': %m", slink);
-                if (r == 0) {
-                        log_device_debug(dev, "No reference left for '%s', removing", slink);
+                        return log_device_debug_errno(dev, r, "Failed to get device node: %m");
 
-                        if (unlink(slink) < 0 && errno != ENOENT)
-                                log_device_debug_errno(dev, errno, "Failed to remove '%s', ignoring: %m", slink);
+                r = device_get_devlink_priority(dev, &priority);
+                if (r < 0)
+                        return log_device_debug_errno(dev, r, "Failed to get priority of device node symlink: %m");
+        }
 
-                        (void) rmdir_parents(slink, "/dev");
-                        return 0;
-                }
+        (void) udev_node_escape_path(slink_name, name_enc, sizeof(name_enc));
+        dirname = path_join("/run/udev/links", name_enc);
+        if (!dirname)
+                return log_oom_debug();
 
-                r = node_symlink(dev, target, slink);
+        dirfd = stack_directory_open(dev, dirname, add);
+        if (dirfd == -ENOENT)
+                r = 0;
+        else if (dirfd < 0)
+                return dirfd;
+        else {
+                lockfd = stack_directory_lock(dev, dirfd);
+                if (lockfd < 0)
+                        return lockfd;
+
+                r = udev_node_stack_update(dirfd, id, devnode, priority, &target);
                 if (r < 0)
-                        return r;
+                        return log_device_debug_errno(dev, r, "Failed to determine device node with the highest priority for '%s': %m", slink);
+        }
+        if (r == 0) {
+                log_device_debug(dev, "No reference left for '%s', removing", slink);
 
-                if (stat(dirname, &st2) < 0 && errno != ENOENT)
-                        return log_device_debug_errno(dev, errno, "Failed to stat %s: %m", dirname);
+                if (unlink(slink) < 0 && errno != ENOENT)
+                        log_device_debug_errno(dev, errno, "Failed to remove '%s', ignoring: %m", slink);
 
-                if (((st1.st_mode & S_IFMT) == 0 && (st2.st_mode & S_IFMT) == 0) ||
-                    stat_inode_unmodified(&st1, &st2))
-                        return 0;
+                (void) rmdir_parents(slink, "/dev");
+                return 0;
         }
 
-        return -ELOOP;
+        /* The lock is kept until the symlink is updated, so that it is not replaced by a worker which
+         * looked at the stack directory earlier. */
+        return node_symlink(dev, target, slink);
 }
 
 static int device_get_devpath_by_devnum(sd_device *dev, char **ret) {
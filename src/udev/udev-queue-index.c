@@ -0,0 +1,329 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "string-util.h"
+#include "udev-queue-index.h"
+
+struct UdevQueueIndexNode {
+        char *key;
+
+        /* Only used for devpaths: the node of the path one component up, and those one component down */
+        UdevQueueIndexNode *parent;
+        LIST_HEAD(UdevQueueIndexNode, children);
+        LIST_FIELDS(UdevQueueIndexNode, siblings);
+
+        /* The events with this key, ordered by seqnum */
+        LIST_HEAD(UdevQueueIndexRef, refs);
+
+        /* The number of references to this node and to the nodes below it, and a lower bound of their
+         * seqnums. The latter is not raised when references are removed, but only when a lookup finds
+         * nothing older below a node. */
+        unsigned n_refs;
+        uint64_t min_seqnum;
+};
+
+struct UdevQueueIndex {
+        Hashmap *ids;
+        Hashmap *devnodes;
+        Hashmap *devpaths;
+};
+
+static UdevQueueIndexNode* node_free(UdevQueueIndexNode *node) {
+        if (!node)
+                return NULL;
+
+        free(node->key);
+        return mfree(node);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(node_hash_ops, char, string_hash_func, string_compare_func,
+                                              UdevQueueIndexNode, node_free);
+
+UdevQueueIndex* udev_queue_index_new(void) {
+        return new0(UdevQueueIndex, 1);
+}
+
+UdevQueueIndex* udev_queue_index_free(UdevQueueIndex *index) {
+        if (!index)
+                return NULL;
+
+        hashmap_free(index->ids);
+        hashmap_free(index->devnodes);
+        hashmap_free(index->devpaths);
+
+        return mfree(index);
+}
+
+static void node_prune(Hashmap *nodes, UdevQueueIndexNode *node) {
+        /* Drops the node and its parents as long as nothing refers to them anymore. */
+
+        while (node && node->n_refs == 0) {
+                UdevQueueIndexNode *parent = node->parent;
+
+                assert(!node->refs);
+                assert(!node->children);
+
+                if (parent)
+                        LIST_REMOVE(siblings, parent->children, node);
+
+                assert_se(hashmap_remove(nodes, node->key) == node);
+                node_free(node);
+
+                node = parent;
+        }
+}
+
+static int node_get(Hashmap **nodes, const char *key, bool tree, UdevQueueIndexNode **ret) {
+        UdevQueueIndexNode *node, *parent = NULL;
+        int r;
+
+        assert(nodes);
+        assert(key);
+        assert(ret);
+
+        node = hashmap_get(*nodes, key);
+        if (node) {
+                *ret = node;
+                return 0;
+        }
+
+        if (tree) {
+                const char *e;
+
+                /* Top level paths, e.g. "/devices", have no parent. */
+                e = strrchr(key, '/');
+                if (e && e != key) {
+                        _cleanup_free_ char *p = NULL;
+
+                        p = strndup(key, e - key);
+                        if (!p)
+                                return -ENOMEM;
+
+                        r = node_get(nodes, p, true, &parent);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        node = new(UdevQueueIndexNode, 1);
+        if (!node) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        *node = (UdevQueueIndexNode) {
+                .key = strdup(key),
+                .parent = parent,
+                .min_seqnum = UINT64_MAX,
+        };
+        if (!node->key) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        r = hashmap_ensure_put(nodes, &node_hash_ops, node->key, node);
+        if (r < 0)
+                goto fail;
+
+        if (parent)
+                LIST_PREPEND(siblings, parent->children, node);
+
+        *ret = node;
+        return 0;
+
+fail:
+        node_free(node);
+        node_prune(*nodes, parent);
+        return r;
+}
+
+static int ref_add(Hashmap **nodes, UdevQueueIndexRef *ref, const char *key, bool tree, uint64_t seqnum) {
+        UdevQueueIndexRef *next = NULL;
+        UdevQueueIndexNode *node;
+        int r;
+
+        assert(nodes);
+        assert(ref);
+
+        if (!key)
+                return 0;
+
+        r = node_get(nodes, key, tree, &node);
+        if (r < 0)
+                return r;
+
+        *ref = (UdevQueueIndexRef) {
+                .node = node,
+                .seqnum = seqnum,
+        };
+
+        /* Events are queued in the order of their seqnums, hence this usually appends. */
+        LIST_FOREACH(refs, i, node->refs)
+                if (i->seqnum > seqnum) {
+                        next = i;
+                        break;
+                }
+
+        LIST_INSERT_BEFORE(refs, node->refs, next, ref);
+
+        for (; node; node = node->parent) {
+                node->n_refs++;
+                node->min_seqnum = MIN(node->min_seqnum, seqnum);
+        }
+
+        return 0;
+}
+
+static void ref_remove(Hashmap *nodes, UdevQueueIndexRef *ref) {
+        UdevQueueIndexNode *node;
+
+        assert(ref);
+
+        node = ref->node;
+        if (!node)
+                return;
+
+        LIST_REMOVE(refs, node->refs, ref);
+
+        for (UdevQueueIndexNode *n = node; n; n = n->parent) {
+                assert(n->n_refs > 0);
+                n->n_refs--;
+        }
+
+        node_prune(nodes, node);
+        ref->node = NULL;
+}
+
+int udev_queue_index_add(
+                UdevQueueIndex *index,
+                UdevQueueIndexEntry *entry,
+                uint64_t seqnum,
+                const char *id,
+                const char *devnode,
+                const char *devpath,
+                const char *devpath_old) {
+
+        int r;
+
+        assert(index);
+        assert(entry);
+        assert(seqnum > 0);
+
+        *entry = (UdevQueueIndexEntry) {
+                .seqnum = seqnum,
+        };
+
+        r = ref_add(&index->ids, &entry->id, id, false, seqnum);
+        if (r < 0)
+                goto fail;
+
+        r = ref_add(&index->devnodes, &entry->devnode, devnode, false, seqnum);
+        if (r < 0)
+                goto fail;
+
+        r = ref_add(&index->devpaths, &entry->devpath, devpath, true, seqnum);
+        if (r < 0)
+                goto fail;
+
+        r = ref_add(&index->devpaths, &entry->devpath_old, devpath_old, true, seqnum);
+        if (r < 0)
+                goto fail;
+
+        return 0;
+
+fail:
+        udev_queue_index_remove(index, entry);
+        return r;
+}
+
+void udev_queue_index_remove(UdevQueueIndex *index, UdevQueueIndexEntry *entry) {
+        assert(entry);
+
+        if (!index)
+                return;
+
+        ref_remove(index->ids, &entry->id);
+        ref_remove(index->devnodes, &entry->devnode);
+        ref_remove(index->devpaths, &entry->devpath);
+        ref_remove(index->devpaths, &entry->devpath_old);
+}
+
+static uint64_t node_find_earlier(const UdevQueueIndexNode *node, uint64_t seqnum) {
+        /* The references are ordered by seqnum, hence only the first one needs to be checked. */
+
+        if (node && node->refs && node->refs->seqnum < seqnum)
+                return node->refs->seqnum;
+
+        return 0;
+}
+
+static uint64_t node_find_earlier_below(UdevQueueIndexNode *node, uint64_t seqnum) {
+        assert(node);
+
+        LIST_FOREACH(siblings, child, node->children) {
+                uint64_t s;
+
+                if (child->min_seqnum >= seqnum)
+                        continue;
+
+                s = node_find_earlier(child, seqnum);
+                if (s == 0)
+                        s = node_find_earlier_below(child, seqnum);
+                if (s > 0)
+                        return s;
+
+                /* Everything below was queued later, no need to look there again for this or any earlier
+                 * seqnum. */
+                child->min_seqnum = seqnum;
+        }
+
+        return 0;
+}
+
+static uint64_t devpath_find_earlier(const UdevQueueIndexRef *ref, uint64_t seqnum) {
+        uint64_t s;
+
+        assert(ref);
+
+        if (!ref->node)
+                return 0;
+
+        /* The same path, or a path above it */
+        for (UdevQueueIndexNode *n = ref->node; n; n = n->parent) {
+                s = node_find_earlier(n, seqnum);
+                if (s > 0)
+                        return s;
+        }
+
+        /* A path below it */
+        return node_find_earlier_below(ref->node, seqnum);
+}
+
+uint64_t udev_queue_index_find_blocker(UdevQueueIndex *index, const UdevQueueIndexEntry *entry) {
+        uint64_t s;
+
+        assert(entry);
+
+        /* Returns the seqnum of an event queued before the given one, which the given one has to wait for,
+         * or 0 if there is none. Note that both the devpath and the old devpath of an event are checked
+         * against both of the other events, which is slightly stricter than necessary for two devices
+         * moved away from the same path, but that does not happen in practice. */
+
+        if (!index)
+                return 0;
+
+        s = node_find_earlier(entry->id.node, entry->seqnum);
+        if (s > 0)
+                return s;
+
+        s = node_find_earlier(entry->devnode.node, entry->seqnum);
+        if (s > 0)
+                return s;
+
+        s = devpath_find_earlier(&entry->devpath, entry->seqnum);
+        if (s > 0)
+                return s;
+
+        return devpath_find_earlier(&entry->devpath_old, entry->seqnum);
+}
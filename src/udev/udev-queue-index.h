@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <inttypes.h>
+
+#include "list.h"
+
+/* Indexes the queued events by the keys which make one event wait for an earlier one: the device ID, the
+ * device node, and the devpath and the old devpath, which conflict with the same path and with any path
+ * below or above them. The devpaths are kept in a tree of their components, hence finding a blocker does
+ * not need to go through the whole queue, but only through the parents of the event's devpath and those
+ * entries below it which have been queued before it. */
+
+typedef struct UdevQueueIndex UdevQueueIndex;
+typedef struct UdevQueueIndexNode UdevQueueIndexNode;
+typedef struct UdevQueueIndexRef UdevQueueIndexRef;
+
+struct UdevQueueIndexRef {
+        UdevQueueIndexNode *node;
+        uint64_t seqnum;
+
+        LIST_FIELDS(UdevQueueIndexRef, refs);
+};
+
+/* To be embedded in the queued event */
+typedef struct UdevQueueIndexEntry {
+        uint64_t seqnum;
+
+        UdevQueueIndexRef id;
+        UdevQueueIndexRef devnode;
+        UdevQueueIndexRef devpath;
+        UdevQueueIndexRef devpath_old;
+} UdevQueueIndexEntry;
+
+UdevQueueIndex* udev_queue_index_new(void);
+UdevQueueIndex* udev_queue_index_free(UdevQueueIndex *index);
+DEFINE_TRIVIAL_CLEANUP_FUNC(UdevQueueIndex*, udev_queue_index_free);
+
+int udev_queue_index_add(
+                UdevQueueIndex *index,
+                UdevQueueIndexEntry *entry,
+                uint64_t seqnum,
+                const char *id,
+                const char *devnode,
+                const char *devpath,
+                const char *devpath_old);
+void udev_queue_index_remove(UdevQueueIndex *index, UdevQueueIndexEntry *entry);
+
+uint64_t udev_queue_index_find_blocker(UdevQueueIndex *index, const UdevQueueIndexEntry *entry);
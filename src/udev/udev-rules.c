@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
 
 #include <ctype.h>
+#include <sys/mman.h>
 
 #include "alloc-util.h"
 #include "architecture.h"
@@ -21,17 +22,20 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "proc-cmdline.h"
+#include "sparse-endian.h"
 #include "stat-util.h"
 #include "strv.h"
 #include "strxcpyx.h"
 #include "sysctl-util.h"
 #include "syslog-util.h"
+#include "tmpfile-util.h"
 #include "udev-builtin.h"
 #include "udev-event.h"
 #include "udev-netlink.h"
 #include "udev-node.h"
 #include "udev-rules.h"
 #include "udev-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "virt.h"
 
@@ -149,6 +153,7 @@ struct UdevRuleToken {
         UdevRuleMatchType match_type:8;
         UdevRuleSubstituteType attr_subst_type:7;
         bool attr_match_remove_trailing_whitespace:1;
+        bool value_has_alternatives:1;
         const char *value;
         void *data;
         LIST_FIELDS(UdevRuleToken, tokens);
@@ -156,9 +161,18 @@ struct UdevRuleToken {
 
 struct UdevRuleLine {
         char *line;
+        size_t line_size;               /* including the two trailing NUL bytes, see rule_add_line() */
         unsigned line_number;
         UdevRuleLineType type;
 
+        /* Necessary conditions for the line to match, derived from its ACTION==, SUBSYSTEM== and KERNEL==
+         * tokens when loading the rules, which allow to skip most lines for an event without walking their
+         * tokens. See rule_line_compile_guards(). */
+        unsigned action_mask;           /* bit 1 << a is set for each action a the line may match */
+        unsigned subsystem_id;          /* id in UdevRules.subsystem_ids, or 0 if no single subsystem is required */
+        const char *kernel_prefix;      /* literal prefix the sysname must start with, or NULL */
+        size_t kernel_prefix_len;
+
         const char *label;
         const char *goto_label;
         UdevRuleLine *goto_line;
@@ -176,11 +190,22 @@ struct UdevRuleFile {
         LIST_FIELDS(UdevRuleFile, rule_files);
 };
 
+/* What is checked against the guards of each line, determined once per event */
+typedef struct UdevRuleEventKeys {
+        UdevRuleLineType line_type_mask; /* lines which have none of these types have no effect */
+        unsigned action_mask;            /* 1 << action of the event, or UINT_MAX if unknown */
+        unsigned subsystem_id;           /* 0 if no line requires the subsystem, UINT_MAX if unknown */
+        const char *sysname;             /* NULL if unknown */
+} UdevRuleEventKeys;
+
 struct UdevRules {
         usec_t dirs_ts_usec;
         ResolveNameTiming resolve_name_timing;
         Hashmap *known_users;
         Hashmap *known_groups;
+        Hashmap *subsystem_ids;
+        char **files;                   /* all files the rules were read from, for udev_rules_write_cache() */
+        usec_t load_usec;               /* CLOCK_REALTIME when we started reading them */
         UdevRuleFile *current_file;
         LIST_HEAD(UdevRuleFile, rule_files);
 };
@@ -315,6 +340,8 @@ UdevRules *udev_rules_free(UdevRules *rules) {
 
         hashmap_free_free_key(rules->known_users);
         hashmap_free_free_key(rules->known_groups);
+        hashmap_free(rules->subsystem_ids);
+        strv_free(rules->files);
         return mfree(rules);
 }
 
@@ -414,7 +441,7 @@ static int rule_line_add_token(UdevRuleLine *rule_line, UdevRuleTokenType type,
         UdevRuleToken *token;
         UdevRuleMatchType match_type = _MATCH_TYPE_INVALID;
         UdevRuleSubstituteType subst_type = _SUBST_TYPE_INVALID;
-        bool remove_trailing_whitespace = false;
+        bool remove_trailing_whitespace = false, alternatives = false;
         size_t len;
 
         assert(rule_line);
@@ -450,8 +477,10 @@ static int rule_line_add_token(UdevRuleLine *rule_line, UdevRuleTokenType type,
                                 } else {
                                         if (bar)
                                                 empty = true;
-                                        else
+                                        else {
                                                 *b++ = '\0';
+                                                alternatives = true;
+                                        }
                                         bar = true;
                                 }
                         }
@@ -496,6 +525,7 @@ static int rule_line_add_token(UdevRuleLine *rule_line, UdevRuleTokenType type,
                 .match_type = match_type,
                 .attr_subst_type = subst_type,
                 .attr_match_remove_trailing_whitespace = remove_trailing_whitespace,
+                .value_has_alternatives = alternatives,
         };
 
         rule_line_append_token(rule_line, token);
@@ -1073,6 +1103,97 @@ static void sort_tokens(UdevRuleLine *rule_line) {
         }
 }
 
+static bool token_match_string(UdevRuleToken *token, const char *str);
+
+static const char* token_single_value(UdevRuleToken *token) {
+        assert(token);
+
+        /* Returns the value of a match token that matches only a single string or glob, i.e. that is
+         * neither negated nor has alternatives or an empty alternative, hence which the device property
+         * necessarily has to match. */
+
+        if (token->op != OP_MATCH || !IN_SET(token->match_type, MATCH_TYPE_PLAIN, MATCH_TYPE_GLOB))
+                return NULL;
+
+        if (token->value_has_alternatives)
+                return NULL;
+
+        return token->value;
+}
+
+static int rule_line_compile_guards(UdevRules *rules, UdevRuleLine *rule_line) {
+        int r;
+
+        assert(rules);
+        assert(rule_line);
+
+        /* Most lines start with ACTION==, SUBSYSTEM== or KERNEL== matches, which fail for the vast majority
+         * of events. Evaluate what we can of them here once, so that udev_rules_apply_to_event() can skip
+         * such lines with a few integer and prefix comparisons. All these tokens are pure matches without
+         * side effects, hence skipping a line that fails any of them is the same as evaluating it. */
+
+        LIST_FOREACH(tokens, token, rule_line->tokens) {
+                const char *v;
+
+                switch (token->type) {
+
+                case TK_M_ACTION:
+                        /* There are only a handful of actions, just try them all. */
+                        for (sd_device_action_t a = 0; a < _SD_DEVICE_ACTION_MAX; a++)
+                                if (!token_match_string(token, device_action_to_string(a)))
+                                        rule_line->action_mask &= ~(1U << a);
+                        break;
+
+                case TK_M_SUBSYSTEM: {
+                        void *id;
+
+                        v = token_single_value(token);
+                        if (!v || token->match_type != MATCH_TYPE_PLAIN || rule_line->subsystem_id != 0)
+                                break;
+
+                        id = hashmap_get(rules->subsystem_ids, v);
+                        if (!id) {
+                                _cleanup_free_ char *k = NULL;
+
+                                k = strdup(v);
+                                if (!k)
+                                        return -ENOMEM;
+
+                                id = UINT_TO_PTR(hashmap_size(rules->subsystem_ids) + 1);
+                                r = hashmap_ensure_put(&rules->subsystem_ids, &string_hash_ops_free, k, id);
+                                if (r < 0)
+                                        return r;
+                                TAKE_PTR(k);
+                        }
+
+                        rule_line->subsystem_id = PTR_TO_UINT(id);
+                        break;
+                }
+
+                case TK_M_KERNEL: {
+                        size_t n;
+
+                        v = token_single_value(token);
+                        if (!v)
+                                break;
+
+                        /* fnmatch() is called without FNM_NOESCAPE, hence stop at backslashes too */
+                        n = strcspn(v, GLOB_CHARS "\\");
+                        if (n > rule_line->kernel_prefix_len) {
+                                rule_line->kernel_prefix = v;
+                                rule_line->kernel_prefix_len = n;
+                        }
+                        break;
+                }
+
+                default:
+                        ;
+                }
+        }
+
+        return 0;
+}
+
 static int rule_add_line(UdevRules *rules, const char *line_str, unsigned line_nr) {
         _cleanup_(udev_rule_line_freep) UdevRuleLine *rule_line = NULL;
         _cleanup_free_ char *line = NULL;
@@ -1101,7 +1222,9 @@ static int rule_add_line(UdevRules *rules, const char *line_str, unsigned line_n
 
         *rule_line = (UdevRuleLine) {
                 .line = TAKE_PTR(line),
+                .line_size = strlen(line_str) + 2,
                 .line_number = line_nr,
+                .action_mask = UINT_MAX,
                 .rule_file = rule_file,
         };
 
@@ -1133,6 +1256,11 @@ static int rule_add_line(UdevRules *rules, const char *line_str, unsigned line_n
         }
 
         sort_tokens(rule_line);
+
+        r = rule_line_compile_guards(rules, rule_line);
+        if (r < 0)
+                return log_oom();
+
         TAKE_PTR(rule_line);
         return 0;
 }
@@ -1296,6 +1424,7 @@ int udev_rules_load(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing
         if (!rules)
                 return -ENOMEM;
 
+        rules->load_usec = now(CLOCK_REALTIME);
         (void) udev_rules_check_timestamp(rules);
 
         r = conf_files_list_strv(&files, ".rules", NULL, 0, RULES_DIRS);
@@ -1308,10 +1437,690 @@ int udev_rules_load(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing
                         log_debug_errno(r, "Failed to read rules file %s, ignoring: %m", *f);
         }
 
+        rules->files = TAKE_PTR(files);
+
         *ret_rules = TAKE_PTR(rules);
         return 0;
 }
 
+/*** Compiled rules ***/
+
+/* The parsed rules may be stored in a binary file, which is much quicker to load than parsing all rules files
+ * again, not least because user and group names are already resolved. The file records the modification
+ * times and sizes of the rules directories and files (and of the user and group databases, if names are
+ * resolved early) it was compiled from, and is ignored as soon as any of them changed. Lines are stored as
+ * their already tokenized line buffer, with token values, labels and string data as offsets into it. All
+ * integers are little endian. */
+
+#define UDEV_RULES_CACHE_SIGNATURE { 'U', 'D', 'E', 'V', 'R', 'U', 'L', 'E' }
+
+/* Bump this whenever the layout below or any of the enums above change */
+#define UDEV_RULES_CACHE_VERSION 1U
+
+#define UDEV_RULES_CACHE_NONE UINT32_MAX
+
+typedef struct UdevRulesCacheHeader {
+        uint8_t signature[8];
+        le32_t version;
+        le32_t project_version;
+        le32_t resolve_name_timing;
+        le32_t n_sources;
+        le32_t n_files;
+        le32_t n_lines;
+} _packed_ UdevRulesCacheHeader;
+
+/* Followed by n_sources × (source, path), then n_files × (le32 name length, name, le32 number of lines,
+ * lines), where each line is (le32 line number, le32 type, le32 buffer size, buffer, le32 label offset,
+ * le32 goto label offset, le32 index of the goto line within the file, le32 number of tokens, tokens). */
+
+typedef enum UdevRulesCacheSourceType {
+        CACHE_SOURCE_DIRECTORY,
+        CACHE_SOURCE_RULES_FILE,
+        CACHE_SOURCE_OTHER,
+        _CACHE_SOURCE_TYPE_MAX,
+} UdevRulesCacheSourceType;
+
+typedef struct UdevRulesCacheSource {
+        le64_t mtime_usec;      /* 0 if missing */
+        le64_t size;            /* only for regular files */
+        le32_t type;
+        le32_t path_len;
+} _packed_ UdevRulesCacheSource;
+
+typedef struct UdevRulesCacheToken {
+        uint8_t type;
+        uint8_t op;
+        int8_t match_type;
+        int8_t attr_subst_type;
+        uint8_t attr_match_remove_trailing_whitespace;
+        uint8_t value_has_alternatives;
+        uint8_t reserved[2];
+        le32_t value;           /* offset into the line buffer */
+        le32_t data_is_offset;  /* if true, data is an offset into the line buffer, the data itself otherwise */
+        le64_t data;
+} _packed_ UdevRulesCacheToken;
+
+static bool token_data_is_string(UdevRuleTokenType type) {
+        return IN_SET(type,
+                      TK_M_ENV, TK_M_CONST, TK_M_ATTR, TK_M_SYSCTL, TK_M_PARENTS_ATTR,
+                      TK_A_SECLABEL, TK_A_ENV, TK_A_ATTR, TK_A_SYSCTL);
+}
+
+static int udev_rules_get_cache_sources(UdevRules *rules, char ***ret_paths, UdevRulesCacheSourceType **ret_types) {
+        _cleanup_free_ UdevRulesCacheSourceType *types = NULL;
+        _cleanup_strv_free_ char **paths = NULL;
+        size_t n = 0;
+        int r;
+
+        assert(rules);
+        assert(ret_paths);
+        assert(ret_types);
+
+        /* The directories' modification times change when rules files are added or removed, the files'
+         * ones when they are modified. */
+
+        r = strv_extend_strv(&paths, (char**) RULES_DIRS, false);
+        if (r < 0)
+                return r;
+        r = strv_extend_strv(&paths, rules->files, false);
+        if (r < 0)
+                return r;
+        if (rules->resolve_name_timing == RESOLVE_NAME_EARLY) {
+                r = strv_extend(&paths, "/etc/passwd");
+                if (r < 0)
+                        return r;
+                r = strv_extend(&paths, "/etc/group");
+                if (r < 0)
+                        return r;
+        }
+
+        types = new(UdevRulesCacheSourceType, strv_length(paths));
+        if (!types)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < strv_length((char**) RULES_DIRS); i++)
+                types[n++] = CACHE_SOURCE_DIRECTORY;
+        for (size_t i = 0; i < strv_length(rules->files); i++)
+                types[n++] = CACHE_SOURCE_RULES_FILE;
+        while (n < strv_length(paths))
+                types[n++] = CACHE_SOURCE_OTHER;
+
+        *ret_paths = TAKE_PTR(paths);
+        *ret_types = TAKE_PTR(types);
+        return 0;
+}
+
+static int cache_source_stat(const char *path, uint64_t *ret_mtime_usec, uint64_t *ret_size) {
+        struct stat st;
+
+        assert(path);
+        assert(ret_mtime_usec);
+        assert(ret_size);
+
+        if (stat(path, &st) < 0) {
+                if (errno != ENOENT)
+                        return -errno;
+
+                *ret_mtime_usec = *ret_size = 0;
+                return 0;
+        }
+
+        /* Rules files masked by symlinks to /dev/null are recorded as missing, whatever its timestamp is */
+        if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)) {
+                *ret_mtime_usec = *ret_size = 0;
+                return 0;
+        }
+
+        *ret_mtime_usec = timespec_load(&st.st_mtim);
+        *ret_size = S_ISREG(st.st_mode) ? (uint64_t) st.st_size : 0;
+        return 0;
+}
+
+static void cache_write_u32(FILE *f, uint32_t v) {
+        le32_t le = htole32(v);
+
+        fwrite(&le, sizeof(le), 1, f);
+}
+
+static void cache_write_string(FILE *f, const char *s) {
+        size_t n = strlen(s);
+
+        cache_write_u32(f, n);
+        fwrite(s, 1, n, f);
+}
+
+static uint32_t cache_line_offset(UdevRuleLine *line, const char *p) {
+        if (!p)
+                return UDEV_RULES_CACHE_NONE;
+
+        assert(p >= line->line && p < line->line + line->line_size);
+        return p - line->line;
+}
+
+static size_t rule_file_n_lines(UdevRuleFile *file) {
+        size_t n = 0;
+
+        LIST_FOREACH(rule_lines, line, file->rule_lines)
+                n++;
+
+        return n;
+}
+
+static uint32_t rule_line_index(UdevRuleLine *line) {
+        uint32_t n = 0;
+
+        if (!line)
+                return UDEV_RULES_CACHE_NONE;
+
+        LIST_FOREACH_BACKWARDS(rule_lines, i, line->rule_lines_prev)
+                n++;
+
+        return n;
+}
+
+static void udev_rules_write_line(FILE *f, UdevRuleLine *line) {
+        size_t n_tokens = 0;
+
+        cache_write_u32(f, line->line_number);
+        cache_write_u32(f, line->type);
+        cache_write_u32(f, line->line_size);
+        fwrite(line->line, 1, line->line_size, f);
+        cache_write_u32(f, cache_line_offset(line, line->label));
+        cache_write_u32(f, cache_line_offset(line, line->goto_label));
+        cache_write_u32(f, rule_line_index(line->goto_line));
+
+        LIST_FOREACH(tokens, token, line->tokens)
+                n_tokens++;
+        cache_write_u32(f, n_tokens);
+
+        LIST_FOREACH(tokens, token, line->tokens) {
+                UdevRulesCacheToken t = {
+                        .type = token->type,
+                        .op = token->op,
+                        .match_type = token->match_type,
+                        .attr_subst_type = token->attr_subst_type,
+                        .attr_match_remove_trailing_whitespace = token->attr_match_remove_trailing_whitespace,
+                        .value_has_alternatives = token->value_has_alternatives,
+                        .value = htole32(cache_line_offset(line, token->value)),
+                };
+
+                if (token_data_is_string(token->type)) {
+                        t.data_is_offset = htole32(true);
+                        t.data = htole64(cache_line_offset(line, token->data));
+                } else
+                        t.data = htole64((uint64_t) (uintptr_t) token->data);
+
+                fwrite(&t, sizeof(t), 1, f);
+        }
+}
+
+int udev_rules_write_cache(UdevRules *rules, const char *path) {
+        _cleanup_(unlink_and_freep) char *temp_path = NULL;
+        _cleanup_free_ UdevRulesCacheSourceType *types = NULL;
+        _cleanup_strv_free_ char **sources = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        UdevRulesCacheHeader header = {
+                .signature = UDEV_RULES_CACHE_SIGNATURE,
+                .version = htole32(UDEV_RULES_CACHE_VERSION),
+                .project_version = htole32(PROJECT_VERSION),
+                .resolve_name_timing = htole32(rules->resolve_name_timing),
+        };
+        size_t n_files = 0, n_lines = 0, i = 0;
+        int r;
+
+        assert(rules);
+        assert(path);
+
+        r = udev_rules_get_cache_sources(rules, &sources, &types);
+        if (r < 0)
+                return r;
+
+        LIST_FOREACH(rule_files, file, rules->rule_files) {
+                n_files++;
+                n_lines += rule_file_n_lines(file);
+        }
+
+        header.n_sources = htole32(strv_length(sources));
+        header.n_files = htole32(n_files);
+        header.n_lines = htole32(n_lines);
+
+        (void) mkdir_parents(path, 0755);
+
+        r = fopen_temporary(path, &f, &temp_path);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0644);
+
+        fwrite(&header, sizeof(header), 1, f);
+
+        STRV_FOREACH(s, sources) {
+                UdevRulesCacheSource source = {
+                        .type = htole32(types[i++]),
+                        .path_len = htole32(strlen(*s)),
+                };
+                uint64_t mtime, size;
+
+                r = cache_source_stat(*s, &mtime, &size);
+                if (r < 0)
+                        return r;
+
+                /* A file that was modified after we started loading the rules might have been read halfway
+                 * through, and the file system timestamps are rather coarse. */
+                if (usec_add(mtime, USEC_PER_SEC) > rules->load_usec)
+                        return -ESTALE;
+
+                source.mtime_usec = htole64(mtime);
+                source.size = htole64(size);
+                fwrite(&source, sizeof(source), 1, f);
+                fwrite(*s, 1, strlen(*s), f);
+        }
+
+        LIST_FOREACH(rule_files, file, rules->rule_files) {
+                cache_write_string(f, file->filename);
+                cache_write_u32(f, rule_file_n_lines(file));
+
+                LIST_FOREACH(rule_lines, line, file->rule_lines)
+                        udev_rules_write_line(f, line);
+        }
+
+        r = fflush_sync_and_check(f);
+        if (r < 0)
+                return r;
+
+        if (rename(temp_path, path) < 0)
+                return -errno;
+
+        temp_path = mfree(temp_path);
+
+        log_debug("Wrote compiled rules of %zu files with %zu lines to %s.", n_files, n_lines, path);
+        return 0;
+}
+
+typedef struct CacheReader {
+        const uint8_t *p, *end;
+} CacheReader;
+
+static const void* cache_read(CacheReader *c, size_t n) {
+        const void *p = c->p;
+
+        if ((size_t) (c->end - c->p) < n)
+                return NULL;
+
+        c->p += n;
+        return p;
+}
+
+static int cache_read_u32(CacheReader *c, uint32_t *ret) {
+        const void *p;
+
+        p = cache_read(c, sizeof(le32_t));
+        if (!p)
+                return -EBADMSG;
+
+        *ret = unaligned_read_le32(p);
+        return 0;
+}
+
+static int cache_read_string(CacheReader *c, char **ret) {
+        const void *p;
+        uint32_t n;
+        char *s;
+        int r;
+
+        r = cache_read_u32(c, &n);
+        if (r < 0)
+                return r;
+
+        p = cache_read(c, n);
+        if (!p)
+                return -EBADMSG;
+
+        s = memdup_suffix0(p, n);
+        if (!s)
+                return -ENOMEM;
+
+        *ret = s;
+        return 0;
+}
+
+static int cache_check_sources(CacheReader *c, uint32_t n_sources, char ***ret_files) {
+        _cleanup_strv_free_ char **files = NULL;
+        int r;
+
+        /* Verifies that none of the sources changed since the cache was written, and returns the rules
+         * files. */
+
+        for (uint32_t i = 0; i < n_sources; i++) {
+                const UdevRulesCacheSource *source;
+                _cleanup_free_ char *path = NULL;
+                uint64_t mtime, size;
+                const void *p;
+                uint32_t n;
+
+                source = cache_read(c, sizeof(UdevRulesCacheSource));
+                if (!source)
+                        return -EBADMSG;
+
+                n = unaligned_read_le32(&source->path_len);
+                p = cache_read(c, n);
+                if (!p)
+                        return -EBADMSG;
+
+                path = memdup_suffix0(p, n);
+                if (!path)
+                        return -ENOMEM;
+
+                r = cache_source_stat(path, &mtime, &size);
+                if (r < 0)
+                        return r;
+
+                if (mtime != unaligned_read_le64(&source->mtime_usec) ||
+                    size != unaligned_read_le64(&source->size))
+                        return log_debug_errno(SYNTHETIC_ERRNO(ESTALE), "%s changed since rules were compiled.", path);
+
+                if (unaligned_read_le32(&source->type) == CACHE_SOURCE_RULES_FILE) {
+                        r = strv_consume(&files, TAKE_PTR(path));
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        *ret_files = TAKE_PTR(files);
+        return 0;
+}
+
+static int cache_read_offset(CacheReader *c, UdevRuleLine *line, const char **ret) {
+        uint32_t o;
+        int r;
+
+        r = cache_read_u32(c, &o);
+        if (r < 0)
+                return r;
+
+        if (o == UDEV_RULES_CACHE_NONE)
+                *ret = NULL;
+        else if (o < line->line_size)
+                *ret = line->line + o;
+        else
+                return -EBADMSG;
+
+        return 0;
+}
+
+static int cache_read_token(CacheReader *c, UdevRuleLine *line) {
+        const UdevRulesCacheToken *t;
+        UdevRuleToken *token;
+        uint32_t value;
+        uint64_t data;
+
+        t = cache_read(c, sizeof(UdevRulesCacheToken));
+        if (!t)
+                return -EBADMSG;
+
+        if (t->type >= _TK_TYPE_MAX ||
+            t->op >= _OP_TYPE_MAX ||
+            (t->match_type != _MATCH_TYPE_INVALID && (t->match_type < 0 || t->match_type >= _MATCH_TYPE_MAX)) ||
+            (t->attr_subst_type != _SUBST_TYPE_INVALID && (t->attr_subst_type < 0 || t->attr_subst_type >= _SUBST_TYPE_MAX)))
+                return -EBADMSG;
+
+        value = unaligned_read_le32(&t->value);
+        if (value != UDEV_RULES_CACHE_NONE && value >= line->line_size)
+                return -EBADMSG;
+
+        data = unaligned_read_le64(&t->data);
+        if (unaligned_read_le32(&t->data_is_offset) != token_data_is_string(t->type))
+                return -EBADMSG;
+        if (token_data_is_string(t->type) && data != UDEV_RULES_CACHE_NONE && data >= line->line_size)
+                return -EBADMSG;
+
+        token = new(UdevRuleToken, 1);
+        if (!token)
+                return -ENOMEM;
+
+        *token = (UdevRuleToken) {
+                .type = t->type,
+                .op = t->op,
+                .match_type = t->match_type,
+                .attr_subst_type = t->attr_subst_type,
+                .attr_match_remove_trailing_whitespace = t->attr_match_remove_trailing_whitespace,
+                .value_has_alternatives = t->value_has_alternatives,
+                .value = value == UDEV_RULES_CACHE_NONE ? NULL : line->line + value,
+        };
+
+        if (!token_data_is_string(t->type))
+                token->data = (void*) (uintptr_t) data;
+        else if (data != UDEV_RULES_CACHE_NONE)
+                token->data = line->line + data;
+
+        rule_line_append_token(line, token);
+        return 0;
+}
+
+static int cache_read_line(CacheReader *c, UdevRules *rules, UdevRuleFile *rule_file, uint32_t *ret_goto) {
+        _cleanup_(udev_rule_line_freep) UdevRuleLine *line = NULL;
+        uint32_t line_number, type, size, n_tokens;
+        const char *buf;
+        int r;
+
+        if (cache_read_u32(c, &line_number) < 0 ||
+            cache_read_u32(c, &type) < 0 ||
+            cache_read_u32(c, &size) < 0)
+                return -EBADMSG;
+
+        /* The buffer has to end in two NUL bytes, so that all strings and nulstrs in it are terminated */
+        buf = cache_read(c, size);
+        if (!buf || size < 2 || buf[size - 1] != '\0' || buf[size - 2] != '\0')
+                return -EBADMSG;
+
+        line = new(UdevRuleLine, 1);
+        if (!line)
+                return -ENOMEM;
+
+        *line = (UdevRuleLine) {
+                .line = memdup(buf, size),
+                .line_size = size,
+                .line_number = line_number,
+                .type = type,
+                .action_mask = UINT_MAX,
+        };
+        if (!line->line)
+                return -ENOMEM;
+
+        if (cache_read_offset(c, line, &line->label) < 0 ||
+            cache_read_offset(c, line, &line->goto_label) < 0 ||
+            cache_read_u32(c, ret_goto) < 0 ||
+            cache_read_u32(c, &n_tokens) < 0)
+                return -EBADMSG;
+
+        for (uint32_t i = 0; i < n_tokens; i++) {
+                r = cache_read_token(c, line);
+                if (r < 0)
+                        return r;
+        }
+
+        r = rule_line_compile_guards(rules, line);
+        if (r < 0)
+                return r;
+
+        line->rule_file = rule_file;
+        if (rule_file->current_line)
+                LIST_APPEND(rule_lines, rule_file->current_line, line);
+        else
+                LIST_APPEND(rule_lines, rule_file->rule_lines, line);
+        rule_file->current_line = TAKE_PTR(line);
+
+        return 0;
+}
+
+static int cache_read_file(CacheReader *c, UdevRules *rules) {
+        _cleanup_free_ UdevRuleLine **lines = NULL;
+        _cleanup_free_ uint32_t *gotos = NULL;
+        _cleanup_free_ char *name = NULL;
+        UdevRuleFile *rule_file;
+        uint32_t n_lines;
+        int r;
+
+        r = cache_read_string(c, &name);
+        if (r < 0)
+                return r;
+
+        r = cache_read_u32(c, &n_lines);
+        if (r < 0)
+                return r;
+
+        /* Each line takes up at least that much, refuse bogus numbers before allocating anything */
+        if (n_lines > (size_t) (c->end - c->p) / (7 * sizeof(le32_t)))
+                return -EBADMSG;
+
+        lines = new(UdevRuleLine*, n_lines);
+        gotos = new(uint32_t, n_lines);
+        rule_file = new(UdevRuleFile, 1);
+        if (!lines || !gotos || !rule_file) {
+                free(rule_file);
+                return -ENOMEM;
+        }
+
+        *rule_file = (UdevRuleFile) {
+                .filename = TAKE_PTR(name),
+        };
+
+        if (rules->current_file)
+                LIST_APPEND(rule_files, rules->current_file, rule_file);
+        else
+                LIST_APPEND(rule_files, rules->rule_files, rule_file);
+        rules->current_file = rule_file;
+
+        for (uint32_t i = 0; i < n_lines; i++) {
+                r = cache_read_line(c, rules, rule_file, gotos + i);
+                if (r < 0)
+                        return r;
+
+                lines[i] = rule_file->current_line;
+        }
+
+        /* GOTOs only ever jump forward, see rule_resolve_goto() */
+        for (uint32_t i = 0; i < n_lines; i++) {
+                if (gotos[i] == UDEV_RULES_CACHE_NONE)
+                        continue;
+                if (gotos[i] <= i || gotos[i] >= n_lines)
+                        return -EBADMSG;
+
+                lines[i]->goto_line = lines[gotos[i]];
+        }
+
+        return 0;
+}
+
+int udev_rules_load_cache(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing, const char *path) {
+        _cleanup_(udev_rules_freep) UdevRules *rules = NULL;
+        const UdevRulesCacheHeader *header;
+        _cleanup_close_ int fd = -1;
+        CacheReader c;
+        struct stat st;
+        void *map;
+        int r;
+
+        assert(ret_rules);
+        assert(path);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        r = stat_verify_regular(&st);
+        if (r < 0)
+                return r;
+
+        if ((size_t) st.st_size < sizeof(UdevRulesCacheHeader))
+                return -EBADMSG;
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+
+        c = (CacheReader) {
+                .p = map,
+                .end = (const uint8_t*) map + st.st_size,
+        };
+
+        header = cache_read(&c, sizeof(UdevRulesCacheHeader));
+        if (memcmp(header->signature, (const uint8_t[]) UDEV_RULES_CACHE_SIGNATURE, sizeof(header->signature)) != 0 ||
+            le32toh(header->version) != UDEV_RULES_CACHE_VERSION ||
+            le32toh(header->project_version) != PROJECT_VERSION) {
+                r = -EBADMSG;
+                goto finish;
+        }
+
+        if (le32toh(header->resolve_name_timing) != (uint32_t) resolve_name_timing) {
+                r = -ESTALE;
+                goto finish;
+        }
+
+        rules = udev_rules_new(resolve_name_timing);
+        if (!rules) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        rules->load_usec = now(CLOCK_REALTIME);
+        (void) udev_rules_check_timestamp(rules);
+
+        r = cache_check_sources(&c, le32toh(header->n_sources), &rules->files);
+        if (r < 0)
+                goto finish;
+
+        for (uint32_t i = 0; i < le32toh(header->n_files); i++) {
+                r = cache_read_file(&c, rules);
+                if (r < 0)
+                        goto finish;
+        }
+
+        if (c.p != c.end) {
+                r = -EBADMSG;
+                goto finish;
+        }
+
+        log_debug("Loaded compiled rules of %" PRIu32 " files with %" PRIu32 " lines from %s.",
+                  le32toh(header->n_files), le32toh(header->n_lines), path);
+
+        *ret_rules = TAKE_PTR(rules);
+        r = 0;
+
+finish:
+        (void) munmap(map, st.st_size);
+        return r;
+}
+
+int udev_rules_load_cached(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing) {
+        const char *p;
+        int r;
+
+        assert(ret_rules);
+
+        NULSTR_FOREACH(p, UDEV_RULES_CACHE_PATHS) {
+                r = udev_rules_load_cache(ret_rules, resolve_name_timing, p);
+                if (r >= 0)
+                        return 0;
+                if (r != -ENOENT)
+                        log_debug_errno(r, "Failed to load compiled rules from %s, ignoring: %m", p);
+        }
+
+        r = udev_rules_load(ret_rules, resolve_name_timing);
+        if (r < 0)
+                return r;
+
+        /* Write the compiled rules for the next time we are started during this boot */
+        r = udev_rules_write_cache(*ret_rules, UDEV_RULES_CACHE_RUNTIME_PATH);
+        if (r < 0)
+                log_debug_errno(r, "Failed to write compiled rules to %s, ignoring: %m", UDEV_RULES_CACHE_RUNTIME_PATH);
+
+        return 0;
+}
+
 bool udev_rules_check_timestamp(UdevRules *rules) {
         if (!rules)
                 return false;
@@ -2454,33 +3263,81 @@ static int udev_rule_apply_parent_token_to_event(
         }
 }
 
+static int udev_rules_get_event_keys(UdevRules *rules, sd_device *dev, UdevRuleEventKeys *ret) {
+        UdevRuleEventKeys keys = {
+                .line_type_mask = LINE_HAS_GOTO | LINE_UPDATE_SOMETHING,
+                .action_mask = UINT_MAX,
+                .subsystem_id = UINT_MAX,
+        };
+        sd_device_action_t action;
+        const char *subsystem;
+        int r;
+
+        assert(rules);
+        assert(dev);
+        assert(ret);
+
+        r = sd_device_get_action(dev, &action);
+        if (r < 0)
+                return r;
+
+        keys.action_mask = 1U << action;
+
+        if (action != SD_DEVICE_REMOVE) {
+                if (sd_device_get_devnum(dev, NULL) >= 0)
+                        keys.line_type_mask |= LINE_HAS_DEVLINK;
+
+                if (sd_device_get_ifindex(dev, NULL) >= 0)
+                        keys.line_type_mask |= LINE_HAS_NAME;
+        }
+
+        /* On errors, leave the filter open, and let the tokens report them. */
+        r = sd_device_get_subsystem(dev, &subsystem);
+        if (r >= 0)
+                keys.subsystem_id = PTR_TO_UINT(hashmap_get(rules->subsystem_ids, subsystem));
+        else if (r == -ENOENT)
+                keys.subsystem_id = 0;
+
+        (void) sd_device_get_sysname(dev, &keys.sysname);
+
+        *ret = keys;
+        return 0;
+}
+
+static bool rule_line_may_match(UdevRuleLine *line, const UdevRuleEventKeys *keys) {
+        assert(line);
+        assert(keys);
+
+        if ((line->type & keys->line_type_mask) == 0)
+                return false;
+
+        if ((line->action_mask & keys->action_mask) == 0)
+                return false;
+
+        if (line->subsystem_id != 0 && keys->subsystem_id != UINT_MAX && line->subsystem_id != keys->subsystem_id)
+                return false;
+
+        if (line->kernel_prefix && keys->sysname &&
+            strncmp(keys->sysname, line->kernel_prefix, line->kernel_prefix_len) != 0)
+                return false;
+
+        return true;
+}
+
 static int udev_rule_apply_line_to_event(
                 UdevRules *rules,
                 UdevEvent *event,
+                const UdevRuleEventKeys *keys,
                 usec_t timeout_usec,
                 int timeout_signal,
                 Hashmap *properties_list,
                 UdevRuleLine **next_line) {
 
         UdevRuleLine *line = rules->current_file->current_line;
-        UdevRuleLineType mask = LINE_HAS_GOTO | LINE_UPDATE_SOMETHING;
         bool parents_done = false;
-        sd_device_action_t action;
         int r;
 
-        r = sd_device_get_action(event->dev, &action);
-        if (r < 0)
-                return r;
-
-        if (action != SD_DEVICE_REMOVE) {
-                if (sd_device_get_devnum(event->dev, NULL) >= 0)
-                        mask |= LINE_HAS_DEVLINK;
-
-                if (sd_device_get_ifindex(event->dev, NULL) >= 0)
-                        mask |= LINE_HAS_NAME;
-        }
-
-        if ((line->type & mask) == 0)
+        if (!rule_line_may_match(line, keys))
                 return 0;
 
         event->esc = ESCAPE_UNSET;
@@ -2520,16 +3377,21 @@ int udev_rules_apply_to_event(
                 int timeout_signal,
                 Hashmap *properties_list) {
 
+        UdevRuleEventKeys keys;
         int r;
 
         assert(rules);
         assert(event);
 
+        r = udev_rules_get_event_keys(rules, event->dev, &keys);
+        if (r < 0)
+                return r;
+
         LIST_FOREACH(rule_files, file, rules->rule_files) {
                 rules->current_file = file;
                 LIST_FOREACH_WITH_NEXT(rule_lines, line, next_line, file->rule_lines) {
                         file->current_line = line;
-                        r = udev_rule_apply_line_to_event(rules, event, timeout_usec, timeout_signal, properties_list, &next_line);
+                        r = udev_rule_apply_line_to_event(rules, event, &keys, timeout_usec, timeout_signal, properties_list, &next_line);
                         if (r < 0)
                                 return r;
                 }
@@ -16,9 +16,26 @@ typedef enum {
         _ESCAPE_TYPE_INVALID = -EINVAL,
 } UdevRuleEscapeType;
 
+/* Where compiled rules are looked for, see udev_rules_load_cached() */
+#define UDEV_RULES_CACHE_RUNTIME_PATH "/run/udev/rules.bin"
+#define UDEV_RULES_CACHE_PATH "/etc/udev/rules.bin"
+#define UDEV_RULES_CACHE_PATHS                  \
+        UDEV_RULES_CACHE_RUNTIME_PATH "\0"      \
+        UDEV_RULES_CACHE_PATH "\0"              \
+        UDEVLIBEXECDIR "/rules.bin\0"
+
 int udev_rules_parse_file(UdevRules *rules, const char *filename);
 UdevRules* udev_rules_new(ResolveNameTiming resolve_name_timing);
 int udev_rules_load(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing);
+
+/* Compiled rules are only loaded if none of the rules files changed since they were written, and if they
+ * were compiled with the same resolve_name_timing, otherwise -ESTALE is returned. */
+int udev_rules_write_cache(UdevRules *rules, const char *path);
+int udev_rules_load_cache(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing, const char *path);
+
+/* Loads the first up-to-date compiled rules from UDEV_RULES_CACHE_PATHS, or the rules files otherwise, and
+ * then writes UDEV_RULES_CACHE_RUNTIME_PATH. */
+int udev_rules_load_cached(UdevRules **ret_rules, ResolveNameTiming resolve_name_timing);
 UdevRules *udev_rules_free(UdevRules *rules);
 DEFINE_TRIVIAL_CLEANUP_FUNC(UdevRules*, udev_rules_free);
 
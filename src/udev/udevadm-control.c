@@ -25,6 +25,8 @@
 #include "time-util.h"
 #include "udevadm.h"
 #include "udev-ctrl.h"
+#include "udev-rules.h"
+#include "udev-util.h"
 #include "util.h"
 #include "virt.h"
 
@@ -41,6 +43,8 @@ static int help(void) {
                "  -p --property=KEY=VALUE  Set a global property for all events\n"
                "  -m --children-max=N      Maximum number of children\n"
                "     --ping                Wait for udev to respond to a ping message\n"
+               "     --compile[=PATH]      Compile the rules into a binary file, " UDEV_RULES_CACHE_PATH "\n"
+               "                           by default, to be loaded instead of the rules files\n"
                "  -t --timeout=SECONDS     Maximum time to block for a reply\n",
                program_invocation_short_name);
 
@@ -54,6 +58,7 @@ int control_main(int argc, char *argv[], void *userdata) {
 
         enum {
                 ARG_PING = 0x100,
+                ARG_COMPILE,
         };
 
         static const struct option options[] = {
@@ -68,6 +73,7 @@ int control_main(int argc, char *argv[], void *userdata) {
                 { "env",              required_argument, NULL, 'p'      }, /* alias for -p */
                 { "children-max",     required_argument, NULL, 'm'      },
                 { "ping",             no_argument,       NULL, ARG_PING },
+                { "compile",          optional_argument, NULL, ARG_COMPILE },
                 { "timeout",          required_argument, NULL, 't'      },
                 { "version",          no_argument,       NULL, 'V'      },
                 { "help",             no_argument,       NULL, 'h'      },
@@ -159,6 +165,24 @@ int control_main(int argc, char *argv[], void *userdata) {
                         else if (r < 0)
                                 return log_error_errno(r, "Failed to send a ping message: %m");
                         break;
+                case ARG_COMPILE: {
+                        _cleanup_(udev_rules_freep) UdevRules *rules = NULL;
+                        ResolveNameTiming resolve_name_timing = RESOLVE_NAME_EARLY;
+                        const char *path = optarg ?: UDEV_RULES_CACHE_PATH;
+
+                        /* This doesn't involve the daemon, it will pick the compiled rules up the next time
+                         * it is started or reloads its rules. */
+                        (void) udev_parse_config_full(NULL, NULL, NULL, &resolve_name_timing, NULL);
+
+                        r = udev_rules_load(&rules, resolve_name_timing);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to read udev rules: %m");
+
+                        r = udev_rules_write_cache(rules, path);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to write compiled rules to %s: %m", path);
+                        break;
+                }
                 case 't':
                         r = parse_sec(optarg, &timeout);
                         if (r < 0)
@@ -12,6 +12,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-database.h"
 #include "device-enumerator-private.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -385,6 +386,9 @@ static void cleanup_dirs_after_db_cleanup(DIR *dir, DIR *datadir) {
 static void cleanup_db(void) {
         _cleanup_closedir_ DIR *dir1 = NULL, *dir2 = NULL, *dir3 = NULL, *dir4 = NULL;
 
+        /* The snapshot would not be used anymore after the database is cleaned up, but drop it anyway. */
+        (void) unlink(DEVICE_DATABASE_SNAPSHOT);
+
         dir1 = opendir("/run/udev/data");
         if (dir1)
                 cleanup_dir(dir1, S_ISVTX, 1);
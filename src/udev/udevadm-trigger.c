@@ -2,6 +2,8 @@
 
 #include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
 
 #include "sd-device.h"
 #include "sd-event.h"
@@ -26,6 +28,115 @@ static bool arg_verbose = false;
 static bool arg_dry_run = false;
 static bool arg_quiet = false;
 static bool arg_uuid = false;
+static unsigned arg_jobs = 1;
+
+static int trigger_device(sd_device *d, sd_device_action_t action, bool settle, bool *skip_uuid_logic, sd_id128_t *ret_id) {
+        int r;
+
+        assert(d);
+        assert(skip_uuid_logic);
+        assert(ret_id);
+
+        *ret_id = SD_ID128_NULL;
+
+        /* Use the UUID mode if the user explicitly asked for it, or if --settle has been specified,
+         * so that we can recognize our own uevent. */
+        r = sd_device_trigger_with_uuid(d, action, (arg_uuid || settle) && !*skip_uuid_logic ? ret_id : NULL);
+        if (r == -EINVAL && !arg_uuid && settle && !*skip_uuid_logic) {
+                /* If we specified a UUID because of the settling logic, and we got EINVAL this might
+                 * be caused by an old kernel which doesn't know the UUID logic (pre-4.13). Let's try
+                 * if it works without the UUID logic then. */
+                r = sd_device_trigger(d, action);
+                if (r != -EINVAL)
+                        *skip_uuid_logic = true; /* dropping the uuid stuff changed the return code,
+                                                  * hence don't bother next time */
+        }
+
+        return r;
+}
+
+static int trigger_handle_result(
+                sd_device *d,
+                const char *syspath,
+                sd_device_action_t action,
+                int result,
+                sd_id128_t id,
+                Hashmap *settle_hashmap,
+                int *ret) {
+
+        int r;
+
+        assert(d);
+        assert(syspath);
+        assert(ret);
+
+        if (result < 0) {
+                /* ENOENT may be returned when a device does not have /uevent or is already
+                 * removed. Hence, this is logged at debug level and ignored.
+                 *
+                 * ENODEV may be returned by some buggy device drivers e.g. /sys/devices/vio.
+                 * See,
+                 * https://github.com/systemd/systemd/issues/13652#issuecomment-535129791 and
+                 * https://bugs.launchpad.net/ubuntu/+source/linux/+bug/1845319.
+                 * So, this error is ignored, but logged at warning level to encourage people to
+                 * fix the driver.
+                 *
+                 * EROFS is returned when /sys is read only. In that case, all subsequent
+                 * writes will also fail, hence return immediately.
+                 *
+                 * EACCES or EPERM may be returned when this is invoked by non-priviledged user.
+                 * We do NOT return immediately, but continue operation and propagate the error.
+                 * Why? Some device can be owned by a user, e.g., network devices configured in
+                 * a network namespace. See, https://github.com/systemd/systemd/pull/18559 and
+                 * https://git.kernel.org/pub/scm/linux/kernel/git/torvalds/linux.git/commit/?id=ebb4a4bf76f164457184a3f43ebc1552416bc823
+                 *
+                 * All other errors are logged at error level, but let's continue the operation,
+                 * and propagate the error.
+                 */
+
+                bool ignore = IN_SET(result, -ENOENT, -ENODEV);
+                int level =
+                        arg_quiet ? LOG_DEBUG :
+                        result == -ENOENT ? LOG_DEBUG :
+                        result == -ENODEV ? LOG_WARNING : LOG_ERR;
+
+                log_device_full_errno(d, level, result,
+                                      "Failed to write '%s' to '%s/uevent'%s: %m",
+                                      device_action_to_string(action), syspath, ignore ? ", ignoring" : "");
+
+                if (result == -EROFS)
+                        return result;
+                if (*ret == 0 && !ignore)
+                        *ret = result;
+                return 0;
+        }
+
+        /* If the user asked for it, write event UUID to stdout */
+        if (arg_uuid)
+                printf(SD_ID128_UUID_FORMAT_STR "\n", SD_ID128_FORMAT_VAL(id));
+
+        if (settle_hashmap) {
+                _cleanup_free_ sd_id128_t *mid = NULL;
+                _cleanup_free_ char *sp = NULL;
+
+                sp = strdup(syspath);
+                if (!sp)
+                        return log_oom();
+
+                mid = newdup(sd_id128_t, &id, 1);
+                if (!mid)
+                        return log_oom();
+
+                r = hashmap_put(settle_hashmap, sp, mid);
+                if (r < 0)
+                        return log_oom();
+
+                TAKE_PTR(sp);
+                TAKE_PTR(mid);
+        }
+
+        return 0;
+}
 
 static int exec_list(
                 sd_device_enumerator *e,
@@ -33,14 +144,11 @@ static int exec_list(
                 Hashmap *settle_hashmap) {
 
         bool skip_uuid_logic = false;
-        const char *action_str;
         sd_device *d;
         int r, ret = 0;
 
-        action_str = device_action_to_string(action);
-
         FOREACH_DEVICE_AND_SUBSYSTEM(e, d) {
-                sd_id128_t id = SD_ID128_NULL;
+                sd_id128_t id;
                 const char *syspath;
 
                 r = sd_device_get_syspath(d, &syspath);
@@ -55,82 +163,230 @@ static int exec_list(
                 if (arg_dry_run)
                         continue;
 
-                /* Use the UUID mode if the user explicitly asked for it, or if --settle has been specified,
-                 * so that we can recognize our own uevent. */
-                r = sd_device_trigger_with_uuid(d, action, (arg_uuid || settle_hashmap) && !skip_uuid_logic ? &id : NULL);
-                if (r == -EINVAL && !arg_uuid && settle_hashmap && !skip_uuid_logic) {
-                        /* If we specified a UUID because of the settling logic, and we got EINVAL this might
-                         * be caused by an old kernel which doesn't know the UUID logic (pre-4.13). Let's try
-                         * if it works without the UUID logic then. */
-                        r = sd_device_trigger(d, action);
-                        if (r != -EINVAL)
-                                skip_uuid_logic = true; /* dropping the uuid stuff changed the return code,
-                                                         * hence don't bother next time */
-                }
-                if (r < 0) {
-                        /* ENOENT may be returned when a device does not have /uevent or is already
-                         * removed. Hence, this is logged at debug level and ignored.
-                         *
-                         * ENODEV may be returned by some buggy device drivers e.g. /sys/devices/vio.
-                         * See,
-                         * https://github.com/systemd/systemd/issues/13652#issuecomment-535129791 and
-                         * https://bugs.launchpad.net/ubuntu/+source/linux/+bug/1845319.
-                         * So, this error is ignored, but logged at warning level to encourage people to
-                         * fix the driver.
-                         *
-                         * EROFS is returned when /sys is read only. In that case, all subsequent
-                         * writes will also fail, hence return immediately.
-                         *
-                         * EACCES or EPERM may be returned when this is invoked by non-priviledged user.
-                         * We do NOT return immediately, but continue operation and propagate the error.
-                         * Why? Some device can be owned by a user, e.g., network devices configured in
-                         * a network namespace. See, https://github.com/systemd/systemd/pull/18559 and
-                         * https://git.kernel.org/pub/scm/linux/kernel/git/torvalds/linux.git/commit/?id=ebb4a4bf76f164457184a3f43ebc1552416bc823
-                         *
-                         * All other errors are logged at error level, but let's continue the operation,
-                         * and propagate the error.
-                         */
-
-                        bool ignore = IN_SET(r, -ENOENT, -ENODEV);
-                        int level =
-                                arg_quiet ? LOG_DEBUG :
-                                r == -ENOENT ? LOG_DEBUG :
-                                r == -ENODEV ? LOG_WARNING : LOG_ERR;
-
-                        log_device_full_errno(d, level, r,
-                                              "Failed to write '%s' to '%s/uevent'%s: %m",
-                                              action_str, syspath, ignore ? ", ignoring" : "");
-
-                        if (r == -EROFS)
-                                return r;
-                        if (ret == 0 && !ignore)
-                                ret = r;
+                r = trigger_device(d, action, settle_hashmap, &skip_uuid_logic, &id);
+
+                r = trigger_handle_result(d, syspath, action, r, id, settle_hashmap, &ret);
+                if (r < 0)
+                        return r;
+        }
+
+        return ret;
+}
+
+typedef struct TriggerJob {
+        sd_device *device;
+        const char *syspath;
+        size_t after; /* the index of the last job which has to be done before this one is started, or SIZE_MAX */
+        sd_id128_t id;
+        int result;
+        bool done;
+} TriggerJob;
+
+typedef struct TriggerQueue {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond; /* signalled whenever a job is done */
+
+        TriggerJob *jobs;
+        size_t n_jobs;
+        size_t next_job;
+        size_t n_done; /* all jobs before this one are done */
+
+        sd_device_action_t action;
+        bool settle;
+        bool skip_uuid_logic;
+        bool stop;
+} TriggerQueue;
+
+static void* trigger_thread(void *userdata) {
+        TriggerQueue *q = ASSERT_PTR(userdata);
+
+        assert_se(pthread_mutex_lock(&q->mutex) == 0);
+
+        while (!q->stop && q->next_job < q->n_jobs) {
+                TriggerJob *j = q->jobs + q->next_job;
+                bool skip_uuid_logic;
+
+                /* Jobs are started in order, and only after the jobs they depend on are done. */
+                if (j->after != SIZE_MAX && q->n_done <= j->after) {
+                        assert_se(pthread_cond_wait(&q->cond, &q->mutex) == 0);
                         continue;
                 }
 
-                /* If the user asked for it, write event UUID to stdout */
-                if (arg_uuid)
-                        printf(SD_ID128_UUID_FORMAT_STR "\n", SD_ID128_FORMAT_VAL(id));
+                q->next_job++;
+                skip_uuid_logic = q->skip_uuid_logic;
 
-                if (settle_hashmap) {
-                        _cleanup_free_ sd_id128_t *mid = NULL;
-                        _cleanup_free_ char *sp = NULL;
+                assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+                j->result = trigger_device(j->device, q->action, q->settle, &skip_uuid_logic, &j->id);
+                assert_se(pthread_mutex_lock(&q->mutex) == 0);
 
-                        sp = strdup(syspath);
-                        if (!sp)
-                                return log_oom();
+                if (skip_uuid_logic)
+                        q->skip_uuid_logic = true;
+                if (j->result == -EROFS)
+                        q->stop = true;
 
-                        mid = newdup(sd_id128_t, &id, 1);
-                        if (!d)
-                                return log_oom();
+                j->done = true;
+                while (q->n_done < q->n_jobs && q->jobs[q->n_done].done)
+                        q->n_done++;
+
+                assert_se(pthread_cond_broadcast(&q->cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+        return NULL;
+}
+
+static bool devpath_is_ordered_last(const char *syspath) {
+        const char *p;
+
+        /* The enumerator puts md and dm devices after all others, and the control device of a sound card
+         * after the other devices of the card. Let's keep it that way. */
+
+        if (strstr(syspath, "/block/md") || strstr(syspath, "/block/dm-"))
+                return true;
+
+        p = strstr(syspath, "/sound/card");
+        return p && strstr(p, "/controlC");
+}
+
+static int trigger_jobs_prepare(TriggerJob *jobs, size_t n_jobs) {
+        _cleanup_hashmap_free_ Hashmap *by_syspath = NULL;
+        int r;
+
+        assert(jobs || n_jobs == 0);
+
+        /* Figure out what each device has to wait for: the devices above it, so that parents get their
+         * uevents (and hence their seqnums) before their children, as with sequential triggering. Siblings
+         * and unrelated devices are triggered in parallel. */
 
-                        r = hashmap_put(settle_hashmap, sp, mid);
+        by_syspath = hashmap_new(&path_hash_ops);
+        if (!by_syspath)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < n_jobs; i++) {
+                _cleanup_free_ char *p = NULL;
+
+                jobs[i].after = SIZE_MAX;
+
+                if (devpath_is_ordered_last(jobs[i].syspath))
+                        jobs[i].after = i > 0 ? i - 1 : SIZE_MAX;
+                else for (;;) {
+                        _cleanup_free_ char *q = NULL;
+                        TriggerJob *parent;
+
+                        r = path_extract_directory(p ?: jobs[i].syspath, &q);
+                        if (r == -EADDRNOTAVAIL || (r >= 0 && path_equal(q, "/sys")))
+                                break;
                         if (r < 0)
-                                return log_oom();
+                                return r;
+
+                        parent = hashmap_get(by_syspath, q);
+                        if (parent && (jobs[i].after == SIZE_MAX || (size_t) (parent - jobs) > jobs[i].after))
+                                jobs[i].after = parent - jobs;
 
-                        TAKE_PTR(sp);
-                        TAKE_PTR(mid);
+                        free_and_replace(p, q);
                 }
+
+                r = hashmap_put(by_syspath, jobs[i].syspath, jobs + i);
+                if (r < 0 && r != -EEXIST)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int exec_list_parallel(
+                sd_device_enumerator *e,
+                sd_device_action_t action,
+                Hashmap *settle_hashmap,
+                unsigned n_threads) {
+
+        _cleanup_free_ pthread_t *threads = NULL;
+        _cleanup_free_ TriggerJob *jobs = NULL;
+        size_t n_jobs = 0, n_started = 0;
+        sigset_t ss, saved_ss;
+        sd_device *d;
+        int r, k, ret = 0;
+
+        assert(n_threads > 1);
+
+        /* Like exec_list(), but writes to the uevent files of several devices at the same time. */
+
+        FOREACH_DEVICE_AND_SUBSYSTEM(e, d) {
+                const char *syspath;
+
+                r = sd_device_get_syspath(d, &syspath);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to get syspath of enumerated devices, ignoring: %m");
+                        continue;
+                }
+
+                if (!GREEDY_REALLOC(jobs, n_jobs + 1))
+                        return log_oom();
+
+                /* The enumerator keeps a reference to the devices */
+                jobs[n_jobs++] = (TriggerJob) {
+                        .device = d,
+                        .syspath = syspath,
+                };
+        }
+
+        r = trigger_jobs_prepare(jobs, n_jobs);
+        if (r < 0)
+                return log_error_errno(r, "Failed to order devices to trigger: %m");
+
+        TriggerQueue q = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+                .jobs = jobs,
+                .n_jobs = n_jobs,
+                .action = action,
+                .settle = settle_hashmap,
+        };
+
+        n_threads = MIN(n_threads, n_jobs);
+        threads = new(pthread_t, n_threads);
+        if (!threads)
+                return log_oom();
+
+        /* The threads never need to handle signals, leave them all to the main thread. */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return log_error_errno(r, "Failed to block signals: %m");
+
+        for (; n_started < n_threads; n_started++) {
+                r = pthread_create(threads + n_started, NULL, trigger_thread, &q);
+                if (r > 0)
+                        break;
+        }
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+
+        if (n_started == 0)
+                /* Let's do the work ourselves then. */
+                (void) trigger_thread(&q);
+
+        for (size_t i = 0; i < n_started; i++)
+                (void) pthread_join(threads[i], NULL);
+
+        assert_se(pthread_cond_destroy(&q.cond) == 0);
+        assert_se(pthread_mutex_destroy(&q.mutex) == 0);
+
+        if (k > 0)
+                return log_error_errno(k, "Failed to restore signal mask: %m");
+
+        for (size_t i = 0; i < n_jobs; i++) {
+                TriggerJob *j = jobs + i;
+
+                if (!j->done)
+                        continue;
+
+                if (arg_verbose)
+                        printf("%s\n", j->syspath);
+
+                r = trigger_handle_result(j->device, j->syspath, action, j->result, j->id, settle_hashmap, &ret);
+                if (r < 0)
+                        return r;
         }
 
         return ret;
@@ -233,6 +489,7 @@ static int help(void) {
                "     --wait-daemon[=SECONDS]        Wait for udevd daemon to be initialized\n"
                "                                    before triggering uevents\n"
                "     --uuid                         Print synthetic uevent UUID\n"
+               "  -j --jobs=N                       Trigger up to N devices at the same time\n"
                "     --prioritized-subsystem=SUBSYSTEM[,SUBSYSTEM…]\n"
                "                                    Trigger devices from a matching subsystem first\n",
                program_invocation_short_name);
@@ -273,6 +530,7 @@ int trigger_main(int argc, char *argv[], void *userdata) {
                 { "help",                  no_argument,       NULL, 'h'                       },
                 { "uuid",                  no_argument,       NULL, ARG_UUID                  },
                 { "prioritized-subsystem", required_argument, NULL, ARG_PRIORITIZED_SUBSYSTEM },
+                { "jobs",                  required_argument, NULL, 'j'                       },
                 {}
         };
         enum {
@@ -302,7 +560,7 @@ int trigger_main(int argc, char *argv[], void *userdata) {
         if (r < 0)
                 return r;
 
-        while ((c = getopt_long(argc, argv, "vnqt:c:s:S:a:A:p:g:y:b:wVh", options, NULL)) >= 0) {
+        while ((c = getopt_long(argc, argv, "vnqt:c:s:S:a:A:p:g:y:b:wj:Vh", options, NULL)) >= 0) {
                 _cleanup_free_ char *buf = NULL;
                 const char *key, *val;
 
@@ -393,6 +651,14 @@ int trigger_main(int argc, char *argv[], void *userdata) {
                         settle = true;
                         break;
 
+                case 'j':
+                        r = safe_atou(optarg, &arg_jobs);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse number of jobs '%s': %m", optarg);
+                        if (arg_jobs == 0)
+                                return log_error_errno(SYNTHETIC_ERRNO(EINVAL), "The number of jobs must be positive.");
+                        break;
+
                 case ARG_NAME: {
                         _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
 
@@ -520,7 +786,10 @@ int trigger_main(int argc, char *argv[], void *userdata) {
                 assert_not_reached();
         }
 
-        r = exec_list(e, action, settle_hashmap);
+        if (arg_jobs > 1 && !arg_dry_run)
+                r = exec_list_parallel(e, action, settle_hashmap, arg_jobs);
+        else
+                r = exec_list(e, action, settle_hashmap);
         if (r < 0)
                 return r;
 
@@ -31,7 +31,9 @@
 #include "cgroup-setup.h"
 #include "cgroup-util.h"
 #include "cpu-set-util.h"
+#include "def.h"
 #include "dev-setup.h"
+#include "device-database.h"
 #include "device-monitor-private.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -57,6 +59,7 @@
 #include "selinux-util.h"
 #include "signal-util.h"
 #include "socket-util.h"
+#include "stats-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "strxcpyx.h"
@@ -65,14 +68,20 @@
 #include "udev-builtin.h"
 #include "udev-ctrl.h"
 #include "udev-event.h"
+#include "udev-queue-index.h"
 #include "udev-util.h"
 #include "udev-watch.h"
 #include "user-util.h"
+#include "varlink.h"
 #include "version.h"
 
 #define WORKER_NUM_MAX 2048U
 #define EVENT_RETRY_INTERVAL_USEC (200 * USEC_PER_MSEC)
 #define EVENT_RETRY_TIMEOUT_USEC  (3 * USEC_PER_MINUTE)
+#define WORKER_PARENT_CACHE_USEC  (3 * USEC_PER_SEC)
+#define WORKER_PARENT_CACHE_MAX   256U
+#define WORKER_SYSATTR_CACHE_MAX  4096U
+#define DB_SNAPSHOT_DELAY_USEC    (1 * USEC_PER_SEC)
 
 static bool arg_debug = false;
 static int arg_daemonize = false;
@@ -90,6 +99,7 @@ typedef struct Manager {
         sd_event *event;
         Hashmap *workers;
         LIST_HEAD(Event, events);
+        UdevQueueIndex *queue_index;
         char *cgroup;
         pid_t pid; /* the process that originally allocated the manager object */
         int log_level;
@@ -101,6 +111,7 @@ typedef struct Manager {
 
         sd_device_monitor *monitor;
         UdevCtrl *ctrl;
+        VarlinkServer *varlink_server;
         int worker_watch[2];
 
         /* used by udev-watch */
@@ -109,6 +120,14 @@ typedef struct Manager {
 
         sd_event_source *kill_workers_event;
 
+        /* see on_db_snapshot_event() */
+        sd_event_source *db_snapshot_event;
+        bool db_snapshot_dirty;
+
+        /* used by workers, see worker_attach_cached_parent() */
+        Hashmap *parent_cache;
+        usec_t parent_cache_usec;
+
         usec_t last_usec;
 
         bool stop_exec_queue;
@@ -137,6 +156,9 @@ typedef struct Event {
         const char *devnode;
         usec_t retry_again_next_usec;
         usec_t retry_again_timeout_usec;
+        usec_t queued_usec;
+
+        UdevQueueIndexEntry index_entry;
 
         sd_event_source *timeout_warning_event;
         sd_event_source *timeout_event;
@@ -175,6 +197,10 @@ typedef enum EventResult {
         _EVENT_RESULT_INVALID         = -EINVAL,
 } EventResult;
 
+DEFINE_STATS_COUNTER(stats_events_queued, "udev.events_queued");
+DEFINE_STATS_COUNTER(stats_events_failed, "udev.events_failed");
+DEFINE_STATS_HISTOGRAM(stats_event, "udev.event"); /* From being queued until the worker is done */
+
 static Event *event_free(Event *event) {
         if (!event)
                 return NULL;
@@ -182,6 +208,7 @@ static Event *event_free(Event *event) {
         assert(event->manager);
 
         LIST_REMOVE(event, event->manager->events, event);
+        udev_queue_index_remove(event->manager->queue_index, &event->index_entry);
         sd_device_unref(event->dev);
 
         /* Do not use sd_event_source_disable_unref() here, as this is called by both workers and the
@@ -228,14 +255,17 @@ static void manager_clear_for_worker(Manager *manager) {
          * main process. */
         manager->inotify_event = sd_event_source_unref(manager->inotify_event);
         manager->kill_workers_event = sd_event_source_unref(manager->kill_workers_event);
+        manager->db_snapshot_event = sd_event_source_unref(manager->db_snapshot_event);
 
         manager->event = sd_event_unref(manager->event);
 
         manager->workers = hashmap_free(manager->workers);
         event_queue_cleanup(manager, EVENT_UNDEF);
+        manager->queue_index = udev_queue_index_free(manager->queue_index);
 
         manager->monitor = sd_device_monitor_unref(manager->monitor);
         manager->ctrl = udev_ctrl_unref(manager->ctrl);
+        manager->varlink_server = varlink_server_unref(manager->varlink_server);
 
         manager->worker_watch[READ_END] = safe_close(manager->worker_watch[READ_END]);
 }
@@ -252,6 +282,7 @@ static Manager* manager_free(Manager *manager) {
 
         hashmap_free_free_free(manager->properties);
         udev_rules_free(manager->rules);
+        hashmap_free(manager->parent_cache);
 
         safe_close(manager->inotify_fd);
         safe_close_pair(manager->worker_watch);
@@ -376,6 +407,30 @@ static int on_kill_workers_event(sd_event_source *s, uint64_t usec, void *userda
         return 1;
 }
 
+static int on_db_snapshot_event(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *manager = userdata;
+        int r;
+
+        assert(manager);
+
+        /* Writes a snapshot of the udev database once no events have been queued for a while, so that
+         * programs going through many devices can read the database entries from it, instead of opening
+         * the file of each device. If events are queued or the database changes in the meantime, the
+         * timer is armed again by on_post() once the queue is empty. */
+
+        if (manager->events)
+                return 1;
+
+        r = device_database_snapshot_write(DEVICE_DATABASE_DIR, DEVICE_DATABASE_SNAPSHOT);
+        if (r == -EAGAIN)
+                return 1;
+        if (r < 0 && r != -ENOENT)
+                log_debug_errno(r, "Failed to write snapshot of udev database, ignoring: %m");
+
+        manager->db_snapshot_dirty = false;
+        return 1;
+}
+
 static void device_broadcast(sd_device_monitor *monitor, sd_device *dev, EventResult result) {
         int r;
 
@@ -581,6 +636,92 @@ static int worker_mark_block_device_read_only(sd_device *dev) {
         return 0;
 }
 
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(parent_cache_hash_ops, char, path_hash_func, path_compare, sd_device, sd_device_unref);
+
+static int worker_attach_cached_parent(Manager *manager, sd_device *dev) {
+        _cleanup_free_ char *path = NULL;
+        sd_device_action_t action;
+        const char *syspath;
+        usec_t usec;
+        int r;
+
+        assert(manager);
+        assert(dev);
+
+        /* On coldplug, many sibling devices are added one after another, and the event of each of them
+         * looks up the same parent devices and reads the same attributes of them for ATTRS{} and friends.
+         * Let's keep the parents around for a short while, and reuse them together with the attribute
+         * values cached in them for the following "add" events. Similarly, the attribute values read
+         * through any device object are shared with the other objects of the same device, see
+         * device_shared_sysattr_cache_enable(). Any other event may change the devices or their attributes,
+         * hence drop the caches then, and also when a device is added again. */
+
+        r = sd_device_get_action(dev, &action);
+        if (r < 0)
+                return r;
+
+        r = sd_device_get_syspath(dev, &syspath);
+        if (r < 0)
+                return r;
+
+        usec = now(CLOCK_MONOTONIC);
+
+        if (action != SD_DEVICE_ADD ||
+            usec > usec_add(manager->parent_cache_usec, WORKER_PARENT_CACHE_USEC) ||
+            hashmap_size(manager->parent_cache) >= WORKER_PARENT_CACHE_MAX ||
+            hashmap_contains(manager->parent_cache, syspath)) {
+                manager->parent_cache = hashmap_free(manager->parent_cache);
+                device_shared_sysattr_cache_flush();
+                manager->parent_cache_usec = usec;
+        }
+
+        /* The uevent may be about changed attributes of the device itself */
+        device_shared_sysattr_cache_invalidate(syspath);
+
+        if (action != SD_DEVICE_ADD)
+                return 0;
+
+        /* Like sd_device_get_parent(), but look into the cache first for each candidate. */
+        for (;;) {
+                _cleanup_(sd_device_unrefp) sd_device *parent = NULL;
+                _cleanup_free_ char *p = NULL;
+                const char *parent_syspath;
+                sd_device *cached;
+
+                r = path_extract_directory(path ?: syspath, &p);
+                if (r < 0)
+                        return r;
+
+                if (path_equal(p, "/sys"))
+                        return 0;
+
+                cached = hashmap_get(manager->parent_cache, p);
+                if (cached) {
+                        device_set_parent(dev, cached);
+                        return 1;
+                }
+
+                r = sd_device_new_from_syspath(&parent, p);
+                if (r == -ENODEV) {
+                        free_and_replace(path, p);
+                        continue;
+                }
+                if (r < 0)
+                        return r;
+
+                r = sd_device_get_syspath(parent, &parent_syspath);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_ensure_put(&manager->parent_cache, &parent_cache_hash_ops, parent_syspath, parent);
+                if (r < 0)
+                        return r;
+
+                device_set_parent(dev, TAKE_PTR(parent));
+                return 0;
+        }
+}
+
 static int worker_process_device(Manager *manager, sd_device *dev) {
         _cleanup_(udev_event_freep) UdevEvent *udev_event = NULL;
         _cleanup_close_ int fd_lock = -1;
@@ -591,6 +732,10 @@ static int worker_process_device(Manager *manager, sd_device *dev) {
 
         log_device_uevent(dev, "Processing device");
 
+        r = worker_attach_cached_parent(manager, dev);
+        if (r < 0)
+                log_device_debug_errno(dev, r, "Failed to look up parent device, ignoring: %m");
+
         udev_event = udev_event_new(dev, arg_exec_delay_usec, manager->rtnl, manager->log_level);
         if (!udev_event)
                 return -ENOMEM;
@@ -684,6 +829,8 @@ static int worker_main(Manager *_manager, sd_device_monitor *monitor, sd_device
         /* Clear unnecessary data in Manager object. */
         manager_clear_for_worker(manager);
 
+        device_shared_sysattr_cache_enable(WORKER_SYSATTR_CACHE_MAX);
+
         r = sd_event_new(&manager->event);
         if (r < 0)
                 return log_error_errno(r, "Failed to allocate event loop: %m");
@@ -856,14 +1003,13 @@ static int event_run(Event *event) {
 }
 
 static int event_is_blocked(Event *event) {
-        Event *loop_event = NULL;
+        uint64_t blocker;
         int r;
 
         /* lookup event for identical, parent, child device */
 
         assert(event);
         assert(event->manager);
-        assert(event->blocker_seqnum <= event->seqnum);
 
         if (event->retry_again_next_usec > 0) {
                 usec_t now_usec;
@@ -876,64 +1022,17 @@ static int event_is_blocked(Event *event) {
                         return true;
         }
 
-        if (event->blocker_seqnum == event->seqnum)
-                /* we have checked previously and no blocker found */
-                return false;
-
-        LIST_FOREACH(event, e, event->manager->events) {
-                loop_event = e;
-
-                /* we already found a later event, earlier cannot block us, no need to check again */
-                if (loop_event->seqnum < event->blocker_seqnum)
-                        continue;
-
-                /* event we checked earlier still exists, no need to check again */
-                if (loop_event->seqnum == event->blocker_seqnum)
-                        return true;
-
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
-                        goto no_blocker;
-
-                /* found event we have not checked */
-                break;
-        }
-
-        assert(loop_event);
-        assert(loop_event->seqnum > event->blocker_seqnum &&
-               loop_event->seqnum < event->seqnum);
-
         /* check if queue contains events we depend on */
-        LIST_FOREACH(event, e, loop_event) {
-                loop_event = e;
-
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
-                        goto no_blocker;
-
-                if (streq_ptr(loop_event->id, event->id))
-                        break;
-
-                if (devpath_conflict(event->devpath, loop_event->devpath) ||
-                    devpath_conflict(event->devpath, loop_event->devpath_old) ||
-                    devpath_conflict(event->devpath_old, loop_event->devpath))
-                        break;
-
-                if (event->devnode && streq_ptr(event->devnode, loop_event->devnode))
-                        break;
-        }
-
-        assert(loop_event);
+        blocker = udev_queue_index_find_blocker(event->manager->queue_index, &event->index_entry);
+        if (blocker == 0)
+                return false;
 
-        log_device_debug(event->dev, "SEQNUM=%" PRIu64 " blocked by SEQNUM=%" PRIu64,
-                         event->seqnum, loop_event->seqnum);
+        if (blocker != event->blocker_seqnum)
+                log_device_debug(event->dev, "SEQNUM=%" PRIu64 " blocked by SEQNUM=%" PRIu64,
+                                 event->seqnum, blocker);
 
-        event->blocker_seqnum = loop_event->seqnum;
+        event->blocker_seqnum = blocker;
         return true;
-
-no_blocker:
-        event->blocker_seqnum = event->seqnum;
-        return false;
 }
 
 static int event_queue_start(Manager *manager) {
@@ -963,7 +1062,7 @@ static int event_queue_start(Manager *manager) {
         udev_builtin_init();
 
         if (!manager->rules) {
-                r = udev_rules_load(&manager->rules, arg_resolve_name_timing);
+                r = udev_rules_load_cached(&manager->rules, arg_resolve_name_timing);
                 if (r < 0)
                         return log_warning_errno(r, "Failed to read udev rules: %m");
         }
@@ -1118,8 +1217,16 @@ static int event_queue_insert(Manager *manager, sd_device *dev) {
                 .devpath_old = devpath_old,
                 .devnode = devnode,
                 .state = EVENT_QUEUED,
+                .queued_usec = now(CLOCK_MONOTONIC),
         };
 
+        r = udev_queue_index_add(manager->queue_index, &event->index_entry, seqnum, id, devnode, devpath, devpath_old);
+        if (r < 0) {
+                sd_device_unref(event->dev);
+                free(event);
+                return r;
+        }
+
         if (!manager->events) {
                 r = touch("/run/udev/queue");
                 if (r < 0)
@@ -1127,6 +1234,8 @@ static int event_queue_insert(Manager *manager, sd_device *dev) {
         }
 
         LIST_APPEND(event, manager->events, event);
+        manager->db_snapshot_dirty = true;
+        stats_counter_inc(&stats_events_queued);
 
         log_device_uevent(dev, "Device is queued");
 
@@ -1211,6 +1320,12 @@ static int on_worker(sd_event_source *s, int fd, uint32_t revents, void *userdat
                 } else if (worker->state != WORKER_KILLED)
                         worker->state = WORKER_IDLE;
 
+                if (worker->event && result != EVENT_RESULT_TRY_AGAIN) {
+                        if (result != EVENT_RESULT_SUCCESS)
+                                stats_counter_inc(&stats_events_failed);
+                        stats_histogram_add_since(&stats_event, worker->event->queued_usec);
+                }
+
                 /* worker returned */
                 if (result == EVENT_RESULT_TRY_AGAIN &&
                     event_requeue(worker->event) < 0)
@@ -1583,6 +1698,12 @@ static int on_post(sd_event_source *s, void *userdata) {
         } else
                 log_debug("No events are queued, removing /run/udev/queue.");
 
+        if (manager->db_snapshot_dirty && !manager->exit &&
+            (!manager->db_snapshot_event || sd_event_source_get_enabled(manager->db_snapshot_event, NULL) <= 0))
+                (void) event_reset_time(manager->event, &manager->db_snapshot_event, CLOCK_MONOTONIC,
+                                        now(CLOCK_MONOTONIC) + DB_SNAPSHOT_DELAY_USEC, USEC_PER_SEC / 10,
+                                        on_db_snapshot_event, manager, 0, "db-snapshot-event", false);
+
         if (!hashmap_isempty(manager->workers)) {
                 /* There are idle workers */
                 (void) event_reset_time(manager->event, &manager->kill_workers_event, CLOCK_MONOTONIC,
@@ -1893,8 +2014,13 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent) {
                 .inotify_fd = -1,
                 .worker_watch = { -1, -1 },
                 .cgroup = TAKE_PTR(cgroup),
+                .db_snapshot_dirty = true,
         };
 
+        manager->queue_index = udev_queue_index_new();
+        if (!manager->queue_index)
+                return log_oom();
+
         r = udev_ctrl_new_from_fd(&manager->ctrl, fd_ctrl);
         if (r < 0)
                 return log_error_errno(r, "Failed to initialize udev control socket: %m");
@@ -1927,6 +2053,38 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent) {
         return 0;
 }
 
+static int vl_method_get_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        return stats_varlink_reply(link, parameters);
+}
+
+static int manager_open_varlink(Manager *manager) {
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
+        int r;
+
+        assert(manager);
+
+        r = varlink_server_new(&s, VARLINK_SERVER_ROOT_ONLY);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to allocate varlink server object: %m");
+
+        varlink_server_set_userdata(s, manager);
+
+        r = varlink_server_bind_method(s, "io.systemd.Statistics.Get", vl_method_get_statistics);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to register varlink methods: %m");
+
+        r = varlink_server_listen_address(s, VARLINK_ADDR_PATH_UDEV, 0600);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to bind to varlink socket: %m");
+
+        r = varlink_server_attach_event(s, manager->event, SD_EVENT_PRIORITY_NORMAL);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to attach varlink connection to event loop: %m");
+
+        manager->varlink_server = TAKE_PTR(s);
+        return 0;
+}
+
 static int main_loop(Manager *manager) {
         int fd_worker, r;
 
@@ -2010,9 +2168,12 @@ static int main_loop(Manager *manager) {
         if (r < 0)
                 return log_error_errno(r, "Failed to create post event source: %m");
 
+        /* Statistics are only a debugging aid, hence don't fail if we can't provide them */
+        (void) manager_open_varlink(manager);
+
         udev_builtin_init();
 
-        r = udev_rules_load(&manager->rules, arg_resolve_name_timing);
+        r = udev_rules_load_cached(&manager->rules, arg_resolve_name_timing);
         if (!manager->rules)
                 return log_error_errno(r, "Failed to read udev rules: %m");
 
@@ -4,6 +4,7 @@
 
 #include "sd-daemon.h"
 
+#include "event-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "mkdir.h"
@@ -13,11 +14,13 @@
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "umask-util.h"
+#include "userdb-cache.h"
 #include "userdbd-manager.h"
 
 #define LISTEN_TIMEOUT_USEC (25 * USEC_PER_SEC)
 
 static int start_workers(Manager *m, bool explicit_request);
+static int manager_schedule_cache(Manager *m, usec_t delay);
 
 static int on_sigchld(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
         Manager *m = userdata;
@@ -39,6 +42,16 @@ static int on_sigchld(sd_event_source *s, const struct signalfd_siginfo *si, voi
                 if (siginfo.si_pid == 0)
                         break;
 
+                if (m->cache_pid > 0 && siginfo.si_pid == m->cache_pid) {
+                        m->cache_pid = 0;
+
+                        if (siginfo.si_code != CLD_EXITED || siginfo.si_status != EXIT_SUCCESS)
+                                log_warning("Failed to publish user and group record cache, ignoring.");
+
+                        (void) manager_schedule_cache(m, USERDB_CACHE_REFRESH_USEC);
+                        continue;
+                }
+
                 if (set_remove(m->workers_dynamic, PID_TO_PTR(siginfo.si_pid)))
                         removed = true;
                 if (set_remove(m->workers_fixed, PID_TO_PTR(siginfo.si_pid)))
@@ -76,6 +89,46 @@ static int on_sigusr2(sd_event_source *s, const struct signalfd_siginfo *si, voi
         return 0;
 }
 
+static int on_cache_timer(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = ASSERT_PTR(userdata);
+        pid_t pid;
+        int r;
+
+        if (m->cache_pid > 0) /* Still busy, the next run is scheduled once it's done */
+                return 0;
+
+        /* Enumerating all records means blocking Varlink calls to all services, let's do that in a child,
+         * so that we can keep on managing the workers meanwhile. */
+        r = safe_fork("(sd-cache)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_CLOSE_ALL_FDS|FORK_REOPEN_LOG|FORK_LOG, &pid);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to fork off child to publish user and group record cache, ignoring: %m");
+                return manager_schedule_cache(m, USERDB_CACHE_REFRESH_USEC);
+        }
+        if (r == 0) {
+                /* Child */
+                r = userdb_cache_publish(USERDB_CACHE_PATH);
+                _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        m->cache_pid = pid;
+        return 0;
+}
+
+static int manager_schedule_cache(Manager *m, usec_t delay) {
+        int r;
+
+        assert(m);
+
+        r = event_reset_time_relative(m->event, &m->cache_event_source, CLOCK_MONOTONIC,
+                                      delay, USEC_PER_SEC,
+                                      on_cache_timer, m,
+                                      SD_EVENT_PRIORITY_IDLE, "userdb-cache", /* force_reset= */ true);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to schedule publishing of user and group record cache, ignoring: %m");
+
+        return 0;
+}
+
 int manager_new(Manager **ret) {
         _cleanup_(manager_freep) Manager *m = NULL;
         int r;
@@ -133,6 +186,7 @@ Manager* manager_free(Manager *m) {
 
         sd_event_source_disable_unref(m->sigusr2_event_source);
         sd_event_source_disable_unref(m->sigchld_event_source);
+        sd_event_source_disable_unref(m->cache_event_source);
 
         sd_event_unref(m->event);
 
@@ -302,5 +356,7 @@ int manager_startup(Manager *m) {
         if (setsockopt(m->listen_fd, SOL_SOCKET, SO_RCVTIMEO, TIMEVAL_STORE(LISTEN_TIMEOUT_USEC), sizeof(struct timeval)) < 0)
                 return log_error_errno(errno, "Failed to se SO_RCVTIMEO: %m");
 
+        (void) manager_schedule_cache(m, 0);
+
         return start_workers(m, false);
 }
@@ -21,6 +21,9 @@ struct Manager {
 
         sd_event_source *sigusr2_event_source;
         sd_event_source *sigchld_event_source;
+        sd_event_source *cache_event_source;
+
+        pid_t cache_pid;       /* Child currently publishing the record cache, see userdb-cache.h */
 
         int listen_fd;
 
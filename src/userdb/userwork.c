@@ -7,7 +7,9 @@
 
 #include "env-util.h"
 #include "fd-util.h"
+#include "format-util.h"
 #include "group-record.h"
+#include "hashmap.h"
 #include "io-util.h"
 #include "main-func.h"
 #include "process-util.h"
@@ -24,6 +26,8 @@
 #define PRESSURE_SLEEP_TIME_USEC (50 * USEC_PER_MSEC)
 #define CONNECTION_IDLE_USEC (15 * USEC_PER_SEC)
 #define LISTEN_IDLE_USEC (90 * USEC_PER_SEC)
+#define NEGATIVE_CACHE_USEC (2 * USEC_PER_SEC)
+#define NEGATIVE_CACHE_ENTRIES_MAX 4096U
 
 typedef struct LookupParameters {
         const char *user_name;
@@ -35,6 +39,68 @@ typedef struct LookupParameters {
         const char *service;
 } LookupParameters;
 
+/* Lookups of records that don't exist are frequent, and need a reply from every single service before we
+ * know. Hence remember for a short while which ones we already looked up in vain via the multiplexer. */
+typedef struct NegativeCacheEntry {
+        usec_t until;
+        char key[];
+} NegativeCacheEntry;
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(negative_cache_hash_ops, char, string_hash_func, string_compare_func,
+                                              NegativeCacheEntry, free);
+
+static Hashmap *negative_cache = NULL;
+
+static char* negative_cache_key(const char *method, const char *name, uid_t id) {
+        char *k;
+
+        /* Follows the order of precedence of the lookups below: numeric IDs first */
+        if (!uid_is_valid(id))
+                return strjoin(method, ":", name);
+
+        if (asprintf(&k, "%s#" UID_FMT, method, id) < 0)
+                return NULL;
+
+        return k;
+}
+
+static bool negative_cache_test(const char *key) {
+        NegativeCacheEntry *e;
+
+        e = hashmap_get(negative_cache, key);
+        if (!e)
+                return false;
+
+        if (now(CLOCK_MONOTONIC) < e->until)
+                return true;
+
+        free(hashmap_remove(negative_cache, key));
+        return false;
+}
+
+static void negative_cache_add(const char *key) {
+        NegativeCacheEntry *e;
+        size_t l;
+
+        if (!key)
+                return;
+
+        /* Entries are short-lived anyway, hence simply start over when we have too many */
+        if (hashmap_size(negative_cache) >= NEGATIVE_CACHE_ENTRIES_MAX)
+                hashmap_clear(negative_cache);
+
+        l = strlen(key);
+        e = malloc(offsetof(NegativeCacheEntry, key) + l + 1);
+        if (!e)
+                return;
+
+        e->until = usec_add(now(CLOCK_MONOTONIC), NEGATIVE_CACHE_USEC);
+        memcpy(e->key, key, l + 1);
+
+        if (hashmap_ensure_put(&negative_cache, &negative_cache_hash_ops, e->key, e) < 0)
+                free(e);
+}
+
 static int add_nss_service(JsonVariant **v) {
         _cleanup_(json_variant_unrefp) JsonVariant *status = NULL, *z = NULL;
         sd_id128_t mid;
@@ -139,6 +205,7 @@ static int vl_method_get_user_record(Varlink *link, JsonVariant *parameters, Var
 
         _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
         _cleanup_(user_record_unrefp) UserRecord *hr = NULL;
+        _cleanup_free_ char *cache_key = NULL;
         LookupParameters p = {
                 .uid = UID_INVALID,
         };
@@ -156,6 +223,13 @@ static int vl_method_get_user_record(Varlink *link, JsonVariant *parameters, Var
                      * we are done'; == 0 means 'not processed, caller should process now' */
                 return r;
 
+        /* Only cache what we looked up via all services, NSS and drop-ins are local and quick anyway */
+        if (userdb_flags == USERDB_AVOID_MULTIPLEXER && (uid_is_valid(p.uid) || p.user_name)) {
+                cache_key = negative_cache_key("user", p.user_name, p.uid);
+                if (cache_key && negative_cache_test(cache_key))
+                        return varlink_error(link, "io.systemd.UserDatabase.NoRecordFound", NULL);
+        }
+
         if (uid_is_valid(p.uid))
                 r = userdb_by_uid(p.uid, userdb_flags, &hr);
         else if (p.user_name)
@@ -203,8 +277,10 @@ static int vl_method_get_user_record(Varlink *link, JsonVariant *parameters, Var
 
                 return varlink_reply(link, last);
         }
-        if (r == -ESRCH)
+        if (r == -ESRCH) {
+                negative_cache_add(cache_key);
                 return varlink_error(link, "io.systemd.UserDatabase.NoRecordFound", NULL);
+        }
         if (r < 0) {
                 log_debug_errno(r, "User lookup failed abnormally: %m");
                 return varlink_error(link, "io.systemd.UserDatabase.ServiceNotAvailable", NULL);
@@ -275,6 +351,7 @@ static int vl_method_get_group_record(Varlink *link, JsonVariant *parameters, Va
 
         _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
         _cleanup_(group_record_unrefp) GroupRecord *g = NULL;
+        _cleanup_free_ char *cache_key = NULL;
         LookupParameters p = {
                 .gid = GID_INVALID,
         };
@@ -291,6 +368,12 @@ static int vl_method_get_group_record(Varlink *link, JsonVariant *parameters, Va
         if (r != 0)
                 return r;
 
+        if (userdb_flags == USERDB_AVOID_MULTIPLEXER && (gid_is_valid(p.gid) || p.group_name)) {
+                cache_key = negative_cache_key("group", p.group_name, p.gid);
+                if (cache_key && negative_cache_test(cache_key))
+                        return varlink_error(link, "io.systemd.UserDatabase.NoRecordFound", NULL);
+        }
+
         if (gid_is_valid(p.gid))
                 r = groupdb_by_gid(p.gid, userdb_flags, &g);
         else if (p.group_name)
@@ -332,8 +415,10 @@ static int vl_method_get_group_record(Varlink *link, JsonVariant *parameters, Va
 
                 return varlink_reply(link, last);
         }
-        if (r == -ESRCH)
+        if (r == -ESRCH) {
+                negative_cache_add(cache_key);
                 return varlink_error(link, "io.systemd.UserDatabase.NoRecordFound", NULL);
+        }
         if (r < 0) {
                 log_debug_errno(r, "Group lookup failed abnormally: %m");
                 return varlink_error(link, "io.systemd.UserDatabase.ServiceNotAvailable", NULL);
@@ -500,6 +585,12 @@ static int run(int argc, char *argv[]) {
         if (r < 0)
                 return log_error_errno(r, "Failed to disable userdb NSS compatibility: %m");
 
+        /* We keep doing lookups on the same services over and over again, hence keep the connections to
+         * them around, rather than connecting anew for every single lookup */
+        r = userdb_enable_connection_pool();
+        if (r < 0)
+                return log_error_errno(r, "Failed to set up connection pool: %m");
+
         start_time = now(CLOCK_MONOTONIC);
 
         for (;;) {
@@ -564,6 +655,9 @@ static int run(int argc, char *argv[]) {
                 last_busy_usec = USEC_INFINITY;
         }
 
+        userdb_disable_connection_pool();
+        hashmap_free(negative_cache);
+
         return 0;
 }
 
@@ -40,6 +40,14 @@ if [ ! -e "$D/etc/udev/hwdb.bin" ]; then
     exit 1
 fi
 
+# Test that an up-to-date database is not rebuilt
+inode="$(stat -c %i "$D/etc/udev/hwdb.bin")"
+"$SYSTEMD_HWDB" update --root "$D"
+if [ "$(stat -c %i "$D/etc/udev/hwdb.bin")" != "$inode" ]; then
+    echo "$D/etc/udev/hwdb.bin was rebuilt although the sources did not change"
+    exit 1
+fi
+
 # Test "bad" properties" — warnings required, errors not allowed
 rm -f "$D/etc/udev/hwdb.bin" "$D/etc/udev/hwdb.d"
 
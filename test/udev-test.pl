@@ -1892,6 +1892,33 @@ KERNEL=="sda1", SYMLINK+="", LABEL="NO"
 KERNEL=="sda1", SYMLINK+="right", LABEL="TEST", GOTO="end"
 KERNEL=="sda1", SYMLINK+="wrong2", LABEL="BAD"
 LABEL="end"
+EOF
+        },
+        {
+                desc            => "skipping lines by ACTION, SUBSYSTEM and KERNEL prefix",
+                devices => [
+                        {
+                                devpath         => "/devices/pci0000:00/0000:00:1f.2/host0/target0:0:0/0:0:0:0/block/sda/sda1",
+                                exp_links       => ["right", "right2", "right3", "right4"],
+                                not_exp_links   => ["wrong", "wrong2", "wrong3", "wrong4", "wrong5"],
+                        }],
+                rules           => <<EOF
+SUBSYSTEM=="net", GOTO="BAD"
+KERNEL=="sdb*", GOTO="BAD"
+ACTION=="remove", GOTO="BAD"
+ACTION!="add", GOTO="BAD"
+SUBSYSTEM=="block", KERNEL=="sda[0-9]", SYMLINK+="right"
+SUBSYSTEM=="block|net", KERNEL=="sd?1", SYMLINK+="right2"
+SUBSYSTEM!="net", KERNEL=="sd", SYMLINK+="wrong"
+KERNEL=="sda1", GOTO="TEST"
+SUBSYSTEM=="block", SYMLINK+="wrong2"
+LABEL="BAD"
+SYMLINK+="wrong3"
+LABEL="TEST"
+ACTION=="add|change", KERNEL=="?da1", SYMLINK+="right3"
+ACTION=="change", SYMLINK+="wrong4"
+SUBSYSTEM=="tty", SYMLINK+="wrong5"
+KERNEL=="sda1", KERNEL=="sd*", SUBSYSTEM=="block", SUBSYSTEM!="net", SYMLINK+="right4"
 EOF
         },
         {
@@ -77,6 +77,20 @@ grep -q '^PRIORITY=6$' /output
 grep '^FOO=' /output && { echo 'unexpected success'; exit 1; }
 grep '^SYSLOG_FACILITY=' /output && { echo 'unexpected success'; exit 1; }
 
+# --output-threads= does not change the output
+journalctl -b -o export -t "$ID" >/expected
+journalctl -b -o export -t "$ID" --output-threads=2 >/output
+cmp /expected /output
+journalctl -b -o json -t "$ID" --output-fields=MESSAGE,PRIORITY >/expected
+journalctl -b -o json -t "$ID" --output-fields=MESSAGE,PRIORITY --output-threads=2 >/output
+cmp /expected /output
+
+# -o export-columnar starts with the header frame, and includes the selected fields
+journalctl -b -o export-columnar -t "$ID" --output-fields=MESSAGE >/output
+[[ "$(head -c 10 /output)" == $'H\x08SDJCOL01' ]]
+grep -q MESSAGE /output
+grep PRIORITY /output && { echo 'unexpected success'; exit 1; }
+
 # `-b all` negates earlier use of -b (-b and -m are otherwise exclusive)
 journalctl -b -1 -b all -m >/dev/null
 